@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The DogeCash Developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+'''
+Script to generate the list of invalid outpoints for invalid.cpp.
+
+It expects a JSON file with an array of {"txid": <hex>, "n": <index>} objects,
+like contrib/devtools/invalid_outpoints.json, and writes a header with the
+outpoints in binary format, sorted in the order of COutPoint::operator<:
+
+    contrib/devtools/gen-invalid-outpoints.py contrib/devtools/invalid_outpoints.json > src/invalid_outpoints.h
+'''
+
+import json
+import sys
+
+def main():
+    if len(sys.argv) != 2:
+        print('Usage: %s <invalid_outpoints.json>' % sys.argv[0], file=sys.stderr)
+        sys.exit(1)
+
+    with open(sys.argv[1], 'r', encoding='utf8') as f:
+        entries = json.load(f)
+
+    outpoints = set()
+    for entry in entries:
+        txid = bytes.fromhex(entry['txid'])
+        n = int(entry['n'])
+        if len(txid) != 32 or txid == bytes(32) or not 0 <= n < 2**32:
+            raise ValueError('invalid outpoint %s' % entry)
+        outpoints.add((txid, n))
+
+    g = sys.stdout
+    g.write('#ifndef DOGEC_INVALID_OUTPOINTS_H\n')
+    g.write('#define DOGEC_INVALID_OUTPOINTS_H\n')
+    g.write('/**\n')
+    g.write(' * List of the invalid outpoints, that are banned from the chain\n')
+    g.write(' * AUTOGENERATED by contrib/devtools/gen-invalid-outpoints.py\n')
+    g.write(' *\n')
+    g.write(' * Each line contains the 32 bytes of a txid, as they are in a uint256, and an\n')
+    g.write(' * output index. The lines are sorted like COutPoints, so that they can be\n')
+    g.write(' * binary searched.\n')
+    g.write(' */\n')
+    g.write('static constexpr InvalidOutPoint invalidOutPoints[] = {\n')
+    # uint256 compares as a number, the hex string, but holds its bytes in reverse order
+    for (txid, n) in sorted(outpoints):
+        g.write('    {{%s}, %d},\n' % (','.join('0x%02x' % b for b in txid[::-1]), n))
+    g.write('};\n')
+    g.write('#endif // DOGEC_INVALID_OUTPOINTS_H\n')
+
+if __name__ == '__main__':
+    main()
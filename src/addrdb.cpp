@@ -129,6 +129,8 @@ bool CAddrDB::Write(const CAddrMan& addr)
 
     // serialize addresses, checksum data up to that point, then append csum
     CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    // an address takes about 64 bytes, and 4 more per reference in the new table
+    ssPeers.reserve(addr.size() * 72);
     ssPeers << FLATDATA(Params().MessageStart());
     ssPeers << addr;
     uint256 hash = Hash(ssPeers.begin(), ssPeers.end());
@@ -168,25 +170,24 @@ bool CAddrDB::Read(CAddrMan& addr)
 
     // use file size to size memory buffer
     uint64_t fileSize = fs::file_size(pathAddr);
-    uint64_t dataSize = fileSize - sizeof(uint256);
+    uint64_t dataSize = 0;
     // Don't try to resize to a negative number if file is small
     if (fileSize >= sizeof(uint256))
         dataSize = fileSize - sizeof(uint256);
-    std::vector<unsigned char> vchData;
-    vchData.resize(dataSize);
+    // read straight into the stream, without a copy of the whole file
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers.resize(dataSize);
     uint256 hashIn;
 
     // read data and checksum from file
     try {
-        filein.read((char*)&vchData[0], dataSize);
+        filein.read(ssPeers.data(), dataSize);
         filein >> hashIn;
     } catch (const std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
     filein.fclose();
 
-    CDataStream ssPeers(vchData, SER_DISK, CLIENT_VERSION);
-
     // verify stored checksum matches input data
     uint256 hashTmp = Hash(ssPeers.begin(), ssPeers.end());
     if (hashIn != hashTmp)
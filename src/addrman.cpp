@@ -12,6 +12,8 @@
 #include "serialize.h"
 #include "streams.h"
 
+#include <unordered_map>
+
 
 int CAddrInfo::GetTriedBucket(const uint256& nKey) const
 {
@@ -396,6 +398,71 @@ CAddrInfo CAddrMan::Select_(bool newOnly)
     }
 }
 
+std::shared_ptr<const CAddrManSnapshot> CAddrMan::MakeSnapshot_() const
+{
+    std::shared_ptr<CAddrManSnapshot> snap = std::make_shared<CAddrManSnapshot>();
+    snap->nEpoch = nEpoch;
+    snap->nTimeTaken = GetTime();
+
+    std::unordered_map<int, uint32_t> mapIndex(mapInfo.size());
+    snap->vInfo.reserve(mapInfo.size());
+    for (const auto& entry : mapInfo) {
+        mapIndex.emplace(entry.first, snap->vInfo.size());
+        snap->vInfo.push_back(entry.second);
+    }
+
+    snap->vTriedPos.reserve(nTried);
+    for (int n = 0; n < ADDRMAN_TRIED_BUCKET_COUNT; n++) {
+        for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+            if (vvTried[n][i] != -1)
+                snap->vTriedPos.push_back(mapIndex.at(vvTried[n][i]));
+        }
+    }
+    snap->vNewPos.reserve(nNew);
+    for (int n = 0; n < ADDRMAN_NEW_BUCKET_COUNT; n++) {
+        for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+            if (vvNew[n][i] != -1)
+                snap->vNewPos.push_back(mapIndex.at(vvNew[n][i]));
+        }
+    }
+    return snap;
+}
+
+CAddrInfo CAddrMan::SelectFromSnapshot(bool newOnly)
+{
+    auto fStale = [this](const std::shared_ptr<const CAddrManSnapshot>& s) {
+        return !s || (s->nEpoch != nEpoch &&
+                      (s->vInfo.size() < ADDRMAN_SNAPSHOT_MIN_SIZE || GetTime() - s->nTimeTaken >= ADDRMAN_SNAPSHOT_MAX_AGE));
+    };
+
+    std::shared_ptr<const CAddrManSnapshot> snap = std::atomic_load(&snapshot);
+    if (fStale(snap)) {
+        LOCK(cs);
+        // another thread may have taken it while we waited for the lock
+        snap = std::atomic_load(&snapshot);
+        if (fStale(snap)) {
+            snap = MakeSnapshot_();
+            std::atomic_store(&snapshot, snap);
+        }
+    }
+
+    // The bucket positions are drawn as in Select_, with the same chance factor
+    FastRandomContext rng;
+    const bool fTried = !newOnly && !snap->vTriedPos.empty() && (snap->vNewPos.empty() || rng.randbool());
+    const std::vector<uint32_t>& vPos = fTried ? snap->vTriedPos : snap->vNewPos;
+    if (vPos.empty())
+        return CAddrInfo();
+
+    const int64_t nNow = GetAdjustedTime();
+    double fChanceFactor = 1.0;
+    while (1) {
+        const CAddrInfo& info = snap->vInfo[vPos[rng.randrange(vPos.size())]];
+        if (rng.randbits(30) < fChanceFactor * info.GetChance(nNow) * (1 << 30))
+            return info;
+        fChanceFactor *= 1.2;
+    }
+}
+
 #ifdef DEBUG_ADDRMAN
 int CAddrMan::Check_()
 {
@@ -9,6 +9,7 @@
 #ifndef BITCOIN_ADDRMAN_H
 #define BITCOIN_ADDRMAN_H
 
+#include "memusage.h"
 #include "netaddress.h"
 #include "protocol.h"
 #include "random.h"
@@ -16,7 +17,9 @@
 #include "timedata.h"
 #include "util.h"
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <vector>
@@ -184,6 +187,31 @@ public:
 //! the maximum number of tried addr collisions to store
 #define ADDRMAN_SET_TRIED_COLLISION_SIZE 10
 
+//! once the tables changed, how old (in seconds) the snapshot read by SelectFromSnapshot can get
+#define ADDRMAN_SNAPSHOT_MAX_AGE 10
+
+//! below this number of addresses, the snapshot is taken again at every change of the tables
+#define ADDRMAN_SNAPSHOT_MIN_SIZE 1000
+
+/**
+ * A copy of the tables of the address manager at some epoch. The connection
+ * threads select their candidates from it without taking the lock of the
+ * address manager, which the addr messages keep busy on large tables.
+ */
+struct CAddrManSnapshot
+{
+    //! the epoch of the tables copied, and when (in seconds)
+    uint64_t nEpoch;
+    int64_t nTimeTaken;
+
+    //! the addresses
+    std::vector<CAddrInfo> vInfo;
+
+    //! the index in vInfo of each occupied position of the tried and new buckets
+    std::vector<uint32_t> vTriedPos;
+    std::vector<uint32_t> vNewPos;
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -223,6 +251,12 @@ private:
     //! Holds addrs inserted into tried table that collide with existing entries. Test-before-evict discpline used to resolve these collisions.
     std::set<int> m_tried_collisions;
 
+    //! incremented by the changes of the tables that matter to the selection
+    std::atomic<uint64_t> nEpoch{0};
+
+    //! read by SelectFromSnapshot, only through std::atomic_load and std::atomic_store
+    std::shared_ptr<const CAddrManSnapshot> snapshot;
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -261,6 +295,9 @@ protected:
     //! Select an address to connect to, if newOnly is set to true, only the new table is selected from.
     CAddrInfo Select_(bool newOnly);
 
+    //! Copy the tables for SelectFromSnapshot.
+    std::shared_ptr<const CAddrManSnapshot> MakeSnapshot_() const;
+
     //! See if any to-be-evicted tried table entries have been tested and if so resolve the collisions.
     void ResolveCollisions_();
 
@@ -328,10 +365,11 @@ public:
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
-        std::map<int, int> mapUnkIds;
+        // the ids are below nIdCount, a vector is much faster than a map on large tables
+        std::vector<int> vUnkIds(nIdCount, -1);
         int nIds = 0;
         for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); it++) {
-            mapUnkIds[(*it).first] = nIds;
+            vUnkIds[(*it).first] = nIds;
             const CAddrInfo& info = (*it).second;
             if (info.nRefCount) {
                 assert(nIds != nNew); // this means nNew was wrong, oh ow
@@ -357,7 +395,7 @@ public:
             s << nSize;
             for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
                 if (vvNew[bucket][i] != -1) {
-                    int nIndex = mapUnkIds[vvNew[bucket][i]];
+                    int nIndex = vUnkIds[vvNew[bucket][i]];
                     s << nIndex;
                 }
             }
@@ -385,9 +423,15 @@ public:
             nUBuckets ^= (1 << 30);
         }
 
-        // Deserialize entries from the new table.
+        if (nNew < 0 || nTried < 0) {
+            throw std::ios_base::failure("Corrupt CAddrMan serialization, negative table size");
+        }
+        vRandom.reserve(nNew + nTried);
+
+        // Deserialize entries from the new table. The ids are increasing, so
+        // that they are inserted at the end of mapInfo.
         for (int n = 0; n < nNew; n++) {
-            CAddrInfo& info = mapInfo[n];
+            CAddrInfo& info = mapInfo.emplace_hint(mapInfo.end(), n, CAddrInfo())->second;
             s >> info;
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
@@ -416,8 +460,8 @@ public:
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
                 vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
+                mapInfo.emplace_hint(mapInfo.end(), nIdCount, std::move(info));
                 vvTried[nKBucket][nKBucketPos] = nIdCount;
                 nIdCount++;
             } else {
@@ -466,6 +510,8 @@ public:
     void Clear()
     {
         LOCK(cs);
+        nEpoch++;
+        std::atomic_store(&snapshot, std::shared_ptr<const CAddrManSnapshot>());
         std::vector<int>().swap(vRandom);
         nKey = GetRandHash();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
@@ -504,6 +550,14 @@ public:
         return vRandom.size();
     }
 
+    //! Memory used by the address tables (the buckets are fixed size arrays)
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return memusage::DynamicUsage(mapInfo) + memusage::DynamicUsage(mapAddr) +
+               memusage::DynamicUsage(vRandom) + memusage::DynamicUsage(m_tried_collisions);
+    }
+
     //! Consistency check
     void Check()
     {
@@ -525,8 +579,10 @@ public:
         Check();
         fRet |= Add_(addr, source, nTimePenalty);
         Check();
-        if (fRet)
+        if (fRet) {
+            nEpoch++;
             LogPrint(BCLog::ADDRMAN, "Added %s from %s: %i tried, %i new\n", addr.ToStringIPPort(), source.ToString(), nTried, nNew);
+        }
         return fRet;
     }
 
@@ -539,8 +595,10 @@ public:
         for (std::vector<CAddress>::const_iterator it = vAddr.begin(); it != vAddr.end(); it++)
             nAdd += Add_(*it, source, nTimePenalty) ? 1 : 0;
         Check();
-        if (nAdd)
+        if (nAdd) {
+            nEpoch++;
             LogPrint(BCLog::ADDRMAN, "Added %i addresses from %s: %i tried, %i new\n", nAdd, source.ToString(), nTried, nNew);
+        }
         return nAdd > 0;
     }
 
@@ -550,6 +608,7 @@ public:
         LOCK(cs);
         Check();
         Good_(addr, test_before_evict, nTime);
+        nEpoch++;
         Check();
     }
 
@@ -559,6 +618,7 @@ public:
         LOCK(cs);
         Check();
         Attempt_(addr, fCountFailure, nTime);
+        nEpoch++;
         Check();
     }
 
@@ -568,6 +628,7 @@ public:
         LOCK(cs);
         Check();
         ResolveCollisions_();
+        nEpoch++;
         Check();
     }
 
@@ -600,6 +661,13 @@ public:
         return addrRet;
     }
 
+    /**
+     * Choose an address to connect to as Select does, from a snapshot of the
+     * tables instead, without taking the lock unless the snapshot is stale.
+     * The snapshot can lag the changes by ADDRMAN_SNAPSHOT_MAX_AGE seconds.
+     */
+    CAddrInfo SelectFromSnapshot(bool newOnly = false);
+
     //! Return a bunch of addresses, selected at random.
     std::vector<CAddress> GetAddr()
     {
@@ -627,6 +695,7 @@ public:
         LOCK(cs);
         Check();
         SetServices_(addr, nServices);
+        nEpoch++;
         Check();
     }
 };
@@ -283,6 +283,9 @@ public:
         return pn[0] | (uint64_t)pn[1] << 32;
     }
 
+    //! Serialized as its memory, the vectors of integers are too (see is_memory_serialized)
+    typedef base_uint memory_serialized_type;
+
     template<typename Stream>
     void Serialize(Stream& s) const
     {
@@ -0,0 +1,136 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "banlist.h"
+
+/** Bit n of the address, from the most significant one of its first byte */
+static inline int AddressBit(const CNetAddr& addr, int n)
+{
+    return (addr.GetByte(15 - (n >> 3)) >> (7 - (n & 7))) & 1;
+}
+
+bool CBanList::Add(const CSubNet& subNet, const CBanEntry& banEntry)
+{
+    auto it = mapBanned.find(subNet);
+    if (it != mapBanned.end()) {
+        if (it->second.nBanUntil >= banEntry.nBanUntil)
+            return false;
+        Unindex(subNet, it->second.nBanUntil);
+        it->second = banEntry;
+    } else {
+        mapBanned.emplace(subNet, banEntry);
+    }
+    Index(subNet, banEntry.nBanUntil);
+    return true;
+}
+
+bool CBanList::Remove(const CSubNet& subNet)
+{
+    auto it = mapBanned.find(subNet);
+    if (it == mapBanned.end())
+        return false;
+    Unindex(subNet, it->second.nBanUntil);
+    mapBanned.erase(it);
+    return true;
+}
+
+void CBanList::Clear()
+{
+    mapBanned.clear();
+    root.children[0].reset();
+    root.children[1].reset();
+    root.nBanUntil = 0;
+    setIrregular.clear();
+    setExpiry.clear();
+}
+
+void CBanList::Set(const banmap_t& banMap)
+{
+    Clear();
+    for (const auto& it : banMap)
+        Add(it.first, it.second);
+}
+
+bool CBanList::IsBanned(const CNetAddr& addr, int64_t nNow) const
+{
+    if (!addr.IsValid())
+        return false;
+    // The subnets containing the address are the prefixes along its path
+    const Node* node = &root;
+    for (int n = 0; node; n++) {
+        if (nNow < node->nBanUntil)
+            return true;
+        if (n == 128)
+            break;
+        node = node->children[AddressBit(addr, n)].get();
+    }
+    for (const CSubNet& subNet : setIrregular) {
+        if (subNet.Match(addr) && nNow < mapBanned.at(subNet).nBanUntil)
+            return true;
+    }
+    return false;
+}
+
+bool CBanList::IsBanned(const CSubNet& subNet, int64_t nNow) const
+{
+    auto it = mapBanned.find(subNet);
+    return it != mapBanned.end() && nNow < it->second.nBanUntil;
+}
+
+std::vector<CSubNet> CBanList::Sweep(int64_t nNow)
+{
+    std::vector<CSubNet> vRemoved;
+    while (!setExpiry.empty() && setExpiry.begin()->first < nNow) {
+        const CSubNet subNet = setExpiry.begin()->second;
+        Remove(subNet);
+        vRemoved.push_back(subNet);
+    }
+    return vRemoved;
+}
+
+void CBanList::Index(const CSubNet& subNet, int64_t nBanUntil)
+{
+    setExpiry.emplace(nBanUntil, subNet);
+    // An invalid subnet matches nothing
+    if (!subNet.IsValid())
+        return;
+    const int nPrefixLength = subNet.GetPrefixLength();
+    if (nPrefixLength < 0) {
+        setIrregular.insert(subNet);
+        return;
+    }
+    Node* node = &root;
+    for (int n = 0; n < nPrefixLength; n++) {
+        std::unique_ptr<Node>& child = node->children[AddressBit(subNet.GetBase(), n)];
+        if (!child)
+            child.reset(new Node());
+        node = child.get();
+    }
+    node->nBanUntil = nBanUntil;
+}
+
+void CBanList::Unindex(const CSubNet& subNet, int64_t nBanUntil)
+{
+    setExpiry.erase(std::make_pair(nBanUntil, subNet));
+    if (!subNet.IsValid())
+        return;
+    const int nPrefixLength = subNet.GetPrefixLength();
+    if (nPrefixLength < 0) {
+        setIrregular.erase(subNet);
+        return;
+    }
+    std::vector<Node*> vPath{&root};
+    for (int n = 0; n < nPrefixLength && vPath.back(); n++)
+        vPath.push_back(vPath.back()->children[AddressBit(subNet.GetBase(), n)].get());
+    if (!vPath.back())
+        return;
+    vPath.back()->nBanUntil = 0;
+    // Prune the branch the subnet was the last ban of
+    for (int n = nPrefixLength; n > 0; n--) {
+        const Node* node = vPath[n];
+        if (node->nBanUntil != 0 || node->children[0] || node->children[1])
+            break;
+        vPath[n - 1]->children[AddressBit(subNet.GetBase(), n - 1)].reset();
+    }
+}
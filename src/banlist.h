@@ -0,0 +1,64 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BANLIST_H
+#define BITCOIN_BANLIST_H
+
+#include "addrdb.h"
+#include "netaddress.h"
+
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+/**
+ * The banned subnets, indexed for the check of every connection.
+ *
+ * The subnets are in a binary trie over the 128 bits of the addresses (IPv4
+ * and onion ones are mapped in the IPv6 space, so the three networks share
+ * it): whether an address is banned takes at most 128 steps, whatever the
+ * number of bans. The bans are also ordered by expiry time, so that a sweep
+ * visits the expired ones only.
+ * The subnets of a netmask other than a prefix one (a.b.c.d/255.0.255.0)
+ * can't be in the trie, and are matched one by one.
+ */
+class CBanList
+{
+public:
+    //! Ban the subnet until banEntry.nBanUntil, unless it is banned for longer already.
+    //! Returns whether the ban list changed.
+    bool Add(const CSubNet& subNet, const CBanEntry& banEntry);
+    //! Returns false if the subnet wasn't banned
+    bool Remove(const CSubNet& subNet);
+    void Clear();
+    void Set(const banmap_t& banMap);
+    const banmap_t& GetMap() const { return mapBanned; }
+    size_t size() const { return mapBanned.size(); }
+
+    //! Whether a subnet banned until after nNow contains the address
+    bool IsBanned(const CNetAddr& addr, int64_t nNow) const;
+    //! Whether the subnet itself is banned until after nNow
+    bool IsBanned(const CSubNet& subNet, int64_t nNow) const;
+
+    //! Remove the bans expired before nNow, returns their subnets
+    std::vector<CSubNet> Sweep(int64_t nNow);
+
+private:
+    struct Node {
+        std::unique_ptr<Node> children[2];
+        //! The end of the ban of the subnet of this prefix, 0 if none
+        int64_t nBanUntil{0};
+    };
+
+    banmap_t mapBanned;
+    Node root;
+    std::set<CSubNet> setIrregular;
+    std::set<std::pair<int64_t, CSubNet> > setExpiry;
+
+    void Index(const CSubNet& subNet, int64_t nBanUntil);
+    void Unindex(const CSubNet& subNet, int64_t nBanUntil);
+};
+
+#endif // BITCOIN_BANLIST_H
@@ -6,9 +6,94 @@
 
 #include "perf.h"
 
+#include <univalue.h>
+
+#include <algorithm>
 #include <assert.h>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <regex>
+#include <sstream>
+
+namespace {
+
+template <typename T>
+T Median(std::vector<T> v)
+{
+    std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+    return v[v.size() / 2];
+}
+
+UniValue ResultToJSON(const benchmark::Result& result)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("name", result.name);
+    obj.pushKV("count", result.count);
+    obj.pushKV("min_ns", result.minNs);
+    obj.pushKV("median_ns", result.medianNs);
+    obj.pushKV("max_ns", result.maxNs);
+    obj.pushKV("average_ns", result.averageNs);
+    obj.pushKV("min_cycles", result.minCycles);
+    obj.pushKV("median_cycles", result.medianCycles);
+    obj.pushKV("max_cycles", result.maxCycles);
+    obj.pushKV("average_cycles", result.averageCycles);
+    return obj;
+}
+
+// The median times by benchmark name of the json output of a previous run
+bool ReadBaseline(const std::string& path, std::map<std::string, int64_t>& baseline)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "Error: cannot open the baseline " << path << "\n";
+        return false;
+    }
+    std::stringstream ss;
+    ss << file.rdbuf();
+    UniValue results;
+    if (!results.read(ss.str()) || !results.isArray()) {
+        std::cerr << "Error: the baseline " << path << " is not the json output of bench_dogecash\n";
+        return false;
+    }
+    for (size_t i = 0; i < results.size(); i++) {
+        const UniValue& name = find_value(results[i], "name");
+        const UniValue& median = find_value(results[i], "median_ns");
+        if (!name.isStr() || !median.isNum()) {
+            std::cerr << "Error: invalid result in the baseline " << path << "\n";
+            return false;
+        }
+        baseline[name.get_str()] = median.get_int64();
+    }
+    return true;
+}
+
+// Prints the change of each median against the baseline, returns false if
+// any of them slowed down beyond the threshold
+bool CompareToBaseline(const std::vector<benchmark::Result>& results, const std::map<std::string, int64_t>& baseline, double threshold)
+{
+    int nRegressions = 0;
+    std::cerr << "#Benchmark,baseline_median(ns),median(ns),change(%)\n";
+    for (const benchmark::Result& result : results) {
+        auto it = baseline.find(result.name);
+        if (it == baseline.end() || it->second <= 0) {
+            std::cerr << result.name << ",-," << result.medianNs << ",-\n";
+            continue;
+        }
+        const double change = 100.0 * (result.medianNs - it->second) / it->second;
+        const bool fRegression = change > threshold;
+        if (fRegression) nRegressions++;
+        std::cerr << result.name << "," << it->second << "," << result.medianNs << ","
+                  << std::fixed << std::setprecision(1) << change << (fRegression ? ",REGRESSION" : "") << "\n";
+        std::cerr.copyfmt(std::ios(nullptr));
+    }
+    if (nRegressions > 0) {
+        std::cerr << nRegressions << " benchmark(s) more than " << threshold << "% slower than the baseline\n";
+    }
+    return nRegressions == 0;
+}
+
+} // namespace
 
 benchmark::BenchRunner::BenchmarkMap &benchmark::BenchRunner::benchmarks() {
     static std::map<std::string, benchmark::BenchFunction> benchmarks_map;
@@ -20,21 +105,56 @@ benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction f
     benchmarks().emplace(name, func);
 }
 
-void
-benchmark::BenchRunner::RunAll(benchmark::duration elapsedTimeForOne)
+bool
+benchmark::BenchRunner::RunAll(const benchmark::Options& options)
 {
+    // read before running, not to find out it is missing after a long run
+    std::map<std::string, int64_t> baseline;
+    if (!options.compare.empty() && !ReadBaseline(options.compare, baseline)) {
+        return false;
+    }
+
     perf_init();
     if (std::ratio_less_equal<benchmark::clock::period, std::micro>::value) {
         std::cerr << "WARNING: Clock precision is worse than microsecond - benchmarks may be less accurate!\n";
     }
-    std::cout << "#Benchmark" << "," << "count" << "," << "min(ns)" << "," << "max(ns)" << "," << "average(ns)" << ","
-              << "min_cycles" << "," << "max_cycles" << "," << "average_cycles" << "\n";
+    const bool fJSON = options.printer == "json";
+    if (!fJSON) {
+        std::cout << "#Benchmark" << "," << "count" << "," << "min(ns)" << "," << "median(ns)" << "," << "max(ns)" << "," << "average(ns)" << ","
+                  << "min_cycles" << "," << "median_cycles" << "," << "max_cycles" << "," << "average_cycles" << "\n";
+    }
 
+    const std::regex reFilter(options.filter);
+    std::vector<Result> results;
     for (const auto &p: benchmarks()) {
-        State state(p.first, elapsedTimeForOne);
+        if (!std::regex_search(p.first, reFilter)) {
+            continue;
+        }
+        State state(p.first, options.elapsedTimeForOne);
         p.second(state);
+        const Result& result = state.GetResult();
+        if (!fJSON) {
+            // as they come, the whole run takes a while
+            std::cout << result.name << "," << result.count << "," << result.minNs << "," << result.medianNs << "," << result.maxNs << ","
+                      << result.averageNs << "," << result.minCycles << "," << result.medianCycles << "," << result.maxCycles << ","
+                      << result.averageCycles << std::endl;
+        }
+        results.push_back(result);
     }
     perf_fini();
+
+    if (fJSON) {
+        UniValue json(UniValue::VARR);
+        for (const Result& result : results) {
+            json.push_back(ResultToJSON(result));
+        }
+        std::cout << json.write(4) << "\n";
+    }
+
+    if (!options.compare.empty()) {
+        return CompareToBaseline(results, baseline, options.threshold);
+    }
+    return true;
 }
 
 bool benchmark::State::KeepRunning()
@@ -52,27 +172,21 @@ bool benchmark::State::KeepRunning()
     else {
         now = clock::now();
         auto elapsed = now - lastTime;
-        auto elapsedOne = elapsed / (countMask + 1);
-        if (elapsedOne < minTime) minTime = elapsedOne;
-        if (elapsedOne > maxTime) maxTime = elapsedOne;
-
         // We only use relative values, so don't have to handle 64-bit wrap-around specially
         nowCycles = perf_cpucycles();
-        uint64_t elapsedOneCycles = (nowCycles - lastCycles) / (countMask + 1);
-        if (elapsedOneCycles < minCycles) minCycles = elapsedOneCycles;
-        if (elapsedOneCycles > maxCycles) maxCycles = elapsedOneCycles;
 
         if (elapsed*128 < maxElapsed) {
           // If the execution was much too fast (1/128th of maxElapsed), increase the count mask by 8x and restart timing.
           // The restart avoids including the overhead of this code in the measurement.
           countMask = ((countMask<<3)|7) & ((1LL<<60)-1);
           count = 0;
-          minTime = duration::max();
-          maxTime = duration::zero();
-          minCycles = std::numeric_limits<uint64_t>::max();
-          maxCycles = std::numeric_limits<uint64_t>::min();
+          vTimes.clear();
+          vCycles.clear();
           return true;
         }
+        vTimes.push_back(elapsed / (countMask + 1));
+        vCycles.push_back((nowCycles - lastCycles) / (countMask + 1));
+
         if (elapsed*16 < maxElapsed) {
             uint64_t newCountMask = ((countMask<<1)|1) & ((1LL<<60)-1);
             if ((count & newCountMask)==0) {
@@ -89,17 +203,21 @@ bool benchmark::State::KeepRunning()
     --count;
 
     assert(count != 0 && "count == 0 => (now == 0 && beginTime == 0) => return above");
+    assert(!vTimes.empty());
 
-    // Output results
     // Duration casts are only necessary here because hardware with sub-nanosecond clocks
     // will lose precision.
-    int64_t min_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(minTime).count();
-    int64_t max_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(maxTime).count();
-    int64_t avg_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>((now-beginTime)/count).count();
-    int64_t averageCycles = (nowCycles-beginCycles)/count;
-    std::cout << std::fixed << std::setprecision(15) << name << "," << count << "," << min_elapsed << "," << max_elapsed << "," << avg_elapsed << ","
-              << minCycles << "," << maxCycles << "," << averageCycles << "\n";
-    std::cout.copyfmt(std::ios(nullptr));
+    auto toNs = [](duration d) { return (int64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count(); };
+    result.name = name;
+    result.count = count;
+    result.minNs = toNs(*std::min_element(vTimes.begin(), vTimes.end()));
+    result.medianNs = toNs(Median(vTimes));
+    result.maxNs = toNs(*std::max_element(vTimes.begin(), vTimes.end()));
+    result.averageNs = toNs((now - beginTime) / count);
+    result.minCycles = *std::min_element(vCycles.begin(), vCycles.end());
+    result.medianCycles = Median(vCycles);
+    result.maxCycles = *std::max_element(vCycles.begin(), vCycles.end());
+    result.averageCycles = (nowCycles - beginCycles) / count;
 
     return false;
 }
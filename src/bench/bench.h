@@ -10,6 +10,7 @@
 #include <limits>
 #include <map>
 #include <string>
+#include <vector>
 
 #include <boost/preprocessor/cat.hpp>
 #include <boost/preprocessor/stringize.hpp>
@@ -46,35 +47,55 @@ namespace benchmark {
     using time_point = clock::time_point;
     using duration = clock::duration;
 
+    // The timings of one benchmark, per iteration: the min, median and max
+    // are over the timed batches of iterations, the average over the run.
+    struct Result {
+        std::string name;
+        uint64_t count{0};
+        int64_t minNs{0}, medianNs{0}, maxNs{0}, averageNs{0};
+        uint64_t minCycles{0}, medianCycles{0}, maxCycles{0}, averageCycles{0};
+    };
+
     class State {
         std::string name;
         duration maxElapsed;
         time_point beginTime, lastTime;
-        duration minTime, maxTime;
         uint64_t count;
         uint64_t countMask;
         uint64_t beginCycles;
         uint64_t lastCycles;
-        uint64_t minCycles;
-        uint64_t maxCycles;
+        // the time and cycles per iteration of each timed batch
+        std::vector<duration> vTimes;
+        std::vector<uint64_t> vCycles;
+        Result result;
     public:
         State(std::string _name, duration _maxElapsed) :
             name(_name),
             maxElapsed(_maxElapsed),
-            minTime(duration::max()),
-            maxTime(duration::zero()),
             count(0),
             countMask(1),
             beginCycles(0),
-            lastCycles(0),
-            minCycles(std::numeric_limits<uint64_t>::max()),
-            maxCycles(std::numeric_limits<uint64_t>::min()) {
+            lastCycles(0) {
         }
         bool KeepRunning();
+        // Set once KeepRunning returned false
+        const Result& GetResult() const { return result; }
     };
 
     typedef std::function<void(State&)> BenchFunction;
 
+    struct Options {
+        duration elapsedTimeForOne{std::chrono::seconds(1)};
+        // only the benchmarks whose name matches this regex are run
+        std::string filter{".*"};
+        // "csv" or "json"
+        std::string printer{"csv"};
+        // the json output of a previous run, to compare the medians against
+        std::string compare;
+        // the slowdown of a median, in percent, reported as a regression
+        double threshold{10.0};
+    };
+
     class BenchRunner
     {
         typedef std::map<std::string, BenchFunction> BenchmarkMap;
@@ -83,7 +104,8 @@ namespace benchmark {
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(duration elapsedTimeForOne = std::chrono::seconds(1));
+        // Returns false if the baseline could not be read or a benchmark regressed.
+        static bool RunAll(const Options& options = Options());
     };
 }
 
@@ -7,17 +7,63 @@
 
 #include "bench.h"
 
+#include "crypto/sha256.h"
 #include "key.h"
 #include "util.h"
 
+#include <iostream>
+#include <regex>
+
+static const char* DEFAULT_BENCH_FILTER = ".*";
+static const char* DEFAULT_BENCH_PRINTER = "csv";
+static const int64_t DEFAULT_BENCH_TIME_MS = 1000;
+static const int64_t DEFAULT_BENCH_THRESHOLD = 10;
+
 int
 main(int argc, char** argv)
 {
+    gArgs.ParseParameters(argc, argv);
+
+    if (gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help")) {
+        std::cout << "Usage: bench_dogecash [options]\n\n"
+                  << HelpMessageOpt("-?", "This help message")
+                  << HelpMessageOpt("-filter=<regex>", strprintf("Run only the benchmarks whose name matches the regex (default: %s)", DEFAULT_BENCH_FILTER))
+                  << HelpMessageOpt("-printer=<csv|json>", strprintf("Output format of the results (default: %s)", DEFAULT_BENCH_PRINTER))
+                  << HelpMessageOpt("-time=<n>", strprintf("Time each benchmark runs for, in milliseconds (default: %d)", DEFAULT_BENCH_TIME_MS))
+                  << HelpMessageOpt("-compare=<file>", "Compare the median times with those of the json output of a previous run, "
+                                                       "exit with an error when a benchmark regressed")
+                  << HelpMessageOpt("-threshold=<n>", strprintf("Slowdown of a median, in percent, reported as a regression by -compare (default: %d)", DEFAULT_BENCH_THRESHOLD));
+        return EXIT_SUCCESS;
+    }
+
+    benchmark::Options options;
+    options.filter = gArgs.GetArg("-filter", DEFAULT_BENCH_FILTER);
+    options.printer = gArgs.GetArg("-printer", DEFAULT_BENCH_PRINTER);
+    options.elapsedTimeForOne = std::chrono::milliseconds(gArgs.GetArg("-time", DEFAULT_BENCH_TIME_MS));
+    options.compare = gArgs.GetArg("-compare", "");
+    options.threshold = gArgs.GetArg("-threshold", DEFAULT_BENCH_THRESHOLD);
+    if (options.printer != "csv" && options.printer != "json") {
+        std::cerr << "Error: unknown printer " << options.printer << "\n";
+        return EXIT_FAILURE;
+    }
+    try {
+        (void)std::regex(options.filter);
+    } catch (const std::regex_error& e) {
+        std::cerr << "Error: invalid filter " << options.filter << ": " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+    if (options.elapsedTimeForOne <= benchmark::duration::zero()) {
+        std::cerr << "Error: -time must be positive\n";
+        return EXIT_FAILURE;
+    }
+
+    SHA256AutoDetect();
     ECC_Start();
     SetupEnvironment();
     g_logger->m_print_to_file = false; // don't want to write to debug.log file
 
-    benchmark::BenchRunner::RunAll();
+    const bool fSuccess = benchmark::BenchRunner::RunAll(options);
 
     ECC_Stop();
+    return fSuccess ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,266 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blocksignature.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/merkle.h"
+#include "key.h"
+#include "keystore.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "validation.h"
+
+/*
+ * Synthetic blocks shaped like the ones our validators see since the PoS
+ * switch: a coinstake block carrying regular transfers, the same with a
+ * masternode payment or with budget payments in the coinstake, and a block
+ * full of shielded transactions.
+ */
+
+static const int NUM_TRANSFERS = 400;
+static const int NUM_BUDGET_PAYEES = 10;
+static const int NUM_SHIELDED_TXES = 40;
+static const int NUM_SHIELDED_DESCRIPTIONS = 2;
+static const int COINS_HEIGHT = 1;
+static const int SPEND_HEIGHT = 1000;
+
+namespace {
+
+enum class StakePayments {
+    NONE,
+    MASTERNODE,
+    BUDGET,
+};
+
+struct BenchBlock {
+    CBlock block;
+    // the coins spent by the block
+    std::vector<std::pair<COutPoint, Coin>> vCoins;
+};
+
+class BlockBuilder
+{
+public:
+    BlockBuilder()
+    {
+        stakeKey.MakeNewKey(true);
+        payKey.MakeNewKey(true);
+        keystore.AddKey(stakeKey);
+        keystore.AddKey(payKey);
+        stakeScript = GetScriptForRawPubKey(stakeKey.GetPubKey());
+        payScript = GetScriptForDestination(payKey.GetPubKey().GetID());
+    }
+
+    BenchBlock Build(StakePayments payments, int nTransfers, int nShieldedTxes)
+    {
+        BenchBlock ret;
+        CBlock& block = ret.block;
+        block.nVersion = CBlockHeader::CURRENT_VERSION;
+        block.hashPrevBlock = GetRandHash();
+        block.nTime = GetTime();
+        block.nBits = 0x1e0ffff0;
+
+        // PoS coinbase: a single empty output
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << SPEND_HEIGHT << OP_0;
+        coinbase.vout.resize(1);
+        coinbase.vout[0].SetEmpty();
+        block.vtx.emplace_back(MakeTransactionRef(coinbase));
+
+        // coinstake
+        const CAmount nStake = 10000 * COIN;
+        CMutableTransaction coinstake;
+        coinstake.vin.emplace_back(AddCoin(ret, stakeScript, nStake));
+        coinstake.vout.emplace_back();
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout.emplace_back(nStake + 5 * COIN, stakeScript);
+        if (payments == StakePayments::MASTERNODE) {
+            coinstake.vout.emplace_back(3 * COIN, payScript);
+        } else if (payments == StakePayments::BUDGET) {
+            for (int i = 0; i < NUM_BUDGET_PAYEES; i++) {
+                coinstake.vout.emplace_back(1000 * COIN, payScript);
+            }
+        }
+        Sign(ret, coinstake);
+        block.vtx.emplace_back(MakeTransactionRef(coinstake));
+
+        // P2PKH transfers, two inputs and two outputs each
+        for (int i = 0; i < nTransfers; i++) {
+            CMutableTransaction tx;
+            tx.vin.emplace_back(AddCoin(ret, payScript, 50 * COIN));
+            tx.vin.emplace_back(AddCoin(ret, payScript, 50 * COIN));
+            tx.vout.emplace_back(60 * COIN, payScript);
+            tx.vout.emplace_back(40 * COIN - 10000, payScript);
+            Sign(ret, tx);
+            block.vtx.emplace_back(MakeTransactionRef(tx));
+        }
+
+        // shielded transactions (the proofs are not checked outside of the contextual checks)
+        for (int i = 0; i < nShieldedTxes; i++) {
+            CMutableTransaction tx;
+            tx.nVersion = CTransaction::TxVersion::SAPLING;
+            tx.sapData->valueBalance = 10000;
+            for (int j = 0; j < NUM_SHIELDED_DESCRIPTIONS; j++) {
+                SpendDescription spend;
+                spend.cv = GetRandHash();
+                spend.anchor = GetRandHash();
+                spend.nullifier = GetRandHash();
+                spend.rk = GetRandHash();
+                tx.sapData->vShieldedSpend.emplace_back(spend);
+
+                OutputDescription output;
+                output.cv = GetRandHash();
+                output.cmu = GetRandHash();
+                output.ephemeralKey = GetRandHash();
+                tx.sapData->vShieldedOutput.emplace_back(output);
+            }
+            block.vtx.emplace_back(MakeTransactionRef(tx));
+        }
+
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+        assert(SignBlockWithKey(block, stakeKey));
+        return ret;
+    }
+
+private:
+    CKey stakeKey;
+    CKey payKey;
+    CBasicKeyStore keystore;
+    CScript stakeScript;
+    CScript payScript;
+
+    CTxIn AddCoin(BenchBlock& ret, const CScript& script, CAmount nValue)
+    {
+        COutPoint prevout(GetRandHash(), 0);
+        ret.vCoins.emplace_back(prevout, Coin(CTxOut(nValue, script), COINS_HEIGHT, false, false));
+        return CTxIn(prevout);
+    }
+
+    void Sign(const BenchBlock& ret, CMutableTransaction& tx)
+    {
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            for (const auto& it : ret.vCoins) {
+                if (it.first != tx.vin[i].prevout) continue;
+                assert(SignSignature(keystore, it.second.out.scriptPubKey, tx, i, it.second.out.nValue, SIGHASH_ALL));
+                break;
+            }
+        }
+    }
+};
+
+void SetupShieldedParams()
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+}
+
+void RestoreParams()
+{
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    SelectParams(CBaseChainParams::MAIN);
+}
+
+void DeserializeAndCheck(benchmark::State& state, StakePayments payments, int nTransfers, int nShieldedTxes)
+{
+    SetupShieldedParams();
+    BlockBuilder builder;
+    const BenchBlock bench = builder.Build(payments, nTransfers, nShieldedTxes);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << bench.block;
+    const size_t nSize = stream.size();
+    char a;
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block; // Note that CBlock caches its checked state, so we need to recreate it here
+        stream >> block;
+        assert(stream.Rewind(nSize));
+
+        CValidationState valState;
+        assert(CheckBlock(block, valState));
+    }
+    RestoreParams();
+}
+
+} // namespace
+
+static void DeserializeAndCheckCoinstakeBlock(benchmark::State& state)
+{
+    DeserializeAndCheck(state, StakePayments::NONE, NUM_TRANSFERS, 0);
+}
+
+static void DeserializeAndCheckMasternodePaymentBlock(benchmark::State& state)
+{
+    DeserializeAndCheck(state, StakePayments::MASTERNODE, NUM_TRANSFERS, 0);
+}
+
+static void DeserializeAndCheckBudgetPaymentBlock(benchmark::State& state)
+{
+    DeserializeAndCheck(state, StakePayments::BUDGET, NUM_TRANSFERS, 0);
+}
+
+static void DeserializeAndCheckShieldedBlock(benchmark::State& state)
+{
+    DeserializeAndCheck(state, StakePayments::MASTERNODE, 0, NUM_SHIELDED_TXES);
+}
+
+// The input checks, script verification and coins update done by
+// ConnectBlock, against an in-memory coins view holding the spent coins.
+static void ConnectBlockInputs(benchmark::State& state)
+{
+    SetupShieldedParams();
+    InitSignatureCache();
+    BlockBuilder builder;
+    const BenchBlock bench = builder.Build(StakePayments::MASTERNODE, NUM_TRANSFERS, 0);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache viewBase(&viewDummy);
+    for (const auto& it : bench.vCoins) {
+        viewBase.AddCoin(it.first, Coin(it.second), false);
+    }
+
+    // GetSpendHeight resolves the height through the view best block
+    CBlockIndex* pindexPrev = new CBlockIndex();
+    const uint256 hashPrev = bench.block.hashPrevBlock;
+    pindexPrev->nHeight = SPEND_HEIGHT - 1;
+    {
+        LOCK(cs_main);
+        pindexPrev->phashBlock = &mapBlockIndex.emplace(hashPrev, pindexPrev).first->first;
+    }
+    viewBase.SetBestBlock(hashPrev);
+
+    while (state.KeepRunning()) {
+        CCoinsViewCache view(&viewBase);
+        for (const auto& tx : bench.block.vtx) {
+            if (!tx->IsCoinBase()) {
+                CValidationState valState;
+                PrecomputedTransactionData precomTxData(*tx);
+                assert(CheckInputs(*tx, valState, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, false, false, precomTxData));
+            }
+            UpdateCoins(*tx, view, SPEND_HEIGHT);
+        }
+    }
+
+    {
+        LOCK(cs_main);
+        mapBlockIndex.erase(hashPrev);
+    }
+    delete pindexPrev;
+    RestoreParams();
+}
+
+BENCHMARK(DeserializeAndCheckCoinstakeBlock);
+BENCHMARK(DeserializeAndCheckMasternodePaymentBlock);
+BENCHMARK(DeserializeAndCheckBudgetPaymentBlock);
+BENCHMARK(DeserializeAndCheckShieldedBlock);
+BENCHMARK(ConnectBlockInputs);
@@ -0,0 +1,418 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "budget/budgetmanager.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "key.h"
+#include "keystore.h"
+#include "masternode-payments.h"
+#include "masternode-sync.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "net_processing.h"
+#include "netbase.h"
+#include "netmessagemaker.h"
+#include "random.h"
+#include "scheduler.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "util/memory.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+/*
+ * The processing of the network messages, one type at a time. A stream of
+ * distinct messages of the type is fed to an inbound peer as its socket would,
+ * and goes through ProcessMessages and SendMessages, one message per
+ * iteration: the time of an iteration is the cost of a message of the type.
+ * Once the stream is exhausted, the state its messages changed (the mempool,
+ * the masternode list, the payment votes, the budget) is reset and the stream
+ * replayed.
+ */
+
+static const int CHAIN_LENGTH = 1000;
+static const int NUM_MASTERNODES = 500;
+static const int NUM_TXES = 1000;
+static const int NUM_PROPOSALS = 4;
+// the items of an inv, or a getdata, message
+static const int INV_SIZE = 100;
+static const int GETDATA_SIZE = 10;
+// the heights after the tip the payment votes are for
+static const int VOTED_HEIGHTS = 20;
+
+namespace {
+
+/** A message as it comes from the socket: the header, then the payload */
+typedef std::vector<unsigned char> WireMessage;
+
+template <typename... Args>
+WireMessage MakeWireMessage(const std::string& strCommand, Args&&... args)
+{
+    const CSharedNetMsg msg = CConnman::MakeSharedMessage(CNetMsgMaker(PROTOCOL_VERSION).Make(strCommand, std::forward<Args>(args)...));
+    WireMessage vBytes(*msg.header);
+    vBytes.insert(vBytes.end(), msg.data->begin(), msg.data->end());
+    return vBytes;
+}
+
+struct MasternodeKeys {
+    CKey collateralKey;
+    CKey masternodeKey;
+    CTxIn vin;
+    CScript payee;
+};
+
+/**
+ * An active chain of empty block indexes, synced, coins to spend with a key,
+ * the collaterals of a masternode list, and a fully connected inbound peer
+ * of a CConnman running none of its threads.
+ */
+class NetSetup
+{
+public:
+    NetSetup() : coinsTip(&coinsDummy)
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        nTime = GetAdjustedTime();
+
+        // the callbacks of the validation interface, for the transactions added to the mempool
+        threadGroup.create_thread(std::bind(&CScheduler::serviceQueue, &scheduler));
+        GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
+        CBlockIndex* pprev = nullptr;
+        {
+            LOCK(cs_main);
+            for (int nHeight = 0; nHeight < CHAIN_LENGTH; nHeight++) {
+                CBlockIndex* pindex = new CBlockIndex();
+                pindex->pprev = pprev;
+                pindex->nHeight = nHeight;
+                pindex->nTime = nTime - (CHAIN_LENGTH - nHeight) * 60;
+                pindex->phashBlock = &mapBlockIndex.emplace(GetRandHash(), pindex).first->first;
+                pindex->BuildSkip();
+                pprev = pindex;
+            }
+            coinsTip.SetBestBlock(pprev->GetBlockHash());
+            pcoinsTip = &coinsTip;
+            assert(LoadChainTip(Params()));
+        }
+        // recent enough for the tier two messages to be processed
+        WITH_LOCK(g_best_block_mutex, g_best_block_time = pprev->GetBlockTime(); );
+        assert(masternodeSync.IsBlockchainSynced());
+
+        // signed transactions, each spending a coin of the key
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+        const CScript script = GetScriptForDestination(key.GetPubKey().GetID());
+        for (int i = 0; i < NUM_TXES; i++) {
+            CMutableTransaction mtx;
+            mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+            mtx.vout.emplace_back(10 * COIN - COIN / 100, script);
+            coinsTip.AddCoin(mtx.vin[0].prevout, Coin(CTxOut(10 * COIN, script), 1, false, false), false);
+            assert(SignSignature(keystore, script, mtx, 0, 10 * COIN, SIGHASH_ALL));
+            vTxes.push_back(MakeTransactionRef(mtx));
+        }
+
+        for (int i = 0; i < NUM_MASTERNODES; i++) {
+            MasternodeKeys mn;
+            mn.collateralKey.MakeNewKey(true);
+            mn.masternodeKey.MakeNewKey(true);
+            mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+            mn.payee = GetScriptForDestination(mn.collateralKey.GetPubKey().GetID());
+            coinsTip.AddCoin(mn.vin.prevout, Coin(CTxOut(GetMNCollateral(CHAIN_LENGTH - 1), mn.payee), 1, false, false), false);
+            vMasternodes.push_back(mn);
+        }
+
+        g_connman = MakeUnique<CConnman>(0x1337, 0x1337);
+        CConnman::Options options;
+        options.nSendBufferMaxSize = 1000 * DEFAULT_MAXSENDBUFFER;
+        options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+        g_connman->Init(options);
+        RegisterNodeSignals(GetNodeSignals());
+
+        node = MakeUnique<CNode>(0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(LookupNumeric("1.2.3.4", 51476), NODE_NETWORK), 0, 0, "", true);
+        GetNodeSignals().InitializeNode(node.get(), *g_connman);
+        // past the version handshake
+        node->nVersion = PROTOCOL_VERSION;
+        node->SetSendVersion(PROTOCOL_VERSION);
+        node->fSuccessfullyConnected = true;
+    }
+
+    ~NetSetup()
+    {
+        bool fUpdateConnectionTime = false;
+        GetNodeSignals().FinalizeNode(node->GetId(), fUpdateConnectionTime);
+        UnregisterNodeSignals(GetNodeSignals());
+        node.reset();
+        g_connman.reset();
+
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        GetMainSignals().FlushBackgroundCallbacks();
+        GetMainSignals().UnregisterBackgroundSignalScheduler();
+
+        mempool.clear();
+        g_budgetman.Clear();
+        g_budgetman.ClearSeen();
+        masternodePayments.Clear();
+        WITH_LOCK(cs_mapMasternodePayeeVotes, masternodePayments.mapMasternodesLastVote.clear(); );
+        mnodeman.Clear();
+        masternodeSync.Reset();
+        UnloadBlockIndex();
+        pcoinsTip = nullptr;
+        SelectParams(CBaseChainParams::MAIN);
+    }
+
+    /** The list of all the masternodes, enabled, pinged two minutes before the setup */
+    void AddMasternodes()
+    {
+        mnodeman.Clear();
+        const uint256 hashPing = chainActive[CHAIN_LENGTH - 1 - MNPING_DEPTH]->GetBlockHash();
+        for (const MasternodeKeys& keys : vMasternodes) {
+            CMasternode mn;
+            mn.vin = keys.vin;
+            mn.pubKeyCollateralAddress = keys.collateralKey.GetPubKey();
+            mn.pubKeyMasternode = keys.masternodeKey.GetPubKey();
+            mn.protocolVersion = PROTOCOL_VERSION;
+            mn.sigTime = nTime - 60 * 60 * 24 * 30;
+            mn.lastPing = CMasternodePing(mn.vin, hashPing, nTime - 120);
+            assert(mnodeman.Add(mn));
+        }
+    }
+
+    /** Receive a message from the peer, process it and the peer's send queue */
+    void ProcessMessage(const WireMessage& msg)
+    {
+        bool fComplete = false;
+        assert(node->ReceiveMsgBytes((const char*)msg.data(), msg.size(), fComplete) && fComplete);
+        node->MarkReceivedMsgsForProcessing(g_connman->GetReceiveFloodSize());
+        while (ProcessMessages(node.get(), *g_connman, interrupt)) {}
+        SendMessages(node.get(), *g_connman, interrupt);
+        // the stream is well formed: the peer is never punished
+        assert(!node->fDisconnect);
+
+        // nothing goes out, the responses are dropped
+        LOCK(node->cs_vSend);
+        node->vSendMsg.clear();
+        node->nSendSize = 0;
+        node->nSendOffset = 0;
+        node->fPauseSend = false;
+    }
+
+    int64_t nTime;
+    CKey key;
+    CBasicKeyStore keystore;
+    std::vector<CTransactionRef> vTxes;
+    std::vector<MasternodeKeys> vMasternodes;
+
+private:
+    CScheduler scheduler;
+    boost::thread_group threadGroup;
+    CCoinsView coinsDummy;
+    CCoinsViewCache coinsTip;
+    std::unique_ptr<CNode> node;
+    std::atomic<bool> interrupt{false};
+};
+
+/** A budget manager taking proposals without looking for their collateral */
+class BenchBudgetManager : public CBudgetManager
+{
+public:
+    void AddBenchProposal(CBudgetProposal& proposal)
+    {
+        LOCK(cs_proposals);
+        proposal.UpdateValid(GetBestHeight());
+        mapProposals.emplace(proposal.GetHash(), proposal);
+        RankProposal(proposal);
+    }
+};
+
+/** Process the messages of the stream in turn, one per iteration, calling reset each time the stream is over */
+void Replay(benchmark::State& state, NetSetup& setup, const std::vector<WireMessage>& vStream, const std::function<void()>& reset = nullptr)
+{
+    size_t nNext = 0;
+    while (state.KeepRunning()) {
+        setup.ProcessMessage(vStream[nNext]);
+        if (++nNext == vStream.size()) {
+            nNext = 0;
+            if (reset) reset();
+        }
+    }
+}
+
+} // namespace
+
+// Announcements of transactions not known yet
+static void ProcessInvMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    std::vector<WireMessage> vStream;
+    for (int i = 0; i < NUM_TXES / INV_SIZE; i++) {
+        std::vector<CInv> vInv;
+        for (int j = 0; j < INV_SIZE; j++) {
+            vInv.emplace_back(MSG_TX, GetRandHash());
+        }
+        vStream.push_back(MakeWireMessage(NetMsgType::INV, vInv));
+    }
+    Replay(state, setup, vStream);
+}
+
+// New transactions, accepted to the mempool
+static void ProcessTxMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    std::vector<WireMessage> vStream;
+    for (const CTransactionRef& tx : setup.vTxes) {
+        vStream.push_back(MakeWireMessage(NetMsgType::TX, *tx));
+    }
+    Replay(state, setup, vStream, [] { mempool.clear(); });
+}
+
+// Requests of transactions of the mempool
+static void ProcessGetDataMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    {
+        LOCK(cs_main);
+        for (const CTransactionRef& tx : setup.vTxes) {
+            CValidationState validationState;
+            assert(AcceptToMemoryPool(mempool, validationState, tx, false, nullptr));
+        }
+    }
+    std::vector<WireMessage> vStream;
+    for (size_t i = 0; i < setup.vTxes.size(); i += GETDATA_SIZE) {
+        std::vector<CInv> vInv;
+        for (size_t j = i; j < i + GETDATA_SIZE && j < setup.vTxes.size(); j++) {
+            vInv.emplace_back(MSG_TX, setup.vTxes[j]->GetHash());
+        }
+        vStream.push_back(MakeWireMessage(NetMsgType::GETDATA, vInv));
+    }
+    Replay(state, setup, vStream);
+}
+
+// The requests of the blocks after a locator, answered with 500 block
+// announcements. The headers messages themselves are not processed while
+// the headers first sync is not active.
+static void ProcessGetBlocksMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    std::vector<WireMessage> vStream;
+    {
+        LOCK(cs_main);
+        for (int nHeight = 0; nHeight < CHAIN_LENGTH - 500; nHeight += 10) {
+            vStream.push_back(MakeWireMessage(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive[nHeight]), uint256()));
+        }
+    }
+    Replay(state, setup, vStream);
+}
+
+// Broadcasts of new masternodes
+static void ProcessMnbMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    const uint256 hashPing = WITH_LOCK(cs_main, return chainActive[CHAIN_LENGTH - 1 - MNPING_DEPTH]->GetBlockHash(); );
+    std::vector<WireMessage> vStream;
+    for (size_t i = 0; i < setup.vMasternodes.size(); i++) {
+        const MasternodeKeys& keys = setup.vMasternodes[i];
+        CMasternodePing ping(keys.vin, hashPing, setup.nTime);
+        assert(ping.Sign(keys.masternodeKey, keys.masternodeKey.GetPubKey().GetID()));
+        const CService addr = LookupNumeric(strprintf("10.0.%d.%d", i / 256, i % 256).c_str(), 51476);
+        CMasternodeBroadcast mnb(addr, keys.vin, keys.collateralKey.GetPubKey(), keys.masternodeKey.GetPubKey(), PROTOCOL_VERSION, ping);
+        mnb.sigTime = setup.nTime;
+        assert(mnb.Sign(keys.collateralKey, keys.collateralKey.GetPubKey()));
+        vStream.push_back(MakeWireMessage(NetMsgType::MNBROADCAST, mnb));
+    }
+    Replay(state, setup, vStream, [] { mnodeman.Clear(); });
+}
+
+// Pings of the masternodes of the list (accepted as long as the benchmark
+// runs for less than a minute, before the list expires)
+static void ProcessMnpMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    setup.AddMasternodes();
+    const uint256 hashPing = WITH_LOCK(cs_main, return chainActive[CHAIN_LENGTH - 1 - MNPING_DEPTH]->GetBlockHash(); );
+    std::vector<WireMessage> vStream;
+    for (const MasternodeKeys& keys : setup.vMasternodes) {
+        CMasternodePing ping(keys.vin, hashPing, setup.nTime);
+        assert(ping.Sign(keys.masternodeKey, keys.masternodeKey.GetPubKey().GetID()));
+        vStream.push_back(MakeWireMessage(NetMsgType::MNPING, ping));
+    }
+    Replay(state, setup, vStream, [&setup] { setup.AddMasternodes(); });
+}
+
+// The payment votes of the masternodes ranked to vote, for the next blocks
+static void ProcessMnwMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    setup.AddMasternodes();
+    std::vector<WireMessage> vStream;
+    for (int nHeight = CHAIN_LENGTH; nHeight < CHAIN_LENGTH + VOTED_HEIGHTS; nHeight++) {
+        for (size_t i = 0; i < setup.vMasternodes.size(); i++) {
+            const MasternodeKeys& keys = setup.vMasternodes[i];
+            if (mnodeman.GetMasternodeRank(keys.vin, nHeight - 100, ActiveProtocol()) > MNPAYMENTS_SIGNATURES_TOTAL) {
+                continue;
+            }
+            CMasternodePaymentWinner winner(keys.vin);
+            winner.nBlockHeight = nHeight;
+            winner.AddPayee(setup.vMasternodes[(nHeight + i) % setup.vMasternodes.size()].payee);
+            assert(winner.Sign(keys.masternodeKey, keys.masternodeKey.GetPubKey().GetID()));
+            vStream.push_back(MakeWireMessage(NetMsgType::MNWINNER, winner));
+        }
+    }
+    Replay(state, setup, vStream, [] {
+        masternodePayments.Clear();
+        WITH_LOCK(cs_mapMasternodePayeeVotes, masternodePayments.mapMasternodesLastVote.clear(); );
+    });
+}
+
+// The votes of all the masternodes on the proposals of the budget
+static void ProcessBudgetVoteMessage(benchmark::State& state)
+{
+    NetSetup setup;
+    setup.AddMasternodes();
+
+    // the budget is loaded as from the database, with proposals and no vote
+    BenchBudgetManager budget;
+    const int nHeight = CHAIN_LENGTH - 1;
+    budget.SetBestHeight(nHeight);
+    const int nBlockStart = nHeight - nHeight % Params().GetConsensus().nBudgetCycleBlocks;
+    for (int i = 0; i < NUM_PROPOSALS; i++) {
+        CBudgetProposal proposal(strprintf("proposal-%d", i), "https://dogecash.org", 100, setup.vMasternodes[i].payee,
+                                 (10 + i) * COIN, nBlockStart, GetRandHash());
+        proposal.nTime = setup.nTime - Params().GetConsensus().nProposalEstablishmentTime * 2;
+        budget.AddBenchProposal(proposal);
+    }
+    CDataStream ssBudget(SER_DISK, CLIENT_VERSION);
+    ssBudget << static_cast<const CBudgetManager&>(budget);
+    auto loadBudget = [&ssBudget] {
+        CDataStream ss(ssBudget);
+        ss >> g_budgetman;
+    };
+    loadBudget();
+    g_budgetman.SetBestHeight(nHeight);
+
+    std::vector<WireMessage> vStream;
+    for (const CBudgetProposal* proposal : budget.GetAllProposals()) {
+        for (size_t i = 0; i < setup.vMasternodes.size(); i++) {
+            const MasternodeKeys& keys = setup.vMasternodes[i];
+            CBudgetVote vote(keys.vin, proposal->GetHash(), i % 3 ? CBudgetVote::VOTE_YES : CBudgetVote::VOTE_NO);
+            assert(vote.Sign(keys.masternodeKey, keys.masternodeKey.GetPubKey().GetID()));
+            vStream.push_back(MakeWireMessage(NetMsgType::BUDGETVOTE, vote));
+        }
+    }
+    Replay(state, setup, vStream, loadBudget);
+}
+
+BENCHMARK(ProcessInvMessage);
+BENCHMARK(ProcessTxMessage);
+BENCHMARK(ProcessGetDataMessage);
+BENCHMARK(ProcessGetBlocksMessage);
+BENCHMARK(ProcessMnbMessage);
+BENCHMARK(ProcessMnpMessage);
+BENCHMARK(ProcessMnwMessage);
+BENCHMARK(ProcessBudgetVoteMessage);
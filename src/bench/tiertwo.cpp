@@ -0,0 +1,257 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "budget/budgetmanager.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "key.h"
+#include "masternode-payments.h"
+#include "masternodeman.h"
+#include "netbase.h"
+#include "random.h"
+#include "script/standard.h"
+#include "validation.h"
+
+/*
+ * The tier two work of a masternode, on synthetic masternode lists: the
+ * score ranks, the election of the next payee against the payment votes of
+ * the last blocks, the budget with proposals voted by the whole list, and
+ * the signature checks of the pings and broadcasts.
+ */
+
+static const int SMALL_LIST = 1000;
+static const int LARGE_LIST = 10000;
+// long enough for the collaterals of the large list to be deep enough to be paid,
+// and for the last paid lookups to walk through 1.25 times the large list
+static const int CHAIN_LENGTH = 15000;
+static const int NUM_PROPOSALS = 100;
+// the heights the ranks are computed at, more than the cached score tables
+static const int RANK_HEIGHTS = 1000;
+
+namespace {
+
+/**
+ * An active chain of empty block indexes and a masternode list, enabled,
+ * with their collaterals in the coins tip and a payee with the required
+ * votes for each of the last blocks.
+ */
+class TierTwoSetup
+{
+public:
+    explicit TierTwoSetup(int nMasternodes) : coinsTip(&coinsDummy)
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        const int64_t nNow = GetAdjustedTime();
+
+        CBlockIndex* pprev = nullptr;
+        {
+            LOCK(cs_main);
+            for (int nHeight = 0; nHeight < CHAIN_LENGTH; nHeight++) {
+                CBlockIndex* pindex = new CBlockIndex();
+                pindex->pprev = pprev;
+                pindex->nHeight = nHeight;
+                pindex->nTime = nNow - (CHAIN_LENGTH - nHeight) * 60;
+                pindex->phashBlock = &mapBlockIndex.emplace(GetRandHash(), pindex).first->first;
+                pindex->BuildSkip();
+                pprev = pindex;
+            }
+            coinsTip.SetBestBlock(pprev->GetBlockHash());
+            pcoinsTip = &coinsTip;
+            assert(LoadChainTip(Params()));
+        }
+
+        for (int i = 0; i < nMasternodes; i++) {
+            CKey collateralKey, masternodeKey;
+            collateralKey.MakeNewKey(true);
+            masternodeKey.MakeNewKey(true);
+
+            CMasternode mn;
+            mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+            mn.pubKeyCollateralAddress = collateralKey.GetPubKey();
+            mn.pubKeyMasternode = masternodeKey.GetPubKey();
+            // old enough not to be filtered out of the payment queue
+            mn.sigTime = nNow - 60 * 60 * 24 * 30;
+            mn.lastPing = CMasternodePing(mn.vin, pprev->GetBlockHash(), nNow - 60);
+            const CScript payee = GetScriptForDestination(mn.pubKeyCollateralAddress.GetID());
+            coinsTip.AddCoin(mn.vin.prevout, Coin(CTxOut(GetMNCollateral(1), payee), 1, false, false), false);
+            assert(mnodeman.Add(mn));
+            vCollaterals.push_back(mn.vin);
+            vPayees.push_back(payee);
+        }
+
+        // the payment votes of the last blocks and of the scheduled ones
+        LOCK(cs_mapMasternodeBlocks);
+        const int nVotedBlocks = nMasternodes * 1.25;
+        for (int nHeight = pprev->nHeight - nVotedBlocks; nHeight <= pprev->nHeight + 8; nHeight++) {
+            CMasternodeBlockPayees payees(nHeight);
+            payees.AddPayee(vPayees[nHeight % nMasternodes], MNPAYMENTS_SIGNATURES_REQUIRED);
+            masternodePayments.mapMasternodeBlocks.emplace(nHeight, payees);
+        }
+    }
+
+    ~TierTwoSetup()
+    {
+        masternodePayments.Clear();
+        mnodeman.Clear();
+        UnloadBlockIndex();
+        pcoinsTip = nullptr;
+        SelectParams(CBaseChainParams::MAIN);
+    }
+
+    std::vector<CTxIn> vCollaterals;
+    std::vector<CScript> vPayees;
+
+private:
+    CCoinsView coinsDummy;
+    CCoinsViewCache coinsTip;
+};
+
+/** A budget manager taking proposals without looking for their collateral */
+class BenchBudgetManager : public CBudgetManager
+{
+public:
+    void AddBenchProposal(CBudgetProposal& proposal)
+    {
+        LOCK(cs_proposals);
+        proposal.UpdateValid(GetBestHeight());
+        mapProposals.emplace(proposal.GetHash(), proposal);
+        RankProposal(proposal);
+    }
+};
+
+/** Proposals voted by all the masternodes of the list, a third of them against */
+void FillBudget(BenchBudgetManager& budget, const TierTwoSetup& setup)
+{
+    const int nHeight = CHAIN_LENGTH - 1;
+    budget.SetBestHeight(nHeight);
+    const int nBlockStart = nHeight - nHeight % Params().GetConsensus().nBudgetCycleBlocks;
+    const int64_t nNow = GetAdjustedTime();
+    for (int i = 0; i < NUM_PROPOSALS; i++) {
+        CBudgetProposal proposal(strprintf("proposal-%d", i), "https://dogecash.org", 100, setup.vPayees[i % setup.vPayees.size()],
+                                 (10 + i) * COIN, nBlockStart, GetRandHash());
+        proposal.nTime = nNow - Params().GetConsensus().nProposalEstablishmentTime * 2;
+        budget.AddBenchProposal(proposal);
+    }
+
+    for (const CBudgetProposal* proposal : budget.GetAllProposals()) {
+        const uint256 nProposalHash = proposal->GetHash();
+        for (size_t i = 0; i < setup.vCollaterals.size(); i++) {
+            std::string strError;
+            const CBudgetVote vote(setup.vCollaterals[i], nProposalHash, i % 3 ? CBudgetVote::VOTE_YES : CBudgetVote::VOTE_NO);
+            assert(budget.UpdateProposal(vote, nullptr, strError));
+        }
+    }
+}
+
+void MasternodeRanks(benchmark::State& state, int nMasternodes)
+{
+    TierTwoSetup setup(nMasternodes);
+    int nHeight = 0;
+    while (state.KeepRunning()) {
+        // a new height each time: the scores are not in the cache
+        assert(!mnodeman.GetMasternodeRanks(CHAIN_LENGTH - 1 - nHeight).empty());
+        nHeight = (nHeight + 1) % RANK_HEIGHTS;
+    }
+}
+
+// The election of the payee the masternode votes for in
+// CMasternodePayments::ProcessBlock, at the next height.
+void NextMasternodeInQueue(benchmark::State& state, int nMasternodes)
+{
+    TierTwoSetup setup(nMasternodes);
+    while (state.KeepRunning()) {
+        int nCount = 0;
+        assert(mnodeman.GetNextMasternodeInQueueForPayment(CHAIN_LENGTH, true, nCount) != nullptr);
+    }
+}
+
+} // namespace
+
+static void MasternodeRanksSmallList(benchmark::State& state)
+{
+    MasternodeRanks(state, SMALL_LIST);
+}
+
+static void MasternodeRanksLargeList(benchmark::State& state)
+{
+    MasternodeRanks(state, LARGE_LIST);
+}
+
+static void NextMasternodeInQueueSmallList(benchmark::State& state)
+{
+    NextMasternodeInQueue(state, SMALL_LIST);
+}
+
+static void NextMasternodeInQueueLargeList(benchmark::State& state)
+{
+    NextMasternodeInQueue(state, LARGE_LIST);
+}
+
+// The budget of the next cycle, at a new height each time as on every
+// block: the votes of the disabled masternodes are looked for again.
+static void BudgetGetBudget(benchmark::State& state)
+{
+    TierTwoSetup setup(SMALL_LIST);
+    BenchBudgetManager budget;
+    FillBudget(budget, setup);
+    int nHeight = CHAIN_LENGTH - 1;
+    while (state.KeepRunning()) {
+        nHeight = nHeight == CHAIN_LENGTH - 1 ? CHAIN_LENGTH : CHAIN_LENGTH - 1;
+        budget.SetBestHeight(nHeight);
+        assert(!budget.GetBudget().empty());
+    }
+}
+
+static void BudgetCheckAndRemove(benchmark::State& state)
+{
+    TierTwoSetup setup(SMALL_LIST);
+    BenchBudgetManager budget;
+    FillBudget(budget, setup);
+    while (state.KeepRunning()) {
+        budget.CheckAndRemove();
+    }
+}
+
+static void VerifyMasternodePing(benchmark::State& state)
+{
+    ECCVerifyHandle verifyHandle;
+    CKey key;
+    key.MakeNewKey(true);
+    const CKeyID keyID = key.GetPubKey().GetID();
+    CMasternodePing ping(CTxIn(COutPoint(GetRandHash(), 0)), GetRandHash(), GetAdjustedTime());
+    assert(ping.Sign(key, keyID));
+
+    while (state.KeepRunning()) {
+        assert(ping.CheckSignature(keyID));
+    }
+}
+
+static void VerifyMasternodeBroadcast(benchmark::State& state)
+{
+    ECCVerifyHandle verifyHandle;
+    CKey collateralKey, masternodeKey;
+    collateralKey.MakeNewKey(true);
+    masternodeKey.MakeNewKey(true);
+    const CTxIn vin(COutPoint(GetRandHash(), 0));
+    CMasternodePing ping(vin, GetRandHash(), GetAdjustedTime());
+    assert(ping.Sign(masternodeKey, masternodeKey.GetPubKey().GetID()));
+    CMasternodeBroadcast mnb(LookupNumeric("1.2.3.4", 56740), vin, collateralKey.GetPubKey(), masternodeKey.GetPubKey(), PROTOCOL_VERSION, ping);
+    assert(mnb.Sign(collateralKey, collateralKey.GetPubKey()));
+
+    while (state.KeepRunning()) {
+        assert(mnb.CheckSignature());
+        assert(mnb.lastPing.CheckSignature(mnb.pubKeyMasternode.GetID()));
+    }
+}
+
+BENCHMARK(MasternodeRanksSmallList);
+BENCHMARK(MasternodeRanksLargeList);
+BENCHMARK(NextMasternodeInQueueSmallList);
+BENCHMARK(NextMasternodeInQueueLargeList);
+BENCHMARK(BudgetGetBudget);
+BENCHMARK(BudgetCheckAndRemove);
+BENCHMARK(VerifyMasternodePing);
+BENCHMARK(VerifyMasternodeBroadcast);
@@ -0,0 +1,86 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "keystore.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "script/sign.h"
+#include "script/standard.h"
+
+/*
+ * Verification of the input of a coinstake spending a cold staking (P2CS)
+ * output, signed by the staker or by the owner. The signature is in the
+ * signature cache, as it is for blocks whose transactions were seen in the
+ * mempool, so the script evaluation itself is measured.
+ */
+
+static const CAmount STAKE_AMOUNT = 1000 * COIN;
+
+static void VerifyColdStake(benchmark::State& state, bool fStaker, bool fInterpreter)
+{
+    InitSignatureCache();
+    CBasicKeyStore keystore;
+    CKey stakerKey, ownerKey;
+    stakerKey.MakeNewKey(true);
+    ownerKey.MakeNewKey(true);
+    keystore.AddKey(stakerKey);
+    keystore.AddKey(ownerKey);
+    const CScript scriptPubKey = GetScriptForStakeDelegation(stakerKey.GetPubKey().GetID(), ownerKey.GetPubKey().GetID());
+
+    // The staker can only spend it to a coinstake paying the same script
+    CMutableTransaction txStake;
+    txStake.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    txStake.vout.resize(2);
+    txStake.vout[0].SetEmpty();
+    txStake.vout[1] = CTxOut(STAKE_AMOUNT + COIN, scriptPubKey);
+    assert(SignSignature(keystore, scriptPubKey, txStake, 0, STAKE_AMOUNT, SIGHASH_ALL, fStaker));
+
+    const CTransaction tx(txStake);
+    const CScript& scriptSig = tx.vin[0].scriptSig;
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC | SCRIPT_VERIFY_LOW_S;
+    PrecomputedTransactionData precomTxData(tx);
+    assert(VerifyScript(scriptSig, scriptPubKey, flags, CachingTransactionSignatureChecker(&tx, 0, STAKE_AMOUNT, true, precomTxData), tx.GetRequiredSigVersion()));
+
+    const CachingTransactionSignatureChecker checker(&tx, 0, STAKE_AMOUNT, false, precomTxData);
+    while (state.KeepRunning()) {
+        if (fInterpreter) {
+            // What VerifyScript runs for a non-standard script
+            std::vector<std::vector<unsigned char> > stack;
+            bool ret = EvalScript(stack, scriptSig, flags, checker, tx.GetRequiredSigVersion()) &&
+                       EvalScript(stack, scriptPubKey, flags, checker, tx.GetRequiredSigVersion());
+            assert(ret && !stack.empty());
+        } else {
+            bool ret = VerifyScript(scriptSig, scriptPubKey, flags, checker, tx.GetRequiredSigVersion());
+            assert(ret);
+        }
+    }
+}
+
+static void VerifyScriptP2CSStaker(benchmark::State& state)
+{
+    VerifyColdStake(state, true, false);
+}
+
+static void VerifyScriptP2CSOwner(benchmark::State& state)
+{
+    VerifyColdStake(state, false, false);
+}
+
+static void EvalScriptP2CSStaker(benchmark::State& state)
+{
+    VerifyColdStake(state, true, true);
+}
+
+static void EvalScriptP2CSOwner(benchmark::State& state)
+{
+    VerifyColdStake(state, false, true);
+}
+
+BENCHMARK(VerifyScriptP2CSStaker);
+BENCHMARK(VerifyScriptP2CSOwner);
+BENCHMARK(EvalScriptP2CSStaker);
+BENCHMARK(EvalScriptP2CSOwner);
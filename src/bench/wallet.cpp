@@ -0,0 +1,320 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "consensus/merkle.h"
+#include "key.h"
+#include "pow.h"
+#include "random.h"
+#include "sapling/note.h"
+#include "sapling/noteencryption.h"
+#include "sapling/saplingscriptpubkeyman.h"
+#include "script/standard.h"
+#include "validation.h"
+#include "wallet/wallet.h"
+
+/*
+ * Synthetic wallets of 10k and 100k transactions, each paying one of the
+ * wallet keys, confirmed in the blocks of an active chain of block indexes:
+ * balances, coin selection, staking, the trial-decryption of shielded
+ * outputs with many viewing keys and a rescan of blocks read from disk.
+ */
+
+static const int SMALL_WALLET = 10000;
+static const int LARGE_WALLET = 100000;
+static const int CHAIN_LENGTH = 1000;
+// blocks at the tip without wallet transactions
+static const int UNUSED_TIP_BLOCKS = 10;
+static const int NUM_KEYS = 100;
+static const int NUM_IVKS = 500;
+static const int NUM_SHIELDED_TXES = 10;
+static const int NUM_SHIELDED_OUTPUTS = 2;
+// difficulty of the kernel search: no kernel is found, all the coins are hashed
+static const unsigned int STAKE_BITS = 0x1800ffff;
+
+namespace {
+
+/**
+ * Regtest, a wallet with NUM_KEYS keys and an active chain with nTxes
+ * transactions paying them, loaded in the wallet or, with fRescan, written
+ * to the block files of a temporary data directory for the wallet to find.
+ */
+class WalletSetup
+{
+public:
+    WalletSetup(int nTxes, bool fRescan) : fWriteBlocks(fRescan)
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        nSaplingHeight = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_V5_0].nActivationHeight;
+        // no sapling tree to keep up to date along the rescan
+        UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+        if (fWriteBlocks) {
+            ClearDatadirCache();
+            pathTemp = GetTempPath() / strprintf("bench_dogecash_%lu_%i", (unsigned long)GetTime(), (int)GetRandInt(100000));
+            fs::create_directories(pathTemp);
+            gArgs.ForceSetArg("-datadir", pathTemp.string());
+        }
+
+        {
+            LOCK(wallet.cs_wallet);
+            assert(wallet.SetupSPKM(false));
+            for (int i = 0; i < NUM_KEYS; i++) {
+                CKey key;
+                key.MakeNewKey(true);
+                assert(wallet.AddKeyPubKey(key, key.GetPubKey()));
+                vScripts.emplace_back(GetScriptForDestination(key.GetPubKey().GetID()));
+            }
+        }
+        CKey foreignKey;
+        foreignKey.MakeNewKey(true);
+        const CScript foreignScript = GetScriptForDestination(foreignKey.GetPubKey().GetID());
+
+        // the blocks, and the transactions to load in the wallet
+        const int nTxBlocks = CHAIN_LENGTH - 1 - UNUSED_TIP_BLOCKS;
+        std::vector<CWalletTx> vWtx;
+        std::unique_ptr<CAutoFile> fileout;
+        if (fWriteBlocks) {
+            fileout.reset(new CAutoFile(OpenBlockFile(CDiskBlockPos(0, 0)), SER_DISK, CLIENT_VERSION));
+            assert(!fileout->IsNull());
+        }
+        const int64_t nStartTime = GetAdjustedTime() - CHAIN_LENGTH;
+        int nTx = 0;
+        LOCK(cs_main);
+        CBlockIndex* pprev = nullptr;
+        for (int nHeight = 0; nHeight < CHAIN_LENGTH; nHeight++) {
+            CBlock block;
+            block.nVersion = CBlockHeader::CURRENT_VERSION;
+            block.hashPrevBlock = pprev ? pprev->GetBlockHash() : UINT256_ZERO;
+            block.nTime = nStartTime + nHeight;
+            block.nBits = UintToArith256(Params().GetConsensus().powLimit).GetCompact();
+
+            CMutableTransaction coinbase;
+            coinbase.vin.resize(1);
+            coinbase.vin[0].prevout.SetNull();
+            coinbase.vin[0].scriptSig = CScript() << nHeight << OP_0;
+            coinbase.vout.emplace_back(0, foreignScript);
+            block.vtx.emplace_back(MakeTransactionRef(coinbase));
+
+            const int nEnd = nHeight == 0 ? 0 : (int64_t)nTxes * std::min(nHeight, nTxBlocks) / nTxBlocks;
+            for (; nTx < nEnd; nTx++) {
+                CMutableTransaction tx;
+                tx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+                tx.vout.emplace_back((1 + nTx % 100) * COIN, vScripts[nTx % NUM_KEYS]);
+                tx.vout.emplace_back(COIN, foreignScript);
+                block.vtx.emplace_back(MakeTransactionRef(tx));
+            }
+            block.hashMerkleRoot = BlockMerkleRoot(block);
+
+            if (fWriteBlocks) {
+                // read back from disk, the header must be valid
+                while (!CheckProofOfWork(block.GetHash(), block.nBits)) block.nNonce++;
+            }
+
+            CBlockIndex* pindex = new CBlockIndex(block);
+            if (fWriteBlocks) {
+                *fileout << FLATDATA(Params().MessageStart()) << (uint32_t)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+                pindex->nFile = 0;
+                pindex->nDataPos = ftell(fileout->Get());
+                pindex->nStatus |= BLOCK_HAVE_DATA;
+                *fileout << block;
+            }
+            pindex->pprev = pprev;
+            pindex->nHeight = nHeight;
+            pindex->SetStakeModifier(GetRandHash());
+            pindex->phashBlock = &mapBlockIndex.emplace(block.GetHash(), pindex).first->first;
+            pindex->BuildSkip();
+            pprev = pindex;
+
+            if (fWriteBlocks) continue;
+            for (unsigned int i = 1; i < block.vtx.size(); i++) {
+                vWtx.emplace_back(&wallet, block.vtx[i]);
+                vWtx.back().m_confirm = CWalletTx::Confirmation(CWalletTx::Status::CONFIRMED, nHeight, block.GetHash(), i);
+            }
+        }
+        chainActive.SetTip(pprev);
+        WITH_LOCK(wallet.cs_wallet, wallet.SetLastBlockProcessed(pprev));
+        for (CWalletTx& wtx : vWtx) {
+            assert(wallet.LoadToWallet(wtx));
+        }
+    }
+
+    ~WalletSetup()
+    {
+        UnloadBlockIndex();
+        if (fWriteBlocks) {
+            fs::remove_all(pathTemp);
+            ClearDatadirCache();
+        }
+        UpdateNetworkUpgradeParameters(Consensus::UPGRADE_V5_0, nSaplingHeight);
+        SelectParams(CBaseChainParams::MAIN);
+    }
+
+    CWallet wallet;
+    std::vector<CScript> vScripts;
+
+private:
+    const bool fWriteBlocks;
+    fs::path pathTemp;
+    int nSaplingHeight;
+};
+
+void AvailableBalance(benchmark::State& state, int nTxes)
+{
+    WalletSetup setup(nTxes, false);
+    const CAmount nBalance = setup.wallet.GetAvailableBalance();
+    while (state.KeepRunning()) {
+        // a new block came in, the credits of the transactions are still cached
+        setup.wallet.MarkBalancesDirty();
+        assert(setup.wallet.GetAvailableBalance() == nBalance);
+    }
+}
+
+void AvailableCoins(benchmark::State& state, int nTxes)
+{
+    WalletSetup setup(nTxes, false);
+    while (state.KeepRunning()) {
+        std::vector<COutput> vCoins;
+        assert(setup.wallet.AvailableCoins(&vCoins));
+        assert((int)vCoins.size() == nTxes);
+    }
+}
+
+void SelectCoinsMinConf(benchmark::State& state, int nTxes)
+{
+    WalletSetup setup(nTxes, false);
+    std::vector<COutput> vCoins;
+    assert(setup.wallet.AvailableCoins(&vCoins));
+    LOCK(setup.wallet.cs_wallet);
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        CAmount nValueRet;
+        assert(setup.wallet.SelectCoinsMinConf(1000 * COIN + 12345, 1, 6, vCoins, setCoinsRet, nValueRet));
+    }
+}
+
+// The stakeable coins and the kernel search over them, as for every time slot
+void StakeableCoinsKernelSearch(benchmark::State& state, int nTxes)
+{
+    WalletSetup setup(nTxes, false);
+    const CBlockIndex* pindexPrev = WITH_LOCK(cs_main, return chainActive.Tip());
+    while (state.KeepRunning()) {
+        std::vector<CStakeableOutput> vCoins;
+        assert(setup.wallet.StakeableCoins(&vCoins));
+        CMutableTransaction txCoinStake;
+        int64_t nTxNewTime = 0;
+        assert(!setup.wallet.CreateCoinStake(setup.wallet, pindexPrev, STAKE_BITS, txCoinStake, nTxNewTime, &vCoins));
+    }
+}
+
+} // namespace
+
+static void WalletAvailableBalanceSmall(benchmark::State& state)
+{
+    AvailableBalance(state, SMALL_WALLET);
+}
+
+static void WalletAvailableBalanceLarge(benchmark::State& state)
+{
+    AvailableBalance(state, LARGE_WALLET);
+}
+
+static void WalletAvailableCoinsSmall(benchmark::State& state)
+{
+    AvailableCoins(state, SMALL_WALLET);
+}
+
+static void WalletAvailableCoinsLarge(benchmark::State& state)
+{
+    AvailableCoins(state, LARGE_WALLET);
+}
+
+static void WalletSelectCoinsMinConfSmall(benchmark::State& state)
+{
+    SelectCoinsMinConf(state, SMALL_WALLET);
+}
+
+static void WalletSelectCoinsMinConfLarge(benchmark::State& state)
+{
+    SelectCoinsMinConf(state, LARGE_WALLET);
+}
+
+static void WalletStakeSmall(benchmark::State& state)
+{
+    StakeableCoinsKernelSearch(state, SMALL_WALLET);
+}
+
+static void WalletStakeLarge(benchmark::State& state)
+{
+    StakeableCoinsKernelSearch(state, LARGE_WALLET);
+}
+
+// The shielded outputs of a block, trial-decrypted with NUM_IVKS viewing
+// keys. One output of the block is ours.
+static void WalletFindMySaplingNotes(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    CWallet wallet;
+    std::vector<libzcash::SaplingPaymentAddress> vAddresses;
+    {
+        LOCK(wallet.cs_wallet);
+        assert(wallet.SetupSPKM(false));
+        for (int i = 0; i < NUM_IVKS; i++) {
+            vAddresses.emplace_back(wallet.GenerateNewSaplingZKey());
+        }
+    }
+
+    std::array<unsigned char, ZC_MEMO_SIZE> memo = {{0xF6}};
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < NUM_SHIELDED_TXES; i++) {
+        CMutableTransaction tx;
+        tx.nVersion = CTransaction::TxVersion::SAPLING;
+        for (int j = 0; j < NUM_SHIELDED_OUTPUTS; j++) {
+            const bool fOurs = i == NUM_SHIELDED_TXES - 1 && j == 0;
+            const libzcash::SaplingPaymentAddress addr = fOurs ? vAddresses.back() : libzcash::SaplingSpendingKey::random().default_address();
+            libzcash::SaplingNote note(addr, 10 * COIN);
+            auto enc = libzcash::SaplingNotePlaintext(note, memo).encrypt(note.pk_d);
+            assert(enc);
+            OutputDescription output;
+            output.cv = GetRandHash();
+            output.cmu = *note.cmu();
+            output.ephemeralKey = enc->second.get_epk();
+            output.encCiphertext = enc->first;
+            tx.sapData->vShieldedOutput.emplace_back(output);
+        }
+        vtx.emplace_back(MakeTransactionRef(tx));
+    }
+
+    const SaplingScriptPubKeyMan* sspkm = wallet.GetSaplingScriptPubKeyMan();
+    while (state.KeepRunning()) {
+        assert(sspkm->FindMySaplingNotes(vtx).back().first.size() == 1);
+    }
+    SelectParams(CBaseChainParams::MAIN);
+}
+
+// A rescan of the chain, its blocks read from disk
+static void WalletRescan(benchmark::State& state)
+{
+    WalletSetup setup(SMALL_WALLET, true);
+    CBlockIndex* pindexStart = WITH_LOCK(cs_main, return chainActive.Genesis());
+    bool fFirst = true;
+    while (state.KeepRunning()) {
+        const int nFound = setup.wallet.ScanForWalletTransactions(pindexStart);
+        // the transactions are added by the first scan, only matched by the others
+        assert(nFound == (fFirst ? SMALL_WALLET : 0));
+        fFirst = false;
+    }
+}
+
+BENCHMARK(WalletAvailableBalanceSmall);
+BENCHMARK(WalletAvailableBalanceLarge);
+BENCHMARK(WalletAvailableCoinsSmall);
+BENCHMARK(WalletAvailableCoinsLarge);
+BENCHMARK(WalletSelectCoinsMinConfSmall);
+BENCHMARK(WalletSelectCoinsMinConfLarge);
+BENCHMARK(WalletStakeSmall);
+BENCHMARK(WalletStakeLarge);
+BENCHMARK(WalletFindMySaplingNotes);
+BENCHMARK(WalletRescan);
@@ -91,6 +91,9 @@ public:
                ((uint64_t)ptr[7]) << 56;
     }
 
+    //! Serialized as its memory, the vectors of blobs are too (see is_memory_serialized)
+    typedef base_blob memory_serialized_type;
+
     template<typename Stream>
     void Serialize(Stream& s) const
     {
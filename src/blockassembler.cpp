@@ -15,6 +15,7 @@
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
 #include "masternode-payments.h"
+#include "miner.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
@@ -40,6 +41,8 @@
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
+std::unique_ptr<BlockTemplateCache> g_blocktemplatecache;
+
 class ScoreCompare
 {
 public:
@@ -66,7 +69,8 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     return nNewTime - nOldTime;
 }
 
-bool SolveProofOfStake(CBlock* pblock, CBlockIndex* pindexPrev, CWallet* pwallet, std::vector<CStakeableOutput>* availableCoins)
+bool SolveProofOfStake(CBlock* pblock, CBlockIndex* pindexPrev, CWallet* pwallet, std::vector<CStakeableOutput>* availableCoins,
+                       const CStakeKernelSchedule* pschedule)
 {
     boost::this_thread::interruption_point();
     pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
@@ -76,7 +80,7 @@ bool SolveProofOfStake(CBlock* pblock, CBlockIndex* pindexPrev, CWallet* pwallet
 
     CMutableTransaction txCoinStake;
     int64_t nTxNewTime = 0;
-    if (!pwallet->CreateCoinStake(*pwallet, pindexPrev, pblock->nBits, txCoinStake, nTxNewTime, availableCoins)) {
+    if (!pwallet->CreateCoinStake(*pwallet, pindexPrev, pblock->nBits, txCoinStake, nTxNewTime, availableCoins, pschedule)) {
         LogPrint(BCLog::STAKING, "%s : stake not found\n", __func__);
         return false;
     }
@@ -147,6 +151,7 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    nSizeShielded = 0;
 
     lastFewTxs = 0;
     blockFinished = false;
@@ -155,7 +160,8 @@ void BlockAssembler::resetBlock()
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn,
                                                CWallet* pwallet,
                                                bool fProofOfStake,
-                                               std::vector<CStakeableOutput>* availableCoins)
+                                               std::vector<CStakeableOutput>* availableCoins,
+                                               const CStakeKernelSchedule* pschedule)
 {
     resetBlock();
 
@@ -179,16 +185,29 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
 
     // Depending on the tip height, try to find a coinstake who solves the block or create a coinbase tx.
-    if (!(fProofOfStake ? SolveProofOfStake(pblock, pindexPrev, pwallet, availableCoins)
+    if (!(fProofOfStake ? SolveProofOfStake(pblock, pindexPrev, pwallet, availableCoins, pschedule)
                         : CreateCoinbaseTx(pblock, scriptPubKeyIn, pindexPrev))) {
         return nullptr;
     }
+    // Staking telemetry: the time spent from here, but signing the block
+    const int64_t nTemplateStart = GetTimeMicros();
+    int64_t nSignTime = 0;
 
     {
         // Add transactions from mempool
-        LOCK2(cs_main,mempool.cs);
-        addPriorityTxs();
-        addScoreTxs();
+        BlockTxSelection selection;
+        if (!g_blocktemplatecache || !g_blocktemplatecache->Get(pindexPrev, selection)) {
+            LOCK2(cs_main, mempool.cs);
+            BlockAssembler(chainparams, defaultPrintPriority).SelectTransactions(pindexPrev, selection);
+        }
+        pblock->vtx.insert(pblock->vtx.end(), selection.vtx.begin(), selection.vtx.end());
+        pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), selection.vTxFees.begin(), selection.vTxFees.end());
+        pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), selection.vTxSigOps.begin(), selection.vTxSigOps.end());
+        nBlockSize = selection.nBlockSize;
+        nBlockTx = selection.vtx.size();
+        nBlockSigOps = selection.nBlockSigOps;
+        nFees = selection.nFees;
+        nSizeShielded = selection.nSizeShielded;
     }
 
     if (!fProofOfStake) {
@@ -215,15 +234,21 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (fProofOfStake) { // this is only for PoS because the IncrementExtraNonce does it for PoW
         pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
         LogPrintf("CPUMiner : proof-of-stake block found %s \n", pblock->GetHash().GetHex());
+        const int64_t nSignStart = GetTimeMicros();
         if (!SignBlock(*pblock, *pwallet)) {
             LogPrintf("%s: Signing new block with UTXO key failed \n", __func__);
             return nullptr;
         }
+        nSignTime = GetTimeMicros() - nSignStart;
     }
 
     {
         LOCK(cs_main);
-        if (chainActive.Tip() != pindexPrev) return nullptr; // new block came in, move on
+        if (chainActive.Tip() != pindexPrev) {
+            // new block came in, move on
+            if (fProofOfStake && pwallet->pStakerStatus) pwallet->pStakerStatus->AddStaleTip();
+            return nullptr;
+        }
 
         CValidationState state;
         if (!TestBlockValidity(state, *pblock, pindexPrev, false, false, false)) {
@@ -232,9 +257,85 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
         }
     }
 
+    if (fProofOfStake && pwallet->pStakerStatus) {
+        pwallet->pStakerStatus->SetTemplateTime(GetTimeMicros() - nTemplateStart - nSignTime);
+        pwallet->pStakerStatus->AddSignTime(nSignTime);
+    }
+
     return std::move(pblocktemplate);
 }
 
+void BlockAssembler::SelectTransactions(const CBlockIndex* pindexPrev, BlockTxSelection& selection)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    resetBlock();
+    pblocktemplate.reset(new CBlockTemplate());
+    pblock = &pblocktemplate->block;
+    nHeight = pindexPrev->nHeight + 1;
+
+    addPriorityTxs();
+    addScoreTxs();
+
+    selection.hashPrevBlock = pindexPrev->GetBlockHash();
+    selection.vtx = std::move(pblock->vtx);
+    selection.vTxFees = std::move(pblocktemplate->vTxFees);
+    selection.vTxSigOps = std::move(pblocktemplate->vTxSigOps);
+    selection.setTxHashes.clear();
+    for (const CTransactionRef& tx : selection.vtx) {
+        selection.setTxHashes.insert(tx->GetHash());
+    }
+    selection.nBlockSize = nBlockSize;
+    selection.nBlockSigOps = nBlockSigOps;
+    selection.nFees = nFees;
+    selection.nSizeShielded = nSizeShielded;
+}
+
+bool BlockAssembler::AppendTransaction(const CBlockIndex* pindexPrev, CTxMemPool::txiter iter, BlockTxSelection& selection)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    assert(selection.hashPrevBlock == pindexPrev->GetBlockHash());
+
+    const uint256& hash = iter->GetTx().GetHash();
+    if (selection.setTxHashes.count(hash)) {
+        return false;
+    }
+    // The parents must come first in the block
+    for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(iter)) {
+        if (!selection.setTxHashes.count(parent->GetTx().GetHash())) {
+            return false;
+        }
+    }
+
+    resetBlock();
+    nHeight = pindexPrev->nHeight + 1;
+    nBlockSize = selection.nBlockSize;
+    nBlockTx = selection.vtx.size();
+    nBlockSigOps = selection.nBlockSigOps;
+    nFees = selection.nFees;
+    nSizeShielded = selection.nSizeShielded;
+
+    // Same rules as addScoreTxs (the priority area only gets filled when the selection is rebuilt)
+    if (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(iter->GetTxSize()) && nBlockSize >= nBlockMinSize) {
+        return false;
+    }
+    if (!TestForBlock(iter)) {
+        return false;
+    }
+
+    selection.vtx.emplace_back(iter->GetSharedTx());
+    selection.vTxFees.push_back(iter->GetFee());
+    selection.vTxSigOps.push_back(iter->GetSigOpCount());
+    selection.setTxHashes.insert(hash);
+    selection.nBlockSize += iter->GetTxSize();
+    selection.nBlockSigOps += iter->GetSigOpCount();
+    selection.nFees += iter->GetFee();
+    if (iter->IsShielded()) selection.nSizeShielded += iter->GetTxSize();
+    return true;
+}
+
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter)
 {
     for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(iter)) {
@@ -448,6 +549,74 @@ void BlockAssembler::addPriorityTxs()
     }
 }
 
+bool BlockTemplateCache::Get(const CBlockIndex* pindexPrev, BlockTxSelection& selectionOut)
+{
+    LOCK2(cs_main, mempool.cs);
+    if (pindexPrev != chainActive.Tip()) {
+        return false;
+    }
+
+    LOCK(cs);
+    bool fStale = selection.hashPrevBlock != pindexPrev->GetBlockHash();
+    // The removals are notified in the background, the selection may be behind the mempool
+    for (auto it = selection.vtx.begin(); !fStale && it != selection.vtx.end(); ++it) {
+        fStale = !mempool.exists((*it)->GetHash());
+    }
+    if (fStale) {
+        Rebuild(pindexPrev);
+    }
+    selectionOut = selection;
+    return true;
+}
+
+void BlockTemplateCache::Rebuild(const CBlockIndex* pindexPrev)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    BlockAssembler(chainparams, DEFAULT_PRINTPRIORITY).SelectTransactions(pindexPrev, selection);
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(const CTransactionRef& ptx)
+{
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+    const CBlockIndex* pindexPrev = chainActive.Tip();
+    if (!pindexPrev || selection.hashPrevBlock != pindexPrev->GetBlockHash()) {
+        // stale, rebuilt by the next Get
+        return;
+    }
+    CTxMemPool::txiter it = mempool.mapTx.find(ptx->GetHash());
+    if (it != mempool.mapTx.end()) {
+        BlockAssembler(chainparams, DEFAULT_PRINTPRIORITY).AppendTransaction(pindexPrev, it, selection);
+    }
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef& ptx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    if (selection.setTxHashes.count(ptx->GetHash())) {
+        selection.hashPrevBlock.SetNull();
+    }
+}
+
+void BlockTemplateCache::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+    // Only build on the tip, the next blocks are notified next. No block is staked during the initial download.
+    if (pindex != chainActive.Tip() || IsInitialBlockDownload()) {
+        selection.hashPrevBlock.SetNull();
+        return;
+    }
+    Rebuild(pindex);
+}
+
+void BlockTemplateCache::BlockDisconnected(const std::shared_ptr<const CBlock>& block, const uint256& blockHash, int nBlockHeight, int64_t blockTime)
+{
+    LOCK(cs);
+    selection.hashPrevBlock.SetNull();
+}
+
 void BlockAssembler::appendSaplingTreeRoot()
 {
     // Update header
@@ -457,17 +626,22 @@ void BlockAssembler::appendSaplingTreeRoot()
 uint256 CalculateSaplingTreeRoot(CBlock* pblock, int nHeight, const CChainParams& chainparams)
 {
     if (NetworkUpgradeActive(nHeight, chainparams.GetConsensus(), Consensus::UPGRADE_V5_0)) {
+        const uint256 bestAnchor = pcoinsTip->GetBestAnchor();
         SaplingMerkleTree sapling_tree;
-        assert(pcoinsTip->GetSaplingAnchorAt(pcoinsTip->GetBestAnchor(), sapling_tree));
+        assert(pcoinsTip->GetSaplingAnchorAt(bestAnchor, sapling_tree));
 
-        // Update the Sapling commitment tree.
+        // Update the Sapling commitment tree, with all the commitments at once.
+        std::vector<libzcash::PedersenHash> vCommitments;
         for (const auto &tx : pblock->vtx) {
             if (tx->IsShieldedTx()) {
                 for (const OutputDescription &odesc : tx->sapData->vShieldedOutput) {
-                    sapling_tree.append(odesc.cmu);
+                    vCommitments.emplace_back(odesc.cmu);
                 }
             }
         }
+        // No new commitment: same root as the tip
+        if (vCommitments.empty()) return bestAnchor;
+        sapling_tree.append(vCommitments);
         return sapling_tree.root();
     }
     return UINT256_ZERO;
@@ -8,15 +8,19 @@
 #define DOGEC_BLOCKASSEMBLER_H
 
 #include "primitives/block.h"
+#include "sync.h"
 #include "txmempool.h"
+#include "validationinterface.h"
 
 #include <stdint.h>
 #include <memory>
+#include <set>
 
 class CBlockIndex;
 class CChainParams;
 class CReserveKey;
 class CStakeableOutput;
+class CStakeKernelSchedule;
 class CScript;
 class CWallet;
 
@@ -29,6 +33,23 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
 };
 
+/** The mempool transactions selected for a block, without its coinbase (or coinstake) */
+struct BlockTxSelection
+{
+    //! The block the selection was made on top of, null if it is stale
+    uint256 hashPrevBlock;
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    std::set<uint256> setTxHashes;
+
+    // The BlockAssembler counters once the transactions are added
+    uint64_t nBlockSize{0};
+    unsigned int nBlockSigOps{0};
+    CAmount nFees{0};
+    unsigned int nSizeShielded{0};
+};
+
 /** Generate a new block */
 class BlockAssembler
 {
@@ -68,7 +89,13 @@ public:
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn,
                                    CWallet* pwallet = nullptr,
                                    bool fProofOfStake = false,
-                                   std::vector<CStakeableOutput>* availableCoins = nullptr);
+                                   std::vector<CStakeableOutput>* availableCoins = nullptr,
+                                   const CStakeKernelSchedule* pschedule = nullptr);
+
+    /** Select the mempool transactions of a block on top of the tip pindexPrev. Requires cs_main and mempool.cs. */
+    void SelectTransactions(const CBlockIndex* pindexPrev, BlockTxSelection& selection);
+    /** Add a mempool transaction to a selection made on top of pindexPrev, if its parents are in and it fits. Requires cs_main and mempool.cs. */
+    bool AppendTransaction(const CBlockIndex* pindexPrev, CTxMemPool::txiter iter, BlockTxSelection& selection);
 
 private:
     // utility functions
@@ -92,6 +119,39 @@ private:
     bool isStillDependent(CTxMemPool::txiter iter);
 };
 
+/**
+ * The transactions for the next block, selected when the tip changes and
+ * extended as transactions enter the mempool (from the validation interface
+ * events), so that CreateNewBlock doesn't walk the whole mempool once the
+ * staker has found a kernel: the coinstake only has to be completed with the
+ * selection, and signed.
+ */
+class BlockTemplateCache : public CValidationInterface
+{
+public:
+    explicit BlockTemplateCache(const CChainParams& chainparams) : chainparams(chainparams) {}
+
+    /** Get the selection for a block on top of pindexPrev, rebuilt if stale. Returns false if pindexPrev isn't the tip. */
+    bool Get(const CBlockIndex* pindexPrev, BlockTxSelection& selectionOut);
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx, MemPoolRemovalReason reason) override;
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
+
+private:
+    const CChainParams& chainparams;
+
+    Mutex cs;
+    BlockTxSelection selection GUARDED_BY(cs);
+
+    void Rebuild(const CBlockIndex* pindexPrev) EXCLUSIVE_LOCKS_REQUIRED(cs);
+};
+
+/** The selection cache of the staker, null if it isn't running */
+extern std::unique_ptr<BlockTemplateCache> g_blocktemplatecache;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(std::shared_ptr<CBlock>& pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
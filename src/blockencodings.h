@@ -0,0 +1,203 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKENCODINGS_H
+#define BITCOIN_BLOCKENCODINGS_H
+
+#include "primitives/block.h"
+
+#include <limits>
+#include <memory>
+
+class CTxMemPool;
+
+//! The version of the compact blocks (BIP 152) announced in sendcmpct
+static const uint64_t CMPCTBLOCKS_VERSION = 1;
+
+/**
+ * The indexes of the transactions of a block that a peer asks us for
+ * (getblocktxn), after the reconstruction of a compact block. They are
+ * differentially encoded on the wire.
+ */
+class BlockTransactionsRequest
+{
+public:
+    uint256 blockhash;
+    std::vector<uint16_t> indexes;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << blockhash;
+        WriteCompactSize(s, indexes.size());
+        for (size_t i = 0; i < indexes.size(); i++) {
+            WriteCompactSize(s, indexes[i] - (i == 0 ? 0 : (indexes[i - 1] + 1)));
+        }
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> blockhash;
+        uint64_t nCount = ReadCompactSize(s);
+        indexes.clear();
+        uint64_t nOffset = 0;
+        for (uint64_t i = 0; i < nCount; i++) {
+            uint64_t nIndex = ReadCompactSize(s) + nOffset;
+            if (nIndex > std::numeric_limits<uint16_t>::max()) {
+                throw std::ios_base::failure("index overflowed 16 bits");
+            }
+            // Grow the vector with the data actually read, not with the announced count
+            indexes.push_back(nIndex);
+            nOffset = nIndex + 1;
+        }
+    }
+};
+
+/** The transactions of a block requested by a getblocktxn (blocktxn) */
+class BlockTransactions
+{
+public:
+    uint256 blockhash;
+    std::vector<CTransactionRef> txn;
+
+    BlockTransactions() {}
+    explicit BlockTransactions(const BlockTransactionsRequest& req) : blockhash(req.blockhash), txn(req.indexes.size()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(blockhash);
+        READWRITE(txn);
+    }
+};
+
+/** A transaction sent in full within a compact block, with its differentially encoded index */
+struct PrefilledTransaction {
+    uint16_t index;
+    CTransactionRef tx;
+};
+
+typedef enum ReadStatus_t
+{
+    READ_STATUS_OK,
+    READ_STATUS_INVALID, // Invalid object, peer is sending bogus crap
+    READ_STATUS_FAILED, // Failed to process object, e.g. short ID collision: fall back to the full block
+} ReadStatus;
+
+/**
+ * A compact block (cmpctblock): the header, the 6-byte short IDs of the
+ * transactions that the receiver probably has in its mempool, the prefilled
+ * transactions that it can't have, and the block signature.
+ * The coinbase and, in the proof of stake blocks, the coinstake are always
+ * prefilled as they never go through the mempool.
+ */
+class CBlockHeaderAndShortTxIDs
+{
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+    friend class PartiallyDownloadedBlock;
+
+protected:
+    std::vector<uint64_t> shorttxids;
+    std::vector<PrefilledTransaction> prefilledtxn;
+
+public:
+    static const int SHORTTXIDS_LENGTH = 6;
+
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    // Dummy for deserialization
+    CBlockHeaderAndShortTxIDs() {}
+
+    explicit CBlockHeaderAndShortTxIDs(const CBlock& block);
+
+    uint64_t GetShortID(const uint256& txhash) const;
+
+    size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s << header << nonce;
+        WriteCompactSize(s, shorttxids.size());
+        for (const uint64_t shorttxid : shorttxids) {
+            ser_writedata32(s, shorttxid & 0xffffffff);
+            ser_writedata16(s, (shorttxid >> 32) & 0xffff);
+        }
+        WriteCompactSize(s, prefilledtxn.size());
+        for (size_t i = 0; i < prefilledtxn.size(); i++) {
+            WriteCompactSize(s, prefilledtxn[i].index - (i == 0 ? 0 : (prefilledtxn[i - 1].index + 1)));
+            s << prefilledtxn[i].tx;
+        }
+        s << vchBlockSig;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s >> header >> nonce;
+        uint64_t nCount = ReadCompactSize(s);
+        shorttxids.clear();
+        for (uint64_t i = 0; i < nCount; i++) {
+            uint64_t lsb = ser_readdata32(s);
+            uint64_t msb = ser_readdata16(s);
+            shorttxids.push_back((msb << 32) | lsb);
+        }
+        nCount = ReadCompactSize(s);
+        prefilledtxn.clear();
+        uint64_t nOffset = 0;
+        for (uint64_t i = 0; i < nCount; i++) {
+            uint64_t nIndex = ReadCompactSize(s) + nOffset;
+            if (nIndex > std::numeric_limits<uint16_t>::max()) {
+                throw std::ios_base::failure("index overflowed 16 bits");
+            }
+            PrefilledTransaction prefilled;
+            prefilled.index = nIndex;
+            s >> prefilled.tx;
+            prefilledtxn.push_back(std::move(prefilled));
+            nOffset = nIndex + 1;
+        }
+        s >> vchBlockSig;
+
+        if (BlockTxCount() > std::numeric_limits<uint16_t>::max()) {
+            throw std::ios_base::failure("indexes overflowed 16 bits");
+        }
+        FillShortTxIDSelector();
+    }
+};
+
+/**
+ * A block being reconstructed from a compact block and the mempool, waiting
+ * for the missing transactions (blocktxn) if any.
+ */
+class PartiallyDownloadedBlock
+{
+protected:
+    std::vector<CTransactionRef> txn_available;
+    size_t prefilled_count = 0, mempool_count = 0;
+    CTxMemPool* pool;
+
+public:
+    CBlockHeader header;
+    std::vector<unsigned char> vchBlockSig;
+
+    explicit PartiallyDownloadedBlock(CTxMemPool* poolIn) : pool(poolIn) {}
+
+    ReadStatus InitData(const CBlockHeaderAndShortTxIDs& cmpctblock);
+    bool IsTxAvailable(size_t index) const;
+    size_t GetMempoolCount() const { return mempool_count; }
+    /** Fill the block with the transactions found and vtx_missing, in the order of the missing indexes */
+    ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
+};
+
+#endif // BITCOIN_BLOCKENCODINGS_H
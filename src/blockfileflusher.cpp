@@ -0,0 +1,155 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfileflusher.h"
+
+#include "util.h"
+#include "validation.h"
+
+#include <climits>
+
+CBlockFileFlusher g_blockfileflusher;
+
+unsigned int CBlockFileFlusher::Task::ChangesFrom(bool fUndoIn) const
+{
+    switch (type) {
+    case ALLOCATE:
+        // the preallocation may set the end of the file, nothing is to be written past it meanwhile
+        return fUndo == fUndoIn ? nOffset : UINT_MAX;
+    case FINALIZE:
+        return fUndoIn ? nLength : nOffset;
+    default:
+        return UINT_MAX;
+    }
+}
+
+CBlockFileFlusher::~CBlockFileFlusher()
+{
+    Stop();
+}
+
+void CBlockFileFlusher::Start()
+{
+    assert(!threadFlusher.joinable());
+    {
+        LOCK(cs);
+        fStop = false;
+        fRunning = true;
+    }
+    threadFlusher = std::thread(&TraceThread<std::function<void()> >, "blkfiles", std::function<void()>(std::bind(&CBlockFileFlusher::ThreadFlusher, this)));
+}
+
+void CBlockFileFlusher::Stop()
+{
+    {
+        LOCK(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    // the queued tasks are completed first
+    if (threadFlusher.joinable()) threadFlusher.join();
+}
+
+void CBlockFileFlusher::Push(const Task& task)
+{
+    {
+        LOCK(cs);
+        if (fRunning) {
+            queue.push_back(task);
+            cond.notify_all();
+            return;
+        }
+    }
+    Run(task);
+}
+
+void CBlockFileFlusher::Allocate(bool fUndo, int nFile, unsigned int nOffset, unsigned int nLength)
+{
+    Push({Task::ALLOCATE, nFile, fUndo, nOffset, nLength});
+}
+
+void CBlockFileFlusher::Commit(int nFile)
+{
+    Push({Task::COMMIT, nFile, false, 0, 0});
+}
+
+void CBlockFileFlusher::Finalize(int nFile, unsigned int nSize, unsigned int nUndoSize)
+{
+    Push({Task::FINALIZE, nFile, false, nSize, nUndoSize});
+}
+
+void CBlockFileFlusher::WaitForWrite(bool fUndo, int nFile, unsigned int nPos, unsigned int nEnd)
+{
+    WAIT_LOCK(cs, lock);
+    cond.wait(lock, [&] {
+        for (const Task& task : queue) {
+            if (task.nFile == nFile && task.ChangesFrom(fUndo) < nEnd) return false;
+        }
+        return true;
+    });
+}
+
+void CBlockFileFlusher::Sync()
+{
+    WAIT_LOCK(cs, lock);
+    cond.wait(lock, [this] { return queue.empty(); });
+}
+
+void CBlockFileFlusher::Run(const Task& task)
+{
+    CDiskBlockPos pos(task.nFile, 0);
+    if (task.type == Task::ALLOCATE) {
+        FILE* file = task.fUndo ? OpenUndoFile(pos) : OpenBlockFile(pos);
+        if (file) {
+            LogPrintf("Pre-allocating up to position 0x%x in %s%05u.dat\n", task.nOffset + task.nLength, task.fUndo ? "rev" : "blk", task.nFile);
+            AllocateFileRange(file, task.nOffset, task.nLength);
+            fclose(file);
+        }
+        return;
+    }
+
+    const bool fFinalize = (task.type == Task::FINALIZE);
+    FILE* file = OpenBlockFile(pos);
+    if (file) {
+        if (fFinalize)
+            TruncateFile(file, task.nOffset);
+        FileCommit(file);
+        fclose(file);
+    }
+
+    file = OpenUndoFile(pos);
+    if (file) {
+        if (fFinalize)
+            TruncateFile(file, task.nLength);
+        FileCommit(file);
+        fclose(file);
+    }
+}
+
+void CBlockFileFlusher::ThreadFlusher()
+{
+    while (true) {
+        Task task;
+        {
+            WAIT_LOCK(cs, lock);
+            cond.wait(lock, [this] { return !queue.empty() || fStop; });
+            if (queue.empty()) {
+                fRunning = false;
+                return;
+            }
+            task = queue.front();
+        }
+        // still in the queue while it runs, for WaitForWrite and Sync
+        try {
+            Run(task);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        {
+            LOCK(cs);
+            queue.pop_front();
+        }
+        cond.notify_all();
+    }
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_BLOCKFILEFLUSHER_H
+#define DOGEC_BLOCKFILEFLUSHER_H
+
+#include "sync.h"
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+/**
+ * Background thread for the slow operations on the block and undo files: the
+ * preallocation of their chunks, the fsync of their data and the truncation
+ * of the files left behind. They run in the order they were queued.
+ *
+ * Validation only waits for them when a write would touch a range an
+ * operation still pending is about to change (WaitForWrite), and before the
+ * block index is written: Sync returns once the operations queued before are
+ * done, so the block index never refers to data that is not on disk.
+ * Until Start is called, and after Stop, the operations run inline.
+ */
+class CBlockFileFlusher
+{
+public:
+    ~CBlockFileFlusher();
+
+    void Start();
+    //! Completes the queued operations and joins the thread
+    void Stop();
+
+    //! Preallocates [nOffset, nOffset + nLength) of the block (or undo) file nFile
+    void Allocate(bool fUndo, int nFile, unsigned int nOffset, unsigned int nLength);
+    //! Writes the data of the block and undo files nFile to disk
+    void Commit(int nFile);
+    //! Truncates the block and undo files nFile to their sizes, and commits them
+    void Finalize(int nFile, unsigned int nSize, unsigned int nUndoSize);
+
+    //! Waits for the pending operations that conflict with a write of [nPos, nEnd) to the file
+    void WaitForWrite(bool fUndo, int nFile, unsigned int nPos, unsigned int nEnd);
+    //! Waits for all the queued operations
+    void Sync();
+
+private:
+    struct Task {
+        enum Type { ALLOCATE, COMMIT, FINALIZE };
+        Type type;
+        int nFile;
+        bool fUndo;
+        //! ALLOCATE: range to preallocate. FINALIZE: the block and undo file sizes.
+        unsigned int nOffset;
+        unsigned int nLength;
+
+        //! Offset from which the task may change the block (or undo) file, UINT_MAX if it does not
+        unsigned int ChangesFrom(bool fUndoIn) const;
+    };
+
+    mutable Mutex cs;
+    std::condition_variable cond;
+    //! The queued tasks, the front one is running until it is popped
+    std::deque<Task> queue;
+    bool fStop{false};
+    //! Whether the tasks are queued for the thread, until it exits
+    bool fRunning{false};
+    std::thread threadFlusher;
+
+    void Push(const Task& task);
+    static void Run(const Task& task);
+    void ThreadFlusher();
+};
+
+extern CBlockFileFlusher g_blockfileflusher;
+
+#endif // DOGEC_BLOCKFILEFLUSHER_H
@@ -0,0 +1,102 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockprecheck.h"
+
+#include "kernel.h"
+#include "logging.h"
+#include "util/threadnames.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+CBlockPreCheckQueue blockprecheckqueue(MAX_BLOCKS_PRECHECK_QUEUE);
+
+void CBlockPreCheckQueue::SetNotifyCallback(std::function<void()> func)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    notify = std::move(func);
+}
+
+bool CBlockPreCheckQueue::Push(const std::shared_ptr<const CBlock>& pblock, NodeId nodeid)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0 || queue.size() >= nMaxSize)
+            return false;
+        queue.push_back(Entry{pblock, nodeid, false});
+        setHashes.insert(pblock->GetHash());
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+std::vector<CBlockPreCheckQueue::Entry> CBlockPreCheckQueue::PopChecked(bool fWait)
+{
+    std::vector<Entry> vRet;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (fWait && nWorkers > 0 && !queue.empty() && !queue.front().fDone) {
+        condDone.wait(lock);
+    }
+    while (!queue.empty() && queue.front().fDone) {
+        setHashes.erase(queue.front().pblock->GetHash());
+        vRet.emplace_back(std::move(queue.front()));
+        queue.pop_front();
+        nNextToCheck--;
+    }
+    return vRet;
+}
+
+bool CBlockPreCheckQueue::Contains(const uint256& hash) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return setHashes.count(hash) > 0;
+}
+
+bool CBlockPreCheckQueue::Empty() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.empty();
+}
+
+void CBlockPreCheckQueue::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nWorkers++;
+    try {
+        while (true) {
+            while (nNextToCheck >= queue.size()) {
+                condWorker.wait(lock); // interruption point
+            }
+            // References to deque elements survive insertions at the back, and
+            // the entry can't be popped before it's done.
+            Entry& entry = queue[nNextToCheck++];
+            std::shared_ptr<const CBlock> pblock = entry.pblock;
+            lock.unlock();
+            try {
+                if (PreCheckBlock(*pblock)) PreCheckProofOfStake(*pblock);
+            } catch (const std::exception& e) {
+                // leave it to CheckBlock
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+            lock.lock();
+            entry.fDone = true;
+            std::function<void()> func = notify;
+            lock.unlock();
+            condDone.notify_all();
+            if (func) func();
+            lock.lock();
+        }
+    } catch (const boost::thread_interrupted&) {
+        if (!lock.owns_lock()) lock.lock();
+        nWorkers--;
+        throw;
+    }
+}
+
+void ThreadBlockPreCheck()
+{
+    util::ThreadRename("dogecash-blockch");
+    blockprecheckqueue.Thread();
+}
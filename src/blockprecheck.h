@@ -0,0 +1,75 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKPRECHECK_H
+#define BITCOIN_BLOCKPRECHECK_H
+
+#include "net.h"
+#include "primitives/block.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Maximum number of received blocks held while waiting for their context-free checks */
+static const unsigned int MAX_BLOCKS_PRECHECK_QUEUE = 64;
+
+/**
+ * Blocks received ahead of the tip, waiting for their context-free checks
+ * (PreCheckBlock) to run on worker threads. The message handler takes them
+ * back in arrival order once checked, so that they reach ProcessNewBlock in
+ * the order they were received, with proof of work, merkle root and block
+ * signature already verified. The proof of stake is verified too when the
+ * parent block is already indexed (PreCheckProofOfStake).
+ */
+class CBlockPreCheckQueue
+{
+public:
+    struct Entry {
+        std::shared_ptr<const CBlock> pblock;
+        NodeId nodeid;
+        bool fDone;
+    };
+
+    explicit CBlockPreCheckQueue(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    //! Called (without the queue lock held) every time a block has been checked
+    void SetNotifyCallback(std::function<void()> func);
+
+    //! Queue a block received from nodeid. Returns false if the queue is full or no worker is running.
+    bool Push(const std::shared_ptr<const CBlock>& pblock, NodeId nodeid);
+
+    //! Take the checked blocks from the front of the queue. With fWait, wait for the front block if it isn't checked yet.
+    std::vector<Entry> PopChecked(bool fWait);
+
+    bool Contains(const uint256& hash) const;
+    bool Empty() const;
+
+    //! Worker loop, exits when the thread is interrupted
+    void Thread();
+
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDone;
+    //! In arrival order. Entries before nNextToCheck are taken by a worker (or done).
+    std::deque<Entry> queue;
+    size_t nNextToCheck{0};
+    std::set<uint256> setHashes;
+    int nWorkers{0};
+    const size_t nMaxSize;
+    std::function<void()> notify;
+};
+
+extern CBlockPreCheckQueue blockprecheckqueue;
+
+/** Run a worker of blockprecheckqueue */
+void ThreadBlockPreCheck();
+
+#endif // BITCOIN_BLOCKPRECHECK_H
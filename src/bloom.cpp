@@ -154,7 +154,83 @@ bool CBloomFilter::Merge(const CBloomFilter& filter) {
     return true;
 }
 
+// The data pushes of a script, until the first invalid opcode
+static void GetScriptPushes(const CScript& script, std::vector<CMurmurHash3Data>& vPushes)
+{
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> data;
+    while (pc < script.end()) {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            vPushes.emplace_back(data);
+    }
+}
+
+static CMurmurHash3Data SerializeOutPoint(const COutPoint& outpoint)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << outpoint;
+    return CMurmurHash3Data((const unsigned char*) stream.data(), stream.size());
+}
+
+CBloomFilterTx::CBloomFilterTx(const CTransaction& tx) : hash(tx.GetHash()), hashData(hash.begin(), hash.size())
+{
+    vOutputs.resize(tx.vout.size());
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        const CScript& script = tx.vout[i].scriptPubKey;
+        GetScriptPushes(script, vOutputs[i].vPushes);
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        vOutputs[i].fPayToPubkey = Solver(script, type, vSolutions) && (type == TX_PUBKEY || type == TX_MULTISIG);
+    }
+    vInputs.reserve(tx.vin.size());
+    for (const CTxIn& txin : tx.vin) {
+        vInputs.emplace_back(SerializeOutPoint(txin.prevout));
+        GetScriptPushes(txin.scriptSig, vInputs.back().vPushes);
+    }
+}
+
+bool CBloomFilter::contains(const CMurmurHash3Data& data) const
+{
+    if (isFull) {
+        return true;
+    }
+    if (isEmpty) {
+        return false;
+    }
+    // The hash functions are run by groups, stopping at the first unset bit
+    static const unsigned int GROUP = 8;
+    uint32_t seeds[GROUP];
+    uint32_t hashes[GROUP];
+    const uint32_t nBits = vData.size() * 8;
+    for (unsigned int i = 0; i < nHashFuncs; i += GROUP) {
+        const unsigned int n = std::min(GROUP, nHashFuncs - i);
+        for (unsigned int j = 0; j < n; j++) {
+            // 0xFBA4C795 as in Hash()
+            seeds[j] = (i + j) * 0xFBA4C795 + nTweak;
+        }
+        data.Hash(seeds, hashes, n);
+        for (unsigned int j = 0; j < n; j++) {
+            const uint32_t nIndex = hashes[j] % nBits;
+            if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+                return false;
+        }
+    }
+    return true;
+}
+
 bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    return IsRelevantAndUpdate(CBloomFilterTx(tx));
+}
+
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomFilterTx& tx)
 {
     bool fFound = false;
     // Match if the filter contains the hash of tx
@@ -163,35 +239,22 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
         return true;
     if (isEmpty)
         return false;
-    const uint256& hash = tx.GetHash();
-    if (contains(hash))
+    if (contains(tx.hashData))
         fFound = true;
 
-    for (unsigned int i = 0; i < tx.vout.size(); i++) {
-        const CTxOut& txout = tx.vout[i];
+    for (unsigned int i = 0; i < tx.vOutputs.size(); i++) {
+        const CBloomFilterTx::Output& output = tx.vOutputs[i];
         // Match if the filter contains any arbitrary script data element in any scriptPubKey in tx
         // If this matches, also add the specific output that was matched.
         // This means clients don't have to update the filter themselves when a new relevant tx
         // is discovered in order to find spending transactions, which avoids round-tripping and race conditions.
-        CScript::const_iterator pc = txout.scriptPubKey.begin();
-        std::vector<unsigned char> data;
-        while (pc < txout.scriptPubKey.end()) {
-            opcodetype opcode;
-            if (!txout.scriptPubKey.GetOp(pc, opcode, data)){
-                break;
-            }
-
-            if (data.size() != 0 && contains(data)) {
+        for (const CMurmurHash3Data& data : output.vPushes) {
+            if (contains(data)) {
                 fFound = true;
                 if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
-                    insert(COutPoint(hash, i));
-                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY) {
-                    txnouttype type;
-                    std::vector<std::vector<unsigned char> > vSolutions;
-                    if (Solver(txout.scriptPubKey, type, vSolutions) &&
-                        (type == TX_PUBKEY || type == TX_MULTISIG))
-                        insert(COutPoint(hash, i));
-                }
+                    insert(COutPoint(tx.hash, i));
+                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY && output.fPayToPubkey)
+                    insert(COutPoint(tx.hash, i));
                 break;
             }
         }
@@ -200,21 +263,15 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     if (fFound)
         return true;
 
-    for (const CTxIn& txin : tx.vin) {
+    for (const CBloomFilterTx::Input& input : tx.vInputs) {
         // Match if the filter contains an outpoint tx spends
-        if (contains(txin.prevout))
+        if (contains(input.prevout))
             return true;
 
         // Match if the filter contains any arbitrary script data element in any scriptSig in tx
-        CScript::const_iterator pc = txin.scriptSig.begin();
-        std::vector<unsigned char> data;
-        while (pc < txin.scriptSig.end()) {
-            opcodetype opcode;
-            if (!txin.scriptSig.GetOp(pc, opcode, data))
-                break;
-            if (data.size() != 0 && contains(data)) {
+        for (const CMurmurHash3Data& data : input.vPushes) {
+            if (contains(data))
                 return true;
-            }
         }
     }
 
@@ -316,3 +373,44 @@ void CRollingBloomFilter::reset()
         *it = 0;
     }
 }
+
+CHashBloomFilter::CHashBloomFilter(size_t nElementsIn, double nFPRate) :
+    k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    k1(GetRand(std::numeric_limits<uint64_t>::max())),
+    nElements(std::max<size_t>(nElementsIn, 1))
+{
+    // Same sizing as CBloomFilter, without the protocol limits
+    const double nBits = -1 / LN2SQUARED * nElements * log(nFPRate);
+    vData.resize(std::max<size_t>((size_t) (nBits / 64) + 1, 1));
+    nHashFuncs = std::max(1u, std::min((unsigned int) (vData.size() * 64 / nElements * LN2), MAX_HASH_FUNCS));
+}
+
+// The n-th position of the hash, by double hashing of a single (salted) SipHash
+static inline size_t HashBloomPosition(uint64_t h, unsigned int n, size_t nBits)
+{
+    return (size_t) (((h & 0xFFFFFFFF) + n * (h >> 32)) % nBits);
+}
+
+void CHashBloomFilter::insert(const uint256& hash)
+{
+    const uint64_t h = SipHashUint256(k0, k1, hash);
+    const size_t nBits = vData.size() * 64;
+    for (unsigned int n = 0; n < nHashFuncs; n++) {
+        const size_t pos = HashBloomPosition(h, n, nBits);
+        vData[pos >> 6] |= (uint64_t) 1 << (pos & 63);
+    }
+    nInserted++;
+}
+
+bool CHashBloomFilter::contains(const uint256& hash) const
+{
+    const uint64_t h = SipHashUint256(k0, k1, hash);
+    const size_t nBits = vData.size() * 64;
+    for (unsigned int n = 0; n < nHashFuncs; n++) {
+        const size_t pos = HashBloomPosition(h, n, nBits);
+        if (!(vData[pos >> 6] & ((uint64_t) 1 << (pos & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -7,13 +7,14 @@
 #ifndef BITCOIN_BLOOM_H
 #define BITCOIN_BLOOM_H
 
+#include "hash.h"
 #include "serialize.h"
+#include "uint256.h"
 
 #include <vector>
 
 class COutPoint;
 class CTransaction;
-class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -31,6 +32,33 @@ enum bloomflags {
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The items of a transaction that the bloom filters match (its hash, the data
+ * pushes of its scripts and the outpoints it spends), parsed and pre-hashed
+ * once, to be matched against the filters of many peers (see CFilteredBlockData).
+ */
+class CBloomFilterTx
+{
+public:
+    struct Output {
+        std::vector<CMurmurHash3Data> vPushes;
+        //! Pay-to-pubkey or multisig, for BLOOM_UPDATE_P2PUBKEY_ONLY
+        bool fPayToPubkey{false};
+    };
+    struct Input {
+        CMurmurHash3Data prevout;
+        std::vector<CMurmurHash3Data> vPushes;
+        explicit Input(const CMurmurHash3Data& prevoutIn) : prevout(prevoutIn) {}
+    };
+
+    uint256 hash;
+    CMurmurHash3Data hashData;
+    std::vector<Output> vOutputs;
+    std::vector<Input> vInputs;
+
+    explicit CBloomFilterTx(const CTransaction& tx);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we sends them.
@@ -54,6 +82,8 @@ private:
 
     unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
 
+    bool contains(const CMurmurHash3Data& data) const;
+
 public:
     /**
      * Creates a new bloom filter which will provide the given fp rate when filled with the given number of elements
@@ -98,6 +128,7 @@ public:
 
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
+    bool IsRelevantAndUpdate(const CBloomFilterTx& tx);
 
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
@@ -152,4 +183,35 @@ private:
     }
 };
 
+/**
+ * HashBloomFilter is a probabilistic set of 256-bit hashes, with no protocol
+ * size limit, kept in front of a database so that the lookups of absent keys
+ * are answered from memory.
+ *
+ * contains(item) always returns true if item was insert()'ed ... but may also
+ * return true for items that were not inserted. Items can't be removed: the
+ * ones erased from the database are false positives until the filter is
+ * built again. Construct it with the number of items it will hold, beyond
+ * which the false-positive rate grows.
+ */
+class CHashBloomFilter
+{
+public:
+    CHashBloomFilter(size_t nElementsIn, double nFPRate);
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+
+    //! Number of insert() calls since the creation
+    size_t size() const { return nInserted; }
+    size_t capacity() const { return nElements; }
+
+private:
+    std::vector<uint64_t> vData;
+    unsigned int nHashFuncs;
+    uint64_t k0, k1;
+    size_t nElements;
+    size_t nInserted{0};
+};
+
 #endif // BITCOIN_BLOOM_H
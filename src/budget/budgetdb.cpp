@@ -9,8 +9,7 @@
 
 #include "chainparams.h"
 #include "clientversion.h"
-
-static const int BUDGET_DB_VERSION = 1;
+#include "tiertwodb.h"
 
 //
 // CBudgetDB
@@ -22,39 +21,7 @@ CBudgetDB::CBudgetDB()
     strMagicMessage = "MasternodeBudget";
 }
 
-bool CBudgetDB::Write(const CBudgetManager& objToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << BUDGET_DB_VERSION;
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathDB, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint(BCLog::MNBUDGET,"Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
-}
-
-CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
+CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad)
 {
     int64_t nStart = GetTimeMillis();
     // open input file, and associate with CAutoFile
@@ -128,22 +95,17 @@ CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
 
     LogPrint(BCLog::MNBUDGET,"Loaded info from budget.dat (dbversion=%d) %dms\n", version, GetTimeMillis() - nStart);
     LogPrint(BCLog::MNBUDGET,"%s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint(BCLog::MNBUDGET,"Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint(BCLog::MNBUDGET,"Budget manager - result: %s\n", objToLoad.ToString());
-    }
 
     return Ok;
 }
 
 void DumpBudgets(CBudgetManager& budgetman)
 {
+    if (!pTierTwoDB) return;
     int64_t nStart = GetTimeMillis();
 
-    CBudgetDB budgetdb;
-    LogPrint(BCLog::MNBUDGET,"Writing info to budget.dat...\n");
-    budgetdb.Write(budgetman);
+    LogPrint(BCLog::MNBUDGET,"Writing the budget changes to the tier two database...\n");
+    budgetman.FlushToDB(*pTierTwoDB);
 
     LogPrint(BCLog::MNBUDGET,"Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
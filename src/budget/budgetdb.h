@@ -11,10 +11,11 @@
 #include "budget/budgetmanager.h"
 #include "fs.h"
 
+/** Writes the budget changes to the tier two database */
 void DumpBudgets(CBudgetManager& budgetman);
 
 
-/** Save Budget Manager (budget.dat)
+/** Former Budget Manager file (budget.dat), read once to fill a new tier two database
  */
 class CBudgetDB
 {
@@ -34,8 +35,7 @@ public:
     };
 
     CBudgetDB();
-    bool Write(const CBudgetManager& objToSave);
-    ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
+    ReadResult Read(CBudgetManager& objToLoad);
 };
 
 #endif // BUDGET_DB_H
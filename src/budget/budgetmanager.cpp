@@ -11,11 +11,17 @@
 #include "masternodeman.h"
 #include "net_processing.h"
 #include "netmessagemaker.h"
+#include "tiertwodb.h"
+#include "txdb.h"
 #include "validation.h"   // GetTransaction, cs_main
+#include "validationinterface.h"
 
 
 CBudgetManager g_budgetman;
 
+// Max number of block heights with a cached highest-voted finalized budget
+static const size_t MAX_HIGHEST_BUDGET_CACHE = 1000;
+
 std::map<uint256, int64_t> askedForSourceProposalOrBudget;
 
 // Used to check both proposals and finalized-budgets collateral txes
@@ -222,6 +228,8 @@ bool CBudgetManager::AddFinalizedBudget(CFinalizedBudget& finalizedBudget)
     {
         LOCK(cs_budgets);
         mapFinalizedBudgets.emplace(nHash, finalizedBudget);
+        setChangedBudgets.emplace(nHash);
+        UpdateHighestVoteCount(nHash);
         // Add to feeTx index
         mapFeeTxToBudget.emplace(feeTxId, nHash);
         // Remove the budget from the unconfirmed map, if it was there
@@ -267,6 +275,8 @@ bool CBudgetManager::AddProposal(CBudgetProposal& budgetProposal)
     {
         LOCK(cs_proposals);
         mapProposals.emplace(nHash, budgetProposal);
+        setChangedProposals.emplace(nHash);
+        RankProposal(budgetProposal);
         // Add to feeTx index
         mapFeeTxToProposal.emplace(feeTxId, nHash);
     }
@@ -290,6 +300,7 @@ void CBudgetManager::CheckAndRemove()
             if (!pbudgetProposal->UpdateValid(nCurrentHeight)) {
                 LogPrint(BCLog::MNBUDGET,"%s: Invalid budget proposal %s %s\n", __func__, (it.first).ToString(), pbudgetProposal->IsInvalidLogStr());
                 mapFeeTxToProposal.erase(pbudgetProposal->GetFeeTXHash());
+                setChangedProposals.emplace(it.first);
             } else {
                  LogPrint(BCLog::MNBUDGET,"%s: Found valid budget proposal: %s %s\n", __func__,
                           pbudgetProposal->GetName(), pbudgetProposal->GetFeeTXHash().ToString());
@@ -298,6 +309,7 @@ void CBudgetManager::CheckAndRemove()
         }
         // Remove invalid entries by overwriting complete map
         mapProposals.swap(tmpMapProposals);
+        RebuildRanking();
         LogPrint(BCLog::MNBUDGET, "%s: mapProposals cleanup - size after: %d\n", __func__, mapProposals.size());
     }
 
@@ -310,6 +322,7 @@ void CBudgetManager::CheckAndRemove()
             if (!pfinalizedBudget->UpdateValid(nCurrentHeight)) {
                 LogPrint(BCLog::MNBUDGET,"%s: Invalid finalized budget %s %s\n", __func__, (it.first).ToString(), pfinalizedBudget->IsInvalidLogStr());
                 mapFeeTxToBudget.erase(pfinalizedBudget->GetFeeTXHash());
+                setChangedBudgets.emplace(it.first);
             } else {
                 LogPrint(BCLog::MNBUDGET,"%s: Found valid finalized budget: %s %s\n", __func__,
                           pfinalizedBudget->GetName(), pfinalizedBudget->GetFeeTXHash().ToString());
@@ -318,6 +331,7 @@ void CBudgetManager::CheckAndRemove()
         }
         // Remove invalid entries by overwriting complete map
         mapFinalizedBudgets = tmpMapFinalizedBudgets;
+        mapHighestBudgetByHeight.clear();
         LogPrint(BCLog::MNBUDGET, "%s: mapFinalizedBudgets cleanup - size after: %d\n", __func__, mapFinalizedBudgets.size());
     }
     // Masternodes vote on valid ones
@@ -344,7 +358,9 @@ void CBudgetManager::RemoveByFeeTxId(const uint256& feeTxId)
                     }
                 }
                 // Erase proposal object
+                UnrankProposal(*p);
                 mapProposals.erase(it->second);
+                setChangedProposals.emplace(it->second);
             }
             // Remove from collateral index
             mapFeeTxToProposal.erase(it);
@@ -370,6 +386,8 @@ void CBudgetManager::RemoveByFeeTxId(const uint256& feeTxId)
                 }
                 // Erase finalized budget object
                 mapFinalizedBudgets.erase(it->second);
+                setChangedBudgets.emplace(it->second);
+                mapHighestBudgetByHeight.clear();
             }
             // Remove from collateral index
             mapFeeTxToBudget.erase(it);
@@ -380,6 +398,13 @@ void CBudgetManager::RemoveByFeeTxId(const uint256& feeTxId)
 const CFinalizedBudget* CBudgetManager::GetBudgetWithHighestVoteCount(int chainHeight) const
 {
     LOCK(cs_budgets);
+    const auto& itCached = mapHighestBudgetByHeight.find(chainHeight);
+    if (itCached != mapHighestBudgetByHeight.end()) {
+        if (itCached->second.IsNull()) return nullptr;
+        const auto& it = mapFinalizedBudgets.find(itCached->second);
+        if (it != mapFinalizedBudgets.end()) return &(it->second);
+    }
+
     int highestVoteCount = 0;
     const CFinalizedBudget* pHighestBudget = nullptr;
     for (const auto& it: mapFinalizedBudgets) {
@@ -392,9 +417,33 @@ const CFinalizedBudget* CBudgetManager::GetBudgetWithHighestVoteCount(int chainH
             highestVoteCount = voteCount;
         }
     }
+
+    // Keep the cache bounded (blocks are checked with increasing height during the initial download)
+    if (mapHighestBudgetByHeight.size() >= MAX_HIGHEST_BUDGET_CACHE)
+        mapHighestBudgetByHeight.erase(mapHighestBudgetByHeight.begin());
+    mapHighestBudgetByHeight[chainHeight] = pHighestBudget ? pHighestBudget->GetHash() : UINT256_ZERO;
     return pHighestBudget;
 }
 
+void CBudgetManager::UpdateHighestVoteCount(const uint256& nBudgetHash)
+{
+    AssertLockHeld(cs_budgets);
+    const CFinalizedBudget* pfb = FindFinalizedBudget(nBudgetHash);
+    if (!pfb) return;
+
+    // Same tie-break as GetBudgetWithHighestVoteCount: the lowest hash wins among equal counts
+    const int nVoteCount = pfb->GetVoteCount();
+    for (auto it = mapHighestBudgetByHeight.lower_bound(pfb->GetBlockStart());
+            it != mapHighestBudgetByHeight.end() && it->first <= pfb->GetBlockEnd(); ++it) {
+        if (it->second == nBudgetHash) continue;
+        const CFinalizedBudget* pWinner = it->second.IsNull() ? nullptr : FindFinalizedBudget(it->second);
+        const int nWinnerCount = pWinner ? pWinner->GetVoteCount() : 0;
+        if (nVoteCount > nWinnerCount || (pWinner && nVoteCount == nWinnerCount && nBudgetHash < it->second)) {
+            it->second = nBudgetHash;
+        }
+    }
+}
+
 int CBudgetManager::GetHighestVoteCount(int chainHeight) const
 {
     const CFinalizedBudget* pbudget = GetBudgetWithHighestVoteCount(chainHeight);
@@ -488,6 +537,7 @@ void CBudgetManager::VoteOnFinalizedBudgets()
             // we only need to check this once
             if (pfb->IsAutoChecked()) continue;
             pfb->SetAutoChecked(true);
+            setChangedBudgets.emplace(it.first);
             //only vote for exact matches
             if (strBudgetMode == "auto") {
                 // compare budget payements with winning proposals
@@ -642,16 +692,14 @@ std::vector<CBudgetProposal*> CBudgetManager::GetAllProposals()
 {
     LOCK(cs_proposals);
 
-    std::vector<CBudgetProposal*> vBudgetProposalRet;
+    RemoveStaleVotesOnProposals(GetBestHeight());
 
-    for (auto& it: mapProposals) {
-        CBudgetProposal* pbudgetProposal = &(it.second);
-        RemoveStaleVotesOnProposal(pbudgetProposal);
-        vBudgetProposalRet.push_back(pbudgetProposal);
+    std::vector<CBudgetProposal*> vBudgetProposalRet;
+    vBudgetProposalRet.reserve(setRankedProposals.size());
+    for (const ProposalRank& rank: setRankedProposals) {
+        vBudgetProposalRet.push_back(&mapProposals.at(std::get<2>(rank)));
     }
 
-    std::sort(vBudgetProposalRet.begin(), vBudgetProposalRet.end(), CBudgetProposal::PtrHigherYes);
-
     return vBudgetProposalRet;
 }
 
@@ -663,13 +711,7 @@ std::vector<CBudgetProposal> CBudgetManager::GetBudget()
     if (nHeight <= 0)
         return {};
 
-    // ------- Sort budgets by net Yes Count
-    std::vector<CBudgetProposal*> vBudgetPorposalsSort;
-    for (auto& it: mapProposals) {
-        RemoveStaleVotesOnProposal(&it.second);
-        vBudgetPorposalsSort.push_back(&it.second);
-    }
-    std::sort(vBudgetPorposalsSort.begin(), vBudgetPorposalsSort.end(), CBudgetProposal::PtrHigherYes);
+    RemoveStaleVotesOnProposals(nHeight);
 
     // ------- Grab The Budgets In Order
     std::vector<CBudgetProposal> vBudgetProposalsRet;
@@ -681,7 +723,9 @@ std::vector<CBudgetProposal> CBudgetManager::GetBudget()
     int mnCount = mnodeman.CountEnabled(ActiveProtocol());
     CAmount nTotalBudget = GetTotalBudget(nBlockStart);
 
-    for (CBudgetProposal* pbudgetProposal: vBudgetPorposalsSort) {
+    // ------- Proposals are already sorted by net Yes Count
+    for (const ProposalRank& rank: setRankedProposals) {
+        CBudgetProposal* pbudgetProposal = &mapProposals.at(std::get<2>(rank));
         LogPrint(BCLog::MNBUDGET,"%s: Processing Budget %s\n", __func__, pbudgetProposal->GetName());
         //prop start/end should be inside this period
         if (pbudgetProposal->IsPassing(nBlockStart, nBlockEnd, mnCount)) {
@@ -777,18 +821,57 @@ void CBudgetManager::AddSeenFinalizedBudgetVote(const CFinalizedBudgetVote& vote
     mapSeenFinalizedBudgetVotes.emplace(vote.GetHash(), vote);
 }
 
+CBudgetManager::ProposalRank CBudgetManager::GetProposalRank(const CBudgetProposal& prop)
+{
+    return ProposalRank(prop.GetYeas() - prop.GetNays(), prop.GetFeeTXHash(), prop.GetHash());
+}
+
+void CBudgetManager::RankProposal(const CBudgetProposal& prop)
+{
+    AssertLockHeld(cs_proposals);
+    setRankedProposals.emplace(GetProposalRank(prop));
+}
+
+void CBudgetManager::UnrankProposal(const CBudgetProposal& prop)
+{
+    AssertLockHeld(cs_proposals);
+    setRankedProposals.erase(GetProposalRank(prop));
+}
+
+void CBudgetManager::RebuildRanking()
+{
+    AssertLockHeld(cs_proposals);
+    setRankedProposals.clear();
+    for (const auto& it: mapProposals) {
+        RankProposal(it.second);
+    }
+}
+
+void CBudgetManager::RemoveStaleVotesOnProposals(int nHeight)
+{
+    AssertLockHeld(cs_proposals);
+    if (nStaleVotesHeight == nHeight) return;
+    for (auto& it: mapProposals) {
+        RemoveStaleVotesOnProposal(&it.second);
+    }
+    nStaleVotesHeight = nHeight;
+}
+
 void CBudgetManager::RemoveStaleVotesOnProposal(CBudgetProposal* prop)
 {
     AssertLockHeld(cs_proposals);
     LogPrint(BCLog::MNBUDGET, "Cleaning proposal votes for %s. Before: YES=%d, NO=%d\n",
             prop->GetName(), prop->GetYeas(), prop->GetNays());
 
+    UnrankProposal(*prop);
     auto it = prop->mapVotes.begin();
     while (it != prop->mapVotes.end()) {
         CMasternode* pmn = mnodeman.Find(it->first);
         (*it).second.SetValid(pmn && pmn->IsEnabled());
         ++it;
     }
+    prop->RecountVotes();
+    RankProposal(*prop);
     LogPrint(BCLog::MNBUDGET, "Cleaned proposal votes for %s. After: YES=%d, NO=%d\n",
             prop->GetName(), prop->GetYeas(), prop->GetNays());
 }
@@ -895,9 +978,7 @@ void CBudgetManager::NewBlock(int height)
         TRY_LOCK(cs_proposals, fBudgetNewBlock);
         if (!fBudgetNewBlock) return;
         LogPrint(BCLog::MNBUDGET,"%s:  mapProposals cleanup - size: %d\n", __func__, mapProposals.size());
-        for (auto& it: mapProposals) {
-            RemoveStaleVotesOnProposal(&it.second);
-        }
+        RemoveStaleVotesOnProposals(nCurrentHeight);
     }
     {
         TRY_LOCK(cs_budgets, fBudgetNewBlock);
@@ -910,7 +991,7 @@ void CBudgetManager::NewBlock(int height)
     LogPrint(BCLog::MNBUDGET,"%s:  PASSED\n", __func__);
 }
 
-int CBudgetManager::ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom)
+int CBudgetManager::ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom, const CBloomFilter* pfilter)
 {
     if (Params().NetworkIDString() == CBaseChainParams::MAIN) {
         if (nProp.IsNull()) {
@@ -922,7 +1003,7 @@ int CBudgetManager::ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom)
         }
     }
 
-    Sync(pfrom, nProp);
+    Sync(pfrom, nProp, false, pfilter);
     LogPrint(BCLog::MNBUDGET, "mnvs - Sent Masternode votes to peer %i\n", pfrom->GetId());
     return 0;
 }
@@ -1060,7 +1141,9 @@ int CBudgetManager::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         // Masternode vote sync
         uint256 nProp;
         vRecv >> nProp;
-        return ProcessBudgetVoteSync(nProp, pfrom);
+        Optional<CBloomFilter> filter;
+        if (!ReadSyncFilter(vRecv, filter)) return 100;
+        return ProcessBudgetVoteSync(nProp, pfrom, filter.get_ptr());
     }
 
     if (strCommand == NetMsgType::BUDGETPROPOSAL) {
@@ -1123,7 +1206,7 @@ void CBudgetManager::SetSynced(bool synced)
     }
 }
 
-void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial)
+void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial, const CBloomFilter* pfilter)
 {
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
     int nInvCount = 0;
@@ -1132,9 +1215,9 @@ void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial)
         for (auto& it: mapProposals) {
             CBudgetProposal* pbudgetProposal = &(it.second);
             if (pbudgetProposal && pbudgetProposal->IsValid() && (nProp.IsNull() || it.first == nProp)) {
-                pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, it.second.GetHash()));
+                if (!pfilter || !pfilter->contains(it.first)) pfrom->PushInventory(CInv(MSG_BUDGET_PROPOSAL, it.first));
                 nInvCount++;
-                pbudgetProposal->SyncVotes(pfrom, fPartial, nInvCount);
+                pbudgetProposal->SyncVotes(pfrom, fPartial, nInvCount, pfilter);
             }
         }
     }
@@ -1147,9 +1230,9 @@ void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial)
         for (auto& it: mapFinalizedBudgets) {
             CFinalizedBudget* pfinalizedBudget = &(it.second);
             if (pfinalizedBudget && pfinalizedBudget->IsValid() && (nProp.IsNull() || it.first == nProp)) {
-                pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, it.second.GetHash()));
+                if (!pfilter || !pfilter->contains(it.first)) pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED, it.first));
                 nInvCount++;
-                pfinalizedBudget->SyncVotes(pfrom, fPartial, nInvCount);
+                pfinalizedBudget->SyncVotes(pfrom, fPartial, nInvCount, pfilter);
             }
         }
     }
@@ -1157,6 +1240,28 @@ void CBudgetManager::Sync(CNode* pfrom, const uint256& nProp, bool fPartial)
     LogPrint(BCLog::MNBUDGET, "%s: sent %d items\n", __func__, nInvCount);
 }
 
+std::vector<uint256> CBudgetManager::GetSyncHashes() const
+{
+    std::vector<uint256> vHashes;
+    {
+        LOCK(cs_proposals);
+        for (const auto& it: mapProposals) {
+            vHashes.emplace_back(it.first);
+            const std::vector<uint256>& vVotes = it.second.GetVotesHashes();
+            vHashes.insert(vHashes.end(), vVotes.begin(), vVotes.end());
+        }
+    }
+    {
+        LOCK(cs_budgets);
+        for (const auto& it: mapFinalizedBudgets) {
+            vHashes.emplace_back(it.first);
+            const std::vector<uint256>& vVotes = it.second.GetVotesHashes();
+            vHashes.insert(vHashes.end(), vVotes.begin(), vVotes.end());
+        }
+    }
+    return vHashes;
+}
+
 bool CBudgetManager::UpdateProposal(const CBudgetVote& vote, CNode* pfrom, std::string& strError)
 {
     LOCK(cs_proposals);
@@ -1181,8 +1286,15 @@ bool CBudgetManager::UpdateProposal(const CBudgetVote& vote, CNode* pfrom, std::
         return false;
     }
 
-
-    return mapProposals[nProposalHash].AddOrUpdateVote(vote, strError);
+    CBudgetProposal& proposal = mapProposals[nProposalHash];
+    UnrankProposal(proposal);
+    bool fUpdated = proposal.AddOrUpdateVote(vote, strError);
+    RankProposal(proposal);
+    if (fUpdated) {
+        setChangedProposals.emplace(nProposalHash);
+        GetMainSignals().BudgetVoteAccepted(nProposalHash, vote.GetVin().prevout, vote.GetDirection(), false);
+    }
+    return fUpdated;
 }
 
 bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pfrom, std::string& strError)
@@ -1209,7 +1321,107 @@ bool CBudgetManager::UpdateFinalizedBudget(CFinalizedBudgetVote& vote, CNode* pf
         return false;
     }
     LogPrint(BCLog::MNBUDGET,"%s: Finalized Proposal %s added\n", __func__, nBudgetHash.ToString());
-    return mapFinalizedBudgets[nBudgetHash].AddOrUpdateVote(vote, strError);
+    if (!mapFinalizedBudgets[nBudgetHash].AddOrUpdateVote(vote, strError)) return false;
+    setChangedBudgets.emplace(nBudgetHash);
+    UpdateHighestVoteCount(nBudgetHash);
+    GetMainSignals().BudgetVoteAccepted(nBudgetHash, vote.GetVin().prevout, CBudgetVote::VOTE_YES, true);
+    return true;
+}
+
+bool CBudgetManager::LoadFromDB(CTierTwoDB& db)
+{
+    int64_t nStart = GetTimeMillis();
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    LOCK2(cs_budgets, cs_proposals);
+    pcursor->Seek(DB_TIERTWO_PROPOSAL);
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIERTWO_PROPOSAL) break;
+        CBudgetProposal proposal;
+        if (!pcursor->GetValue(proposal)) {
+            Clear();
+            setChangedProposals.clear();
+            setChangedBudgets.clear();
+            return error("%s : failed to read proposal %s", __func__, key.second.ToString());
+        }
+        mapFeeTxToProposal.emplace(proposal.GetFeeTXHash(), key.second);
+        mapProposals.emplace(key.second, proposal);
+        pcursor->Next();
+    }
+
+    pcursor->Seek(DB_TIERTWO_FINALIZED_BUDGET);
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIERTWO_FINALIZED_BUDGET) break;
+        CFinalizedBudget finalizedBudget;
+        if (!pcursor->GetValue(finalizedBudget)) {
+            Clear();
+            setChangedProposals.clear();
+            setChangedBudgets.clear();
+            return error("%s : failed to read finalized budget %s", __func__, key.second.ToString());
+        }
+        mapFeeTxToBudget.emplace(finalizedBudget.GetFeeTXHash(), key.second);
+        mapFinalizedBudgets.emplace(key.second, finalizedBudget);
+        pcursor->Next();
+    }
+
+    // our own finalized budgets waiting for their collateral to mature
+    if (db.Exists(DB_TIERTWO_UNCONFIRMED_FEETX) && !db.Read(DB_TIERTWO_UNCONFIRMED_FEETX, mapUnconfirmedFeeTx)) {
+        mapUnconfirmedFeeTx.clear();
+    }
+
+    RebuildRanking();
+    mapHighestBudgetByHeight.clear();
+    setChangedProposals.clear();
+    setChangedBudgets.clear();
+
+    LogPrint(BCLog::MNBUDGET, "Loaded %d proposals and %d finalized budgets from the tier two database %dms\n",
+             mapProposals.size(), mapFinalizedBudgets.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CBudgetManager::FlushToDB(CTierTwoDB& db)
+{
+    std::set<uint256> setProposals, setBudgets;
+    CDBBatch batch;
+    size_t nWritten = 0;
+    {
+        LOCK2(cs_budgets, cs_proposals);
+        setProposals.swap(setChangedProposals);
+        setBudgets.swap(setChangedBudgets);
+        for (const uint256& nHash : setProposals) {
+            const auto it = mapProposals.find(nHash);
+            if (it != mapProposals.end()) {
+                batch.Write(std::make_pair(DB_TIERTWO_PROPOSAL, nHash), it->second);
+                nWritten++;
+            } else {
+                batch.Erase(std::make_pair(DB_TIERTWO_PROPOSAL, nHash));
+            }
+        }
+        for (const uint256& nHash : setBudgets) {
+            const auto it = mapFinalizedBudgets.find(nHash);
+            if (it != mapFinalizedBudgets.end()) {
+                batch.Write(std::make_pair(DB_TIERTWO_FINALIZED_BUDGET, nHash), it->second);
+                nWritten++;
+            } else {
+                batch.Erase(std::make_pair(DB_TIERTWO_FINALIZED_BUDGET, nHash));
+            }
+        }
+        // a handful of entries at most, rewritten as a whole
+        batch.Write(DB_TIERTWO_UNCONFIRMED_FEETX, mapUnconfirmedFeeTx);
+    }
+
+    const size_t nChanged = setProposals.size() + setBudgets.size();
+    if (!db.WriteBatch(batch, true)) {
+        // keep them for the next flush
+        LOCK2(cs_budgets, cs_proposals);
+        setChangedProposals.insert(setProposals.begin(), setProposals.end());
+        setChangedBudgets.insert(setBudgets.begin(), setBudgets.end());
+        return error("%s : failed to write %d budget changes", __func__, nChanged);
+    }
+    LogPrint(BCLog::MNBUDGET, "Flushed %d proposals and finalized budgets, erased %d\n", nWritten, nChanged - nWritten);
+    return true;
 }
 
 std::string CBudgetManager::ToString() const
@@ -1238,6 +1450,37 @@ std::string CBudgetManager::ToString() const
             nSeenVotes, nOrphanVotes, nSeenFinalizedVotes, nOrphanFinalizedVotes);
 }
 
+size_t CBudgetManager::DynamicMemoryUsage() const
+{
+    size_t nUsage = 0;
+    {
+        LOCK(cs_proposals);
+        nUsage += memusage::DynamicUsage(mapProposals) + memusage::DynamicUsage(mapFeeTxToProposal) +
+                  memusage::DynamicUsage(setRankedProposals) + memusage::DynamicUsage(setChangedProposals);
+        for (const auto& it : mapProposals) nUsage += it.second.DynamicMemoryUsage();
+    }
+    {
+        LOCK(cs_budgets);
+        nUsage += memusage::DynamicUsage(mapFinalizedBudgets) + memusage::DynamicUsage(mapFeeTxToBudget) +
+                  memusage::DynamicUsage(mapUnconfirmedFeeTx) + memusage::DynamicUsage(mapHighestBudgetByHeight) +
+                  memusage::DynamicUsage(setChangedBudgets);
+        for (const auto& it : mapFinalizedBudgets) nUsage += it.second.DynamicMemoryUsage();
+    }
+    {
+        LOCK(cs_votes);
+        nUsage += memusage::DynamicUsage(mapSeenProposalVotes) + memusage::DynamicUsage(mapOrphanProposalVotes);
+        for (const auto& it : mapSeenProposalVotes) nUsage += it.second.DynamicMemoryUsage();
+        for (const auto& it : mapOrphanProposalVotes) nUsage += it.second.DynamicMemoryUsage();
+    }
+    {
+        LOCK(cs_finalizedvotes);
+        nUsage += memusage::DynamicUsage(mapSeenFinalizedBudgetVotes) + memusage::DynamicUsage(mapOrphanFinalizedBudgetVotes);
+        for (const auto& it : mapSeenFinalizedBudgetVotes) nUsage += it.second.DynamicMemoryUsage();
+        for (const auto& it : mapOrphanFinalizedBudgetVotes) nUsage += it.second.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
 
 /*
  * Check Collateral
@@ -1256,11 +1499,27 @@ bool CheckCollateralConfs(const uint256& nTxCollateralHash, int nCurrentHeight,
     return true;
 }
 
+bool IsBudgetCollateralCandidate(const CTransaction& tx)
+{
+    if (tx.IsCoinBase() || tx.IsCoinStake() || tx.nLockTime != 0) return false;
+    for (const CTxOut& o : tx.vout) {
+        // OP_RETURN <32 bytes hash>
+        if (o.nValue >= BUDGET_FEE_TX && o.scriptPubKey.size() == 34 &&
+                o.scriptPubKey[0] == OP_RETURN && o.scriptPubKey[1] == 32) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool CheckCollateral(const uint256& nTxCollateralHash, const uint256& nExpectedHash, std::string& strError, int64_t& nTime, int nCurrentHeight, bool fBudgetFinalization)
 {
     CTransactionRef txCollateral;
     uint256 nBlockHash;
-    if (!GetTransaction(nTxCollateralHash, txCollateral, nBlockHash, true)) {
+    // The fee transactions are in their own index, the txindex may be disabled or still syncing
+    const bool fFound = pblocktree->ReadBudgetCollateral(nTxCollateralHash, nBlockHash, txCollateral) ||
+                        GetTransaction(nTxCollateralHash, txCollateral, nBlockHash, true);
+    if (!fFound) {
         strError = strprintf("Can't find collateral tx %s", nTxCollateralHash.ToString());
         return false;
     }
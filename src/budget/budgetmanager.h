@@ -11,6 +11,11 @@
 #include "budget/budgetproposal.h"
 #include "budget/finalizedbudget.h"
 
+#include <set>
+#include <tuple>
+
+class CTierTwoDB;
+
 //
 // Budget Manager : Contains all proposals for the budget
 //
@@ -37,6 +42,28 @@ protected:
     // Memory Only. Updated in NewBlock (blocks arrive in order)
     std::atomic<int> nBestHeight;
 
+    // Memory only. Proposals ranked by net yes count (ties solved by fee txid, as in
+    // CBudgetProposal::PtrHigherYes). Kept in sync as proposals and votes come and go.
+    typedef std::tuple<int, uint256, uint256> ProposalRank;    // (net yes, fee txid, proposal hash)
+    std::set<ProposalRank, std::greater<ProposalRank>> setRankedProposals;  // guarded by cs_proposals
+    // Memory only. Best height at which the votes of disabled masternodes were last invalidated
+    int nStaleVotesHeight{0};                                               // guarded by cs_proposals
+    // Memory only. Finalized budget with the highest vote count per block height (null if none).
+    // Votes are never removed from finalized budgets, so new votes only challenge the cached winner.
+    mutable std::map<int, uint256> mapHighestBudgetByHeight;                // guarded by cs_budgets
+    // Memory only. The proposals and finalized budgets added, voted or removed since the last FlushToDB
+    std::set<uint256> setChangedProposals;                                  // guarded by cs_proposals
+    std::set<uint256> setChangedBudgets;                                    // guarded by cs_budgets
+
+    static ProposalRank GetProposalRank(const CBudgetProposal& prop);
+    void RankProposal(const CBudgetProposal& prop);
+    void UnrankProposal(const CBudgetProposal& prop);
+    void RebuildRanking();
+    // Invalidates the votes of disabled masternodes on all proposals (once per block)
+    void RemoveStaleVotesOnProposals(int nHeight);
+    // Updates the cached winners of the heights covered by the finalized budget, after it got a vote
+    void UpdateHighestVoteCount(const uint256& nBudgetHash);
+
     // Returns a const pointer to the budget with highest vote count
     const CFinalizedBudget* GetBudgetWithHighestVoteCount(int chainHeight) const;
     int GetHighestVoteCount(int chainHeight) const;
@@ -88,7 +115,10 @@ public:
 
     void ResetSync() { SetSynced(false); }
     void MarkSynced() { SetSynced(true); }
-    void Sync(CNode* node, const uint256& nProp, bool fPartial = false);
+    // announces the proposals/budgets and their votes, except the ones matching pfilter (known by the peer)
+    void Sync(CNode* node, const uint256& nProp, bool fPartial = false, const CBloomFilter* pfilter = nullptr);
+    // hashes of the proposals, finalized budgets and their votes (known items filter of the sync request)
+    std::vector<uint256> GetSyncHashes() const;
     void SetBestHeight(int height) { nBestHeight.store(height, std::memory_order_release); };
     int GetBestHeight() const { return nBestHeight.load(std::memory_order_acquire); }
 
@@ -97,7 +127,7 @@ public:
     int ProcessMessageInner(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
     void NewBlock(int height);
 
-    int ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom);
+    int ProcessBudgetVoteSync(const uint256& nProp, CNode* pfrom, const CBloomFilter* pfilter = nullptr);
     int ProcessProposal(CBudgetProposal& proposal);
     int ProcessProposalVote(CBudgetVote& proposal, CNode* pfrom);
     int ProcessFinalizedBudget(CFinalizedBudget& finalbudget);
@@ -137,14 +167,19 @@ public:
     {
         {
             LOCK(cs_proposals);
+            for (const auto& it : mapProposals) setChangedProposals.emplace(it.first);
             mapProposals.clear();
             mapFeeTxToProposal.clear();
+            setRankedProposals.clear();
+            nStaleVotesHeight = 0;
         }
         {
             LOCK(cs_budgets);
+            for (const auto& it : mapFinalizedBudgets) setChangedBudgets.emplace(it.first);
             mapFinalizedBudgets.clear();
             mapFeeTxToBudget.clear();
             mapUnconfirmedFeeTx.clear();
+            mapHighestBudgetByHeight.clear();
         }
         {
             LOCK(cs_votes);
@@ -159,7 +194,13 @@ public:
         LogPrintf("Budget object cleared\n");
     }
     void CheckAndRemove();
+    // Reads the proposals and finalized budgets of the tier two database, without their seen votes
+    bool LoadFromDB(CTierTwoDB& db);
+    // Writes the proposals and finalized budgets changed since the previous flush
+    bool FlushToDB(CTierTwoDB& db);
     std::string ToString() const;
+    // Memory used by the proposals, the finalized budgets and the votes
+    size_t DynamicMemoryUsage() const;
 
     // Remove proposal/budget by FeeTx (called when a block is disconnected)
     void RemoveByFeeTxId(const uint256& feeTxId);
@@ -172,6 +213,10 @@ public:
             LOCK(cs_proposals);
             READWRITE(mapProposals);
             READWRITE(mapFeeTxToProposal);
+            if (ser_action.ForRead()) {
+                RebuildRanking();
+                for (const auto& it : mapProposals) setChangedProposals.emplace(it.first);
+            }
         }
         {
             LOCK(cs_votes);
@@ -183,6 +228,10 @@ public:
             READWRITE(mapFinalizedBudgets);
             READWRITE(mapFeeTxToBudget);
             READWRITE(mapUnconfirmedFeeTx);
+            if (ser_action.ForRead()) {
+                mapHighestBudgetByHeight.clear();
+                for (const auto& it : mapFinalizedBudgets) setChangedBudgets.emplace(it.first);
+            }
         }
         {
             LOCK(cs_finalizedvotes);
@@ -194,4 +243,12 @@ public:
 
 extern CBudgetManager g_budgetman;
 
+/**
+ * Whether the transaction may be the collateral of a proposal or of a finalized
+ * budget: an OP_RETURN output committing to a hash, worth at least BUDGET_FEE_TX.
+ * Without txindex these transactions are kept in the block tree database, for
+ * CheckCollateral (see CBlockTreeDB::WriteBudgetCollaterals).
+ */
+bool IsBudgetCollateralCandidate(const CTransaction& tx);
+
 #endif // BUDGET_MANAGER_H
@@ -7,6 +7,7 @@
 
 #include "budget/budgetproposal.h"
 
+#include "bloom.h"
 #include "masternodeman.h"
 
 CBudgetProposal::CBudgetProposal():
@@ -68,12 +69,12 @@ bool CBudgetProposal::ParseBroadcast(CDataStream& broadcast)
     return true;
 }
 
-void CBudgetProposal::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const
+void CBudgetProposal::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBloomFilter* pfilter) const
 {
     for (const auto& it: mapVotes) {
         const CBudgetVote& vote = it.second;
         if (vote.IsValid() && (!fPartial || !vote.IsSynced())) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, vote.GetHash()));
+            if (!pfilter || !pfilter->contains(vote.GetHash())) pfrom->PushInventory(CInv(MSG_BUDGET_VOTE, vote.GetHash()));
             nInvCount++;
         }
     }
@@ -220,8 +221,9 @@ bool CBudgetProposal::AddOrUpdateVote(const CBudgetVote& vote, std::string& strE
     const COutPoint& mnId = vote.GetVin().prevout;
     const int64_t voteTime = vote.GetTime();
 
-    if (mapVotes.count(mnId)) {
-        const int64_t& oldTime = mapVotes[mnId].GetTime();
+    auto it = mapVotes.find(mnId);
+    if (it != mapVotes.end()) {
+        const int64_t& oldTime = it->second.GetTime();
         if (oldTime > voteTime) {
             strError = strprintf("new vote older than existing vote - %s\n", vote.GetHash().ToString());
             LogPrint(BCLog::MNBUDGET, "%s: %s\n", __func__, strError);
@@ -242,7 +244,13 @@ bool CBudgetProposal::AddOrUpdateVote(const CBudgetVote& vote, std::string& strE
         return false;
     }
 
-    mapVotes[mnId] = vote;
+    if (it != mapVotes.end()) {
+        CountVote(it->second, -1);
+        it->second = vote;
+    } else {
+        mapVotes.emplace(mnId, vote);
+    }
+    CountVote(vote, 1);
     LogPrint(BCLog::MNBUDGET, "%s: %s %s\n", __func__, strAction.c_str(), vote.GetHash().ToString().c_str());
 
     return true;
@@ -279,15 +287,25 @@ double CBudgetProposal::GetRatio() const
     return ((double)(yeas) / (double)(yeas + nays));
 }
 
-int CBudgetProposal::GetVoteCount(CBudgetVote::VoteDirection vd) const
+void CBudgetProposal::CountVote(const CBudgetVote& vote, int nDelta)
 {
-    int ret = 0;
+    const int vd = vote.GetDirection();
+    if (vote.IsValid() && vd >= 0 && vd < (int)vVoteCounts.size())
+        vVoteCounts[vd] += nDelta;
+}
+
+void CBudgetProposal::RecountVotes()
+{
+    vVoteCounts.fill(0);
     for (const auto& it : mapVotes) {
-        const CBudgetVote& vote = it.second;
-        if (vote.GetDirection() == vd && vote.IsValid())
-            ret++;
+        CountVote(it.second, 1);
     }
-    return ret;
+}
+
+int CBudgetProposal::GetVoteCount(CBudgetVote::VoteDirection vd) const
+{
+    if (vd < 0 || vd >= (int)vVoteCounts.size()) return 0;
+    return vVoteCounts[vd];
 }
 
 std::vector<uint256> CBudgetProposal::GetVotesHashes() const
@@ -299,6 +317,14 @@ std::vector<uint256> CBudgetProposal::GetVotesHashes() const
     return vRet;
 }
 
+size_t CBudgetProposal::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(mapVotes);
+    for (const auto& it : mapVotes) nUsage += it.second.DynamicMemoryUsage();
+    return nUsage + memusage::DynamicUsage(strProposalName) + memusage::DynamicUsage(strURL) +
+           memusage::DynamicUsage(strInvalid) + address.DynamicMemoryUsage();
+}
+
 int CBudgetProposal::GetBlockStartCycle() const
 {
     //end block is half way through the next cycle (so the proposal will be removed much after the payment is sent)
@@ -12,11 +12,14 @@
 #include "net.h"
 #include "streams.h"
 
+#include <array>
+
 static const CAmount PROPOSAL_FEE_TX = (350 * COIN);
 static const CAmount BUDGET_FEE_TX_OLD = (350 * COIN);
 static const CAmount BUDGET_FEE_TX = (5 * COIN);
 static const int64_t BUDGET_VOTE_UPDATE_MIN = 60 * 60;
 
+class CBloomFilter;
 class CBudgetManager;
 
 //
@@ -38,6 +41,10 @@ private:
     bool CheckAmount(const CAmount& nTotalBudget);
     bool CheckAddress();
 
+    // Memory only. Running tally of the valid votes, indexed by VoteDirection
+    std::array<int, 3> vVoteCounts{};
+    void CountVote(const CBudgetVote& vote, int nDelta);
+
 protected:
     std::map<COutPoint, CBudgetVote> mapVotes;
     std::string strProposalName;
@@ -56,11 +63,13 @@ public:
     CBudgetProposal(const std::string& name, const std::string& url, int paycount, const CScript& payee, const CAmount& amount, int blockstart, const uint256& nfeetxhash);
 
     bool AddOrUpdateVote(const CBudgetVote& vote, std::string& strError);
+    // recomputes the vote tally from mapVotes (after the validity of the votes changed)
+    void RecountVotes();
     UniValue GetVotesArray() const;
     void SetSynced(bool synced);    // sets fSynced on votes (true only if valid)
 
     // sync proposal votes with a node
-    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const;
+    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBloomFilter* pfilter = nullptr) const;
 
     // sets fValid and strInvalid, returns fValid
     bool UpdateValid(int nHeight);
@@ -94,6 +103,7 @@ public:
     CAmount GetAmount() const { return nAmount; }
     void SetAllotted(CAmount nAllottedIn) { nAllotted = nAllottedIn; }
     CAmount GetAllotted() const { return nAllotted; }
+    size_t DynamicMemoryUsage() const;
 
     uint256 GetHash() const
     {
@@ -121,6 +131,7 @@ public:
         READWRITE(nFeeTXHash);
         READWRITE(nTime);
         READWRITE(mapVotes);
+        if (ser_action.ForRead()) RecountVotes();
     }
 
     // Serialization for network messages.
@@ -54,6 +54,8 @@ public:
     std::string GetStrMessage() const override;
     CTxIn GetVin() const { return vin; };
 
+    size_t DynamicMemoryUsage() const { return CSignedMessage::DynamicMemoryUsage() + vin.DynamicMemoryUsage(); }
+
     UniValue ToJSON() const;
 
     VoteDirection GetDirection() const { return nVote; }
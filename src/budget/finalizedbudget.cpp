@@ -7,6 +7,7 @@
 
 #include "budget/finalizedbudget.h"
 
+#include "bloom.h"
 #include "masternodeman.h"
 
 
@@ -185,12 +186,12 @@ std::vector<uint256> CFinalizedBudget::GetProposalsHashes() const
     return vHashes;
 }
 
-void CFinalizedBudget::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const
+void CFinalizedBudget::SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBloomFilter* pfilter) const
 {
     for (const auto& it: mapVotes) {
         const CFinalizedBudgetVote& vote = it.second;
         if (vote.IsValid() && (!fPartial || !vote.IsSynced())) {
-            pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, vote.GetHash()));
+            if (!pfilter || !pfilter->contains(vote.GetHash())) pfrom->PushInventory(CInv(MSG_BUDGET_FINALIZED_VOTE, vote.GetHash()));
             nInvCount++;
         }
     }
@@ -284,6 +285,14 @@ std::vector<uint256> CFinalizedBudget::GetVotesHashes() const
     return vRet;
 }
 
+size_t CFinalizedBudget::DynamicMemoryUsage() const
+{
+    size_t nUsage = memusage::DynamicUsage(mapVotes);
+    for (const auto& it : mapVotes) nUsage += it.second.DynamicMemoryUsage();
+    return nUsage + memusage::RecursiveDynamicUsage(vecBudgetPayments) + memusage::DynamicUsage(strBudgetName) +
+           memusage::DynamicUsage(strProposals) + memusage::DynamicUsage(strInvalid);
+}
+
 bool CFinalizedBudget::IsPaidAlready(const uint256& nProposalHash, const uint256& nBlockHash, int nBlockHeight) const
 {
     // Remove budget-payments from former/future payment cycles
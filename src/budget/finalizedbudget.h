@@ -13,6 +13,7 @@
 #include "net.h"
 #include "streams.h"
 
+class CBloomFilter;
 class CTxBudgetPayment;
 class CBudgetManager;
 
@@ -64,7 +65,7 @@ public:
     void SetSynced(bool synced);    // sets fSynced on votes (true only if valid)
 
     // sync budget votes with a node
-    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount) const;
+    void SyncVotes(CNode* pfrom, bool fPartial, int& nInvCount, const CBloomFilter* pfilter = nullptr) const;
 
     // sets fValid and strInvalid, returns fValid
     bool UpdateValid(int nHeight);
@@ -97,6 +98,7 @@ public:
     bool CheckProposals(const std::map<uint256, CBudgetProposal>& mapWinningProposals) const;
     // Total amount paid out by this budget
     CAmount GetTotalPayout() const;
+    size_t DynamicMemoryUsage() const;
 
     uint256 GetHash() const
     {
@@ -171,6 +173,8 @@ public:
     // compare payments by proposal hash
     inline bool operator>(const CTxBudgetPayment& other) const { return nProposalHash > other.nProposalHash; }
 
+    size_t DynamicMemoryUsage() const { return payee.DynamicMemoryUsage(); }
+
 };
 
 #endif
@@ -38,6 +38,8 @@ public:
     std::string GetStrMessage() const override;
     CTxIn GetVin() const { return vin; };
 
+    size_t DynamicMemoryUsage() const { return CSignedMessage::DynamicMemoryUsage() + vin.DynamicMemoryUsage(); }
+
     UniValue ToJSON() const;
 
     uint256 GetBudgetHash() const { return nBudgetHash; }
@@ -8,13 +8,51 @@
 
 #include "chain.h"
 #include "legacy/stakemodifier.h"  // for ComputeNextStakeModifier
+#include "support/allocators/pool.h"
 
+#include <algorithm>
+#include <mutex>
+
+namespace {
+
+typedef PoolResource<sizeof(CBlockIndex), (alignof(CBlockIndex) > alignof(void*) ? alignof(CBlockIndex) : alignof(void*))> BlockIndexPool;
+
+// Millions of entries are loaded at startup, and they are never freed but
+// in UnloadBlockIndex: allocate them in 1 MiB chunks, without the per-entry
+// malloc overhead. The pool is leaked, as entries may be released during
+// the static destruction.
+BlockIndexPool& GetBlockIndexPool()
+{
+    static BlockIndexPool* pool = new BlockIndexPool(1 << 20);
+    return *pool;
+}
+
+std::mutex& GetBlockIndexPoolMutex()
+{
+    static std::mutex* mutex = new std::mutex();
+    return *mutex;
+}
+
+} // namespace
+
+void* CBlockIndex::operator new(size_t size)
+{
+    std::lock_guard<std::mutex> lock(GetBlockIndexPoolMutex());
+    return GetBlockIndexPool().Allocate(size, alignof(CBlockIndex));
+}
+
+void CBlockIndex::operator delete(void* p, size_t size)
+{
+    std::lock_guard<std::mutex> lock(GetBlockIndexPoolMutex());
+    GetBlockIndexPool().Deallocate(p, size, alignof(CBlockIndex));
+}
 
 /**
  * CChain implementation
  */
 void CChain::SetTip(CBlockIndex* pindex)
 {
+    pTipSnapshot.store(pindex, std::memory_order_release);
     if (pindex == NULL) {
         vChain.clear();
         return;
@@ -228,10 +266,7 @@ bool CBlockIndex::SetStakeEntropyBit(unsigned int nEntropyBit)
 // Sets V1 stake modifier (uint64_t)
 void CBlockIndex::SetStakeModifier(const uint64_t nStakeModifier, bool fGeneratedStakeModifier)
 {
-    vStakeModifier.clear();
-    const size_t modSize = sizeof(nStakeModifier);
-    vStakeModifier.resize(modSize);
-    std::memcpy(vStakeModifier.data(), &nStakeModifier, modSize);
+    vStakeModifier.assign((const unsigned char*) &nStakeModifier, sizeof(nStakeModifier));
     if (fGeneratedStakeModifier)
         nFlags |= BLOCK_STAKE_MODIFIER;
 
@@ -253,8 +288,7 @@ void CBlockIndex::SetNewStakeModifier()
 // Sets V2 stake modifiers (uint256)
 void CBlockIndex::SetStakeModifier(const uint256& nStakeModifier)
 {
-    vStakeModifier.clear();
-    vStakeModifier.insert(vStakeModifier.begin(), nStakeModifier.begin(), nStakeModifier.end());
+    vStakeModifier.assign(nStakeModifier.begin(), nStakeModifier.size());
 }
 
 // Generates and sets new V2 stake modifier
@@ -276,8 +310,8 @@ uint64_t CBlockIndex::GetStakeModifierV1() const
 {
     if (vStakeModifier.empty() || Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_V3_4))
         return 0;
-    uint64_t nStakeModifier;
-    std::memcpy(&nStakeModifier, vStakeModifier.data(), vStakeModifier.size());
+    uint64_t nStakeModifier = 0;
+    std::memcpy(&nStakeModifier, vStakeModifier.data(), std::min(vStakeModifier.size(), sizeof(nStakeModifier)));
     return nStakeModifier;
 }
 
@@ -287,7 +321,7 @@ uint256 CBlockIndex::GetStakeModifierV2() const
     if (vStakeModifier.empty() || !Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_V3_4))
         return UINT256_ZERO;
     uint256 nStakeModifier;
-    std::memcpy(nStakeModifier.begin(), vStakeModifier.data(), vStakeModifier.size());
+    std::memcpy(nStakeModifier.begin(), vStakeModifier.data(), std::min(vStakeModifier.size(), (size_t) nStakeModifier.size()));
     return nStakeModifier;
 }
 
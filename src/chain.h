@@ -22,6 +22,9 @@
 #include "util.h"
 #include "libzerocoin/Denominations.h"
 
+#include <assert.h>
+#include <atomic>
+#include <cstring>
 #include <vector>
 
 class CBlockFileInfo
@@ -170,6 +173,52 @@ enum {
     BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
 };
 
+/**
+ * Stake modifier bytes of a block index entry, kept inline instead of in a
+ * heap-allocated vector. The size tags the version: 0 for PoW blocks, 8 for
+ * the V1 modifier (uint64_t) and 32 for the V2 modifier (uint256).
+ * Serialized exactly as the std::vector<unsigned char> it replaces.
+ */
+class CStakeModifierBytes
+{
+public:
+    static const size_t MAX_SIZE = 32;
+
+    bool empty() const { return nSize == 0; }
+    size_t size() const { return nSize; }
+    const unsigned char* data() const { return vch; }
+
+    void assign(const unsigned char* pbegin, size_t len)
+    {
+        assert(len <= MAX_SIZE);
+        nSize = (uint8_t) len;
+        std::memcpy(vch, pbegin, len);
+        std::memset(vch + len, 0, MAX_SIZE - len);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, nSize);
+        if (nSize) s.write((const char*) vch, nSize);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        const uint64_t len = ReadCompactSize(s);
+        if (len > MAX_SIZE)
+            throw std::ios_base::failure("CStakeModifierBytes::Unserialize() : size too large");
+        unsigned char buf[MAX_SIZE];
+        if (len) s.read((char*) buf, len);
+        assign(buf, len);
+    }
+
+private:
+    unsigned char vch[MAX_SIZE]{};
+    uint8_t nSize{0};
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -215,9 +264,9 @@ public:
     unsigned int nStatus{0};
 
     // proof-of-stake specific fields
-    // char vector holding the stake modifier bytes. It is empty for PoW blocks.
+    // stake modifier bytes. It is empty for PoW blocks.
     // Modifier V1 is 64 bit while modifier V2 is 256 bit.
-    std::vector<unsigned char> vStakeModifier{};
+    CStakeModifierBytes vStakeModifier{};
     unsigned int nFlags{0};
 
     //! Change in value held by the Sapling circuit over this block.
@@ -244,6 +293,10 @@ public:
     CBlockIndex() {}
     CBlockIndex(const CBlock& block);
 
+    //! Entries created with new are packed in large chunks (see chain.cpp)
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size);
+
     std::string ToString() const;
 
     CDiskBlockPos GetBlockPos() const;
@@ -530,6 +583,8 @@ class CChain
 {
 private:
     std::vector<CBlockIndex*> vChain;
+    //! The tip, published by SetTip for the readers that don't hold cs_main
+    std::atomic<CBlockIndex*> pTipSnapshot{nullptr};
 
 public:
     /** Returns the index entry for the genesis block of this chain, or NULL if none. */
@@ -589,6 +644,23 @@ public:
         return vChain.size() - 1;
     }
 
+    /**
+     * The tip, read without cs_main. It may not match the rest of the chain
+     * while SetTip runs, but the entries reached from it through pprev and
+     * pskip never change: it needs no lock to be walked.
+     */
+    CBlockIndex* TipSnapshot() const
+    {
+        return pTipSnapshot.load(std::memory_order_acquire);
+    }
+
+    /** The entry at a height in the chain of TipSnapshot(), without cs_main, or NULL if it's over the tip. */
+    CBlockIndex* AtHeightSnapshot(int nHeight) const
+    {
+        CBlockIndex* pindexTip = TipSnapshot();
+        return pindexTip ? pindexTip->GetAncestor(nHeight) : NULL;
+    }
+
     /** Set/initialize a chain with a given tip. */
     void SetTip(CBlockIndex* pindex);
 
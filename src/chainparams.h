@@ -17,6 +17,7 @@
 #include "protocol.h"
 #include "uint256.h"
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -84,6 +85,8 @@ public:
     const std::string& Bech32HRP(Bech32Type type) const { return bech32HRPs[type]; }
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     virtual const Checkpoints::CCheckpointData& Checkpoints() const = 0;
+    /** Hashes of the published chainstate snapshots (see dumptxoutset), by height of their base block */
+    const std::map<int, uint256>& TxOutSetSnapshots() const { return mapTxOutSetSnapshots; }
 
     std::string DevAddress() const { return nDevAddr; }
 
@@ -103,6 +106,7 @@ protected:
     std::vector<unsigned char> base58Prefixes[MAX_BASE58_TYPES];
     std::string bech32HRPs[MAX_BECH32_TYPES];
     std::vector<SeedSpec6> vFixedSeeds;
+    std::map<int, uint256> mapTxOutSetSnapshots;
 
     std::string nDevAddr;
 };
@@ -6,6 +6,10 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -23,11 +27,30 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * The verifications are spread over one deque per worker: each worker
+  * takes its batches from the back of its own deque, and steals from the
+  * front of the others once it is empty. The shared mutex only guards the
+  * counters, the checks are moved under the lock of their deque. The size
+  * of the batches follows the cost of the checks seen so far, so that a
+  * batch of cheap checks is large and a batch of expensive ones is short.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
+    //! Number of deques: the master's, then one per worker (shared past that)
+    static const unsigned int MAX_WORKER_QUEUES = 32;
+
+    //! Time a batch should take, given the average cost of a check
+    static const int64_t TARGET_BATCH_NANOS = 200 * 1000;
+
+    //! The checks handed to a worker, that the others steal when they run out
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
     //! Mutex to protect the inner state
     boost::mutex mutex;
 
@@ -37,9 +60,14 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The deques of the checks, the master's first
+    std::vector<std::unique_ptr<WorkerQueue>> vQueues;
+
+    //! The number of deques in use: the master's and those of the workers started
+    unsigned int nQueues;
+
+    //! The number of checks in the deques that no worker has taken yet
+    unsigned int nQueued;
 
     //! The number of workers (including the master) that are idle.
     int nIdle;
@@ -63,8 +91,75 @@ private:
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    //! Moving average of the time a check takes, 0 until a batch ran
+    std::atomic<int64_t> nCheckNanos;
+
+    /**
+     * Run a worker's batch of checks, stopping at the first one failing:
+     * through T::RunBatch if T has one, to verify them together.
+     */
+    template <typename U>
+    static auto RunChecks(std::vector<U>& vChecks, int) -> decltype(U::RunBatch(vChecks))
+    {
+        return U::RunBatch(vChecks);
+    }
+
+    template <typename U>
+    static bool RunChecks(std::vector<U>& vChecks, long)
+    {
+        for (U& check : vChecks)
+            if (!check())
+                return false;
+        return true;
+    }
+
+    //! The largest batch to take now, from the cost of the checks
+    unsigned int GetBatchLimit() const
+    {
+        const int64_t nCost = nCheckNanos.load(std::memory_order_relaxed);
+        if (nCost <= 0)
+            return nBatchSize;
+        return (unsigned int)std::max<int64_t>(1, std::min<int64_t>(nBatchSize, TARGET_BATCH_NANOS / nCost));
+    }
+
+    /**
+     * Move nNow checks, that the caller has reserved, to vChecks: from the
+     * back of its own deque first, then from the front of the others. The
+     * reserved checks are in the deques: they are pushed before nQueued is
+     * increased, and only taken after it is decreased.
+     */
+    void TakeChecks(unsigned int nSlot, unsigned int nNow, std::vector<T>& vChecks)
+    {
+        vChecks.resize(nNow);
+        unsigned int nTaken = 0;
+        {
+            WorkerQueue& own = *vQueues[nSlot];
+            boost::unique_lock<boost::mutex> lock(own.mutex);
+            for (; nTaken < nNow && !own.checks.empty(); nTaken++) {
+                vChecks[nTaken].swap(own.checks.back());
+                own.checks.pop_back();
+            }
+        }
+        for (unsigned int i = 1; nTaken < nNow; i++) {
+            WorkerQueue& victim = *vQueues[(nSlot + i) % MAX_WORKER_QUEUES];
+            boost::unique_lock<boost::mutex> lock(victim.mutex);
+            for (; nTaken < nNow && !victim.checks.empty(); nTaken++) {
+                vChecks[nTaken].swap(victim.checks.front());
+                victim.checks.pop_front();
+            }
+        }
+    }
+
+    //! Fold the cost of a batch in the moving average
+    void RecordBatchCost(int64_t nNanos, unsigned int nChecks)
+    {
+        const int64_t nCost = std::max<int64_t>(1, nNanos / nChecks);
+        const int64_t nOld = nCheckNanos.load(std::memory_order_relaxed);
+        nCheckNanos.store(nOld <= 0 ? nCost : (nOld * 7 + nCost) / 8, std::memory_order_relaxed);
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nSlot, bool fMaster = false)
     {
         boost::condition_variable& cond = fMaster ? condMaster : condWorker;
         std::vector<T> vChecks;
@@ -79,14 +174,14 @@ private:
                     fAllOk &= fOk;
                     nTodo -= nNow;
                     if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master he can exit and return the result
+                        // We processed the last element; inform the master it can exit and return the result
                         condMaster.notify_one();
                 } else {
                     // first iteration
                     nTotal++;
                 }
                 // logically, the do loop starts here
-                while (queue.empty()) {
+                while (nQueued == 0) {
                     if ((fMaster || fQuit) && nTodo == 0) {
                         nTotal--;
                         bool fRet = fAllOk;
@@ -104,54 +199,82 @@ private:
                 // * Do not try to do everything at once, but aim for increasingly smaller batches so
                 //   all workers finish approximately simultaneously.
                 // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+                // * Don't do batches smaller than 1 (duh), or longer than the target time.
+                nNow = std::max(1U, std::min(GetBatchLimit(), nQueued / (nTotal + nIdle + 1)));
+                nQueued -= nNow;
                 // Check whether we need to do work at all
                 fOk = fAllOk;
             }
+            // The checks are moved out of the deques without the shared lock
+            TakeChecks(nSlot, nNow, vChecks);
             // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
+            if (fOk) {
+                const auto start = std::chrono::steady_clock::now();
+                fOk = RunChecks(vChecks, 0);
+                RecordBatchCost(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), nNow);
+            }
             vChecks.clear();
         } while (true);
     }
 
 public:
-    //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    //! Create a new check queue, whose batches hold at most nBatchSizeIn checks
+    CCheckQueue(unsigned int nBatchSizeIn) : nQueues(1), nQueued(0), nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn), nCheckNanos(0)
+    {
+        for (unsigned int i = 0; i < MAX_WORKER_QUEUES; i++) {
+            vQueues.emplace_back(new WorkerQueue());
+        }
+    }
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nSlot;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nSlot = nQueues % MAX_WORKER_QUEUES;
+            nQueues = std::min(nQueues + 1, MAX_WORKER_QUEUES);
+        }
+        Loop(nSlot);
     }
 
     //! Wait until execution finishes, and return whether all evaluations where successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
-    //! Add a batch of checks to the queue
+    //! Add a batch of checks to the queue, spread over the deques of the workers
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        unsigned int nSlots;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nSlots = nQueues;
+        }
+        const size_t nPerSlot = (vChecks.size() + nSlots - 1) / nSlots;
+        for (unsigned int nSlot = 0; nSlot < nSlots; nSlot++) {
+            const size_t nBegin = nSlot * nPerSlot;
+            if (nBegin >= vChecks.size())
+                break;
+            const size_t nEnd = std::min(vChecks.size(), nBegin + nPerSlot);
+            WorkerQueue& target = *vQueues[nSlot];
+            boost::unique_lock<boost::mutex> lock(target.mutex);
+            for (size_t i = nBegin; i < nEnd; i++) {
+                target.checks.emplace_back();
+                vChecks[i].swap(target.checks.back());
+            }
+        }
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nQueued += vChecks.size();
+            nTodo += vChecks.size();
         }
-        nTodo += vChecks.size();
         if (vChecks.size() == 1)
             condWorker.notify_one();
-        else if (vChecks.size() > 1)
+        else
             condWorker.notify_all();
     }
 
@@ -32,6 +32,7 @@ bool CCoinsView::BatchWrite(CCoinsMap& mapCoins,
 bool CCoinsView::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const { return false; }
 bool CCoinsView::GetNullifier(const uint256 &nullifier) const { return false; }
 uint256 CCoinsView::GetBestAnchor() const { return uint256(); };
+bool CCoinsView::GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const { return false; }
 
 CCoinsViewBacked::CCoinsViewBacked(CCoinsView* viewIn) : base(viewIn) {}
 bool CCoinsViewBacked::GetCoin(const COutPoint& outpoint, Coin& coin) const { return base->GetCoin(outpoint, coin); }
@@ -53,6 +54,7 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap& mapCoins,
 bool CCoinsViewBacked::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const { return base->GetSaplingAnchorAt(rt, tree); }
 bool CCoinsViewBacked::GetNullifier(const uint256 &nullifier) const { return base->GetNullifier(nullifier); }
 uint256 CCoinsViewBacked::GetBestAnchor() const { return base->GetBestAnchor(); }
+bool CCoinsViewBacked::GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const { return base->GetAllSaplingData(vAnchors, vNullifiers); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 SaltedIdHasher::SaltedIdHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
@@ -69,8 +71,10 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint& outpoint) const
 {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        it->second.recent = true;
         return it;
+    }
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
@@ -113,6 +117,7 @@ void CCoinsViewCache::AddCoin(const COutPoint& outpoint, Coin&& coin, bool possi
     }
     it->second.coin = std::move(coin);
     it->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.recent = true;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
@@ -173,6 +178,19 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint& outpoint) const
     return it != cacheCoins.end();
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint& outpoint, Coin&& coin)
+{
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(coin)));
+    if (!inserted)
+        return;
+    if (it->second.coin.IsSpent()) {
+        it->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    cachedCoinsUsage += memusage::DynamicUsage(it->second.coin);
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const
 {
     if (hashBlock.IsNull())
@@ -286,6 +304,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap& mapCoins,
                     itUs->second.coin = std::move(it->second.coin);
                     cachedCoinsUsage += memusage::DynamicUsage(itUs->second.coin);
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.recent = true;
                     // NOTE: It is possible the child has a FRESH flag here in
                     // the event the entry we found in the parent is pruned. But
                     // we must not copy that FRESH flag to the parent as that
@@ -318,6 +337,69 @@ bool CCoinsViewCache::Flush()
     cacheSaplingAnchors.clear();
     cacheSaplingNullifiers.clear();
     cachedCoinsUsage = 0;
+    // release the pool
+    ReallocateCache();
+    return fOk;
+}
+
+void CCoinsViewCache::ReallocateCache()
+{
+    CCoinsMap mapNew(cacheCoins.size());
+    for (auto& it : cacheCoins) {
+        mapNew.emplace(it.first, std::move(it.second));
+    }
+    cacheCoins.swap(mapNew);
+}
+
+bool CCoinsViewCache::PartialFlush(size_t nMaxUsage)
+{
+    // The dirty entries are moved to mapWrite if evicted, copied otherwise.
+    CCoinsMap mapWrite;
+    auto evict = [&](CCoinsMap::iterator it) {
+        cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+            mapWrite.emplace(it->first, std::move(it->second));
+        }
+        return cacheCoins.erase(it);
+    };
+    // Evict the spent coins and the coins not used since the last partial
+    // flush, giving a second chance to the others. The memory used by the
+    // pool only goes down with ReallocateCache, hence the size estimation.
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent() || !it->second.recent) {
+            it = evict(it);
+        } else {
+            it->second.recent = false;
+            ++it;
+        }
+    }
+    const size_t nEntryUsage = memusage::MallocUsage(sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + 2 * sizeof(void*));
+    auto usage = [&]() {
+        return cacheCoins.size() * (nEntryUsage + sizeof(void*)) + cachedCoinsUsage +
+               memusage::DynamicUsage(cacheSaplingAnchors) + memusage::DynamicUsage(cacheSaplingNullifiers);
+    };
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end() && usage() > nMaxUsage;) {
+        it = evict(it);
+    }
+    for (auto& it : cacheCoins) {
+        if (it.second.flags & CCoinsCacheEntry::DIRTY) {
+            CCoinsCacheEntry& entry = mapWrite[it.first];
+            entry.coin = it.second.coin;
+            entry.flags = it.second.flags;
+            it.second.flags = 0;
+        }
+    }
+    LogPrint(BCLog::COINDB, "%s: %u coins kept in the cache, %u written\n", __func__, cacheCoins.size(), mapWrite.size());
+
+    bool fOk = base->BatchWrite(mapWrite,
+            hashBlock,
+            hashSaplingAnchor,
+            cacheSaplingAnchors,
+            cacheSaplingNullifiers);
+    cacheSaplingAnchors.clear();
+    cacheSaplingNullifiers.clear();
+    // release the memory of the evicted entries
+    ReallocateCache();
     return fOk;
 }
 
@@ -422,7 +504,7 @@ bool CCoinsViewCache::PruneInvalidEntries()
     // Prune zerocoin Mints and fraudulent/frozen outputs
     bool loaded = invalid_out::LoadOutpoints();
     assert(loaded);
-    for (const COutPoint& out: invalid_out::setInvalidOutPoints) {
+    for (const COutPoint& out: invalid_out::GetOutPoints()) {
         if (HaveCoin(out)) {
             LogPrintf("Pruning invalid output %s\n", out.ToString());
             SpendCoin(out);
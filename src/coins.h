@@ -15,6 +15,7 @@
 #include "sapling/incrementalmerkletree.h"
 #include "script/standard.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <assert.h>
@@ -28,25 +29,28 @@
  * Serialized format:
  * - VARINT((coinbase ? 2 : 0) | (coinstake ? 1 : 0) | (height << 2))
  * - the non-spent CTxOut (via CTxOutCompressor)
+ *
+ * The members are ordered by size, the flags fill the padding after the
+ * height: a coin is 48 bytes (instead of 64) on 64-bit platforms.
  */
 class Coin
 {
 public:
-    //! whether the containing transaction was a coinbase
-    bool fCoinBase;
-
-    //! whether the containing transaction was a coinstake
-    bool fCoinStake;
-
     //! unspent transaction output
     CTxOut out;
 
     //! at which height the containing transaction was included in the active block chain
     uint32_t nHeight;
 
+    //! whether the containing transaction was a coinbase
+    bool fCoinBase;
+
+    //! whether the containing transaction was a coinstake
+    bool fCoinStake;
+
     //! construct a Coin from a CTxOut and height/coinbase properties.
-    Coin(CTxOut&& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn) : fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), out(std::move(outIn)), nHeight(nHeightIn) {}
-    Coin(const CTxOut& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn) : fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn), out(outIn), nHeight(nHeightIn) {}
+    Coin(CTxOut&& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn) : out(std::move(outIn)), nHeight(nHeightIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn) {}
+    Coin(const CTxOut& outIn, int nHeightIn, bool fCoinBaseIn, bool fCoinStakeIn) : out(outIn), nHeight(nHeightIn), fCoinBase(fCoinBaseIn), fCoinStake(fCoinStakeIn) {}
 
     void Clear() {
         out.SetNull();
@@ -56,7 +60,7 @@ public:
     }
 
     //! empty constructor
-    Coin() : fCoinBase(false), fCoinStake(false), nHeight(0) { }
+    Coin() : nHeight(0), fCoinBase(false), fCoinStake(false) { }
 
     bool IsCoinBase() const {
         return fCoinBase;
@@ -96,8 +100,8 @@ public:
 class SaltedOutpointHasher
 {
 private:
-    /** Salt */
-    const uint64_t k0, k1;
+    /** Salt (not const, for the maps to be swappable) */
+    uint64_t k0, k1;
 
 public:
     SaltedOutpointHasher();
@@ -106,8 +110,12 @@ public:
      * This *must* return size_t. With Boost 1.46 on 32-bit systems the
      * unordered_map will behave unpredictably if the custom hasher returns a
      * uint64_t, resulting in failures when syncing the chain (#4634).
+     *
+     * Having the hash noexcept allows libstdc++'s unordered_map to recalculate
+     * the hash during rehash, so it does not need to be stored in the node:
+     * 8 bytes less per coin in the cache, the hash is cheap to compute.
      */
-    size_t operator()(const COutPoint& id) const {
+    size_t operator()(const COutPoint& id) const noexcept {
         return SipHashUint256Extra(k0, k1, id.hash, id.n);
     }
 };
@@ -116,8 +124,8 @@ public:
 class SaltedIdHasher
 {
 private:
-    /** Salt */
-    const uint64_t k0, k1;
+    /** Salt (not const, for the maps to be swappable) */
+    uint64_t k0, k1;
 
 public:
     SaltedIdHasher();
@@ -135,14 +143,15 @@ public:
 struct CCoinsCacheEntry {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    bool recent; // Used since the last partial flush (see CCoinsViewCache::PartialFlush).
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
         FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), recent(true) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), recent(true) {}
 };
 
 // Sapling
@@ -175,7 +184,15 @@ struct CNullifiersCacheEntry
 typedef std::unordered_map<uint256, CAnchorsSaplingCacheEntry, SaltedIdHasher> CAnchorsSaplingMap;
 typedef std::unordered_map<uint256, CNullifiersCacheEntry, SaltedIdHasher> CNullifiersMap;
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The entries of a coins map are allocated from a pool owned by the map, that
+ * is released all at once when the map is replaced (see CCoinsViewCache::Flush).
+ */
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                      sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                      (alignof(std::pair<const COutPoint, CCoinsCacheEntry>) > alignof(void*) ? alignof(std::pair<const COutPoint, CCoinsCacheEntry>) : alignof(void*))>
+        CCoinsMapAllocator;
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>, CCoinsMapAllocator> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -244,6 +261,9 @@ public:
 
     //! Get the current "tip" or the latest anchored tree root in the chain
     virtual uint256 GetBestAnchor() const;
+
+    //! Retrieve every anchored tree and spent nullifier (of the backing database only, like Cursor)
+    virtual bool GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const;
 };
 
 
@@ -260,6 +280,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView& viewIn);
+    CCoinsView* GetBackend() const { return base; }
     CCoinsViewCursor* Cursor() const override;
     size_t EstimateSize() const override;
 
@@ -273,6 +294,7 @@ public:
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
     bool GetNullifier(const uint256 &nullifier) const override;
     uint256 GetBestAnchor() const override;
+    bool GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const override;
 };
 
 
@@ -340,6 +362,12 @@ public:
      */
     bool HaveCoinInCache(const COutPoint& outpoint) const;
 
+    /**
+     * Add a coin read from the backing view ahead of its use (see PrefetchCoins), as
+     * FetchCoin would have added it. Nothing is done if the outpoint is in the cache.
+     */
+    void AddFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Return a reference to a Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin. Modifications to other cache entries are
@@ -367,6 +395,14 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush, but
+     * keep the coins used since the previous partial flush, as long as the cache
+     * memory usage remains below nMaxUsage. The others are evicted, then more
+     * entries if needed. The retained entries are left unmodified (and not FRESH).
+     */
+    bool PartialFlush(size_t nMaxUsage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is not modified.
      */
@@ -416,6 +452,8 @@ public:
 
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint& outpoint) const;
+    //! Replace cacheCoins by a new map with a pool of its own, keeping the entries
+    void ReallocateCache();
 
     //! Generalized interface for popping anchors
     template<typename Tree, typename Cache, typename CacheEntry>
@@ -7,6 +7,10 @@
 
 #include "consensus/params.h"
 #include "consensus/upgrades.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "random.h"
+#include "streams.h"
 #include "util.h"
 
 namespace Consensus {
@@ -24,4 +28,103 @@ bool Params::NetworkUpgradeActive(int nHeight, Consensus::UpgradeIndex idx) cons
     return NetworkUpgradeState(nHeight, *this, idx) == UPGRADE_ACTIVE;
 }
 
+/**
+ * The zerocoin parameters of the two readings of ZC_Modulus. Deriving them
+ * generates and tests primes for a result that never changes, so they are
+ * cached in the data directory: the file is keyed by the hash of the moduli
+ * and security level, and checksummed. They are derived again when it does
+ * not match.
+ */
+struct ZerocoinParamsCache {
+    libzerocoin::ZerocoinParams paramsHex;
+    libzerocoin::ZerocoinParams paramsDec;
+
+    explicit ZerocoinParamsCache(const std::string& strModulus);
+
+private:
+    uint256 key;
+    fs::path path;
+
+    bool Read();
+    bool Write() const;
+};
+
+ZerocoinParamsCache::ZerocoinParamsCache(const std::string& strModulus)
+{
+    CBigNum bnHexModulus = 0;
+    bnHexModulus.SetHex(strModulus);
+    CBigNum bnDecModulus = 0;
+    bnDecModulus.SetDec(strModulus);
+
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << bnHexModulus << bnDecModulus << (uint32_t)ZEROCOIN_DEFAULT_SECURITYLEVEL << std::string(ZEROCOIN_PROTOCOL_VERSION);
+    key = ss.GetHash();
+    path = GetDataDir() / "zerocoinparams.dat";
+
+    if (Read() &&
+            paramsHex.accumulatorParams.accumulatorModulus == bnHexModulus &&
+            paramsDec.accumulatorParams.accumulatorModulus == bnDecModulus)
+        return;
+
+    paramsHex = libzerocoin::ZerocoinParams(bnHexModulus);
+    paramsDec = libzerocoin::ZerocoinParams(bnDecModulus);
+    if (!Write())
+        LogPrintf("%s: the zerocoin parameters will be derived again at the next start\n", __func__);
+}
+
+bool ZerocoinParamsCache::Read()
+{
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return false;
+
+    try {
+        CHashVerifier<CAutoFile> verifier(&filein);
+        uint256 keyIn;
+        verifier >> keyIn;
+        if (keyIn != key)
+            return error("%s: %s is for other parameters", __func__, path.string());
+        verifier >> paramsHex;
+        verifier >> paramsDec;
+        uint256 hashIn;
+        filein >> hashIn;
+        if (hashIn != verifier.GetHash())
+            return error("%s: Checksum mismatch, data corrupted", __func__);
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return paramsHex.initialized && paramsDec.initialized;
+}
+
+bool ZerocoinParamsCache::Write() const
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key << paramsHex << paramsDec;
+    ss << Hash(ss.begin(), ss.end());
+
+    unsigned short randv = 0;
+    GetRandBytes((unsigned char*)&randv, sizeof(randv));
+    const fs::path pathTmp = GetDataDir() / strprintf("zerocoinparams.dat.%04x", randv);
+    CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: Failed to open file %s", __func__, pathTmp.string());
+    try {
+        fileout << ss;
+    } catch (const std::exception& e) {
+        return error("%s: Serialize or I/O error - %s", __func__, e.what());
+    }
+    FileCommit(fileout.Get());
+    fileout.fclose();
+
+    if (!RenameOver(pathTmp, path))
+        return error("%s: Rename-into-place failed", __func__);
+    return true;
+}
+
+libzerocoin::ZerocoinParams* Params::Zerocoin_Params(bool useModulusV1) const
+{
+    static ZerocoinParamsCache cache(ZC_Modulus);
+    return (useModulusV1 ? &cache.paramsHex : &cache.paramsDec);
+}
+
 } // End consensus namespace
@@ -86,6 +86,10 @@ struct NetworkUpgrade {
  */
 struct Params {
     uint256 hashGenesisBlock;
+    // Default -assumevalid: a block whose ancestors are known to have valid scripts
+    uint256 defaultAssumeValid;
+    // Hash of the legacy zerocoin snapshot that -zerocoinsnapshot accepts (null if there is none)
+    uint256 hashZerocoinSnapshot;
     bool fPowAllowMinDifficultyBlocks;
     uint256 powLimit;
     uint256 posLimitV1;
@@ -170,16 +174,8 @@ struct Params {
     int ZC_MinStakeDepth;
     int ZC_TimeStart;
 
-    libzerocoin::ZerocoinParams* Zerocoin_Params(bool useModulusV1) const
-    {
-        static CBigNum bnHexModulus = 0;
-        if (!bnHexModulus) bnHexModulus.SetHex(ZC_Modulus);
-        static libzerocoin::ZerocoinParams ZCParamsHex = libzerocoin::ZerocoinParams(bnHexModulus);
-        static CBigNum bnDecModulus = 0;
-        if (!bnDecModulus) bnDecModulus.SetDec(ZC_Modulus);
-        static libzerocoin::ZerocoinParams ZCParamsDec = libzerocoin::ZerocoinParams(bnDecModulus);
-        return (useModulusV1 ? &ZCParamsHex : &ZCParamsDec);
-    }
+    //! Derived once from ZC_Modulus (read as hex for the V1 parameters), cached in zerocoinparams.dat
+    libzerocoin::ZerocoinParams* Zerocoin_Params(bool useModulusV1) const;
 
     /**
      * Returns true if the given network upgrade is active as of the given block
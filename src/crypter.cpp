@@ -169,6 +169,7 @@ bool CCryptoKeyStore::AddCryptedKey(const CPubKey& vchPubKey, const std::vector<
             return false;
 
         mapCryptedKeys[vchPubKey.GetID()] = make_pair(vchPubKey, vchCryptedSecret);
+        setVerifiedCryptedKeys.erase(vchPubKey.GetID());
     }
     return true;
 }
@@ -190,6 +191,15 @@ bool CCryptoKeyStore::GetKey(const CKeyID& address, CKey& keyOut) const
             if (vchSecret.size() != 32)
                 return false;
             keyOut.Set(vchSecret.begin(), vchSecret.end(), vchPubKey.IsCompressed());
+            // Unlock only checks one key: check the others the first time they are used
+            if (!setVerifiedCryptedKeys.count(address)) {
+                if (keyOut.GetPubKey() != vchPubKey) {
+                    LogPrintf("%s: key %s doesn't decrypt to its public key. Your wallet file may be corrupt.\n", __func__, address.ToString());
+                    keyOut = CKey();
+                    return false;
+                }
+                setVerifiedCryptedKeys.insert(address);
+            }
             return true;
         }
     }
@@ -13,6 +13,8 @@
 #include "serialize.h"
 #include "streams.h"
 
+#include <set>
+
 class uint256;
 
 const unsigned int WALLET_CRYPTO_KEY_SIZE = 32;
@@ -153,8 +155,11 @@ protected:
 
     CryptedKeyMap mapCryptedKeys;
 
+    //! the crypted keys whose decryption matched their public key, checked by GetKey on first use
+    mutable std::set<CKeyID> setVerifiedCryptedKeys;
+
     // Unlock Sapling keys
-    bool UnlockSaplingKeys(const CKeyingMaterial& vMasterKeyIn, bool fDecryptionThoroughlyChecked);
+    bool UnlockSaplingKeys(const CKeyingMaterial& vMasterKeyIn);
 
 public:
     CCryptoKeyStore() : fUseCrypto(false) { }
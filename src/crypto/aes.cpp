@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/dogecash-config.h"
+#endif
+
 #include "aes.h"
 #include "crypto/common.h"
 
@@ -12,6 +16,125 @@ extern "C" {
 #include "crypto/ctaes/ctaes.c"
 }
 
+#if defined(USE_ASM) && defined(ENABLE_AESNI) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#define HAVE_X86_AES_DISPATCH 1
+namespace aes_ni
+{
+void Expand256(unsigned char* rk, const unsigned char* key, bool decrypt);
+void Encrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in);
+void Decrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in);
+}
+#endif
+
+#if defined(ENABLE_ARM_AES)
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#endif
+namespace aes_arm
+{
+void Expand256(unsigned char* rk, const unsigned char* key, bool decrypt);
+void Encrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in);
+void Decrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in);
+}
+#endif
+
+namespace {
+
+/** An AES-256 implementation using the instructions of the CPU */
+struct AES256Hardware {
+    const char* name;
+    void (*Expand)(unsigned char* rk, const unsigned char* key, bool decrypt);
+    void (*Encrypt)(const unsigned char* rk, unsigned char* out, const unsigned char* in);
+    void (*Decrypt)(const unsigned char* rk, unsigned char* out, const unsigned char* in);
+};
+
+#if defined(HAVE_X86_AES_DISPATCH)
+/** Execute the cpuid instruction */
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+#if defined(__i386__) && defined(__PIC__)
+    // ebx holds the GOT pointer in 32-bit PIC code
+    __asm__ ("xchgl %%ebx, %1\n\tcpuid\n\txchgl %%ebx, %1" : "=a"(a), "=&r"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+#else
+    __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+#endif
+}
+#endif
+
+/** The FIPS-197 AES-256 example, both ways */
+bool SelfTest(const AES256Hardware& hw)
+{
+    static const unsigned char key[32] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f};
+    static const unsigned char plain[16] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+    static const unsigned char cipher[16] = {
+        0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf, 0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89};
+    unsigned char rk[AES256_ROUNDKEYS_SIZE];
+    unsigned char out[16];
+    hw.Expand(rk, key, false);
+    hw.Encrypt(rk, out, plain);
+    if (memcmp(out, cipher, sizeof(out)) != 0) return false;
+    hw.Expand(rk, key, true);
+    hw.Decrypt(rk, out, cipher);
+    return memcmp(out, plain, sizeof(out)) == 0;
+}
+
+/** The hardware implementation this CPU supports, if any */
+const AES256Hardware* DetectHardware()
+{
+#if defined(HAVE_X86_AES_DISPATCH)
+    static const AES256Hardware aesni = {"aesni", aes_ni::Expand256, aes_ni::Encrypt256, aes_ni::Decrypt256};
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    const bool have_aesni = (ecx >> 25) & 1;
+    if (have_aesni && SelfTest(aesni)) {
+        return &aesni;
+    }
+#endif
+
+#if defined(ENABLE_ARM_AES)
+    static const AES256Hardware arm_aes = {"arm_aes", aes_arm::Expand256, aes_arm::Encrypt256, aes_arm::Decrypt256};
+    bool have_arm_aes = false;
+#if defined(__linux__)
+#if defined(__arm__) // 32-bit
+    have_arm_aes = getauxval(AT_HWCAP2) & HWCAP2_AES;
+#else // 64-bit
+    have_arm_aes = getauxval(AT_HWCAP) & HWCAP_AES;
+#endif
+#elif defined(__APPLE__)
+    int val = 0;
+    size_t len = sizeof(val);
+    if (sysctlbyname("hw.optional.arm.FEAT_AES", &val, &len, nullptr, 0) == 0) {
+        have_arm_aes = val != 0;
+    }
+#endif
+    if (have_arm_aes && SelfTest(arm_aes)) {
+        return &arm_aes;
+    }
+#endif
+    return nullptr;
+}
+
+const AES256Hardware* GetHardware()
+{
+    static const AES256Hardware* const hw = DetectHardware();
+    return hw;
+}
+
+} // namespace
+
+std::string AES256Implementation()
+{
+    const AES256Hardware* hw = GetHardware();
+    return hw ? hw->name : "standard";
+}
+
 AES128Encrypt::AES128Encrypt(const unsigned char key[16])
 {
     AES128_init(&ctx, key);
@@ -44,32 +167,54 @@ void AES128Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char cip
 
 AES256Encrypt::AES256Encrypt(const unsigned char key[32])
 {
-    AES256_init(&ctx, key);
+    const AES256Hardware* hw = GetHardware();
+    fHardware = hw != nullptr;
+    if (fHardware) {
+        hw->Expand(rk, key, false);
+    } else {
+        AES256_init(&ctx, key);
+    }
 }
 
 AES256Encrypt::~AES256Encrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(rk, 0, sizeof(rk));
 }
 
 void AES256Encrypt::Encrypt(unsigned char ciphertext[16], const unsigned char plaintext[16]) const
 {
-    AES256_encrypt(&ctx, 1, ciphertext, plaintext);
+    if (fHardware) {
+        GetHardware()->Encrypt(rk, ciphertext, plaintext);
+    } else {
+        AES256_encrypt(&ctx, 1, ciphertext, plaintext);
+    }
 }
 
 AES256Decrypt::AES256Decrypt(const unsigned char key[32])
 {
-    AES256_init(&ctx, key);
+    const AES256Hardware* hw = GetHardware();
+    fHardware = hw != nullptr;
+    if (fHardware) {
+        hw->Expand(rk, key, true);
+    } else {
+        AES256_init(&ctx, key);
+    }
 }
 
 AES256Decrypt::~AES256Decrypt()
 {
     memset(&ctx, 0, sizeof(ctx));
+    memset(rk, 0, sizeof(rk));
 }
 
 void AES256Decrypt::Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const
 {
-    AES256_decrypt(&ctx, 1, plaintext, ciphertext);
+    if (fHardware) {
+        GetHardware()->Decrypt(rk, plaintext, ciphertext);
+    } else {
+        AES256_decrypt(&ctx, 1, plaintext, ciphertext);
+    }
 }
 
 
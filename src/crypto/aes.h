@@ -7,6 +7,8 @@
 #ifndef BITCOIN_CRYPTO_AES_H
 #define BITCOIN_CRYPTO_AES_H
 
+#include <string>
+
 extern "C" {
 #include "crypto/ctaes/ctaes.h"
 }
@@ -14,6 +16,8 @@ extern "C" {
 static const int AES_BLOCKSIZE = 16;
 static const int AES128_KEYSIZE = 16;
 static const int AES256_KEYSIZE = 32;
+/** The 15 round keys of AES-256, as used by the hardware implementations */
+static const int AES256_ROUNDKEYS_SIZE = 15 * AES_BLOCKSIZE;
 
 /** An encryption class for AES-128. */
 class AES128Encrypt
@@ -39,11 +43,14 @@ public:
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
 };
 
-/** An encryption class for AES-256. */
+/** An encryption class for AES-256, with AES-NI or ARMv8 AES when the CPU has them. */
 class AES256Encrypt
 {
 private:
     AES256_ctx ctx;
+    //! The round keys of the hardware implementation, when there is one
+    unsigned char rk[AES256_ROUNDKEYS_SIZE];
+    bool fHardware;
 
 public:
     AES256Encrypt(const unsigned char key[32]);
@@ -51,11 +58,14 @@ public:
     void Encrypt(unsigned char ciphertext[16], const unsigned char plaintext[16]) const;
 };
 
-/** A decryption class for AES-256. */
+/** A decryption class for AES-256, with AES-NI or ARMv8 AES when the CPU has them. */
 class AES256Decrypt
 {
 private:
     AES256_ctx ctx;
+    //! The round keys of the hardware implementation, when there is one
+    unsigned char rk[AES256_ROUNDKEYS_SIZE];
+    bool fHardware;
 
 public:
     AES256Decrypt(const unsigned char key[32]);
@@ -63,6 +73,9 @@ public:
     void Decrypt(unsigned char plaintext[16], const unsigned char ciphertext[16]) const;
 };
 
+/** The AES-256 implementation in use: "aesni", "arm_aes" or "standard" (ctaes). */
+std::string AES256Implementation();
+
 class AES256CBCEncrypt
 {
 public:
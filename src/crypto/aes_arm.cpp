@@ -0,0 +1,85 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// AES-256 with the ARMv8 cryptography extension.
+
+#ifdef ENABLE_ARM_AES
+
+#include <stdint.h>
+#include <string.h>
+#include <arm_acle.h>
+#include <arm_neon.h>
+
+namespace {
+
+/** SubWord of a key schedule word: AESE on four copies of it, so that ShiftRows doesn't move anything */
+uint32_t inline SubWord(uint32_t w)
+{
+    const uint8x16_t x = vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(w)), vdupq_n_u8(0));
+    return vgetq_lane_u32(vreinterpretq_u32_u8(x), 0);
+}
+
+uint32_t inline RotWord(uint32_t w)
+{
+    // The words are loaded little endian: the first byte is the lowest
+    return (w >> 8) | (w << 24);
+}
+
+} // namespace
+
+namespace aes_arm
+{
+void Expand256(unsigned char* rk, const unsigned char* key, bool decrypt)
+{
+    static const uint32_t rcon[7] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40};
+    uint32_t w[60];
+    memcpy(w, key, 32);
+    for (int i = 8; i < 60; i++) {
+        uint32_t t = w[i - 1];
+        if (i % 8 == 0) {
+            t = SubWord(RotWord(t)) ^ rcon[i / 8 - 1];
+        } else if (i % 8 == 4) {
+            t = SubWord(t);
+        }
+        w[i] = w[i - 8] ^ t;
+    }
+
+    if (decrypt) {
+        // The equivalent inverse cipher: reversed keys, InvMixColumns on the inner ones
+        uint8x16_t k;
+        for (int i = 0; i < 15; i++) {
+            k = vld1q_u8((const uint8_t*)(w + 4 * (14 - i)));
+            if (i > 0 && i < 14) {
+                k = vaesimcq_u8(k);
+            }
+            vst1q_u8(rk + 16 * i, k);
+        }
+    } else {
+        memcpy(rk, w, sizeof(w));
+    }
+    memset(w, 0, sizeof(w));
+}
+
+void Encrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in)
+{
+    uint8x16_t x = vld1q_u8(in);
+    for (int i = 0; i < 13; i++) {
+        x = vaesmcq_u8(vaeseq_u8(x, vld1q_u8(rk + 16 * i)));
+    }
+    x = vaeseq_u8(x, vld1q_u8(rk + 16 * 13));
+    vst1q_u8(out, veorq_u8(x, vld1q_u8(rk + 16 * 14)));
+}
+
+void Decrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in)
+{
+    uint8x16_t x = vld1q_u8(in);
+    for (int i = 0; i < 13; i++) {
+        x = vaesimcq_u8(vaesdq_u8(x, vld1q_u8(rk + 16 * i)));
+    }
+    x = vaesdq_u8(x, vld1q_u8(rk + 16 * 13));
+    vst1q_u8(out, veorq_u8(x, vld1q_u8(rk + 16 * 14)));
+}
+}
+
+#endif
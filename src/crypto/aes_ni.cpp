@@ -0,0 +1,99 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// AES-256 with the AES-NI instructions, following the key expansion of the
+// Intel AES-NI white paper (Shay Gueron, "Intel Advanced Encryption Standard
+// (AES) New Instructions Set").
+
+#ifdef ENABLE_AESNI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace {
+
+/** The first half of a round key pair: SubWord(RotWord(w)) ^ rcon of the previous key */
+__m128i inline ExpandA(__m128i key, __m128i assist)
+{
+    assist = _mm_shuffle_epi32(assist, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+/** The second half of a round key pair: SubWord(w) of the previous key */
+__m128i inline ExpandB(__m128i key, __m128i prev)
+{
+    const __m128i assist = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(prev, 0x00), 0xaa);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, assist);
+}
+
+} // namespace
+
+namespace aes_ni
+{
+void Expand256(unsigned char* rk, const unsigned char* key, bool decrypt)
+{
+    __m128i k[15];
+    k[0] = _mm_loadu_si128((const __m128i*)key);
+    k[1] = _mm_loadu_si128((const __m128i*)(key + 16));
+    // The round constant of _mm_aeskeygenassist_si128 must be an immediate
+    k[2] = ExpandA(k[0], _mm_aeskeygenassist_si128(k[1], 0x01));
+    k[3] = ExpandB(k[1], k[2]);
+    k[4] = ExpandA(k[2], _mm_aeskeygenassist_si128(k[3], 0x02));
+    k[5] = ExpandB(k[3], k[4]);
+    k[6] = ExpandA(k[4], _mm_aeskeygenassist_si128(k[5], 0x04));
+    k[7] = ExpandB(k[5], k[6]);
+    k[8] = ExpandA(k[6], _mm_aeskeygenassist_si128(k[7], 0x08));
+    k[9] = ExpandB(k[7], k[8]);
+    k[10] = ExpandA(k[8], _mm_aeskeygenassist_si128(k[9], 0x10));
+    k[11] = ExpandB(k[9], k[10]);
+    k[12] = ExpandA(k[10], _mm_aeskeygenassist_si128(k[11], 0x20));
+    k[13] = ExpandB(k[11], k[12]);
+    k[14] = ExpandA(k[12], _mm_aeskeygenassist_si128(k[13], 0x40));
+
+    __m128i* out = (__m128i*)rk;
+    if (decrypt) {
+        // The equivalent inverse cipher: reversed keys, InvMixColumns on the inner ones
+        _mm_storeu_si128(out, k[14]);
+        for (int i = 1; i < 14; i++) {
+            _mm_storeu_si128(out + i, _mm_aesimc_si128(k[14 - i]));
+        }
+        _mm_storeu_si128(out + 14, k[0]);
+    } else {
+        for (int i = 0; i < 15; i++) {
+            _mm_storeu_si128(out + i, k[i]);
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        k[i] = _mm_setzero_si128();
+    }
+}
+
+void Encrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in)
+{
+    const __m128i* k = (const __m128i*)rk;
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_loadu_si128(k));
+    for (int i = 1; i < 14; i++) {
+        x = _mm_aesenc_si128(x, _mm_loadu_si128(k + i));
+    }
+    _mm_storeu_si128((__m128i*)out, _mm_aesenclast_si128(x, _mm_loadu_si128(k + 14)));
+}
+
+void Decrypt256(const unsigned char* rk, unsigned char* out, const unsigned char* in)
+{
+    const __m128i* k = (const __m128i*)rk;
+    __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_loadu_si128(k));
+    for (int i = 1; i < 14; i++) {
+        x = _mm_aesdec_si128(x, _mm_loadu_si128(k + i));
+    }
+    _mm_storeu_si128((__m128i*)out, _mm_aesdeclast_si128(x, _mm_loadu_si128(k + 14)));
+}
+}
+
+#endif
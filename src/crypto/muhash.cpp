@@ -0,0 +1,264 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace {
+
+using limb_t = Num3072::limb_t;
+using double_limb_t = Num3072::double_limb_t;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr int LIMBS = Num3072::LIMBS;
+/** 2^3072 - 1103717, the largest 3072-bit safe prime number, is used as the modulus. */
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+/** a += b, returns the carry */
+inline limb_t Add(limb_t* a, const limb_t* b)
+{
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        const double_limb_t sum = (double_limb_t)a[i] + b[i] + carry;
+        a[i] = (limb_t)sum;
+        carry = (limb_t)(sum >> LIMB_SIZE);
+    }
+    return carry;
+}
+
+/** a -= b, returns the borrow */
+inline limb_t Sub(limb_t* a, const limb_t* b)
+{
+    limb_t borrow = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        const limb_t ai = a[i];
+        const limb_t d = ai - b[i] - borrow;
+        borrow = (ai < b[i] || (ai == b[i] && borrow)) ? 1 : 0;
+        a[i] = d;
+    }
+    return borrow;
+}
+
+/** a += n, n below 2^(2 * LIMB_SIZE - 1), returns the carry */
+inline limb_t AddSmall(limb_t* a, double_limb_t n)
+{
+    for (int i = 0; i < LIMBS && n; ++i) {
+        n += a[i];
+        a[i] = (limb_t)n;
+        n >>= LIMB_SIZE;
+    }
+    return (limb_t)n;
+}
+
+/** a = (a >> 1) | (top << 3071) */
+inline void ShiftRight1(limb_t* a, limb_t top)
+{
+    for (int i = 0; i < LIMBS - 1; ++i) {
+        a[i] = (a[i] >> 1) | (a[i + 1] << (LIMB_SIZE - 1));
+    }
+    a[LIMBS - 1] = (a[LIMBS - 1] >> 1) | (top << (LIMB_SIZE - 1));
+}
+
+inline int Compare(const limb_t* a, const limb_t* b)
+{
+    for (int i = LIMBS - 1; i >= 0; --i) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+inline bool IsOne(const limb_t* a)
+{
+    if (a[0] != 1) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (a[i] != 0) return false;
+    }
+    return true;
+}
+
+/** The modulus */
+struct Prime {
+    limb_t limbs[LIMBS];
+    Prime()
+    {
+        for (int i = 0; i < LIMBS; ++i) limbs[i] = ~(limb_t)0;
+        limbs[0] -= MAX_PRIME_DIFF - 1;
+    }
+};
+const Prime prime;
+
+/** Bring a number below 2^3072 into [0, p): it is at least p if adding MAX_PRIME_DIFF overflows */
+inline void FullReduce(limb_t* a)
+{
+    limb_t tmp[LIMBS];
+    memcpy(tmp, a, sizeof(tmp));
+    if (AddSmall(tmp, MAX_PRIME_DIFF)) {
+        memcpy(a, tmp, sizeof(tmp));
+    }
+}
+
+/** (a + p) / 2 or a / 2, whichever is whole, modulo p */
+inline void HalveMod(limb_t* a)
+{
+    limb_t top = 0;
+    if (a[0] & 1) {
+        top = Add(a, prime.limbs);
+    }
+    ShiftRight1(a, top);
+}
+
+/** a = a - b modulo p, both in [0, p) */
+inline void SubMod(limb_t* a, const limb_t* b)
+{
+    if (Sub(a, b)) {
+        Add(a, prime.limbs);
+    }
+}
+
+} // namespace
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            limbs[i] = ReadLE32(data + 4 * i);
+        } else {
+            limbs[i] = ReadLE64(data + 8 * i);
+        }
+    }
+    FullReduce(limbs);
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) limbs[i] = 0;
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product over 6144 bits
+    limb_t t[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            const double_limb_t cur = (double_limb_t)limbs[i] * a.limbs[j] + t[i + j] + carry;
+            t[i + j] = (limb_t)cur;
+            carry = (limb_t)(cur >> LIMB_SIZE);
+        }
+        t[i + LIMBS] = carry;
+    }
+
+    // 2^3072 = MAX_PRIME_DIFF (mod p): fold the high half into the low half
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        const double_limb_t cur = (double_limb_t)t[i + LIMBS] * MAX_PRIME_DIFF + t[i] + carry;
+        limbs[i] = (limb_t)cur;
+        carry = (limb_t)(cur >> LIMB_SIZE);
+    }
+    // carry < MAX_PRIME_DIFF + 1: fold it in as well. Wrapping around a
+    // second time leaves a number small enough to take the last fold.
+    while (carry) {
+        carry = AddSmall(limbs, (double_limb_t)carry * MAX_PRIME_DIFF);
+    }
+    FullReduce(limbs);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Binary extended Euclid, with the invariants x1 * this = u and
+    // x2 * this = v (mod p). The inputs are public, so it needn't run in
+    // constant time. Zero, which has no inverse, is returned as is.
+    Num3072 u(*this), v, x1, x2;
+    memcpy(v.limbs, prime.limbs, sizeof(v.limbs));
+    memset(x2.limbs, 0, sizeof(x2.limbs));
+    limb_t zero[LIMBS] = {};
+    if (Compare(u.limbs, zero) == 0) return u;
+
+    while (!IsOne(u.limbs) && !IsOne(v.limbs)) {
+        while (!(u.limbs[0] & 1)) {
+            ShiftRight1(u.limbs, 0);
+            HalveMod(x1.limbs);
+        }
+        while (!(v.limbs[0] & 1)) {
+            ShiftRight1(v.limbs, 0);
+            HalveMod(x2.limbs);
+        }
+        if (Compare(u.limbs, v.limbs) >= 0) {
+            Sub(u.limbs, v.limbs);
+            SubMod(x1.limbs, x2.limbs);
+        } else {
+            Sub(v.limbs, u.limbs);
+            SubMod(x2.limbs, x1.limbs);
+        }
+    }
+    return IsOne(u.limbs) ? x1 : x2;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            WriteLE32(out + i * 4, limbs[i]);
+        } else {
+            WriteLE64(out + i * 8, limbs[i]);
+        }
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hashed_in[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hashed_in);
+    unsigned char tmp[Num3072::BYTE_SIZE];
+    ChaCha20(hashed_in, sizeof(hashed_in)).Output(tmp, Num3072::BYTE_SIZE);
+    return Num3072(tmp);
+}
+
+void MuHash3072::Finalize(uint256& out)
+{
+    m_numerator.Divide(m_denominator);
+    m_denominator.SetToOne(); // Needed to keep the MuHash object valid
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Insert(const std::vector<unsigned char>& in)
+{
+    m_numerator.Multiply(ToNum3072(in.data(), in.size()));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const std::vector<unsigned char>& in)
+{
+    m_denominator.Multiply(ToNum3072(in.data(), in.size()));
+    return *this;
+}
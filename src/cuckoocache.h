@@ -415,6 +415,19 @@ public:
         }
     }
 
+    /** for_each calls fn with each element of the table not collected as
+     * garbage, the ones erased by contains are skipped.
+     *
+     * @param fn the function to call with each element
+     */
+    template <typename F>
+    void for_each(F fn) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                fn(table[i]);
+    }
+
     /* contains iterates through the hash locations for a given element
      * and checks to see if it is present.
      *
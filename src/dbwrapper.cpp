@@ -5,20 +5,82 @@
 #include "dbwrapper.h"
 
 #include "util.h"
+#include "util/threadnames.h"
 
 #include <leveldb/cache.h>
 #include <leveldb/env.h>
 #include <leveldb/filter_policy.h>
 #include <memenv.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <stdint.h>
+#include <thread>
 
+/**
+ * An environment that runs the background work of a database (the compactions)
+ * on a thread of its own.
+ * The default environment has a single background thread for all the databases
+ * of the process: the compactions of a database wait for the ones of the others.
+ */
+class CDBCompactionEnv : public leveldb::EnvWrapper
+{
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::pair<void (*)(void*), void*> > queue;
+    bool fStop{false};
+    std::thread thread;
+
+    void Loop()
+    {
+        util::ThreadRename("dogecash-leveldb");
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cond.wait(lock, [this] { return fStop || !queue.empty(); });
+            if (queue.empty())
+                return;
+            std::pair<void (*)(void*), void*> work = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            work.first(work.second);
+            lock.lock();
+        }
+    }
+
+public:
+    explicit CDBCompactionEnv(leveldb::Env* target) : leveldb::EnvWrapper(target), thread(&CDBCompactionEnv::Loop, this) {}
+
+    //! The database must be closed first: it waits for its scheduled work to be done
+    ~CDBCompactionEnv()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_one();
+        thread.join();
+    }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+    void Schedule(void (*function)(void*), void* arg) override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.emplace_back(function, arg);
+        }
+        cond.notify_one();
+    }
+};
+
+
+static leveldb::Options GetOptions(const CDBOptions& dbOptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
+    options.block_cache = leveldb::NewLRUCache(dbOptions.nBlockCacheSize);
+    options.write_buffer_size = dbOptions.nWriteBufferSize;
+    options.filter_policy = dbOptions.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dbOptions.nBloomBits) : nullptr;
+    options.max_file_size = dbOptions.nMaxFileSize;
     options.compression = leveldb::kNoCompression;
     options.max_open_files = 64;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
@@ -29,14 +91,20 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe) :
+    CDBWrapper(path, CDBOptions(nCacheSize), fMemory, fWipe)
+{
+}
+
+CDBWrapper::CDBWrapper(const fs::path& path, const CDBOptions& dbOptions, bool fMemory, bool fWipe) :
+    nCompactAfterBytes(dbOptions.nCompactAfterBytes)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(dbOptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -49,6 +117,10 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
         }
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
+        if (dbOptions.fOwnCompactionThread) {
+            penv = new CDBCompactionEnv(leveldb::Env::Default());
+            options.env = penv;
+        }
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -71,6 +143,48 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
+    nBytesWritten += batch.SizeEstimate();
+    return true;
+}
+
+bool CDBWrapper::CompactStep(size_t nKeys)
+{
+    if (!fCompacting) {
+        if (nCompactAfterBytes == 0 || nBytesWritten < nCompactAfterBytes)
+            return false;
+        LogPrint(BCLog::LEVELDB, "Compacting LevelDB after %u bytes written\n", nBytesWritten.load());
+        nBytesWritten = 0;
+        strCompactCursor.clear();
+        fCompacting = true;
+    }
+
+    // The end of this step: nKeys entries after the previous one
+    std::unique_ptr<leveldb::Iterator> it(pdb->NewIterator(iteroptions));
+    if (strCompactCursor.empty()) {
+        it->SeekToFirst();
+    } else {
+        it->Seek(strCompactCursor);
+    }
+    for (size_t i = 0; i < nKeys && it->Valid(); i++) {
+        it->Next();
+    }
+    dbwrapper_private::HandleError(it->status());
+
+    const leveldb::Slice begin(strCompactCursor);
+    const leveldb::Slice* pbegin = strCompactCursor.empty() ? nullptr : &begin;
+    if (it->Valid()) {
+        const std::string strEnd = it->key().ToString();
+        const leveldb::Slice end(strEnd);
+        it.reset();
+        pdb->CompactRange(pbegin, &end);
+        strCompactCursor = strEnd;
+    } else {
+        it.reset();
+        pdb->CompactRange(pbegin, nullptr);
+        strCompactCursor.clear();
+        fCompacting = false;
+        LogPrint(BCLog::LEVELDB, "LevelDB compaction pass done\n");
+    }
     return true;
 }
 
@@ -84,7 +198,9 @@ bool CDBWrapper::IsEmpty()
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
+void CDBIterator::SeekToLast() { piter->SeekToLast(); }
 void CDBIterator::Next() { piter->Next(); }
+void CDBIterator::Prev() { piter->Prev(); }
 
 
 namespace dbwrapper_private {
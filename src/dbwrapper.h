@@ -13,6 +13,8 @@
 #include "version.h"
 
 
+#include <atomic>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -20,6 +22,34 @@
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+/** The keys are serialized on the stack, and only allocate when they are longer than that */
+typedef CInlineWriter<DBWRAPPER_PREALLOC_KEY_SIZE> CDBKeyWriter;
+
+//! Entries compacted by each CDBWrapper::CompactStep call of the scheduler
+static const size_t DB_COMPACTION_STEP_KEYS = 200000;
+//! Interval between the CDBWrapper::CompactStep calls of the scheduler, in milliseconds
+static const int64_t DB_COMPACTION_INTERVAL = 60 * 1000;
+
+/** The LevelDB settings of a database, tuned for the way it is used */
+struct CDBOptions
+{
+    //! Cache of the uncompressed table blocks
+    size_t nBlockCacheSize;
+    //! Size of the memtable: up to two write buffers may be held in memory simultaneously
+    size_t nWriteBufferSize;
+    //! Bits per key of the bloom filters of the tables, 0 for none. They save the disk reads of the missing keys.
+    int nBloomBits{10};
+    //! Target size of the table files: larger ones need fewer of the max_open_files for big databases
+    size_t nMaxFileSize{2 << 20};
+    //! Bytes written after which CompactStep makes a compaction pass over the database, 0 to leave it to LevelDB
+    uint64_t nCompactAfterBytes{0};
+    //! Compact in the background on a thread of its own, instead of the one that LevelDB shares between all the databases
+    bool fOwnCompactionThread{false};
+
+    /** The default split of a cache size: half for the block cache, a quarter for the write buffer */
+    explicit CDBOptions(size_t nCacheSize = 0) : nBlockCacheSize(nCacheSize / 2), nWriteBufferSize(nCacheSize / 4) {}
+};
+
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -48,8 +78,9 @@ class CDBBatch
 private:
     leveldb::WriteBatch batch;
 
-    CDataStream ssKey;
-    CDataStream ssValue;
+    //! Reused by every write of the batch: it doesn't allocate once it is large enough
+    CDBKeyWriter ssKey;
+    std::vector<unsigned char> vchValue;
 
     size_t size_estimate;
 
@@ -57,7 +88,10 @@ public:
     /**
      * @param[in] _parent   CDBWrapper that this batch is to be submitted to
      */
-    CDBBatch() : ssKey(SER_DISK, CLIENT_VERSION), ssValue(SER_DISK, CLIENT_VERSION), size_estimate(0) { };
+    CDBBatch() : ssKey(SER_DISK, CLIENT_VERSION), size_estimate(0)
+    {
+        vchValue.reserve(DBWRAPPER_PREALLOC_VALUE_SIZE);
+    };
 
     void Clear()
     {
@@ -68,15 +102,13 @@ public:
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey.clear();
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
-        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
-        ssValue.reserve(DBWRAPPER_PREALLOC_VALUE_SIZE);
-        ssValue << value;
-        leveldb::Slice slValue(ssValue.data(), ssValue.size());
+        vchValue.clear();
+        CVectorWriter(SER_DISK, CLIENT_VERSION, vchValue, 0, value);
+        leveldb::Slice slValue((const char*)vchValue.data(), vchValue.size());
 
         batch.Put(slKey, slValue);
 
@@ -88,15 +120,12 @@ public:
         // - byte[]: value
         // The formula below assumes the key and value are both less than 16k.
         size_estimate += 3 + (slKey.size() > 127) + slKey.size() + (slValue.size() > 127) + slValue.size();
-        ssKey.clear();
-        ssValue.clear();
     }
 
     template <typename K>
     void Erase(const K& key)
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey.clear();
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
@@ -108,7 +137,6 @@ public:
         // - byte[]: key
         // The formula below assumes the key is less than 16kB.
         size_estimate += 2 + (slKey.size() > 127) + slKey.size();
-        ssKey.clear();
     }
 
     size_t SizeEstimate() const { return size_estimate; }
@@ -129,21 +157,22 @@ public:
     bool Valid();
 
     void SeekToFirst();
+    void SeekToLast();
 
     template<typename K> void Seek(const K& key) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        CDBKeyWriter ssKey(SER_DISK, CLIENT_VERSION);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
         piter->Seek(slKey);
     }
 
     void Next();
+    void Prev();
 
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            SpanReader ssKey(SER_DISK, CLIENT_VERSION, slKey.data(), slKey.size());
             ssKey >> key;
         } catch(const std::exception& e) {
             return false;
@@ -158,7 +187,7 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            SpanReader ssValue(SER_DISK, CLIENT_VERSION, slValue.data(), slValue.size());
             ssValue >> value;
         } catch(const std::exception& e) {
             return false;
@@ -196,6 +225,14 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! bytes written since the last compaction pass
+    std::atomic<uint64_t> nBytesWritten{0};
+    const uint64_t nCompactAfterBytes;
+
+    //! the key the compaction pass in progress stopped at: only used by CompactStep
+    std::string strCompactCursor;
+    bool fCompacting{false};
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -204,13 +241,16 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      */
     CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    /**
+     * @param[in] dbOptions   LevelDB settings of this database.
+     */
+    CDBWrapper(const fs::path& path, const CDBOptions& dbOptions, bool fMemory = false, bool fWipe = false);
     ~CDBWrapper();
 
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        CDBKeyWriter ssKey(SER_DISK, CLIENT_VERSION);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
@@ -223,7 +263,7 @@ public:
             dbwrapper_private::HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            SpanReader ssValue(SER_DISK, CLIENT_VERSION, strValue.data(), strValue.size());
             ssValue >> value;
         } catch (const std::exception&) {
             return false;
@@ -242,8 +282,7 @@ public:
     template <typename K>
     bool Exists(const K& key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
-        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        CDBKeyWriter ssKey(SER_DISK, CLIENT_VERSION);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
 
@@ -291,22 +330,46 @@ public:
     */
     bool IsEmpty();
 
+    /**
+     * Compact the next nKeys entries of the database, if a compaction pass is in
+     * progress or enough was written since the last one (nCompactAfterBytes).
+     * The scheduler calls it when the node is idle, so that LevelDB has less to
+     * compact in the background during the next burst of writes.
+     * A pass goes over the whole database in these small steps, so that each call
+     * is short. Not to be called from several threads.
+     * @return true if something was compacted
+     */
+    bool CompactStep(size_t nKeys);
+
     template<typename K>
     size_t EstimateSize(const K& key_begin, const K& key_end) const
     {
-        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
-        ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
-        ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        CDBKeyWriter ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
         ssKey1 << key_begin;
         ssKey2 << key_end;
-        leveldb::Slice slKey1(&ssKey1[0], ssKey1.size());
-        leveldb::Slice slKey2(&ssKey2[0], ssKey2.size());
+        leveldb::Slice slKey1(ssKey1.data(), ssKey1.size());
+        leveldb::Slice slKey2(ssKey2.data(), ssKey2.size());
         uint64_t size = 0;
         leveldb::Range range(slKey1, slKey2);
         pdb->GetApproximateSizes(&range, 1, &size);
         return size;
     }
 
+    /**
+     * Compact a range of keys. NULL is treated as a key before all keys
+     * in the database.
+     */
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CDBKeyWriter ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(ssKey1.data(), ssKey1.size());
+        leveldb::Slice slKey2(ssKey2.data(), ssKey2.size());
+        pdb->CompactRange(&slKey1, &slKey2);
+    }
+
 };
 
 #endif // BITCOIN_DBWRAPPER_H
@@ -13,6 +13,8 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <iostream>
+#include <sstream>
 #include <stdio.h>
 
 #include <event2/event.h>
@@ -24,6 +26,7 @@
 
 static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
 static const int DEFAULT_HTTP_CLIENT_TIMEOUT=900;
+static const int DEFAULT_STDIN_BATCH_SIZE = 1000;
 
 std::string HelpMessageCli()
 {
@@ -41,6 +44,9 @@ std::string HelpMessageCli()
     strUsage += HelpMessageOpt("-rpcuser=<user>", _("Username for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcpassword=<pw>", _("Password for JSON-RPC connections"));
     strUsage += HelpMessageOpt("-rpcclienttimeout=<n>", strprintf(_("Timeout during HTTP requests (default: %d)"), DEFAULT_HTTP_CLIENT_TIMEOUT));
+    strUsage += HelpMessageOpt("-stdin", _("Read the commands from standard input, one per line with their parameters separated by whitespace, "
+                                           "send them as JSON-RPC batches over a single connection and print the results in order"));
+    strUsage += HelpMessageOpt("-stdinbatchsize=<n>", strprintf(_("Number of commands sent in each batch with -stdin (default: %d)"), DEFAULT_STDIN_BATCH_SIZE));
 
     return strUsage;
 }
@@ -74,7 +80,8 @@ static bool AppInitRPC(int argc, char* argv[])
             strUsage += "\n" + _("Usage:") + "\n" +
                         "  dogecash-cli [options] <command> [params]  " + _("Send command to DogeCash Core") + "\n" +
                         "  dogecash-cli [options] help                " + _("List commands") + "\n" +
-                        "  dogecash-cli [options] help <command>      " + _("Get help for a command") + "\n";
+                        "  dogecash-cli [options] help <command>      " + _("Get help for a command") + "\n" +
+                        "  dogecash-cli [options] -stdin < commands   " + _("Send the commands read from standard input") + "\n";
 
             strUsage += "\n" + HelpMessageCli();
         }
@@ -113,11 +120,15 @@ struct HTTPReply
 {
     int status;
     std::string body;
+    //! the loop to stop once the reply is in, a kept alive connection keeps it running
+    struct event_base* base{nullptr};
 };
 
 static void http_request_done(struct evhttp_request *req, void *ctx)
 {
     HTTPReply *reply = static_cast<HTTPReply*>(ctx);
+    if (reply->base)
+        event_base_loopbreak(reply->base);
 
     if (req == NULL) {
         /* If req is NULL, it means an error occurred while connecting, but
@@ -140,77 +151,109 @@ static void http_request_done(struct evhttp_request *req, void *ctx)
     }
 }
 
-UniValue CallRPC(const std::string& strMethod, const UniValue& params)
+/**
+ * A connection to the RPC server. Kept alive, it carries the requests one
+ * after the other instead of connecting again for each of them.
+ */
+class CRPCConnection
 {
-    std::string host = gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT);
-    int port = gArgs.GetArg("-rpcport", BaseParams().RPCPort());
-
-    // Create event base
-    struct event_base *base = event_base_new(); // TODO RAII
-    if (!base)
-        throw std::runtime_error("cannot create event_base");
-
-    // Synchronously look up hostname
-    struct evhttp_connection *evcon = evhttp_connection_base_new(base, NULL, host.c_str(), port); // TODO RAII
-    if (evcon == NULL)
-        throw std::runtime_error("create connection failed");
-    evhttp_connection_set_timeout(evcon, gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
-
-    HTTPReply response;
-    struct evhttp_request *req = evhttp_request_new(http_request_done, (void*)&response); // TODO RAII
-    if (req == NULL)
-        throw std::runtime_error("create http request failed");
-
-    // Get credentials
-    std::string strRPCUserColonPass;
-    if (gArgs.GetArg("-rpcpassword", "") == "") {
-        // Try fall back to cookie-based authentication if no password is provided
-        if (!GetAuthCookie(&strRPCUserColonPass)) {
-            throw std::runtime_error(strprintf(
-                 _("Could not locate RPC credentials. No authentication cookie could be found, and no rpcpassword is set in the configuration file (%s)"),
-                    GetConfigFile().string().c_str()));
+public:
+    explicit CRPCConnection(bool fKeepAliveIn) : fKeepAlive(fKeepAliveIn)
+    {
+        host = gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT);
+        int port = gArgs.GetArg("-rpcport", BaseParams().RPCPort());
+
+        // Get credentials
+        std::string strRPCUserColonPass;
+        if (gArgs.GetArg("-rpcpassword", "") == "") {
+            // Try fall back to cookie-based authentication if no password is provided
+            if (!GetAuthCookie(&strRPCUserColonPass)) {
+                throw std::runtime_error(strprintf(
+                     _("Could not locate RPC credentials. No authentication cookie could be found, and no rpcpassword is set in the configuration file (%s)"),
+                        GetConfigFile().string().c_str()));
 
+            }
+        } else {
+            strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+        }
+        strAuthorization = std::string("Basic ") + EncodeBase64(strRPCUserColonPass);
+
+        // Create event base
+        base = event_base_new();
+        if (!base)
+            throw std::runtime_error("cannot create event_base");
+
+        // Synchronously look up hostname
+        evcon = evhttp_connection_base_new(base, NULL, host.c_str(), port);
+        if (evcon == NULL) {
+            event_base_free(base);
+            throw std::runtime_error("create connection failed");
         }
-    } else {
-        strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+        evhttp_connection_set_timeout(evcon, gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
     }
 
-    struct evkeyvalq *output_headers = evhttp_request_get_output_headers(req);
-    assert(output_headers);
-    evhttp_add_header(output_headers, "Host", host.c_str());
-    evhttp_add_header(output_headers, "Connection", "close");
-    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
-
-    // Attach request data
-    std::string strRequest = JSONRPCRequestObj(strMethod, params, 1).write() + "\n";
-    struct evbuffer * output_buffer = evhttp_request_get_output_buffer(req);
-    assert(output_buffer);
-    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
-
-    int r = evhttp_make_request(evcon, req, EVHTTP_REQ_POST, "/");
-    if (r != 0) {
+    ~CRPCConnection()
+    {
         evhttp_connection_free(evcon);
         event_base_free(base);
-        throw CConnectionFailed("send http request failed");
     }
 
-    event_base_dispatch(base);
-    evhttp_connection_free(evcon);
-    event_base_free(base);
+    /** Send a request, or a batch of them, and return the parsed reply */
+    UniValue Post(const UniValue& request)
+    {
+        HTTPReply response;
+        response.base = base;
+        struct evhttp_request *req = evhttp_request_new(http_request_done, (void*)&response);
+        if (req == NULL)
+            throw std::runtime_error("create http request failed");
+
+        struct evkeyvalq *output_headers = evhttp_request_get_output_headers(req);
+        assert(output_headers);
+        evhttp_add_header(output_headers, "Host", host.c_str());
+        evhttp_add_header(output_headers, "Connection", fKeepAlive ? "keep-alive" : "close");
+        evhttp_add_header(output_headers, "Authorization", strAuthorization.c_str());
+
+        // Attach request data
+        std::string strRequest = request.write() + "\n";
+        struct evbuffer * output_buffer = evhttp_request_get_output_buffer(req);
+        assert(output_buffer);
+        evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+        // the request is freed by libevent, whether it is sent or not
+        int r = evhttp_make_request(evcon, req, EVHTTP_REQ_POST, "/");
+        if (r != 0)
+            throw CConnectionFailed("send http request failed");
+
+        event_base_dispatch(base);
+
+        if (response.status == 0)
+            throw CConnectionFailed("couldn't connect to server");
+        else if (response.status == HTTP_UNAUTHORIZED)
+            throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
+        else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
+            throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
+        else if (response.body.empty())
+            throw std::runtime_error("no response from server");
+
+        // Parse reply
+        UniValue valReply(UniValue::VSTR);
+        if (!valReply.read(response.body))
+            throw std::runtime_error("couldn't parse reply from server");
+        return valReply;
+    }
 
-    if (response.status == 0)
-        throw CConnectionFailed("couldn't connect to server");
-    else if (response.status == HTTP_UNAUTHORIZED)
-        throw std::runtime_error("incorrect rpcuser or rpcpassword (authorization failed)");
-    else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR)
-        throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
-    else if (response.body.empty())
-        throw std::runtime_error("no response from server");
+private:
+    std::string host;
+    std::string strAuthorization;
+    const bool fKeepAlive;
+    struct event_base* base;
+    struct evhttp_connection* evcon;
+};
 
-    // Parse reply
-    UniValue valReply(UniValue::VSTR);
-    if (!valReply.read(response.body))
-        throw std::runtime_error("couldn't parse reply from server");
+UniValue CallRPC(const std::string& strMethod, const UniValue& params)
+{
+    CRPCConnection connection(false);
+    const UniValue valReply = connection.Post(JSONRPCRequestObj(strMethod, params, 1));
     const UniValue& reply = valReply.get_obj();
     if (reply.empty())
         throw std::runtime_error("expected reply to have result, error and id properties");
@@ -218,6 +261,101 @@ UniValue CallRPC(const std::string& strMethod, const UniValue& params)
     return reply;
 }
 
+/** The text to print for a reply, returns the exit code of the command */
+static int FormatReply(const UniValue& reply, bool fWait, std::string& strPrint)
+{
+    // Parse reply
+    const UniValue& result = find_value(reply, "result");
+    const UniValue& error = find_value(reply, "error");
+
+    if (!error.isNull()) {
+        // Error
+        int code = error["code"].get_int();
+        if (fWait && code == RPC_IN_WARMUP)
+            throw CConnectionFailed("server in warmup");
+        strPrint = "error: " + error.write();
+        return abs(code);
+    }
+    // Result
+    if (result.isNull())
+        strPrint = "";
+    else if (result.isStr())
+        strPrint = result.get_str();
+    else
+        strPrint = result.write(2);
+    return 0;
+}
+
+/**
+ * -stdin: the commands of the standard input, sent in batches over a single
+ * connection. The results are printed in the order of the commands, the exit
+ * code is the one of the first command that failed.
+ */
+static int CommandLineRPCBatch()
+{
+    std::vector<UniValue> vRequests;
+    std::string strLine;
+    while (std::getline(std::cin, strLine)) {
+        std::istringstream ss(strLine);
+        std::string strMethod;
+        if (!(ss >> strMethod))
+            continue;
+        std::vector<std::string> strParams;
+        for (std::string strParam; ss >> strParam; )
+            strParams.push_back(strParam);
+        try {
+            vRequests.push_back(JSONRPCRequestObj(strMethod, RPCConvertValues(strMethod, strParams), (int)vRequests.size()));
+        } catch (const std::exception& e) {
+            throw std::runtime_error(strprintf("command %d (%s): %s", vRequests.size() + 1, strMethod, e.what()));
+        }
+    }
+
+    const size_t nBatchSize = std::max(1, (int)gArgs.GetArg("-stdinbatchsize", DEFAULT_STDIN_BATCH_SIZE));
+    const bool fWait = gArgs.GetBoolArg("-rpcwait", false);
+    CRPCConnection connection(true);
+    int nRet = 0;
+    for (size_t nStart = 0; nStart < vRequests.size(); nStart += nBatchSize) {
+        const size_t nEnd = std::min(vRequests.size(), nStart + nBatchSize);
+        UniValue batch(UniValue::VARR);
+        for (size_t i = nStart; i < nEnd; i++)
+            batch.push_back(vRequests[i]);
+
+        // Execute and handle connection failures with -rpcwait
+        std::vector<std::string> vPrint(nEnd - nStart);
+        std::vector<int> vRet(nEnd - nStart);
+        do {
+            try {
+                const UniValue replies = connection.Post(batch);
+                if (!replies.isArray() || replies.size() != batch.size())
+                    throw std::runtime_error("expected reply to be an array with a reply for each command");
+                // matched by id, the order of the replies is up to the server
+                for (size_t i = 0; i < replies.size(); i++) {
+                    const UniValue& id = find_value(replies[i], "id");
+                    if (!id.isNum() || id.get_int64() < (int64_t)nStart || id.get_int64() >= (int64_t)nEnd)
+                        throw std::runtime_error("unexpected id in the reply from server");
+                    const size_t nIndex = id.get_int64() - nStart;
+                    vRet[nIndex] = FormatReply(replies[i], fWait, vPrint[nIndex]);
+                }
+                // Connection succeeded, no need to retry.
+                break;
+            } catch (const CConnectionFailed& e) {
+                if (fWait)
+                    MilliSleep(1000);
+                else
+                    throw;
+            }
+        } while (fWait);
+
+        for (size_t i = 0; i < vPrint.size(); i++) {
+            if (nRet == 0)
+                nRet = vRet[i];
+            if (vPrint[i] != "")
+                fprintf((vRet[i] == 0 ? stdout : stderr), "%s\n", vPrint[i].c_str());
+        }
+    }
+    return nRet;
+}
+
 int CommandLineRPC(int argc, char* argv[])
 {
     std::string strPrint;
@@ -229,6 +367,12 @@ int CommandLineRPC(int argc, char* argv[])
             argv++;
         }
 
+        if (gArgs.GetBoolArg("-stdin", false)) {
+            if (argc > 1)
+                throw std::runtime_error("no command expected on the command line with -stdin");
+            return CommandLineRPCBatch();
+        }
+
         // Method
         if (argc < 2)
             throw std::runtime_error("too few parameters");
@@ -243,27 +387,7 @@ int CommandLineRPC(int argc, char* argv[])
         do {
             try {
                 const UniValue reply = CallRPC(strMethod, params);
-
-                // Parse reply
-                const UniValue& result = find_value(reply, "result");
-                const UniValue& error = find_value(reply, "error");
-
-                if (!error.isNull()) {
-                    // Error
-                    int code = error["code"].get_int();
-                    if (fWait && code == RPC_IN_WARMUP)
-                        throw CConnectionFailed("server in warmup");
-                    strPrint = "error: " + error.write();
-                    nRet = abs(code);
-                } else {
-                    // Result
-                    if (result.isNull())
-                        strPrint = "";
-                    else if (result.isStr())
-                        strPrint = result.get_str();
-                    else
-                        strPrint = result.write(2);
-                }
+                nRet = FormatReply(reply, fWait, strPrint);
                 // Connection succeeded, no need to retry.
                 break;
             } catch (const CConnectionFailed& e) {
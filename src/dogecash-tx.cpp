@@ -17,15 +17,20 @@
 #include "script/sign.h"
 #include <univalue.h>
 #include "util.h"
+#include "util/parallel.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
+#include <iostream>
+#include <sstream>
 #include <stdio.h>
 
 #include <boost/algorithm/string.hpp>
 
 static bool fCreateBlank;
 static std::map<std::string, UniValue> registers;
+static int nSignThreads;
 
 static bool AppInitRawTx(int argc, char* argv[])
 {
@@ -43,6 +48,9 @@ static bool AppInitRawTx(int argc, char* argv[])
     }
 
     fCreateBlank = gArgs.GetBoolArg("-create", false);
+    nSignThreads = gArgs.GetArg("-par", 0);
+    if (nSignThreads <= 0)
+        nSignThreads = std::max(1, GetNumCores());
 
     if (argc < 2 || gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help")) {
         // First part of help message is specific to this utility
@@ -50,13 +58,18 @@ static bool AppInitRawTx(int argc, char* argv[])
                                _("Usage:") + "\n" +
                                "  dogecash-tx [options] <hex-tx> [commands]  " + _("Update hex-encoded dogecash transaction") + "\n" +
                                "  dogecash-tx [options] -create [commands]   " + _("Create hex-encoded dogecash transaction") + "\n" +
+                               "  dogecash-tx [options] -batch < specs       " + _("Create or update the transactions read from standard input") + "\n" +
                                "\n";
 
         fprintf(stdout, "%s", strUsage.c_str());
 
         strUsage = HelpMessageGroup(_("Options:"));
         strUsage += HelpMessageOpt("-?", _("This help message"));
+        strUsage += HelpMessageOpt("-batch", _("Read the transactions from standard input, one per line as <hex-tx> or -create followed by the commands, "
+                                               "separated by whitespace, and output them in order. A line of register commands only sets the registers, "
+                                               "which are kept for the next lines."));
         strUsage += HelpMessageOpt("-create", _("Create new, empty TX."));
+        strUsage += HelpMessageOpt("-par=<n>", _("Set the number of threads signing the inputs of a transaction, up to the number of cores (0 = number of cores, default: 0)"));
         strUsage += HelpMessageOpt("-json", _("Select JSON output"));
         strUsage += HelpMessageOpt("-txid", _("Output only the hex-encoded transaction id of the resultant transaction."));
         strUsage += HelpMessageOpt("-regtest", _("Enter regression test mode, which uses a special chain in which blocks can be solved instantly."));
@@ -90,6 +103,18 @@ static bool AppInitRawTx(int argc, char* argv[])
     return true;
 }
 
+/**
+ * The keys and the previous outputs of the registers, parsed once for all
+ * the transactions signed until the registers change.
+ */
+struct SignContext
+{
+    CBasicKeyStore keystore;
+    CCoinsView viewDummy;
+    CCoinsViewCache view{&viewDummy};
+};
+static std::unique_ptr<SignContext> signContext;
+
 static void RegisterSetJson(const std::string& key, const std::string& rawJson)
 {
     UniValue val;
@@ -99,6 +124,8 @@ static void RegisterSetJson(const std::string& key, const std::string& rawJson)
     }
 
     registers[key] = val;
+    // parsed again for the next signature
+    signContext.reset();
 }
 
 static void RegisterSet(const std::string& strInput)
@@ -342,28 +369,18 @@ std::vector<unsigned char> ParseHexUO(std::map<std::string, UniValue>& o, std::s
     return ParseHexUV(o[strKey], strKey);
 }
 
-static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
+static SignContext& GetSignContext()
 {
-    int nHashType = SIGHASH_ALL;
-
-    if (flagStr.size() > 0)
-        if (!findSighashFlags(nHashType, flagStr))
-            throw std::runtime_error("unknown sighash flag/sign option");
+    if (signContext)
+        return *signContext;
 
-    std::vector<CTransaction> txVariants;
-    txVariants.push_back(tx);
-
-    // mergedTx will end up with all the signatures; it
-    // starts as a clone of the raw tx:
-    CMutableTransaction mergedTx(txVariants[0]);
-    bool fComplete = true;
-    CCoinsView viewDummy;
-    CCoinsViewCache view(&viewDummy);
+    std::unique_ptr<SignContext> context(new SignContext());
+    CCoinsViewCache& view = context->view;
 
     if (!registers.count("privatekeys"))
         throw std::runtime_error("privatekeys register variable must be set.");
     bool fGivenKeys = false;
-    CBasicKeyStore tempKeystore;
+    CBasicKeyStore& tempKeystore = context->keystore;
     UniValue keysObj = registers["privatekeys"];
     fGivenKeys = true;
 
@@ -421,6 +438,7 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
                 if (prevOut.exists("amount")) {
                     newcoin.out.nValue = AmountFromValue(prevOut["amount"]);
                 }
+                view.AddCoin(out, std::move(newcoin), true);
             }
 
             // if redeemScript given and private keys given,
@@ -435,24 +453,48 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
         }
     }
 
-    const CKeyStore& keystore = tempKeystore;
+    signContext = std::move(context);
+    return *signContext;
+}
+
+static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
+{
+    int nHashType = SIGHASH_ALL;
+
+    if (flagStr.size() > 0)
+        if (!findSighashFlags(nHashType, flagStr))
+            throw std::runtime_error("unknown sighash flag/sign option");
+
+    std::vector<CTransaction> txVariants;
+    txVariants.push_back(tx);
+
+    // mergedTx will end up with all the signatures; it
+    // starts as a clone of the raw tx:
+    CMutableTransaction mergedTx(txVariants[0]);
+    bool fComplete = true;
+
+    SignContext& context = GetSignContext();
+    const CKeyStore& keystore = context.keystore;
+    // looked up before the threads, the cache is not thread safe
+    std::vector<Coin> vCoins;
+    for (const CTxIn& txin : mergedTx.vin)
+        vCoins.push_back(context.view.AccessCoin(txin.prevout));
 
     bool fHashSingle = ((nHashType & ~SIGHASH_ANYONECANPAY) == SIGHASH_SINGLE);
+    const SigVersion sigversion = mergedTx.GetRequiredSigVersion();
 
-    // Sign what we can:
-    for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
-        CTxIn& txin = mergedTx.vin[i];
-        const Coin& coin = view.AccessCoin(txin.prevout);
-        if (coin.IsSpent()) {
-            fComplete = false;
-            continue;
-        }
+    // Sign what we can, the inputs in parallel as a signature does not
+    // depend on the scriptSig of the other inputs:
+    std::vector<SignatureData> vSigData(mergedTx.vin.size());
+    ParallelForEach(mergedTx.vin.size(), nSignThreads, [&](unsigned int i) {
+        const Coin& coin = vCoins[i];
+        if (coin.IsSpent())
+            return;
 
         const CScript& prevPubKey = coin.out.scriptPubKey;
         const CAmount& amount = coin.out.nValue;
 
-        SignatureData sigdata;
-        SigVersion sigversion =  mergedTx.GetRequiredSigVersion();
+        SignatureData& sigdata = vSigData[i];
         // Only sign SIGHASH_SINGLE if there's a corresponding output:
         if (!fHashSingle || (i < mergedTx.vout.size()))
             ProduceSignature(
@@ -467,12 +509,25 @@ static void MutateTxSign(CMutableTransaction& tx, const std::string& flagStr)
         for (const CTransaction& txv : txVariants) {
             sigdata = CombineSignatures(prevPubKey, MutableTransactionSignatureChecker(&mergedTx, i, amount), sigdata, DataFromTransaction(txv, i));
         }
-        UpdateTransaction(mergedTx, i, sigdata);
-        if (!VerifyScript(txin.scriptSig, prevPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
-                MutableTransactionSignatureChecker(&mergedTx, i, amount), sigversion))
+    });
+
+    for (unsigned int i = 0; i < mergedTx.vin.size(); i++) {
+        if (vCoins[i].IsSpent()) {
             fComplete = false;
+            continue;
+        }
+        UpdateTransaction(mergedTx, i, vSigData[i]);
     }
 
+    std::vector<char> vValid(mergedTx.vin.size(), false);
+    ParallelForEach(mergedTx.vin.size(), nSignThreads, [&](unsigned int i) {
+        const Coin& coin = vCoins[i];
+        vValid[i] = !coin.IsSpent() && VerifyScript(mergedTx.vin[i].scriptSig, coin.out.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
+                                                    MutableTransactionSignatureChecker(&mergedTx, i, coin.out.nValue), sigversion);
+    });
+    if (std::count(vValid.begin(), vValid.end(), false))
+        fComplete = false;
+
     if (fComplete) {
         // do nothing... for now
         // perhaps store this for later optional JSON output
@@ -494,9 +549,9 @@ public:
     }
 };
 
-static void MutateTx(CMutableTransaction& tx, const std::string& command, const std::string& commandVal)
+// ecc is started by the first signature, for all the transactions that follow
+static void MutateTx(CMutableTransaction& tx, const std::string& command, const std::string& commandVal, std::unique_ptr<Secp256k1Init>& ecc)
 {
-    std::unique_ptr<Secp256k1Init> ecc;
     if (command == "nversion")
         MutateTxVersion(tx, commandVal);
     else if (command == "locktime")
@@ -562,6 +617,62 @@ static void OutputTx(const CTransaction& tx)
         OutputTxHex(tx);
 }
 
+static void MutateTx(CMutableTransaction& tx, const std::vector<std::string>& commands, std::unique_ptr<Secp256k1Init>& ecc)
+{
+    for (const std::string& arg : commands) {
+        std::string key, value;
+        size_t eqpos = arg.find('=');
+        if (eqpos == std::string::npos)
+            key = arg;
+        else {
+            key = arg.substr(0, eqpos);
+            value = arg.substr(eqpos + 1);
+        }
+
+        MutateTx(tx, key, value, ecc);
+    }
+}
+
+static bool IsRegisterCommand(const std::string& arg)
+{
+    return boost::algorithm::starts_with(arg, "set=") || boost::algorithm::starts_with(arg, "load=");
+}
+
+/**
+ * -batch: a transaction for each line of the standard input, with the
+ * arguments of the command line. The registers, the keys and the previous
+ * outputs parsed from them, and the secp256k1 context are kept from one
+ * transaction to the next.
+ */
+static void BatchRawTx(std::unique_ptr<Secp256k1Init>& ecc)
+{
+    std::string strLine;
+    for (int nLine = 1; std::getline(std::cin, strLine); nLine++) {
+        std::istringstream ss(strLine);
+        std::vector<std::string> args;
+        for (std::string arg; ss >> arg; )
+            args.push_back(arg);
+        if (args.empty())
+            continue;
+
+        try {
+            if (std::all_of(args.begin(), args.end(), IsRegisterCommand)) {
+                CMutableTransaction txDummy;
+                MutateTx(txDummy, args, ecc);
+                continue;
+            }
+
+            CMutableTransaction tx;
+            if (args[0] != "-create" && !DecodeHexTx(tx, args[0]))
+                throw std::runtime_error("invalid transaction encoding");
+            MutateTx(tx, std::vector<std::string>(args.begin() + 1, args.end()), ecc);
+            OutputTx(tx);
+        } catch (const std::exception& e) {
+            throw std::runtime_error(strprintf("line %d: %s", nLine, e.what()));
+        }
+    }
+}
+
 static std::string readStdin()
 {
     char buf[4096];
@@ -594,6 +705,14 @@ static int CommandLineRawTx(int argc, char* argv[])
             argv++;
         }
 
+        std::unique_ptr<Secp256k1Init> ecc;
+        if (gArgs.GetBoolArg("-batch", false)) {
+            if (argc > 1)
+                throw std::runtime_error("no transaction expected on the command line with -batch");
+            BatchRawTx(ecc);
+            return nRet;
+        }
+
         CMutableTransaction tx;
         int startArg;
 
@@ -614,19 +733,7 @@ static int CommandLineRawTx(int argc, char* argv[])
         } else
             startArg = 1;
 
-        for (int i = startArg; i < argc; i++) {
-            std::string arg = argv[i];
-            std::string key, value;
-            size_t eqpos = arg.find('=');
-            if (eqpos == std::string::npos)
-                key = arg;
-            else {
-                key = arg.substr(0, eqpos);
-                value = arg.substr(eqpos + 1);
-            }
-
-            MutateTx(tx, key, value);
-        }
+        MutateTx(tx, std::vector<std::string>(&argv[startArg], &argv[argc]), ecc);
 
         OutputTx(tx);
     }
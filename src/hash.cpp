@@ -72,6 +72,73 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
     return h1;
 }
 
+CMurmurHash3Data::CMurmurHash3Data(const unsigned char* pdata, size_t nLen) : nSize(nLen)
+{
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    auto mix = [c1, c2](uint32_t k1) {
+        k1 *= c1;
+        k1 = ROTL32(k1, 15);
+        return k1 * c2;
+    };
+
+    const size_t nblocks = nLen / 4;
+    vBlocks.reserve(nblocks + 1);
+    for (size_t i = 0; i < nblocks; i++) {
+        vBlocks.push_back(mix(ReadLE32(pdata + i * 4)));
+    }
+    const uint8_t* tail = pdata + nblocks * 4;
+    uint32_t k1 = 0;
+    switch (nLen & 3) {
+    case 3:
+        k1 ^= tail[2] << 16;
+    case 2:
+        k1 ^= tail[1] << 8;
+    case 1:
+        k1 ^= tail[0];
+        vBlocks.push_back(mix(k1));
+    };
+}
+
+static inline uint32_t MurmurHash3Final(uint32_t h1, uint32_t nSize)
+{
+    h1 ^= nSize;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+    return h1;
+}
+
+uint32_t CMurmurHash3Data::Hash(uint32_t nHashSeed) const
+{
+    uint32_t h1;
+    Hash(&nHashSeed, &h1, 1);
+    return h1;
+}
+
+void CMurmurHash3Data::Hash(const uint32_t* pSeeds, uint32_t* pHashes, size_t n) const
+{
+    // The tail block is only xored in
+    const size_t nFull = nSize / 4;
+    for (size_t j = 0; j < n; j++) {
+        pHashes[j] = pSeeds[j];
+    }
+    for (size_t i = 0; i < nFull; i++) {
+        const uint32_t k1 = vBlocks[i];
+        for (size_t j = 0; j < n; j++) {
+            uint32_t h1 = pHashes[j] ^ k1;
+            h1 = ROTL32(h1, 13);
+            pHashes[j] = h1 * 5 + 0xe6546b64;
+        }
+    }
+    const uint32_t kTail = nFull < vBlocks.size() ? vBlocks[nFull] : 0;
+    for (size_t j = 0; j < n; j++) {
+        pHashes[j] = MurmurHash3Final(pHashes[j] ^ kTail, nSize);
+    }
+}
+
 void BIP32Hash(const ChainCode chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64])
 {
     unsigned char num[4];
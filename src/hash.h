@@ -398,6 +398,33 @@ public:
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/**
+ * The part of MurmurHash3 (x86_32) of some data that doesn't depend on the
+ * seed: its 32-bit blocks, already mixed. Hashing the same data with many
+ * seeds (the hash functions of the bloom filters) then only runs the short
+ * per-seed chain over those words.
+ */
+class CMurmurHash3Data
+{
+private:
+    //! The mixed blocks, the tail last (when the size isn't a multiple of 4)
+    std::vector<uint32_t> vBlocks;
+    uint32_t nSize;
+
+public:
+    CMurmurHash3Data(const unsigned char* pdata, size_t nLen);
+    explicit CMurmurHash3Data(const std::vector<unsigned char>& vData) : CMurmurHash3Data(vData.data(), vData.size()) {}
+
+    //! Same as MurmurHash3(nHashSeed, data)
+    uint32_t Hash(uint32_t nHashSeed) const;
+
+    /**
+     * The hashes for n seeds. The seeds are run side by side over each
+     * word, a loop the compiler can vectorize.
+     */
+    void Hash(const uint32_t* pSeeds, uint32_t* pHashes, size_t n) const;
+};
+
 void BIP32Hash(const ChainCode chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
 //int HMAC_SHA512_Init(HMAC_SHA512_CTX *pctx, const void *pkey, size_t len);
@@ -405,6 +432,10 @@ void BIP32Hash(const ChainCode chainCode, unsigned int nChild, unsigned char hea
 //int HMAC_SHA512_Final(unsigned char *pmd, HMAC_SHA512_CTX *pctx);
 
 /* ----------- Quark Hash ------------------------------------------------ */
+// Hashes one header at a time: the rounds 3 and 6 pick their function from
+// the data, so the lanes of a multi-buffer (SIMD) version would diverge, and
+// the sph functions have no vectorised versions in the tree. The blocks keep
+// their hash instead (see CBlock::CacheHash).
 template <typename T1>
 inline uint256 HashQuark(const T1 pbegin, const T1 pend)
 
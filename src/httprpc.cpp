@@ -10,6 +10,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -18,6 +19,8 @@
 #include "utilstrencodings.h"
 #include "guiinterface.h"
 
+#include <set>
+
 #include <boost/algorithm/string.hpp> // boost::trim
 
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
@@ -75,6 +78,8 @@ static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const Uni
 
     std::string strReply = JSONRPCReply(NullUniValue, objError, id);
 
+    // Drop the part of a streamed result written before the error
+    req->ClearReply();
     req->WriteHeader("Content-Type", "application/json");
     req->WriteReply(nStatus, strReply);
 }
@@ -123,9 +128,11 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     }
 
     try {
-        // Parse request
+        // Parse request, in place in the input buffer
+        size_t nSize;
+        const char* pData = req->PeekBodyData(nSize);
         UniValue valRequest;
-        if (!valRequest.read(req->ReadBody()))
+        if (!pData || !valRequest.read(pData, nSize))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
         // Set the URI
@@ -134,16 +141,36 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         std::string strReply;
         // singleton request
         if (valRequest.isObject()) {
-            jreq.parse(valRequest);
+            jreq.parse(std::move(valRequest));
+
+            // A command with a large result streams it into the reply body,
+            // behind the head of the reply object
+            bool fHeadWritten = false;
+            size_t nStreamed = 0;
+            JSONStreamWriter stream([req, &fHeadWritten, &nStreamed](const std::string& strChunk) {
+                if (!fHeadWritten) {
+                    req->AppendReply("{\"result\":");
+                    fHeadWritten = true;
+                }
+                req->AppendReply(strChunk);
+                nStreamed += strChunk.size();
+            });
+            jreq.streamResult = &stream;
 
             UniValue result = tableRPC.execute(jreq);
 
             // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            if (stream.IsStarted()) {
+                stream.Flush();
+                strReply = ",\"error\":null,\"id\":" + jreq.id.write() + "}\n";
+            } else {
+                strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            }
+            RPCRecordReplySize(jreq.strMethod, nStreamed + strReply.size());
 
         // array of requests
         } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
+            strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
         else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
@@ -159,6 +186,40 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** Light commands, e.g. for health checks, handled before the other requests of their queue */
+static const std::set<std::string> setLightweightCommands = {
+    "getbestblockhash",
+    "getblockcount",
+    "getconnectioncount",
+    "getdifficulty",
+    "getmempoolinfo",
+    "getrpcinfo",
+    "ping",
+};
+
+/** The largest request body looked at to choose the work queue. A larger
+ * one goes to the JSON-RPC queue without priority. */
+static const size_t MAX_SELECTOR_BODY_SIZE = 16 * 1024;
+
+/** The wallet commands go to the wallet queue, the light commands first */
+static HTTPWorkQueueChoice SelectJSONRPCWorkQueue(HTTPRequest* req, const std::string&)
+{
+    HTTPWorkQueueChoice choice;
+    size_t nSize;
+    const char* pData = req->PeekBodyData(nSize);
+    UniValue valRequest;
+    if (!pData || nSize > MAX_SELECTOR_BODY_SIZE || !valRequest.read(pData, nSize) || !valRequest.isObject())
+        return choice;
+    const UniValue& method = find_value(valRequest, "method");
+    if (!method.isStr())
+        return choice;
+    const CRPCCommand* pcmd = tableRPC[method.get_str()];
+    if (pcmd && pcmd->category == "wallet")
+        choice.kind = WORKQUEUE_WALLET;
+    choice.fPriority = setLightweightCommands.count(method.get_str()) > 0;
+    return choice;
+}
+
 static bool InitRPCAuthentication()
 {
     if (gArgs.GetArg("-rpcpassword", "") == "")
@@ -182,7 +243,7 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, SelectJSONRPCWorkQueue);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
@@ -22,6 +22,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#include <deque>
 #include <future>
 
 #include <event2/event.h>
@@ -63,7 +64,8 @@ private:
 };
 
 /** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
+ * Work items are simply callable objects. The priority items are handled
+ * before the others.
  */
 template <typename WorkItem>
 class WorkQueue
@@ -73,9 +75,17 @@ private:
     std::mutex cs;
     std::condition_variable cond;
     /* XXX in C++11 we can use std::unique_ptr here and avoid manual cleanup */
-    std::deque<WorkItem*> queue;
+    /** The items, with the time they were queued */
+    std::deque<std::pair<WorkItem*, int64_t>> queue;
+    std::deque<std::pair<WorkItem*, int64_t>> priorityQueue;
     bool running;
     size_t maxDepth;
+    size_t peakDepth{0};
+    uint64_t nProcessed{0};
+    uint64_t nRejected{0};
+    int64_t nWaitMicros{0};
+    int64_t nMaxWaitMicros{0};
+    int64_t nRunMicros{0};
 
 public:
     explicit WorkQueue(size_t _maxDepth) : running(true),
@@ -86,19 +96,24 @@ public:
      */
     ~WorkQueue()
     {
-        while (!queue.empty()) {
-            delete queue.front();
-            queue.pop_front();
+        for (auto* q : {&priorityQueue, &queue}) {
+            while (!q->empty()) {
+                delete q->front().first;
+                q->pop_front();
+            }
         }
     }
     /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    bool Enqueue(WorkItem* item, bool fPriority = false)
     {
         std::unique_lock<std::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        std::deque<std::pair<WorkItem*, int64_t>>& q = fPriority ? priorityQueue : queue;
+        if (q.size() >= maxDepth) {
+            nRejected++;
             return false;
         }
-        queue.push_back(item);
+        q.emplace_back(item, GetTimeMicros());
+        peakDepth = std::max(peakDepth, queue.size() + priorityQueue.size());
         cond.notify_one();
         return true;
     }
@@ -107,17 +122,28 @@ public:
     {
         while (true) {
             WorkItem* i = nullptr;
+            int64_t nStart;
             {
                 std::unique_lock<std::mutex> lock(cs);
-                while (running && queue.empty())
+                while (running && queue.empty() && priorityQueue.empty())
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = queue.front();
-                queue.pop_front();
+                std::deque<std::pair<WorkItem*, int64_t>>& q = priorityQueue.empty() ? queue : priorityQueue;
+                i = q.front().first;
+                nStart = GetTimeMicros();
+                const int64_t nWait = nStart - q.front().second;
+                nWaitMicros += nWait;
+                nMaxWaitMicros = std::max(nMaxWaitMicros, nWait);
+                q.pop_front();
             }
             (*i)();
             delete i;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                nProcessed++;
+                nRunMicros += GetTimeMicros() - nStart;
+            }
         }
     }
     /** Interrupt and exit loops */
@@ -132,20 +158,46 @@ public:
     size_t Depth()
     {
         std::unique_lock<std::mutex> lock(cs);
-        return queue.size();
+        return queue.size() + priorityQueue.size();
+    }
+
+    void GetStats(HTTPWorkQueueStats& stats)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        stats.nMaxDepth = maxDepth;
+        stats.nDepth = queue.size() + priorityQueue.size();
+        stats.nPeakDepth = peakDepth;
+        stats.nProcessed = nProcessed;
+        stats.nRejected = nRejected;
+        stats.nWaitMicros = nWaitMicros;
+        stats.nMaxWaitMicros = nMaxWaitMicros;
+        stats.nRunMicros = nRunMicros;
     }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPWorkQueueSelector selector):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), selector(selector)
     {
     }
     std::string prefix{};
     bool exactMatch{false};
     HTTPRequestHandler handler{};
+    HTTPWorkQueueSelector selector{};
+};
+
+/** The options of the work queues */
+static const struct {
+    const char* name;
+    const char* threadsArg;
+    int defaultThreads;
+    const char* depthArg;
+} workQueueOptions[WORKQUEUE_COUNT] = {
+    {"rpc", "-rpcthreads", DEFAULT_HTTP_THREADS, "-rpcworkqueue"},
+    {"rest", "-restthreads", DEFAULT_HTTP_REST_THREADS, "-restworkqueue"},
+    {"wallet", "-rpcwalletthreads", DEFAULT_HTTP_WALLET_THREADS, "-rpcwalletworkqueue"},
 };
 
 /** HTTP module state */
@@ -156,8 +208,9 @@ static struct event_base* eventBase = 0;
 struct evhttp* eventHTTP = 0;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = 0;
+//! Work queues for handling longer requests off the event loop thread
+static WorkQueue<HTTPClosure>* workQueues[WORKQUEUE_COUNT] = {};
+static int workQueueThreads[WORKQUEUE_COUNT] = {};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 std::vector<evhttp_bound_socket *> boundSockets;
@@ -271,9 +324,13 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkQueueChoice choice;
+        if (i->selector)
+            choice = i->selector(hreq.get(), path);
+        WorkQueue<HTTPClosure>* workQueue = workQueues[choice.kind];
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(hreq.release(), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (workQueue->Enqueue(item.get(), choice.fPriority))
             item.release(); /* if true, queue took ownership */
         else
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
@@ -414,10 +471,11 @@ bool InitHTTPServer()
     }
 
     LogPrint(BCLog::HTTP, "Initialized HTTP server\n");
-    int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
-
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    for (int kind = 0; kind < WORKQUEUE_COUNT; kind++) {
+        int workQueueDepth = std::max((long)gArgs.GetArg(workQueueOptions[kind].depthArg, DEFAULT_HTTP_WORKQUEUE), 1L);
+        LogPrintf("HTTP: creating %s work queue of depth %d\n", workQueueOptions[kind].name, workQueueDepth);
+        workQueues[kind] = new WorkQueue<HTTPClosure>(workQueueDepth);
+    }
     eventBase = base;
     eventHTTP = http;
     return true;
@@ -444,14 +502,17 @@ static std::vector<std::thread> g_thread_http_workers;
 bool StartHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
-    int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
     std::packaged_task<bool(event_base*, evhttp*)> task(ThreadHTTP);
     threadResult = task.get_future();
     threadHTTP = std::thread(std::move(task), eventBase, eventHTTP);
 
-    for (int i = 0; i < rpcThreads; i++) {
-        g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueue);
+    for (int kind = 0; kind < WORKQUEUE_COUNT; kind++) {
+        int nThreads = std::max((long)gArgs.GetArg(workQueueOptions[kind].threadsArg, workQueueOptions[kind].defaultThreads), 1L);
+        LogPrintf("HTTP: starting %d %s worker threads\n", nThreads, workQueueOptions[kind].name);
+        workQueueThreads[kind] = nThreads;
+        for (int i = 0; i < nThreads; i++) {
+            g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueues[kind]);
+        }
     }
     return true;
 }
@@ -465,20 +526,25 @@ void InterruptHTTPServer()
         }
         evhttp_set_gencb(eventHTTP, http_reject_request_cb, NULL);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (WorkQueue<HTTPClosure>* workQueue : workQueues) {
+        if (workQueue)
+            workQueue->Interrupt();
+    }
 }
 
 void StopHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Stopping HTTP server\n");
-    if (workQueue) {
+    if (workQueues[WORKQUEUE_RPC]) {
         LogPrint(BCLog::HTTP, "Waiting for HTTP worker threads to exit\n");
         for (auto& thread: g_thread_http_workers) {
             thread.join();
         }
         g_thread_http_workers.clear();
-        delete workQueue;
+        for (WorkQueue<HTTPClosure>*& workQueue : workQueues) {
+            delete workQueue;
+            workQueue = nullptr;
+        }
     }
     MilliSleep(500); // Avoid race condition while the last HTTP-thread is exiting
     if (eventBase) {
@@ -512,6 +578,21 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats()
+{
+    std::vector<HTTPWorkQueueStats> vStats;
+    for (int kind = 0; kind < WORKQUEUE_COUNT; kind++) {
+        if (!workQueues[kind])
+            continue;
+        HTTPWorkQueueStats stats;
+        stats.name = workQueueOptions[kind].name;
+        stats.nThreads = workQueueThreads[kind];
+        workQueues[kind]->GetStats(stats);
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
@@ -583,6 +664,17 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+const char* HTTPRequest::PeekBodyData(size_t& nSize)
+{
+    nSize = 0;
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return nullptr;
+    nSize = evbuffer_get_length(buf);
+    // Only the first call linearizes a multi-segment buffer
+    return (const char*)evbuffer_pullup(buf, -1);
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -590,6 +682,23 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+void HTTPRequest::AppendReply(const std::string& strPart)
+{
+    assert(!replySent && req);
+    // The main http thread doesn't touch the output buffer until the reply is sent
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_add(evb, strPart.data(), strPart.size());
+}
+
+void HTTPRequest::ClearReply()
+{
+    assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_drain(evb, evbuffer_get_length(evb));
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -662,10 +771,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPWorkQueueSelector &selector)
 {
     LogPrint(BCLog::HTTP, "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.emplace_back(prefix, exactMatch, handler);
+    pathHandlers.emplace_back(prefix, exactMatch, handler, selector);
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
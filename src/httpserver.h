@@ -8,9 +8,12 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <vector>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
+static const int DEFAULT_HTTP_REST_THREADS=2;
+static const int DEFAULT_HTTP_WALLET_THREADS=2;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
@@ -36,13 +39,48 @@ void StopHTTPServer();
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
 
+/** The work queues of the HTTP server. Each has its own worker threads and
+ * depth, so that the slow requests of one kind don't hold up the others.
+ */
+enum HTTPWorkQueueKind {
+    WORKQUEUE_RPC,      //!< JSON-RPC (-rpcthreads, -rpcworkqueue)
+    WORKQUEUE_REST,     //!< REST (-restthreads, -restworkqueue)
+    WORKQUEUE_WALLET,   //!< JSON-RPC wallet commands (-rpcwalletthreads, -rpcwalletworkqueue)
+    WORKQUEUE_COUNT
+};
+
+/** The work queue of a request, and whether it is handled before the other
+ * requests of the queue (a light request, e.g. a health check). A queue
+ * takes up to its depth of priority requests besides its other requests.
+ */
+struct HTTPWorkQueueChoice {
+    HTTPWorkQueueKind kind{WORKQUEUE_RPC};
+    bool fPriority{false};
+};
+
+/** The activity of a work queue since the start */
+struct HTTPWorkQueueStats {
+    std::string name;
+    int nThreads{0};
+    size_t nMaxDepth{0};
+    size_t nDepth{0};           //!< Requests waiting now
+    size_t nPeakDepth{0};
+    uint64_t nProcessed{0};
+    uint64_t nRejected{0};      //!< Requests refused, the queue being full
+    int64_t nWaitMicros{0};     //!< Total time the processed requests waited in the queue
+    int64_t nMaxWaitMicros{0};  //!< Longest time a request waited in the queue
+    int64_t nRunMicros{0};      //!< Total time they took to handle
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef std::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Chooses the work queue of a request, on the event loop thread: it must be quick */
+typedef std::function<HTTPWorkQueueChoice(HTTPRequest* req, const std::string &)> HTTPWorkQueueSelector;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a selector, the requests go to the JSON-RPC queue.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPWorkQueueSelector &selector = nullptr);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -51,6 +89,9 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** The activity of the work queues, empty if the HTTP server isn't running */
+std::vector<HTTPWorkQueueStats> GetHTTPWorkQueueStats();
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -98,6 +139,13 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * The request body in place, made contiguous in the input buffer, for a
+     * parser to read it without a copy (also to choose a work queue).
+     * Returns nullptr if the body is empty. Valid until the reply is sent.
+     */
+    const char* PeekBodyData(size_t& nSize);
+
     /**
      * Write output header.
      *
@@ -105,6 +153,17 @@ public:
      */
     void WriteHeader(const std::string& hdr, const std::string& value);
 
+    /**
+     * Append a part of the reply body, e.g. a chunk of a streamed RPC result.
+     * The body is sent once WriteReply is called, with what it adds at the end.
+     */
+    void AppendReply(const std::string& strPart);
+
+    /**
+     * Discard the body appended so far, e.g. to send an error instead.
+     */
+    void ClearReply();
+
     /**
      * Write HTTP reply.
      * nStatus is the HTTP status code to send.
@@ -89,6 +89,78 @@ struct CAddressUnspentValue {
     }
 };
 
+/**
+ * Position of an address index entry in the chain: the entries of an address
+ * are stored in this order, and a scan can be resumed after a position.
+ *
+ * The transaction and input/output indexes are stored with an order-preserving
+ * compact encoding (their size in bytes, then their big-endian bytes), so most
+ * use 2 bytes instead of 4.
+ */
+struct CAddressIndexPosition {
+    int blockHeight;
+    unsigned int txindex;
+    size_t index;
+    bool spending;
+
+    template<typename Stream>
+    static void WriteCompactBE(Stream& s, uint32_t n) {
+        uint8_t nBytes = 0;
+        for (uint32_t v = n; v; v >>= 8) nBytes++;
+        ser_writedata8(s, nBytes);
+        for (int i = nBytes - 1; i >= 0; i--) ser_writedata8(s, (n >> (8 * i)) & 0xff);
+    }
+    template<typename Stream>
+    static uint32_t ReadCompactBE(Stream& s) {
+        const uint8_t nBytes = ser_readdata8(s);
+        if (nBytes > 4) throw std::ios_base::failure("invalid compact address index position");
+        uint32_t n = 0;
+        for (uint8_t i = 0; i < nBytes; i++) n = (n << 8) | ser_readdata8(s);
+        return n;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        // Heights are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, blockHeight);
+        WriteCompactBE(s, txindex);
+        WriteCompactBE(s, index);
+        ser_writedata8(s, spending);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        blockHeight = ser_readdata32be(s);
+        txindex = ReadCompactBE(s);
+        index = ReadCompactBE(s);
+        spending = ser_readdata8(s);
+    }
+
+    CAddressIndexPosition(int height, unsigned int blockindex, size_t indexValue, bool isSpending) {
+        blockHeight = height;
+        txindex = blockindex;
+        index = indexValue;
+        spending = isSpending;
+    }
+
+    CAddressIndexPosition() {
+        SetNull();
+    }
+
+    void SetNull() {
+        blockHeight = 0;
+        txindex = 0;
+        index = 0;
+        spending = false;
+    }
+
+    friend bool operator<(const CAddressIndexPosition& a, const CAddressIndexPosition& b) {
+        if (a.blockHeight != b.blockHeight) return a.blockHeight < b.blockHeight;
+        if (a.txindex != b.txindex) return a.txindex < b.txindex;
+        if (a.index != b.index) return a.index < b.index;
+        return a.spending < b.spending;
+    }
+};
+
 struct CAddressIndexKey {
     unsigned int type;
     uint160 hashBytes;
@@ -150,6 +222,38 @@ struct CAddressIndexKey {
         spending = false;
     }
 
+    CAddressIndexPosition GetPosition() const {
+        return CAddressIndexPosition(blockHeight, txindex, index, spending);
+    }
+};
+
+/** The running totals of an address, kept up to date with its activity */
+struct CAddressBalance {
+    CAmount balance;
+    CAmount received;
+    uint32_t nTxCount;
+    int nLastHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(nTxCount);
+        READWRITE(nLastHeight);
+    }
+
+    CAddressBalance() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        nTxCount = 0;
+        nLastHeight = 0;
+    }
 };
 
 struct CAddressIndexIteratorKey {
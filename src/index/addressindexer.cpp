@@ -0,0 +1,418 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/addressindexer.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "compressor.h"
+#include "undo.h"
+#include "util.h"
+#include "util/memory.h"
+
+#include <limits>
+#include <map>
+
+constexpr char DB_ADDRESSINDEX = 'a';
+constexpr char DB_ADDRESSUNSPENTINDEX = 'u';
+constexpr char DB_ADDRESSBALANCE = 'b';
+constexpr char DB_VERSION = 'V';
+
+//! Version of the database layout (the first one, without a version, had no balances)
+constexpr int ADDRESSINDEX_VERSION = 2;
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+namespace {
+
+/**
+ * An address index entry as stored, with the address and position in the key
+ * and the txid in the value: consecutive entries of an address only differ in
+ * the last bytes of their key, and LevelDB shares the common key prefix with
+ * the previous entry, so most entries only store a few bytes of their key.
+ */
+struct DBAddressIndexKey {
+    uint8_t type;
+    uint160 hashBytes;
+    CAddressIndexPosition pos;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(pos);
+    }
+
+    DBAddressIndexKey() : type(0) {}
+    DBAddressIndexKey(int typeIn, const uint160& hashBytesIn, const CAddressIndexPosition& posIn) :
+        type(typeIn), hashBytes(hashBytesIn), pos(posIn) {}
+    explicit DBAddressIndexKey(const CAddressIndexKey& key) :
+        type(key.type), hashBytes(key.hashBytes), pos(key.GetPosition()) {}
+};
+
+/** The value of an address index entry: the txid, and the amount (unsigned, the key has its sign) */
+struct DBAddressIndexValue {
+    uint256 txhash;
+    CAmount nAmount;
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        txhash.Serialize(s);
+        uint64_t nCompressed = CTxOutCompressor::CompressAmount(nAmount);
+        ::Serialize(s, VARINT(nCompressed));
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        txhash.Unserialize(s);
+        uint64_t nCompressed;
+        ::Unserialize(s, VARINT(nCompressed));
+        nAmount = CTxOutCompressor::DecompressAmount(nCompressed);
+    }
+
+    DBAddressIndexValue() : nAmount(0) {}
+    DBAddressIndexValue(const uint256& txhashIn, CAmount nAmountIn) : txhash(txhashIn), nAmount(nAmountIn) {}
+};
+
+void WriteAddressIndexEntry(CDBBatch& batch, const CAddressIndexKey& key, CAmount nAmount)
+{
+    batch.Write(std::make_pair(DB_ADDRESSINDEX, DBAddressIndexKey(key)), DBAddressIndexValue(key.txhash, nAmount));
+}
+
+void EraseAddressIndexEntry(CDBBatch& batch, const CAddressIndexKey& key)
+{
+    batch.Erase(std::make_pair(DB_ADDRESSINDEX, DBAddressIndexKey(key)));
+}
+
+/** The activity of an address in a block, added to (or removed from) its balance */
+struct BalanceDelta {
+    CAmount balance{0};
+    CAmount received{0};
+    uint32_t nTxCount{0};
+    //! The last transaction counted: the entries of a transaction are added together
+    unsigned int nLastTx{std::numeric_limits<unsigned int>::max()};
+
+    void Add(unsigned int nTx, CAmount nValue)
+    {
+        balance += nValue;
+        if (nValue > 0) received += nValue;
+        if (nTx != nLastTx) {
+            nTxCount++;
+            nLastTx = nTx;
+        }
+    }
+};
+
+typedef std::map<std::pair<int, uint160>, BalanceDelta> BalanceDeltaMap;
+
+} // anon namespace
+
+/**
+ * Access to the address index database (indexes/addressindex/)
+ *
+ * The database stores the activity of each address (its received outputs
+ * and spent inputs, keyed by address, height and transaction), its balance,
+ * and its unspent outputs.
+ */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadAddressBalance(int type, const uint160& hashBytes, CAddressBalance& balance) const;
+
+    /// Apply the activity of the addresses in the block at nHeight to their balances
+    bool WriteBalances(CDBBatch& batch, const BalanceDeltaMap& deltas, int nHeight);
+
+    /// Remove the activity of the addresses in the block at nHeight from their balances
+    bool EraseBalances(CDBBatch& batch, const BalanceDeltaMap& deltas, int nHeight);
+
+private:
+    /// The height of the last activity of an address before nHeight (0 if none)
+    int ReadLastHeightBefore(int type, const uint160& hashBytes, int nHeight);
+};
+
+bool GetAddressIndexScript(const CScript& script, int& type, uint160& hashBytes)
+{
+    if (script.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 2, script.begin() + 22));
+        type = 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 3, script.begin() + 23));
+        type = 1;
+    } else if (script.IsPayToWitnessPubkeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(script.begin() + 2, script.end()));
+        type = 1;
+    } else {
+        hashBytes.SetNull();
+        type = 0;
+        return false;
+    }
+    return true;
+}
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool AddressIndex::DB::ReadAddressBalance(int type, const uint160& hashBytes, CAddressBalance& balance) const
+{
+    if (!Read(std::make_pair(DB_ADDRESSBALANCE, CAddressIndexIteratorKey(type, hashBytes)), balance)) {
+        balance.SetNull();
+    }
+    return true;
+}
+
+bool AddressIndex::DB::WriteBalances(CDBBatch& batch, const BalanceDeltaMap& deltas, int nHeight)
+{
+    for (const auto& it : deltas) {
+        const CAddressIndexIteratorKey key(it.first.first, it.first.second);
+        CAddressBalance balance;
+        ReadAddressBalance(key.type, key.hashBytes, balance);
+        balance.balance += it.second.balance;
+        balance.received += it.second.received;
+        balance.nTxCount += it.second.nTxCount;
+        balance.nLastHeight = nHeight;
+        batch.Write(std::make_pair(DB_ADDRESSBALANCE, key), balance);
+    }
+    return true;
+}
+
+bool AddressIndex::DB::EraseBalances(CDBBatch& batch, const BalanceDeltaMap& deltas, int nHeight)
+{
+    for (const auto& it : deltas) {
+        const CAddressIndexIteratorKey key(it.first.first, it.first.second);
+        CAddressBalance balance;
+        ReadAddressBalance(key.type, key.hashBytes, balance);
+        if (balance.nTxCount < it.second.nTxCount) {
+            return error("%s: balance of address %s inconsistent with its activity", __func__, key.hashBytes.ToString());
+        }
+        balance.balance -= it.second.balance;
+        balance.received -= it.second.received;
+        balance.nTxCount -= it.second.nTxCount;
+        if (balance.nTxCount == 0) {
+            batch.Erase(std::make_pair(DB_ADDRESSBALANCE, key));
+            continue;
+        }
+        balance.nLastHeight = ReadLastHeightBefore(key.type, key.hashBytes, nHeight);
+        batch.Write(std::make_pair(DB_ADDRESSBALANCE, key), balance);
+    }
+    return true;
+}
+
+int AddressIndex::DB::ReadLastHeightBefore(int type, const uint160& hashBytes, int nHeight)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, DBAddressIndexKey(type, hashBytes, CAddressIndexPosition(nHeight, 0, 0, false))));
+    if (pcursor->Valid()) {
+        pcursor->Prev();
+    } else {
+        pcursor->SeekToLast();
+    }
+    std::pair<char, DBAddressIndexKey> key;
+    if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.type == type && key.second.hashBytes == hashBytes) {
+        return key.second.pos.blockHeight;
+    }
+    return 0;
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<AddressIndex::DB>(n_cache_size, f_memory, f_wipe))
+{
+    int nVersion = 0;
+    if (!m_db->Read(DB_VERSION, nVersion) || nVersion != ADDRESSINDEX_VERSION) {
+        if (!m_db->IsEmpty()) {
+            LogPrintf("%s: the database has an older layout, rebuilding it\n", GetName());
+            m_db.reset();
+            m_db = MakeUnique<AddressIndex::DB>(n_cache_size, f_memory, true);
+        }
+        m_db->Write(DB_VERSION, ADDRESSINDEX_VERSION);
+    }
+}
+
+AddressIndex::~AddressIndex() {}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block transactions are not connected
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo blockUndo;
+    if (!ReadBlockUndo(block, pindex, blockUndo)) {
+        return false;
+    }
+
+    // Written in order: an output spent in the same block is erased from the
+    // unspent index after it's been added.
+    CDBBatch batch;
+    BalanceDeltaMap deltas;
+    int type;
+    uint160 hashBytes;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txhash = tx.GetHash();
+
+        if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                return error("%s: transaction and undo data inconsistent", __func__);
+            }
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxIn& input = tx.vin[j];
+                const CTxOut& prevout = txundo.vprevout[j].out;
+                if (!GetAddressIndexScript(prevout.scriptPubKey, type, hashBytes)) continue;
+
+                // record spending activity
+                WriteAddressIndexEntry(batch, CAddressIndexKey(type, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue);
+                deltas[std::make_pair(type, hashBytes)].Add(i, -prevout.nValue);
+
+                // remove address from unspent index
+                batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(type, hashBytes, input.prevout.hash, input.prevout.n)));
+            }
+        }
+
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            if (!GetAddressIndexScript(out.scriptPubKey, type, hashBytes)) continue;
+
+            // record receiving activity
+            WriteAddressIndexEntry(batch, CAddressIndexKey(type, hashBytes, pindex->nHeight, i, txhash, k, false), out.nValue);
+            deltas[std::make_pair(type, hashBytes)].Add(i, out.nValue);
+
+            // record unspent output
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(type, hashBytes, txhash, k)), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight));
+        }
+    }
+    return m_db->WriteBalances(batch, deltas, pindex->nHeight) && m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo blockUndo;
+    if (!ReadBlockUndo(block, pindex, blockUndo)) {
+        return false;
+    }
+
+    // undo transactions in reverse order
+    CDBBatch batch;
+    BalanceDeltaMap deltas;
+    int type;
+    uint160 hashBytes;
+    for (int i = block.vtx.size() - 1; i >= 0; i--) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txhash = tx.GetHash();
+
+        for (unsigned int k = tx.vout.size(); k-- > 0;) {
+            const CTxOut& out = tx.vout[k];
+            if (!GetAddressIndexScript(out.scriptPubKey, type, hashBytes)) continue;
+
+            // undo receiving activity
+            EraseAddressIndexEntry(batch, CAddressIndexKey(type, hashBytes, pindex->nHeight, i, txhash, k, false));
+            deltas[std::make_pair(type, hashBytes)].Add(i, out.nValue);
+
+            // undo unspent index
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(type, hashBytes, txhash, k)));
+        }
+
+        if (tx.IsCoinBase() || tx.HasZerocoinSpendInputs()) continue;
+
+        const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction and undo data inconsistent", __func__);
+        }
+        for (unsigned int j = tx.vin.size(); j-- > 0;) {
+            const CTxIn& input = tx.vin[j];
+            const Coin& coin = txundo.vprevout[j];
+            if (!GetAddressIndexScript(coin.out.scriptPubKey, type, hashBytes)) continue;
+
+            // undo spending activity
+            EraseAddressIndexEntry(batch, CAddressIndexKey(type, hashBytes, pindex->nHeight, i, txhash, j, true));
+            deltas[std::make_pair(type, hashBytes)].Add(i, -coin.out.nValue);
+
+            // restore unspent index
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(type, hashBytes, input.prevout.hash, input.prevout.n)), CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+        }
+    }
+    return m_db->EraseBalances(batch, deltas, pindex->nHeight) && m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::ScanAddressIndex(const uint160& addressHash, int type, int start, int end, const CAddressIndexPosition* pafter,
+                                    const std::function<bool(const CAddressIndexKey&, CAmount)>& fn)
+{
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+
+    if (pafter && pafter->blockHeight >= start) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, DBAddressIndexKey(type, addressHash, *pafter)));
+    } else if (start > 0) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+    } else {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, DBAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.type != type || key.second.hashBytes != addressHash) {
+            break;
+        }
+        const CAddressIndexPosition& pos = key.second.pos;
+        if (end > 0 && pos.blockHeight > end) {
+            break;
+        }
+        if (pafter && !(*pafter < pos)) {
+            continue;
+        }
+        DBAddressIndexValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("failed to get address index value");
+        }
+        const CAddressIndexKey entry(type, addressHash, pos.blockHeight, pos.txindex, value.txhash, pos.index, pos.spending);
+        if (!fn(entry, pos.spending ? -value.nAmount : value.nAmount)) {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool AddressIndex::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    return ScanAddressIndex(addressHash, type, start, end, nullptr, [&addressIndex](const CAddressIndexKey& key, CAmount nValue) {
+        addressIndex.emplace_back(key, nValue);
+        return true;
+    });
+}
+
+bool AddressIndex::ReadAddressBalance(const uint160& addressHash, int type, CAddressBalance& balance) const
+{
+    return m_db->ReadAddressBalance(type, addressHash, balance);
+}
+
+bool AddressIndex::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+
+    while (pcursor->Valid()) {
+        std::pair<char, CAddressUnspentKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+            CAddressUnspentValue nValue;
+            if (pcursor->GetValue(nValue)) {
+                unspentOutputs.push_back(std::make_pair(key.second, nValue));
+                pcursor->Next();
+            } else {
+                return error("failed to get address unspent value");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEXER_H
+#define BITCOIN_INDEX_ADDRESSINDEXER_H
+
+#include "index/addressindex.h"
+#include "index/base.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * Get the address index type (1 for key hashes, 2 for script hashes) and hash
+ * of an output script. Returns false for the scripts not indexed.
+ */
+bool GetAddressIndexScript(const CScript& script, int& type, uint160& hashBytes);
+
+/**
+ * AddressIndex is used to look up the transactions paying to and spending from
+ * an address (-addressindex), and its unspent outputs.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /**
+     * Visit the activity of an address in chain order, from the height start
+     * (or after the position *pafter) up to the height end (0: the tip).
+     * The entries are read as they're visited, until fn returns false.
+     */
+    bool ScanAddressIndex(const uint160& addressHash, int type, int start, int end, const CAddressIndexPosition* pafter,
+                          const std::function<bool(const CAddressIndexKey&, CAmount)>& fn);
+
+    /// The activity of an address, optionally between the heights start and end.
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
+
+    /// The balance, total received and transaction count of an address, read in one lookup.
+    bool ReadAddressBalance(const uint160& addressHash, int type, CAddressBalance& balance) const;
+
+    /// The unspent outputs of an address.
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+};
+
+/// The global address index, used by the address RPCs. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEXER_H
@@ -0,0 +1,123 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BASE_H
+#define BITCOIN_INDEX_BASE_H
+
+#include "dbwrapper.h"
+#include "fs.h"
+#include "primitives/block.h"
+#include "threadinterrupt.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <thread>
+
+class CBlockIndex;
+class CBlockUndo;
+
+/**
+ * Base class for the indexes built in the background from the active chain,
+ * each in its own database (indexes/<name>/). On startup the index syncs from
+ * its best block, stored as a locator, up to the chain tip on a thread of its
+ * own, and then follows the chain on the BlockConnected and BlockDisconnected
+ * notifications. The index can be enabled at any time, without a reindex.
+ */
+class BaseIndex : public CValidationInterface
+{
+protected:
+    class DB : public CDBWrapper
+    {
+    public:
+        DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+        /// Read block locator of the chain that the index is in sync with.
+        bool ReadBestBlock(CBlockLocator& locator) const;
+
+        /// Write block locator of the chain that the index is in sync with.
+        void WriteBestBlock(CDBBatch& batch, const CBlockLocator& locator);
+    };
+
+private:
+    /// Whether the index is in sync with the main chain. The flag is flipped
+    /// from false to true once, after which point this starts processing
+    /// ValidationInterface notifications to stay in sync.
+    std::atomic<bool> m_synced{false};
+
+    /// The last block in the chain that the index is in sync with.
+    std::atomic<const CBlockIndex*> m_best_block_index{nullptr};
+
+    std::thread m_thread_sync;
+    CThreadInterrupt m_interrupt;
+
+    /// Sync the index with the block index starting from the current best block.
+    /// Intended to be run in its own thread, m_thread_sync, and can be
+    /// interrupted with m_interrupt. Once the index gets in sync, the m_synced
+    /// flag is set and the BlockConnected ValidationInterface callback takes
+    /// over and the sync thread exits.
+    void ThreadSync();
+
+    /// Write the current index state (eg. chain block locator and subclass-specific items) to disk.
+    bool Commit();
+
+    /// Undo the blocks from current_tip back to new_tip, one of its ancestors.
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex,
+                        const std::vector<CTransactionRef>& txn_conflicted) override;
+
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
+
+    void SetBestChain(const CBlockLocator& locator) override;
+
+    /// Initialize internal state from the database and block index.
+    virtual bool Init();
+
+    /// Write the subclass-specific state to disk, in the same batch as the best block locator.
+    virtual bool CommitInternal(CDBBatch& batch) { return true; }
+
+    /// The last block in the chain that the index is in sync with.
+    const CBlockIndex* CurrentIndex() const { return m_best_block_index.load(); }
+
+    /// Write update index entries for a newly connected block.
+    virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+
+    /// Remove the index entries of a block disconnected from the chain tip.
+    virtual bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
+
+    /// Read the undo data of a block of the index, with the coins spent by its transactions.
+    static bool ReadBlockUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& undo);
+
+    virtual DB& GetDB() const = 0;
+
+    /// Get the name of the index for display in logs.
+    virtual const char* GetName() const = 0;
+
+public:
+    /// Destructor interrupts sync thread if running and blocks until it exits.
+    virtual ~BaseIndex();
+
+    /// Whether the initial sync has completed, after which the index follows the chain tip.
+    bool IsSynced() const { return m_synced; }
+
+    /// Blocks the current thread until the index is caught up to the current
+    /// state of the block chain. This only blocks if the index has gotten in
+    /// sync once and only needs to process blocks in the ValidationInterface
+    /// queue. If the index is catching up from far behind, this method does
+    /// not block and immediately returns false.
+    bool BlockUntilSyncedToCurrentChain();
+
+    void Interrupt();
+
+    /// Start initializes the sync state and registers the instance as a
+    /// ValidationInterface so that it stays in sync with blockchain updates.
+    void Start();
+
+    /// Stops the instance from staying in sync with blockchain updates.
+    void Stop();
+};
+
+#endif // BITCOIN_INDEX_BASE_H
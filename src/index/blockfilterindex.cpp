@@ -0,0 +1,216 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/blockfilterindex.h"
+
+#include "chain.h"
+#include "util.h"
+#include "util/memory.h"
+
+/* The database stores the filter of each block of the active chain by height
+ * (DB_BLOCK_HEIGHT, big endian so that the entries are in chain order), with
+ * the block hash, the filter hash and the filter header. The entries of the
+ * blocks disconnected from the chain are moved to DB_BLOCK_HASH, keyed by
+ * block hash, so that the filters of the stale blocks can still be served.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+
+std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+namespace {
+
+struct DBVal {
+    uint256 hash;
+    uint256 filter_hash;
+    uint256 header;
+    std::vector<unsigned char> encoded_filter;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(hash);
+        READWRITE(filter_hash);
+        READWRITE(header);
+        READWRITE(encoded_filter);
+    }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for block filter index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+} // namespace
+
+/**
+ * Access to the block filter index database (indexes/blockfilter/<filter type>/)
+ */
+class BlockFilterIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// The entry of a block: by height if it is still in the active chain
+    /// of the index, by hash if it has been disconnected since.
+    bool LookupOne(const CBlockIndex* block_index, DBVal& result) const;
+};
+
+BlockFilterIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(path, n_cache_size, f_memory, f_wipe)
+{}
+
+bool BlockFilterIndex::DB::LookupOne(const CBlockIndex* block_index, DBVal& result) const
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    DBVal read_out;
+    if (Read(DBHeightKey(block_index->nHeight), read_out) && read_out.hash == block_index->GetBlockHash()) {
+        result = std::move(read_out);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return Read(std::make_pair(DB_BLOCK_HASH, block_index->GetBlockHash()), result);
+}
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_filter_type(filter_type),
+      m_db(MakeUnique<BlockFilterIndex::DB>(GetDataDir() / "indexes" / "blockfilter" / BlockFilterTypeName(filter_type),
+                                            n_cache_size, f_memory, f_wipe))
+{
+    const std::string& filter_name = BlockFilterTypeName(filter_type);
+    if (filter_name.empty()) throw std::invalid_argument("unknown filter_type");
+
+    m_name = filter_name + " block filter index";
+}
+
+BlockFilterIndex::~BlockFilterIndex() {}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block has no undo data, and no previous filter header
+    CBlockUndo block_undo;
+    uint256 prev_header;
+
+    if (pindex->nHeight > 0) {
+        if (!ReadBlockUndo(block, pindex, block_undo)) {
+            return false;
+        }
+
+        DBVal prev_entry;
+        if (!m_db->LookupOne(pindex->pprev, prev_entry)) {
+            return error("%s: Failed to read the filter of the previous block %s", __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+        prev_header = prev_entry.header;
+    }
+
+    BlockFilter filter(m_filter_type, block, block_undo);
+
+    DBVal value;
+    value.hash = pindex->GetBlockHash();
+    value.filter_hash = filter.GetHash();
+    value.header = filter.ComputeHeader(prev_header);
+    value.encoded_filter = filter.GetEncodedFilter();
+
+    CDBBatch batch;
+    batch.Write(DBHeightKey(pindex->nHeight), value);
+    // the block is connected again after having been disconnected
+    batch.Erase(std::make_pair(DB_BLOCK_HASH, value.hash));
+    return m_db->WriteBatch(batch);
+}
+
+bool BlockFilterIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    DBVal value;
+    if (!m_db->Read(DBHeightKey(pindex->nHeight), value) || value.hash != pindex->GetBlockHash()) {
+        return error("%s: Failed to read the filter of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    CDBBatch batch;
+    batch.Write(std::make_pair(DB_BLOCK_HASH, value.hash), value);
+    batch.Erase(DBHeightKey(pindex->nHeight));
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& BlockFilterIndex::GetDB() const { return *m_db; }
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+{
+    DBVal entry;
+    if (!m_db->LookupOne(block_index, entry)) {
+        return false;
+    }
+
+    filter_out = BlockFilter(m_filter_type, block_index->GetBlockHash(), std::move(entry.encoded_filter));
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+{
+    DBVal entry;
+    if (!m_db->LookupOne(block_index, entry)) {
+        return false;
+    }
+
+    header_out = entry.header;
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                                         std::vector<BlockFilter>& filters_out) const
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)", __func__, start_height, stop_index->nHeight);
+    }
+
+    filters_out.resize(stop_index->nHeight - start_height + 1);
+    for (const CBlockIndex* block_index = stop_index; block_index && block_index->nHeight >= start_height; block_index = block_index->pprev) {
+        if (!LookupFilter(block_index, filters_out[block_index->nHeight - start_height])) {
+            return error("%s: unable to read the filter of block %s", __func__, block_index->GetBlockHash().ToString());
+        }
+    }
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
+                                             std::vector<uint256>& hashes_out) const
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)", __func__, start_height, stop_index->nHeight);
+    }
+
+    hashes_out.resize(stop_index->nHeight - start_height + 1);
+    for (const CBlockIndex* block_index = stop_index; block_index && block_index->nHeight >= start_height; block_index = block_index->pprev) {
+        DBVal entry;
+        if (!m_db->LookupOne(block_index, entry)) {
+            return error("%s: unable to read the filter of block %s", __func__, block_index->GetBlockHash().ToString());
+        }
+        hashes_out[block_index->nHeight - start_height] = entry.filter_hash;
+    }
+    return true;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKFILTERINDEX_H
+#define BITCOIN_INDEX_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "index/base.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * BlockFilterIndex is used to store and retrieve the block filters (BIP 157)
+ * of the blocks of the chain (-blockfilterindex), with their filter headers.
+ * The light clients download the filters (getcfilters), matched against their
+ * scripts on their side, instead of having a node match a bloom filter on
+ * every block for them.
+ */
+class BlockFilterIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const BlockFilterType m_filter_type;
+    const std::unique_ptr<DB> m_db;
+
+    std::string m_name;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return m_name.c_str(); }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit BlockFilterIndex(BlockFilterType filter_type, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~BlockFilterIndex() override;
+
+    BlockFilterType GetFilterType() const { return m_filter_type; }
+
+    /// Get a single filter by block.
+    bool LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const;
+
+    /// Get a single filter header by block.
+    bool LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const;
+
+    /// Get a range of filters between two heights on a chain.
+    bool LookupFilterRange(int start_height, const CBlockIndex* stop_index,
+                           std::vector<BlockFilter>& filters_out) const;
+
+    /// Get a range of filter hashes between two heights on a chain.
+    bool LookupFilterHashRange(int start_height, const CBlockIndex* stop_index,
+                               std::vector<uint256>& hashes_out) const;
+};
+
+/// The global basic block filter index, used by the getblockfilter RPC and
+/// the getcfilters, getcfheaders and getcfcheckpt messages. May be null.
+extern std::unique_ptr<BlockFilterIndex> g_blockfilterindex;
+
+#endif // BITCOIN_INDEX_BLOCKFILTERINDEX_H
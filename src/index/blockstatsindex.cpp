@@ -0,0 +1,175 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/blockstatsindex.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "undo.h"
+#include "util.h"
+#include "util/memory.h"
+#include "version.h"
+
+/* The database stores the statistics of each block of the active chain by
+ * height (DB_BLOCK_HEIGHT), and those of the blocks disconnected since by
+ * block hash (DB_BLOCK_HASH), as the block filter index does.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+
+std::unique_ptr<BlockStatsIndex> g_block_stats_index;
+
+namespace {
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for block stats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+} // namespace
+
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& block_undo, BlockStatsIndex::Stats& stats)
+{
+    const size_t ntx = block.vtx.size();
+    // The genesis block has no undo data
+    if (ntx > 1 && block_undo.vtxundo.size() + 1 != ntx) {
+        return error("%s: block %s and undo data inconsistent", __func__, block.GetHash().ToString());
+    }
+
+    const size_t firstTxIndex = block.IsProofOfStake() ? 2 : 1;
+    stats.block_hash = block.GetHash();
+    stats.tx_count_all = ntx;
+    stats.tx_count = ntx > firstTxIndex ? ntx - firstTxIndex : 0;
+
+    for (size_t idx = 1; idx < ntx; idx++) {
+        const CTransaction& tx = *block.vtx[idx];
+        // No prevouts for the zerocoin spends
+        CAmount nValueIn = 0;
+        for (const Coin& coin : block_undo.vtxundo[idx - 1].vprevout) {
+            nValueIn += coin.out.nValue;
+        }
+
+        if (tx.hasSaplingData()) {
+            stats.shielded_tx_count++;
+            stats.shielded_spend_count += tx.sapData->vShieldedSpend.size();
+            stats.shielded_output_count += tx.sapData->vShieldedOutput.size();
+        }
+
+        if (idx < firstTxIndex) {
+            // the coinstake
+            stats.coinstake_value_in = nValueIn;
+            stats.coinstake_value_out = tx.GetValueOut();
+            continue;
+        }
+
+        // zerocoin txes have fixed fee, don't count them here.
+        if (tx.ContainsZerocoins())
+            continue;
+
+        stats.tx_bytes += GetSerializeSize(tx, SER_NETWORK, CLIENT_VERSION);
+        stats.fees += nValueIn + tx.GetShieldedValueIn() - tx.GetValueOut();
+    }
+    return true;
+}
+
+/**
+ * Access to the block stats index database (indexes/blockstats/)
+ */
+class BlockStatsIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(path, n_cache_size, f_memory, f_wipe) {}
+
+    /// The entry of a block: by height if it is still in the active chain
+    /// of the index, by hash if it has been disconnected since.
+    bool LookupOne(const CBlockIndex* block_index, Stats& result) const
+    {
+        Stats read_out;
+        if (Read(DBHeightKey(block_index->nHeight), read_out) && read_out.block_hash == block_index->GetBlockHash()) {
+            result = std::move(read_out);
+            return true;
+        }
+        return Read(std::make_pair(DB_BLOCK_HASH, block_index->GetBlockHash()), result);
+    }
+};
+
+BlockStatsIndex::BlockStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<BlockStatsIndex::DB>(GetDataDir() / "indexes" / "blockstats", n_cache_size, f_memory, f_wipe))
+{}
+
+BlockStatsIndex::~BlockStatsIndex() {}
+
+bool BlockStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    if (pindex->nHeight > 0 && !ReadBlockUndo(block, pindex, block_undo)) {
+        return false;
+    }
+
+    Stats value;
+    if (!ComputeBlockStats(block, block_undo, value)) {
+        return false;
+    }
+
+    CDBBatch batch;
+    batch.Write(DBHeightKey(pindex->nHeight), value);
+    // the block is connected again after having been disconnected
+    batch.Erase(std::make_pair(DB_BLOCK_HASH, value.block_hash));
+    return m_db->WriteBatch(batch);
+}
+
+bool BlockStatsIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    Stats value;
+    if (!m_db->Read(DBHeightKey(pindex->nHeight), value) || value.block_hash != pindex->GetBlockHash()) {
+        return error("%s: Failed to read the stats of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    CDBBatch batch;
+    batch.Write(std::make_pair(DB_BLOCK_HASH, value.block_hash), value);
+    batch.Erase(DBHeightKey(pindex->nHeight));
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& BlockStatsIndex::GetDB() const { return *m_db; }
+
+bool BlockStatsIndex::LookUpStats(const CBlockIndex* block_index, Stats& stats_out) const
+{
+    return m_db->LookupOne(block_index, stats_out);
+}
+
+bool BlockStatsIndex::LookUpStatsRange(int start_height, const CBlockIndex* stop_index, std::vector<Stats>& stats_out) const
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)", __func__, start_height, stop_index->nHeight);
+    }
+
+    stats_out.resize(stop_index->nHeight - start_height + 1);
+    for (const CBlockIndex* block_index = stop_index; block_index && block_index->nHeight >= start_height; block_index = block_index->pprev) {
+        if (!m_db->LookupOne(block_index, stats_out[block_index->nHeight - start_height])) {
+            return error("%s: unable to read the stats of block %s", __func__, block_index->GetBlockHash().ToString());
+        }
+    }
+    return true;
+}
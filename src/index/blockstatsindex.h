@@ -0,0 +1,95 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKSTATSINDEX_H
+#define BITCOIN_INDEX_BLOCKSTATSINDEX_H
+
+#include "amount.h"
+#include "index/base.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * BlockStatsIndex stores a few statistics of every block of the chain
+ * (-blockstatsindex): the transactions, their size and fees, the shielded
+ * transactions and the coinstake values. getblockindexstats and getfeeinfo
+ * add up these rows instead of reading every block of the range, with the
+ * previous outputs of its inputs, from disk.
+ */
+class BlockStatsIndex final : public BaseIndex
+{
+public:
+    /// The statistics of a block
+    struct Stats {
+        uint256 block_hash;
+        //! The transactions, without the coinbase and the coinstake
+        uint32_t tx_count{0};
+        //! The transactions, with the coinbase and the coinstake
+        uint32_t tx_count_all{0};
+        //! The size and the fees of the transactions, without the coinbase, the coinstake and the zerocoin transactions
+        uint64_t tx_bytes{0};
+        CAmount fees{0};
+        //! The transactions with sapling data, and their spends and outputs
+        uint32_t shielded_tx_count{0};
+        uint32_t shielded_spend_count{0};
+        uint32_t shielded_output_count{0};
+        //! The value staked by the coinstake, and what it pays out
+        CAmount coinstake_value_in{0};
+        CAmount coinstake_value_out{0};
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action)
+        {
+            READWRITE(block_hash);
+            READWRITE(tx_count);
+            READWRITE(tx_count_all);
+            READWRITE(tx_bytes);
+            READWRITE(fees);
+            READWRITE(shielded_tx_count);
+            READWRITE(shielded_spend_count);
+            READWRITE(shielded_output_count);
+            READWRITE(coinstake_value_in);
+            READWRITE(coinstake_value_out);
+        }
+    };
+
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "blockstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit BlockStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~BlockStatsIndex() override;
+
+    /// The statistics of a block.
+    bool LookUpStats(const CBlockIndex* block_index, Stats& stats_out) const;
+
+    /// The statistics of the blocks between two heights of a chain.
+    bool LookUpStatsRange(int start_height, const CBlockIndex* stop_index, std::vector<Stats>& stats_out) const;
+};
+
+/// The statistics of a block, from the block and its undo data (the coins spent by its transactions).
+bool ComputeBlockStats(const CBlock& block, const CBlockUndo& block_undo, BlockStatsIndex::Stats& stats);
+
+/// The global block statistics index, used by getblockindexstats. May be null.
+extern std::unique_ptr<BlockStatsIndex> g_block_stats_index;
+
+#endif // BITCOIN_INDEX_BLOCKSTATSINDEX_H
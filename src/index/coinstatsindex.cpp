@@ -0,0 +1,256 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/coinstatsindex.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "invalid.h"
+#include "streams.h"
+#include "undo.h"
+#include "util.h"
+#include "util/memory.h"
+#include "validation.h"
+
+/* The database stores the statistics of each block of the active chain by
+ * height (DB_BLOCK_HEIGHT), and those of the blocks disconnected since by
+ * block hash (DB_BLOCK_HASH), as the block filter index does. The running
+ * MuHash is stored once (DB_MUHASH), written with the best block locator.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_MUHASH = 'M';
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+namespace {
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for coin stats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+std::vector<unsigned char> TxOutSer(const COutPoint& outpoint, const Coin& coin)
+{
+    std::vector<unsigned char> ser;
+    CVectorWriter ss(SER_DISK, PROTOCOL_VERSION, ser, 0);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 4 + (coin.fCoinBase ? 2 : 0) + (coin.fCoinStake ? 1 : 0));
+    ss << coin.out;
+    return ser;
+}
+
+} // namespace
+
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    muhash.Insert(TxOutSer(outpoint, coin));
+}
+
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin)
+{
+    muhash.Remove(TxOutSer(outpoint, coin));
+}
+
+/**
+ * Access to the coin stats index database (indexes/coinstats/)
+ */
+class CoinStatsIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(path, n_cache_size, f_memory, f_wipe) {}
+
+    /// The entry of a block: by height if it is still in the active chain
+    /// of the index, by hash if it has been disconnected since.
+    bool LookupOne(const CBlockIndex* block_index, Stats& result) const
+    {
+        Stats read_out;
+        if (Read(DBHeightKey(block_index->nHeight), read_out) && read_out.block_hash == block_index->GetBlockHash()) {
+            result = std::move(read_out);
+            return true;
+        }
+        return Read(std::make_pair(DB_BLOCK_HASH, block_index->GetBlockHash()), result);
+    }
+};
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<CoinStatsIndex::DB>(GetDataDir() / "indexes" / "coinstats", n_cache_size, f_memory, f_wipe))
+{}
+
+CoinStatsIndex::~CoinStatsIndex() {}
+
+bool CoinStatsIndex::Init()
+{
+    if (!BaseIndex::Init()) {
+        return false;
+    }
+
+    const CBlockIndex* best_block_index = CurrentIndex();
+    if (!m_db->Read(DB_MUHASH, m_state) || !best_block_index) {
+        m_state = State();
+        if (best_block_index) {
+            return error("%s: the running state of %s is missing, restart with -reindex to rebuild it", __func__, GetName());
+        }
+        return true;
+    }
+
+    // The best block is the fork point with the active chain when the
+    // index was left on a stale chain: bring the state back to it.
+    const CBlockIndex* state_index;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(m_state.block_hash);
+        state_index = it != mapBlockIndex.end() ? it->second : nullptr;
+    }
+    if (!state_index || state_index->GetAncestor(best_block_index->nHeight) != best_block_index) {
+        return error("%s: the running state of %s doesn't match its best block, restart with -reindex to rebuild it", __func__, GetName());
+    }
+    for (const CBlockIndex* pindex = state_index; pindex != best_block_index; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex) || !DisconnectBlock(block, pindex)) {
+            return error("%s: Failed to disconnect block %s from %s", __func__, pindex->GetBlockHash().ToString(), GetName());
+        }
+    }
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    batch.Write(DB_MUHASH, m_state);
+    return true;
+}
+
+bool CoinStatsIndex::ApplyBlock(const CBlock& block, const CBlockIndex* pindex, bool fConnect)
+{
+    // The genesis block has no undo data, and its outputs aren't in the UTXO set
+    if (pindex->nHeight == 0) {
+        return true;
+    }
+
+    CBlockUndo block_undo;
+    if (!ReadBlockUndo(block, pindex, block_undo)) {
+        return false;
+    }
+
+    // The same outputs as AddCoins adds to the UTXO set
+    const bool fSkipInvalid = SkipInvalidUTXOS(pindex->nHeight);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        for (uint32_t j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            const COutPoint outpoint(txid, j);
+            if (out.scriptPubKey.IsUnspendable() || out.IsZerocoinMint() ||
+                    (fSkipInvalid && invalid_out::ContainsOutPoint(outpoint))) {
+                continue;
+            }
+            const Coin coin(out, pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake());
+            if (fConnect) {
+                ApplyCoinHash(m_state.muhash, outpoint, coin);
+                m_state.transaction_output_count++;
+                m_state.total_amount += out.nValue;
+            } else {
+                RemoveCoinHash(m_state.muhash, outpoint, coin);
+                m_state.transaction_output_count--;
+                m_state.total_amount -= out.nValue;
+            }
+        }
+
+        if (i == 0) {
+            continue;
+        }
+        // No prevouts for the zerocoin spends
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        if (!tx_undo.vprevout.empty() && tx_undo.vprevout.size() != tx.vin.size()) {
+            return error("%s: block %s and undo data inconsistent", __func__, pindex->GetBlockHash().ToString());
+        }
+        for (size_t j = 0; j < tx_undo.vprevout.size(); j++) {
+            const Coin& coin = tx_undo.vprevout[j];
+            if (fConnect) {
+                RemoveCoinHash(m_state.muhash, tx.vin[j].prevout, coin);
+                m_state.transaction_output_count--;
+                m_state.total_amount -= coin.out.nValue;
+            } else {
+                ApplyCoinHash(m_state.muhash, tx.vin[j].prevout, coin);
+                m_state.transaction_output_count++;
+                m_state.total_amount += coin.out.nValue;
+            }
+        }
+    }
+    return true;
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    const uint256 prev_hash = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+    if (m_state.block_hash != prev_hash) {
+        return error("%s: the running state of %s is at block %s, not at the previous block %s", __func__,
+                     GetName(), m_state.block_hash.ToString(), prev_hash.ToString());
+    }
+    if (!ApplyBlock(block, pindex, true)) {
+        return false;
+    }
+    m_state.block_hash = pindex->GetBlockHash();
+
+    Stats value;
+    value.block_hash = m_state.block_hash;
+    m_state.muhash.Finalize(value.muhash);
+    value.transaction_output_count = m_state.transaction_output_count;
+    value.total_amount = m_state.total_amount;
+
+    CDBBatch batch;
+    batch.Write(DBHeightKey(pindex->nHeight), value);
+    // the block is connected again after having been disconnected
+    batch.Erase(std::make_pair(DB_BLOCK_HASH, value.block_hash));
+    return m_db->WriteBatch(batch);
+}
+
+bool CoinStatsIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    Stats value;
+    if (!m_db->Read(DBHeightKey(pindex->nHeight), value) || value.block_hash != pindex->GetBlockHash()) {
+        return error("%s: Failed to read the stats of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (m_state.block_hash != value.block_hash) {
+        return error("%s: the running state of %s is at block %s, not at the disconnected block %s", __func__,
+                     GetName(), m_state.block_hash.ToString(), value.block_hash.ToString());
+    }
+    if (!ApplyBlock(block, pindex, false)) {
+        return false;
+    }
+    m_state.block_hash = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+
+    CDBBatch batch;
+    batch.Write(std::make_pair(DB_BLOCK_HASH, value.block_hash), value);
+    batch.Erase(DBHeightKey(pindex->nHeight));
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& CoinStatsIndex::GetDB() const { return *m_db; }
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, Stats& stats_out) const
+{
+    return m_db->LookupOne(block_index, stats_out);
+}
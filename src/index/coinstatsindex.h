@@ -0,0 +1,110 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COINSTATSINDEX_H
+#define BITCOIN_INDEX_COINSTATSINDEX_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "index/base.h"
+
+#include <memory>
+
+class Coin;
+class COutPoint;
+
+/**
+ * CoinStatsIndex keeps a running hash of the UTXO set (MuHash3072, which
+ * doesn't depend on the order of the coins), with the number of outputs and
+ * the total amount, updated with the outputs created and spent by each block
+ * of the chain (-coinstatsindex). The statistics are stored for every block,
+ * so that gettxoutsetinfo answers at once, at any height, instead of reading
+ * the whole chainstate.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+public:
+    /// The statistics of the UTXO set after a block
+    struct Stats {
+        uint256 block_hash;
+        uint256 muhash;
+        uint64_t transaction_output_count{0};
+        CAmount total_amount{0};
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action)
+        {
+            READWRITE(block_hash);
+            READWRITE(muhash);
+            READWRITE(transaction_output_count);
+            READWRITE(total_amount);
+        }
+    };
+
+protected:
+    class DB;
+
+private:
+    /// The running state, at the last block written (or disconnected), stored with the best block locator
+    struct State {
+        uint256 block_hash;
+        MuHash3072 muhash;
+        uint64_t transaction_output_count{0};
+        CAmount total_amount{0};
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action)
+        {
+            READWRITE(block_hash);
+            READWRITE(muhash);
+            READWRITE(transaction_output_count);
+            READWRITE(total_amount);
+        }
+    };
+
+    const std::unique_ptr<DB> m_db;
+    State m_state;
+
+    /// Add (fConnect) or remove the outputs created by a block, remove or add back the ones it spends
+    bool ApplyBlock(const CBlock& block, const CBlockIndex* pindex, bool fConnect);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "coinstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~CoinStatsIndex() override;
+
+    /// The statistics of the UTXO set after the given block.
+    bool LookUpStats(const CBlockIndex* block_index, Stats& stats_out) const;
+};
+
+/// Add a coin of the UTXO set to a running MuHash of the set.
+void ApplyCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/// Remove a coin of the UTXO set from a running MuHash of the set.
+void RemoveCoinHash(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin);
+
+/// The global UTXO set statistics index, used by gettxoutsetinfo. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // BITCOIN_INDEX_COINSTATSINDEX_H
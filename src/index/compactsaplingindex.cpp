@@ -0,0 +1,138 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/compactsaplingindex.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "util.h"
+#include "util/memory.h"
+
+/* The database stores the compact block of each block of the active chain by
+ * height (DB_BLOCK_HEIGHT), and those of the blocks disconnected since by
+ * block hash (DB_BLOCK_HASH), as the block stats index does.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+
+std::unique_ptr<CompactSaplingIndex> g_compact_sapling_index;
+
+namespace {
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for compact sapling index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+} // namespace
+
+CompactSaplingBlock MakeCompactSaplingBlock(const CBlock& block, int height)
+{
+    CompactSaplingBlock compact;
+    compact.height = height;
+    compact.block_hash = block.GetHash();
+    compact.prev_hash = block.hashPrevBlock;
+    compact.time = block.nTime;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (!tx.hasSaplingData() || (tx.sapData->vShieldedSpend.empty() && tx.sapData->vShieldedOutput.empty())) {
+            continue;
+        }
+        compact.vtx.emplace_back();
+        CompactSaplingTx& ctx = compact.vtx.back();
+        ctx.index = i;
+        ctx.txid = tx.GetHash();
+        ctx.nullifiers.reserve(tx.sapData->vShieldedSpend.size());
+        for (const SpendDescription& spend : tx.sapData->vShieldedSpend) {
+            ctx.nullifiers.push_back(spend.nullifier);
+        }
+        ctx.outputs.resize(tx.sapData->vShieldedOutput.size());
+        for (size_t j = 0; j < tx.sapData->vShieldedOutput.size(); j++) {
+            const OutputDescription& output = tx.sapData->vShieldedOutput[j];
+            ctx.outputs[j].cmu = output.cmu;
+            ctx.outputs[j].epk = output.ephemeralKey;
+            std::copy(output.encCiphertext.begin(), output.encCiphertext.begin() + COMPACT_NOTE_CIPHERTEXT_SIZE,
+                      ctx.outputs[j].ciphertext.begin());
+        }
+    }
+    return compact;
+}
+
+/**
+ * Access to the compact sapling block index database (indexes/compactsapling/)
+ */
+class CompactSaplingIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false) :
+        BaseIndex::DB(path, n_cache_size, f_memory, f_wipe) {}
+
+    /// The entry of a block: by height if it is still in the active chain
+    /// of the index, by hash if it has been disconnected since.
+    bool LookupOne(const CBlockIndex* block_index, CompactSaplingBlock& result) const
+    {
+        CompactSaplingBlock read_out;
+        if (Read(DBHeightKey(block_index->nHeight), read_out) && read_out.block_hash == block_index->GetBlockHash()) {
+            result = std::move(read_out);
+            return true;
+        }
+        return Read(std::make_pair(DB_BLOCK_HASH, block_index->GetBlockHash()), result);
+    }
+};
+
+CompactSaplingIndex::CompactSaplingIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<CompactSaplingIndex::DB>(GetDataDir() / "indexes" / "compactsapling", n_cache_size, f_memory, f_wipe))
+{}
+
+CompactSaplingIndex::~CompactSaplingIndex() {}
+
+bool CompactSaplingIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    const CompactSaplingBlock value = MakeCompactSaplingBlock(block, pindex->nHeight);
+
+    CDBBatch batch;
+    batch.Write(DBHeightKey(pindex->nHeight), value);
+    // the block is connected again after having been disconnected
+    batch.Erase(std::make_pair(DB_BLOCK_HASH, value.block_hash));
+    return m_db->WriteBatch(batch);
+}
+
+bool CompactSaplingIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CompactSaplingBlock value;
+    if (!m_db->Read(DBHeightKey(pindex->nHeight), value) || value.block_hash != pindex->GetBlockHash()) {
+        return error("%s: Failed to read the compact block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    CDBBatch batch;
+    batch.Write(std::make_pair(DB_BLOCK_HASH, value.block_hash), value);
+    batch.Erase(DBHeightKey(pindex->nHeight));
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& CompactSaplingIndex::GetDB() const { return *m_db; }
+
+bool CompactSaplingIndex::LookUpBlock(const CBlockIndex* block_index, CompactSaplingBlock& block_out) const
+{
+    return m_db->LookupOne(block_index, block_out);
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COMPACTSAPLINGINDEX_H
+#define BITCOIN_INDEX_COMPACTSAPLINGINDEX_H
+
+#include "index/base.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+/** The bytes of an output ciphertext a light wallet trial-decrypts: the lead byte, diversifier, value and rcm of the note */
+static const size_t COMPACT_NOTE_CIPHERTEXT_SIZE = 52;
+
+/** A Sapling output, without what only spending it or checking it needs */
+struct CompactSaplingOutput {
+    uint256 cmu;
+    uint256 epk;
+    std::array<unsigned char, COMPACT_NOTE_CIPHERTEXT_SIZE> ciphertext = {{0}};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(cmu);
+        READWRITE(epk);
+        READWRITE(ciphertext);
+    }
+};
+
+/** The nullifiers and the compact outputs of a shielded transaction */
+struct CompactSaplingTx {
+    //! The position of the transaction in its block
+    uint32_t index{0};
+    uint256 txid;
+    std::vector<uint256> nullifiers;
+    std::vector<CompactSaplingOutput> outputs;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(index);
+        READWRITE(txid);
+        READWRITE(nullifiers);
+        READWRITE(outputs);
+    }
+};
+
+/** The shielded transactions of a block, all a light wallet scans */
+struct CompactSaplingBlock {
+    int32_t height{0};
+    uint256 block_hash;
+    uint256 prev_hash;
+    uint32_t time{0};
+    std::vector<CompactSaplingTx> vtx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(height);
+        READWRITE(block_hash);
+        READWRITE(prev_hash);
+        READWRITE(time);
+        READWRITE(vtx);
+    }
+};
+
+/** The compact form of a block */
+CompactSaplingBlock MakeCompactSaplingBlock(const CBlock& block, int height);
+
+/**
+ * CompactSaplingIndex stores the compact form of every block of the chain
+ * (-compactsaplingindex), that /rest/compactblocks serves: light wallets
+ * find their notes and spends there, without downloading the full blocks.
+ */
+class CompactSaplingIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "compactsaplingindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CompactSaplingIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~CompactSaplingIndex() override;
+
+    /// The compact form of a block.
+    bool LookUpBlock(const CBlockIndex* block_index, CompactSaplingBlock& block_out) const;
+};
+
+/// The global compact sapling block index, used by /rest/compactblocks. May be null.
+extern std::unique_ptr<CompactSaplingIndex> g_compact_sapling_index;
+
+#endif // BITCOIN_INDEX_COMPACTSAPLINGINDEX_H
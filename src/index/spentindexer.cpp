@@ -0,0 +1,98 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/spentindexer.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "index/addressindexer.h"
+#include "undo.h"
+#include "util.h"
+#include "util/memory.h"
+
+constexpr char DB_SPENTINDEX = 'p';
+
+std::unique_ptr<SpentIndex> g_spentindex;
+
+/**
+ * Access to the spent index database (indexes/spentindex/)
+ *
+ * The database maps each spent output to the input spending it.
+ */
+class SpentIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value) const;
+};
+
+SpentIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "spentindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool SpentIndex::DB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value) const
+{
+    return Read(std::make_pair(DB_SPENTINDEX, key), value);
+}
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<SpentIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+SpentIndex::~SpentIndex() {}
+
+bool SpentIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block transactions are not connected
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo blockUndo;
+    if (!ReadBlockUndo(block, pindex, blockUndo)) {
+        return false;
+    }
+
+    CDBBatch batch;
+    int type;
+    uint160 hashBytes;
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (tx.HasZerocoinSpendInputs()) continue;
+
+        const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction and undo data inconsistent", __func__);
+        }
+        for (unsigned int j = 0; j < tx.vin.size(); j++) {
+            const CTxIn& input = tx.vin[j];
+            const CTxOut& prevout = txundo.vprevout[j].out;
+            // the outputs to scripts without an address are indexed too, with a null hash
+            GetAddressIndexScript(prevout.scriptPubKey, type, hashBytes);
+            batch.Write(std::make_pair(DB_SPENTINDEX, CSpentIndexKey(input.prevout.hash, input.prevout.n)),
+                        CSpentIndexValue(tx.GetHash(), j, pindex->nHeight, prevout.nValue, type, hashBytes));
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool SpentIndex::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDBBatch batch;
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (tx.HasZerocoinSpendInputs()) continue;
+
+        for (const CTxIn& input : tx.vin) {
+            batch.Erase(std::make_pair(DB_SPENTINDEX, CSpentIndexKey(input.prevout.hash, input.prevout.n)));
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& SpentIndex::GetDB() const { return *m_db; }
+
+bool SpentIndex::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value) const
+{
+    return m_db->ReadSpentIndex(key, value);
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SPENTINDEXER_H
+#define BITCOIN_INDEX_SPENTINDEXER_H
+
+#include "index/base.h"
+#include "index/spentindex.h"
+
+#include <memory>
+
+/**
+ * SpentIndex is used to look up the input spending a transaction output, with
+ * the amount and address of the output (-spentindex).
+ */
+class SpentIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool DisconnectBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~SpentIndex() override;
+
+    /// The input spending a confirmed output, if it's been spent.
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value) const;
+};
+
+/// The global spent index, used by the getspentinfo RPC. May be null.
+extern std::unique_ptr<SpentIndex> g_spentindex;
+
+#endif // BITCOIN_INDEX_SPENTINDEXER_H
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/timestampindexer.h"
+
+#include "chain.h"
+#include "util.h"
+#include "util/memory.h"
+#include "validation.h"
+
+constexpr char DB_TIMESTAMPINDEX = 's';
+constexpr char DB_BLOCKHASHINDEX = 'z';
+
+std::unique_ptr<TimestampIndex> g_timestampindex;
+
+/**
+ * Access to the timestamp index database (indexes/timestampindex/)
+ *
+ * The database stores the blocks by logical timestamp, and the logical
+ * timestamp of each block.
+ */
+class TimestampIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadTimestampBlockIndex(const uint256& hash, unsigned int& logicalTS) const;
+};
+
+TimestampIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "timestampindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool TimestampIndex::DB::ReadTimestampBlockIndex(const uint256& hash, unsigned int& logicalTS) const
+{
+    CTimestampBlockIndexValue lts;
+    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+        return false;
+
+    logicalTS = lts.ltimestamp;
+    return true;
+}
+
+TimestampIndex::TimestampIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<TimestampIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+TimestampIndex::~TimestampIndex() {}
+
+bool TimestampIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block transactions are not connected
+    if (pindex->nHeight == 0) return true;
+
+    unsigned int logicalTS = pindex->nTime;
+    unsigned int prevLogicalTS = 0;
+
+    // retrieve logical timestamp of the previous block
+    if (pindex->pprev->nHeight > 0 && !m_db->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+        LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+    if (logicalTS <= prevLogicalTS) {
+        logicalTS = prevLogicalTS + 1;
+        LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
+    }
+
+    // The entries of a disconnected block are kept: getblockhashes filters
+    // them out with fActiveOnly, and the entries of the block, connected
+    // again, are the same.
+    CDBBatch batch;
+    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(logicalTS, pindex->GetBlockHash())), 0);
+    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(pindex->GetBlockHash())), CTimestampBlockIndexValue(logicalTS));
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& TimestampIndex::GetDB() const { return *m_db; }
+
+bool TimestampIndex::ReadTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& hashes)
+{
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+
+    while (pcursor->Valid()) {
+        std::pair<char, CTimestampIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high) {
+            if (!fActiveOnly || HashOnchainActive(key.second.blockHash)) {
+                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
+            }
+
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_TIMESTAMPINDEXER_H
+#define BITCOIN_INDEX_TIMESTAMPINDEXER_H
+
+#include "index/base.h"
+#include "index/timestampindex.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * TimestampIndex is used to look up the blocks by their logical timestamp
+ * (-timestampindex): the block time, made strictly increasing along the chain.
+ */
+class TimestampIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "timestampindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit TimestampIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~TimestampIndex() override;
+
+    /// The blocks with a logical timestamp in [low, high), optionally only those of the active chain.
+    bool ReadTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& hashes);
+};
+
+/// The global timestamp index, used by the getblockhashes RPC. May be null.
+extern std::unique_ptr<TimestampIndex> g_timestampindex;
+
+#endif // BITCOIN_INDEX_TIMESTAMPINDEXER_H
@@ -19,14 +19,27 @@
 #include "activemasternode.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockassembler.h"
+#include "blockfileflusher.h"
+#include "blockprecheck.h"
 #include "budget/budgetdb.h"
 #include "budget/budgetmanager.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/upgrades.h"
+#include "crypto/aes.h"
+#include "crypto/sha256.h"
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "index/addressindexer.h"
+#include "index/spentindexer.h"
+#include "index/blockfilterindex.h"
+#include "index/blockstatsindex.h"
+#include "index/compactsaplingindex.h"
+#include "index/txindex.h"
+#include "index/coinstatsindex.h"
+#include "index/timestampindexer.h"
 #include "invalid.h"
 #include "key.h"
 #include "masternode-payments.h"
@@ -34,6 +47,7 @@
 #include "masternodeman.h"
 #include "messagesigner.h"
 #include "miner.h"
+#include "mnprecheck.h"
 #include "netbase.h"
 #include "net_processing.h"
 #include "policy/feerate.h"
@@ -46,8 +60,11 @@
 #include "scheduler.h"
 #include "spork.h"
 #include "sporkdb.h"
+#include "tiertwodb.h"
 #include "txdb.h"
 #include "torcontrol.h"
+#include "txprecheck.h"
+#include "txreconciliation.h"
 #include "guiinterface.h"
 #include "guiinterfaceutil.h"
 #include "util.h"
@@ -55,18 +72,22 @@
 #include "util/threadnames.h"
 #include "validation.h"
 #include "validationinterface.h"
+#include "validationstats.h"
 #include "zdogecchain.h"
+#include "zdogec/zerocoinsnapshot.h"
 
 #ifdef ENABLE_WALLET
 #include "wallet/db.h"
 #include "wallet/wallet.h"
 #include "wallet/rpcwallet.h"
+#include "wallet/shieldsendqueue.h"
 
 #endif
 #include "warnings.h"
 
 #include <atomic>
 #include <fstream>
+#include <future>
 #include <stdint.h>
 #include <stdio.h>
 #include <memory>
@@ -199,6 +220,22 @@ void Interrupt()
     InterruptMapPort();
     if (g_connman)
         g_connman->Interrupt();
+    if (g_addressindex)
+        g_addressindex->Interrupt();
+    if (g_spentindex)
+        g_spentindex->Interrupt();
+    if (g_timestampindex)
+        g_timestampindex->Interrupt();
+    if (g_blockfilterindex)
+        g_blockfilterindex->Interrupt();
+    if (g_coin_stats_index)
+        g_coin_stats_index->Interrupt();
+    if (g_block_stats_index)
+        g_block_stats_index->Interrupt();
+    if (g_txindex)
+        g_txindex->Interrupt();
+    if (g_compact_sapling_index)
+        g_compact_sapling_index->Interrupt();
 }
 
 /** Preparing steps before shutting down or restarting the wallet */
@@ -232,6 +269,10 @@ void PrepareShutdown()
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
+    if (g_blocktemplatecache) UnregisterValidationInterface(g_blocktemplatecache.get());
+#ifdef ENABLE_WALLET
+    if (g_stakerscheduler) UnregisterValidationInterface(g_stakerscheduler.get());
+#endif
     if (g_connman) g_connman->Stop();
 
     StopTorControl();
@@ -239,19 +280,31 @@ void PrepareShutdown()
     // After everything has been shut down, but before things get flushed, stop the
     // CScheduler/checkqueue threadGroup
     threadGroup.interrupt_all();
+#ifdef ENABLE_WALLET
+    // The staker may be waiting for its next time slot
+    if (g_stakerscheduler) g_stakerscheduler->Interrupt();
+#endif
     threadGroup.join_all();
 
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     peerLogic.reset();
+    g_blocktemplatecache.reset();
+#ifdef ENABLE_WALLET
+    g_stakerscheduler.reset();
+    // The sends still queued hold reserved keys of the wallet
+    shieldsendqueue.Clear();
+#endif
     g_connman.reset();
 
     DumpMasternodes();
     DumpBudgets(g_budgetman);
     DumpMasternodePayments();
+    pTierTwoDB.reset();
     UnregisterNodeSignals(GetNodeSignals());
     if (::mempool.IsLoaded() && gArgs.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool(::mempool);
+        DumpMempool(::mempool, true);
+        DumpSignatureCache();
     }
 
     if (fFeeEstimatesInitialized) {
@@ -273,6 +326,40 @@ void PrepareShutdown()
     // CValidationInterface callbacks, flush them...
     GetMainSignals().FlushBackgroundCallbacks();
 
+    // The indexes are in sync with the chain state flushed above
+    if (g_addressindex) {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_spentindex) {
+        g_spentindex->Stop();
+        g_spentindex.reset();
+    }
+    if (g_timestampindex) {
+        g_timestampindex->Stop();
+        g_timestampindex.reset();
+    }
+    if (g_blockfilterindex) {
+        g_blockfilterindex->Stop();
+        g_blockfilterindex.reset();
+    }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Stop();
+        g_coin_stats_index.reset();
+    }
+    if (g_block_stats_index) {
+        g_block_stats_index->Stop();
+        g_block_stats_index.reset();
+    }
+    if (g_txindex) {
+        g_txindex->Stop();
+        g_txindex.reset();
+    }
+    if (g_compact_sapling_index) {
+        g_compact_sapling_index->Stop();
+        g_compact_sapling_index.reset();
+    }
+
     // Any future callbacks will be dropped. This should absolutely be safe - if
     // missing a callback results in an unrecoverable situation, unclean shutdown
     // would too. The only reason to do the above flushes is to let the wallet catch
@@ -286,9 +373,17 @@ void PrepareShutdown()
 
             //record that client took the proper shutdown procedure
             pblocktree->WriteFlag("shutdown", true);
+
+            if (gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT)) {
+                DumpBlockIndexSnapshot();
+            }
         }
+        // the block files were committed by the flush above
+        g_blockfileflusher.Stop();
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsWriteBack;
+        pcoinsWriteBack = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -348,7 +443,11 @@ void Shutdown()
 #endif
     globalVerifyHandle.reset();
     ECC_Stop();
+    if (g_logger->GetAsyncDropped() > 0)
+        LogPrintf("%s: %u log messages were dropped\n", __func__, g_logger->GetAsyncDropped());
     LogPrintf("%s: done\n", __func__);
+    // Write the messages still queued
+    g_logger->StopAsync();
 }
 
 /**
@@ -423,8 +522,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script and Sapling proof verification (0 to verify all, default: %s, testnet: %s)"), defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
+    strUsage += HelpMessageOpt("-checkblocksbackground", strprintf(_("Disconnect and reconnect the -checkblocks blocks in the background once the node has started, instead of before (default: %u)"), DEFAULT_CHECKBLOCKS_BACKGROUND));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), DOGEC_CONF_FILENAME));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -439,26 +540,46 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file: this can be an absolute path or a path relative to the data directory (default: %s)"), DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-disablesystemnotifications", strprintf(_("Disable OS notifications for incoming transactions (default: %u)"), 0));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-blockcompression", strprintf(_("Compress the blocks and undo data written to the block files. The blocks already stored are left as they are, and stay readable with or without this option. Older versions and external tools can't read compressed block files (default: %u)"), DEFAULT_BLOCK_COMPRESSION));
+    strUsage += HelpMessageOpt("-blockfilechunksize=<n>", strprintf(_("Pre-allocate the block files by chunks of <n> MiB, and the undo files by chunks of 1/16 of it, a chunk ahead of their data (1 to %d, default: %u)"), MAX_BLOCKFILE_SIZE >> 20, DEFAULT_BLOCKFILE_CHUNK_MIB));
+    strUsage += HelpMessageOpt("-blockindexsnapshot", strprintf(_("Save the block index to a flat file at shutdown, loaded faster than the database at the next startup, as long as the block index is unchanged. Don't run older versions on the same data directory with it (default: %u)"), DEFAULT_BLOCKINDEX_SNAPSHOT));
+    strUsage += HelpMessageOpt("-dbcacheretain=<n>", strprintf(_("Percentage of the in-memory UTXO set kept of its most recently used coins when it is flushed because it is full (0 to %d, default: %d)"), nMaxDbCacheRetain, nDefaultDbCacheRetain));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-replayblocks=<file>", _("Connect the blocks of an external blk000??.dat file, without connecting to the network, "
+                                                         "log the blocks and transactions per second and the time spent in each phase of the validation, then stop. "
+                                                         "Run it on a fresh data directory to benchmark the initial block download"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), DEFAULT_MAX_REORG_DEPTH));
+    strUsage += HelpMessageOpt("-undocache=<n>", strprintf(_("Keep the last <n> blocks connected and their undo data in memory, to disconnect them in a reorg without reading the disk (default: %u)"), DEFAULT_UNDO_CACHE_BLOCKS));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
-    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool and the signature cache on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
+    strUsage += HelpMessageOpt("-mempooldumpinterval=<n>", strprintf(_("With -persistmempool, also save the mempool every <n> minutes, 0 to only save it on shutdown (default: %u)"), DEFAULT_MEMPOOL_DUMP_INTERVAL));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), DOGEC_PID_FILENAME));
 #endif
+    strUsage += HelpMessageOpt("-prune=<n>", strprintf(_("Reduce storage requirements by pruning (deleting) old blocks. "
+            "This mode is incompatible with -txindex, -addressindex, -spentindex, -timestampindex, -blockfilterindex, -coinstatsindex, -blockstatsindex and -compactsaplingindex, "
+            "and disables the rescans of the wallet beyond the blocks kept. "
+            "Warning: Reverting this setting requires re-downloading the entire blockchain. "
+            "(default: 0 = disable pruning blocks, >%u = target size in MiB to use for block files)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-reindexthreads=<n>", strprintf(_("Number of threads reading the block files ahead during -reindex (0 to %d, 0 = read them in the import thread, default: %d)"), MAX_REINDEX_THREADS, DEFAULT_REINDEX_THREADS));
     strUsage += HelpMessageOpt("-resync", _("Delete blockchain folders and resync from scratch") + " " + _("on startup"));
 #if !defined(WIN32)
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
-    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
-    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
-    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, built in the background, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, built in the background, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
+    strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, built in the background, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
+    strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, built in the background, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain an index of the compact block filters (BIP 157), built in the background, used by the getblockfilter rpc call and the light clients (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain the statistics of the UTXO set at every block (MuHash, outputs and total amount), built in the background, used by the gettxoutsetinfo rpc call (default: %u)"), DEFAULT_COINSTATSINDEX));
+    strUsage += HelpMessageOpt("-compactsaplingindex", strprintf(_("Maintain the compact form of every block (sapling note commitments, ephemeral keys, note ciphertext prefixes and nullifiers), built in the background, served to light wallets by /rest/compactblocks (default: %u)"), DEFAULT_COMPACTSAPLINGINDEX));
+    strUsage += HelpMessageOpt("-blockstatsindex", strprintf(_("Maintain the statistics of every block (transactions, size, fees, shielded transactions, coinstake), built in the background, used by the getblockindexstats and getfeeinfo rpc calls (default: %u)"), DEFAULT_BLOCKSTATSINDEX));
     strUsage += HelpMessageOpt("-forcestart", _("Attempt to force blockchain corruption recovery") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-zerocoinsnapshot=<file>", _("Load the final legacy zerocoin state from <file>, checked against the hash known for the network, instead of building it while syncing the blocks under -assumevalid"));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -476,17 +597,26 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxconnections=<n>", strprintf(_("Maintain at most <n> connections to peers (default: %u)"), DEFAULT_MAX_PEER_CONNECTIONS));
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt("-maxuploadtarget=<n>", strprintf(_("Tries to keep the upload traffic under the given target (in MiB per 24h): past it, the historical blocks and the tier two sync are no longer served to the non-whitelisted peers, 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt("-maxuploadhistoricalblocks=<n>", strprintf(_("Upload budget of the blocks older than a week (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_BUDGET));
+    strUsage += HelpMessageOpt("-maxuploadtiprelay=<n>", strprintf(_("Upload budget of the recent blocks and headers (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_BUDGET));
+    strUsage += HelpMessageOpt("-maxuploadtxrelay=<n>", strprintf(_("Upload budget of the transactions (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_BUDGET));
+    strUsage += HelpMessageOpt("-maxuploadtiertwo=<n>", strprintf(_("Upload budget of the masternode, budget and spork messages (in MiB per 24h), 0 = no limit (default: %d)"), DEFAULT_MAX_UPLOAD_BUDGET));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Set the number of threads handling the peer messages, the tier two messages being processed in parallel with the others (%u to %d, default: %d)"), 1, MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Only connect to nodes in network <net> (ipv4, ipv6 or onion)"));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
     strUsage += HelpMessageOpt("-peerbloomfilters", strprintf(_("Support filtering of blocks and transaction with bloom filters (default: %u)"), DEFAULT_PEERBLOOMFILTERS));
+    strUsage += HelpMessageOpt("-peerblockfilters", strprintf(_("Serve the compact block filters to peers, requires -blockfilterindex (default: %u)"), DEFAULT_PEERBLOCKFILTERS));
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), GetSupportedSocketEventsModes(), SocketEventsModeToString(DefaultSocketEventsMode())));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
+    strUsage += HelpMessageOpt("-txreconciliation", strprintf(_("Relay the transactions to the peers supporting it by set reconciliation, announcing them to a few outbound peers only (default: %u)"), DEFAULT_TXRECONCILIATION));
     strUsage += HelpMessageOpt("-upnp", strprintf(_("Use UPnP to map the listening port (default: %u)"), DEFAULT_UPNP));
     strUsage += HelpMessageOpt("-whitebind=<addr>", _("Bind to given address and whitelist peers connecting to it. Use [host]:port notation for IPv6"));
     strUsage += HelpMessageOpt("-whitelist=<netmask>", _("Whitelist peers connecting from the given netmask or IP address. Can be specified multiple times.") +
@@ -506,6 +636,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubsequence=<address>", _("Enable publish hash block and tx sequence in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubmnlist=<address>", _("Enable publish masternode list changes in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubbudgetvote=<address>", _("Enable publish budget votes in <address>"));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -537,11 +670,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
+    strUsage += HelpMessageOpt("-logasync", strprintf(_("Write debug.log from a background thread, dropping the messages when more than %u wait (default: %u)"), LOG_ASYNC_BUFFER_SIZE, DEFAULT_LOGASYNC));
     if (showDebug) {
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf(_("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default:%u)"), DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf(_("Require high priority for relaying free or low-fee transactions (default:%u)"), DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit size of signature cache to <n> MiB (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf(_("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)"), DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"), CURRENCY_UNIT, FormatMoney(::minRelayTxFee.GetFeePerK())));
@@ -583,8 +717,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), defaultBaseParams->RPCPort(), testnetBaseParams->RPCPort()));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcwalletthreads=<n>", strprintf(_("Set the number of threads to service RPC wallet calls (default: %d)"), DEFAULT_HTTP_WALLET_THREADS));
+    strUsage += HelpMessageOpt("-restthreads=<n>", strprintf(_("Set the number of threads to service REST requests (default: %d)"), DEFAULT_HTTP_REST_THREADS));
     if (showDebug) {
         strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcwalletworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC wallet calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-restworkqueue=<n>", strprintf("Set the depth of the work queue to service REST requests (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -643,6 +781,22 @@ static void BlockNotifyGenesisWait(bool, const CBlockIndex *pBlockIndex)
     }
 }
 
+/**
+ * Compact a step of the databases that were written a lot since their last compaction.
+ * Not during the initial sync: LevelDB compacts them in the background while they grow.
+ * One step of one database per call, so that the scheduler thread isn't held for long.
+ */
+static void CompactDatabasesIfIdle()
+{
+    if (ShutdownRequested() || IsInitialBlockDownload())
+        return;
+    if (pcoinsdbview->CompactStep(DB_COMPACTION_STEP_KEYS))
+        return;
+    if (pblocktree->CompactStep(DB_COMPACTION_STEP_KEYS))
+        return;
+    zerocoinDB->CompactStep(DB_COMPACTION_STEP_KEYS);
+}
+
 ////////////////////////////////////////////////////
 
 
@@ -660,6 +814,60 @@ struct CImportingNow {
     }
 };
 
+/**
+ * -replayblocks: connect the blocks of a file, and log the throughput and the
+ * breakdown of the validation time (see getvalidationstats)
+ */
+static void ReplayBlockFile(const fs::path& path)
+{
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file) {
+        LogPrintf("Error: Could not open the blocks file to replay %s\n", path.string());
+        return;
+    }
+
+    int nHeightStart;
+    unsigned int nTxStart;
+    {
+        LOCK(cs_main);
+        nHeightStart = chainActive.Height();
+        nTxStart = chainActive.Tip()->nChainTx;
+    }
+    if (nHeightStart > 0) {
+        LogPrintf("Warning: replaying the blocks on a chain at height %d, not on a fresh data directory\n", nHeightStart);
+    }
+
+    LogPrintf("Replaying blocks file %s (dbcache %d MiB, %d script check threads)...\n",
+              path.string(), nCoinCacheUsage >> 20, std::max(1, nScriptCheckThreads));
+    ResetBlockPhaseStats();
+    const int64_t nStart = GetTimeMicros();
+    {
+        CImportingNow imp;
+        LoadExternalBlockFile(file);
+    }
+    const double dElapsed = std::max((int64_t)1, GetTimeMicros() - nStart) / 1000000.0;
+
+    int nHeightEnd;
+    unsigned int nTxEnd;
+    {
+        LOCK(cs_main);
+        nHeightEnd = chainActive.Height();
+        nTxEnd = chainActive.Tip()->nChainTx;
+    }
+    const int nBlocks = nHeightEnd - nHeightStart;
+    const unsigned int nTxes = nTxEnd - nTxStart;
+    LogPrintf("Replayed %d blocks (height %d to %d), %u transactions in %.3fs: %.2f blocks/s, %.2f tx/s\n",
+              nBlocks, nHeightStart, nHeightEnd, nTxes, dElapsed, nBlocks / dElapsed, nTxes / dElapsed);
+
+    const std::vector<BlockPhaseStats> vStats = GetBlockPhaseStats();
+    const int64_t nTotalTime = std::max((int64_t)1, vStats[BLOCK_PHASE_TOTAL].nTotalTime);
+    for (const BlockPhaseStats& stats : vStats) {
+        LogPrintf("  %-10s %10.3fs %5.1f%%  avg %.3fms  p50 %.3fms  p90 %.3fms  p99 %.3fms  max %.3fms\n",
+                  stats.name, stats.nTotalTime / 1000000.0, 100.0 * stats.nTotalTime / nTotalTime,
+                  stats.nAvg / 1000.0, stats.nP50 / 1000.0, stats.nP90 / 1000.0, stats.nP99 / 1000.0, stats.nMax / 1000.0);
+    }
+}
+
 void ThreadImport(const std::vector<fs::path>& vImportFiles)
 {
     util::ThreadRename("dogecash-loadblk");
@@ -668,17 +876,26 @@ void ThreadImport(const std::vector<fs::path>& vImportFiles)
     // -reindex
     if (fReindex) {
         CImportingNow imp;
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE* file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(file, &pos);
-            nFile++;
+        if (fPruneMode) {
+            CleanupBlockRevFiles();
+        }
+        const int nReaders = std::min(MAX_REINDEX_THREADS, (int)gArgs.GetArg("-reindexthreads", DEFAULT_REINDEX_THREADS));
+        if (nReaders > 0) {
+            if (!ReindexBlockFiles(nReaders))
+                return; // Node is shutting down, keep reindexing on the next start
+        } else {
+            int nFile = 0;
+            while (true) {
+                CDiskBlockPos pos(nFile, 0);
+                if (!fs::exists(GetBlockPosFilename(pos, "blk")))
+                    break; // No block files left to reindex
+                FILE* file = OpenBlockFile(pos, true);
+                if (!file)
+                    break; // This error is logged in OpenBlockFile
+                LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+                LoadExternalBlockFile(file, &pos);
+                nFile++;
+            }
         }
         pblocktree->WriteReindexing(false);
         fReindex = false;
@@ -716,6 +933,14 @@ void ThreadImport(const std::vector<fs::path>& vImportFiles)
         }
     }
 
+    // -replayblocks=
+    if (gArgs.IsArgSet("-replayblocks")) {
+        ReplayBlockFile(gArgs.GetArg("-replayblocks", ""));
+        LogPrintf("Stopping after the blocks replay\n");
+        StartShutdown();
+        return;
+    }
+
     if (gArgs.GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT)) {
         LogPrintf("Stopping after block import\n");
         StartShutdown();
@@ -811,6 +1036,7 @@ namespace { // Variables internal to initialization process only
     int nUserMaxConnections;
     int nFD;
     ServiceFlags nLocalServices = NODE_NETWORK;
+    SocketEventsMode socketEventsMode = SocketEventsMode::SELECT;
 
     std::string strWalletFile;
     bool fDisableWallet = false;
@@ -881,6 +1107,12 @@ void InitParameterInteraction()
             LogPrintf("%s : parameter interaction: -bind or -whitebind set -> setting -listen=1\n", __func__);
     }
 
+    if (gArgs.IsArgSet("-replayblocks")) {
+        // the blocks replayed are the only ones to connect
+        if (gArgs.SoftSetArg("-connect", "0"))
+            LogPrintf("%s : parameter interaction: -replayblocks set -> setting -connect=0\n", __func__);
+    }
+
     if (gArgs.IsArgSet("-connect")) {
         // when only connecting to trusted nodes, do not seed via DNS, or listen by default
         if (gArgs.SoftSetBoolArg("-dnsseed", false))
@@ -924,6 +1156,12 @@ void InitParameterInteraction()
             LogPrintf("%s : parameter interaction: -salvagewallet=1 -> setting -rescan=1\n", __func__);
     }
 
+    if (gArgs.GetArg("-prune", 0) > 0) {
+        // The transaction index is on by default: pruning turns it off, unless it's asked for
+        if (gArgs.SoftSetBoolArg("-txindex", false))
+            LogPrintf("%s : parameter interaction: -prune set -> setting -txindex=0\n", __func__);
+    }
+
     int zapwallettxes = gArgs.GetArg("-zapwallettxes", 0);
     // -zapwallettxes implies dropping the mempool on startup
     if (zapwallettxes != 0 && gArgs.SoftSetBoolArg("-persistmempool", false)) {
@@ -977,19 +1215,6 @@ static std::string ResolveErrMsg(const char * const optname, const std::string&
     return strprintf(_("Cannot resolve -%s address: '%s'"), optname, strBind);
 }
 
-// Sets the last CACHED_BLOCK_HASHES hashes into masternode manager cache
-static void LoadBlockHashesCache(CMasternodeMan& man)
-{
-    LOCK(cs_main);
-    const CBlockIndex* pindex = chainActive.Tip();
-    unsigned int inserted = 0;
-    while (pindex && inserted < CACHED_BLOCK_HASHES) {
-        man.CacheBlockHash(pindex);
-        pindex = pindex->pprev;
-        ++inserted;
-    }
-}
-
 void InitLogging()
 {
     g_logger->m_print_to_file = !gArgs.IsArgNegated("-debuglogfile");
@@ -1027,12 +1252,19 @@ bool AppInitParameterInteraction()
         return UIError(_("Cannot set -bind or -whitebind together with -listen=0"));
     }
 
+    const std::string strSocketEventsMode = gArgs.GetArg("-socketevents", SocketEventsModeToString(DefaultSocketEventsMode()));
+    if (!ParseSocketEventsMode(strSocketEventsMode, socketEventsMode)) {
+        return UIError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"), strSocketEventsMode, GetSupportedSocketEventsModes()));
+    }
+
     int nBind = std::max(nUserBind, size_t(1));
     nUserMaxConnections = gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int) (FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    if (IsSocketEventsModeLimited(socketEventsMode)) {
+        nMaxConnections = std::max(std::min(nMaxConnections, (int) (FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    }
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS)
         return UIError(_("Not enough file descriptors available."));
@@ -1086,6 +1318,51 @@ bool AppInitParameterInteraction()
         mempool.setSanityCheck(1.0 / ratio);
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", Params().DefaultConsistencyChecks());
+    fBlockCompression = gArgs.GetBoolArg("-blockcompression", DEFAULT_BLOCK_COMPRESSION);
+    const int64_t nBlockFileChunkMiB = gArgs.GetArg("-blockfilechunksize", DEFAULT_BLOCKFILE_CHUNK_MIB);
+    if (nBlockFileChunkMiB < 1 || nBlockFileChunkMiB > (MAX_BLOCKFILE_SIZE >> 20)) {
+        return UIError(strprintf(_("Invalid -blockfilechunksize=%d, it must be between 1 and %d"), nBlockFileChunkMiB, MAX_BLOCKFILE_SIZE >> 20));
+    }
+    nBlockFileChunkSize = nBlockFileChunkMiB << 20;
+    nUndoFileChunkSize = nBlockFileChunkSize / 16;
+    fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    fTimestampIndex = gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    fBlockFilterIndex = gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    fCoinStatsIndex = gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX);
+    fBlockStatsIndex = gArgs.GetBoolArg("-blockstatsindex", DEFAULT_BLOCKSTATSINDEX);
+    fCompactSaplingIndex = gArgs.GetBoolArg("-compactsaplingindex", DEFAULT_COMPACTSAPLINGINDEX);
+    fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
+
+    // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
+    int64_t nPruneArg = gArgs.GetArg("-prune", 0);
+    if (nPruneArg < 0) {
+        return UIError(_("Prune cannot be configured with a negative value."));
+    }
+    nPruneTarget = (uint64_t)nPruneArg * 1024 * 1024;
+    if (nPruneArg > 0) {
+        if (nPruneTarget < MIN_DISK_SPACE_FOR_BLOCK_FILES) {
+            return UIError(strprintf(_("Prune configured below the minimum of %d MiB.  Please use a higher number."), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
+        }
+        // These indexes read, or are built in the background from, the whole chain
+        const std::vector<std::pair<std::string, bool> > vIndexes = {
+            {"-txindex", fTxIndex},
+            {"-addressindex", fAddressIndex},
+            {"-spentindex", fSpentIndex},
+            {"-timestampindex", fTimestampIndex},
+            {"-blockfilterindex", fBlockFilterIndex},
+            {"-coinstatsindex", fCoinStatsIndex},
+            {"-blockstatsindex", fBlockStatsIndex},
+            {"-compactsaplingindex", fCompactSaplingIndex},
+        };
+        for (const auto& index : vIndexes) {
+            if (index.second) {
+                return UIError(strprintf(_("Prune mode is incompatible with %s."), index.first));
+            }
+        }
+        LogPrintf("Prune configured to target %uMiB on disk for block and undo files.\n", nPruneTarget / 1024 / 1024);
+        fPruneMode = true;
+    }
     Checkpoints::fEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
 
     // -mempoollimit limits
@@ -1104,6 +1381,12 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", Params().GetConsensus().defaultAssumeValid.GetHex()));
+    if (!hashAssumeValid.IsNull())
+        LogPrintf("Assuming ancestors of block %s have valid signatures.\n", hashAssumeValid.GetHex());
+    else
+        LogPrintf("Validating signatures for all blocks.\n");
+
     setvbuf(stdout, NULL, _IOLBF, 0); /// ***TODO*** do we still need this after -printtoconsole is gone?
 
     RegisterAllCoreRPCCommands(tableRPC);
@@ -1153,9 +1436,22 @@ bool AppInitParameterInteraction()
         SetMockTime(gArgs.GetArg("-mocktime", 0)); // SetMockTime(0) is a no-op
     }
 
+    // A pruned node can't serve the old blocks
+    if (fPruneMode)
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (!fBlockFilterIndex)
+            return UIError(_("Cannot set -peerblockfilters without -blockfilterindex."));
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION))
+        nLocalServices = ServiceFlags(nLocalServices | NODE_TXRECON);
+
     nMaxTipAge = gArgs.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     if (!InitNUParams())
@@ -1164,6 +1460,43 @@ bool AppInitParameterInteraction()
     return true;
 }
 
+static void LogInitPhase(const std::string& strName, int64_t nStart)
+{
+    LogPrintf("Startup phase %s: %dms\n", strName, GetTimeMillis() - nStart);
+}
+
+/**
+ * Run a part of the startup that doesn't need the block index on a thread of
+ * its own, while the block index loads. get() on the returned future waits for
+ * it and rethrows what it threw; the future waits for it when destroyed too.
+ */
+static std::future<void> StartInitTask(const std::string& strName, std::function<void()> func)
+{
+    return std::async(std::launch::async, [strName, func] {
+        util::ThreadRename("init-" + strName);
+        const int64_t nStart = GetTimeMillis();
+        func();
+        LogInitPhase(strName + " (in parallel)", nStart);
+    });
+}
+
+/** The levels 3 and 4 of the startup block checks, run once the node has started (-checkblocksbackground) */
+static void ThreadVerifyDB(int nCheckDepth)
+{
+    util::ThreadRename("dogecash-verifydb");
+    const int64_t nStart = GetTimeMillis();
+    fVerifyingBlocks = true;
+    const bool fVerified = CVerifyDB().VerifyDB(pcoinsTip, 4, nCheckDepth);
+    fVerifyingBlocks = false;
+    if (!fVerified) {
+        uiInterface.ThreadSafeMessageBox(_("Corrupted block database detected") + "\n" + _("Restart with -reindex to rebuild it."),
+                                         "", CClientUIInterface::MSG_ERROR);
+        StartShutdown();
+        return;
+    }
+    LogInitPhase("background block check", nStart);
+}
+
 static bool LockDataDirectory(bool probeOnly)
 {
     std::string strDataDir = GetDataDir().string();
@@ -1196,6 +1529,9 @@ bool AppInitSanityChecks()
     // ********************************************************* Step 4: sanity checks
 
     // Initialize elliptic curve code
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    LogPrintf("Using the '%s' AES implementation\n", AES256Implementation());
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1227,6 +1563,8 @@ bool AppInitMain()
             g_logger->ShrinkDebugFile();
         if (!g_logger->OpenDebugLog())
             return UIError(strprintf("Could not open debug log file %s", g_logger->m_file_path.string()));
+        if (gArgs.GetBoolArg("-logasync", DEFAULT_LOGASYNC))
+            g_logger->StartAsync();
     }
 #ifdef ENABLE_WALLET
     LogPrintf("Using BerkeleyDB version %s\n", DbEnv::version(0, 0, 0));
@@ -1240,11 +1578,22 @@ bool AppInitMain()
     std::ostringstream strErrors;
 
     InitSignatureCache();
+    // the signatures of the mempool saved with it, so that they are not checked again
+    if (gArgs.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        LoadSignatureCache();
+    InitScriptExecutionCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadSaplingProofCheck);
+            threadGroup.create_thread(&ThreadZerocoinSpendCheck);
+            threadGroup.create_thread(&ThreadCoinPrefetch);
+            threadGroup.create_thread(&ThreadBlockPreCheck);
+            threadGroup.create_thread(&ThreadTxPreCheck);
+            threadGroup.create_thread(&ThreadMasternodePreCheck);
+        }
     }
 
     if (gArgs.IsArgSet("-sporkkey")) // spork priv key
@@ -1253,9 +1602,14 @@ bool AppInitMain()
             return UIError(_("Unable to sign spork message, wrong key?"));
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads: one for the realtime lane only,
+    // so that the notifications don't wait behind the background tasks
+    CScheduler::Function realtimeLoop = std::bind(&CScheduler::serviceLanes, &scheduler, 1 << CScheduler::REALTIME);
+    threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", realtimeLoop));
     CScheduler::Function serviceLoop = std::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    for (int i = 0; i < DEFAULT_SCHEDULER_BACKGROUND_THREADS; i++) {
+        threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler-bg", serviceLoop));
+    }
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(mempool);
@@ -1396,8 +1750,11 @@ bool AppInitMain()
     g_connman = MakeUnique<CConnman>(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max()));
     CConnman& connman = *g_connman;
 
+    // Nothing reads the addresses before the node starts
+    std::future<void> addressesLoad = StartInitTask("peers", [&connman] { connman.LoadAddresses(); });
+
     peerLogic.reset(new PeerLogicValidation(&connman));
-    RegisterValidationInterface(peerLogic.get());
+    RegisterValidationInterface(peerLogic.get(), "net");
     RegisterNodeSignals(GetNodeSignals());
 
     // sanitize comments per BIP-0014, format user agent and check total size
@@ -1530,7 +1887,7 @@ bool AppInitMain()
     pzmqNotificationInterface = CZMQNotificationInterface::Create();
 
     if (pzmqNotificationInterface) {
-        RegisterValidationInterface(pzmqNotificationInterface);
+        RegisterValidationInterface(pzmqNotificationInterface, "zmq");
     }
 #endif
 
@@ -1540,26 +1897,69 @@ bool AppInitMain()
 
     // Create blocks directory if it doesn't already exist
     fs::create_directories(GetDataDir() / "blocks");
+    // preallocates and commits the block files in the background from now on
+    g_blockfileflusher.Start();
 
     // cache size calculations
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-    if (nBlockTreeDBCache > (1 << 21) && !gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
+    if (nBlockTreeDBCache > (1 << 21))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    const int nIndexes = (int)fAddressIndex + (int)fSpentIndex + (int)fTimestampIndex + (int)fBlockFilterIndex + (int)fCoinStatsIndex + (int)fBlockStatsIndex + (int)fTxIndex + (int)fCompactSaplingIndex;
+    int64_t nIndexCache = nIndexes > 0 ? std::min(nTotalCache / 8, nMaxIndexCache << 20) : 0;
+    nTotalCache -= nIndexCache;
+    int64_t nZerocoinDBCache = std::min(nTotalCache / 16, nMaxZerocoinDBCache << 20);
+    nTotalCache -= nZerocoinDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    int64_t nCacheRetain = std::max<int64_t>(0, std::min(gArgs.GetArg("-dbcacheretain", nDefaultDbCacheRetain), nMaxDbCacheRetain));
+    nCoinCacheRetainUsage = nCoinCacheUsage * nCacheRetain / 100;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nIndexes > 0) {
+        LogPrintf("* Using %.1fMiB for the address, spent, timestamp and block filter index databases\n", nIndexCache * (1.0 / 1024 / 1024));
+    }
+    LogPrintf("* Using %.1fMiB for zerocoin database\n", nZerocoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    LogPrintf("* Keeping %.1fMiB of the in-memory UTXO set when it is full\n", nCoinCacheRetainUsage * (1.0 / 1024 / 1024));
 
     const CChainParams& chainparams = Params();
     const Consensus::Params& consensus = chainparams.GetConsensus();
 
+    // The fee estimates and the tier two database don't depend on the block index
+    std::future<void> feeEstimatesLoad = StartInitTask("feeest", [] {
+        fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+        CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
+        // Allowed to fail as this file IS missing on first startup.
+        if (!est_filein.IsNull())
+            mempool.ReadFeeEstimates(est_filein);
+    });
+    bool fTierTwoDBNew = false;
+    std::future<void> tierTwoLoad = StartInitTask("tiertwo", [&fTierTwoDBNew] {
+        pTierTwoDB.reset(new CTierTwoDB(1 << 20));
+        const int nTierTwoDBVersion = pTierTwoDB->ReadVersion();
+        if (nTierTwoDBVersion != 0 && nTierTwoDBVersion != TIERTWO_DB_VERSION) {
+            LogPrintf("Tier two database version %d not supported - cached data discarded\n", nTierTwoDBVersion);
+            pTierTwoDB.reset();
+            pTierTwoDB.reset(new CTierTwoDB(1 << 20, false, true));
+        }
+        // the former dat files are only read once, to fill a new database
+        fTierTwoDBNew = (pTierTwoDB->ReadVersion() == 0);
+        if (fTierTwoDBNew) return;
+
+        if (!mnodeman.LoadFromDB(*pTierTwoDB))
+            LogPrintf("Error reading the masternode list from the tier two database - cached data discarded\n");
+        if (!masternodePayments.LoadFromDB(*pTierTwoDB))
+            LogPrintf("Error reading the masternode payments from the tier two database - cached data discarded\n");
+        if (!g_budgetman.LoadFromDB(*pTierTwoDB))
+            LogPrintf("Error reading the budgets from the tier two database - cached data discarded\n");
+    });
+
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
@@ -1571,6 +1971,7 @@ bool AppInitMain()
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsWriteBack;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -1578,7 +1979,7 @@ bool AppInitMain()
                 delete pSporkDB;
 
                 //DogeCash specific: zerocoin and spork DB's
-                zerocoinDB = new CZerocoinDB(0, false, fReindex);
+                zerocoinDB = new CZerocoinDB(nZerocoinDBCache, false, fReindex);
                 pSporkDB = new CSporkDB(0, false, false);
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
@@ -1594,9 +1995,17 @@ bool AppInitMain()
                 uiInterface.InitMessage(_("Loading sporks..."));
                 sporkManager.LoadSporksFromDB();
 
-                // LoadBlockIndex will load fTxIndex from the db, or set it if
-                // we're reindexing. It will also load fHavePruned if we've
-                // ever removed a block file from disk.
+                // DOGEC: the legacy zerocoin state, from a snapshot if one was (or is to be) loaded
+                InitZerocoinSnapshot(*zerocoinDB);
+                if (GetZerocoinSnapshotHeight() < 0 && gArgs.IsArgSet("-zerocoinsnapshot")) {
+                    uiInterface.InitMessage(_("Loading zerocoin snapshot..."));
+                    std::string strSnapshotError;
+                    if (!LoadZerocoinSnapshot(*zerocoinDB, AbsPathForConfigVal(gArgs.GetArg("-zerocoinsnapshot", "")), consensus.hashZerocoinSnapshot, strSnapshotError))
+                        return UIError(strprintf(_("Error loading the zerocoin snapshot: %s"), strSnapshotError));
+                }
+
+                // LoadBlockIndex will load fHavePruned if we've ever removed a
+                // block file from disk.
                 uiInterface.InitMessage(_("Loading block index..."));
                 std::string strBlockIndexError;
                 if (!LoadBlockIndex(strBlockIndexError)) {
@@ -1611,27 +2020,10 @@ bool AppInitMain()
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(consensus.hashGenesisBlock) == 0)
                     return UIError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
 
-                // Check for changed -txindex state
-                if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
-                    break;
-                }
-
-                // Check for changed -addressindex state
-                if (fAddressIndex != gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -addressindex");
-                    break;
-                }
-
-                // Check for changed -spentindex state
-                if (fSpentIndex != gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -spentindex");
-                    break;
-                }
-
-                // Check for changed -timestampindex state
-                if (fTimestampIndex != gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -timestampindex");
+                // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
+                // in the past, but is now trying to run unpruned.
+                if (fHavePruned && !fPruneMode) {
+                    strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
 
@@ -1665,7 +2057,8 @@ bool AppInitMain()
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsWriteBack = new CCoinsViewWriteBack(pcoinscatcher, pcoinsdbview);
+                pcoinsTip = new CCoinsViewCache(pcoinsWriteBack);
 
                 // !TODO: after enabling reindex-chainstate
                 // if (!fReindex && !fReindexChainState) {
@@ -1691,9 +2084,9 @@ bool AppInitMain()
                             break;
                         }
                         MoneySupply.Update(pcoinsTip->GetTotalAmount(), chainHeight);
-                        // No need to keep the invalid outs in memory. Clear the map 100 blocks after the last invalid UTXO
+                        // No need to look up the invalid outs anymore 100 blocks after the last invalid UTXO
                         if (chainHeight > consensus.height_last_invalid_UTXO + 100) {
-                            invalid_out::setInvalidOutPoints.clear();
+                            invalid_out::UnloadOutpoints();
                         }
                     } else {
                         // Populate list of invalid/fraudulent outpoints that are banned from the chain
@@ -1722,12 +2115,20 @@ bool AppInitMain()
                         }
                     }
 
-                    // Zerocoin must check at level 4
-                    if (!CVerifyDB().VerifyDB(pcoinsdbview, 4, gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
+                    // Zerocoin must check at level 4: in the background, if it's the blocks only here
+                    const int nCheckLevel = gArgs.GetBoolArg("-checkblocksbackground", DEFAULT_CHECKBLOCKS_BACKGROUND) ? 2 : 4;
+                    if (!CVerifyDB().VerifyDB(pcoinsWriteBack, nCheckLevel, gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
                         strLoadError = _("Corrupted block database detected");
                         fVerifyingBlocks = false;
                         break;
                     }
+
+                    // Before the first blocks are pruned
+                    if (!InitBudgetCollateralIndex()) {
+                        strLoadError = _("Error indexing the budget collaterals");
+                        fVerifyingBlocks = false;
+                        break;
+                    }
                 }
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
@@ -1738,7 +2139,7 @@ bool AppInitMain()
 
             fVerifyingBlocks = false;
             fLoaded = true;
-            LogPrintf(" block index %15dms\n", GetTimeMillis() - load_block_index_start_time);
+            LogInitPhase("block index", load_block_index_start_time);
         } while (false);
 
         if (!fLoaded && !ShutdownRequested()) {
@@ -1768,22 +2169,58 @@ bool AppInitMain()
         return false;
     }
 
-    fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-    CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
-    // Allowed to fail as this file IS missing on first startup.
-    if (!est_filein.IsNull())
-        mempool.ReadFeeEstimates(est_filein);
+    // The indexes catch up with the chain in the background, from the
+    // best block they've been synced with (or from the genesis block).
+    if (fAddressIndex) {
+        g_addressindex = MakeUnique<AddressIndex>(nIndexCache / nIndexes, false, fReindex);
+        g_addressindex->Start();
+    }
+    if (fSpentIndex) {
+        g_spentindex = MakeUnique<SpentIndex>(nIndexCache / nIndexes, false, fReindex);
+        g_spentindex->Start();
+    }
+    if (fTimestampIndex) {
+        g_timestampindex = MakeUnique<TimestampIndex>(nIndexCache / nIndexes, false, fReindex);
+        g_timestampindex->Start();
+    }
+    if (fBlockFilterIndex) {
+        g_blockfilterindex = MakeUnique<BlockFilterIndex>(BlockFilterType::BASIC, nIndexCache / nIndexes, false, fReindex);
+        g_blockfilterindex->Start();
+    }
+    if (fCoinStatsIndex) {
+        g_coin_stats_index = MakeUnique<CoinStatsIndex>(nIndexCache / nIndexes, false, fReindex);
+        g_coin_stats_index->Start();
+    }
+    if (fBlockStatsIndex) {
+        g_block_stats_index = MakeUnique<BlockStatsIndex>(nIndexCache / nIndexes, false, fReindex);
+        g_block_stats_index->Start();
+    }
+    if (fTxIndex) {
+        g_txindex = MakeUnique<TxIndex>(nIndexCache / nIndexes, false, fReindex);
+        g_txindex->Start();
+    }
+    if (fCompactSaplingIndex) {
+        g_compact_sapling_index = MakeUnique<CompactSaplingIndex>(nIndexCache / nIndexes, false, fReindex);
+        g_compact_sapling_index->Start();
+    }
+
+    feeEstimatesLoad.get();
     fFeeEstimatesInitialized = true;
 
 // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
+    const int64_t nWalletStart = GetTimeMillis();
     if (!CWallet::InitLoadWallet())
         return false;
+    LogInitPhase("wallet", nWalletStart);
 #else
     LogPrintf("No wallet compiled in!\n");
 #endif
     // ********************************************************* Step 9: import blocks
 
+    // The blocks connected from here on check the collaterals of the masternode list
+    tierTwoLoad.get();
+
     if (!CheckDiskSpace())
         return false;
 
@@ -1799,12 +2236,14 @@ bool AppInitMain()
         uiInterface.NotifyBlockTip.connect(BlockNotifyCallback);
 
     // scan for better chains in the block chain database, that are not yet connected in the active best chain
+    const int64_t nActivateStart = GetTimeMillis();
     CValidationState state;
     if (!ActivateBestChain(state)) {
         strErrors << "Failed to connect best block";
         StartShutdown();
         return false;
     }
+    LogInitPhase("best chain", nActivateStart);
     // update g_best_block if needed
     {
         LOCK(g_best_block_mutex);
@@ -1839,29 +2278,38 @@ bool AppInitMain()
 
     // ********************************************************* Step 10: setup layer 2 data
 
+    const int64_t nTierTwoStart = GetTimeMillis();
     uiInterface.InitMessage(_("Loading masternode cache..."));
 
-    mnodeman.SetBestHeight(nChainHeight);
-    LoadBlockHashesCache(mnodeman);
-    CMasternodeDB mndb;
-    CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman);
-    if (readResult == CMasternodeDB::FileError)
-        LogPrintf("Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrintf("Error reading mncache.dat - cached data discarded\n");
+    // the masternode list, payments and budgets were loaded with the block index, unless the tier two database is new
+    if (fTierTwoDBNew) {
+        CMasternodeDB mndb;
+        CMasternodeDB::ReadResult readResult = mndb.Read(mnodeman);
+        if (readResult == CMasternodeDB::FileError)
+            LogPrintf("Missing masternode cache file - mncache.dat, will try to recreate\n");
+        else if (readResult != CMasternodeDB::Ok) {
+            LogPrintf("Error reading mncache.dat - cached data discarded\n");
+        }
     }
 
     uiInterface.InitMessage(_("Loading budget cache..."));
 
-    CBudgetDB budgetdb;
-    const bool fDryRun = (nChainHeight <= 0);
-    if (!fDryRun) g_budgetman.SetBestHeight(nChainHeight);
-    CBudgetDB::ReadResult readResult2 = budgetdb.Read(g_budgetman, fDryRun);
+    // the budgets too, the expired ones are removed once the chain height is known
+    if (fTierTwoDBNew) {
+        CBudgetDB budgetdb;
+        CBudgetDB::ReadResult readResult2 = budgetdb.Read(g_budgetman);
 
-    if (readResult2 == CBudgetDB::FileError)
-        LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
-    else if (readResult2 != CBudgetDB::Ok) {
-        LogPrintf("Error reading budget.dat - cached data discarded\n");
+        if (readResult2 == CBudgetDB::FileError)
+            LogPrintf("Missing budget cache - budget.dat, will try to recreate\n");
+        else if (readResult2 != CBudgetDB::Ok) {
+            LogPrintf("Error reading budget.dat - cached data discarded\n");
+        }
+    }
+    if (nChainHeight > 0) {
+        g_budgetman.SetBestHeight(nChainHeight);
+        LogPrint(BCLog::MNBUDGET, "Budget manager - cleaning....\n");
+        g_budgetman.CheckAndRemove();
+        LogPrint(BCLog::MNBUDGET, "Budget manager - result: %s\n", g_budgetman.ToString());
     }
 
     //flag our cached items so we send them to our peers
@@ -1870,20 +2318,27 @@ bool AppInitMain()
 
     uiInterface.InitMessage(_("Loading masternode payment cache..."));
 
-    CMasternodePaymentDB mnpayments;
-    CMasternodePaymentDB::ReadResult readResult3 = mnpayments.Read(masternodePayments);
+    if (fTierTwoDBNew) {
+        CMasternodePaymentDB mnpayments;
+        CMasternodePaymentDB::ReadResult readResult3 = mnpayments.Read(masternodePayments);
 
-    if (readResult3 == CMasternodePaymentDB::FileError)
-        LogPrintf("Missing masternode payment cache - mnpayments.dat, will try to recreate\n");
-    else if (readResult3 != CMasternodePaymentDB::Ok) {
-        LogPrintf("Error reading mnpayments.dat - cached data discarded\n");
+        if (readResult3 == CMasternodePaymentDB::FileError)
+            LogPrintf("Missing masternode payment cache - mnpayments.dat, will try to recreate\n");
+        else if (readResult3 != CMasternodePaymentDB::Ok) {
+            LogPrintf("Error reading mnpayments.dat - cached data discarded\n");
+        }
+
+        DumpMasternodes();
+        DumpBudgets(g_budgetman);
+        DumpMasternodePayments();
+        pTierTwoDB->WriteVersion();
     }
 
     fMasterNode = gArgs.GetBoolArg("-masternode", DEFAULT_MASTERNODE);
 
     if ((fMasterNode || masternodeConfig.getCount() > -1) && fTxIndex == false) {
         return UIError("Enabling Masternode support requires turning on transaction indexing."
-                         "Please add txindex=1 to your configuration and start with -reindex");
+                         "Please add txindex=1 to your configuration");
     }
 
     if (fMasterNode) {
@@ -1920,6 +2375,7 @@ bool AppInitMain()
     LogPrintf("Budget Mode %s\n", strBudgetMode.c_str());
 
     threadGroup.create_thread(std::bind(&ThreadCheckMasternodes));
+    LogInitPhase("layer 2", nTierTwoStart);
 
     if (ShutdownRequested()) {
         LogPrintf("Shutdown requested. Exiting.\n");
@@ -1966,10 +2422,32 @@ bool AppInitMain()
     connOptions.uiInterface = &uiInterface;
     connOptions.nSendBufferMaxSize = 1000*gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.socketEventsMode = socketEventsMode;
+    connOptions.nMsgHandThreads = gArgs.GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS);
+
+    const uint64_t nMiB = 1024 * 1024;
+    connOptions.nMaxUploadTarget = std::max<int64_t>(0, gArgs.GetArg("-maxuploadtarget", DEFAULT_MAX_UPLOAD_TARGET)) * nMiB;
+    for (int i = 0; i < UPLOAD_OTHER; i++) {
+        const std::string strArg = "-maxupload" + GetUploadClassName(static_cast<UploadClass>(i));
+        connOptions.vUploadBudget[i] = std::max<int64_t>(0, gArgs.GetArg(strArg, DEFAULT_MAX_UPLOAD_BUDGET)) * nMiB;
+    }
 
+    addressesLoad.get();
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return UIError(strNodeError);
 
+    // Save the mempool in the background too, the shutdown then skips the dump if nothing changed since
+    const int64_t nMempoolDumpInterval = gArgs.GetArg("-mempooldumpinterval", DEFAULT_MEMPOOL_DUMP_INTERVAL);
+    if (gArgs.GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL) && nMempoolDumpInterval > 0) {
+        scheduler.scheduleEvery([] {
+            // don't overwrite the file with a partially loaded mempool
+            if (::mempool.IsLoaded()) DumpMempool(::mempool, true);
+        }, nMempoolDumpInterval * 60 * 1000);
+    }
+
+    // Compact the databases written by the block connections when the node is idle
+    scheduler.scheduleEvery(CompactDatabasesIfIdle, DB_COMPACTION_INTERVAL);
+
 #ifdef ENABLE_WALLET
     // Generate coins in the background
     if (pwalletMain)
@@ -1985,11 +2463,28 @@ bool AppInitMain()
 
         // StakeMiner thread disabled by default on regtest
         if (gArgs.GetBoolArg("-staking", !Params().IsRegTestNet() && DEFAULT_STAKING)) {
+            g_blocktemplatecache = MakeUnique<BlockTemplateCache>(chainparams);
+            RegisterValidationInterface(g_blocktemplatecache.get(), "blocktemplate");
+            g_stakerscheduler = MakeUnique<StakerScheduler>(pwalletMain);
+            RegisterValidationInterface(g_stakerscheduler.get(), "staker");
             threadGroup.create_thread(std::bind(&ThreadStakeMinter));
         }
+
+        int nShieldSendThreads = std::max(0, std::min((int)gArgs.GetArg("-shieldsendthreads", DEFAULT_SHIELDSEND_THREADS), MAX_SHIELDSEND_THREADS));
+        for (int i = 0; i < nShieldSendThreads; i++) {
+            threadGroup.create_thread(&ThreadShieldSend);
+        }
+
+        if (gArgs.GetBoolArg("-keypoolthread", DEFAULT_KEYPOOL_THREAD)) {
+            threadGroup.create_thread(&ThreadKeyPoolTopUp);
+        }
     }
 #endif
 
+    if (gArgs.GetBoolArg("-checkblocksbackground", DEFAULT_CHECKBLOCKS_BACKGROUND)) {
+        threadGroup.create_thread(std::bind(&ThreadVerifyDB, (int)gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS)));
+    }
+
     SetRPCWarmupFinished();
     uiInterface.InitMessage(_("Done loading"));
 
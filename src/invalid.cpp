@@ -5,60 +5,68 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "invalid.h"
-#include "invalid_outpoints.json.h"
 
 #include "primitives/transaction.h"
 
-#include <univalue.h>
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+
+struct InvalidOutPoint
+{
+    unsigned char hash[32];
+    uint32_t n;
+};
+
+#include "invalid_outpoints.h"
 
 namespace invalid_out
 {
-    std::set<COutPoint> setInvalidOutPoints;
+    static std::atomic<bool> fLoaded{false};
 
-    UniValue read_json(const std::string& jsondata)
+    static int Compare(const InvalidOutPoint& a, const COutPoint& b)
     {
-        UniValue v;
-
-        if (!v.read(jsondata) || !v.isArray())
-        {
-            return UniValue(UniValue::VARR);
+        // The order of uint256: from the most significant byte, the last one
+        const unsigned char* pb = b.hash.begin();
+        for (int i = sizeof(a.hash) - 1; i >= 0; i--) {
+            if (a.hash[i] != pb[i]) return a.hash[i] < pb[i] ? -1 : 1;
         }
-        return v.get_array();
+        return a.n < b.n ? -1 : (a.n > b.n ? 1 : 0);
     }
 
     bool LoadOutpoints()
     {
-        UniValue v = read_json(LoadInvalidOutPoints());
-
-        if (v.empty())
-            return false;
-
-        for (unsigned int idx = 0; idx < v.size(); idx++) {
-            const UniValue &val = v[idx];
-            const UniValue &o = val.get_obj();
-
-            const UniValue &vTxid = find_value(o, "txid");
-            if (!vTxid.isStr())
-                return false;
-
-            uint256 txid = uint256S(vTxid.get_str());
-            if (txid.IsNull())
-                return false;
+        fLoaded = true;
+        return true;
+    }
 
-            const UniValue &vN = find_value(o, "n");
-            if (!vN.isNum())
-                return false;
+    void UnloadOutpoints()
+    {
+        fLoaded = false;
+    }
 
-            auto n = static_cast<uint32_t>(vN.get_int());
-            COutPoint out(txid, n);
-            setInvalidOutPoints.insert(out);
+    std::vector<COutPoint> GetOutPoints()
+    {
+        std::vector<COutPoint> vOutPoints;
+        if (!fLoaded)
+            return vOutPoints;
+
+        vOutPoints.reserve(std::end(invalidOutPoints) - std::begin(invalidOutPoints));
+        for (const InvalidOutPoint& entry : invalidOutPoints) {
+            uint256 txid;
+            memcpy(txid.begin(), entry.hash, sizeof(entry.hash));
+            vOutPoints.emplace_back(txid, entry.n);
         }
-        return true;
+        return vOutPoints;
     }
 
     bool ContainsOutPoint(const COutPoint& out)
     {
-        return static_cast<bool>(setInvalidOutPoints.count(out));
+        if (!fLoaded)
+            return false;
+
+        const InvalidOutPoint* it = std::lower_bound(std::begin(invalidOutPoints), std::end(invalidOutPoints), out,
+                [](const InvalidOutPoint& entry, const COutPoint& o) { return Compare(entry, o) < 0; });
+        return it != std::end(invalidOutPoints) && Compare(*it, out) == 0;
     }
 }
-
@@ -9,20 +9,18 @@
 #ifndef DOGEC_INVALID_H
 #define DOGEC_INVALID_H
 
-#include <set>
-#include <string>
+#include <vector>
 
 class COutPoint;
-class UniValue;
 
 namespace invalid_out
 {
-    extern std::set<COutPoint> setInvalidOutPoints;
-
-    UniValue read_json(const std::string& jsondata);
-
     bool ContainsOutPoint(const COutPoint& out);
+    std::vector<COutPoint> GetOutPoints();
+
+    // The outpoints are compiled in: these only turn the lookups on and off
     bool LoadOutpoints();
+    void UnloadOutpoints();
 }
 
 #endif //DOGEC_INVALID_H
@@ -0,0 +1,49 @@
+#ifndef DOGEC_INVALID_OUTPOINTS_H
+#define DOGEC_INVALID_OUTPOINTS_H
+/**
+ * List of the invalid outpoints, that are banned from the chain
+ * AUTOGENERATED by contrib/devtools/gen-invalid-outpoints.py
+ *
+ * Each line contains the 32 bytes of a txid, as they are in a uint256, and an
+ * output index. The lines are sorted like COutPoints, so that they can be
+ * binary searched.
+ */
+static constexpr InvalidOutPoint invalidOutPoints[] = {
+    {{0x46,0x27,0xb5,0xb4,0xf0,0xc8,0x87,0x47,0x5d,0x4b,0xd8,0x68,0xf6,0x12,0xef,0xed,0x72,0x58,0x1d,0xae,0x8a,0x7b,0x76,0x4d,0xd3,0x8b,0x1e,0x01,0xa5,0xa0,0x57,0x03}, 1},
+    {{0x35,0x0e,0x13,0x26,0xf7,0xb6,0x23,0x99,0x33,0x34,0xa5,0xe1,0xa4,0x81,0x91,0x7c,0x89,0x1a,0xe2,0xd5,0x85,0xde,0x20,0xfe,0x2b,0x06,0xfa,0x01,0x97,0xa1,0x12,0x08}, 0},
+    {{0x22,0xc5,0xd8,0x50,0xbc,0xd1,0x6b,0xab,0x7d,0xfa,0xc0,0xd8,0x56,0xbb,0xb4,0xc1,0x8e,0x5d,0x36,0x07,0x9f,0x3f,0xa1,0x19,0x6c,0x73,0x96,0x5b,0x2c,0x9b,0x9b,0x19}, 1},
+    {{0x9a,0x86,0xf2,0x0c,0x69,0xf9,0x61,0x40,0x49,0x82,0x33,0xe4,0x6b,0x17,0x38,0x6c,0xfb,0x29,0x12,0xda,0xf6,0xed,0x1a,0x58,0x1e,0xac,0x31,0x0f,0xde,0xbd,0xa5,0x1b}, 1},
+    {{0x8f,0x33,0x51,0x3d,0x37,0x8f,0x04,0xf2,0xc3,0x9c,0xe3,0xa3,0x1e,0xce,0x9f,0xb0,0x6c,0x57,0x66,0x78,0x2e,0x15,0x30,0x67,0x0b,0x9b,0xda,0xdb,0x2f,0xd6,0x64,0x1c}, 1},
+    {{0xab,0xdd,0x6b,0x1a,0xbb,0x0d,0x0e,0xc0,0x76,0xf9,0xbb,0xb8,0xd9,0xe2,0x2b,0x52,0x0d,0x5e,0x31,0x98,0x8c,0x6c,0xcc,0xb2,0x77,0x9e,0x9a,0xd0,0x05,0x1c,0x3e,0x25}, 0},
+    {{0xdd,0x4c,0x6c,0x06,0x46,0x15,0xa4,0xc1,0xeb,0x0f,0xfa,0x96,0x46,0xe0,0x69,0x9f,0x0d,0x93,0xcc,0x90,0xd4,0xa3,0xe3,0x85,0x26,0x86,0xd3,0x4d,0x8d,0x5c,0xe5,0x2c}, 0},
+    {{0x43,0x34,0x05,0x57,0xd8,0xe0,0xc4,0xf0,0xf9,0x1a,0xd9,0x25,0x8c,0x62,0x4d,0xef,0xf3,0x2d,0x7f,0x63,0xed,0x74,0x09,0xc0,0xa3,0xec,0x64,0x01,0x16,0xc1,0x3b,0x35}, 1},
+    {{0x0a,0xdd,0xba,0x23,0x9f,0x10,0xf4,0x62,0x94,0x5c,0x4f,0x96,0x34,0x56,0x84,0xab,0x87,0xba,0x90,0x40,0xa2,0xb6,0xbf,0x13,0xf4,0xbc,0xb6,0x0b,0x8e,0x00,0xa4,0x38}, 1},
+    {{0xfd,0xcb,0x13,0xc8,0xf1,0x6e,0xe0,0x27,0x16,0x49,0x25,0xe6,0x4d,0x9f,0x1b,0x43,0xc4,0x74,0x63,0x27,0x2f,0xf4,0x60,0xb5,0x89,0xfa,0x20,0x23,0x8e,0x3b,0xe8,0x40}, 1},
+    {{0xf4,0xa0,0xd8,0x07,0x71,0xd0,0xa0,0x48,0x42,0xca,0x28,0xc8,0x43,0x13,0xfe,0xca,0x42,0xe6,0xa5,0x83,0x79,0xac,0x0f,0xc3,0x30,0xf7,0x22,0xe7,0xd0,0x59,0x97,0x43}, 1},
+    {{0x15,0x5e,0x8f,0xd6,0x51,0x31,0x87,0xf8,0x16,0x51,0x6e,0x8d,0xef,0x53,0x10,0x82,0xb7,0x2c,0x10,0x2d,0x76,0xd0,0xd6,0xde,0xed,0x25,0x76,0xee,0x1b,0x3e,0x81,0x52}, 1},
+    {{0x8c,0x29,0xc3,0x64,0xfd,0x18,0xf2,0x09,0x44,0xcd,0x97,0xc9,0x32,0xde,0x53,0xe7,0xf4,0x87,0xcc,0xa5,0x91,0x96,0xc1,0x92,0xa0,0xbd,0x06,0xd5,0x5d,0x66,0x95,0x6b}, 1},
+    {{0xb3,0xf6,0x5c,0xe3,0xbe,0x8d,0xc4,0x45,0x08,0xcf,0xbc,0x2e,0x68,0x47,0xea,0x29,0xa9,0xc4,0xdc,0xe9,0x83,0xfb,0x69,0x0c,0xb4,0x9c,0x10,0xe2,0xb8,0x6c,0x2a,0x70}, 0},
+    {{0x31,0x6a,0x0b,0xd9,0x4f,0x87,0x77,0x2c,0x35,0xa3,0x59,0x4c,0x63,0x67,0x68,0xf2,0xce,0x56,0xa6,0x13,0x71,0xf5,0xfc,0x4b,0xb8,0x40,0x65,0x74,0x31,0x73,0xdd,0x75}, 1},
+    {{0xa7,0x25,0x76,0xb7,0x4f,0xdb,0x9a,0xe9,0x0a,0x96,0x20,0x89,0x13,0x88,0xca,0x99,0x6d,0x3e,0x7f,0xdb,0xfc,0x82,0x29,0x79,0x8d,0xa8,0xb1,0xed,0x4e,0xd9,0xfd,0x75}, 1},
+    {{0x84,0x07,0x79,0x27,0x48,0x84,0x49,0x3e,0x70,0x85,0x7d,0x54,0xa5,0xe6,0x5c,0x87,0x71,0x71,0xd9,0xcd,0xac,0x98,0xb6,0x08,0x9f,0xbe,0x19,0x87,0xa1,0x8a,0x7d,0x79}, 1},
+    {{0x70,0x73,0x8d,0xda,0x50,0xc8,0x53,0x40,0x24,0x29,0x3b,0x7e,0x73,0x8f,0xe9,0xf6,0xae,0xc6,0xc4,0xe4,0x1d,0x57,0x3f,0xdd,0x7c,0x52,0x4e,0xd5,0x63,0x1d,0x76,0x86}, 1},
+    {{0xbd,0xd7,0x33,0x52,0x95,0x47,0x9a,0x02,0x66,0xf9,0x1c,0x5b,0x91,0x76,0x6c,0x37,0x87,0x9f,0xc6,0xc4,0x92,0xe3,0xec,0x72,0x6b,0x47,0xf1,0x96,0xc7,0xee,0xdc,0x8c}, 1},
+    {{0x24,0x32,0x3c,0xa1,0x84,0x3e,0x90,0x02,0x70,0x49,0xf0,0x66,0xd0,0x24,0x86,0xf1,0x4a,0x79,0x14,0xa4,0x9f,0x95,0x05,0x3b,0x10,0xd7,0x51,0x2d,0xd1,0x89,0x6e,0x8d}, 1},
+    {{0x56,0xc7,0x98,0xc4,0xb6,0x22,0xc9,0xf6,0x30,0x22,0xac,0x94,0xf9,0x1e,0xa8,0xe8,0x52,0x44,0x56,0xba,0xcb,0xc6,0x8c,0xff,0xbb,0x52,0xc5,0x93,0x78,0x61,0xdc,0x92}, 1},
+    {{0x85,0x23,0xd7,0x33,0x0b,0xda,0x83,0x5e,0xa9,0x2e,0x3f,0x75,0x46,0x61,0x5f,0xa0,0x62,0x69,0x60,0x5a,0x9a,0x24,0x86,0xfb,0x6b,0x9b,0x97,0xf2,0xc0,0x62,0xcb,0x9b}, 1},
+    {{0x5e,0xfd,0xad,0x5f,0xe1,0xc0,0x90,0x8e,0xd0,0xa9,0x43,0x1d,0x72,0x2b,0x1e,0x36,0x8b,0x96,0x3e,0xb4,0x1f,0x3e,0xa3,0x88,0xe4,0x37,0xa1,0x14,0x9d,0xc9,0x96,0xa6}, 1},
+    {{0xfe,0x2f,0x9d,0xd6,0xf1,0x61,0xab,0x92,0x3a,0x17,0xb3,0x87,0x6e,0x41,0x00,0x43,0xab,0x28,0x14,0x0e,0x92,0x53,0x91,0x27,0x07,0x1b,0x77,0xa9,0xba,0xaa,0x78,0xa9}, 1},
+    {{0xb1,0x4b,0x69,0xc5,0xcb,0xcf,0x6c,0xa4,0x58,0x0b,0xc1,0x0b,0x0a,0x75,0xf1,0xbd,0xf1,0x70,0x49,0xb5,0x00,0x58,0xe3,0xb5,0xd2,0x9b,0x27,0x2c,0xc1,0x3e,0xd2,0xb1}, 0},
+    {{0xd9,0x82,0xf0,0xdd,0x1d,0xa7,0xcb,0x35,0x87,0x2e,0xec,0xfd,0x35,0x57,0xc7,0xb2,0x1d,0xed,0x7b,0x65,0x88,0x82,0x90,0xd1,0x61,0x4c,0x35,0xc5,0x39,0xa2,0xf7,0xb9}, 1},
+    {{0x81,0x04,0x0a,0x58,0xf9,0x78,0x31,0x14,0xe9,0x07,0x1e,0x6c,0x7d,0x99,0xa4,0xe6,0xbf,0xd9,0x7d,0xcd,0xe4,0xf8,0x00,0x93,0xbc,0xba,0xd2,0x92,0x10,0x05,0xfa,0xbd}, 1},
+    {{0xe6,0x03,0x05,0x67,0xc4,0x57,0x99,0x70,0x40,0xc1,0xdf,0xbb,0x8c,0x16,0x8c,0x27,0x44,0x28,0x74,0xf8,0x50,0xf9,0xdc,0x07,0x3f,0x64,0x01,0x74,0x1f,0x39,0x6d,0xc2}, 1},
+    {{0x98,0x09,0x60,0xe1,0x22,0x62,0x9b,0x5e,0xa4,0xce,0x5b,0x1d,0x7c,0x6a,0x70,0x43,0x77,0xfe,0x85,0x3b,0x3d,0x41,0x69,0x8d,0xb5,0xb1,0xc4,0xfd,0x37,0x4f,0x9f,0xc6}, 1},
+    {{0xc3,0x5d,0xef,0x41,0x86,0x37,0x59,0xf3,0x8f,0x55,0x90,0x48,0xe7,0x54,0x62,0x00,0xcf,0x57,0x1f,0x0c,0xeb,0x08,0x75,0x22,0x5b,0xc1,0xef,0x46,0x56,0x5c,0x5e,0xc7}, 0},
+    {{0x80,0xf4,0x38,0x72,0xb3,0xfd,0x02,0xb5,0x46,0x48,0x41,0x4e,0x2f,0xd3,0xf3,0xb9,0xcb,0xfe,0xc1,0xa6,0x8d,0x0f,0xfc,0x94,0x3e,0xa0,0x95,0x7f,0x80,0x7d,0x8a,0xc8}, 1},
+    {{0xb3,0xaf,0x9a,0x5c,0x25,0xff,0x77,0x83,0x73,0xc3,0x7e,0x8a,0x10,0xb0,0x63,0x78,0xd7,0xaf,0x1e,0x5a,0x1e,0xd1,0xd9,0x7c,0x2f,0x8f,0x7a,0xad,0xeb,0x9d,0x1b,0xd0}, 1},
+    {{0x57,0xde,0xde,0x04,0x02,0x99,0x3a,0x3d,0x36,0x83,0x21,0x78,0xeb,0x24,0xb5,0xb7,0xe8,0xfd,0x93,0x1e,0x02,0x67,0x85,0x02,0x92,0xf1,0x2b,0xaf,0x13,0x5c,0x9b,0xd5}, 1},
+    {{0x41,0xb9,0xbd,0xa6,0x8d,0xb0,0xaa,0xaa,0x03,0x35,0x51,0x3f,0xd0,0xd1,0x36,0x6b,0xe5,0xbc,0x8d,0x33,0xa8,0x21,0x70,0xfa,0xbe,0x47,0x23,0x69,0x3d,0x3a,0x52,0xeb}, 1},
+    {{0xd9,0x33,0x46,0xa3,0x5e,0xb0,0x9a,0x7a,0x9c,0x7f,0xc8,0x73,0xf1,0x4a,0x48,0xa6,0x5f,0x31,0xad,0x6a,0xf5,0x9b,0xd7,0x10,0xcb,0x3e,0x93,0x96,0x7d,0x33,0x1d,0xf1}, 1},
+    {{0x37,0xde,0xa3,0xea,0xe1,0xa7,0xf7,0xd3,0x1e,0xdf,0x51,0x90,0x63,0x80,0x0e,0xf7,0xb1,0xf0,0xf0,0xf5,0x3c,0x1d,0x3a,0xc2,0x08,0x87,0x7e,0x1e,0x5e,0x7c,0xa2,0xf5}, 1},
+};
+#endif // DOGEC_INVALID_OUTPOINTS_H
@@ -1,160 +0,0 @@
-// Copyright (c) 2018 The PIVX developers
-// Distributed under the MIT software license, see the accompanying
-// file COPYING or http://www.opensource.org/licenses/mit-license.php.
-
-#ifndef DogeCash_INVALID_OUTPOINTS_JSON_H
-#define DogeCash_INVALID_OUTPOINTS_JSON_H
-#include <string>
-
-std::string LoadInvalidOutPoints()
-{
-    std::string str = "[\n"
-            "  {\n"
-            "    \"txid\": \"0357a0a5011e8bd34d767b8aae1d5872edef12f668d84b5d4787c8f0b4b52746\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"0812a19701fa062bfe20de85d5e21a897c9181a4e1a534339923b6f726130e35\",\n"
-            "    \"n\": 0\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"199b9b2c5b96736c19a13f9f07365d8ec1b4bb56d8c0fa7dab6bd1bc50d8c522\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"1ba5bdde0f31ac1e581aedf6da1229fb6c38176be43382494061f9690cf2869a\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"1c64d62fdbda9b0b6730152e7866576cb09fce1ea3e39cc3f2048f373d51338f\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"253e1c05d09a9e77b2cc6c8c98315e0d522be2d9b8bbf976c00e0dbb1a6bddab\",\n"
-            "    \"n\": 0\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"2ce55c8d4dd3862685e3a3d490cc930d9f69e04696fa0febc1a41546066c4cdd\",\n"
-            "    \"n\": 0\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"353bc1160164eca3c00974ed637f2df3ef4d628c25d91af9f0c4e0d857053443\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"38a4008e0bb6bcf413bfb6a24090ba87ab845634964f5c9462f4109f23badd0a\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"40e83b8e2320fa89b560f42f276374c4431b9f4de625491627e06ef1c813cbfd\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"439759d0e722f730c30fac7983a5e642cafe1343c828ca4248a0d07107d8a0f4\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"52813e1bee7625edded6d0762d102cb7821053ef8d6e5116f8873151d68f5e15\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"6b95665dd506bda092c19691a5cc87f4e753de32c997cd4409f218fd64c3298c\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"702a6cb8e2109cb40c69fb83e9dcc4a929ea47682ebccf0845c48dbee35cf6b3\",\n"
-            "    \"n\": 0\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"75dd7331746540b84bfcf57113a656cef26867634c59a3352c77874fd90b6a31\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"75fdd94eedb1a88d792982fcdb7f3e6d99ca88138920960ae99adb4fb77625a7\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"797d8aa18719be9f08b698accdd97171875ce6a5547d85703e49844827790784\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"86761d63d54e527cdd3f571de4c4c6aef6e98f737e3b29244053c850da8d7370\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"8cdceec796f1476b72ece392c4c69f87376c76915b1cf966029a47955233d7bd\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"8d6e89d12d51d7103b05959fa414794af18624d066f0497002903e84a13c3224\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"92dc617893c552bbff8cc6cbba564452e8a81ef994ac2230f6c922b6c498c756\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"9bcb62c0f2979b6bfb86249a5a606962a05f6146753f2ea95e83da0b33d72385\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"a696c99d14a137e488a33e1fb43e968b361e2b721d43a9d08e90c0e15fadfd5e\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"a978aabaa9771b07279153920e1428ab4300416e87b3173a92ab61f1d69d2ffe\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"b1d23ec12c279bd2b5e35800b54970f1bdf1750a0bc10b58a46ccfcbc5694bb1\",\n"
-            "    \"n\": 0\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"b9f7a239c5354c61d1908288657bed1db2c75735fdec2e8735cba71dddf082d9\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"bdfa051092d2babc9300f8e4cd7dd9bfe6a4997d6c1e07e9143178f9580a0481\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"c26d391f7401643f07dcf950f8742844278c168cbbdfc140709957c4670503e6\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"c69f4f37fdc4b1b58d69413d3b85fe7743706a7c1d5bcea45e9b6222e1600998\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"c75e5c5646efc15b227508eb0c1f57cf006254e74890558ff359378641ef5dc3\",\n"
-            "    \"n\": 0\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"c88a7d807f95a03e94fc0f8da6c1fecbb9f3d32f4e414846b502fdb37238f480\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"d01b9debad7a8f2f7cd9d11e5a1eafd77863b0108a7ec3738377ff255c9aafb3\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"d59b5c13af2bf192028567021e93fde8b7b524eb782183363d3a990204dede57\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"eb523a3d692347befa7021a8338dbce56b36d1d03f513503aaaab08da6bdb941\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"f11d337d96933ecb10d79bf56aad315fa6484af173c87f9c7a9ab05ea34633d9\",\n"
-            "    \"n\": 1\n"
-            "  },\n"
-            "  {\n"
-            "    \"txid\": \"f5a27c5e1e7e8708c23a1d3cf5f0f0b1f70e80639051df1ed3f7a7e1eaa3de37\",\n"
-            "    \"n\": 1\n"
-            "  }\n"
-            "]";
-    return str;
-}
-
-#endif //DogeCash_INVALID_OUTPOINTS_JSON_H
@@ -9,6 +9,7 @@
 
 #include "kernel.h"
 
+#include "crypto/common.h"
 #include "db.h"
 #include "legacy/stakemodifier.h"
 #include "policy/policy.h"
@@ -83,6 +84,55 @@ bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
     return res;
 }
 
+CStakeKernelSearch::CStakeKernelSearch(const CBlockIndex* const pindexPrev, unsigned int nBits, int nTimeTx):
+    pindexPrev(pindexPrev),
+    nTime(nTimeTx)
+{
+    assert(IsSupported(pindexPrev));
+    const uint256& nStakeModifier = pindexPrev->GetStakeModifierV2();
+    hasherModifier.Write(nStakeModifier.begin(), nStakeModifier.size());
+    bnTarget.SetCompact(nBits);
+}
+
+bool CStakeKernelSearch::IsSupported(const CBlockIndex* pindexPrev)
+{
+    return Params().GetConsensus().NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_V3_4);
+}
+
+// Return stake kernel hash, as serialized by CStakeKernel::GetHash
+uint256 CStakeKernelSearch::GetHash(const COutPoint& outpointFrom, int nTimeBlockFrom) const
+{
+    // nTimeBlockFrom, the uniqueness (n and hash of the outpoint) and nTime
+    unsigned char buf[4 + 4 + 32 + 4];
+    WriteLE32(buf, nTimeBlockFrom);
+    WriteLE32(buf + 4, outpointFrom.n);
+    memcpy(buf + 8, outpointFrom.hash.begin(), 32);
+    WriteLE32(buf + 40, nTime);
+
+    uint256 hash;
+    CSHA256(hasherModifier).Write(buf, sizeof(buf)).Finalize(hash.begin());
+    CSHA256().Write(hash.begin(), CSHA256::OUTPUT_SIZE).Finalize(hash.begin());
+    return hash;
+}
+
+bool CStakeKernelSearch::CheckKernelHash(const COutPoint& outpointFrom, int nTimeBlockFrom, CAmount nValue) const
+{
+    // Weighted target, the product being truncated to 256 bits like in CStakeKernel
+    uint256 bnWeightedTarget(bnTarget);
+    const uint64_t nWeight = (uint64_t) nValue / 100;
+    if (nWeight <= std::numeric_limits<uint32_t>::max())
+        bnWeightedTarget *= (uint32_t) nWeight;
+    else
+        bnWeightedTarget *= uint256(nWeight);
+
+    return GetHash(outpointFrom, nTimeBlockFrom) < bnWeightedTarget;
+}
+
+int64_t GetStakeTime()
+{
+    return Params().IsRegTestNet() ? GetAdjustedTime() : GetCurrentTimeSlot();
+}
+
 
 /*
  * PoS Validation
@@ -110,7 +160,7 @@ bool LoadStakeInput(const CBlock& block, const CBlockIndex* pindexPrev, std::uni
     const CTxIn& txin = block.vtx[1]->vin[0];
     stake = txin.IsZerocoinSpend() ?
             std::unique_ptr<CStakeInput>(new CLegacyzdogecStake()) :
-            std::unique_ptr<CStakeInput>(CDogeCashStake::NewDogeCashStake(txin));
+            std::unique_ptr<CStakeInput>(CDogeCashStake::NewDogeCashStake(txin, pindexPrev));
 
     return stake && stake->InitFromTxIn(txin);
 }
@@ -132,7 +182,7 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
 
     // Get the new time slot (and verify it's not the same as previous block)
     const bool fRegTest = Params().IsRegTestNet();
-    nTimeTx = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
+    nTimeTx = GetStakeTime();
     if (nTimeTx <= pindexPrev->nTime && !fRegTest) return false;
 
     // Verify Proof Of Stake
@@ -150,25 +200,12 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
  *                              (if nullptr, it will be searched in mapBlockIndex)
  * @return      bool            true if the block has a valid proof of stake
  */
-bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockIndex* pindexPrev)
+// Check the kernel hash and the coinstake input signature of a block
+static bool CheckStakeKernelAndSig(const CBlock& block, const CBlockIndex* pindexPrev, CStakeInput* stakeInput, std::string& strError, bool fSkipLog = false)
 {
-    const int nHeight = pindexPrev->nHeight + 1;
-    // Initialize stake input
-    std::unique_ptr<CStakeInput> stakeInput;
-    if (!LoadStakeInput(block, pindexPrev, stakeInput)) {
-        strError = "stake input initialization failed";
-        return false;
-    }
-
-    // Stake input contextual checks
-    if (!stakeInput->ContextCheck(nHeight, block.nTime)) {
-        strError = "stake input failing contextual checks";
-        return false;
-    }
-
     // Verify Proof Of Stake
-    CStakeKernel stakeKernel(pindexPrev, stakeInput.get(), block.nBits, block.nTime);
-    if (!stakeKernel.CheckKernelHash()) {
+    CStakeKernel stakeKernel(pindexPrev, stakeInput, block.nBits, block.nTime);
+    if (!stakeKernel.CheckKernelHash(fSkipLog)) {
         strError = "kernel hash check fails";
         return false;
     }
@@ -195,6 +232,59 @@ bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockI
     return true;
 }
 
+bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockIndex* pindexPrev)
+{
+    // Already verified by PreCheckProofOfStake, with the same parent (the block
+    // hash commits to it): valid as long as the stake input is in the active chain.
+    if (!block.hashStakeFromPreChecked.IsNull()) {
+        BlockMap::const_iterator mi = mapBlockIndex.find(block.hashStakeFromPreChecked);
+        if (mi != mapBlockIndex.end() && chainActive.Contains(mi->second))
+            return true;
+    }
+
+    const int nHeight = pindexPrev->nHeight + 1;
+    // Initialize stake input
+    std::unique_ptr<CStakeInput> stakeInput;
+    if (!LoadStakeInput(block, pindexPrev, stakeInput)) {
+        strError = "stake input initialization failed";
+        return false;
+    }
+
+    // Stake input contextual checks
+    if (!stakeInput->ContextCheck(nHeight, block.nTime)) {
+        strError = "stake input failing contextual checks";
+        return false;
+    }
+
+    return CheckStakeKernelAndSig(block, pindexPrev, stakeInput.get(), strError);
+}
+
+void PreCheckProofOfStake(const CBlock& block)
+{
+    if (!block.IsProofOfStake() || block.vtx[1]->vin.empty() || block.vtx[1]->vin[0].IsZerocoinSpend())
+        return;
+
+    const CBlockIndex* pindexPrev = nullptr;
+    std::unique_ptr<CStakeInput> stakeInput;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(block.hashPrevBlock);
+        if (mi == mapBlockIndex.end())
+            return;
+        pindexPrev = mi->second;
+        // The legacy modifier depends on the active chain past the stake input
+        const int nHeight = pindexPrev->nHeight + 1;
+        if (!Params().GetConsensus().NetworkUpgradeActive(nHeight, Consensus::UPGRADE_V3_4))
+            return;
+        if (!LoadStakeInput(block, pindexPrev, stakeInput) || !stakeInput->ContextCheck(nHeight, block.nTime))
+            return;
+    }
+
+    std::string strError;
+    if (CheckStakeKernelAndSig(block, pindexPrev, stakeInput.get(), strError, true))
+        block.hashStakeFromPreChecked = stakeInput->GetIndexFrom()->GetBlockHash();
+}
+
 
 /*
  * GetStakeKernelHash   Return stake kernel of a block
@@ -10,6 +10,7 @@
 #ifndef DOGEC_KERNEL_H
 #define DOGEC_KERNEL_H
 
+#include "crypto/sha256.h"
 #include "stakeinput.h"
 
 class CStakeKernel {
@@ -41,6 +42,50 @@ private:
     CAmount stakeValue{0};     // target multiplier
 };
 
+/*
+ * CStakeKernelSearch   Kernel search of a staker over its coins, for a given
+ *                      parent block and time slot: the stake modifier is hashed
+ *                      and the target decoded once, then the kernel of each
+ *                      candidate is hashed from its outpoint and block time,
+ *                      without any allocation nor stake input.
+ *                      Same hash and target as CStakeKernel, with the modifier v2.
+ */
+class CStakeKernelSearch {
+public:
+    /**
+     * CStakeKernelSearch Constructor
+     *
+     * @param[in]   pindexPrev      index of the parent of the kernel block
+     * @param[in]   nBits           target difficulty bits of the kernel block
+     * @param[in]   nTimeTx         time of the kernel block
+     */
+    CStakeKernelSearch(const CBlockIndex* const pindexPrev, unsigned int nBits, int nTimeTx);
+
+    // Whether the kernels on top of pindexPrev use the modifier v2, as required by the search
+    static bool IsSupported(const CBlockIndex* pindexPrev);
+
+    // Return the stake kernel hash of a candidate
+    uint256 GetHash(const COutPoint& outpointFrom, int nTimeBlockFrom) const;
+
+    // Check that the kernel hash of a candidate meets its weighted target
+    bool CheckKernelHash(const COutPoint& outpointFrom, int nTimeBlockFrom, CAmount nValue) const;
+
+    const CBlockIndex* GetPrev() const { return pindexPrev; }
+    int GetTime() const { return nTime; }
+
+private:
+    const CBlockIndex* pindexPrev;
+    CSHA256 hasherModifier;    // with the stake modifier written
+    int nTime;
+    uint256 bnTarget;          // target of nBits, before the weighting by the stake value
+};
+
+/*
+ * GetStakeTime         Return the time of the block being staked now: the current
+ *                      time slot (the adjusted time on regtest)
+ */
+int64_t GetStakeTime();
+
 /* PoS Validation */
 
 /*
@@ -65,6 +110,19 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
  */
 bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockIndex* pindexPrev = nullptr);
 
+/*
+ * PreCheckProofOfStake Verify the proof of stake of a block ahead of AcceptBlock
+ *                      (on the block pre-check workers). cs_main is held only to
+ *                      load the stake input: the kernel hash and the coinstake
+ *                      signature are checked without it. Only a valid proof is
+ *                      recorded in the block, CheckProofOfStake does the full
+ *                      check otherwise. Skipped for the legacy modifier blocks
+ *                      and the zerocoin stakes, or if the parent is unknown.
+ *
+ * @param[in]   block           block with the proof being verified
+ */
+void PreCheckProofOfStake(const CBlock& block);
+
 /*
  * GetStakeKernelHash   Return stake kernel of a block
  *
@@ -10,6 +10,8 @@
 #include "legacy/stakemodifier.h"
 #include "validation.h"   // mapBlockIndex, chainActive
 
+#include <unordered_map>
+
 /*
  * Old Modifier - Only for IBD
  */
@@ -17,6 +19,16 @@
 static const unsigned int MODIFIER_INTERVAL = 60;
 static const int MODIFIER_INTERVAL_RATIO = 3;
 static const int64_t OLD_MODIFIER_INTERVAL = 2087;
+// Max entries of the kernel modifier cache before it's cleared
+static const size_t MAX_OLD_MODIFIER_CACHE_SIZE = 100000;
+
+// A candidate block for the modifier selection, with its selection hash
+struct ModifierCandidate
+{
+    int64_t nTime;
+    const CBlockIndex* pindex;
+    uint256 hashSelection;
+};
 
 // Get selection interval section (in seconds)
 static int64_t GetStakeModifierSelectionIntervalSection(int nSection)
@@ -27,61 +39,32 @@ static int64_t GetStakeModifierSelectionIntervalSection(int nSection)
 }
 
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
-// already selected blocks in vSelectedBlocks, and with timestamp up to
+// already selected blocks in setSelectedBlocks, and with timestamp up to
 // nSelectionIntervalStop.
 static bool SelectBlockFromCandidates(
-    std::vector<std::pair<int64_t, uint256> >& vSortedByTimestamp,
-    std::map<uint256, const CBlockIndex*>& mapSelectedBlocks,
+    const std::vector<ModifierCandidate>& vSortedByTimestamp,
+    const std::set<const CBlockIndex*>& setSelectedBlocks,
     int64_t nSelectionIntervalStop,
-    uint64_t nStakeModifierPrev,
     const CBlockIndex** pindexSelected)
 {
-    bool fModifierV2 = false;
-    bool fFirstRun = true;
     bool fSelected = false;
     uint256 hashBest;
     *pindexSelected = (const CBlockIndex*)0;
     for (const auto& item : vSortedByTimestamp) {
-        if (!mapBlockIndex.count(item.second))
-            return error("%s : failed to find block index for candidate block %s", __func__, item.second.ToString().c_str());
-
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
-        if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
+        const CBlockIndex* pindex = item.pindex;
+        if (fSelected && item.nTime > nSelectionIntervalStop)
             break;
 
-        //if the lowest block height (vSortedByTimestamp[0]) is >= switch height, use new modifier calc
-        if (fFirstRun){
-            fModifierV2 = Params().GetConsensus().NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_POS_V2);
-            fFirstRun = false;
-        }
-
-        if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
+        if (setSelectedBlocks.count(pindex) > 0)
             continue;
 
-        // compute the selection hash by hashing an input that is unique to that block
-        uint256 hashProof;
-        if(fModifierV2)
-            hashProof = pindex->GetBlockHash();
-        else
-            hashProof = pindex->IsProofOfStake() ? UINT256_ZERO : pindex->GetBlockHash();
-
-        CDataStream ss(SER_GETHASH, 0);
-        ss << hashProof << nStakeModifierPrev;
-        uint256 hashSelection = Hash(ss.begin(), ss.end());
-
-        // the selection hash is divided by 2**32 so that proof-of-stake block
-        // is always favored over proof-of-work block. this is to preserve
-        // the energy efficiency property
-        if (pindex->IsProofOfStake())
-            hashSelection >>= 32;
-
-        if (fSelected && hashSelection < hashBest) {
-            hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*)pindex;
+        if (fSelected && item.hashSelection < hashBest) {
+            hashBest = item.hashSelection;
+            *pindexSelected = pindex;
         } else if (!fSelected) {
             fSelected = true;
-            hashBest = hashSelection;
-            *pindexSelected = (const CBlockIndex*)pindex;
+            hashBest = item.hashSelection;
+            *pindexSelected = pindex;
         }
     }
     if (gArgs.GetBoolArg("-printstakemodifier", false))
@@ -89,10 +72,29 @@ static bool SelectBlockFromCandidates(
     return fSelected;
 }
 
+// Kernel modifiers found by GetOldModifier: hash of the block from -> (height, hash)
+// of the block holding the modifier. The result depends only on the active chain
+// between the two, so it holds as long as the second one is in the active chain.
+// Blocks are referred by hash, as the block index can be unloaded.
+static Mutex cs_oldModifierCache;
+static std::unordered_map<uint256, std::pair<int, uint256>, BlockHasher> mapOldModifierCache;
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier)
 {
+    {
+        LOCK(cs_oldModifierCache);
+        const auto it = mapOldModifierCache.find(pindexFrom->GetBlockHash());
+        if (it != mapOldModifierCache.end()) {
+            const CBlockIndex* pindexModifier = chainActive[it->second.first];
+            if (pindexModifier && pindexModifier->GetBlockHash() == it->second.second) {
+                nStakeModifier = pindexModifier->GetStakeModifierV1();
+                return true;
+            }
+        }
+    }
+
     int64_t nStakeModifierTime = pindexFrom->GetBlockTime();
     const CBlockIndex* pindex = pindexFrom;
     CBlockIndex* pindexNext = chainActive[pindex->nHeight + 1];
@@ -109,6 +111,10 @@ bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier)
     } while (nStakeModifierTime < pindexFrom->GetBlockTime() + OLD_MODIFIER_INTERVAL);
 
     nStakeModifier = pindex->GetStakeModifierV1();
+
+    LOCK(cs_oldModifierCache);
+    if (mapOldModifierCache.size() >= MAX_OLD_MODIFIER_CACHE_SIZE) mapOldModifierCache.clear();
+    mapOldModifierCache[pindexFrom->GetBlockHash()] = std::make_pair(pindex->nHeight, pindex->GetBlockHash());
     return true;
 }
 
@@ -178,38 +184,65 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     if (nModifierTime / MODIFIER_INTERVAL >= pindexPrev->GetBlockTime() / MODIFIER_INTERVAL)
         return true;
 
-    // Sort candidate blocks by timestamp
-    std::vector<std::pair<int64_t, uint256> > vSortedByTimestamp;
+    // Sort candidate blocks by timestamp (then by hash)
+    std::vector<ModifierCandidate> vSortedByTimestamp;
     vSortedByTimestamp.reserve(64 * MODIFIER_INTERVAL  / Params().GetConsensus().nTargetSpacing);
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / MODIFIER_INTERVAL ) * MODIFIER_INTERVAL  - OLD_MODIFIER_INTERVAL;
     const CBlockIndex* pindex = pindexPrev;
 
     while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart) {
-        vSortedByTimestamp.emplace_back(pindex->GetBlockTime(), pindex->GetBlockHash());
+        vSortedByTimestamp.push_back({pindex->GetBlockTime(), pindex, UINT256_ZERO});
         pindex = pindex->pprev;
     }
 
     int nHeightFirstCandidate = pindex ? (pindex->nHeight + 1) : 0;
     std::reverse(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
-    std::sort(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
+    std::sort(vSortedByTimestamp.begin(), vSortedByTimestamp.end(),
+              [](const ModifierCandidate& a, const ModifierCandidate& b) {
+                  if (a.nTime != b.nTime) return a.nTime < b.nTime;
+                  return a.pindex->GetBlockHash() < b.pindex->GetBlockHash();
+              });
+
+    // The selection hashes don't change between the rounds: compute them once.
+    // If the lowest block height (vSortedByTimestamp[0]) is >= switch height, use new modifier calc
+    const bool fModifierV2 = !vSortedByTimestamp.empty() &&
+            Params().GetConsensus().NetworkUpgradeActive(vSortedByTimestamp[0].pindex->nHeight, Consensus::UPGRADE_POS_V2);
+    for (auto& item : vSortedByTimestamp) {
+        // compute the selection hash by hashing an input that is unique to that block
+        uint256 hashProof;
+        if (fModifierV2)
+            hashProof = item.pindex->GetBlockHash();
+        else
+            hashProof = item.pindex->IsProofOfStake() ? UINT256_ZERO : item.pindex->GetBlockHash();
+
+        CDataStream ss(SER_GETHASH, 0);
+        ss << hashProof << nStakeModifier;
+        item.hashSelection = Hash(ss.begin(), ss.end());
+
+        // the selection hash is divided by 2**32 so that proof-of-stake block
+        // is always favored over proof-of-work block. this is to preserve
+        // the energy efficiency property
+        if (item.pindex->IsProofOfStake())
+            item.hashSelection >>= 32;
+    }
 
     // Select 64 blocks from candidate blocks to generate stake modifier
     uint64_t nStakeModifierNew = 0;
     int64_t nSelectionIntervalStop = nSelectionIntervalStart;
-    std::map<uint256, const CBlockIndex*> mapSelectedBlocks;
+    std::set<const CBlockIndex*> setSelectedBlocks;
     for (int nRound = 0; nRound < std::min(64, (int)vSortedByTimestamp.size()); nRound++) {
         // add an interval section to the current selection round
         nSelectionIntervalStop += GetStakeModifierSelectionIntervalSection(nRound);
 
         // select a block from the candidates of current round
-        if (!SelectBlockFromCandidates(vSortedByTimestamp, mapSelectedBlocks, nSelectionIntervalStop, nStakeModifier, &pindex))
+        if (!SelectBlockFromCandidates(vSortedByTimestamp, setSelectedBlocks, nSelectionIntervalStop, &pindex))
             return error("%s : unable to select block at round %d", __func__, nRound);
 
         // write the entropy bit of the selected block
         nStakeModifierNew |= (((uint64_t)pindex->GetStakeEntropyBit()) << nRound);
 
         // add the selected block from candidates to selected list
-        mapSelectedBlocks.emplace(pindex->GetBlockHash(), pindex);
+        setSelectedBlocks.emplace(pindex);
         if (gArgs.GetBoolArg("-printstakemodifier", false))
             LogPrintf("%s : selected round %d stop=%s height=%d bit=%d\n", __func__,
                 nRound, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nSelectionIntervalStop).c_str(), pindex->nHeight, pindex->GetStakeEntropyBit());
@@ -227,10 +260,10 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
                 strSelectionMap.replace(pindex->nHeight - nHeightFirstCandidate, 1, "=");
             pindex = pindex->pprev;
         }
-        for (const std::pair<const uint256, const CBlockIndex*> &item : mapSelectedBlocks) {
+        for (const CBlockIndex* pindexSelected : setSelectedBlocks) {
             // 'S' indicates selected proof-of-stake blocks
             // 'W' indicates selected proof-of-work blocks
-            strSelectionMap.replace(item.second->nHeight - nHeightFirstCandidate, 1, item.second->IsProofOfStake() ? "S" : "W");
+            strSelectionMap.replace(pindexSelected->nHeight - nHeightFirstCandidate, 1, pindexSelected->IsProofOfStake() ? "S" : "W");
         }
         LogPrintf("%s : selection height [%d, %d] map %s\n", __func__, nHeightFirstCandidate, pindexPrev->nHeight, strSelectionMap.c_str());
     }
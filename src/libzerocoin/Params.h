@@ -175,6 +175,10 @@ public:
 	ZerocoinParams(CBigNum accumulatorModulus,
 	       uint32_t securityLevel = ZEROCOIN_DEFAULT_SECURITYLEVEL);
 
+	/** @brief Uninitialized parameters, to be deserialized
+	**/
+	ZerocoinParams();
+
 	bool initialized;
 
 	AccumulatorAndProofParams accumulatorParams;
@@ -8,8 +8,14 @@
 
 #include "chainparamsbase.h"
 #include "logging.h"
+#include "util/threadnames.h"
 #include "utiltime.h"
 
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <thread>
+
 
 const char * const DEFAULT_DEBUGLOGFILE = "debug.log";
 
@@ -36,6 +42,89 @@ static int FileWriteStr(const std::string &str, FILE *fp)
     return fwrite(str.data(), 1, str.size(), fp);
 }
 
+//! The most the background writer writes at once
+static const size_t LOG_ASYNC_BATCH_SIZE = 1 << 20;
+
+/**
+ * A bounded queue of messages without locks, for any number of producers and one consumer
+ * (the bounded queue of Dmitry Vyukov): each cell holds the position it can be pushed at,
+ * then the position after it once it holds a message, to be popped.
+ */
+struct BCLog::Logger::AsyncBuffer
+{
+    struct Cell {
+        std::atomic<size_t> nSequence;
+        std::string str;
+    };
+    std::unique_ptr<Cell[]> cells;
+    const size_t nMask;
+    std::atomic<size_t> nPushPos{0};
+    //! Written by the consumer only
+    std::atomic<size_t> nPopPos{0};
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    //! The writer waits: the producers wake it up
+    std::atomic<bool> fIdle{false};
+    bool fStop{false};
+    std::thread thread;
+
+    explicit AsyncBuffer(size_t nSize) : cells(new Cell[nSize]), nMask(nSize - 1)
+    {
+        assert((nSize & nMask) == 0);
+        for (size_t i = 0; i < nSize; i++) {
+            cells[i].nSequence = i;
+        }
+    }
+
+    bool Push(const std::string& str)
+    {
+        size_t nPos = nPushPos.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells[nPos & nMask];
+            const size_t nSequence = cell->nSequence.load(std::memory_order_acquire);
+            const intptr_t nDiff = (intptr_t)nSequence - (intptr_t)nPos;
+            if (nDiff == 0) {
+                if (nPushPos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (nDiff < 0) {
+                // full
+                return false;
+            } else {
+                nPos = nPushPos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->str = str;
+        cell->nSequence.store(nPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(std::string& str)
+    {
+        const size_t nPos = nPopPos.load(std::memory_order_relaxed);
+        Cell& cell = cells[nPos & nMask];
+        if (cell.nSequence.load(std::memory_order_acquire) != nPos + 1)
+            return false;
+        str = std::move(cell.str);
+        cell.str.clear();
+        cell.nSequence.store(nPos + nMask + 1, std::memory_order_release);
+        nPopPos.store(nPos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Empty() const
+    {
+        const size_t nPos = nPopPos.load(std::memory_order_relaxed);
+        return cells[nPos & nMask].nSequence.load(std::memory_order_acquire) != nPos + 1;
+    }
+};
+
+BCLog::Logger::~Logger()
+{
+    StopAsync();
+}
+
 bool BCLog::Logger::OpenDebugLog()
 {
     std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
@@ -208,6 +297,17 @@ void BCLog::Logger::LogPrintStr(const std::string &str)
     }
 
     if (m_print_to_file) {
+        AsyncBuffer* async = m_async.load();
+        if (async) {
+            if (!async->Push(strTimestamped)) {
+                m_async_dropped++;
+            } else if (async->fIdle) {
+                std::lock_guard<std::mutex> lock(async->mutex);
+                async->cond.notify_one();
+            }
+            return;
+        }
+
         std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
 
         // buffer if we haven't opened the log yet
@@ -215,21 +315,98 @@ void BCLog::Logger::LogPrintStr(const std::string &str)
             m_msgs_before_open.push_back(strTimestamped);
 
         } else {
-            // reopen the log file, if requested
-            if (m_reopen_file) {
-                m_reopen_file = false;
-                FILE* new_fileout = fsbridge::fopen(m_file_path, "a");
-                if (new_fileout) {
-                    setbuf(new_fileout, nullptr); // unbuffered
-                    fclose(m_fileout);
-                    m_fileout = new_fileout;
-                }
-            }
-            FileWriteStr(strTimestamped, m_fileout);
+            FileWriteStrLocked(strTimestamped);
         }
     }
 }
 
+void BCLog::Logger::FileWriteStrLocked(const std::string& str)
+{
+    // reopen the log file, if requested
+    if (m_reopen_file) {
+        m_reopen_file = false;
+        FILE* new_fileout = fsbridge::fopen(m_file_path, "a");
+        if (new_fileout) {
+            setbuf(new_fileout, nullptr); // unbuffered
+            fclose(m_fileout);
+            m_fileout = new_fileout;
+        }
+    }
+    FileWriteStr(str, m_fileout);
+}
+
+void BCLog::Logger::AsyncWriterThread(AsyncBuffer& buffer)
+{
+    util::ThreadRename("dogecash-logger");
+    std::string strBatch;
+    std::string str;
+    uint64_t nDroppedWritten = m_async_dropped;
+    while (true) {
+        // Read before the buffer is emptied: the messages queued before StopAsync are written
+        bool fStop;
+        {
+            std::lock_guard<std::mutex> lock(buffer.mutex);
+            fStop = buffer.fStop;
+        }
+        strBatch.clear();
+        while (strBatch.size() < LOG_ASYNC_BATCH_SIZE && buffer.Pop(str)) {
+            strBatch += str;
+        }
+        const uint64_t nDropped = m_async_dropped;
+        if (nDropped != nDroppedWritten) {
+            strBatch += strprintf("%s%u log messages dropped: the log buffer was full\n",
+                m_log_timestamps ? DateTimeStrFormat("%Y-%m-%d %H:%M:%S ", GetTime()) : "", nDropped - nDroppedWritten);
+            nDroppedWritten = nDropped;
+        }
+        if (!strBatch.empty()) {
+            // One write for many messages
+            std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
+            FileWriteStrLocked(strBatch);
+            continue;
+        }
+        if (fStop) return;
+
+        std::unique_lock<std::mutex> lock(buffer.mutex);
+        buffer.fIdle = true;
+        // A producer that missed fIdle is caught by the timeout
+        if (!buffer.fStop && buffer.Empty()) {
+            buffer.cond.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        buffer.fIdle = false;
+    }
+}
+
+void BCLog::Logger::StartAsync()
+{
+    if (m_async.load()) return;
+    {
+        std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
+        if (m_fileout == nullptr) return;
+    }
+    // Never freed, like the logger: a thread may still hold it after StopAsync
+    AsyncBuffer* async = new AsyncBuffer(LOG_ASYNC_BUFFER_SIZE);
+    async->thread = std::thread(&BCLog::Logger::AsyncWriterThread, this, std::ref(*async));
+    m_async = async;
+}
+
+void BCLog::Logger::StopAsync()
+{
+    AsyncBuffer* async = m_async.exchange(nullptr);
+    if (!async) return;
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        async->fStop = true;
+    }
+    async->cond.notify_one();
+    async->thread.join();
+    // The messages queued by the threads that saw m_async just before it was reset
+    std::string str;
+    std::lock_guard<std::mutex> scoped_lock(m_file_mutex);
+    while (async->Pop(str)) {
+        FileWriteStrLocked(str);
+    }
+}
+
 void BCLog::Logger::ShrinkDebugFile()
 {
     // Amount of debug.log to save at end when shrinking (must fit in memory)
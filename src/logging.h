@@ -26,6 +26,9 @@
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+static const bool DEFAULT_LOGASYNC      = false;
+//! The messages the debug log buffers in asynchronous mode (a power of 2), before it drops them
+static const size_t LOG_ASYNC_BUFFER_SIZE = 1 << 16;
 extern const char * const DEFAULT_DEBUGLOGFILE;
 
 extern bool fLogIPs;
@@ -77,6 +80,15 @@ namespace BCLog {
         std::mutex m_file_mutex;
         std::list<std::string> m_msgs_before_open;
 
+        struct AsyncBuffer;
+        //! Set while the messages are written to the file by a background thread
+        std::atomic<AsyncBuffer*> m_async{nullptr};
+        std::atomic<uint64_t> m_async_dropped{0};
+
+        /** Write to the file, reopening it first if requested. m_file_mutex must be held. */
+        void FileWriteStrLocked(const std::string& str);
+        void AsyncWriterThread(AsyncBuffer& buffer);
+
         /**
          * m_started_new_line is a state variable that will suppress printing of
          * the timestamp when multiple calls are made that don't end in a
@@ -90,6 +102,8 @@ namespace BCLog {
         std::string LogTimestampStr(const std::string& str);
 
     public:
+        ~Logger();
+
         bool m_print_to_console = false;
         bool m_print_to_file = false;
 
@@ -108,6 +122,18 @@ namespace BCLog {
         bool OpenDebugLog();
         void ShrinkDebugFile();
 
+        /**
+         * Write the debug log from a background thread: the callers only format their
+         * messages and queue them, without lock, into a buffer of LOG_ASYNC_BUFFER_SIZE
+         * messages. When it is full, the messages are dropped and counted. The messages
+         * still queued are lost if the process crashes.
+         */
+        void StartAsync();
+        /** Write the messages queued, and go back to writing them on the calling threads */
+        void StopAsync();
+        /** The messages dropped because the buffer was full, since the start */
+        uint64_t GetAsyncDropped() const { return m_async_dropped.load(); }
+
         uint32_t GetCategoryMask() const { return m_categories.load(); }
 
         void EnableCategory(LogFlags flag);
@@ -16,6 +16,7 @@
 #include "net_processing.h"
 #include "spork.h"
 #include "sync.h"
+#include "tiertwodb.h"
 #include "util.h"
 #include "utilmoneystr.h"
 
@@ -39,38 +40,6 @@ CMasternodePaymentDB::CMasternodePaymentDB()
     strMagicMessage = "MasternodePayments";
 }
 
-bool CMasternodePaymentDB::Write(const CMasternodePayments& objToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << MNPAYMENTS_DB_VERSION;
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathDB, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    fileout.fclose();
-
-    LogPrint(BCLog::MASTERNODE,"Written info to mnpayments.dat  %dms\n", GetTimeMillis() - nStart);
-
-    return true;
-}
-
 CMasternodePaymentDB::ReadResult CMasternodePaymentDB::Read(CMasternodePayments& objToLoad)
 {
     int64_t nStart = GetTimeMillis();
@@ -204,11 +173,11 @@ void CMasternodePaymentWinner::Relay()
 
 void DumpMasternodePayments()
 {
+    if (!pTierTwoDB) return;
     int64_t nStart = GetTimeMillis();
 
-    CMasternodePaymentDB paymentdb;
-    LogPrint(BCLog::MASTERNODE,"Writing info to mnpayments.dat...\n");
-    paymentdb.Write(masternodePayments);
+    LogPrint(BCLog::MASTERNODE,"Writing the masternode payment changes to the tier two database...\n");
+    masternodePayments.FlushToDB(*pTierTwoDB);
 
     LogPrint(BCLog::MASTERNODE,"Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
@@ -411,6 +380,12 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
 
         int nCountNeeded;
         vRecv >> nCountNeeded;
+        Optional<CBloomFilter> filter;
+        if (!ReadSyncFilter(vRecv, filter)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 100);
+            return;
+        }
 
         if (Params().NetworkIDString() == CBaseChainParams::MAIN) {
             if (pfrom->HasFulfilledRequest(NetMsgType::GETMNWINNERS)) {
@@ -422,7 +397,7 @@ void CMasternodePayments::ProcessMessageMasternodePayments(CNode* pfrom, std::st
         }
 
         pfrom->FulfilledRequest(NetMsgType::GETMNWINNERS);
-        masternodePayments.Sync(pfrom, nCountNeeded);
+        masternodePayments.Sync(pfrom, nCountNeeded, filter.get_ptr());
         LogPrint(BCLog::MASTERNODE, "mnget - Sent Masternode winners to peer %i\n", pfrom->GetId());
     } else if (strCommand == NetMsgType::MNWINNER) { //Masternode Payments Declare Winner
         //this is required in litemodef
@@ -536,57 +511,50 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         }
 
         mapMasternodePayeeVotes[winnerIn.GetHash()] = winnerIn;
-
-        if (!mapMasternodeBlocks.count(winnerIn.nBlockHeight)) {
-            CMasternodeBlockPayees blockPayees(winnerIn.nBlockHeight);
-            mapMasternodeBlocks[winnerIn.nBlockHeight] = blockPayees;
-        }
+        setChangedVotes.emplace(winnerIn.GetHash());
+        AddVoteToBlock(winnerIn.GetHash(), winnerIn);
     }
 
-    mapMasternodeBlocks[winnerIn.nBlockHeight].AddPayee(winnerIn.payee, 1);
-
     return true;
 }
 
+void CMasternodePayments::AddVoteToBlock(const uint256& hash, const CMasternodePaymentWinner& winner)
+{
+    AssertLockHeld(cs_mapMasternodeBlocks);
+    auto it = mapMasternodeBlocks.find(winner.nBlockHeight);
+    if (it == mapMasternodeBlocks.end())
+        it = mapMasternodeBlocks.emplace(winner.nBlockHeight, CMasternodeBlockPayees(winner.nBlockHeight)).first;
+    it->second.AddPayee(winner.payee, 1);
+    mapVoteHashesByHeight[winner.nBlockHeight].push_back(hash);
+}
+
 bool CMasternodeBlockPayees::IsTransactionValid(const CTransaction& txNew)
 {
     LOCK(cs_vecPayments);
 
-    //require at least 6 signatures
-    int nMaxSignatures = 0;
-    for (CMasternodePayee& payee : vecPayments)
-        if (payee.nVotes >= nMaxSignatures && payee.nVotes >= MNPAYMENTS_SIGNATURES_REQUIRED)
-            nMaxSignatures = payee.nVotes;
-
     // if we don't have at least 6 signatures on a payee, approve whichever is the longest chain
-    if (nMaxSignatures < MNPAYMENTS_SIGNATURES_REQUIRED) return true;
+    if (vecRequiredPayees.empty()) return true;
 
-    std::string strPayeesPossible = "";
     CAmount requiredMasternodePayment = GetMasternodePayment(nBlockHeight);
 
-    for (CMasternodePayee& payee : vecPayments) {
-        bool found = false;
-        for (CTxOut out : txNew.vout) {
-            if (payee.scriptPubKey == out.scriptPubKey) {
-                if(out.nValue == requiredMasternodePayment)
-                    found = true;
-                else
-                    LogPrintf("%s : Masternode payment value (%s) different from required value (%s).\n",
-                            __func__, FormatMoney(out.nValue).c_str(), FormatMoney(requiredMasternodePayment).c_str());
-            }
-        }
-
-        if (payee.nVotes >= MNPAYMENTS_SIGNATURES_REQUIRED) {
-            if (found) return true;
+    // the payees were selected as the votes came, only the outputs are left to compare
+    for (const CTxOut& out : txNew.vout) {
+        if (std::find(vecRequiredPayees.begin(), vecRequiredPayees.end(), out.scriptPubKey) == vecRequiredPayees.end())
+            continue;
+        if (out.nValue == requiredMasternodePayment) return true;
+        LogPrintf("%s : Masternode payment value (%s) different from required value (%s).\n",
+                __func__, FormatMoney(out.nValue).c_str(), FormatMoney(requiredMasternodePayment).c_str());
+    }
 
-            CTxDestination address1;
-            ExtractDestination(payee.scriptPubKey, address1);
+    std::string strPayeesPossible = "";
+    for (const CScript& payee : vecRequiredPayees) {
+        CTxDestination address1;
+        ExtractDestination(payee, address1);
 
-            if (strPayeesPossible != "")
-                strPayeesPossible += ",";
+        if (strPayeesPossible != "")
+            strPayeesPossible += ",";
 
-            strPayeesPossible += EncodeDestination(address1);
-        }
+        strPayeesPossible += EncodeDestination(address1);
     }
 
     LogPrint(BCLog::MASTERNODE,"CMasternodePayments::IsTransactionValid - Missing required payment of %s to %s\n", FormatMoney(requiredMasternodePayment).c_str(), strPayeesPossible.c_str());
@@ -640,19 +608,92 @@ void CMasternodePayments::CleanPaymentList(int mnCount, int nHeight)
     //keep up to five cycles for historical sake
     int nLimit = std::max(int(mnCount * 1.25), 1000);
 
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
+    // the oldest heights come first, only the ones to remove are visited
+    auto it = mapVoteHashesByHeight.begin();
+    while (it != mapVoteHashesByHeight.end() && nHeight - it->first > nLimit) {
+        LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing %d old Masternode payments - block %d\n", it->second.size(), it->first);
+        for (const uint256& hash : it->second) {
+            masternodeSync.mapSeenSyncMNW.erase(hash);
+            setChangedVotes.emplace(hash);
+            mapMasternodePayeeVotes.erase(hash);
+        }
+        it = mapVoteHashesByHeight.erase(it);
+    }
+    auto itBlock = mapMasternodeBlocks.begin();
+    while (itBlock != mapMasternodeBlocks.end() && nHeight - itBlock->first > nLimit)
+        itBlock = mapMasternodeBlocks.erase(itBlock);
+}
 
-        if (nHeight - winner.nBlockHeight > nLimit) {
-            LogPrint(BCLog::MASTERNODE, "CMasternodePayments::CleanPaymentList - Removing old Masternode payment - block %d\n", winner.nBlockHeight);
-            masternodeSync.mapSeenSyncMNW.erase((*it).first);
-            mapMasternodePayeeVotes.erase(it++);
-            mapMasternodeBlocks.erase(winner.nBlockHeight);
-        } else {
-            ++it;
+void CMasternodePayments::Clear()
+{
+    LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
+    for (const auto& it : mapMasternodePayeeVotes) setChangedVotes.emplace(it.first);
+    mapMasternodeBlocks.clear();
+    mapMasternodePayeeVotes.clear();
+    mapVoteHashesByHeight.clear();
+}
+
+void CMasternodePayments::RebuildHeightIndex()
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+    mapVoteHashesByHeight.clear();
+    for (const auto& it : mapMasternodePayeeVotes)
+        mapVoteHashesByHeight[it.second.nBlockHeight].push_back(it.first);
+}
+
+bool CMasternodePayments::LoadFromDB(CTierTwoDB& db)
+{
+    int64_t nStart = GetTimeMillis();
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+    pcursor->Seek(DB_TIERTWO_PAYMENT_VOTE);
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIERTWO_PAYMENT_VOTE) break;
+        CMasternodePaymentWinner winner;
+        if (!pcursor->GetValue(winner)) {
+            Clear();
+            setChangedVotes.clear();
+            return error("%s : failed to read payment vote %s", __func__, key.second.ToString());
         }
+        // the block payees are the sums of the votes
+        AddVoteToBlock(key.second, winner);
+        mapMasternodePayeeVotes.emplace(key.second, winner);
+        pcursor->Next();
     }
+
+    LogPrint(BCLog::MASTERNODE, "Loaded %d masternode payment votes from the tier two database %dms\n", mapMasternodePayeeVotes.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CMasternodePayments::FlushToDB(CTierTwoDB& db)
+{
+    std::set<uint256> setChanged;
+    CDBBatch batch;
+    size_t nWritten = 0;
+    {
+        LOCK(cs_mapMasternodePayeeVotes);
+        setChanged.swap(setChangedVotes);
+        for (const uint256& hash : setChanged) {
+            const auto it = mapMasternodePayeeVotes.find(hash);
+            if (it != mapMasternodePayeeVotes.end()) {
+                batch.Write(std::make_pair(DB_TIERTWO_PAYMENT_VOTE, hash), it->second);
+                nWritten++;
+            } else {
+                batch.Erase(std::make_pair(DB_TIERTWO_PAYMENT_VOTE, hash));
+            }
+        }
+    }
+
+    if (!db.WriteBatch(batch, true)) {
+        // keep them for the next flush
+        LOCK(cs_mapMasternodePayeeVotes);
+        setChangedVotes.insert(setChanged.begin(), setChanged.end());
+        return error("%s : failed to write %d payment vote changes", __func__, setChanged.size());
+    }
+    LogPrint(BCLog::MASTERNODE, "Flushed %d masternode payment votes, erased %d\n", nWritten, setChanged.size() - nWritten);
+    return true;
 }
 
 bool CMasternodePayments::ProcessBlock(int nBlockHeight)
@@ -722,7 +763,7 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight)
     return false;
 }
 
-void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
+void CMasternodePayments::Sync(CNode* node, int nCountNeeded, const CBloomFilter* pfilter)
 {
     LOCK(cs_mapMasternodePayeeVotes);
 
@@ -731,18 +772,29 @@ void CMasternodePayments::Sync(CNode* node, int nCountNeeded)
     if (nCountNeeded > nCount) nCountNeeded = nCount;
 
     int nInvCount = 0;
-    std::map<uint256, CMasternodePaymentWinner>::iterator it = mapMasternodePayeeVotes.begin();
-    while (it != mapMasternodePayeeVotes.end()) {
-        CMasternodePaymentWinner winner = (*it).second;
-        if (winner.nBlockHeight >= nHeight - nCountNeeded && winner.nBlockHeight <= nHeight + 20) {
-            node->PushInventory(CInv(MSG_MASTERNODE_WINNER, winner.GetHash()));
+    auto it = mapVoteHashesByHeight.lower_bound(nHeight - nCountNeeded);
+    for (; it != mapVoteHashesByHeight.end() && it->first <= nHeight + 20; ++it) {
+        for (const uint256& hash : it->second) {
+            if (!pfilter || !pfilter->contains(hash)) node->PushInventory(CInv(MSG_MASTERNODE_WINNER, hash));
             nInvCount++;
         }
-        ++it;
     }
     g_connman->PushMessage(node, CNetMsgMaker(node->GetSendVersion()).Make(NetMsgType::SYNCSTATUSCOUNT, MASTERNODE_SYNC_MNW, nInvCount));
 }
 
+std::vector<uint256> CMasternodePayments::GetSyncHashes(int nCountNeeded) const
+{
+    LOCK(cs_mapMasternodePayeeVotes);
+
+    std::vector<uint256> vHashes;
+    int nHeight = mnodeman.GetBestHeight();
+    auto it = mapVoteHashesByHeight.lower_bound(nHeight - nCountNeeded);
+    for (; it != mapVoteHashesByHeight.end(); ++it) {
+        vHashes.insert(vHashes.end(), it->second.begin(), it->second.end());
+    }
+    return vHashes;
+}
+
 std::string CMasternodePayments::ToString() const
 {
     std::ostringstream info;
@@ -751,3 +803,15 @@ std::string CMasternodePayments::ToString() const
 
     return info.str();
 }
+
+size_t CMasternodePayments::DynamicMemoryUsage() const
+{
+    LOCK2(cs_mapMasternodePayeeVotes, cs_mapMasternodeBlocks);
+    size_t nUsage = memusage::DynamicUsage(mapMasternodePayeeVotes) + memusage::DynamicUsage(mapMasternodesLastVote);
+    for (const auto& it : mapMasternodePayeeVotes) nUsage += it.second.DynamicMemoryUsage();
+    nUsage += memusage::DynamicUsage(mapMasternodeBlocks);
+    for (const auto& it : mapMasternodeBlocks) nUsage += it.second.DynamicMemoryUsage();
+    nUsage += memusage::DynamicUsage(setChangedVotes) + memusage::DynamicUsage(mapVoteHashesByHeight);
+    for (const auto& it : mapVoteHashesByHeight) nUsage += memusage::DynamicUsage(it.second);
+    return nUsage;
+}
@@ -19,6 +19,7 @@ extern RecursiveMutex cs_mapMasternodePayeeVotes;
 class CMasternodePayments;
 class CMasternodePaymentWinner;
 class CMasternodeBlockPayees;
+class CTierTwoDB;
 
 extern CMasternodePayments masternodePayments;
 
@@ -33,7 +34,7 @@ void FillBlockPayee(CMutableTransaction& txNew, const int nHeight, bool fProofOf
 
 void DumpMasternodePayments();
 
-/** Save Masternode Payment Data (mnpayments.dat)
+/** Former Masternode Payment Data (mnpayments.dat), read once to fill the tier two database
  */
 class CMasternodePaymentDB
 {
@@ -53,7 +54,6 @@ public:
     };
 
     CMasternodePaymentDB();
-    bool Write(const CMasternodePayments& objToSave);
     ReadResult Read(CMasternodePayments& objToLoad);
 };
 
@@ -83,6 +83,8 @@ public:
         READWRITE(*(CScriptBase*)(&scriptPubKey));
         READWRITE(nVotes);
     }
+
+    size_t DynamicMemoryUsage() const { return scriptPubKey.DynamicMemoryUsage(); }
 };
 
 // Keep track of votes for payees from masternodes
@@ -91,6 +93,8 @@ class CMasternodeBlockPayees
 public:
     int nBlockHeight;
     std::vector<CMasternodePayee> vecPayments;
+    // Memory only. The payees with the required votes, one of which the block has to pay
+    std::vector<CScript> vecRequiredPayees;
 
     CMasternodeBlockPayees()
     {
@@ -109,6 +113,8 @@ public:
 
         for (CMasternodePayee& payee : vecPayments) {
             if (payee.scriptPubKey == payeeIn) {
+                if (payee.nVotes < MNPAYMENTS_SIGNATURES_REQUIRED && payee.nVotes + nIncrement >= MNPAYMENTS_SIGNATURES_REQUIRED)
+                    vecRequiredPayees.push_back(payeeIn);
                 payee.nVotes += nIncrement;
                 return;
             }
@@ -116,6 +122,7 @@ public:
 
         CMasternodePayee c(payeeIn, nIncrement);
         vecPayments.push_back(c);
+        if (nIncrement >= MNPAYMENTS_SIGNATURES_REQUIRED) vecRequiredPayees.push_back(payeeIn);
     }
 
     bool GetPayee(CScript& payee)
@@ -144,9 +151,27 @@ public:
         return false;
     }
 
+    std::vector<CScript> GetPayeesWithVotes(int nVotesReq)
+    {
+        LOCK(cs_vecPayments);
+
+        std::vector<CScript> vPayees;
+        for (CMasternodePayee& p : vecPayments) {
+            if (p.nVotes >= nVotesReq) vPayees.push_back(p.scriptPubKey);
+        }
+
+        return vPayees;
+    }
+
     bool IsTransactionValid(const CTransaction& txNew);
     std::string GetRequiredPaymentsString();
 
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs_vecPayments);
+        return memusage::RecursiveDynamicUsage(vecPayments) + memusage::RecursiveDynamicUsage(vecRequiredPayees);
+    }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -154,6 +179,11 @@ public:
     {
         READWRITE(nBlockHeight);
         READWRITE(vecPayments);
+        if (ser_action.ForRead()) {
+            vecRequiredPayees.clear();
+            for (const CMasternodePayee& payee : vecPayments)
+                if (payee.nVotes >= MNPAYMENTS_SIGNATURES_REQUIRED) vecRequiredPayees.push_back(payee.scriptPubKey);
+        }
     }
 };
 
@@ -194,6 +224,11 @@ public:
         payee = payeeIn;
     }
 
+    size_t DynamicMemoryUsage() const
+    {
+        return CSignedMessage::DynamicMemoryUsage() + vinMasternode.DynamicMemoryUsage() + payee.DynamicMemoryUsage();
+    }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -231,6 +266,15 @@ class CMasternodePayments
 {
 private:
     int nLastBlockHeight;
+    // Memory Only. The votes added or removed since the last FlushToDB
+    std::set<uint256> setChangedVotes;
+    // Memory Only. The hashes of mapMasternodePayeeVotes by block height, pruned from the oldest height
+    std::map<int, std::vector<uint256>> mapVoteHashesByHeight;
+
+    // Add a new vote to its block payees and to the height index
+    void AddVoteToBlock(const uint256& hash, const CMasternodePaymentWinner& winner);
+    // Rebuild mapVoteHashesByHeight from mapMasternodePayeeVotes
+    void RebuildHeightIndex();
 
 public:
     std::map<uint256, CMasternodePaymentWinner> mapMasternodePayeeVotes;
@@ -242,17 +286,20 @@ public:
         nLastBlockHeight = 0;
     }
 
-    void Clear()
-    {
-        LOCK2(cs_mapMasternodeBlocks, cs_mapMasternodePayeeVotes);
-        mapMasternodeBlocks.clear();
-        mapMasternodePayeeVotes.clear();
-    }
+    void Clear();
+
+    /// Load the payment votes saved in the tier two database
+    bool LoadFromDB(CTierTwoDB& db);
+    /// Write the votes added or removed since the last flush to the tier two database
+    bool FlushToDB(CTierTwoDB& db);
 
     bool AddWinningMasternode(CMasternodePaymentWinner& winner);
     bool ProcessBlock(int nBlockHeight);
 
-    void Sync(CNode* node, int nCountNeeded);
+    // announces the votes of the last nCountNeeded blocks, except the ones matching pfilter (known by the peer)
+    void Sync(CNode* node, int nCountNeeded, const CBloomFilter* pfilter = nullptr);
+    // hashes of the votes of the last nCountNeeded blocks (known items filter of the sync request)
+    std::vector<uint256> GetSyncHashes(int nCountNeeded) const;
     void CleanPaymentList(int mnCount, int nHeight);
 
     bool GetBlockPayee(int nBlockHeight, CScript& payee);
@@ -280,6 +327,9 @@ public:
     void FillBlockPayee(CMutableTransaction& txNew, const int nHeight, bool fProofOfStake);
     std::string ToString() const;
 
+    /// Memory used by the votes and the block payees
+    size_t DynamicMemoryUsage() const;
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -287,6 +337,10 @@ public:
     {
         READWRITE(mapMasternodePayeeVotes);
         READWRITE(mapMasternodeBlocks);
+        if (ser_action.ForRead()) {
+            for (const auto& it : mapMasternodePayeeVotes) setChangedVotes.emplace(it.first);
+            RebuildHeightIndex();
+        }
     }
 };
 
@@ -14,6 +14,7 @@
 #include "masternodeman.h"
 #include "netmessagemaker.h"
 #include "spork.h"
+#include "random.h"
 #include "util.h"
 #include "addrman.h"
 // clang-format on
@@ -21,6 +22,29 @@
 class CMasternodeSync;
 CMasternodeSync masternodeSync;
 
+Optional<CBloomFilter> MakeSyncFilter(const std::vector<uint256>& vKnownHashes)
+{
+    if (vKnownHashes.empty()) return nullopt;
+    const size_t nElements = std::min(vKnownHashes.size(), (size_t)MASTERNODE_SYNC_FILTER_MAX_ELEMENTS);
+    CBloomFilter filter(nElements, MASTERNODE_SYNC_FILTER_FPRATE, GetRand(std::numeric_limits<unsigned int>::max()), BLOOM_UPDATE_NONE);
+    for (size_t i = 0; i < nElements; i++) {
+        filter.insert(vKnownHashes[i]);
+    }
+    return filter;
+}
+
+bool ReadSyncFilter(CDataStream& vRecv, Optional<CBloomFilter>& filter)
+{
+    // requests from older peers don't carry a filter
+    if (vRecv.empty()) return true;
+    CBloomFilter tmpFilter;
+    vRecv >> tmpFilter;
+    if (!tmpFilter.IsWithinSizeConstraints()) return false;
+    tmpFilter.UpdateEmptyFull();
+    filter = tmpFilter;
+    return true;
+}
+
 CMasternodeSync::CMasternodeSync()
 {
     Reset();
@@ -107,6 +131,7 @@ void CMasternodeSync::Reset()
     countBudgetItemFin = 0;
     RequestedMasternodeAssets = MASTERNODE_SYNC_INITIAL;
     RequestedMasternodeAttempt = 0;
+    nStepRequests = 0;
     nAssetSyncStarted = GetTime();
 }
 
@@ -218,27 +243,35 @@ void CMasternodeSync::ProcessMessage(CNode* pfrom, std::string& strCommand, CDat
 
         if (RequestedMasternodeAssets >= MASTERNODE_SYNC_FINISHED) return;
 
+        // the peer may have skipped the items we already have (sync filter):
+        // a non-zero count means that the peer has the same items, count it as progress.
+        const bool fHasItems = nCount > 0;
+
         //this means we will receive no further communication
         switch (nItemID) {
         case (MASTERNODE_SYNC_LIST):
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeList += nCount;
             countMasternodeList++;
+            if (fHasItems) lastMasternodeList = GetTime();
             break;
         case (MASTERNODE_SYNC_MNW):
             if (nItemID != RequestedMasternodeAssets) return;
             sumMasternodeWinner += nCount;
             countMasternodeWinner++;
+            if (fHasItems) lastMasternodeWinner = GetTime();
             break;
         case (MASTERNODE_SYNC_BUDGET_PROP):
             if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
             sumBudgetItemProp += nCount;
             countBudgetItemProp++;
+            if (fHasItems) lastBudgetItem = GetTime();
             break;
         case (MASTERNODE_SYNC_BUDGET_FIN):
             if (RequestedMasternodeAssets != MASTERNODE_SYNC_BUDGET) return;
             sumBudgetItemFin += nCount;
             countBudgetItemFin++;
+            if (fHasItems) lastBudgetItem = GetTime();
             break;
         }
 
@@ -261,9 +294,8 @@ void CMasternodeSync::Process()
     static int tick = 0;
     const bool isRegTestNet = Params().IsRegTestNet();
 
-    if (tick++ % MASTERNODE_SYNC_TIMEOUT != 0) return;
-
     if (IsSynced()) {
+        if (tick++ % MASTERNODE_SYNC_TIMEOUT != 0) return;
         /*
             Resync if we lose all masternodes from sleep/wake or failure to sync originally
         */
@@ -298,7 +330,8 @@ void CMasternodeSync::Process()
         return;
     }
 
-    // Mainnet sync
+    // Mainnet sync: ask up to MASTERNODE_SYNC_PEERS peers at each step
+    nStepRequests = 0;
     g_connman->ForEachNodeContinueIf([sync](CNode* pnode){
         return sync->SyncWithNode(pnode);
     });
@@ -314,9 +347,12 @@ bool CMasternodeSync::SyncWithNode(CNode* pnode)
         pnode->FulfilledRequest("getspork");
 
         g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETSPORKS)); //get current network sporks
-        if (RequestedMasternodeAttempt >= 2) GetNextAsset();
-        RequestedMasternodeAttempt++;
-        return false;
+        if (RequestedMasternodeAttempt >= 2) {
+            GetNextAsset();
+            RequestedMasternodeAttempt++;
+            return false;
+        }
+        return CountStepRequest();
     }
 
     if (pnode->nVersion >= ActiveProtocol()) {
@@ -332,7 +368,7 @@ bool CMasternodeSync::SyncWithNode(CNode* pnode)
 
             // timeout
             if (lastMasternodeList == 0 &&
-                (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
+                GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5) {
                 if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
                     LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed on %s, will retry later\n", "MASTERNODE_SYNC_LIST");
                     RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
@@ -348,8 +384,7 @@ bool CMasternodeSync::SyncWithNode(CNode* pnode)
             if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return false;
 
             mnodeman.DsegUpdate(pnode);
-            RequestedMasternodeAttempt++;
-            return false;
+            return CountStepRequest();
         }
 
         if (RequestedMasternodeAssets == MASTERNODE_SYNC_MNW) {
@@ -363,7 +398,7 @@ bool CMasternodeSync::SyncWithNode(CNode* pnode)
 
             // timeout
             if (lastMasternodeWinner == 0 &&
-                (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
+                GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5) {
                 if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
                     LogPrintf("CMasternodeSync::Process - ERROR - Sync has failed on %s, will retry later\n", "MASTERNODE_SYNC_MNW");
                     RequestedMasternodeAssets = MASTERNODE_SYNC_FAILED;
@@ -379,9 +414,13 @@ bool CMasternodeSync::SyncWithNode(CNode* pnode)
             if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return false;
 
             int nMnCount = mnodeman.CountEnabled();
-            g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETMNWINNERS, nMnCount)); //sync payees
-            RequestedMasternodeAttempt++;
-            return false;
+            const Optional<CBloomFilter>& filter = MakeSyncFilter(masternodePayments.GetSyncHashes(nMnCount));
+            if (filter) {
+                g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETMNWINNERS, nMnCount, *filter)); //sync payees we don't have
+            } else {
+                g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETMNWINNERS, nMnCount)); //sync payees
+            }
+            return CountStepRequest();
         }
 
         if (RequestedMasternodeAssets == MASTERNODE_SYNC_BUDGET) {
@@ -397,7 +436,7 @@ bool CMasternodeSync::SyncWithNode(CNode* pnode)
 
             // timeout
             if (lastBudgetItem == 0 &&
-                (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3 || GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5)) {
+                GetTime() - nAssetSyncStarted > MASTERNODE_SYNC_TIMEOUT * 5) {
                 // maybe there is no budgets at all, so just finish syncing
                 GetNextAsset();
                 activeMasternode.ManageStatus();
@@ -410,13 +449,23 @@ bool CMasternodeSync::SyncWithNode(CNode* pnode)
             if (RequestedMasternodeAttempt >= MASTERNODE_SYNC_THRESHOLD * 3) return false;
 
             uint256 n;
-            g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::BUDGETVOTESYNC, n)); //sync masternode votes
-            RequestedMasternodeAttempt++;
-            return false;
+            const Optional<CBloomFilter>& filter = MakeSyncFilter(g_budgetman.GetSyncHashes());
+            if (filter) {
+                g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::BUDGETVOTESYNC, n, *filter)); //sync masternode votes we don't have
+            } else {
+                g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::BUDGETVOTESYNC, n)); //sync masternode votes
+            }
+            return CountStepRequest();
         }
     }
 
     return true;
 }
 
+bool CMasternodeSync::CountStepRequest()
+{
+    RequestedMasternodeAttempt++;
+    return ++nStepRequests < MASTERNODE_SYNC_PEERS;
+}
+
 
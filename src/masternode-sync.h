@@ -8,7 +8,9 @@
 #ifndef MASTERNODE_SYNC_H
 #define MASTERNODE_SYNC_H
 
+#include "bloom.h"
 #include "net.h"    // for NodeId
+#include "optional.h"
 #include "uint256.h"
 
 #include <atomic>
@@ -27,10 +29,24 @@
 
 #define MASTERNODE_SYNC_TIMEOUT 5
 #define MASTERNODE_SYNC_THRESHOLD 2
+// max number of peers asked for the current asset at each sync step
+#define MASTERNODE_SYNC_PEERS 3
+
+// Known items filter, appended to the GETMNLIST, GETMNWINNERS and BUDGETVOTESYNC requests:
+// the peer skips the inventories of the items we already have.
+#define MASTERNODE_SYNC_FILTER_FPRATE 0.0001
+#define MASTERNODE_SYNC_FILTER_MAX_ELEMENTS 12000
 
 class CMasternodeSync;
 extern CMasternodeSync masternodeSync;
 
+// Builds the filter of the known item hashes (only the first MASTERNODE_SYNC_FILTER_MAX_ELEMENTS,
+// the others are announced again). The tweak is random, so that an item skipped because of a
+// false positive is still announced by the other peers.
+Optional<CBloomFilter> MakeSyncFilter(const std::vector<uint256>& vKnownHashes);
+// Reads the optional filter at the end of a sync request. Returns false if it is oversized.
+bool ReadSyncFilter(CDataStream& vRecv, Optional<CBloomFilter>& filter);
+
 struct TierTwoPeerData {
     // map of message --> last request timestamp, bool hasResponseArrived.
     std::map<const char*, std::pair<int64_t, bool>> mapMsgData;
@@ -111,7 +127,12 @@ private:
     // map of nodeID --> TierTwoPeerData
     std::map<NodeId, TierTwoPeerData> peersSyncState;
 
+    // Number of peers asked for the current asset in this sync step
+    int nStepRequests;
+
     void SyncRegtest(CNode* pnode);
+    // Counts a request sent in this step. Returns true if another peer can be asked in the same step.
+    bool CountStepRequest();
 
     template <typename... Args>
     void RequestDataTo(CNode* pnode, const char* msg, bool forceRequest, Args&&... args);
@@ -125,6 +125,8 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
 {
     if (mnb.sigTime > sigTime) {
         // TODO: lock cs. Need to be careful as mnb.lastPing.CheckAndUpdate locks cs_main internally.
+        const CPubKey pubKeyMasternodeOld = pubKeyMasternode;
+        const CService addrOld = addr;
         pubKeyMasternode = mnb.pubKeyMasternode;
         pubKeyCollateralAddress = mnb.pubKeyCollateralAddress;
         sigTime = mnb.sigTime;
@@ -136,6 +138,7 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
             lastPing = mnb.lastPing;
             mnodeman.mapSeenMasternodePing.emplace(lastPing.GetHash(), lastPing);
         }
+        mnodeman.UpdateIndexes(*this, pubKeyMasternodeOld, addrOld);
         return true;
     }
     return false;
@@ -192,11 +195,22 @@ bool CMasternode::IsInputAssociatedWithPubkey() const
     CScript payee;
     payee = GetScriptForDestination(pubKeyCollateralAddress.GetID());
 
+    // An unspent collateral is in the coins, even if its block was pruned
+    const int nTipHeight = GetChainTipSnapshot()->nHeight;
+    {
+        LOCK(cs_main);
+        const Coin& coin = pcoinsTip->AccessCoin(vin.prevout);
+        if (!coin.IsSpent() && coin.out.nValue == GetMNCollateral(nTipHeight) && coin.out.scriptPubKey == payee) return true;
+        // The transaction of a spent collateral may have been pruned: CheckInputsAndAdd
+        // drops the broadcast as spent, without banning the peer relaying it
+        if (coin.IsSpent() && fPruneMode) return true;
+    }
+
     CTransactionRef txVin;
     uint256 hash;
     if(GetTransaction(vin.prevout.hash, txVin, hash, true)) {
         for (const CTxOut& out : txVin->vout) {
-                if (out.nValue == GetMNCollateral(chainActive.Height()) && out.scriptPubKey == payee) return true;
+                if (out.nValue == GetMNCollateral(nTipHeight) && out.scriptPubKey == payee) return true;
         }
     }
 
@@ -346,8 +360,30 @@ bool CMasternodeBroadcast::Sign(const std::string strSignKey)
     return Sign(key, pubkey);
 }
 
+uint256 CMasternodeBroadcast::GetSignedHash() const
+{
+    return CMessageSigner::GetMessageHash(
+                            nMessVersion == MessageVersion::MESS_VER_HASH ?
+                            GetSignatureHash().GetHex() :
+                            GetStrMessage()
+                            );
+}
+
+void CMasternodeBroadcast::PreCheckSignatures() const
+{
+    PreCheckSignature();
+    lastPing.PreCheckSignature();
+}
+
 bool CMasternodeBroadcast::CheckSignature() const
 {
+    CKeyID keyIDRecovered;
+    if (GetRecoveredSigner(keyIDRecovered)) {
+        if (keyIDRecovered.IsNull() || keyIDRecovered != pubKeyCollateralAddress.GetID())
+            return error("%s : (nMessVersion=%d) signature doesn't match the collateral key", __func__, nMessVersion);
+        return true;
+    }
+
     std::string strError = "";
     std::string strMessage = (
                             nMessVersion == MessageVersion::MESS_VER_HASH ?
@@ -506,7 +542,13 @@ bool CMasternodeBroadcast::CheckInputsAndAdd(int nChainHeight, int& nDoS)
 
     // verify that sig time is legit in past
     // should be at least not earlier than block when 1000 DOGEC tx got MASTERNODE_MIN_CONFIRMATIONS
-    CBlockIndex* pConfIndex = WITH_LOCK(cs_main, return chainActive[utxoHeight + MasternodeCollateralMinConf() - 1]); // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+    const CBlockIndex* pConfIndex = chainActive.AtHeightSnapshot(utxoHeight + MasternodeCollateralMinConf() - 1); // block where tx got MASTERNODE_MIN_CONFIRMATIONS
+    if (!pConfIndex) {
+        // the tip moved back since the confirmations were counted, check it again later
+        mnodeman.mapSeenMasternodeBroadcast.erase(GetHash());
+        masternodeSync.mapSeenSyncMNB.erase(GetHash());
+        return false;
+    }
     if (pConfIndex->GetBlockTime() > sigTime) {
         LogPrint(BCLog::MASTERNODE,"mnb - Bad sigTime %d for Masternode %s (%i conf block is at %d)\n",
             sigTime, vin.prevout.hash.ToString(), MasternodeCollateralMinConf(), pConfIndex->GetBlockTime());
@@ -630,6 +672,7 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireAvailable, bool fCh
 
             // SetLastPing locks masternode cs. Be careful with the lock ordering.
             pmn->SetLastPing(*this);
+            mnodeman.SetPinged(vin.prevout);
 
             //mnodeman.mapSeenMasternodeBroadcast.lastPing is probably outdated, so we'll update it
             CMasternodeBroadcast mnb(*pmn);
@@ -70,6 +70,8 @@ public:
     const CTxIn GetVin() const { return vin; };
     bool IsNull() const { return blockHash.IsNull() || vin.prevout.IsNull(); }
 
+    size_t DynamicMemoryUsage() const { return CSignedMessage::DynamicMemoryUsage() + vin.DynamicMemoryUsage(); }
+
     bool CheckAndUpdate(int& nDos, bool fRequireAvailable = true, bool fCheckSigTimeOnly = false);
     void Relay();
 
@@ -125,6 +127,12 @@ public:
 
     void SetLastPing(const CMasternodePing& _lastPing) { WITH_LOCK(cs, lastPing = _lastPing;); }
 
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        return CSignedMessage::DynamicMemoryUsage() + vin.DynamicMemoryUsage() + lastPing.DynamicMemoryUsage();
+    }
+
     CMasternode& operator=(const CMasternode& other)
     {
         nMessVersion = other.nMessVersion;
@@ -240,6 +248,10 @@ public:
 
 class CMasternodeBroadcast : public CMasternode
 {
+protected:
+    // the broadcast signs the hex string of its signature hash
+    uint256 GetSignedHash() const override;
+
 public:
     CMasternodeBroadcast();
     CMasternodeBroadcast(CService newAddr, CTxIn newVin, CPubKey newPubkey, CPubKey newPubkey2, int protocolVersionIn, const CMasternodePing& _lastPing);
@@ -256,6 +268,8 @@ public:
     bool Sign(const CKey& key, const CPubKey& pubKey);
     bool Sign(const std::string strSignKey);
     bool CheckSignature() const;
+    /// Recover the signers of the broadcast and of its ping, see CSignedMessage::PreCheckSignature
+    void PreCheckSignatures() const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -8,16 +8,21 @@
 #include "masternodeman.h"
 
 #include "addrman.h"
+#include "budget/budgetdb.h"
 #include "fs.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "masternode.h"
 #include "messagesigner.h"
+#include "mnprecheck.h"
 #include "netbase.h"
 #include "netmessagemaker.h"
 #include "net_processing.h"
 #include "spork.h"
+#include "tiertwodb.h"
 #include "util.h"
+#include "util/trace.h"
+#include "validationinterface.h"
 
 #include <boost/thread/thread.hpp>
 
@@ -36,19 +41,19 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const std::pair<int64_t, CTxIn>& t1,
-        const std::pair<int64_t, CTxIn>& t2) const
+struct CompareMasternodeScoreDesc {
+    bool operator()(const CMasternodeScore& t1,
+        const CMasternodeScore& t2) const
     {
-        return t1.first < t2.first;
+        return t1.nScore > t2.nScore;
     }
 };
 
-struct CompareScoreMN {
+struct CompareScoreMNDesc {
     bool operator()(const std::pair<int64_t, MasternodeRef>& t1,
         const std::pair<int64_t, MasternodeRef>& t2) const
     {
-        return t1.first < t2.first;
+        return t1.first > t2.first;
     }
 };
 
@@ -64,40 +69,6 @@ CMasternodeDB::CMasternodeDB()
     strMagicMessage = "MasternodeCache";
 }
 
-bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
-{
-    int64_t nStart = GetTimeMillis();
-
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << MASTERNODE_DB_VERSION;
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fsbridge::fopen(pathMN, "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (const std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
-    }
-    //    FileCommit(fileout);
-    fileout.fclose();
-
-    LogPrint(BCLog::MASTERNODE,"Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint(BCLog::MASTERNODE,"  %s\n", mnodemanToSave.ToString());
-
-    return true;
-}
-
 CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
 {
     int64_t nStart = GetTimeMillis();
@@ -176,17 +147,16 @@ CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
 
 void DumpMasternodes()
 {
+    if (!pTierTwoDB) return;
     int64_t nStart = GetTimeMillis();
 
-    CMasternodeDB mndb;
-    LogPrint(BCLog::MASTERNODE,"Writing info to mncache.dat...\n");
-    mndb.Write(mnodeman);
+    LogPrint(BCLog::MASTERNODE,"Writing the masternode list changes to the tier two database...\n");
+    mnodeman.FlushToDB(*pTierTwoDB);
 
     LogPrint(BCLog::MASTERNODE,"Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
 CMasternodeMan::CMasternodeMan():
-        cvLastBlockHashes(CACHED_BLOCK_HASHES, UINT256_ZERO),
         nDsqCount(0)
 {}
 
@@ -201,7 +171,10 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (it == mapMasternodes.end()) {
         LogPrint(BCLog::MASTERNODE, "Adding new Masternode %s\n", mn.vin.prevout.ToString());
         mapMasternodes.emplace(mn.vin.prevout, std::make_shared<CMasternode>(mn));
+        IndexMasternode(mn);
+        ClearScoresCache();
         LogPrint(BCLog::MASTERNODE, "Masternode added. New total count: %d\n", mapMasternodes.size());
+        GetMainSignals().MasternodeListChanged(mn.vin.prevout, true);
         return true;
     }
 
@@ -228,48 +201,69 @@ int CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 {
     LOCK(cs);
 
+    const int64_t nNow = GetAdjustedTime();
+    const int nActiveProtocol = ActiveProtocol();
+
+    // Only the masternodes whose check deadline passed can have become removable,
+    // unless the active protocol changed or the expired ones go too.
+    std::vector<COutPoint> vToCheck;
+    if (forceExpiredRemoval || nActiveProtocol != nLastCheckedProtocol) {
+        vToCheck.reserve(mapMasternodes.size());
+        for (const auto& it : mapMasternodes) vToCheck.emplace_back(it.first);
+    } else {
+        for (auto it = setCheckDeadlines.begin(); it != setCheckDeadlines.end() && it->first <= nNow; ++it)
+            vToCheck.emplace_back(it->second);
+    }
+    nLastCheckedProtocol = nActiveProtocol;
+
     //remove inactive and outdated
-    auto it = mapMasternodes.begin();
-    while (it != mapMasternodes.end()) {
+    std::set<COutPoint> setRemoved;
+    for (const COutPoint& collateralOut : vToCheck) {
+        auto it = mapMasternodes.find(collateralOut);
+        if (it == mapMasternodes.end()) continue;
         MasternodeRef& mn = it->second;
         auto activeState = mn->GetActiveState();
         if (activeState == CMasternode::MASTERNODE_REMOVE ||
             activeState == CMasternode::MASTERNODE_VIN_SPENT ||
             (forceExpiredRemoval && activeState == CMasternode::MASTERNODE_EXPIRED) ||
-            mn->protocolVersion < ActiveProtocol()) {
+            mn->protocolVersion < nActiveProtocol) {
             LogPrint(BCLog::MASTERNODE, "Removing inactive Masternode %s\n", it->first.ToString());
 
-            //erase all of the broadcasts we've seen from this vin
-            // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
-            //    sending a brand new mnb
-            std::map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
-            while (it3 != mapSeenMasternodeBroadcast.end()) {
-                if (it3->second.vin == it->second->vin) {
-                    masternodeSync.mapSeenSyncMNB.erase((*it3).first);
-                    it3 = mapSeenMasternodeBroadcast.erase(it3);
-                } else {
-                    ++it3;
-                }
-            }
-
             // allow us to ask for this masternode again if we see another ping
-            std::map<COutPoint, int64_t>::iterator it2 = mWeAskedForMasternodeListEntry.begin();
-            while (it2 != mWeAskedForMasternodeListEntry.end()) {
-                if (it2->first == it->first) {
-                    it2 = mWeAskedForMasternodeListEntry.erase(it2);
-                } else {
-                    ++it2;
-                }
-            }
+            mWeAskedForMasternodeListEntry.erase(it->first);
 
-            it = mapMasternodes.erase(it);
+            setRemoved.emplace(it->first);
+            UnindexMasternode(*mn);
+            mapMasternodes.erase(it);
+            ClearScoresCache();
+            GetMainSignals().MasternodeListChanged(collateralOut, false);
             LogPrint(BCLog::MASTERNODE, "Masternode removed.\n");
         } else {
-            ++it;
+            // pinged since it was scheduled
+            ScheduleCheck(*mn);
+        }
+    }
+
+    //erase all of the broadcasts we've seen from the removed vins
+    // -- if we missed a few pings and the node was removed, this will allow is to get it back without them
+    //    sending a brand new mnb
+    if (!setRemoved.empty()) {
+        std::map<uint256, CMasternodeBroadcast>::iterator it3 = mapSeenMasternodeBroadcast.begin();
+        while (it3 != mapSeenMasternodeBroadcast.end()) {
+            if (setRemoved.count(it3->second.vin.prevout)) {
+                masternodeSync.mapSeenSyncMNB.erase((*it3).first);
+                it3 = mapSeenMasternodeBroadcast.erase(it3);
+            } else {
+                ++it3;
+            }
         }
     }
     LogPrint(BCLog::MASTERNODE, "New total masternode count: %d\n", mapMasternodes.size());
 
+    // the rest only drops the expired entries to save memory, they are checked on use
+    if (nNow - nLastSweepTime < MASTERNODES_SWEEP_SECONDS) return mapMasternodes.size();
+    nLastSweepTime = nNow;
+
     // check who's asked for the Masternode list
     std::map<CNetAddr, int64_t>::iterator it1 = mAskedUsForMasternodeList.begin();
     while (it1 != mAskedUsForMasternodeList.end()) {
@@ -327,7 +321,14 @@ int CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
 void CMasternodeMan::Clear()
 {
     LOCK(cs);
+    for (const auto& it : mapMasternodes) setChangedMasternodes.emplace(it.first);
     mapMasternodes.clear();
+    setPubKeyMasternodes.clear();
+    vNetworkCounts.fill(0);
+    mapCheckDeadlines.clear();
+    setCheckDeadlines.clear();
+    mapCollateralHeights.clear();
+    ClearScoresCache();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -366,41 +367,35 @@ int CMasternodeMan::stable_size() const
 
 int CMasternodeMan::CountEnabled(int protocolVersion) const
 {
-    int i = 0;
     protocolVersion = protocolVersion == -1 ? ActiveProtocol() : protocolVersion;
 
+    LOCK(cs);
+    // the enabled state depends on the time, so the counts are only reused within the second
+    const int64_t nNow = GetAdjustedTime();
+    if (nNow != nEnabledCountsTime) {
+        mapEnabledCounts.clear();
+        nEnabledCountsTime = nNow;
+    }
+    const auto itCount = mapEnabledCounts.find(protocolVersion);
+    if (itCount != mapEnabledCounts.end()) return itCount->second;
+
+    int i = 0;
     for (const auto& it : mapMasternodes) {
         const MasternodeRef& mn = it.second;
         if (mn->protocolVersion < protocolVersion || !mn->IsEnabled()) continue;
         i++;
     }
 
+    mapEnabledCounts.emplace(protocolVersion, i);
     return i;
 }
 
 int CMasternodeMan::CountNetworks(int& ipv4, int& ipv6, int& onion) const
 {
     LOCK(cs);
-    for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
-        std::string strHost;
-        int port;
-        SplitHostPort(mn->addr.ToString(), port, strHost);
-        CNetAddr node;
-        LookupHost(strHost.c_str(), node, false);
-        int nNetwork = node.GetNetwork();
-        switch (nNetwork) {
-            case 1 :
-                ipv4++;
-                break;
-            case 2 :
-                ipv6++;
-                break;
-            case 3 :
-                onion++;
-                break;
-        }
-    }
+    ipv4 += vNetworkCounts[NET_IPV4];
+    ipv6 += vNetworkCounts[NET_IPV6];
+    onion += vNetworkCounts[NET_TOR];
     return mapMasternodes.size();
 }
 
@@ -420,7 +415,19 @@ void CMasternodeMan::DsegUpdate(CNode* pnode)
         }
     }
 
-    g_connman->PushMessage(pnode, CNetMsgMaker(pnode->GetSendVersion()).Make(NetMsgType::GETMNLIST, CTxIn()));
+    // let the peer skip the broadcasts we already have
+    std::vector<uint256> vKnownHashes;
+    vKnownHashes.reserve(mapMasternodes.size());
+    for (const auto& it : mapMasternodes) {
+        vKnownHashes.emplace_back(CMasternodeBroadcast(*it.second).GetHash());
+    }
+    const Optional<CBloomFilter>& filter = MakeSyncFilter(vKnownHashes);
+    CNetMsgMaker msgMaker(pnode->GetSendVersion());
+    if (filter) {
+        g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETMNLIST, CTxIn(), *filter));
+    } else {
+        g_connman->PushMessage(pnode, msgMaker.Make(NetMsgType::GETMNLIST, CTxIn()));
+    }
     int64_t askAgain = GetTime() + MASTERNODES_DSEG_SECONDS;
     mWeAskedForMasternodeList[pnode->addr] = askAgain;
 }
@@ -442,13 +449,10 @@ const CMasternode* CMasternodeMan::Find(const COutPoint& collateralOut) const
 CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
 {
     LOCK(cs);
-
-    for (auto& it : mapMasternodes) {
-        MasternodeRef& mn = it.second;
-        if (mn->pubKeyMasternode == pubKeyMasternode)
-            return mn.get();
-    }
-    return nullptr;
+    // the first collateral (in the map order) with this key
+    auto it = setPubKeyMasternodes.lower_bound(std::make_pair(pubKeyMasternode, COutPoint(UINT256_ZERO, 0)));
+    if (it == setPubKeyMasternodes.end() || it->first != pubKeyMasternode) return nullptr;
+    return Find(it->second);
 }
 
 void CMasternodeMan::CheckSpentCollaterals(const std::vector<CTransactionRef>& vtx)
@@ -459,6 +463,8 @@ void CMasternodeMan::CheckSpentCollaterals(const std::vector<CTransactionRef>& v
             auto it = mapMasternodes.find(in.prevout);
             if (it != mapMasternodes.end()) {
                 it->second->SetSpent();
+                // removed on the next CheckAndRemove
+                ScheduleCheck(*it->second);
             }
         }
     }
@@ -482,6 +488,9 @@ const CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlock
     */
 
     int nMnCount = CountEnabled();
+    // the payees of the last blocks, walked once for all the masternodes
+    std::map<CScript, int64_t> mapLastPaid;
+    GetLastPaidTimes(BlockReading, mapLastPaid);
     for (const auto& it : mapMasternodes) {
         const MasternodeRef& mn = it.second;
         if (!mn->IsEnabled()) continue;
@@ -496,9 +505,17 @@ const CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlock
         if (fFilterSigTime && mn->sigTime + (nMnCount * 2.6 * 60) > GetAdjustedTime()) continue;
 
         //make sure it has as many confirmations as there are masternodes
-        if (pcoinsTip->GetCoinDepthAtHeight(mn->vin.prevout, nBlockHeight) < nMnCount) continue;
+        const auto& itHeight = mapCollateralHeights.find(mn->vin.prevout);
+        if (itHeight != mapCollateralHeights.end()) {
+            if (nBlockHeight - itHeight->second + 1 < nMnCount) continue;
+        } else {
+            const Coin& coin = pcoinsTip->AccessCoin(mn->vin.prevout);
+            if (coin.IsSpent() || nBlockHeight - (int)coin.nHeight + 1 < nMnCount) continue;
+            // deep enough now, only the required depth changes from here on
+            mapCollateralHeights.emplace(mn->vin.prevout, coin.nHeight);
+        }
 
-        vecMasternodeLastPaid.emplace_back(SecondsSincePayment(mn, BlockReading), mn->vin);
+        vecMasternodeLastPaid.emplace_back(SecondsSincePayment(mn, mapLastPaid), mn->vin);
     }
 
     nCount = (int)vecMasternodeLastPaid.size();
@@ -532,29 +549,182 @@ const CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlock
     return pBestMasternode;
 }
 
-const CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol) const
+void CMasternodeMan::ClearScoresCache() const
 {
-    int64_t score = 0;
-    const CMasternode* winner = nullptr;
-    const uint256& hash = GetHashAtHeight(nBlockHeight - 1);
+    LOCK(cs);
+    mapScoresCache.clear();
+    mapEnabledCounts.clear();
+}
+
+void CMasternodeMan::ScheduleCheck(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    UnscheduleCheck(mn.vin.prevout);
+    // every change of a listed masternode, including its removal, comes through here
+    setChangedMasternodes.emplace(mn.vin.prevout);
+    // a new ping only moves the deadline later, which the check finds out
+    int64_t nDeadline = 0;
+    if (!mn.lastPing.IsNull() && mn.GetActiveState() != CMasternode::MASTERNODE_VIN_SPENT)
+        nDeadline = mn.lastPing.sigTime + MasternodeRemovalSeconds();
+    mapCheckDeadlines.emplace(mn.vin.prevout, nDeadline);
+    setCheckDeadlines.emplace(nDeadline, mn.vin.prevout);
+}
+
+void CMasternodeMan::UnscheduleCheck(const COutPoint& collateralOut)
+{
+    AssertLockHeld(cs);
+    setChangedMasternodes.emplace(collateralOut);
+    const auto it = mapCheckDeadlines.find(collateralOut);
+    if (it == mapCheckDeadlines.end()) return;
+    setCheckDeadlines.erase(std::make_pair(it->second, collateralOut));
+    mapCheckDeadlines.erase(it);
+}
+
+void CMasternodeMan::IndexMasternode(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    setPubKeyMasternodes.emplace(mn.pubKeyMasternode, mn.vin.prevout);
+    vNetworkCounts[mn.addr.GetNetwork()]++;
+    ScheduleCheck(mn);
+}
+
+void CMasternodeMan::UnindexMasternode(const CMasternode& mn)
+{
+    AssertLockHeld(cs);
+    setPubKeyMasternodes.erase(std::make_pair(mn.pubKeyMasternode, mn.vin.prevout));
+    vNetworkCounts[mn.addr.GetNetwork()]--;
+    UnscheduleCheck(mn.vin.prevout);
+    mapCollateralHeights.erase(mn.vin.prevout);
+}
+
+void CMasternodeMan::RebuildIndexes()
+{
+    LOCK(cs);
+    setPubKeyMasternodes.clear();
+    vNetworkCounts.fill(0);
+    mapCheckDeadlines.clear();
+    setCheckDeadlines.clear();
+    for (const auto& it : mapMasternodes)
+        IndexMasternode(*it.second);
+}
+
+void CMasternodeMan::SetPinged(const COutPoint& collateralOut)
+{
+    LOCK(cs);
+    if (mapMasternodes.count(collateralOut)) setChangedMasternodes.emplace(collateralOut);
+}
+
+bool CMasternodeMan::LoadFromDB(CTierTwoDB& db)
+{
+    int64_t nStart = GetTimeMillis();
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    LOCK(cs);
+    pcursor->Seek(DB_TIERTWO_MASTERNODE);
+    while (pcursor->Valid()) {
+        std::pair<char, COutPoint> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIERTWO_MASTERNODE) break;
+        MasternodeRef mn = std::make_shared<CMasternode>();
+        if (!pcursor->GetValue(*mn)) {
+            Clear();
+            setChangedMasternodes.clear();
+            return error("%s : failed to read masternode %s", __func__, key.second.ToString());
+        }
+        mapMasternodes.emplace(key.second, mn);
+        pcursor->Next();
+    }
 
-    // scan for winner
+    // known already, for the peers sending the list again
     for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
-        if (mn->protocolVersion < minProtocol || !mn->IsEnabled()) continue;
+        const CMasternodeBroadcast mnb(*it.second);
+        mapSeenMasternodeBroadcast.emplace(mnb.GetHash(), mnb);
+        if (!mnb.lastPing.IsNull()) mapSeenMasternodePing.emplace(mnb.lastPing.GetHash(), mnb.lastPing);
+    }
 
-        // calculate the score for each Masternode
-        uint256 n = mn->CalculateScore(hash);
-        int64_t n2 = n.GetCompact(false);
+    ClearScoresCache();
+    RebuildIndexes();
+    setChangedMasternodes.clear();
 
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = mn.get();
+    LogPrint(BCLog::MASTERNODE, "Loaded %d masternodes from the tier two database %dms\n", mapMasternodes.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CMasternodeMan::FlushToDB(CTierTwoDB& db)
+{
+    std::set<COutPoint> setChanged;
+    CDBBatch batch;
+    size_t nWritten = 0;
+    {
+        LOCK(cs);
+        setChanged.swap(setChangedMasternodes);
+        for (const COutPoint& collateralOut : setChanged) {
+            const auto it = mapMasternodes.find(collateralOut);
+            if (it != mapMasternodes.end()) {
+                batch.Write(std::make_pair(DB_TIERTWO_MASTERNODE, collateralOut), *it->second);
+                nWritten++;
+            } else {
+                batch.Erase(std::make_pair(DB_TIERTWO_MASTERNODE, collateralOut));
+            }
         }
     }
 
-    return winner;
+    if (!db.WriteBatch(batch, true)) {
+        // keep them for the next flush
+        LOCK(cs);
+        setChangedMasternodes.insert(setChanged.begin(), setChanged.end());
+        return error("%s : failed to write %d masternode changes", __func__, setChanged.size());
+    }
+    LogPrint(BCLog::MASTERNODE, "Flushed %d masternodes, erased %d\n", nWritten, setChanged.size() - nWritten);
+    return true;
+}
+
+void CMasternodeMan::UpdateIndexes(const CMasternode& mn, const CPubKey& pubKeyMasternodeOld, const CService& addrOld)
+{
+    LOCK(cs);
+    // only the listed object is indexed
+    const auto it = mapMasternodes.find(mn.vin.prevout);
+    if (it == mapMasternodes.end() || it->second.get() != &mn) return;
+
+    setPubKeyMasternodes.erase(std::make_pair(pubKeyMasternodeOld, mn.vin.prevout));
+    vNetworkCounts[addrOld.GetNetwork()]--;
+    IndexMasternode(mn);
+    mapEnabledCounts.clear();
+}
+
+MasternodeScoresRef CMasternodeMan::GetScores(const uint256& hash) const
+{
+    LOCK(cs);
+    const auto it = mapScoresCache.find(hash);
+    if (it != mapScoresCache.end()) return it->second;
+
+    auto scores = std::make_shared<MasternodeScores>();
+    scores->reserve(mapMasternodes.size());
+    for (const auto& it2 : mapMasternodes) {
+        const uint256& n = it2.second->CalculateScore(hash);
+        scores->push_back({n, (int64_t) n.GetCompact(false), it2.second});
+    }
+    // stable: equal scores keep the map order, as the previous linear scans did
+    std::stable_sort(scores->begin(), scores->end(), CompareMasternodeScoreDesc());
+
+    // the table is rebuilt on demand, so there is no need for a smarter eviction
+    if (mapScoresCache.size() >= CACHED_SCORE_TABLES) mapScoresCache.clear();
+    mapScoresCache.emplace(hash, scores);
+    return scores;
+}
+
+const CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol) const
+{
+    const uint256& hash = GetHashAtHeight(nBlockHeight - 1);
+
+    // the winner is the first enabled masternode with the highest score
+    for (const CMasternodeScore& s : *GetScores(hash)) {
+        if (s.nScore <= 0) break;
+        const MasternodeRef& mn = s.mn;
+        if (mn->protocolVersion < minProtocol || !mn->IsEnabled()) continue;
+        return mn.get();
+    }
+
+    return nullptr;
 }
 
 std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast) const
@@ -567,11 +737,13 @@ std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast
         const uint256& hash = GetHashAtHeight(nHeight - 101);
         uint256 nHigh = UINT256_ZERO;
         MasternodeRef pBestMasternode;
-        for (const auto& it : mapMasternodes) {
-            const uint256& n = it.second->CalculateScore(hash);
-            if (n > nHigh) {
-                nHigh = n;
-                pBestMasternode = it.second;
+        // the table is ordered by compact score: the highest full score is in the leading group
+        const MasternodeScoresRef scores = GetScores(hash);
+        for (const CMasternodeScore& s : *scores) {
+            if (s.nScore != scores->front().nScore) break;
+            if (s.score > nHigh) {
+                nHigh = s.score;
+                pBestMasternode = s.mn;
             }
         }
         if (nHigh > UINT256_ZERO) {
@@ -583,7 +755,6 @@ std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive) const
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
@@ -591,15 +762,16 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     // height outside range
     if (!hash) return -1;
 
-    // scan for winner
-    for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
+    const bool fCheckAge = sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
+    int rank = 0;
+    for (const CMasternodeScore& s : *GetScores(hash)) {
+        const MasternodeRef& mn = s.mn;
         if (mn->protocolVersion < minProtocol) {
             LogPrint(BCLog::MASTERNODE,"Skipping Masternode with obsolete version %d\n", mn->protocolVersion);
             continue;                                                       // Skip obsolete versions
         }
 
-        if (sporkManager.IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+        if (fCheckAge) {
             nMasternode_Age = GetAdjustedTime() - mn->sigTime;
             if ((nMasternode_Age) < nMasternode_Min_Age) {
                 LogPrint(BCLog::MASTERNODE,"Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
@@ -609,18 +781,9 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
         if (fOnlyActive) {
             if (!mn->IsEnabled()) continue;
         }
-        uint256 n = mn->CalculateScore(hash);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.emplace_back(n2, mn->vin);
-    }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (std::pair<int64_t, CTxIn> & s : vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn->vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -634,25 +797,26 @@ std::vector<std::pair<int64_t, MasternodeRef>> CMasternodeMan::GetMasternodeRank
     const uint256& hash = GetHashAtHeight(nBlockHeight - 1);
     // height outside range
     if (!hash) return vecMasternodeScores;
-    {
-        LOCK(cs);
-        // scan for winner
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef& mn = it.second;
-            if (!mn->IsEnabled()) {
-                vecMasternodeScores.emplace_back(9999, mn);
-                continue;
-            }
 
-            int64_t n2 = mn->CalculateScore(hash).GetCompact(false);
-            vecMasternodeScores.emplace_back(n2, mn);
-        }
+    const MasternodeScoresRef scores = GetScores(hash);
+    vecMasternodeScores.reserve(scores->size());
+    for (const CMasternodeScore& s : *scores) {
+        vecMasternodeScores.emplace_back(s.mn->IsEnabled() ? s.nScore : 9999, s.mn);
     }
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
+    // only the disabled masternodes need to be moved
+    std::stable_sort(vecMasternodeScores.begin(), vecMasternodeScores.end(), CompareScoreMNDesc());
     return vecMasternodeScores;
 }
 
 int CMasternodeMan::ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb)
+{
+    const int64_t nStart = GetTimeMicros();
+    const int nDoS = ProcessMNBroadcastInner(pfrom, mnb);
+    TRACE5(masternode, mnb_processed, mnb.GetHash().begin(), mnb.vin.prevout.hash.begin(), mnb.vin.prevout.n, nDoS, GetTimeMicros() - nStart);
+    return nDoS;
+}
+
+int CMasternodeMan::ProcessMNBroadcastInner(CNode* pfrom, CMasternodeBroadcast& mnb)
 {
     const uint256& mnbHash = mnb.GetHash();
     if (mapSeenMasternodeBroadcast.count(mnbHash)) { //seen
@@ -715,7 +879,7 @@ int CMasternodeMan::ProcessMNPing(CNode* pfrom, CMasternodePing& mnp)
     return 0;
 }
 
-int CMasternodeMan::ProcessGetMNList(CNode* pfrom, CTxIn& vin)
+int CMasternodeMan::ProcessGetMNList(CNode* pfrom, CTxIn& vin, const CBloomFilter* pfilter)
 {
     if (vin.IsNull()) { //only should ask for this once
         //local network
@@ -747,7 +911,7 @@ int CMasternodeMan::ProcessGetMNList(CNode* pfrom, CTxIn& vin)
                 if (vin.IsNull() || vin == mn->vin) {
                     CMasternodeBroadcast mnb = CMasternodeBroadcast(*mn);
                     uint256 hash = mnb.GetHash();
-                    pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
+                    if (!pfilter || !pfilter->contains(hash)) pfrom->PushInventory(CInv(MSG_MASTERNODE_ANNOUNCE, hash));
                     nInvCount++;
 
                     if (!mapSeenMasternodeBroadcast.count(hash)) mapSeenMasternodeBroadcast.emplace(hash, mnb);
@@ -779,6 +943,32 @@ void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CData
     }
 }
 
+void CMasternodeMan::ProcessPreChecked(CConnman& connman)
+{
+    std::vector<CMasternodePreCheckQueue::Entry> vEntries = mnprecheckqueue.PopChecked();
+    if (vEntries.empty()) return;
+
+    std::vector<std::pair<NodeId, int>> vBanScores;
+    {
+        LOCK(cs_process_message);
+        for (CMasternodePreCheckQueue::Entry& entry : vEntries) {
+            CNode* pnode = nullptr;
+            connman.ForNode(entry.nodeid, [&pnode](CNode* p) { pnode = p->AddRef(); return true; });
+            // the peer is gone, the others will relay the message again
+            if (!pnode) continue;
+            const int banScore = entry.pmnb ? ProcessMNBroadcast(pnode, *entry.pmnb) : ProcessMNPing(pnode, *entry.pmnp);
+            if (banScore > 0) vBanScores.emplace_back(entry.nodeid, banScore);
+            pnode->Release();
+        }
+    }
+
+    if (!vBanScores.empty()) {
+        LOCK(cs_main);
+        for (const auto& p : vBanScores)
+            Misbehaving(p.first, p.second);
+    }
+}
+
 int CMasternodeMan::ProcessMessageInner(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return 0; //disable all Masternode related functionality
@@ -789,6 +979,9 @@ int CMasternodeMan::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
     if (strCommand == NetMsgType::MNBROADCAST) {
         CMasternodeBroadcast mnb;
         vRecv >> mnb;
+        // the signatures are checked on the pre-check workers, unless the queue is full
+        if (!mapSeenMasternodeBroadcast.count(mnb.GetHash()) && mnprecheckqueue.Push(mnb, pfrom->GetId()))
+            return 0;
         return ProcessMNBroadcast(pfrom, mnb);
 
     } else if (strCommand == NetMsgType::MNPING) {
@@ -796,13 +989,17 @@ int CMasternodeMan::ProcessMessageInner(CNode* pfrom, std::string& strCommand, C
         CMasternodePing mnp;
         vRecv >> mnp;
         LogPrint(BCLog::MNPING, "mnp - Masternode ping, vin: %s\n", mnp.vin.prevout.hash.ToString());
+        if (!mapSeenMasternodePing.count(mnp.GetHash()) && mnprecheckqueue.Push(mnp, pfrom->GetId()))
+            return 0;
         return ProcessMNPing(pfrom, mnp);
 
     } else if (strCommand == NetMsgType::GETMNLIST) {
         //Get Masternode list or specific entry
         CTxIn vin;
         vRecv >> vin;
-        return ProcessGetMNList(pfrom, vin);
+        Optional<CBloomFilter> filter;
+        if (!ReadSyncFilter(vRecv, filter)) return 100;
+        return ProcessGetMNList(pfrom, vin, filter.get_ptr());
     }
     // Nothing to report
     return 0;
@@ -813,7 +1010,10 @@ void CMasternodeMan::Remove(const COutPoint& collateralOut)
     LOCK(cs);
     const auto it = mapMasternodes.find(collateralOut);
     if (it != mapMasternodes.end()) {
+        UnindexMasternode(*it->second);
         mapMasternodes.erase(it);
+        ClearScoresCache();
+        GetMainSignals().MasternodeListChanged(collateralOut, false);
     }
 }
 
@@ -834,9 +1034,9 @@ void CMasternodeMan::UpdateMasternodeList(CMasternodeBroadcast& mnb)
     }
 }
 
-int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading) const
+int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const std::map<CScript, int64_t>& mapLastPaid) const
 {
-    int64_t sec = (GetAdjustedTime() - GetLastPaid(mn, BlockReading));
+    int64_t sec = (GetAdjustedTime() - GetLastPaid(mn, mapLastPaid));
     int64_t month = 60 * 60 * 24 * 30;
     if (sec < month) return sec; //if it's less than 30 days, give seconds
 
@@ -849,6 +1049,41 @@ int64_t CMasternodeMan::SecondsSincePayment(const MasternodeRef& mn, const CBloc
     return month + hash.GetCompact(false);
 }
 
+void CMasternodeMan::GetLastPaidTimes(const CBlockIndex* BlockReading, std::map<CScript, int64_t>& mapLastPaid) const
+{
+    if (BlockReading == nullptr) return;
+
+    int nMnCount = CountEnabled() * 1.25;
+    for (int n = 0; n < nMnCount; n++) {
+        const auto& it = masternodePayments.mapMasternodeBlocks.find(BlockReading->nHeight);
+        if (it != masternodePayments.mapMasternodeBlocks.end()) {
+            // The payees with at least 2 votes, the most recent block wins
+            for (const CScript& payee : it->second.GetPayeesWithVotes(2))
+                mapLastPaid.emplace(payee, BlockReading->nTime);
+        }
+        BlockReading = BlockReading->pprev;
+
+        if (BlockReading == nullptr || BlockReading->nHeight <= 0) {
+            break;
+        }
+    }
+}
+
+int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, const std::map<CScript, int64_t>& mapLastPaid) const
+{
+    const auto& it = mapLastPaid.find(GetScriptForDestination(mn->pubKeyCollateralAddress.GetID()));
+    if (it == mapLastPaid.end()) return 0;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << mn->vin;
+    ss << mn->sigTime;
+    uint256 hash = ss.GetHash();
+
+    // use a deterministic offset to break a tie -- 2.5 minutes
+    int64_t nOffset = hash.GetCompact(false) % 150;
+    return it->second + nOffset;
+}
+
 int64_t CMasternodeMan::GetLastPaid(const MasternodeRef& mn, const CBlockIndex* BlockReading) const
 {
     if (BlockReading == nullptr) return false;
@@ -893,14 +1128,37 @@ std::string CMasternodeMan::ToString() const
     return info.str();
 }
 
-void CMasternodeMan::CacheBlockHash(const CBlockIndex* pindex)
+size_t CMasternodeMan::DynamicMemoryUsage() const
 {
-    cvLastBlockHashes.Set(pindex->nHeight, pindex->GetBlockHash());
+    LOCK(cs);
+    size_t nUsage = memusage::DynamicUsage(mapMasternodes);
+    for (const auto& it : mapMasternodes) {
+        nUsage += memusage::DynamicUsage(it.second) + it.second->DynamicMemoryUsage();
+    }
+    nUsage += memusage::DynamicUsage(mapSeenMasternodeBroadcast);
+    for (const auto& it : mapSeenMasternodeBroadcast) nUsage += it.second.DynamicMemoryUsage();
+    nUsage += memusage::DynamicUsage(mapSeenMasternodePing);
+    for (const auto& it : mapSeenMasternodePing) nUsage += it.second.DynamicMemoryUsage();
+    nUsage += memusage::DynamicUsage(mapScoresCache);
+    for (const auto& it : mapScoresCache) {
+        nUsage += memusage::DynamicUsage(it.second) + memusage::DynamicUsage(*it.second);
+    }
+    nUsage += memusage::DynamicUsage(mAskedUsForMasternodeList) +
+              memusage::DynamicUsage(mWeAskedForMasternodeList) +
+              memusage::DynamicUsage(mWeAskedForMasternodeListEntry) +
+              memusage::DynamicUsage(setPubKeyMasternodes) +
+              memusage::DynamicUsage(mapCheckDeadlines) +
+              memusage::DynamicUsage(setCheckDeadlines) +
+              memusage::DynamicUsage(setChangedMasternodes) +
+              memusage::DynamicUsage(mapEnabledCounts);
+    return nUsage;
 }
 
-void CMasternodeMan::UncacheBlockHash(const CBlockIndex* pindex)
+static_assert(CACHED_BLOCK_HASHES == CChainTipSnapshot::LAST_HASHES, "the masternode manager reads the block hashes from the tip snapshot");
+
+int CMasternodeMan::GetBestHeight() const
 {
-    cvLastBlockHashes.Set(pindex->nHeight, UINT256_ZERO);
+    return GetChainTipSnapshot()->nHeight;
 }
 
 uint256 CMasternodeMan::GetHashAtHeight(int nHeight) const
@@ -910,20 +1168,20 @@ uint256 CMasternodeMan::GetHashAtHeight(int nHeight) const
         LogPrint(BCLog::MASTERNODE, "%s: Negative height. Returning 0\n",  __func__);
         return UINT256_ZERO;
     }
-    int nCurrentHeight = GetBestHeight();
-    if (nHeight > nCurrentHeight) {
+    const ChainTipSnapshotRef tip = GetChainTipSnapshot();
+    if (nHeight > tip->nHeight) {
         LogPrint(BCLog::MASTERNODE, "%s: height %d over current height %d. Returning 0\n",
-                __func__, nHeight, nCurrentHeight);
+                __func__, nHeight, tip->nHeight);
         return UINT256_ZERO;
     }
 
-    if (nHeight > nCurrentHeight - (int) CACHED_BLOCK_HASHES) {
-        // Use cached hash
-        return cvLastBlockHashes.Get(nHeight);
+    if (nHeight > tip->nHeight - (int) CACHED_BLOCK_HASHES) {
+        // Use the last hashes of the snapshot
+        return tip->GetLastHash(nHeight);
     } else {
-        // Use chainActive
-        LOCK(cs_main);
-        return chainActive[nHeight]->GetBlockHash();
+        // Use the chain snapshot, without cs_main
+        const CBlockIndex* pindex = chainActive.AtHeightSnapshot(nHeight);
+        return pindex ? pindex->GetBlockHash() : UINT256_ZERO;
     }
 }
 
@@ -937,15 +1195,24 @@ bool CMasternodeMan::IsWithinDepth(const uint256& nHash, int depth) const
         return error("%s: Invalid depth %d. Cached block hashes: %d\n", __func__, depth, CACHED_BLOCK_HASHES);
     }
     // Check last depth blocks to find one with matching hash
-    const int nCurrentHeight = GetBestHeight();
-    int nStopHeight = std::max(0, nCurrentHeight - depth);
-    for (int i = nCurrentHeight; i >= nStopHeight; i--) {
-        if (GetHashAtHeight(i) == nHash)
+    const ChainTipSnapshotRef tip = GetChainTipSnapshot();
+    for (int i = 0; i <= depth && i < (int) tip->vLastHashes.size(); i++) {
+        if (tip->vLastHashes[i] == nHash)
             return true;
     }
     return false;
 }
 
+std::vector<uint256> CMasternodeMan::GetCachedBlocks() const
+{
+    std::vector<uint256> vHashes(CACHED_BLOCK_HASHES, UINT256_ZERO);
+    const ChainTipSnapshotRef tip = GetChainTipSnapshot();
+    for (int i = 0; i < (int) tip->vLastHashes.size(); i++) {
+        vHashes[(tip->nHeight - i) % CACHED_BLOCK_HASHES] = tip->vLastHashes[i];
+    }
+    return vHashes;
+}
+
 void ThreadCheckMasternodes()
 {
     if (fLiteMode) return; //disable all Masternode related functionality
@@ -983,6 +1250,13 @@ void ThreadCheckMasternodes()
                 if (c % (MasternodePingSeconds()/5) == 0) {
                     masternodePayments.CleanPaymentList(mnodeman.CheckAndRemove(), mnodeman.GetBestHeight());
                 }
+
+                // only the changes since the previous dump are written
+                if (c % MASTERNODES_DUMP_SECONDS == 0) {
+                    DumpMasternodes();
+                    DumpBudgets(g_budgetman);
+                    DumpMasternodePayments();
+                }
             }
         }
     } catch (boost::thread_interrupted&) {
@@ -10,28 +10,33 @@
 
 #include "activemasternode.h"
 #include "base58.h"
-#include "cyclingvector.h"
 #include "key.h"
 #include "masternode.h"
 #include "net.h"
 #include "sync.h"
 #include "util.h"
 
+#include <array>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_SWEEP_SECONDS (10 * 60)
 
-/** Maximum number of block hashes to cache */
+/** Number of the last block hashes in the chain tip snapshot (CChainTipSnapshot::LAST_HASHES) */
 static const unsigned int CACHED_BLOCK_HASHES = 200;
+/** Maximum number of per block hash score tables to cache */
+static const unsigned int CACHED_SCORE_TABLES = 256;
 
 class CMasternodeMan;
 class CActiveMasternode;
+class CTierTwoDB;
 
 extern CMasternodeMan mnodeman;
 extern CActiveMasternode activeMasternode;
 
 void DumpMasternodes();
 
-/** Access to the MN database (mncache.dat)
+/** Access to the former MN database (mncache.dat), read once to fill the tier two database
  */
 class CMasternodeDB
 {
@@ -51,13 +56,24 @@ public:
     };
 
     CMasternodeDB();
-    bool Write(const CMasternodeMan& mnodemanToSave);
     ReadResult Read(CMasternodeMan& mnodemanToLoad);
 };
 
 //
 typedef std::shared_ptr<CMasternode> MasternodeRef;
 
+/** Score of a masternode for a given block hash */
+struct CMasternodeScore {
+    uint256 score;
+    // compact form of the score, used to rank the masternodes
+    int64_t nScore;
+    MasternodeRef mn;
+};
+
+/** Every known masternode, sorted from the highest to the lowest nScore */
+typedef std::vector<CMasternodeScore> MasternodeScores;
+typedef std::shared_ptr<const MasternodeScores> MasternodeScoresRef;
+
 class CMasternodeMan
 {
 private:
@@ -76,14 +92,51 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
-    // Memory Only. Updated in NewBlock (blocks arrive in order)
-    std::atomic<int> nBestHeight;
-
-    // Memory Only. Cache last block hashes. Used to verify mn pings and winners.
-    CyclingVector<uint256> cvLastBlockHashes;
+    // Memory Only. Sorted masternode scores, per block hash. Cleared on every list change.
+    mutable std::map<uint256, MasternodeScoresRef> mapScoresCache;
+
+    // Memory Only. Secondary indexes of mapMasternodes, updated with it:
+    // the (masternode key, collateral) pairs, and the masternode count per network.
+    std::set<std::pair<CPubKey, COutPoint>> setPubKeyMasternodes;
+    std::array<int, NET_MAX> vNetworkCounts{};
+
+    // Memory Only. When each masternode can become removable at the earliest
+    // (the expiry of its last ping), by collateral and in time order, so that
+    // CheckAndRemove only looks at the masternodes past their deadline.
+    std::map<COutPoint, int64_t> mapCheckDeadlines;
+    std::set<std::pair<int64_t, COutPoint>> setCheckDeadlines;
+    // Memory Only. The collaterals of the masternodes added, changed or removed since the last FlushToDB
+    std::set<COutPoint> setChangedMasternodes;
+    // Memory Only. The active protocol at the last CheckAndRemove, and the last sweep of the expired requests and messages
+    int nLastCheckedProtocol{0};
+    int64_t nLastSweepTime{0};
+
+    // Memory Only. CountEnabled results per protocol version, for the second
+    // they were computed at. Cleared on every list change.
+    mutable std::map<int, int> mapEnabledCounts;
+    mutable int64_t nEnabledCountsTime{0};
+
+    // Memory Only. The confirmation heights of the collaterals deep enough to
+    // be paid, by collateral, so that the payment queue does not look them up
+    // in the coins cache on every block. Dropped with the masternode.
+    mutable std::map<COutPoint, int> mapCollateralHeights;
+
+    // Drop the cached score tables and counts (the masternode list changed)
+    void ClearScoresCache() const;
+    // (Re)schedule the removal check of a masternode of mapMasternodes, or drop it
+    void ScheduleCheck(const CMasternode& mn);
+    void UnscheduleCheck(const COutPoint& collateralOut);
+    // Add/remove a masternode of mapMasternodes to/from the secondary indexes
+    void IndexMasternode(const CMasternode& mn);
+    void UnindexMasternode(const CMasternode& mn);
+    // Rebuild the secondary indexes from mapMasternodes
+    void RebuildIndexes();
+    // Return the (cached) score table for the given block hash
+    MasternodeScoresRef GetScores(const uint256& hash) const;
 
     // Return the banning score (0 if no ban score increase is needed).
     int ProcessMNBroadcast(CNode* pfrom, CMasternodeBroadcast& mnb);
+    int ProcessMNBroadcastInner(CNode* pfrom, CMasternodeBroadcast& mnb);
     int ProcessMNPing(CNode* pfrom, CMasternodePing& mnp);
     int ProcessMessageInner(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
 
@@ -104,6 +157,10 @@ public:
     {
         LOCK(cs);
         READWRITE(mapMasternodes);
+        if (ser_action.ForRead()) {
+            ClearScoresCache();
+            RebuildIndexes();
+        }
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
         READWRITE(mWeAskedForMasternodeListEntry);
@@ -121,14 +178,14 @@ public:
     /// Ask (source) node for mnb
     void AskForMN(CNode* pnode, const CTxIn& vin);
 
-    /// Check all Masternodes and remove inactive. Return the total masternode count.
+    /// Check the Masternodes past their ping deadline (all of them on a protocol change) and remove inactive. Return the total masternode count.
     int CheckAndRemove(bool forceExpiredRemoval = false);
 
     /// Clear Masternode vector
     void Clear();
 
-    void SetBestHeight(int height) { nBestHeight.store(height, std::memory_order_release); };
-    int GetBestHeight() const { return nBestHeight.load(std::memory_order_acquire); }
+    /// The height of the chain tip snapshot
+    int GetBestHeight() const;
 
     int CountEnabled(int protocolVersion = -1) const;
 
@@ -159,31 +216,51 @@ public:
     int GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol = 0, bool fOnlyActive = true) const;
 
     void ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
+    /// Process the broadcasts and pings of mnprecheckqueue whose signers are recovered, in arrival order
+    void ProcessPreChecked(CConnman& connman);
 
-    // Process GETMNLIST message, returning the banning score (if 0, no ban score increase is needed)
-    int ProcessGetMNList(CNode* pfrom, CTxIn& vin);
+    // Process GETMNLIST message, returning the banning score (if 0, no ban score increase is needed).
+    // The broadcasts matching pfilter (known by the peer) are counted, but not announced.
+    int ProcessGetMNList(CNode* pfrom, CTxIn& vin, const CBloomFilter* pfilter = nullptr);
 
     /// Return the number of Masternodes older than (default) 8000 seconds
     int stable_size() const;
 
     std::string ToString() const;
 
+    /// Memory used by the masternode list, the seen broadcasts and pings and the indexes
+    size_t DynamicMemoryUsage() const;
+
     void Remove(const COutPoint& collateralOut);
 
     /// Update masternode list and maps using provided CMasternodeBroadcast
     void UpdateMasternodeList(CMasternodeBroadcast& mnb);
 
+    /// Record a new ping of a listed masternode, for the next flush
+    void SetPinged(const COutPoint& collateralOut);
+
+    /// Load the masternode list saved in the tier two database
+    bool LoadFromDB(CTierTwoDB& db);
+    /// Write the masternodes changed since the last flush to the tier two database
+    bool FlushToDB(CTierTwoDB& db);
+
+    /// Update the secondary indexes and the removal check after a listed masternode took a new broadcast
+    void UpdateIndexes(const CMasternode& mn, const CPubKey& pubKeyMasternodeOld, const CService& addrOld);
+
     /// Get the time a masternode was last paid
     int64_t GetLastPaid(const MasternodeRef& mn, const CBlockIndex* BlockReading) const;
-    int64_t SecondsSincePayment(const MasternodeRef& mn, const CBlockIndex* BlockReading) const;
+    /// Get the time a masternode was last paid, out of the times of GetLastPaidTimes
+    int64_t GetLastPaid(const MasternodeRef& mn, const std::map<CScript, int64_t>& mapLastPaid) const;
+    int64_t SecondsSincePayment(const MasternodeRef& mn, const std::map<CScript, int64_t>& mapLastPaid) const;
+    /// The last time each payee was paid in the blocks GetLastPaid looks back at, in one pass
+    void GetLastPaidTimes(const CBlockIndex* BlockReading, std::map<CScript, int64_t>& mapLastPaid) const;
 
-    // Block hashes cycling vector management
-    void CacheBlockHash(const CBlockIndex* pindex);
-    void UncacheBlockHash(const CBlockIndex* pindex);
+    // Block hashes, read from the chain tip snapshot (used to verify mn pings and winners)
     uint256 GetHashAtHeight(int nHeight) const;
     bool IsWithinDepth(const uint256& nHash, int depth) const;
     uint256 GetBlockHashToPing() const { return GetHashAtHeight(GetBestHeight() - MNPING_DEPTH); }
-    std::vector<uint256> GetCachedBlocks() const { return cvLastBlockHashes.GetCache(); }
+    /// The last CACHED_BLOCK_HASHES hashes, indexed by height modulo CACHED_BLOCK_HASHES
+    std::vector<uint256> GetCachedBlocks() const;
 };
 
 void ThreadCheckMasternodes();
@@ -7,12 +7,15 @@
 
 #include "indirectmap.h"
 #include "prevector.h"
+#include "support/allocators/pool.h"
 
 #include <stdlib.h>
 
+#include <list>
 #include <map>
 #include <memory>
 #include <set>
+#include <string>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
@@ -47,11 +50,14 @@ template<typename X, typename Y> static inline size_t DynamicUsage(std::pair<X,
  *  updating on modification.
  */
 template<typename X> static size_t DynamicUsage(const std::vector<X>& v);
+template<typename X> static size_t DynamicUsage(const std::list<X>& l);
 template<typename X> static size_t DynamicUsage(const std::set<X>& s);
 template<typename X, typename Y> static size_t DynamicUsage(const std::map<X, Y>& m);
+static size_t DynamicUsage(const std::string& s);
 template<typename X> static size_t DynamicUsage(const X& x);
 
 template<typename X> static size_t RecursiveDynamicUsage(const std::vector<X>& v);
+template<typename X> static size_t RecursiveDynamicUsage(const std::list<X>& l);
 template<typename X> static size_t RecursiveDynamicUsage(const std::set<X>& v);
 template<typename X, typename Y> static size_t RecursiveDynamicUsage(const std::map<X, Y>& v);
 template<typename X, typename Y> static size_t RecursiveDynamicUsage(const std::pair<X, Y>& v);
@@ -109,6 +115,37 @@ static inline size_t RecursiveDynamicUsage(const std::vector<X>& v)
     return usage;
 }
 
+template<typename X>
+struct stl_list_node
+{
+private:
+    void* next;
+    void* prev;
+    X x;
+};
+
+template<typename X>
+static inline size_t DynamicUsage(const std::list<X>& l)
+{
+    return MallocUsage(sizeof(stl_list_node<X>)) * l.size();
+}
+
+template<typename X>
+static inline size_t RecursiveDynamicUsage(const std::list<X>& l)
+{
+    size_t usage = DynamicUsage(l);
+    for (const X& x : l) {
+        usage += RecursiveDynamicUsage(x);
+    }
+    return usage;
+}
+
+static inline size_t DynamicUsage(const std::string& s)
+{
+    // The short strings are stored in the object itself
+    return s.capacity() > std::string().capacity() ? MallocUsage(s.capacity() + 1) : 0;
+}
+
 template<unsigned int N, typename X, typename S, typename D>
 static inline size_t DynamicUsage(const prevector<N, X, S, D>& v)
 {
@@ -149,6 +186,12 @@ static inline size_t DynamicUsage(const std::map<X, Y>& m)
     return MallocUsage(sizeof(stl_tree_node<std::pair<const X, Y> >)) * m.size();
 }
 
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const std::multimap<X, Y, Z>& m)
+{
+    return MallocUsage(sizeof(stl_tree_node<std::pair<const X, Y> >)) * m.size();
+}
+
 template<typename X, typename Y>
 static inline size_t RecursiveDynamicUsage(const std::map<X, Y>& v)
 {
@@ -221,6 +264,14 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename P, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, P, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    // The nodes live in the pool chunks, whether they are in use or on a free list
+    const auto& resource = m.get_allocator().GetResource();
+    return MallocUsage(resource->ChunkSizeBytes()) * resource->NumAllocatedChunks() + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 // Dispatch to class method as fallback
 
 template<typename X>
@@ -37,25 +37,52 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
-uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256>& vTxid)
+CFilteredBlockData::CFilteredBlockData(const std::shared_ptr<const CBlock>& pblockIn) : pblock(pblockIn)
 {
-    if (height == 0) {
-        // hash at height 0 is the txids themself
-        return vTxid[pos];
-    } else {
-        // calculate left hash
-        uint256 left = CalcHash(height - 1, pos * 2, vTxid), right;
-        // calculate right hash if not beyond the end of the array - copy left hash otherwise1
-        if (pos * 2 + 1 < CalcTreeWidth(height - 1))
-            right = CalcHash(height - 1, pos * 2 + 1, vTxid);
-        else
-            right = left;
-        // combine subhashes
-        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+    std::vector<uint256> vHashes;
+    vHashes.reserve(pblock->vtx.size());
+    vTxs.reserve(pblock->vtx.size());
+    for (const CTransactionRef& tx : pblock->vtx) {
+        vTxs.emplace_back(*tx);
+        vHashes.push_back(tx->GetHash());
+    }
+    vMerkleLevels = CPartialMerkleTree::CalcLevels(vHashes);
+}
+
+CMerkleBlock::CMerkleBlock(const CFilteredBlockData& blockData, CBloomFilter& filter)
+{
+    header = blockData.pblock->GetBlockHeader();
+
+    std::vector<bool> vMatch(blockData.vTxs.size(), false);
+    for (unsigned int i = 0; i < blockData.vTxs.size(); i++) {
+        if (filter.IsRelevantAndUpdate(blockData.vTxs[i])) {
+            vMatch[i] = true;
+            vMatchedTxn.emplace_back(i, blockData.vTxs[i].hash);
+        }
     }
+
+    txn = CPartialMerkleTree(blockData.vMerkleLevels, vMatch);
+}
+
+std::vector<std::vector<uint256>> CPartialMerkleTree::CalcLevels(const std::vector<uint256>& vTxid)
+{
+    std::vector<std::vector<uint256>> vLevels(1, vTxid);
+    while (vLevels.back().size() > 1) {
+        const std::vector<uint256>& vBelow = vLevels.back();
+        std::vector<uint256> vLevel;
+        vLevel.reserve((vBelow.size() + 1) / 2);
+        for (size_t pos = 0; pos < vBelow.size(); pos += 2) {
+            // the last node of an odd level is paired with itself
+            const uint256& left = vBelow[pos];
+            const uint256& right = pos + 1 < vBelow.size() ? vBelow[pos + 1] : left;
+            vLevel.push_back(Hash(BEGIN(left), END(left), BEGIN(right), END(right)));
+        }
+        vLevels.emplace_back(std::move(vLevel));
+    }
+    return vLevels;
 }
 
-void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256>& vTxid, const std::vector<bool>& vMatch)
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<std::vector<uint256>>& vLevels, const std::vector<bool>& vMatch)
 {
     // determine whether this node is the parent of at least one matched txid
     bool fParentOfMatch = false;
@@ -65,12 +92,12 @@ void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const st
     vBits.push_back(fParentOfMatch);
     if (height == 0 || !fParentOfMatch) {
         // if at height 0, or nothing interesting below, store hash and stop
-        vHash.push_back(CalcHash(height, pos, vTxid));
+        vHash.push_back(vLevels[height][pos]);
     } else {
         // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height - 1, pos * 2, vTxid, vMatch);
+        TraverseAndBuild(height - 1, pos * 2, vLevels, vMatch);
         if (pos * 2 + 1 < CalcTreeWidth(height - 1))
-            TraverseAndBuild(height - 1, pos * 2 + 1, vTxid, vMatch);
+            TraverseAndBuild(height - 1, pos * 2 + 1, vLevels, vMatch);
     }
 }
 
@@ -106,6 +133,16 @@ uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, uns
 }
 
 CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256>& vTxid, const std::vector<bool>& vMatch) : nTransactions(vTxid.size()), fBad(false)
+{
+    Build(CalcLevels(vTxid), vMatch);
+}
+
+CPartialMerkleTree::CPartialMerkleTree(const std::vector<std::vector<uint256>>& vLevels, const std::vector<bool>& vMatch) : nTransactions(vLevels[0].size()), fBad(false)
+{
+    Build(vLevels, vMatch);
+}
+
+void CPartialMerkleTree::Build(const std::vector<std::vector<uint256>>& vLevels, const std::vector<bool>& vMatch)
 {
     // reset state
     vBits.clear();
@@ -117,7 +154,7 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256>& vTxid, const
         nHeight++;
 
     // traverse the partial tree
-    TraverseAndBuild(nHeight, 0, vTxid, vMatch);
+    TraverseAndBuild(nHeight, 0, vLevels, vMatch);
 }
 
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
@@ -13,6 +13,7 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <memory>
 #include <vector>
 
 /** Data structure that represents a partial merkle tree.
@@ -70,11 +71,10 @@ protected:
         return (nTransactions + (1 << height) - 1) >> height;
     }
 
-    /** calculate the hash of a node in the merkle tree (at leaf level: the txid's themselves) */
-    uint256 CalcHash(int height, unsigned int pos, const std::vector<uint256>& vTxid);
+    /** recursive function that traverses tree nodes, storing the data as bits and hashes (taken from the levels of the tree) */
+    void TraverseAndBuild(int height, unsigned int pos, const std::vector<std::vector<uint256>>& vLevels, const std::vector<bool>& vMatch);
 
-    /** recursive function that traverses tree nodes, storing the data as bits and hashes */
-    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256>& vTxid, const std::vector<bool>& vMatch);
+    void Build(const std::vector<std::vector<uint256>>& vLevels, const std::vector<bool>& vMatch);
 
     /**
      * recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
@@ -110,6 +110,12 @@ public:
     /** Construct a partial merkle tree from a list of transaction id's, and a mask that selects a subset of them */
     CPartialMerkleTree(const std::vector<uint256>& vTxid, const std::vector<bool>& vMatch);
 
+    /** Same, from the levels of the full tree computed by CalcLevels, to build many partial trees of a block */
+    CPartialMerkleTree(const std::vector<std::vector<uint256>>& vLevels, const std::vector<bool>& vMatch);
+
+    /** Every level of the merkle tree of the txids, from the txids themselves up to the root */
+    static std::vector<std::vector<uint256>> CalcLevels(const std::vector<uint256>& vTxid);
+
     CPartialMerkleTree();
 
     /**
@@ -120,6 +126,21 @@ public:
 };
 
 
+/**
+ * What the filtered blocks sent to the peers with a bloom filter are made of:
+ * the block, the items of its transactions (see CBloomFilterTx) and its merkle
+ * tree, computed once per block and shared by all those peers.
+ */
+class CFilteredBlockData
+{
+public:
+    const std::shared_ptr<const CBlock> pblock;
+    std::vector<CBloomFilterTx> vTxs;
+    std::vector<std::vector<uint256>> vMerkleLevels;
+
+    explicit CFilteredBlockData(const std::shared_ptr<const CBlock>& pblockIn);
+};
+
 /**
  * Used to relay blocks as header + vector<merkle branch>
  * to filtered nodes.
@@ -142,6 +163,9 @@ public:
      */
     CMerkleBlock(const CBlock& block, CBloomFilter& filter);
 
+    /** Same, from the data of the block shared by all the filtered peers */
+    CMerkleBlock(const CFilteredBlockData& blockData, CBloomFilter& filter);
+
     CMerkleBlock() {}
 
     ADD_SERIALIZE_METHODS;
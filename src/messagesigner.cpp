@@ -108,8 +108,40 @@ bool CSignedMessage::Sign(const std::string strSignKey)
     return Sign(key, pubkey.GetID());
 }
 
+uint256 CSignedMessage::GetSignedHash() const
+{
+    if (nMessVersion == MessageVersion::MESS_VER_HASH)
+        return GetSignatureHash();
+    return CMessageSigner::GetMessageHash(GetStrMessage());
+}
+
+static uint256 GetSignerRecoveryHash(const uint256& hash, const std::vector<unsigned char>& vchSig)
+{
+    return Hash(hash.begin(), hash.end(), vchSig.begin(), vchSig.end());
+}
+
+void CSignedMessage::PreCheckSignature() const
+{
+    const uint256 hash = GetSignedHash();
+    CPubKey pubkeyFromSig;
+    signerRecovered = pubkeyFromSig.RecoverCompact(hash, vchSig) ? pubkeyFromSig.GetID() : CKeyID();
+    hashSignerRecovered = GetSignerRecoveryHash(hash, vchSig);
+}
+
+bool CSignedMessage::GetRecoveredSigner(CKeyID& keyIDRet) const
+{
+    if (hashSignerRecovered.IsNull() || hashSignerRecovered != GetSignerRecoveryHash(GetSignedHash(), vchSig))
+        return false;
+    keyIDRet = signerRecovered;
+    return true;
+}
+
 bool CSignedMessage::CheckSignature(const CKeyID& keyID) const
 {
+    CKeyID keyIDRecovered;
+    if (GetRecoveredSigner(keyIDRecovered))
+        return !keyIDRecovered.IsNull() && keyIDRecovered == keyID;
+
     std::string strError = "";
 
     if (nMessVersion == MessageVersion::MESS_VER_HASH) {
@@ -9,6 +9,7 @@
 #define MESSAGESIGNER_H
 
 #include "key.h"
+#include "memusage.h"
 #include "primitives/transaction.h" // for CTxIn
 
 extern const std::string strMessageMagic;
@@ -55,6 +56,16 @@ class CSignedMessage
 protected:
     std::vector<unsigned char> vchSig;
 
+    // memory only: the key recovered from vchSig by PreCheckSignature, and
+    // the hash of the signed hash and signature it was recovered from
+    mutable uint256 hashSignerRecovered;
+    mutable CKeyID signerRecovered;
+
+    /// The hash the signature commits to
+    virtual uint256 GetSignedHash() const;
+    /// Get the key recovered by PreCheckSignature, false if the message changed since
+    bool GetRecoveredSigner(CKeyID& keyIDRet) const;
+
 public:
     int nMessVersion;
 
@@ -68,6 +79,8 @@ public:
     bool Sign(const CKey& key, const CKeyID& keyID);
     bool Sign(const std::string strSignKey);
     bool CheckSignature(const CKeyID& keyID) const;
+    /// Recover the signer ahead, on a worker thread, so that CheckSignature only compares the keys
+    void PreCheckSignature() const;
 
     // Pure virtual functions (used in Sign-Verify functions)
     // Must be implemented in child classes
@@ -78,6 +91,8 @@ public:
     void SetVchSig(const std::vector<unsigned char>& vchSigIn) { vchSig = vchSigIn; }
     std::vector<unsigned char> GetVchSig() const { return vchSig; }
     std::string GetSignatureBase64() const;
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(vchSig); }
 };
 
 #endif
@@ -16,9 +16,11 @@
 #include "blockassembler.h"
 #include "consensus/tx_verify.h" // needed in case of no ENABLE_WALLET
 #include "consensus/params.h"
+#include "kernel.h"
 #include "masternode-sync.h"
 #include "net.h"
 #include "policy/feerate.h"
+#include "pow.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "timedata.h"
@@ -47,7 +49,7 @@ std::unique_ptr<CBlockTemplate> CreateNewBlockWithKey(CReserveKey* reservekey, C
     if (!reservekey->GetReservedKey(pubkey))
         return nullptr;
 
-    const int nHeightNext = chainActive.Tip()->nHeight + 1;
+    const int nHeightNext = GetChainTipSnapshot()->nHeight + 1;
 
     // If we're building a late PoW block, don't continue
     // PoS blocks are built directly with CreateNewBlock
@@ -70,8 +72,10 @@ bool ProcessBlockFound(const std::shared_ptr<const CBlock>& pblock, CWallet& wal
     // Found a solution
     {
         WAIT_LOCK(g_best_block_mutex, lock);
-        if (pblock->hashPrevBlock != g_best_block)
+        if (pblock->hashPrevBlock != g_best_block) {
+            if (pblock->IsProofOfStake() && wallet.pStakerStatus) wallet.pStakerStatus->AddStaleTip();
             return error("DOGECMiner : generated block is stale");
+        }
     }
 
     // Remove key from key pool
@@ -92,21 +96,93 @@ bool ProcessBlockFound(const std::shared_ptr<const CBlock>& pblock, CWallet& wal
     return true;
 }
 
-bool fGenerateBitcoins = false;
-bool fStakeableCoins = false;
+std::unique_ptr<StakerScheduler> g_stakerscheduler;
 
-void CheckForCoins(CWallet* pwallet, std::vector<CStakeableOutput>* availableCoins)
+StakerScheduler::StakerScheduler(CWallet* pwallet)
 {
-    if (!pwallet || !pwallet->pStakerStatus)
-        return;
+    // A wallet transaction changed: new coins, or some of them spent
+    connTransactionChanged = pwallet->NotifyTransactionChanged.connect([this](CWallet*, const uint256&, ChangeType) {
+        Notify(false, true);
+    });
+    // The wallet was unlocked (or locked again)
+    connStatusChanged = pwallet->NotifyStatusChanged.connect([this](CCryptoKeyStore*) {
+        Notify(true, false);
+    });
+}
 
-    // control the amount of times the client will check for mintable coins (every block)
+void StakerScheduler::Notify(bool fWakeUpIn, bool fCoinsChangedIn)
+{
     {
-        WAIT_LOCK(g_best_block_mutex, lock);
-        if (g_best_block == pwallet->pStakerStatus->GetLastHash())
-            return;
+        LOCK(cs);
+        fWakeUp |= fWakeUpIn;
+        fCoinsChanged |= fCoinsChangedIn;
     }
-    fStakeableCoins = pwallet->StakeableCoins(availableCoins);
+    if (fWakeUpIn)
+        condWakeUp.notify_all();
+}
+
+void StakerScheduler::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    // The coins mature with the new blocks too
+    Notify(true, true);
+}
+
+void StakerScheduler::Interrupt()
+{
+    {
+        LOCK(cs);
+        fInterrupted = true;
+    }
+    condWakeUp.notify_all();
+}
+
+bool StakerScheduler::CoinsChanged()
+{
+    LOCK(cs);
+    const bool fRet = fCoinsChanged;
+    fCoinsChanged = false;
+    return fRet;
+}
+
+void StakerScheduler::WaitForWork(int64_t nMaxWaitMillis)
+{
+    boost::this_thread::interruption_point();
+
+    // Until the first second of the next time slot
+    const int64_t nNow = GetAdjustedTime();
+    const int64_t nNextSlot = GetTimeSlot(nNow) + Params().GetConsensus().nTimeSlotLength;
+    const int64_t nWaitMillis = std::min(nMaxWaitMillis, (nNextSlot - nNow) * 1000 - GetTimeMillis() % 1000);
+    {
+        WAIT_LOCK(cs, lock);
+        condWakeUp.wait_for(lock, std::chrono::milliseconds(std::max(nWaitMillis, (int64_t) 0)), [this] {
+            AssertLockHeld(cs);
+            return fWakeUp || fInterrupted;
+        });
+        fWakeUp = false;
+    }
+
+    boost::this_thread::interruption_point();
+}
+
+bool fGenerateBitcoins = false;
+bool fStakeableCoins = false;
+
+//! Returns whether the coins were listed again
+bool CheckForCoins(CWallet* pwallet, std::vector<CStakeableOutput>* availableCoins)
+{
+    if (!pwallet || !pwallet->pStakerStatus || !g_stakerscheduler)
+        return false;
+
+    // The coins are listed again only after a new tip, or a change of the wallet transactions
+    if (g_stakerscheduler->CoinsChanged()) {
+        const int64_t nStart = GetTimeMicros();
+        fStakeableCoins = pwallet->StakeableCoins(availableCoins);
+        pwallet->pStakerStatus->SetRefreshTime(GetTimeMicros() - nStart);
+        LogPrint(BCLog::STAKING, "%s: %d stakeable coins listed in %.2fms\n", __func__,
+                 availableCoins ? availableCoins->size() : 0, pwallet->pStakerStatus->GetRefreshTime() * 0.001);
+        return true;
+    }
+    return false;
 }
 
 void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
@@ -125,6 +201,9 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
 
     // Available UTXO set
     std::vector<CStakeableOutput> availableCoins;
+    // Their kernels hashed ahead of time
+    CStakeKernelSchedule kernelSchedule;
+    const int nStakeLookahead = std::max(0, (int) gArgs.GetArg("-stakelookahead", DEFAULT_STAKE_LOOKAHEAD));
     unsigned int nExtraNonce = 0;
 
     while (fGenerateBitcoins || fProofOfStake) {
@@ -141,23 +220,54 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             }
 
             // update fStakeableCoins
-            CheckForCoins(pwallet, &availableCoins);
+            if (CheckForCoins(pwallet, &availableCoins))
+                kernelSchedule.SetNull();
 
             while ((g_connman && g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && Params().MiningRequiresPeers())
                     || pwallet->IsLocked() || !fStakeableCoins || masternodeSync.NotCompleted()) {
-                MilliSleep(5000);
+                // The peers and the sync are polled, the rest wakes the staker up
+                g_stakerscheduler->WaitForWork(5000);
                 // Do another check here to ensure fStakeableCoins is updated
-                if (!fStakeableCoins) CheckForCoins(pwallet, &availableCoins);
+                if (CheckForCoins(pwallet, &availableCoins))
+                    kernelSchedule.SetNull();
             }
 
             //search our map of hashed blocks, see if bestblock has been hashed yet
             if (pwallet->pStakerStatus &&
                     pwallet->pStakerStatus->GetLastHash() == pindexPrev->GetBlockHash() &&
                     pwallet->pStakerStatus->GetLastTime() >= GetCurrentTimeSlot()) {
-                MilliSleep(2000);
+                // Until the next tip or time slot
+                g_stakerscheduler->WaitForWork(nSpacingMillis);
                 continue;
             }
 
+            // The kernels of the next slots hashed once per tip (and list of coins), the
+            // block only being built in the slots where one of them meets the target
+            if (nStakeLookahead > 0 && !Params().IsRegTestNet() && CStakeKernelSearch::IsSupported(pindexPrev)) {
+                const unsigned int nBits = GetNextWorkRequired(pindexPrev, nullptr);
+                const int64_t nTimeSlot = GetStakeTime();
+                if (!kernelSchedule.Covers(pindexPrev, nBits, nTimeSlot)) {
+                    const int64_t nStart = GetTimeMicros();
+                    kernelSchedule.Compute(pindexPrev, nBits, nTimeSlot, nStakeLookahead, availableCoins,
+                                           gArgs.GetArg("-stakethreads", DEFAULT_STAKE_THREADS));
+                    LogPrint(BCLog::STAKING, "%s: kernels of %d coins hashed for %d slots in %.2fms\n", __func__,
+                             availableCoins.size(), nStakeLookahead, (GetTimeMicros() - nStart) * 0.001);
+                }
+                if (!kernelSchedule.HasWinner(nTimeSlot)) {
+                    // Attempted, as far as the staker status goes
+                    CStakerStatus* ss = pwallet->pStakerStatus;
+                    const int64_t nLastTime = ss->GetLastTime();
+                    if (nLastTime > 0 && nTimeSlot > nLastTime + consensus.nTimeSlotLength)
+                        ss->AddMissedSlots((nTimeSlot - nLastTime) / consensus.nTimeSlotLength - 1);
+                    ss->SetLastTip(pindexPrev);
+                    ss->SetLastCoins((int) availableCoins.size());
+                    ss->SetLastTries((int) availableCoins.size());
+                    ss->SetLastTime(nTimeSlot);
+                    g_stakerscheduler->WaitForWork(nSpacingMillis);
+                    continue;
+                }
+            }
+
         } else if (pindexPrev->nHeight > 6 && consensus.NetworkUpgradeActive(pindexPrev->nHeight - 6, Consensus::UPGRADE_POS)) {
             // Late PoW: run for a little while longer, just in case there is a rewind on the chain.
             LogPrintf("%s: Exiting PoW Mining Thread at height: %d\n", __func__, pindexPrev->nHeight);
@@ -170,7 +280,7 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         unsigned int nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
 
         std::unique_ptr<CBlockTemplate> pblocktemplate((fProofOfStake ?
-                                                        BlockAssembler(Params(), DEFAULT_PRINTPRIORITY).CreateNewBlock(CScript(), pwallet, true, &availableCoins) :
+                                                        BlockAssembler(Params(), DEFAULT_PRINTPRIORITY).CreateNewBlock(CScript(), pwallet, true, &availableCoins, &kernelSchedule) :
                                                         CreateNewBlockWithKey(opReservekey.get_ptr(), pwallet)));
         if (!pblocktemplate) continue;
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>(pblocktemplate->block);
@@ -179,7 +289,14 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
         if (fProofOfStake) {
             LogPrintf("%s : proof-of-stake block was signed %s \n", __func__, pblock->GetHash().ToString().c_str());
             SetThreadPriority(THREAD_PRIORITY_NORMAL);
-            if (!ProcessBlockFound(pblock, *pwallet, opReservekey)) {
+            const int64_t nProcessStart = GetTimeMicros();
+            const bool fProcessed = ProcessBlockFound(pblock, *pwallet, opReservekey);
+            CStakerStatus* ss = pwallet->pStakerStatus;
+            ss->SetProcessTime(GetTimeMicros() - nProcessStart);
+            LogPrint(BCLog::STAKING, "%s: timings (ms) refresh=%.2f kernel=%.2f template=%.2f sign=%.2f process=%.2f\n", __func__,
+                     ss->GetRefreshTime() * 0.001, ss->GetKernelTime() * 0.001, ss->GetTemplateTime() * 0.001,
+                     ss->GetSignTime() * 0.001, ss->GetProcessTime() * 0.001);
+            if (!fProcessed) {
                 LogPrintf("%s: New block orphaned\n", __func__);
                 continue;
             }
@@ -254,7 +371,7 @@ void BitcoinMiner(CWallet* pwallet, bool fProofOfStake)
             if (    (g_connman && g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0 && Params().MiningRequiresPeers()) || // Regtest mode doesn't require peers
                     (pblock->nNonce >= 0xffff0000) ||
                     (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 60) ||
-                    (pindexPrev != chainActive.Tip())
+                    (pindexPrev != GetChainTip())
                 ) break;
 
             // Update nTime every few seconds
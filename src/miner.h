@@ -10,9 +10,15 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "sync.h"
+#include "validationinterface.h"
 
+#include <condition_variable>
+#include <memory>
 #include <stdint.h>
 
+#include <boost/signals2/connection.hpp>
+
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
@@ -33,6 +39,43 @@ static const bool DEFAULT_PRINTPRIORITY = false;
 
     void BitcoinMiner(CWallet* pwallet, bool fProofOfStake);
     void ThreadStakeMinter();
+
+/**
+ * Wakes the staker as soon as there is something new to stake on: a new tip, the
+ * start of the next time slot, or the wallet being unlocked. Tracks the changes
+ * of the wallet transactions, so that the stakeable coins are listed again only
+ * when they may have changed.
+ */
+class StakerScheduler : public CValidationInterface
+{
+public:
+    explicit StakerScheduler(CWallet* pwallet);
+
+    /** Wait for a new tip, the next time slot or nMaxWaitMillis, whichever comes first. Interruption point. */
+    void WaitForWork(int64_t nMaxWaitMillis);
+    /** Whether the stakeable coins may have changed since the last call */
+    bool CoinsChanged();
+    /** Wake the staker up for good, after the interruption of its thread */
+    void Interrupt();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+
+private:
+    Mutex cs;
+    std::condition_variable condWakeUp;
+    bool fWakeUp GUARDED_BY(cs){false};
+    bool fInterrupted GUARDED_BY(cs){false};
+    bool fCoinsChanged GUARDED_BY(cs){true};
+
+    boost::signals2::scoped_connection connTransactionChanged;
+    boost::signals2::scoped_connection connStatusChanged;
+
+    void Notify(bool fWakeUpIn, bool fCoinsChangedIn);
+};
+
+/** The scheduler of the staker thread, null if it isn't running */
+extern std::unique_ptr<StakerScheduler> g_stakerscheduler;
 #endif // ENABLE_WALLET
 
 extern double dHashesPerSec;
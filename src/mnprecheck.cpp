@@ -0,0 +1,106 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mnprecheck.h"
+
+#include "logging.h"
+#include "util/threadnames.h"
+
+#include <boost/thread.hpp>
+
+CMasternodePreCheckQueue mnprecheckqueue(MAX_MN_PRECHECK_QUEUE);
+
+void CMasternodePreCheckQueue::SetNotifyCallback(std::function<void()> func)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    notify = std::move(func);
+}
+
+uint256 CMasternodePreCheckQueue::GetHash(const Entry& entry)
+{
+    return entry.pmnb ? entry.pmnb->GetHash() : entry.pmnp->GetHash();
+}
+
+bool CMasternodePreCheckQueue::Push(const CMasternodeBroadcast& mnb, NodeId nodeid)
+{
+    return Push(Entry{std::make_shared<CMasternodeBroadcast>(mnb), nullptr, nodeid, false}, mnb.GetHash());
+}
+
+bool CMasternodePreCheckQueue::Push(const CMasternodePing& mnp, NodeId nodeid)
+{
+    return Push(Entry{nullptr, std::make_shared<CMasternodePing>(mnp), nodeid, false}, mnp.GetHash());
+}
+
+bool CMasternodePreCheckQueue::Push(Entry&& entry, const uint256& hash)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0 || queue.size() >= nMaxSize)
+            return false;
+        // already queued, from another peer
+        if (!setHashes.insert(hash).second)
+            return true;
+        queue.emplace_back(std::move(entry));
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+std::vector<CMasternodePreCheckQueue::Entry> CMasternodePreCheckQueue::PopChecked()
+{
+    std::vector<Entry> vRet;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!queue.empty() && queue.front().fDone) {
+        setHashes.erase(GetHash(queue.front()));
+        vRet.emplace_back(std::move(queue.front()));
+        queue.pop_front();
+        nNextToCheck--;
+    }
+    return vRet;
+}
+
+void CMasternodePreCheckQueue::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nWorkers++;
+    try {
+        while (true) {
+            while (nNextToCheck >= queue.size()) {
+                condWorker.wait(lock); // interruption point
+            }
+            // References to deque elements survive insertions at the back, and
+            // the entries can't be popped before they're done.
+            const size_t nBegin = nNextToCheck;
+            nNextToCheck = std::min(queue.size(), nBegin + MN_PRECHECK_BATCH_SIZE);
+            std::vector<Entry*> vBatch;
+            for (size_t i = nBegin; i < nNextToCheck; i++)
+                vBatch.push_back(&queue[i]);
+            lock.unlock();
+            for (Entry* entry : vBatch) {
+                // Nothing else touches the messages until the entry is done
+                if (entry->pmnb)
+                    entry->pmnb->PreCheckSignatures();
+                else
+                    entry->pmnp->PreCheckSignature();
+            }
+            lock.lock();
+            for (Entry* entry : vBatch)
+                entry->fDone = true;
+            std::function<void()> func = notify;
+            lock.unlock();
+            if (func) func();
+            lock.lock();
+        }
+    } catch (const boost::thread_interrupted&) {
+        if (!lock.owns_lock()) lock.lock();
+        nWorkers--;
+        throw;
+    }
+}
+
+void ThreadMasternodePreCheck()
+{
+    util::ThreadRename("dogecash-mncheck");
+    mnprecheckqueue.Thread();
+}
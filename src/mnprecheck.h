@@ -0,0 +1,80 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MNPRECHECK_H
+#define BITCOIN_MNPRECHECK_H
+
+#include "masternode.h"
+#include "net.h"
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Maximum number of received masternode broadcasts and pings held while waiting for their signatures check */
+static const unsigned int MAX_MN_PRECHECK_QUEUE = 5000;
+/** Number of messages a worker takes at once */
+static const unsigned int MN_PRECHECK_BATCH_SIZE = 32;
+
+/**
+ * Masternode broadcasts and pings received from the peers, waiting for the
+ * keys that signed them to be recovered on worker threads, in batches. The
+ * message handler takes them back in arrival order once checked and applies
+ * them to the masternode list in one go (CMasternodeMan::ProcessPreChecked),
+ * with the signatures checks down to a comparison of the keys, so that the
+ * list sync doesn't recover the keys one message at a time.
+ * Messages already queued are dropped (by hash).
+ */
+class CMasternodePreCheckQueue
+{
+public:
+    struct Entry {
+        //! One of the two is set
+        std::shared_ptr<CMasternodeBroadcast> pmnb;
+        std::shared_ptr<CMasternodePing> pmnp;
+        NodeId nodeid;
+        bool fDone;
+    };
+
+    explicit CMasternodePreCheckQueue(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    //! Called (without the queue lock held) every time a batch has been checked
+    void SetNotifyCallback(std::function<void()> func);
+
+    //! Queue a message received from nodeid. Returns false if the queue is full or no worker is running.
+    bool Push(const CMasternodeBroadcast& mnb, NodeId nodeid);
+    bool Push(const CMasternodePing& mnp, NodeId nodeid);
+
+    //! Take the checked messages from the front of the queue
+    std::vector<Entry> PopChecked();
+
+    //! Worker loop, exits when the thread is interrupted
+    void Thread();
+
+private:
+    bool Push(Entry&& entry, const uint256& hash);
+    static uint256 GetHash(const Entry& entry);
+
+    mutable boost::mutex mutex;
+    boost::condition_variable condWorker;
+    //! In arrival order. Entries before nNextToCheck are taken by a worker (or done).
+    std::deque<Entry> queue;
+    size_t nNextToCheck{0};
+    std::set<uint256> setHashes;
+    int nWorkers{0};
+    const size_t nMaxSize;
+    std::function<void()> notify;
+};
+
+extern CMasternodePreCheckQueue mnprecheckqueue;
+
+/** Run a worker of mnprecheckqueue */
+void ThreadMasternodePreCheck();
+
+#endif // BITCOIN_MNPRECHECK_H
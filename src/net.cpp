@@ -436,7 +436,7 @@ void CConnman::ClearBanned()
 {
     {
         LOCK(cs_setBanned);
-        setBanned.clear();
+        setBanned.Clear();
         setBannedIsDirty = true;
     }
     DumpBanlist(); // store banlist to Disk
@@ -446,34 +446,14 @@ void CConnman::ClearBanned()
 
 bool CConnman::IsBanned(CNetAddr ip)
 {
-    bool fResult = false;
-    {
-        LOCK(cs_setBanned);
-        for (banmap_t::iterator it = setBanned.begin(); it != setBanned.end(); it++)
-        {
-            CSubNet subNet = (*it).first;
-            CBanEntry banEntry = (*it).second;
-
-            if(subNet.Match(ip) && GetTime() < banEntry.nBanUntil)
-                fResult = true;
-        }
-    }
-    return fResult;
+    LOCK(cs_setBanned);
+    return setBanned.IsBanned(ip, GetTime());
 }
 
 bool CConnman::IsBanned(CSubNet subnet)
 {
-    bool fResult = false;
-    {
-        LOCK(cs_setBanned);
-        banmap_t::iterator i = setBanned.find(subnet);
-        if (i != setBanned.end()) {
-            CBanEntry banEntry = (*i).second;
-            if (GetTime() < banEntry.nBanUntil)
-                fResult = true;
-        }
-    }
-    return fResult;
+    LOCK(cs_setBanned);
+    return setBanned.IsBanned(subnet, GetTime());
 }
 
 void CConnman::Ban(const CNetAddr& addr, const BanReason &banReason, int64_t bantimeoffset, bool sinceUnixEpoch)
@@ -495,12 +475,9 @@ void CConnman::Ban(const CSubNet& subNet, const BanReason &banReason, int64_t ba
 
     {
         LOCK(cs_setBanned);
-        if (setBanned[subNet].nBanUntil < banEntry.nBanUntil) {
-            setBanned[subNet] = banEntry;
-            setBannedIsDirty = true;
-        }
-        else
+        if (!setBanned.Add(subNet, banEntry))
             return;
+        setBannedIsDirty = true;
     }
     if(clientInterface)
         clientInterface->BannedListChanged();
@@ -525,7 +502,7 @@ bool CConnman::Unban(const CSubNet &subNet)
 {
     {
         LOCK(cs_setBanned);
-        if (!setBanned.erase(subNet))
+        if (!setBanned.Remove(subNet))
             return false;
         setBannedIsDirty = true;
     }
@@ -538,13 +515,13 @@ bool CConnman::Unban(const CSubNet &subNet)
 void CConnman::GetBanned(banmap_t &banMap)
 {
     LOCK(cs_setBanned);
-    banMap = setBanned; //create a thread safe copy
+    banMap = setBanned.GetMap(); //create a thread safe copy
 }
 
 void CConnman::SetBanned(const banmap_t &banMap)
 {
     LOCK(cs_setBanned);
-    setBanned = banMap;
+    setBanned.Set(banMap);
     setBannedIsDirty = true;
 }
 
@@ -555,20 +532,11 @@ void CConnman::SweepBanned()
     bool notifyUI = false;
     {
         LOCK(cs_setBanned);
-        banmap_t::iterator it = setBanned.begin();
-        while(it != setBanned.end())
-        {
-            CSubNet subNet = (*it).first;
-            CBanEntry banEntry = (*it).second;
-            if(now > banEntry.nBanUntil)
-            {
-                setBanned.erase(it++);
-                setBannedIsDirty = true;
-                notifyUI = true;
-                LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
-            }
-            else
-                ++it;
+        // only the expired bans are visited
+        for (const CSubNet& subNet : setBanned.Sweep(now)) {
+            setBannedIsDirty = true;
+            notifyUI = true;
+            LogPrint(BCLog::NET, "%s: Removed banned node ip/subnet from banlist.dat: %s\n", __func__, subNet.ToString());
         }
     }
     // update UI
@@ -654,13 +622,21 @@ void CNode::copyStats(CNodeStats& stats)
     {
         LOCK(cs_vSend);
         X(mapSendBytesPerMsgCmd);
+        X(mapSendMsgsPerMsgCmd);
         X(nSendBytes);
     }
     {
         LOCK(cs_vRecv);
         X(mapRecvBytesPerMsgCmd);
+        X(mapRecvMsgsPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_processCost);
+        X(mapProcessTimePerMsgCmd);
+        X(mapQueueTimePerMsgCmd);
+    }
+    X(nRecvBufferUsage);
     X(fWhitelisted);
 
     // It is common for nodes with good ping times to suddenly become lagged,
@@ -700,11 +676,13 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete
         CNetMessage& msg = vRecvMsg.back();
 
         // absorb network data
+        const size_t nUsageBefore = msg.GetMemoryUsage();
         int handled;
         if (!msg.in_data)
             handled = msg.readHeader(pch, nBytes);
         else
             handled = msg.readData(pch, nBytes);
+        nRecvBufferUsage += msg.GetMemoryUsage() - nUsageBefore;
 
         if (handled < 0)
             return false;
@@ -726,6 +704,7 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete
                 i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
             assert(i != mapRecvBytesPerMsgCmd.end());
             i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+            mapRecvMsgsPerMsgCmd[i->first]++;
 
             msg.nTime = nTimeMicros;
             complete = true;
@@ -735,6 +714,23 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::MarkReceivedMsgsForProcessing(unsigned int nReceiveFloodSize)
+{
+    size_t nSizeAdded = 0;
+    auto it(vRecvMsg.begin());
+    for (; it != vRecvMsg.end(); ++it) {
+        if (!it->complete())
+            break;
+        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+    }
+    {
+        LOCK(cs_vProcessMsg);
+        vProcessMsg.splice(vProcessMsg.end(), vRecvMsg, vRecvMsg.begin(), it);
+        nProcessQueueSize += nSizeAdded;
+        fPauseRecv = nProcessQueueSize > nReceiveFloodSize;
+    }
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -761,6 +757,67 @@ int CNode::GetSendVersion() const
     return nSendVersion;
 }
 
+CRecvBufferPool g_recvbufferpool;
+
+CSerializeData CRecvBufferPool::Get(size_t nSize)
+{
+    CSerializeData buffer;
+    if (nSize > MAX_BUFFER_SIZE) {
+        buffer.reserve(nSize);
+        return buffer;
+    }
+    // smallest size class holding nSize
+    int nClass = 0;
+    while ((MIN_BUFFER_SIZE << nClass) < nSize)
+        nClass++;
+    {
+        LOCK(cs);
+        std::vector<CSerializeData>& vFree = vFreeBuffers[nClass];
+        if (!vFree.empty()) {
+            buffer.swap(vFree.back());
+            vFree.pop_back();
+            nPooledBytes -= buffer.capacity();
+            return buffer;
+        }
+    }
+    buffer.reserve(MIN_BUFFER_SIZE << nClass);
+    return buffer;
+}
+
+void CRecvBufferPool::Put(CSerializeData&& buffer)
+{
+    const size_t nCapacity = buffer.capacity();
+    if (nCapacity < MIN_BUFFER_SIZE || nCapacity > MAX_BUFFER_SIZE)
+        return;
+    // largest size class the buffer can serve
+    int nClass = NUM_SIZE_CLASSES - 1;
+    while ((MIN_BUFFER_SIZE << nClass) > nCapacity)
+        nClass--;
+    buffer.clear();
+
+    LOCK(cs);
+    std::vector<CSerializeData>& vFree = vFreeBuffers[nClass];
+    if ((vFree.size() + 1) * (MIN_BUFFER_SIZE << nClass) > MAX_CLASS_BYTES)
+        return;
+    nPooledBytes += nCapacity;
+    vFree.emplace_back(std::move(buffer));
+}
+
+size_t CRecvBufferPool::GetPooledBytes() const
+{
+    LOCK(cs);
+    return nPooledBytes;
+}
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData buffer;
+    hdrbuf.swap_buffer(buffer);
+    g_recvbufferpool.Put(std::move(buffer));
+    vRecv.swap_buffer(buffer);
+    g_recvbufferpool.Put(std::move(buffer));
+}
+
 int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
 {
     // copy data to temporary parsing buffer
@@ -785,8 +842,11 @@ int CNetMessage::readHeader(const char* pch, unsigned int nBytes)
     if (hdr.nMessageSize > MAX_SIZE)
         return -1;
 
-    // switch state to reading message data
+    // switch state to reading message data, in a buffer from the pool: it is
+    // reserved for up to 256 KiB, as readData allocates ahead
     in_data = true;
+    CSerializeData buffer = g_recvbufferpool.Get(std::min(hdr.nMessageSize, (unsigned int)CRecvBufferPool::MAX_BUFFER_SIZE));
+    vRecv.swap_buffer(buffer);
 
     return nCopy;
 }
@@ -815,7 +875,7 @@ size_t CConnman::SocketSendData(CNode* pnode)
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto& data = *it;
+        const auto& data = **it;
         assert(data.size() > pnode->nSendOffset);
         int nBytes = 0;
         {
@@ -916,6 +976,16 @@ static bool CompareNetGroupKeyed(const NodeEvictionCandidate &a, const NodeEvict
     return a.nKeyedNetGroup < b.nKeyedNetGroup;
 };
 
+/** Erase the last nCount candidates in the order of comp, leaving the others in any order */
+template <typename Compare>
+static void EraseLastCandidates(std::vector<NodeEvictionCandidate>& vEvictionCandidates, size_t nCount, Compare comp)
+{
+    nCount = std::min(nCount, vEvictionCandidates.size());
+    if (nCount == 0) return;
+    std::nth_element(vEvictionCandidates.begin(), vEvictionCandidates.end() - nCount, vEvictionCandidates.end(), comp);
+    vEvictionCandidates.erase(vEvictionCandidates.end() - nCount, vEvictionCandidates.end());
+}
+
 /** Try to find a connection to evict when the node is full.
  *  Extreme care must be taken to avoid opening the node to attacker
  *   triggered network partitioning.
@@ -944,57 +1014,58 @@ bool CConnman::AttemptToEvictConnection(bool fPreferNewConnection)
 
     if (vEvictionCandidates.empty()) return false;
 
-    // Protect connections with certain characteristics
+    // Protect connections with certain characteristics. Only the protected
+    // peers are needed, not the order of all the others: they are moved at
+    // the end in linear time, rather than sorting all of the candidates.
 
     // Deterministically select 4 peers to protect by netgroup.
     // An attacker cannot predict which netgroups will be protected
-    std::sort(vEvictionCandidates.begin(), vEvictionCandidates.end(), CompareNetGroupKeyed);
-    vEvictionCandidates.erase(vEvictionCandidates.end() - std::min(4, static_cast<int>(vEvictionCandidates.size())), vEvictionCandidates.end());
+    EraseLastCandidates(vEvictionCandidates, 4, CompareNetGroupKeyed);
 
     if (vEvictionCandidates.empty()) return false;
 
     // Protect the 8 nodes with the lowest minimum ping time.
     // An attacker cannot manipulate this metric without physically moving nodes closer to the target.
-    std::sort(vEvictionCandidates.begin(), vEvictionCandidates.end(), ReverseCompareNodeMinPingTime);
-    vEvictionCandidates.erase(vEvictionCandidates.end() - std::min(8, static_cast<int>(vEvictionCandidates.size())), vEvictionCandidates.end());
+    EraseLastCandidates(vEvictionCandidates, 8, ReverseCompareNodeMinPingTime);
 
     if (vEvictionCandidates.empty()) return false;
 
     // Protect the half of the remaining nodes which have been connected the longest.
     // This replicates the non-eviction implicit behavior, and precludes attacks that start later.
-    std::sort(vEvictionCandidates.begin(), vEvictionCandidates.end(), ReverseCompareNodeTimeConnected);
-    vEvictionCandidates.erase(vEvictionCandidates.end() - static_cast<int>(vEvictionCandidates.size() / 2), vEvictionCandidates.end());
+    EraseLastCandidates(vEvictionCandidates, vEvictionCandidates.size() / 2, ReverseCompareNodeTimeConnected);
 
     if (vEvictionCandidates.empty()) return false;
 
     // Identify the network group with the most connections and youngest member.
-    // (vEvictionCandidates is already sorted by reverse connect time)
-    uint64_t naMostConnections;
+    uint64_t naMostConnections = 0;
     unsigned int nMostConnections = 0;
     int64_t nMostConnectionsTime = 0;
-    std::map<uint64_t, std::vector<NodeEvictionCandidate> > mapAddrCounts;
+    // Size and youngest member of each group
+    std::map<uint64_t, std::pair<unsigned int, const NodeEvictionCandidate*> > mapGroups;
     for (const NodeEvictionCandidate& node : vEvictionCandidates) {
-        mapAddrCounts[node.nKeyedNetGroup].push_back(node);
-        int64_t grouptime = mapAddrCounts[node.nKeyedNetGroup][0].nTimeConnected;
-        size_t groupsize = mapAddrCounts[node.nKeyedNetGroup].size();
+        auto& group = mapGroups[node.nKeyedNetGroup];
+        group.first++;
+        if (!group.second || node.nTimeConnected > group.second->nTimeConnected)
+            group.second = &node;
+    }
+    for (const auto& it : mapGroups) {
+        const unsigned int groupsize = it.second.first;
+        const int64_t grouptime = it.second.second->nTimeConnected;
         if (groupsize > nMostConnections || (groupsize == nMostConnections && grouptime > nMostConnectionsTime)) {
             nMostConnections = groupsize;
             nMostConnectionsTime = grouptime;
-            naMostConnections = node.nKeyedNetGroup;
+            naMostConnections = it.first;
         }
     }
-
-    // Reduce to the network group with the most connections
-    vEvictionCandidates = std::move(mapAddrCounts[naMostConnections]);
+    const NodeId evicted = mapGroups[naMostConnections].second->id;
 
     // Do not disconnect peers if there is only 1 connection from their network group
-    if (vEvictionCandidates.size() <= 1)
+    if (nMostConnections <= 1)
         // unless we prefer the new connection (for whitelisted peers)
         if (!fPreferNewConnection)
             return false;
 
-    // Disconnect from the network group with the most connections
-    NodeId evicted = vEvictionCandidates.front().id;
+    // Disconnect the youngest of the network group with the most connections
     LOCK(cs_vNodes);
     for(std::vector<CNode*>::const_iterator it(vNodes.begin()); it != vNodes.end(); ++it) {
         if ((*it)->GetId() == evicted) {
@@ -1033,7 +1104,8 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    // only select() is limited by FD_SETSIZE
+    if (IsSocketEventsModeLimited(socketEventsMode) && !IsSelectableSocket(hSocket)) {
         LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
         CloseSocket(hSocket);
         return;
@@ -1046,6 +1118,13 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     }
 
     if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
+        const int64_t nNow = GetTimeMillis();
+        if (!whitelisted && nNow < nNextInboundEviction) {
+            LogPrint(BCLog::NET, "connection from %s dropped (full, eviction rate limited)\n", addr.ToString());
+            CloseSocket(hSocket);
+            return;
+        }
+        nNextInboundEviction = nNow + INBOUND_EVICTION_INTERVAL;
         if (!AttemptToEvictConnection(whitelisted)) {
             // No connection to evict, disconnect the new connection
             LogPrint(BCLog::NET, "failed to find an eviction candidate - connection dropped (full)\n");
@@ -1136,35 +1215,24 @@ void CConnman::ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
+        const int nTimeoutMs = 50; // frequency to poll pnode->vSend
 
+        std::vector<SocketEventsRequest> vRequests;
         for (const ListenSocket& hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
+            vRequests.push_back({hListenSocket.socket, -1, SOCKET_EVENT_RECV});
         }
 
         {
             LOCK(cs_vNodes);
+            vRequests.reserve(vRequests.size() + vNodes.size());
             for (CNode* pnode : vNodes) {
                 // Implement the following logic:
-                // * If there is data to send, select() for sending data. As this only
+                // * If there is data to send, wait for sending data. As this only
                 //   happens when optimistic write failed, we choose to first drain the
                 //   write buffer in this case before receiving more. This avoids
                 //   needlessly queueing received data, if the remote peer is not themselves
                 //   receiving data. This means properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer, select() for
+                // * Otherwise, if there is space left in the receive buffer, wait for
                 //   receiving data.
                 // * Hand off all complete messages to the processor, to be handled without
                 //   blocking here.
@@ -1180,35 +1248,27 @@ void CConnman::ThreadSocketHandler()
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
 
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
+                uint8_t nEvents = 0;
                 if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
+                    nEvents = SOCKET_EVENT_SEND;
+                } else if (select_recv) {
+                    nEvents = SOCKET_EVENT_RECV;
                 }
+                vRequests.push_back({pnode->hSocket, pnode->GetId(), nEvents});
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        std::map<SOCKET, uint8_t> mapReady;
+        bool fWaitOk = socketEvents->Wait(vRequests, mapReady, nTimeoutMs);
         if (interruptNet)
             return;
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(std::chrono::milliseconds(timeout.tv_usec/1000)))
+        if (!fWaitOk) {
+            // try to receive from every socket, then back off
+            mapReady.clear();
+            for (const SocketEventsRequest& req : vRequests)
+                mapReady[req.socket] = SOCKET_EVENT_RECV;
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(nTimeoutMs)))
                 return;
         }
 
@@ -1216,7 +1276,7 @@ void CConnman::ThreadSocketHandler()
         // Accept new connections
         //
         for (const ListenSocket& hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && mapReady.count(hListenSocket.socket)) {
                 AcceptConnection(hListenSocket);
             }
         }
@@ -1245,9 +1305,12 @@ void CConnman::ThreadSocketHandler()
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET)
                     continue;
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                const auto it = mapReady.find(pnode->hSocket);
+                if (it != mapReady.end()) {
+                    recvSet = it->second & SOCKET_EVENT_RECV;
+                    sendSet = it->second & SOCKET_EVENT_SEND;
+                    errorSet = it->second & SOCKET_EVENT_ERR;
+                }
             }
             if (recvSet || errorSet) {
                 {
@@ -1267,19 +1330,7 @@ void CConnman::ThreadSocketHandler()
                                 pnode->CloseSocketDisconnect();
                             RecordBytesRecv(nBytes);
                             if (notify) {
-                                size_t nSizeAdded = 0;
-                                auto it(pnode->vRecvMsg.begin());
-                                for (; it != pnode->vRecvMsg.end(); ++it) {
-                                    if (!it->complete())
-                                        break;
-                                    nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                                }
-                                {
-                                    LOCK(pnode->cs_vProcessMsg);
-                                    pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                                    pnode->nProcessQueueSize += nSizeAdded;
-                                    pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                                }
+                                pnode->MarkReceivedMsgsForProcessing(nReceiveFloodSize);
                                 WakeMessageHandler();
                             }
                         } else if (nBytes == 0) {
@@ -1342,9 +1393,9 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        nMsgProcWakeSeq++;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -1679,7 +1730,7 @@ void CConnman::ThreadOpenConnections()
 
             // SelectTriedCollision returns an invalid address if it is empty.
             if (!fFeeler || !addr.IsValid()) {
-                addr = addrman.Select(fFeeler);
+                addr = addrman.SelectFromSnapshot(fFeeler);
             }
 
             // if we selected an invalid address, restart
@@ -1842,39 +1893,92 @@ bool CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     return true;
 }
 
-void CConnman::ThreadMessageHandler()
+void CNode::AddProcessCost(const std::string& strCommand, int64_t nCostUsec, int64_t nNowUsec, int64_t nQueueUsec)
+{
+    LOCK(cs_processCost);
+    // to prevent a memory DOS, only allow valid commands (see ReceiveMsgBytes)
+    mapMsgCmdSize::iterator i = mapProcessTimePerMsgCmd.find(strCommand);
+    if (i == mapProcessTimePerMsgCmd.end())
+        i = mapProcessTimePerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    assert(i != mapProcessTimePerMsgCmd.end());
+    i->second += nCostUsec;
+    mapQueueTimePerMsgCmd[i->first] += nQueueUsec;
+
+    // Leaky bucket: the budget of the peer drains what it used since the last message
+    const int64_t nBudget = (nNowUsec - nProcessCostTime) * PEER_PROCESS_BUDGET_PERMILLE / 1000;
+    nProcessCost = std::max((int64_t)0, nProcessCost - nBudget) + nCostUsec;
+    nProcessCostTime = nNowUsec;
+}
+
+bool CNode::IsOverProcessBudget(int64_t nNowUsec) const
 {
+    if (fWhitelisted)
+        return false;
+    LOCK(cs_processCost);
+    const int64_t nBudget = (nNowUsec - nProcessCostTime) * PEER_PROCESS_BUDGET_PERMILLE / 1000;
+    return nProcessCost - nBudget > MAX_PEER_PROCESS_BURST;
+}
+
+void CConnman::ThreadMessageHandler(int nThread)
+{
+    uint64_t nWakeSeq;
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        nWakeSeq = nMsgProcWakeSeq;
+    }
     while (!flagInterruptMsgProc) {
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % nMsgHandThreads != nThread)
+                    continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
         bool fMoreWork = false;
 
-        for (CNode* pnode : vNodesCopy) {
-            if (pnode->fDisconnect)
-                continue;
-
+        // Returns false when interrupted
+        auto ProcessNode = [&](CNode* pnode) {
             // Receive messages
             bool fMoreNodeWork = GetNodeSignals().ProcessMessages(pnode, *this, flagInterruptMsgProc);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
             if (flagInterruptMsgProc)
-                return;
+                return false;
 
             // Send messages
             {
                 LOCK(pnode->cs_sendProcessing);
                 GetNodeSignals().SendMessages(pnode, *this, flagInterruptMsgProc);
             }
-            if (flagInterruptMsgProc)
+            return !flagInterruptMsgProc;
+        };
+
+        // The peers that used more than their share of the handler time only
+        // get the time left by the others, so that a burst of expensive
+        // requests from one peer doesn't stall the whole network
+        std::vector<CNode*> vNodesOverBudget;
+        const int64_t nNow = GetTimeMicros();
+        for (CNode* pnode : vNodesCopy) {
+            if (pnode->fDisconnect)
+                continue;
+            if (pnode->IsOverProcessBudget(nNow)) {
+                vNodesOverBudget.push_back(pnode);
+                continue;
+            }
+            if (!ProcessNode(pnode))
                 return;
         }
 
+        if (!fMoreWork) {
+            for (CNode* pnode : vNodesOverBudget) {
+                if (!ProcessNode(pnode))
+                    return;
+            }
+        }
+
 
         {
             LOCK(cs_vNodes);
@@ -1884,9 +1988,9 @@ void CConnman::ThreadMessageHandler()
 
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nWakeSeq] { return nMsgProcWakeSeq != nWakeSeq; });
         }
-        fMsgProcWake = false;
+        nWakeSeq = nMsgProcWakeSeq;
     }
 }
 
@@ -2034,6 +2138,10 @@ CConnman::CConnman(uint64_t nSeed0In, uint64_t nSeed1In) : nSeed0(nSeed0In), nSe
     nBestHeight = 0;
     clientInterface = NULL;
     flagInterruptMsgProc = false;
+
+    for (const std::string& msg : getAllNetMessageTypes())
+        mapMsgStats[msg];
+    mapMsgStats[NET_MESSAGE_COMMAND_OTHER];
 }
 
 NodeId CConnman::GetNewNodeId()
@@ -2041,10 +2149,35 @@ NodeId CConnman::GetNewNodeId()
     return nLastNodeId.fetch_add(1, std::memory_order_relaxed);
 }
 
-bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options connOptions)
+void CConnman::LoadAddresses()
+{
+    // Load addresses from peers.dat
+    int64_t nStart = GetTimeMillis();
+    CAddrDB adb;
+    if (adb.Read(addrman))
+        LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
+    else {
+        addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
+        LogPrintf("Invalid or missing peers.dat; recreating\n");
+        DumpAddresses();
+    }
+    fAddressesLoaded = true;
+}
+
+void CConnman::Init(const Options& connOptions)
 {
     nTotalBytesRecv = 0;
-    nTotalBytesSent = 0;
+    {
+        LOCK(cs_totalBytesSent);
+        nTotalBytesSent = 0;
+        nMaxUploadTarget = connOptions.nMaxUploadTarget;
+        nUploadCycleStart = GetTime();
+        nUploadCycleBytes = 0;
+        for (int i = 0; i < UPLOAD_CLASS_MAX; i++) {
+            vUploadClassStats[i] = CUploadClassStats();
+            vUploadClassStats[i].nBudget = connOptions.vUploadBudget[i];
+        }
+    }
 
     nRelevantServices = connOptions.nRelevantServices;
     nLocalServices = connOptions.nLocalServices;
@@ -2055,27 +2188,33 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
 
+    nMsgHandThreads = std::max(1, std::min(connOptions.nMsgHandThreads, MAX_MSGHAND_THREADS));
+}
+
+bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options connOptions)
+{
+    Init(connOptions);
+
+    socketEventsMode = connOptions.socketEventsMode;
+    socketEvents = MakeSocketEvents(socketEventsMode);
+    if (!socketEvents) {
+        strNodeError = strprintf(_("Unable to initialize the %s socket events backend"), SocketEventsModeToString(socketEventsMode));
+        return false;
+    }
+    LogPrintf("Using %s socket events backend\n", socketEvents->GetName());
+
     SetBestHeight(connOptions.nBestHeight);
 
     clientInterface = connOptions.uiInterface;
-    if (clientInterface)
-        clientInterface->InitMessage(_("Loading addresses..."));
-    // Load addresses from peers.dat
-    int64_t nStart = GetTimeMillis();
-    {
-        CAddrDB adb;
-        if (adb.Read(addrman))
-            LogPrintf("Loaded %i addresses from peers.dat  %dms\n", addrman.size(), GetTimeMillis() - nStart);
-        else {
-            addrman.Clear(); // Addrman can be in an inconsistent state after failure, reset it
-            LogPrintf("Invalid or missing peers.dat; recreating\n");
-            DumpAddresses();
-        }
+    if (!fAddressesLoaded) {
+        if (clientInterface)
+            clientInterface->InitMessage(_("Loading addresses..."));
+        LoadAddresses();
     }
     if (clientInterface)
         clientInterface->InitMessage(_("Loading banlist..."));
     // Load addresses from banlist.dat
-    nStart = GetTimeMillis();
+    int64_t nStart = GetTimeMillis();
     CBanDB bandb;
     banmap_t banmap;
     if (bandb.Read(banmap)) {
@@ -2122,7 +2261,7 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        nMsgProcWakeSeq = 0;
     }
 
     // Send and receive from sockets, accept connections
@@ -2141,7 +2280,12 @@ bool CConnman::Start(CScheduler& scheduler, std::string& strNodeError, Options c
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMsgHandThreads; i++) {
+        const std::string strName = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        threadMessageHandlers.emplace_back([this, i, strName] {
+            TraceThread<std::function<void()> >(strName.c_str(), std::bind(&CConnman::ThreadMessageHandler, this, i));
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2190,8 +2334,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2253,6 +2400,11 @@ size_t CConnman::GetAddressCount() const
     return addrman.size();
 }
 
+size_t CConnman::GetAddressUsage() const
+{
+    return addrman.DynamicMemoryUsage();
+}
+
 void CConnman::SetServices(const CService &addr, ServiceFlags nServices)
 {
     addrman.SetServices(addr, nServices);
@@ -2316,6 +2468,18 @@ size_t CConnman::GetNodeCount(NumConnections flags)
     return nNum;
 }
 
+size_t CConnman::GetNodeBuffersUsage()
+{
+    size_t nUsage = 0;
+    LOCK(cs_vNodes);
+    for (CNode* pnode : vNodes) {
+        nUsage += pnode->nRecvBufferUsage;
+        LOCK(pnode->cs_vSend);
+        nUsage += pnode->nSendSize;
+    }
+    return nUsage;
+}
+
 void CConnman::GetNodeStats(std::vector<CNodeStats>& vstats)
 {
     vstats.clear();
@@ -2360,6 +2524,33 @@ void CConnman::RelayInv(CInv& inv)
     }
 }
 
+std::string GetUploadClassName(UploadClass uploadClass)
+{
+    switch (uploadClass) {
+    case UPLOAD_HISTORICAL_BLOCKS: return "historicalblocks";
+    case UPLOAD_TIP_RELAY: return "tiprelay";
+    case UPLOAD_TX_RELAY: return "txrelay";
+    case UPLOAD_TIERTWO_SYNC: return "tiertwo";
+    case UPLOAD_OTHER: return "other";
+    case UPLOAD_CLASS_MAX: break;
+    }
+    return "";
+}
+
+UploadClass GetUploadClass(const std::string& command)
+{
+    if (command == NetMsgType::BLOCK || command == NetMsgType::MERKLEBLOCK ||
+        command == NetMsgType::CMPCTBLOCK || command == NetMsgType::BLOCKTXN ||
+        command == NetMsgType::HEADERS)
+        return UPLOAD_TIP_RELAY;
+    if (command == NetMsgType::TX || command == NetMsgType::INV ||
+        command == NetMsgType::GETDATA || command == NetMsgType::NOTFOUND)
+        return UPLOAD_TX_RELAY;
+    if (IsTierTwoMessageType(command))
+        return UPLOAD_TIERTWO_SYNC;
+    return UPLOAD_OTHER;
+}
+
 void CConnman::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
@@ -2370,6 +2561,120 @@ void CConnman::RecordBytesSent(uint64_t bytes)
 {
     LOCK(cs_totalBytesSent);
     nTotalBytesSent += bytes;
+
+    UpdateUploadCycle(GetTime());
+    nUploadCycleBytes += bytes;
+}
+
+void CConnman::RecordUploadBytes(UploadClass uploadClass, uint64_t bytes)
+{
+    LOCK(cs_totalBytesSent);
+    UpdateUploadCycle(GetTime());
+    vUploadClassStats[uploadClass].nBytesTotal += bytes;
+    vUploadClassStats[uploadClass].nBytesInCycle += bytes;
+}
+
+void CConnman::UpdateUploadCycle(int64_t nNow)
+{
+    AssertLockHeld(cs_totalBytesSent);
+    if (nUploadCycleStart + UPLOAD_CYCLE_TIMEFRAME > nNow)
+        return;
+    // Start a new cycle, aligned on the previous one
+    nUploadCycleStart = nNow - (nNow - nUploadCycleStart) % UPLOAD_CYCLE_TIMEFRAME;
+    nUploadCycleBytes = 0;
+    for (CUploadClassStats& stats : vUploadClassStats)
+        stats.nBytesInCycle = 0;
+}
+
+void CNetMsgStats::AddProcessed(uint64_t nBytes, int64_t nProcessUsec, int64_t nQueueUsec)
+{
+    nMsgsProcessed++;
+    nBytesProcessed += nBytes;
+    nProcessTime += nProcessUsec;
+    nMaxProcessTime = std::max(nMaxProcessTime, nProcessUsec);
+    nQueueTime += nQueueUsec;
+    nMaxQueueTime = std::max(nMaxQueueTime, nQueueUsec);
+
+    int nBucket = 0;
+    while (nBucket < MSG_PROCESS_TIME_BUCKETS - 1 && nProcessUsec >= (int64_t(1) << nBucket))
+        nBucket++;
+    vProcessTimeHistogram[nBucket]++;
+}
+
+void CConnman::RecordMessageSent(const std::string& command, uint64_t nBytes)
+{
+    LOCK(cs_msgStats);
+    mapMsgCmdStats::iterator it = mapMsgStats.find(command);
+    if (it == mapMsgStats.end())
+        it = mapMsgStats.find(NET_MESSAGE_COMMAND_OTHER);
+    it->second.nMsgsSent++;
+    it->second.nBytesSent += nBytes;
+}
+
+void CConnman::RecordMessageProcessed(const std::string& command, uint64_t nBytes, int64_t nProcessUsec, int64_t nQueueUsec)
+{
+    LOCK(cs_msgStats);
+    mapMsgCmdStats::iterator it = mapMsgStats.find(command);
+    if (it == mapMsgStats.end())
+        it = mapMsgStats.find(NET_MESSAGE_COMMAND_OTHER);
+    it->second.AddProcessed(nBytes, nProcessUsec, nQueueUsec);
+}
+
+mapMsgCmdStats CConnman::GetMessageStats()
+{
+    LOCK(cs_msgStats);
+    return mapMsgStats;
+}
+
+uint64_t CConnman::GetMaxUploadTarget()
+{
+    LOCK(cs_totalBytesSent);
+    return nMaxUploadTarget;
+}
+
+bool CConnman::UploadTargetReached()
+{
+    LOCK(cs_totalBytesSent);
+    UpdateUploadCycle(GetTime());
+    return nMaxUploadTarget > 0 && nUploadCycleBytes >= nMaxUploadTarget;
+}
+
+uint64_t CConnman::GetUploadTargetLeft()
+{
+    LOCK(cs_totalBytesSent);
+    UpdateUploadCycle(GetTime());
+    if (nMaxUploadTarget == 0)
+        return 0;
+    return nUploadCycleBytes >= nMaxUploadTarget ? 0 : nMaxUploadTarget - nUploadCycleBytes;
+}
+
+int64_t CConnman::GetUploadCycleTimeLeft()
+{
+    LOCK(cs_totalBytesSent);
+    const int64_t nNow = GetTime();
+    UpdateUploadCycle(nNow);
+    return nUploadCycleStart + UPLOAD_CYCLE_TIMEFRAME - nNow;
+}
+
+std::array<CUploadClassStats, UPLOAD_CLASS_MAX> CConnman::GetUploadClassStats()
+{
+    LOCK(cs_totalBytesSent);
+    UpdateUploadCycle(GetTime());
+    return vUploadClassStats;
+}
+
+bool CConnman::UploadBudgetReached(UploadClass uploadClass)
+{
+    if (uploadClass == UPLOAD_OTHER)
+        return false;
+    LOCK(cs_totalBytesSent);
+    UpdateUploadCycle(GetTime());
+    const CUploadClassStats& stats = vUploadClassStats[uploadClass];
+    if (stats.nBudget > 0 && stats.nBytesInCycle >= stats.nBudget)
+        return true;
+    // Past the target, only the tip and the tx relay go on, for the health of the network
+    const bool fBulkClass = uploadClass == UPLOAD_HISTORICAL_BLOCKS || uploadClass == UPLOAD_TIERTWO_SYNC;
+    return fBulkClass && nMaxUploadTarget > 0 && nUploadCycleBytes >= nMaxUploadTarget;
 }
 
 uint64_t CConnman::GetTotalBytesRecv()
@@ -2409,7 +2714,6 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     id(idIn),
     nKeyedNetGroup(nKeyedNetGroupIn),
     addrKnown(5000, 0.001),
-    filterInventoryKnown(50000, 0.000001),
     nLocalHostNonce(nLocalHostNonceIn),
     nLocalServices(nLocalServicesIn),
     nMyStartingHeight(nMyStartingHeightIn),
@@ -2439,12 +2743,12 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nSendOffset = 0;
     hashContinue = UINT256_ZERO;
     nStartingHeight = -1;
-    filterInventoryKnown.reset();
     fSendMempool = false;
     fGetAddr = false;
     nNextLocalAddrSend = 0;
     nNextAddrSend = 0;
     nNextInvSend = 0;
+    nNextTierTwoInvSend = 0;
     fRelayTxes = false;
     pfilter = new CBloomFilter();
     timeLastMempoolReq = 0;
@@ -2456,10 +2760,20 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
+    nRecvBufferUsage = 0;
+    nProcessCost = 0;
+    nProcessCostTime = 0;
 
-    for (const std::string &msg : getAllNetMessageTypes())
+    for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapRecvMsgsPerMsgCmd[msg] = 0;
+        mapProcessTimePerMsgCmd[msg] = 0;
+        mapQueueTimePerMsgCmd[msg] = 0;
+    }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapRecvMsgsPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapProcessTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapQueueTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
 
     if (fLogIPs)
         LogPrint(BCLog::NET, "Added connection to %s peer=%d\n", addrName, id);
@@ -2510,11 +2824,9 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+CSharedNetMsg CConnman::MakeSharedMessage(CSerializedNetMsg&& msg)
 {
     size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
@@ -2524,6 +2836,36 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
+    CSharedNetMsg shared;
+    shared.header = std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader));
+    shared.data = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+    shared.command = std::move(msg.command);
+    return shared;
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    PushMessage(pnode, MakeSharedMessage(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    PushMessage(pnode, msg, GetUploadClass(msg.command));
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg, UploadClass uploadClass)
+{
+    PushMessage(pnode, MakeSharedMessage(std::move(msg)), uploadClass);
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg, UploadClass uploadClass)
+{
+    size_t nMessageSize = msg.data->size();
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
+    RecordUploadBytes(uploadClass, nTotalSize);
+    RecordMessageSent(msg.command, nTotalSize);
+
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2531,13 +2873,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         //log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
+        pnode->mapSendMsgsPerMsgCmd[msg.command]++;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(msg.header);
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.data);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
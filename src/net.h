@@ -10,6 +10,7 @@
 #define BITCOIN_NET_H
 
 #include "addrdb.h"
+#include "banlist.h"
 #include "addrman.h"
 #include "bloom.h"
 #include "compat.h"
@@ -17,14 +18,17 @@
 #include "hash.h"
 #include "limitedmap.h"
 #include "netaddress.h"
+#include "peerinventory.h"
 #include "protocol.h"
 #include "random.h"
+#include "socketevents.h"
 #include "streams.h"
 #include "sync.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
 #include "threadinterrupt.h"
 
+#include <array>
 #include <atomic>
 #include <deque>
 #include <stdint.h>
@@ -61,6 +65,9 @@ static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 2 * 1024 * 1024;
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** Maximum number of outgoing nodes */
 static const int MAX_OUTBOUND_CONNECTIONS = 16;
+/** Minimum time between two inbound peers evicted for a new connection, when full (in milliseconds).
+ *  The connections accepted meanwhile are dropped, so that a flood doesn't evict a peer per attempt. */
+static const int64_t INBOUND_EVICTION_INTERVAL = 100;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
 /** -upnp default */
@@ -84,7 +91,23 @@ static const bool DEFAULT_FORCEDNSSEED = true;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
 
+/** Share of the message handler time (per mille) that a peer can spend over time */
+static const int64_t PEER_PROCESS_BUDGET_PERMILLE = 100;
+/** Message processing time (in usec) a peer can burst above its budget, before it only
+ *  gets the handler time left by the other peers */
+static const int64_t MAX_PEER_PROCESS_BURST = 500 * 1000;
+
+/** Default number of message handler threads, the peers being split among them */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
+
 // NOTE: When adjusting this, update rpcnet:setban's help ("24h")
+/** The upload budgets (-maxuploadtarget, -maxupload<class>) are per cycle of 24 hours */
+static const int64_t UPLOAD_CYCLE_TIMEFRAME = 60 * 60 * 24;
+/** Default upload target and budgets, in MiB per cycle (0 = no limit) */
+static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
+static const uint64_t DEFAULT_MAX_UPLOAD_BUDGET = 0;
 static const unsigned int DEFAULT_MISBEHAVING_BANTIME = 60 * 60 * 24;  // Default 24-hour ban
 
 typedef int NodeId;
@@ -121,6 +144,61 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/**
+ * Serialized message (header included) that can be queued, without copies,
+ * to the send buffers of several peers. Serialize once, send many.
+ */
+struct CSharedNetMsg
+{
+    std::shared_ptr<const std::vector<unsigned char>> header;
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    std::string command;
+};
+
+/**
+ * The traffic classes of the upload budgets. Past the budget of its class
+ * (or, for the bulk classes, past the total -maxuploadtarget), a request is
+ * refused to the non-whitelisted peers.
+ */
+enum UploadClass {
+    UPLOAD_HISTORICAL_BLOCKS, //!< the old blocks, served to the peers syncing the chain
+    UPLOAD_TIP_RELAY,         //!< the recent blocks, compact blocks and headers
+    UPLOAD_TX_RELAY,          //!< the transactions and the inventory
+    UPLOAD_TIERTWO_SYNC,      //!< the masternode, budget and spork messages
+    UPLOAD_OTHER,             //!< the control messages (version, ping, addr...), never limited
+    UPLOAD_CLASS_MAX
+};
+
+/** The name of an upload class, as in -maxupload<name> and getnettotals */
+std::string GetUploadClassName(UploadClass uploadClass);
+/** The upload class of a message, the blocks being tip relay unless told otherwise */
+UploadClass GetUploadClass(const std::string& command);
+
+struct CUploadClassStats {
+    uint64_t nBytesTotal{0};   //!< queued since the start
+    uint64_t nBytesInCycle{0}; //!< queued in the current cycle
+    uint64_t nBudget{0};       //!< budget per cycle, 0 if unlimited
+};
+
+/** Buckets of the processing time histograms: below 1, 2, 4... usec, the last one unbounded */
+static const int MSG_PROCESS_TIME_BUCKETS = 24;
+
+/** The statistics of the messages of a command, over all the peers (getnetmsgstats) */
+struct CNetMsgStats {
+    uint64_t nMsgsSent{0};
+    uint64_t nBytesSent{0};
+    uint64_t nMsgsProcessed{0};
+    uint64_t nBytesProcessed{0};
+    int64_t nProcessTime{0};  //!< usec
+    int64_t nMaxProcessTime{0};
+    int64_t nQueueTime{0};    //!< usec from the receipt of the messages to their processing
+    int64_t nMaxQueueTime{0};
+    std::array<uint64_t, MSG_PROCESS_TIME_BUCKETS> vProcessTimeHistogram{};
+
+    void AddProcessed(uint64_t nBytes, int64_t nProcessUsec, int64_t nQueueUsec);
+};
+typedef std::map<std::string, CNetMsgStats> mapMsgCmdStats;
+
 
 class CConnman
 {
@@ -144,10 +222,18 @@ public:
         CClientUIInterface* uiInterface = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        SocketEventsMode socketEventsMode = SocketEventsMode::SELECT;
+        int nMsgHandThreads = DEFAULT_MSGHAND_THREADS;
+        uint64_t nMaxUploadTarget = 0; //!< total bytes per cycle, 0 if unlimited
+        std::array<uint64_t, UPLOAD_CLASS_MAX> vUploadBudget{}; //!< bytes per cycle, 0 if unlimited
     };
     CConnman(uint64_t seed0, uint64_t seed1);
     ~CConnman();
+    /** Apply the options, Start does it. Alone, for a CConnman driven without its threads (benchmarks). */
+    void Init(const Options& connOptions);
     bool Start(CScheduler& scheduler, std::string& strNodeError, Options options);
+    //! Load the addresses from peers.dat. Start does it if it wasn't done before, this is for loading them earlier.
+    void LoadAddresses();
     void Stop();
     void Interrupt();
     bool BindListenPort(const CService &bindAddr, std::string& strError, bool fWhitelisted = false);
@@ -157,6 +243,13 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
+    /** Push a message accounted to the given upload class instead of the class of its command */
+    void PushMessage(CNode* pnode, CSerializedNetMsg&& msg, UploadClass uploadClass);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg, UploadClass uploadClass);
+
+    /** Compute the header of a message once, to push it to several peers */
+    static CSharedNetMsg MakeSharedMessage(CSerializedNetMsg&& msg);
 
     template<typename Callable>
     bool ForEachNodeContinueIf(Callable&& func)
@@ -219,6 +312,7 @@ public:
 
     // Addrman functions
     size_t GetAddressCount() const;
+    size_t GetAddressUsage() const;
     void SetServices(const CService &addr, ServiceFlags nServices);
     void MarkAddressGood(const CAddress& addr);
     void AddNewAddress(const CAddress& addr, const CAddress& addrFrom, int64_t nTimePenalty = 0);
@@ -258,6 +352,8 @@ public:
 
     size_t GetNodeCount(NumConnections num);
     void GetNodeStats(std::vector<CNodeStats>& vstats);
+    //! Memory held by the send queues and the receive buffers of the peers
+    size_t GetNodeBuffersUsage();
     bool DisconnectNode(const std::string& node);
     bool DisconnectNode(NodeId id);
 
@@ -270,6 +366,19 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    //! The upload target and budgets, over cycles of UPLOAD_CYCLE_TIMEFRAME
+    uint64_t GetMaxUploadTarget();
+    bool UploadTargetReached();
+    uint64_t GetUploadTargetLeft();
+    int64_t GetUploadCycleTimeLeft();
+    std::array<CUploadClassStats, UPLOAD_CLASS_MAX> GetUploadClassStats();
+    /** Whether the budget of the class is used up, or the upload target for the bulk classes */
+    bool UploadBudgetReached(UploadClass uploadClass);
+
+    /** Account a processed message in the statistics of its command */
+    void RecordMessageProcessed(const std::string& command, uint64_t nBytes, int64_t nProcessUsec, int64_t nQueueUsec);
+    mapMsgCmdStats GetMessageStats();
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -277,6 +386,8 @@ public:
     CSipHasher GetDeterministicRandomizer(uint64_t id);
 
     unsigned int GetReceiveFloodSize() const;
+
+    void WakeMessageHandler();
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -288,13 +399,11 @@ private:
     void ThreadOpenAddedConnections();
     void ProcessOneShot();
     void ThreadOpenConnections();
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
-    void WakeMessageHandler();
-
     uint64_t CalculateKeyedNetGroup(const CAddress& ad);
 
     CNode* FindNode(const CNetAddr& ip);
@@ -324,6 +433,9 @@ private:
     // Network stats
     void RecordBytesRecv(uint64_t bytes);
     void RecordBytesSent(uint64_t bytes);
+    void RecordUploadBytes(UploadClass uploadClass, uint64_t bytes);
+    void RecordMessageSent(const std::string& command, uint64_t nBytes);
+    void UpdateUploadCycle(int64_t nNow);
 
     // Whether the node should be passed out in ForEach* callbacks
     static bool NodeFullyConnected(const CNode* pnode);
@@ -334,6 +446,17 @@ private:
     uint64_t nTotalBytesRecv{0};
     uint64_t nTotalBytesSent{0};
 
+    // Upload target and budgets, guarded by cs_totalBytesSent
+    uint64_t nMaxUploadTarget{0};
+    int64_t nUploadCycleStart{0};
+    uint64_t nUploadCycleBytes{0}; //!< actually sent in the current cycle
+    std::array<CUploadClassStats, UPLOAD_CLASS_MAX> vUploadClassStats;
+
+    // Statistics per command, over all the peers. The map holds all the known
+    // commands from the start (and NET_MESSAGE_COMMAND_OTHER): no memory DOS.
+    Mutex cs_msgStats;
+    mapMsgCmdStats mapMsgStats;
+
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
     std::vector<CSubNet> vWhitelistedRange;
@@ -343,10 +466,13 @@ private:
     unsigned int nReceiveFloodSize{0};
 
     std::vector<ListenSocket> vhListenSocket;
-    banmap_t setBanned;
+    CBanList setBanned;
     RecursiveMutex cs_setBanned;
     bool setBannedIsDirty{false};
     bool fAddressesInitialized{false};
+    // Earliest time of the next eviction for an inbound connection (only used by the socket handler thread)
+    int64_t nNextInboundEviction{0};
+    std::atomic<bool> fAddressesLoaded{false};
     CAddrMan addrman;
     std::deque<std::string> vOneShots;
     RecursiveMutex cs_vOneShots;
@@ -370,11 +496,20 @@ private:
     std::atomic<int> nBestHeight;
     CClientUIInterface* clientInterface{nullptr};
 
+    /** Backend waiting for the socket events in ThreadSocketHandler */
+    SocketEventsMode socketEventsMode{SocketEventsMode::SELECT};
+    std::unique_ptr<CSocketEvents> socketEvents;
+
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0{0}, nSeed1{0};
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake{false};
+    /** Count of the wake ups of the message processor, each of the
+     *  message handler threads waits for a new one when idle. */
+    uint64_t nMsgProcWakeSeq{0};
+
+    /** Number of message handler threads, a peer being handled by the
+     *  thread of its id modulo this number, in the order of its messages */
+    int nMsgHandThreads{DEFAULT_MSGHAND_THREADS};
 
     std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
@@ -386,7 +521,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover();
@@ -485,8 +620,13 @@ public:
     int nStartingHeight;
     uint64_t nSendBytes;
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    mapMsgCmdSize mapSendMsgsPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapRecvMsgsPerMsgCmd;
+    mapMsgCmdSize mapProcessTimePerMsgCmd;
+    mapMsgCmdSize mapQueueTimePerMsgCmd;
+    uint64_t nRecvBufferUsage;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -494,6 +634,37 @@ public:
 };
 
 
+/**
+ * Pool of the receive buffers, by power of two size class: the buffers of the
+ * processed messages are reused by the next messages of any peer, instead of
+ * each message allocating (and growing) its own. Thread safe.
+ */
+class CRecvBufferPool
+{
+public:
+    /** Smallest and largest pooled buffer capacities */
+    static const size_t MIN_BUFFER_SIZE = 256;
+    static const size_t MAX_BUFFER_SIZE = 256 * 1024;
+    /** Maximum size of the buffers kept for each size class */
+    static const size_t MAX_CLASS_BYTES = 4 * 1024 * 1024;
+
+    /** An empty buffer with a capacity of at least nSize */
+    CSerializeData Get(size_t nSize);
+    /** Keep a buffer no longer used for reuse, unless its size class is full */
+    void Put(CSerializeData&& buffer);
+    /** Size of the buffers currently kept */
+    size_t GetPooledBytes() const;
+
+private:
+    static const int NUM_SIZE_CLASSES = 11; // MIN_BUFFER_SIZE << 10 == MAX_BUFFER_SIZE
+
+    mutable Mutex cs;
+    std::array<std::vector<CSerializeData>, NUM_SIZE_CLASSES> vFreeBuffers GUARDED_BY(cs);
+    size_t nPooledBytes GUARDED_BY(cs){0};
+};
+
+extern CRecvBufferPool g_recvbufferpool;
+
 class CNetMessage
 {
 public:
@@ -509,12 +680,21 @@ public:
     int64_t nTime; // time (in microseconds) of message receipt.
 
     CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
-        hdrbuf.resize(24);
+        CSerializeData buffer = g_recvbufferpool.Get(CMessageHeader::HEADER_SIZE);
+        hdrbuf.swap_buffer(buffer);
+        hdrbuf.resize(CMessageHeader::HEADER_SIZE);
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
     }
+    ~CNetMessage();
+
+    CNetMessage(const CNetMessage&) = delete;
+    CNetMessage& operator=(const CNetMessage&) = delete;
+
+    /** Memory held by the buffers of the message */
+    size_t GetMemoryUsage() const { return hdrbuf.capacity() + vRecv.capacity(); }
 
     bool complete() const
     {
@@ -546,11 +726,15 @@ public:
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg;
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
 
+    // Memory held by the buffers of the messages being received and waiting
+    // to be processed (see CNetMessage::GetMemoryUsage)
+    std::atomic<size_t> nRecvBufferUsage;
+
     RecursiveMutex cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
@@ -597,7 +781,15 @@ public:
     std::atomic_bool fPauseSend;
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
+    mapMsgCmdSize mapSendMsgsPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdSize mapRecvMsgsPerMsgCmd;
+    mapMsgCmdSize mapProcessTimePerMsgCmd; // usec, protected by cs_processCost
+    mapMsgCmdSize mapQueueTimePerMsgCmd;   // usec from the receipt to the processing, protected by cs_processCost
+
+    mutable RecursiveMutex cs_processCost;
+    int64_t nProcessCost;     // usec over the budget of the peer, decaying
+    int64_t nProcessCostTime; // time (in usec) of the last update of nProcessCost
 
     std::vector<std::string> vecRequestsFulfilled; //keep track of what client has asked for
 
@@ -614,7 +806,7 @@ public:
     int64_t nNextLocalAddrSend;
 
     // inventory based relay
-    CRollingBloomFilter filterInventoryKnown;
+    PeerInventoryKnown filterInventoryKnown;
     // Set of transaction ids we still have to announce.
     // They are sorted by the mempool before relay, so the order is not important.
     std::set<uint256> setInventoryTxToSend;
@@ -622,12 +814,14 @@ public:
     // There is no final sorting before sending, as they are always sent immediately
     // and in the order requested.
     std::vector<uint256> vInventoryBlockToSend;
-    // Set of tier two messages ids we still have to announce.
+    // List of tier two messages ids we still have to announce, in the order
+    // they were queued. They are sent in batches on their own trickle timer.
     std::vector<CInv> vInventoryTierTwoToSend;
     RecursiveMutex cs_inventory;
     std::multimap<int64_t, CInv> mapAskFor;
     std::vector<uint256> vBlockRequested;
     int64_t nNextInvSend;
+    int64_t nNextTierTwoInvSend;
     // Used for BIP35 mempool sending, also protected by cs_inventory
     bool fSendMempool;
 
@@ -695,6 +889,14 @@ public:
     }
 
     bool ReceiveMsgBytes(const char* pch, unsigned int nBytes, bool& complete);
+    /** Hand the complete messages received over to the message handler */
+    void MarkReceivedMsgsForProcessing(unsigned int nReceiveFloodSize);
+
+    /** Account the time spent processing a message of this peer, and the time it waited before */
+    void AddProcessCost(const std::string& strCommand, int64_t nCostUsec, int64_t nNowUsec, int64_t nQueueUsec);
+    /** Whether the peer processing time went over its budget (PEER_PROCESS_BUDGET_PERMILLE),
+     *  by more than MAX_PEER_PROCESS_BURST. Whitelisted peers never do. */
+    bool IsOverProcessBudget(int64_t nNowUsec) const;
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -751,6 +953,12 @@ public:
         }
     }
 
+    bool IsInventoryKnown(const uint256& hash)
+    {
+        LOCK(cs_inventory);
+        return filterInventoryKnown.contains(hash);
+    }
+
     void PushInventory(const CInv& inv)
     {
         LOCK(cs_inventory);
@@ -760,7 +968,7 @@ public:
             }
         } else if (inv.type == MSG_BLOCK) {
             vInventoryBlockToSend.push_back(inv.hash);
-        } else {
+        } else if (!filterInventoryKnown.contains(inv.hash)) {
             vInventoryTierTwoToSend.emplace_back(inv);
         }
     }
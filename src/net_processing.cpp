@@ -8,31 +8,71 @@
 
 #include "net_processing.h"
 
+#include "blockencodings.h"
+#include "blockprecheck.h"
 #include "budget/budgetmanager.h"
+#include "blockfilter.h"
 #include "chain.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
+#include "index/blockfilterindex.h"
 #include "masternodeman.h"
 #include "masternode-payments.h"
 #include "masternode-sync.h"
 #include "merkleblock.h"
+#include "mnprecheck.h"
 #include "netbase.h"
 #include "netmessagemaker.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
+#include "random.h"
+#include "script/sigcache.h"
 #include "sporkdb.h"
+#include "txorphanage.h"
+#include "txprecheck.h"
+#include "txreconciliation.h"
+#include "util/trace.h"
 
-int64_t nTimeBestReceived = 0;  // Used only to inform the wallet of when we last received a block
+#include <limits>
 
-static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
+#include <boost/thread/shared_mutex.hpp>
 
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-};
+int64_t nTimeBestReceived = 0;  // Used only to inform the wallet of when we last received a block
 
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);
-std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev GUARDED_BY(cs_main);
+static const uint64_t RANDOMIZER_ID_ADDRESS_RELAY = 0x3cac0035b5866b90ULL; // SHA256("main address relay")[0:8]
 
-void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+/** Interval between compact filter checkpoints. See BIP 157. */
+static constexpr int CFCHECKPT_INTERVAL = 1000;
+
+/** Maximum number of serialized blocks kept to answer getdata requests */
+static const unsigned int MAX_SERIALIZED_BLOCKS_CACHE = 8;
+/** Only the blocks within this depth from the tip get their serialized form cached */
+static const int SERIALIZED_BLOCKS_CACHE_DEPTH = 10;
+
+/** Number of headers of a run serialized at once to answer getheaders */
+static const int HEADERS_CACHE_RUN = 500;
+/** Maximum number of runs of serialized headers kept to answer getheaders */
+static const unsigned int MAX_HEADERS_CACHE_RUNS = 200;
+
+/** Depth of the blocks answered with a compact block, the deeper ones are sent in full. See BIP 152. */
+static const int MAX_CMPCTBLOCK_DEPTH = 5;
+/** Depth of the blocks whose transactions are answered to a getblocktxn. See BIP 152. */
+static const int MAX_BLOCKTXN_DEPTH = 10;
+
+static TxOrphanage g_orphanage GUARDED_BY(cs_main);
+static TxReconciliationTracker g_txreconciliation;
+
+/** With several message handler threads (-msghandthreads), processing the
+ *  messages handled here and sending the messages of a peer take cs_msgproc,
+ *  while the tier two messages take cs_msgproc_tiertwo, and so run in
+ *  parallel with them. The messages of a peer are always processed in order,
+ *  by the same thread. */
+static RecursiveMutex cs_msgproc;
+static RecursiveMutex cs_msgproc_tiertwo;
 
 // Internal stuff
 namespace {
@@ -69,6 +109,57 @@ std::map<uint256, NodeId> mapBlockSource;
 std::unique_ptr<CRollingBloomFilter> recentRejects;
 uint256 hashRecentRejectsChainTip;
 
+/** Memory used by the known inventory cache: about 130,000 items */
+static const size_t KNOWN_INVENTORY_CACHE_BYTES = 4 << 20;
+
+/**
+ * The inventory we have for good: the blocks of the index, the transactions that
+ * were in the mempool or the chain, and the tier-two objects and sporks seen.
+ * The announcements of an item by the other peers, after the first one, are
+ * answered here, before taking cs_main, without the lookups in the tier-two
+ * managers and their locks. Only the answers that can't turn false go in it:
+ * not the rejected transactions (retried on a new tip), nor the orphans, nor
+ * the items waiting in the precheck queues, nor the masternode broadcasts.
+ */
+class KnownInventoryCache
+{
+private:
+    //! Entries are SHA256(nonce || type || hash)
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setKnown;
+    boost::shared_mutex cs_known;
+
+    uint256 ComputeEntry(const CInv& inv) const
+    {
+        uint256 entry;
+        const uint32_t nType = inv.type;
+        CSHA256().Write(nonce.begin(), 32).Write((const unsigned char*)&nType, sizeof(nType)).Write(inv.hash.begin(), 32).Finalize(entry.begin());
+        return entry;
+    }
+
+public:
+    KnownInventoryCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+        setKnown.setup_bytes(KNOWN_INVENTORY_CACHE_BYTES);
+    }
+
+    bool Contains(const CInv& inv)
+    {
+        const uint256 entry = ComputeEntry(inv);
+        boost::shared_lock<boost::shared_mutex> lock(cs_known);
+        return setKnown.contains(entry, false);
+    }
+
+    void Insert(const CInv& inv)
+    {
+        uint256 entry = ComputeEntry(inv);
+        boost::unique_lock<boost::shared_mutex> lock(cs_known);
+        setKnown.insert(entry);
+    }
+};
+std::unique_ptr<KnownInventoryCache> knownInventory;
+
 /** Blocks that are in flight, and that are in the queue to be downloaded. Protected by cs_main. */
 struct QueuedBlock {
     uint256 hash;
@@ -85,6 +176,35 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
+/**
+ * On-wire form of the recent blocks requested by our peers, most recently
+ * used first, so that a new tip asked by many peers is read from disk and
+ * serialized only once. Protected by cs_main.
+ */
+std::list<std::pair<uint256, CSharedNetMsg>> listSerializedBlocks;
+
+/** The headers of the active chain at the heights [nHeight, nHeight + HEADERS_CACHE_RUN), in their on-wire form */
+struct CSerializedHeaders {
+    int nHeight;
+    //! The hash of the last block of the run, which commits to all the others
+    uint256 hashLast;
+    std::vector<unsigned char> vData;
+};
+
+/**
+ * Runs of headers requested by our peers, most recently used first: syncing
+ * peers ask for overlapping ranges. A run is valid while its last block is in
+ * the active chain, so those of a reorganized range are serialized again.
+ * Protected by cs_main.
+ */
+std::list<CSerializedHeaders> listSerializedHeaders;
+
+/** On-wire form of the last compact block requested by our peers. Protected by cs_main. */
+std::pair<uint256, CSharedNetMsg> lastSerializedCmpctBlock;
+
+/** Items and merkle tree of the last filtered block requested by our peers. Protected by cs_main. */
+std::pair<uint256, std::shared_ptr<const CFilteredBlockData>> lastFilteredBlockData;
+
 } // anon namespace
 
 
@@ -209,8 +329,18 @@ struct CNodeState {
     int64_t nStallingSince;
     std::list<QueuedBlock> vBlocksInFlight;
     int nBlocksInFlight;
+    //! Number of blocks we let in flight from this peer, adapted to its download speed.
+    int nBlocksInFlightTarget;
+    //! Moving average of the time the peer takes to deliver one block (in microseconds), or 0.
+    int64_t nAvgBlockTime;
+    //! When we last received a requested block from this peer (in microseconds), or 0.
+    int64_t nLastBlockReceived;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! Whether this peer can give us compact blocks (sendcmpct of CMPCTBLOCKS_VERSION).
+    bool fProvidesCompactBlocks;
+    //! The compact block of this peer waiting for its missing transactions (blocktxn), or null.
+    std::unique_ptr<PartiallyDownloadedBlock> partialBlock;
 
     CNodeBlocks nodeBlocks;
 
@@ -224,7 +354,11 @@ struct CNodeState {
         fSyncStarted = false;
         nStallingSince = 0;
         nBlocksInFlight = 0;
+        nBlocksInFlightTarget = DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER;
+        nAvgBlockTime = 0;
+        nLastBlockReceived = 0;
         fPreferredDownload = false;
+        fProvidesCompactBlocks = false;
     }
 };
 
@@ -297,18 +431,37 @@ void FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTime)
 
     for (const QueuedBlock& entry : state->vBlocksInFlight)
         mapBlocksInFlight.erase(entry.hash);
-    EraseOrphansFor(nodeid);
+    g_orphanage.EraseForPeer(nodeid);
+    g_txreconciliation.ForgetPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
 
     mapNodeState.erase(nodeid);
 }
 
-// Requires cs_main.
-void MarkBlockAsReceived(const uint256& hash)
+/**
+ * Adapt the number of blocks we keep in flight from a peer to its measured speed: as many
+ * as it delivers in BLOCK_DOWNLOAD_TARGET_TIME, so that the window covers both its latency
+ * and its throughput. Requires cs_main.
+ */
+void UpdateBlockDownloadRate(CNodeState* state, int64_t nRequestTime)
+{
+    const int64_t nNow = GetTimeMicros();
+    // The blocks requested before this one were being sent until the previous arrival
+    const int64_t nBlockTime = std::max<int64_t>(nNow - std::max(nRequestTime, state->nLastBlockReceived), 1);
+    state->nLastBlockReceived = nNow;
+    state->nAvgBlockTime = state->nAvgBlockTime == 0 ? nBlockTime : (state->nAvgBlockTime * 7 + nBlockTime) / 8;
+    const int64_t nTarget = BLOCK_DOWNLOAD_TARGET_TIME * 1000000 / state->nAvgBlockTime;
+    state->nBlocksInFlightTarget = std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, nTarget));
+}
+
+// Requires cs_main. nodeFrom is the peer the block was received from, if any.
+void MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1)
 {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState* state = State(itInFlight->second.first);
+        if (itInFlight->second.first == nodeFrom)
+            UpdateBlockDownloadRate(state, itInFlight->second.second->nTime);
         nQueuedValidatedHeaders -= itInFlight->second.second->fValidatedHeaders;
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
@@ -487,86 +640,6 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 }
 
 
-//////////////////////////////////////////////////////////////////////////////
-//
-// mapOrphanTransactions
-//
-
-bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    const uint256& hash = tx->GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 10,000 orphans, each of which is at most 5,000 bytes big is
-    // at most 500 megabytes of orphans:
-    unsigned int sz = tx->GetTotalSize();
-    if (sz > 5000) {
-        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
-        return false;
-    }
-
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer});
-    assert(ret.second);
-    for (const CTxIn& txin : tx->vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
-
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u prevsz %u)\n", hash.ToString(),
-        mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return;
-    for (const CTxIn& txin : it->second.tx->vin) {
-        std::map<uint256, std::set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(hash);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-    mapOrphanTransactions.erase(it);
-}
-
-void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer) {
-            EraseOrphanTx(maybeErase->second.tx->GetHash());
-            ++nErased;
-        }
-    }
-    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer %d\n", nErased, peer);
-}
-
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
-{
-    unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
 // Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
@@ -600,6 +673,17 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn) :
 {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    knownInventory.reset(new KnownInventoryCache());
+    blockprecheckqueue.SetNotifyCallback([connmanIn] { connmanIn->WakeMessageHandler(); });
+    txprecheckqueue.SetNotifyCallback([connmanIn] { connmanIn->WakeMessageHandler(); });
+    mnprecheckqueue.SetNotifyCallback([connmanIn] { connmanIn->WakeMessageHandler(); });
+}
+
+PeerLogicValidation::~PeerLogicValidation()
+{
+    blockprecheckqueue.SetNotifyCallback(nullptr);
+    txprecheckqueue.SetNotifyCallback(nullptr);
+    mnprecheckqueue.SetNotifyCallback(nullptr);
 }
 
 void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
@@ -648,8 +732,36 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
 // Messages
 //
 
-bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+/** The announcements of the tier-two objects we have count for the sync progress */
+static void CountKnownTierTwoInv(const CInv& inv)
 {
+    switch (inv.type) {
+    case MSG_MASTERNODE_WINNER:
+        masternodeSync.AddedMasternodeWinner(inv.hash);
+        break;
+    case MSG_BUDGET_VOTE:
+    case MSG_BUDGET_PROPOSAL:
+    case MSG_BUDGET_FINALIZED_VOTE:
+    case MSG_BUDGET_FINALIZED:
+        masternodeSync.AddedBudgetItem(inv.hash);
+        break;
+    }
+}
+
+/** Whether the known inventory cache has the item. Doesn't need cs_main. */
+static bool AlreadyHaveKnown(const CInv& inv)
+{
+    assert(knownInventory);
+    if (!knownInventory->Contains(inv))
+        return false;
+    CountKnownTierTwoInv(inv);
+    return true;
+}
+
+/** The lookups of AlreadyHave. Sets fKnownRet when the answer can go in the known inventory cache. */
+bool static AlreadyHaveInner(const CInv& inv, bool& fKnownRet) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    fKnownRet = true;
     switch (inv.type) {
     case MSG_TX: {
         assert(recentRejects);
@@ -663,54 +775,36 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
         }
 
 
+        if (mempool.exists(inv.hash) ||
+            pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+            pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1)))
+            return true;
+        fKnownRet = false;
         return recentRejects->contains(inv.hash) ||
-               mempool.exists(inv.hash) ||
-               mapOrphanTransactions.count(inv.hash) ||
-               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
-               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
+               txprecheckqueue.Contains(inv.hash) ||
+               g_orphanage.HaveTx(inv.hash);
     }
 
     case MSG_BLOCK:
-        return mapBlockIndex.count(inv.hash);
-    case MSG_TXLOCK_REQUEST:
-        // deprecated
-        return true;
-    case MSG_TXLOCK_VOTE:
-        // deprecated
-        return true;
+        if (mapBlockIndex.count(inv.hash))
+            return true;
+        fKnownRet = false;
+        return blockprecheckqueue.Contains(inv.hash);
     case MSG_SPORK:
         return mapSporks.count(inv.hash);
     case MSG_MASTERNODE_WINNER:
-        if (masternodePayments.mapMasternodePayeeVotes.count(inv.hash)) {
-            masternodeSync.AddedMasternodeWinner(inv.hash);
-            return true;
-        }
-        return false;
+        return masternodePayments.mapMasternodePayeeVotes.count(inv.hash);
     case MSG_BUDGET_VOTE:
-        if (g_budgetman.HaveSeenProposalVote(inv.hash)) {
-            masternodeSync.AddedBudgetItem(inv.hash);
-            return true;
-        }
-        return false;
+        return g_budgetman.HaveSeenProposalVote(inv.hash);
     case MSG_BUDGET_PROPOSAL:
-        if (g_budgetman.HaveProposal(inv.hash)) {
-            masternodeSync.AddedBudgetItem(inv.hash);
-            return true;
-        }
-        return false;
+        return g_budgetman.HaveProposal(inv.hash);
     case MSG_BUDGET_FINALIZED_VOTE:
-        if (g_budgetman.HaveSeenFinalizedBudgetVote(inv.hash)) {
-            masternodeSync.AddedBudgetItem(inv.hash);
-            return true;
-        }
-        return false;
+        return g_budgetman.HaveSeenFinalizedBudgetVote(inv.hash);
     case MSG_BUDGET_FINALIZED:
-        if (g_budgetman.HaveFinalizedBudget(inv.hash)) {
-            masternodeSync.AddedBudgetItem(inv.hash);
-            return true;
-        }
-        return false;
+        return g_budgetman.HaveFinalizedBudget(inv.hash);
     case MSG_MASTERNODE_ANNOUNCE:
+        // The broadcasts whose collateral isn't confirmed enough yet are forgotten, to be checked again later
+        fKnownRet = false;
         if (mnodeman.mapSeenMasternodeBroadcast.count(inv.hash)) {
             masternodeSync.AddedMasternodeList(inv.hash);
             return true;
@@ -719,7 +813,22 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     case MSG_MASTERNODE_PING:
         return mnodeman.mapSeenMasternodePing.count(inv.hash);
     }
-    // Don't know what it is, just say we already got one
+    // Don't know what it is (or deprecated, MSG_TXLOCK_REQUEST and MSG_TXLOCK_VOTE), just say we already got one
+    fKnownRet = false;
+    return true;
+}
+
+bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (AlreadyHaveKnown(inv))
+        return true;
+    bool fKnown;
+    if (!AlreadyHaveInner(inv, fKnown))
+        return false;
+    if (fKnown) {
+        knownInventory->Insert(inv);
+        CountKnownTierTwoInv(inv);
+    }
     return true;
 }
 
@@ -728,6 +837,11 @@ static void RelayTransaction(const CTransaction& tx, CConnman& connman)
     CInv inv(MSG_TX, tx.GetHash());
     connman.ForEachNode([&inv](CNode* pnode)
     {
+        // The peers we reconcile with get it at the next reconciliation
+        if (!g_txreconciliation.ShouldFlood(pnode->GetId())) {
+            if (pnode->IsInventoryKnown(inv.hash) || g_txreconciliation.AddToSet(pnode->GetId(), inv.hash))
+                return;
+        }
         pnode->PushInventory(inv);
     });
 }
@@ -836,6 +950,89 @@ bool static PushTierTwoGetDataRequest(const CInv& inv,
     return false;
 }
 
+static CSharedNetMsg GetSerializedBlock(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const uint256& hash = pindex->GetBlockHash();
+    for (auto it = listSerializedBlocks.begin(); it != listSerializedBlocks.end(); ++it) {
+        if (it->first == hash) {
+            listSerializedBlocks.splice(listSerializedBlocks.begin(), listSerializedBlocks, it);
+            return it->second;
+        }
+    }
+
+    // The on-disk and on-wire forms of a block are the same: no need to deserialize it
+    CSerializedNetMsg rawMsg;
+    rawMsg.command = NetMsgType::BLOCK;
+    if (!ReadRawBlockFromDisk(rawMsg.data, pindex))
+        assert(!"cannot load block from disk");
+    CSharedNetMsg msg = CConnman::MakeSharedMessage(std::move(rawMsg));
+    if (chainActive.Height() - pindex->nHeight < SERIALIZED_BLOCKS_CACHE_DEPTH) {
+        listSerializedBlocks.emplace_front(hash, msg);
+        if (listSerializedBlocks.size() > MAX_SERIALIZED_BLOCKS_CACHE)
+            listSerializedBlocks.pop_back();
+    }
+    return msg;
+}
+
+/** The run of headers starting at nHeight (a multiple of HEADERS_CACHE_RUN), null if the active chain doesn't have it all */
+static const std::vector<unsigned char>* GetSerializedHeaders(int nHeight) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CBlockIndex* pindexLast = chainActive[nHeight + HEADERS_CACHE_RUN - 1];
+    if (!pindexLast)
+        return nullptr;
+    for (auto it = listSerializedHeaders.begin(); it != listSerializedHeaders.end(); ++it) {
+        if (it->nHeight == nHeight) {
+            if (it->hashLast != pindexLast->GetBlockHash()) {
+                listSerializedHeaders.erase(it);
+                break;
+            }
+            listSerializedHeaders.splice(listSerializedHeaders.begin(), listSerializedHeaders, it);
+            return &it->vData;
+        }
+    }
+
+    // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+    CSerializedHeaders headers{nHeight, pindexLast->GetBlockHash(), {}};
+    CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, headers.vData, 0);
+    for (int h = nHeight; h < nHeight + HEADERS_CACHE_RUN; h++) {
+        writer << CBlock(chainActive[h]->GetBlockHeader());
+    }
+    listSerializedHeaders.emplace_front(std::move(headers));
+    if (listSerializedHeaders.size() > MAX_HEADERS_CACHE_RUNS)
+        listSerializedHeaders.pop_back();
+    return &listSerializedHeaders.front().vData;
+}
+
+static CSharedNetMsg GetSerializedCmpctBlock(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    // The same compact block (and short IDs nonce) is sent to all the peers
+    const uint256& hash = pindex->GetBlockHash();
+    if (lastSerializedCmpctBlock.first == hash)
+        return lastSerializedCmpctBlock.second;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        assert(!"cannot load block from disk");
+    CSharedNetMsg msg = CConnman::MakeSharedMessage(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(block)));
+    lastSerializedCmpctBlock = std::make_pair(hash, msg);
+    return msg;
+}
+
+static std::shared_ptr<const CFilteredBlockData> GetFilteredBlockData(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    // The same block is matched against the filter of each peer
+    const uint256& hash = pindex->GetBlockHash();
+    if (lastFilteredBlockData.first == hash)
+        return lastFilteredBlockData.second;
+
+    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+    if (!ReadBlockFromDisk(*pblock, pindex))
+        assert(!"cannot load block from disk");
+    auto pdata = std::make_shared<const CFilteredBlockData>(pblock);
+    lastFilteredBlockData = std::make_pair(hash, pdata);
+    return pdata;
+}
+
 void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman& connman, const std::atomic<bool>& interruptMsgProc)
 {
     LOCK(cs_main);
@@ -856,28 +1053,48 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman& connman
                 LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for old block that isn't in the main chain\n", pfrom->GetId());
             }
         }
+        // Pruned nodes may have deleted the block
+        if (send && !(mi->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint(BCLog::NET, "ProcessGetData(): ignoring request from peer=%i for pruned block %s\n", pfrom->GetId(), inv.hash.ToString());
+            send = false;
+        }
+    }
+    // Past the upload budget of the class of the block, disconnect the peer so that
+    // it finds another one to download from (whitelisted peers are always served)
+    const UploadClass uploadClass = send && chainActive.Tip()->GetBlockTime() - mi->second->GetBlockTime() > HISTORICAL_BLOCK_AGE ?
+                                    UPLOAD_HISTORICAL_BLOCKS : UPLOAD_TIP_RELAY;
+    if (send && !pfrom->fWhitelisted && connman.UploadBudgetReached(uploadClass)) {
+        LogPrint(BCLog::NET, "%s upload budget reached, disconnect peer=%d\n", GetUploadClassName(uploadClass), pfrom->GetId());
+        pfrom->fDisconnect = true;
+        send = false;
     }
     // Don't send not-validated blocks
     if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
-        // Send block from disk
-        CBlock block;
-        if (!ReadBlockFromDisk(block, (*mi).second))
-            assert(!"cannot load block from disk");
         if (inv.type == MSG_BLOCK)
-            connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+            connman.PushMessage(pfrom, GetSerializedBlock(mi->second), uploadClass);
+        else if (inv.type == MSG_CMPCT_BLOCK) {
+            // The transactions of the older blocks have left the mempool of the peer
+            if (chainActive.Height() - mi->second->nHeight <= MAX_CMPCTBLOCK_DEPTH)
+                connman.PushMessage(pfrom, GetSerializedCmpctBlock(mi->second), uploadClass);
+            else
+                connman.PushMessage(pfrom, GetSerializedBlock(mi->second), uploadClass);
+        }
         else // MSG_FILTERED_BLOCK)
         {
+            // Send block from disk
+            std::shared_ptr<const CFilteredBlockData> blockData = GetFilteredBlockData(mi->second);
+            const CBlock& block = *blockData->pblock;
             bool send_ = false;
             CMerkleBlock merkleBlock;
             {
                 LOCK(pfrom->cs_filter);
                 if (pfrom->pfilter) {
                     send_ = true;
-                    merkleBlock = CMerkleBlock(block, *pfrom->pfilter);
+                    merkleBlock = CMerkleBlock(*blockData, *pfrom->pfilter);
                 }
             }
             if (send_) {
-                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock), uploadClass);
                 // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
                 // This avoids hurting performance by pointlessly requiring a round-trip
                 // Note that there is currently no way for a node to request any single transactions we didnt send here -
@@ -885,7 +1102,7 @@ void static ProcessGetBlockData(CNode* pfrom, const CInv& inv, CConnman& connman
                 // Thus, the protocol spec specified allows for us to provide duplicate txn here,
                 // however we MUST always provide at least what the remote peer needs
                 for (std::pair<unsigned int, uint256>& pair : merkleBlock.vMatchedTxn)
-                    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, *block.vtx[pair.first]));
+                    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, *block.vtx[pair.first]), uploadClass);
             }
             // else
             // no response
@@ -924,6 +1141,8 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, const std::atomic<bo
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    // Past the tx relay budget, the transactions requested are answered with notfound
+    const bool fTxBudgetReached = !pfrom->fWhitelisted && connman.UploadBudgetReached(UPLOAD_TX_RELAY);
     {
         LOCK(cs_main);
 
@@ -939,7 +1158,7 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, const std::atomic<bo
 
             // Send stream from relay memory
             bool pushed = false;
-            if (inv.type == MSG_TX) {
+            if (inv.type == MSG_TX && !fTxBudgetReached) {
                 auto txinfo = mempool.info(inv.hash);
                 if (txinfo.tx) { // future: add timeLastMempoolReq check
                     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
@@ -966,7 +1185,7 @@ void static ProcessGetData(CNode* pfrom, CConnman& connman, const std::atomic<bo
     if (it != pfrom->vRecvGetData.end()) {
         const CInv &inv = *it;
         it++;
-        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK) {
+        if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK) {
             ProcessGetBlockData(pfrom, inv, connman, interruptMsgProc);
         }
     }
@@ -1019,6 +1238,389 @@ static void CheckBlockSpam(CValidationState& state, CNode* pfrom, const uint256&
     }
 }
 
+/** Hand a block received from nodeid to ProcessNewBlock. pfrom is nullptr if the peer is gone since. */
+static void ProcessBlockFromPeer(CNode* pfrom, NodeId nodeid, CConnman& connman, const std::shared_ptr<const CBlock>& pblock)
+{
+    const uint256& hashBlock = pblock->GetHash();
+    CValidationState state;
+    bool fAccepted = true;
+    ProcessNewBlock(state, pfrom, pblock, nullptr, &fAccepted);
+    if (!fAccepted && pfrom) {
+        CheckBlockSpam(state, pfrom, hashBlock);
+    }
+    WITH_LOCK(cs_main, mapBlockSource.emplace(hashBlock, nodeid); );
+    int nDoS;
+    if (state.IsInvalid(nDoS)) {
+        assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
+        if (pfrom) {
+            connman.PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::REJECT, std::string(NetMsgType::BLOCK), state.GetRejectCode(),
+                state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hashBlock));
+        }
+        if (nDoS > 0) {
+            TRY_LOCK(cs_main, lockMain);
+            if (lockMain) Misbehaving(nodeid, nDoS);
+        }
+    }
+    //disconnect this node if its old protocol version
+    if (pfrom) pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), NetMsgType::BLOCK);
+}
+
+/** Process the blocks of blockprecheckqueue whose checks are done, in arrival order. Returns their number. */
+static size_t ProcessPreCheckedBlocks(CConnman& connman, bool fWait)
+{
+    const std::vector<CBlockPreCheckQueue::Entry> vEntries = blockprecheckqueue.PopChecked(fWait);
+    for (const CBlockPreCheckQueue::Entry& entry : vEntries) {
+        CNode* pnode = nullptr;
+        connman.ForNode(entry.nodeid, [&pnode](CNode* p) { pnode = p->AddRef(); return true; });
+        ProcessBlockFromPeer(pnode, entry.nodeid, connman, entry.pblock);
+        if (pnode) pnode->Release();
+    }
+    return vEntries.size();
+}
+
+/** Hand a block reconstructed from a compact block of pfrom to ProcessNewBlock */
+static void ProcessReconstructedBlock(CNode* pfrom, CConnman& connman, const std::shared_ptr<const CBlock>& pblock)
+{
+    WITH_LOCK(cs_main, MarkBlockAsReceived(pblock->GetHash(), pfrom->GetId()); );
+    while (ProcessPreCheckedBlocks(connman, true) > 0) {}
+    ProcessBlockFromPeer(pfrom, pfrom->GetId(), connman, pblock);
+}
+
+/** Hand a transaction received from pfrom to AcceptToMemoryPool, with the result of its pre-check if any */
+static void ProcessTransactionFromPeer(CNode* pfrom, CConnman& connman, const CTransactionRef& ptx, const TxPreCheckResult* pPreCheck)
+{
+    const CTransaction& tx = *ptx;
+    CInv inv(MSG_TX, tx.GetHash());
+
+    LOCK(cs_main);
+
+    bool ignoreFees = false;
+    bool fMissingInputs = false;
+    bool fMissingZerocoinInputs = false;
+    CValidationState state;
+
+    if (!tx.HasZerocoinSpendInputs() && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees, false, pPreCheck)) {
+        mempool.check(pcoinsTip);
+        RelayTransaction(tx, connman);
+
+        LogPrint(BCLog::MEMPOOL, "%s : peer=%d %s : accepted %s (poolsz %u txn, %u kB)\n",
+                __func__, pfrom->id, pfrom->cleanSubVer, tx.GetHash().ToString(),
+                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        std::vector<CTransactionRef> vWorkQueue{ptx};
+        std::set<NodeId> setMisbehaving;
+        for (unsigned int i = 0; i < vWorkQueue.size(); i++) {
+            for (const uint256& orphanHash : g_orphanage.GetChildren(*vWorkQueue[i])) {
+                CTransactionRef orphanTx;
+                NodeId fromPeer;
+                if (!g_orphanage.GetTx(orphanHash, orphanTx, fromPeer))
+                    continue; // resolved by another parent already
+                bool fMissingInputs2 = false;
+                // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
+                // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
+                // anyone relaying LegitTxX banned)
+                CValidationState stateDummy;
+
+
+                if(setMisbehaving.count(fromPeer))
+                    continue;
+                if(AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
+                    LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
+                    RelayTransaction(*orphanTx, connman);
+                    vWorkQueue.push_back(orphanTx);
+                    g_orphanage.EraseTx(orphanHash);
+                } else if(!fMissingInputs2) {
+                    int nDos = 0;
+                    if(stateDummy.IsInvalid(nDos) && nDos > 0) {
+                        // Punish peer that gave us an invalid orphan tx
+                        Misbehaving(fromPeer, nDos);
+                        setMisbehaving.insert(fromPeer);
+                        LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
+                    }
+                    // Has inputs but not accepted to mempool
+                    // Probably non-standard or insufficient fee/priority
+                    LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
+                    g_orphanage.EraseTx(orphanHash);
+                    assert(recentRejects);
+                    recentRejects->insert(orphanHash);
+                }
+                mempool.check(pcoinsTip);
+            }
+        }
+
+
+    } else if (tx.HasZerocoinSpendInputs() && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingZerocoinInputs, false, false, ignoreFees)) {
+        //Presstab: ZCoin has a bunch of code commented out here. Is this something that should have more going on?
+        //Also there is nothing that handles fMissingZerocoinInputs. Does there need to be?
+        RelayTransaction(tx, connman);
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: Zerocoinspend peer=%d %s : accepted %s (poolsz %u)\n",
+                 pfrom->id, pfrom->cleanSubVer,
+                 tx.GetHash().ToString(),
+                 mempool.mapTx.size());
+    } else if (fMissingInputs) {
+        g_orphanage.AddTx(ptx, pfrom->GetId());
+
+        // DoS prevention: do not allow the orphanage to grow unbounded
+        unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+        unsigned int nEvicted = g_orphanage.LimitOrphans(nMaxOrphanTx);
+        if (nEvicted > 0)
+            LogPrint(BCLog::MEMPOOL, "orphanage overflow, removed %u tx\n", nEvicted);
+    } else {
+        // AcceptToMemoryPool() returned false, possibly because the tx is
+        // already in the mempool; if the tx isn't in the mempool that
+        // means it was rejected and we shouldn't ask for it again.
+        if (!mempool.exists(tx.GetHash())) {
+            assert(recentRejects);
+            recentRejects->insert(tx.GetHash());
+        }
+        if (pfrom->fWhitelisted) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were rejected from the mempool, allowing the node to
+            // function as a gateway for nodes hidden behind it.
+            //
+            // FIXME: This includes invalid transactions, which means a
+            // whitelisted peer could get us banned! We may want to change
+            // that.
+            RelayTransaction(tx, connman);
+        }
+    }
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS)) {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
+            pfrom->id, pfrom->cleanSubVer,
+            FormatStateMessage(state));
+        if (state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
+            connman.PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::REJECT, std::string(NetMsgType::TX), state.GetRejectCode(),
+                    state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+        if (nDoS > 0)
+            Misbehaving(pfrom->GetId(), nDoS);
+    }
+}
+
+/** Process the transactions of txprecheckqueue whose pre-checks are done, in arrival order */
+static void ProcessPreCheckedTxs(CConnman& connman)
+{
+    for (const CTxPreCheckQueue::Entry& entry : txprecheckqueue.PopChecked()) {
+        CNode* pnode = nullptr;
+        connman.ForNode(entry.nodeid, [&pnode](CNode* p) { pnode = p->AddRef(); return true; });
+        if (pnode) {
+            ProcessTransactionFromPeer(pnode, connman, entry.tx, &entry.result);
+            pnode->Release();
+        } else {
+            // The peer is gone, the transaction will be announced again by the others
+            LOCK(cs_main);
+            for (const COutPoint& outpoint : entry.result.coins_to_uncache)
+                pcoinsTip->Uncache(outpoint);
+        }
+    }
+}
+
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index, BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(stop_hash);
+        stop_index = mi != mapBlockIndex.end() ? mi->second : nullptr;
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !chainActive.Contains(stop_index)) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with "
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = g_blockfilterindex.get();
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, CConnman& connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto& filter : filters) {
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, CConnman& connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block = stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::CFHEADERS,
+                                             filter_type_ser,
+                                             stop_index->GetBlockHash(),
+                                             prev_header,
+                                             filter_hashes));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, CConnman& connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::CFCHECKPT,
+                                             filter_type_ser,
+                                             stop_index->GetBlockHash(),
+                                             headers));
+}
+
 bool fRequestedSporksIDB = false;
 bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vRecv, int64_t nTimeReceived, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
@@ -1113,6 +1715,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             }
         }
 
+        // Offer to reconcile the transactions, if both sides support it
+        if ((pfrom->GetLocalServices() & NODE_TXRECON) && (nServices & NODE_TXRECON) && pfrom->fRelayTxes) {
+            const uint64_t nSalt = g_txreconciliation.PreRegisterPeer(pfrom->GetId());
+            connman.PushMessage(pfrom, CNetMsgMaker(nSendVersion).Make(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_VERSION, nSalt));
+        }
+
         // Change version
         pfrom->SetSendVersion(nSendVersion);
         pfrom->nVersion = nVersion;
@@ -1212,6 +1820,8 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             State(pfrom->GetId())->fCurrentlyConnected = true;
         }
         pfrom->fSuccessfullyConnected = true;
+        // We serve and take the compact blocks, the new blocks are still announced by inv
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, false, CMPCTBLOCKS_VERSION));
         LogPrintf("New outbound peer connected: version: %d, blocks=%d, peer=%d%s\n",
                   pfrom->nVersion.load(), pfrom->nStartingHeight, pfrom->GetId(),
                   (fLogIPs ? strprintf(", peeraddr=%s", pfrom->addr.ToString()) : ""));
@@ -1271,6 +1881,12 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             return error("message inv size() = %u", vInv.size());
         }
 
+        // Most of the items announced are known already: they are looked up before taking cs_main
+        std::vector<bool> vKnown(vInv.size());
+        for (unsigned int nInv = 0; nInv < vInv.size(); nInv++) {
+            vKnown[nInv] = AlreadyHaveKnown(vInv[nInv]);
+        }
+
         LOCK(cs_main);
 
         std::vector<CInv> vToFetch;
@@ -1289,7 +1905,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
             pfrom->AddInventoryKnown(inv);
 
-            bool fAlreadyHave = AlreadyHave(inv);
+            bool fAlreadyHave = vKnown[nInv] || AlreadyHave(inv);
             LogPrint(BCLog::NET, "got inv: %s  %s peer=%d\n", inv.ToString(), fAlreadyHave ? "have" : "new", pfrom->id);
 
             if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
@@ -1307,11 +1923,216 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 
         }
 
+        // A single new block announced out of the initial download is most likely
+        // made of transactions that we have in the mempool already
+        if (vToFetch.size() == 1 && State(pfrom->GetId())->fProvidesCompactBlocks && !IsInitialBlockDownload()) {
+            vToFetch[0].type = MSG_CMPCT_BLOCK;
+        }
+
         if (!vToFetch.empty())
             connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, vToFetch));
     }
 
 
+    else if (strCommand == NetMsgType::SENDTXRCNCL) {
+        uint32_t nReconVersion;
+        uint64_t nRemoteSalt;
+        vRecv >> nReconVersion >> nRemoteSalt;
+        // Ignored if we didn't offer it in turn
+        if (nReconVersion >= TXRECONCILIATION_VERSION && g_txreconciliation.RegisterPeer(pfrom->GetId(), pfrom->fInbound, nRemoteSalt))
+            LogPrint(BCLog::NET, "reconciling the transactions with peer=%d\n", pfrom->GetId());
+    }
+
+
+    else if (strCommand == NetMsgType::REQTXRCNCL) {
+        uint32_t nRemoteSetSize;
+        vRecv >> nRemoteSetSize;
+        PinSketch sketch;
+        if (!g_txreconciliation.HandleRequest(pfrom->GetId(), nRemoteSetSize, sketch)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            return error("unexpected reqtxrcncl, peer=%d", pfrom->GetId());
+        }
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+    }
+
+
+    else if (strCommand == NetMsgType::SKETCH) {
+        PinSketch sketch;
+        vRecv >> sketch;
+        bool fSuccess;
+        std::vector<uint256> vAnnounce;
+        std::vector<uint32_t> vAsk;
+        if (!g_txreconciliation.HandleSketch(pfrom->GetId(), sketch, fSuccess, vAnnounce, vAsk)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            return error("unexpected sketch, peer=%d", pfrom->GetId());
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s: %u to announce, %u to ask\n", pfrom->GetId(),
+                 fSuccess ? "decoded" : "failed, falling back to inv", vAnnounce.size(), vAsk.size());
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, fSuccess, vAsk));
+        for (const uint256& hash : vAnnounce)
+            pfrom->PushInventory(CInv(MSG_TX, hash));
+    }
+
+
+    else if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool fSuccess;
+        std::vector<uint32_t> vAsk;
+        vRecv >> fSuccess >> vAsk;
+        std::vector<uint256> vAnnounce;
+        if (vAsk.size() > MAX_SKETCH_CAPACITY || !g_txreconciliation.HandleDiff(pfrom->GetId(), fSuccess, vAsk, vAnnounce)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            return error("unexpected reconcildiff, peer=%d", pfrom->GetId());
+        }
+        for (const uint256& hash : vAnnounce)
+            pfrom->PushInventory(CInv(MSG_TX, hash));
+    }
+
+
+    else if (strCommand == NetMsgType::SENDCMPCT) {
+        bool fAnnounceUsingCMPCTBLOCK = false;
+        uint64_t nCMPCTBLOCKVersion = 0;
+        vRecv >> fAnnounceUsingCMPCTBLOCK >> nCMPCTBLOCKVersion;
+        // The high-bandwidth mode (fAnnounceUsingCMPCTBLOCK) is not implemented: the
+        // blocks are announced by inv, and requested as compact blocks in getdata.
+        if (nCMPCTBLOCKVersion == CMPCTBLOCKS_VERSION) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesCompactBlocks = true;
+        }
+    }
+
+
+    else if (strCommand == NetMsgType::GETBLOCKTXN) {
+        BlockTransactionsRequest req;
+        vRecv >> req;
+
+        LOCK(cs_main);
+
+        BlockMap::iterator it = mapBlockIndex.find(req.blockhash);
+        if (it == mapBlockIndex.end() || !(it->second->nStatus & BLOCK_HAVE_DATA)) {
+            LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block we don't have\n", pfrom->GetId());
+            return true;
+        }
+
+        if (it->second->nHeight < chainActive.Height() - MAX_BLOCKTXN_DEPTH) {
+            // Too deep to be worth reading its transactions, the peer gets the full block
+            LogPrint(BCLog::NET, "Peer %d sent us a getblocktxn for a block > %i deep\n", pfrom->GetId(), MAX_BLOCKTXN_DEPTH);
+            connman.PushMessage(pfrom, GetSerializedBlock(it->second));
+            return true;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, it->second))
+            assert(!"cannot load block from disk");
+
+        BlockTransactions resp(req);
+        for (size_t i = 0; i < req.indexes.size(); i++) {
+            if (req.indexes[i] >= block.vtx.size()) {
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us a getblocktxn with out-of-bounds tx indices\n", pfrom->GetId());
+                return true;
+            }
+            resp.txn[i] = block.vtx[req.indexes[i]];
+        }
+        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCKTXN, resp));
+    }
+
+
+    else if (strCommand == NetMsgType::CMPCTBLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        CBlockHeaderAndShortTxIDs cmpctblock;
+        vRecv >> cmpctblock;
+        const uint256 hashBlock = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hashBlock);
+        LogPrint(BCLog::NET, "received cmpctblock %s peer=%d\n", hashBlock.ToString(), pfrom->id);
+        pfrom->AddInventoryKnown(inv);
+
+        bool fAlreadyHave = blockprecheckqueue.Contains(hashBlock);
+        bool fHavePrev = blockprecheckqueue.Contains(cmpctblock.header.hashPrevBlock);
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        {
+            LOCK(cs_main);
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            fAlreadyHave |= mi != mapBlockIndex.end() && (mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK));
+            if (fAlreadyHave)
+                return true;
+
+            // Out of order: the full block goes through the usual sync path
+            fHavePrev |= mapBlockIndex.count(cmpctblock.header.hashPrevBlock) > 0;
+            if (!fHavePrev) {
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{inv}));
+                return true;
+            }
+
+            CNodeState* nodestate = State(pfrom->GetId());
+            nodestate->partialBlock.reset(new PartiallyDownloadedBlock(&mempool));
+            ReadStatus status = nodestate->partialBlock->InitData(cmpctblock);
+            if (status == READ_STATUS_INVALID) {
+                nodestate->partialBlock.reset();
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block\n", pfrom->GetId());
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Short ID collision, fall back to the full block
+                nodestate->partialBlock.reset();
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{inv}));
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < cmpctblock.BlockTxCount(); i++) {
+                if (!nodestate->partialBlock->IsTxAvailable(i))
+                    req.indexes.push_back(i);
+            }
+            if (!req.indexes.empty()) {
+                req.blockhash = hashBlock;
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+                return true;
+            }
+
+            status = nodestate->partialBlock->FillBlock(*pblock, std::vector<CTransactionRef>());
+            nodestate->partialBlock.reset();
+            if (status != READ_STATUS_OK) {
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{inv}));
+                return true;
+            }
+        }
+        ProcessReconstructedBlock(pfrom, connman, pblock);
+    }
+
+
+    else if (strCommand == NetMsgType::BLOCKTXN && !fImporting && !fReindex) // Ignore blocks received while importing
+    {
+        BlockTransactions resp;
+        vRecv >> resp;
+
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            if (!nodestate->partialBlock || nodestate->partialBlock->header.GetHash() != resp.blockhash) {
+                LogPrint(BCLog::NET, "Peer %d sent us block transactions for block we weren't expecting\n", pfrom->GetId());
+                return true;
+            }
+
+            ReadStatus status = nodestate->partialBlock->FillBlock(*pblock, resp.txn);
+            nodestate->partialBlock.reset();
+            if (status == READ_STATUS_INVALID) {
+                Misbehaving(pfrom->GetId(), 100);
+                LogPrintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->GetId());
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // Might have collided, fall back to the full block
+                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::GETDATA, std::vector<CInv>{CInv(MSG_BLOCK, resp.blockhash)}));
+                return true;
+            }
+        }
+        ProcessReconstructedBlock(pfrom, connman, pblock);
+    }
+
+
     else if (strCommand == NetMsgType::GETDATA) {
         std::vector<CInv> vInv;
         vRecv >> vInv;
@@ -1400,139 +2221,52 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
                 pindex = chainActive.Next(pindex);
         }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
-        std::vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
+        // The whole runs of headers in the range are copied from their serialized form,
+        // unless hashStop is in them
+        BlockMap::iterator miStop = mapBlockIndex.find(hashStop);
+        const int nStopHeight = miStop != mapBlockIndex.end() && chainActive.Contains(miStop->second) ?
+                                miStop->second->nHeight : std::numeric_limits<int>::max();
+        std::vector<unsigned char> vHeaders;
+        unsigned int nCount = 0;
         LogPrintf("getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex)) {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop)
+        while (pindex && nCount < MAX_HEADERS_RESULTS) {
+            if (pindex->nHeight % HEADERS_CACHE_RUN == 0 && nCount + HEADERS_CACHE_RUN <= MAX_HEADERS_RESULTS &&
+                    (nStopHeight < pindex->nHeight || nStopHeight >= pindex->nHeight + HEADERS_CACHE_RUN) &&
+                    chainActive.Contains(pindex)) {
+                const std::vector<unsigned char>* pvRun = GetSerializedHeaders(pindex->nHeight);
+                if (pvRun) {
+                    vHeaders.insert(vHeaders.end(), pvRun->begin(), pvRun->end());
+                    nCount += HEADERS_CACHE_RUN;
+                    pindex = chainActive.Next(chainActive[pindex->nHeight + HEADERS_CACHE_RUN - 1]);
+                    continue;
+                }
+            }
+            CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vHeaders, vHeaders.size()) << CBlock(pindex->GetBlockHeader());
+            nCount++;
+            if (pindex->GetBlockHash() == hashStop)
                 break;
+            pindex = chainActive.Next(pindex);
         }
-        connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::HEADERS;
+        CVectorWriter writer(SER_NETWORK, PROTOCOL_VERSION, msg.data, 0);
+        WriteCompactSize(writer, nCount);
+        msg.data.insert(msg.data.end(), vHeaders.begin(), vHeaders.end());
+        connman.PushMessage(pfrom, std::move(msg));
     }
 
 
     else if (strCommand == NetMsgType::TX) {
-        std::vector<uint256> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
-        CTransaction tx(deserialize, vRecv);
-        CTransactionRef ptx = MakeTransactionRef(tx);
+        CTransactionRef ptx = MakeTransactionRef(CTransaction(deserialize, vRecv));
 
-        CInv inv(MSG_TX, tx.GetHash());
+        CInv inv(MSG_TX, ptx->GetHash());
         pfrom->AddInventoryKnown(inv);
 
-        LOCK(cs_main);
-
-        bool ignoreFees = false;
-        bool fMissingInputs = false;
-        bool fMissingZerocoinInputs = false;
-        CValidationState state;
-
-        mapAlreadyAskedFor.erase(inv);
-
-        if (!tx.HasZerocoinSpendInputs() && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs, false, ignoreFees)) {
-            mempool.check(pcoinsTip);
-            RelayTransaction(tx, connman);
-            vWorkQueue.push_back(inv.hash);
-
-            LogPrint(BCLog::MEMPOOL, "%s : peer=%d %s : accepted %s (poolsz %u txn, %u kB)\n",
-                    __func__, pfrom->id, pfrom->cleanSubVer, tx.GetHash().ToString(),
-                    mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            std::set<NodeId> setMisbehaving;
-            for(unsigned int i = 0; i < vWorkQueue.size(); i++) {
-                std::map<uint256, std::set<uint256> >::iterator itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue[i]);
-                if(itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for(std::set<uint256>::iterator mi = itByPrev->second.begin();
-                    mi != itByPrev->second.end();
-                    ++mi) {
-                    const uint256 &orphanHash = *mi;
-                    const auto &orphanTx = mapOrphanTransactions[orphanHash].tx;
-                    NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
-                    // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
-                    // anyone relaying LegitTxX banned)
-                    CValidationState stateDummy;
-
-
-                    if(setMisbehaving.count(fromPeer))
-                        continue;
-                    if(AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2)) {
-                        LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(*orphanTx, connman);
-                        vWorkQueue.push_back(orphanHash);
-                        vEraseQueue.push_back(orphanHash);
-                    } else if(!fMissingInputs2) {
-                        int nDos = 0;
-                        if(stateDummy.IsInvalid(nDos) && nDos > 0) {
-                            // Punish peer that gave us an invalid orphan tx
-                            Misbehaving(fromPeer, nDos);
-                            setMisbehaving.insert(fromPeer);
-                            LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n", orphanHash.ToString());
-                        }
-                        // Has inputs but not accepted to mempool
-                        // Probably non-standard or insufficient fee/priority
-                        LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
-                        vEraseQueue.push_back(orphanHash);
-                        assert(recentRejects);
-                        recentRejects->insert(orphanHash);
-                    }
-                    mempool.check(pcoinsTip);
-                }
-            }
-
-            for (uint256& hash : vEraseQueue) EraseOrphanTx(hash);
-
-        } else if (tx.HasZerocoinSpendInputs() && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingZerocoinInputs, false, false, ignoreFees)) {
-            //Presstab: ZCoin has a bunch of code commented out here. Is this something that should have more going on?
-            //Also there is nothing that handles fMissingZerocoinInputs. Does there need to be?
-            RelayTransaction(tx, connman);
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: Zerocoinspend peer=%d %s : accepted %s (poolsz %u)\n",
-                     pfrom->id, pfrom->cleanSubVer,
-                     tx.GetHash().ToString(),
-                     mempool.mapTx.size());
-        } else if (fMissingInputs) {
-            AddOrphanTx(ptx, pfrom->GetId());
-
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-            if (nEvicted > 0)
-                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-        } else {
-            // AcceptToMemoryPool() returned false, possibly because the tx is
-            // already in the mempool; if the tx isn't in the mempool that
-            // means it was rejected and we shouldn't ask for it again.
-            if (!mempool.exists(tx.GetHash())) {
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-            }
-            if (pfrom->fWhitelisted) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were rejected from the mempool, allowing the node to
-                // function as a gateway for nodes hidden behind it.
-                //
-                // FIXME: This includes invalid transactions, which means a
-                // whitelisted peer could get us banned! We may want to change
-                // that.
-                RelayTransaction(tx, connman);
-            }
-        }
+        WITH_LOCK(cs_main, mapAlreadyAskedFor.erase(inv); );
 
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS)) {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d %s was not accepted into the memory pool: %s\n", tx.GetHash().ToString(),
-                pfrom->id, pfrom->cleanSubVer,
-                FormatStateMessage(state));
-            if (state.GetRejectCode() < REJECT_INTERNAL) // Never send AcceptToMemoryPool's internal codes over P2P
-                connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                        state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-            if (nDoS > 0)
-                Misbehaving(pfrom->GetId(), nDoS);
+        // Verify the signatures and the proofs out of cs_main first, if there is room in the queue
+        if (ptx->HasZerocoinSpendInputs() || !txprecheckqueue.Push(ptx, pfrom->GetId())) {
+            ProcessTransactionFromPeer(pfrom, connman, ptx, nullptr);
         }
     }
 
@@ -1602,7 +2336,7 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
         LogPrint(BCLog::NET, "received block %s peer=%d\n", inv.hash.ToString(), pfrom->id);
 
         // sometimes we will be sent their most recent block and its not the one we want, in that case tell where we are
-        if (!mapBlockIndex.count(pblock->hashPrevBlock)) {
+        if (!mapBlockIndex.count(pblock->hashPrevBlock) && !blockprecheckqueue.Contains(pblock->hashPrevBlock)) {
             CBlockLocator locator = WITH_LOCK(cs_main, return chainActive.GetLocator(););
             if (find(pfrom->vBlockRequested.begin(), pfrom->vBlockRequested.end(), hashBlock) != pfrom->vBlockRequested.end()) {
                 // we already asked for this block, so lets work backwards and ask for the previous block
@@ -1615,27 +2349,28 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
             }
         } else {
             pfrom->AddInventoryKnown(inv);
-            CValidationState state;
-            if (!mapBlockIndex.count(hashBlock)) {
-                WITH_LOCK(cs_main, MarkBlockAsReceived(hashBlock); );
-                bool fAccepted = true;
-                ProcessNewBlock(state, pfrom, pblock, nullptr, &fAccepted);
-                if (!fAccepted) {
-                    CheckBlockSpam(state, pfrom, hashBlock);
+            bool fAlreadyHave = blockprecheckqueue.Contains(hashBlock);
+            {
+                // With headers-first the index of the block is known before its data
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+                fAlreadyHave |= mi != mapBlockIndex.end() && (mi->second->nStatus & (BLOCK_HAVE_DATA | BLOCK_FAILED_MASK));
+            }
+            if (!fAlreadyHave) {
+                WITH_LOCK(cs_main, MarkBlockAsReceived(hashBlock, pfrom->GetId()); );
+                // During the initial download, leave the context-free checks to the pre-check
+                // workers while the blocks received before this one are connected. The successors
+                // of queued blocks are queued too, to keep the arrival order.
+                bool fQueued = false;
+                if (IsInitialBlockDownload() || blockprecheckqueue.Contains(pblock->hashPrevBlock)) {
+                    do {
+                        fQueued = blockprecheckqueue.Push(pblock, pfrom->GetId());
+                    } while (!fQueued && ProcessPreCheckedBlocks(connman, true) > 0);
                 }
-                WITH_LOCK(cs_main, mapBlockSource.emplace(hashBlock, pfrom->GetId()); );
-                int nDoS;
-                if(state.IsInvalid(nDoS)) {
-                    assert (state.GetRejectCode() < REJECT_INTERNAL); // Blocks are never rejected with internal reject codes
-                    connman.PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, state.GetRejectCode(),
-                        state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-                    if(nDoS > 0) {
-                        TRY_LOCK(cs_main, lockMain);
-                        if(lockMain) Misbehaving(pfrom->GetId(), nDoS);
-                    }
+                if (!fQueued) {
+                    while (ProcessPreCheckedBlocks(connman, true) > 0) {}
+                    ProcessBlockFromPeer(pfrom, pfrom->GetId(), connman, pblock);
                 }
-                //disconnect this node if its old protocol version
-                pfrom->DisconnectOldProtocol(pfrom->nVersion, ActiveProtocol(), strCommand);
             } else {
                 LogPrint(BCLog::NET, "%s : Already processed block %s, skipping ProcessNewBlock()\n", __func__, pblock->GetHash().GetHex());
             }
@@ -1806,6 +2541,21 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
     }
 
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, connman);
+    }
+
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, connman);
+    }
+
+
     else if (strCommand == NetMsgType::REJECT) {
         try {
             std::string strMsg;
@@ -1856,6 +2606,42 @@ bool static ProcessMessage(CNode* pfrom, std::string strCommand, CDataStream& vR
 }
 
 
+/** The bulk tier two sync requests, which block and tx relay messages can overtake */
+static bool IsBulkSyncCommand(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::GETMNLIST ||
+           strCommand == NetMsgType::GETMNWINNERS ||
+           strCommand == NetMsgType::BUDGETVOTESYNC;
+}
+
+static bool IsRelayCommand(const std::string& strCommand)
+{
+    return strCommand == NetMsgType::BLOCK ||
+           strCommand == NetMsgType::CMPCTBLOCK ||
+           strCommand == NetMsgType::BLOCKTXN ||
+           strCommand == NetMsgType::HEADERS ||
+           strCommand == NetMsgType::TX ||
+           strCommand == NetMsgType::INV;
+}
+
+/** Messages looked at past the bulk sync requests queued first, for a block or tx relay message */
+static const unsigned int MAX_RELAY_PREEMPT_SCAN = 16;
+
+/** The next message of a peer to process: the first one, unless it is a bulk
+ *  tier two sync request followed by other bulk requests then a relay message.
+ *  The bulk requests only wait for our answers, in the order they came, so
+ *  nothing else is reordered. */
+static std::list<CNetMessage>::iterator NextMessageToProcess(std::list<CNetMessage>& vProcessMsg)
+{
+    std::list<CNetMessage>::iterator it = vProcessMsg.begin();
+    unsigned int nScanned = 0;
+    while (it != vProcessMsg.end() && nScanned++ < MAX_RELAY_PREEMPT_SCAN && IsBulkSyncCommand(it->hdr.GetCommand()))
+        ++it;
+    if (it != vProcessMsg.begin() && it != vProcessMsg.end() && IsRelayCommand(it->hdr.GetCommand()))
+        return it;
+    return vProcessMsg.begin();
+}
+
 bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
     // Message format
@@ -1867,8 +2653,19 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
     //
     bool fMoreWork = false;
 
-    if (!pfrom->vRecvGetData.empty())
-        ProcessGetData(pfrom, connman, interruptMsgProc);
+    {
+        LOCK(cs_msgproc);
+        ProcessPreCheckedBlocks(connman, false);
+        ProcessPreCheckedTxs(connman);
+        mnodeman.ProcessPreChecked(connman);
+
+        if (!pfrom->vRecvGetData.empty()) {
+            const int64_t nTimeStart = GetTimeMicros();
+            ProcessGetData(pfrom, connman, interruptMsgProc);
+            const int64_t nNow = GetTimeMicros();
+            pfrom->AddProcessCost(NetMsgType::GETDATA, nNow - nTimeStart, nNow, 0);
+        }
+    }
 
     if (pfrom->fDisconnect)
         return false;
@@ -1886,8 +2683,9 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
         if (pfrom->vProcessMsg.empty())
             return false;
         // Just take one message
-        msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
+        msgs.splice(msgs.begin(), pfrom->vProcessMsg, NextMessageToProcess(pfrom->vProcessMsg));
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        pfrom->nRecvBufferUsage -= msgs.front().GetMemoryUsage();
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman.GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
@@ -1924,10 +2722,24 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
             return fMoreWork;
         }
 
+    // Past the tier two upload budget, leave the bulk sync requests unanswered:
+    // the syncing peers time out and ask the next peer
+    if (IsBulkSyncCommand(strCommand) && !pfrom->fWhitelisted && connman.UploadBudgetReached(UPLOAD_TIERTWO_SYNC)) {
+        LogPrint(BCLog::NET, "tier two upload budget reached, ignoring %s from peer=%d\n", SanitizeString(strCommand), pfrom->id);
+        return fMoreWork;
+    }
+
     // Process message
     bool fRet = false;
+    const int64_t nTimeStart = GetTimeMicros();
     try {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
+        if (IsTierTwoMessageType(strCommand)) {
+            LOCK(cs_msgproc_tiertwo);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
+        } else {
+            LOCK(cs_msgproc);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, connman, interruptMsgProc);
+        }
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -1948,6 +2760,12 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
     } catch (...) {
         PrintExceptionContinue(NULL, "ProcessMessages()");
     }
+    const int64_t nNow = GetTimeMicros();
+    const int64_t nQueueTime = std::max((int64_t)0, nTimeStart - msg.nTime);
+    pfrom->AddProcessCost(strCommand, nNow - nTimeStart, nNow, nQueueTime);
+    connman.RecordMessageProcessed(strCommand, nMessageSize + CMessageHeader::HEADER_SIZE, nNow - nTimeStart, nQueueTime);
+    TRACE7(net, inbound_message, pfrom->GetId(), pfrom->GetAddrName().c_str(), strCommand.c_str(), nMessageSize,
+        nNow - nTimeStart, nQueueTime, fRet);
 
     if (!fRet)
         LogPrint(BCLog::NET, "ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
@@ -1974,6 +2792,7 @@ public:
 
 bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsgProc)
 {
+    LOCK(cs_msgproc);
     {
         // Don't send anything until the version handshake is complete
         if (!pto->fSuccessfullyConnected || pto->fDisconnect)
@@ -2075,10 +2894,13 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             if ((nSyncStarted == 0 && fFetch) || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO);
-                connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                if (Params().HeadersFirstSyncingActive()) {
+                    const CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint(BCLog::NET, "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETHEADERS, chainActive.GetLocator(pindexStart), UINT256_ZERO));
+                } else {
+                    connman.PushMessage(pto, msgMaker.Make(NetMsgType::GETBLOCKS, chainActive.GetLocator(chainActive.Tip()), UINT256_ZERO));
+                }
             }
         }
 
@@ -2108,15 +2930,28 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             }
             pto->vInventoryBlockToSend.clear();
 
-            // Add tier two INVs
-            for (const CInv& tInv : pto->vInventoryTierTwoToSend) {
-                vInv.emplace_back(tInv);
-                if (vInv.size() == MAX_INV_SZ) {
-                    connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
-                    vInv.clear();
+            // Add tier two INVs, batched on their own trickle timer instead of
+            // one inv message per relayed object.
+            bool fSendTierTwoTrickle = pto->fWhitelisted;
+            if (pto->nNextTierTwoInvSend < nNow) {
+                fSendTierTwoTrickle = true;
+                pto->nNextTierTwoInvSend = PoissonNextSend(nNow, TIERTWO_INVENTORY_BROADCAST_INTERVAL >> !pto->fInbound);
+            }
+            if (fSendTierTwoTrickle) {
+                for (const CInv& tInv : pto->vInventoryTierTwoToSend) {
+                    // Queued twice, or announced by the peer since it was queued
+                    if (pto->filterInventoryKnown.contains(tInv.hash)) {
+                        continue;
+                    }
+                    pto->filterInventoryKnown.insert(tInv.hash);
+                    vInv.emplace_back(tInv);
+                    if (vInv.size() == MAX_INV_SZ) {
+                        connman.PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+                        vInv.clear();
+                    }
                 }
+                pto->vInventoryTierTwoToSend.clear();
             }
-            pto->vInventoryTierTwoToSend.clear();
 
             // Check whether periodic send should happen
             bool fSendTrickle = pto->fWhitelisted;
@@ -2157,6 +2992,11 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
                 pto->timeLastMempoolReq = GetTime();
             }
 
+            // Ask the outbound peers we reconcile with for their sketch
+            uint32_t nReconSetSize;
+            if (g_txreconciliation.ShouldRequest(pto->GetId(), nNow, nReconSetSize))
+                connman.PushMessage(pto, msgMaker.Make(NetMsgType::REQTXRCNCL, nReconSetSize));
+
             // Determine transactions to relay
             if (fSendTrickle) {
                 // Produce a vector with all candidates for sending
@@ -2231,10 +3071,10 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && fFetch && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        if (!pto->fClient && fFetch && state.nBlocksInFlight < state.nBlocksInFlightTarget) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            FindNextBlocksToDownload(pto->GetId(), state.nBlocksInFlightTarget - state.nBlocksInFlight, vToDownload, staller);
             for (const CBlockIndex* pindex : vToDownload) {
                 vGetData.emplace_back(MSG_BLOCK, pindex->GetBlockHash());
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), pindex);
@@ -2244,6 +3084,8 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
             if (state.nBlocksInFlight == 0 && staller != -1) {
                 if (State(staller)->nStallingSince == 0) {
                     State(staller)->nStallingSince = nNow;
+                    // The staller holds the window back: give it less to do
+                    State(staller)->nBlocksInFlightTarget = std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER, State(staller)->nBlocksInFlightTarget / 2);
                     LogPrint(BCLog::NET, "Stall started peer=%d\n", staller);
                 }
             }
@@ -2269,14 +3111,3 @@ bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interruptMsg
     }
     return true;
 }
-
-class CNetProcessingCleanup
-{
-public:
-    CNetProcessingCleanup() {}
-    ~CNetProcessingCleanup() {
-        // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
-    }
-} instance_of_cnetprocessingcleanup;
@@ -23,12 +23,20 @@ static const unsigned int DEFAULT_BLOCK_SPAM_FILTER_MAX_SIZE = 500;
 /** Default for -blockspamfiltermaxavg, maximum average size of an index occurrence in the block spam filter */
 static const unsigned int DEFAULT_BLOCK_SPAM_FILTER_MAX_AVG = 50;
 
+/** Default for -peerblockfilters, serve the compact block filters (BIP 157) to the peers */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
+
 /** Average delay between trickled inventory transmissions in seconds.
  *  Blocks and whitelisted receivers bypass this, outbound peers get half this delay. */
 static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Average delay between the batched tier two inventory transmissions in seconds.
+ *  Shorter than the transactions one, as the masternode sync waits for these items. */
+static const unsigned int TIERTWO_INVENTORY_BROADCAST_INTERVAL = 2;
+/** The blocks older than this, relative to the tip, are served as historical blocks (upload class) */
+static const int64_t HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 
 /** Register with a network node to receive its signals */
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
@@ -41,7 +49,7 @@ private:
 
 public:
     PeerLogicValidation(CConnman* connmanIn);
-    ~PeerLogicValidation() = default;
+    ~PeerLogicValidation();
 
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
     void BlockChecked(const CBlock& block, const CValidationState& state) override;
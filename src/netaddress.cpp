@@ -657,6 +657,25 @@ static inline int NetmaskBits(uint8_t x)
     }
 }
 
+int CSubNet::GetPrefixLength() const
+{
+    int n = 0;
+    int nBits = 0;
+    for (; n < 16 && netmask[n] == 0xff; ++n)
+        nBits += 8;
+    if (n < 16) {
+        const int bits = NetmaskBits(netmask[n]);
+        if (bits < 0)
+            return -1;
+        nBits += bits;
+        ++n;
+    }
+    for (; n < 16; ++n)
+        if (netmask[n] != 0x00)
+            return -1;
+    return nBits;
+}
+
 std::string CSubNet::ToString() const
 {
     /* Parse binary 1{n}0{N-n} to see if mask can be represented as /n */
@@ -112,6 +112,12 @@ public:
 
     bool Match(const CNetAddr& addr) const;
 
+    //! The network (base) address, masked
+    const CNetAddr& GetBase() const { return network; }
+    //! The number of leading one bits of the netmask, over the 128 of the address,
+    //! or -1 if the netmask isn't of the 1{n}0{128-n} form
+    int GetPrefixLength() const;
+
     std::string ToString() const;
     bool IsValid() const;
 
@@ -0,0 +1,143 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "peerinventory.h"
+
+#include "hash.h"
+#include "random.h"
+
+#include <limits>
+
+SharedInventoryKnown::SharedInventoryKnown() :
+    k0(GetRand(std::numeric_limits<uint64_t>::max())),
+    k1(GetRand(std::numeric_limits<uint64_t>::max())),
+    vRing(RING_SIZE),
+    vRingHome(RING_SIZE, 0),
+    vTable(TABLE_SIZE, 0)
+{
+}
+
+int SharedInventoryKnown::AddPeer()
+{
+    LOCK(cs);
+    if (!vFreePeers.empty()) {
+        const int nPeer = vFreePeers.back();
+        vFreePeers.pop_back();
+        vPeerBits[nPeer].assign(RING_SIZE / 64, 0);
+        return nPeer;
+    }
+    vPeerBits.emplace_back(RING_SIZE / 64, 0);
+    return vPeerBits.size() - 1;
+}
+
+void SharedInventoryKnown::RemovePeer(int nPeer)
+{
+    LOCK(cs);
+    // released, not to clear its bits on every reuse of a slot
+    std::vector<uint64_t>().swap(vPeerBits[nPeer]);
+    vFreePeers.push_back(nPeer);
+}
+
+void SharedInventoryKnown::Insert(int nPeer, const uint256& hash)
+{
+    LOCK(cs);
+    uint32_t nSlot = Find(hash);
+    if (nSlot == NOT_FOUND) nSlot = Add(hash);
+    vPeerBits[nPeer][nSlot / 64] |= (uint64_t)1 << (nSlot % 64);
+}
+
+bool SharedInventoryKnown::Contains(int nPeer, const uint256& hash) const
+{
+    LOCK(cs);
+    const uint32_t nSlot = Find(hash);
+    return nSlot != NOT_FOUND && (vPeerBits[nPeer][nSlot / 64] >> (nSlot % 64)) & 1;
+}
+
+void SharedInventoryKnown::Reset(int nPeer)
+{
+    LOCK(cs);
+    vPeerBits[nPeer].assign(RING_SIZE / 64, 0);
+}
+
+uint32_t SharedInventoryKnown::GetHome(const uint256& hash) const
+{
+    return SipHashUint256(k0, k1, hash) % TABLE_SIZE;
+}
+
+uint32_t SharedInventoryKnown::Find(const uint256& hash) const
+{
+    for (uint32_t nPos = GetHome(hash); vTable[nPos] != 0; nPos = (nPos + 1) % TABLE_SIZE) {
+        if (vRing[vTable[nPos] - 1] == hash) return vTable[nPos] - 1;
+    }
+    return NOT_FOUND;
+}
+
+uint32_t SharedInventoryKnown::Add(const uint256& hash)
+{
+    const uint32_t nSlot = nNext;
+    if (fFull) {
+        EraseFromTable(nSlot);
+        const uint64_t nMask = ~((uint64_t)1 << (nSlot % 64));
+        for (std::vector<uint64_t>& vBits : vPeerBits) {
+            if (!vBits.empty()) vBits[nSlot / 64] &= nMask;
+        }
+    }
+    vRing[nSlot] = hash;
+    vRingHome[nSlot] = GetHome(hash);
+    uint32_t nPos = vRingHome[nSlot];
+    while (vTable[nPos] != 0) nPos = (nPos + 1) % TABLE_SIZE;
+    vTable[nPos] = nSlot + 1;
+
+    nNext = (nNext + 1) % RING_SIZE;
+    if (nNext == 0) fFull = true;
+    return nSlot;
+}
+
+void SharedInventoryKnown::EraseFromTable(uint32_t nSlot)
+{
+    uint32_t nHole = vRingHome[nSlot];
+    while (vTable[nHole] != nSlot + 1) nHole = (nHole + 1) % TABLE_SIZE;
+    vTable[nHole] = 0;
+
+    // Shift back the entries of the run after the hole that may take it
+    for (uint32_t nPos = (nHole + 1) % TABLE_SIZE; vTable[nPos] != 0; nPos = (nPos + 1) % TABLE_SIZE) {
+        const uint32_t nHome = vRingHome[vTable[nPos] - 1];
+        // the entry stays if its home is in (nHole, nPos], cyclically
+        const bool fStays = nHole < nPos ? (nHome > nHole && nHome <= nPos) : (nHome > nHole || nHome <= nPos);
+        if (fStays) continue;
+        vTable[nHole] = vTable[nPos];
+        vTable[nPos] = 0;
+        nHole = nPos;
+    }
+}
+
+static SharedInventoryKnown& GetSharedInventoryKnown()
+{
+    // created with the first peer, after the randomizer is initialized, and
+    // never destroyed, not to depend on the order of the static destructors
+    static SharedInventoryKnown* sharedInventoryKnown = new SharedInventoryKnown();
+    return *sharedInventoryKnown;
+}
+
+PeerInventoryKnown::PeerInventoryKnown() : nPeer(GetSharedInventoryKnown().AddPeer()) {}
+
+PeerInventoryKnown::~PeerInventoryKnown()
+{
+    GetSharedInventoryKnown().RemovePeer(nPeer);
+}
+
+void PeerInventoryKnown::insert(const uint256& hash)
+{
+    GetSharedInventoryKnown().Insert(nPeer, hash);
+}
+
+bool PeerInventoryKnown::contains(const uint256& hash) const
+{
+    return GetSharedInventoryKnown().Contains(nPeer, hash);
+}
+
+void PeerInventoryKnown::reset()
+{
+    GetSharedInventoryKnown().Reset(nPeer);
+}
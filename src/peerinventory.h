@@ -0,0 +1,87 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_PEERINVENTORY_H
+#define DOGEC_PEERINVENTORY_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * The recent inventory items known to each peer (announced by it, or to it),
+ * for all the peers at once: a ring of the last RING_SIZE items seen, found
+ * by a hash table, and a bit per ring slot for each peer. A peer costs a
+ * bitset of RING_SIZE bits instead of a rolling bloom filter of its own, the
+ * answers are exact, and an item is forgotten by all the peers when its slot
+ * is reused, RING_SIZE items later. Thread safe.
+ */
+class SharedInventoryKnown
+{
+public:
+    static const uint32_t RING_SIZE = 1 << 16;
+
+    SharedInventoryKnown();
+
+    /** A new peer, knowing nothing. Returns its index for the other calls. */
+    int AddPeer();
+    void RemovePeer(int nPeer);
+
+    void Insert(int nPeer, const uint256& hash);
+    bool Contains(int nPeer, const uint256& hash) const;
+    /** Forget all the items the peer knows */
+    void Reset(int nPeer);
+
+private:
+    static const uint32_t TABLE_SIZE = 2 * RING_SIZE;
+    static const uint32_t NOT_FOUND = RING_SIZE;
+
+    mutable Mutex cs;
+    const uint64_t k0;
+    const uint64_t k1;
+
+    //! the items, oldest at nNext once full, and their home position in vTable
+    std::vector<uint256> vRing;
+    std::vector<uint32_t> vRingHome;
+    uint32_t nNext{0};
+    bool fFull{false};
+    //! linear probing table of the ring slots plus one, 0 if empty
+    std::vector<uint32_t> vTable;
+
+    //! the bits of the ring slots known by each peer, and the free indexes
+    std::vector<std::vector<uint64_t>> vPeerBits;
+    std::vector<int> vFreePeers;
+
+    uint32_t GetHome(const uint256& hash) const;
+    /** The ring slot of an item, NOT_FOUND if it isn't in */
+    uint32_t Find(const uint256& hash) const;
+    /** Add an item to the ring, in place of the oldest one once full. Returns its slot. */
+    uint32_t Add(const uint256& hash);
+    void EraseFromTable(uint32_t nSlot);
+};
+
+/**
+ * The inventory known to a peer, a handle on the shared structure, with the
+ * interface of the rolling bloom filter it replaces.
+ */
+class PeerInventoryKnown
+{
+public:
+    PeerInventoryKnown();
+    ~PeerInventoryKnown();
+
+    void insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+    void reset();
+
+private:
+    const int nPeer;
+
+    PeerInventoryKnown(const PeerInventoryKnown&) = delete;
+    PeerInventoryKnown& operator=(const PeerInventoryKnown&) = delete;
+};
+
+#endif // DOGEC_PEERINVENTORY_H
@@ -0,0 +1,220 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "pinsketch.h"
+
+#include <assert.h>
+
+namespace {
+
+typedef std::vector<uint32_t> Poly; // coefficients in GF(2^32), lowest degree first
+
+// GF(2^32) as GF(2)[x] / (x^32 + x^7 + x^3 + x^2 + 1)
+uint32_t FieldReduce(uint64_t v)
+{
+    // x^32 = x^7 + x^3 + x^2 + 1, twice as the first fold leaves up to 39 bits
+    for (int i = 0; i < 2; i++) {
+        const uint64_t h = v >> 32;
+        v = (v & 0xffffffff) ^ h ^ (h << 2) ^ (h << 3) ^ (h << 7);
+    }
+    return (uint32_t)v;
+}
+
+/** Multiplications by a fixed element, four bits of the other one at a time */
+class FieldMultiplier
+{
+private:
+    uint64_t table[16];
+
+public:
+    explicit FieldMultiplier(uint32_t a)
+    {
+        table[0] = 0;
+        for (int i = 1; i < 16; i++)
+            table[i] = (i & 1) ? table[i - 1] ^ a : table[i / 2] << 1;
+    }
+
+    uint32_t Mul(uint32_t b) const
+    {
+        uint64_t r = 0;
+        for (int i = 28; i >= 0; i -= 4)
+            r = (r << 4) ^ table[(b >> i) & 15];
+        return FieldReduce(r);
+    }
+};
+
+uint32_t FieldMul(uint32_t a, uint32_t b)
+{
+    return FieldMultiplier(a).Mul(b);
+}
+
+uint32_t FieldInv(uint32_t a)
+{
+    // a^(2^32 - 2) = a^2 * a^4 * ... * a^(2^31)
+    uint32_t r = 1;
+    for (int i = 1; i < 32; i++) {
+        a = FieldMul(a, a);
+        r = FieldMul(r, a);
+    }
+    return r;
+}
+
+void PolyTrim(Poly& a)
+{
+    while (!a.empty() && a.back() == 0) a.pop_back();
+}
+
+void PolyMonic(Poly& a)
+{
+    const FieldMultiplier mul(FieldInv(a.back()));
+    for (uint32_t& c : a) c = mul.Mul(c);
+}
+
+/** a mod m, m monic */
+void PolyMod(Poly& a, const Poly& m)
+{
+    const size_t nDeg = m.size() - 1;
+    while (a.size() > nDeg) {
+        const uint32_t lead = a.back();
+        const size_t nShift = a.size() - 1 - nDeg;
+        if (lead != 0) {
+            const FieldMultiplier mul(lead);
+            for (size_t i = 0; i < nDeg; i++)
+                a[nShift + i] ^= mul.Mul(m[i]);
+        }
+        a.pop_back();
+    }
+    PolyTrim(a);
+}
+
+/** a^2 mod m, m monic: squaring is linear in characteristic 2 */
+Poly PolySqrMod(const Poly& a, const Poly& m)
+{
+    Poly r(a.empty() ? 0 : 2 * a.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); i++)
+        r[2 * i] = FieldMul(a[i], a[i]);
+    PolyMod(r, m);
+    return r;
+}
+
+Poly PolyGCD(Poly a, Poly b)
+{
+    PolyTrim(a);
+    PolyTrim(b);
+    while (!b.empty()) {
+        PolyMonic(b);
+        PolyMod(a, b);
+        std::swap(a, b);
+    }
+    if (!a.empty()) PolyMonic(a);
+    return a;
+}
+
+/** The roots of f, monic with distinct roots that are all in the field */
+void FindRoots(const Poly& f, std::vector<uint32_t>& roots)
+{
+    if (f.size() == 2) {
+        roots.push_back(f[0]);
+        return;
+    }
+    // Split f with the trace of beta*x, 0 or 1 at each root, over the
+    // basis elements beta: two distinct roots differ at one of them at least.
+    for (int i = 0; i < 32; i++) {
+        Poly t{0, (uint32_t)1 << i};
+        PolyMod(t, f);
+        Poly trace = t;
+        for (int j = 1; j < 32; j++) {
+            t = PolySqrMod(t, f);
+            trace.resize(std::max(trace.size(), t.size()), 0);
+            for (size_t k = 0; k < t.size(); k++) trace[k] ^= t[k];
+        }
+        Poly g = PolyGCD(f, trace);
+        if (g.size() <= 1 || g.size() == f.size()) continue;
+        // the roots with trace 1 are the ones of gcd(f, trace + 1)
+        if (trace.empty()) trace.push_back(0);
+        trace[0] ^= 1;
+        Poly h = PolyGCD(f, trace);
+        assert(g.size() + h.size() == f.size() + 1);
+        FindRoots(g, roots);
+        FindRoots(h, roots);
+        return;
+    }
+    assert(false);
+}
+
+} // namespace
+
+void PinSketch::Add(uint32_t element)
+{
+    assert(element != 0);
+    const FieldMultiplier mulSqr(FieldMul(element, element));
+    uint32_t pow = element;
+    for (uint32_t& syndrome : vSyndromes) {
+        syndrome ^= pow;
+        pow = mulSqr.Mul(pow);
+    }
+}
+
+void PinSketch::Merge(const PinSketch& other)
+{
+    assert(other.GetCapacity() == GetCapacity());
+    for (size_t i = 0; i < vSyndromes.size(); i++)
+        vSyndromes[i] ^= other.vSyndromes[i];
+}
+
+bool PinSketch::Decode(std::vector<uint32_t>& elements) const
+{
+    elements.clear();
+    const size_t nCapacity = GetCapacity();
+
+    // All the power sums s_1..s_2c, the even ones being s_2k = s_k^2
+    std::vector<uint32_t> s(2 * nCapacity);
+    for (size_t k = 1; k <= s.size(); k++)
+        s[k - 1] = (k & 1) ? vSyndromes[k / 2] : FieldMul(s[k / 2 - 1], s[k / 2 - 1]);
+
+    // Berlekamp-Massey: the error locator, of roots the inverses of the elements
+    Poly c{1}, b{1};
+    size_t nLen = 0, m = 1;
+    uint32_t nLastDiscrepancy = 1;
+    for (size_t n = 0; n < s.size(); n++) {
+        uint32_t d = s[n];
+        for (size_t i = 1; i <= nLen && i < c.size(); i++)
+            d ^= FieldMul(c[i], s[n - i]);
+        if (d == 0) {
+            m++;
+            continue;
+        }
+        const FieldMultiplier mul(FieldMul(d, FieldInv(nLastDiscrepancy)));
+        Poly t = c;
+        c.resize(std::max(c.size(), b.size() + m), 0);
+        for (size_t i = 0; i < b.size(); i++)
+            c[i + m] ^= mul.Mul(b[i]);
+        if (2 * nLen <= n) {
+            nLen = n + 1 - nLen;
+            b = t;
+            nLastDiscrepancy = d;
+            m = 1;
+        } else {
+            m++;
+        }
+    }
+    PolyTrim(c);
+    if (nLen == 0) return true;
+    if (nLen > nCapacity || c.size() != nLen + 1) return false;
+
+    // The polynomial of roots the elements, the locator reversed
+    Poly f(c.rbegin(), c.rend());
+    PolyMonic(f);
+
+    // All the roots must be distinct and in the field: f divides x^(2^32) - x
+    Poly x{0, 1};
+    PolyMod(x, f);
+    Poly t = x;
+    for (int i = 0; i < 32; i++)
+        t = PolySqrMod(t, f);
+    if (t != x) return false;
+
+    FindRoots(f, elements);
+    return true;
+}
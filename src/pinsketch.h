@@ -0,0 +1,51 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_PINSKETCH_H
+#define DOGEC_PINSKETCH_H
+
+#include "serialize.h"
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A PinSketch of a set of non-zero 32 bit elements: the odd power sums of
+ * the elements in GF(2^32), one per unit of capacity. Adding an element
+ * twice removes it, so merging the sketches of two sets gives the sketch of
+ * their symmetric difference, which can be decoded back into its elements
+ * as long as there are no more of them than the capacity.
+ */
+class PinSketch
+{
+private:
+    std::vector<uint32_t> vSyndromes;
+
+public:
+    explicit PinSketch(size_t nCapacity = 0) : vSyndromes(nCapacity, 0) {}
+
+    size_t GetCapacity() const { return vSyndromes.size(); }
+
+    /** Add (or remove, if already in) a non-zero element */
+    void Add(uint32_t element);
+
+    /** Merge the sketch of another set, of the same capacity */
+    void Merge(const PinSketch& other);
+
+    /**
+     * The elements of the set, false if there are more than the capacity
+     * (a failure to decode is likely then, but not certain).
+     */
+    bool Decode(std::vector<uint32_t>& elements) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(vSyndromes);
+    }
+};
+
+#endif // DOGEC_PINSKETCH_H
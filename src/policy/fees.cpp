@@ -56,9 +56,9 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     if (blocksToConfirm < 1)
         return;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++) {
-        curBlockConf[i - 1][bucketindex]++;
-    }
+    // counted in all the confirmation counts from blocksToConfirm up in UpdateMovingAverages
+    if ((size_t)blocksToConfirm <= curBlockConf.size())
+        curBlockConf[blocksToConfirm - 1][bucketindex]++;
     curBlockTxCt[bucketindex]++;
     curBlockVal[bucketindex] += val;
 }
@@ -66,8 +66,11 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
 void TxConfirmStats::UpdateMovingAverages()
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
+        int nConfirmedWithin = 0;
+        for (unsigned int i = 0; i < confAvg.size(); i++) {
+            nConfirmedWithin += curBlockConf[i][j];
+            confAvg[i][j] = confAvg[i][j] * decay + nConfirmedWithin;
+        }
         avg[j] = avg[j] * decay + curBlockVal[j];
         txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
     }
@@ -280,19 +283,17 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     }
 }
 
-void CBlockPolicyEstimator::removeTx(uint256 hash)
+bool CBlockPolicyEstimator::removeTx(const uint256& hash)
 {
+    // Not all the mempool txs are tracked (see processTransaction), and the
+    // ones of a block have already been removed by processBlock
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
-    if (pos == mapMemPoolTxs.end()) {
-        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error mempool tx %s not found for removeTx\n",
-                 hash.ToString().c_str());
-        return;
-    }
-    unsigned int entryHeight = pos->second.blockHeight;
-    unsigned int bucketIndex = pos->second.bucketIndex;
+    if (pos == mapMemPoolTxs.end())
+        return false;
 
-    feeStats.removeTx(entryHeight, nBestSeenHeight, bucketIndex);
-    mapMemPoolTxs.erase(hash);
+    feeStats.removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex);
+    mapMemPoolTxs.erase(pos);
+    return true;
 }
 
 CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
@@ -380,7 +381,7 @@ void CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
 }
 
 void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
-                                         std::vector<CTxMemPoolEntry>& entries, bool fCurrentEstimate)
+                                         const std::vector<const CTxMemPoolEntry*>& entries, bool fCurrentEstimate)
 {
     if (nBlockHeight <= nBestSeenHeight) {
         // Ignore side chains and re-orgs; assuming they are random
@@ -390,6 +391,11 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
         // transaction fees."
         return;
     }
+
+    // Stop tracking the txs of the block as unconfirmed, as of the previous best height
+    for (const CTxMemPoolEntry* entry : entries)
+        removeTx(entry->GetTx().GetHash());
+
     nBestSeenHeight = nBlockHeight;
 
     // Only want to be updating estimates when our blockchain is synced,
@@ -401,8 +407,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     feeStats.ClearCurrent(nBlockHeight);
 
     // Repopulate the current block state
-    for (unsigned int i = 0; i < entries.size(); i++)
-        processBlockTx(nBlockHeight, entries[i]);
+    for (const CTxMemPoolEntry* entry : entries)
+        processBlockTx(nBlockHeight, *entry);
 
     // Update all exponential averages with the current block state
     feeStats.UpdateMovingAverages();
@@ -452,24 +458,6 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoun
     return CFeeRate(median);
 }
 
-double CBlockPolicyEstimator::estimatePriority(int confTarget)
-{
-    return -1;
-}
-
-double CBlockPolicyEstimator::estimateSmartPriority(int confTarget, int *answerFoundAtTarget, const CTxMemPool& pool)
-{
-    if (answerFoundAtTarget)
-        *answerFoundAtTarget = confTarget;
-
-    // If mempool is limiting txs, no priority txs are allowed
-    CAmount minPoolFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
-    if (minPoolFee > 0)
-        return INF_PRIORITY;
-
-    return -1;
-}
-
 void CBlockPolicyEstimator::Write(CAutoFile& fileout)
 {
     fileout << nBestSeenHeight;
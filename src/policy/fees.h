@@ -84,7 +84,8 @@ private:
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
     std::vector<std::vector<double> > confAvg; // confAvg[Y][X]
-    // and calcuate the totals for the current block to update the moving averages
+    // and count the txs of the current block confirmed in exactly Y blocks,
+    // summed into "within Y blocks" once per block to update the moving averages
     std::vector<std::vector<int> > curBlockConf; // curBlockConf[Y][X]
 
     // Sum the total feerate of all tx's in each bucket
@@ -203,18 +204,16 @@ public:
     /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values */
     CBlockPolicyEstimator(const CFeeRate& minRelayFee);
 
-    /** Process all the transactions that have been included in a block */
+    /** Process all the transactions that have been included in a block,
+     *  while they are still in the mempool (they are no longer tracked after) */
     void processBlock(unsigned int nBlockHeight,
-                      std::vector<CTxMemPoolEntry>& entries, bool fCurrentEstimate);
-
-    /** Process a transaction confirmed in a block*/
-    void processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry& entry);
+                      const std::vector<const CTxMemPoolEntry*>& entries, bool fCurrentEstimate);
 
     /** Process a transaction accepted to the mempool*/
     void processTransaction(const CTxMemPoolEntry& entry, bool fCurrentEstimate);
 
-    /** Remove a transaction from the mempool tracking stats*/
-    void removeTx(uint256 hash);
+    /** Remove a transaction from the mempool tracking stats, false if it wasn't tracked */
+    bool removeTx(const uint256& hash);
 
     /** Return a feerate estimate */
     CFeeRate estimateFee(int confTarget);
@@ -225,20 +224,6 @@ public:
      */
     CFeeRate estimateSmartFee(int confTarget, int *answerFoundAtTarget, const CTxMemPool& pool);
 
-    /** Return a priority estimate.
-     *  DEPRECATED
-     *  Returns -1
-     */
-    double estimatePriority(int confTarget);
-
-    /** Estimate priority needed to get be included in a block within
-     *  confTarget blocks.
-     *  DEPRECATED
-     *  Returns -1 unless mempool is currently limited then returns INF_PRIORITY
-     *  answerFoundAtTarget is set to confTarget
-     */
-    double estimateSmartPriority(int confTarget, int *answerFoundAtTarget, const CTxMemPool& pool);
-
     /** Write estimation data to a file */
     void Write(CAutoFile& fileout);
 
@@ -260,5 +245,8 @@ private:
 
     /** Classes to track historical data on transaction confirmations */
     TxConfirmStats feeStats;
+
+    /** Process a transaction confirmed in a block*/
+    void processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry& entry);
 };
 #endif /*BITCOIN_POLICYESTIMATOR_H */
@@ -33,6 +33,32 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+static bool IsSameHeader(const CBlockHeader& a, const CBlockHeader& b)
+{
+    return a.nVersion == b.nVersion &&
+           a.hashPrevBlock == b.hashPrevBlock &&
+           a.hashMerkleRoot == b.hashMerkleRoot &&
+           a.nTime == b.nTime &&
+           a.nBits == b.nBits &&
+           a.nNonce == b.nNonce &&
+           a.nAccumulatorCheckpoint == b.nAccumulatorCheckpoint &&
+           a.hashFinalSaplingRoot == b.hashFinalSaplingRoot;
+}
+
+uint256 CBlock::CacheHash() const
+{
+    headerCached = *this;
+    hashCached = headerCached.GetHash();
+    return hashCached;
+}
+
+uint256 CBlock::GetHash() const
+{
+    if (!hashCached.IsNull() && IsSameHeader(headerCached, *this))
+        return hashCached;
+    return CBlockHeader::GetHash();
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
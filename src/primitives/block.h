@@ -97,6 +97,8 @@ public:
 
     // memory only
     mutable bool fChecked{false};
+    mutable bool fPreChecked{false}; // context-free checks done ahead of CheckBlock (see PreCheckBlock)
+    mutable uint256 hashStakeFromPreChecked{}; // block of the stake input, if the proof of stake was checked ahead (see PreCheckProofOfStake)
 
     CBlock()
     {
@@ -124,9 +126,20 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         fChecked = false;
+        fPreChecked = false;
+        hashStakeFromPreChecked.SetNull();
+        hashCached.SetNull();
         vchBlockSig.clear();
     }
 
+    //! Hash the header, and keep the hash for GetHash. Only to be called while
+    //! the block has a single owner (after reading it, or before sharing it).
+    uint256 CacheHash() const;
+    //! The hash kept by CacheHash, as long as the header didn't change since.
+    //! The Quark hash of the legacy headers is costly, and a block read from
+    //! disk or received is hashed many times on its way.
+    uint256 GetHash() const;
+
     CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
@@ -155,6 +168,11 @@ public:
 
     std::string ToString() const;
     void print() const;
+
+private:
+    // memory only: see CacheHash
+    mutable uint256 hashCached{};
+    mutable CBlockHeader headerCached{};
 };
 
 
@@ -75,7 +75,6 @@ CTxOut::CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn)
 {
     nValue = nValueIn;
     scriptPubKey = scriptPubKeyIn;
-    nRounds = -10;
 }
 
 uint256 CTxOut::GetHash() const
@@ -131,7 +130,11 @@ size_t CTransaction::DynamicMemoryUsage() const
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
 CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), nType(TxType::NORMAL), vin(), vout(), nLockTime(0), hash() {}
 CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), nType(tx.nType), vin(tx.vin), vout(tx.vout), nLockTime(tx.nLockTime), sapData(tx.sapData), extraPayload(tx.extraPayload), hash(ComputeHash()) {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), nType(tx.nType), vin(std::move(tx.vin)), vout(std::move(tx.vout)), nLockTime(tx.nLockTime), sapData(tx.sapData), extraPayload(tx.extraPayload), hash(ComputeHash()) {}
+// The deserialized transactions are moved in, so each of their containers is allocated once.
+// They don't come from a per-block arena: their refs outlive the block (mempool, wallet,
+// notifications) and one of them would keep the whole arena, and the allocations are a
+// small share of the deserialization, where computing the hash dominates.
+CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), nType(tx.nType), vin(std::move(tx.vin)), vout(std::move(tx.vout)), nLockTime(tx.nLockTime), sapData(std::move(tx.sapData)), extraPayload(std::move(tx.extraPayload)), hash(ComputeHash()) {}
 
 bool CTransaction::HasZerocoinSpendInputs() const
 {
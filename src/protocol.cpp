@@ -40,6 +40,20 @@ const char* FILTERADD = "filteradd";
 const char* FILTERCLEAR = "filterclear";
 const char* REJECT = "reject";
 const char* SENDHEADERS = "sendheaders";
+const char* GETCFILTERS = "getcfilters";
+const char* CFILTER = "cfilter";
+const char* GETCFHEADERS = "getcfheaders";
+const char* CFHEADERS = "cfheaders";
+const char* GETCFCHECKPT = "getcfcheckpt";
+const char* CFCHECKPT = "cfcheckpt";
+const char* SENDCMPCT = "sendcmpct";
+const char* CMPCTBLOCK = "cmpctblock";
+const char* GETBLOCKTXN = "getblocktxn";
+const char* BLOCKTXN = "blocktxn";
+const char* SENDTXRCNCL = "sendtxrcncl";
+const char* REQTXRCNCL = "reqtxrcncl";
+const char* SKETCH = "sketch";
+const char* RECONCILDIFF = "reconcildiff";
 const char* SPORK = "spork";
 const char* GETSPORKS = "getsporks";
 const char* MNBROADCAST = "mnb";
@@ -72,7 +86,8 @@ static const char* ppszTypeName[] = {
     "mnq",
     NetMsgType::MNBROADCAST,
     NetMsgType::MNPING,
-    "dstx"  // deprecated
+    "dstx",  // deprecated
+    NetMsgType::CMPCTBLOCK
 };
 
 /** All known message types. Keep this in the same order as the list of
@@ -119,7 +134,21 @@ const static std::string allNetMessageTypes[] = {
     NetMsgType::GETMNLIST,
     NetMsgType::BUDGETVOTESYNC,
     NetMsgType::GETSPORKS,
-    NetMsgType::SYNCSTATUSCOUNT
+    NetMsgType::SYNCSTATUSCOUNT,
+    NetMsgType::GETCFILTERS,
+    NetMsgType::CFILTER,
+    NetMsgType::GETCFHEADERS,
+    NetMsgType::CFHEADERS,
+    NetMsgType::GETCFCHECKPT,
+    NetMsgType::CFCHECKPT,
+    NetMsgType::SENDCMPCT,
+    NetMsgType::CMPCTBLOCK,
+    NetMsgType::GETBLOCKTXN,
+    NetMsgType::BLOCKTXN,
+    NetMsgType::SENDTXRCNCL,
+    NetMsgType::REQTXRCNCL,
+    NetMsgType::SKETCH,
+    NetMsgType::RECONCILDIFF
 };
 const static std::vector<std::string> allNetMessageTypesVec(allNetMessageTypes, allNetMessageTypes + ARRAYLEN(allNetMessageTypes));
 
@@ -217,7 +246,7 @@ bool CInv::IsKnownType() const
 }
 
 bool CInv::IsMasterNodeType() const{
-     return type > 2;
+     return type > 2 && type != MSG_CMPCT_BLOCK;
 }
 
 const char* CInv::GetCommand() const
@@ -239,3 +268,20 @@ const std::vector<std::string>& getAllNetMessageTypes()
 {
     return allNetMessageTypesVec;
 }
+
+bool IsTierTwoMessageType(const std::string& msgType)
+{
+    return msgType == NetMsgType::SPORK ||
+           msgType == NetMsgType::GETSPORKS ||
+           msgType == NetMsgType::MNBROADCAST ||
+           msgType == NetMsgType::MNPING ||
+           msgType == NetMsgType::MNWINNER ||
+           msgType == NetMsgType::GETMNWINNERS ||
+           msgType == NetMsgType::GETMNLIST ||
+           msgType == NetMsgType::BUDGETPROPOSAL ||
+           msgType == NetMsgType::BUDGETVOTE ||
+           msgType == NetMsgType::BUDGETVOTESYNC ||
+           msgType == NetMsgType::FINALBUDGET ||
+           msgType == NetMsgType::FINALBUDGETVOTE ||
+           msgType == NetMsgType::SYNCSTATUSCOUNT;
+}
@@ -226,6 +226,90 @@ extern const char* REJECT;
  * @see https://bitcoin.org/en/developer-reference#sendheaders
  */
 extern const char* SENDHEADERS;
+/**
+ * getcfilters requests compact filters for a range of blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char* GETCFILTERS;
+/**
+ * cfilter is a response to a getcfilters request containing a single compact
+ * filter.
+ */
+extern const char* CFILTER;
+/**
+ * getcfheaders requests a compact filter header and the filter hashes for a
+ * range of blocks, which can then be used to reconstruct the filter headers
+ * for those blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char* GETCFHEADERS;
+/**
+ * cfheaders is a response to a getcfheaders request containing a filter header
+ * and a vector of filter hashes for each subsequent block in the requested range.
+ */
+extern const char* CFHEADERS;
+/**
+ * getcfcheckpt requests evenly spaced compact filter headers, enabling
+ * parallelized download and validation of the headers between them.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char* GETCFCHECKPT;
+/**
+ * cfcheckpt is a response to a getcfcheckpt request containing a vector of
+ * evenly spaced filter headers for blocks on the requested chain.
+ */
+extern const char* CFCHECKPT;
+/**
+ * Contains a 1-byte bool and 8-byte LE version number.
+ * Indicates that a node is willing to provide blocks via "cmpctblock" messages.
+ * May indicate that a node prefers to receive new block announcements via a
+ * "cmpctblock" message rather than an "inv", depending on message contents.
+ * @see https://github.com/bitcoin/bips/blob/master/bip-0152.mediawiki
+ */
+extern const char* SENDCMPCT;
+/**
+ * Contains a CBlockHeaderAndShortTxIDs object - providing a header and
+ * list of "short txids".
+ * @see https://github.com/bitcoin/bips/blob/master/bip-0152.mediawiki
+ */
+extern const char* CMPCTBLOCK;
+/**
+ * Contains a BlockTransactionsRequest
+ * Peer should respond with "blocktxn" message.
+ * @see https://github.com/bitcoin/bips/blob/master/bip-0152.mediawiki
+ */
+extern const char* GETBLOCKTXN;
+/**
+ * Contains a BlockTransactions.
+ * Sent in response to a "getblocktxn" message.
+ * @see https://github.com/bitcoin/bips/blob/master/bip-0152.mediawiki
+ */
+extern const char* BLOCKTXN;
+/**
+ * Contains a 4-byte version number and an 8-byte salt.
+ * Sent in response to "version", between peers that both advertise
+ * NODE_TXRECON, to reconcile the transactions instead of announcing all of
+ * them by inv. Both sides must send it.
+ */
+extern const char* SENDTXRCNCL;
+/**
+ * Contains the 4-byte size of the reconciliation set of the sender.
+ * Sent by the side that opened the connection to ask for a "sketch".
+ */
+extern const char* REQTXRCNCL;
+/**
+ * Contains a PinSketch of the short ids of the reconciliation set.
+ * Sent in response to a "reqtxrcncl" message.
+ */
+extern const char* SKETCH;
+/**
+ * Contains a 1-byte bool (whether the difference decoded) and the short ids
+ * of the transactions to announce. Ends a reconciliation, after a "sketch".
+ */
+extern const char* RECONCILDIFF;
 /**
  * The spork message is used to send spork values to connected
  * peers
@@ -285,6 +369,9 @@ extern const char* SYNCSTATUSCOUNT;
 /* Get a vector of all valid message types (see above) */
 const std::vector<std::string>& getAllNetMessageTypes();
 
+/* Whether the message type is handled by the tier two managers (masternodes, budget, sporks) */
+bool IsTierTwoMessageType(const std::string& msgType);
+
 /** nServices flags */
 enum ServiceFlags : uint64_t {
     // Nothing
@@ -303,6 +390,16 @@ enum ServiceFlags : uint64_t {
     // that the node doesn't want to receive master nodes messages. (the 1<<3 was not picked as constant because on bitcoin 0.14 is witness and we want that update here )
     NODE_BLOOM_WITHOUT_MN = (1 << 4),
 
+    // NODE_COMPACT_FILTERS means the node will service basic block filter
+    // requests (getcfilters, getcfheaders and getcfcheckpt).
+    // See BIP157 and BIP158 for details on how this is implemented.
+    NODE_COMPACT_FILTERS = (1 << 6),
+
+    // NODE_TXRECON means the node reconciles the sets of transactions to
+    // relay with its peers (sendtxrcncl, reqtxrcncl, sketch, reconcildiff),
+    // rather than announcing every transaction to every peer.
+    NODE_TXRECON = (1 << 7),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
@@ -397,7 +494,10 @@ enum {
     MSG_MASTERNODE_QUORUM,
     MSG_MASTERNODE_ANNOUNCE,
     MSG_MASTERNODE_PING,
-    MSG_DSTX
+    MSG_DSTX,
+    // Sent in getdata only, to the peers that announced the compact blocks
+    // support (BIP 152). Not the BIP 152 value, which is taken by MSG_TXLOCK_REQUEST.
+    MSG_CMPCT_BLOCK
 };
 
 #endif // BITCOIN_PROTOCOL_H
@@ -185,6 +185,27 @@ bool CPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchS
     return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
 }
 
+bool CPubKey::VerifyAll(const std::vector<std::pair<const uint256*, const std::vector<unsigned char>*> >& vSigs) const
+{
+    if (!IsValid())
+        return false;
+    secp256k1_pubkey pubkey;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, &(*this)[0], size())) {
+        return false;
+    }
+    for (const auto& hashAndSig : vSigs) {
+        secp256k1_ecdsa_signature sig;
+        if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, hashAndSig.second->data(), hashAndSig.second->size())) {
+            return false;
+        }
+        secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, &sig, &sig);
+        if (!secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hashAndSig.first->begin(), &pubkey)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 bool CPubKey::RecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig)
 {
     if (vchSig.size() != COMPACT_SIGNATURE_SIZE)
@@ -187,6 +187,12 @@ public:
      */
     bool Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const;
 
+    /**
+     * Verify DER signatures of several hashes, parsing this key once for
+     * all of them. False if any of them fails.
+     */
+    bool VerifyAll(const std::vector<std::pair<const uint256*, const std::vector<unsigned char>*> >& vSigs) const;
+
     /**
      * Check whether a signature is normalized (lower-S).
      */
@@ -9,6 +9,8 @@
 
 /* Milliseconds between model updates */
 static const int MODEL_UPDATE_DELAY = 1000;
+/* Milliseconds the wallet notifications are collected for, before being applied to the models at once */
+static const int MODEL_BATCH_DELAY = 250;
 
 /* AskPassphraseDialog -- Maximum passphrase length */
 static const int MAX_PASSPHRASE_SIZE = 1024;
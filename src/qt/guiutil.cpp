@@ -950,6 +950,12 @@ QString formatServicesStr(quint64 mask)
             case NODE_BLOOM_WITHOUT_MN:
                 strList.append(QObject::tr("BLOOM"));
                 break;
+            case NODE_COMPACT_FILTERS:
+                strList.append(QObject::tr("COMPACT_FILTERS"));
+                break;
+            case NODE_TXRECON:
+                strList.append(QObject::tr("TXRECON"));
+                break;
             default:
                 strList.append(QString("%1[%2]").arg(QObject::tr("UNKNOWN")).arg(check));
             }
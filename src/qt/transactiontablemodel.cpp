@@ -28,12 +28,15 @@
 #include <QDebug>
 #include <QIcon>
 #include <QList>
+#include <QTimer>
 #include <QtConcurrent/QtConcurrent>
 #include <QFuture>
 
+#include <atomic>
+
 #define SINGLE_THREAD_MAX_TXES_SIZE 4000
 
-// Maximum amount of loaded records in ram in the first load.
+// Maximum amount of transactions loaded in ram in the first load, the latest ones.
 // If the user has more and want to load them:
 // TODO, add load on demand in pages (not every tx loaded all the time into the records list).
 #define MAX_AMOUNT_LOADED_RECORDS 20000
@@ -82,9 +85,8 @@ public:
     CWallet* wallet;
     TransactionTableModel* parent;
 
-    /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+    /* Local cache of wallet, of the MAX_AMOUNT_LOADED_RECORDS latest transactions.
+     * Sorted by sha256, for the lookups of updateWallet.
      */
     QList<TransactionRecord> cachedWallet;
     bool hasZcTxes = false;
@@ -102,27 +104,13 @@ public:
         qDebug() << "TransactionTablePriv::refreshWallet";
         cachedWallet.clear();
 
-        std::vector<CWalletTx> walletTxes = wallet->getWalletTxs();
+        // Only the latest ones: the wallet copies them from its ordered list, without copying
+        // (and sorting) the older ones first
+        const std::vector<CWalletTx> walletTxes = wallet->getWalletTxs(MAX_AMOUNT_LOADED_RECORDS);
 
         // Divide the work between multiple threads to speedup the process if the vector is larger than 4k txes
         std::size_t txesSize = walletTxes.size();
         if (txesSize > SINGLE_THREAD_MAX_TXES_SIZE) {
-
-            // First check if the amount of txs exceeds the UI limit
-            if (txesSize > MAX_AMOUNT_LOADED_RECORDS) {
-                // Sort the txs by date just to be really really sure that them are ordered.
-                // (this extra calculation should be removed in the future if can ensure that
-                // txs are stored in order in the db, which is what should be happening)
-                sort(walletTxes.begin(), walletTxes.end(),
-                        [](const CWalletTx & a, const CWalletTx & b) -> bool {
-                         return a.GetTxTime() > b.GetTxTime();
-                     });
-
-                // Only latest ones.
-                walletTxes = std::vector<CWalletTx>(walletTxes.begin(), walletTxes.begin() + MAX_AMOUNT_LOADED_RECORDS);
-                txesSize = walletTxes.size();
-            };
-
             // Simple way to get the processors count
             std::size_t threadsCount = (QThreadPool::globalInstance()->maxThreadCount() / 2 ) + 1;
 
@@ -131,24 +119,22 @@ public:
             std::size_t totalSumSize = 0;
             QList<QFuture<ConvertTxToVectorResult>> tasks;
 
-            // Subsets + run task
+            // Subsets + run task, on ranges of walletTxes: it outlives the tasks
             for (std::size_t i = 0; i < threadsCount; ++i) {
                 tasks.append(
                         QtConcurrent::run(
                                 convertTxToRecords,
                                 this,
                                 wallet,
-                                std::vector<CWalletTx>(walletTxes.begin() + totalSumSize, walletTxes.begin() + totalSumSize + subsetSize)
+                                walletTxes.begin() + totalSumSize,
+                                walletTxes.begin() + totalSumSize + subsetSize
                         )
                  );
                 totalSumSize += subsetSize;
             }
 
             // Now take the remaining ones and do the work here
-            std::size_t const remainingSize = txesSize - totalSumSize;
-            auto res = convertTxToRecords(this, wallet,
-                                              std::vector<CWalletTx>(walletTxes.end() - remainingSize, walletTxes.end())
-            );
+            auto res = convertTxToRecords(this, wallet, walletTxes.begin() + totalSumSize, walletTxes.end());
             cachedWallet.append(res.records);
             nFirstLoadedTxTime = res.nFirstLoadedTxTime;
 
@@ -162,18 +148,24 @@ public:
             }
         } else {
             // Single thread flow
-            ConvertTxToVectorResult convertRes = convertTxToRecords(this, wallet, walletTxes);
+            ConvertTxToVectorResult convertRes = convertTxToRecords(this, wallet, walletTxes.begin(), walletTxes.end());
             cachedWallet.append(convertRes.records);
             nFirstLoadedTxTime = convertRes.nFirstLoadedTxTime;
         }
+
+        // The transactions came most recent first: updateWallet needs them by hash. The
+        // records of a transaction stay in the order of decomposeTransaction.
+        std::stable_sort(cachedWallet.begin(), cachedWallet.end(), TxLessThan());
     }
 
-    static ConvertTxToVectorResult convertTxToRecords(TransactionTablePriv* tablePriv, const CWallet* wallet, const std::vector<CWalletTx>& walletTxes) {
+    static ConvertTxToVectorResult convertTxToRecords(TransactionTablePriv* tablePriv, const CWallet* wallet,
+                                                      std::vector<CWalletTx>::const_iterator begin,
+                                                      std::vector<CWalletTx>::const_iterator end) {
         ConvertTxToVectorResult res;
 
         bool hasZcTxes = tablePriv->hasZcTxes;
-        for (const auto &tx : walletTxes) {
-            QList<TransactionRecord> records = TransactionRecord::decomposeTransaction(wallet, tx);
+        for (auto it = begin; it != end; ++it) {
+            QList<TransactionRecord> records = TransactionRecord::decomposeTransaction(wallet, *it);
 
             if (!hasZcTxes) {
                 for (const TransactionRecord &record : records) {
@@ -332,6 +324,11 @@ TransactionTableModel::TransactionTableModel(CWallet* wallet, WalletModel* paren
     columns << QString() << QString() << tr("Date") << tr("Type") << tr("Address") << BitcoinUnits::getAmountColumnTitle(walletModel->getOptionsModel()->getDisplayUnit());
     priv->refreshWallet();
 
+    pendingTimer = new QTimer(this);
+    pendingTimer->setSingleShot(true);
+    pendingTimer->setInterval(MODEL_BATCH_DELAY);
+    connect(pendingTimer, &QTimer::timeout, this, &TransactionTableModel::processPendingTransactions);
+
     connect(walletModel->getOptionsModel(), &OptionsModel::displayUnitChanged, this, &TransactionTableModel::updateDisplayUnit);
 
     subscribeToCoreSignals();
@@ -350,16 +347,55 @@ void TransactionTableModel::updateAmountColumnTitle()
     Q_EMIT headerDataChanged(Qt::Horizontal, Amount, Amount);
 }
 
-void TransactionTableModel::updateTransaction(const QString& hash, int status, bool showTransaction)
+bool TransactionTableModel::queueTransaction(const uint256& hash, int status)
+{
+    LOCK(cs_pending);
+    const bool fNewBatch = vPendingHashes.empty();
+    // A later notification of the same transaction replaces the previous one: updateWallet
+    // turns CT_UPDATED into CT_NEW or CT_DELETED from what the model holds.
+    if (mapPendingStatus.emplace(hash, status).second) {
+        vPendingHashes.push_back(hash);
+    } else {
+        mapPendingStatus[hash] = status;
+    }
+    return fNewBatch;
+}
+
+void TransactionTableModel::schedulePendingTransactions()
 {
-    uint256 updated;
-    updated.SetHex(hash.toStdString());
+    if (!pendingTimer->isActive())
+        pendingTimer->start();
+}
 
-    TransactionRecord rec(0);
-    priv->updateWallet(updated, status, showTransaction, rec);
+void TransactionTableModel::processPendingTransactions()
+{
+    std::vector<uint256> vHashes;
+    std::map<uint256, int> mapStatus;
+    {
+        LOCK(cs_pending);
+        vHashes.swap(vPendingHashes);
+        mapStatus.swap(mapPendingStatus);
+    }
+    if (vHashes.empty())
+        return;
 
-    if (!rec.isNull())
-        Q_EMIT txArrived(hash, rec.isCoinStake(), rec.isAnyColdStakingType());
+    // The rows are inserted one transaction at a time, but txArrived is emitted once per
+    // kind of transaction of the batch: its listeners refresh their whole views.
+    // prevent balloon spam, show maximum 10 balloons
+    fProcessingQueuedTransactions = vHashes.size() > 10;
+    std::map<std::pair<bool, bool>, QString> mapArrived;
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        if (vHashes.size() - i <= 10)
+            fProcessingQueuedTransactions = false;
+        const uint256& hash = vHashes[i];
+        qDebug() << "NotifyTransactionChanged : " + QString::fromStdString(hash.GetHex()) + " status= " + QString::number(mapStatus[hash]);
+        TransactionRecord rec(0);
+        priv->updateWallet(hash, mapStatus[hash], true, rec);
+        if (!rec.isNull())
+            mapArrived[std::make_pair(rec.isCoinStake(), rec.isAnyColdStakingType())] = QString::fromStdString(hash.GetHex());
+    }
+    for (const auto& it : mapArrived)
+        Q_EMIT txArrived(it.second, it.first.first, it.first.second);
 }
 
 void TransactionTableModel::updateConfirmations()
@@ -827,41 +863,15 @@ void TransactionTableModel::updateDisplayUnit()
     Q_EMIT dataChanged(index(0, Amount), index(priv->size() - 1, Amount));
 }
 
-// queue notifications to show a non freezing progress dialog e.g. for rescan
-struct TransactionNotification {
-public:
-    TransactionNotification() = delete; // need to specify hash and status
-    TransactionNotification(uint256 hash, ChangeType status) : hash(hash), status(status) {}
-
-    void invoke(QObject* ttm)
-    {
-        QString strHash = QString::fromStdString(hash.GetHex());
-        qDebug() << "NotifyTransactionChanged : " + strHash + " status= " + QString::number(status);
-        QMetaObject::invokeMethod(ttm, "updateTransaction", Qt::QueuedConnection,
-            Q_ARG(QString, strHash),
-            Q_ARG(int, status),
-            Q_ARG(bool, true));
-    }
-
-private:
-    uint256 hash;
-    ChangeType status;
-};
-
-static bool fQueueNotifications = false;
-static std::vector<TransactionNotification> vQueueNotifications;
+// queue notifications to show a non freezing progress dialog e.g. for rescan: the batch
+// isn't applied before the end of the operation
+static std::atomic<bool> fQueueNotifications{false};
 
 static void NotifyTransactionChanged(TransactionTableModel* ttm, CWallet* wallet, const uint256& hash, ChangeType status)
 {
-
-    TransactionNotification notification(hash, status);
-
-    if (fQueueNotifications)
-    {
-        vQueueNotifications.push_back(notification);
-        return;
-    }
-    notification.invoke(ttm);
+    // The first notification of a batch starts its timer, the next ones join it
+    if (ttm->queueTransaction(hash, status) && !fQueueNotifications)
+        QMetaObject::invokeMethod(ttm, "schedulePendingTransactions", Qt::QueuedConnection);
 }
 
 static void ShowProgress(TransactionTableModel* ttm, const std::string& title, int nProgress)
@@ -871,15 +881,7 @@ static void ShowProgress(TransactionTableModel* ttm, const std::string& title, i
 
     if (nProgress == 100) {
         fQueueNotifications = false;
-        if (vQueueNotifications.size() > 10) // prevent balloon spam, show maximum 10 balloons
-            QMetaObject::invokeMethod(ttm, "setProcessingQueuedTransactions", Qt::QueuedConnection, Q_ARG(bool, true));
-        for (unsigned int i = 0; i < vQueueNotifications.size(); ++i) {
-            if (vQueueNotifications.size() - i <= 10)
-                QMetaObject::invokeMethod(ttm, "setProcessingQueuedTransactions", Qt::QueuedConnection, Q_ARG(bool, false));
-
-            vQueueNotifications[i].invoke(ttm);
-        }
-        std::vector<TransactionNotification>().swap(vQueueNotifications); // clear
+        QMetaObject::invokeMethod(ttm, "schedulePendingTransactions", Qt::QueuedConnection);
     }
 }
 
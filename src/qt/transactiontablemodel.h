@@ -11,11 +11,15 @@
 #define BITCOIN_QT_TRANSACTIONTABLEMODEL_H
 
 #include "bitcoinunits.h"
+#include "sync.h"
+#include "uint256.h"
 
 #include <QAbstractTableModel>
 #include <QStringList>
 
+#include <map>
 #include <memory>
+#include <vector>
 
 namespace interfaces {
     class Handler;
@@ -27,6 +31,10 @@ class WalletModel;
 
 class CWallet;
 
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
 /** UI model for the transaction table of a wallet.
  */
 class TransactionTableModel : public QAbstractTableModel
@@ -87,6 +95,9 @@ public:
     QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const;
     bool processingQueuedTransactions() { return fProcessingQueuedTransactions; }
 
+    /** Add a wallet notification to the pending batch, from any thread. Returns true if it starts a new batch. */
+    bool queueTransaction(const uint256& hash, int status);
+
 Q_SIGNALS:
     void txArrived(const QString& hash, const bool& isCoinStake, const bool& isCSAnyType);
 
@@ -101,6 +112,13 @@ private:
     TransactionTablePriv* priv{nullptr};
     bool fProcessingQueuedTransactions{false};
 
+    /* The wallet notifications not applied yet: the last status of each transaction, in the order
+     * they first came in. Applied together after MODEL_BATCH_DELAY. */
+    Mutex cs_pending;
+    std::vector<uint256> vPendingHashes GUARDED_BY(cs_pending);
+    std::map<uint256, int> mapPendingStatus GUARDED_BY(cs_pending);
+    QTimer* pendingTimer{nullptr};
+
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
 
@@ -117,8 +135,10 @@ private:
     QVariant txAddressDecoration(const TransactionRecord* wtx) const;
 
 public Q_SLOTS:
-    /* New transaction, or transaction changed status */
-    void updateTransaction(const QString& hash, int status, bool showTransaction);
+    /* Starts the timer of the pending batch, if it isn't running */
+    void schedulePendingTransactions();
+    /* New transactions, or transactions that changed status: applies the pending batch */
+    void processPendingTransactions();
     void updateConfirmations();
     void updateDisplayUnit();
     /** Updates the column title to "Amount (DisplayUnit)" and emits headerDataChanged() signal for table headers to react. */
@@ -331,6 +331,7 @@ void WalletModel::setWalletCustomFee(bool fUseCustomFee, const CAmount& nFee)
 
 void WalletModel::updateTransaction()
 {
+    fTransactionUpdateQueued = false;
     // Balance and number of transactions might have changed
     fForceCheckBalanceChanged = true;
 }
@@ -753,22 +754,14 @@ static void NotifyAddressBookChanged(WalletModel* walletmodel, CWallet* wallet,
         Q_ARG(int, status));
 }
 
-// queue notifications to show a non freezing progress dialog e.g. for rescan
-static bool fQueueNotifications = false;
-static std::vector<std::pair<uint256, ChangeType> > vQueueNotifications;
+// The balance is recomputed by the next poll after any number of transaction changes:
+// a single updateTransaction call is queued until it runs.
+static std::atomic<bool> fTransactionUpdateQueued{false};
 static void NotifyTransactionChanged(WalletModel* walletmodel, CWallet* wallet, const uint256& hash, ChangeType status)
 {
-    if (fQueueNotifications) {
-        vQueueNotifications.emplace_back(hash, status);
+    if (fTransactionUpdateQueued.exchange(true))
         return;
-    }
-
-    QString strHash = QString::fromStdString(hash.GetHex());
-
-    qDebug() << "NotifyTransactionChanged : " + strHash + " status= " + QString::number(status);
-    QMetaObject::invokeMethod(walletmodel, "updateTransaction", Qt::QueuedConnection /*,
-                              Q_ARG(QString, strHash),
-                              Q_ARG(int, status)*/);
+    QMetaObject::invokeMethod(walletmodel, "updateTransaction", Qt::QueuedConnection);
 }
 
 static void ShowProgress(WalletModel* walletmodel, const std::string& title, int nProgress)
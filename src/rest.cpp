@@ -10,6 +10,8 @@
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "httpserver.h"
+#include "index/compactsaplingindex.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -24,6 +26,10 @@
 
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const long MAX_BLOCKRANGE_COUNT = 1000; //allow a max of 1000 blocks to be queried at once
+static const size_t MAX_BLOCKRANGE_SIZE = 64 * 1024 * 1024; //stop adding blocks to a block range reply past 64 MB
+static const size_t MAX_ADDRESSUTXOS_ADDRESSES = 100; //allow a max of 100 addresses to be queried at once
+static const long MAX_COMPACTBLOCKS_COUNT = 1000; //allow a max of 1000 compact blocks to be queried at once
 
 enum RetFormat {
     RF_UNDEF,
@@ -62,10 +68,13 @@ struct CCoin {
 };
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
-extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue blockToJSONUnlocked(const CBlock& block, const CBlockIndex* blockindex, bool txDetails);
 extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern bool getIndexKeyFromAddress(const std::string& str, uint160& hashBytes, int& addressType);
+extern bool getAddressFromIndex(const int& type, const uint160& hash, std::string& address);
+extern bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a, std::pair<CAddressUnspentKey, CAddressUnspentValue> b);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string message)
 {
@@ -176,8 +185,12 @@ static bool rest_headers(HTTPRequest* req,
     }
     case RF_JSON: {
         UniValue jsonHeaders(UniValue::VARR);
-        for (const CBlockIndex *pindex : headers) {
-            jsonHeaders.push_back(blockheaderToJSON(pindex));
+        {
+            // The confirmations and the next block depend on the chain
+            LOCK(cs_main);
+            for (const CBlockIndex *pindex : headers) {
+                jsonHeaders.push_back(blockheaderToJSON(pindex));
+            }
         }
         std::string strJSON = jsonHeaders.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
@@ -207,7 +220,6 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -217,32 +229,224 @@ static bool rest_block(HTTPRequest* req,
         pblockindex = mapBlockIndex[hash];
         if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+    }
+
+    switch (rf) {
+    case RF_BINARY: {
+        // serve the block as stored on disk, which is its serialized form
+        std::vector<unsigned char> rawBlock;
+        if (!ReadRawBlockFromDisk(rawBlock, pblockindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        std::string binaryBlock(rawBlock.begin(), rawBlock.end());
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryBlock);
+        return true;
+    }
 
+    case RF_HEX: {
+        std::vector<unsigned char> rawBlock;
+        if (!ReadRawBlockFromDisk(rawBlock, pblockindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        std::string strHex = HexStr(rawBlock.begin(), rawBlock.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        CBlock block;
         if (!ReadBlockFromDisk(block, pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        UniValue objBlock = blockToJSONUnlocked(block, pblockindex, showTxDetails);
+        std::string strJSON = objBlock.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_blockrange(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::vector<std::string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block range specified. Use /rest/blockrange/<start>/<count>.<ext>.");
+
+    int32_t nStart;
+    if (!ParseInt32(path[0], &nStart) || nStart < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid start height: " + path[0]);
+    long count = strtol(path[1].c_str(), NULL, 10);
+    if (count < 1 || count > MAX_BLOCKRANGE_COUNT)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    // The blocks of the active chain are looked up under cs_main, and read
+    // from disk without it: a reorg meanwhile doesn't remove them from disk.
+    std::vector<const CBlockIndex*> blocks;
+    blocks.reserve(count);
+    {
+        LOCK(cs_main);
+        if (nStart > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+        for (const CBlockIndex* pindex = chainActive[nStart]; pindex && blocks.size() < (size_t)count; pindex = chainActive.Next(pindex)) {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0)
+                return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not available (pruned data)");
+            blocks.push_back(pindex);
+        }
+    }
+
+    // The blocks are appended to the reply as they are read, back to back,
+    // up to MAX_BLOCKRANGE_SIZE: the number served is in X-Block-Count, the
+    // client asks for the rest from the next height.
+    std::vector<unsigned char> rawBlock;
+    size_t nSize = 0;
+    unsigned int nBlocks = 0;
+    for (const CBlockIndex* pindex : blocks) {
+        if (nBlocks > 0 && nSize >= MAX_BLOCKRANGE_SIZE)
+            break;
+        if (!ReadRawBlockFromDisk(rawBlock, pindex)) {
+            req->ClearReply();
+            return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + " not found");
+        }
+        if (rf == RF_BINARY) {
+            req->AppendReply(std::string(rawBlock.begin(), rawBlock.end()));
+        } else {
+            req->AppendReply(HexStr(rawBlock.begin(), rawBlock.end()));
+        }
+        nSize += rawBlock.size();
+        nBlocks++;
+    }
+
+    req->WriteHeader("X-Block-Count", std::to_string(nBlocks));
+    if (rf == RF_BINARY) {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK);
+    } else {
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, "\n");
+    }
+    return true;
+}
+
+static UniValue CompactSaplingBlockToJSON(const CompactSaplingBlock& block)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("height", block.height);
+    result.pushKV("hash", block.block_hash.GetHex());
+    result.pushKV("previousblockhash", block.prev_hash.GetHex());
+    result.pushKV("time", (int64_t)block.time);
+    UniValue vtx(UniValue::VARR);
+    for (const CompactSaplingTx& ctx : block.vtx) {
+        UniValue tx(UniValue::VOBJ);
+        tx.pushKV("index", (int64_t)ctx.index);
+        tx.pushKV("txid", ctx.txid.GetHex());
+        UniValue nullifiers(UniValue::VARR);
+        for (const uint256& nullifier : ctx.nullifiers) {
+            nullifiers.push_back(nullifier.GetHex());
+        }
+        tx.pushKV("nullifiers", nullifiers);
+        UniValue outputs(UniValue::VARR);
+        for (const CompactSaplingOutput& output : ctx.outputs) {
+            UniValue out(UniValue::VOBJ);
+            out.pushKV("cmu", output.cmu.GetHex());
+            out.pushKV("epk", output.epk.GetHex());
+            out.pushKV("ciphertext", HexStr(output.ciphertext.begin(), output.ciphertext.end()));
+            outputs.push_back(out);
+        }
+        tx.pushKV("outputs", outputs);
+        vtx.push_back(tx);
+    }
+    result.pushKV("vtx", vtx);
+    return result;
+}
+
+static bool rest_compactblocks(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::vector<std::string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, params[0], boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block range specified. Use /rest/compactblocks/<start>/<count>.<ext>.");
+
+    int32_t nStart;
+    if (!ParseInt32(path[0], &nStart) || nStart < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid start height: " + path[0]);
+    long count = strtol(path[1].c_str(), NULL, 10);
+    if (count < 1 || count > MAX_COMPACTBLOCKS_COUNT)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[1]);
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<const CBlockIndex*> blocks;
+    blocks.reserve(count);
+    {
+        LOCK(cs_main);
+        if (nStart > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[0]);
+        for (const CBlockIndex* pindex = chainActive[nStart]; pindex && blocks.size() < (size_t)count; pindex = chainActive.Next(pindex)) {
+            blocks.push_back(pindex);
+        }
+    }
+
+    // The index has the compact blocks already; without it, or while it is
+    // syncing, they are made from the blocks on disk.
+    const bool fIndexed = g_compact_sapling_index && g_compact_sapling_index->BlockUntilSyncedToCurrentChain();
+    std::vector<CompactSaplingBlock> vCompact(blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        const CBlockIndex* pindex = blocks[i];
+        if (fIndexed && g_compact_sapling_index->LookUpBlock(pindex, vCompact[i]))
+            continue;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            const bool fPruned = WITH_LOCK(cs_main, return !(pindex->nStatus & BLOCK_HAVE_DATA) && pindex->nTx > 0);
+            return RESTERR(req, HTTP_NOT_FOUND, pindex->GetBlockHash().GetHex() + (fPruned ? " not available (pruned data)" : " not found"));
+        }
+        vCompact[i] = MakeCompactSaplingBlock(block, pindex->nHeight);
+    }
 
     switch (rf) {
     case RF_BINARY: {
-        std::string binaryBlock = ssBlock.str();
+        CDataStream ssCompact(SER_NETWORK, PROTOCOL_VERSION);
+        ssCompact << vCompact;
+        std::string binaryCompact = ssCompact.str();
         req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryBlock);
+        req->WriteReply(HTTP_OK, binaryCompact);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        CDataStream ssCompact(SER_NETWORK, PROTOCOL_VERSION);
+        ssCompact << vCompact;
+        std::string strHex = HexStr(ssCompact.begin(), ssCompact.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        std::string strJSON = objBlock.write() + "\n";
+        UniValue result(UniValue::VARR);
+        for (const CompactSaplingBlock& compact : vCompact) {
+            result.push_back(CompactSaplingBlockToJSON(compact));
+        }
+        std::string strJSON = result.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -586,24 +790,114 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_addressutxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::vector<std::string> params;
+    const RetFormat rf = ParseDataFormat(params, strURIPart);
+    if (rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    if (!fAddressIndex)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Address index not enabled (-addressindex)");
+
+    std::vector<std::string> uriParts;
+    if (params[0].length() > 1)
+        boost::split(uriParts, params[0].substr(1), boost::is_any_of("/"));
+    if (uriParts.empty())
+        return RESTERR(req, HTTP_BAD_REQUEST, "No address specified. Use /rest/addressutxos/<address>/.../<address>.json.");
+    if (uriParts.size() > MAX_ADDRESSUTXOS_ADDRESSES)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: max addresses exceeded (max: %d, tried: %d)", MAX_ADDRESSUTXOS_ADDRESSES, uriParts.size()));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (const std::string& strAddress : uriParts) {
+        uint160 hashBytes;
+        int addressType;
+        if (!getIndexKeyFromAddress(strAddress, hashBytes, addressType))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + strAddress);
+        if (!GetAddressUnspent(hashBytes, addressType, unspentOutputs))
+            return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "No information available for address: " + strAddress);
+    }
+    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+
+    int nHeight;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        nHeight = chainActive.Height();
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    // The outputs of a busy address are many: they are written into the
+    // reply one by one, instead of as a whole UniValue tree.
+    JSONStreamWriter stream([req](const std::string& strChunk) { req->AppendReply(strChunk); });
+    stream.BeginObject();
+    stream.KeyValue("chainHeight", nHeight);
+    stream.KeyValue("chaintipHash", hashTip.GetHex());
+    stream.Key("utxos");
+    stream.BeginArray();
+    for (const auto& it : unspentOutputs) {
+        std::string address;
+        if (!getAddressFromIndex(it.first.type, it.first.hashBytes, address))
+            continue;
+
+        UniValue output(UniValue::VOBJ);
+        output.pushKV("address", address);
+        output.pushKV("txid", it.first.txhash.GetHex());
+        output.pushKV("outputIndex", (int)it.first.index);
+        output.pushKV("script", HexStr(it.second.script.begin(), it.second.script.end()));
+        output.pushKV("satoshis", it.second.satoshis);
+        output.pushKV("height", it.second.blockHeight);
+        stream.Value(output);
+    }
+    stream.EndArray();
+    stream.EndObject();
+    stream.Flush();
+
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, "\n");
+    return true;
+}
+
+/** The RPC and HTTP work queue stats of getrpcinfo, for a Prometheus scraper (no format extension) */
+static bool rest_metrics(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!strURIPart.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, "Invalid URI format. Expected /rest/metrics");
+
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, GetRPCStatsPrometheus());
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
+    bool fPriority; //!< A light request, e.g. for health checks, handled before the others
 } uri_prefixes[] = {
-      {"/rest/tx/", rest_tx},
-      {"/rest/block/notxdetails/", rest_block_notxdetails},
-      {"/rest/block/", rest_block_extended},
-      {"/rest/chaininfo", rest_chaininfo},
-      {"/rest/mempool/info", rest_mempool_info},
-      {"/rest/mempool/contents", rest_mempool_contents},
-      {"/rest/headers/", rest_headers},
-      {"/rest/getutxos", rest_getutxos},
+      {"/rest/tx/", rest_tx, false},
+      {"/rest/block/notxdetails/", rest_block_notxdetails, false},
+      {"/rest/block/", rest_block_extended, false},
+      {"/rest/chaininfo", rest_chaininfo, true},
+      {"/rest/mempool/info", rest_mempool_info, true},
+      {"/rest/mempool/contents", rest_mempool_contents, false},
+      {"/rest/headers/", rest_headers, false},
+      {"/rest/blockrange/", rest_blockrange, false},
+      {"/rest/compactblocks/", rest_compactblocks, false},
+      {"/rest/getutxos", rest_getutxos, false},
+      {"/rest/addressutxos", rest_addressutxos, false},
+      {"/rest/metrics", rest_metrics, true},
 };
 
 bool StartREST()
 {
-    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++) {
+        HTTPWorkQueueChoice choice;
+        choice.kind = WORKQUEUE_REST;
+        choice.fPriority = uri_prefixes[i].fPriority;
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler,
+                            [choice](HTTPRequest*, const std::string&) { return choice; });
+    }
     return true;
 }
 
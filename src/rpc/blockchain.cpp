@@ -8,24 +8,33 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockfilter.h"
 #include "budget/budgetmanager.h"
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "core_io.h"
+#include "index/blockfilterindex.h"
+#include "index/blockstatsindex.h"
+#include "index/coinstatsindex.h"
 #include "consensus/upgrades.h"
 #include "kernel.h"
 #include "masternodeman.h"
 #include "policy/feerate.h"
 #include "policy/policy.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "sync.h"
 #include "txdb.h"
+#include "undo.h"
 #include "util.h"
+#include "utxosnapshot.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
 #include "hash.h"
 #include "validationinterface.h"
+#include "validationstats.h"
 #include "wallet/wallet.h"
+#include "zdogec/zerocoinsnapshot.h"
 
 #include <stdint.h>
 #include <univalue.h>
@@ -186,6 +195,46 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     return result;
 }
 
+/** blockToJSON called without cs_main: it is taken only for the fields that depend on the chain */
+UniValue blockToJSONUnlocked(const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    UniValue result = WITH_LOCK(cs_main, return blockToJSON(block, blockindex, false));
+    if (txDetails) {
+        UniValue txs(UniValue::VARR);
+        for (const auto& txIn : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(*txIn, UINT256_ZERO, objTx);
+            txs.push_back(objTx);
+        }
+        result.pushKV("tx", txs);
+    }
+    return result;
+}
+
+/** blockToJSON written to a stream, one transaction at a time */
+static void blockToJSONStream(JSONStreamWriter& stream, const CBlock& block, const CBlockIndex* blockindex, bool txDetails)
+{
+    const UniValue header = WITH_LOCK(cs_main, return blockToJSON(block, blockindex, false));
+    const std::vector<std::string>& keys = header.getKeys();
+    const std::vector<UniValue>& values = header.getValues();
+    stream.BeginObject();
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (keys[i] != "tx" || !txDetails) {
+            stream.KeyValue(keys[i], values[i]);
+            continue;
+        }
+        stream.Key("tx");
+        stream.BeginArray();
+        for (const auto& txIn : block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(*txIn, UINT256_ZERO, objTx);
+            stream.Value(objTx);
+        }
+        stream.EndArray();
+    }
+    stream.EndObject();
+}
+
 UniValue getblockcount(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -395,38 +444,43 @@ UniValue getdifficulty(const JSONRPCRequest& request)
 }
 
 
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    AssertLockHeld(mempool.cs);
+    UniValue info(UniValue::VOBJ);
+    info.pushKV("size", (int)e.GetTxSize());
+    info.pushKV("fee", ValueFromAmount(e.GetFee()));
+    info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
+    info.pushKV("time", e.GetTime());
+    info.pushKV("height", (int)e.GetHeight());
+    info.pushKV("startingpriority", e.GetPriority(e.GetHeight()));
+    info.pushKV("currentpriority", e.GetPriority(chainActive.Height()));
+    info.pushKV("descendantcount", e.GetCountWithDescendants());
+    info.pushKV("descendantsize", e.GetSizeWithDescendants());
+    info.pushKV("descendantfees", e.GetModFeesWithDescendants());
+    const CTransaction& tx = e.GetTx();
+    std::set<std::string> setDepends;
+    for (const CTxIn& txin : tx.vin) {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    for (const std::string& dep : setDepends) {
+        depends.push_back(dep);
+    }
+
+    info.pushKV("depends", depends);
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose) {
         LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
         for (const CTxMemPoolEntry& e : mempool.mapTx) {
-            const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            info.pushKV("size", (int)e.GetTxSize());
-            info.pushKV("fee", ValueFromAmount(e.GetFee()));
-            info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
-            info.pushKV("time", e.GetTime());
-            info.pushKV("height", (int)e.GetHeight());
-            info.pushKV("startingpriority", e.GetPriority(e.GetHeight()));
-            info.pushKV("currentpriority", e.GetPriority(chainActive.Height()));
-            info.pushKV("descendantcount", e.GetCountWithDescendants());
-            info.pushKV("descendantsize", e.GetSizeWithDescendants());
-            info.pushKV("descendantfees", e.GetModFeesWithDescendants());
-            const CTransaction& tx = e.GetTx();
-            std::set<std::string> setDepends;
-            for (const CTxIn& txin : tx.vin) {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            for (const std::string& dep : setDepends) {
-                depends.push_back(dep);
-            }
-
-            info.pushKV("depends", depends);
-            o.pushKV(hash.ToString(), info);
+            o.pushKV(e.GetTx().GetHash().ToString(), mempoolEntryToJSON(e));
         }
         return o;
     } else {
@@ -441,6 +495,17 @@ UniValue mempoolToJSON(bool fVerbose = false)
     }
 }
 
+/** The verbose mempoolToJSON written to a stream, one entry at a time */
+static void mempoolToJSONStream(JSONStreamWriter& stream)
+{
+    LOCK(mempool.cs);
+    stream.BeginObject();
+    for (const CTxMemPoolEntry& e : mempool.mapTx) {
+        stream.KeyValue(e.GetTx().GetHash().ToString(), mempoolEntryToJSON(e));
+    }
+    stream.EndObject();
+}
+
 UniValue getrawmempool(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -479,12 +544,16 @@ UniValue getrawmempool(const JSONRPCRequest& request)
             "\nExamples\n" +
             HelpExampleCli("getrawmempool", "true") + HelpExampleRpc("getrawmempool", "true"));
 
-    LOCK(cs_main);
-
     bool fVerbose = false;
     if (request.params.size() > 0)
         fVerbose = request.params[0].get_bool();
 
+    LOCK(cs_main);
+
+    if (fVerbose && request.streamResult) {
+        mempoolToJSONStream(*request.streamResult);
+        return NullUniValue;
+    }
     return mempoolToJSON(fVerbose);
 }
 
@@ -504,9 +573,10 @@ UniValue getblockhash(const JSONRPCRequest& request)
             "\nExamples:\n" +
             HelpExampleCli("getblockhash", "1000") + HelpExampleRpc("getblockhash", "1000"));
 
+    int nHeight = request.params[0].get_int();
+
     LOCK(cs_main);
 
-    int nHeight = request.params[0].get_int();
     if (nHeight < 0 || nHeight > chainActive.Height())
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
@@ -518,15 +588,17 @@ UniValue getblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
         throw std::runtime_error(
-            "getblock \"hash\" ( verbose )\n"
-            "\nIf verbose is false, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
-            "If verbose is true, returns an Object with information about block <hash>.\n"
+            "getblock \"hash\" ( verbosity )\n"
+            "\nIf verbosity is 0, returns a string that is serialized, hex-encoded data for block 'hash'.\n"
+            "If verbosity is 1, returns an Object with information about block <hash>.\n"
+            "If verbosity is 2, returns an Object with information about block <hash> and information about each transaction.\n"
 
             "\nArguments:\n"
             "1. \"hash\"          (string, required) The block hash\n"
-            "2. verbose           (boolean, optional, default=true) true for a json object, false for the hex encoded data\n"
+            "2. verbosity         (numeric, optional, default=1) 0 for hex encoded data, 1 for a json object, and 2 for json object with transaction data\n"
+            "                     A boolean is also accepted: true for 1, false for 0\n"
 
-            "\nResult (for verbose = true):\n"
+            "\nResult (for verbosity = 1):\n"
             "{\n"
             "  \"hash\" : \"hash\",     (string) the block hash (same as provided)\n"
             "  \"confirmations\" : n,   (numeric) The number of confirmations, or -1 if the block is not on the main chain\n"
@@ -551,39 +623,63 @@ UniValue getblock(const JSONRPCRequest& request)
             "  }\n"
             "}\n"
 
-            "\nResult (for verbose=false):\n"
+            "\nResult (for verbosity = 2):\n"
+            "{\n"
+            "  ...,                     Same output as verbosity = 1\n"
+            "  \"tx\" : [               (array of Objects) The transactions in the format of the getrawtransaction RPC. Different from verbosity = 1 \"tx\" result\n"
+            "         ,...\n"
+            "  ],\n"
+            "  ,...                     Same output as verbosity = 1\n"
+            "}\n"
+
+            "\nResult (for verbosity = 0):\n"
             "\"data\"             (string) A string that is serialized, hex-encoded data for block 'hash'.\n"
 
             "\nExamples:\n" +
             HelpExampleCli("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") +
             HelpExampleRpc("getblock", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
-    bool fVerbose = true;
-    if (request.params.size() > 1)
-        fVerbose = request.params[1].get_bool();
+    int verbosity = 1;
+    if (request.params.size() > 1) {
+        if (request.params[1].isNum())
+            verbosity = request.params[1].get_int();
+        else
+            verbosity = request.params[1].get_bool() ? 1 : 0;
+    }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    const CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+        if (!(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
 
+    // The data of a block doesn't change once stored: read it without
+    // holding cs_main, which the block validation waits for
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if (!ReadBlockFromDisk(block, pblockindex))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
-    if (!fVerbose) {
+    if (verbosity <= 0) {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockToJSON(block, pblockindex);
+    // The transactions of a large block make a large result: stream it
+    if (request.streamResult) {
+        blockToJSONStream(*request.streamResult, block, pblockindex, verbosity >= 2);
+        return NullUniValue;
+    }
+    return blockToJSONUnlocked(block, pblockindex, verbosity >= 2);
 }
 
 UniValue getblockheader(const JSONRPCRequest& request)
@@ -622,13 +718,14 @@ UniValue getblockheader(const JSONRPCRequest& request)
             HelpExampleCli("getblockheader", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\"") +
             HelpExampleRpc("getblockheader", "\"00000000000fd08c2fb661d2fcb0d49abb3a91e5f27082ce64feed3b4dede2e2\""));
 
-    std::string strHash = request.params[0].get_str();
-    uint256 hash(uint256S(strHash));
+    uint256 hash(uint256S(request.params[0].get_str()));
 
     bool fVerbose = true;
     if (request.params.size() > 1)
         fVerbose = request.params[1].get_bool();
 
+    LOCK(cs_main);
+
     if (mapBlockIndex.count(hash) == 0)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
@@ -644,6 +741,84 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block (requires -blockfilterindex).\n"
+
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=\"basic\") The type name of the filter\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",    (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"     (string) the hex-encoded filter header\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"") +
+            HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\""));
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (request.params.size() > 1) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = g_blockfilterindex.get();
+    if (!index || index->GetFilterType() != filtertype) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(block_hash);
+        if (mi == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_index = mi->second;
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 UniValue getsupplyinfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -690,6 +865,12 @@ UniValue getsupplyinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+enum class CoinStatsHashType {
+    HASH_SERIALIZED,
+    MUHASH,
+    NONE,
+};
+
 struct CCoinsStats
 {
     int nHeight{0};
@@ -697,11 +878,12 @@ struct CCoinsStats
     uint64_t nTransactions{0};
     uint64_t nTransactionOutputs{0};
     uint256 hashSerialized{UINT256_ZERO};
+    uint256 muhash{UINT256_ZERO};
     uint64_t nDiskSize{0};
     CAmount nTotalAmount{0};
 };
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, MuHash3072& muhash, CoinStatsHashType hash_type, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
     ss << hash;
@@ -712,6 +894,9 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
         ss << VARINT(output.first + 1);
         ss << output.second.out.scriptPubKey;
         ss << VARINT(output.second.out.nValue);
+        if (hash_type == CoinStatsHashType::MUHASH) {
+            ApplyCoinHash(muhash, COutPoint(hash, output.first), output.second);
+        }
         stats.nTransactionOutputs++;
         stats.nTotalAmount += output.second.out.nValue;
     }
@@ -719,11 +904,12 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
 }
 
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats, CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED)
 {
     std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    MuHash3072 muhash;
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
@@ -738,7 +924,7 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
             if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
+                ApplyStats(stats, ss, muhash, hash_type, prevkey, outputs);
                 outputs.clear();
             }
             prevkey = key.hash;
@@ -749,51 +935,363 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         pcursor->Next();
     }
     if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        ApplyStats(stats, ss, muhash, hash_type, prevkey, outputs);
     }
     stats.hashSerialized = ss.GetHash();
+    if (hash_type == CoinStatsHashType::MUHASH) {
+        muhash.Finalize(stats.muhash);
+    }
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
 
+static CoinStatsHashType ParseHashType(const UniValue& param)
+{
+    if (param.isNull()) return CoinStatsHashType::HASH_SERIALIZED;
+    const std::string& hash_type = param.get_str();
+    if (hash_type == "hash_serialized_2") return CoinStatsHashType::HASH_SERIALIZED;
+    if (hash_type == "muhash") return CoinStatsHashType::MUHASH;
+    if (hash_type == "none") return CoinStatsHashType::NONE;
+    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type));
+}
+
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 3)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height use_index )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless it is answered by the coin stats index (-coinstatsindex).\n"
+
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, default=\"hash_serialized_2\") Which UTXO set hash should be calculated:\n"
+            "                       \"hash_serialized_2\", \"muhash\" or \"none\". Only \"muhash\" and \"none\" can be\n"
+            "                       answered by the coin stats index.\n"
+            "2. hash_or_height     (string or numeric, optional) The block hash or height of the target height,\n"
+            "                       only available with the coin stats index (default: the chain tip).\n"
+            "3. use_index          (boolean, optional, default=true) Use the coin stats index, if enabled.\n"
 
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"height\":n,     (numeric) The block height (index) of the returned statistics\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the block at which these statistics are calculated\n"
+            "  \"transactions\": n,      (numeric) The number of transactions (not available with the coin stats index)\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
-            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\",   (string) The serialized hash (only with hash_type \"hash_serialized_2\")\n"
+            "  \"muhash\": \"hash\",      (string) The MuHash3072 of the UTXO set (only with hash_type \"muhash\")\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk (not available with the coin stats index)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
 
             "\nExamples:\n" +
-            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "") + HelpExampleCli("gettxoutsetinfo", "\"none\"") +
+            HelpExampleCli("gettxoutsetinfo", "\"muhash\" 1000") + HelpExampleRpc("gettxoutsetinfo", ""));
+
+    const CoinStatsHashType hash_type = ParseHashType(request.params[0]);
+    const bool fUseIndex = request.params.size() < 3 || request.params[2].isNull() || request.params[2].get_bool();
+    const bool fIndex = g_coin_stats_index && fUseIndex && hash_type != CoinStatsHashType::HASH_SERIALIZED;
+    const bool fHeight = request.params.size() > 1 && !request.params[1].isNull();
+    if (fHeight && !fIndex) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Querying specific block heights requires the coin stats index (-coinstatsindex) and hash_type \"muhash\" or \"none\"");
+    }
 
     UniValue ret(UniValue::VOBJ);
 
+    if (fIndex) {
+        // Let the index process the blocks already connected
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            if (!fHeight) {
+                pindex = chainActive.Tip();
+            } else if (request.params[1].isNum()) {
+                const int nHeight = request.params[1].get_int();
+                if (nHeight < 0 || nHeight > chainActive.Height()) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Target block height %d is out of range", nHeight));
+                }
+                pindex = chainActive[nHeight];
+            } else {
+                const uint256 hash = ParseHashV(request.params[1], "hash_or_height");
+                BlockMap::const_iterator it = mapBlockIndex.find(hash);
+                if (it == mapBlockIndex.end()) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+                }
+                pindex = it->second;
+            }
+        }
+        CoinStatsIndex::Stats stats;
+        if (!g_coin_stats_index->LookUpStats(pindex, stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set statistics, the coin stats index may still be syncing");
+        }
+        ret.pushKV("height", (int64_t)pindex->nHeight);
+        ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+        ret.pushKV("txouts", (int64_t)stats.transaction_output_count);
+        if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.muhash.GetHex());
+        }
+        ret.pushKV("total_amount", ValueFromAmount(stats.total_amount));
+        return ret;
+    }
+
     CCoinsStats stats;
     FlushStateToDisk();
-    if (GetUTXOStats(pcoinsTip, stats)) {
+    if (GetUTXOStats(pcoinsTip, stats, hash_type)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::MUHASH) {
+            ret.pushKV("muhash", stats.muhash.GetHex());
+        }
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
         ret.pushKV("disk_size", stats.nDiskSize);
     }
     return ret;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite a snapshot of the chainstate (UTXO set, Sapling anchors and nullifiers) to a file.\n"
+            "Note this call may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"   (string, required) path of the output file. Relative paths are prefixed by the data directory.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\": n,     (numeric) The number of coins written in the snapshot\n"
+            "  \"base_hash\": \"hex\",     (string) The hash of the block at the tip of the chain state\n"
+            "  \"base_height\": n,       (numeric) The height of the block at the tip of the chain state\n"
+            "  \"path\": \"path\",         (string) The absolute path that the snapshot was written to\n"
+            "  \"txoutset_hash\": \"hex\", (string) The hash of the snapshot content\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") + HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    // Write to a temporary path and then move it into `path` on completion
+    const fs::path temppath = path.string() + ".incomplete";
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists. If you are sure this is what you want, move it out of the way first");
+    }
+
+    CCoinsStats stats;
+    SnapshotMetadata metadata;
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::vector<std::pair<uint256, SaplingMerkleTree>> vAnchors;
+    std::vector<uint256> vNullifiers;
+    {
+        // The database iterator keeps a consistent view of the chainstate once created,
+        // so cs_main is only needed until the cursor is taken.
+        LOCK(cs_main);
+        FlushStateToDisk();
+        if (!GetUTXOStats(pcoinsTip, stats)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read UTXO set");
+        }
+        pcursor.reset(pcoinsTip->Cursor());
+        if (!pcoinsTip->GetAllSaplingData(vAnchors, vNullifiers)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read Sapling anchors and nullifiers");
+        }
+        const CBlockIndex* pindexBase = mapBlockIndex.at(stats.hashBlock);
+        metadata.hashBaseBlock = stats.hashBlock;
+        metadata.nBaseHeight = pindexBase->nHeight;
+        metadata.hashBestAnchor = pcoinsTip->GetBestAnchor();
+        metadata.nCoins = stats.nTransactionOutputs;
+        metadata.nAnchors = vAnchors.size();
+        metadata.nNullifiers = vNullifiers.size();
+        metadata.nTransparentSupply = stats.nTotalAmount;
+        metadata.nShieldedSupply = pindexBase->nChainSaplingValue ? *pindexBase->nChainSaplingValue : 0;
+    }
+
+    CAutoFile afile(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to open " + temppath.string() + " for writing");
+    }
+    afile << metadata;
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    uint64_t nCoins = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read UTXO set");
+        }
+        afile << key << coin;
+        ss << key << coin;
+        nCoins++;
+        pcursor->Next();
+    }
+    if (nCoins != metadata.nCoins) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "UTXO set changed while being written");
+    }
+    for (const auto& it : vAnchors) {
+        afile << it.first << it.second;
+        ss << it.first << it.second;
+    }
+    for (const uint256& nf : vNullifiers) {
+        afile << nf;
+        ss << nf;
+    }
+    afile.fclose();
+    fs::rename(temppath, path);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", (int64_t)nCoins);
+    ret.pushKV("base_hash", metadata.hashBaseBlock.GetHex());
+    ret.pushKV("base_height", metadata.nBaseHeight);
+    ret.pushKV("path", path.string());
+    ret.pushKV("txoutset_hash", ss.GetHash().GetHex());
+    return ret;
+}
+
+UniValue dumpzerocoinsnapshot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumpzerocoinsnapshot \"path\"\n"
+            "\nWrite the legacy zerocoin state (spent serials, mints and supply) to a file, for -zerocoinsnapshot.\n"
+            "Zerocoin must be disabled at the tip of the chain.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"   (string, required) path of the output file. Relative paths are prefixed by the data directory.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hex\",     (string) The hash of the block at the tip of the chain\n"
+            "  \"base_height\": n,       (numeric) The height of the block at the tip of the chain\n"
+            "  \"path\": \"path\",         (string) The absolute path that the snapshot was written to\n"
+            "  \"snapshot_hash\": \"hex\", (string) The hash of the file, to set as hashZerocoinSnapshot in the chain parameters\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("dumpzerocoinsnapshot", "\"zerocoin.dat\"") + HelpExampleRpc("dumpzerocoinsnapshot", "\"zerocoin.dat\""));
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists. If you are sure this is what you want, move it out of the way first");
+    }
+
+    LOCK(cs_main);
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (!Params().GetConsensus().NetworkUpgradeActive(pindexTip->nHeight, Consensus::UPGRADE_V5_0)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Zerocoin is not disabled yet at the tip of the chain");
+    }
+    uint256 hashSnapshot;
+    std::string strError;
+    if (!DumpZerocoinSnapshot(*zerocoinDB, pindexTip->nHeight, pindexTip->GetBlockHash(), path, hashSnapshot, strError)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, strError);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("base_hash", pindexTip->GetBlockHash().GetHex());
+    ret.pushKV("base_height", pindexTip->nHeight);
+    ret.pushKV("path", path.string());
+    ret.pushKV("snapshot_hash", hashSnapshot.GetHex());
+    return ret;
+}
+
+UniValue verifytxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "verifytxoutset \"path\"\n"
+            "\nCheck a chainstate snapshot written by dumptxoutset against the snapshot hashes of the chain parameters.\n"
+            "Note this call may take some time.\n"
+
+            "\nArguments:\n"
+            "1. \"path\"   (string, required) path of the snapshot file. Relative paths are prefixed by the data directory.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hex\",            (string) The hash of the base block of the snapshot\n"
+            "  \"base_height\": n,              (numeric) The height of the base block of the snapshot\n"
+            "  \"coins\": n,                    (numeric) The number of coins in the snapshot\n"
+            "  \"transparentsupply\": n,        (numeric) The sum of the coins values\n"
+            "  \"shieldsupply\": n,             (numeric) The shield pool value at the base block\n"
+            "  \"txoutset_hash\": \"hex\",        (string) The hash of the snapshot content\n"
+            "  \"expected_txoutset_hash\": \"hex\", (string, optional) The snapshot hash of the chain parameters for base_height\n"
+            "  \"valid\": true|false           (boolean) Whether the snapshot is consistent and matches the chain parameters\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("verifytxoutset", "\"utxo.dat\"") + HelpExampleRpc("verifytxoutset", "\"utxo.dat\""));
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    CAutoFile afile(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unable to open " + path.string());
+    }
+
+    SnapshotMetadata metadata;
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    CAmount nTotalAmount = 0;
+    bool fConsistent = true;
+    try {
+        afile >> metadata;
+        if (metadata.nVersion != SnapshotMetadata::CURRENT_VERSION) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Unsupported snapshot version %d", metadata.nVersion));
+        }
+        for (uint64_t i = 0; i < metadata.nCoins; i++) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            afile >> key >> coin;
+            ss << key << coin;
+            nTotalAmount += coin.out.nValue;
+            fConsistent &= Params().GetConsensus().MoneyRange(coin.out.nValue) && Params().GetConsensus().MoneyRange(nTotalAmount);
+        }
+        bool fHaveBestAnchor = metadata.hashBestAnchor == SaplingMerkleTree::empty_root();
+        for (uint64_t i = 0; i < metadata.nAnchors; i++) {
+            uint256 root;
+            SaplingMerkleTree tree;
+            afile >> root >> tree;
+            ss << root << tree;
+            fConsistent &= tree.root() == root;
+            fHaveBestAnchor |= root == metadata.hashBestAnchor;
+        }
+        fConsistent &= fHaveBestAnchor;
+        for (uint64_t i = 0; i < metadata.nNullifiers; i++) {
+            uint256 nf;
+            afile >> nf;
+            ss << nf;
+        }
+    } catch (const std::ios_base::failure& e) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Snapshot file is truncated or corrupted: %s", e.what()));
+    }
+    fConsistent &= nTotalAmount == metadata.nTransparentSupply;
+    {
+        // The base block, when known, must be where the snapshot says it is
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(metadata.hashBaseBlock);
+        fConsistent &= it == mapBlockIndex.end() || it->second->nHeight == metadata.nBaseHeight;
+    }
+
+    const uint256 hash = ss.GetHash();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("base_hash", metadata.hashBaseBlock.GetHex());
+    ret.pushKV("base_height", metadata.nBaseHeight);
+    ret.pushKV("coins", (int64_t)metadata.nCoins);
+    ret.pushKV("transparentsupply", ValueFromAmount(metadata.nTransparentSupply));
+    ret.pushKV("shieldsupply", ValueFromAmount(metadata.nShieldedSupply));
+    ret.pushKV("txoutset_hash", hash.GetHex());
+    const auto& snapshots = Params().TxOutSetSnapshots();
+    const auto itSnapshot = snapshots.find(metadata.nBaseHeight);
+    if (itSnapshot != snapshots.end()) {
+        ret.pushKV("expected_txoutset_hash", itSnapshot->second.GetHex());
+    }
+    ret.pushKV("valid", fConsistent && itSnapshot != snapshots.end() && itSnapshot->second == hash);
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -832,18 +1330,18 @@ UniValue gettxout(const JSONRPCRequest& request)
             "\nAs a json rpc call\n" +
             HelpExampleRpc("gettxout", "\"txid\", 1"));
 
-    LOCK(cs_main);
-
-    UniValue ret(UniValue::VOBJ);
-
-    std::string strHash = request.params[0].get_str();
-    uint256 hash(uint256S(strHash));
+    // The arguments are parsed before taking the locks
+    uint256 hash(uint256S(request.params[0].get_str()));
     int n = request.params[1].get_int();
     COutPoint out(hash, n);
     bool fMempool = true;
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VOBJ);
+
     Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
@@ -996,6 +1494,9 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "    \"valueDelta\":        (numeric) Change in value held by the Sapling circuit over the chain tip block\n"
             "  },\n"
             "  \"initial_block_downloading\": true|false, (boolean) whether the node is in initial block downloading state or not\n"
+            "  \"pruned\": xx,             (boolean) if the blocks are subject to pruning\n"
+            "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
+            "  \"prune_target_size\": xxxxxx, (numeric) the target size used by pruning, in bytes (only present if pruning is enabled)\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1033,6 +1534,11 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     // Sapling shield pool value
     obj.pushKV("shield_pool_value", pChainTip ? ValuePoolDesc(pChainTip->nChainSaplingValue, pChainTip->nSaplingValue) : 0);
     obj.pushKV("initial_block_downloading", IsInitialBlockDownload());
+    obj.pushKV("pruned", fPruneMode);
+    if (fPruneMode) {
+        obj.pushKV("pruneheight", GetPruneHeight());
+        obj.pushKV("prune_target_size", nPruneTarget);
+    }
     UniValue softforks(UniValue::VARR);
     softforks.push_back(SoftForkDesc("bip65", 5, pChainTip));
     obj.pushKV("softforks",             softforks);
@@ -1153,12 +1659,27 @@ UniValue mempoolInfoToJSON()
 {
     UniValue ret(UniValue::VOBJ);
     ret.pushKV("loaded", mempool.IsLoaded());
+    ret.pushKV("loadprogress", mempool.GetLoadProgress());
     ret.pushKV("size", (int64_t) mempool.size());
     ret.pushKV("bytes", (int64_t) mempool.GetTotalTxSize());
     ret.pushKV("usage", (int64_t) mempool.DynamicMemoryUsage());
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
+    ret.pushKV("blockfillfee", ValueFromAmount(mempool.GetBlockFillFeeRate(gArgs.GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE)).GetFeePerK()));
+
+    UniValue histogram(UniValue::VARR);
+    const std::array<FeeRateBucket, FEE_HISTOGRAM_BUCKETS>& buckets = mempool.GetFeeHistogram();
+    for (unsigned int i = 0; i < buckets.size(); i++) {
+        if (buckets[i].nCount == 0) continue;
+        UniValue bucket(UniValue::VOBJ);
+        bucket.pushKV("feerate", ValueFromAmount(CTxMemPool::GetFeeHistogramBucketStart(i).GetFeePerK()));
+        bucket.pushKV("count", (int64_t) buckets[i].nCount);
+        bucket.pushKV("bytes", (int64_t) buckets[i].nBytes);
+        bucket.pushKV("fees", ValueFromAmount(buckets[i].nFees));
+        histogram.push_back(bucket);
+    }
+    ret.pushKV("feehistogram", histogram);
 
     return ret;
 }
@@ -1173,12 +1694,22 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "\nResult:\n"
             "{\n"
             "  \"loaded\": true|false         (boolean) True if the mempool is fully loaded\n"
+            "  \"loadprogress\": x.xxx        (numeric) Fraction of the mempool file loaded from disk so far, 1 once loaded\n"
             "  \"size\": xxxxx                (numeric) Current tx count\n"
             "  \"bytes\": xxxxx               (numeric) Sum of all tx sizes\n"
             "  \"usage\": xxxxx               (numeric) Total memory usage for the mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
             "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
+            "  \"blockfillfee\": xxxxx        (numeric) Estimated fee rate in " + CURRENCY_UNIT + "/kB for a tx to make it into the next block, 0 if the whole mempool fits\n"
+            "  \"feehistogram\": [            (array) The transactions of the mempool by fee rate, non-empty buckets only\n"
+            "    {\n"
+            "      \"feerate\": xxxxx         (numeric) Lowest fee rate in " + CURRENCY_UNIT + "/kB of the bucket, the next one being twice this\n"
+            "      \"count\": xxxxx           (numeric) Number of transactions in the bucket\n"
+            "      \"bytes\": xxxxx           (numeric) Sum of their sizes\n"
+            "      \"fees\": xxxxx            (numeric) Sum of their modified fees\n"
+            "    }, ...\n"
+            "  ]\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -1187,6 +1718,54 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+UniValue getvalidationstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getvalidationstats ( reset )\n"
+            "\nReturns the time spent in each phase of the validation of the last blocks.\n"
+            "Each phase keeps the durations of its last " + std::to_string(BLOCK_STATS_WINDOW) + " runs: the blocks checked\n"
+            "by -checklevel or for a block template are not counted.\n"
+
+            "\nArguments:\n"
+            "1. reset    (boolean, optional, default=false) Empty the windows, after returning them\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"phase\": {              (object) read, checkblock (including tiertwo), pos, tiertwo, inputs,\n"
+            "                           scripts, sapling, index, flush and total (the whole connection of a block)\n"
+            "    \"samples\": n,         (numeric) The number of durations in the window\n"
+            "    \"total_samples\": n,   (numeric) The number of durations since the start\n"
+            "    \"total_s\": x.xxx,     (numeric) The sum of the durations since the start, in seconds\n"
+            "    \"avg_ms\": x.xxx,      (numeric) The average duration over the window, in milliseconds\n"
+            "    \"p50_ms\": x.xxx,      (numeric) The median duration\n"
+            "    \"p90_ms\": x.xxx,      (numeric) The 90th percentile\n"
+            "    \"p99_ms\": x.xxx,      (numeric) The 99th percentile\n"
+            "    \"max_ms\": x.xxx       (numeric) The longest duration\n"
+            "  }, ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getvalidationstats", "") + HelpExampleRpc("getvalidationstats", ""));
+
+    UniValue ret(UniValue::VOBJ);
+    for (const BlockPhaseStats& stats : GetBlockPhaseStats()) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("samples", (uint64_t)stats.nSamples);
+        entry.pushKV("total_samples", stats.nTotalSamples);
+        entry.pushKV("total_s", stats.nTotalTime / 1000000.0);
+        entry.pushKV("avg_ms", stats.nAvg / 1000.0);
+        entry.pushKV("p50_ms", stats.nP50 / 1000.0);
+        entry.pushKV("p90_ms", stats.nP90 / 1000.0);
+        entry.pushKV("p99_ms", stats.nP99 / 1000.0);
+        entry.pushKV("max_ms", stats.nMax / 1000.0);
+        ret.pushKV(stats.name, entry);
+    }
+    if (request.params.size() > 0 && request.params[0].get_bool())
+        ResetBlockPhaseStats();
+    return ret;
+}
+
 UniValue invalidateblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1215,9 +1794,7 @@ UniValue invalidateblock(const JSONRPCRequest& request)
 
     if (state.IsValid()) {
         ActivateBestChain(state);
-        int nHeight = WITH_LOCK(cs_main, return chainActive.Height(); );
-        g_budgetman.SetBestHeight(nHeight);
-        mnodeman.SetBestHeight(nHeight);
+        g_budgetman.SetBestHeight(GetChainTipSnapshot()->nHeight);
     }
 
     if (!state.IsValid()) {
@@ -1256,9 +1833,7 @@ UniValue reconsiderblock(const JSONRPCRequest& request)
 
     if (state.IsValid()) {
         ActivateBestChain(state);
-        int nHeight = WITH_LOCK(cs_main, return chainActive.Height(); );
-        g_budgetman.SetBestHeight(nHeight);
-        mnodeman.SetBestHeight(nHeight);
+        g_budgetman.SetBestHeight(GetChainTipSnapshot()->nHeight);
     }
 
     if (!state.IsValid()) {
@@ -1321,6 +1896,11 @@ UniValue getblockindexstats(const JSONRPCRequest& request) {
                 "  \"txbytes\": xxxxx                (numeric) Sum of the size of all txes over block range\n"
                 "  \"ttlfee\": xxxxx                 (numeric) Sum of the fee amount of all txes over block range\n"
                 "  \"feeperkb\": xxxxx               (numeric) Average fee per kb (excluding zc txes)\n"
+                "  \"shield_txcount\": xxxxx         (numeric) tx count with shielded data\n"
+                "  \"shield_spends\": xxxxx          (numeric) Number of shielded spends\n"
+                "  \"shield_outputs\": xxxxx         (numeric) Number of shielded outputs\n"
+                "  \"staked\": xxxxx                 (numeric) Sum of the value staked by the coinstakes\n"
+                "  \"stake_payout\": xxxxx           (numeric) Sum of the value paid out by the coinstakes\n"
                 "}\n"
 
                 "\nExamples:\n" +
@@ -1334,58 +1914,45 @@ UniValue getblockindexstats(const JSONRPCRequest& request) {
     ret.pushKV("Starting block", heightStart);
     ret.pushKV("Ending block", heightEnd);
 
-    CAmount nFees = 0;
-    int64_t nBytes = 0;
-    int64_t nTxCount = 0;
-    int64_t nTxCount_all = 0;
-
-    const CBlockIndex* pindex = WITH_LOCK(cs_main, return chainActive[heightEnd]);
-    if (!pindex)
+    const CBlockIndex* pindexEnd = WITH_LOCK(cs_main, return chainActive[heightEnd]);
+    if (!pindexEnd)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "invalid block height");
 
-    while (pindex && pindex->nHeight >= heightStart) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
-        }
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        const int ntx = block.vtx.size();
-        const int firstTxIndex = block.IsProofOfStake() ? 2 : 1;
-        nTxCount_all += ntx;
-        nTxCount = nTxCount + ntx - firstTxIndex;
-
-        // loop through each tx in block and save size and fee (except for coinbase/coinstake)
-        for (int idx = firstTxIndex; idx < ntx; idx++) {
-            const CTransaction& tx = *(block.vtx[idx]);
-
-            // zerocoin txes have fixed fee, don't count them here.
-            if (tx.ContainsZerocoins())
-                continue;
-
-            // Transaction size
-            nBytes += GetSerializeSize(tx, SER_NETWORK, CLIENT_VERSION);
-
-            // Transparent inputs
-            for (unsigned int j = 0; j < tx.vin.size(); j++) {
-                COutPoint prevout = tx.vin[j].prevout;
-                CTransactionRef txPrev;
-                uint256 hashBlock;
-                if(!GetTransaction(prevout.hash, txPrev, hashBlock, true))
-                    throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read tx from disk");
-                nValueIn += txPrev->vout[prevout.n].nValue;
+    // The block stats index has the rows of the range already; without it,
+    // or while it is syncing, the blocks are read from disk with their undo data.
+    std::vector<BlockStatsIndex::Stats> vStats;
+    if (!g_block_stats_index || !g_block_stats_index->BlockUntilSyncedToCurrentChain() ||
+            !g_block_stats_index->LookUpStatsRange(heightStart, pindexEnd, vStats)) {
+        vStats.assign(heightEnd - heightStart + 1, BlockStatsIndex::Stats());
+        for (const CBlockIndex* pindex = pindexEnd; pindex && pindex->nHeight >= heightStart; pindex = pindex->pprev) {
+            CBlock block;
+            CBlockUndo blockUndo;
+            if (!ReadBlockFromDisk(block, pindex) || (pindex->nHeight > 0 && !UndoReadFromDisk(blockUndo, pindex)) ||
+                    !ComputeBlockStats(block, blockUndo, vStats[pindex->nHeight - heightStart])) {
+                throw JSONRPCError(RPC_DATABASE_ERROR, "failed to read block from disk");
             }
-            // Shield inputs
-            nValueIn += tx.GetShieldedValueIn();
-
-            // Tranparent/Shield outputs
-            nValueOut += tx.GetValueOut();
-
-            // update fee
-            nFees += nValueIn - nValueOut;
         }
-        pindex = pindex->pprev;
+    }
+
+    CAmount nFees = 0;
+    int64_t nBytes = 0;
+    int64_t nTxCount = 0;
+    int64_t nTxCount_all = 0;
+    int64_t nShieldTxCount = 0;
+    int64_t nShieldSpends = 0;
+    int64_t nShieldOutputs = 0;
+    CAmount nStaked = 0;
+    CAmount nStakePayout = 0;
+    for (const BlockStatsIndex::Stats& stats : vStats) {
+        nFees += stats.fees;
+        nBytes += stats.tx_bytes;
+        nTxCount += stats.tx_count;
+        nTxCount_all += stats.tx_count_all;
+        nShieldTxCount += stats.shielded_tx_count;
+        nShieldSpends += stats.shielded_spend_count;
+        nShieldOutputs += stats.shielded_output_count;
+        nStaked += stats.coinstake_value_in;
+        nStakePayout += stats.coinstake_value_out;
     }
 
     // get fee rate
@@ -1397,6 +1964,11 @@ UniValue getblockindexstats(const JSONRPCRequest& request) {
     ret.pushKV("txbytes", (int64_t)nBytes);
     ret.pushKV("ttlfee", FormatMoney(nFees));
     ret.pushKV("feeperkb", FormatMoney(nFeeRate.GetFeePerK()));
+    ret.pushKV("shield_txcount", nShieldTxCount);
+    ret.pushKV("shield_spends", nShieldSpends);
+    ret.pushKV("shield_outputs", nShieldOutputs);
+    ret.pushKV("staked", FormatMoney(nStaked));
+    ret.pushKV("stake_payout", FormatMoney(nStakePayout));
 
     return ret;
 }
@@ -1439,28 +2011,37 @@ UniValue getfeeinfo(const JSONRPCRequest& request)
     newParams.push_back(UniValue(nBlocks));
     newRequest.params = newParams;
 
-    return getblockindexstats(newRequest);
+    UniValue ret = getblockindexstats(newRequest);
+    // what a tx must pay to get into the next block, with the current mempool
+    CFeeRate highPriorityFee = std::max(mempool.GetBlockFillFeeRate(gArgs.GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE)), ::minRelayTxFee);
+    ret.pushKV("rec_highpriorityfee_perkb", FormatMoney(highPriorityFee.GetFeePerK()));
+    return ret;
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  (argTypes)
+  //  --------------------- ------------------------  -----------------------  ----------  ----------
     { "blockchain",         "getblockindexstats",     &getblockindexstats,     true  },
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
     { "blockchain",         "getbestsaplinganchor",   &getbestsaplinganchor,   true  },
     { "blockchain",         "getblockcount",          &getblockcount,          true  },
     { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         false },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  {UniValue::VNUM} },
+    { "blockchain",         "getblockheader",         &getblockheader,         false, {UniValue::VSTR, UniValue::VBOOL} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         true  },
     { "blockchain",         "getchaintips",           &getchaintips,           true  },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
     { "blockchain",         "getfeeinfo",             &getfeeinfo,             true  },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
     { "blockchain",         "getsupplyinfo",          &getsupplyinfo,          true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {UniValue::VBOOL} },
+    { "blockchain",         "gettxout",               &gettxout,               true,  {UniValue::VSTR, UniValue::VNUM, UniValue::VBOOL} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     true,  {UniValue::VBOOL} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           true  },
+    { "blockchain",         "dumpzerocoinsnapshot",   &dumpzerocoinsnapshot,   true  },
+    { "blockchain",         "verifytxoutset",         &verifytxoutset,         true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
 
     /* Not shown in help */
@@ -424,7 +424,7 @@ UniValue getnextsuperblock(const JSONRPCRequest& request)
             "\nExamples:\n" +
             HelpExampleCli("getnextsuperblock", "") + HelpExampleRpc("getnextsuperblock", ""));
 
-    int nChainHeight = WITH_LOCK(cs_main, return chainActive.Height());
+    int nChainHeight = GetChainTipSnapshot()->nHeight;
     if (nChainHeight < 0) return "unknown";
 
     const int nBlocksPerCycle = Params().GetConsensus().nBudgetCycleBlocks;
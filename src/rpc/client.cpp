@@ -64,7 +64,14 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "shieldsendmany", 1 },
     { "shieldsendmany", 2 },
     { "shieldsendmany", 3 },
+    { "shieldsendmanyasync", 1 },
+    { "shieldsendmanyasync", 2 },
+    { "shieldsendmanyasync", 3 },
+    { "getoperationstatus", 0 },
+    { "getoperationresult", 0 },
     { "getblockhash", 0 },
+    { "gettxoutsetinfo", 1 },
+    { "gettxoutsetinfo", 2 },
     { "waitforblockheight", 0 },
     { "waitforblockheight", 1 },
     { "waitforblock", 1 },
@@ -97,9 +104,13 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "listshieldunspent", 3 },
     { "logging", 0 },
     { "logging", 1 },
+    { "getlockstats", 0 },
+    { "getlockstats", 1 },
+    { "getlockstats", 2 },
     { "getblock", 1 },
     { "getblockheader", 1 },
     { "gettransaction", 1 },
+    { "archivewallettxs", 0 },
     { "getrawtransaction", 1 },
     { "createrawtransaction", 0 },
     { "createrawtransaction", 1 },
@@ -152,6 +163,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     { "getblockindexstats", 0 },
     { "getblockindexstats", 1 },
     { "getfeeinfo", 0 },
+    { "getvalidationstats", 0 },
     { "getsupplyinfo", 0 },
 };
 
@@ -0,0 +1,90 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+JSONStreamWriter::JSONStreamWriter(Sink sinkIn, size_t nChunkSizeIn) :
+    sink(std::move(sinkIn)),
+    nChunkSize(nChunkSizeIn)
+{
+    buffer.reserve(nChunkSize);
+}
+
+void JSONStreamWriter::Separate()
+{
+    fStarted = true;
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vHasElement.empty()) {
+        if (vHasElement.back()) buffer += ',';
+        vHasElement.back() = true;
+    }
+}
+
+void JSONStreamWriter::Append(const std::string& str)
+{
+    buffer += str;
+    if (buffer.size() >= nChunkSize) Flush();
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    buffer += '{';
+    vHasElement.push_back(false);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!vHasElement.empty() && !fAfterKey);
+    vHasElement.pop_back();
+    Append("}");
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    buffer += '[';
+    vHasElement.push_back(false);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!vHasElement.empty() && !fAfterKey);
+    vHasElement.pop_back();
+    Append("]");
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vHasElement.empty() && !fAfterKey);
+    Separate();
+    // A string value writes with the JSON escapes
+    buffer += UniValue(key).write();
+    buffer += ':';
+    fAfterKey = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    Append(value.write());
+}
+
+void JSONStreamWriter::KeyValue(const std::string& key, const UniValue& value)
+{
+    Key(key);
+    Value(value);
+}
+
+void JSONStreamWriter::Flush()
+{
+    if (buffer.empty()) return;
+    sink(buffer);
+    buffer.clear();
+}
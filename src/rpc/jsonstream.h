@@ -0,0 +1,63 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/**
+ * Writes a JSON document piece by piece, handing it to a sink in chunks of
+ * about nChunkSize bytes, so that a large RPC result (a block with its
+ * transactions, the verbose mempool...) doesn't have to be built as a
+ * whole UniValue tree and then copied into one string before being sent.
+ *
+ * The caller opens and closes the objects and arrays; the separators are
+ * added by the writer. The values themselves are small UniValue objects
+ * (a transaction, a mempool entry), written as UniValue::write() would.
+ */
+class JSONStreamWriter
+{
+public:
+    typedef std::function<void(const std::string&)> Sink;
+
+    static const size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit JSONStreamWriter(Sink sinkIn, size_t nChunkSizeIn = DEFAULT_CHUNK_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** The key of the next value of the current object */
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+    /** Key(key) then Value(value) */
+    void KeyValue(const std::string& key, const UniValue& value);
+
+    /** Hand what is buffered to the sink */
+    void Flush();
+
+    /** Whether anything has been written, i.e. the result is being streamed */
+    bool IsStarted() const { return fStarted; }
+
+private:
+    Sink sink;
+    size_t nChunkSize;
+    std::string buffer;
+    bool fStarted{false};
+    /** Whether the open objects and arrays have a first element yet */
+    std::vector<bool> vHasElement;
+    bool fAfterKey{false};
+
+    void Separate();
+    void Append(const std::string& str);
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
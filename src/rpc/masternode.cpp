@@ -656,7 +656,7 @@ UniValue getmasternodewinners (const JSONRPCRequest& request)
             "\nExamples:\n" +
             HelpExampleCli("getmasternodewinners", "") + HelpExampleRpc("getmasternodewinners", ""));
 
-    int nHeight = WITH_LOCK(cs_main, return chainActive.Height());
+    int nHeight = GetChainTipSnapshot()->nHeight;
     if (nHeight < 0) return "[]";
 
     int nLast = 10;
@@ -719,7 +719,8 @@ UniValue submitblock(const JSONRPCRequest& request)
 
     CValidationState state;
     submitblock_StateCatcher sc(block.GetHash());
-    RegisterValidationInterface(&sc);
+    // Only listens to BlockChecked, delivered inline: no thread needed
+    RegisterValidationInterface(&sc, "submitblock", true);
     bool fAccepted = ProcessNewBlock(state, nullptr, blockptr, nullptr);
     UnregisterValidationInterface(&sc);
     if (fBlockPresent) {
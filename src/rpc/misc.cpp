@@ -9,24 +9,30 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "budget/budgetmanager.h"
 #include "clientversion.h"
 #include "httpserver.h"
 #include "init.h"
 #include "sapling/key_io_sapling.h"
+#include "masternode-payments.h"
 #include "masternode-sync.h"
+#include "masternodeman.h"
 #include "net.h"
 #include "netbase.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "spork.h"
 #include "timedata.h"
 #include "util.h"
 #include <validation.h>
+#include "validationinterface.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #endif
 #include "warnings.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <txmempool.h>
@@ -448,33 +454,56 @@ UniValue validateaddress(const JSONRPCRequest& request)
     return ret;
 }
 
+/** The address index key (hash and type: 1 for the key hashes, 2 for the script hashes) of an address */
+bool getIndexKeyFromAddress(const std::string& str, uint160& hashBytes, int& addressType)
+{
+    CTxDestination dest = DecodeDestination(str);
+    CScript scriptPubKey = GetScriptForDestination(dest);
+
+    if (scriptPubKey.IsPayToScriptHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(scriptPubKey.begin() + 2, scriptPubKey.begin() + 22));
+        addressType = 2;
+    } else if (scriptPubKey.IsPayToPublicKeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(scriptPubKey.begin() + 3, scriptPubKey.begin() + 23));
+        addressType = 1;
+    } else if (scriptPubKey.IsPayToWitnessPubkeyHash()) {
+        hashBytes = uint160(std::vector<unsigned char>(scriptPubKey.begin() + 2, scriptPubKey.end()));
+        addressType = 1;
+    } else {
+        hashBytes.SetNull();
+        addressType = 0;
+    }
+
+    return addressType != 0;
+}
+
+static void getAddressFromString(const std::string& str, std::vector<std::pair<uint160, int> >& addresses)
+{
+    uint160 hashBytes;
+    int addressType = 0;
+    if (!getIndexKeyFromAddress(str, hashBytes, addressType)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    addresses.push_back(std::make_pair(hashBytes, addressType));
+}
+
 static bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint160, int> >& addresses)
 {
     if (params[0].isStr()) {
-        CTxDestination dest = DecodeDestination(params[0].get_str());
-        CScript scriptPubKey = GetScriptForDestination(dest);
-        uint160 hashBytes;
-        int addressType = 0;
-
-        if (scriptPubKey.IsPayToScriptHash()) {
-            hashBytes = uint160(std::vector<unsigned char>(scriptPubKey.begin() + 2, scriptPubKey.begin() + 22));
-            addressType = 2;
-        } else if (scriptPubKey.IsPayToPublicKeyHash()) {
-            hashBytes = uint160(std::vector<unsigned char>(scriptPubKey.begin() + 3, scriptPubKey.begin() + 23));
-            addressType = 1;
-        } else if (scriptPubKey.IsPayToWitnessPubkeyHash()) {
-            hashBytes = uint160(std::vector<unsigned char>(scriptPubKey.begin() + 2, scriptPubKey.end()));
-            addressType = 1;
-        } else {
-            hashBytes.SetNull();
-            addressType = 0;
+        getAddressFromString(params[0].get_str(), addresses);
+    } else if (params[0].isObject()) {
+        UniValue addressValues = find_value(params[0].get_obj(), "addresses");
+        if (!addressValues.isArray()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Addresses is expected to be an array");
         }
 
-        if (addressType == 0) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        for (unsigned int i = 0; i < addressValues.size(); i++) {
+            if (!addressValues[i].isStr()) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+            }
+            getAddressFromString(addressValues[i].get_str(), addresses);
         }
-
-        addresses.push_back(std::make_pair(hashBytes, addressType));
     } else {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
@@ -482,6 +511,117 @@ static bool getAddressesFromParams(const UniValue& params, std::vector<std::pair
     return true;
 }
 
+/** Read the "limit" and "cursor" options of the address history queries */
+static void getPageFromParams(const UniValue& params, size_t& nLimit, CAddressIndexPosition& after, bool& fAfter)
+{
+    nLimit = 0;
+    fAfter = false;
+    if (!params[0].isObject()) return;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (!limitValue.isNull()) {
+        int n = limitValue.get_int();
+        if (n <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+        }
+        nLimit = n;
+    }
+
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (!cursorValue.isNull()) {
+        if (nLimit == 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "A cursor is only valid with a limit");
+        }
+        if (!cursorValue.isStr() || !IsHex(cursorValue.get_str())) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        CDataStream ss(ParseHex(cursorValue.get_str()), SER_DISK, CLIENT_VERSION);
+        try {
+            ss >> after;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        if (!ss.empty()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        fAfter = true;
+    }
+}
+
+/**
+ * Read a page of the activity of the addresses, in chain order: the entries
+ * after the position pafter (if any), at most nLimit of them, or all the
+ * entries of at most nLimit transactions with fByTx. Each address is only read
+ * up to the end of the page. Returns the cursor of the next page, or null if
+ * this page is the last one.
+ */
+static UniValue getAddressIndexPage(const std::vector<std::pair<uint160, int> >& addresses, int start, int end,
+                                    const CAddressIndexPosition* pafter, size_t nLimit, bool fByTx,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex)
+{
+    // Counts the entries, or the transactions with fByTx, of a sequence in chain order
+    struct PageCounter {
+        const bool fByTx;
+        size_t nCount{0};
+        std::pair<int, unsigned int> lastTx{-1, 0};
+
+        explicit PageCounter(bool fByTxIn) : fByTx(fByTxIn) {}
+
+        //! Count the entry, returns false if it's past the first nLimit
+        bool Add(const CAddressIndexKey& key, size_t nLimit)
+        {
+            const std::pair<int, unsigned int> tx(key.blockHeight, key.txindex);
+            if (fByTx && tx == lastTx) return true;
+            if (nCount == nLimit) return false;
+            nCount++;
+            lastTx = tx;
+            return true;
+        }
+    };
+
+    bool fMore = false;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        PageCounter counter(fByTx);
+        bool fScanned = ScanAddressIndex((*it).first, (*it).second, start, end, pafter, [&](const CAddressIndexKey& key, CAmount nValue) {
+            if (!counter.Add(key, nLimit)) {
+                fMore = true;
+                return false;
+            }
+            addressIndex.emplace_back(key, nValue);
+            return true;
+        });
+        if (!fScanned) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
+
+    // Keep the first page of the addresses together
+    std::sort(addressIndex.begin(), addressIndex.end(), [](const std::pair<CAddressIndexKey, CAmount>& a, const std::pair<CAddressIndexKey, CAmount>& b) {
+        return a.first.GetPosition() < b.first.GetPosition();
+    });
+    PageCounter counter(fByTx);
+    for (size_t i = 0; i < addressIndex.size(); i++) {
+        if (!counter.Add(addressIndex[i].first, nLimit)) {
+            addressIndex.resize(i);
+            fMore = true;
+            break;
+        }
+    }
+
+    if (!fMore || addressIndex.empty()) {
+        return NullUniValue;
+    }
+    CAddressIndexPosition last = addressIndex.back().first.GetPosition();
+    if (fByTx) {
+        // resume after all the entries of the transaction
+        last.index = std::numeric_limits<uint32_t>::max();
+        last.spending = true;
+    }
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << last;
+    return HexStr(ss.begin(), ss.end());
+}
+
 bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
     std::pair<CAddressUnspentKey, CAddressUnspentValue> b)
 {
@@ -522,6 +662,8 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"limit\" (number, optional) Return at most this many changes, and a cursor for the next ones\n"
+            "  \"cursor\" (string, optional) The cursor returned with the previous changes, to get the next ones\n"
             "}\n"
             "\nResult:\n"
             "[\n"
@@ -533,6 +675,12 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nResult (with a limit, or chainInfo):\n"
+            "{\n"
+            "  \"deltas\": [...]  (array) The changes, as above\n"
+            "  \"cursor\"  (string) With a limit, the cursor of the next changes, null after the last ones\n"
+            "  \"start\", \"end\"  (object) With chainInfo, the hash and height of the start and end blocks\n"
+            "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'") + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}"));
 
@@ -566,41 +714,34 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    size_t nLimit;
+    CAddressIndexPosition after;
+    bool fAfter;
+    getPageFromParams(request.params, nLimit, after, fAfter);
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    UniValue cursor;
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    if (nLimit > 0) {
+        cursor = getAddressIndexPage(addresses, start, end, fAfter ? &after : nullptr, nLimit, false, addressIndex);
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
 
-    UniValue deltas(UniValue::VARR);
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
-        }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.pushKV("satoshis", it->second);
-        delta.pushKV("txid", it->first.txhash.GetHex());
-        delta.pushKV("index", (int)it->first.index);
-        delta.pushKV("blockindex", (int)it->first.txindex);
-        delta.pushKV("height", it->first.blockHeight);
-        delta.pushKV("address", address);
-        deltas.push_back(delta);
-    }
-
-    UniValue result(UniValue::VOBJ);
-
-    if (includeChainInfo && start > 0 && end > 0) {
+    const bool fChainInfo = includeChainInfo && start > 0 && end > 0;
+    UniValue startInfo(UniValue::VOBJ);
+    UniValue endInfo(UniValue::VOBJ);
+    if (fChainInfo) {
         LOCK(cs_main);
 
         if (start > chainActive.Height() || end > chainActive.Height()) {
@@ -610,19 +751,70 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         CBlockIndex* startIndex = chainActive[start];
         CBlockIndex* endIndex = chainActive[end];
 
-        UniValue startInfo(UniValue::VOBJ);
-        UniValue endInfo(UniValue::VOBJ);
-
         startInfo.pushKV("hash", startIndex->GetBlockHash().GetHex());
         startInfo.pushKV("height", start);
 
         endInfo.pushKV("hash", endIndex->GetBlockHash().GetHex());
         endInfo.pushKV("height", end);
+    }
+
+    auto deltaToJSON = [](const std::pair<CAddressIndexKey, CAmount>& entry) {
+        std::string address;
+        if (!getAddressFromIndex(entry.first.type, entry.first.hashBytes, address)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        }
+
+        UniValue delta(UniValue::VOBJ);
+        delta.pushKV("satoshis", entry.second);
+        delta.pushKV("txid", entry.first.txhash.GetHex());
+        delta.pushKV("index", (int)entry.first.index);
+        delta.pushKV("blockindex", (int)entry.first.txindex);
+        delta.pushKV("height", entry.first.blockHeight);
+        delta.pushKV("address", address);
+        return delta;
+    };
+
+    // The history of a busy address makes a large result: stream it
+    if (request.streamResult) {
+        JSONStreamWriter& stream = *request.streamResult;
+        const bool fWrapped = fChainInfo || nLimit > 0;
+        if (fWrapped) {
+            stream.BeginObject();
+            stream.Key("deltas");
+        }
+        stream.BeginArray();
+        for (const auto& entry : addressIndex) {
+            stream.Value(deltaToJSON(entry));
+        }
+        stream.EndArray();
+        if (fWrapped) {
+            if (nLimit > 0) stream.KeyValue("cursor", cursor);
+            if (fChainInfo) {
+                stream.KeyValue("start", startInfo);
+                stream.KeyValue("end", endInfo);
+            }
+            stream.EndObject();
+        }
+        return NullUniValue;
+    }
+
+    UniValue deltas(UniValue::VARR);
+    for (const auto& entry : addressIndex) {
+        deltas.push_back(deltaToJSON(entry));
+    }
 
+    UniValue result(UniValue::VOBJ);
+
+    if (fChainInfo) {
         result.pushKV("deltas", deltas);
+        if (nLimit > 0) result.pushKV("cursor", cursor);
         result.pushKV("start", startInfo);
         result.pushKV("end", endInfo);
 
+        return result;
+    } else if (nLimit > 0) {
+        result.pushKV("deltas", deltas);
+        result.pushKV("cursor", cursor);
         return result;
     } else {
         return deltas;
@@ -657,22 +849,17 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
-
     CAmount balance = 0;
     CAmount received = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    // the running totals of each address, not its activity
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressBalance addressBalance;
+        if (!GetAddressBalance((*it).first, (*it).second, addressBalance)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += addressBalance.balance;
+        received += addressBalance.received;
     }
 
     UniValue result(UniValue::VOBJ);
@@ -984,12 +1171,19 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids, and a cursor for the next ones\n"
+            "  \"cursor\" (string, optional) The cursor returned with the previous txids, to get the next ones\n"
             "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with a limit):\n"
+            "{\n"
+            "  \"txids\": [...]  (array) The txids, in chain order\n"
+            "  \"cursor\"  (string) The cursor of the next txids, null after the last ones\n"
+            "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'") + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}"));
 
@@ -1001,17 +1195,40 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
 
     int start = 0;
     int end = 0;
-    // if (request.params[0].isObject()) {
-    //     UniValue startValue = find_value(request.params[0].get_obj(), "start");
-    //     UniValue endValue = find_value(request.params[0].get_obj(), "end");
-    //     if (startValue.isNum() && endValue.isNum()) {
-    //         start = startValue.get_int();
-    //         end = endValue.get_int();
-    //     }
-    // }
+    if (request.params[0].isObject()) {
+        UniValue startValue = find_value(request.params[0].get_obj(), "start");
+        UniValue endValue = find_value(request.params[0].get_obj(), "end");
+        if (startValue.isNum() && endValue.isNum()) {
+            start = startValue.get_int();
+            end = endValue.get_int();
+        }
+    }
+
+    size_t nLimit;
+    CAddressIndexPosition after;
+    bool fAfter;
+    getPageFromParams(request.params, nLimit, after, fAfter);
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
+    if (nLimit > 0) {
+        UniValue cursor = getAddressIndexPage(addresses, start, end, fAfter ? &after : nullptr, nLimit, true, addressIndex);
+
+        // the entries of a transaction are next to each other
+        UniValue txids(UniValue::VARR);
+        for (size_t i = 0; i < addressIndex.size(); i++) {
+            if (i == 0 || addressIndex[i].first.txindex != addressIndex[i - 1].first.txindex ||
+                    addressIndex[i].first.blockHeight != addressIndex[i - 1].first.blockHeight) {
+                txids.push_back(addressIndex[i].first.txhash.GetHex());
+            }
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("txids", txids);
+        result.pushKV("cursor", cursor);
+        return result;
+    }
+
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
@@ -1314,6 +1531,237 @@ UniValue logging(const JSONRPCRequest& request)
     return result;
 }
 
+/** Resident set size of the process, 0 where it isn't known */
+static size_t GetProcessRSS()
+{
+#ifdef __linux__
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    unsigned long nPages = 0, nResident = 0;
+    const int nRead = fscanf(file, "%lu %lu", &nPages, &nResident);
+    fclose(file);
+    if (nRead == 2) return (size_t)nResident * sysconf(_SC_PAGESIZE);
+#endif
+    return 0;
+}
+
+UniValue getmemoryinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1) {
+        throw std::runtime_error(
+            "getmemoryinfo ( \"mode\" )\n"
+            "\nReturns the memory used by the process and, in detailed mode, by each subsystem.\n"
+            "The sizes of the subsystems are estimates of their heap usage, computed by walking\n"
+            "their containers: the detailed mode takes the lock of each subsystem in turn.\n"
+
+            "\nArguments:\n"
+            "1. \"mode\"    (string, optional, default=\"stats\") \"stats\" or \"detailed\"\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"rss\": n,                 (numeric) Resident set size of the process, in bytes (0 if unknown)\n"
+            "  \"subsystems\": {           (object, detailed mode only) Estimated memory usage, in bytes\n"
+            "    \"coinstip\": n,          (numeric) The UTXO cache\n"
+            "    \"mempool\": n,           (numeric) The transaction memory pool\n"
+            "    \"masternodes\": n,       (numeric) The masternode list, the seen broadcasts and pings\n"
+            "    \"mnpayments\": n,        (numeric) The masternode payment votes and block payees\n"
+            "    \"budget\": n,            (numeric) The budget proposals, finalized budgets and votes\n"
+            "    \"wallet\": n,            (numeric) The wallet transactions\n"
+            "    \"sapling_witnesses\": n, (numeric) The witnesses of the wallet Sapling notes\n"
+            "    \"addrman\": n,           (numeric) The address manager tables\n"
+            "    \"peers\": n              (numeric) The send queues and receive buffers of the peers\n"
+            "  },\n"
+            "  \"accounted\": n,           (numeric, detailed mode only) Sum of the subsystems\n"
+            "  \"unaccounted\": n          (numeric, detailed mode only) rss minus accounted (0 if rss is unknown)\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getmemoryinfo", "") + HelpExampleCli("getmemoryinfo", "\"detailed\"") + HelpExampleRpc("getmemoryinfo", "\"detailed\""));
+    }
+
+    const std::string strMode = request.params.size() > 0 ? request.params[0].get_str() : "stats";
+    if (strMode != "stats" && strMode != "detailed") {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "unknown mode " + strMode);
+    }
+
+    const size_t nRSS = GetProcessRSS();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("rss", (uint64_t)nRSS);
+    if (strMode == "stats") {
+        return obj;
+    }
+
+    std::vector<std::pair<std::string, size_t>> vUsage;
+    vUsage.emplace_back("coinstip", WITH_LOCK(cs_main, return pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0; ));
+    vUsage.emplace_back("mempool", mempool.DynamicMemoryUsage());
+    vUsage.emplace_back("masternodes", mnodeman.DynamicMemoryUsage());
+    vUsage.emplace_back("mnpayments", masternodePayments.DynamicMemoryUsage());
+    vUsage.emplace_back("budget", g_budgetman.DynamicMemoryUsage());
+    size_t nWalletUsage = 0, nWitnessesUsage = 0;
+#ifdef ENABLE_WALLET
+    if (pwalletMain) {
+        pwalletMain->GetMemoryUsage(nWalletUsage, nWitnessesUsage);
+    }
+#endif
+    vUsage.emplace_back("wallet", nWalletUsage);
+    vUsage.emplace_back("sapling_witnesses", nWitnessesUsage);
+    vUsage.emplace_back("addrman", g_connman ? g_connman->GetAddressUsage() : 0);
+    vUsage.emplace_back("peers", g_connman ? g_connman->GetNodeBuffersUsage() : 0);
+
+    UniValue subsystems(UniValue::VOBJ);
+    size_t nAccounted = 0;
+    for (const auto& it : vUsage) {
+        subsystems.pushKV(it.first, (uint64_t)it.second);
+        nAccounted += it.second;
+    }
+    obj.pushKV("subsystems", subsystems);
+    obj.pushKV("accounted", (uint64_t)nAccounted);
+    obj.pushKV("unaccounted", (uint64_t)(nRSS > nAccounted ? nRSS - nAccounted : 0));
+    return obj;
+}
+
+/** The counters of a call site, or of all the sites of a lock */
+static UniValue LockStatsToJSON(uint64_t nAcquired, uint64_t nContended, int64_t nWaitMicros, int64_t nHeldMicros)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("acquired", nAcquired);
+    obj.pushKV("contended", nContended);
+    obj.pushKV("wait_ms", nWaitMicros / 1000.0);
+    obj.pushKV("held_ms", nHeldMicros / 1000.0);
+    return obj;
+}
+
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 3) {
+        throw std::runtime_error(
+            "getlockstats ( enable reset count )\n"
+            "\nReturns how often the locks were acquired, waited for (contended), and how long they were waited for\n"
+            "and held, by call site of LOCK and by lock name, since the lock profiling was enabled.\n"
+            "The profiling is off by default. When on, it costs each lock two clock reads.\n"
+
+            "\nArguments:\n"
+            "1. enable     (boolean, optional) Turn the lock profiling on or off\n"
+            "2. reset      (boolean, optional, default=false) Set the counters to zero first\n"
+            "3. count      (numeric, optional, default=20) The number of call sites to return, the most waited for first\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,    (boolean) Whether the lock profiling is on\n"
+            "  \"locks\": {                (object) The sums of the call sites of each lock\n"
+            "    \"name\": {               (object) The lock, as it is named by LOCK, e.g. cs_main or pwallet->cs_wallet\n"
+            "      \"acquired\": n,        (numeric) Number of times it was locked\n"
+            "      \"contended\": n,       (numeric) Number of times it was held by another thread\n"
+            "      \"wait_ms\": x.xxx,     (numeric) Time spent waiting for it\n"
+            "      \"held_ms\": x.xxx      (numeric) Time it was held\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"sites\": [                (array) The call sites\n"
+            "    {\n"
+            "      \"lock\": \"name\",       (string) The lock\n"
+            "      \"site\": \"file:line\",  (string) The LOCK call\n"
+            "      \"acquired\": n, \"contended\": n, \"wait_ms\": x.xxx, \"held_ms\": x.xxx\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getlockstats", "true true") + HelpExampleCli("getlockstats", "") + HelpExampleRpc("getlockstats", "true, true, 50"));
+    }
+
+    if (request.params.size() > 1 && request.params[1].get_bool()) {
+        ResetLockSites();
+    }
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        SetLockProfiling(request.params[0].get_bool());
+    }
+    const int nCount = request.params.size() > 2 ? request.params[2].get_int() : 20;
+    if (nCount < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+
+    std::vector<const LockSiteStats*> vSites = GetLockSites();
+    std::sort(vSites.begin(), vSites.end(), [](const LockSiteStats* a, const LockSiteStats* b) {
+        return a->nWaitMicros.load() > b->nWaitMicros.load();
+    });
+
+    struct LockTotals {
+        uint64_t nAcquired{0};
+        uint64_t nContended{0};
+        int64_t nWaitMicros{0};
+        int64_t nHeldMicros{0};
+    };
+    std::map<std::string, LockTotals> mapLocks;
+    UniValue sites(UniValue::VARR);
+    for (const LockSiteStats* site : vSites) {
+        const uint64_t nAcquired = site->nAcquired;
+        if (nAcquired == 0)
+            continue;
+        const uint64_t nContended = site->nContended;
+        const int64_t nWaitMicros = site->nWaitMicros;
+        const int64_t nHeldMicros = site->nHeldMicros;
+        LockTotals& totals = mapLocks[site->pszName];
+        totals.nAcquired += nAcquired;
+        totals.nContended += nContended;
+        totals.nWaitMicros += nWaitMicros;
+        totals.nHeldMicros += nHeldMicros;
+        if ((int)sites.size() < nCount) {
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("lock", site->pszName);
+            obj.pushKV("site", strprintf("%s:%d", site->pszFile, site->nLine));
+            obj.pushKVs(LockStatsToJSON(nAcquired, nContended, nWaitMicros, nHeldMicros));
+            sites.push_back(obj);
+        }
+    }
+
+    UniValue locks(UniValue::VOBJ);
+    for (const auto& it : mapLocks) {
+        locks.pushKV(it.first, LockStatsToJSON(it.second.nAcquired, it.second.nContended, it.second.nWaitMicros, it.second.nHeldMicros));
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("enabled", g_lock_profiling.load());
+    ret.pushKV("locks", locks);
+    ret.pushKV("sites", sites);
+    return ret;
+}
+
+UniValue getvalidationqueueinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0) {
+        throw std::runtime_error(
+            "getvalidationqueueinfo\n"
+            "\nReturns the notification queue of each subscriber to the validation events (wallet, zmq, indexes...),\n"
+            "that has a thread of its own to deliver them, since it was registered.\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"name\",         (string) The subscriber\n"
+            "    \"pending\": n,            (numeric) Number of notifications queued and not handled yet\n"
+            "    \"peak_pending\": n,       (numeric) The most notifications that were pending at once\n"
+            "    \"delivered\": n,          (numeric) Number of notifications handled\n"
+            "    \"busy_ms\": x.xxx,        (numeric) Time spent handling them\n"
+            "    \"max_delay_ms\": x.xxx    (numeric) The longest a notification waited in the queue\n"
+            "  }, ...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getvalidationqueueinfo", "") + HelpExampleRpc("getvalidationqueueinfo", ""));
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const ValidationInterfaceQueueStats& stats : GetMainSignals().GetQueueStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", stats.strName);
+        obj.pushKV("pending", (uint64_t)stats.nPending);
+        obj.pushKV("peak_pending", (uint64_t)stats.nPeakPending);
+        obj.pushKV("delivered", stats.nDelivered);
+        obj.pushKV("busy_ms", stats.nBusyMicros / 1000.0);
+        obj.pushKV("max_delay_ms", stats.nMaxDelayMicros / 1000.0);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1323,6 +1771,9 @@ static const CRPCCommand commands[] =
     { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         true  },
     { "util",               "logging",                &logging,                true  },
+    { "util",               "getlockstats",           &getlockstats,           true  },
+    { "util",               "getmemoryinfo",          &getmemoryinfo,          true  },
+    { "util",               "getvalidationqueueinfo", &getvalidationqueueinfo, true  },
     { "util",               "verifymessage",          &verifymessage,          true  },
 
     /* Not shown in help */
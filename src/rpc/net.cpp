@@ -103,6 +103,23 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       \"addr\": n,             (numeric) The total bytes received aggregated by message type\n"
             "       ...\n"
             "    }\n"
+            "    \"recvbuffer\": n,           (numeric) The memory held by the buffers of the messages being received and waiting to be processed\n"
+            "    \"processtime_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The total time spent processing, in microseconds, aggregated by message type\n"
+            "       ...\n"
+            "    }\n"
+            "    \"msgssent_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The number of messages sent aggregated by message type\n"
+            "       ...\n"
+            "    }\n"
+            "    \"msgsrecv_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The number of messages received aggregated by message type\n"
+            "       ...\n"
+            "    }\n"
+            "    \"queuetime_per_msg\": {\n"
+            "       \"addr\": n,             (numeric) The total time waited from the receipt to the processing, in microseconds, aggregated by message type\n"
+            "       ...\n"
+            "    }\n"
             "  }\n"
             "  ,...\n"
             "]\n"
@@ -169,6 +186,35 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
         }
         obj.pushKV("bytesrecv_per_msg", recvPerMsgCmd);
 
+        UniValue timePerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapProcessTimePerMsgCmd) {
+            if (i.second > 0)
+                timePerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("processtime_per_msg", timePerMsgCmd);
+
+        UniValue sendMsgsPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapSendMsgsPerMsgCmd) {
+            if (i.second > 0)
+                sendMsgsPerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("msgssent_per_msg", sendMsgsPerMsgCmd);
+
+        UniValue recvMsgsPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapRecvMsgsPerMsgCmd) {
+            if (i.second > 0)
+                recvMsgsPerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("msgsrecv_per_msg", recvMsgsPerMsgCmd);
+
+        UniValue queueTimePerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i : stats.mapQueueTimePerMsgCmd) {
+            if (i.second > 0)
+                queueTimePerMsgCmd.pushKV(i.first, i.second);
+        }
+        obj.pushKV("queuetime_per_msg", queueTimePerMsgCmd);
+        obj.pushKV("recvbuffer", stats.nRecvBufferUsage);
+
         ret.push_back(obj);
     }
 
@@ -322,7 +368,24 @@ UniValue getnettotals(const JSONRPCRequest& request)
             "{\n"
             "  \"totalbytesrecv\": n,   (numeric) Total bytes received\n"
             "  \"totalbytessent\": n,   (numeric) Total bytes sent\n"
-            "  \"timemillis\": t        (numeric) Total cpu time\n"
+            "  \"timemillis\": t,       (numeric) Total cpu time\n"
+            "  \"uploadtarget\":\n"
+            "  {\n"
+            "    \"timeframe\": n,                   (numeric) Length of the measuring timeframe in seconds\n"
+            "    \"target\": n,                      (numeric) Target in bytes, 0 if unlimited\n"
+            "    \"target_reached\": true|false,     (boolean) True if the target has been reached\n"
+            "    \"bytes_left_in_cycle\": t,         (numeric) Bytes left before the target, 0 if unlimited\n"
+            "    \"time_left_in_cycle\": t,          (numeric) Seconds left in the current cycle\n"
+            "    \"classes\": {                      (json object) the upload of each traffic class\n"
+            "      \"historicalblocks\": {           (json object) also tiprelay, txrelay, tiertwo and other\n"
+            "        \"bytes\": n,                   (numeric) Bytes queued since the start\n"
+            "        \"bytes_in_cycle\": n,          (numeric) Bytes queued in the current cycle\n"
+            "        \"budget\": n,                  (numeric) Budget in bytes per cycle, 0 if unlimited\n"
+            "        \"budget_reached\": true|false  (boolean) True if the requests of this class are refused\n"
+            "      },\n"
+            "      ...\n"
+            "    }\n"
+            "  }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -335,9 +398,88 @@ UniValue getnettotals(const JSONRPCRequest& request)
     obj.pushKV("totalbytesrecv", g_connman->GetTotalBytesRecv());
     obj.pushKV("totalbytessent", g_connman->GetTotalBytesSent());
     obj.pushKV("timemillis", GetTimeMillis());
+
+    UniValue uploadTarget(UniValue::VOBJ);
+    uploadTarget.pushKV("timeframe", UPLOAD_CYCLE_TIMEFRAME);
+    uploadTarget.pushKV("target", g_connman->GetMaxUploadTarget());
+    uploadTarget.pushKV("target_reached", g_connman->UploadTargetReached());
+    uploadTarget.pushKV("bytes_left_in_cycle", g_connman->GetUploadTargetLeft());
+    uploadTarget.pushKV("time_left_in_cycle", g_connman->GetUploadCycleTimeLeft());
+    UniValue classes(UniValue::VOBJ);
+    const auto vStats = g_connman->GetUploadClassStats();
+    for (int i = 0; i < UPLOAD_CLASS_MAX; i++) {
+        const UploadClass uploadClass = static_cast<UploadClass>(i);
+        UniValue stats(UniValue::VOBJ);
+        stats.pushKV("bytes", vStats[i].nBytesTotal);
+        stats.pushKV("bytes_in_cycle", vStats[i].nBytesInCycle);
+        stats.pushKV("budget", vStats[i].nBudget);
+        stats.pushKV("budget_reached", g_connman->UploadBudgetReached(uploadClass));
+        classes.pushKV(GetUploadClassName(uploadClass), stats);
+    }
+    uploadTarget.pushKV("classes", classes);
+    obj.pushKV("uploadtarget", uploadTarget);
     return obj;
 }
 
+UniValue getnetmsgstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw std::runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns the statistics of the network messages of each type, over all the peers\n"
+            "since the start. The types without any message are left out.\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"type\": {                     (json object) the message type, e.g. \"inv\"\n"
+            "    \"msgssent\": n,              (numeric) Number of messages sent\n"
+            "    \"bytessent\": n,             (numeric) Bytes sent, headers included\n"
+            "    \"msgsprocessed\": n,         (numeric) Number of messages received and processed\n"
+            "    \"bytesprocessed\": n,        (numeric) Bytes received and processed, headers included\n"
+            "    \"processtime\": n,           (numeric) Total processing time, in microseconds\n"
+            "    \"maxprocesstime\": n,        (numeric) Longest processing time, in microseconds\n"
+            "    \"queuetime\": n,             (numeric) Total time waited from the receipt to the processing, in microseconds\n"
+            "    \"maxqueuetime\": n,          (numeric) Longest time waited, in microseconds\n"
+            "    \"processtime_histogram\": [  (array) number of messages processed in less than 1, 2, 4... microseconds,\n"
+            "      n,                          the last bucket being unbounded, trailing empty buckets left out\n"
+            "      ...\n"
+            "    ]\n"
+            "  },\n"
+            "  ...\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getnetmsgstats", "") + HelpExampleRpc("getnetmsgstats", ""));
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    UniValue ret(UniValue::VOBJ);
+    for (const mapMsgCmdStats::value_type& i : g_connman->GetMessageStats()) {
+        const CNetMsgStats& stats = i.second;
+        if (stats.nMsgsSent == 0 && stats.nMsgsProcessed == 0)
+            continue;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("msgssent", stats.nMsgsSent);
+        obj.pushKV("bytessent", stats.nBytesSent);
+        obj.pushKV("msgsprocessed", stats.nMsgsProcessed);
+        obj.pushKV("bytesprocessed", stats.nBytesProcessed);
+        obj.pushKV("processtime", stats.nProcessTime);
+        obj.pushKV("maxprocesstime", stats.nMaxProcessTime);
+        obj.pushKV("queuetime", stats.nQueueTime);
+        obj.pushKV("maxqueuetime", stats.nMaxQueueTime);
+        int nBuckets = MSG_PROCESS_TIME_BUCKETS;
+        while (nBuckets > 0 && stats.vProcessTimeHistogram[nBuckets - 1] == 0)
+            nBuckets--;
+        UniValue histogram(UniValue::VARR);
+        for (int n = 0; n < nBuckets; n++)
+            histogram.push_back(stats.vProcessTimeHistogram[n]);
+        obj.pushKV("processtime_histogram", histogram);
+        ret.pushKV(i.first, obj);
+    }
+    return ret;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -560,6 +702,7 @@ static const CRPCCommand commands[] =
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true  },
     { "network",            "getconnectioncount",     &getconnectioncount,     true  },
     { "network",            "getnettotals",           &getnettotals,           true  },
+    { "network",            "getnetmsgstats",         &getnetmsgstats,         true  },
     { "network",            "getpeerinfo",            &getpeerinfo,            true  },
     { "network",            "ping",                   &ping,                   true  },
     { "network",            "setban",                 &setban,                 true  },
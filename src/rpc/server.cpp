@@ -15,7 +15,9 @@
 #include "random.h"
 #include "sync.h"
 #include "guiinterface.h"
+#include "httpserver.h"
 #include "util.h"
+#include "util/parallel.h"
 #include "utilstrencodings.h"
 
 #ifdef ENABLE_WALLET
@@ -27,7 +29,9 @@
 
 #include <univalue.h>
 
+#include <functional>
 #include <memory> // for unique_ptr
+#include <set>
 
 static bool fRPCRunning = false;
 static bool fRPCInWarmup = true;
@@ -39,6 +43,92 @@ static RPCTimerInterface* timerInterface = NULL;
 /* Map of name to timer. */
 static std::map<std::string, std::unique_ptr<RPCTimerBase>> deadlineTimers;
 
+/** The durations of the calls go in buckets of powers of two microseconds, up to 2^31 (36 minutes) */
+static const int RPC_LATENCY_BUCKETS = 32;
+
+/* The calls of each command, their duration, their wait for locks held by
+ * other threads, the time they held cs_main and cs_wallet, and the size of
+ * their replies */
+struct RPCCommandStats {
+    uint64_t nCalls{0};
+    uint64_t nErrors{0};
+    int64_t nTimeMicros{0};
+    uint64_t nLockContended{0};
+    int64_t nLockWaitMicros{0};
+    int64_t nMainHeldMicros{0};
+    int64_t nWalletHeldMicros{0};
+    uint64_t nBytesOut{0};
+    uint64_t vLatencyBuckets[RPC_LATENCY_BUCKETS]{};
+
+    /** The upper bound, in milliseconds, of the bucket of the calls where the given fraction of them is reached */
+    double LatencyPercentileMillis(double fraction) const
+    {
+        const double nTarget = fraction * nCalls;
+        uint64_t nCount = 0;
+        for (int i = 0; i < RPC_LATENCY_BUCKETS; i++) {
+            nCount += vLatencyBuckets[i];
+            if (nCount > 0 && nCount >= nTarget)
+                return (double)((int64_t)1 << i) / 1000;
+        }
+        return (double)((int64_t)1 << (RPC_LATENCY_BUCKETS - 1)) / 1000;
+    }
+};
+static Mutex cs_rpcStats;
+static std::map<std::string, RPCCommandStats> mapRPCStats GUARDED_BY(cs_rpcStats);
+
+/** Adds the duration and the locking of a command to its stats, when it returns or throws */
+class RPCStatsRecorder
+{
+private:
+    const std::string& strMethod;
+    const int64_t nStart;
+    const LockContentionStats contentionStart;
+    bool fSucceeded{false};
+
+public:
+    explicit RPCStatsRecorder(const std::string& strMethodIn) :
+        strMethod(strMethodIn),
+        nStart(GetTimeMicros()),
+        contentionStart(GetThreadLockContention())
+    {
+        SetThreadLockHeldTracking(true);
+    }
+
+    /** The command returned a result; otherwise it counts as an error */
+    void Succeeded() { fSucceeded = true; }
+
+    ~RPCStatsRecorder()
+    {
+        SetThreadLockHeldTracking(false);
+        const LockContentionStats contention = GetThreadLockContention();
+        const int64_t nTime = GetTimeMicros() - nStart;
+        int nBucket = 0;
+        while (nBucket < RPC_LATENCY_BUCKETS - 1 && ((int64_t)1 << nBucket) < nTime)
+            nBucket++;
+        LogPrint(BCLog::RPC, "ThreadRPCServer method=%s %s in %.2fms\n", SanitizeString(strMethod), fSucceeded ? "done" : "failed", nTime * 0.001);
+        LOCK(cs_rpcStats);
+        RPCCommandStats& stats = mapRPCStats[strMethod];
+        stats.nCalls++;
+        if (!fSucceeded)
+            stats.nErrors++;
+        stats.nTimeMicros += nTime;
+        stats.vLatencyBuckets[nBucket]++;
+        stats.nLockContended += contention.nContended - contentionStart.nContended;
+        stats.nLockWaitMicros += contention.nWaitMicros - contentionStart.nWaitMicros;
+        stats.nMainHeldMicros += contention.nMainHeldMicros - contentionStart.nMainHeldMicros;
+        stats.nWalletHeldMicros += contention.nWalletHeldMicros - contentionStart.nWalletHeldMicros;
+    }
+};
+
+void RPCRecordReplySize(const std::string& strMethod, size_t nBytes)
+{
+    LOCK(cs_rpcStats);
+    // Only the commands that ran have stats
+    std::map<std::string, RPCCommandStats>::iterator it = mapRPCStats.find(strMethod);
+    if (it != mapRPCStats.end())
+        it->second.nBytesOut += nBytes;
+}
+
 static struct CRPCSignals
 {
     boost::signals2::signal<void ()> Started;
@@ -62,7 +152,7 @@ void RPCServer::OnPreCommand(std::function<void (const CRPCCommand&)> slot)
 }
 
 void RPCTypeCheck(const UniValue& params,
-                  const std::list<UniValue::VType>& typesExpected,
+                  const std::vector<UniValue::VType>& typesExpected,
                   bool fAllowNull)
 {
     unsigned int i = 0;
@@ -129,11 +219,12 @@ UniValue ValueFromAmount(const CAmount& amount)
             strprintf("%s%d.%08d", sign ? "-" : "", quotient, remainder));
 }
 
-uint256 ParseHashV(const UniValue& v, std::string strName)
+static const std::string strNoHex;
+
+uint256 ParseHashV(const UniValue& v, const std::string& strName)
 {
-    std::string strHex;
-    if (v.isStr())
-        strHex = v.get_str();
+    // The string of the argument is used in place
+    const std::string& strHex = v.isStr() ? v.get_str() : strNoHex;
     if (!IsHex(strHex)) // Note: IsHex("") is false
         throw JSONRPCError(RPC_INVALID_PARAMETER, strName + " must be hexadecimal string (not '" + strHex + "')");
     if (64 != strHex.length())
@@ -142,20 +233,18 @@ uint256 ParseHashV(const UniValue& v, std::string strName)
     result.SetHex(strHex);
     return result;
 }
-uint256 ParseHashO(const UniValue& o, std::string strKey)
+uint256 ParseHashO(const UniValue& o, const std::string& strKey)
 {
     return ParseHashV(find_value(o, strKey), strKey);
 }
-std::vector<unsigned char> ParseHexV(const UniValue& v, std::string strName)
+std::vector<unsigned char> ParseHexV(const UniValue& v, const std::string& strName)
 {
-    std::string strHex;
-    if (v.isStr())
-        strHex = v.get_str();
+    const std::string& strHex = v.isStr() ? v.get_str() : strNoHex;
     if (!IsHex(strHex))
         throw JSONRPCError(RPC_INVALID_PARAMETER, strName + " must be hexadecimal string (not '" + strHex + "')");
     return ParseHex(strHex);
 }
-std::vector<unsigned char> ParseHexO(const UniValue& o, std::string strKey)
+std::vector<unsigned char> ParseHexO(const UniValue& o, const std::string& strKey)
 {
     return ParseHexV(find_value(o, strKey), strKey);
 }
@@ -261,6 +350,162 @@ UniValue stop(const JSONRPCRequest& jsonRequest)
 }
 
 
+UniValue getrpcinfo(const JSONRPCRequest& jsonRequest)
+{
+    if (jsonRequest.fHelp || jsonRequest.params.size() > 0)
+        throw std::runtime_error(
+            "getrpcinfo\n"
+            "\nReturns the calls of each RPC command since the start, and how long they waited\n"
+            "for locks held by other threads (e.g. for cs_main, held by the block validation),\n"
+            "with the activity of the work queues of the HTTP server.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"commands\": {\n"
+            "    \"command\": {            (object) The stats of a command that has been called\n"
+            "      \"calls\": n,           (numeric) The number of calls\n"
+            "      \"errors\": n,          (numeric) The number of calls that returned an error\n"
+            "      \"time_ms\": n,         (numeric) The total duration of the calls, in milliseconds\n"
+            "      \"p50_ms\": x.xxx,      (numeric) The duration half of the calls stay within, in milliseconds\n"
+            "                              (rounded up to a power of two microseconds)\n"
+            "      \"p90_ms\": x.xxx,      (numeric) Same, for 90% of the calls\n"
+            "      \"p99_ms\": x.xxx,      (numeric) Same, for 99% of the calls\n"
+            "      \"lock_contentions\": n, (numeric) The number of times a call waited for a lock\n"
+            "      \"lock_wait_ms\": n,    (numeric) The total time the calls waited for locks, in milliseconds\n"
+            "      \"cs_main_held_ms\": n, (numeric) The total time the calls held cs_main, in milliseconds\n"
+            "      \"cs_wallet_held_ms\": n, (numeric) The total time the calls held cs_wallet, in milliseconds\n"
+            "      \"bytes_out\": n        (numeric) The total size of the replies\n"
+            "    }, ...\n"
+            "  },\n"
+            "  \"work_queues\": [        (array) The HTTP server work queues (JSON-RPC, REST, wallet)\n"
+            "    {\n"
+            "      \"name\": \"xxx\",       (string) The name of the queue\n"
+            "      \"threads\": n,         (numeric) The number of worker threads\n"
+            "      \"max_depth\": n,       (numeric) The most requests it takes, and as many priority requests\n"
+            "      \"depth\": n,           (numeric) The requests waiting now\n"
+            "      \"peak_depth\": n,      (numeric) The most requests that waited at once\n"
+            "      \"processed\": n,       (numeric) The number of requests handled\n"
+            "      \"rejected\": n,        (numeric) The number of requests refused, the queue being full\n"
+            "      \"avg_wait_ms\": x.xxx, (numeric) The average time a request waited in the queue, in milliseconds\n"
+            "      \"max_wait_ms\": x.xxx, (numeric) The longest time a request waited in the queue, in milliseconds\n"
+            "      \"avg_run_ms\": x.xxx   (numeric) The average time a request took to handle, in milliseconds\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getrpcinfo", "") + HelpExampleRpc("getrpcinfo", ""));
+
+    UniValue commands(UniValue::VOBJ);
+    {
+        LOCK(cs_rpcStats);
+        for (const auto& it : mapRPCStats) {
+            UniValue entry(UniValue::VOBJ);
+            const RPCCommandStats& stats = it.second;
+            entry.pushKV("calls", stats.nCalls);
+            entry.pushKV("errors", stats.nErrors);
+            entry.pushKV("time_ms", stats.nTimeMicros / 1000);
+            entry.pushKV("p50_ms", stats.LatencyPercentileMillis(0.5));
+            entry.pushKV("p90_ms", stats.LatencyPercentileMillis(0.9));
+            entry.pushKV("p99_ms", stats.LatencyPercentileMillis(0.99));
+            entry.pushKV("lock_contentions", stats.nLockContended);
+            entry.pushKV("lock_wait_ms", stats.nLockWaitMicros / 1000);
+            entry.pushKV("cs_main_held_ms", stats.nMainHeldMicros / 1000);
+            entry.pushKV("cs_wallet_held_ms", stats.nWalletHeldMicros / 1000);
+            entry.pushKV("bytes_out", stats.nBytesOut);
+            commands.pushKV(it.first, entry);
+        }
+    }
+    UniValue queues(UniValue::VARR);
+    for (const HTTPWorkQueueStats& stats : GetHTTPWorkQueueStats()) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("name", stats.name);
+        entry.pushKV("threads", stats.nThreads);
+        entry.pushKV("max_depth", (uint64_t)stats.nMaxDepth);
+        entry.pushKV("depth", (uint64_t)stats.nDepth);
+        entry.pushKV("peak_depth", (uint64_t)stats.nPeakDepth);
+        entry.pushKV("processed", stats.nProcessed);
+        entry.pushKV("rejected", stats.nRejected);
+        entry.pushKV("avg_wait_ms", stats.nProcessed ? stats.nWaitMicros / 1000.0 / stats.nProcessed : 0.0);
+        entry.pushKV("max_wait_ms", stats.nMaxWaitMicros / 1000.0);
+        entry.pushKV("avg_run_ms", stats.nProcessed ? stats.nRunMicros / 1000.0 / stats.nProcessed : 0.0);
+        queues.push_back(entry);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("commands", commands);
+    ret.pushKV("work_queues", queues);
+    return ret;
+}
+
+static std::string FormatPrometheusValue(double value)
+{
+    return strprintf("%.17g", value);
+}
+
+std::string GetRPCStatsPrometheus()
+{
+    // Formatted from a copy, without holding cs_rpcStats
+    std::map<std::string, RPCCommandStats> mapStats;
+    {
+        LOCK(cs_rpcStats);
+        mapStats = mapRPCStats;
+    }
+
+    std::string strOut;
+    // A counter of each command, in seconds or as is
+    auto commandCounter = [&strOut, &mapStats](const char* pszName, const char* pszHelp, const std::function<double(const RPCCommandStats&)>& value) {
+        strOut += strprintf("# HELP %s %s\n# TYPE %s counter\n", pszName, pszHelp, pszName);
+        for (const auto& it : mapStats) {
+            strOut += strprintf("%s{method=\"%s\"} %s\n", pszName, it.first, FormatPrometheusValue(value(it.second)));
+        }
+    };
+    commandCounter("dogecash_rpc_calls_total", "The calls of an RPC command",
+                   [](const RPCCommandStats& s) { return (double)s.nCalls; });
+    commandCounter("dogecash_rpc_errors_total", "The calls of an RPC command that returned an error",
+                   [](const RPCCommandStats& s) { return (double)s.nErrors; });
+    commandCounter("dogecash_rpc_lock_wait_seconds_total", "The time the calls of an RPC command waited for locks",
+                   [](const RPCCommandStats& s) { return s.nLockWaitMicros / 1e6; });
+    commandCounter("dogecash_rpc_cs_main_held_seconds_total", "The time the calls of an RPC command held cs_main",
+                   [](const RPCCommandStats& s) { return s.nMainHeldMicros / 1e6; });
+    commandCounter("dogecash_rpc_cs_wallet_held_seconds_total", "The time the calls of an RPC command held cs_wallet",
+                   [](const RPCCommandStats& s) { return s.nWalletHeldMicros / 1e6; });
+    commandCounter("dogecash_rpc_response_bytes_total", "The size of the replies of an RPC command",
+                   [](const RPCCommandStats& s) { return (double)s.nBytesOut; });
+
+    // The durations as a histogram, with cumulative buckets
+    strOut += "# HELP dogecash_rpc_duration_seconds The duration of the calls of an RPC command\n"
+              "# TYPE dogecash_rpc_duration_seconds histogram\n";
+    for (const auto& it : mapStats) {
+        const RPCCommandStats& stats = it.second;
+        uint64_t nCount = 0;
+        for (int i = 0; i < RPC_LATENCY_BUCKETS - 1; i++) {
+            nCount += stats.vLatencyBuckets[i];
+            strOut += strprintf("dogecash_rpc_duration_seconds_bucket{method=\"%s\",le=\"%s\"} %d\n",
+                                it.first, FormatPrometheusValue(((int64_t)1 << i) / 1e6), nCount);
+        }
+        strOut += strprintf("dogecash_rpc_duration_seconds_bucket{method=\"%s\",le=\"+Inf\"} %d\n", it.first, stats.nCalls);
+        strOut += strprintf("dogecash_rpc_duration_seconds_sum{method=\"%s\"} %s\n", it.first, FormatPrometheusValue(stats.nTimeMicros / 1e6));
+        strOut += strprintf("dogecash_rpc_duration_seconds_count{method=\"%s\"} %d\n", it.first, stats.nCalls);
+    }
+
+    const std::vector<HTTPWorkQueueStats> vQueueStats = GetHTTPWorkQueueStats();
+    auto queueMetric = [&strOut, &vQueueStats](const char* pszName, const char* pszType, const char* pszHelp, const std::function<double(const HTTPWorkQueueStats&)>& value) {
+        strOut += strprintf("# HELP %s %s\n# TYPE %s %s\n", pszName, pszHelp, pszName, pszType);
+        for (const HTTPWorkQueueStats& stats : vQueueStats) {
+            strOut += strprintf("%s{queue=\"%s\"} %s\n", pszName, stats.name, FormatPrometheusValue(value(stats)));
+        }
+    };
+    queueMetric("dogecash_http_queue_depth", "gauge", "The requests waiting in an HTTP work queue",
+                [](const HTTPWorkQueueStats& s) { return (double)s.nDepth; });
+    queueMetric("dogecash_http_queue_processed_total", "counter", "The requests handled by an HTTP work queue",
+                [](const HTTPWorkQueueStats& s) { return (double)s.nProcessed; });
+    queueMetric("dogecash_http_queue_rejected_total", "counter", "The requests refused by a full HTTP work queue",
+                [](const HTTPWorkQueueStats& s) { return (double)s.nRejected; });
+    queueMetric("dogecash_http_queue_wait_seconds_total", "counter", "The time the requests waited in an HTTP work queue",
+                [](const HTTPWorkQueueStats& s) { return s.nWaitMicros / 1e6; });
+    queueMetric("dogecash_http_queue_run_seconds_total", "counter", "The time the requests of an HTTP work queue took to handle",
+                [](const HTTPWorkQueueStats& s) { return s.nRunMicros / 1e6; });
+    return strOut;
+}
+
 /**
  * Call Table
  */
@@ -270,6 +515,7 @@ static const CRPCCommand vRPCCommands[] =
         //  --------------------- ------------------------  -----------------------  ----------
         /* Overall control/query calls */
 
+        {"control", "getrpcinfo", &getrpcinfo, true },
         {"control", "help", &help, true },
         {"control", "stop", &stop, true },
 };
@@ -355,7 +601,7 @@ bool RPCIsInWarmup(std::string* outStatus)
     return fRPCInWarmup;
 }
 
-void JSONRPCRequest::parse(const UniValue& valRequest)
+const UniValue& JSONRPCRequest::parseIdAndMethod(const UniValue& valRequest)
 {
     // Parse request
     if (!valRequest.isObject())
@@ -366,7 +612,7 @@ void JSONRPCRequest::parse(const UniValue& valRequest)
     id = find_value(request, "id");
 
     // Parse method
-    UniValue valMethod = find_value(request, "method");
+    const UniValue& valMethod = find_value(request, "method");
     if (valMethod.isNull())
         throw JSONRPCError(RPC_INVALID_REQUEST, "Missing method");
     if (!valMethod.isStr())
@@ -375,14 +621,32 @@ void JSONRPCRequest::parse(const UniValue& valRequest)
     if (strMethod != "getblocktemplate")
         LogPrint(BCLog::RPC, "ThreadRPCServer method=%s\n", SanitizeString(strMethod));
 
-    // Parse params
-    UniValue valParams = find_value(request, "params");
+    // The params, checked by the caller
+    const UniValue& valParams = find_value(request, "params");
+    if (!valParams.isArray() && !valParams.isNull())
+        throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
+    return valParams;
+}
+
+void JSONRPCRequest::parse(const UniValue& valRequest)
+{
+    const UniValue& valParams = parseIdAndMethod(valRequest);
     if (valParams.isArray())
-        params = valParams.get_array();
-    else if (valParams.isNull())
-        params = UniValue(UniValue::VARR);
+        params = valParams;
     else
-        throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
+        params = UniValue(UniValue::VARR);
+}
+
+void JSONRPCRequest::parse(UniValue&& valRequest)
+{
+    const UniValue& valParams = parseIdAndMethod(valRequest);
+    if (valParams.isArray()) {
+        // valParams is an element of valRequest (not the shared null value
+        // find_value returns for a missing key), which the caller gives up
+        params = std::move(const_cast<UniValue&>(valParams));
+    } else {
+        params = UniValue(UniValue::VARR);
+    }
 }
 
 bool IsDeprecatedRPCEnabled(const std::string& method)
@@ -392,11 +656,11 @@ bool IsDeprecatedRPCEnabled(const std::string& method)
     return find(enabled_methods.begin(), enabled_methods.end(), method) != enabled_methods.end();
 }
 
-static UniValue JSONRPCExecOne(const UniValue& req)
+/** The reply object of an entry of a batch, written */
+static std::string JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
 {
     UniValue rpc_result(UniValue::VOBJ);
 
-    JSONRPCRequest jreq;
     try {
         jreq.parse(req);
 
@@ -409,16 +673,70 @@ static UniValue JSONRPCExecOne(const UniValue& req)
             JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
     }
 
-    return rpc_result;
+    std::string strReply = rpc_result.write();
+    RPCRecordReplySize(jreq.strMethod, strReply.size());
+    return strReply;
+}
+
+/** Read-only commands that the entries of a batch may run at the same time */
+static const std::set<std::string> setBatchParallelCommands = {
+    "decoderawtransaction",
+    "decodescript",
+    "getaddressbalance",
+    "getaddressdeltas",
+    "getaddressmempool",
+    "getaddresstxids",
+    "getaddressutxos",
+    "getbestblockhash",
+    "getblock",
+    "getblockcount",
+    "getblockfilter",
+    "getblockhash",
+    "getblockhashes",
+    "getblockheader",
+    "getrawmempool",
+    "getrawtransaction",
+    "getspentinfo",
+    "gettxout",
+    "validateaddress",
+    "verifymessage",
+};
+
+static bool IsBatchParallel(const UniValue& req)
+{
+    if (!req.isObject()) return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    return method.isStr() && setBatchParallelCommands.count(method.get_str());
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    // The consecutive read-only entries run over up to -rpcthreads threads of
+    // the shared worker pool (the concurrent batches share its threads), any
+    // other entry runs alone, after the ones before it: the entries that
+    // depend on the effects of the previous ones see them as before.
+    const int nMaxThreads = std::max((int)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1);
+    std::vector<std::string> vResults(vReq.size());
+    size_t reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        size_t nEnd = reqIdx + 1;
+        if (IsBatchParallel(vReq[reqIdx])) {
+            while (nEnd < vReq.size() && IsBatchParallel(vReq[nEnd])) nEnd++;
+        }
+        ParallelForEach(nEnd - reqIdx, nMaxThreads, [&](size_t i) {
+            vResults[reqIdx + i] = JSONRPCExecOne(jreq, vReq[reqIdx + i]);
+        });
+        reqIdx = nEnd;
+    }
 
-    return ret.write() + "\n";
+    // The array of the written replies, as UniValue::write would write it
+    std::string strReply = "[";
+    for (size_t i = 0; i < vResults.size(); i++) {
+        if (i > 0)
+            strReply += ",";
+        strReply += vResults[i];
+    }
+    return strReply + "]\n";
 }
 
 UniValue CRPCTable::execute(const JSONRPCRequest &request) const
@@ -436,9 +754,15 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 
     g_rpcSignals.PreCommand(*pcmd);
 
+    RPCStatsRecorder statsRecorder(pcmd->name);
     try {
+        // Check the types of the arguments once, for the actor
+        pcmd->CheckArgTypes(request.params);
+
         // Execute
-        return pcmd->actor(request);
+        UniValue result = pcmd->actor(request);
+        statsRecorder.Succeeded();
+        return result;
     } catch (const std::exception& e) {
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
@@ -17,9 +17,12 @@
 #include <map>
 #include <stdint.h>
 #include <string>
+#include <vector>
 
 #include <univalue.h>
 
+class JSONStreamWriter;
+
 class CRPCCommand;
 
 namespace RPCServer
@@ -51,9 +54,16 @@ public:
     bool fHelp;
     std::string URI;
     std::string authUser;
+    /** When set, a command with a large result may write it here, and return null */
+    JSONStreamWriter* streamResult{nullptr};
 
     JSONRPCRequest() { id = NullUniValue; params = NullUniValue; fHelp = false; }
     void parse(const UniValue& valRequest);
+    /** Same as parse, moving the params out of the request instead of copying them */
+    void parse(UniValue&& valRequest);
+
+private:
+    const UniValue& parseIdAndMethod(const UniValue& valRequest);
 };
 
 /** Query whether RPC is running */
@@ -75,7 +85,7 @@ bool RPCIsInWarmup(std::string* statusOut);
  * the right number of arguments are passed, just that any passed are the correct type.
  */
 void RPCTypeCheck(const UniValue& params,
-                  const std::list<UniValue::VType>& typesExpected, bool fAllowNull=false);
+                  const std::vector<UniValue::VType>& typesExpected, bool fAllowNull=false);
 
 /**
  * Check for expected keys/value types in an Object.
@@ -131,10 +141,22 @@ typedef UniValue(*rpcfn_type)(const JSONRPCRequest& jsonRequest);
 class CRPCCommand
 {
 public:
+    CRPCCommand(std::string categoryIn, std::string nameIn, rpcfn_type actorIn, bool okSafeModeIn,
+                std::vector<UniValue::VType> argTypesIn = {}) :
+        category(std::move(categoryIn)), name(std::move(nameIn)), actor(actorIn), okSafeMode(okSafeModeIn),
+        argTypes(std::move(argTypesIn)) {}
+
     std::string category;
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    /** The types of the positional arguments, null allowed (the optional
+     * ones), checked by CRPCTable::execute before the actor runs, so that
+     * the actor reads them with the plain getters. Empty: not checked. */
+    std::vector<UniValue::VType> argTypes;
+
+    /** Throws the RPC_TYPE_ERROR of the first argument not of its type in argTypes */
+    void CheckArgTypes(const UniValue& params) const { RPCTypeCheck(params, argTypes, true); }
 };
 
 /**
@@ -180,10 +202,10 @@ extern CRPCTable tableRPC;
  * Utilities: convert hex-encoded Values
  * (throws error if not hex).
  */
-extern uint256 ParseHashV(const UniValue& v, std::string strName);
-extern uint256 ParseHashO(const UniValue& o, std::string strKey);
-extern std::vector<unsigned char> ParseHexV(const UniValue& v, std::string strName);
-extern std::vector<unsigned char> ParseHexO(const UniValue& o, std::string strKey);
+extern uint256 ParseHashV(const UniValue& v, const std::string& strName);
+extern uint256 ParseHashO(const UniValue& o, const std::string& strKey);
+extern std::vector<unsigned char> ParseHexV(const UniValue& v, const std::string& strName);
+extern std::vector<unsigned char> ParseHexO(const UniValue& o, const std::string& strKey);
 extern int ParseInt(const UniValue& o, std::string strKey);
 extern bool ParseBool(const UniValue& o, std::string strKey);
 
@@ -202,7 +224,12 @@ extern void EnsureWallet();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
-std::string JSONRPCExecBatch(const UniValue& vReq);
+/** Execute a batch of requests, with the URI and user of jreq. The results are in the order of the requests. */
+std::string JSONRPCExecBatch(const JSONRPCRequest& jreq, const UniValue& vReq);
+/** Adds the size of a reply to the stats of its command (getrpcinfo) */
+void RPCRecordReplySize(const std::string& strMethod, size_t nBytes);
+/** The stats of the RPC commands and of the HTTP work queues, in the Prometheus text format */
+std::string GetRPCStatsPrometheus();
 void RPCNotifyBlockChange(bool fInitialDownload, const CBlockIndex* pindex);
 
 #endif // BITCOIN_RPCSERVER_H
@@ -22,8 +22,8 @@ extern "C" {
 
     bool librustzcash_ivk_to_pkd(const unsigned char *ivk, const unsigned char *diversifier, unsigned char *result);
 
-    /// Loads the zk-SNARK parameters into memory and saves
-    /// paths as necessary. Only called once.
+    /// Checks the zk-SNARK parameter files, loads the verifying
+    /// keys into memory and saves paths as necessary. Only called once.
     void librustzcash_init_zksnark_params(
         const codeunit* spend_path,
         size_t spend_path_len,
@@ -36,6 +36,11 @@ extern "C" {
         const char* sprout_hash
     );
 
+    /// Loads the Sapling proving parameters into memory, from the
+    /// files checked by librustzcash_init_zksnark_params. Only called
+    /// once, before the first proof.
+    bool librustzcash_load_zksnark_proving_params();
+
     /// Validates the provided Equihash solution against
     /// the given parameters, input and nonce.
     bool librustzcash_eh_isvalid(
@@ -72,6 +77,19 @@ extern "C" {
         unsigned char *result
     );
 
+    /// Computes `n` merkle tree hashes for a given depth,
+    /// as librustzcash_merkle_hash does for one.
+    ///
+    /// `a`, `b` and `result` each must be of length
+    /// `n` * 32, holding the `n` consecutive nodes.
+    void librustzcash_merkle_hash_batch(
+        size_t depth,
+        size_t n,
+        const unsigned char *a,
+        const unsigned char *b,
+        unsigned char *result
+    );
+
     /// Computes the signature for each Spend description, given the key
     /// `ask`, the re-randomization `ar`, the 32-byte sighash `sighash`,
     /// and an output `result` buffer of 64-bytes for the signature.
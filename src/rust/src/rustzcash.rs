@@ -20,7 +20,8 @@ use zcash_proofs::circuit::sprout::{self, TREE_DEPTH as SPROUT_TREE_DEPTH};
 
 use bellman::gadgets::multipack;
 use bellman::groth16::{
-    create_random_proof, verify_proof, Parameters, PreparedVerifyingKey, Proof,
+    create_random_proof, prepare_verifying_key, verify_proof, Parameters, PreparedVerifyingKey,
+    Proof, VerifyingKey,
 };
 
 use blake2s_simd::Params as Blake2sParams;
@@ -28,7 +29,7 @@ use blake2s_simd::Params as Blake2sParams;
 use byteorder::{LittleEndian, ReadBytesExt, WriteBytesExt};
 
 use rand_core::{OsRng, RngCore};
-use std::io::BufReader;
+use std::io::{self, BufReader, Read};
 
 use libc::{c_char, c_uchar, size_t};
 use std::ffi::CStr;
@@ -56,10 +57,7 @@ use zcash_primitives::{
     transaction::components::Amount,
     zip32, JUBJUB,
 };
-use zcash_proofs::{
-    load_parameters,
-    sapling::{SaplingProvingContext, SaplingVerificationContext},
-};
+use zcash_proofs::sapling::{SaplingProvingContext, SaplingVerificationContext};
 
 #[cfg(test)]
 mod tests;
@@ -72,6 +70,77 @@ static mut SAPLING_SPEND_PARAMS: Option<Parameters<Bls12>> = None;
 static mut SAPLING_OUTPUT_PARAMS: Option<Parameters<Bls12>> = None;
 static mut SPROUT_GROTH16_PARAMS_PATH: Option<PathBuf> = None;
 
+/// The files of the proving parameters, with their hash, loaded on the
+/// first proof by librustzcash_load_zksnark_proving_params
+static mut SAPLING_SPEND_PARAMS_FILE: Option<(PathBuf, String)> = None;
+static mut SAPLING_OUTPUT_PARAMS_FILE: Option<(PathBuf, String)> = None;
+
+/// Hashes with BLAKE2b-512 what is read through it
+struct HashReader<R: Read> {
+    reader: R,
+    hasher: blake2b_simd::State,
+}
+
+impl<R: Read> HashReader<R> {
+    fn new(reader: R) -> Self {
+        HashReader {
+            reader,
+            hasher: blake2b_simd::State::new(),
+        }
+    }
+
+    /// Reads the rest of the stream, and returns the hash of all of it in hex
+    fn into_hash(mut self) -> io::Result<String> {
+        io::copy(&mut self, &mut io::sink())?;
+        Ok(self
+            .hasher
+            .finalize()
+            .as_bytes()
+            .iter()
+            .map(|b| format!("{:02x}", b))
+            .collect())
+    }
+}
+
+impl<R: Read> Read for HashReader<R> {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        let bytes = self.reader.read(buf)?;
+        if bytes > 0 {
+            self.hasher.update(&buf[0..bytes]);
+        }
+        Ok(bytes)
+    }
+}
+
+fn open_params_file(path: &Path) -> io::Result<HashReader<BufReader<File>>> {
+    Ok(HashReader::new(BufReader::with_capacity(
+        1024 * 1024,
+        File::open(path)?,
+    )))
+}
+
+/// Reads the verifying key at the start of a parameters file, and checks the
+/// hash of the whole file, without deserializing the proving key (most of it)
+fn read_verifying_key(path: &Path, hash: &str) -> PreparedVerifyingKey<Bls12> {
+    let mut reader = open_params_file(path).expect("couldn't open the parameters file");
+    let vk = VerifyingKey::<Bls12>::read(&mut reader).expect("couldn't deserialize the verifying key");
+    if reader.into_hash().expect("couldn't read the parameters file") != hash {
+        panic!("the hash of the parameters file {} is wrong", path.display());
+    }
+    prepare_verifying_key(&vk)
+}
+
+/// Reads the parameters of a file, that can have changed since the startup
+fn read_parameters(path: &Path, hash: &str) -> Option<Parameters<Bls12>> {
+    let mut reader = open_params_file(path).ok()?;
+    // The points are checked by the hash of the file
+    let params = Parameters::<Bls12>::read(&mut reader, false).ok()?;
+    if reader.into_hash().ok()? != hash {
+        return None;
+    }
+    Some(params)
+}
+
 /// Writes an FrRepr to [u8] of length 32
 fn write_le(f: FrRepr, to: &mut [u8]) {
     assert_eq!(to.len(), 32);
@@ -214,21 +283,17 @@ fn init_zksnark_params(
         )
     };
 
-    // Load params
-    let (spend_params, spend_vk, output_params, output_vk, sprout_vk) = load_parameters(
-        spend_path,
-        spend_hash,
-        output_path,
-        output_hash,
-        sprout_path,
-        sprout_hash,
-    );
+    // Load the verifying keys only: the proving parameters are only needed
+    // to create shielded transactions
+    let spend_vk = read_verifying_key(spend_path, spend_hash);
+    let output_vk = read_verifying_key(output_path, output_hash);
+    let sprout_vk = sprout_path.map(|p| read_verifying_key(p, sprout_hash.unwrap()));
 
     // Caller is responsible for calling this function once, so
     // these global mutations are safe.
     unsafe {
-        SAPLING_SPEND_PARAMS = Some(spend_params);
-        SAPLING_OUTPUT_PARAMS = Some(output_params);
+        SAPLING_SPEND_PARAMS_FILE = Some((spend_path.to_owned(), spend_hash.to_owned()));
+        SAPLING_OUTPUT_PARAMS_FILE = Some((output_path.to_owned(), output_hash.to_owned()));
         SPROUT_GROTH16_PARAMS_PATH = sprout_path.map(|p| p.to_owned());
 
         SAPLING_SPEND_VK = Some(spend_vk);
@@ -237,6 +302,31 @@ fn init_zksnark_params(
     }
 }
 
+#[no_mangle]
+pub extern "system" fn librustzcash_load_zksnark_proving_params() -> bool {
+    // Caller is responsible for calling this function once, after
+    // librustzcash_init_zksnark_params and before any proof
+    let (spend_file, output_file) = match unsafe {
+        (SAPLING_SPEND_PARAMS_FILE.as_ref(), SAPLING_OUTPUT_PARAMS_FILE.as_ref())
+    } {
+        (Some(spend_file), Some(output_file)) => (spend_file, output_file),
+        _ => return false,
+    };
+    let spend_params = match read_parameters(&spend_file.0, &spend_file.1) {
+        Some(p) => p,
+        None => return false,
+    };
+    let output_params = match read_parameters(&output_file.0, &output_file.1) {
+        Some(p) => p,
+        None => return false,
+    };
+    unsafe {
+        SAPLING_SPEND_PARAMS = Some(spend_params);
+        SAPLING_OUTPUT_PARAMS = Some(output_params);
+    }
+    true
+}
+
 #[no_mangle]
 pub extern "system" fn librustzcash_tree_uncommitted(result: *mut [c_uchar; 32]) {
     let tmp = Note::<Bls12>::uncommitted().into_repr();
@@ -274,6 +364,33 @@ pub extern "system" fn librustzcash_merkle_hash(
     write_le(tmp, &mut result[..]);
 }
 
+/// Computes `n` merkle tree hashes at the same depth: `a`, `b` and `result`
+/// each hold `n` consecutive 32-byte nodes, so that a whole tree level is
+/// hashed with a single call.
+#[no_mangle]
+pub extern "system" fn librustzcash_merkle_hash_batch(
+    depth: size_t,
+    n: size_t,
+    a: *const c_uchar,
+    b: *const c_uchar,
+    result: *mut c_uchar,
+) {
+    // Should be okay, caller is responsible for ensuring the pointers are
+    // valid pointers to n * 32 bytes, result being mutable.
+    let a = unsafe { slice::from_raw_parts(a, n * 32) };
+    let b = unsafe { slice::from_raw_parts(b, n * 32) };
+    let result = unsafe { slice::from_raw_parts_mut(result, n * 32) };
+
+    for ((a, b), result) in a
+        .chunks_exact(32)
+        .zip(b.chunks_exact(32))
+        .zip(result.chunks_exact_mut(32))
+    {
+        let tmp = merkle_hash(depth, &read_le(a), &read_le(b));
+        write_le(tmp, result);
+    }
+}
+
 #[no_mangle] // ToScalar
 pub extern "system" fn librustzcash_to_scalar(
     input: *const [c_uchar; 64],
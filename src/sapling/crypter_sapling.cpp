@@ -83,35 +83,16 @@ bool CCryptoKeyStore::HaveSaplingSpendingKey(const libzcash::SaplingExtendedFull
     return false;
 }
 
-bool CCryptoKeyStore::UnlockSaplingKeys(const CKeyingMaterial& vMasterKeyIn, bool fDecryptionThoroughlyChecked)
+bool CCryptoKeyStore::UnlockSaplingKeys(const CKeyingMaterial& vMasterKeyIn)
 {
     if (mapCryptedSaplingSpendingKeys.empty()) {
         LogPrintf("%s: mapCryptedSaplingSpendingKeys empty. No need to unlock anything.\n", __func__);
         return true;
     }
 
-    bool keyFail = false;
-    bool keyPass = false;
-    CryptedSaplingSpendingKeyMap::const_iterator miSapling = mapCryptedSaplingSpendingKeys.begin();
-    for (; miSapling != mapCryptedSaplingSpendingKeys.end(); ++miSapling) {
-        const libzcash::SaplingExtendedFullViewingKey &extfvk = (*miSapling).first;
-        const std::vector<unsigned char> &vchCryptedSecret = (*miSapling).second;
-        libzcash::SaplingExtendedSpendingKey sk;
-        if (!DecryptSaplingSpendingKey(vMasterKeyIn, vchCryptedSecret, extfvk, sk)) {
-            keyFail = true;
-            break;
-        }
-        keyPass = true;
-        if (fDecryptionThoroughlyChecked)
-            break;
-    }
-
-    if (keyPass && keyFail) {
-        LogPrintf("Sapling wallet is probably corrupted: Some keys decrypt but not all.");
-        throw std::runtime_error("Error unlocking sapling wallet: some keys decrypt but not all. Your wallet file may be corrupt.");
-    }
-    if (keyFail || !keyPass)
-        return false;
-
-    return true;
+    // One key is enough to check the master key: DecryptSaplingSpendingKey
+    // checks each of the others against its viewing key when it is used.
+    const auto& entry = *mapCryptedSaplingSpendingKeys.begin();
+    libzcash::SaplingExtendedSpendingKey sk;
+    return DecryptSaplingSpendingKey(vMasterKeyIn, entry.second, entry.first, sk);
 }
@@ -6,6 +6,7 @@
 // file COPYING or https://www.opensource.org/licenses/mit-license.php.
 
 #include <stdexcept>
+#include <string.h>
 
 #include "crypto/sha256.h"
 #include "sapling/incrementalmerkletree.h"
@@ -31,6 +32,33 @@ PedersenHash PedersenHash::combine(
     return res;
 }
 
+std::vector<PedersenHash> PedersenHash::combine_batch(
+    const std::vector<PedersenHash>& a,
+    const std::vector<PedersenHash>& b,
+    size_t depth
+)
+{
+    assert(a.size() == b.size());
+    const size_t n = a.size();
+    if (n == 0) {
+        return {};
+    }
+    std::vector<unsigned char> vA(n * 32), vB(n * 32), vRes(n * 32);
+    for (size_t i = 0; i < n; i++) {
+        memcpy(vA.data() + i * 32, a[i].begin(), 32);
+        memcpy(vB.data() + i * 32, b[i].begin(), 32);
+    }
+
+    // A single crossing of the FFI boundary for the whole batch
+    librustzcash_merkle_hash_batch(depth, n, vA.data(), vB.data(), vRes.data());
+
+    std::vector<PedersenHash> res(n);
+    for (size_t i = 0; i < n; i++) {
+        memcpy(res[i].begin(), vRes.data() + i * 32, 32);
+    }
+    return res;
+}
+
 PedersenHash PedersenHash::uncommitted() {
     PedersenHash res = PedersenHash();
 
@@ -440,6 +468,21 @@ SHA256Compress SHA256Compress::combine(
     return res;
 }
 
+std::vector<SHA256Compress> SHA256Compress::combine_batch(
+    const std::vector<SHA256Compress>& a,
+    const std::vector<SHA256Compress>& b,
+    size_t depth
+)
+{
+    assert(a.size() == b.size());
+    std::vector<SHA256Compress> res;
+    res.reserve(a.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        res.emplace_back(combine(a[i], b[i], depth));
+    }
+    return res;
+}
+
 static const std::array<SHA256Compress, 66> sha256_empty_roots = {
     uint256(std::vector<unsigned char>{
         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -926,6 +969,7 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
         throw std::runtime_error("tree is full");
     }
 
+    cachedRoot = boost::none;
     if (!left) {
         // Set the left leaf
         left = obj;
@@ -957,6 +1001,67 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalMerkleTree<Depth, Hash>::append(const std::vector<Hash>& objs) {
+    if (objs.empty()) {
+        return;
+    }
+    if ((uint64_t) size() + objs.size() > ((uint64_t) 1 << Depth)) {
+        throw std::runtime_error("tree is full");
+    }
+
+    cachedRoot = boost::none;
+
+    // The leaves: all of them but the last one (or two, when their
+    // number is even) are combined in pairs.
+    std::vector<Hash> nodes;
+    nodes.reserve(objs.size() + 2);
+    if (left) nodes.emplace_back(*left);
+    if (right) nodes.emplace_back(*right);
+    nodes.insert(nodes.end(), objs.begin(), objs.end());
+
+    const size_t nPairs = (nodes.size() - 1) / 2;
+    std::vector<Hash> vA, vB;
+    vA.reserve(nPairs);
+    vB.reserve(nPairs);
+    for (size_t i = 0; i < nPairs; i++) {
+        vA.emplace_back(nodes[2 * i]);
+        vB.emplace_back(nodes[2 * i + 1]);
+    }
+    if (nodes.size() % 2 == 0) {
+        left = nodes[nodes.size() - 2];
+        right = nodes.back();
+    } else {
+        left = nodes.back();
+        right = boost::none;
+    }
+    std::vector<Hash> combined = nPairs ? Hash::combine_batch(vA, vB, 0) : std::vector<Hash>();
+
+    // Then each level of parents: the pending left subtree, if any,
+    // followed by the subtrees just completed below, combined in pairs.
+    for (size_t i = 0; !combined.empty(); i++) {
+        if (i >= parents.size()) {
+            parents.push_back(boost::none);
+        }
+        nodes.clear();
+        if (parents[i]) nodes.emplace_back(*parents[i]);
+        nodes.insert(nodes.end(), combined.begin(), combined.end());
+
+        vA.clear();
+        vB.clear();
+        for (size_t j = 0; j + 1 < nodes.size(); j += 2) {
+            vA.emplace_back(nodes[j]);
+            vB.emplace_back(nodes[j + 1]);
+        }
+        if (nodes.size() % 2 == 1) {
+            parents[i] = nodes.back();
+        } else {
+            parents[i] = boost::none;
+        }
+        combined = vA.empty() ? std::vector<Hash>() : Hash::combine_batch(vA, vB, i + 1);
+    }
+}
+
 // This is for allowing the witness to determine if a subtree has filled
 // to a particular depth, or for append() to ensure we're not appending
 // to a full tree.
@@ -1139,6 +1244,29 @@ void IncrementalWitness<Depth, Hash>::append(Hash obj) {
     }
 }
 
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::append(const std::vector<Hash>& objs) {
+    size_t i = 0;
+    while (i < objs.size()) {
+        if (!cursor) {
+            // Fills a leaf, or starts a new cursor
+            append(objs[i++]);
+            continue;
+        }
+
+        // Fill the cursor, at most up to its completion, in a single batch
+        const uint64_t nRoom = ((uint64_t) 1 << cursor_depth) - cursor->size();
+        const size_t n = (size_t) std::min<uint64_t>(objs.size() - i, nRoom);
+        cursor->append(std::vector<Hash>(objs.begin() + i, objs.begin() + i + n));
+        i += n;
+
+        if (cursor->is_complete(cursor_depth)) {
+            filled.push_back(cursor->root(cursor_depth));
+            cursor = boost::none;
+        }
+    }
+}
+
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
 
@@ -17,6 +17,7 @@
 
 #include <array>
 #include <deque>
+#include <vector>
 
 namespace libzcash {
 
@@ -103,8 +104,13 @@ public:
     size_t size() const;
 
     void append(Hash obj);
+    // Same as appending the objects one by one, hashing each level of the
+    // tree with a single Hash::combine_batch call
+    void append(const std::vector<Hash>& objs);
     Hash root() const {
-        return root(Depth, std::deque<Hash>());
+        // Memoized until the next append: each root costs a hash per level
+        if (!cachedRoot) cachedRoot = root(Depth, std::deque<Hash>());
+        return *cachedRoot;
     }
     Hash last() const;
 
@@ -120,6 +126,7 @@ public:
         READWRITE(left);
         READWRITE(right);
         READWRITE(parents);
+        if (ser_action.ForRead()) cachedRoot = boost::none;
 
         wfcheck();
     }
@@ -139,6 +146,8 @@ private:
 
     // Collapsed "left" subtrees ordered toward the root of the tree.
     std::vector<Optional<Hash>> parents;
+    // Root of the tree, computed at the first root() call (not serialized)
+    mutable Optional<Hash> cachedRoot;
     MerklePath path(std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
     Hash root(size_t depth, std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
     bool is_complete(size_t depth = Depth) const;
@@ -177,11 +186,20 @@ public:
         return tree.size() - 1;
     }
 
+    size_t DynamicMemoryUsage() const {
+        return tree.DynamicMemoryUsage() +
+               filled.size() * 32 + // filled
+               (cursor ? cursor->DynamicMemoryUsage() : 0); // cursor
+    }
+
     Hash root() const {
         return tree.root(Depth, partial_path());
     }
 
     void append(Hash obj);
+    // Same as appending the objects one by one, the cursor being
+    // filled by batches
+    void append(const std::vector<Hash>& objs);
 
     ADD_SERIALIZE_METHODS;
 
@@ -227,6 +245,12 @@ public:
         const SHA256Compress& b,
         size_t depth
     );
+    // Combines a[i] with b[i], for every i, at the same depth
+    static std::vector<SHA256Compress> combine_batch(
+        const std::vector<SHA256Compress>& a,
+        const std::vector<SHA256Compress>& b,
+        size_t depth
+    );
 
     static SHA256Compress uncommitted() {
         return SHA256Compress();
@@ -244,6 +268,12 @@ public:
         const PedersenHash& b,
         size_t depth
     );
+    // Combines a[i] with b[i], for every i, at the same depth
+    static std::vector<PedersenHash> combine_batch(
+        const std::vector<PedersenHash>& a,
+        const std::vector<PedersenHash>& b,
+        size_t depth
+    );
 
     static PedersenHash uncommitted();
     static PedersenHash EmptyRoot(size_t);
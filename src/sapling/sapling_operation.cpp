@@ -65,7 +65,7 @@ TxValues calculateTarget(const std::vector<SendManyRecipient>& recipients, const
     return txValues;
 }
 
-OperationResult SaplingOperation::build()
+OperationResult SaplingOperation::prepare()
 {
     bool isFromtAddress = false;
     bool isFromShielded = false;
@@ -214,7 +214,11 @@ OperationResult SaplingOperation::build()
     }
     // Done
     fee = nFeeRet;
+    return OperationResult(true);
+}
 
+OperationResult SaplingOperation::prove()
+{
     // Clear dummy signatures/proofs and add real ones
     txBuilder.ClearProofsAndSignatures();
     TransactionBuilderResult txResult = txBuilder.ProveAndSign();
@@ -227,9 +231,46 @@ OperationResult SaplingOperation::build()
     return OperationResult(true);
 }
 
+OperationResult SaplingOperation::build()
+{
+    OperationResult res = prepare();
+    return (res) ? prove() : res;
+}
+
+void SaplingOperation::lockInputs()
+{
+    AssertLockHeld(pwalletMain->cs_wallet);
+    for (const COutput& t : transInputs) {
+        lockedCoins.emplace_back(t.tx->GetHash(), t.i);
+        pwalletMain->LockCoin(lockedCoins.back());
+    }
+    for (const SaplingOutPoint& op : selectedNotes) {
+        lockedNotes.emplace_back(op);
+        pwalletMain->LockNote(op);
+    }
+}
+
+void SaplingOperation::unlockInputs()
+{
+    AssertLockHeld(pwalletMain->cs_wallet);
+    for (const COutPoint& out : lockedCoins) {
+        pwalletMain->UnlockCoin(out);
+    }
+    for (const SaplingOutPoint& op : lockedNotes) {
+        pwalletMain->UnlockNote(op);
+    }
+    lockedCoins.clear();
+    lockedNotes.clear();
+}
+
 OperationResult SaplingOperation::send(std::string& retTxHash)
 {
     const CWallet::CommitResult& res = pwalletMain->CommitTransaction(finalTx, tkeyChange, g_connman.get());
+    if (!lockedCoins.empty() || !lockedNotes.empty()) {
+        // committed (and marked as spent) or failed, release them either way
+        LOCK(pwalletMain->cs_wallet);
+        unlockInputs();
+    }
     if (res.status != CWallet::CommitStatus::OK) {
         return errorOut(res.ToString());
     }
@@ -378,7 +419,7 @@ static CacheCheckResult CheckCachedNote(const SaplingNoteEntry& t, const libzcas
         // re-check the spent status
         if (sspkm->IsSaplingSpent(*(nd.nullifier))) {
             LogPrintf("Removed note %s as it appears to be already spent.\n", noteStr);
-            prevTx.MarkDirty();
+            prevTx.MarkSpendsDirty(ISMINE_SHIELDED_ALL);
             CWalletDB(pwalletMain->GetDBHandle(), "r+").WriteTx(prevTx);
             pwalletMain->NotifyTransactionChanged(pwalletMain, t.op.hash, CT_UPDATED);
             return CacheCheckResult::SPENT;
@@ -390,6 +431,7 @@ static CacheCheckResult CheckCachedNote(const SaplingNoteEntry& t, const libzcas
 OperationResult SaplingOperation::loadUnspentNotes(TxValues& txValues, uint256& ovk)
 {
     shieldedInputs.clear();
+    selectedNotes.clear();
     auto sspkm = pwalletMain->GetSaplingScriptPubKeyMan();
     // if we already have selected the notes, let's directly set them.
     bool hasCoinControl = coinControl && coinControl->HasSelected();
@@ -484,6 +526,7 @@ OperationResult SaplingOperation::loadUnspentNotes(TxValues& txValues, uint256&
     uint256 anchor;
     std::vector<boost::optional<SaplingWitness>> witnesses;
     pwalletMain->GetSaplingScriptPubKeyMan()->GetSaplingNoteWitnesses(ops, witnesses, anchor);
+    selectedNotes = ops;
 
     // Add Sapling spends
     for (size_t i = 0; i < notes.size(); i++) {
@@ -88,6 +88,10 @@ public:
 
     ~SaplingOperation() { delete tkeyChange; }
 
+    // Select the inputs and compute the fee, with dummy proofs and signatures (requires cs_main and cs_wallet)
+    OperationResult prepare();
+    // Replace the dummy proofs and signatures of a prepared transaction with the real ones (no lock required)
+    OperationResult prove();
     OperationResult build();
     OperationResult send(std::string& retTxHash);
     OperationResult buildAndSend(std::string& retTxHash);
@@ -95,6 +99,10 @@ public:
     void setFromAddress(const CTxDestination&);
     void setFromAddress(const libzcash::SaplingPaymentAddress&);
     void clearTx() { txBuilder.Clear(); }
+    // Lock the selected coins and notes in the wallet, so that other operations don't spend them
+    // while this one is proved without the wallet lock. send() unlocks them. (Require cs_wallet)
+    void lockInputs();
+    void unlockInputs();
     // In case of no addressFrom filter selected, it will accept any utxo in the wallet as input.
     SaplingOperation* setSelectTransparentCoins(const bool select, const bool _fIncludeDelegated = false);
     SaplingOperation* setSelectShieldedCoins(const bool select) { selectFromShield = select; return this; };
@@ -119,6 +127,10 @@ private:
     std::vector<SendManyRecipient> recipients;
     std::vector<COutput> transInputs;
     std::vector<SaplingNoteEntry> shieldedInputs;
+    std::vector<SaplingOutPoint> selectedNotes;
+    // inputs locked in the wallet by lockInputs()
+    std::vector<COutPoint> lockedCoins;
+    std::vector<SaplingOutPoint> lockedNotes;
     int mindepth{5}; // Min default depth 5.
     CAmount fee{0};  // User selected fee.
 
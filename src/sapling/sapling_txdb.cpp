@@ -11,7 +11,30 @@ static const char DB_SAPLING_ANCHOR = 'Z';
 static const char DB_SAPLING_NULLIFIER = 'S';
 static const char DB_BEST_SAPLING_ANCHOR = 'z';
 
+// Number of commitment trees kept in memory by CCoinsViewDB
+static const size_t MAX_SAPLING_ANCHORS_CACHE = 128;
+// Minimum number of nullifiers, and false positive rate, of the nullifiers filter
+static const size_t MIN_NULLIFIERS_FILTER_ELEMENTS = 100000;
+static const double NULLIFIERS_FILTER_FP_RATE = 0.001;
+
 // Sapling
+void CCoinsViewDB::CacheSaplingAnchor(const uint256& rt, const SaplingMerkleTree& tree) const
+{
+    AssertLockHeld(cs_saplingAnchorsCache);
+    auto it = mapSaplingAnchorsCache.find(rt);
+    if (it != mapSaplingAnchorsCache.end()) {
+        it->second->second = tree;
+        lruSaplingAnchors.splice(lruSaplingAnchors.begin(), lruSaplingAnchors, it->second);
+        return;
+    }
+    lruSaplingAnchors.emplace_front(rt, tree);
+    mapSaplingAnchorsCache.emplace(rt, lruSaplingAnchors.begin());
+    if (lruSaplingAnchors.size() > MAX_SAPLING_ANCHORS_CACHE) {
+        mapSaplingAnchorsCache.erase(lruSaplingAnchors.back().first);
+        lruSaplingAnchors.pop_back();
+    }
+}
+
 bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const {
     if (rt == SaplingMerkleTree::empty_root()) {
         SaplingMerkleTree new_tree;
@@ -19,12 +42,48 @@ bool CCoinsViewDB::GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree
         return true;
     }
 
+    LOCK(cs_saplingAnchorsCache);
+    auto it = mapSaplingAnchorsCache.find(rt);
+    if (it != mapSaplingAnchorsCache.end()) {
+        tree = it->second->second;
+        lruSaplingAnchors.splice(lruSaplingAnchors.begin(), lruSaplingAnchors, it->second);
+        return true;
+    }
+
     bool read = db.Read(std::make_pair(DB_SAPLING_ANCHOR, rt), tree);
+    if (read) CacheSaplingAnchor(rt, tree);
 
     return read;
 }
 
+void CCoinsViewDB::LoadNullifiersFilter(size_t nMinElements) const
+{
+    AssertLockHeld(cs_nullifiersFilter);
+    std::vector<uint256> vNullifiers;
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    std::pair<char, uint256> key;
+    for (pcursor->Seek(DB_SAPLING_NULLIFIER); pcursor->Valid(); pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_SAPLING_NULLIFIER)
+            break;
+        vNullifiers.emplace_back(key.second);
+    }
+
+    // Room for twice as many, before the next build
+    const size_t nElements = std::max(MIN_NULLIFIERS_FILTER_ELEMENTS, 2 * std::max(nMinElements, vNullifiers.size()));
+    pNullifiersFilter.reset(new CHashBloomFilter(nElements, NULLIFIERS_FILTER_FP_RATE));
+    for (const uint256& nf : vNullifiers) {
+        pNullifiersFilter->insert(nf);
+    }
+    LogPrint(BCLog::COINDB, "%s: %u sapling nullifiers loaded (filter of %u)\n", __func__, vNullifiers.size(), nElements);
+}
+
 bool CCoinsViewDB::GetNullifier(const uint256 &nf) const {
+    {
+        LOCK(cs_nullifiersFilter);
+        if (!pNullifiersFilter) LoadNullifiersFilter(0);
+        // Never inserted: not in the database either
+        if (!pNullifiersFilter->contains(nf)) return false;
+    }
     bool spent = false;
     return db.Read(std::make_pair(DB_SAPLING_NULLIFIER, nf), spent);
 }
@@ -36,11 +95,32 @@ uint256 CCoinsViewDB::GetBestAnchor() const {
     return hashBestAnchor;
 }
 
-void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char& dbChar)
+bool CCoinsViewDB::GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const
+{
+    // There are no "const iterators" for LevelDB, and we only need read operations
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(db).NewIterator());
+    std::pair<char, uint256> key;
+    for (pcursor->Seek(DB_SAPLING_ANCHOR); pcursor->Valid(); pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_SAPLING_ANCHOR)
+            break;
+        SaplingMerkleTree tree;
+        if (!pcursor->GetValue(tree))
+            return error("%s: unable to read anchor %s", __func__, key.second.ToString());
+        vAnchors.emplace_back(key.second, tree);
+    }
+    for (pcursor->Seek(DB_SAPLING_NULLIFIER); pcursor->Valid(); pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_SAPLING_NULLIFIER)
+            break;
+        vNullifiers.emplace_back(key.second);
+    }
+    return true;
+}
+
+void BatchWriteNullifiers(CDBBatch& batch, const CNullifiersMap& mapToUse, const char& dbChar)
 {
     size_t count = 0;
     size_t changed = 0;
-    for (CNullifiersMap::iterator it = mapToUse.begin(); it != mapToUse.end();) {
+    for (CNullifiersMap::const_iterator it = mapToUse.begin(); it != mapToUse.end(); ++it) {
         if (it->second.flags & CNullifiersCacheEntry::DIRTY) {
             if (!it->second.entered)
                 batch.Erase(std::make_pair(dbChar, it->first));
@@ -49,18 +129,16 @@ void BatchWriteNullifiers(CDBBatch& batch, CNullifiersMap& mapToUse, const char&
             changed++;
         }
         count++;
-        CNullifiersMap::iterator itOld = it++;
-        mapToUse.erase(itOld);
     }
     LogPrint(BCLog::COINDB, "Committed %u changed nullifiers (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
 }
 
 template<typename Map, typename MapIterator, typename MapEntry, typename Tree>
-void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
+void BatchWriteAnchors(CDBBatch& batch, const Map& mapToUse, const char& dbChar)
 {
     size_t count = 0;
     size_t changed = 0;
-    for (MapIterator it = mapToUse.begin(); it != mapToUse.end();) {
+    for (MapIterator it = mapToUse.begin(); it != mapToUse.end(); ++it) {
         if (it->second.flags & MapEntry::DIRTY) {
             if (!it->second.entered)
                 batch.Erase(std::make_pair(dbChar, it->first));
@@ -72,19 +150,49 @@ void BatchWriteAnchors(CDBBatch& batch, Map& mapToUse, const char& dbChar)
             changed++;
         }
         count++;
-        MapIterator itOld = it++;
-        mapToUse.erase(itOld);
     }
     LogPrint(BCLog::COINDB, "Committed %u changed sapling anchors (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
 }
 
 bool CCoinsViewDB::BatchWriteSapling(const uint256& hashSaplingAnchor,
-                              CAnchorsSaplingMap& mapSaplingAnchors,
-                              CNullifiersMap& mapSaplingNullifiers,
+                              const CAnchorsSaplingMap& mapSaplingAnchors,
+                              const CNullifiersMap& mapSaplingNullifiers,
                               CDBBatch& batch) {
 
-    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
+    ::BatchWriteAnchors<CAnchorsSaplingMap, CAnchorsSaplingMap::const_iterator, CAnchorsSaplingCacheEntry, SaplingMerkleTree>(batch, mapSaplingAnchors, DB_SAPLING_ANCHOR);
+    {
+        // Keep the in-memory trees in line with the batch: the new anchors are the most likely to be used next
+        LOCK(cs_saplingAnchorsCache);
+        for (const auto& it : mapSaplingAnchors) {
+            if (!(it.second.flags & CAnchorsSaplingCacheEntry::DIRTY) || it.first == SaplingMerkleTree::empty_root()) continue;
+            if (it.second.entered) {
+                CacheSaplingAnchor(it.first, it.second.tree);
+            } else {
+                auto cit = mapSaplingAnchorsCache.find(it.first);
+                if (cit != mapSaplingAnchorsCache.end()) {
+                    lruSaplingAnchors.erase(cit->second);
+                    mapSaplingAnchorsCache.erase(cit);
+                }
+            }
+        }
+    }
     ::BatchWriteNullifiers(batch, mapSaplingNullifiers, DB_SAPLING_NULLIFIER);
+    {
+        // Add the new nullifiers to the filter before they reach the database, so that it
+        // never misses one. The erased ones stay in, as false positives, until the next build.
+        LOCK(cs_nullifiersFilter);
+        std::vector<uint256> vNew;
+        for (const auto& it : mapSaplingNullifiers) {
+            if ((it.second.flags & CNullifiersCacheEntry::DIRTY) && it.second.entered) vNew.emplace_back(it.first);
+        }
+        if (!pNullifiersFilter || pNullifiersFilter->size() + vNew.size() > pNullifiersFilter->capacity()) {
+            // Built from the database, without this batch
+            LoadNullifiersFilter(pNullifiersFilter ? pNullifiersFilter->size() + vNew.size() : 0);
+        }
+        for (const uint256& nf : vNew) {
+            pNullifiersFilter->insert(nf);
+        }
+    }
     if (!hashSaplingAnchor.IsNull())
         batch.Write(DB_BEST_SAPLING_ANCHOR, hashSaplingAnchor);
     return true;
@@ -12,6 +12,7 @@
 #include "consensus/validation.h" // for CValidationState
 #include "util.h" // for error()
 #include "consensus/upgrades.h" // for CurrentEpochBranchId()
+#include "primitives/block.h"
 
 #include <librustzcash.h>
 
@@ -105,6 +106,87 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
     return true;
 }
 
+bool ComputeShieldedSighash(const CTransaction& tx, uint256& dataToBeSigned)
+{
+    // Empty output script.
+    CScript scriptCode;
+    try {
+        dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
+    } catch (const std::logic_error& ex) {
+        return false;
+    }
+    return true;
+}
+
+ProofResult VerifyShieldedProofs(const CTransaction& tx, const uint256& dataToBeSigned)
+{
+    // Sapling verification process
+    auto ctx = librustzcash_sapling_verification_ctx_init();
+
+    for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
+        if (!librustzcash_sapling_check_spend(
+                ctx,
+                spend.cv.begin(),
+                spend.anchor.begin(),
+                spend.nullifier.begin(),
+                spend.rk.begin(),
+                spend.zkproof.begin(),
+                spend.spendAuthSig.begin(),
+                dataToBeSigned.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            return PROOF_BAD_SPEND;
+        }
+    }
+
+    for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
+        if (!librustzcash_sapling_check_output(
+                ctx,
+                output.cv.begin(),
+                output.cmu.begin(),
+                output.ephemeralKey.begin(),
+                output.zkproof.begin())) {
+            librustzcash_sapling_verification_ctx_free(ctx);
+            return PROOF_BAD_OUTPUT;
+        }
+    }
+
+    if (!librustzcash_sapling_final_check(
+            ctx,
+            tx.sapData->valueBalance,
+            tx.sapData->bindingSig.begin(),
+            dataToBeSigned.begin())) {
+        librustzcash_sapling_verification_ctx_free(ctx);
+        return PROOF_BAD_BINDING_SIG;
+    }
+
+    librustzcash_sapling_verification_ctx_free(ctx);
+    return PROOF_OK;
+}
+
+static bool RejectProofResult(ProofResult res, CValidationState& state, int dosLevelPotentiallyRelaxing)
+{
+    switch (res) {
+        case PROOF_BAD_SPEND:
+            return state.DoS(
+                    dosLevelPotentiallyRelaxing,
+                    error("%s: Sapling spend description invalid", __func__ ),
+                    REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
+        case PROOF_BAD_OUTPUT:
+            // This should be a non-contextual check, but we check it here
+            // as we need to pass over the outputs anyway in order to then
+            // call librustzcash_sapling_final_check().
+            return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
+                             REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
+        case PROOF_BAD_BINDING_SIG:
+            return state.DoS(
+                    dosLevelPotentiallyRelaxing,
+                    error("%s: Sapling binding signature invalid", __func__ ),
+                    REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+        default:
+            return true;
+    }
+}
+
 /**
 * Check a transaction contextually against a set of consensus rules valid at a given block height.
 *
@@ -124,7 +206,8 @@ bool ContextualCheckTransaction(
         const CChainParams& chainparams,
         const int nHeight,
         const bool isMined,
-        bool isInitBlockDownload)
+        bool isInitBlockDownload,
+        bool fCheckProofs)
 {
     const int DOS_LEVEL_BLOCK = 100;
     // DoS level set to 10 to be more forgiving.
@@ -161,72 +244,41 @@ bool ContextualCheckTransaction(
                     REJECT_INVALID, "bad-cs-has-shielded-data");
     }
 
-    if (hasShieldedData) {
+    if (hasShieldedData && fCheckProofs) {
         uint256 dataToBeSigned;
-        // Empty output script.
-        CScript scriptCode;
-        try {
-            dataToBeSigned = SignatureHash(scriptCode, tx, NOT_AN_INPUT, SIGHASH_ALL, 0, SIGVERSION_SAPLING);
-        } catch (const std::logic_error& ex) {
+        if (!ComputeShieldedSighash(tx, dataToBeSigned)) {
             // A logic error should never occur because we pass NOT_AN_INPUT and
             // SIGHASH_ALL to SignatureHash().
             return state.DoS(100, error("%s: error computing signature hash", __func__ ),
                              REJECT_INVALID, "error-computing-signature-hash");
         }
 
-        // Sapling verification process
-        auto ctx = librustzcash_sapling_verification_ctx_init();
-
-        for (const SpendDescription &spend : tx.sapData->vShieldedSpend) {
-            if (!librustzcash_sapling_check_spend(
-                    ctx,
-                    spend.cv.begin(),
-                    spend.anchor.begin(),
-                    spend.nullifier.begin(),
-                    spend.rk.begin(),
-                    spend.zkproof.begin(),
-                    spend.spendAuthSig.begin(),
-                    dataToBeSigned.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                return state.DoS(
-                        dosLevelPotentiallyRelaxing,
-                        error("%s: Sapling spend description invalid", __func__ ),
-                        REJECT_INVALID, "bad-txns-sapling-spend-description-invalid");
-            }
+        const ProofResult res = VerifyShieldedProofs(tx, dataToBeSigned);
+        if (res != PROOF_OK) {
+            return RejectProofResult(res, state, dosLevelPotentiallyRelaxing);
         }
+    }
+    return true;
+}
 
-        for (const OutputDescription &output : tx.sapData->vShieldedOutput) {
-            if (!librustzcash_sapling_check_output(
-                    ctx,
-                    output.cv.begin(),
-                    output.cmu.begin(),
-                    output.ephemeralKey.begin(),
-                    output.zkproof.begin())) {
-                librustzcash_sapling_verification_ctx_free(ctx);
-                // This should be a non-contextual check, but we check it here
-                // as we need to pass over the outputs anyway in order to then
-                // call librustzcash_sapling_final_check().
-                return state.DoS(100, error("%s: Sapling output description invalid", __func__ ),
-                                 REJECT_INVALID, "bad-txns-sapling-output-description-invalid");
-            }
+bool CheckBlockShieldedProofs(const CBlock& block, CValidationState& state)
+{
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsShieldedTx() || !tx->hasSaplingData()) {
+            continue;
         }
-
-        if (!librustzcash_sapling_final_check(
-                ctx,
-                tx.sapData->valueBalance,
-                tx.sapData->bindingSig.begin(),
-                dataToBeSigned.begin())) {
-            librustzcash_sapling_verification_ctx_free(ctx);
-            return state.DoS(
-                    dosLevelPotentiallyRelaxing,
-                    error("%s: Sapling binding signature invalid", __func__ ),
-                    REJECT_INVALID, "bad-txns-sapling-binding-signature-invalid");
+        uint256 dataToBeSigned;
+        if (!ComputeShieldedSighash(*tx, dataToBeSigned)) {
+            return state.DoS(100, error("%s: error computing signature hash for tx %s", __func__, tx->GetHash().ToString()),
+                             REJECT_INVALID, "error-computing-signature-hash");
+        }
+        const ProofResult res = VerifyShieldedProofs(*tx, dataToBeSigned);
+        if (res != PROOF_OK) {
+            LogPrintf("%s: shielded proof check failed for tx %s\n", __func__, tx->GetHash().ToString());
+            return RejectProofResult(res, state, 100);
         }
-
-        librustzcash_sapling_verification_ctx_free(ctx);
     }
     return true;
 }
 
-
 } // End SaplingValidation namespace
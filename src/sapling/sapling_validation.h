@@ -10,6 +10,7 @@
 
 #include "chainparams.h"
 
+class CBlock;
 class CTransaction;
 class CValidationState;
 
@@ -23,9 +24,30 @@ bool CheckTransactionWithoutProofVerification(const CTransaction& tx, CValidatio
 
 /** Check a transaction contextually against a set of consensus rules */
 // Note: if v5 upgrade wasn't enforced, this method returns true without performing any check.
+// Note2: fCheckProofs=false skips the spend/output proofs and signatures verification,
+// which is then expected to be performed at block level by CheckBlockShieldedProofs.
 bool ContextualCheckTransaction(const CTransaction &tx, CValidationState &state,
                                 const CChainParams &chainparams, int nHeight, bool isMined,
-                                bool sInitBlockDownload);
+                                bool sInitBlockDownload, bool fCheckProofs = true);
+
+/** Result of the proofs and signatures verification of a shielded transaction */
+enum ProofResult {
+    PROOF_OK,
+    PROOF_BAD_SPEND,
+    PROOF_BAD_OUTPUT,
+    PROOF_BAD_BINDING_SIG
+};
+
+/** Compute the sighash signed by spendAuthSig and bindingSig. Returns false on failure */
+bool ComputeShieldedSighash(const CTransaction& tx, uint256& dataToBeSigned);
+
+/** Verify spend/output proofs, spend auth signatures and binding signature of a shielded tx */
+ProofResult VerifyShieldedProofs(const CTransaction& tx, const uint256& dataToBeSigned);
+
+/** Serially verify the proofs of all the shielded transactions in a block.
+ *  On failure, the rejection reason of the first failing transaction is set
+ *  in the validation state. */
+bool CheckBlockShieldedProofs(const CBlock& block, CValidationState& state);
 
 }; // End SaplingValidation namespace
 
@@ -7,6 +7,7 @@
 
 #include "sapling/saplingscriptpubkeyman.h"
 #include "chain.h" // for CBlockIndex
+#include "util/parallel.h"
 #include "validation.h" // for ReadBlockFromDisk()
 
 void SaplingScriptPubKeyMan::AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid)
@@ -34,6 +35,97 @@ bool SaplingScriptPubKeyMan::IsSaplingSpent(const uint256& nullifier) const {
     return false;
 }
 
+std::vector<uint256> SaplingScriptPubKeyMan::GetSaplingSpends(const uint256& nullifier) const
+{
+    AssertLockHeld(wallet->cs_wallet);
+    std::vector<uint256> vRet;
+    const auto range = mapTxSaplingNullifiers.equal_range(nullifier);
+    for (auto it = range.first; it != range.second; ++it) {
+        vRet.push_back(it->second);
+    }
+    return vRet;
+}
+
+bool SaplingScriptPubKeyMan::IsSaplingSpentInChain(const uint256& nullifier) const
+{
+    AssertLockHeld(wallet->cs_wallet);
+    const auto range = mapTxSaplingNullifiers.equal_range(nullifier);
+    for (auto it = range.first; it != range.second; ++it) {
+        const auto mit = wallet->mapWallet.find(it->second);
+        if (mit != wallet->mapWallet.end() && mit->second.isConfirmed()) return true;
+    }
+    return false;
+}
+
+void SaplingScriptPubKeyMan::AddToUnspentNotes(const CWalletTx& wtx, const SaplingOutPoint& op)
+{
+    AssertLockHeld(wallet->cs_wallet);
+    const auto it = wtx.mapSaplingNoteData.find(op);
+    if (it == wtx.mapSaplingNoteData.end() || !it->second.IsMyNote() ||
+            (it->second.nullifier && IsSaplingSpentInChain(*it->second.nullifier))) {
+        EraseFromUnspentNotes(op);
+        return;
+    }
+    if (mapUnspentNotes.count(op)) return;
+    // the address is cached when the note is decrypted, decrypt it again otherwise
+    Optional<libzcash::SaplingPaymentAddress> pa = it->second.address;
+    if (!pa) {
+        auto optNotePtAndAddress = wtx.DecryptSaplingNote(op);
+        assert(static_cast<bool>(optNotePtAndAddress));
+        pa = optNotePtAndAddress->second;
+    }
+    mapUnspentNotes.emplace(op, *pa);
+    mapUnspentNotesByAddress[*pa].emplace(op);
+}
+
+void SaplingScriptPubKeyMan::AddToUnspentNotes(const CWalletTx& wtx)
+{
+    AssertLockHeld(wallet->cs_wallet);
+    for (const auto& it : wtx.mapSaplingNoteData) {
+        AddToUnspentNotes(wtx, it.first);
+    }
+    // The notes spent by a tx in the chain can't be selected anymore
+    if (wtx.isConfirmed() && wtx.tx->sapData) {
+        for (const SpendDescription& spend : wtx.tx->sapData->vShieldedSpend) {
+            const auto it = mapSaplingNullifiersToNotes.find(spend.nullifier);
+            if (it != mapSaplingNullifiersToNotes.end()) EraseFromUnspentNotes(it->second);
+        }
+    }
+}
+
+void SaplingScriptPubKeyMan::RestoreUnspentNotes(const CTransaction& tx)
+{
+    AssertLockHeld(wallet->cs_wallet);
+    if (!tx.sapData) return;
+    for (const SpendDescription& spend : tx.sapData->vShieldedSpend) {
+        const auto it = mapSaplingNullifiersToNotes.find(spend.nullifier);
+        if (it == mapSaplingNullifiersToNotes.end()) continue;
+        const auto wit = wallet->mapWallet.find(it->second.hash);
+        if (wit != wallet->mapWallet.end()) AddToUnspentNotes(wit->second, it->second);
+    }
+}
+
+void SaplingScriptPubKeyMan::EraseFromUnspentNotes(const CWalletTx& wtx)
+{
+    AssertLockHeld(wallet->cs_wallet);
+    for (const auto& it : wtx.mapSaplingNoteData) {
+        EraseFromUnspentNotes(it.first);
+    }
+}
+
+void SaplingScriptPubKeyMan::EraseFromUnspentNotes(const SaplingOutPoint& op)
+{
+    AssertLockHeld(wallet->cs_wallet);
+    const auto it = mapUnspentNotes.find(op);
+    if (it == mapUnspentNotes.end()) return;
+    const auto ait = mapUnspentNotesByAddress.find(it->second);
+    if (ait != mapUnspentNotesByAddress.end()) {
+        ait->second.erase(op);
+        if (ait->second.empty()) mapUnspentNotesByAddress.erase(ait);
+    }
+    mapUnspentNotes.erase(it);
+}
+
 void SaplingScriptPubKeyMan::UpdateSaplingNullifierNoteMapForBlock(const CBlock *pblock) {
     LOCK(wallet->cs_wallet);
 
@@ -110,8 +202,9 @@ void SaplingScriptPubKeyMan::UpdateNullifierNoteMapWithTx(const CWalletTx& wtx)
     }
 }
 
-template<typename NoteDataMap>
-void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+template<typename NoteDataMap, typename NoteData>
+void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize,
+                           std::vector<NoteData*>& vPending, std::vector<NoteData*>& vWitnessed)
 {
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
@@ -131,70 +224,71 @@ void CopyPreviousWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nW
             // Copy the witness for the previous block if we have one
             if (nd->witnesses.size() > 0) {
                 nd->witnesses.push_front(nd->witnesses.front());
+                vWitnessed.emplace_back(nd);
             }
             if (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
                 nd->witnesses.pop_back();
             }
+            vPending.emplace_back(nd);
         }
     }
 }
 
-template<typename NoteDataMap>
-void AppendNoteCommitment(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const uint256& note_commitment)
+template<typename NoteData, typename Hash>
+void AppendNoteCommitments(std::vector<NoteData*>& vWitnessed, int64_t nWitnessCacheSize, const std::vector<Hash>& vCommitments)
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        // skip externally sent notes
-        if (!nd->IsMyNote()) continue;
-        if (nd->witnessHeight < indexHeight && nd->witnesses.size() > 0) {
-            // Check the validity of the cache
-            // See comment in CopyPreviousWitnesses about validity.
-            assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
-            nd->witnesses.front().append(note_commitment);
-        }
+    for (auto* nd : vWitnessed) {
+        // Check the validity of the cache
+        // See comment in CopyPreviousWitnesses about validity.
+        assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
+        nd->witnesses.front().append(vCommitments);
     }
 }
 
+/**
+ * Witness the note at key, if it is ours and not witnessed yet at indexHeight.
+ * Returns the note data when it got witnessed, its witness having then to be
+ * incremented by the following commitments of the block only.
+ */
 template<typename OutPoint, typename NoteData, typename Witness>
-void WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
+NoteData* WitnessNoteIfMine(std::map<OutPoint, NoteData>& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, const OutPoint& key, const Witness& witness)
 {
     auto ndIt = noteDataMap.find(key);
-    if (ndIt != noteDataMap.end()) {
-        auto* nd = &ndIt->second;
-        // skip externally sent and already witnessed notes
-        if (!nd->IsMyNote() || nd->witnessHeight >= indexHeight) return;
-        if (nd->witnesses.size() > 0) {
-            // We think this can happen because we write out the
-            // witness cache state after every block increment or
-            // decrement, but the block index itself is written in
-            // batches. So if the node crashes in between these two
-            // operations, it is possible for IncrementNoteWitnesses
-            // to be called again on previously-cached blocks. This
-            // doesn't affect existing cached notes because of the
-            // NoteData::witnessHeight checks. See #1378 for details.
-            LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
-                      key.ToString(), nd->witnesses.size(),
-                      nd->witnessHeight,
-                      nd->witnesses.front().root().GetHex(),
-                      indexHeight,
-                      witness.root().GetHex());
-            nd->witnesses.clear();
-        }
-        nd->witnesses.push_front(witness);
-        // Set height to one less than pindex so it gets incremented
-        nd->witnessHeight = indexHeight - 1;
-        // Check the validity of the cache
-        assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
+    if (ndIt == noteDataMap.end()) return nullptr;
+    auto* nd = &ndIt->second;
+    // skip externally sent and already witnessed notes
+    if (!nd->IsMyNote() || nd->witnessHeight >= indexHeight) return nullptr;
+    // a note with cached witnesses is already being incremented
+    const bool fTracked = nd->witnesses.size() > 0;
+    if (fTracked) {
+        // We think this can happen because we write out the
+        // witness cache state after every block increment or
+        // decrement, but the block index itself is written in
+        // batches. So if the node crashes in between these two
+        // operations, it is possible for IncrementNoteWitnesses
+        // to be called again on previously-cached blocks. This
+        // doesn't affect existing cached notes because of the
+        // NoteData::witnessHeight checks. See #1378 for details.
+        LogPrintf("Inconsistent witness cache state found for %s\n- Cache size: %d\n- Top (height %d): %s\n- New (height %d): %s\n",
+                  key.ToString(), nd->witnesses.size(),
+                  nd->witnessHeight,
+                  nd->witnesses.front().root().GetHex(),
+                  indexHeight,
+                  witness.root().GetHex());
+        nd->witnesses.clear();
     }
+    nd->witnesses.push_front(witness);
+    // Set height to one less than pindex so it gets incremented
+    nd->witnessHeight = indexHeight - 1;
+    // Check the validity of the cache
+    assert(nWitnessCacheSize >= (int64_t) nd->witnesses.size());
+    return nd;
 }
 
-template<typename NoteDataMap>
-void UpdateWitnessHeights(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+template<typename NoteData>
+void UpdateWitnessHeights(std::vector<NoteData*>& vPending, int indexHeight, int64_t nWitnessCacheSize)
 {
-    for (auto& item : noteDataMap) {
-        auto* nd = &(item.second);
-        // skip externally sent notes
-        if (!nd->IsMyNote()) continue;
+    for (auto* nd : vPending) {
         if (nd->witnessHeight < indexHeight) {
             nd->witnessHeight = indexHeight;
             // Check the validity of the cache
@@ -210,8 +304,15 @@ void SaplingScriptPubKeyMan::IncrementNoteWitnesses(const CBlockIndex* pindex,
 {
     LOCK(wallet->cs_wallet);
     int chainHeight = pindex->nHeight;
+
+    // Walk the wallet only once, collecting the notes behind this height
+    // (vPending) and, among them, the ones with a witness to increment
+    // (vWitnessed). Every commitment of the block is then appended to
+    // those witnesses only, instead of walking the whole wallet again.
+    std::vector<SaplingNoteData*> vPending;
+    std::vector<SaplingNoteData*> vWitnessed;
     for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize);
+        ::CopyPreviousWitnesses(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize, vPending, vWitnessed);
     }
 
     if (nWitnessCacheSize < WITNESS_CACHE_SIZE) {
@@ -219,36 +320,52 @@ void SaplingScriptPubKeyMan::IncrementNoteWitnesses(const CBlockIndex* pindex,
         nWitnessCacheNeedsUpdate = true;
     }
 
+    // The commitments are appended by batches: to the tree up to each note
+    // of ours (to witness it), and to every witness once the whole block is
+    // known, starting after the note for the ones created in this block.
+    std::vector<libzcash::PedersenHash> vCommitments;
+    std::vector<std::pair<SaplingNoteData*, size_t>> vNewWitnessed;
+    size_t nTreeCommitments = 0;
     for (const auto& tx : pblock->vtx) {
         if (!tx->IsShieldedTx()) continue;
 
         const uint256& hash = tx->GetHash();
-        bool txIsOurs = wallet->mapWallet.count(hash);
+        auto itWtx = wallet->mapWallet.find(hash);
+        bool txIsOurs = itWtx != wallet->mapWallet.end();
 
         // Sapling
         for (uint32_t i = 0; i < tx->sapData->vShieldedOutput.size(); i++) {
-            const uint256& note_commitment = tx->sapData->vShieldedOutput[i].cmu;
-            saplingTree.append(note_commitment);
-
-            // Increment existing witnesses
-            for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-                ::AppendNoteCommitment(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize, note_commitment);
-            }
+            vCommitments.emplace_back(tx->sapData->vShieldedOutput[i].cmu);
 
             // If this is our note, witness it
             if (txIsOurs) {
                 SaplingOutPoint outPoint {hash, i};
-                ::WitnessNoteIfMine(wallet->mapWallet.at(hash).mapSaplingNoteData, chainHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                auto& noteDataMap = itWtx->second.mapSaplingNoteData;
+                if (noteDataMap.find(outPoint) == noteDataMap.end()) continue;
+                saplingTree.append(std::vector<libzcash::PedersenHash>(vCommitments.begin() + nTreeCommitments, vCommitments.end()));
+                nTreeCommitments = vCommitments.size();
+                SaplingNoteData* nd = ::WitnessNoteIfMine(noteDataMap, chainHeight, nWitnessCacheSize, outPoint, saplingTree.witness());
+                if (nd) {
+                    // A note with an inconsistent cache was incremented as an existing one
+                    vWitnessed.erase(std::remove(vWitnessed.begin(), vWitnessed.end(), nd), vWitnessed.end());
+                    vNewWitnessed.emplace_back(nd, vCommitments.size());
+                }
             }
         }
 
     }
+    saplingTree.append(std::vector<libzcash::PedersenHash>(vCommitments.begin() + nTreeCommitments, vCommitments.end()));
 
-    // Update witness heights
-    for (std::pair<const uint256, CWalletTx>& wtxItem : wallet->mapWallet) {
-        ::UpdateWitnessHeights(wtxItem.second.mapSaplingNoteData, chainHeight, nWitnessCacheSize);
+    // Increment existing witnesses
+    ::AppendNoteCommitments(vWitnessed, nWitnessCacheSize, vCommitments);
+    for (const auto& it : vNewWitnessed) {
+        std::vector<SaplingNoteData*> vNote{it.first};
+        ::AppendNoteCommitments(vNote, nWitnessCacheSize, std::vector<libzcash::PedersenHash>(vCommitments.begin() + it.second, vCommitments.end()));
     }
 
+    // Update witness heights
+    ::UpdateWitnessHeights(vPending, chainHeight, nWitnessCacheSize);
+
     // For performance reasons, we write out the witness cache in
     // CWallet::SetBestChain() (which also ensures that overall consistency
     // of the wallet.dat is maintained).
@@ -322,52 +439,100 @@ void SaplingScriptPubKeyMan::DecrementNoteWitnesses(int nChainHeight)
  * the result of FindMySaplingNotes (for the addresses available at the time) will
  * already have been cached in CWalletTx.mapSaplingNoteData.
  */
-std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingScriptPubKeyMan::FindMySaplingNotes(const CTransaction &tx) const
+SaplingNotesFound SaplingScriptPubKeyMan::FindMySaplingNotes(const CTransaction &tx) const
 {
     // First check that this tx is a Shielded tx.
     if (!tx.IsShieldedTx()) {
         return {};
     }
+    return FindMySaplingNotes(std::vector<const CTransaction*>{&tx}).front();
+}
 
-    LOCK(wallet->cs_KeyStore);
-    const uint256& hash = tx.GetHash();
+std::vector<SaplingNotesFound> SaplingScriptPubKeyMan::FindMySaplingNotes(const std::vector<CTransactionRef>& vtx) const
+{
+    std::vector<const CTransaction*> vptx;
+    vptx.reserve(vtx.size());
+    for (const auto& ptx : vtx) vptx.emplace_back(ptx.get());
+    return FindMySaplingNotes(vptx);
+}
 
-    mapSaplingNoteData_t noteData;
-    SaplingIncomingViewingKeyMap viewingKeysToAdd;
+std::vector<SaplingNotesFound> SaplingScriptPubKeyMan::FindMySaplingNotes(const std::vector<const CTransaction*>& vtx) const
+{
+    std::vector<SaplingNotesFound> ret(vtx.size());
+
+    // Every shielded output of the set of transactions is a trial decryption job
+    std::vector<std::pair<size_t, uint32_t>> vJobs;
+    for (size_t i = 0; i < vtx.size(); i++) {
+        const CTransaction& tx = *vtx[i];
+        if (!tx.IsShieldedTx()) continue;
+        for (uint32_t j = 0; j < tx.sapData->vShieldedOutput.size(); j++) {
+            vJobs.emplace_back(i, j);
+        }
+    }
+    if (vJobs.empty()) return ret;
+
+    // Snapshot the viewing keys once, so the keystore lock is not held while decrypting
+    std::vector<libzcash::SaplingIncomingViewingKey> vIvks;
+    {
+        LOCK(wallet->cs_KeyStore);
+        vIvks.reserve(wallet->mapSaplingFullViewingKeys.size());
+        for (const auto& it : wallet->mapSaplingFullViewingKeys) {
+            vIvks.emplace_back(it.first);
+        }
+    }
+    if (vIvks.empty()) return ret;
 
     // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
-    for (uint32_t i = 0; i < tx.sapData->vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.sapData->vShieldedOutput[i];
-        for (auto it = wallet->mapSaplingFullViewingKeys.begin(); it != wallet->mapSaplingFullViewingKeys.end(); ++it) {
-            libzcash::SaplingIncomingViewingKey ivk = it->first;
-            auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cmu);
-            if (!result) {
-                continue;
+    // Trial-decrypt every output against every ivk. Jobs are independent, so they are
+    // spread over the shared worker pool.
+    struct DecryptedOutput {
+        size_t ivkIndex;
+        libzcash::SaplingNotePlaintext plaintext;
+        Optional<libzcash::SaplingPaymentAddress> address;
+    };
+    std::vector<Optional<DecryptedOutput>> vDecrypted(vJobs.size());
+    const size_t nTrials = vJobs.size() * vIvks.size();
+    const int nWorkers = nTrials < MIN_TRIAL_DECRYPTIONS_PER_THREAD ? 1 :
+            (int) std::min<size_t>(nTrials / MIN_TRIAL_DECRYPTIONS_PER_THREAD, std::max(GetNumCores(), 1));
+    ParallelForEach(vJobs.size(), nWorkers, [&](size_t n) {
+        const OutputDescription& output = vtx[vJobs[n].first]->sapData->vShieldedOutput[vJobs[n].second];
+        for (size_t k = 0; k < vIvks.size(); k++) {
+            auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, vIvks[k], output.ephemeralKey, output.cmu);
+            if (result) {
+                vDecrypted[n] = DecryptedOutput{k, *result, vIvks[k].address(result->d)};
+                break;
             }
+        }
+    });
 
-            // Check if we already have it.
-            Optional<libzcash::SaplingPaymentAddress> address = ivk.address(result.get().d);
-            if (address && wallet->mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
-                viewingKeysToAdd[address.get()] = ivk;
-            }
-            // We don't cache the nullifier here as computing it requires knowledge of the note position
-            // in the commitment tree, which can only be determined when the transaction has been mined.
-            SaplingOutPoint op {hash, i};
-            SaplingNoteData nd;
-            nd.ivk = ivk;
-            nd.amount = result->value();
-            nd.address = address;
-            const auto& memo = result->memo();
-            // don't save empty memo (starting with 0xF6)
-            if (memo[0] < 0xF6) {
-                nd.memo = memo;
-            }
-            noteData.insert(std::make_pair(op, nd));
-            break;
+    // Merge the results, only now the keystore lock is required
+    LOCK(wallet->cs_KeyStore);
+    for (size_t n = 0; n < vJobs.size(); n++) {
+        if (!vDecrypted[n]) continue;
+        const DecryptedOutput& dec = *vDecrypted[n];
+        const libzcash::SaplingIncomingViewingKey& ivk = vIvks[dec.ivkIndex];
+        SaplingNotesFound& txRet = ret[vJobs[n].first];
+
+        // Check if we already have it.
+        if (dec.address && wallet->mapSaplingIncomingViewingKeys.count(*dec.address) == 0) {
+            txRet.second[*dec.address] = ivk;
         }
+        // We don't cache the nullifier here as computing it requires knowledge of the note position
+        // in the commitment tree, which can only be determined when the transaction has been mined.
+        SaplingOutPoint op {vtx[vJobs[n].first]->GetHash(), vJobs[n].second};
+        SaplingNoteData nd;
+        nd.ivk = ivk;
+        nd.amount = dec.plaintext.value();
+        nd.address = dec.address;
+        const auto& memo = dec.plaintext.memo();
+        // don't save empty memo (starting with 0xF6)
+        if (memo[0] < 0xF6) {
+            nd.memo = memo;
+        }
+        txRet.first.insert(std::make_pair(op, nd));
     }
 
-    return std::make_pair(noteData, viewingKeysToAdd);
+    return ret;
 }
 
 std::vector<libzcash::SaplingPaymentAddress> SaplingScriptPubKeyMan::FindMySaplingAddresses(const CTransaction& tx) const
@@ -458,57 +623,94 @@ void SaplingScriptPubKeyMan::GetFilteredNotes(
 {
     LOCK(wallet->cs_wallet);
 
-    for (auto& p : wallet->mapWallet) {
-        const CWalletTx& wtx = p.second;
+    const auto addNote = [&](const CWalletTx& wtx, const SaplingOutPoint& op, const SaplingNoteData& nd, int depth) {
+        // skip sent notes
+        if (!nd.IsMyNote()) return;
 
-        // Filter coinbase/coinstakes transactions that don't have Sapling outputs
-        if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.mapSaplingNoteData.empty()) {
-            continue;
-        }
+        // recover plaintext and address
+        auto optNotePtAndAddress = wtx.DecryptSaplingNote(op);
+        assert(static_cast<bool>(optNotePtAndAddress));
 
-        // Filter the transactions before checking for notes
-        const int depth = wtx.GetDepthInMainChain();
-        if (!IsFinalTx(wtx.tx, wallet->GetLastBlockHeight() + 1, GetAdjustedTime()) ||
-            depth < minDepth || depth > maxDepth) {
-            continue;
-        }
+        const libzcash::SaplingIncomingViewingKey& ivk = *(nd.ivk);
+        const libzcash::SaplingNotePlaintext& notePt = optNotePtAndAddress->first;
+        const libzcash::SaplingPaymentAddress& pa = optNotePtAndAddress->second;
+        auto note = notePt.note(ivk).get();
 
-        for (const auto& it : wtx.mapSaplingNoteData) {
-            const SaplingOutPoint& op = it.first;
-            const SaplingNoteData& nd = it.second;
+        // skip notes which belong to a different payment address in the wallet
+        if (!(filterAddresses.empty() || filterAddresses.count(pa))) {
+            return;
+        }
 
-            // skip sent notes
-            if (!nd.IsMyNote()) continue;
+        if (ignoreSpent && nd.nullifier && IsSaplingSpent(*nd.nullifier)) {
+            return;
+        }
 
-            // recover plaintext and address
-            auto optNotePtAndAddress = wtx.DecryptSaplingNote(op);
-            assert(static_cast<bool>(optNotePtAndAddress));
+        // skip notes which cannot be spent
+        if (requireSpendingKey && !HaveSpendingKeyForPaymentAddress(pa)) {
+            return;
+        }
 
-            const libzcash::SaplingIncomingViewingKey& ivk = *(nd.ivk);
-            const libzcash::SaplingNotePlaintext& notePt = optNotePtAndAddress->first;
-            const libzcash::SaplingPaymentAddress& pa = optNotePtAndAddress->second;
-            auto note = notePt.note(ivk).get();
+        // skip locked notes
+        if (ignoreLocked && wallet->IsLockedNote(op)) {
+            return;
+        }
 
-            // skip notes which belong to a different payment address in the wallet
-            if (!(filterAddresses.empty() || filterAddresses.count(pa))) {
-                continue;
+        saplingEntries.emplace_back(op, pa, note, notePt.memo(), depth);
+    };
+
+    // Filter the transactions before checking for notes
+    const auto isTxSelectable = [&](const CWalletTx& wtx, int& depth) {
+        depth = wtx.GetDepthInMainChain();
+        return IsFinalTx(wtx.tx, wallet->GetLastBlockHeight() + 1, GetAdjustedTime()) &&
+               depth >= minDepth && depth <= maxDepth;
+    };
+
+    if (ignoreSpent) {
+        // Walk the unspent notes index, only the ones of the filtered addresses when given
+        std::set<SaplingOutPoint> setFiltered;
+        if (!filterAddresses.empty()) {
+            for (const libzcash::PaymentAddress& addr : filterAddresses) {
+                const auto* pa = boost::get<libzcash::SaplingPaymentAddress>(&addr);
+                if (!pa) continue;
+                const auto it = mapUnspentNotesByAddress.find(*pa);
+                if (it != mapUnspentNotesByAddress.end()) setFiltered.insert(it->second.begin(), it->second.end());
             }
+        }
 
-            if (ignoreSpent && nd.nullifier && IsSaplingSpent(*nd.nullifier)) {
-                continue;
+        // The outpoints are sorted, so the tx checks run once per tx
+        const CWalletTx* pwtx = nullptr;
+        bool fTxSelectable = false;
+        int depth = 0;
+        const auto checkNote = [&](const SaplingOutPoint& op) {
+            if (!pwtx || pwtx->GetHash() != op.hash) {
+                pwtx = &wallet->mapWallet.at(op.hash);
+                fTxSelectable = isTxSelectable(*pwtx, depth);
             }
+            if (fTxSelectable) addNote(*pwtx, op, pwtx->mapSaplingNoteData.at(op), depth);
+        };
+        if (filterAddresses.empty()) {
+            for (const auto& it : mapUnspentNotes) checkNote(it.first);
+        } else {
+            for (const SaplingOutPoint& op : setFiltered) checkNote(op);
+        }
+        return;
+    }
 
-            // skip notes which cannot be spent
-            if (requireSpendingKey && !HaveSpendingKeyForPaymentAddress(pa)) {
-                continue;
-            }
+    for (auto& p : wallet->mapWallet) {
+        const CWalletTx& wtx = p.second;
 
-            // skip locked notes. todo: Implement locked notes..
-            //if (ignoreLocked && IsLockedNote(op)) {
-            //    continue;
-            //}
+        // Filter coinbase/coinstakes transactions that don't have Sapling outputs
+        if ((wtx.IsCoinBase() || wtx.IsCoinStake()) && wtx.mapSaplingNoteData.empty()) {
+            continue;
+        }
 
-            saplingEntries.emplace_back(op, pa, note, notePt.memo(), depth);
+        int depth;
+        if (!isTxSelectable(wtx, depth)) {
+            continue;
+        }
+
+        for (const auto& it : wtx.mapSaplingNoteData) {
+            addNote(wtx, it.first, it.second, depth);
         }
     }
 }
@@ -6,6 +6,7 @@
 #define DOGEC_SAPLINGSCRIPTPUBKEYMAN_H
 
 #include "consensus/consensus.h"
+#include "memusage.h"
 #include "sapling/note.h"
 #include "wallet/hdchain.h"
 #include "wallet/wallet.h"
@@ -49,6 +50,7 @@ public:
     std::list<SaplingWitness> witnesses;
     Optional<libzcash::SaplingIncomingViewingKey> ivk {nullopt};
     inline bool IsMyNote() const { return ivk != nullopt; }
+    size_t DynamicMemoryUsage() const { return memusage::RecursiveDynamicUsage(witnesses); }
 
     /**
      * Cached note amount.
@@ -133,6 +135,11 @@ enum KeyAddResult {
 };
 
 typedef std::map<SaplingOutPoint, SaplingNoteData> mapSaplingNoteData_t;
+//! Notes found in a tx, and the addresses --> ivk mapping missing in the keystore
+typedef std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingNotesFound;
+
+//! Minimum amount of trial decryptions to justify spawning an additional worker thread
+static const size_t MIN_TRIAL_DECRYPTIONS_PER_THREAD = 64;
 
 /*
  * Sapling keys manager
@@ -155,6 +162,17 @@ public:
      */
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
     bool IsSaplingSpent(const uint256& nullifier) const;
+    //! wallet transactions spending the given nullifier
+    std::vector<uint256> GetSaplingSpends(const uint256& nullifier) const;
+
+    /**
+     * Keep track of the notes of ours not spent in the chain (see mapUnspentNotes).
+     * AddToUnspentNotes(wtx) is called when wtx is added or loaded, RestoreUnspentNotes(tx)
+     * when tx leaves the chain or the wallet, and EraseFromUnspentNotes(wtx) when wtx is erased.
+     */
+    void AddToUnspentNotes(const CWalletTx& wtx);
+    void RestoreUnspentNotes(const CTransaction& tx);
+    void EraseFromUnspentNotes(const CWalletTx& wtx);
 
     /**
      * pindex is the new tip being connected.
@@ -271,7 +289,12 @@ public:
 
     //! Finds all output notes in the given tx that have been sent to a
     //! SaplingPaymentAddress in this wallet
-    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> FindMySaplingNotes(const CTransaction& tx) const;
+    SaplingNotesFound FindMySaplingNotes(const CTransaction& tx) const;
+    //! Batched version for a set of transactions (e.g. all the txes of a block).
+    //! Outputs are trial-decrypted in parallel against a snapshot of the wallet ivks,
+    //! the keystore lock is only taken to copy the keys and to merge the results.
+    //! Returns one entry per tx, in the same order.
+    std::vector<SaplingNotesFound> FindMySaplingNotes(const std::vector<CTransactionRef>& vtx) const;
 
     //! Find all of the addresses in the given tx that have been sent to a SaplingPaymentAddress in this wallet.
     std::vector<libzcash::SaplingPaymentAddress> FindMySaplingAddresses(const CTransaction& tx) const;
@@ -414,6 +437,8 @@ private:
     Optional<uint256> commonOVK;
     uint256 getCommonOVKFromSeed() const;
 
+    /* Trial-decryption engine shared by the FindMySaplingNotes overloads */
+    std::vector<SaplingNotesFound> FindMySaplingNotes(const std::vector<const CTransaction*>& vtx) const;
 
     /**
      * Used to keep track of spent Notes, and
@@ -421,6 +446,19 @@ private:
      */
     typedef std::multimap<uint256, uint256> TxNullifiers;
     TxNullifiers mapTxSaplingNullifiers;
+
+    /**
+     * The notes of ours that are not spent by a transaction in the chain,
+     * with their address, and the same outpoints by address.
+     * GetFilteredNotes walks these, instead of every note of mapWallet, when
+     * the spent notes are not requested. It's a superset: the spends not in
+     * the chain yet (and the nullifiers computed later) are checked there.
+     */
+    std::map<SaplingOutPoint, libzcash::SaplingPaymentAddress> mapUnspentNotes;
+    std::map<libzcash::SaplingPaymentAddress, std::set<SaplingOutPoint>> mapUnspentNotesByAddress;
+    void AddToUnspentNotes(const CWalletTx& wtx, const SaplingOutPoint& op);
+    void EraseFromUnspentNotes(const SaplingOutPoint& op);
+    bool IsSaplingSpentInChain(const uint256& nullifier) const;
 };
 
 #endif //DOGEC_SAPLINGSCRIPTPUBKEYMAN_H
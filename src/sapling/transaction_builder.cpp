@@ -8,6 +8,7 @@
 #include "sapling/transaction_builder.h"
 
 #include "script/sign.h"
+#include "util/parallel.h"
 #include "utilmoneystr.h"
 #include "consensus/upgrades.h"
 #include "policy/policy.h"
@@ -27,7 +28,8 @@ SpendDescriptionInfo::SpendDescriptionInfo(const libzcash::SaplingExpandedSpendi
     librustzcash_sapling_generate_r(alpha.begin());
 }
 
-Optional<OutputDescription> OutputDescriptionInfo::Build(void* ctx) {
+Optional<OutputDescriptionInfo::Prepared> OutputDescriptionInfo::Prepare() const
+{
     auto cmu = this->note.cmu();
     if (!cmu) {
         return nullopt;
@@ -39,19 +41,24 @@ Optional<OutputDescription> OutputDescriptionInfo::Build(void* ctx) {
     if (!res) {
         return nullopt;
     }
-    auto enc = res.get();
-    auto encryptor = enc.second;
 
     libzcash::SaplingPaymentAddress address(this->note.d, this->note.pk_d);
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     ss << address;
     std::vector<unsigned char> addressBytes(ss.begin(), ss.end());
 
+    return Prepared{*cmu, *res, addressBytes};
+}
+
+Optional<OutputDescription> OutputDescriptionInfo::Build(void* ctx, Prepared& prepared) const
+{
+    auto& encryptor = prepared.enc.second;
+
     OutputDescription odesc;
     if (!librustzcash_sapling_output_proof(
             ctx,
             encryptor.get_esk().begin(),
-            addressBytes.data(),
+            prepared.addressBytes.data(),
             this->note.r.begin(),
             this->note.value(),
             odesc.cv.begin(),
@@ -59,9 +66,9 @@ Optional<OutputDescription> OutputDescriptionInfo::Build(void* ctx) {
         return nullopt;
     }
 
-    odesc.cmu = *cmu;
+    odesc.cmu = prepared.cmu;
     odesc.ephemeralKey = encryptor.get_epk();
-    odesc.encCiphertext = enc.first;
+    odesc.encCiphertext = prepared.enc.first;
 
     libzcash::SaplingOutgoingPlaintext outPlaintext(this->note.pk_d, encryptor.get_esk());
     odesc.outCiphertext = outPlaintext.encrypt(
@@ -73,6 +80,14 @@ Optional<OutputDescription> OutputDescriptionInfo::Build(void* ctx) {
     return odesc;
 }
 
+Optional<OutputDescription> OutputDescriptionInfo::Build(void* ctx) {
+    auto prepared = Prepare();
+    if (!prepared) {
+        return nullopt;
+    }
+    return Build(ctx, *prepared);
+}
+
 // Dummy constants used during fee-calculation loop
 static OutputDescription CreateDummyOD()
 {
@@ -243,6 +258,15 @@ void TransactionBuilder::SendChangeTo(const CTxDestination& changeAddr)
     saplingChangeAddr = nullopt;
 }
 
+//! Fewer descriptions per thread aren't worth starting the threads
+static const size_t MIN_SHIELDED_DESCS_PER_THREAD = 2;
+
+// The threads worth using for n descriptions, up to one per core
+static int ShieldedDescThreads(size_t n)
+{
+    return (int) std::max((size_t) 1, std::min((size_t) GetNumCores(), n / MIN_SHIELDED_DESCS_PER_THREAD));
+}
+
 TransactionBuilderResult TransactionBuilder::ProveAndSign()
 {
     //
@@ -250,17 +274,40 @@ TransactionBuilderResult TransactionBuilder::ProveAndSign()
     //
     if (!spends.empty() || !outputs.empty()) {
 
+        if (!LoadSaplingProvingParams()) {
+            return TransactionBuilderResult("Failed to load the Sapling proving parameters");
+        }
+
+        // The note commitments, encryptions and nullifiers don't need the
+        // proving context, compute them over several threads first
+        std::vector<Optional<OutputDescriptionInfo::Prepared>> vOutputsPrepared(outputs.size());
+        std::vector<Optional<uint256>> vNullifiers(spends.size());
+        ParallelForEach(outputs.size() + spends.size(), ShieldedDescThreads(outputs.size() + spends.size()), [&](size_t i) {
+            if (i < outputs.size()) {
+                vOutputsPrepared[i] = outputs[i].Prepare();
+                return;
+            }
+            const SpendDescriptionInfo& spend = spends[i - outputs.size()];
+            if (spend.note.cmu()) {
+                vNullifiers[i - outputs.size()] = spend.note.nullifier(
+                        spend.expsk.full_viewing_key(), spend.witness.position());
+            }
+        });
+
+        // The proofs go through the one proving context, which sums up the
+        // value commitments for the binding signature (each proof already
+        // runs over all the cores)
         auto ctx = librustzcash_sapling_proving_ctx_init();
 
         // Create Sapling OutputDescriptions
-        for (auto output : outputs) {
-            // Check this out here as well to provide better logging.
-            if (!output.note.cmu()) {
+        for (size_t i = 0; i < outputs.size(); i++) {
+            if (!vOutputsPrepared[i]) {
                 librustzcash_sapling_proving_ctx_free(ctx);
-                return TransactionBuilderResult("Output is invalid");
+                // Check the commitment here as well to provide better logging.
+                return TransactionBuilderResult(outputs[i].note.cmu() ? "Failed to create output description" : "Output is invalid");
             }
 
-            auto odesc = output.Build(ctx);
+            auto odesc = outputs[i].Build(ctx, *vOutputsPrepared[i]);
             if (!odesc) {
                 librustzcash_sapling_proving_ctx_free(ctx);
                 return TransactionBuilderResult("Failed to create output description");
@@ -270,11 +317,9 @@ TransactionBuilderResult TransactionBuilder::ProveAndSign()
         }
 
         // Create Sapling SpendDescriptions
-        for (auto spend : spends) {
-            auto cm = spend.note.cmu();
-            auto nf = spend.note.nullifier(
-                    spend.expsk.full_viewing_key(), spend.witness.position());
-            if (!cm || !nf) {
+        for (size_t i = 0; i < spends.size(); i++) {
+            const SpendDescriptionInfo& spend = spends[i];
+            if (!vNullifiers[i]) {
                 librustzcash_sapling_proving_ctx_free(ctx);
                 return TransactionBuilderResult("Spend is invalid");
             }
@@ -302,7 +347,7 @@ TransactionBuilderResult TransactionBuilder::ProveAndSign()
             }
 
             sdesc.anchor = spend.anchor;
-            sdesc.nullifier = *nf;
+            sdesc.nullifier = *vNullifiers[i];
             mtx.sapData->vShieldedSpend.push_back(sdesc);
         }
 
@@ -321,13 +366,13 @@ TransactionBuilderResult TransactionBuilder::ProveAndSign()
         }
 
         // Create Sapling spendAuth and binding signatures
-        for (size_t i = 0; i < spends.size(); i++) {
+        ParallelForEach(spends.size(), ShieldedDescThreads(spends.size()), [&](size_t i) {
             librustzcash_sapling_spend_sig(
                     spends[i].expsk.ask.begin(),
                     spends[i].alpha.begin(),
                     dataToBeSigned.begin(),
                     mtx.sapData->vShieldedSpend[i].spendAuthSig.data());
-        }
+        });
 
         librustzcash_sapling_binding_sig(
                 ctx,
@@ -49,6 +49,15 @@ struct OutputDescriptionInfo {
             memo(_memo)
     {}
 
+    // The parts of the description that don't need the proving context
+    struct Prepared {
+        uint256 cmu;
+        libzcash::SaplingNotePlaintextEncryptionResult enc;
+        std::vector<unsigned char> addressBytes;
+    };
+
+    Optional<Prepared> Prepare() const;
+    Optional<OutputDescription> Build(void* ctx, Prepared& prepared) const;
     Optional<OutputDescription> Build(void* ctx);
 };
 
@@ -21,42 +21,77 @@ CScheduler::~CScheduler()
     assert(nThreadsServicingQueue == 0);
 }
 
+bool CScheduler::isEmpty(unsigned int nLaneMask) const
+{
+    for (int lane = 0; lane < LANE_COUNT; lane++) {
+        if ((nLaneMask & (1 << lane)) && !taskQueues[lane].empty())
+            return false;
+    }
+    return true;
+}
+
 void CScheduler::serviceQueue()
+{
+    serviceLanes(ALL_LANES);
+}
+
+void CScheduler::serviceLanes(unsigned int nLaneMask)
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
     ++nThreadsServicingQueue;
 
+    // The first task of the lanes serviced: that of the highest priority lane, among the due ones
+    auto nextTask = [this, nLaneMask]() -> TaskQueue* {
+        TaskQueue* pfirst = nullptr;
+        const boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+        for (int lane = 0; lane < LANE_COUNT; lane++) {
+            TaskQueue& queue = taskQueues[lane];
+            if (!(nLaneMask & (1 << lane)) || queue.empty())
+                continue;
+            if (queue.begin()->first <= now)
+                return &queue;
+            if (!pfirst || queue.begin()->first < pfirst->begin()->first)
+                pfirst = &queue;
+        }
+        return pfirst;
+    };
+
     // newTaskMutex is locked throughout this loop EXCEPT
     // when the thread is waiting or when the user's function
     // is called.
     while (!shouldStop()) {
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && isEmpty(nLaneMask)) {
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 // Use this chance to get a tiny bit more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
+            while (!shouldStop() && isEmpty(nLaneMask)) {
                 // Wait until there is something to do.
                 newTaskScheduled.wait(lock);
             }
 
             // Wait until either there is a new task, or until
-            // the time of the first item on the queue:
+            // the time of the first item on the queues:
 
             // Some boost versions have a conflicting overload of wait_until that returns void.
             // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.wait_until<>(lock, taskQueue.begin()->first) != boost::cv_status::timeout) {
-                // Keep waiting until timeout
+            // The time is copied: another thread may run the task while this one waits.
+            while (!shouldStop() && !isEmpty(nLaneMask)) {
+                const boost::chrono::system_clock::time_point timeToWaitFor = nextTask()->begin()->first;
+                if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
+                    break; // Exit loop after timeout, it means we reached the time of the event
             }
-            // If there are multiple threads, the queue can empty while we're waiting (another
+            // If there are multiple threads, the queues can empty while we're waiting (another
             // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (shouldStop() || isEmpty(nLaneMask))
+                continue;
+            TaskQueue& queue = *nextTask();
+            if (queue.begin()->first > boost::chrono::system_clock::now())
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            Function f = queue.begin()->second;
+            queue.erase(queue.begin());
 
             {
                 // Unlock before calling f, so it can reschedule itself or another task
@@ -70,7 +105,7 @@ void CScheduler::serviceQueue()
         }
     }
     --nThreadsServicingQueue;
-    newTaskScheduled.notify_one();
+    newTaskScheduled.notify_all();
 }
 
 void CScheduler::stop(bool drain)
@@ -85,39 +120,45 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Lane lane)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.emplace(t, f);
+        taskQueues[lane].emplace(t, f);
     }
-    newTaskScheduled.notify_one();
+    // The threads waiting may not all service this lane
+    newTaskScheduled.notify_all();
 }
 
-void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds, Lane lane)
 {
-    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds));
+    schedule(f, boost::chrono::system_clock::now() + boost::chrono::milliseconds(deltaMilliSeconds), lane);
 }
 
-static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds)
+static void Repeat(CScheduler* s, CScheduler::Function f, int64_t deltaMilliSeconds, CScheduler::Lane lane)
 {
     f();
-    s->scheduleFromNow(std::bind(&Repeat, s, f, deltaMilliSeconds), deltaMilliSeconds);
+    s->scheduleFromNow(std::bind(&Repeat, s, f, deltaMilliSeconds, lane), deltaMilliSeconds, lane);
 }
 
-void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds)
+void CScheduler::scheduleEvery(CScheduler::Function f, int64_t deltaMilliSeconds, Lane lane)
 {
-    scheduleFromNow(std::bind(&Repeat, this, f, deltaMilliSeconds), deltaMilliSeconds);
+    scheduleFromNow(std::bind(&Repeat, this, f, deltaMilliSeconds, lane), deltaMilliSeconds, lane);
 }
 
 size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    for (const TaskQueue& queue : taskQueues) {
+        if (queue.empty())
+            continue;
+        if (result == 0 || queue.begin()->first < first)
+            first = queue.begin()->first;
+        if (result == 0 || queue.rbegin()->first > last)
+            last = queue.rbegin()->first;
+        result += queue.size();
     }
     return result;
 }
@@ -136,7 +177,7 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         if (m_are_callbacks_running) return;
         if (m_callbacks_pending.empty()) return;
     }
-    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this));
+    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now(), m_lane);
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
@@ -35,6 +35,14 @@
 // delete t;
 // delete s; // Must be done after thread is interrupted/joined.
 //
+// The tasks are in lanes: when tasks of several lanes are due, the
+// realtime ones (notifications) run first. A thread can service some of
+// the lanes only (serviceLanes), e.g. the realtime one, so that a long
+// background task (a dump to disk) doesn't hold the notifications back.
+//
+
+/** Number of threads servicing the background lane (and the realtime one when it is busy) */
+static const int DEFAULT_SCHEDULER_BACKGROUND_THREADS = 2;
 
 class CScheduler
 {
@@ -44,18 +52,26 @@ public:
 
     typedef std::function<void(void)> Function;
 
+    //! The lanes, by priority
+    enum Lane {
+        REALTIME = 0,
+        BACKGROUND = 1,
+        LANE_COUNT,
+    };
+    static const unsigned int ALL_LANES = (1 << LANE_COUNT) - 1;
+
     // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now());
+    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now(), Lane lane=BACKGROUND);
 
     // Convenience method: call f once deltaMilliSeconds from now
-    void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
+    void scheduleFromNow(Function f, int64_t deltaMilliSeconds, Lane lane=BACKGROUND);
 
     // Another convenience method: call f approximately
     // every deltaMilliSeconds forever, starting deltaMilliSeconds from now.
     // To be more precise: every time f is finished, it
     // is rescheduled to run deltaMilliSeconds later. If you
     // need more accurate scheduling, don't use this method.
-    void scheduleEvery(Function f, int64_t deltaMilliSeconds);
+    void scheduleEvery(Function f, int64_t deltaMilliSeconds, Lane lane=BACKGROUND);
 
     // To keep things as simple as possible, there is no unschedule.
 
@@ -63,6 +79,9 @@ public:
     // and interrupted using boost::interrupt_thread
     void serviceQueue();
 
+    // As serviceQueue, for the lanes in nLaneMask only (1 << lane)
+    void serviceLanes(unsigned int nLaneMask);
+
     // Tell any threads running serviceQueue to stop as soon as they're
     // done servicing whatever task they're currently servicing (drain=false)
     // or when there is no work left to be done (drain=true)
@@ -77,13 +96,15 @@ public:
     bool AreThreadsServicingQueue() const;
 
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    typedef std::multimap<boost::chrono::system_clock::time_point, Function> TaskQueue;
+    TaskQueue taskQueues[LANE_COUNT];
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() const { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool isEmpty(unsigned int nLaneMask) const;
+    bool shouldStop() const { return stopRequested || (stopWhenEmpty && isEmpty(ALL_LANES)); }
 };
 
 /**
@@ -99,6 +120,7 @@ private:
 class SingleThreadedSchedulerClient {
 private:
     CScheduler *m_pscheduler;
+    const CScheduler::Lane m_lane;
 
     RecursiveMutex m_cs_callbacks_pending;
     std::list<std::function<void (void)>> m_callbacks_pending;
@@ -108,7 +130,7 @@ private:
     void ProcessQueue();
 
 public:
-    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn) : m_pscheduler(pschedulerIn) {}
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn, CScheduler::Lane laneIn = CScheduler::REALTIME) : m_pscheduler(pschedulerIn), m_lane(laneIn) {}
 
     /**
      * Add a callback to be executed. Callbacks are executed serially
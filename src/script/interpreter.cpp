@@ -15,6 +15,7 @@
 #include "crypto/sha256.h"
 #include "pubkey.h"
 #include "script/script.h"
+#include "streams.h"
 #include "uint256.h"
 
 
@@ -1171,16 +1172,74 @@ uint256 GetShieldedOutputsHash(const CTransaction& txTo) {
     return ss.GetHash();
 }
 
+/** Feeds serialized data to a single SHA256 (the signature hash preimage) */
+class CSHA256Writer
+{
+private:
+    CSHA256& ctx;
+
+public:
+    explicit CSHA256Writer(CSHA256& ctxIn) : ctx(ctxIn) {}
+
+    int GetType() const { return SER_GETHASH; }
+    int GetVersion() const { return 0; }
+
+    void write(const char* pch, size_t size)
+    {
+        ctx.Write((const unsigned char*)pch, size);
+    }
+
+    template <typename T>
+    CSHA256Writer& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+};
+
+/** The size of a blanked input in the legacy preimage: prevout, empty script and nSequence */
+const size_t LEGACY_BLANK_INPUT_SIZE = 36 + 1 + 4;
+
 } // anon namespace
 
 PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction& txTo)
 {
-    hashPrevouts = GetPrevoutHash(txTo);
-    hashSequence = GetSequenceHash(txTo);
-    hashOutputs = GetOutputsHash(txTo);
-    if (txTo.sapData) {
-        hashShieldedSpends = GetShieldedSpendsHash(txTo);
-        hashShieldedOutputs = GetShieldedOutputsHash(txTo);
+    if (txTo.isSaplingVersion()) {
+        hashPrevouts = GetPrevoutHash(txTo);
+        hashSequence = GetSequenceHash(txTo);
+        hashOutputs = GetOutputsHash(txTo);
+        if (txTo.sapData) {
+            hashShieldedSpends = GetShieldedSpendsHash(txTo);
+            hashShieldedOutputs = GetShieldedOutputsHash(txTo);
+        }
+        return;
+    }
+
+    // A single input gains nothing from the midstates
+    if (txTo.vin.size() < 2) {
+        return;
+    }
+
+    CVectorWriter suffix(SER_GETHASH, 0, legacySuffix, 0);
+    for (const CTxIn& in : txTo.vin) {
+        suffix << in.prevout << CScript() << in.nSequence;
+    }
+    WriteCompactSize(suffix, txTo.vout.size());
+    for (const CTxOut& out : txTo.vout) {
+        suffix << out;
+    }
+    suffix << txTo.nLockTime;
+
+    CSHA256 prefix;
+    CSHA256Writer prefixWriter(prefix);
+    prefixWriter << txTo.nVersion << txTo.nType;
+    WriteCompactSize(prefixWriter, txTo.vin.size());
+    legacyMidstates.reserve(txTo.vin.size());
+    for (size_t n = 0; n < txTo.vin.size(); n++) {
+        const unsigned char* input = legacySuffix.data() + n * LEGACY_BLANK_INPUT_SIZE;
+        legacyMidstates.emplace_back(prefix);
+        legacyMidstates.back().Write(input, 36);
+        prefix.Write(input, LEGACY_BLANK_INPUT_SIZE);
     }
 }
 
@@ -1196,6 +1255,10 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     }
 
     if (sigversion == SIGVERSION_SAPLING) {
+        // The sapling hashes are only precomputed for sapling transactions
+        if (!txTo.isSaplingVersion()) {
+            cache = nullptr;
+        }
 
         uint256 hashPrevouts;
         uint256 hashSequence;
@@ -1292,6 +1355,25 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer txTmp(txTo, scriptCode, nIn, nHashType);
 
+    // SIGHASH_ALL preimages only differ by the script code and nSequence of
+    // the input being signed: resume from its midstate and hash the rest.
+    if (cache && !cache->legacyMidstates.empty() && nIn < cache->legacyMidstates.size() &&
+            !(nHashType & SIGHASH_ANYONECANPAY) &&
+            (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE) {
+        CSHA256 ctx(cache->legacyMidstates[nIn]);
+        CSHA256Writer writer(ctx);
+        txTmp.SerializeScriptCode(writer);
+        writer << txTo.vin[nIn].nSequence;
+        const size_t offset = (nIn + 1) * LEGACY_BLANK_INPUT_SIZE;
+        ctx.Write(cache->legacySuffix.data() + offset, cache->legacySuffix.size() - offset);
+        writer << nHashType;
+        unsigned char buf[CSHA256::OUTPUT_SIZE];
+        ctx.Finalize(buf);
+        uint256 result;
+        CSHA256().Write(buf, sizeof(buf)).Finalize(result.begin());
+        return result;
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -1393,6 +1475,156 @@ bool TransactionSignatureChecker::CheckColdStake(const CScript& prevoutScript) c
 }
 
 
+namespace {
+
+/** A value pushed by a scriptSig, pointing into the script instead of being copied on a stack */
+struct PushedValue {
+    const unsigned char* data;
+    size_t size;
+};
+
+/** The values pushed by OP_1NEGATE and OP_1 .. OP_16 */
+const unsigned char vchSmallInts[] = {0x81, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+
+/**
+ * Decode a scriptSig made of exactly N minimal pushes (OP_0, direct pushes,
+ * OP_1NEGATE and OP_1 .. OP_16). Anything else, PUSHDATAs included, is left
+ * to the interpreter.
+ */
+template <size_t N>
+bool DecodePushes(const CScript& script, PushedValue (&values)[N])
+{
+    if (script.size() > MAX_SCRIPT_SIZE) {
+        return false;
+    }
+    size_t n = 0;
+    CScript::const_iterator pc = script.begin();
+    while (pc < script.end()) {
+        if (n == N) {
+            return false;
+        }
+        const unsigned int opcode = *pc++;
+        if (opcode == OP_0) {
+            values[n++] = {vchSmallInts, 0};
+        } else if (opcode < OP_PUSHDATA1) {
+            if ((unsigned int)(script.end() - pc) < opcode) {
+                return false;
+            }
+            if (opcode == 1 && ((*pc >= 1 && *pc <= 16) || *pc == 0x81)) {
+                return false;
+            }
+            values[n++] = {&*pc, opcode};
+            pc += opcode;
+        } else if (opcode == OP_1NEGATE) {
+            values[n++] = {vchSmallInts, 1};
+        } else if (opcode >= OP_1 && opcode <= OP_16) {
+            values[n++] = {vchSmallInts + opcode - (OP_1 - 1), 1};
+        } else {
+            return false;
+        }
+    }
+    return n == N;
+}
+
+bool CastToBool(const PushedValue& value)
+{
+    for (size_t i = 0; i < value.size; i++) {
+        if (value.data[i] != 0) {
+            // Can be negative zero
+            return i != value.size - 1 || value.data[i] != 0x80;
+        }
+    }
+    return false;
+}
+
+bool IsHashOf(const PushedValue& value, CScript::const_iterator hash)
+{
+    uint160 result;
+    CHash160().Write(value.data, value.size).Finalize(result.begin());
+    return std::equal(result.begin(), result.end(), hash);
+}
+
+/** The final OP_CHECKSIG of the templates, against the whole scriptPubKey */
+bool CheckTemplateSig(const PushedValue& sig, const PushedValue& pubkey, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion)
+{
+    const valtype vchSig(sig.data, sig.data + sig.size);
+    const valtype vchPubKey(pubkey.data, pubkey.data + pubkey.size);
+    if (!CheckSignatureEncoding(vchSig, flags, nullptr) || !CheckPubKeyEncoding(vchPubKey, flags, nullptr)) {
+        return false;
+    }
+    return checker.CheckSig(vchSig, vchPubKey, scriptPubKey, sigversion);
+}
+
+bool IsPayToPubKey(const CScript& script)
+{
+    return (script.size() == 35 && script[0] == 33 && script[34] == OP_CHECKSIG) ||
+           (script.size() == 67 && script[0] == 65 && script[66] == OP_CHECKSIG);
+}
+
+/** The cold staking template, byte for byte */
+bool IsStrictPayToColdStaking(const CScript& script)
+{
+    return script.size() == 51 &&
+           script[0] == OP_DUP && script[1] == OP_HASH160 && script[2] == OP_ROT && script[3] == OP_IF &&
+           script[4] == OP_CHECKCOLDSTAKEVERIFY && script[5] == 0x14 && script[26] == OP_ELSE &&
+           script[27] == 0x14 && script[48] == OP_ENDIF && script[49] == OP_EQUALVERIFY && script[50] == OP_CHECKSIG;
+}
+
+/**
+ * Spend a P2PKH, P2PK or P2CS output without running the interpreter: the
+ * pushes of the scriptSig are decoded in place and the template is checked
+ * directly, with no stack. Returns true only when EvalScript would succeed;
+ * any failure, or an unusual encoding, goes through the interpreter, which
+ * reports the script error.
+ *
+ * The signature is never deleted from the scriptCode: a signature push can
+ * only match a 20-byte hash push (P2PKH, P2CS) or the public key push (P2PK),
+ * those cases are left to the interpreter too.
+ */
+bool VerifyTemplateScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion)
+{
+    if (scriptPubKey.IsPayToPublicKeyHash()) {
+        // <sig> <pubkey> | DUP HASH160 <hash> EQUALVERIFY CHECKSIG
+        PushedValue values[2];
+        if (!DecodePushes(scriptSig, values) || values[0].size == 20 || !IsHashOf(values[1], scriptPubKey.begin() + 3)) {
+            return false;
+        }
+        return CheckTemplateSig(values[0], values[1], scriptPubKey, flags, checker, sigversion);
+    }
+
+    if (IsPayToPubKey(scriptPubKey)) {
+        // <sig> | <pubkey> CHECKSIG
+        PushedValue values[1];
+        const PushedValue pubkey = {&scriptPubKey[1], scriptPubKey.size() - 2};
+        if (!DecodePushes(scriptSig, values) ||
+                (values[0].size == pubkey.size && std::equal(pubkey.data, pubkey.data + pubkey.size, values[0].data))) {
+            return false;
+        }
+        return CheckTemplateSig(values[0], pubkey, scriptPubKey, flags, checker, sigversion);
+    }
+
+    if (IsStrictPayToColdStaking(scriptPubKey)) {
+        // <sig> <flag> <pubkey> | DUP HASH160 ROT IF CHECKCOLDSTAKEVERIFY <staker> ELSE <owner> ENDIF EQUALVERIFY CHECKSIG
+        PushedValue values[3];
+        if (!DecodePushes(scriptSig, values) || values[0].size == 20) {
+            return false;
+        }
+        const bool fStaker = CastToBool(values[1]);
+        if (fStaker && !checker.CheckColdStake(scriptPubKey)) {
+            return false;
+        }
+        if (!IsHashOf(values[2], scriptPubKey.begin() + (fStaker ? 6 : 28))) {
+            return false;
+        }
+        return CheckTemplateSig(values[0], values[2], scriptPubKey, flags, checker, sigversion);
+    }
+
+    return false;
+}
+
+} // anon namespace
+
+
 bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigned int flags, const BaseSignatureChecker& checker, SigVersion sigversion, ScriptError* serror)
 {
     set_error(serror, SCRIPT_ERR_UNKNOWN_ERROR);
@@ -1401,6 +1633,11 @@ bool VerifyScript(const CScript& scriptSig, const CScript& scriptPubKey, unsigne
         return set_error(serror, SCRIPT_ERR_SIG_PUSHONLY);
     }
 
+    // Standard spends skip the interpreter
+    if (VerifyTemplateScript(scriptSig, scriptPubKey, flags, checker, sigversion)) {
+        return set_success(serror);
+    }
+
     std::vector<std::vector<unsigned char> > stack, stackCopy;
     if (!EvalScript(stack, scriptSig, flags, checker, sigversion, serror))
         // serror is set
@@ -7,6 +7,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include "crypto/sha256.h"
 #include "primitives/transaction.h"
 #include "script_error.h"
 #include "uint256.h"
@@ -87,8 +88,18 @@ bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned i
 
 struct PrecomputedTransactionData
 {
+    //! The sapling signature hash parts (sapling version transactions only)
     uint256 hashPrevouts, hashSequence, hashOutputs, hashShieldedSpends, hashShieldedOutputs;
 
+    //! Legacy transactions with several inputs: the SHA256 state of the
+    //! SIGHASH_ALL preimage up to the prevout of each input (everything
+    //! before its script code), shared by all the checks of the transaction.
+    std::vector<CSHA256> legacyMidstates;
+    //! The blanked inputs (prevout, empty script, nSequence), the outputs and
+    //! the locktime, serialized once: the preimage of input n goes on with
+    //! its nSequence and this buffer from the input n + 1.
+    std::vector<unsigned char> legacySuffix;
+
     PrecomputedTransactionData(const CTransaction& tx);
 };
 
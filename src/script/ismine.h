@@ -33,6 +33,8 @@ enum isminetype {
     ISMINE_SPENDABLE_NO_DELEGATED =  ISMINE_SPENDABLE | ISMINE_SPENDABLE_SHIELDED,
     ISMINE_SPENDABLE_ALL = ISMINE_SPENDABLE_DELEGATED | ISMINE_SPENDABLE | ISMINE_SPENDABLE_SHIELDED,
     ISMINE_WATCH_ONLY_ALL = ISMINE_WATCH_ONLY | ISMINE_WATCH_ONLY_SHIELDED,
+    ISMINE_TRANSPARENT_ALL = ISMINE_WATCH_ONLY | ISMINE_SPENDABLE | ISMINE_COLD | ISMINE_SPENDABLE_DELEGATED,
+    ISMINE_SHIELDED_ALL = ISMINE_WATCH_ONLY_SHIELDED | ISMINE_SPENDABLE_SHIELDED,
     ISMINE_ALL = ISMINE_WATCH_ONLY | ISMINE_SPENDABLE | ISMINE_COLD | ISMINE_SPENDABLE_DELEGATED | ISMINE_SPENDABLE_SHIELDED | ISMINE_WATCH_ONLY_SHIELDED,
     ISMINE_ENUM_ELEMENTS
 };
@@ -55,6 +57,13 @@ struct CachableAmount
     {
         m_cached.reset();
     }
+    //! Drop the cached values of the filters that overlap with the given one
+    inline void Reset(isminefilter filter)
+    {
+        for (size_t i = 1; i < m_cached.size(); i++) {
+            if (i & filter) m_cached.reset(i);
+        }
+    }
     void Set(isminefilter filter, CAmount value)
     {
         m_cached.set(filter);
@@ -6,15 +6,21 @@
 
 #include "sigcache.h"
 
+#include "clientversion.h"
 #include "cuckoocache.h"
 #include "memusage.h"
 #include "pubkey.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <algorithm>
+
 #include <boost/thread/thread.hpp>
 
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
 namespace {
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
@@ -58,6 +64,25 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    //! The entries still valid, and the nonce they are computed with
+    std::vector<uint256> GetEntries(uint256& nonceOut)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonceOut = nonce;
+        std::vector<uint256> vEntries;
+        setValid.for_each([&vEntries](const uint256& entry) { vEntries.push_back(entry); });
+        return vEntries;
+    }
+
+    //! Adds entries computed with nonceIn, replacing the nonce: no entry is to be computed before
+    void SetEntries(const uint256& nonceIn, const std::vector<uint256>& vEntries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        for (const uint256& entry : vEntries)
+            setValid.insert(entry);
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -75,10 +100,68 @@ void InitSignatureCache()
 {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
-    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
     size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
-    LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
-            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+    LogPrintf("Using %zu MiB out of %zu/2 requested for signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+}
+
+bool DumpSignatureCache()
+{
+    int64_t nStart = GetTimeMicros();
+    uint256 nonce;
+    const std::vector<uint256> vEntries = signatureCache.GetEntries(nonce);
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SIGCACHE_DUMP_VERSION;
+        file << nonce;
+        file << vEntries;
+        FileCommit(file.Get());
+        file.fclose();
+        if (!RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat")) {
+            throw std::runtime_error("Rename failed");
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    LogPrintf("Dumped %u signature cache entries: %.3fs\n", vEntries.size(), (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
+bool LoadSignatureCache()
+{
+    int64_t nStart = GetTimeMicros();
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 nonce;
+    std::vector<uint256> vEntries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SIGCACHE_DUMP_VERSION) {
+            return false;
+        }
+        file >> nonce;
+        file >> vEntries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    signatureCache.SetEntries(nonce, vEntries);
+    LogPrintf("Imported %u signature cache entries: %.3fs\n", vEntries.size(), (GetTimeMicros() - nStart) * 0.000001);
+    return true;
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
@@ -93,3 +176,55 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(entry);
     return true;
 }
+
+bool BatchingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+    if (signatureCache.Get(entry, !store))
+        return true;
+    batch.Add(vchSig, pubkey, sighash, store);
+    return true;
+}
+
+void CSignatureBatch::Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, bool store)
+{
+    entries.emplace_back();
+    Entry& entry = entries.back();
+    entry.pubkey = pubkey;
+    entry.sighash = sighash;
+    entry.vchSig = vchSig;
+    entry.store = store;
+}
+
+bool CSignatureBatch::Verify()
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.pubkey != b.pubkey) return a.pubkey < b.pubkey;
+        if (a.sighash != b.sighash) return a.sighash < b.sighash;
+        return a.vchSig < b.vchSig;
+    });
+
+    std::vector<std::pair<const uint256*, const std::vector<unsigned char>*> > vSigs;
+    for (size_t begin = 0, end; begin < entries.size(); begin = end) {
+        // The signatures by the key of entries[begin], each one once
+        vSigs.clear();
+        for (end = begin; end < entries.size() && entries[end].pubkey == entries[begin].pubkey; end++) {
+            if (end == begin || entries[end].sighash != entries[end - 1].sighash || entries[end].vchSig != entries[end - 1].vchSig) {
+                vSigs.emplace_back(&entries[end].sighash, &entries[end].vchSig);
+            }
+        }
+        if (!entries[begin].pubkey.VerifyAll(vSigs)) {
+            return false;
+        }
+    }
+
+    for (const Entry& e : entries) {
+        if (e.store) {
+            uint256 entry;
+            signatureCache.ComputeEntry(entry, e.sighash, e.vchSig, e.pubkey);
+            signatureCache.Set(entry);
+        }
+    }
+    return true;
+}
@@ -51,6 +51,58 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/**
+ * Signatures collected while running the scripts of a batch of script checks,
+ * verified together afterwards: the entries are sorted by public key, so that
+ * each key is parsed once, and repeated signatures are verified once.
+ *
+ * libsecp256k1 has no batch verification of ECDSA signatures (they don't
+ * carry the y coordinate of R, which combining them in one multi-scalar
+ * multiplication needs): the gain is the parsing and the duplicates, and the
+ * verification running in a tight loop out of the interpreter.
+ */
+class CSignatureBatch
+{
+private:
+    struct Entry {
+        CPubKey pubkey;
+        uint256 sighash;
+        std::vector<unsigned char> vchSig;
+        bool store;
+    };
+    std::vector<Entry> entries;
+
+public:
+    void Add(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, bool store);
+    bool empty() const { return entries.empty(); }
+    void clear() { entries.clear(); }
+
+    /** Verify all the signatures added, adding them to the signature cache when asked */
+    bool Verify();
+};
+
+/**
+ * Signature checker assuming that the signatures not in the cache are valid,
+ * adding them to a batch to verify once the scripts have run. The scripts
+ * must be run again with a CachingTransactionSignatureChecker if the batch
+ * fails to verify, or if they fail: a script may expect a signature to fail.
+ */
+class BatchingTransactionSignatureChecker : public CachingTransactionSignatureChecker
+{
+private:
+    bool store;
+    CSignatureBatch& batch;
+
+public:
+    BatchingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn, PrecomputedTransactionData& cachedHashesIn, CSignatureBatch& batchIn) : CachingTransactionSignatureChecker(txToIn, nInIn, amount, storeIn, cachedHashesIn), store(storeIn), batch(batchIn) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+};
+
 void InitSignatureCache();
+/** Dump the entries of the signature cache, and the nonce they are computed with, to disk */
+bool DumpSignatureCache();
+/** Load the signature cache from disk, before any signature is checked */
+bool LoadSignatureCache();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -19,6 +19,7 @@
 #include <stdint.h>
 #include <string.h>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -553,6 +554,23 @@ CVarInt<I> WrapVarInt(I& n)
     return CVarInt<I>(n);
 }
 
+/**
+ * Whether the serialization of T is a copy of its memory, as for the blobs and
+ * the big integers: the vectors of them are then written and read in a single
+ * call, like the ones of unsigned char, instead of element by element.
+ * A class opts in with a memory_serialized_type typedef naming itself, the
+ * derived classes are included as long as they add no member.
+ */
+template<typename T, typename = void>
+struct is_memory_serialized : std::false_type {};
+
+template<typename T>
+struct is_memory_serialized<T, typename std::enable_if<sizeof(T) == sizeof(typename T::memory_serialized_type)>::type> : std::true_type {};
+
+/** The tag the vectors of T dispatch on, unsigned char to serialize them as a single blob */
+template<typename T>
+using vector_serialize_tag = typename std::conditional<is_memory_serialized<T>::value, unsigned char, T>::type;
+
 /**
  * Forward declarations
  */
@@ -565,7 +583,7 @@ template<typename Stream, typename C> void Unserialize(Stream& is, std::basic_st
 
 /**
  * prevector
- * prevectors of unsigned char are a special case and are intended to be serialized as a single opaque blob.
+ * prevectors of unsigned char, and of the memory serialized types, are a special case and are intended to be serialized as a single opaque blob.
  */
 template<typename Stream, unsigned int N, typename T> void Serialize_impl(Stream& os, const prevector<N, T>& v, const unsigned char&);
 template<typename Stream, unsigned int N, typename T, typename V> void Serialize_impl(Stream& os, const prevector<N, T>& v, const V&);
@@ -576,7 +594,7 @@ template<typename Stream, unsigned int N, typename T> inline void Unserialize(St
 
 /**
  * vector
- * vectors of unsigned char are a special case and are intended to be serialized as a single opaque blob.
+ * vectors of unsigned char, and of the memory serialized types, are a special case and are intended to be serialized as a single opaque blob.
  */
 template<typename Stream, typename T, typename A> void Serialize_impl(Stream& os, const std::vector<T, A>& v, const unsigned char&);
 template<typename Stream, typename T, typename A, typename V> void Serialize_impl(Stream& os, const std::vector<T, A>& v, const V&);
@@ -804,7 +822,7 @@ void Serialize_impl(Stream& os, const prevector<N, T>& v, const V&)
 template<typename Stream, unsigned int N, typename T>
 inline void Serialize(Stream& os, const prevector<N, T>& v)
 {
-    Serialize_impl(os, v, T());
+    Serialize_impl(os, v, vector_serialize_tag<T>());
 }
 
 
@@ -845,7 +863,7 @@ void Unserialize_impl(Stream& is, prevector<N, T>& v, const V&)
 template<typename Stream, unsigned int N, typename T>
 inline void Unserialize(Stream& is, prevector<N, T>& v)
 {
-    Unserialize_impl(is, v, T());
+    Unserialize_impl(is, v, vector_serialize_tag<T>());
 }
 
 
@@ -872,7 +890,7 @@ void Serialize_impl(Stream& os, const std::vector<T, A>& v, const V&)
 template <typename Stream, typename T, typename A>
 inline void Serialize(Stream& os, const std::vector<T, A>& v)
 {
-    Serialize_impl(os, v, T());
+    Serialize_impl(os, v, vector_serialize_tag<T>());
 }
 
 
@@ -911,7 +929,7 @@ void Unserialize_impl(Stream& is, std::vector<T, A>& v, const V&)
 template <typename Stream, typename T, typename A>
 inline void Unserialize(Stream& is, std::vector<T, A>& v)
 {
-    Unserialize_impl(is, v, T());
+    Unserialize_impl(is, v, vector_serialize_tag<T>());
 }
 
 
@@ -0,0 +1,355 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "socketevents.h"
+
+#include "logging.h"
+#include "netbase.h"
+
+#if defined(HAVE_SYS_EPOLL_H) && !defined(WIN32)
+#define USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#if defined(HAVE_SYS_EVENT_H) && !defined(WIN32)
+#define USE_KQUEUE
+#include <sys/event.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#endif
+
+#include <errno.h>
+
+namespace {
+
+class CSocketEventsSelect : public CSocketEvents
+{
+public:
+    const char* GetName() const override { return "select"; }
+
+    bool Wait(const std::vector<SocketEventsRequest>& vRequests, std::map<SOCKET, uint8_t>& mapReady, int nTimeoutMs) override
+    {
+        struct timeval timeout;
+        timeout.tv_sec = nTimeoutMs / 1000;
+        timeout.tv_usec = (nTimeoutMs % 1000) * 1000;
+
+        fd_set fdsetRecv;
+        fd_set fdsetSend;
+        fd_set fdsetError;
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        bool have_fds = false;
+
+        for (const SocketEventsRequest& req : vRequests) {
+            // the listening sockets only wait for incoming connections
+            if (req.nOwner >= 0) FD_SET(req.socket, &fdsetError);
+            if (req.nEvents & SOCKET_EVENT_RECV) FD_SET(req.socket, &fdsetRecv);
+            if (req.nEvents & SOCKET_EVENT_SEND) FD_SET(req.socket, &fdsetSend);
+            hSocketMax = std::max(hSocketMax, req.socket);
+            have_fds = true;
+        }
+
+        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
+                             &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        if (nSelect == SOCKET_ERROR) {
+            if (have_fds) {
+                int nErr = WSAGetLastError();
+                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            }
+            return false;
+        }
+
+        for (const SocketEventsRequest& req : vRequests) {
+            uint8_t nReady = 0;
+            if (FD_ISSET(req.socket, &fdsetRecv)) nReady |= SOCKET_EVENT_RECV;
+            if (FD_ISSET(req.socket, &fdsetSend)) nReady |= SOCKET_EVENT_SEND;
+            if (FD_ISSET(req.socket, &fdsetError)) nReady |= SOCKET_EVENT_ERR;
+            if (nReady) mapReady[req.socket] = nReady;
+        }
+        return true;
+    }
+};
+
+/**
+ * Base for the backends keeping the sockets registered in the kernel
+ * across calls: only the changes since the previous Wait are applied.
+ */
+class CSocketEventsRegistered : public CSocketEvents
+{
+protected:
+    struct Registration {
+        int64_t nOwner;
+        uint8_t nEvents;
+        uint64_t nGeneration;
+    };
+    std::map<SOCKET, Registration> mapRegistered;
+    uint64_t nGeneration{0};
+
+    //! Update the kernel registration of a socket (nOld is 0 for a new registration)
+    virtual void Register(SOCKET socket, uint8_t nOld, uint8_t nNew, bool fNew) = 0;
+    //! Drop a socket no longer requested (it may already be closed)
+    virtual void Unregister(SOCKET socket, uint8_t nOld) = 0;
+
+    void UpdateRegistrations(const std::vector<SocketEventsRequest>& vRequests)
+    {
+        nGeneration++;
+        for (const SocketEventsRequest& req : vRequests) {
+            auto it = mapRegistered.find(req.socket);
+            if (it == mapRegistered.end()) {
+                Register(req.socket, 0, req.nEvents, true);
+                mapRegistered.emplace(req.socket, Registration{req.nOwner, req.nEvents, nGeneration});
+                continue;
+            }
+            Registration& reg = it->second;
+            if (reg.nOwner != req.nOwner) {
+                // the descriptor was closed and reused by another connection
+                Unregister(req.socket, reg.nEvents);
+                Register(req.socket, 0, req.nEvents, true);
+            } else if (reg.nEvents != req.nEvents) {
+                Register(req.socket, reg.nEvents, req.nEvents, false);
+            }
+            reg.nOwner = req.nOwner;
+            reg.nEvents = req.nEvents;
+            reg.nGeneration = nGeneration;
+        }
+        for (auto it = mapRegistered.begin(); it != mapRegistered.end();) {
+            if (it->second.nGeneration != nGeneration) {
+                Unregister(it->first, it->second.nEvents);
+                it = mapRegistered.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+};
+
+#ifdef USE_EPOLL
+class CSocketEventsEpoll : public CSocketEventsRegistered
+{
+private:
+    const int fdEpoll;
+    std::vector<struct epoll_event> vEvents;
+
+    static uint32_t ToEpoll(uint8_t nEvents)
+    {
+        uint32_t events = 0;
+        if (nEvents & SOCKET_EVENT_RECV) events |= EPOLLIN;
+        if (nEvents & SOCKET_EVENT_SEND) events |= EPOLLOUT;
+        return events;
+    }
+
+    void Register(SOCKET socket, uint8_t nOld, uint8_t nNew, bool fNew) override
+    {
+        struct epoll_event event = {};
+        event.events = ToEpoll(nNew);
+        event.data.fd = socket;
+        if (!fNew && epoll_ctl(fdEpoll, EPOLL_CTL_MOD, socket, &event) == 0) return;
+        if (epoll_ctl(fdEpoll, EPOLL_CTL_ADD, socket, &event) != 0 && errno != EEXIST) {
+            LogPrintf("%s: epoll_ctl add failed for socket %d: %s\n", __func__, socket, NetworkErrorString(errno));
+        }
+    }
+
+    void Unregister(SOCKET socket, uint8_t nOld) override
+    {
+        // closed sockets are dropped by the kernel: errors are expected here
+        struct epoll_event event = {};
+        epoll_ctl(fdEpoll, EPOLL_CTL_DEL, socket, &event);
+    }
+
+public:
+    explicit CSocketEventsEpoll(int fdEpollIn) : fdEpoll(fdEpollIn) {}
+    ~CSocketEventsEpoll() { close(fdEpoll); }
+
+    const char* GetName() const override { return "epoll"; }
+
+    bool Wait(const std::vector<SocketEventsRequest>& vRequests, std::map<SOCKET, uint8_t>& mapReady, int nTimeoutMs) override
+    {
+        UpdateRegistrations(vRequests);
+        vEvents.resize(std::max<size_t>(vRequests.size(), 1));
+        int nEvents = epoll_wait(fdEpoll, vEvents.data(), (int) vEvents.size(), nTimeoutMs);
+        if (nEvents < 0) {
+            if (errno == EINTR) return true;
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        for (int i = 0; i < nEvents; i++) {
+            const struct epoll_event& event = vEvents[i];
+            uint8_t nReady = 0;
+            if (event.events & EPOLLIN) nReady |= SOCKET_EVENT_RECV;
+            if (event.events & EPOLLOUT) nReady |= SOCKET_EVENT_SEND;
+            if (event.events & (EPOLLERR | EPOLLHUP)) nReady |= SOCKET_EVENT_ERR;
+            mapReady[event.data.fd] |= nReady;
+        }
+        return true;
+    }
+};
+#endif // USE_EPOLL
+
+#ifdef USE_KQUEUE
+class CSocketEventsKqueue : public CSocketEventsRegistered
+{
+private:
+    const int fdKqueue;
+    std::vector<struct kevent> vChanges;
+    std::vector<struct kevent> vEvents;
+
+    void AddChange(SOCKET socket, int16_t filter, uint16_t flags)
+    {
+        struct kevent change;
+        EV_SET(&change, socket, filter, flags | EV_RECEIPT, 0, 0, nullptr);
+        vChanges.push_back(change);
+    }
+
+    void Register(SOCKET socket, uint8_t nOld, uint8_t nNew, bool fNew) override
+    {
+        if ((nNew & SOCKET_EVENT_RECV) && !(nOld & SOCKET_EVENT_RECV)) AddChange(socket, EVFILT_READ, EV_ADD);
+        if (!(nNew & SOCKET_EVENT_RECV) && (nOld & SOCKET_EVENT_RECV)) AddChange(socket, EVFILT_READ, EV_DELETE);
+        if ((nNew & SOCKET_EVENT_SEND) && !(nOld & SOCKET_EVENT_SEND)) AddChange(socket, EVFILT_WRITE, EV_ADD);
+        if (!(nNew & SOCKET_EVENT_SEND) && (nOld & SOCKET_EVENT_SEND)) AddChange(socket, EVFILT_WRITE, EV_DELETE);
+    }
+
+    void Unregister(SOCKET socket, uint8_t nOld) override
+    {
+        Register(socket, nOld, 0, false);
+    }
+
+    void ApplyChanges()
+    {
+        if (vChanges.empty()) return;
+        // with EV_RECEIPT every change is acknowledged: failures only concern
+        // the filters of sockets already closed, which the kernel dropped.
+        vEvents.resize(vChanges.size());
+        kevent(fdKqueue, vChanges.data(), (int) vChanges.size(), vEvents.data(), (int) vEvents.size(), nullptr);
+        vChanges.clear();
+    }
+
+public:
+    explicit CSocketEventsKqueue(int fdKqueueIn) : fdKqueue(fdKqueueIn) {}
+    ~CSocketEventsKqueue() { close(fdKqueue); }
+
+    const char* GetName() const override { return "kqueue"; }
+
+    bool Wait(const std::vector<SocketEventsRequest>& vRequests, std::map<SOCKET, uint8_t>& mapReady, int nTimeoutMs) override
+    {
+        UpdateRegistrations(vRequests);
+        ApplyChanges();
+
+        struct timespec timeout;
+        timeout.tv_sec = nTimeoutMs / 1000;
+        timeout.tv_nsec = (nTimeoutMs % 1000) * 1000000;
+        vEvents.resize(std::max<size_t>(2 * vRequests.size(), 1));
+        int nEvents = kevent(fdKqueue, nullptr, 0, vEvents.data(), (int) vEvents.size(), &timeout);
+        if (nEvents < 0) {
+            if (errno == EINTR) return true;
+            LogPrintf("socket kevent error %s\n", NetworkErrorString(errno));
+            return false;
+        }
+        for (int i = 0; i < nEvents; i++) {
+            const struct kevent& event = vEvents[i];
+            uint8_t nReady = 0;
+            if (event.filter == EVFILT_READ) nReady |= SOCKET_EVENT_RECV;
+            if (event.filter == EVFILT_WRITE) nReady |= SOCKET_EVENT_SEND;
+            if (event.flags & EV_ERROR) nReady |= SOCKET_EVENT_ERR;
+            mapReady[(SOCKET) event.ident] |= nReady;
+        }
+        return true;
+    }
+};
+#endif // USE_KQUEUE
+
+} // namespace
+
+SocketEventsMode DefaultSocketEventsMode()
+{
+#if defined(USE_EPOLL)
+    return SocketEventsMode::EPOLL;
+#elif defined(USE_KQUEUE)
+    return SocketEventsMode::KQUEUE;
+#else
+    return SocketEventsMode::SELECT;
+#endif
+}
+
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode)
+{
+    if (strMode == "select") {
+        mode = SocketEventsMode::SELECT;
+        return true;
+    }
+#ifdef USE_EPOLL
+    if (strMode == "epoll") {
+        mode = SocketEventsMode::EPOLL;
+        return true;
+    }
+#endif
+#ifdef USE_KQUEUE
+    if (strMode == "kqueue") {
+        mode = SocketEventsMode::KQUEUE;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string SocketEventsModeToString(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SocketEventsMode::SELECT: return "select";
+    case SocketEventsMode::EPOLL: return "epoll";
+    case SocketEventsMode::KQUEUE: return "kqueue";
+    }
+    return "unknown";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string strModes = "select";
+#ifdef USE_EPOLL
+    strModes += ", epoll";
+#endif
+#ifdef USE_KQUEUE
+    strModes += ", kqueue";
+#endif
+    return strModes;
+}
+
+bool IsSocketEventsModeLimited(SocketEventsMode mode)
+{
+    return mode == SocketEventsMode::SELECT;
+}
+
+std::unique_ptr<CSocketEvents> MakeSocketEvents(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SocketEventsMode::SELECT:
+        return std::unique_ptr<CSocketEvents>(new CSocketEventsSelect());
+    case SocketEventsMode::EPOLL: {
+#ifdef USE_EPOLL
+        int fd = epoll_create1(EPOLL_CLOEXEC);
+        if (fd < 0) {
+            LogPrintf("%s: epoll_create1 failed: %s\n", __func__, NetworkErrorString(errno));
+            return nullptr;
+        }
+        return std::unique_ptr<CSocketEvents>(new CSocketEventsEpoll(fd));
+#else
+        return nullptr;
+#endif
+    }
+    case SocketEventsMode::KQUEUE: {
+#ifdef USE_KQUEUE
+        int fd = kqueue();
+        if (fd < 0) {
+            LogPrintf("%s: kqueue failed: %s\n", __func__, NetworkErrorString(errno));
+            return nullptr;
+        }
+        return std::unique_ptr<CSocketEvents>(new CSocketEventsKqueue(fd));
+#else
+        return nullptr;
+#endif
+    }
+    }
+    return nullptr;
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#if defined(HAVE_CONFIG_H)
+#include "config/dogecash-config.h"
+#endif
+
+#include "compat.h"
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** Socket readiness events */
+static const uint8_t SOCKET_EVENT_RECV = 0x01;
+static const uint8_t SOCKET_EVENT_SEND = 0x02;
+static const uint8_t SOCKET_EVENT_ERR = 0x04;
+
+enum class SocketEventsMode {
+    SELECT,
+    EPOLL,
+    KQUEUE,
+};
+
+/** A socket to wait on, and the events (SOCKET_EVENT_RECV/SEND) it is waited for */
+struct SocketEventsRequest {
+    SOCKET socket;
+    // Identifies the owner of the socket (-1 for the listening sockets): a closed
+    // socket descriptor can be reused by a new connection, which must then be
+    // registered again.
+    int64_t nOwner;
+    uint8_t nEvents;
+};
+
+/**
+ * Backend waiting for readiness events on the network sockets.
+ * Errors (SOCKET_EVENT_ERR) are always reported, whatever the requested events.
+ */
+class CSocketEvents
+{
+public:
+    virtual ~CSocketEvents() {}
+    virtual const char* GetName() const = 0;
+
+    /**
+     * Wait up to nTimeoutMs for the requested events.
+     * @param[in]  vRequests  the sockets to wait on (every socket must appear once)
+     * @param[out] mapReady   the events that are ready, per socket
+     * @return false on error (the caller is expected to back off)
+     */
+    virtual bool Wait(const std::vector<SocketEventsRequest>& vRequests, std::map<SOCKET, uint8_t>& mapReady, int nTimeoutMs) = 0;
+};
+
+/** Default -socketevents mode: the most scalable backend available */
+SocketEventsMode DefaultSocketEventsMode();
+/** Parse a -socketevents value. Returns false if unknown or not available on this platform */
+bool ParseSocketEventsMode(const std::string& strMode, SocketEventsMode& mode);
+std::string SocketEventsModeToString(SocketEventsMode mode);
+/** Comma separated list of the modes available on this platform */
+std::string GetSupportedSocketEventsModes();
+/** Whether the mode is bound by FD_SETSIZE */
+bool IsSocketEventsModeLimited(SocketEventsMode mode);
+
+/** Create the backend for the given mode. Returns nullptr if it can't be initialized */
+std::unique_ptr<CSocketEvents> MakeSocketEvents(SocketEventsMode mode);
+
+#endif // BITCOIN_SOCKETEVENTS_H
@@ -40,12 +40,39 @@ CSporkManager::CSporkManager()
         sporkDefsById.emplace(sporkDef.sporkId, &sporkDef);
         sporkDefsByName.emplace(sporkDef.name, &sporkDef);
     }
+    UpdateSporkValues();
 }
 
 void CSporkManager::Clear()
 {
+    LOCK(cs);
     strMasterPrivKey = "";
     mapSporksActive.clear();
+    UpdateSporkValues();
+}
+
+void CSporkManager::UpdateSporkValue(SporkId nSporkID)
+{
+    LOCK(cs);
+    const int nIndex = nSporkID - SPORK_ID_MIN;
+    if (nIndex < 0 || nIndex >= (int)vSporkValues.size()) return;
+
+    int64_t nValue = -1;
+    const auto& itActive = mapSporksActive.find(nSporkID);
+    if (itActive != mapSporksActive.end()) {
+        nValue = itActive->second.nValue;
+    } else {
+        const auto& itDef = sporkDefsById.find(nSporkID);
+        if (itDef != sporkDefsById.end()) nValue = itDef->second->defaultValue;
+    }
+    vSporkValues[nIndex].store(nValue, std::memory_order_release);
+}
+
+void CSporkManager::UpdateSporkValues()
+{
+    for (int nId = SPORK_ID_MIN; nId <= SPORK_ID_MAX; nId++) {
+        UpdateSporkValue((SporkId)nId);
+    }
 }
 
 // DOGEC: on startup load spork values from previous session if they exist in the sporkDB
@@ -75,8 +102,12 @@ void CSporkManager::LoadSporksFromDB()
         }
 
         // add spork to memory
-        mapSporks[spork.GetHash()] = spork;
-        mapSporksActive[spork.nSporkID] = spork;
+        {
+            LOCK(cs);
+            mapSporks[spork.GetHash()] = spork;
+            mapSporksActive[spork.nSporkID] = spork;
+            UpdateSporkValue(spork.nSporkID);
+        }
         std::time_t result = spork.nValue;
         // If SPORK Value is greater than 1,000,000 assume it's actually a Date and then convert to a more readable format
         std::string sporkName = sporkManager.GetSporkNameByID(spork.nSporkID);
@@ -178,6 +209,7 @@ int CSporkManager::ProcessSporkMsg(CSporkMessage& spork)
         LOCK(cs);
         mapSporks[hash] = spork;
         mapSporksActive[spork.nSporkID] = spork;
+        UpdateSporkValue(spork.nSporkID);
     }
     spork.Relay();
 
@@ -215,6 +247,7 @@ bool CSporkManager::UpdateSpork(SporkId nSporkID, int64_t nValue)
         LOCK(cs);
         mapSporks[spork.GetHash()] = spork;
         mapSporksActive[nSporkID] = spork;
+        UpdateSporkValue(nSporkID);
         return true;
     }
 
@@ -230,21 +263,13 @@ bool CSporkManager::IsSporkActive(SporkId nSporkID)
 // grab the value of the spork on the network, or the default
 int64_t CSporkManager::GetSporkValue(SporkId nSporkID)
 {
-    LOCK(cs);
-
-    if (mapSporksActive.count(nSporkID)) {
-        return mapSporksActive[nSporkID].nValue;
-
-    } else {
-        auto it = sporkDefsById.find(nSporkID);
-        if (it != sporkDefsById.end()) {
-            return it->second->defaultValue;
-        } else {
-            LogPrintf("%s : Unknown Spork %d\n", __func__, nSporkID);
-        }
+    // sporkDefsById is only written in the constructor, no lock needed
+    const int nIndex = nSporkID - SPORK_ID_MIN;
+    if (nIndex < 0 || nIndex >= (int)vSporkValues.size() || !sporkDefsById.count(nSporkID)) {
+        LogPrintf("%s : Unknown Spork %d\n", __func__, nSporkID);
+        return -1;
     }
-
-    return -1;
+    return vSporkValues[nIndex].load(std::memory_order_acquire);
 }
 
 SporkId CSporkManager::GetSporkIDByName(std::string strName)
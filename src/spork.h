@@ -19,6 +19,9 @@
 
 #include "protocol.h"
 
+#include <array>
+#include <atomic>
+
 
 class CSporkMessage;
 class CSporkManager;
@@ -92,6 +95,12 @@ private:
     std::map<SporkId, CSporkDef*> sporkDefsById;
     std::map<std::string, CSporkDef*> sporkDefsByName;
     std::map<SporkId, CSporkMessage> mapSporksActive;
+    // Current value (network or default) of each spork, indexed by nSporkID - SPORK_ID_MIN.
+    // Written with cs held whenever mapSporksActive changes, read without locking.
+    std::array<std::atomic<int64_t>, SPORK_ID_MAX - SPORK_ID_MIN + 1> vSporkValues;
+
+    void UpdateSporkValue(SporkId nSporkID);
+    void UpdateSporkValues();
 
 public:
     CSporkManager();
@@ -102,6 +111,7 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
         READWRITE(mapSporksActive);
+        if (ser_action.ForRead()) UpdateSporkValues();
         // we don't serialize private key to prevent its leakage
     }
 
@@ -6,7 +6,15 @@
 #include "sporkdb.h"
 #include "spork.h"
 
-CSporkDB::CSporkDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "sporks", nCacheSize, fMemory, fWipe) {}
+/** A few entries, all read at startup: no bloom filters */
+static CDBOptions SporkOptions(size_t nCacheSize)
+{
+    CDBOptions dbOptions(nCacheSize);
+    dbOptions.nBloomBits = 0;
+    return dbOptions;
+}
+
+CSporkDB::CSporkDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "sporks", SporkOptions(nCacheSize), fMemory, fWipe) {}
 
 bool CSporkDB::WriteSpork(const SporkId nSporkId, const CSporkMessage& spork)
 {
@@ -31,6 +31,10 @@ enum SporkId : int32_t {
     SPORK_INVALID                               = -1
 };
 
+// Range of the spork ids
+static const int SPORK_ID_MIN = SPORK_2_SWIFTTX;
+static const int SPORK_ID_MAX = SPORK_20_SAPLING_MAINTENANCE;
+
 // Default values
 struct CSporkDef
 {
@@ -10,13 +10,30 @@
 #include "txdb.h"
 #include "wallet/wallet.h"
 
-CDogeCashStake* CDogeCashStake::NewDogeCashStake(const CTxIn& txin)
+CDogeCashStake* CDogeCashStake::NewDogeCashStake(const CTxIn& txin, const CBlockIndex* pindexPrev)
 {
     if (txin.IsZerocoinSpend()) {
         error("%s: unable to initialize CDogeCashStake from zerocoin spend", __func__);
         return nullptr;
     }
 
+    // The unspent output and its height are in the coins: its transaction
+    // doesn't need to be read, from a block that may have been pruned
+    {
+        LOCK(cs_main);
+        Coin coin;
+        if (pcoinsTip->GetCoin(txin.prevout, coin) && !coin.IsSpent() && chainActive[coin.nHeight]) {
+            return new CDogeCashStake(coin.out, txin.prevout, chainActive[coin.nHeight]);
+        }
+        // A fork block can stake an output spent in the active chain after the
+        // fork point: the undo data of the block spending it has the coin
+        const CBlockIndex* pindexFork = pindexPrev ? chainActive.FindFork(pindexPrev) : nullptr;
+        if (pindexFork && GetCoinSpentAfterFork(txin.prevout, pindexFork, coin) &&
+                (int)coin.nHeight <= pindexFork->nHeight) {
+            return new CDogeCashStake(coin.out, txin.prevout, chainActive[coin.nHeight]);
+        }
+    }
+
     // Find the previous transaction in database
     uint256 hashBlock;
     CTransactionRef txPrev;
@@ -45,7 +45,8 @@ public:
     CDogeCashStake(const CTxOut& _from, const COutPoint& _outPointFrom, const CBlockIndex* _pindexFrom) :
             CStakeInput(_pindexFrom), outputFrom(_from), outpointFrom(_outPointFrom) {}
 
-    static CDogeCashStake* NewDogeCashStake(const CTxIn& txin);
+    // The input of a coinstake staked on top of pindexPrev
+    static CDogeCashStake* NewDogeCashStake(const CTxIn& txin, const CBlockIndex* pindexPrev);
 
     bool InitFromTxIn(const CTxIn& txin) override { return pindexFrom; }
     const CBlockIndex* GetIndexFrom() const override;
@@ -0,0 +1,177 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Memory resource for node based containers, handing out the small blocks
+ * from large chunks. Freed blocks are kept on a free list (one per block
+ * size) and reused; the chunks are released all at once when the resource is
+ * destroyed. Blocks larger than MAX_BLOCK_SIZE_BYTES, or with a stricter
+ * alignment than ALIGN_BYTES, are allocated with operator new.
+ *
+ * Not thread safe: each container (or set of containers used from the same
+ * thread) should have its own resource.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource
+{
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES >= alignof(void*) && ALIGN_BYTES <= alignof(std::max_align_t), "ALIGN_BYTES must be supported by operator new");
+
+    //! Freed blocks are linked through their first bytes
+    struct ListNode {
+        ListNode* next;
+    };
+
+    static constexpr std::size_t RoundToAlign(std::size_t bytes)
+    {
+        return ((bytes < sizeof(ListNode) ? sizeof(ListNode) : bytes) + ALIGN_BYTES - 1) & ~(ALIGN_BYTES - 1);
+    }
+
+    static constexpr std::size_t NUM_FREE_LISTS = RoundToAlign(MAX_BLOCK_SIZE_BYTES) / ALIGN_BYTES + 1;
+
+    const std::size_t nChunkSizeBytes;
+    std::vector<void*> vChunks;
+    std::array<ListNode*, NUM_FREE_LISTS> freeLists{};
+    //! Not yet used part of the last chunk
+    char* pAvailableBegin{nullptr};
+    char* pAvailableEnd{nullptr};
+
+    static bool IsPooled(std::size_t bytes, std::size_t alignment)
+    {
+        return bytes <= MAX_BLOCK_SIZE_BYTES && alignment <= ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, std::size_t nSize)
+    {
+        ListNode* node = new (p) ListNode;
+        node->next = freeLists[nSize / ALIGN_BYTES];
+        freeLists[nSize / ALIGN_BYTES] = node;
+    }
+
+    void AllocateChunk()
+    {
+        // what's left of the current chunk is smaller than any pooled block
+        const std::size_t nRemaining = pAvailableEnd - pAvailableBegin;
+        if (nRemaining > 0) PushFree(pAvailableBegin, nRemaining);
+        pAvailableBegin = static_cast<char*>(::operator new(nChunkSizeBytes));
+        pAvailableEnd = pAvailableBegin + nChunkSizeBytes;
+        vChunks.push_back(pAvailableBegin);
+    }
+
+public:
+    static const std::size_t DEFAULT_CHUNK_SIZE_BYTES = 256 * 1024;
+
+    explicit PoolResource(std::size_t nChunkSizeBytesIn = DEFAULT_CHUNK_SIZE_BYTES) :
+        nChunkSizeBytes(RoundToAlign(nChunkSizeBytesIn))
+    {
+        assert(nChunkSizeBytes >= RoundToAlign(MAX_BLOCK_SIZE_BYTES));
+    }
+
+    ~PoolResource()
+    {
+        for (void* chunk : vChunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment)) return ::operator new(bytes);
+        const std::size_t nSize = RoundToAlign(bytes);
+        ListNode*& head = freeLists[nSize / ALIGN_BYTES];
+        if (head) {
+            ListNode* node = head;
+            head = node->next;
+            return node;
+        }
+        if (static_cast<std::size_t>(pAvailableEnd - pAvailableBegin) < nSize) AllocateChunk();
+        void* p = pAvailableBegin;
+        pAvailableBegin += nSize;
+        return p;
+    }
+
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (!IsPooled(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        PushFree(p, RoundToAlign(bytes));
+    }
+
+    std::size_t NumAllocatedChunks() const { return vChunks.size(); }
+    std::size_t ChunkSizeBytes() const { return nChunkSizeBytes; }
+};
+
+/**
+ * Allocator using a PoolResource. The resource is shared by the copies of the
+ * allocator, and follows the container on copy, move and swap. A default
+ * constructed allocator gets a resource of its own.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+public:
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> Resource;
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <class U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator() : resource(std::make_shared<Resource>()) {}
+    explicit PoolAllocator(std::shared_ptr<Resource> resourceIn) : resource(std::move(resourceIn)) {}
+    template <class U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : resource(other.GetResource()) {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    const std::shared_ptr<Resource>& GetResource() const { return resource; }
+
+private:
+    std::shared_ptr<Resource> resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.GetResource() == b.GetResource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -5,6 +5,10 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/dogecash-config.h"
+#endif
+
 #include "sync.h"
 
 #include <memory>
@@ -15,6 +19,54 @@
 #include "util/threadnames.h"
 
 #include <stdio.h>
+#include <string.h>
+
+std::atomic<bool> g_lock_profiling{false};
+
+/* The registry of the call sites. Its own mutex is a plain one: locking it
+ * doesn't go through the profiling. */
+static std::mutex& LockSitesMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::vector<LockSiteStats*>& LockSites()
+{
+    static std::vector<LockSiteStats*> sites;
+    return sites;
+}
+
+LockSiteStats::LockSiteStats(const char* pszNameIn, const char* pszFileIn, int nLineIn) :
+    pszName(pszNameIn),
+    pszFile(pszFileIn),
+    nLine(nLineIn)
+{
+    std::lock_guard<std::mutex> lock(LockSitesMutex());
+    LockSites().push_back(this);
+}
+
+void SetLockProfiling(bool fEnable)
+{
+    g_lock_profiling = fEnable;
+}
+
+std::vector<const LockSiteStats*> GetLockSites()
+{
+    std::lock_guard<std::mutex> lock(LockSitesMutex());
+    return std::vector<const LockSiteStats*>(LockSites().begin(), LockSites().end());
+}
+
+void ResetLockSites()
+{
+    std::lock_guard<std::mutex> lock(LockSitesMutex());
+    for (LockSiteStats* pSite : LockSites()) {
+        pSite->nAcquired = 0;
+        pSite->nContended = 0;
+        pSite->nWaitMicros = 0;
+        pSite->nHeldMicros = 0;
+    }
+}
 
 #ifdef DEBUG_LOCKCONTENTION
 #if !defined(HAVE_THREAD_LOCAL)
@@ -27,6 +79,82 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+#if defined(HAVE_THREAD_LOCAL)
+static thread_local LockContentionStats g_thread_lock_contention;
+
+/* The slots of the locks whose hold time is measured: cs_main, and
+ * cs_wallet whichever wallet pointer it is locked through */
+enum { HELD_SLOT_MAIN, HELD_SLOT_WALLET, HELD_SLOTS };
+struct LockHeldState {
+    bool fTracking{false};
+    int nDepth[HELD_SLOTS]{};   //!< Recursive locks only count the outermost one
+    int64_t nStart[HELD_SLOTS]{};
+};
+static thread_local LockHeldState g_thread_lock_held;
+
+LockContentionStats GetThreadLockContention()
+{
+    return g_thread_lock_contention;
+}
+
+void RecordLockContention(int64_t nWaitMicros)
+{
+    g_thread_lock_contention.nContended++;
+    g_thread_lock_contention.nWaitMicros += nWaitMicros;
+}
+
+void SetThreadLockHeldTracking(bool fEnable)
+{
+    g_thread_lock_held.fTracking = fEnable;
+}
+
+static int LockHeldSlot(const char* pszName)
+{
+    if (strcmp(pszName, "cs_main") == 0)
+        return HELD_SLOT_MAIN;
+    // "cs_wallet", "pwallet->cs_wallet", "pwalletMain->cs_wallet"...
+    const size_t nLen = strlen(pszName);
+    if (nLen >= 9 && strcmp(pszName + nLen - 9, "cs_wallet") == 0)
+        return HELD_SLOT_WALLET;
+    return -1;
+}
+
+int EnterLockHeld(const char* pszName)
+{
+    LockHeldState& state = g_thread_lock_held;
+    if (!state.fTracking)
+        return -1;
+    const int nSlot = LockHeldSlot(pszName);
+    if (nSlot >= 0 && state.nDepth[nSlot]++ == 0)
+        state.nStart[nSlot] = GetTimeMicros();
+    return nSlot;
+}
+
+void LeaveLockHeld(int nSlot)
+{
+    if (nSlot < 0)
+        return;
+    LockHeldState& state = g_thread_lock_held;
+    if (--state.nDepth[nSlot] > 0)
+        return;
+    const int64_t nHeld = GetTimeMicros() - state.nStart[nSlot];
+    if (nSlot == HELD_SLOT_MAIN)
+        g_thread_lock_contention.nMainHeldMicros += nHeld;
+    else
+        g_thread_lock_contention.nWalletHeldMicros += nHeld;
+}
+#else
+LockContentionStats GetThreadLockContention()
+{
+    return LockContentionStats();
+}
+
+void RecordLockContention(int64_t nWaitMicros) {}
+void SetThreadLockHeldTracking(bool fEnable) {}
+int EnterLockHeld(const char* pszName) { return -1; }
+void LeaveLockHeld(int nSlot) {}
+#endif
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
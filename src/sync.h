@@ -12,9 +12,13 @@
 #include "threadsafety.h"
 #include "util/macros.h"
 
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
 #include <condition_variable>
 #include <thread>
 #include <mutex>
+#include <vector>
 
 
 /////////////////////////////////////////////////
@@ -117,55 +121,134 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** The locks the current thread had to wait for, held by other threads,
+ * and how long it held cs_main and cs_wallet itself (see SetThreadLockHeldTracking) */
+struct LockContentionStats {
+    uint64_t nContended{0};
+    int64_t nWaitMicros{0};
+    int64_t nMainHeldMicros{0};
+    int64_t nWalletHeldMicros{0};
+};
+
+/** The lock contention of the current thread so far (zero without thread_local support) */
+LockContentionStats GetThreadLockContention();
+void RecordLockContention(int64_t nWaitMicros);
+
+/** Measure (or stop measuring) how long the current thread holds cs_main and
+ * cs_wallet, e.g. while it runs an RPC command. Off by default: the other
+ * threads only pay a thread_local check per lock. */
+void SetThreadLockHeldTracking(bool fEnable);
+/** The outermost lock of cs_main or cs_wallet by the current thread starts
+ * the clock, and returns its slot; -1 for any other lock */
+int EnterLockHeld(const char* pszName);
+void LeaveLockHeld(int nSlot);
+
+/**
+ * The locking statistics of a LOCK call site, counted while the lock profiling is
+ * enabled: for finding which locks the threads wait for, and who holds them.
+ * One per call site, created the first time it is reached, and never destroyed
+ * before the exit.
+ */
+struct LockSiteStats {
+    const char* const pszName;
+    const char* const pszFile;
+    const int nLine;
+    std::atomic<uint64_t> nAcquired{0};
+    std::atomic<uint64_t> nContended{0};
+    std::atomic<int64_t> nWaitMicros{0};
+    std::atomic<int64_t> nHeldMicros{0};
+
+    LockSiteStats(const char* pszNameIn, const char* pszFileIn, int nLineIn);
+};
+
+/** Off by default: the locks then only pay a relaxed load of this flag */
+extern std::atomic<bool> g_lock_profiling;
+void SetLockProfiling(bool fEnable);
+/** The call sites reached so far */
+std::vector<const LockSiteStats*> GetLockSites();
+void ResetLockSites();
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock  : public Base
 {
 private:
-    void Enter(const char* pszName, const char* pszFile, int nLine)
+    int nHeldSlot{-1};
+    //! The call site that the hold time is added to, when profiled
+    LockSiteStats* pProfiledSite{nullptr};
+    std::chrono::steady_clock::time_point heldStart;
+
+    void StartProfile(LockSiteStats* pSite, int64_t nWaitMicros)
+    {
+        pSite->nAcquired.fetch_add(1, std::memory_order_relaxed);
+        if (nWaitMicros >= 0) {
+            pSite->nContended.fetch_add(1, std::memory_order_relaxed);
+            pSite->nWaitMicros.fetch_add(nWaitMicros, std::memory_order_relaxed);
+        }
+        pProfiledSite = pSite;
+        heldStart = std::chrono::steady_clock::now();
+    }
+
+    void Enter(const char* pszName, const char* pszFile, int nLine, LockSiteStats* pSite)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
-#ifdef DEBUG_LOCKCONTENTION
+        int64_t nWaitMicros = -1;
         if (!Base::try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
-        Base::lock();
-#ifdef DEBUG_LOCKCONTENTION
+            // Only a contended lock is timed
+            const auto start = std::chrono::steady_clock::now();
+            Base::lock();
+            nWaitMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            RecordLockContention(nWaitMicros);
         }
-#endif
+        nHeldSlot = EnterLockHeld(pszName);
+        if (pSite && g_lock_profiling.load(std::memory_order_relaxed))
+            StartProfile(pSite, nWaitMicros);
     }
 
-    bool TryEnter(const char* pszName, const char* pszFile, int nLine)
+    bool TryEnter(const char* pszName, const char* pszFile, int nLine, LockSiteStats* pSite)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()), true);
         Base::try_lock();
-        if (!Base::owns_lock())
+        if (!Base::owns_lock()) {
             LeaveCritical();
+        } else {
+            nHeldSlot = EnterLockHeld(pszName);
+            if (pSite && g_lock_profiling.load(std::memory_order_relaxed))
+                StartProfile(pSite, -1);
+        }
         return Base::owns_lock();
     }
 
 public:
-    UniqueLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : Base(mutexIn, std::defer_lock)
+    UniqueLock(Mutex& mutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false, LockSiteStats* pSite = nullptr) EXCLUSIVE_LOCK_FUNCTION(mutexIn) : Base(mutexIn, std::defer_lock)
     {
         if (fTry)
-            TryEnter(pszName, pszFile, nLine);
+            TryEnter(pszName, pszFile, nLine, pSite);
         else
-            Enter(pszName, pszFile, nLine);
+            Enter(pszName, pszFile, nLine, pSite);
     }
 
-    UniqueLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
+    UniqueLock(Mutex* pmutexIn, const char* pszName, const char* pszFile, int nLine, bool fTry = false, LockSiteStats* pSite = nullptr) EXCLUSIVE_LOCK_FUNCTION(pmutexIn)
     {
         if (!pmutexIn) return;
 
         *static_cast<Base*>(this) = Base(*pmutexIn, std::defer_lock);
         if (fTry)
-            TryEnter(pszName, pszFile, nLine);
+            TryEnter(pszName, pszFile, nLine, pSite);
         else
-            Enter(pszName, pszFile, nLine);
+            Enter(pszName, pszFile, nLine, pSite);
     }
 
     ~UniqueLock() UNLOCK_FUNCTION()
     {
+        if (pProfiledSite && Base::owns_lock()) {
+            const auto held = std::chrono::steady_clock::now() - heldStart;
+            pProfiledSite->nHeldMicros.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(held).count(), std::memory_order_relaxed);
+        }
+        LeaveLockHeld(nHeldSlot);
         if (Base::owns_lock())
             LeaveCritical();
     }
@@ -179,11 +262,15 @@ public:
 template<typename MutexArg>
 using DebugLock = UniqueLock<typename std::remove_reference<typename std::remove_pointer<MutexArg>::type>::type>;
 
-#define LOCK(cs) DebugLock<decltype(cs)> PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
+//! The stats of the call site, a static of its own lambda. WAIT_LOCK has none: its
+//! hold time would include the condition variable waits.
+#define LOCK_SITE(cs) ([]() -> LockSiteStats* { static LockSiteStats site(#cs, __FILE__, __LINE__); return &site; }())
+
+#define LOCK(cs) DebugLock<decltype(cs)> PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__, false, LOCK_SITE(cs))
 #define LOCK2(cs1, cs2)                                               \
-    DebugLock<decltype(cs1)> criticalblock1(cs1, #cs1, __FILE__, __LINE__); \
-    DebugLock<decltype(cs2)> criticalblock2(cs2, #cs2, __FILE__, __LINE__);
-#define TRY_LOCK(cs, name) DebugLock<decltype(cs)> name(cs, #cs, __FILE__, __LINE__, true)
+    DebugLock<decltype(cs1)> criticalblock1(cs1, #cs1, __FILE__, __LINE__, false, LOCK_SITE(cs1)); \
+    DebugLock<decltype(cs2)> criticalblock2(cs2, #cs2, __FILE__, __LINE__, false, LOCK_SITE(cs2));
+#define TRY_LOCK(cs, name) DebugLock<decltype(cs)> name(cs, #cs, __FILE__, __LINE__, true, LOCK_SITE(cs))
 #define WAIT_LOCK(cs, name) DebugLock<decltype(cs)> name(cs, #cs, __FILE__, __LINE__)
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
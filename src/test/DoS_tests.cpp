@@ -19,6 +19,7 @@
 #include "pow.h"
 #include "script/sign.h"
 #include "serialize.h"
+#include "txorphanage.h"
 #include "util.h"
 #include "validation.h"
 
@@ -26,16 +27,24 @@
 
 #include <boost/test/unit_test.hpp>
 
-// Tests this internal-to-validation.cpp method:
-extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
+class TxOrphanageTest : public TxOrphanage
+{
+public:
+    explicit TxOrphanageTest(size_t nMaxPeerBytesIn = MAX_ORPHAN_BYTES_PER_PEER) : TxOrphanage(nMaxPeerBytesIn) {}
+
+    CTransactionRef RandomOrphan()
+    {
+        OrphanMap::iterator it = mapOrphans.lower_bound(InsecureRand256());
+        if (it == mapOrphans.end())
+            it = mapOrphans.begin();
+        return it->second.tx;
+    }
+
+    bool IndexesEmpty() const
+    {
+        return mapOrphansByPrevout.empty() && vOrphanList.empty() && mapPeerBytes.empty();
+    }
 };
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-extern std::map<uint256, std::set<uint256> > mapOrphanTransactionsByPrev;
 
 CService ip(uint32_t i)
 {
@@ -134,17 +143,9 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     BOOST_CHECK(!connman->IsBanned(addr));
 }
 
-CTransactionRef RandomOrphan()
-{
-    std::map<uint256, COrphanTx>::iterator it;
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return it->second.tx;
-}
-
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
 {
+    TxOrphanageTest orphanage;
     CKey key;
     key.MakeNewKey(true);
     CBasicKeyStore keystore;
@@ -162,13 +163,13 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(tx), i);
     }
 
     // ... and 50 that depend on other orphans:
     for (int i = 0; i < 50; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vin.resize(1);
@@ -179,13 +180,13 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
         SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(tx), i);
     }
 
     // This really-big orphan should be ignored:
     for (int i = 0; i < 10; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vout.resize(1);
@@ -203,25 +204,93 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
+        BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i));
     }
 
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++)
     {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
+        size_t sizeBefore = orphanage.Size();
+        orphanage.EraseForPeer(i);
+        BOOST_CHECK(orphanage.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(orphanage.PeerBytes(i), 0U);
     }
 
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
-    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    // Test LimitOrphans() function:
+    orphanage.LimitOrphans(40);
+    BOOST_CHECK(orphanage.Size() <= 40);
+    orphanage.LimitOrphans(10);
+    BOOST_CHECK(orphanage.Size() <= 10);
+    orphanage.LimitOrphans(0);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+    BOOST_CHECK(orphanage.IndexesEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanChildrenAndBudget)
+{
+    // Room for two orphans of the size below per peer
+    CMutableTransaction parent;
+    parent.vin.resize(1);
+    parent.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    parent.vout.resize(2);
+    parent.vout[0].nValue = 1*CENT;
+    parent.vout[1].nValue = 1*CENT;
+    const CTransactionRef ptxParent = MakeTransactionRef(parent);
+    TxOrphanageTest orphanage(2 * ptxParent->GetTotalSize() + 10);
+
+    // Two children of a parent we don't know about, one spending both outputs
+    CMutableTransaction child1;
+    child1.vin.resize(1);
+    child1.vin[0].prevout = COutPoint(ptxParent->GetHash(), 0);
+    child1.vout.resize(1);
+    child1.vout[0].nValue = 1*CENT;
+    CMutableTransaction child2;
+    child2.vin.resize(2);
+    child2.vin[0].prevout = COutPoint(ptxParent->GetHash(), 0);
+    child2.vin[1].prevout = COutPoint(ptxParent->GetHash(), 1);
+    child2.vout.resize(1);
+    child2.vout[0].nValue = 2*CENT;
+    const CTransactionRef ptxChild1 = MakeTransactionRef(child1);
+    const CTransactionRef ptxChild2 = MakeTransactionRef(child2);
+
+    BOOST_CHECK(orphanage.AddTx(ptxChild1, 0));
+    BOOST_CHECK(!orphanage.AddTx(ptxChild1, 1)); // known already
+    BOOST_CHECK(orphanage.AddTx(ptxChild2, 1));
+    BOOST_CHECK(orphanage.HaveTx(ptxChild2->GetHash()));
+
+    // Both are found from the parent, once each
+    std::vector<uint256> vChildren = orphanage.GetChildren(*ptxParent);
+    BOOST_CHECK_EQUAL(vChildren.size(), 2U);
+    BOOST_CHECK(std::count(vChildren.begin(), vChildren.end(), ptxChild1->GetHash()) == 1);
+    BOOST_CHECK(std::count(vChildren.begin(), vChildren.end(), ptxChild2->GetHash()) == 1);
+    BOOST_CHECK(orphanage.GetChildren(*ptxChild1).empty());
+
+    CTransactionRef ptxOut;
+    NodeId peerOut = -1;
+    BOOST_CHECK(orphanage.GetTx(ptxChild2->GetHash(), ptxOut, peerOut));
+    BOOST_CHECK(ptxOut == ptxChild2);
+    BOOST_CHECK_EQUAL(peerOut, 1);
+
+    // Peer 2 runs out of budget, without affecting the others
+    for (int i = 0; i < 3; i++) {
+        CMutableTransaction orphan;
+        orphan.vin.resize(1);
+        orphan.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        orphan.vout.resize(2);
+        BOOST_CHECK_EQUAL(orphanage.AddTx(MakeTransactionRef(orphan), 2), i < 2);
+    }
+    BOOST_CHECK(orphanage.PeerBytes(2) <= 2 * ptxParent->GetTotalSize() + 10);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 4U);
+
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(ptxChild1->GetHash()), 1);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(ptxChild1->GetHash()), 0);
+    BOOST_CHECK_EQUAL(orphanage.PeerBytes(0), 0U);
+    vChildren = orphanage.GetChildren(*ptxParent);
+    BOOST_CHECK_EQUAL(vChildren.size(), 1U);
+    BOOST_CHECK(vChildren[0] == ptxChild2->GetHash());
+
+    orphanage.LimitOrphans(0);
+    BOOST_CHECK(orphanage.IndexesEmpty());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -227,6 +227,42 @@ BOOST_AUTO_TEST_CASE(addrman_select)
     BOOST_CHECK_EQUAL(ports.size(), 3);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_select_snapshot)
+{
+    CAddrManTest addrman;
+
+    // Set addrman addr placement to be deterministic.
+    addrman.MakeDeterministic();
+
+    CNetAddr source = ResolveIP("252.2.2.2");
+
+    BOOST_CHECK(addrman.SelectFromSnapshot().ToString() == "[::]:0");
+
+    // Small tables are copied again at every change
+    CService addr1 = ResolveService("250.1.1.1", 8333);
+    addrman.Add(CAddress(addr1, NODE_NONE), source);
+    BOOST_CHECK(addrman.SelectFromSnapshot().ToString() == "250.1.1.1:8333");
+    BOOST_CHECK(addrman.SelectFromSnapshot(true).ToString() == "250.1.1.1:8333");
+
+    addrman.Good(CAddress(addr1, NODE_NONE));
+    BOOST_CHECK(addrman.SelectFromSnapshot(true).ToString() == "[::]:0");
+    BOOST_CHECK(addrman.SelectFromSnapshot().ToString() == "250.1.1.1:8333");
+
+    // Both tables are selected from
+    CService addr2 = ResolveService("250.3.1.1", 8333);
+    addrman.Add(CAddress(addr2, NODE_NONE), source);
+    BOOST_CHECK(addrman.SelectFromSnapshot(true).ToString() == "250.3.1.1:8333");
+    std::set<std::string> addrs;
+    for (int i = 0; i < 50; ++i) {
+        addrs.insert(addrman.SelectFromSnapshot().ToString());
+    }
+    BOOST_CHECK_EQUAL(addrs.size(), 2);
+
+    // Clear drops the snapshot
+    addrman.Clear();
+    BOOST_CHECK(addrman.SelectFromSnapshot().ToString() == "[::]:0");
+}
+
 BOOST_AUTO_TEST_CASE(addrman_new_collisions)
 {
     CAddrManTest addrman;
@@ -0,0 +1,121 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "banlist.h"
+#include "netbase.h"
+#include "test/test_dogecash.h"
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(banlist_tests, BasicTestingSetup)
+
+static CNetAddr ResolveIP(const std::string& ip)
+{
+    CNetAddr addr;
+    LookupHost(ip.c_str(), addr, false);
+    return addr;
+}
+
+static CSubNet ResolveSubNet(const char* subnet)
+{
+    CSubNet ret;
+    LookupSubNet(subnet, ret);
+    return ret;
+}
+
+static CBanEntry BanUntil(int64_t nBanUntil)
+{
+    CBanEntry banEntry(0);
+    banEntry.nBanUntil = nBanUntil;
+    return banEntry;
+}
+
+static bool SameBans(const banmap_t& a, const banmap_t& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+        [](const banmap_t::value_type& x, const banmap_t::value_type& y) {
+            return x.first == y.first && x.second.nBanUntil == y.second.nBanUntil;
+        });
+}
+
+BOOST_AUTO_TEST_CASE(banlist_match)
+{
+    CBanList banList;
+    BOOST_CHECK(banList.Add(ResolveSubNet("1.2.3.0/24"), BanUntil(100)));
+    BOOST_CHECK(banList.Add(ResolveSubNet("1.2.0.0/16"), BanUntil(50)));
+    BOOST_CHECK(banList.Add(ResolveSubNet("2001:db8::/32"), BanUntil(100)));
+    BOOST_CHECK(banList.Add(CSubNet(ResolveIP("5wyqrzbvrdsumnok.onion")), BanUntil(100)));
+    BOOST_CHECK(banList.Add(ResolveSubNet("10.0.0.1/255.0.255.0"), BanUntil(100)));
+    // a shorter ban doesn't replace a longer one
+    BOOST_CHECK(!banList.Add(ResolveSubNet("1.2.3.0/24"), BanUntil(80)));
+
+    BOOST_CHECK(banList.IsBanned(ResolveIP("1.2.3.4"), 60));
+    BOOST_CHECK(banList.IsBanned(ResolveIP("1.2.4.4"), 40));
+    BOOST_CHECK(!banList.IsBanned(ResolveIP("1.2.4.4"), 60));
+    BOOST_CHECK(!banList.IsBanned(ResolveIP("1.3.3.4"), 40));
+    BOOST_CHECK(banList.IsBanned(ResolveIP("2001:db8:1::1"), 60));
+    BOOST_CHECK(!banList.IsBanned(ResolveIP("2001:db9::1"), 60));
+    BOOST_CHECK(banList.IsBanned(ResolveIP("5wyqrzbvrdsumnok.onion"), 60));
+    BOOST_CHECK(!banList.IsBanned(ResolveIP("5wyqrzbvrdsumnol.onion"), 60));
+    BOOST_CHECK(banList.IsBanned(ResolveIP("10.7.0.9"), 60));
+    BOOST_CHECK(!banList.IsBanned(ResolveIP("10.7.1.9"), 60));
+    BOOST_CHECK(banList.IsBanned(ResolveSubNet("1.2.0.0/16"), 40));
+    BOOST_CHECK(!banList.IsBanned(ResolveSubNet("1.2.0.0/15"), 40));
+
+    // the expired bans only are swept
+    std::vector<CSubNet> vRemoved = banList.Sweep(60);
+    BOOST_CHECK_EQUAL(vRemoved.size(), 1);
+    BOOST_CHECK(vRemoved[0] == ResolveSubNet("1.2.0.0/16"));
+    BOOST_CHECK_EQUAL(banList.size(), 4);
+    BOOST_CHECK(banList.IsBanned(ResolveIP("1.2.3.4"), 60));
+
+    BOOST_CHECK(banList.Remove(ResolveSubNet("1.2.3.0/24")));
+    BOOST_CHECK(!banList.Remove(ResolveSubNet("1.2.3.0/24")));
+    BOOST_CHECK(!banList.IsBanned(ResolveIP("1.2.3.4"), 60));
+    BOOST_CHECK(banList.Sweep(60).empty());
+    BOOST_CHECK_EQUAL(banList.Sweep(200).size(), 3);
+    BOOST_CHECK_EQUAL(banList.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(banlist_match_random)
+{
+    // The trie gives the same answers as matching every subnet
+    CBanList banList;
+    banmap_t banMap;
+    for (int i = 0; i < 300; i++) {
+        const std::string strIP = strprintf("%d.%d.%d.%d", InsecureRandRange(4), InsecureRandRange(4), InsecureRandRange(256), InsecureRandRange(256));
+        const CSubNet subNet(ResolveIP(strIP), 8 + InsecureRandRange(25));
+        const CBanEntry banEntry = BanUntil(1 + InsecureRandRange(100));
+        banList.Add(subNet, banEntry);
+        if (banMap[subNet].nBanUntil < banEntry.nBanUntil)
+            banMap[subNet] = banEntry;
+    }
+    BOOST_CHECK(SameBans(banList.GetMap(), banMap));
+
+    for (int nRound = 0; nRound < 2; nRound++) {
+        for (int i = 0; i < 1000; i++) {
+            const int64_t nNow = InsecureRandRange(100);
+            const CNetAddr addr = ResolveIP(strprintf("%d.%d.%d.%d", InsecureRandRange(4), InsecureRandRange(4), InsecureRandRange(256), InsecureRandRange(256)));
+            bool fBanned = false;
+            for (const auto& it : banMap)
+                fBanned |= it.first.Match(addr) && nNow < it.second.nBanUntil;
+            BOOST_CHECK_EQUAL(banList.IsBanned(addr, nNow), fBanned);
+        }
+        // the same after sweeping, and removing some
+        banList.Sweep(50);
+        for (auto it = banMap.begin(); it != banMap.end();) {
+            if (it->second.nBanUntil < 50 || InsecureRandBool()) {
+                banList.Remove(it->first);
+                it = banMap.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        BOOST_CHECK(SameBans(banList.GetMap(), banMap));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
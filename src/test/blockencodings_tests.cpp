@@ -0,0 +1,152 @@
+// Copyright (c) 2011-2016 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_dogecash.h"
+
+#include "blockencodings.h"
+#include "consensus/merkle.h"
+#include "streams.h"
+#include "txmempool.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, TestingSetup)
+
+static CMutableTransaction BuildSpend(const uint256& hashPrev, uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev, n);
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx.vout[0].nValue = 1000;
+    return tx;
+}
+
+/** A block made of a coinbase, a coinstake if fProofOfStake, and three spends */
+static CBlock BuildBlock(bool fProofOfStake)
+{
+    CBlock block;
+    block.nBits = 0x207fffff;
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_1;
+    coinbase.vout.resize(1);
+    if (!fProofOfStake) {
+        coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        coinbase.vout[0].nValue = 10000;
+    }
+    block.vtx.emplace_back(MakeTransactionRef(coinbase));
+
+    if (fProofOfStake) {
+        CMutableTransaction coinstake = BuildSpend(InsecureRand256(), 0);
+        coinstake.vout.resize(2);
+        coinstake.vout[0].SetEmpty();
+        coinstake.vout[1].scriptPubKey = CScript() << OP_TRUE;
+        coinstake.vout[1].nValue = 10000;
+        block.vtx.emplace_back(MakeTransactionRef(coinstake));
+        block.vchBlockSig = {0x30, 0x01, 0x02, 0x03};
+    }
+
+    const uint256 hashFunding = InsecureRand256();
+    for (uint32_t i = 0; i < 3; i++) {
+        block.vtx.emplace_back(MakeTransactionRef(BuildSpend(hashFunding, i)));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    return block;
+}
+
+static CBlockHeaderAndShortTxIDs RoundTrip(const CBlockHeaderAndShortTxIDs& cmpctblock)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << cmpctblock;
+    CBlockHeaderAndShortTxIDs cmpctblock2;
+    stream >> cmpctblock2;
+    return cmpctblock2;
+}
+
+BOOST_AUTO_TEST_CASE(SimpleRoundTripTest)
+{
+    for (bool fProofOfStake : {false, true}) {
+        CTxMemPool pool(CFeeRate(0));
+        TestMemPoolEntryHelper entry;
+        CBlock block = BuildBlock(fProofOfStake);
+        BOOST_CHECK_EQUAL(block.IsProofOfStake(), fProofOfStake);
+        const size_t nFirstSpend = fProofOfStake ? 2 : 1;
+
+        // All the spends but the last one are in the mempool
+        for (size_t i = nFirstSpend; i < block.vtx.size() - 1; i++) {
+            CMutableTransaction tx(*block.vtx[i]);
+            pool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+        }
+
+        const CBlockHeaderAndShortTxIDs cmpctblock = RoundTrip(CBlockHeaderAndShortTxIDs(block));
+        BOOST_CHECK_EQUAL(cmpctblock.BlockTxCount(), block.vtx.size());
+        BOOST_CHECK(cmpctblock.vchBlockSig == block.vchBlockSig);
+
+        PartiallyDownloadedBlock partialBlock(&pool);
+        BOOST_CHECK(partialBlock.InitData(cmpctblock) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), block.vtx.size() - nFirstSpend - 1);
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            // The coinbase and the coinstake are prefilled
+            BOOST_CHECK_EQUAL(partialBlock.IsTxAvailable(i), i != block.vtx.size() - 1);
+        }
+
+        // The wrong missing transaction gives a block that doesn't match its merkle root
+        CBlock block2;
+        {
+            PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+            BOOST_CHECK(partialBlockCopy.FillBlock(block2, {block.vtx[nFirstSpend]}) == READ_STATUS_FAILED);
+        }
+        // Too many missing transactions
+        {
+            PartiallyDownloadedBlock partialBlockCopy = partialBlock;
+            BOOST_CHECK(partialBlockCopy.FillBlock(block2, {block.vtx.back(), block.vtx.back()}) == READ_STATUS_INVALID);
+        }
+
+        BOOST_CHECK(partialBlock.FillBlock(block2, {block.vtx.back()}) == READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block2.GetHash().ToString(), block.GetHash().ToString());
+        BOOST_CHECK(block2.vchBlockSig == block.vchBlockSig);
+        BOOST_CHECK_EQUAL(block2.vtx.size(), block.vtx.size());
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            BOOST_CHECK(block2.vtx[i]->GetHash() == block.vtx[i]->GetHash());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EmptyMempoolTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    CBlock block = BuildBlock(true);
+
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(RoundTrip(CBlockHeaderAndShortTxIDs(block))) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(partialBlock.GetMempoolCount(), 0U);
+
+    std::vector<CTransactionRef> vtx_missing(block.vtx.begin() + 2, block.vtx.end());
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block2.GetHash().ToString(), block.GetHash().ToString());
+}
+
+BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest)
+{
+    BlockTransactionsRequest req1;
+    req1.blockhash = InsecureRand256();
+    req1.indexes = {0, 1, 3, 4, 0xffff};
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << req1;
+
+    BlockTransactionsRequest req2;
+    stream >> req2;
+
+    BOOST_CHECK_EQUAL(req1.blockhash.ToString(), req2.blockhash.ToString());
+    BOOST_CHECK(req1.indexes == req2.indexes);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_dogecash.h"
+#include "blockfileflusher.h"
+#include "validation.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfileflusher_tests, TestingSetup)
+
+// Files far from the ones of the genesis block
+static const int TEST_FILE = 9000;
+
+static uint64_t FileSize(int nFile, bool fUndo)
+{
+    return fs::file_size(GetBlockPosFilename(CDiskBlockPos(nFile, 0), fUndo ? "rev" : "blk"));
+}
+
+static void WriteData(int nFile, bool fUndo, unsigned int nPos, unsigned int nLength)
+{
+    CDiskBlockPos pos(nFile, nPos);
+    FILE* file = fUndo ? OpenUndoFile(pos) : OpenBlockFile(pos);
+    BOOST_REQUIRE(file);
+    std::vector<unsigned char> vData(nLength, 0x5a);
+    BOOST_CHECK_EQUAL(fwrite(vData.data(), 1, vData.size(), file), vData.size());
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(inline_without_thread)
+{
+    // not started: the tasks are done on return
+    CBlockFileFlusher flusher;
+    WriteData(TEST_FILE, false, 0, 1000);
+    WriteData(TEST_FILE, true, 0, 100);
+    flusher.Finalize(TEST_FILE, 600, 50);
+    BOOST_CHECK_EQUAL(FileSize(TEST_FILE, false), 600);
+    BOOST_CHECK_EQUAL(FileSize(TEST_FILE, true), 50);
+}
+
+BOOST_AUTO_TEST_CASE(queued_in_order)
+{
+    CBlockFileFlusher flusher;
+    flusher.Start();
+    WriteData(TEST_FILE + 1, false, 0, 1000);
+    WriteData(TEST_FILE + 1, true, 0, 1000);
+    flusher.Allocate(false, TEST_FILE + 1, 1000, 1 << 16);
+    flusher.Commit(TEST_FILE + 1);
+    flusher.Finalize(TEST_FILE + 1, 1000, 800);
+
+    // a write past the finalized size waits for the truncation
+    flusher.WaitForWrite(true, TEST_FILE + 1, 800, 900);
+    BOOST_CHECK_EQUAL(FileSize(TEST_FILE + 1, true), 800);
+    flusher.Sync();
+    BOOST_CHECK_EQUAL(FileSize(TEST_FILE + 1, false), 1000);
+
+    // the tasks queued before Stop are completed, the next ones run inline
+    flusher.Finalize(TEST_FILE + 1, 500, 500);
+    flusher.Stop();
+    BOOST_CHECK_EQUAL(FileSize(TEST_FILE + 1, false), 500);
+    flusher.Finalize(TEST_FILE + 1, 400, 400);
+    BOOST_CHECK_EQUAL(FileSize(TEST_FILE + 1, true), 400);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
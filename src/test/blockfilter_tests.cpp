@@ -0,0 +1,155 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "key.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "test/test_dogecash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    GCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        GCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(std::move(element1));
+
+        GCSFilter::Element element2(32);
+        element2[1] = i;
+        excluded_elements.insert(std::move(element2));
+    }
+
+    GCSFilter filter({0, 0, 10, 1 << 10}, included_elements);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        auto insertion = excluded_elements.insert(element);
+        BOOST_CHECK(filter.MatchAny(excluded_elements));
+        excluded_elements.erase(insertion.first);
+    }
+
+    // the filter decodes back from its encoding
+    GCSFilter decoded({0, 0, 10, 1 << 10}, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), 100U);
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(decoded.Match(element));
+    }
+
+    // trailing data, or too few elements, are rejected
+    std::vector<unsigned char> encoded = filter.GetEncoded();
+    encoded.push_back(0);
+    BOOST_CHECK_THROW(GCSFilter({0, 0, 10, 1 << 10}, encoded), std::ios_base::failure);
+    encoded.resize(encoded.size() / 2);
+    BOOST_CHECK_THROW(GCSFilter({0, 0, 10, 1 << 10}, encoded), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
+{
+    GCSFilter filter;
+    BOOST_CHECK_EQUAL(filter.GetN(), 0U);
+    BOOST_CHECK_EQUAL(filter.GetEncoded().size(), 1U);
+
+    const GCSFilter::Params& params = filter.GetParams();
+    BOOST_CHECK_EQUAL(params.m_siphash_k0, 0U);
+    BOOST_CHECK_EQUAL(params.m_siphash_k1, 0U);
+    BOOST_CHECK_EQUAL(params.m_P, 0);
+    BOOST_CHECK_EQUAL(params.m_M, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CKey owner, staker, spender;
+    owner.MakeNewKey(true);
+    staker.MakeNewKey(true);
+    spender.MakeNewKey(true);
+
+    CScript included_scripts[4], excluded_scripts[3];
+
+    // Output scripts, the cold staking delegations included
+    included_scripts[0] << std::vector<unsigned char>(0, 65) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(1, 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    included_scripts[2] = GetScriptForStakeDelegation(staker.GetPubKey().GetID(), owner.GetPubKey().GetID());
+
+    // Script spent by the block
+    included_scripts[3] = GetScriptForDestination(spender.GetPubKey().GetID());
+
+    // OP_RETURN output
+    excluded_scripts[0] << OP_RETURN << std::vector<unsigned char>(4, 40);
+    // Script not in the block
+    excluded_scripts[1] = GetScriptForStakeDelegation(owner.GetPubKey().GetID(), staker.GetPubKey().GetID());
+    // Empty output script (coinstake marker)
+    excluded_scripts[2] = CScript();
+
+    CMutableTransaction tx_1;
+    tx_1.vout.resize(3);
+    tx_1.vout[0].scriptPubKey = included_scripts[0];
+    tx_1.vout[1].scriptPubKey = included_scripts[1];
+    tx_1.vout[2].scriptPubKey = excluded_scripts[2];
+
+    CMutableTransaction tx_2;
+    tx_2.vout.resize(2);
+    tx_2.vout[0].scriptPubKey = included_scripts[2];
+    tx_2.vout[1].scriptPubKey = excluded_scripts[0];
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx_1));
+    block.vtx.push_back(MakeTransactionRef(tx_2));
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[3]), 1000, true, false);
+
+    BlockFilter block_filter(BlockFilterType::BASIC, block, block_undo);
+    const GCSFilter& filter = block_filter.GetFilter();
+
+    BOOST_CHECK_EQUAL(filter.GetN(), 4U);
+    for (const CScript& script : included_scripts) {
+        BOOST_CHECK(filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+    for (const CScript& script : excluded_scripts) {
+        BOOST_CHECK(!filter.Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+
+    // Test serialization/unserialization.
+    BlockFilter block_filter2;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block_filter;
+    stream >> block_filter2;
+
+    BOOST_CHECK(block_filter.GetFilterType() == block_filter2.GetFilterType());
+    BOOST_CHECK_EQUAL(block_filter.GetBlockHash(), block_filter2.GetBlockHash());
+    BOOST_CHECK(block_filter.GetEncodedFilter() == block_filter2.GetEncodedFilter());
+
+    BlockFilter default_ctor_block_filter_1;
+    BlockFilter default_ctor_block_filter_2;
+    BOOST_CHECK(default_ctor_block_filter_1.GetFilterType() == default_ctor_block_filter_2.GetFilterType());
+    BOOST_CHECK_EQUAL(default_ctor_block_filter_1.GetBlockHash(), default_ctor_block_filter_2.GetBlockHash());
+    BOOST_CHECK(default_ctor_block_filter_1.GetEncodedFilter() == default_ctor_block_filter_2.GetEncodedFilter());
+
+    // The header commits to the previous one
+    const uint256 header = block_filter.ComputeHeader(uint256());
+    BOOST_CHECK(header != block_filter.ComputeHeader(header));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(255)), "");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::BASIC);
+
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
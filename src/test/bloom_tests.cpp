@@ -8,9 +8,11 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "consensus/merkle.h"
 #include "key.h"
 #include "merkleblock.h"
 #include "random.h"
+#include "script/standard.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
@@ -462,6 +464,47 @@ static std::vector<unsigned char> RandomData()
     return std::vector<unsigned char>(r.begin(), r.end());
 }
 
+BOOST_AUTO_TEST_CASE(merkle_block_shared_data)
+{
+    // A block paying to (and spending from) a few keys, some of them in the filters
+    std::vector<CKey> vKeys(8);
+    for (CKey& key : vKeys)
+        key.MakeNewKey(true);
+    CBlock block;
+    for (unsigned int i = 0; i < 40; i++) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(i > 0 ? block.vtx[i - 1]->GetHash() : GetRandHash(), 0));
+        tx.vin[0].scriptSig << ToByteVector(vKeys[i % 3].GetPubKey());
+        tx.vout.emplace_back(i, GetScriptForRawPubKey(vKeys[i % 8].GetPubKey()));
+        tx.vout.emplace_back(i, GetScriptForDestination(vKeys[(i + 5) % 8].GetPubKey().GetID()));
+        block.vtx.emplace_back(MakeTransactionRef(tx));
+    }
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    const CFilteredBlockData blockData(std::make_shared<const CBlock>(block));
+
+    for (unsigned char nFlags : {BLOOM_UPDATE_NONE, BLOOM_UPDATE_ALL, BLOOM_UPDATE_P2PUBKEY_ONLY}) {
+        for (unsigned int k = 0; k < 4; k++) {
+            CBloomFilter filter1(10, 0.0001, InsecureRand32(), nFlags);
+            filter1.insert(ToByteVector(vKeys[k + 3].GetPubKey()));
+            if (k == 0) filter1.insert(ToByteVector(vKeys[1].GetPubKey().GetID()));
+            CBloomFilter filter2 = filter1;
+
+            // The shared data gives the same merkle block, and updates the filter the same way
+            CMerkleBlock merkleBlock1(block, filter1);
+            CMerkleBlock merkleBlock2(blockData, filter2);
+            BOOST_CHECK(merkleBlock1.vMatchedTxn == merkleBlock2.vMatchedTxn);
+            CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+            ss1 << merkleBlock1 << filter1;
+            ss2 << merkleBlock2 << filter2;
+            BOOST_CHECK(ss1.str() == ss2.str());
+
+            std::vector<uint256> vMatched;
+            BOOST_CHECK(merkleBlock2.txn.ExtractMatches(vMatched) == block.hashMerkleRoot);
+            BOOST_CHECK_EQUAL(vMatched.size(), merkleBlock2.vMatchedTxn.size());
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(rolling_bloom)
 {
     // last-100-entry, 1% false positive:
@@ -533,4 +576,30 @@ BOOST_AUTO_TEST_CASE(rolling_bloom)
     }
 }
 
+BOOST_AUTO_TEST_CASE(hash_bloom)
+{
+    // 1000 entries, 1% false positive, far beyond the protocol size limit
+    CHashBloomFilter hb(1000, 0.01);
+
+    std::vector<uint256> data;
+    for (int i = 0; i < 1000; i++) {
+        data.emplace_back(GetRandHash());
+        hb.insert(data.back());
+    }
+    BOOST_CHECK_EQUAL(hb.size(), 1000);
+    // No false negative
+    for (const uint256& hash : data) {
+        BOOST_CHECK(hb.contains(hash));
+    }
+
+    // About 100 false positives out of 10,000 random keys, when full
+    unsigned int nHits = 0;
+    for (int i = 0; i < 10000; i++) {
+        if (hb.contains(GetRandHash()))
+            ++nHits;
+    }
+    BOOST_TEST_MESSAGE("HashBloomFilter got " << nHits << " false positives (~100 expected)");
+    BOOST_CHECK(nHits < 175);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -100,4 +100,25 @@ BOOST_AUTO_TEST_CASE(block_value)
     BOOST_CHECK(!t_budgetman.IsBlockValueValid(nHeight, nExpected, nExpected+propAmt, false));
 }
 
+BOOST_AUTO_TEST_CASE(budget_collateral_candidate)
+{
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    mtx.vout.emplace_back(BUDGET_FEE_TX, CScript() << OP_RETURN << ToByteVector(GetRandHash()));
+    BOOST_CHECK(IsBudgetCollateralCandidate(CTransaction(mtx)));
+
+    // The fee is too low
+    mtx.vout[0].nValue = BUDGET_FEE_TX - 1;
+    BOOST_CHECK(!IsBudgetCollateralCandidate(CTransaction(mtx)));
+
+    // The OP_RETURN doesn't commit to a hash
+    mtx.vout[0] = CTxOut(PROPOSAL_FEE_TX, CScript() << OP_RETURN << std::vector<unsigned char>(20, 0x01));
+    BOOST_CHECK(!IsBudgetCollateralCandidate(CTransaction(mtx)));
+
+    // CheckCollateral rejects a lock time
+    mtx.vout[0] = CTxOut(PROPOSAL_FEE_TX, CScript() << OP_RETURN << ToByteVector(GetRandHash()));
+    mtx.nLockTime = 1;
+    BOOST_CHECK(!IsBudgetCollateralCandidate(CTransaction(mtx)));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
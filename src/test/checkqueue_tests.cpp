@@ -0,0 +1,58 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_dogecash.h"
+
+#include <atomic>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+//! Counts the checks run, fails when its value is set to fail
+struct CountingCheck {
+    static std::atomic<unsigned int> nRun;
+    bool fFail{false};
+
+    bool operator()()
+    {
+        nRun++;
+        return !fFail;
+    }
+    void swap(CountingCheck& x) { std::swap(fFail, x.fFail); }
+};
+std::atomic<unsigned int> CountingCheck::nRun{0};
+
+BOOST_AUTO_TEST_CASE(checkqueue_work_stealing)
+{
+    boost::thread_group threadGroup;
+    CCheckQueue<CountingCheck> queue(128);
+    for (int i = 0; i < 3; i++)
+        threadGroup.create_thread(std::bind(&CCheckQueue<CountingCheck>::Thread, std::ref(queue)));
+
+    // Batches of every size, a few of them with a failing check; the master
+    // adds in several calls, spread over the deques of the workers
+    for (unsigned int nRound = 0; nRound < 500; nRound++) {
+        CountingCheck::nRun = 0;
+        const bool fFail = nRound % 50 == 7;
+        unsigned int nTotal = 0;
+        CCheckQueueControl<CountingCheck> control(&queue);
+        for (unsigned int nAdd = 0; nAdd < 4; nAdd++) {
+            std::vector<CountingCheck> vChecks(nRound % 40 + nAdd);
+            if (fFail && nAdd == 2) vChecks.back().fFail = true;
+            nTotal += vChecks.size();
+            control.Add(vChecks);
+        }
+        BOOST_CHECK_EQUAL(control.Wait(), !fFail);
+        // All of them ran, unless one failed
+        if (!fFail) BOOST_CHECK_EQUAL(CountingCheck::nRun, nTotal);
+    }
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -10,7 +10,9 @@
 #include "test/test_dogecash.h"
 
 #include "coins.h"
+#include "invalid.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -1239,6 +1241,37 @@ BOOST_AUTO_TEST_CASE(ccoins_add)
     CheckAddCoin(VALUE2, VALUE3, FAIL,   DIRTY|FRESH, NO_ENTRY    );
 }
 
+void CheckAddFetchedCoin(CAmount cache_value, CAmount fetched_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+
+    Coin coin;
+    SetCoinsValue(fetched_value, coin);
+    test.cache.AddFetchedCoin(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_add_fetched)
+{
+    /* A prefetched coin is added as FetchCoin would add it, and never
+     * replaces the entry that the cache already has.
+     *
+     *                  Cache   Fetched Result  Cache        Result
+     *                  Value   Value   Value   Flags        Flags
+     */
+    CheckAddFetchedCoin(ABSENT, VALUE3, VALUE3, NO_ENTRY   , 0           );
+    CheckAddFetchedCoin(ABSENT, PRUNED, PRUNED, NO_ENTRY   , FRESH       );
+    CheckAddFetchedCoin(PRUNED, VALUE3, PRUNED, DIRTY      , DIRTY       );
+    CheckAddFetchedCoin(VALUE2, VALUE3, VALUE2, 0          , 0           );
+    CheckAddFetchedCoin(VALUE2, VALUE3, VALUE2, DIRTY|FRESH, DIRTY|FRESH );
+}
+
 void CheckWriteCoins(CAmount parent_value, CAmount child_value, CAmount expected_value, char parent_flags, char child_flags, char expected_flags)
 {
     SingleEntryCacheTest test(ABSENT, parent_value, parent_flags);
@@ -1324,4 +1357,100 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+
+BOOST_AUTO_TEST_CASE(ccoins_partial_flush)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache base(&viewDummy);
+    CCoinsViewCache cache(&base);
+    const COutPoint hot(InsecureRand256(), 0);
+    const COutPoint cold(InsecureRand256(), 0);
+    for (const COutPoint& outpoint : {hot, cold}) {
+        Coin coin;
+        coin.out.nValue = InsecureRand32();
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+
+    // everything was just used: written, and kept
+    BOOST_CHECK(cache.PartialFlush(std::numeric_limits<size_t>::max()));
+    BOOST_CHECK(base.HaveCoinInCache(hot) && base.HaveCoinInCache(cold));
+    BOOST_CHECK(cache.HaveCoinInCache(hot) && cache.HaveCoinInCache(cold));
+
+    // the coin not used since is evicted, the spent one is written and evicted
+    BOOST_CHECK(cache.HaveCoin(hot));
+    BOOST_CHECK(cache.PartialFlush(std::numeric_limits<size_t>::max()));
+    BOOST_CHECK(cache.HaveCoinInCache(hot));
+    BOOST_CHECK(!cache.HaveCoinInCache(cold));
+    cache.SpendCoin(hot);
+    BOOST_CHECK(cache.PartialFlush(std::numeric_limits<size_t>::max()));
+    BOOST_CHECK(!cache.HaveCoinInCache(hot));
+    BOOST_CHECK(!base.HaveCoin(hot));
+    BOOST_CHECK(base.HaveCoin(cold));
+
+    // recently used coins are evicted too to get below the limit
+    BOOST_CHECK(cache.HaveCoin(cold));
+    BOOST_CHECK(cache.PartialFlush(0));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+    BOOST_CHECK(base.HaveCoin(cold));
+}
+
+BOOST_FIXTURE_TEST_CASE(ccoins_writeback, TestingSetup)
+{
+    CCoinsViewDB db(1 << 20, true);
+    CCoinsViewWriteBack writeback(&db, &db);
+    CCoinsViewCache cache(&writeback);
+    const COutPoint outpoint(InsecureRand256(), 0);
+    const uint256 hashBlock1 = InsecureRand256();
+    const uint256 hashBlock2 = InsecureRand256();
+
+    Coin coin;
+    coin.out.nValue = InsecureRand32();
+    coin.nHeight = 1;
+    cache.AddCoin(outpoint, std::move(coin), false);
+    cache.SetBestBlock(hashBlock1);
+    BOOST_CHECK(cache.Flush());
+    // readable while being written, and once written
+    BOOST_CHECK(writeback.HaveCoin(outpoint));
+    BOOST_CHECK(writeback.GetBestBlock() == hashBlock1);
+    BOOST_CHECK(writeback.Sync());
+    BOOST_CHECK(!writeback.IsWriting());
+    BOOST_CHECK_EQUAL(writeback.DynamicMemoryUsage(), 0);
+    BOOST_CHECK(db.HaveCoin(outpoint));
+    BOOST_CHECK(db.GetBestBlock() == hashBlock1);
+
+    cache.SpendCoin(outpoint);
+    cache.SetBestBlock(hashBlock2);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!writeback.HaveCoin(outpoint));
+    BOOST_CHECK(!cache.HaveCoin(outpoint));
+    BOOST_CHECK(writeback.Sync());
+    BOOST_CHECK(!db.HaveCoin(outpoint));
+    BOOST_CHECK(db.GetBestBlock() == hashBlock2);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_outpoints_lookup)
+{
+    const COutPoint known(uint256S("0357a0a5011e8bd34d767b8aae1d5872edef12f668d84b5d4787c8f0b4b52746"), 1);
+    BOOST_CHECK(invalid_out::GetOutPoints().empty());
+    BOOST_CHECK(!invalid_out::ContainsOutPoint(known));
+
+    BOOST_CHECK(invalid_out::LoadOutpoints());
+    const std::vector<COutPoint> vOutPoints = invalid_out::GetOutPoints();
+    BOOST_CHECK_EQUAL(vOutPoints.size(), 36);
+    for (size_t i = 0; i < vOutPoints.size(); i++) {
+        // The binary search needs them sorted, without duplicates
+        if (i > 0) BOOST_CHECK(vOutPoints[i - 1] < vOutPoints[i]);
+        BOOST_CHECK(invalid_out::ContainsOutPoint(vOutPoints[i]));
+        BOOST_CHECK(!invalid_out::ContainsOutPoint(COutPoint(vOutPoints[i].hash, vOutPoints[i].n + 2)));
+    }
+    BOOST_CHECK(invalid_out::ContainsOutPoint(known));
+    BOOST_CHECK(!invalid_out::ContainsOutPoint(COutPoint(known.hash, 0)));
+    BOOST_CHECK(!invalid_out::ContainsOutPoint(COutPoint(GetRandHash(), 1)));
+
+    invalid_out::UnloadOutpoints();
+    BOOST_CHECK(!invalid_out::ContainsOutPoint(known));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -16,6 +16,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_dogecash.h"
@@ -272,6 +273,23 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = InsecureRandBits(8);
+        }
+        for (int j = 0; j < i; ++j) {
+            CSHA256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+            CSHA256().Write(out1 + 32 * j, 32).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
@@ -490,6 +508,28 @@ BOOST_AUTO_TEST_CASE(aes_testvectors) {
         TestAES256("603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4", "f69f2445df4f9b17ad2b417be66c3710", "23304b7a39f9f3ff067d8d8f9e24ecc7");
 }
 
+BOOST_AUTO_TEST_CASE(aes256_implementation)
+{
+    // AES256Encrypt and AES256Decrypt use AES-NI or the ARMv8 AES instructions
+    // when the CPU has them: they must agree with the constant time implementation.
+    BOOST_TEST_MESSAGE("Using the '" << AES256Implementation() << "' AES implementation");
+    for (int i = 0; i < 1000; i++) {
+        unsigned char key[32], in[AES_BLOCKSIZE], out[AES_BLOCKSIZE], ref[AES_BLOCKSIZE], back[AES_BLOCKSIZE];
+        GetRandBytes(key, sizeof(key));
+        GetRandBytes(in, sizeof(in));
+        AES256_ctx ctx;
+        AES256_init(&ctx, key);
+        AES256_encrypt(&ctx, 1, ref, in);
+
+        AES256Encrypt enc(key);
+        enc.Encrypt(out, in);
+        BOOST_CHECK(memcmp(out, ref, AES_BLOCKSIZE) == 0);
+        AES256Decrypt dec(key);
+        dec.Decrypt(back, out);
+        BOOST_CHECK(memcmp(back, in, AES_BLOCKSIZE) == 0);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
 
     // NIST AES CBC 128-bit encryption test-vectors
@@ -541,4 +581,68 @@ BOOST_AUTO_TEST_CASE(aes_cbc_testvectors) {
                   "b2eb05e2c39be9fcda6c19078c6a9d1b3f461796d6b0d6b2e0c2a72b4d80e644");
 }
 
+
+static MuHash3072 MuHashOf(unsigned char c)
+{
+    return MuHash3072(std::vector<unsigned char>(1, c));
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    // The arithmetic modulo 2^3072 - 1103717
+    unsigned char bytes[Num3072::BYTE_SIZE];
+    memset(bytes, 0xff, sizeof(bytes));
+    Num3072 max(bytes);
+    max.ToBytes(bytes);
+    BOOST_CHECK_EQUAL(ReadLE32(bytes), 1103716U);
+    for (size_t i = 4; i < sizeof(bytes); i++) BOOST_CHECK_EQUAL(bytes[i], 0);
+
+    for (int i = 0; i < 10; i++) {
+        GetRandBytes(bytes, sizeof(bytes));
+        Num3072 x(bytes);
+        Num3072 y = x.GetInverse();
+        y.Multiply(x);
+        unsigned char one[Num3072::BYTE_SIZE];
+        y.ToBytes(one);
+        BOOST_CHECK_EQUAL(one[0], 1);
+        for (size_t j = 1; j < sizeof(one); j++) BOOST_CHECK_EQUAL(one[j], 0);
+    }
+
+    // The set hash doesn't depend on the order of the insertions and removals
+    uint256 empty, set1, set2, set3;
+    MuHash3072().Finalize(empty);
+    MuHash3072 acc;
+    acc.Insert({1}).Insert({2}).Insert({3}).Remove({2});
+    acc.Finalize(set1);
+    MuHash3072 acc2;
+    acc2.Remove({2}).Insert({3}).Insert({2}).Insert({1});
+    acc2.Finalize(set2);
+    BOOST_CHECK(set1 == set2);
+    BOOST_CHECK(set1 != empty);
+
+    MuHash3072 acc3 = MuHashOf(1);
+    acc3 *= MuHashOf(3);
+    acc3 *= MuHashOf(4);
+    acc3 /= MuHashOf(4);
+    acc3.Finalize(set3);
+    BOOST_CHECK(set1 == set3);
+
+    acc.Remove({1}).Remove({3});
+    acc.Finalize(set1);
+    BOOST_CHECK(set1 == empty);
+
+    // The running state survives the serialization, removals pending included
+    MuHash3072 acc4;
+    acc4.Insert({5}).Insert({6}).Remove({5});
+    CDataStream ss(SER_DISK, 0);
+    ss << acc4;
+    MuHash3072 acc5;
+    ss >> acc5;
+    acc4.Finalize(set1);
+    acc5.Finalize(set2);
+    MuHashOf(6).Finalize(set3);
+    BOOST_CHECK(set1 == set2);
+    BOOST_CHECK(set1 == set3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,6 +7,7 @@
 #include "test/test_dogecash.h"
 #include "random.h"
 
+#include <set>
 #include <thread>
 
 #include <boost/test/unit_test.hpp>
@@ -380,4 +381,27 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that for_each reads out the elements inserted and not erased, as the
+ * signature cache dump does.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    insecure_rand = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(1000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        cc.contains(hashes[i], true);
+
+    std::set<uint256> found;
+    cc.for_each([&found](const uint256& h) { found.insert(h); });
+    BOOST_CHECK_EQUAL(found.size(), hashes.size() / 2);
+    for (size_t i = 0; i < hashes.size(); ++i)
+        BOOST_CHECK_EQUAL(found.count(hashes[i]), i % 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -72,6 +72,61 @@ BOOST_AUTO_TEST_CASE(dbwrapper_batch)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_compact_step)
+{
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBOptions dbOptions(1 << 20);
+    dbOptions.nCompactAfterBytes = 10000;
+    CDBWrapper dbw(ph, dbOptions, true, false);
+
+    std::vector<uint256> values;
+    for (uint32_t i = 0; i < 1000; i++) {
+        values.push_back(GetRandHash());
+        BOOST_CHECK(dbw.Write(std::make_pair('v', i), values.back()));
+    }
+
+    // A pass in steps of 300 entries: 4 steps, then nothing until more is written
+    int nSteps = 0;
+    while (dbw.CompactStep(300)) {
+        BOOST_REQUIRE(++nSteps <= 4);
+    }
+    BOOST_CHECK_EQUAL(nSteps, 4);
+    BOOST_CHECK(!dbw.CompactStep(300));
+
+    uint256 res;
+    for (uint32_t i = 0; i < values.size(); i++) {
+        BOOST_CHECK(dbw.Read(std::make_pair('v', i), res));
+        BOOST_CHECK(res == values[i]);
+    }
+
+    // Without nCompactAfterBytes, the compactions are left to LevelDB
+    CDBWrapper dbw2(fs::temp_directory_path() / fs::unique_path(), (1 << 20), true, false);
+    BOOST_CHECK(dbw2.Write('k', GetRandHash()));
+    BOOST_CHECK(!dbw2.CompactStep(300));
+}
+
+BOOST_AUTO_TEST_CASE(dbwrapper_own_compaction_thread)
+{
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    // Small buffers and tables, so that the writes are flushed and compacted
+    CDBOptions dbOptions(1 << 16);
+    dbOptions.nMaxFileSize = 64 << 10;
+    dbOptions.fOwnCompactionThread = true;
+    {
+        CDBWrapper dbw(ph, dbOptions, false, false);
+        for (uint32_t i = 0; i < 20000; i++) {
+            BOOST_CHECK(dbw.Write(std::make_pair('v', i), uint256(i)));
+        }
+    }
+
+    CDBWrapper dbw(ph, dbOptions, false, false);
+    uint256 res;
+    for (uint32_t i = 0; i < 20000; i++) {
+        BOOST_CHECK(dbw.Read(std::make_pair('v', i), res));
+        BOOST_CHECK(res == uint256(i));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
 {
     {
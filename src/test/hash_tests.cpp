@@ -78,6 +78,26 @@ uint64_t siphash_4_2_testvec[] = {
     0x6ca4ecb15c5f91e1, 0x9f626da15c9625f3, 0xe51b38608ef25f57, 0x958a324ceb064572
 };
 
+BOOST_AUTO_TEST_CASE(murmurhash3_prepared)
+{
+    // The pre-mixed data gives the same hashes as MurmurHash3, for every size of tail
+    std::vector<unsigned char> vData;
+    for (unsigned int nLen = 0; nLen < 40; nLen++) {
+        const CMurmurHash3Data data(vData);
+        uint32_t seeds[11];
+        uint32_t hashes[11];
+        for (unsigned int i = 0; i < 11; i++) {
+            seeds[i] = i * 0xFBA4C795 + nLen;
+            BOOST_CHECK_EQUAL(data.Hash(seeds[i]), MurmurHash3(seeds[i], vData));
+        }
+        data.Hash(seeds, hashes, 11);
+        for (unsigned int i = 0; i < 11; i++) {
+            BOOST_CHECK_EQUAL(hashes[i], MurmurHash3(seeds[i], vData));
+        }
+        vData.push_back(InsecureRandBits(8));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(siphash)
 {
     CSipHasher hasher(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
@@ -0,0 +1,93 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_dogecash.h"
+
+#include "chain.h"
+#include "kernel.h"
+#include "stakeinput.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(kernel_search_matches_kernel)
+{
+    // Modifier v2 on mainnet
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_V3_4].nActivationHeight + 1000;
+    indexPrev.SetStakeModifier(InsecureRand256());
+    BOOST_CHECK(CStakeKernelSearch::IsSupported(&indexPrev));
+
+    CBlockIndex indexFrom;
+    indexFrom.nHeight = indexPrev.nHeight - 500;
+    indexFrom.nTime = 1600000000;
+    const int nTimeTx = 1600100000;
+
+    // A target that no kernel meets, and one that many do
+    for (unsigned int nBits : {0x0300ffffU, 0x2000ffffU}) {
+        const CStakeKernelSearch kernelSearch(&indexPrev, nBits, nTimeTx);
+        int nFound = 0;
+        for (int i = 0; i < 200; i++) {
+            const COutPoint outpoint(InsecureRand256(), InsecureRandRange(10));
+            // Up to 2^20 coins: the weights beyond 32 bits are covered too
+            const CAmount nValue = InsecureRandRange(COIN << 20);
+            CDogeCashStake stakeInput(CTxOut(nValue, CScript()), outpoint, &indexFrom);
+
+            const CStakeKernel stakeKernel(&indexPrev, &stakeInput, nBits, nTimeTx);
+            BOOST_CHECK(kernelSearch.GetHash(outpoint, indexFrom.nTime) == stakeKernel.GetHash());
+            const bool fFound = stakeKernel.CheckKernelHash(true);
+            BOOST_CHECK_EQUAL(kernelSearch.CheckKernelHash(outpoint, indexFrom.nTime, nValue), fFound);
+            nFound += fFound;
+        }
+        BOOST_CHECK(nBits == 0x0300ffffU ? nFound == 0 : nFound > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_inline_storage)
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nHeightV2 = consensus.vUpgrades[Consensus::UPGRADE_V3_4].nActivationHeight;
+
+    // V1 modifier: 8 bytes, read back only before the upgrade
+    CBlockIndex indexV1;
+    indexV1.nHeight = nHeightV2 - 1;
+    indexV1.SetStakeModifier(0x0123456789abcdefULL, true);
+    BOOST_CHECK_EQUAL(indexV1.vStakeModifier.size(), 8U);
+    BOOST_CHECK_EQUAL(indexV1.GetStakeModifierV1(), 0x0123456789abcdefULL);
+    BOOST_CHECK(indexV1.GetStakeModifierV2().IsNull());
+
+    // V2 modifier: 32 bytes, read back only after the upgrade
+    const uint256 nModifierV2 = InsecureRand256();
+    CBlockIndex indexV2;
+    indexV2.nHeight = nHeightV2;
+    indexV2.SetStakeModifier(nModifierV2);
+    BOOST_CHECK_EQUAL(indexV2.vStakeModifier.size(), 32U);
+    BOOST_CHECK(indexV2.GetStakeModifierV2() == nModifierV2);
+    BOOST_CHECK_EQUAL(indexV2.GetStakeModifierV1(), 0U);
+
+    // Serialized as the byte vector it replaced (empty for PoW blocks)
+    CBlockIndex indexPoW;
+    for (const CBlockIndex* pindex : {&indexV1, &indexV2, &indexPoW}) {
+        const CStakeModifierBytes& bytes = pindex->vStakeModifier;
+        const std::vector<unsigned char> vch(bytes.data(), bytes.data() + bytes.size());
+        CDataStream ssVector(SER_DISK, CLIENT_VERSION), ss(SER_DISK, CLIENT_VERSION);
+        ssVector << vch;
+        ss << bytes;
+        BOOST_CHECK(ss.str() == ssVector.str());
+
+        CStakeModifierBytes bytesRead;
+        ss >> bytesRead;
+        BOOST_CHECK_EQUAL(bytesRead.size(), bytes.size());
+        BOOST_CHECK(std::equal(vch.begin(), vch.end(), bytesRead.data()));
+    }
+
+    // Longer vectors are rejected
+    CDataStream ssTooLong(SER_DISK, CLIENT_VERSION);
+    ssTooLong << std::vector<unsigned char>(33, 0x01);
+    CStakeModifierBytes bytesTooLong;
+    BOOST_CHECK_THROW(ssTooLong >> bytesTooLong, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
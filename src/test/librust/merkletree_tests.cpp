@@ -175,4 +175,65 @@ BOOST_AUTO_TEST_CASE(EmptyrootSapling) {
     BOOST_CHECK(SaplingMerkleTree::empty_root() == expected);
 }
 
+BOOST_AUTO_TEST_CASE(MemoizedRootSapling) {
+    SaplingMerkleTree tree;
+    SaplingMerkleTree other;
+    other.append(uint256S("01"));
+    other.append(uint256S("02"));
+    other.append(uint256S("03"));
+    const uint256 otherRoot = other.root();
+
+    // The memoized root is dropped by append...
+    BOOST_CHECK(tree.root() == SaplingMerkleTree::empty_root());
+    tree.append(uint256S("01"));
+    BOOST_CHECK(tree.root() != SaplingMerkleTree::empty_root());
+
+    // ...and when the tree is read over
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << other;
+    ss >> tree;
+    BOOST_CHECK(tree.root() == otherRoot);
+}
+
+BOOST_AUTO_TEST_CASE(BatchAppendSapling) {
+    UniValue commitment_tests = read_json(MAKE_STRING(json_tests::merkle_commitments_sapling));
+    std::vector<libzcash::PedersenHash> commitments;
+    for (size_t i = 0; i < 16; i++) {
+        commitments.emplace_back(uint256S(commitment_tests[i].get_str()));
+    }
+
+    // Every split of the commitments in two batches, from every starting size
+    for (size_t start = 0; start < 16; start++) {
+        for (size_t split = start; split <= 16; split++) {
+            SaplingTestingMerkleTree seqTree;
+            SaplingTestingMerkleTree batchTree;
+            for (size_t i = 0; i < start; i++) {
+                seqTree.append(commitments[i]);
+                batchTree.append(commitments[i]);
+            }
+            SaplingTestingWitness seqWitness = seqTree.witness();
+            SaplingTestingWitness batchWitness = batchTree.witness();
+            for (size_t i = start; i < 16; i++) {
+                seqTree.append(commitments[i]);
+                seqWitness.append(commitments[i]);
+            }
+            batchTree.append(std::vector<libzcash::PedersenHash>(commitments.begin() + start, commitments.begin() + split));
+            batchWitness.append(std::vector<libzcash::PedersenHash>(commitments.begin() + start, commitments.begin() + split));
+            batchTree.append(std::vector<libzcash::PedersenHash>(commitments.begin() + split, commitments.end()));
+            batchWitness.append(std::vector<libzcash::PedersenHash>(commitments.begin() + split, commitments.end()));
+
+            BOOST_CHECK(batchTree == seqTree);
+            BOOST_CHECK(batchTree.root() == seqTree.root());
+            BOOST_CHECK(batchWitness == seqWitness);
+            BOOST_CHECK(batchWitness.root() == seqWitness.root());
+        }
+    }
+
+    // The tree is full
+    SaplingTestingMerkleTree tree;
+    tree.append(commitments);
+    BOOST_CHECK_THROW(tree.append(std::vector<libzcash::PedersenHash>(1)), std::runtime_error);
+    BOOST_CHECK_THROW(SaplingTestingMerkleTree().append(std::vector<libzcash::PedersenHash>(17)), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
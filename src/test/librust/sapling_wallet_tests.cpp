@@ -178,6 +178,14 @@ BOOST_AUTO_TEST_CASE(FindMySaplingNotes) {
     noteMap = wallet.GetSaplingScriptPubKeyMan()->FindMySaplingNotes(*wtx.tx).first;
     BOOST_CHECK_EQUAL(2, noteMap.size());
 
+    // Batched decryption over a set of txes returns the same notes, per tx and in order
+    std::vector<CTransactionRef> vtx {MakeTransactionRef(CMutableTransaction()), wtx.tx, wtx.tx};
+    auto vNotes = wallet.GetSaplingScriptPubKeyMan()->FindMySaplingNotes(vtx);
+    BOOST_CHECK_EQUAL(3, vNotes.size());
+    BOOST_CHECK_EQUAL(0, vNotes[0].first.size());
+    BOOST_CHECK(vNotes[1].first == noteMap);
+    BOOST_CHECK(vNotes[2].first == noteMap);
+
     // Revert to default
     RegtestDeactivateSapling();
 }
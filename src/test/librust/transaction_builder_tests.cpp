@@ -11,6 +11,7 @@
 #include "sapling/sapling.h"
 #include "sapling/transaction_builder.h"
 #include "sapling/sapling_validation.h"
+#include "validation.h"
 
 #include <univalue.h>
 #include <boost/test/unit_test.hpp>
@@ -332,4 +333,58 @@ BOOST_AUTO_TEST_CASE(CheckSaplingTxVersion)
 }
 
 
+BOOST_AUTO_TEST_CASE(CheckBlockShieldedProofs)
+{
+    auto consensusParams = RegtestActivateSapling();
+
+    auto sk = libzcash::SaplingSpendingKey::random();
+    auto expsk = sk.expanded_spending_key();
+    auto fvk = sk.full_viewing_key();
+    auto pa = sk.default_address();
+
+    // Two valid Sapling-only transactions in the same block
+    CBlock block;
+    block.vtx.emplace_back(MakeTransactionRef(CMutableTransaction()));
+    for (CAmount nValue : {40000000, 100000000}) {
+        auto testNote = GetTestSaplingNote(pa, nValue);
+        auto builder = TransactionBuilder(consensusParams, 2);
+        builder.AddSaplingSpend(expsk, testNote.note, testNote.tree.root(), testNote.tree.witness());
+        builder.SetFee(10000000);
+        builder.AddSaplingOutput(fvk.ovk, pa, 25000000, {});
+        block.vtx.emplace_back(MakeTransactionRef(builder.Build().GetTxOrThrow()));
+    }
+
+    CValidationState state;
+    BOOST_CHECK(SaplingValidation::CheckBlockShieldedProofs(block, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "");
+
+    // Tamper the binding signature of the last transaction: the whole block is rejected
+    CMutableTransaction mtx(*block.vtx.back());
+    mtx.sapData->bindingSig[0] ^= 0xff;
+    block.vtx.back() = MakeTransactionRef(mtx);
+    BOOST_CHECK(!SaplingValidation::CheckBlockShieldedProofs(block, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-sapling-binding-signature-invalid");
+
+    // Same result through the checkqueue closures
+    uint256 dataToBeSigned;
+    BOOST_CHECK(SaplingValidation::ComputeShieldedSighash(*block.vtx[1], dataToBeSigned));
+    CSaplingProofCheck goodCheck(*block.vtx[1], dataToBeSigned);
+    BOOST_CHECK(goodCheck());
+    BOOST_CHECK(SaplingValidation::ComputeShieldedSighash(*block.vtx[2], dataToBeSigned));
+    CSaplingProofCheck badCheck(*block.vtx[2], dataToBeSigned);
+    BOOST_CHECK(!badCheck());
+    BOOST_CHECK_EQUAL(badCheck.GetResult(), SaplingValidation::PROOF_BAD_BINDING_SIG);
+
+    // With a bad spend proof in the first transaction too, the first failing one in block order is reported
+    CMutableTransaction mtxFirst(*block.vtx[1]);
+    mtxFirst.sapData->vShieldedSpend[0].zkproof[0] ^= 0xff;
+    block.vtx[1] = MakeTransactionRef(mtxFirst);
+    state = CValidationState();
+    BOOST_CHECK(!SaplingValidation::CheckBlockShieldedProofs(block, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-sapling-spend-description-invalid");
+
+    // Revert to default
+    RegtestDeactivateSapling();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
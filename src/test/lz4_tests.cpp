@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "util/lz4.h"
+
+#include "random.h"
+#include "test/test_dogecash.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(lz4_tests, BasicTestingSetup)
+
+static std::vector<unsigned char> RoundTrip(const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> compressed;
+    LZ4Compress(data.data(), data.size(), compressed);
+    std::vector<unsigned char> out(data.size());
+    BOOST_CHECK(LZ4Decompress(compressed.data(), compressed.size(), out.data(), out.size()));
+    BOOST_CHECK(out == data);
+    return compressed;
+}
+
+BOOST_AUTO_TEST_CASE(lz4_roundtrip)
+{
+    // empty and tiny inputs are stored as literals
+    RoundTrip({});
+    RoundTrip({0x01});
+    RoundTrip(std::vector<unsigned char>(12, 0xaa));
+
+    // long runs use overlapping matches and extended lengths
+    std::vector<unsigned char> zeros(100000, 0);
+    BOOST_CHECK(RoundTrip(zeros).size() < 1000);
+
+    // random data doesn't compress, and needs extended literal lengths
+    std::vector<unsigned char> random(5000);
+    GetRandBytes(random.data(), random.size());
+    BOOST_CHECK(RoundTrip(random).size() >= random.size());
+
+    // random data repeated beyond the maximum match offset
+    std::vector<unsigned char> mixed;
+    for (int i = 0; i < 40; i++) {
+        mixed.insert(mixed.end(), random.begin(), random.end());
+        mixed.insert(mixed.end(), i * 100, (unsigned char)i);
+    }
+    BOOST_CHECK(RoundTrip(mixed).size() < mixed.size() / 10);
+}
+
+BOOST_AUTO_TEST_CASE(lz4_malformed)
+{
+    std::vector<unsigned char> data(2000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (unsigned char)(i % 37);
+    }
+    std::vector<unsigned char> compressed;
+    LZ4Compress(data.data(), data.size(), compressed);
+    std::vector<unsigned char> out(data.size() + 1);
+
+    // wrong decompressed size
+    BOOST_CHECK(!LZ4Decompress(compressed.data(), compressed.size(), out.data(), data.size() - 1));
+    BOOST_CHECK(!LZ4Decompress(compressed.data(), compressed.size(), out.data(), data.size() + 1));
+    // truncated input
+    for (size_t n = 0; n < compressed.size(); n++) {
+        BOOST_CHECK(!LZ4Decompress(compressed.data(), n, out.data(), data.size()));
+    }
+    // match before the start of the output
+    const unsigned char badOffset[] = {0x10, 'a', 0x02, 0x00, 0x00};
+    BOOST_CHECK(!LZ4Decompress(badOffset, sizeof(badOffset), out.data(), 6));
+    const unsigned char zeroOffset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+    BOOST_CHECK(!LZ4Decompress(zeroOffset, sizeof(zeroOffset), out.data(), 6));
+    // valid: 'a' then a match of 4 bytes at offset 1, then an empty last sequence
+    const unsigned char valid[] = {0x10, 'a', 0x01, 0x00, 0x00};
+    BOOST_CHECK(LZ4Decompress(valid, sizeof(valid), out.data(), 5));
+    BOOST_CHECK(std::string((const char*)out.data(), 5) == "aaaaa");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
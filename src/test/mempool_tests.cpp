@@ -584,4 +584,128 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolPackageAccountingTest)
+{
+    // A diamond: the parent has two children, both spent by the grandchild,
+    // which reaches the parent twice when walking its ancestors.
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 20000LL;
+    }
+    CMutableTransaction txChild[2];
+    for (int i = 0; i < 2; i++) {
+        txChild[i].vin.resize(1);
+        txChild[i].vin[0].scriptSig = CScript() << OP_11;
+        txChild[i].vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        txChild[i].vout.resize(1);
+        txChild[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild[i].vout[0].nValue = 10000LL;
+    }
+    CMutableTransaction txGrandChild;
+    txGrandChild.vin.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txGrandChild.vin[i].scriptSig = CScript() << OP_11;
+        txGrandChild.vin[i].prevout = COutPoint(txChild[i].GetHash(), 0);
+    }
+    txGrandChild.vout.resize(1);
+    txGrandChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txGrandChild.vout[0].nValue = 15000LL;
+
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(1000LL).FromTx(txParent));
+    pool.addUnchecked(txChild[0].GetHash(), entry.Fee(1000LL).FromTx(txChild[0]));
+    pool.addUnchecked(txChild[1].GetHash(), entry.Fee(1000LL).FromTx(txChild[1]));
+
+    std::string dummy;
+    CTxMemPool::setEntries setAncestors;
+    CTxMemPoolEntry grandChildEntry = entry.Fee(1000LL).FromTx(txGrandChild);
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(grandChildEntry, setAncestors, 3, 1000000, 1000, 1000000, dummy));
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(grandChildEntry, setAncestors, 4, 1000000, 1000, 1000000, dummy));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3U);
+    pool.addUnchecked(txGrandChild.GetHash(), grandChildEntry, setAncestors);
+
+    // The parent is counted once in the package of the grandchild, and the
+    // grandchild once in the package of the parent
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetCountWithAncestors(), 4U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetModFeesWithAncestors(), 4000LL);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetCountWithDescendants(), 4U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txParent.GetHash())->GetModFeesWithDescendants(), 4000LL);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txChild[0].GetHash())->GetCountWithDescendants(), 2U);
+
+    // Confirming the parent leaves the rest of the package consistent
+    std::vector<CTransactionRef> vtx(1, MakeTransactionRef(txParent));
+    pool.removeForBlock(vtx, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetCountWithAncestors(), 3U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txGrandChild.GetHash())->GetModFeesWithAncestors(), 3000LL);
+
+    // Removing a child removes the grandchild with it
+    pool.removeRecursive(txChild[0]);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txChild[1].GetHash())->GetCountWithDescendants(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolFeeHistogramTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    BOOST_CHECK_EQUAL(CTxMemPool::GetFeeHistogramBucket(CFeeRate(0)), 0U);
+    BOOST_CHECK_EQUAL(CTxMemPool::GetFeeHistogramBucket(CFeeRate(1023)), 9U);
+    BOOST_CHECK_EQUAL(CTxMemPool::GetFeeHistogramBucket(CFeeRate(1024)), 10U);
+    BOOST_CHECK_EQUAL(CTxMemPool::GetFeeHistogramBucket(CFeeRate(10000 * COIN)), FEE_HISTOGRAM_BUCKETS - 1);
+    BOOST_CHECK(CTxMemPool::GetFeeHistogramBucketStart(10) == CFeeRate(1024));
+
+    CMutableTransaction tx[3];
+    for (int i = 0; i < 3; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout = COutPoint(InsecureRand256(), 0);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10 * COIN;
+    }
+    const uint64_t nTxSize = ::GetSerializeSize(tx[0], SER_NETWORK, PROTOCOL_VERSION);
+    const CAmount nFee = 10000LL;
+    const unsigned int nBucket = CTxMemPool::GetFeeHistogramBucket(CFeeRate(nFee, nTxSize));
+    pool.addUnchecked(tx[0].GetHash(), entry.Fee(nFee).FromTx(tx[0]));
+    pool.addUnchecked(tx[1].GetHash(), entry.Fee(nFee).FromTx(tx[1]));
+    pool.addUnchecked(tx[2].GetHash(), entry.Fee(8 * nFee).FromTx(tx[2]));
+
+    std::array<FeeRateBucket, FEE_HISTOGRAM_BUCKETS> histogram = pool.GetFeeHistogram();
+    BOOST_CHECK_EQUAL(histogram[nBucket].nCount, 2U);
+    BOOST_CHECK_EQUAL(histogram[nBucket].nBytes, 2 * nTxSize);
+    BOOST_CHECK_EQUAL(histogram[nBucket].nFees, 2 * nFee);
+    BOOST_CHECK_EQUAL(histogram[nBucket + 3].nCount, 1U);
+
+    // The best tx fills a block of its size, the whole mempool fits in a bigger one
+    BOOST_CHECK(pool.GetBlockFillFeeRate(nTxSize) == CTxMemPool::GetFeeHistogramBucketStart(nBucket + 3));
+    BOOST_CHECK(pool.GetBlockFillFeeRate(2 * nTxSize) == CTxMemPool::GetFeeHistogramBucketStart(nBucket));
+    BOOST_CHECK(pool.GetBlockFillFeeRate(3 * nTxSize + 1) == CFeeRate(0));
+
+    // Prioritising moves the tx to its new bucket
+    pool.PrioritiseTransaction(tx[0].GetHash(), tx[0].GetHash().ToString(), 0, 7 * nFee);
+    histogram = pool.GetFeeHistogram();
+    BOOST_CHECK_EQUAL(histogram[nBucket].nCount, 1U);
+    BOOST_CHECK_EQUAL(histogram[nBucket + 3].nCount, 2U);
+    BOOST_CHECK_EQUAL(histogram[nBucket + 3].nFees, 16 * nFee);
+
+    pool.removeRecursive(tx[0]);
+    pool.removeRecursive(tx[1]);
+    histogram = pool.GetFeeHistogram();
+    BOOST_CHECK_EQUAL(histogram[nBucket].nCount, 0U);
+    BOOST_CHECK_EQUAL(histogram[nBucket + 3].nCount, 1U);
+    BOOST_CHECK_EQUAL(histogram[nBucket + 3].nBytes, nTxSize);
+
+    pool.clear();
+    BOOST_CHECK(pool.GetFeeHistogram() == (std::array<FeeRateBucket, FEE_HISTOGRAM_BUCKETS>()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 
 #include "test/test_dogecash.h"
 
+#include <set>
 #include <string>
 
 #include <boost/test/unit_test.hpp>
@@ -176,4 +177,116 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test)
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_pool)
+{
+    CRecvBufferPool pool;
+
+    // Rounded up to a size class, then reused by the requests it can serve
+    CSerializeData buffer = pool.Get(1000);
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK(buffer.capacity() >= 1024U);
+    buffer.resize(1000);
+    const char* pData = buffer.data();
+    const size_t nCapacity = buffer.capacity();
+    pool.Put(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), nCapacity);
+
+    CSerializeData reused = pool.Get(513);
+    BOOST_CHECK(reused.empty());
+    BOOST_CHECK(reused.data() == pData);
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+
+    // The buffers too large for the pool are not kept
+    CSerializeData large = pool.Get(CRecvBufferPool::MAX_BUFFER_SIZE + 1);
+    BOOST_CHECK(large.capacity() > CRecvBufferPool::MAX_BUFFER_SIZE);
+    pool.Put(std::move(large));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), 0U);
+
+    // Nor the ones over the limit of their size class
+    std::vector<CSerializeData> vBuffers;
+    for (size_t i = 0; i <= CRecvBufferPool::MAX_CLASS_BYTES / CRecvBufferPool::MAX_BUFFER_SIZE; i++)
+        vBuffers.push_back(pool.Get(CRecvBufferPool::MAX_BUFFER_SIZE));
+    for (CSerializeData& b : vBuffers)
+        pool.Put(std::move(b));
+    BOOST_CHECK_EQUAL(pool.GetPooledBytes(), CRecvBufferPool::MAX_CLASS_BYTES);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(socket_events)
+{
+    std::vector<SocketEventsMode> modes = {SocketEventsMode::SELECT};
+    SocketEventsMode mode;
+    if (ParseSocketEventsMode("epoll", mode)) modes.push_back(mode);
+    if (ParseSocketEventsMode("kqueue", mode)) modes.push_back(mode);
+    BOOST_CHECK(!ParseSocketEventsMode("unknown", mode));
+
+    for (SocketEventsMode m : modes) {
+        std::unique_ptr<CSocketEvents> events = MakeSocketEvents(m);
+        BOOST_REQUIRE(events);
+        int sv[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+
+        // nothing to read yet, but the other end can be written
+        std::vector<SocketEventsRequest> vRequests = {{(SOCKET) sv[0], 1, SOCKET_EVENT_RECV}, {(SOCKET) sv[1], 2, SOCKET_EVENT_SEND}};
+        std::map<SOCKET, uint8_t> mapReady;
+        BOOST_CHECK(events->Wait(vRequests, mapReady, 50));
+        BOOST_CHECK(!(mapReady[sv[0]] & SOCKET_EVENT_RECV));
+        BOOST_CHECK(mapReady[sv[1]] & SOCKET_EVENT_SEND);
+
+        // data available, and no more interest in sending
+        BOOST_CHECK(send(sv[1], "x", 1, 0) == 1);
+        vRequests[1].nEvents = 0;
+        mapReady.clear();
+        BOOST_CHECK(events->Wait(vRequests, mapReady, 50));
+        BOOST_CHECK(mapReady[sv[0]] & SOCKET_EVENT_RECV);
+        BOOST_CHECK(!(mapReady[sv[1]] & SOCKET_EVENT_SEND));
+
+        close(sv[0]);
+        close(sv[1]);
+    }
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(upload_classes)
+{
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::BLOCK), UPLOAD_TIP_RELAY);
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::CMPCTBLOCK), UPLOAD_TIP_RELAY);
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::TX), UPLOAD_TX_RELAY);
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::INV), UPLOAD_TX_RELAY);
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::MNBROADCAST), UPLOAD_TIERTWO_SYNC);
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::SYNCSTATUSCOUNT), UPLOAD_TIERTWO_SYNC);
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::PING), UPLOAD_OTHER);
+    BOOST_CHECK_EQUAL(GetUploadClass(NetMsgType::VERSION), UPLOAD_OTHER);
+
+    // The names are the suffixes of the -maxupload<class> options
+    std::set<std::string> setNames;
+    for (int i = 0; i < UPLOAD_CLASS_MAX; i++) {
+        BOOST_CHECK(!GetUploadClassName(static_cast<UploadClass>(i)).empty());
+        setNames.insert(GetUploadClassName(static_cast<UploadClass>(i)));
+    }
+    BOOST_CHECK_EQUAL(setNames.size(), (size_t)UPLOAD_CLASS_MAX);
+}
+
+BOOST_AUTO_TEST_CASE(msg_stats_histogram)
+{
+    CNetMsgStats stats;
+    stats.AddProcessed(100, 0, 10);
+    stats.AddProcessed(100, 1, 20);
+    stats.AddProcessed(100, 3, 0);
+    stats.AddProcessed(100, 4, 0);
+    stats.AddProcessed(100, std::numeric_limits<int64_t>::max(), 0);
+
+    BOOST_CHECK_EQUAL(stats.nMsgsProcessed, 5U);
+    BOOST_CHECK_EQUAL(stats.nBytesProcessed, 500U);
+    BOOST_CHECK_EQUAL(stats.nQueueTime, 30);
+    BOOST_CHECK_EQUAL(stats.nMaxQueueTime, 20);
+    BOOST_CHECK_EQUAL(stats.nMaxProcessTime, std::numeric_limits<int64_t>::max());
+    // below 1, 2, 4 and 8 usec, then the last, unbounded, bucket
+    BOOST_CHECK_EQUAL(stats.vProcessTimeHistogram[0], 1U);
+    BOOST_CHECK_EQUAL(stats.vProcessTimeHistogram[1], 1U);
+    BOOST_CHECK_EQUAL(stats.vProcessTimeHistogram[2], 1U);
+    BOOST_CHECK_EQUAL(stats.vProcessTimeHistogram[3], 1U);
+    BOOST_CHECK_EQUAL(stats.vProcessTimeHistogram[MSG_PROCESS_TIME_BUCKETS - 1], 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,88 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_dogecash.h"
+#include "peerinventory.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(peerinventory_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(known_per_peer)
+{
+    SharedInventoryKnown known;
+    const int nPeer1 = known.AddPeer();
+    const int nPeer2 = known.AddPeer();
+
+    const uint256 hash1 = InsecureRand256();
+    const uint256 hash2 = InsecureRand256();
+    known.Insert(nPeer1, hash1);
+    known.Insert(nPeer2, hash2);
+    known.Insert(nPeer2, hash1);
+    BOOST_CHECK(known.Contains(nPeer1, hash1));
+    BOOST_CHECK(!known.Contains(nPeer1, hash2));
+    BOOST_CHECK(known.Contains(nPeer2, hash1));
+    BOOST_CHECK(known.Contains(nPeer2, hash2));
+
+    known.Reset(nPeer2);
+    BOOST_CHECK(!known.Contains(nPeer2, hash1));
+    BOOST_CHECK(!known.Contains(nPeer2, hash2));
+    BOOST_CHECK(known.Contains(nPeer1, hash1));
+
+    // A removed peer's index is reused, knowing nothing
+    known.RemovePeer(nPeer1);
+    const int nPeer3 = known.AddPeer();
+    BOOST_CHECK_EQUAL(nPeer3, nPeer1);
+    BOOST_CHECK(!known.Contains(nPeer3, hash1));
+}
+
+BOOST_AUTO_TEST_CASE(ring_reuse)
+{
+    SharedInventoryKnown known;
+    const int nPeer = known.AddPeer();
+
+    std::vector<uint256> vHashes;
+    for (uint32_t i = 0; i < SharedInventoryKnown::RING_SIZE; i++) {
+        vHashes.push_back(InsecureRand256());
+        known.Insert(nPeer, vHashes.back());
+    }
+    // Known again: keeps its slot
+    known.Insert(nPeer, vHashes[0]);
+    for (const uint256& hash : vHashes) {
+        BOOST_CHECK(known.Contains(nPeer, hash));
+    }
+
+    // The new items take the slots of the oldest ones, forgotten
+    const uint256 hashNew1 = InsecureRand256();
+    const uint256 hashNew2 = InsecureRand256();
+    known.Insert(nPeer, hashNew1);
+    known.Insert(nPeer, hashNew2);
+    BOOST_CHECK(known.Contains(nPeer, hashNew1));
+    BOOST_CHECK(known.Contains(nPeer, hashNew2));
+    BOOST_CHECK(!known.Contains(nPeer, vHashes[0]));
+    BOOST_CHECK(!known.Contains(nPeer, vHashes[1]));
+    for (size_t i = 2; i < vHashes.size(); i++) {
+        BOOST_CHECK(known.Contains(nPeer, vHashes[i]));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(peer_handle)
+{
+    const uint256 hash = InsecureRand256();
+    PeerInventoryKnown peer1;
+    {
+        PeerInventoryKnown peer2;
+        peer2.insert(hash);
+        BOOST_CHECK(peer2.contains(hash));
+        BOOST_CHECK(!peer1.contains(hash));
+    }
+    PeerInventoryKnown peer3;
+    BOOST_CHECK(!peer3.contains(hash));
+    peer1.insert(hash);
+    BOOST_CHECK(peer1.contains(hash));
+    peer1.reset();
+    BOOST_CHECK(!peer1.contains(hash));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
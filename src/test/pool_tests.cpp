@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "memusage.h"
+#include "support/allocators/pool.h"
+
+#include "test/test_dogecash.h"
+
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pool_resource_reuse)
+{
+    PoolResource<64, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 0);
+
+    void* a = resource.Allocate(24, 8);
+    void* b = resource.Allocate(24, 8);
+    BOOST_CHECK(a != b);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1);
+
+    // freed blocks are reused for the same size
+    resource.Deallocate(a, 24, 8);
+    BOOST_CHECK(resource.Allocate(20, 8) == a);
+
+    // larger blocks don't come from the pool
+    void* c = resource.Allocate(128, 8);
+    resource.Deallocate(c, 128, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1);
+
+    // a new chunk once the first one is used up
+    for (int i = 0; i < 1024 / 64; i++) {
+        resource.Allocate(64, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2);
+    resource.Deallocate(b, 24, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_map)
+{
+    typedef PoolAllocator<std::pair<const int, int64_t>, 64, 8> Allocator;
+    typedef std::unordered_map<int, int64_t, std::hash<int>, std::equal_to<int>, Allocator> Map;
+
+    Map map;
+    for (int i = 0; i < 10000; i++) {
+        map.emplace(i, i);
+    }
+    for (int i = 0; i < 10000; i += 2) {
+        map.erase(i);
+    }
+    const size_t nChunks = map.get_allocator().GetResource()->NumAllocatedChunks();
+    const size_t nUsage = memusage::DynamicUsage(map);
+    BOOST_CHECK(nChunks > 0);
+    BOOST_CHECK(nUsage >= nChunks * map.get_allocator().GetResource()->ChunkSizeBytes());
+
+    // erased nodes are reused
+    for (int i = 0; i < 10000; i += 2) {
+        map.emplace(i, i);
+    }
+    BOOST_CHECK_EQUAL(map.get_allocator().GetResource()->NumAllocatedChunks(), nChunks);
+
+    // the pool follows the map
+    Map other;
+    other.swap(map);
+    BOOST_CHECK_EQUAL(other.size(), 10000);
+    BOOST_CHECK_EQUAL(other.get_allocator().GetResource()->NumAllocatedChunks(), nChunks);
+    BOOST_CHECK_EQUAL(map.get_allocator().GetResource()->NumAllocatedChunks(), 0);
+    for (int i = 0; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(other.at(i), i);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 
 #include "rpc/server.h"
 #include "rpc/client.h"
+#include "rpc/jsonstream.h"
 
 #include "base58.h"
 #include "netbase.h"
@@ -44,6 +45,8 @@ UniValue CallRPC(std::string args)
     BOOST_CHECK(tableRPC[strMethod]);
     rpcfn_type method = tableRPC[strMethod]->actor;
     try {
+        // As CRPCTable::execute does
+        tableRPC[strMethod]->CheckArgTypes(request.params);
         UniValue result = (*method)(request);
         return result;
     }
@@ -94,6 +97,13 @@ BOOST_AUTO_TEST_CASE(rpc_rawparams)
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction null"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC("sendrawtransaction DEADBEEF"), std::runtime_error);
     BOOST_CHECK_THROW(CallRPC(std::string("sendrawtransaction ")+rawtx+" extra"), std::runtime_error);
+    BOOST_CHECK_THROW(CallRPC(std::string("sendrawtransaction ")+rawtx+" 1"), std::runtime_error);
+
+    // The argument types of the commands with a schema are checked before the actor runs
+    BOOST_CHECK_THROW(CallRPC("getblockhash \"0\""), std::runtime_error);
+    BOOST_CHECK_NO_THROW(CallRPC("getblockhash 0"));
+    BOOST_CHECK_THROW(CallRPC("gettxout a3b807410df0b60fcb9736768df5823938b2f838694939ba45f3c0a1bff150ed \"0\""), std::runtime_error);
+    BOOST_CHECK_NO_THROW(CallRPC("gettxout a3b807410df0b60fcb9736768df5823938b2f838694939ba45f3c0a1bff150ed 0"));
 }
 
 BOOST_AUTO_TEST_CASE(rpc_rawsign)
@@ -205,6 +215,46 @@ BOOST_AUTO_TEST_CASE(json_parse_errors)
     BOOST_CHECK_THROW(ParseNonRFCJSONValue("3J98t1WpEZ73CNmQviecrnyiWrnqRhWNL"), std::runtime_error);
 }
 
+BOOST_AUTO_TEST_CASE(json_stream_writer)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("txid", "a\"b");
+    entry.pushKV("amount", ValueFromAmount(150000000));
+    UniValue expected(UniValue::VOBJ);
+    UniValue arr(UniValue::VARR);
+    arr.push_back(entry);
+    arr.push_back(UniValue(UniValue::VARR));
+    arr.push_back(entry);
+    expected.pushKV("tx", arr);
+    expected.pushKV("empty", UniValue(UniValue::VOBJ));
+    expected.pushKV("n", 7);
+
+    // Small chunks: the output is the same, however it is cut
+    std::vector<std::string> chunks;
+    JSONStreamWriter stream([&chunks](const std::string& chunk) { chunks.push_back(chunk); }, 8);
+    BOOST_CHECK(!stream.IsStarted());
+    stream.BeginObject();
+    stream.Key("tx");
+    stream.BeginArray();
+    stream.Value(entry);
+    stream.BeginArray();
+    stream.EndArray();
+    stream.Value(entry);
+    stream.EndArray();
+    stream.Key("empty");
+    stream.BeginObject();
+    stream.EndObject();
+    stream.KeyValue("n", 7);
+    stream.EndObject();
+    stream.Flush();
+    BOOST_CHECK(stream.IsStarted());
+    BOOST_CHECK(chunks.size() > 1);
+
+    std::string written;
+    for (const std::string& chunk : chunks) written += chunk;
+    BOOST_CHECK_EQUAL(written, expected.write());
+}
+
 BOOST_AUTO_TEST_CASE(rpc_ban)
 {
     BOOST_CHECK_NO_THROW(CallRPC(std::string("clearbanned")));
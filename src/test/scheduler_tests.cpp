@@ -151,4 +151,43 @@ BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered)
     BOOST_CHECK_EQUAL(counter2, 100);
 }
 
+BOOST_AUTO_TEST_CASE(scheduler_lanes)
+{
+    CScheduler scheduler;
+
+    // due tasks run by lane priority, before their time order
+    std::vector<int> order;
+    const boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+    scheduler.schedule([&order]() { order.push_back(1); }, now - boost::chrono::milliseconds(2), CScheduler::BACKGROUND);
+    scheduler.schedule([&order]() { order.push_back(0); }, now - boost::chrono::milliseconds(1), CScheduler::REALTIME);
+    boost::thread_group threads;
+    threads.create_thread(boost::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    threads.join_all();
+    BOOST_CHECK(order == std::vector<int>({0, 1}));
+
+    // a realtime thread runs the realtime tasks while a background task is blocked
+    CScheduler laneScheduler;
+    threads.create_thread(boost::bind(&CScheduler::serviceLanes, &laneScheduler, 1 << CScheduler::REALTIME));
+    threads.create_thread(boost::bind(&CScheduler::serviceQueue, &laneScheduler));
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fRealtimeRan = false;
+    bool fBlockedOnRealtime = false;
+    laneScheduler.schedule([&]() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fBlockedOnRealtime = cond.wait_for(lock, boost::chrono::seconds(10), [&]() { return fRealtimeRan; });
+    }, boost::chrono::system_clock::now(), CScheduler::BACKGROUND);
+    MicroSleep(1000);
+    laneScheduler.schedule([&]() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRealtimeRan = true;
+        cond.notify_all();
+    }, boost::chrono::system_clock::now(), CScheduler::REALTIME);
+    laneScheduler.stop(true);
+    threads.join_all();
+    BOOST_CHECK(fRealtimeRan);
+    BOOST_CHECK(fBlockedOnRealtime);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -141,6 +141,18 @@ BOOST_AUTO_TEST_CASE(coldstake_script)
     CMutableTransaction tx(good_tx);
     BOOST_CHECK(CheckP2CSScript(tx.vin[0].scriptSig, scriptP2CS, tx, err));
 
+    // the keys can't be used for each other's branch
+    SignColdStake(tx, 0, scriptP2CS, ownerKey, true);
+    BOOST_CHECK(!CheckP2CSScript(tx.vin[0].scriptSig, scriptP2CS, tx, err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EQUALVERIFY, ScriptErrorString(err));
+    SignColdStake(tx, 0, scriptP2CS, stakerKey, false);
+    BOOST_CHECK(!CheckP2CSScript(tx.vin[0].scriptSig, scriptP2CS, tx, err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EQUALVERIFY, ScriptErrorString(err));
+    // the owner can spend it like the staker
+    SignColdStake(tx, 0, scriptP2CS, ownerKey, false);
+    BOOST_CHECK(CheckP2CSScript(tx.vin[0].scriptSig, scriptP2CS, tx, err));
+    tx = good_tx;
+
     // pay less than expected
     tx.vout[1].nValue -= 3 * COIN;
     SignColdStake(tx, 0, scriptP2CS, stakerKey, true);
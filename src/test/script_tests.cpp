@@ -753,6 +753,57 @@ BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG12)
     BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EVAL_FALSE, ScriptErrorString(err));
 }
 
+BOOST_AUTO_TEST_CASE(script_standard_templates)
+{
+    // P2PKH and P2PK spends are verified without the interpreter when they
+    // succeed, the failures must report the same errors as before.
+    ScriptError err;
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(false);
+
+    const CScript scriptP2PKH = GetScriptForDestination(key1.GetPubKey().GetID());
+    const CScript scriptP2PK = GetScriptForRawPubKey(key2.GetPubKey());
+    for (const CScript& scriptPubKey : {scriptP2PKH, scriptP2PK}) {
+        const bool fP2PKH = scriptPubKey == scriptP2PKH;
+        const CKey& key = fP2PKH ? key1 : key2;
+        CMutableTransaction txFrom = BuildCreditingTransaction(scriptPubKey);
+        CMutableTransaction txTo = BuildSpendingTransaction(CScript(), txFrom);
+        const SigVersion sv = txTo.GetRequiredSigVersion();
+
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(SignatureHash(scriptPubKey, txTo, 0, SIGHASH_ALL, 0, sv), vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        CScript scriptSig = CScript() << vchSig;
+        if (fP2PKH) {
+            scriptSig << ToByteVector(key.GetPubKey());
+        }
+        BOOST_CHECK(VerifyScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&txTo, 0, txFrom.vout[0].nValue), sv, &err));
+        BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_OK, ScriptErrorString(err));
+
+        // Wrong signature
+        txTo.vout[0].nValue = 2;
+        BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&txTo, 0, txFrom.vout[0].nValue), sv, &err));
+        BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EVAL_FALSE, ScriptErrorString(err));
+
+        // Extra push
+        scriptSig << OP_1;
+        BOOST_CHECK(!VerifyScript(scriptSig, scriptPubKey, flags, MutableTransactionSignatureChecker(&txTo, 0, txFrom.vout[0].nValue), sv, &err));
+        BOOST_CHECK_MESSAGE(err == (fP2PKH ? SCRIPT_ERR_EQUALVERIFY : SCRIPT_ERR_SIG_DER), ScriptErrorString(err));
+    }
+
+    // Wrong public key
+    CMutableTransaction txFrom = BuildCreditingTransaction(scriptP2PKH);
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), txFrom);
+    const SigVersion sv = txTo.GetRequiredSigVersion();
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key2.Sign(SignatureHash(scriptP2PKH, txTo, 0, SIGHASH_ALL, 0, sv), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    const CScript scriptSig = CScript() << vchSig << ToByteVector(key2.GetPubKey());
+    BOOST_CHECK(!VerifyScript(scriptSig, scriptP2PKH, flags, MutableTransactionSignatureChecker(&txTo, 0, txFrom.vout[0].nValue), sv, &err));
+    BOOST_CHECK_MESSAGE(err == SCRIPT_ERR_EQUALVERIFY, ScriptErrorString(err));
+}
+
 BOOST_AUTO_TEST_CASE(script_CHECKMULTISIG23)
 {
     ScriptError err;
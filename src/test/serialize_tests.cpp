@@ -374,4 +374,38 @@ BOOST_AUTO_TEST_CASE(class_methods)
     BOOST_CHECK(methodtest3 == methodtest4);
 }
 
+BOOST_AUTO_TEST_CASE(memory_serialized_vectors)
+{
+    static_assert(is_memory_serialized<uint256>::value, "uint256 is serialized as its memory");
+    static_assert(is_memory_serialized<CKeyID>::value, "uint160 derived classes are serialized as their memory");
+    static_assert(!is_memory_serialized<COutPoint>::value, "COutPoint is not serialized as its memory");
+    static_assert(!is_memory_serialized<uint32_t>::value, "integers are serialized little endian");
+
+    std::vector<uint256> vHashes;
+    prevector<4, uint256> pvHashes;
+    CDataStream ssElements(SER_DISK, PROTOCOL_VERSION);
+    for (int i = 0; i < 10; i++) {
+        vHashes.push_back(InsecureRand256());
+        pvHashes.push_back(vHashes.back());
+    }
+    // the single blob is the same as the elements one after the other
+    WriteCompactSize(ssElements, vHashes.size());
+    for (const uint256& hash : vHashes)
+        ssElements << hash;
+
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << vHashes;
+    BOOST_CHECK(ss.str() == ssElements.str());
+    std::vector<uint256> vHashesRead;
+    ss >> vHashesRead;
+    BOOST_CHECK(vHashesRead == vHashes);
+
+    ss << pvHashes;
+    BOOST_CHECK(ss.str() == ssElements.str());
+    prevector<4, uint256> pvHashesRead;
+    ss >> pvHashesRead;
+    BOOST_CHECK(pvHashesRead == pvHashes);
+    BOOST_CHECK(ss.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
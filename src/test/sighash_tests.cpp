@@ -193,6 +193,13 @@ BOOST_AUTO_TEST_CASE(sighash_test)
         if (txTo.nVersion < CTransaction::TxVersion::SAPLING) { // Sapling has a different signature.
             BOOST_CHECK(sh == sho);
         }
+
+        // The precomputed data (the legacy midstates) gives the same hashes
+        const CTransaction tx(txTo);
+        const PrecomputedTransactionData precomTxData(tx);
+        BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, tx.GetRequiredSigVersion(), &precomTxData) == sh);
+        BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL, 0, tx.GetRequiredSigVersion(), &precomTxData) ==
+                    SignatureHash(scriptCode, tx, nIn, SIGHASH_ALL, 0, tx.GetRequiredSigVersion()));
     }
     #if defined(PRINT_SIGHASH_JSON)
     std::cout << "]\n";
@@ -102,4 +102,38 @@ BOOST_AUTO_TEST_CASE(getlocator_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(chain_snapshot_test)
+{
+    std::vector<uint256> vHashMain(1000);
+    std::vector<CBlockIndex> vBlocksMain(1000);
+    for (unsigned int i=0; i<vBlocksMain.size(); i++) {
+        vHashMain[i] = i;
+        vBlocksMain[i].nHeight = i;
+        vBlocksMain[i].pprev = i ? &vBlocksMain[i - 1] : NULL;
+        vBlocksMain[i].phashBlock = &vHashMain[i];
+        vBlocksMain[i].BuildSkip();
+    }
+
+    CChain chain;
+    BOOST_CHECK(chain.TipSnapshot() == NULL);
+    BOOST_CHECK(chain.AtHeightSnapshot(0) == NULL);
+
+    chain.SetTip(&vBlocksMain.back());
+    BOOST_CHECK(chain.TipSnapshot() == chain.Tip());
+    for (int n=0; n<100; n++) {
+        int h = InsecureRandRange(vBlocksMain.size());
+        BOOST_CHECK(chain.AtHeightSnapshot(h) == chain[h]);
+    }
+    BOOST_CHECK(chain.AtHeightSnapshot(vBlocksMain.size()) == NULL);
+
+    // Moving the tip back: the snapshot doesn't reach over it
+    chain.SetTip(&vBlocksMain[499]);
+    BOOST_CHECK(chain.TipSnapshot() == &vBlocksMain[499]);
+    BOOST_CHECK(chain.AtHeightSnapshot(499) == &vBlocksMain[499]);
+    BOOST_CHECK(chain.AtHeightSnapshot(500) == NULL);
+
+    chain.SetTip(NULL);
+    BOOST_CHECK(chain.TipSnapshot() == NULL);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -67,4 +67,71 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_inline_writer_span_reader)
+{
+    // Short enough to stay inline, and long enough to move to the heap
+    for (size_t len : {10, 100}) {
+        std::vector<unsigned char> vch(len, 0x5a);
+        uint32_t n = 0x01020304;
+
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << vch << n;
+        CInlineWriter<64> writer(SER_DISK, CLIENT_VERSION);
+        writer << vch << n;
+        BOOST_CHECK_EQUAL(writer.size(), ss.size());
+        BOOST_CHECK(memcmp(writer.data(), ss.data(), ss.size()) == 0);
+
+        SpanReader reader(SER_DISK, CLIENT_VERSION, writer.data(), writer.size());
+        std::vector<unsigned char> vchOut;
+        uint32_t nOut;
+        reader >> vchOut >> nOut;
+        BOOST_CHECK(vchOut == vch);
+        BOOST_CHECK_EQUAL(nOut, n);
+        BOOST_CHECK(reader.empty());
+        BOOST_CHECK_THROW(reader >> nOut, std::ios_base::failure);
+
+        SpanReader skip(SER_DISK, CLIENT_VERSION, writer.data(), writer.size());
+        skip.ignore(writer.size() - sizeof(n));
+        skip >> nOut;
+        BOOST_CHECK_EQUAL(nOut, n);
+        writer.clear();
+        BOOST_CHECK_EQUAL(writer.size(), 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(bitstream_reader_writer)
+{
+    CDataStream serialized(SER_NETWORK, PROTOCOL_VERSION);
+
+    BitStreamWriter<CDataStream> bit_writer(serialized);
+    bit_writer.Write(0, 1);
+    bit_writer.Write(2, 2);
+    bit_writer.Write(6, 3);
+    bit_writer.Write(11, 4);
+    bit_writer.Write(1, 5);
+    bit_writer.Write(32, 6);
+    bit_writer.Write(7, 7);
+    bit_writer.Write(30497, 16);
+    bit_writer.Flush();
+
+    CDataStream serialized_copy = serialized;
+    uint32_t serialized_int1;
+    serialized >> serialized_int1;
+    BOOST_CHECK_EQUAL(serialized_int1, (uint32_t)0x7700C35A); // NOTE: Serialized as LE
+    uint16_t serialized_int2;
+    serialized >> serialized_int2;
+    BOOST_CHECK_EQUAL(serialized_int2, (uint16_t)0x1072); // NOTE: Serialized as LE
+
+    BitStreamReader<CDataStream> bit_reader(serialized_copy);
+    BOOST_CHECK_EQUAL(bit_reader.Read(1), 0);
+    BOOST_CHECK_EQUAL(bit_reader.Read(2), 2);
+    BOOST_CHECK_EQUAL(bit_reader.Read(3), 6);
+    BOOST_CHECK_EQUAL(bit_reader.Read(4), 11);
+    BOOST_CHECK_EQUAL(bit_reader.Read(5), 1);
+    BOOST_CHECK_EQUAL(bit_reader.Read(6), 32);
+    BOOST_CHECK_EQUAL(bit_reader.Read(7), 7);
+    BOOST_CHECK_EQUAL(bit_reader.Read(16), 30497);
+    BOOST_CHECK_THROW(bit_reader.Read(8), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
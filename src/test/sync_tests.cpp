@@ -2,9 +2,17 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/dogecash-config.h"
+#endif
+
 #include "sync.h"
 #include "test/test_dogecash.h"
 
+#include <atomic>
+#include <string.h>
+#include <thread>
+
 #include <boost/test/unit_test.hpp>
 
 namespace {
@@ -49,4 +57,127 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(lock_contention)
+{
+    Mutex mutex;
+    const LockContentionStats start = GetThreadLockContention();
+
+    // A lock taken at once isn't counted
+    {
+        LOCK(mutex);
+    }
+    BOOST_CHECK_EQUAL(GetThreadLockContention().nContended, start.nContended);
+
+    // A lock held by another thread is
+    std::atomic<bool> fLocked{false};
+    std::thread holder([&mutex, &fLocked] {
+        LOCK(mutex);
+        fLocked = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    });
+    while (!fLocked) std::this_thread::yield();
+    {
+        LOCK(mutex);
+    }
+    holder.join();
+
+    const LockContentionStats end = GetThreadLockContention();
+#if defined(HAVE_THREAD_LOCAL)
+    BOOST_CHECK_EQUAL(end.nContended, start.nContended + 1);
+    BOOST_CHECK(end.nWaitMicros > start.nWaitMicros);
+#else
+    BOOST_CHECK_EQUAL(end.nContended, 0U);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(lock_held_time)
+{
+    RecursiveMutex cs_main;
+    RecursiveMutex other;
+    const LockContentionStats start = GetThreadLockContention();
+
+    // Not measured unless the thread asks for it
+    {
+        LOCK(cs_main);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    BOOST_CHECK_EQUAL(GetThreadLockContention().nMainHeldMicros, start.nMainHeldMicros);
+
+    SetThreadLockHeldTracking(true);
+    {
+        LOCK(cs_main);
+        {
+            // The recursive lock doesn't count twice
+            LOCK(cs_main);
+            LOCK(other);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    SetThreadLockHeldTracking(false);
+
+    const LockContentionStats end = GetThreadLockContention();
+#if defined(HAVE_THREAD_LOCAL)
+    BOOST_CHECK(end.nMainHeldMicros - start.nMainHeldMicros >= 10000);
+    BOOST_CHECK(end.nMainHeldMicros - start.nMainHeldMicros < 1000000);
+    BOOST_CHECK_EQUAL(end.nWalletHeldMicros, start.nWalletHeldMicros);
+#else
+    BOOST_CHECK_EQUAL(end.nMainHeldMicros, 0);
+#endif
+}
+
+BOOST_AUTO_TEST_CASE(lock_profiling)
+{
+    Mutex profiled_mutex;
+    auto find_site = [](const char* pszName) -> const LockSiteStats* {
+        for (const LockSiteStats* site : GetLockSites()) {
+            if (strcmp(site->pszName, pszName) == 0) return site;
+        }
+        return nullptr;
+    };
+
+    // Off: the call site is registered, but nothing is counted
+    {
+        LOCK(profiled_mutex);
+    }
+    const LockSiteStats* site = find_site("profiled_mutex");
+    BOOST_REQUIRE(site != nullptr);
+    BOOST_CHECK_EQUAL(site->nAcquired.load(), 0U);
+
+    SetLockProfiling(true);
+    std::atomic<bool> fLocked{false};
+    std::thread holder([&profiled_mutex, &fLocked] {
+        LOCK(profiled_mutex);
+        fLocked = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    });
+    while (!fLocked) std::this_thread::yield();
+    {
+        LOCK(profiled_mutex);
+    }
+    holder.join();
+    SetLockProfiling(false);
+
+    // Each LOCK is a site of its own: the holder's site has its hold time, this one the wait
+    BOOST_CHECK_EQUAL(site->nAcquired.load(), 0U);
+    uint64_t nAcquired = 0, nContended = 0;
+    int64_t nWaitMicros = 0, nHeldMicros = 0;
+    for (const LockSiteStats* s : GetLockSites()) {
+        if (strcmp(s->pszName, "profiled_mutex") != 0) continue;
+        nAcquired += s->nAcquired;
+        nContended += s->nContended;
+        nWaitMicros += s->nWaitMicros;
+        nHeldMicros += s->nHeldMicros;
+    }
+    BOOST_CHECK_EQUAL(nAcquired, 2U);
+    BOOST_CHECK_EQUAL(nContended, 1U);
+    BOOST_CHECK(nWaitMicros > 0);
+    BOOST_CHECK(nHeldMicros >= 20000);
+
+    ResetLockSites();
+    for (const LockSiteStats* s : GetLockSites()) {
+        BOOST_CHECK_EQUAL(s->nAcquired.load(), 0U);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
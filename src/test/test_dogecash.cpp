@@ -10,6 +10,7 @@
 #include "test/test_dogecash.h"
 
 #include "blockassembler.h"
+#include "crypto/sha256.h"
 #include "guiinterface.h"
 #include "miner.h"
 #include "net_processing.h"
@@ -42,10 +43,12 @@ std::ostream& operator<<(std::ostream& os, const uint256& num)
 
 BasicTestingSetup::BasicTestingSetup()
 {
+        SHA256AutoDetect();
         RandomInit();
         ECC_Start();
         SetupEnvironment();
         InitSignatureCache();
+        InitScriptExecutionCache();
         fCheckBlockIndex = true;
         SelectParams(CBaseChainParams::MAIN);
 }
@@ -79,7 +82,8 @@ TestingSetup::TestingSetup()
         pSporkDB = new CSporkDB(0, true);
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsWriteBack = new CCoinsViewWriteBack(pcoinsdbview, pcoinsdbview);
+        pcoinsTip = new CCoinsViewCache(pcoinsWriteBack);
         if (!LoadGenesisBlock()) {
             throw std::runtime_error("Error initializing block database");
         }
@@ -107,6 +111,7 @@ TestingSetup::~TestingSetup()
         GetMainSignals().UnregisterWithMempoolSignals(mempool);
         UnloadBlockIndex();
         delete pcoinsTip;
+        delete pcoinsWriteBack;
         delete pcoinsdbview;
         delete pblocktree;
         delete zerocoinDB;
@@ -405,6 +405,59 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_script_check_batch)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript p2pk = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    // Spendable with a signature that fails to verify
+    const CScript p2pkNot = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG << OP_NOT;
+
+    CMutableTransaction mtx;
+    mtx.nVersion = 1;
+    for (uint32_t i = 0; i < 8; i++) {
+        mtx.vin.emplace_back(COutPoint(GetRandHash(), i));
+    }
+    mtx.vout.resize(1);
+    mtx.vout[0].nValue = 1000;
+    mtx.vout[0].scriptPubKey = p2pk;
+
+    auto sign = [&](uint32_t nIn, const CScript& scriptCode, bool fValid) {
+        const uint256 hash = SignatureHash(scriptCode, mtx, nIn, SIGHASH_ALL, 1000, SIGVERSION_BASE);
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(fValid ? hash : GetRandHash(), vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        mtx.vin[nIn].scriptSig = CScript() << vchSig;
+    };
+    auto run = [&](const std::vector<CScript>& scriptPubKeys) {
+        const CTransaction tx(mtx);
+        PrecomputedTransactionData precomTxData(tx);
+        std::vector<CScriptCheck> vChecks;
+        for (uint32_t i = 0; i < tx.vin.size(); i++) {
+            vChecks.emplace_back(scriptPubKeys[i], 1000, tx, i, SCRIPT_VERIFY_P2SH, false, &precomTxData);
+        }
+        return CScriptCheck::RunBatch(vChecks);
+    };
+
+    // All valid: verified as a batch
+    std::vector<CScript> scriptPubKeys(mtx.vin.size(), p2pk);
+    for (uint32_t i = 0; i < mtx.vin.size(); i++) {
+        sign(i, p2pk, true);
+    }
+    BOOST_CHECK(run(scriptPubKeys));
+
+    // One invalid signature fails the batch, and the checks run one by one
+    sign(5, p2pk, false);
+    BOOST_CHECK(!run(scriptPubKeys));
+
+    // A script expecting its signature to fail passes one by one only
+    scriptPubKeys[5] = p2pkNot;
+    sign(5, p2pkNot, false);
+    BOOST_CHECK(run(scriptPubKeys));
+    sign(5, p2pkNot, true);
+    BOOST_CHECK(!run(scriptPubKeys));
+}
+
 BOOST_AUTO_TEST_CASE(test_IsStandard)
 {
     LOCK(cs_main);
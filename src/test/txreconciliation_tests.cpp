@@ -0,0 +1,186 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_dogecash.h"
+#include "pinsketch.h"
+#include "streams.h"
+#include "txreconciliation.h"
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+static uint32_t RandElement()
+{
+    uint32_t element;
+    do {
+        element = InsecureRand32();
+    } while (element == 0);
+    return element;
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_decode)
+{
+    for (size_t nCapacity = 1; nCapacity <= 32; nCapacity++) {
+        for (size_t nDiff = 0; nDiff <= nCapacity; nDiff++) {
+            PinSketch a(nCapacity), b(nCapacity);
+            // the common elements cancel out
+            for (int i = 0; i < 50; i++) {
+                const uint32_t element = RandElement();
+                a.Add(element);
+                b.Add(element);
+            }
+            std::set<uint32_t> setDiff;
+            while (setDiff.size() < nDiff) {
+                const uint32_t element = RandElement();
+                if (!setDiff.insert(element).second) continue;
+                (InsecureRandBool() ? a : b).Add(element);
+            }
+            a.Merge(b);
+            std::vector<uint32_t> vDecoded;
+            BOOST_CHECK(a.Decode(vDecoded));
+            std::sort(vDecoded.begin(), vDecoded.end());
+            BOOST_CHECK(std::vector<uint32_t>(setDiff.begin(), setDiff.end()) == vDecoded);
+        }
+    }
+
+    // Adding twice removes
+    PinSketch sketch(4);
+    sketch.Add(7);
+    sketch.Add(7);
+    std::vector<uint32_t> vDecoded{1};
+    BOOST_CHECK(sketch.Decode(vDecoded));
+    BOOST_CHECK(vDecoded.empty());
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_serialization)
+{
+    PinSketch sketch(8);
+    for (int i = 0; i < 5; i++) sketch.Add(RandElement());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << sketch;
+    BOOST_CHECK_EQUAL(ss.size(), 1U + 8 * 4);
+    PinSketch sketch2;
+    ss >> sketch2;
+    BOOST_CHECK_EQUAL(sketch2.GetCapacity(), 8U);
+    std::vector<uint32_t> v1, v2;
+    BOOST_CHECK(sketch.Decode(v1));
+    BOOST_CHECK(sketch2.Decode(v2));
+    BOOST_CHECK(v1 == v2);
+    BOOST_CHECK_EQUAL(v1.size(), 5U);
+}
+
+BOOST_AUTO_TEST_CASE(register_and_flood)
+{
+    TxReconciliationTracker tracker;
+    // Not registered: announced as before
+    BOOST_CHECK(tracker.ShouldFlood(0));
+    BOOST_CHECK(!tracker.AddToSet(0, InsecureRand256()));
+    // Only the peers we offered it to can register
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, 1));
+
+    for (NodeId peer = 0; peer < 4; peer++) {
+        tracker.PreRegisterPeer(peer);
+        BOOST_CHECK(tracker.RegisterPeer(peer, peer == 3, 1));
+        BOOST_CHECK(tracker.IsPeerRegistered(peer));
+    }
+    // The first outbound peers keep getting the transactions, the others and the inbound ones reconcile
+    BOOST_CHECK(tracker.ShouldFlood(0));
+    BOOST_CHECK(tracker.ShouldFlood(1));
+    BOOST_CHECK(!tracker.ShouldFlood(2));
+    BOOST_CHECK(!tracker.ShouldFlood(3));
+
+    // A flooding peer leaves, the next outbound one takes over
+    tracker.ForgetPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK(tracker.ShouldFlood(2));
+    BOOST_CHECK(!tracker.ShouldFlood(3));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_round)
+{
+    // initiator: the side that opened the connection; responder: the other side
+    TxReconciliationTracker initiator, responder;
+    const NodeId peer = 5;
+    const uint64_t nSaltInitiator = initiator.PreRegisterPeer(peer);
+    const uint64_t nSaltResponder = responder.PreRegisterPeer(peer);
+    BOOST_CHECK(initiator.RegisterPeer(peer, false, nSaltResponder));
+    BOOST_CHECK(responder.RegisterPeer(peer, true, nSaltInitiator));
+
+    std::set<uint256> setInitiatorOnly, setResponderOnly;
+    for (int i = 0; i < 100; i++) {
+        const uint256 txid = InsecureRand256();
+        BOOST_CHECK(initiator.AddToSet(peer, txid));
+        BOOST_CHECK(responder.AddToSet(peer, txid));
+    }
+    for (int i = 0; i < 3; i++) {
+        setInitiatorOnly.insert(InsecureRand256());
+        setResponderOnly.insert(InsecureRand256());
+    }
+    for (const uint256& txid : setInitiatorOnly) initiator.AddToSet(peer, txid);
+    for (const uint256& txid : setResponderOnly) responder.AddToSet(peer, txid);
+
+    // Only the initiator asks, once per round
+    uint32_t nSetSize;
+    BOOST_CHECK(!responder.ShouldRequest(peer, GetTimeMicros(), nSetSize));
+    BOOST_CHECK(initiator.ShouldRequest(peer, GetTimeMicros(), nSetSize));
+    BOOST_CHECK_EQUAL(nSetSize, 103U);
+    BOOST_CHECK(!initiator.ShouldRequest(peer, GetTimeMicros(), nSetSize));
+
+    PinSketch sketch;
+    BOOST_CHECK(responder.HandleRequest(peer, nSetSize, sketch));
+    BOOST_CHECK(!initiator.HandleRequest(peer, nSetSize, sketch));
+
+    bool fSuccess = false;
+    std::vector<uint256> vAnnounce;
+    std::vector<uint32_t> vAsk;
+    BOOST_CHECK(initiator.HandleSketch(peer, sketch, fSuccess, vAnnounce, vAsk));
+    BOOST_CHECK(fSuccess);
+    BOOST_CHECK(std::set<uint256>(vAnnounce.begin(), vAnnounce.end()) == setInitiatorOnly);
+    BOOST_CHECK_EQUAL(vAsk.size(), 3U);
+    // Not asked for anymore
+    BOOST_CHECK(!initiator.HandleSketch(peer, sketch, fSuccess, vAnnounce, vAsk));
+
+    vAnnounce.clear();
+    BOOST_CHECK(responder.HandleDiff(peer, true, vAsk, vAnnounce));
+    BOOST_CHECK(std::set<uint256>(vAnnounce.begin(), vAnnounce.end()) == setResponderOnly);
+    BOOST_CHECK(!responder.HandleDiff(peer, true, vAsk, vAnnounce));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_fallback)
+{
+    TxReconciliationTracker initiator, responder;
+    const NodeId peer = 1;
+    const uint64_t nSaltInitiator = initiator.PreRegisterPeer(peer);
+    BOOST_CHECK(initiator.RegisterPeer(peer, false, responder.PreRegisterPeer(peer)));
+    BOOST_CHECK(responder.RegisterPeer(peer, true, nSaltInitiator));
+
+    // More differences than the sketch holds: both sides announce their whole set
+    const size_t nResponderSize = MAX_SKETCH_CAPACITY + 10;
+    for (size_t i = 0; i < nResponderSize; i++) responder.AddToSet(peer, InsecureRand256());
+    initiator.AddToSet(peer, InsecureRand256());
+
+    uint32_t nSetSize;
+    BOOST_CHECK(initiator.ShouldRequest(peer, GetTimeMicros(), nSetSize));
+    PinSketch sketch;
+    BOOST_CHECK(responder.HandleRequest(peer, nSetSize, sketch));
+    BOOST_CHECK_EQUAL(sketch.GetCapacity(), MAX_SKETCH_CAPACITY);
+
+    bool fSuccess = true;
+    std::vector<uint256> vAnnounce;
+    std::vector<uint32_t> vAsk;
+    BOOST_CHECK(initiator.HandleSketch(peer, sketch, fSuccess, vAnnounce, vAsk));
+    BOOST_CHECK(!fSuccess);
+    BOOST_CHECK_EQUAL(vAnnounce.size(), 1U);
+    BOOST_CHECK(vAsk.empty());
+
+    vAnnounce.clear();
+    BOOST_CHECK(responder.HandleDiff(peer, false, vAsk, vAnnounce));
+    BOOST_CHECK_EQUAL(vAnnounce.size(), nResponderSize);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,7 +7,9 @@
 
 #include "test/test_dogecash.h"
 
+#include "coins.h"
 #include "consensus/validation.h"
+#include "policy/policy.h"
 #include "pubkey.h"
 #include "random.h"
 #include "script/standard.h"
@@ -88,4 +90,51 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_script_execution_cache, TestChain100Setup)
+{
+    // The scripts of a transaction accepted to the mempool pass with the
+    // flags ConnectBlock checks with: CheckInputs with these flags skips
+    // them afterwards. Make the coin spent unspendable to tell.
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[1].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    BOOST_CHECK(ToMemPool(spend));
+
+    LOCK(cs_main);
+    CCoinsViewCache coins(pcoinsTip);
+    Coin coin = coins.AccessCoin(spend.vin[0].prevout);
+    coins.SpendCoin(spend.vin[0].prevout);
+    coin.out.scriptPubKey = CScript() << OP_FALSE;
+    coins.AddCoin(spend.vin[0].prevout, std::move(coin), false);
+
+    unsigned int blockFlags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    if (Params().GetConsensus().NetworkUpgradeActive(chainActive.Height(), Consensus::UPGRADE_BIP65))
+        blockFlags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+
+    const CTransaction tx(spend);
+    PrecomputedTransactionData txdata(tx);
+    CValidationState state;
+    // Not cached with the standard flags, which only go to the signature cache
+    BOOST_CHECK(!CheckInputs(tx, state, coins, true, STANDARD_SCRIPT_VERIFY_FLAGS, false, false, txdata));
+    // Cached with the block flags, whether storing or not (ConnectBlock
+    // doesn't, which only lets the entry be overwritten)
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, blockFlags, false, true, txdata));
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, blockFlags, false, false, txdata));
+    // Only with these flags
+    BOOST_CHECK(!CheckInputs(tx, state, coins, true, blockFlags | SCRIPT_VERIFY_STRICTENC, false, false, txdata));
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
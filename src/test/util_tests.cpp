@@ -10,10 +10,13 @@
 #include "clientversion.h"
 #include "primitives/transaction.h"
 #include "sync.h"
+#include "util/parallel.h"
 #include "utilstrencodings.h"
 #include "utilmoneystr.h"
 #include "test/test_dogecash.h"
 
+#include <atomic>
+#include <stdexcept>
 #include <stdint.h>
 #include <vector>
 
@@ -602,4 +605,29 @@ BOOST_AUTO_TEST_CASE(test_Capitalize)
     BOOST_CHECK_EQUAL(Capitalize("\x00\xfe\xff"), "\x00\xfe\xff");
 }
 
+BOOST_AUTO_TEST_CASE(util_ParallelForEach)
+{
+    // Every index is visited once, whatever the number of threads
+    for (int nThreads : {0, 1, 2, 64}) {
+        std::vector<std::atomic<int>> vHits(1000);
+        ParallelForEach(vHits.size(), nThreads, [&vHits](size_t i) { vHits[i]++; });
+        for (const std::atomic<int>& nHits : vHits) {
+            BOOST_CHECK_EQUAL(nHits, 1);
+        }
+    }
+    ParallelForEach(0, 4, [](size_t i) { BOOST_ERROR("called on an empty range"); });
+
+    // Nested calls complete, the calling threads taking part
+    std::atomic<int> nCalls{0};
+    ParallelForEach(16, 4, [&nCalls](size_t i) {
+        ParallelForEach(16, 4, [&nCalls](size_t j) { nCalls++; });
+    });
+    BOOST_CHECK_EQUAL(nCalls, 16 * 16);
+
+    // The exception thrown by fn reaches the caller
+    BOOST_CHECK_THROW(ParallelForEach(100, 4, [](size_t i) {
+        if (i == 42) throw std::runtime_error("42");
+    }), std::runtime_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
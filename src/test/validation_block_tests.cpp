@@ -10,6 +10,7 @@
 #include "consensus/validation.h"
 #include "pow.h"
 #include "random.h"
+#include "stakeinput.h"
 #include "test/test_dogecash.h"
 #include "validation.h"
 #include "validationinterface.h"
@@ -175,4 +176,71 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, WITH_LOCK(cs_main, return chainActive.Tip()->GetBlockHash()));
 }
 
+BOOST_FIXTURE_TEST_CASE(chain_tip_snapshot, TestChain100Setup)
+{
+    LOCK(cs_main);
+    const ChainTipSnapshotRef tip = GetChainTipSnapshot();
+    BOOST_CHECK_EQUAL(tip->nHeight, chainActive.Height());
+    BOOST_CHECK_EQUAL(tip->hash, chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(tip->nTime, chainActive.Tip()->GetBlockTime());
+    // the chain is shorter than LAST_HASHES: all its hashes are there
+    BOOST_CHECK_EQUAL((int)tip->vLastHashes.size(), chainActive.Height() + 1);
+    for (int h = 0; h <= chainActive.Height(); h++) {
+        BOOST_CHECK_EQUAL(tip->GetLastHash(h), chainActive[h]->GetBlockHash());
+    }
+    BOOST_CHECK(tip->GetLastHash(-1).IsNull());
+    BOOST_CHECK(tip->GetLastHash(chainActive.Height() + 1).IsNull());
+
+    // a disconnected tip is published as well
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(state, Params(), chainActive.Tip()));
+    const ChainTipSnapshotRef tipAfter = GetChainTipSnapshot();
+    BOOST_CHECK_EQUAL(tipAfter->nHeight, tip->nHeight - 1);
+    BOOST_CHECK_EQUAL(tipAfter->hash, tip->vLastHashes[1]);
+    // the snapshot held before is unchanged
+    BOOST_CHECK_EQUAL(tip->nHeight, tipAfter->nHeight + 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(stake_input_spent_after_fork, TestChain100Setup)
+{
+    // Spend the first coinbase in the tip
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    const CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+
+    LOCK(cs_main);
+    BOOST_CHECK_EQUAL(chainActive.Tip()->GetBlockHash(), block.GetHash());
+    const CBlockIndex* pindexFork = chainActive.Tip()->pprev;
+    const CTxIn& txin = spend.vin[0];
+
+    // Without the tx index, its transaction can't be found anymore, as on a pruned node
+    CTransactionRef txPrev;
+    uint256 hashBlock;
+    BOOST_CHECK(!GetTransaction(txin.prevout.hash, txPrev, hashBlock, true));
+
+    // A block forking below the tip sees the coin, from the undo data of the tip
+    Coin coin;
+    BOOST_CHECK(GetCoinSpentAfterFork(txin.prevout, pindexFork, coin));
+    BOOST_CHECK(coin.out == coinbaseTxns[0].vout[0]);
+    BOOST_CHECK_EQUAL(coin.nHeight, 1U);
+    std::unique_ptr<CDogeCashStake> stake(CDogeCashStake::NewDogeCashStake(txin, pindexFork));
+    BOOST_CHECK(stake && stake->GetIndexFrom() == chainActive[1]);
+
+    // A block on top of the tip spends it twice
+    BOOST_CHECK(!GetCoinSpentAfterFork(txin.prevout, chainActive.Tip(), coin));
+    stake.reset(CDogeCashStake::NewDogeCashStake(txin, chainActive.Tip()));
+    BOOST_CHECK(!stake);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,6 +9,7 @@
 #include "sapling/sapling_validation.h"
 #include "tiertwo/specialtx_validation.h"
 #include "test/librust/utiltest.h"
+#include "validation.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -154,4 +155,58 @@ BOOST_AUTO_TEST_CASE(test_simple_shielded_invalid)
     SelectParams(CBaseChainParams::MAIN);
 }
 
+BOOST_AUTO_TEST_CASE(read_raw_block_from_disk)
+{
+    const CBlockIndex* pindex = WITH_LOCK(cs_main, return chainActive.Genesis());
+    BOOST_REQUIRE(pindex);
+
+    CBlock block;
+    BOOST_REQUIRE(ReadBlockFromDisk(block, pindex));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+
+    // the hash computed by the read is kept until the header changes
+    BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+    CBlock modified = block;
+    modified.nNonce++;
+    BOOST_CHECK(modified.GetHash() == modified.GetBlockHeader().GetHash());
+    BOOST_CHECK(modified.GetHash() != pindex->GetBlockHash());
+
+    // the raw bytes are exactly the block serialization
+    std::vector<unsigned char> raw;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(raw, pindex));
+    BOOST_CHECK(raw == std::vector<unsigned char>(ss.begin(), ss.end()));
+
+    // a position not preceded by the index header is rejected
+    CDiskBlockPos pos = WITH_LOCK(cs_main, return pindex->GetBlockPos());
+    pos.nPos += 1;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, pos));
+}
+
+BOOST_AUTO_TEST_CASE(pre_check_block)
+{
+    CBlock block = Params().GenesisBlock();
+    BOOST_CHECK(PreCheckBlock(block));
+    BOOST_CHECK(block.fPreChecked);
+    // the (Quark) hash is computed once, and reused
+    BOOST_CHECK(block.GetHash() == Params().GenesisBlock().GetBlockHeader().GetHash());
+    BOOST_CHECK(block.GetHash() == Params().GetConsensus().hashGenesisBlock);
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state));
+
+    // but not once the header of the pre-checked block changed
+    CBlock modified = block;
+    modified.nNonce++;
+    BOOST_CHECK(modified.GetHash() == modified.GetBlockHeader().GetHash());
+    BOOST_CHECK(modified.GetHash() != block.GetHash());
+
+    // a failing block is left to CheckBlock, which rejects it
+    CBlock mutated = Params().GenesisBlock();
+    mutated.vtx.push_back(mutated.vtx[0]);
+    BOOST_CHECK(!PreCheckBlock(mutated));
+    BOOST_CHECK(!mutated.fPreChecked);
+    BOOST_CHECK(!CheckBlock(mutated, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txnmrklroot");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
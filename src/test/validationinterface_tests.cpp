@@ -0,0 +1,218 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "primitives/transaction.h"
+#include "test/test_dogecash.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationinterface_tests, TestingSetup)
+
+//! The transactions of the events are told apart by their lock time: producer * 1000000 + sequence
+static CTransactionRef MakeEventTx(uint32_t nProducer, uint32_t nSequence)
+{
+    CMutableTransaction mtx;
+    mtx.nLockTime = nProducer * 1000000 + nSequence;
+    return MakeTransactionRef(mtx);
+}
+
+struct RecordingSubscriber : public CValidationInterface {
+    std::vector<uint32_t> vReceived;
+    //! When set, the first callback waits for it
+    std::shared_future<void> gate;
+    std::atomic<bool> fEntered{false};
+
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override
+    {
+        fEntered = true;
+        if (gate.valid()) {
+            gate.wait();
+            gate = std::shared_future<void>();
+        }
+        vReceived.push_back(ptx->nLockTime);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(subscriber_order)
+{
+    RecordingSubscriber sub1, sub2;
+    RegisterValidationInterface(&sub1, "sub1");
+    RegisterValidationInterface(&sub2, "sub2");
+
+    // Several producers: each subscriber gets the events of a producer in order
+    const uint32_t nProducers = 4, nEvents = 1000;
+    std::vector<std::thread> vThreads;
+    for (uint32_t p = 0; p < nProducers; p++) {
+        vThreads.emplace_back([p] {
+            for (uint32_t i = 0; i < nEvents; i++) {
+                GetMainSignals().TransactionAddedToMempool(MakeEventTx(p, i));
+            }
+        });
+    }
+    for (std::thread& t : vThreads) t.join();
+    SyncWithValidationInterfaceQueue();
+
+    for (const RecordingSubscriber* sub : {&sub1, &sub2}) {
+        BOOST_CHECK_EQUAL(sub->vReceived.size(), nProducers * nEvents);
+        std::vector<uint32_t> vNext(nProducers, 0);
+        for (uint32_t n : sub->vReceived) {
+            BOOST_CHECK_EQUAL(n % 1000000, vNext[n / 1000000]++);
+        }
+    }
+
+    UnregisterValidationInterface(&sub1);
+    UnregisterValidationInterface(&sub2);
+}
+
+static ValidationInterfaceQueueStats GetSubscriberStats(const std::string& strName)
+{
+    for (const ValidationInterfaceQueueStats& stats : GetMainSignals().GetQueueStats()) {
+        if (stats.strName == strName) return stats;
+    }
+    return ValidationInterfaceQueueStats();
+}
+
+BOOST_AUTO_TEST_CASE(slow_subscriber)
+{
+    std::promise<void> release;
+    RecordingSubscriber slow, fast;
+    slow.gate = release.get_future().share();
+    RegisterValidationInterface(&slow, "slow");
+    RegisterValidationInterface(&fast, "fast");
+
+    for (uint32_t i = 0; i < 100; i++) {
+        GetMainSignals().TransactionAddedToMempool(MakeEventTx(0, i));
+    }
+    // The fast subscriber isn't held back by the slow one
+    SyncWithValidationInterfaceQueue(&fast);
+    BOOST_CHECK_EQUAL(fast.vReceived.size(), 100U);
+    // The barrier is counted once its callback returned
+    while (GetSubscriberStats("fast").nPending != 0) {
+        std::this_thread::yield();
+    }
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 100U);
+
+    for (const ValidationInterfaceQueueStats& stats : GetMainSignals().GetQueueStats()) {
+        if (stats.strName == "slow") {
+            BOOST_CHECK_EQUAL(stats.nPending, 100U);
+            BOOST_CHECK_EQUAL(stats.nDelivered, 0U);
+        } else {
+            // and the barrier of SyncWithValidationInterfaceQueue, unless the queue was empty already
+            BOOST_CHECK_EQUAL(stats.nPending, 0U);
+            BOOST_CHECK(stats.nDelivered == 100U || stats.nDelivered == 101U);
+        }
+        BOOST_CHECK_EQUAL(stats.nPeakPending >= 1, true);
+    }
+
+    release.set_value();
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK_EQUAL(slow.vReceived.size(), 100U);
+    while (GetMainSignals().CallbacksPending() != 0) {
+        std::this_thread::yield();
+    }
+
+    UnregisterValidationInterface(&slow);
+    UnregisterValidationInterface(&fast);
+}
+
+BOOST_AUTO_TEST_CASE(unregister_drops_events)
+{
+    std::promise<void> release;
+    RecordingSubscriber sub;
+    sub.gate = release.get_future().share();
+    RegisterValidationInterface(&sub, "sub");
+
+    for (uint32_t i = 0; i < 10; i++) {
+        GetMainSignals().TransactionAddedToMempool(MakeEventTx(0, i));
+    }
+    // A barrier queued before the subscriber leaves still runs
+    std::promise<void> barrier;
+    CallFunctionInValidationInterfaceQueue([&barrier] { barrier.set_value(); });
+
+    while (!sub.fEntered) {
+        std::this_thread::yield();
+    }
+    std::thread unregister([&sub] { UnregisterValidationInterface(&sub); });
+    // Unregistering waits for the callback running
+    while (!GetMainSignals().GetQueueStats().empty()) {
+        std::this_thread::yield();
+    }
+    release.set_value();
+    unregister.join();
+    barrier.get_future().wait();
+
+    // The callback running finished, the others were dropped
+    BOOST_CHECK_EQUAL(sub.vReceived.size(), 1U);
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 0U);
+}
+
+struct SelfUnregisteringSubscriber : public CValidationInterface {
+    std::atomic<int> nCalls{0};
+
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override
+    {
+        if (nCalls++ == 0) {
+            UnregisterValidationInterface(this);
+        }
+    }
+};
+
+BOOST_AUTO_TEST_CASE(unregister_from_callback)
+{
+    SelfUnregisteringSubscriber sub;
+    RegisterValidationInterface(&sub, "sub");
+    for (uint32_t i = 0; i < 10; i++) {
+        GetMainSignals().TransactionAddedToMempool(MakeEventTx(0, i));
+    }
+    std::promise<void> barrier;
+    CallFunctionInValidationInterfaceQueue([&barrier] { barrier.set_value(); });
+    barrier.get_future().wait();
+
+    // The thread finished the callback and left, the events after it were dropped
+    BOOST_CHECK_EQUAL(sub.nCalls, 1);
+    BOOST_CHECK(GetMainSignals().GetQueueStats().empty());
+}
+
+struct ThreadRecordingSubscriber : public CValidationInterface {
+    std::vector<std::thread::id> vThreadIds;
+
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override
+    {
+        vThreadIds.push_back(std::this_thread::get_id());
+    }
+};
+
+BOOST_AUTO_TEST_CASE(synchronous_subscriber)
+{
+    ThreadRecordingSubscriber sub;
+    RegisterValidationInterface(&sub, "sub", true);
+
+    // Delivered before the signal returns, on the signalling thread
+    GetMainSignals().TransactionAddedToMempool(MakeEventTx(0, 0));
+    BOOST_CHECK_EQUAL(sub.vThreadIds.size(), 1U);
+    BOOST_CHECK(sub.vThreadIds[0] == std::this_thread::get_id());
+    std::thread signaller([] { GetMainSignals().TransactionAddedToMempool(MakeEventTx(0, 1)); });
+    const std::thread::id signallerId = signaller.get_id();
+    signaller.join();
+    BOOST_CHECK_EQUAL(sub.vThreadIds.size(), 2U);
+    BOOST_CHECK(sub.vThreadIds[1] == signallerId);
+
+    // Nothing is ever pending, the barriers don't wait for it
+    BOOST_CHECK_EQUAL(GetMainSignals().CallbacksPending(), 0U);
+    SyncWithValidationInterfaceQueue();
+    const std::vector<ValidationInterfaceQueueStats> vStats = GetMainSignals().GetQueueStats();
+    BOOST_CHECK_EQUAL(vStats.size(), 1U);
+    BOOST_CHECK_EQUAL(vStats[0].nDelivered, 2U);
+
+    UnregisterValidationInterface(&sub);
+    GetMainSignals().TransactionAddedToMempool(MakeEventTx(0, 2));
+    BOOST_CHECK_EQUAL(sub.vThreadIds.size(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
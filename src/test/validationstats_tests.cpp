@@ -0,0 +1,56 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_dogecash.h"
+#include "validationstats.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(validationstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(phase_percentiles)
+{
+    ResetBlockPhaseStats();
+    for (int64_t n = 100; n >= 1; n--) {
+        RecordBlockPhase(BLOCK_PHASE_SCRIPTS, n);
+    }
+    const std::vector<BlockPhaseStats> vStats = GetBlockPhaseStats();
+    BOOST_CHECK_EQUAL(vStats.size(), (size_t)BLOCK_PHASE_COUNT);
+    const BlockPhaseStats& stats = vStats[BLOCK_PHASE_SCRIPTS];
+    BOOST_CHECK_EQUAL(std::string(stats.name), "scripts");
+    BOOST_CHECK_EQUAL(stats.nSamples, 100U);
+    BOOST_CHECK_EQUAL(stats.nAvg, 50);
+    BOOST_CHECK_EQUAL(stats.nP50, 51);
+    BOOST_CHECK_EQUAL(stats.nP90, 91);
+    BOOST_CHECK_EQUAL(stats.nP99, 100);
+    BOOST_CHECK_EQUAL(stats.nMax, 100);
+    // The other phases are empty
+    BOOST_CHECK_EQUAL(vStats[BLOCK_PHASE_READ].nSamples, 0U);
+    BOOST_CHECK_EQUAL(vStats[BLOCK_PHASE_READ].nMax, 0);
+}
+
+BOOST_AUTO_TEST_CASE(phase_window)
+{
+    ResetBlockPhaseStats();
+    // The oldest durations leave the window
+    for (size_t i = 0; i < BLOCK_STATS_WINDOW; i++) {
+        RecordBlockPhase(BLOCK_PHASE_TOTAL, 1000000);
+    }
+    for (size_t i = 0; i < BLOCK_STATS_WINDOW; i++) {
+        RecordBlockPhase(BLOCK_PHASE_TOTAL, 10);
+    }
+    BlockPhaseStats stats = GetBlockPhaseStats()[BLOCK_PHASE_TOTAL];
+    BOOST_CHECK_EQUAL(stats.nSamples, BLOCK_STATS_WINDOW);
+    BOOST_CHECK_EQUAL(stats.nTotalSamples, 2 * BLOCK_STATS_WINDOW);
+    BOOST_CHECK_EQUAL(stats.nTotalTime, (int64_t)BLOCK_STATS_WINDOW * 1000010);
+    BOOST_CHECK_EQUAL(stats.nMax, 10);
+
+    ResetBlockPhaseStats();
+    stats = GetBlockPhaseStats()[BLOCK_PHASE_TOTAL];
+    BOOST_CHECK_EQUAL(stats.nSamples, 0U);
+    BOOST_CHECK_EQUAL(stats.nTotalSamples, 0U);
+    BOOST_CHECK_EQUAL(stats.nTotalTime, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
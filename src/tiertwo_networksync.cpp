@@ -52,7 +52,8 @@ bool CMasternodeSync::MessageDispatcher(CNode* pfrom, std::string& strCommand, C
         // Get Masternode list or specific entry
         CTxIn vin;
         vRecv >> vin;
-        int banScore = mnodeman.ProcessGetMNList(pfrom, vin);
+        Optional<CBloomFilter> filter;
+        int banScore = ReadSyncFilter(vRecv, filter) ? mnodeman.ProcessGetMNList(pfrom, vin, filter.get_ptr()) : 100;
         if (banScore > 0) {
             LOCK(cs_main);
             Misbehaving(pfrom->GetId(), banScore);
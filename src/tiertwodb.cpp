@@ -0,0 +1,31 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "tiertwodb.h"
+
+#include "util.h"
+
+std::unique_ptr<CTierTwoDB> pTierTwoDB;
+
+/** A few entries, all read at startup: no bloom filters */
+static CDBOptions TierTwoOptions(size_t nCacheSize)
+{
+    CDBOptions dbOptions(nCacheSize);
+    dbOptions.nBloomBits = 0;
+    return dbOptions;
+}
+
+CTierTwoDB::CTierTwoDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "tiertwo", TierTwoOptions(nCacheSize), fMemory, fWipe) {}
+
+int CTierTwoDB::ReadVersion()
+{
+    int nVersion = 0;
+    Read(DB_TIERTWO_VERSION, nVersion);
+    return nVersion;
+}
+
+bool CTierTwoDB::WriteVersion()
+{
+    return Write(DB_TIERTWO_VERSION, TIERTWO_DB_VERSION, true);
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_TIERTWODB_H
+#define DOGEC_TIERTWODB_H
+
+#include "dbwrapper.h"
+
+#include <memory>
+
+/** Version of the tier two database records. The database is wiped when it differs. */
+static const int TIERTWO_DB_VERSION = 2;
+
+static const char DB_TIERTWO_VERSION = 'V';
+static const char DB_TIERTWO_MASTERNODE = 'm';
+static const char DB_TIERTWO_PAYMENT_VOTE = 'w';
+static const char DB_TIERTWO_PROPOSAL = 'p';
+static const char DB_TIERTWO_FINALIZED_BUDGET = 'f';
+static const char DB_TIERTWO_UNCONFIRMED_FEETX = 'u';
+
+/**
+ * Tier two state: the masternode list entries, by collateral, the masternode
+ * payment votes, the budget proposals and the finalized budgets, by hash.
+ * CMasternodeMan, CMasternodePayments and CBudgetManager keep track of the
+ * entries changed since their last flush, so that a flush only writes those
+ * and can run periodically, and a restarted node resumes with the state of
+ * the last flush.
+ */
+class CTierTwoDB : public CDBWrapper
+{
+public:
+    CTierTwoDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+private:
+    CTierTwoDB(const CTierTwoDB&);
+    void operator=(const CTierTwoDB&);
+
+public:
+    /// The version of the records, 0 if the database is new
+    int ReadVersion();
+    bool WriteVersion();
+};
+
+extern std::unique_ptr<CTierTwoDB> pTierTwoDB;
+
+#endif //DOGEC_TIERTWODB_H
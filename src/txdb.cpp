@@ -8,6 +8,7 @@
 
 #include "txdb.h"
 
+#include "memusage.h"
 #include "random.h"
 #include "pow.h"
 #include "uint256.h"
@@ -22,7 +23,6 @@
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -30,12 +30,9 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_SNAPSHOT = 'X';
+static const char DB_BUDGET_COLLATERAL = 'G';
 
-static const char DB_ADDRESSINDEX = 'a';
-static const char DB_ADDRESSUNSPENTINDEX = 'u';
-static const char DB_TIMESTAMPINDEX = 's';
-static const char DB_BLOCKHASHINDEX = 'z';
-static const char DB_SPENTINDEX = 'p';
 // static const char DB_MONEY_SUPPLY = 'M';
 
 namespace {
@@ -64,7 +61,21 @@ struct CoinEntry
 }
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+/**
+ * The chainstate gets random reads of the coins, and the bloom filters save the
+ * disk reads of the missing ones. Larger tables keep more of a big chainstate open.
+ * It has the most to compact: on its own thread, it doesn't wait for the indexes.
+ */
+static CDBOptions ChainstateOptions(size_t nCacheSize)
+{
+    CDBOptions dbOptions(nCacheSize);
+    dbOptions.nMaxFileSize = 4 << 20;
+    dbOptions.nCompactAfterBytes = 512 << 20;
+    dbOptions.fOwnCompactionThread = true;
+    return dbOptions;
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", ChainstateOptions(nCacheSize), fMemory, fWipe)
 {
 }
 
@@ -99,6 +110,19 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
                               const uint256& hashSaplingAnchor,
                               CAnchorsSaplingMap& mapSaplingAnchors,
                               CNullifiersMap& mapSaplingNullifiers)
+{
+    bool ret = WriteCoins(mapCoins, hashBlock, hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers);
+    mapCoins.clear();
+    mapSaplingAnchors.clear();
+    mapSaplingNullifiers.clear();
+    return ret;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap& mapCoins,
+                              const uint256& hashBlock,
+                              const uint256& hashSaplingAnchor,
+                              const CAnchorsSaplingMap& mapSaplingAnchors,
+                              const CNullifiersMap& mapSaplingNullifiers)
 {
     CDBBatch batch;
     size_t count = 0;
@@ -124,7 +148,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -134,8 +158,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins,
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -168,13 +190,215 @@ size_t CCoinsViewDB::EstimateSize() const
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
+CCoinsViewWriteBack::CCoinsViewWriteBack(CCoinsView* viewIn, CCoinsViewDB* dbIn) : CCoinsViewBacked(viewIn), db(dbIn)
+{
+    threadWriter = std::thread(&TraceThread<std::function<void()> >, "coinsdb", std::function<void()>(std::bind(&CCoinsViewWriteBack::ThreadWriter, this)));
+}
+
+CCoinsViewWriteBack::~CCoinsViewWriteBack()
+{
+    {
+        LOCK(cs);
+        fStop = true;
+    }
+    cond.notify_all();
+    // the pending write is completed first
+    if (threadWriter.joinable()) threadWriter.join();
+}
+
+void CCoinsViewWriteBack::ThreadWriter()
+{
+    while (true) {
+        {
+            WAIT_LOCK(cs, lock);
+            cond.wait(lock, [this] { return fPending || fStop; });
+            if (!fPending) return;
+        }
+        // The maps are only modified by this thread until fPending is reset
+        int64_t nStart = GetTimeMillis();
+        bool fOk = false;
+        try {
+            fOk = db->WriteCoins(mapCoins, hashBlock, hashSaplingAnchor, mapSaplingAnchors, mapSaplingNullifiers);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        {
+            LOCK(cs);
+            if (fOk) {
+                LogPrint(BCLog::COINDB, "Background write of the coins cache at %s done (%dms)\n", hashBlock.ToString(), GetTimeMillis() - nStart);
+                mapCoins.clear();
+                mapSaplingAnchors.clear();
+                mapSaplingNullifiers.clear();
+                hashBlock.SetNull();
+                hashSaplingAnchor.SetNull();
+                nUsage = 0;
+                fPending = false;
+            } else {
+                // keep the entries readable, the node is going to shut down
+                LogPrintf("%s: failed to write the coins cache at %s\n", __func__, hashBlock.ToString());
+                fFailed = true;
+            }
+        }
+        cond.notify_all();
+        if (!fOk) return;
+    }
+}
+
+bool CCoinsViewWriteBack::BatchWrite(CCoinsMap& mapCoinsIn,
+                                     const uint256& hashBlockIn,
+                                     const uint256& hashSaplingAnchorIn,
+                                     CAnchorsSaplingMap& mapSaplingAnchorsIn,
+                                     CNullifiersMap& mapSaplingNullifiersIn)
+{
+    WAIT_LOCK(cs, lock);
+    cond.wait(lock, [this] { return !fPending || fFailed; });
+    if (fFailed) return false;
+    mapCoins.swap(mapCoinsIn);
+    mapSaplingAnchors.swap(mapSaplingAnchorsIn);
+    mapSaplingNullifiers.swap(mapSaplingNullifiersIn);
+    hashBlock = hashBlockIn;
+    hashSaplingAnchor = hashSaplingAnchorIn;
+    nUsage = memusage::DynamicUsage(mapCoins) +
+             memusage::DynamicUsage(mapSaplingAnchors) +
+             memusage::DynamicUsage(mapSaplingNullifiers);
+    for (const auto& it : mapCoins) {
+        nUsage += it.second.coin.DynamicMemoryUsage();
+    }
+    fPending = true;
+    cond.notify_all();
+    return true;
+}
+
+bool CCoinsViewWriteBack::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        LOCK(cs);
+        if (fPending) {
+            CCoinsMap::const_iterator it = mapCoins.find(outpoint);
+            if (it != mapCoins.end()) {
+                if (it->second.coin.IsSpent()) return false;
+                coin = it->second.coin;
+                return true;
+            }
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewWriteBack::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        LOCK(cs);
+        if (fPending) {
+            CCoinsMap::const_iterator it = mapCoins.find(outpoint);
+            if (it != mapCoins.end()) return !it->second.coin.IsSpent();
+        }
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewWriteBack::GetBestBlock() const
+{
+    {
+        LOCK(cs);
+        if (fPending) return hashBlock;
+    }
+    return base->GetBestBlock();
+}
+
+CCoinsViewCursor* CCoinsViewWriteBack::Cursor() const
+{
+    Sync();
+    return base->Cursor();
+}
+
+bool CCoinsViewWriteBack::GetSaplingAnchorAt(const uint256& rt, SaplingMerkleTree& tree) const
+{
+    {
+        LOCK(cs);
+        if (fPending) {
+            CAnchorsSaplingMap::const_iterator it = mapSaplingAnchors.find(rt);
+            if (it != mapSaplingAnchors.end()) {
+                if (!it->second.entered) return false;
+                tree = it->second.tree;
+                return true;
+            }
+        }
+    }
+    return base->GetSaplingAnchorAt(rt, tree);
+}
+
+bool CCoinsViewWriteBack::GetNullifier(const uint256& nullifier) const
+{
+    {
+        LOCK(cs);
+        if (fPending) {
+            CNullifiersMap::const_iterator it = mapSaplingNullifiers.find(nullifier);
+            if (it != mapSaplingNullifiers.end()) return it->second.entered;
+        }
+    }
+    return base->GetNullifier(nullifier);
+}
+
+uint256 CCoinsViewWriteBack::GetBestAnchor() const
+{
+    {
+        LOCK(cs);
+        if (fPending && !hashSaplingAnchor.IsNull()) return hashSaplingAnchor;
+    }
+    return base->GetBestAnchor();
+}
+
+bool CCoinsViewWriteBack::GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const
+{
+    Sync();
+    return base->GetAllSaplingData(vAnchors, vNullifiers);
+}
+
+bool CCoinsViewWriteBack::Sync() const
+{
+    WAIT_LOCK(cs, lock);
+    cond.wait(lock, [this] { return !fPending || fFailed; });
+    return !fFailed;
+}
+
+bool CCoinsViewWriteBack::IsWriting() const
+{
+    LOCK(cs);
+    return fPending && !fFailed;
+}
+
+bool CCoinsViewWriteBack::HasFailed() const
+{
+    LOCK(cs);
+    return fFailed;
+}
+
+size_t CCoinsViewWriteBack::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    return fPending ? nUsage : 0;
+}
+
+/** The block index is read at startup, and by the txindex lookups, which can miss */
+static CDBOptions BlockTreeOptions(size_t nCacheSize)
+{
+    CDBOptions dbOptions(nCacheSize);
+    dbOptions.nCompactAfterBytes = 64 << 20;
+    return dbOptions;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", BlockTreeOptions(nCacheSize), fMemory, fWipe)
 {
 }
 
 bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
 {
-    return Write(std::make_pair(DB_BLOCK_INDEX, blockindex.GetBlockHash()), blockindex);
+    CDBBatch batch;
+    // the block index snapshot (if any) is outdated
+    batch.Erase(DB_INDEX_SNAPSHOT);
+    batch.Write(std::make_pair(DB_BLOCK_INDEX, blockindex.GetBlockHash()), blockindex);
+    return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo& info)
@@ -262,22 +486,31 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
+    if (!blockinfo.empty()) {
+        // the block index snapshot (if any) is outdated
+        batch.Erase(DB_INDEX_SNAPSHOT);
+    }
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
+bool CBlockTreeDB::ReadBudgetCollateral(const uint256& txid, uint256& hashBlock, CTransactionRef& tx)
 {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
+    std::pair<uint256, CTransactionRef> entry;
+    if (!Read(std::make_pair(DB_BUDGET_COLLATERAL, txid), entry))
+        return false;
+    hashBlock = entry.first;
+    tx = entry.second;
+    return true;
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& vect)
+bool CBlockTreeDB::WriteBudgetCollaterals(const uint256& hashBlock, const std::vector<CTransactionRef>& vtx)
 {
     CDBBatch batch;
-    for (std::vector<std::pair<uint256, CDiskTxPos> >::const_iterator it = vect.begin(); it != vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    for (const CTransactionRef& tx : vtx)
+        batch.Write(std::make_pair(DB_BUDGET_COLLATERAL, tx->GetHash()), std::make_pair(hashBlock, tx));
     return WriteBatch(batch);
 }
 
@@ -305,6 +538,41 @@ bool CBlockTreeDB::ReadInt(const std::string& name, int& nValue)
     return Read(std::make_pair('I', name), nValue);
 }
 
+// Construct the block index object of a database (or snapshot) record
+static bool LoadDiskBlockIndex(const uint256& hashBlock, const CDiskBlockIndex& diskindex, std::function<CBlockIndex*(const uint256&)>& insertBlockIndex)
+{
+    CBlockIndex* pindexNew = insertBlockIndex(hashBlock);
+    pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
+    pindexNew->nHeight = diskindex.nHeight;
+    pindexNew->nFile = diskindex.nFile;
+    pindexNew->nDataPos = diskindex.nDataPos;
+    pindexNew->nUndoPos = diskindex.nUndoPos;
+    pindexNew->nVersion = diskindex.nVersion;
+    pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+    pindexNew->nTime = diskindex.nTime;
+    pindexNew->nBits = diskindex.nBits;
+    pindexNew->nNonce = diskindex.nNonce;
+    pindexNew->nStatus = diskindex.nStatus;
+    pindexNew->nTx = diskindex.nTx;
+
+    // sapling
+    pindexNew->nSaplingValue  = diskindex.nSaplingValue;
+    pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
+
+    //zerocoin
+    pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+
+    //Proof Of Stake
+    pindexNew->nFlags = diskindex.nFlags;
+    pindexNew->vStakeModifier = diskindex.vStakeModifier;
+
+    if (!Params().GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_POS)) {
+        if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
+            return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+    }
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -318,37 +586,8 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                // sapling
-                pindexNew->nSaplingValue  = diskindex.nSaplingValue;
-                pindexNew->hashFinalSaplingRoot = diskindex.hashFinalSaplingRoot;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-
-                //Proof Of Stake
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->vStakeModifier = diskindex.vStakeModifier;
-
-                if (!Params().GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_POS)) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-
+                if (!LoadDiskBlockIndex(diskindex.GetBlockHash(), diskindex, insertBlockIndex))
+                    return false;
                 pcursor->Next();
             } else {
                 return error("%s : failed to read value", __func__);
@@ -361,13 +600,104 @@ bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)
     return true;
 }
 
+/*
+ * Block index snapshot: a nonce, the number of records, the (hash, CDiskBlockIndex)
+ * records and the hash of all that. The nonce is also written in the database,
+ * and erased with the first change of the block index.
+ */
+static const uint32_t INDEX_SNAPSHOT_VERSION = 1;
+
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const fs::path& path, const std::vector<const CBlockIndex*>& vIndex)
+{
+    const uint256 nonce = GetRandHash();
+    const fs::path pathTmp = path.string() + ".new";
+    CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: failed to open %s", __func__, pathTmp.string());
+    try {
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        const uint64_t nCount = vIndex.size();
+        fileout << INDEX_SNAPSHOT_VERSION << nonce << nCount;
+        hasher << INDEX_SNAPSHOT_VERSION << nonce << nCount;
+        for (const CBlockIndex* pindex : vIndex) {
+            const CDiskBlockIndex diskindex(pindex);
+            fileout << pindex->GetBlockHash() << diskindex;
+            hasher << pindex->GetBlockHash() << diskindex;
+        }
+        fileout << hasher.GetHash();
+        FileCommit(fileout.Get());
+        fileout.fclose();
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    if (!RenameOver(pathTmp, path))
+        return error("%s: failed to rename %s", __func__, pathTmp.string());
+    return Write(DB_INDEX_SNAPSHOT, nonce, true);
+}
+
+bool CBlockTreeDB::LoadBlockIndexSnapshot(const fs::path& path, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
+{
+    uint256 nonceDB;
+    if (!Read(DB_INDEX_SNAPSHOT, nonceDB))
+        return false;
+    CAutoFile filein(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: failed to open %s", __func__, path.string());
+    try {
+        CHashVerifier<CAutoFile> verifier(&filein);
+        uint32_t nVersion;
+        uint256 nonce;
+        uint64_t nCount;
+        verifier >> nVersion >> nonce >> nCount;
+        if (nVersion != INDEX_SNAPSHOT_VERSION || nonce != nonceDB)
+            return error("%s: %s doesn't match the block index database", __func__, path.string());
+        for (uint64_t i = 0; i < nCount; i++) {
+            if (i % 10000 == 0) boost::this_thread::interruption_point();
+            uint256 hashBlock;
+            CDiskBlockIndex diskindex;
+            verifier >> hashBlock >> diskindex;
+            if (!LoadDiskBlockIndex(hashBlock, diskindex, insertBlockIndex))
+                return false;
+        }
+        uint256 hashFile;
+        filein >> hashFile;
+        if (hashFile != verifier.GetHash())
+            return error("%s: %s is corrupted", __func__, path.string());
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    return true;
+}
+
 bool CBlockTreeDB::ReadLegacyBlockIndex(const uint256& blockHash, CLegacyBlockIndex& biRet)
 {
     return Read(std::make_pair(DB_BLOCK_INDEX, blockHash), biRet);
 }
 
-CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "zerocoin", nCacheSize, fMemory, fWipe)
+//! Entries of the zerocoin spend cache: about 10MB
+static const size_t MAX_SPEND_CACHE_SIZE = 100000;
+
+/**
+ * The zerocoin database is mostly looked up for serials that were never spent: the
+ * bloom filters answer them. It is written in bulk by a snapshot load.
+ */
+static CDBOptions ZerocoinOptions(size_t nCacheSize)
+{
+    CDBOptions dbOptions(nCacheSize);
+    dbOptions.nCompactAfterBytes = 64 << 20;
+    return dbOptions;
+}
+
+CZerocoinDB::CZerocoinDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "zerocoin", ZerocoinOptions(nCacheSize), fMemory, fWipe)
+{
+}
+
+void CZerocoinDB::CacheCoinSpend(const uint256& hashSerial, const uint256& txHash)
 {
+    AssertLockHeld(cs_spendCache);
+    if (mapSpendCache.size() >= MAX_SPEND_CACHE_SIZE && !mapSpendCache.count(hashSerial))
+        mapSpendCache.clear();
+    mapSpendCache[hashSerial] = txHash;
 }
 
 bool CZerocoinDB::WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo)
@@ -415,7 +745,17 @@ bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::C
     }
 
     LogPrint(BCLog::COINDB, "Writing %u coin spends to db.\n", (unsigned int)count);
-    return WriteBatch(batch, true);
+    LOCK(cs_spendCache);
+    if (!WriteBatch(batch, true)) {
+        mapSpendCache.clear();
+        return false;
+    }
+    for (const auto& it : spendInfo) {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << it.first.getCoinSerialNumber();
+        CacheCoinSpend(Hash(ss.begin(), ss.end()), it.second);
+    }
+    return true;
 }
 
 bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
@@ -424,12 +764,26 @@ bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
     ss << bnSerial;
     uint256 hash = Hash(ss.begin(), ss.end());
 
-    return Read(std::make_pair('s', hash), txHash);
+    return ReadCoinSpend(hash, txHash);
 }
 
 bool CZerocoinDB::ReadCoinSpend(const uint256& hashSerial, uint256 &txHash)
 {
-    return Read(std::make_pair('s', hashSerial), txHash);
+    LOCK(cs_spendCache);
+    auto it = mapSpendCache.find(hashSerial);
+    if (it != mapSpendCache.end()) {
+        if (it->second.IsNull())
+            return false;
+        txHash = it->second;
+        return true;
+    }
+
+    uint256 txHashRead;
+    const bool fFound = Read(std::make_pair('s', hashSerial), txHashRead);
+    CacheCoinSpend(hashSerial, fFound ? txHashRead : UINT256_ZERO);
+    if (fFound)
+        txHash = txHashRead;
+    return fFound;
 }
 
 bool CZerocoinDB::EraseCoinSpend(const CBigNum& bnSerial)
@@ -438,6 +792,8 @@ bool CZerocoinDB::EraseCoinSpend(const CBigNum& bnSerial)
     ss << bnSerial;
     uint256 hash = Hash(ss.begin(), ss.end());
 
+    LOCK(cs_spendCache);
+    mapSpendCache.erase(hash);
     return Erase(std::make_pair('s', hash));
 }
 
@@ -473,13 +829,79 @@ bool CZerocoinDB::WipeCoins(std::string strType)
             LogPrintf("%s: error failed to delete %s\n", __func__, hash.GetHex());
     }
 
+    if (type == 's') {
+        LOCK(cs_spendCache);
+        mapSpendCache.clear();
+    }
+    return true;
+}
+
+
+bool CZerocoinDB::ReadCoinRecords(const std::string& strType, std::vector<std::pair<uint256, uint256> >& vRecords)
+{
+    if (strType != "spends" && strType != "mints")
+        return error("%s: did not recognize type %s", __func__, strType);
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    char type = (strType == "spends" ? 's' : 'm');
+    pcursor->Seek(std::make_pair(type, UINT256_ZERO));
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != type)
+            break;
+        uint256 txHash;
+        if (!pcursor->GetValue(txHash))
+            return error("%s : failed to read value", __func__);
+        vRecords.emplace_back(key.second, txHash);
+        pcursor->Next();
+    }
     return true;
 }
 
+bool CZerocoinDB::WriteCoinRecords(const std::string& strType, const std::vector<std::pair<uint256, uint256> >& vRecords)
+{
+    if (strType != "spends" && strType != "mints")
+        return error("%s: did not recognize type %s", __func__, strType);
+
+    char type = (strType == "spends" ? 's' : 'm');
+    CDBBatch batch;
+    for (const auto& record : vRecords) {
+        batch.Write(std::make_pair(type, record.first), record.second);
+        if (batch.SizeEstimate() > 16 << 20) {
+            if (!WriteBatch(batch))
+                return false;
+            batch.Clear();
+        }
+    }
+    const bool ret = WriteBatch(batch, true);
+    if (type == 's') {
+        LOCK(cs_spendCache);
+        mapSpendCache.clear();
+    }
+    return ret;
+}
+
 
 // Legacy Zerocoin Database
 static const char LZC_ACCUMCS = 'A';
 static const char LZC_MAPSUPPLY = 'M';
+static const char LZC_SNAPSHOT = 'Z';
+
+bool CZerocoinDB::WriteSnapshotBlock(int nHeight, const uint256& hashBlock)
+{
+    return Write(LZC_SNAPSHOT, std::make_pair(nHeight, hashBlock), true);
+}
+
+bool CZerocoinDB::ReadSnapshotBlock(int& nHeight, uint256& hashBlock)
+{
+    std::pair<int, uint256> block;
+    if (!Read(LZC_SNAPSHOT, block))
+        return false;
+    nHeight = block.first;
+    hashBlock = block.second;
+    return true;
+}
 
 bool CZerocoinDB::WriteZCSupply(const std::map<libzerocoin::CoinDenomination, int64_t>& mapZCS)
 {
@@ -636,158 +1058,3 @@ bool CCoinsViewDB::Upgrade() {
     db.WriteBatch(batch);
     return true;
 }
-
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value)
-{
-    return Read(std::make_pair(DB_SPENTINDEX, key), value);
-}
-
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect)
-{
-    CDBBatch batch;
-    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
-        } else {
-            batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
-{
-    CDBBatch batch;
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
-        } else {
-            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
-        }
-    }
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
-{
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, CAddressUnspentKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
-            CAddressUnspentValue nValue;
-            if (pcursor->GetValue(nValue)) {
-                unspentOutputs.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address unspent value");
-            }
-        } else {
-            break;
-        }
-    }
-
-    return true;
-}
-
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
-{
-    CDBBatch batch;
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect)
-{
-    CDBBatch batch;
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++)
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
-{
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
-    }
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
-            }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address index value");
-            }
-        } else {
-            break;
-        }
-    }
-
-    return true;
-}
-
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey& timestampIndex)
-{
-    CDBBatch batch;
-    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int& high, const unsigned int& low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& hashes)
-{
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, CTimestampIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high) {
-            if (fActiveOnly) {
-                if (HashOnchainActive(key.second.blockHash)) {
-                    hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-                }
-            } else {
-                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-            }
-
-            pcursor->Next();
-        } else {
-            break;
-        }
-    }
-
-    return true;
-}
-
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey& blockhashIndex, const CTimestampBlockIndexValue& logicalts)
-{
-    CDBBatch batch;
-    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256& hash, unsigned int& ltimestamp)
-{
-    CTimestampBlockIndexValue(lts);
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
-        return false;
-
-    ltimestamp = lts.ltimestamp;
-    return true;
-}
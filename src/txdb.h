@@ -9,18 +9,21 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "bloom.h"
 #include "coins.h"
 #include "chain.h"
 #include "dbwrapper.h"
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
+#include "sync.h"
 
-#include <index/addressindex.h>
-#include <index/spentindex.h>
-#include <index/timestampindex.h>
-
+#include <condition_variable>
+#include <list>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -31,12 +34,20 @@ class uint256;
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 100;
+//! -dbcacheretain default (%)
+static const int64_t nDefaultDbCacheRetain = 50;
+//! max. -dbcacheretain (%)
+static const int64_t nMaxDbCacheRetain = 90;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
 //! max. -dbcache in (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! Max memory allocated to the address, spent and timestamp index databases together (MiB)
+static const int64_t nMaxIndexCache = 1024;
+//! Max memory allocated to the zerocoin database (MiB)
+static const int64_t nMaxZerocoinDBCache = 8;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -73,9 +84,26 @@ class CCoinsViewDB : public CCoinsView
 protected:
     CDBWrapper db;
 
+    //! Recently used Sapling commitment trees by anchor, most recent first, so that
+    //! the shielded spends don't read (and deserialize) them again after each flush.
+    typedef std::list<std::pair<uint256, SaplingMerkleTree>> SaplingAnchorsLRU;
+    mutable RecursiveMutex cs_saplingAnchorsCache;
+    mutable SaplingAnchorsLRU lruSaplingAnchors;
+    mutable std::map<uint256, SaplingAnchorsLRU::iterator> mapSaplingAnchorsCache;
+    void CacheSaplingAnchor(const uint256& rt, const SaplingMerkleTree& tree) const;
+
+    //! Filter of the Sapling nullifiers in the database, built at the first use, so
+    //! that looking up a nullifier not spent yet (the common case) doesn't hit the disk.
+    mutable RecursiveMutex cs_nullifiersFilter;
+    mutable std::unique_ptr<CHashBloomFilter> pNullifiersFilter;
+    void LoadNullifiersFilter(size_t nMinElements) const;
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
+    //! See CDBWrapper::CompactStep
+    bool CompactStep(size_t nKeys) { return db.CompactStep(nKeys); }
+
     bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
     bool HaveCoin(const COutPoint& outpoint) const override;
     uint256 GetBestBlock() const override;
@@ -91,14 +119,21 @@ public:
                     const uint256& hashSaplingAnchor,
                     CAnchorsSaplingMap& mapSaplingAnchors,
                     CNullifiersMap& mapSaplingNullifiers) override;
+    //! Same as BatchWrite, but leaves the maps untouched
+    bool WriteCoins(const CCoinsMap& mapCoins,
+                    const uint256& hashBlock,
+                    const uint256& hashSaplingAnchor,
+                    const CAnchorsSaplingMap& mapSaplingAnchors,
+                    const CNullifiersMap& mapSaplingNullifiers);
 
     // Sapling, the implementation of the following functions can be found in sapling_txdb.cpp.
     bool GetSaplingAnchorAt(const uint256 &rt, SaplingMerkleTree &tree) const override;
     bool GetNullifier(const uint256 &nf) const override;
     uint256 GetBestAnchor() const override;
+    bool GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const override;
     bool BatchWriteSapling(const uint256& hashSaplingAnchor,
-                           CAnchorsSaplingMap& mapSaplingAnchors,
-                           CNullifiersMap& mapSaplingNullifiers,
+                           const CAnchorsSaplingMap& mapSaplingAnchors,
+                           const CNullifiersMap& mapSaplingNullifiers,
                            CDBBatch& batch);
 };
 
@@ -124,6 +159,65 @@ private:
     friend class CCoinsViewDB;
 };
 
+/**
+ * Layer between the coins cache and the coin database that writes flushed
+ * caches from a background thread. BatchWrite takes the maps over (they are
+ * swapped, not copied) and returns, so that a flush only stalls validation
+ * if the previous write is still in progress. Lookups are answered from the
+ * entries being written until they are committed. The database goes through
+ * the usual head blocks transition, so a crash in the middle of a write is
+ * recovered by ReplayBlocks.
+ */
+class CCoinsViewWriteBack : public CCoinsViewBacked
+{
+public:
+    //! viewIn is used for reads, dbIn for the writes
+    CCoinsViewWriteBack(CCoinsView* viewIn, CCoinsViewDB* dbIn);
+    ~CCoinsViewWriteBack();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const override;
+    bool HaveCoin(const COutPoint& outpoint) const override;
+    uint256 GetBestBlock() const override;
+    //! Waits for the pending write, the database being iterated directly
+    CCoinsViewCursor* Cursor() const override;
+    bool BatchWrite(CCoinsMap& mapCoins,
+                    const uint256& hashBlock,
+                    const uint256& hashSaplingAnchor,
+                    CAnchorsSaplingMap& mapSaplingAnchors,
+                    CNullifiersMap& mapSaplingNullifiers) override;
+
+    bool GetSaplingAnchorAt(const uint256& rt, SaplingMerkleTree& tree) const override;
+    bool GetNullifier(const uint256& nullifier) const override;
+    uint256 GetBestAnchor() const override;
+    //! Waits for the pending write, like Cursor
+    bool GetAllSaplingData(std::vector<std::pair<uint256, SaplingMerkleTree>>& vAnchors, std::vector<uint256>& vNullifiers) const override;
+
+    //! Wait until the pending write (if any) is committed. Returns false if a write failed.
+    bool Sync() const;
+    bool IsWriting() const;
+    bool HasFailed() const;
+    //! Memory held by the entries being written
+    size_t DynamicMemoryUsage() const;
+
+private:
+    CCoinsViewDB* db;
+
+    mutable Mutex cs;
+    mutable std::condition_variable cond;
+    bool fPending{false};
+    bool fFailed{false};
+    bool fStop{false};
+    CCoinsMap mapCoins;
+    uint256 hashBlock;
+    uint256 hashSaplingAnchor;
+    CAnchorsSaplingMap mapSaplingAnchors;
+    CNullifiersMap mapSaplingNullifiers;
+    size_t nUsage{0};
+
+    std::thread threadWriter;
+    void ThreadWriter();
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -141,27 +235,19 @@ public:
     bool ReadLastBlockFile(int& nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool& fReindex);
-    bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    //! The budget fee transactions, with the block that has them: CheckCollateral reads them here when there's no txindex
+    bool ReadBudgetCollateral(const uint256& txid, uint256& hashBlock, CTransactionRef& tx);
+    bool WriteBudgetCollaterals(const uint256& hashBlock, const std::vector<CTransactionRef>& vtx);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
     bool ReadInt(const std::string& name, int& nValue);
     bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! Dump vIndex to a flat file, to be loaded (faster) by LoadBlockIndexSnapshot until the block index changes
+    bool WriteBlockIndexSnapshot(const fs::path& path, const std::vector<const CBlockIndex*>& vIndex);
+    //! Returns false if there's no valid snapshot. The entries loaded (if any) must be discarded then.
+    bool LoadBlockIndexSnapshot(const fs::path& path, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
     bool ReadLegacyBlockIndex(const uint256& blockHash, CLegacyBlockIndex& biRet);
-
-    // Address Index
-    bool ReadSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value);
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect);
-    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
-    bool ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect);
-    bool ReadAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
-    bool WriteTimestampIndex(const CTimestampIndexKey& timestampIndex);
-    bool ReadTimestampIndex(const unsigned int& high, const unsigned int& low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& vect);
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey& blockhashIndex, const CTimestampBlockIndexValue& logicalts);
-    bool ReadTimestampBlockIndex(const uint256& hash, unsigned int& logicalTS);
 };
 
 /** Zerocoin database (zerocoin/) */
@@ -174,6 +260,17 @@ private:
     CZerocoinDB(const CZerocoinDB&);
     void operator=(const CZerocoinDB&);
 
+    struct SerialHasher {
+        size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
+    };
+
+    /** The spends read or written recently, by serial hash. A null txid
+     * records that the serial isn't spent, which is the answer to nearly
+     * every lookup made while connecting the zerocoin blocks. */
+    RecursiveMutex cs_spendCache;
+    std::unordered_map<uint256, uint256, SerialHasher> mapSpendCache;
+    void CacheCoinSpend(const uint256& hashSerial, const uint256& txHash);
+
 public:
     /** Write zDOGEC mints to the zerocoinDB in a batch */
     bool WriteCoinMintBatch(const std::vector<std::pair<libzerocoin::PublicCoin, uint256> >& mintInfo);
@@ -186,6 +283,12 @@ public:
     bool EraseCoinMint(const CBigNum& bnPubcoin);
     bool EraseCoinSpend(const CBigNum& bnSerial);
     bool WipeCoins(std::string strType);
+    /** All the "spends" (serial hash -> txid) or "mints" (pubcoin hash -> txid), and writing them back */
+    bool ReadCoinRecords(const std::string& strType, std::vector<std::pair<uint256, uint256> >& vRecords);
+    bool WriteCoinRecords(const std::string& strType, const std::vector<std::pair<uint256, uint256> >& vRecords);
+    /** The block of the zerocoin snapshot loaded in the database, if any */
+    bool WriteSnapshotBlock(int nHeight, const uint256& hashBlock);
+    bool ReadSnapshotBlock(int& nHeight, uint256& hashBlock);
 
     /** Map supply [denom] --> supply     */
     bool WriteZCSupply(const std::map<libzerocoin::CoinDenomination, int64_t>& mapZCS);
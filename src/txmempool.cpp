@@ -68,39 +68,45 @@ void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
-
-    while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (const txiter& childEntry : setChildren) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
-            if (cacheIt != cachedDescendants.end()) {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                for (const txiter& cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+    std::vector<txiter> stageEntries, vAllDescendants;
+    {
+        const EpochGuard epoch(*this);
+        for (const txiter& childEntry : GetMemPoolChildren(updateIt)) {
+            if (!visited(childEntry)) stageEntries.push_back(childEntry);
+        }
+
+        while (!stageEntries.empty()) {
+            const txiter cit = stageEntries.back();
+            stageEntries.pop_back();
+            vAllDescendants.push_back(cit);
+            const setEntries &setChildren = GetMemPoolChildren(cit);
+            for (const txiter& childEntry : setChildren) {
+                cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
+                if (cacheIt != cachedDescendants.end()) {
+                    // We've already calculated this one, just add the entries for this set
+                    // but don't traverse again.
+                    for (const txiter& cacheEntry : cacheIt->second) {
+                        if (!visited(cacheEntry)) vAllDescendants.push_back(cacheEntry);
+                    }
+                } else if (!visited(childEntry)) {
+                    // Schedule for later processing
+                    stageEntries.push_back(childEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // vAllDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (const txiter& cit : setAllDescendants) {
+    std::vector<txiter>& vCached = cachedDescendants[updateIt];
+    for (const txiter& cit : vAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            vCached.push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCount()));
         }
@@ -158,7 +164,13 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    setEntries parentHashes;
+    // The ancestors found, and the ones still to walk, are the entries
+    // visited in this epoch
+    const EpochGuard epoch(*this);
+    for (const txiter& ancestorIt : setAncestors) {
+        visited(ancestorIt);
+    }
+    std::vector<txiter> parentHashes;
     const auto &tx = entry.GetSharedTx();
 
     if (fSearchForParents) {
@@ -167,8 +179,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx->vin.size(); i++) {
             txiter piter = mapTx.find(tx->vin[i].prevout.hash);
-            if (piter != mapTx.end()) {
-                parentHashes.insert(piter);
+            if (piter != mapTx.end() && !visited(piter)) {
+                parentHashes.push_back(piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -179,16 +191,18 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (const txiter& piter : GetMemPoolParents(it)) {
+            if (!visited(piter)) parentHashes.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -205,8 +219,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter& phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -267,14 +281,14 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // Here we only update statistics and not data in mapLinks (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
+        std::vector<txiter> vDescendants;
         for (const txiter& removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
+            vDescendants.clear();
+            CalculateDescendants(removeIt, vDescendants); // self excluded
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCount();
-            for (const txiter& dit : setDescendants) {
+            for (const txiter& dit : vDescendants) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
             }
         }
@@ -389,6 +403,7 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
             mapTx.modify(newit, update_fee_delta(deltas.second));
         }
     }
+    UpdateFeeHistogram(*newit, 1);
 
     // Update cachedInnerUsage to include contained transaction's usage.
     // (When we update the entry for in-mempool parents, memory usage will be
@@ -449,6 +464,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
         }
     }
     totalTxSize -= it->GetTxSize();
+    UpdateFeeHistogram(*it, -1);
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
@@ -459,11 +475,40 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     removeSpentIndex(hash);
 }
 
+std::shared_ptr<const CTxMemPool::addressDeltaList> CTxMemPool::getAddressDeltas(const std::pair<uint160, int>& address) const
+{
+    LOCK(cs_indexes);
+    addressDeltaMap::const_iterator it = mapAddress.find(address);
+    return it != mapAddress.end() ? it->second : nullptr;
+}
+
+void CTxMemPool::updateAddressDeltas(const std::pair<uint160, int>& address, addressDeltaList&& deltas)
+{
+    AssertLockHeld(cs);
+    std::shared_ptr<const addressDeltaList> list;
+    if (!deltas.empty()) list = std::make_shared<const addressDeltaList>(std::move(deltas));
+    // the old list, if no reader holds it anymore, is freed after the lock is released
+    std::shared_ptr<const addressDeltaList> old;
+    LOCK(cs_indexes);
+    addressDeltaMap::iterator it = mapAddress.find(address);
+    if (it == mapAddress.end()) {
+        if (list) mapAddress.emplace(address, std::move(list));
+        return;
+    }
+    old = std::move(it->second);
+    if (list) {
+        it->second = std::move(list);
+    } else {
+        mapAddress.erase(it);
+    }
+}
+
 void CTxMemPool::addAddressIndex(const CTxMemPoolEntry& entry, const CCoinsViewCache& view)
 {
     LOCK(cs);
     const CTransaction& tx = entry.GetTx();
     std::vector<CMempoolAddressDeltaKey> inserted;
+    std::map<std::pair<uint160, int>, addressDeltaList> added;
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -473,13 +518,13 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry& entry, const CCoinsViewC
             std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin() + 2, prevout.scriptPubKey.begin() + 22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
+            added[std::make_pair(key.addressBytes, key.type)].emplace_back(key, delta);
             inserted.push_back(key);
         } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
             std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin() + 3, prevout.scriptPubKey.begin() + 23);
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
+            added[std::make_pair(key.addressBytes, key.type)].emplace_back(key, delta);
             inserted.push_back(key);
         }
     }
@@ -489,30 +534,53 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry& entry, const CCoinsViewC
         if (out.scriptPubKey.IsPayToScriptHash()) {
             std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 2, out.scriptPubKey.begin() + 22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+            added[std::make_pair(key.addressBytes, key.type)].emplace_back(key, CMempoolAddressDelta(entry.GetTime(), out.nValue));
             inserted.push_back(key);
         } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
             std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 3, out.scriptPubKey.begin() + 23);
-            std::pair<addressDeltaMap::iterator, bool> ret;
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+            added[std::make_pair(key.addressBytes, key.type)].emplace_back(key, CMempoolAddressDelta(entry.GetTime(), out.nValue));
             inserted.push_back(key);
         }
     }
 
+    // Merge the deltas of the transaction into a copy of the list of each
+    // address, kept in key order (an already indexed key is left as it is)
+    const CMempoolAddressDeltaKeyCompare comp;
+    for (auto& it : added) {
+        addressDeltaList& deltas = it.second;
+        std::stable_sort(deltas.begin(), deltas.end(), [&comp](const addressDelta& a, const addressDelta& b) {
+            return comp(a.first, b.first);
+        });
+        std::shared_ptr<const addressDeltaList> current = getAddressDeltas(it.first);
+        addressDeltaList merged;
+        merged.reserve((current ? current->size() : 0) + deltas.size());
+        addressDeltaList::const_iterator cit, cend;
+        if (current) {
+            cit = current->begin();
+            cend = current->end();
+        }
+        for (const addressDelta& delta : deltas) {
+            while (current && cit != cend && comp(cit->first, delta.first)) {
+                merged.push_back(*cit++);
+            }
+            bool fDuplicate = (current && cit != cend && !comp(delta.first, cit->first)) ||
+                              (!merged.empty() && !comp(merged.back().first, delta.first));
+            if (!fDuplicate) merged.push_back(delta);
+        }
+        if (current) merged.insert(merged.end(), cit, cend);
+        updateAddressDeltas(it.first, std::move(merged));
+    }
+
     mapAddressInserted.insert(std::make_pair(txhash, inserted));
 }
 
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> >& addresses,
-    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >& results)
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >& results) const
 {
-    LOCK(cs);
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
-        }
+        std::shared_ptr<const addressDeltaList> deltas = getAddressDeltas(*it);
+        if (deltas) results.insert(results.end(), deltas->begin(), deltas->end());
     }
     return true;
 }
@@ -523,9 +591,19 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
 
     if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
+        std::set<std::pair<uint160, int> > addresses;
+        for (const CMempoolAddressDeltaKey& key : it->second) {
+            addresses.emplace(key.addressBytes, key.type);
+        }
+        for (const std::pair<uint160, int>& address : addresses) {
+            std::shared_ptr<const addressDeltaList> current = getAddressDeltas(address);
+            if (!current) continue;
+            addressDeltaList deltas;
+            deltas.reserve(current->size());
+            for (const addressDelta& delta : *current) {
+                if (delta.first.txhash != txhash) deltas.push_back(delta);
+            }
+            updateAddressDeltas(address, std::move(deltas));
         }
         mapAddressInserted.erase(it);
     }
@@ -539,6 +617,7 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry& entry, const CCoinsViewCac
 
     const CTransaction& tx = entry.GetTx();
     std::vector<CSpentIndexKey> inserted;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > values;
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -561,17 +640,21 @@ void CTxMemPool::addSpentIndex(const CTxMemPoolEntry& entry, const CCoinsViewCac
         CSpentIndexKey key = CSpentIndexKey(input.prevout.hash, input.prevout.n);
         CSpentIndexValue value = CSpentIndexValue(txhash, j, -1, prevout.nValue, addressType, addressHash);
 
-        mapSpent.insert(std::make_pair(key, value));
+        values.emplace_back(key, value);
         inserted.push_back(key);
     }
 
+    {
+        LOCK(cs_indexes);
+        mapSpent.insert(values.begin(), values.end());
+    }
     mapSpentInserted.insert(std::make_pair(txhash, inserted));
 }
 
-bool CTxMemPool::getSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value)
+bool CTxMemPool::getSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value) const
 {
-    LOCK(cs);
-    mapSpentIndex::iterator it;
+    LOCK(cs_indexes);
+    mapSpentIndex::const_iterator it;
 
     it = mapSpent.find(key);
     if (it != mapSpent.end()) {
@@ -587,9 +670,9 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     mapSpentIndexInserted::iterator it = mapSpentInserted.find(txhash);
 
     if (it != mapSpentInserted.end()) {
-        std::vector<CSpentIndexKey> keys = (*it).second;
-        for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapSpent.erase(*mit);
+        LOCK(cs_indexes);
+        for (const CSpentIndexKey& key : it->second) {
+            mapSpent.erase(key);
         }
         mapSpentInserted.erase(it);
     }
@@ -605,27 +688,46 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants)
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
-    }
+    if (setDescendants.count(entryit)) return;
+
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stage(1, entryit);
+    visited(entryit);
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         for (const txiter& childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!visited(childiter) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
 }
 
+void CTxMemPool::CalculateDescendants(txiter entryit, std::vector<txiter>& vDescendants) const
+{
+    const EpochGuard epoch(*this);
+    visited(entryit);
+    const size_t nBegin = vDescendants.size();
+    for (const txiter& childiter : GetMemPoolChildren(entryit)) {
+        if (!visited(childiter)) vDescendants.push_back(childiter);
+    }
+    // Traverse down the children of entry, the entries of vDescendants past
+    // nBegin being the ones to walk (a breadth first walk, with no stage set).
+    for (size_t i = nBegin; i < vDescendants.size(); i++) {
+        const setEntries &setChildren = GetMemPoolChildren(vDescendants[i]);
+        for (const txiter& childiter : setChildren) {
+            if (!visited(childiter)) vDescendants.push_back(childiter);
+        }
+    }
+}
+
 void CTxMemPool::removeRecursive(const CTransaction& origTx, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
@@ -750,13 +852,15 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
                                 bool fCurrentEstimate)
 {
     LOCK(cs);
-    std::vector<CTxMemPoolEntry> entries;
+    std::vector<const CTxMemPoolEntry*> entries;
     for (const auto& tx : vtx) {
         uint256 hash = tx->GetHash();
         indexed_transaction_set::iterator i = mapTx.find(hash);
         if (i != mapTx.end())
-            entries.push_back(*i);
+            entries.push_back(&*i);
     }
+    // Update policy estimates before the entries of the block leave the mempool
+    minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
     for (const auto& tx : vtx) {
         txiter it = mapTx.find(tx->GetHash());
         if (it != mapTx.end()) {
@@ -767,8 +871,6 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
-    // After the txs in the new block have been removed from the mempool, update policy estimates
-    minerPolicyEstimator->processBlock(nBlockHeight, entries, fCurrentEstimate);
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
 }
@@ -780,6 +882,7 @@ void CTxMemPool::_clear()
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
+    feeHistogram.fill(FeeRateBucket());
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
@@ -805,6 +908,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
+    std::array<FeeRateBucket, FEE_HISTOGRAM_BUCKETS> checkHistogram;
 
     CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache*>(pcoins));
 
@@ -813,6 +917,10 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
         unsigned int i = 0;
         checkTotal += it->GetTxSize();
+        FeeRateBucket& bucket = checkHistogram[GetFeeHistogramBucket(CFeeRate(it->GetModifiedFee(), it->GetTxSize()))];
+        bucket.nCount++;
+        bucket.nBytes += it->GetTxSize();
+        bucket.nFees += it->GetModifiedFee();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
@@ -904,7 +1012,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
         else {
             CValidationState state;
             PrecomputedTransactionData precomTxData(tx);
-            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, precomTxData, NULL));
+            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, false, precomTxData, NULL));
             UpdateCoins(tx, mempoolDuplicate, 1000000);
         }
     }
@@ -920,7 +1028,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
             assert(stepsSinceLastRemove < waitingOnDependants.size());
         } else {
             PrecomputedTransactionData precomTxData(entry->GetTx());
-            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, precomTxData, NULL));
+            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, false, precomTxData, NULL));
             UpdateCoins(entry->GetTx(), mempoolDuplicate, 1000000);
             stepsSinceLastRemove = 0;
         }
@@ -937,6 +1045,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     checkNullifiers();
 
     assert(totalTxSize == checkTotal);
+    assert(feeHistogram == checkHistogram);
     assert(innerUsage == cachedInnerUsage);
 }
 
@@ -1064,16 +1173,6 @@ CFeeRate CTxMemPool::estimateSmartFee(int nBlocks, int *answerFoundAtBlocks) con
     LOCK(cs);
     return minerPolicyEstimator->estimateSmartFee(nBlocks, answerFoundAtBlocks, *this);
 }
-double CTxMemPool::estimatePriority(int nBlocks) const
-{
-    LOCK(cs);
-    return minerPolicyEstimator->estimatePriority(nBlocks);
-}
-double CTxMemPool::estimateSmartPriority(int nBlocks, int *answerFoundAtBlocks) const
-{
-    LOCK(cs);
-    return minerPolicyEstimator->estimateSmartPriority(nBlocks, answerFoundAtBlocks, *this);
-}
 
 bool CTxMemPool::WriteFeeEstimates(CAutoFile& fileout) const
 {
@@ -1113,9 +1212,12 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+        ++nTransactionsUpdated;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
+            UpdateFeeHistogram(*it, -1);
             mapTx.modify(it, update_fee_delta(deltas.second));
+            UpdateFeeHistogram(*it, 1);
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
             uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -1261,6 +1363,20 @@ void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
     }
 }
 
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool& in) : pool(in)
+{
+    assert(!pool.m_has_epoch_guard);
+    ++pool.m_epoch;
+    pool.m_has_epoch_guard = true;
+}
+
+CTxMemPool::EpochGuard::~EpochGuard()
+{
+    // prevents stale results being used
+    ++pool.m_epoch;
+    pool.m_has_epoch_guard = false;
+}
+
 const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
@@ -1302,6 +1418,49 @@ CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const
     return std::max(CFeeRate(rollingMinimumFeeRate), minReasonableRelayFee);
 }
 
+void CTxMemPool::UpdateFeeHistogram(const CTxMemPoolEntry& entry, int64_t nDirection)
+{
+    AssertLockHeld(cs);
+    FeeRateBucket& bucket = feeHistogram[GetFeeHistogramBucket(CFeeRate(entry.GetModifiedFee(), entry.GetTxSize()))];
+    bucket.nCount += nDirection;
+    bucket.nBytes += nDirection * (int64_t)entry.GetTxSize();
+    bucket.nFees += nDirection * entry.GetModifiedFee();
+}
+
+unsigned int CTxMemPool::GetFeeHistogramBucket(const CFeeRate& feeRate)
+{
+    CAmount nFeePerK = feeRate.GetFeePerK();
+    unsigned int nBucket = 0;
+    while (nFeePerK > 1 && nBucket < FEE_HISTOGRAM_BUCKETS - 1) {
+        nFeePerK >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+CFeeRate CTxMemPool::GetFeeHistogramBucketStart(unsigned int nBucket)
+{
+    return CFeeRate(nBucket == 0 ? 0 : (CAmount)1 << nBucket);
+}
+
+std::array<FeeRateBucket, FEE_HISTOGRAM_BUCKETS> CTxMemPool::GetFeeHistogram() const
+{
+    LOCK(cs);
+    return feeHistogram;
+}
+
+CFeeRate CTxMemPool::GetBlockFillFeeRate(uint64_t nBlockBytes) const
+{
+    LOCK(cs);
+    uint64_t nBytes = 0;
+    for (unsigned int i = FEE_HISTOGRAM_BUCKETS; i-- > 0;) {
+        nBytes += feeHistogram[i].nBytes;
+        if (nBytes >= nBlockBytes)
+            return GetFeeHistogramBucketStart(i);
+    }
+    return CFeeRate(0);
+}
+
 void CTxMemPool::trackPackageRemoved(const CFeeRate& rate)
 {
     AssertLockHeld(cs);
@@ -1368,3 +1527,16 @@ void CTxMemPool::SetIsLoaded(bool loaded)
     m_is_loaded = loaded;
 }
 
+void CTxMemPool::SetLoadProgress(uint64_t done, uint64_t total)
+{
+    m_load_total = total;
+    m_load_done = done;
+}
+
+double CTxMemPool::GetLoadProgress() const
+{
+    if (IsLoaded()) return 1.0;
+    const uint64_t total = m_load_total;
+    return total ? std::min(1.0, (double)m_load_done / total) : 0.0;
+}
+
@@ -9,6 +9,8 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <array>
+#include <atomic>
 #include <list>
 #include <memory>
 #include <set>
@@ -102,6 +104,9 @@ private:
     unsigned int nSigOpCountWithAncestors;
 
 public:
+    //! Epoch of the last mempool walk that reached this entry (see CTxMemPool::EpochGuard)
+    mutable uint64_t m_epoch{0};
+
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
             int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
             bool poolHasNoInputsOf, CAmount _inChainInputValue, bool _spendsCoinbaseOrCoinstake,
@@ -323,6 +328,25 @@ enum class MemPoolRemovalReason {
     REPLACED     //! Removed for replacement
 };
 
+/** Number of buckets of the fee rate histogram of the mempool. Bucket 0 holds
+ *  the transactions paying less than 2 satoshis per kB, and bucket i > 0 the
+ *  ones paying [2^i, 2^(i+1)) satoshis per kB (the last one being open ended). */
+static const unsigned int FEE_HISTOGRAM_BUCKETS = 40;
+
+/** The transactions of the mempool in a bucket of the fee rate histogram,
+ *  ranked by their own modified fee rate (not the one of their packages). */
+struct FeeRateBucket
+{
+    uint64_t nCount{0};
+    uint64_t nBytes{0};
+    CAmount nFees{0};
+
+    bool operator==(const FeeRateBucket& other) const
+    {
+        return nCount == other.nCount && nBytes == other.nBytes && nFees == other.nFees;
+    }
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -418,6 +442,12 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //! minimum fee to get into the pool, decreases exponentially
 
+    std::array<FeeRateBucket, FEE_HISTOGRAM_BUCKETS> feeHistogram; //! updated as the transactions enter and leave the pool
+    void UpdateFeeHistogram(const CTxMemPoolEntry& entry, int64_t nDirection);
+
+    mutable uint64_t m_epoch{0}; //! epoch of the walk in progress (see EpochGuard)
+    mutable bool m_has_epoch_guard{false};
+
     void trackPackageRemoved(const CFeeRate& rate);
 
     // Shielded txes
@@ -425,6 +455,9 @@ private:
     void checkNullifiers() const;
 
     bool m_is_loaded GUARDED_BY(cs){false};
+    //! Transactions of the mempool file replayed so far, out of m_load_total
+    std::atomic<uint64_t> m_load_done{0};
+    std::atomic<uint64_t> m_load_total{0};
 
 public:
 
@@ -501,8 +534,34 @@ public:
 
     const setEntries & GetMemPoolParents(txiter entry) const;
     const setEntries & GetMemPoolChildren(txiter entry) const;
+
+    /**
+     * The walks of the ancestors and descendants of a transaction mark the
+     * entries they reach with the epoch of the walk, instead of collecting
+     * them in a set (allocating a node for each of them) to know which have
+     * been seen. An EpochGuard starts a new epoch for the walk in its scope;
+     * visited() then tells (and marks) whether the walk reached an entry
+     * already. The walks don't nest, and run with cs held.
+     */
+    class EpochGuard
+    {
+        const CTxMemPool& pool;
+
+    public:
+        explicit EpochGuard(const CTxMemPool& in);
+        ~EpochGuard();
+    };
+
+    /** Whether the walk in progress reached the entry already; marks it as reached */
+    bool visited(txiter it) const
+    {
+        assert(m_has_epoch_guard);
+        const bool ret = it->m_epoch >= m_epoch;
+        it->m_epoch = m_epoch;
+        return ret;
+    }
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
         setEntries parents;
@@ -512,18 +571,39 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    /**
+     * The address and spent indexes are read by the RPC calls without taking
+     * cs, so that they don't wait for (or hold up) the transaction acceptance:
+     * they only take cs_indexes, long enough to look up an entry. They are
+     * changed with both locks held (cs first), the writers being serialized
+     * by cs.
+     *
+     * The deltas of an address are kept in an immutable list, shared with the
+     * readers: a change makes a new copy of the list of the address, which is
+     * swapped in under cs_indexes, while the readers keep walking their
+     * snapshot of the old one.
+     */
+    mutable Mutex cs_indexes;
+
     // Address Index
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
-    addressDeltaMap mapAddress;
+    typedef std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> addressDelta;
+    typedef std::vector<addressDelta> addressDeltaList;
+    typedef std::map<std::pair<uint160, int>, std::shared_ptr<const addressDeltaList> > addressDeltaMap;
+    addressDeltaMap mapAddress GUARDED_BY(cs_indexes);
 
     typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
-    addressDeltaMapInserted mapAddressInserted;
+    addressDeltaMapInserted mapAddressInserted GUARDED_BY(cs);
 
     typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
-    mapSpentIndex mapSpent;
+    mapSpentIndex mapSpent GUARDED_BY(cs_indexes);
 
     typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
-    mapSpentIndexInserted mapSpentInserted;
+    mapSpentIndexInserted mapSpentInserted GUARDED_BY(cs);
+
+    /** Swap in the new list of deltas of an address (an empty one removes the address) */
+    void updateAddressDeltas(const std::pair<uint160, int>& address, addressDeltaList&& deltas);
+    /** Snapshot of the deltas of an address, or nullptr if there are none */
+    std::shared_ptr<const addressDeltaList> getAddressDeltas(const std::pair<uint160, int>& address) const;
 
 
     void UpdateParent(txiter entry, txiter parent, bool add);
@@ -563,12 +643,13 @@ public:
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate = true);
 
     void addAddressIndex(const CTxMemPoolEntry& entry, const CCoinsViewCache& view);
+    /** Lookups of the address and spent indexes don't lock cs (see cs_indexes) */
     bool getAddressIndex(std::vector<std::pair<uint160, int> >& addresses,
-        std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >& results);
+        std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >& results) const;
     bool removeAddressIndex(const uint256 txhash);
 
     void addSpentIndex(const CTxMemPoolEntry& entry, const CCoinsViewCache& view);
-    bool getSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value);
+    bool getSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value) const;
     bool removeSpentIndex(const uint256 txhash);
 
     void removeRecursive(const CTransaction& tx, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
@@ -639,6 +720,20 @@ public:
      */
     CFeeRate GetMinFee(size_t sizelimit) const;
 
+    /** The bucket of the fee rate histogram of a fee rate, and the lowest fee rate of a bucket */
+    static unsigned int GetFeeHistogramBucket(const CFeeRate& feeRate);
+    static CFeeRate GetFeeHistogramBucketStart(unsigned int nBucket);
+
+    /** A copy of the fee rate histogram of the mempool */
+    std::array<FeeRateBucket, FEE_HISTOGRAM_BUCKETS> GetFeeHistogram() const;
+
+    /** Estimate of the fee rate needed to make it into a block of nBlockBytes,
+     *  from the histogram: the start of the bucket where the transactions of
+     *  the higher buckets fill the block, 0 if the whole mempool fits.
+     *  This doesn't walk mapTx, and ignores the packages of the transactions.
+     */
+    CFeeRate GetBlockFillFeeRate(uint64_t nBlockBytes) const;
+
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
       *  pvNoSpendsRemaining, if set, will be populated with the list of transactions
       *  which are not in mempool which no longer have any spends in this mempool.
@@ -654,6 +749,12 @@ public:
     /** Sets the current loaded state */
     void SetIsLoaded(bool loaded);
 
+    /** Sets the progress of the load from disk: done transactions of the file replayed, out of total */
+    void SetLoadProgress(uint64_t done, uint64_t total);
+
+    /** @returns the fraction of the mempool file replayed so far, 1 once the mempool is loaded */
+    double GetLoadProgress() const;
+
     unsigned long size() const
     {
         LOCK(cs);
@@ -691,15 +792,6 @@ public:
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
 
-    /** Estimate priority needed to get into the next nBlocks
-     *  If no answer can be given at nBlocks, return an estimate
-     *  at the lowest number of blocks where one can be given
-     */
-    double estimateSmartPriority(int nBlocks, int *answerFoundAtBlocks = NULL) const;
-
-    /** Estimate priority needed to get into the next nBlocks */
-    double estimatePriority(int nBlocks) const;
-
     /** Write/Read estimates to disk */
     bool WriteFeeEstimates(CAutoFile& fileout) const;
     bool ReadFeeEstimates(CAutoFile& filein);
@@ -740,6 +832,8 @@ private:
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
     void CalculateDescendants(txiter it, setEntries &setDescendants);
+    /** Populate vDescendants with the in-mempool descendants of it, it excluded. */
+    void CalculateDescendants(txiter it, std::vector<txiter>& vDescendants) const;
 
     /** Before calling removeUnchecked for a given transaction,
      *  UpdateForRemoveFromMempool must be called on the entire (dependent) set
@@ -0,0 +1,145 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Copyright (c) 2021 The DogeCash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanage.h"
+
+#include "logging.h"
+#include "random.h"
+
+bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
+{
+    const uint256& hash = tx->GetHash();
+    if (mapOrphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    unsigned int sz = tx->GetTotalSize();
+    if (sz > MAX_ORPHAN_TX_SIZE) {
+        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    size_t& nPeerBytes = mapPeerBytes[peer];
+    if (nPeerBytes + sz > nMaxPeerBytes) {
+        LogPrint(BCLog::MEMPOOL, "ignoring orphan tx %s, peer=%d over its orphans budget (%u bytes)\n", hash.ToString(), peer, nPeerBytes);
+        if (nPeerBytes == 0) mapPeerBytes.erase(peer);
+        return false;
+    }
+
+    auto ret = mapOrphans.emplace(hash, OrphanTx{tx, peer, vOrphanList.size()});
+    assert(ret.second);
+    vOrphanList.push_back(ret.first);
+    nPeerBytes += sz;
+    for (const CTxIn& txin : tx->vin) {
+        mapOrphansByPrevout[txin.prevout].insert(ret.first);
+    }
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
+        mapOrphans.size(), mapOrphansByPrevout.size());
+    return true;
+}
+
+bool TxOrphanage::HaveTx(const uint256& txid) const
+{
+    return mapOrphans.count(txid) > 0;
+}
+
+bool TxOrphanage::GetTx(const uint256& txid, CTransactionRef& txOut, NodeId& peerOut) const
+{
+    const auto it = mapOrphans.find(txid);
+    if (it == mapOrphans.end())
+        return false;
+    txOut = it->second.tx;
+    peerOut = it->second.fromPeer;
+    return true;
+}
+
+int TxOrphanage::EraseTx(const uint256& txid)
+{
+    OrphanMap::iterator it = mapOrphans.find(txid);
+    if (it == mapOrphans.end())
+        return 0;
+    for (const CTxIn& txin : it->second.tx->vin) {
+        auto itPrev = mapOrphansByPrevout.find(txin.prevout);
+        if (itPrev == mapOrphansByPrevout.end())
+            continue;
+        itPrev->second.erase(it);
+        if (itPrev->second.empty())
+            mapOrphansByPrevout.erase(itPrev);
+    }
+
+    auto itPeer = mapPeerBytes.find(it->second.fromPeer);
+    assert(itPeer != mapPeerBytes.end());
+    itPeer->second -= it->second.tx->GetTotalSize();
+    if (itPeer->second == 0)
+        mapPeerBytes.erase(itPeer);
+
+    // Move the last orphan of the list in the place of the erased one
+    const size_t nOldPos = it->second.nListPos;
+    assert(vOrphanList[nOldPos] == it);
+    if (nOldPos + 1 != vOrphanList.size()) {
+        OrphanMap::iterator itLast = vOrphanList.back();
+        vOrphanList[nOldPos] = itLast;
+        itLast->second.nListPos = nOldPos;
+    }
+    vOrphanList.pop_back();
+
+    mapOrphans.erase(it);
+    return 1;
+}
+
+void TxOrphanage::EraseForPeer(NodeId peer)
+{
+    if (!mapPeerBytes.count(peer))
+        return;
+
+    int nErased = 0;
+    OrphanMap::iterator iter = mapOrphans.begin();
+    while (iter != mapOrphans.end()) {
+        OrphanMap::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
+        if (maybeErase->second.fromPeer == peer) {
+            nErased += EraseTx(maybeErase->first);
+        }
+    }
+    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer %d\n", nErased, peer);
+}
+
+unsigned int TxOrphanage::LimitOrphans(unsigned int nMaxOrphans)
+{
+    unsigned int nEvicted = 0;
+    FastRandomContext rng;
+    while (mapOrphans.size() > nMaxOrphans) {
+        // Evict a random orphan:
+        const size_t nPos = rng.randrange(vOrphanList.size());
+        EraseTx(vOrphanList[nPos]->first);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+std::vector<uint256> TxOrphanage::GetChildren(const CTransaction& tx) const
+{
+    std::set<uint256> setChildren;
+    const uint256& hash = tx.GetHash();
+    for (uint32_t n = 0; n < tx.vout.size(); n++) {
+        const auto itByPrev = mapOrphansByPrevout.find(COutPoint(hash, n));
+        if (itByPrev == mapOrphansByPrevout.end())
+            continue;
+        for (const OrphanMap::iterator& it : itByPrev->second) {
+            setChildren.insert(it->first);
+        }
+    }
+    return std::vector<uint256>(setChildren.begin(), setChildren.end());
+}
+
+size_t TxOrphanage::PeerBytes(NodeId peer) const
+{
+    const auto it = mapPeerBytes.find(peer);
+    return it != mapPeerBytes.end() ? it->second : 0;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2021 The Bitcoin Core developers
+// Copyright (c) 2021 The DogeCash Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or https://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_TXORPHANAGE_H
+#define DOGEC_TXORPHANAGE_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+/** Orphan transactions bigger than this are ignored (a peer with a legitimate one rebroadcasts it later) */
+static const unsigned int MAX_ORPHAN_TX_SIZE = 5000;
+/** Maximum total size of the orphans kept for a single peer */
+static const size_t MAX_ORPHAN_BYTES_PER_PEER = 20 * MAX_ORPHAN_TX_SIZE;
+
+/**
+ * The transactions received with inputs we don't know about yet (orphans),
+ * indexed by the outpoints they spend: once a transaction is accepted, the
+ * orphans spending its outputs are found directly. Each peer has a budget of
+ * orphan bytes, so that a single peer can't push out the orphans of the
+ * others, and the eviction of the global limit picks a random orphan in
+ * constant time. Not thread safe, guarded by cs_main in net_processing.
+ */
+class TxOrphanage
+{
+public:
+    explicit TxOrphanage(size_t nMaxPeerBytesIn = MAX_ORPHAN_BYTES_PER_PEER) : nMaxPeerBytes(nMaxPeerBytesIn) {}
+
+    /** Add an orphan received from peer. Returns false if it's known already, too big, or the peer is over budget. */
+    bool AddTx(const CTransactionRef& tx, NodeId peer);
+
+    bool HaveTx(const uint256& txid) const;
+
+    /** Get an orphan and the peer it was received from. Returns false if it isn't (anymore) an orphan. */
+    bool GetTx(const uint256& txid, CTransactionRef& txOut, NodeId& peerOut) const;
+
+    /** Erase an orphan. Returns the number of erased transactions (0 or 1). */
+    int EraseTx(const uint256& txid);
+
+    /** Erase the orphans received from peer */
+    void EraseForPeer(NodeId peer);
+
+    /** Evict random orphans until at most nMaxOrphans are left. Returns the number evicted. */
+    unsigned int LimitOrphans(unsigned int nMaxOrphans);
+
+    /** The orphans spending an output of tx, in no particular order */
+    std::vector<uint256> GetChildren(const CTransaction& tx) const;
+
+    size_t Size() const { return mapOrphans.size(); }
+    size_t PeerBytes(NodeId peer) const;
+
+protected:
+    struct OrphanTx {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        //! Position in vOrphanList
+        size_t nListPos;
+    };
+    typedef std::map<uint256, OrphanTx> OrphanMap;
+
+    struct IteratorComparator {
+        bool operator()(const OrphanMap::iterator& a, const OrphanMap::iterator& b) const
+        {
+            return a->first < b->first;
+        }
+    };
+
+    OrphanMap mapOrphans;
+    //! The orphans spending each outpoint
+    std::map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>> mapOrphansByPrevout;
+    //! All the orphans, for the random eviction
+    std::vector<OrphanMap::iterator> vOrphanList;
+    //! Total size of the orphans of each peer
+    std::map<NodeId, size_t> mapPeerBytes;
+
+    const size_t nMaxPeerBytes;
+};
+
+#endif // DOGEC_TXORPHANAGE_H
@@ -0,0 +1,92 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txprecheck.h"
+
+#include "logging.h"
+#include "util/threadnames.h"
+
+#include <boost/thread.hpp>
+
+CTxPreCheckQueue txprecheckqueue(MAX_TXS_PRECHECK_QUEUE);
+
+void CTxPreCheckQueue::SetNotifyCallback(std::function<void()> func)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    notify = std::move(func);
+}
+
+bool CTxPreCheckQueue::Push(const CTransactionRef& tx, NodeId nodeid)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0 || queue.size() >= nMaxSize)
+            return false;
+        queue.push_back(Entry{tx, nodeid, TxPreCheckResult(), false});
+        setHashes.insert(tx->GetHash());
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+std::vector<CTxPreCheckQueue::Entry> CTxPreCheckQueue::PopChecked()
+{
+    std::vector<Entry> vRet;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!queue.empty() && queue.front().fDone) {
+        setHashes.erase(setHashes.find(queue.front().tx->GetHash()));
+        vRet.emplace_back(std::move(queue.front()));
+        queue.pop_front();
+        nNextToCheck--;
+    }
+    return vRet;
+}
+
+bool CTxPreCheckQueue::Contains(const uint256& hash) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return setHashes.count(hash) > 0;
+}
+
+void CTxPreCheckQueue::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nWorkers++;
+    try {
+        while (true) {
+            while (nNextToCheck >= queue.size()) {
+                condWorker.wait(lock); // interruption point
+            }
+            // References to deque elements survive insertions at the back, and
+            // the entry can't be popped before it's done.
+            Entry& entry = queue[nNextToCheck++];
+            CTransactionRef tx = entry.tx;
+            TxPreCheckResult result;
+            lock.unlock();
+            try {
+                PreCheckTransaction(*tx, result);
+            } catch (const std::exception& e) {
+                // leave it to AcceptToMemoryPool
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+            lock.lock();
+            entry.result = std::move(result);
+            entry.fDone = true;
+            std::function<void()> func = notify;
+            lock.unlock();
+            if (func) func();
+            lock.lock();
+        }
+    } catch (const boost::thread_interrupted&) {
+        if (!lock.owns_lock()) lock.lock();
+        nWorkers--;
+        throw;
+    }
+}
+
+void ThreadTxPreCheck()
+{
+    util::ThreadRename("dogecash-txcheck");
+    txprecheckqueue.Thread();
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXPRECHECK_H
+#define BITCOIN_TXPRECHECK_H
+
+#include "net.h"
+#include "primitives/transaction.h"
+#include "validation.h"
+
+#include <deque>
+#include <functional>
+#include <set>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Maximum number of received transactions held while waiting for their pre-check */
+static const unsigned int MAX_TXS_PRECHECK_QUEUE = 1000;
+
+/**
+ * Transactions received from the peers, waiting for PreCheckTransaction to
+ * run on worker threads, without cs_main. The message handler takes them back
+ * in arrival order once checked, for the AcceptToMemoryPool commit stage under
+ * cs_main, so that a flood of transactions doesn't verify its signatures and
+ * proofs one at a time with cs_main held.
+ */
+class CTxPreCheckQueue
+{
+public:
+    struct Entry {
+        CTransactionRef tx;
+        NodeId nodeid;
+        TxPreCheckResult result;
+        bool fDone;
+    };
+
+    explicit CTxPreCheckQueue(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    //! Called (without the queue lock held) every time a transaction has been checked
+    void SetNotifyCallback(std::function<void()> func);
+
+    //! Queue a transaction received from nodeid. Returns false if the queue is full or no worker is running.
+    bool Push(const CTransactionRef& tx, NodeId nodeid);
+
+    //! Take the checked transactions from the front of the queue
+    std::vector<Entry> PopChecked();
+
+    bool Contains(const uint256& hash) const;
+
+    //! Worker loop, exits when the thread is interrupted
+    void Thread();
+
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable condWorker;
+    //! In arrival order. Entries before nNextToCheck are taken by a worker (or done).
+    std::deque<Entry> queue;
+    size_t nNextToCheck{0};
+    std::multiset<uint256> setHashes;
+    int nWorkers{0};
+    const size_t nMaxSize;
+    std::function<void()> notify;
+};
+
+extern CTxPreCheckQueue txprecheckqueue;
+
+/** Run a worker of txprecheckqueue */
+void ThreadTxPreCheck();
+
+#endif // BITCOIN_TXPRECHECK_H
@@ -0,0 +1,187 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txreconciliation.h"
+
+#include "hash.h"
+#include "random.h"
+
+#include <algorithm>
+#include <limits>
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer)
+{
+    LOCK(cs);
+    const uint64_t nSalt = GetRand(std::numeric_limits<uint64_t>::max());
+    mapPreRegistered[peer] = nSalt;
+    return nSalt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId peer, bool fInbound, uint64_t nRemoteSalt)
+{
+    LOCK(cs);
+    auto it = mapPreRegistered.find(peer);
+    if (it == mapPreRegistered.end()) return false;
+    const uint64_t nLocalSalt = it->second;
+    mapPreRegistered.erase(it);
+
+    // the same keys on both sides, whichever salt is whose
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << std::string("Tx Relay Salting") << std::min(nLocalSalt, nRemoteSalt) << std::max(nLocalSalt, nRemoteSalt);
+    const uint256 hash = ss.GetHash();
+
+    PeerState& state = mapPeers[peer];
+    state.k0 = hash.GetUint64(0);
+    state.k1 = hash.GetUint64(1);
+    state.fInbound = fInbound;
+    if (!fInbound && nFloodPeers < OUTBOUND_FLOOD_PEERS) {
+        state.fFlood = true;
+        nFloodPeers++;
+    }
+    return true;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer)
+{
+    LOCK(cs);
+    mapPreRegistered.erase(peer);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end()) return;
+    const bool fFlood = it->second.fFlood;
+    mapPeers.erase(it);
+    if (!fFlood) return;
+
+    // hand the flooding over to another outbound peer
+    nFloodPeers--;
+    for (auto& p : mapPeers) {
+        if (!p.second.fInbound && !p.second.fFlood) {
+            p.second.fFlood = true;
+            nFloodPeers++;
+            break;
+        }
+    }
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer) const
+{
+    LOCK(cs);
+    return mapPeers.count(peer);
+}
+
+bool TxReconciliationTracker::ShouldFlood(NodeId peer) const
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    return it == mapPeers.end() || it->second.fFlood;
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer, const uint256& txid)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end() || it->second.setTx.size() >= MAX_RECONCILIATION_SET_SIZE) return false;
+    it->second.setTx.insert(txid);
+    return true;
+}
+
+bool TxReconciliationTracker::ShouldRequest(NodeId peer, int64_t nNow, uint32_t& nSetSize)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end()) return false;
+    PeerState& state = it->second;
+    if (state.fInbound || state.fRequested || state.nNextRequest > nNow) return false;
+    state.nNextRequest = PoissonNextSend(nNow, RECONCILIATION_INTERVAL);
+    state.fRequested = true;
+    nSetSize = state.setTx.size();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleRequest(NodeId peer, uint32_t nRemoteSetSize, PinSketch& sketch)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fInbound || it->second.fSketched) return false;
+    PeerState& state = it->second;
+
+    // The difference is at least the one of the sizes, with a margin for the
+    // transactions the peer and us got from others in the meantime.
+    const size_t nLocalSetSize = state.setTx.size();
+    const size_t nDiff = std::max<size_t>(nLocalSetSize, nRemoteSetSize) - std::min<size_t>(nLocalSetSize, nRemoteSetSize);
+    const size_t nCapacity = std::min(MAX_SKETCH_CAPACITY, nDiff + std::min<size_t>(nLocalSetSize, nRemoteSetSize) / 4 + 1);
+
+    sketch = PinSketch(nCapacity);
+    for (const uint256& txid : state.setTx) {
+        const uint32_t nShortID = GetShortID(state, txid);
+        if (state.mapSketched.emplace(nShortID, txid).second)
+            sketch.Add(nShortID);
+    }
+    state.setTx.clear();
+    state.fSketched = true;
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer, const PinSketch& sketch, bool& fSuccess, std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vAsk)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fRequested || sketch.GetCapacity() == 0 || sketch.GetCapacity() > MAX_SKETCH_CAPACITY)
+        return false;
+    PeerState& state = it->second;
+    state.fRequested = false;
+
+    std::map<uint32_t, uint256> mapLocal;
+    PinSketch diff(sketch.GetCapacity());
+    for (const uint256& txid : state.setTx) {
+        const uint32_t nShortID = GetShortID(state, txid);
+        if (mapLocal.emplace(nShortID, txid).second)
+            diff.Add(nShortID);
+    }
+    diff.Merge(sketch);
+
+    std::vector<uint32_t> vDiff;
+    fSuccess = diff.Decode(vDiff);
+    if (fSuccess) {
+        for (uint32_t nShortID : vDiff) {
+            auto itLocal = mapLocal.find(nShortID);
+            if (itLocal != mapLocal.end())
+                vAnnounce.push_back(itLocal->second);
+            else
+                vAsk.push_back(nShortID);
+        }
+    } else {
+        vAnnounce.assign(state.setTx.begin(), state.setTx.end());
+    }
+    state.setTx.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleDiff(NodeId peer, bool fSuccess, const std::vector<uint32_t>& vAsk, std::vector<uint256>& vAnnounce)
+{
+    LOCK(cs);
+    auto it = mapPeers.find(peer);
+    if (it == mapPeers.end() || !it->second.fSketched) return false;
+    PeerState& state = it->second;
+
+    if (fSuccess) {
+        for (uint32_t nShortID : vAsk) {
+            auto itSketched = state.mapSketched.find(nShortID);
+            if (itSketched != state.mapSketched.end())
+                vAnnounce.push_back(itSketched->second);
+        }
+    } else {
+        for (const auto& p : state.mapSketched)
+            vAnnounce.push_back(p.second);
+    }
+    state.mapSketched.clear();
+    state.fSketched = false;
+    return true;
+}
+
+uint32_t TxReconciliationTracker::GetShortID(const PeerState& state, const uint256& txid) const
+{
+    // the sketches take non-zero elements only
+    const uint32_t nShortID = (uint32_t)SipHashUint256(state.k0, state.k1, txid);
+    return nShortID == 0 ? 1 : nShortID;
+}
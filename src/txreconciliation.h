@@ -0,0 +1,110 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_TXRECONCILIATION_H
+#define DOGEC_TXRECONCILIATION_H
+
+#include "net.h"
+#include "pinsketch.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+/** Default for -txreconciliation, reconcile the transactions with the peers supporting it instead of announcing them all */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** Version of the reconciliation protocol, sent in sendtxrcncl */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Average delay between two reconciliations with an outbound peer, in seconds */
+static const int RECONCILIATION_INTERVAL = 8;
+/** Number of outbound reconciling peers the transactions are still announced to right away */
+static const size_t OUTBOUND_FLOOD_PEERS = 2;
+/** Maximum capacity of a sketch, the larger differences fall back to the announcement of the whole sets */
+static const size_t MAX_SKETCH_CAPACITY = 64;
+/** Maximum number of transactions waiting for the next reconciliation with a peer, the others are announced */
+static const size_t MAX_RECONCILIATION_SET_SIZE = 3000;
+
+/**
+ * The transactions to reconcile with each peer that negotiated it (Erlay).
+ * Instead of an inv per transaction to every peer, the transactions wait in
+ * a set per peer, and every RECONCILIATION_INTERVAL the side that opened the
+ * connection asks the other for the sketch of its set (reqtxrcncl/sketch).
+ * The difference of the two sets, decoded from the merge of the sketches, is
+ * all that gets announced (reconcildiff, then inv). A few outbound peers keep
+ * getting every transaction right away so that they still spread quickly,
+ * and the sets that don't decode fall back to the announcement of all their
+ * transactions. Thread safe.
+ */
+class TxReconciliationTracker
+{
+public:
+    /** Our salt for a new peer, to send in sendtxrcncl */
+    uint64_t PreRegisterPeer(NodeId peer);
+
+    /** Register a pre-registered peer that sent its sendtxrcncl. Returns false if it wasn't pre-registered. */
+    bool RegisterPeer(NodeId peer, bool fInbound, uint64_t nRemoteSalt);
+
+    void ForgetPeer(NodeId peer);
+
+    bool IsPeerRegistered(NodeId peer) const;
+
+    /** Whether the transactions are announced to a registered peer right away, rather than reconciled */
+    bool ShouldFlood(NodeId peer) const;
+
+    /** Add a transaction to the set of a registered peer. Returns false if the set is full (announce it then). */
+    bool AddToSet(NodeId peer, const uint256& txid);
+
+    /** Whether it's time to ask an outbound peer for its sketch, with the size of our set to send along */
+    bool ShouldRequest(NodeId peer, int64_t nNow, uint32_t& nSetSize);
+
+    /**
+     * Answer the request of an inbound peer with the sketch of our set, which
+     * is kept until its reconcildiff. Returns false if the peer can't ask.
+     */
+    bool HandleRequest(NodeId peer, uint32_t nRemoteSetSize, PinSketch& sketch);
+
+    /**
+     * The sketch of an outbound peer we asked: fills the transactions of our
+     * set the peer is missing, and the short ids of the ones it has for us;
+     * fSuccess is false if the difference didn't decode, vAnnounce is all of
+     * our set then. Returns false if the sketch wasn't asked for or is too big.
+     */
+    bool HandleSketch(NodeId peer, const PinSketch& sketch, bool& fSuccess, std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vAsk);
+
+    /**
+     * The reconcildiff of an inbound peer: fills the transactions of the
+     * sketched set to announce to it, all of them if it failed to decode.
+     * Returns false if no sketch was sent to the peer.
+     */
+    bool HandleDiff(NodeId peer, bool fSuccess, const std::vector<uint32_t>& vAsk, std::vector<uint256>& vAnnounce);
+
+private:
+    struct PeerState {
+        //! the SipHash keys of the short ids, out of both salts
+        uint64_t k0;
+        uint64_t k1;
+        bool fInbound;
+        bool fFlood{false};
+        //! the transactions to reconcile
+        std::set<uint256> setTx;
+        //! outbound: when to ask for the next sketch, and whether one is asked for
+        int64_t nNextRequest{0};
+        bool fRequested{false};
+        //! inbound: the set that was sketched, by short id, until the reconcildiff
+        std::map<uint32_t, uint256> mapSketched;
+        bool fSketched{false};
+    };
+
+    uint32_t GetShortID(const PeerState& state, const uint256& txid) const;
+
+    mutable Mutex cs;
+    //! our salts for the peers that didn't send theirs yet
+    std::map<NodeId, uint64_t> mapPreRegistered;
+    std::map<NodeId, PeerState> mapPeers;
+    size_t nFloodPeers{0};
+};
+
+#endif // DOGEC_TXRECONCILIATION_H
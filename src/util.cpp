@@ -491,7 +491,8 @@ void initZKSNARKS()
     auto sapling_spend_str = sapling_spend.native();
     auto sapling_output_str = sapling_output.native();
 
-    //LogPrintf("Loading Sapling (Spend) parameters from %s\n", sapling_spend.string().c_str());
+    // Only the verifying keys are loaded here: the proving parameters are
+    // loaded by LoadSaplingProvingParams, when the first proof is created
 
     librustzcash_init_zksnark_params(
         reinterpret_cast<const codeunit*>(sapling_spend_str.c_str()),
@@ -508,6 +509,23 @@ void initZKSNARKS()
     //std::cout << "### Sapling params initialized ###" << std::endl;
 }
 
+static Mutex csProvingParams;
+
+bool LoadSaplingProvingParams()
+{
+    static bool fLoaded = false;
+
+    LOCK(csProvingParams);
+    if (!fLoaded) {
+        int64_t nStart = GetTimeMillis();
+        fLoaded = librustzcash_load_zksnark_proving_params();
+        if (!fLoaded)
+            return error("%s: failed to load the Sapling proving parameters", __func__);
+        LogPrintf("Loaded the Sapling proving parameters in %dms\n", GetTimeMillis() - nStart);
+    }
+    return true;
+}
+
 const fs::path& GetDataDir(bool fNetSpecific)
 {
     LOCK(csPathCached);
@@ -96,6 +96,8 @@ const fs::path &GetDataDir(bool fNetSpecific = true);
 const fs::path &ZC_GetParamsDir();
 // Init sapling library
 void initZKSNARKS();
+// Load the sapling proving parameters, on the first call
+bool LoadSaplingProvingParams();
 void ClearDatadirCache();
 fs::path GetConfigFile();
 fs::path GetMasternodeConfigFile();
@@ -0,0 +1,133 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "util/lz4.h"
+
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const size_t MIN_MATCH = 4;
+//! The last bytes of the input are always literals
+const size_t LAST_LITERALS = 5;
+//! No match may start in the last bytes of the input
+const size_t MF_LIMIT = 12;
+const size_t MAX_OFFSET = 65535;
+const int HASH_LOG = 16;
+
+uint32_t Hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - HASH_LOG);
+}
+
+void WriteLength(std::vector<unsigned char>& vOut, size_t nLength)
+{
+    while (nLength >= 255) {
+        vOut.push_back(255);
+        nLength -= 255;
+    }
+    vOut.push_back((unsigned char)nLength);
+}
+
+void WriteLiterals(std::vector<unsigned char>& vOut, const unsigned char* pLiterals, size_t nLiterals, unsigned int nMatchToken)
+{
+    vOut.push_back((unsigned char)((std::min<size_t>(nLiterals, 15) << 4) | nMatchToken));
+    if (nLiterals >= 15) WriteLength(vOut, nLiterals - 15);
+    vOut.insert(vOut.end(), pLiterals, pLiterals + nLiterals);
+}
+
+bool ReadLength(const unsigned char* pSrc, size_t nSize, size_t& nPos, size_t nMax, size_t& nLength)
+{
+    unsigned char b;
+    do {
+        if (nPos >= nSize) return false;
+        b = pSrc[nPos++];
+        nLength += b;
+        if (nLength > nMax) return false;
+    } while (b == 255);
+    return true;
+}
+
+} // namespace
+
+void LZ4Compress(const unsigned char* pSrc, size_t nSize, std::vector<unsigned char>& vOut)
+{
+    vOut.clear();
+    vOut.reserve(nSize + nSize / 255 + 16);
+
+    size_t nAnchor = 0;
+    if (nSize > MF_LIMIT) {
+        // Last position seen for each hash of 4 bytes
+        std::vector<uint32_t> vTable(1 << HASH_LOG, 0);
+        const size_t nMatchLimit = nSize - LAST_LITERALS;
+        const size_t nLastMatchStart = nSize - MF_LIMIT;
+        size_t nPos = 1;
+        while (nPos <= nLastMatchStart) {
+            const uint32_t v = ReadLE32(pSrc + nPos);
+            uint32_t& entry = vTable[Hash(v)];
+            const size_t nCandidate = entry;
+            entry = (uint32_t)nPos;
+            if (nPos - nCandidate > MAX_OFFSET || ReadLE32(pSrc + nCandidate) != v) {
+                nPos++;
+                continue;
+            }
+            size_t nLength = MIN_MATCH;
+            while (nPos + nLength < nMatchLimit && pSrc[nCandidate + nLength] == pSrc[nPos + nLength]) {
+                nLength++;
+            }
+            const size_t nMatchLength = nLength - MIN_MATCH;
+            WriteLiterals(vOut, pSrc + nAnchor, nPos - nAnchor, std::min<size_t>(nMatchLength, 15));
+            const size_t nOffset = nPos - nCandidate;
+            vOut.push_back((unsigned char)(nOffset & 0xff));
+            vOut.push_back((unsigned char)(nOffset >> 8));
+            if (nMatchLength >= 15) WriteLength(vOut, nMatchLength - 15);
+            nPos += nLength;
+            nAnchor = nPos;
+        }
+    }
+    WriteLiterals(vOut, pSrc + nAnchor, nSize - nAnchor, 0);
+}
+
+bool LZ4Decompress(const unsigned char* pSrc, size_t nSize, unsigned char* pDst, size_t nDstSize)
+{
+    size_t nPos = 0;
+    size_t nOut = 0;
+    while (true) {
+        if (nPos >= nSize) return false;
+        const unsigned char token = pSrc[nPos++];
+
+        size_t nLiterals = token >> 4;
+        if (nLiterals == 15 && !ReadLength(pSrc, nSize, nPos, nDstSize, nLiterals)) return false;
+        if (nLiterals > nSize - nPos || nLiterals > nDstSize - nOut) return false;
+        memcpy(pDst + nOut, pSrc + nPos, nLiterals);
+        nPos += nLiterals;
+        nOut += nLiterals;
+
+        // the last sequence has no match
+        if (nPos == nSize) return nOut == nDstSize;
+
+        if (nSize - nPos < 2) return false;
+        const size_t nOffset = pSrc[nPos] | (pSrc[nPos + 1] << 8);
+        nPos += 2;
+        if (nOffset == 0 || nOffset > nOut) return false;
+
+        size_t nLength = token & 15;
+        if (nLength == 15 && !ReadLength(pSrc, nSize, nPos, nDstSize, nLength)) return false;
+        nLength += MIN_MATCH;
+        if (nLength > nDstSize - nOut) return false;
+        const unsigned char* pMatch = pDst + nOut - nOffset;
+        if (nOffset >= nLength) {
+            memcpy(pDst + nOut, pMatch, nLength);
+        } else {
+            // overlapping copy, repeating the last nOffset bytes
+            for (size_t i = 0; i < nLength; i++) {
+                pDst[nOut + i] = pMatch[i];
+            }
+        }
+        nOut += nLength;
+    }
+}
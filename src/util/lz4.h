@@ -0,0 +1,27 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_LZ4_H
+#define BITCOIN_UTIL_LZ4_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Compression in the LZ4 block format (a single block, no frame), with a
+ * greedy single-probe match finder: fast to compress, and much faster to
+ * decompress, which is what reading the block files back needs.
+ */
+
+/** Compress nSize bytes at pSrc into vOut (replacing its content) */
+void LZ4Compress(const unsigned char* pSrc, size_t nSize, std::vector<unsigned char>& vOut);
+
+/**
+ * Decompress the nSize bytes at pSrc into the nDstSize bytes at pDst.
+ * Returns false if the input is malformed or doesn't decompress to exactly
+ * nDstSize bytes. Never reads or writes out of bounds.
+ */
+bool LZ4Decompress(const unsigned char* pSrc, size_t nSize, unsigned char* pDst, size_t nDstSize);
+
+#endif // BITCOIN_UTIL_LZ4_H
@@ -0,0 +1,148 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "util/parallel.h"
+
+#include "sync.h"
+#include "util.h"
+#include "util/threadnames.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+/** A ParallelForEach call, shared by the threads working on it. */
+struct ParallelJob
+{
+    const size_t nCount;
+    //! Only called on the indexes below nCount, so never once the caller returned
+    const std::function<void(size_t)>* const pfn;
+    std::atomic<size_t> nNext{0};
+
+    Mutex cs;
+    std::condition_variable cond;
+    int nRunning GUARDED_BY(cs){0};
+    std::exception_ptr exception GUARDED_BY(cs);
+
+    ParallelJob(size_t nCountIn, const std::function<void(size_t)>& fn) : nCount(nCountIn), pfn(&fn) {}
+
+    // Work through the indexes not taken yet
+    void Run()
+    {
+        WITH_LOCK(cs, nRunning++);
+        size_t i;
+        while ((i = nNext++) < nCount) {
+            try {
+                (*pfn)(i);
+            } catch (...) {
+                LOCK(cs);
+                if (!exception) exception = std::current_exception();
+                nNext = nCount;
+            }
+        }
+        WITH_LOCK(cs, nRunning--);
+        cond.notify_all();
+    }
+};
+
+/** The threads helping the ParallelForEach callers, started on first use.
+ * It lives until the exit, past the lock profiling: its mutex is a plain one. */
+class WorkerPool
+{
+private:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::shared_ptr<ParallelJob>> queue;
+    bool fStop{false};
+    std::vector<std::thread> threads;
+
+    void Thread()
+    {
+        util::ThreadRename("dogecash-worker");
+        while (true) {
+            std::shared_ptr<ParallelJob> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this]() { return fStop || !queue.empty(); });
+                if (fStop) return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            job->Run();
+        }
+    }
+
+public:
+    WorkerPool()
+    {
+        for (int i = 1; i < GetNumCores(); i++) {
+            threads.emplace_back(&WorkerPool::Thread, this);
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+    size_t Size() const { return threads.size(); }
+
+    // Queue the job for nHelpers workers; the ones getting to it once it's done return at once
+    void Post(const std::shared_ptr<ParallelJob>& job, size_t nHelpers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.insert(queue.end(), nHelpers, job);
+        }
+        if (nHelpers == 1) {
+            cond.notify_one();
+        } else {
+            cond.notify_all();
+        }
+    }
+};
+
+WorkerPool& GetWorkerPool()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+} // namespace
+
+void ParallelForEach(size_t nCount, int nMaxThreads, const std::function<void(size_t)>& fn)
+{
+    if (nCount == 0) return;
+    auto job = std::make_shared<ParallelJob>(nCount, fn);
+    size_t nHelpers = std::min<size_t>(nCount, std::max(nMaxThreads, 1)) - 1;
+    if (nHelpers > 0) {
+        WorkerPool& pool = GetWorkerPool();
+        nHelpers = std::min(nHelpers, pool.Size());
+        if (nHelpers > 0) pool.Post(job, nHelpers);
+    }
+    job->Run();
+
+    std::exception_ptr exception;
+    {
+        WAIT_LOCK(job->cs, lock);
+        job->cond.wait(lock, [&job]() { return job->nRunning == 0; });
+        exception = job->exception;
+    }
+    if (exception) std::rethrow_exception(exception);
+}
@@ -0,0 +1,27 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_PARALLEL_H
+#define BITCOIN_UTIL_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * Calls fn on the indexes 0 to nCount - 1, over the calling thread and up to
+ * nMaxThreads - 1 threads of a worker pool shared by all the callers.
+ *
+ * The pool is started on first use with one thread less than the cores, and
+ * concurrent calls share its threads rather than starting their own: the
+ * number of threads never grows with the number of calls. The calling thread
+ * takes part, so a call completes even when every worker is busy (e.g. for a
+ * nested call, made from fn).
+ *
+ * Returns once fn returned for all the indexes it was called on. When fn
+ * throws, the indexes not started yet are skipped and the first exception is
+ * rethrown to the caller.
+ */
+void ParallelForEach(size_t nCount, int nMaxThreads, const std::function<void(size_t)>& fn);
+
+#endif // BITCOIN_UTIL_PARALLEL_H
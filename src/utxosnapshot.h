@@ -0,0 +1,50 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOSNAPSHOT_H
+#define BITCOIN_UTXOSNAPSHOT_H
+
+#include "amount.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/**
+ * Header of a chainstate snapshot file (see dumptxoutset). It is followed by
+ * nCoins (COutPoint, Coin) pairs, nAnchors (root, SaplingMerkleTree) pairs and
+ * nNullifiers nullifiers. The snapshot hash covers everything after the header.
+ */
+class SnapshotMetadata
+{
+public:
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t nVersion{CURRENT_VERSION};
+    uint256 hashBaseBlock;
+    int nBaseHeight{0};
+    uint256 hashBestAnchor;
+    uint64_t nCoins{0};
+    uint64_t nAnchors{0};
+    uint64_t nNullifiers{0};
+    //! Money supply at the base block, as reported by getsupplyinfo
+    CAmount nTransparentSupply{0};
+    CAmount nShieldedSupply{0};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nVersion);
+        READWRITE(hashBaseBlock);
+        READWRITE(nBaseHeight);
+        READWRITE(hashBestAnchor);
+        READWRITE(nCoins);
+        READWRITE(nAnchors);
+        READWRITE(nNullifiers);
+        READWRITE(nTransparentSupply);
+        READWRITE(nShieldedSupply);
+    }
+};
+
+#endif // BITCOIN_UTXOSNAPSHOT_H
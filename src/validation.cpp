@@ -15,6 +15,7 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockfileflusher.h"
 #include "blocksignature.h"
 #include "budget/budgetmanager.h"
 #include "chainparams.h"
@@ -25,8 +26,13 @@
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "consensus/zerocoin_verify.h"
+#include "cuckoocache.h"
 #include "fs.h"
 #include "guiinterface.h"
+#include "index/addressindexer.h"
+#include "index/spentindexer.h"
+#include "index/txindex.h"
+#include "index/timestampindexer.h"
 #include "init.h"
 #include "invalid.h"
 #include "interfaces/handler.h"
@@ -49,19 +55,29 @@
 #include "txmempool.h"
 #include "undo.h"
 #include "util.h"
+#include "util/lz4.h"
+#include "util/parallel.h"
+#include "util/trace.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
+#include "validationstats.h"
 #include "warnings.h"
 #include "zdogecchain.h"
 #include "zdogec/zerocoin.h"
+#include "zdogec/zerocoinsnapshot.h"
 #include "zdogec/zdogecmodule.h"
 
 #include <future>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 #include <atomic>
+#include <deque>
+#include <list>
 #include <queue>
+#include <unordered_map>
+#include <unordered_set>
 
 
 #if defined(NDEBUG)
@@ -101,10 +117,22 @@ std::atomic<bool> fReindex{false};
 bool fTxIndex = true;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
+bool fBlockFilterIndex = false;
+bool fCoinStatsIndex = false;
+bool fBlockStatsIndex = false;
+bool fCompactSaplingIndex = false;
 bool fSpentIndex = false;
 bool fCheckBlockIndex = false;
+bool fPruneMode = false;
+bool fHavePruned = false;
+uint64_t nPruneTarget = 0;
+unsigned int nBlockFileChunkSize = BLOCKFILE_CHUNK_SIZE;
+unsigned int nUndoFileChunkSize = UNDOFILE_CHUNK_SIZE;
+bool fBlockCompression = DEFAULT_BLOCK_COMPRESSION;
+uint256 hashAssumeValid;
 bool fVerifyingBlocks = false;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nCoinCacheRetainUsage = 0;
 
 /* If the tip is older than this (in seconds), the node is considered to be in initial block download. */
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -123,6 +151,15 @@ CMoneySupply MoneySupply;
 
 static void CheckBlockIndex();
 
+/** The script verification flags ConnectBlock checks the transactions of a block with */
+static unsigned int GetBlockScriptFlags(bool fCLTVIsActivated)
+{
+    unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+    if (fCLTVIsActivated)
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    return flags;
+}
+
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
 
@@ -184,6 +221,9 @@ std::set<CBlockIndex*> setDirtyBlockIndex;
 
 /** Dirty block file entries. */
 std::set<int> setDirtyFileInfo;
+
+/** Global flag to indicate we should check to see if there are block/undo files that should be deleted. Set on startup or if we allocate more file space when we're in prune mode. */
+bool fCheckForPruning = false;
 } // anon namespace
 
 CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& locator)
@@ -203,16 +243,36 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 
 CBlockIndex* GetChainTip()
 {
-    LOCK(cs_main);
-    CBlockIndex* p = chainActive.Tip();
-    if (!p)
-        return nullptr;
-    // Do not pass in the chain active tip, because it can change.
-    // Instead pass the blockindex directly from mapblockindex, which is const
-    return mapBlockIndex.at(p->GetBlockHash());
+    // The entries of mapBlockIndex are never freed while running: the tip
+    // snapshot stays valid after the chain moves on, without cs_main.
+    return chainActive.TipSnapshot();
+}
+
+static std::shared_ptr<const CChainTipSnapshot> g_chain_tip_snapshot = std::make_shared<const CChainTipSnapshot>();
+
+ChainTipSnapshotRef GetChainTipSnapshot()
+{
+    return std::atomic_load(&g_chain_tip_snapshot);
+}
+
+/** Publish a new tip snapshot: the readers keep the old one as long as they hold it */
+static void PublishChainTipSnapshot(const CBlockIndex* pindexTip)
+{
+    std::shared_ptr<CChainTipSnapshot> snapshot = std::make_shared<CChainTipSnapshot>();
+    if (pindexTip) {
+        snapshot->nHeight = pindexTip->nHeight;
+        snapshot->hash = pindexTip->GetBlockHash();
+        snapshot->nTime = pindexTip->GetBlockTime();
+        snapshot->vLastHashes.reserve(std::min(pindexTip->nHeight + 1, CChainTipSnapshot::LAST_HASHES));
+        for (const CBlockIndex* pindex = pindexTip; pindex && (int)snapshot->vLastHashes.size() < CChainTipSnapshot::LAST_HASHES; pindex = pindex->pprev) {
+            snapshot->vLastHashes.push_back(pindex->GetBlockHash());
+        }
+    }
+    std::atomic_store(&g_chain_tip_snapshot, std::shared_ptr<const CChainTipSnapshot>(std::move(snapshot)));
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewWriteBack* pcoinsWriteBack = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CZerocoinDB* zerocoinDB = NULL;
 CSporkDB* pSporkDB = NULL;
@@ -320,9 +380,11 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
+static void PrefetchCoins(const std::vector<COutPoint>& vOutPoints, std::vector<COutPoint>* pvAdded = nullptr);
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransactionRef& _tx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool ignoreFees,
-                              std::vector<COutPoint>& coins_to_uncache)
+                              bool fShieldedProofsChecked, std::vector<COutPoint>& coins_to_uncache)
 {
     AssertLockHeld(cs_main);
     const CTransaction& tx = *_tx;
@@ -357,7 +419,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     // Sapling
     int nextBlockHeight = chainHeight + 1;
     // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
-    if (!SaplingValidation::ContextualCheckTransaction(tx, state, params, nextBlockHeight, false, IsInitialBlockDownload())) {
+    if (!SaplingValidation::ContextualCheckTransaction(tx, state, params, nextBlockHeight, false, IsInitialBlockDownload(), !fShieldedProofsChecked)) {
         return error("AcceptToMemoryPool: ContextualCheckTransaction failed");
     }
 
@@ -428,6 +490,16 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             }
         }
 
+        // read the inputs of a large transaction at once, to uncache them too if it's rejected
+        if (tx.vin.size() >= MIN_PREFETCH_COINS && !tx.HasZerocoinSpendInputs()) {
+            std::vector<COutPoint> vPrevouts;
+            vPrevouts.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                vPrevouts.push_back(txin.prevout);
+            }
+            PrefetchCoins(vPrevouts, &coins_to_uncache);
+        }
+
         // do all inputs exist?
         for (const CTxIn& txin : tx.vin) {
             if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
@@ -560,25 +632,29 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
             flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
 
         PrecomputedTransactionData precomTxData(tx);
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
+        if (!CheckInputs(tx, state, view, true, flags, true, false, precomTxData)) {
             return false;
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
+        // Check again against the script verification flags of ConnectBlock
+        // (GetBlockScriptFlags, the consensus ones the next block is checked
+        // with), in case of bugs in the standard flags that cause transactions
+        // to pass as valid when they're actually invalid. For instance the
+        // STRICTENC flag was incorrectly allowing certain CHECKSIG NOT scripts
+        // to pass, even though they were invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        flags = MANDATORY_SCRIPT_VERIFY_FLAGS;
-        if (fCLTVIsActivated)
-            flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-        if (!CheckInputs(tx, state, view, true, flags, true, precomTxData)) {
-            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
-                    __func__, hash.ToString(), FormatStateMessage(state));
+        //
+        // As these are the flags of ConnectBlock, the result is stored in the
+        // script execution cache: the block including the transaction skips
+        // its scripts.
+        const int nStandardFlags = flags;
+        flags = GetBlockScriptFlags(fCLTVIsActivated);
+        if (!CheckInputs(tx, state, view, true, flags, true, true, precomTxData)) {
+            return error("%s: BUG! PLEASE REPORT THIS! CheckInputs failed against the block script flags (0x%x) but not the STANDARD ones (0x%x) %s, %s",
+                    __func__, flags, nStandardFlags, hash.ToString(), FormatStateMessage(state));
         }
         // todo: pool.removeStaged for all conflicting entries
 
@@ -613,10 +689,19 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
 }
 
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef& tx, bool fLimitFree,
-                        bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees)
+                        bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee, bool fIgnoreFees,
+                        const TxPreCheckResult* pPreCheck)
 {
     std::vector<COutPoint> coins_to_uncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees, coins_to_uncache);
+    bool fShieldedProofsChecked = false;
+    if (pPreCheck) {
+        coins_to_uncache = pPreCheck->coins_to_uncache;
+        fShieldedProofsChecked = pPreCheck->fShieldedProofsChecked;
+    }
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, fRejectAbsurdFee, fIgnoreFees,
+                                        fShieldedProofsChecked, coins_to_uncache);
+    TRACE5(mempool, accept_result, tx->GetHash().begin(), res, pfMissingInputs && *pfMissingInputs,
+        state.GetRejectCode(), state.GetRejectReason().c_str());
     if (!res) {
         for (const COutPoint& outpoint: coins_to_uncache)
             pcoinsTip->Uncache(outpoint);
@@ -629,17 +714,86 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
 
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionRef& tx,
                         bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit,
-                        bool fRejectInsaneFee, bool ignoreFees)
+                        bool fRejectInsaneFee, bool ignoreFees, const TxPreCheckResult* pPreCheck)
 {
-    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectInsaneFee, ignoreFees);
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectInsaneFee, ignoreFees, pPreCheck);
+}
+
+void PreCheckTransaction(const CTransaction& tx, TxPreCheckResult& result)
+{
+    if (tx.IsCoinBase() || tx.IsCoinStake() || tx.ContainsZerocoins())
+        return;
+
+    int chainHeight;
+    {
+        LOCK(cs_main);
+        chainHeight = chainActive.Height();
+    }
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const bool fSaplingActive = consensus.NetworkUpgradeActive(chainHeight, Consensus::UPGRADE_V5_0);
+    const bool fColdStakingActive = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE);
+
+    // Don't spend the expensive checks on a transaction that is going to be rejected anyway
+    CValidationState state;
+    if (!CheckTransaction(tx, consensus.NetworkUpgradeActive(chainHeight, Consensus::UPGRADE_ZC),
+            state, isBlockBetweenFakeSerialAttackRange(chainHeight), fColdStakingActive, fSaplingActive))
+        return;
+
+    // The proofs are checked by ContextualCheckTransaction, with the rules of the next block
+    const int nextBlockHeight = chainHeight + 1;
+    if (consensus.NetworkUpgradeActive(nextBlockHeight, Consensus::UPGRADE_V5_0) && tx.IsShieldedTx() && tx.hasSaplingData()) {
+        uint256 dataToBeSigned;
+        if (!SaplingValidation::ComputeShieldedSighash(tx, dataToBeSigned) ||
+                SaplingValidation::VerifyShieldedProofs(tx, dataToBeSigned) != SaplingValidation::PROOF_OK)
+            return;
+        result.fShieldedProofsChecked = true;
+    }
+
+    // Copy the inputs out of the chain state and the mempool, then let the locks go
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    {
+        LOCK2(cs_main, mempool.cs);
+        if (mempool.exists(tx.GetHash()))
+            return;
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        view.SetBackend(viewMemPool);
+        for (const CTxIn& txin : tx.vin) {
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                result.coins_to_uncache.push_back(txin.prevout);
+            }
+            // orphan, or double spend: nothing to check before AcceptToMemoryPool
+            if (!view.HaveCoin(txin.prevout))
+                return;
+        }
+        view.SetBackend(dummy);
+    }
+
+    // The same flags as the first CheckInputs of AcceptToMemoryPool. The
+    // block flags pass of AcceptToMemoryPool hits the same signature cache
+    // entries.
+    unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (consensus.NetworkUpgradeActive(chainHeight, Consensus::UPGRADE_BIP65))
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+
+    PrecomputedTransactionData precomTxData(tx);
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        const Coin& coin = view.AccessCoin(tx.vin[i].prevout);
+        CScriptCheck check(coin.out.scriptPubKey, coin.out.nValue, tx, i, flags, true, &precomTxData);
+        if (!check())
+            return;
+    }
 }
 
 bool GetTimestampIndex(const unsigned int& high, const unsigned int& low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& hashes)
 {
-    if (!fTimestampIndex)
+    if (!g_timestampindex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
+    if (!g_timestampindex->BlockUntilSyncedToCurrentChain())
+        return error("Timestamp index is still being built");
+
+    if (!g_timestampindex->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
@@ -647,13 +801,16 @@ bool GetTimestampIndex(const unsigned int& high, const unsigned int& low, const
 
 bool GetSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value)
 {
-    if (!fSpentIndex)
+    if (!g_spentindex)
         return false;
 
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!g_spentindex->BlockUntilSyncedToCurrentChain())
+        return error("Spent index is still being built");
+
+    if (!g_spentindex->ReadSpentIndex(key, value))
         return false;
 
     return true;
@@ -661,32 +818,62 @@ bool GetSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value)
 
 bool HashOnchainActive(const uint256& hash)
 {
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(hash);
+    return it != mapBlockIndex.end() && chainActive.Contains(it->second);
+}
 
-    if (!chainActive.Contains(pblockindex)) {
-        return false;
-    }
+bool GetAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+{
+    if (!g_addressindex)
+        return error("address index not enabled");
+
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain())
+        return error("address index is still being built");
+
+    if (!g_addressindex->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+        return error("unable to get txids for address");
 
     return true;
 }
 
-bool GetAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start, int end)
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexPosition* pafter, const std::function<bool(const CAddressIndexKey&, CAmount)>& fn)
 {
-    if (!fAddressIndex)
+    if (!g_addressindex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain())
+        return error("address index is still being built");
+
+    if (!g_addressindex->ScanAddressIndex(addressHash, type, start, end, pafter, fn))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalance& balance)
+{
+    if (!g_addressindex)
+        return error("address index not enabled");
+
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain())
+        return error("address index is still being built");
+
+    if (!g_addressindex->ReadAddressBalance(addressHash, type, balance))
+        return error("unable to get balance for address");
+
+    return true;
+}
+
 bool GetAddressUnspent(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
 {
-    if (!fAddressIndex)
+    if (!g_addressindex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain())
+        return error("address index is still being built");
+
+    if (!g_addressindex->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
 
     return true;
@@ -706,6 +893,191 @@ bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state,
     return true;
 }
 
+namespace {
+
+/** Flag of the size field of a block or undo file record, set if the record is compressed */
+const uint32_t DISK_RECORD_COMPRESSED = 0x80000000;
+/** Message start and size field */
+const unsigned int DISK_RECORD_HEADER_SIZE = MESSAGE_START_SIZE + sizeof(uint32_t);
+
+/**
+ * A block or undo data, serialized as written to the block and undo files: the
+ * message start and a size field, followed by the serialization or, with
+ * DISK_RECORD_COMPRESSED set in the size field, by the serialized size (4 bytes)
+ * and the LZ4 compressed serialization. Records are compressed with
+ * -blockcompression, when it saves space.
+ */
+class CDiskRecord
+{
+public:
+    template <typename T>
+    CDiskRecord(const T& obj, bool fCompress) : ss(SER_DISK, CLIENT_VERSION)
+    {
+        ss << obj;
+        nSizeField = ss.size();
+        if (!fCompress)
+            return;
+        std::vector<unsigned char> vCompressed;
+        LZ4Compress((const unsigned char*)ss.data(), ss.size(), vCompressed);
+        if (vCompressed.size() + 4 >= ss.size())
+            return;
+        unsigned char buf[4];
+        WriteLE32(buf, ss.size());
+        ss.clear();
+        ss.write((const char*)buf, sizeof(buf));
+        ss.write((const char*)vCompressed.data(), vCompressed.size());
+        nSizeField = ss.size() | DISK_RECORD_COMPRESSED;
+    }
+
+    //! Bytes taken in the file, header included
+    unsigned int GetDiskSize() const { return DISK_RECORD_HEADER_SIZE + ss.size(); }
+
+    //! Write the record to the file at its current position, and set pos to the position of the payload
+    bool Write(CAutoFile& fileout, CDiskBlockPos& pos) const
+    {
+        fileout << FLATDATA(Params().MessageStart()) << nSizeField;
+        long fileOutPos = ftell(fileout.Get());
+        if (fileOutPos < 0)
+            return false;
+        pos.nPos = (unsigned int)fileOutPos;
+        fileout.write(ss.data(), ss.size());
+        return true;
+    }
+
+private:
+    CDataStream ss;
+    uint32_t nSizeField;
+};
+
+/** Position of the header of the record whose payload is at pos */
+bool GetDiskRecordHeaderPos(const CDiskBlockPos& pos, CDiskBlockPos& hpos)
+{
+    if (pos.nPos < DISK_RECORD_HEADER_SIZE)
+        return error("%s : invalid record position %d:%u", __func__, pos.nFile, pos.nPos);
+    hpos = pos;
+    hpos.nPos -= DISK_RECORD_HEADER_SIZE;
+    return true;
+}
+
+/** Read a record header, returning its size field */
+template <typename Stream>
+uint32_t ReadDiskRecordHeader(Stream& s)
+{
+    unsigned char buf[MESSAGE_START_SIZE];
+    uint32_t nSizeField;
+    s >> FLATDATA(buf) >> nSizeField;
+    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+        throw std::ios_base::failure("record magic mismatch");
+    return nSizeField;
+}
+
+/** Read the payload of a compressed record and decompress it into ss */
+template <typename Stream>
+void ReadCompressedRecord(Stream& s, uint32_t nSizeField, CDataStream& ss)
+{
+    const uint32_t nSize = nSizeField & ~DISK_RECORD_COMPRESSED;
+    if (nSize < 4 || nSize > MAX_SIZE)
+        throw std::ios_base::failure("invalid compressed record size");
+    std::vector<unsigned char> vCompressed(nSize);
+    s.read((char*)vCompressed.data(), nSize);
+    const uint32_t nRawSize = ReadLE32(vCompressed.data());
+    if (nRawSize > MAX_SIZE)
+        throw std::ios_base::failure("invalid compressed record data size");
+    ss.clear();
+    ss.resize(nRawSize);
+    if (!LZ4Decompress(vCompressed.data() + 4, nSize - 4, (unsigned char*)ss.data(), nRawSize))
+        throw std::ios_base::failure("corrupt compressed record");
+}
+
+/**
+ * The confirmed transactions GetTransaction found recently, with the hash of
+ * their block, least recently used first: the consensus code (stake inputs,
+ * budget collaterals) looks up the same transactions again and again. Guarded
+ * by cs_main, as GetTransaction.
+ */
+class CTxLookupCache
+{
+public:
+    bool Get(const uint256& txid, CTransactionRef& txOut, uint256& hashBlock)
+    {
+        AssertLockHeld(cs_main);
+        auto it = mapEntries.find(txid);
+        if (it == mapEntries.end()) {
+            return false;
+        }
+        // The block may have been disconnected since
+        BlockMap::const_iterator mi = mapBlockIndex.find(it->second.hashBlock);
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second)) {
+            listLru.erase(it->second.itLru);
+            mapEntries.erase(it);
+            return false;
+        }
+        listLru.splice(listLru.end(), listLru, it->second.itLru);
+        txOut = it->second.tx;
+        hashBlock = it->second.hashBlock;
+        return true;
+    }
+
+    void Put(const CTransactionRef& tx, const uint256& hashBlock)
+    {
+        AssertLockHeld(cs_main);
+        const uint256& txid = tx->GetHash();
+        if (mapEntries.count(txid)) {
+            return;
+        }
+        if (mapEntries.size() >= TX_LOOKUP_CACHE_SIZE) {
+            mapEntries.erase(listLru.front());
+            listLru.pop_front();
+        }
+        listLru.push_back(txid);
+        mapEntries.emplace(txid, Entry{tx, hashBlock, std::prev(listLru.end())});
+    }
+
+private:
+    static const size_t TX_LOOKUP_CACHE_SIZE = 1000;
+
+    struct Entry {
+        CTransactionRef tx;
+        uint256 hashBlock;
+        std::list<uint256>::iterator itLru;
+    };
+    std::list<uint256> listLru;
+    std::unordered_map<uint256, Entry, SaltedIdHasher> mapEntries;
+};
+
+CTxLookupCache txLookupCache;
+
+} // anon namespace
+
+bool ReadTxFromDisk(const CDiskTxPos& postx, CTransactionRef& txOut, uint256& hashBlock)
+{
+    CDiskBlockPos hpos;
+    if (!GetDiskRecordHeaderPos(postx, hpos))
+        return false;
+    CAutoFile file(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: OpenBlockFile failed", __func__);
+    CBlockHeader header;
+    try {
+        const uint32_t nSizeField = ReadDiskRecordHeader(file);
+        if (nSizeField & DISK_RECORD_COMPRESSED) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ReadCompressedRecord(file, nSizeField, ss);
+            ss >> header;
+            ss.ignore(postx.nTxOffset);
+            ss >> txOut;
+        } else {
+            file >> header;
+            fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+            file >> txOut;
+        }
+    } catch (const std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    hashBlock = header.GetHash();
+    return true;
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBlock, bool fAllowSlow, CBlockIndex* blockIndex)
 {
@@ -721,28 +1093,15 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBl
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
+        if (txLookupCache.Get(hash, txOut, hashBlock)) {
+            return true;
+        }
 
-            // transaction not found in the index, nothing more can be done
-            return false;
+        // The index may still be syncing: the transactions of the last blocks
+        // may not be in it yet
+        if (g_txindex && g_txindex->FindTx(hash, hashBlock, txOut)) {
+            txLookupCache.Put(txOut, hashBlock);
+            return true;
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -758,6 +1117,7 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBl
                 if (tx->GetHash() == hash) {
                     txOut = tx;
                     hashBlock = pindexSlow->GetBlockHash();
+                    if (chainActive.Contains(pindexSlow)) txLookupCache.Put(txOut, hashBlock);
                     return true;
                 }
             }
@@ -767,52 +1127,86 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, uint256& hashBl
     return false;
 }
 
+bool GetCoinSpentAfterFork(const COutPoint& outpoint, const CBlockIndex* pindexFork, Coin& coinOut)
+{
+    LOCK(cs_main);
+    if (!pindexFork || !chainActive.Contains(pindexFork)) return false;
+    // The blocks that deep are rejected anyway, and may have been pruned
+    if (chainActive.Height() - pindexFork->nHeight > GetPruneKeepDepth()) return false;
+
+    for (const CBlockIndex* pindex = chainActive.Tip(); pindex != pindexFork; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) return false;
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                if (tx.vin[j].prevout != outpoint) continue;
+                CBlockUndo blockundo;
+                if (!UndoReadFromDisk(blockundo, pindex) || blockundo.vtxundo.size() + 1 != block.vtx.size()) return false;
+                const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+                if (txundo.vprevout.size() != tx.vin.size()) return false;
+                coinOut = txundo.vprevout[j];
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 //
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos)
+namespace {
+
+bool WriteBlockToDisk(const CDiskRecord& record, CDiskBlockPos& pos)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
         return error("WriteBlockToDisk : OpenBlockFile failed");
 
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(Params().MessageStart()) << nSize;
-
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
+    // Write index header and block
+    if (!record.Write(fileout, pos))
         return error("WriteBlockToDisk : ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
 
     return true;
 }
 
+} // anon namespace
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, at the index header
+    CDiskBlockPos hpos;
+    if (!GetDiskRecordHeaderPos(pos, hpos))
+        return false;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadBlockFromDisk : OpenBlockFile failed");
 
     // Read block
     try {
-        filein >> block;
+        const uint32_t nSizeField = ReadDiskRecordHeader(filein);
+        if (nSizeField & DISK_RECORD_COMPRESSED) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ReadCompressedRecord(filein, nSizeField, ss);
+            ss >> block;
+        } else {
+            filein >> block;
+        }
     } catch (const std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
-    // Check the header
+    // Check the header (hashed once: the readers hash the block again)
+    const uint256 hash = block.CacheHash();
     if (block.IsProofOfWork()) {
-        if (!CheckProofOfWork(block.GetHash(), block.nBits))
+        if (!CheckProofOfWork(hash, block.nBits))
             return error("ReadBlockFromDisk : Errors in block header");
     }
 
@@ -823,13 +1217,56 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash()) {
-        LogPrintf("%s : block=%s index=%s\n", __func__, block.GetHash().GetHex(), pindex->GetBlockHash().GetHex());
+    const uint256 hash = block.GetHash();
+    if (hash != pindex->GetBlockHash()) {
+        LogPrintf("%s : block=%s index=%s\n", __func__, hash.GetHex(), pindex->GetBlockHash().GetHex());
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
     }
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos)
+{
+    // Open history file at the index header (message start and size) preceding the block
+    CDiskBlockPos hpos;
+    if (!GetDiskRecordHeaderPos(pos, hpos))
+        return false;
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed for %d:%u", __func__, pos.nFile, pos.nPos);
+
+    try {
+        const uint32_t blk_size = ReadDiskRecordHeader(filein);
+        if (blk_size & DISK_RECORD_COMPRESSED) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ReadCompressedRecord(filein, blk_size, ss);
+            block.assign(ss.begin(), ss.end());
+            return true;
+        }
+        if (blk_size > MAX_SIZE) {
+            return error("%s : Block data is larger than maximum deserialization size for %d:%u: %u > %u",
+                         __func__, pos.nFile, pos.nPos, blk_size, MAX_SIZE);
+        }
+
+        block.resize(blk_size);
+        filein.read((char*) block.data(), blk_size);
+    } catch (const std::exception& e) {
+        return error("%s : Read from block file failed: %s for %d:%u", __func__, e.what(), pos.nFile, pos.nPos);
+    }
+
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
+    }
+    return ReadRawBlockFromDisk(block, pos);
+}
+
 
 double ConvertBitsToDouble(unsigned int nBits)
 {
@@ -1040,7 +1477,7 @@ void static InvalidBlockFound(CBlockIndex* pindex, const CValidationState& state
     }
 }
 
-static bool SkipInvalidUTXOS(int nHeight)
+bool SkipInvalidUTXOS(int nHeight)
 {
     const Consensus::Params& consensus = Params().GetConsensus();
     return Params().NetworkIDString() == CBaseChainParams::MAIN &&
@@ -1072,12 +1509,56 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache &inputs, int nHeight, b
     UpdateCoins(tx, inputs, txundo, nHeight, fSkipInvalid);
 }
 
+bool CSaplingProofCheck::operator()()
+{
+    result = SaplingValidation::VerifyShieldedProofs(*ptx, dataToBeSigned);
+    return result == SaplingValidation::PROOF_OK;
+}
+
+bool CZerocoinSpendCheck::operator()()
+{
+    try {
+        return ContextualCheckZerocoinSpendNoSerialCheck(*ptx, spend.get(), nHeight, UINT256_ZERO);
+    } catch (const std::exception& e) {
+        return error("%s: zerocoin spend of tx %s failed to verify: %s", __func__, ptx->GetHash().GetHex(), e.what());
+    }
+}
+
 bool CScriptCheck::operator()()
 {
     const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
     return VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *precomTxData), ptxTo->GetRequiredSigVersion(), &error);
 }
 
+bool CScriptCheck::operator()(CSignatureBatch& batch)
+{
+    const CScript& scriptSig = ptxTo->vin[nIn].scriptSig;
+    return VerifyScript(scriptSig, scriptPubKey, nFlags, BatchingTransactionSignatureChecker(ptxTo, nIn, amount, cacheStore, *precomTxData, batch), ptxTo->GetRequiredSigVersion(), &error);
+}
+
+bool CScriptCheck::RunBatch(std::vector<CScriptCheck>& vChecks)
+{
+    if (vChecks.size() > 1) {
+        CSignatureBatch batch;
+        bool fOk = true;
+        for (CScriptCheck& check : vChecks) {
+            if (!check(batch)) {
+                fOk = false;
+                break;
+            }
+        }
+        // Nothing was assumed: the result stands
+        if (batch.empty())
+            return fOk;
+        if (fOk && batch.Verify())
+            return true;
+    }
+    for (CScriptCheck& check : vChecks)
+        if (!check())
+            return false;
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1138,7 +1619,27 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
+/**
+ * Transactions whose scripts all passed with a given set of flags (keyed by
+ * SHA256(nonce || txid || flags)), so that ConnectBlock doesn't run them
+ * through the interpreter again once AcceptToMemoryPool has. Guarded by
+ * cs_main, as CuckooCache doesn't lock.
+ */
+static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static uint256 scriptExecutionCacheNonce;
+
+void InitScriptExecutionCache()
+{
+    scriptExecutionCacheNonce = GetRandHash();
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase() && !tx.HasZerocoinSpendInputs()) {
 
@@ -1156,6 +1657,19 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // First check if script executions have been cached with the same
+            // flags. This assumes that the inputs provided are correct: the
+            // txid commits to the prevouts, which commit to the scriptPubKeys
+            // and amounts checked against.
+            uint256 hashCacheEntry;
+            // Only the first 19 bytes of the nonce, so that the entry fits a
+            // single SHA256 block: 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+            static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+            CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+                return true;
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
                 const Coin& coin = inputs.AccessCoin(prevout);
@@ -1170,7 +1684,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                 const CAmount amount = coin.out.nValue;
 
                 // Verify signature
-                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheStore, &precomTxData);
+                CScriptCheck check(scriptPubKey, amount, tx, i, flags, cacheSigStore, &precomTxData);
                 if (pvChecks) {
                     pvChecks->emplace_back();
                     check.swap(pvChecks->back());
@@ -1183,7 +1697,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(scriptPubKey, amount, tx, i,
-                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &precomTxData);
+                            flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &precomTxData);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1197,6 +1711,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // We executed all of the provided scripts, and were told to
+                // cache the result. Do so now.
+                scriptExecutionCache.insert(hashCacheEntry);
+            }
         }
     }
 
@@ -1223,23 +1743,16 @@ static bool AbortNode(CValidationState& state, const std::string& strMessage, co
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock)
+bool UndoWriteToDisk(const CBlockUndo& blockundo, const CDiskRecord& record, CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
         return error("%s : OpenUndoFile failed", __func__);
 
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(Params().MessageStart()) << nSize;
-
-    // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
+    // Write index header and undo data
+    if (!record.Write(fileout, pos))
         return error("%s : ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
@@ -1252,24 +1765,40 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, at the index header
+    CDiskBlockPos hpos;
+    if (!GetDiskRecordHeaderPos(pos, hpos))
+        return false;
+    CAutoFile filein(OpenUndoFile(hpos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("%s : OpenBlockFile failed", __func__);
 
     // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    uint256 hashData;
     try {
-        verifier << hashBlock;
-        verifier >> blockundo;
+        // We need a CHashVerifier as reserializing may lose data
+        const uint32_t nSizeField = ReadDiskRecordHeader(filein);
+        if (nSizeField & DISK_RECORD_COMPRESSED) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+            ReadCompressedRecord(filein, nSizeField, ss);
+            CHashVerifier<CDataStream> verifier(&ss);
+            verifier << hashBlock;
+            verifier >> blockundo;
+            hashData = verifier.GetHash();
+        } else {
+            CHashVerifier<CAutoFile> verifier(&filein);
+            verifier << hashBlock;
+            verifier >> blockundo;
+            hashData = verifier.GetHash();
+        }
         filein >> hashChecksum;
     } catch (const std::exception& e) {
         return error("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
 
     // Verify checksum
-    if (hashChecksum != verifier.GetHash())
+    if (hashChecksum != hashData)
         return error("%s : Checksum mismatch", __func__);
 
     return true;
@@ -1277,6 +1806,25 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
 
 } // anon namespace
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    // the genesis block has no undo data
+    if (!pindex->pprev) {
+        blockundo = CBlockUndo();
+        return true;
+    }
+
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetUndoPos();
+    }
+    if (pos.IsNull())
+        return error("%s: no undo data available for block %s", __func__, pindex->GetBlockHash().ToString());
+
+    return UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash());
+}
+
 enum DisconnectResult
 {
     DISCONNECT_OK,      // All good.
@@ -1321,32 +1869,33 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
+ *  The undo data is read from disk, unless the caller read it already (pblockUndo, consumed).
  *  When FAILED is returned, view is left in an indeterminate state. */
-DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
+DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, CBlockUndo* pblockUndo = nullptr)
 {
     AssertLockHeld(cs_main);
     bool fClean = true;
 
-    CBlockUndo blockUndo;
+    CBlockUndo blockUndoRead;
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         error("%s: no undo data available", __func__);
         return DISCONNECT_FAILED;
     }
-    if (!UndoReadFromDisk(blockUndo, pos, pindex->pprev->GetBlockHash())) {
-        error("%s: failure reading undo data", __func__);
-        return DISCONNECT_FAILED;
+    if (!pblockUndo) {
+        if (!UndoReadFromDisk(blockUndoRead, pos, pindex->pprev->GetBlockHash())) {
+            error("%s: failure reading undo data", __func__);
+            return DISCONNECT_FAILED;
+        }
+        pblockUndo = &blockUndoRead;
     }
+    CBlockUndo& blockUndo = *pblockUndo;
 
     if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
         error("%s: block and undo data inconsistent", __func__);
         return DISCONNECT_FAILED;
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction& tx = *block.vtx[i];
@@ -1359,40 +1908,6 @@ DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoin
         // if tx is a budget collateral tx, remove relative object
         g_budgetman.RemoveByFeeTxId(hash);
 
-        if (fAddressIndex) {
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut& out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 2, out.scriptPubKey.begin() + 22);
-
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), hash, k), CAddressUnspentValue()));
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 3, out.scriptPubKey.begin() + 23);
-
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), hash, k), CAddressUnspentValue()));
-                } else if (out.scriptPubKey.IsPayToWitnessPubkeyHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 2, out.scriptPubKey.end());
-
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, k, false), out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), hash, k), CAddressUnspentValue()));
-                } else {
-                    continue;
-                }
-            }
-        }
-
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         for (size_t o = 0; o < tx.vout.size(); o++) {
@@ -1427,47 +1942,6 @@ DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoin
             if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
             fClean = fClean && res != DISCONNECT_UNCLEAN;
 
-            const CTxIn input = tx.vin[j];
-
-            if (fSpentIndex) {
-                // undo and delete the spent index
-                spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-            }
-
-            if (fAddressIndex) {
-                const CTxOut& prevout = view.AccessCoin(tx.vin[j].prevout).out;
-                if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin() + 2, prevout.scriptPubKey.begin() + 22);
-
-                    // undo spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                    // restore unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-
-                } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                    std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin() + 3, prevout.scriptPubKey.begin() + 23);
-
-                    // undo spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                    // restore unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-                } else if (prevout.scriptPubKey.IsPayToWitnessPubkeyHash()) {
-                    std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin() + 2, prevout.scriptPubKey.end());
-
-                    // undo spending activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
-
-                    // restore unspent index
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), input.prevout.hash, input.prevout.n), CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, undo.nHeight)));
-
-                } else {
-                    continue;
-                }
-            }
         }
         // At this point, all of txundo.vprevout should have been moved out.
     }
@@ -1488,17 +1962,6 @@ DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoin
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            error("Failed to delete address index");
-            return DISCONNECT_FAILED;
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            error("Failed to write address unspent index");
-            return DISCONNECT_FAILED;
-        }
-    }
-
     if (consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_ZC_V2) &&
             pindex->nHeight <= consensus.height_last_ZC_AccumCheckpoint) {
         // Legacy Zerocoin DB: If Accumulators Checkpoint is changed, remove changed checksums
@@ -1508,27 +1971,22 @@ DisconnectResult DisconnectBlock(CBlock& block, const CBlockIndex* pindex, CCoin
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+// Queues the commit of the last block and undo files to g_blockfileflusher, see Sync for the completion
 void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
-    CDiskBlockPos posOld(nLastBlockFile, 0);
-
-    FILE* fileOld = OpenBlockFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
+    if (fFinalize)
+        g_blockfileflusher.Finalize(nLastBlockFile, vinfoBlockFile[nLastBlockFile].nSize, vinfoBlockFile[nLastBlockFile].nUndoSize);
+    else
+        g_blockfileflusher.Commit(nLastBlockFile);
+}
 
-    fileOld = OpenUndoFile(posOld);
-    if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
-        FileCommit(fileOld);
-        fclose(fileOld);
-    }
+// Size a file is pre-allocated to for nSize bytes of data: the chunks holding it and the next one
+static unsigned int PreallocatedSize(unsigned int nSize, unsigned int nChunkSize)
+{
+    if (nSize == 0) return 0;
+    return ((nSize + nChunkSize - 1) / nChunkSize + 1) * nChunkSize;
 }
 
 bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
@@ -1541,16 +1999,103 @@ void ThreadScriptCheck()
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CSaplingProofCheck> saplingcheckqueue(8);
+
+void ThreadSaplingProofCheck()
+{
+    util::ThreadRename("dogecash-saplingch");
+    saplingcheckqueue.Thread();
+}
+
+static CCheckQueue<CZerocoinSpendCheck> zerocoincheckqueue(8);
+
+void ThreadZerocoinSpendCheck()
+{
+    util::ThreadRename("dogecash-zerocoinch");
+    zerocoincheckqueue.Thread();
+}
+
+static CCheckQueue<CCoinPrefetch> coinprefetchqueue(32);
+
+void ThreadCoinPrefetch()
+{
+    util::ThreadRename("dogecash-coinfetch");
+    coinprefetchqueue.Thread();
+}
+
+bool CCoinPrefetch::operator()()
+{
+    // A coin that isn't found is looked up again, and rejected, by its input
+    pResult->first = base->GetCoin(outpoint, pResult->second);
+    return true;
+}
+
+/**
+ * Read the coins of these outpoints that are missing from the tip cache on the coin
+ * prefetch threads, instead of one after the other from the database when the inputs
+ * are checked. The backing view of the tip cache can be read by several threads.
+ * The outpoints that were added to the cache are appended to pvAdded, if given.
+ */
+static void PrefetchCoins(const std::vector<COutPoint>& vOutPoints, std::vector<COutPoint>* pvAdded)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0)
+        return;
+
+    std::vector<COutPoint> vMissing;
+    for (const COutPoint& outpoint : vOutPoints) {
+        if (!pcoinsTip->HaveCoinInCache(outpoint))
+            vMissing.push_back(outpoint);
+    }
+    if (vMissing.size() < MIN_PREFETCH_COINS)
+        return;
+
+    std::vector<std::pair<bool, Coin> > vResults(vMissing.size());
+    std::vector<CCoinPrefetch> vReads;
+    vReads.reserve(vMissing.size());
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        vReads.emplace_back(pcoinsTip->GetBackend(), vMissing[i], &vResults[i]);
+    }
+    CCheckQueueControl<CCoinPrefetch> control(&coinprefetchqueue);
+    control.Add(vReads);
+    control.Wait();
+
+    for (size_t i = 0; i < vMissing.size(); i++) {
+        if (!vResults[i].first)
+            continue;
+        pcoinsTip->AddFetchedCoin(vMissing[i], std::move(vResults[i].second));
+        if (pvAdded)
+            pvAdded->push_back(vMissing[i]);
+    }
+}
+
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/**
+ * Whether pindex is an ancestor of the -assumevalid block, and that block is on our best
+ * header chain. This doesn't force the selection of any chain, it only caches the result
+ * of part of the verification. Requires cs_main.
+ */
+static bool IsAssumedValid(const CBlockIndex* pindex)
+{
+    if (hashAssumeValid.IsNull() || pindexBestHeader == nullptr)
+        return false;
+    BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValid);
+    if (it == mapBlockIndex.end())
+        return false;
+    const CBlockIndex* pindexAssumeValid = it->second;
+    return pindexAssumeValid->GetAncestor(pindex->nHeight) == pindex &&
+           pindexBestHeader->GetAncestor(pindexAssumeValid->nHeight) == pindexAssumeValid;
+}
+
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
-static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck = false)
+static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck = false, std::shared_ptr<CBlockUndo>* ppblockUndo = nullptr)
 {
     AssertLockHeld(cs_main);
     // Check it again in case a previous version let a bad block in
@@ -1605,7 +2150,11 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         }
     }
 
-    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate();
+    // Scripts are not checked below the last checkpoint, nor (with the Sapling proofs) for the
+    // ancestors of the assumed-valid block. The coins, nullifiers and commitment tree are still
+    // fully updated.
+    const bool fAssumeValid = IsAssumedValid(pindex);
+    bool fScriptChecks = pindex->nHeight >= Checkpoints::GetTotalBlocksEstimate() && !fAssumeValid;
 
     // If scripts won't be checked anyways, don't bother seeing if CLTV is activated
     bool fCLTVIsActivated = false;
@@ -1615,15 +2164,15 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
 
+    // The blocks checked for a template or by -checklevel don't go in the getvalidationstats windows
+    const bool fRecordStats = !fJustCheck && !fVerifyingBlocks;
     int64_t nTimeStart = GetTimeMicros();
+    TRACE3(validation, block_connect_start, block.GetHash().begin(), pindex->nHeight, block.vtx.size());
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpends;
     std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMints;
-    vPos.reserve(block.vtx.size());
     CBlockUndo blockundo;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
@@ -1632,25 +2181,75 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     std::vector<uint256> vSpendsInBlock;
     uint256 hashBlock = block.GetHash();
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
 
     // Sapling
     SaplingMerkleTree sapling_tree;
-    assert(view.GetSaplingAnchorAt(view.GetBestAnchor(), sapling_tree));
+    const uint256 saplingAnchorPrev = view.GetBestAnchor();
+    assert(view.GetSaplingAnchorAt(saplingAnchorPrev, sapling_tree));
+    // The commitments of the block, appended to the tree at once after the transactions
+    std::vector<libzcash::PedersenHash> vSaplingCommitments;
 
     //
     bool isV5UpgradeEnforced = consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V5_0);
+    const bool fSaplingProofChecks = isV5UpgradeEnforced && !fAssumeValid;
 
     std::vector<PrecomputedTransactionData> precomTxData;
     precomTxData.reserve(block.vtx.size()); // Required so that pointers to individual precomTxData don't get invalidated
+
+    // The coins spent by the block, apart from the outputs of its own transactions
+    if (nScriptCheckThreads) {
+        std::unordered_set<uint256, SaltedIdHasher> setBlockTxids;
+        size_t nBlockInputs = 0;
+        for (const auto& tx : block.vtx) {
+            setBlockTxids.insert(tx->GetHash());
+            nBlockInputs += tx->vin.size();
+        }
+        if (nBlockInputs >= MIN_PREFETCH_COINS) {
+            std::vector<COutPoint> vPrevouts;
+            vPrevouts.reserve(nBlockInputs);
+            for (const auto& tx : block.vtx) {
+                if (tx->IsCoinBase() || tx->HasZerocoinSpendInputs())
+                    continue;
+                for (const CTxIn& txin : tx->vin) {
+                    if (!setBlockTxids.count(txin.prevout.hash))
+                        vPrevouts.push_back(txin.prevout);
+                }
+            }
+            PrefetchCoins(vPrevouts);
+        }
+    }
+    // Sapling: dispatch the spend/output proofs of every shielded tx in the block
+    // to the proof checking threads, so that they are verified while connecting.
+    CCheckQueueControl<CSaplingProofCheck> saplingControl(fSaplingProofChecks && nScriptCheckThreads ? &saplingcheckqueue : nullptr);
+    if (fSaplingProofChecks && nScriptCheckThreads) {
+        std::vector<CSaplingProofCheck> vSaplingChecks;
+        for (const auto& tx : block.vtx) {
+            if (!tx->IsShieldedTx() || !tx->hasSaplingData()) continue;
+            uint256 dataToBeSigned;
+            if (!SaplingValidation::ComputeShieldedSighash(*tx, dataToBeSigned))
+                return state.DoS(100, error("%s: error computing signature hash for tx %s", __func__, tx->GetHash().ToString()),
+                                 REJECT_INVALID, "error-computing-signature-hash");
+            vSaplingChecks.emplace_back(*tx, dataToBeSigned);
+        }
+        saplingControl.Add(vSaplingChecks);
+    } else if (fSaplingProofChecks) {
+        const int64_t nTimeSaplingStart = GetTimeMicros();
+        if (!SaplingValidation::CheckBlockShieldedProofs(block, state))
+            return error("%s: shielded proofs verification failed for block %s: %s", __func__, hashBlock.ToString(), FormatStateMessage(state));
+        if (fRecordStats) RecordBlockPhase(BLOCK_PHASE_SAPLING, GetTimeMicros() - nTimeSaplingStart);
+    }
+
+    // The zerocoin spends are checked by their own threads, as the sapling proofs
+    CCheckQueueControl<CZerocoinSpendCheck> zerocoinControl(nScriptCheckThreads ? &zerocoincheckqueue : nullptr);
+    // The zerocoin db already holds the spends and mints of the blocks covered by the
+    // snapshot: their serials aren't looked up, and their records aren't written again.
+    const bool fZerocoinSnapshot = fAssumeValid && pindex->nHeight <= GetZerocoinSnapshotHeight();
+
     bool fInitialBlockDownload = IsInitialBlockDownload();
     bool fZerocoinMaintenance =  (block.nTime > sporkManager.GetSporkValue(SPORK_16_ZEROCOIN_MAINTENANCE_MODE));
     bool fSaplingMaintenance =  (block.nTime > sporkManager.GetSporkValue(SPORK_20_SAPLING_MAINTENANCE));
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        const uint256 txhash = tx.GetHash();
 
         nInputs += tx.vin.size();
         nSigOps += GetLegacySigOpCount(tx);
@@ -1697,6 +2296,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
 
             //Check for double spending of serial #'s
             std::set<CBigNum> setSerials;
+            std::vector<CZerocoinSpendCheck> vZerocoinChecks;
             for (const CTxIn& txIn : tx.vin) {
                 bool isPublicSpend = txIn.IsZerocoinPublicSpend();
                 bool isPrivZerocoinSpend = txIn.IsZerocoinSpend();
@@ -1708,26 +2308,36 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                     return false;
                 }
 
+                std::shared_ptr<const libzerocoin::CoinSpend> spend;
                 if (isPublicSpend) {
                     libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
                     PublicCoinSpend publicSpend(params);
                     if (!ZDOGECModule::ParseZerocoinPublicSpend(txIn, tx, state, publicSpend)){
                         return false;
                     }
-                    nValueIn += publicSpend.getDenomination() * COIN;
-                    //queue for db write after the 'justcheck' section has concluded
-                    vSpends.emplace_back(publicSpend, tx.GetHash());
-                    if (!ContextualCheckZerocoinSpend(tx, &publicSpend, pindex->nHeight, hashBlock))
-                        return state.DoS(100, error("%s: failed to add block %s with invalid public zc spend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                    spend = std::make_shared<const PublicCoinSpend>(publicSpend);
                 } else {
-                    libzerocoin::CoinSpend spend = TxInToZerocoinSpend(txIn);
-                    nValueIn += spend.getDenomination() * COIN;
-                    //queue for db write after the 'justcheck' section has concluded
-                    vSpends.emplace_back(spend, tx.GetHash());
-                    if (!ContextualCheckZerocoinSpend(tx, &spend, pindex->nHeight, hashBlock))
-                        return state.DoS(100, error("%s: failed to add block %s with invalid zerocoinspend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                    spend = std::make_shared<const libzerocoin::CoinSpend>(TxInToZerocoinSpend(txIn));
                 }
+                nValueIn += spend->getDenomination() * COIN;
+                //queue for db write after the 'justcheck' section has concluded
+                vSpends.emplace_back(*spend, tx.GetHash());
+
+                if (!nScriptCheckThreads) {
+                    const bool fValid = fZerocoinSnapshot ? ContextualCheckZerocoinSpendNoSerialCheck(tx, spend.get(), pindex->nHeight, hashBlock)
+                                                          : ContextualCheckZerocoinSpend(tx, spend.get(), pindex->nHeight, hashBlock);
+                    if (!fValid)
+                        return state.DoS(100, error("%s: failed to add block %s with invalid zc spend", __func__, tx.GetHash().GetHex()), REJECT_INVALID);
+                    continue;
+                }
+                // Only the serial lookup needs the zerocoin db: the rest of the checks run in parallel
+                int nHeightSpend = 0;
+                if (!fZerocoinSnapshot && IsSerialInBlockchain(spend->getCoinSerialNumber(), nHeightSpend))
+                    return state.DoS(100, error("%s: zc spend of tx %s with serial %s is already in block %d", __func__,
+                                                tx.GetHash().GetHex(), spend->getCoinSerialNumber().GetHex(), nHeightSpend), REJECT_INVALID);
+                vZerocoinChecks.emplace_back(tx, spend, pindex->nHeight);
             }
+            zerocoinControl.Add(vZerocoinChecks);
 
         } else if (!tx.IsCoinBase()) {
             if (!view.HaveInputs(tx))
@@ -1746,43 +2356,6 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             if (nSigOps > nMaxBlockSigOps)
                 return state.DoS(100, error("ConnectBlock() : too many sigops"), REJECT_INVALID, "bad-blk-sigops");
 
-            // Address Index
-            if (fAddressIndex || fSpentIndex) {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut& prevout = view.AccessCoin(tx.vin[j].prevout).out;
-                    uint160 hashBytes;
-                    int addressType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        hashBytes = uint160(std::vector<unsigned char>(prevout.scriptPubKey.begin() + 2, prevout.scriptPubKey.begin() + 22));
-                        addressType = 2;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
-                        hashBytes = uint160(std::vector<unsigned char>(prevout.scriptPubKey.begin() + 3, prevout.scriptPubKey.begin() + 23));
-                        addressType = 1;
-                    } else if (prevout.scriptPubKey.IsPayToWitnessPubkeyHash()) {
-                        hashBytes = uint160(std::vector<unsigned char>(prevout.scriptPubKey.begin() + 2, prevout.scriptPubKey.end()));
-                        addressType = 1;
-                    } else {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        // record spending activity
-                        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                    }
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
-            }
         }
 
         // Cache the sig ser hashes
@@ -1794,12 +2367,10 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
             nValueIn += view.GetValueIn(tx);
 
             std::vector<CScriptCheck> vChecks;
-            unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
-            if (fCLTVIsActivated)
-                flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+            const unsigned int flags = GetBlockScriptFlags(fCLTVIsActivated);
 
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, precomTxData[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("%s: Check inputs on %s failed with %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
         }
@@ -1813,61 +2384,29 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight, fSkipInvalid);
 
         // Sapling update tree
-        if (tx.IsShieldedTx() && !tx.sapData->vShieldedOutput.empty()) {
+        if (tx.IsShieldedTx()) {
             for(const OutputDescription &outputDescription : tx.sapData->vShieldedOutput) {
-                sapling_tree.append(outputDescription.cmu);
-            }
-        }
-
-        vPos.emplace_back(tx.GetHash(), pos);
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
-
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut& out = tx.vout[k];
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 2, out.scriptPubKey.begin() + 22);
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 3, out.scriptPubKey.begin() + 23);
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                } else if (out.scriptPubKey.IsPayToWitnessPubkeyHash()) {
-                    std::vector<unsigned char> hashBytes(out.scriptPubKey.begin() + 2, out.scriptPubKey.end());
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(CAddressIndexKey(1, uint160(hashBytes), pindex->nHeight, i, tx.GetHash(), k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(1, uint160(hashBytes), tx.GetHash(), k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                } else {
-                    continue;
-                }
+                vSaplingCommitments.emplace_back(outputDescription.cmu);
             }
         }
     }
 
     
 
-    // Push new tree anchor
-    view.PushAnchor(sapling_tree);
+    // Push new tree anchor. Without new commitments the root is the previous anchor,
+    // no need to hash the tree again.
+    const bool fSaplingTreeChanged = !vSaplingCommitments.empty();
+    if (fSaplingTreeChanged) {
+        sapling_tree.append(vSaplingCommitments);
+        view.PushAnchor(sapling_tree);
+    }
+    const uint256 saplingRoot = fSaplingTreeChanged ? sapling_tree.root() : saplingAnchorPrev;
 
     // Verify header correctness
     if (consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_V5_0)) {
         // If Sapling is active, block.hashFinalSaplingRoot must be the
         // same as the root of the Sapling tree
-        if (block.hashFinalSaplingRoot != sapling_tree.root()) {
+        if (block.hashFinalSaplingRoot != saplingRoot) {
             return state.DoS(100,
                              error("ConnectBlock(): block's hashFinalSaplingRoot is incorrect (should be Sapling tree root)"),
                              REJECT_INVALID, "bad-sapling-root-in-block");
@@ -1880,6 +2419,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     int64_t nTime1 = GetTimeMicros();
     nTimeConnect += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime1 - nTimeStart), 0.001 * (nTime1 - nTimeStart) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime1 - nTimeStart) / (nInputs - 1), nTimeConnect * 0.000001);
+    if (fRecordStats) RecordBlockPhase(BLOCK_PHASE_INPUTS, nTime1 - nTimeStart);
 
     //PoW phase redistributed fees to miner. PoS stage destroys fees.
     CAmount nExpectedMint = GetBlockValue(pindex->nHeight);
@@ -1893,9 +2433,25 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
                          REJECT_INVALID, "bad-cb-amount");
     }
 
+    const int64_t nTimeWaitStart = GetTimeMicros();
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+    const int64_t nTimeScripts = GetTimeMicros();
+    if (!saplingControl.Wait()) {
+        // Fall back to the serial verification only to pinpoint the failing transaction
+        if (SaplingValidation::CheckBlockShieldedProofs(block, state))
+            return state.DoS(100, error("%s: Sapling CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
+        return error("%s: shielded proofs verification failed for block %s: %s", __func__, hashBlock.ToString(), FormatStateMessage(state));
+    }
+    const int64_t nTimeSapling = GetTimeMicros();
+    if (!zerocoinControl.Wait())
+        return state.DoS(100, error("%s: failed to add block %s with invalid zc spend", __func__, hashBlock.ToString()), REJECT_INVALID);
     int64_t nTime2 = GetTimeMicros();
+    if (fRecordStats) {
+        RecordBlockPhase(BLOCK_PHASE_SCRIPTS, (nTimeScripts - nTimeWaitStart) + (nTime2 - nTimeSapling));
+        if (fSaplingProofChecks && nScriptCheckThreads)
+            RecordBlockPhase(BLOCK_PHASE_SAPLING, nTimeSapling - nTimeScripts);
+    }
     nTimeVerify += nTime2 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime2 - nTimeStart), nInputs <= 1 ? 0 : 0.001 * (nTime2 - nTimeStart) / (nInputs - 1), nTimeVerify * 0.000001);
 
@@ -1907,9 +2463,10 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
             CDiskBlockPos diskPosBlock;
-            if (!FindUndoPos(state, pindex->nFile, diskPosBlock, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+            CDiskRecord record(blockundo, fBlockCompression);
+            if (!FindUndoPos(state, pindex->nFile, diskPosBlock, record.GetDiskSize() + 32))
                 return error("ConnectBlock() : FindUndoPos failed");
-            if (!UndoWriteToDisk(blockundo, diskPosBlock, pindex->pprev->GetBlockHash()))
+            if (!UndoWriteToDisk(blockundo, record, diskPosBlock, pindex->pprev->GetBlockHash()))
                 return AbortNode(state, "Failed to write undo data");
 
             // update nUndoPos in block index
@@ -1922,49 +2479,19 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 
     // Flush spend/mint info to disk
-    if (!vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends))
+    if (!fZerocoinSnapshot && !vSpends.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpends))
         return AbortNode(state, "Failed to record coin serials to database");
-    if (!vMints.empty() && !zerocoinDB->WriteCoinMintBatch(vMints))
+    if (!fZerocoinSnapshot && !vMints.empty() && !zerocoinDB->WriteCoinMintBatch(vMints))
         return AbortNode(state, "Failed to record new mints to database");
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-
-    if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
-    if (fTimestampIndex) {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+    // CheckCollateral reads the budget fee transactions here, rather than
+    // from the transaction index, that is built in the background (if at all)
+    std::vector<CTransactionRef> vCollaterals;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (IsBudgetCollateralCandidate(*tx)) vCollaterals.push_back(tx);
     }
+    if (!vCollaterals.empty() && !pblocktree->WriteBudgetCollaterals(pindex->GetBlockHash(), vCollaterals))
+        return AbortNode(state, "Failed to write budget collateral index");
 
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -1972,6 +2499,7 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     int64_t nTime3 = GetTimeMicros();
     nTimeIndex += nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime3 - nTime2), nTimeIndex * 0.000001);
+    if (fRecordStats) RecordBlockPhase(BLOCK_PHASE_INDEX, nTime3 - nTime2);
 
     int64_t nTime4 = GetTimeMicros();
     nTimeCallbacks += nTime4 - nTime3;
@@ -1986,14 +2514,179 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         zerocoinDB->WipeAccChecksums();
     }
 
-    // 100 blocks after the last invalid out, clean the map contents
+    // 100 blocks after the last invalid out, stop looking them up
     if (pindex->nHeight == consensus.height_last_invalid_UTXO + 100) {
-        invalid_out::setInvalidOutPoints.clear();
+        invalid_out::UnloadOutpoints();
+    }
+
+    // handed over to the cache of the recent blocks
+    if (ppblockUndo) *ppblockUndo = std::make_shared<CBlockUndo>(std::move(blockundo));
+
+    TRACE7(validation, block_connected, hashBlock.begin(), pindex->nHeight, block.vtx.size(), nInputs, nSigOps,
+        nTime2 - nTimeStart, GetTimeMicros() - nTimeStart);
+    return true;
+}
+
+int GetPruneKeepDepth()
+{
+    // The stake inputs and the masternode collaterals are read from the coins,
+    // or from the undo data of the blocks a reorg can disconnect, and the budget
+    // collaterals from their own index: only the blocks a reorg can disconnect,
+    // or a peer catching up can ask, are needed.
+    const int nReorgDepth = gArgs.GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH) + 1;
+    return std::max(MIN_BLOCKS_TO_KEEP, nReorgDepth);
+}
+
+int GetPruneHeight()
+{
+    AssertLockHeld(cs_main);
+    if (!fHavePruned || !chainActive.Tip()) return 0;
+    const CBlockIndex* pindex = chainActive.Tip();
+    while (pindex->pprev && (pindex->pprev->nStatus & BLOCK_HAVE_DATA)) {
+        pindex = pindex->pprev;
     }
+    return pindex->nHeight;
+}
 
+bool HaveBlockDataFrom(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!fHavePruned) return true;
+    for (const CBlockIndex* pindexWalk = chainActive.Tip(); pindexWalk && pindexWalk->nHeight >= pindex->nHeight; pindexWalk = pindexWalk->pprev) {
+        if (!(pindexWalk->nStatus & BLOCK_HAVE_DATA)) return false;
+    }
     return true;
 }
 
+/** Forget the blocks of a block file in the block index, before the file is deleted */
+static void PruneOneBlockFile(int nFile)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_LastBlockFile);
+
+    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        CBlockIndex* pindex = it->second;
+        if (pindex->nFile == nFile) {
+            pindex->nStatus &= ~BLOCK_HAVE_DATA;
+            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nFile = 0;
+            pindex->nDataPos = 0;
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+
+            // Prune from mapBlocksUnlinked -- any block we prune would have
+            // to be downloaded again in order to consider its chain, at which
+            // point it would be considered as a candidate for
+            // mapBlocksUnlinked or setBlockIndexCandidates.
+            auto range = mapBlocksUnlinked.equal_range(pindex->pprev);
+            while (range.first != range.second) {
+                std::multimap<CBlockIndex*, CBlockIndex*>::iterator _it = range.first;
+                range.first++;
+                if (_it->second == pindex) {
+                    mapBlocksUnlinked.erase(_it);
+                }
+            }
+        }
+    }
+
+    vinfoBlockFile[nFile].SetNull();
+    setDirtyFileInfo.insert(nFile);
+}
+
+/**
+ * Select the block files to delete, and forget them in the block index, to bring
+ * the block and undo files down to nPruneTarget. The files with blocks in the
+ * last GetPruneKeepDepth() blocks, and the file being written, are never pruned.
+ */
+static void FindFilesToPrune(std::set<int>& setFilesToPrune)
+{
+    AssertLockHeld(cs_main);
+    LOCK(cs_LastBlockFile);
+    if (!chainActive.Tip() || nPruneTarget == 0) {
+        return;
+    }
+    const int nLastBlockWeCanPrune = chainActive.Height() - GetPruneKeepDepth();
+    if (nLastBlockWeCanPrune <= 0) {
+        return;
+    }
+
+    uint64_t nCurrentUsage = 0;
+    for (const CBlockFileInfo& info : vinfoBlockFile) {
+        nCurrentUsage += info.nSize + info.nUndoSize;
+    }
+    // Leave room for the pre-allocation of the next chunks
+    const uint64_t nBuffer = 2 * ((uint64_t)nBlockFileChunkSize + nUndoFileChunkSize);
+    if (nCurrentUsage + nBuffer < nPruneTarget) {
+        return;
+    }
+
+    for (int nFile = 0; nFile < nLastBlockFile; nFile++) {
+        const uint64_t nBytesToPrune = vinfoBlockFile[nFile].nSize + vinfoBlockFile[nFile].nUndoSize;
+        if (vinfoBlockFile[nFile].nSize == 0) {
+            continue;
+        }
+        if (nCurrentUsage + nBuffer < nPruneTarget) {
+            break;
+        }
+        // Don't prune files that could have a block within the blocks to keep
+        if (vinfoBlockFile[nFile].nHeightLast > (unsigned int)nLastBlockWeCanPrune) {
+            continue;
+        }
+        PruneOneBlockFile(nFile);
+        setFilesToPrune.insert(nFile);
+        nCurrentUsage -= nBytesToPrune;
+    }
+
+    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+        nPruneTarget / 1024 / 1024, nCurrentUsage / 1024 / 1024,
+        ((int64_t)nPruneTarget - (int64_t)nCurrentUsage) / 1024 / 1024,
+        nLastBlockWeCanPrune, setFilesToPrune.size());
+}
+
+/** Delete the block and undo files, once the block index that forgot them is on disk */
+static void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
+{
+    for (int nFile : setFilesToPrune) {
+        CDiskBlockPos pos(nFile, 0);
+        fs::remove(GetBlockPosFilename(pos, "blk"));
+        fs::remove(GetBlockPosFilename(pos, "rev"));
+        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, nFile);
+    }
+}
+
+void CleanupBlockRevFiles()
+{
+    std::map<std::string, fs::path> mapBlockFiles;
+
+    // Glob all blk?????.dat and rev?????.dat files from the blocks directory.
+    // Remove the rev files immediately and insert the blk file paths into an
+    // ordered map keyed by block file index.
+    LogPrintf("Removing unusable blk?????.dat and rev?????.dat files for -reindex with -prune\n");
+    const fs::path blocksdir = GetDataDir() / "blocks";
+    for (fs::directory_iterator it(blocksdir); it != fs::directory_iterator(); it++) {
+        const std::string strFile = it->path().filename().string();
+        if (fs::is_regular_file(*it) && strFile.length() == 12 && strFile.substr(8, 4) == ".dat") {
+            if (strFile.substr(0, 3) == "blk")
+                mapBlockFiles[strFile.substr(3, 5)] = it->path();
+            else if (strFile.substr(0, 3) == "rev")
+                fs::remove(it->path());
+        }
+    }
+
+    // Remove all block files that aren't part of a contiguous set starting at
+    // zero by walking the ordered map (keys are block file indices) by
+    // keeping a separate counter. Once we hit a gap (or if 0 doesn't exist)
+    // start removing block files.
+    int nContigCounter = 0;
+    for (const std::pair<const std::string, fs::path>& item : mapBlockFiles) {
+        if (atoi(item.first) == nContigCounter) {
+            nContigCounter++;
+            continue;
+        }
+        fs::remove(item.second);
+    }
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed if either they're too large, forceWrite is set, or
@@ -2007,7 +2700,11 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    // height of the last flush after which the money supply is to be updated
+    static int nSupplyFlushHeight = -1;
     try {
+        if (pcoinsWriteBack->HasFailed())
+            return AbortNode(state, "Failed to write to coin database");
         int64_t nNow = GetTimeMicros();
         // Avoid writing/flushing immediately after startup.
         if (nLastWrite == 0) {
@@ -2033,15 +2730,27 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
         bool fPeriodicWrite = mode == FLUSH_STATE_PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
         bool fPeriodicFlush = mode == FLUSH_STATE_PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+        std::set<int> setFilesToPrune;
+        if (fPruneMode && fCheckForPruning && !fReindex && mode != FLUSH_STATE_NONE) {
+            FindFilesToPrune(setFilesToPrune);
+            fCheckForPruning = false;
+            if (!setFilesToPrune.empty() && !fHavePruned) {
+                pblocktree->WriteFlag("prunedblockfiles", true);
+                fHavePruned = true;
+            }
+        }
+        const bool fFlushForPrune = !setFilesToPrune.empty();
         // Combine all conditions that result in a full cache flush.
-        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush;
+        bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
             if (!CheckDiskSpace(0))
                 return state.Error("out of disk space");
-            // First make sure all block and undo data is flushed to disk.
+            // First make sure all block and undo data is flushed to disk,
+            // including the commits queued before.
             FlushBlockFile();
+            g_blockfileflusher.Sync();
             // Then update all block file information (which may refer to block and undo files).
             {
                 std::vector<std::pair<int, const CBlockFileInfo*> > vFiles;
@@ -2073,14 +2782,32 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // The coins are handed to pcoinsWriteBack, that writes them in the
+            // background, unless we are asked to be on disk when returning.
+            // When the cache is full, keep its hottest part to avoid restarting cold.
+            bool fPartial = (fCacheLarge || fCacheCritical) && nCoinCacheRetainUsage > 0;
+            TRACE4(utxocache, flush_start, (int)mode, pcoinsTip->GetCacheSize(), pcoinsTip->DynamicMemoryUsage(), fPartial);
+            if (!(fPartial ? pcoinsTip->PartialFlush(nCoinCacheRetainUsage) : pcoinsTip->Flush()))
+                return AbortNode(state, "Failed to write to coin database");
+            // The coins must be on disk before the blocks they were connected from are deleted
+            if ((mode == FLUSH_STATE_ALWAYS || fFlushForPrune) && !pcoinsWriteBack->Sync())
                 return AbortNode(state, "Failed to write to coin database");
+            TRACE3(utxocache, flushed, (int)mode, pcoinsTip->GetCacheSize(), GetTimeMicros() - nNow);
             nLastFlush = nNow;
-            // Update money supply on memory, reading data from disk
-            if (!ShutdownRequested() && !IsInitialBlockDownload()) {
-                MoneySupply.Update(pcoinsTip->GetTotalAmount(), chainActive.Height());
+            if (!IsInitialBlockDownload()) {
+                nSupplyFlushHeight = chainActive.Height();
             }
         }
+        if (fFlushForPrune) {
+            UnlinkPrunedFiles(setFilesToPrune);
+        }
+        // Update money supply on memory, reading data from disk, once it's written
+        if (nSupplyFlushHeight >= 0 && !pcoinsWriteBack->IsWriting()) {
+            if (!ShutdownRequested()) {
+                MoneySupply.Update(pcoinsTip->GetTotalAmount(), nSupplyFlushHeight);
+            }
+            nSupplyFlushHeight = -1;
+        }
         if ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000) {
             // Update best block in wallet (so we can detect restored wallets).
             GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -2104,6 +2831,7 @@ void static UpdateTip(CBlockIndex* pindexNew)
 {
     AssertLockHeld(cs_main);
     chainActive.SetTip(pindexNew);
+    PublishChainTipSnapshot(pindexNew);
     g_IsV6Active = Params().GetConsensus().NetworkUpgradeActive(pindexNew->nHeight, Consensus::UPGRADE_V5_0);
 
     // New best block
@@ -2146,69 +2874,210 @@ void static UpdateTip(CBlockIndex* pindexNew)
     }
 }
 
-/** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
-bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams)
+//! The serialized size of the transactions of disconnected blocks that wait to go back to the mempool
+static const size_t MAX_DISCONNECTED_TX_POOL_SIZE = 20 * 1000 * 1000;
+//! How many blocks a reorganization reads ahead and disconnects in one coins cache layer
+static const size_t DISCONNECT_BATCH_BLOCKS = 16;
+
+/**
+ * The transactions of the blocks disconnected by a reorganization, that go back to the
+ * mempool once the new chain is connected, and the Sapling anchors these blocks left.
+ * The blocks are added tip first and their transactions in reverse: read backwards, the
+ * queue has the parents before their children.
+ */
+class DisconnectedBlockTransactions
+{
+private:
+    std::deque<CTransactionRef> queuedTx;
+    //! Mined again by the new chain: they don't go back
+    std::unordered_set<uint256, SaltedIdHasher> setConfirmed;
+    std::vector<uint256> vAnchors;
+    size_t nSize{0};
+
+public:
+    void AddBlock(const CBlock& block)
+    {
+        for (auto it = block.vtx.rbegin(); it != block.vtx.rend(); ++it) {
+            queuedTx.push_back(*it);
+            nSize += (*it)->GetTotalSize();
+        }
+        // Over the limit, the transactions disconnected first are given up, with their descendants
+        while (nSize > MAX_DISCONNECTED_TX_POOL_SIZE) {
+            mempool.removeRecursive(*queuedTx.front(), MemPoolRemovalReason::REORG);
+            nSize -= queuedTx.front()->GetTotalSize();
+            queuedTx.pop_front();
+        }
+    }
+
+    void AddAnchor(const uint256& anchor) { vAnchors.push_back(anchor); }
+
+    void RemoveForBlock(const std::vector<CTransactionRef>& vtx)
+    {
+        if (queuedTx.empty()) return;
+        for (const CTransactionRef& tx : vtx) {
+            setConfirmed.insert(tx->GetHash());
+        }
+    }
+
+    /**
+     * Put the transactions back into the mempool, parents first (or, without fAddToMempool,
+     * only remove their descendants from it), then evict the spends of the anchors left.
+     */
+    void UpdateMempoolForReorg(bool fAddToMempool)
+    {
+        AssertLockHeld(cs_main);
+        std::vector<uint256> vHashUpdate;
+        for (auto it = queuedTx.rbegin(); it != queuedTx.rend(); ++it) {
+            const CTransactionRef& tx = *it;
+            if (setConfirmed.count(tx->GetHash())) continue;
+            // ignore validation errors in resurrected transactions
+            CValidationState stateDummy;
+            if (!fAddToMempool || tx->IsCoinBase() || tx->IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, nullptr, true)) {
+                mempool.removeRecursive(*tx, MemPoolRemovalReason::REORG);
+            } else if (mempool.exists(tx->GetHash())) {
+                vHashUpdate.push_back(tx->GetHash());
+            }
+        }
+        queuedTx.clear();
+        setConfirmed.clear();
+        nSize = 0;
+        // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
+        // no in-mempool children, which is generally not true when adding
+        // previously-confirmed transactions back to the mempool.
+        // UpdateTransactionsFromBlock finds descendants of any transactions in the
+        // disconnected blocks that were added back and cleans up the mempool state.
+        mempool.UpdateTransactionsFromBlock(vHashUpdate);
+        // Evict from mempool the spends of the anchors that changed
+        for (const uint256& anchor : vAnchors) {
+            mempool.removeWithAnchor(anchor);
+        }
+        vAnchors.clear();
+    }
+};
+
+/**
+ * The last blocks connected to the tip, with their undo data: the short
+ * reorgs of the stake races disconnect them without reading the disk.
+ * Up to -undocache blocks, guarded by cs_main.
+ */
+struct RecentBlock
+{
+    const CBlockIndex* pindex;
+    std::shared_ptr<const CBlock> pblock;
+    std::shared_ptr<CBlockUndo> pundo;
+};
+static std::deque<RecentBlock> recentBlocks;
+
+static void AddRecentBlock(const CBlockIndex* pindex, const std::shared_ptr<const CBlock>& pblock, const std::shared_ptr<CBlockUndo>& pundo)
+{
+    AssertLockHeld(cs_main);
+    const size_t nMaxBlocks = std::max(0, (int)gArgs.GetArg("-undocache", DEFAULT_UNDO_CACHE_BLOCKS));
+    if (nMaxBlocks == 0 || !pundo) return;
+    recentBlocks.push_back({pindex, pblock, pundo});
+    while (recentBlocks.size() > nMaxBlocks) recentBlocks.pop_front();
+}
+
+// Moves the block and its undo data out of the cache, if they are there
+static bool TakeRecentBlock(const CBlockIndex* pindex, std::shared_ptr<const CBlock>& pblock, CBlockUndo& undo)
 {
     AssertLockHeld(cs_main);
-    CBlockIndex* pindexDelete = chainActive.Tip();
-    assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete))
-        return AbortNode(state, "Failed to read block");
-    // Apply the block atomically to the chain state.
-    const uint256& saplingAnchorBeforeDisconnect = pcoinsTip->GetBestAnchor();
-    int64_t nStart = GetTimeMicros();
-    {
-        CCoinsViewCache view(pcoinsTip);
-        assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK)
-            return error("DisconnectTip() : DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
-        assert(view.Flush());
-    }
-    LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
-    const uint256& saplingAnchorAfterDisconnect = pcoinsTip->GetBestAnchor();
-    // Write the chain state to disk, if necessary.
-    if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
-        return false;
-    // Resurrect mempool transactions from the disconnected block.
-    std::vector<uint256> vHashUpdate;
-    for (const auto& tx : block.vtx) {
-        // ignore validation errors in resurrected transactions
-        CValidationState stateDummy;
-        if (tx->IsCoinBase() || tx->IsCoinStake() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, nullptr, true)) {
-            mempool.removeRecursive(*tx, MemPoolRemovalReason::REORG);
-        } else if (mempool.exists(tx->GetHash())) {
-            vHashUpdate.push_back(tx->GetHash());
-        }
-    }
-    // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
-    // no in-mempool children, which is generally not true when adding
-    // previously-confirmed transactions back to the mempool.
-    // UpdateTransactionsFromBlock finds descendants of any transactions in this
-    // block that were added back and cleans up the mempool state.
-    mempool.UpdateTransactionsFromBlock(vHashUpdate);
-    // Update MN manager cache
-    // replace the cached hash of pindexDelete with the hash of the block
-    // at depth CACHED_BLOCK_HASHES if it exists, or empty hash otherwise.
-    if ((unsigned) pindexDelete->nHeight >= CACHED_BLOCK_HASHES) {
-        mnodeman.CacheBlockHash(chainActive[pindexDelete->nHeight - CACHED_BLOCK_HASHES]);
-    } else {
-        mnodeman.UncacheBlockHash(pindexDelete);
-    }
-    // Evict from mempool if the anchor changes
-    if (saplingAnchorBeforeDisconnect != saplingAnchorAfterDisconnect) {
-        // The anchor may not change between block disconnects,
-        // in which case we don't want to evict from the mempool yet!
-        mempool.removeWithAnchor(saplingAnchorBeforeDisconnect);
+    for (auto it = recentBlocks.begin(); it != recentBlocks.end(); ++it) {
+        if (it->pindex == pindex) {
+            pblock = it->pblock;
+            undo = std::move(*it->pundo);
+            recentBlocks.erase(it);
+            return true;
+        }
     }
-    // Update chainActive and related variables.
-    UpdateTip(pindexDelete->pprev);
-    // Let wallets know transactions went from 1-confirmed to
-    // 0-confirmed or conflicted:
-    GetMainSignals().BlockDisconnected(pblock, pindexDelete->GetBlockHash(), pindexDelete->nHeight, pindexDelete->GetBlockTime());
+    return false;
+}
+
+/** A block to disconnect, read ahead with its undo data */
+struct DisconnectBlockRead
+{
+    CBlockIndex* pindex;
+    std::shared_ptr<const CBlock> pblock;
+    CBlockUndo undo;
+    bool fBlockRead{false};
+    bool fUndoRead{false};
+};
+
+/**
+ * Disconnect chainActive's tip down to pindexFork (excluded). The blocks and their undo data are
+ * read ahead over several threads, a batch at a time, and each batch is applied to one coins cache
+ * layer, flushed once. The transactions of the blocks are queued in disconnectpool: call its
+ * UpdateMempoolForReorg, then mempool.removeForReorg, and re-limit the mempool size after this,
+ * with cs_main held.
+ */
+static bool DisconnectTipsTo(CValidationState& state, const CBlockIndex* pindexFork, DisconnectedBlockTransactions& disconnectpool)
+{
+    AssertLockHeld(cs_main);
+    while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
+        std::vector<DisconnectBlockRead> vBlocks;
+        for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex != pindexFork && vBlocks.size() < DISCONNECT_BATCH_BLOCKS; pindex = pindex->pprev) {
+            vBlocks.emplace_back();
+            DisconnectBlockRead& entry = vBlocks.back();
+            entry.pindex = pindex;
+            entry.fBlockRead = entry.fUndoRead = TakeRecentBlock(pindex, entry.pblock, entry.undo);
+        }
+        // Read the other blocks and their undo data from disk
+        ParallelForEach(vBlocks.size(), GetNumCores(), [&vBlocks](size_t i) {
+            DisconnectBlockRead& entry = vBlocks[i];
+            if (entry.fBlockRead)
+                return;
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            entry.fBlockRead = ReadBlockFromDisk(*pblock, entry.pindex);
+            entry.pblock = pblock;
+            const CDiskBlockPos pos = entry.pindex->GetUndoPos();
+            // DisconnectBlock reads the undo data again, and reports the failure
+            entry.fUndoRead = entry.fBlockRead && !pos.IsNull() && UndoReadFromDisk(entry.undo, pos, entry.pindex->pprev->GetBlockHash());
+        });
+
+        // Apply each block atomically to the layer of the batch
+        int64_t nStart = GetTimeMicros();
+        size_t nDisconnected = 0;
+        {
+            CCoinsViewCache viewBatch(pcoinsTip);
+            for (DisconnectBlockRead& entry : vBlocks) {
+                if (!entry.fBlockRead)
+                    break;
+                CCoinsViewCache view(&viewBatch);
+                assert(view.GetBestBlock() == entry.pindex->GetBlockHash());
+                const uint256 saplingAnchorBeforeDisconnect = view.GetBestAnchor();
+                if (DisconnectBlock(*entry.pblock, entry.pindex, view, entry.fUndoRead ? &entry.undo : nullptr) != DISCONNECT_OK)
+                    break;
+                // The anchor may not change between block disconnects,
+                // in which case we don't want to evict from the mempool!
+                if (view.GetBestAnchor() != saplingAnchorBeforeDisconnect)
+                    disconnectpool.AddAnchor(saplingAnchorBeforeDisconnect);
+                assert(view.Flush());
+                nDisconnected++;
+            }
+            assert(viewBatch.Flush());
+        }
+        LogPrint(BCLog::BENCH, "- Disconnect %u blocks: %.2fms\n", nDisconnected, (GetTimeMicros() - nStart) * 0.001);
+
+        // Write the chain state to disk, if necessary.
+        if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
+            return false;
+
+        for (size_t i = 0; i < nDisconnected; i++) {
+            const DisconnectBlockRead& entry = vBlocks[i];
+            disconnectpool.AddBlock(*entry.pblock);
+            // Update chainActive and related variables.
+            UpdateTip(entry.pindex->pprev);
+            // Let wallets know transactions went from 1-confirmed to
+            // 0-confirmed or conflicted:
+            GetMainSignals().BlockDisconnected(entry.pblock, entry.pindex->GetBlockHash(), entry.pindex->nHeight, entry.pindex->GetBlockTime());
+        }
 
+        if (nDisconnected < vBlocks.size()) {
+            const DisconnectBlockRead& entry = vBlocks[nDisconnected];
+            if (!entry.fBlockRead)
+                return AbortNode(state, "Failed to read block");
+            return error("DisconnectTip() : DisconnectBlock %s failed", entry.pindex->GetBlockHash().ToString());
+        }
+    }
     return true;
 }
 
@@ -2290,7 +3159,7 @@ public:
  *
  * The block is added to connectTrace if connection succeeds.
  */
-bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace)
+bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool)
 {
     assert(pindexNew->pprev == chainActive.Tip());
 
@@ -2312,9 +3181,11 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    if (!pblock) RecordBlockPhase(BLOCK_PHASE_READ, nTime2 - nTime1);
+    std::shared_ptr<CBlockUndo> pblockUndo;
     {
         CCoinsViewCache view(pcoinsTip);
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, false);
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, false, &pblockUndo);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid())
@@ -2339,13 +3210,14 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
     int64_t nTime5 = GetTimeMicros();
     nTimeChainState += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_FLUSH, nTime5 - nTime3);
 
     // Remove conflicting transactions from the mempool.
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight, !IsInitialBlockDownload());
+    disconnectpool.RemoveForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
-    // Update MN manager cache
-    mnodeman.CacheBlockHash(pindexNew);
+    AddRecentBlock(pindexNew, pthisBlock, pblockUndo);
     mnodeman.CheckSpentCollaterals(blockConnecting.vtx);
 
     int64_t nTime6 = GetTimeMicros();
@@ -2353,6 +3225,7 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, const st
     nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    RecordBlockPhase(BLOCK_PHASE_TOTAL, nTime6 - nTime1);
 
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
@@ -2442,9 +3315,14 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
 
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
-    while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
-        if (!DisconnectTip(state, Params()))
+    DisconnectedBlockTransactions disconnectpool;
+    if (chainActive.Tip() && chainActive.Tip() != pindexFork) {
+        if (!DisconnectTipsTo(state, pindexFork, disconnectpool)) {
+            // It's probably hopeless to try to make the mempool consistent
+            // here if the disconnect failed, but we can try.
+            disconnectpool.UpdateMempoolForReorg(false);
             return false;
+        }
         fBlocksDisconnected = true;
     }
 
@@ -2467,7 +3345,7 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
 
         // Connect new blocks.
         for (CBlockIndex* pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, pindexConnect, (pindexConnect == pindexMostWork) ? pblock : std::shared_ptr<const CBlock>(), connectTrace)) {
+            if (!ConnectTip(state, pindexConnect, (pindexConnect == pindexMostWork) ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (!state.CorruptionPossible())
@@ -2478,6 +3356,9 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
                     break;
                 } else {
                     // A system error occurred (disk space, database error, ...).
+                    // Make the mempool consistent with the current tip, just in case
+                    // any observers try to use it before shutdown.
+                    disconnectpool.UpdateMempoolForReorg(false);
                     return false;
                 }
             } else {
@@ -2492,6 +3373,8 @@ static bool ActivateBestChainStep(CValidationState& state, CBlockIndex* pindexMo
     }
 
     if (fBlocksDisconnected) {
+        // The transactions of the disconnected blocks go back to the mempool at once, on the new chain
+        disconnectpool.UpdateMempoolForReorg(true);
         mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
         LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
     }
@@ -2616,17 +3499,22 @@ bool InvalidateBlock(CValidationState& state, const CChainParams& chainparams, C
     setDirtyBlockIndex.insert(pindex);
     setBlockIndexCandidates.erase(pindex);
 
-    while (chainActive.Contains(pindex)) {
-        CBlockIndex* pindexWalk = chainActive.Tip();
-        pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
-        setDirtyBlockIndex.insert(pindexWalk);
-        setBlockIndexCandidates.erase(pindexWalk);
+    if (chainActive.Contains(pindex)) {
+        for (CBlockIndex* pindexWalk = chainActive.Tip(); pindexWalk != pindex; pindexWalk = pindexWalk->pprev) {
+            pindexWalk->nStatus |= BLOCK_FAILED_CHILD;
+            setDirtyBlockIndex.insert(pindexWalk);
+            setBlockIndexCandidates.erase(pindexWalk);
+        }
         // ActivateBestChain considers blocks already in chainActive
         // unconditionally valid already, so force disconnect away from it.
-        if (!DisconnectTip(state, chainparams)) {
+        DisconnectedBlockTransactions disconnectpool;
+        if (!DisconnectTipsTo(state, pindex->pprev, disconnectpool)) {
+            disconnectpool.UpdateMempoolForReorg(false);
             mempool.removeForReorg(pcoinsTip, chainActive.Tip()->nHeight + 1, STANDARD_LOCKTIME_VERIFY_FLAGS);
             return false;
         }
+        // The transactions of the disconnected blocks go back to the mempool at once
+        disconnectpool.UpdateMempoolForReorg(true);
     }
 
     LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
@@ -2809,6 +3697,9 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
                 vinfoBlockFile.resize(nFile + 1);
             }
         }
+        if (fPruneMode && nFile != (unsigned int)nLastBlockFile) {
+            fCheckForPruning = true;
+        }
         pos.nFile = nFile;
         pos.nPos = vinfoBlockFile[nFile].nSize;
     }
@@ -2821,19 +3712,20 @@ bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned int nAdd
         vinfoBlockFile[nFile].nSize += nAddSize;
 
     if (!fKnown) {
-        unsigned int nOldChunks = (pos.nPos + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
-        unsigned int nNewChunks = (vinfoBlockFile[nFile].nSize + BLOCKFILE_CHUNK_SIZE - 1) / BLOCKFILE_CHUNK_SIZE;
-        if (nNewChunks > nOldChunks) {
-            if (CheckDiskSpace(nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos)) {
-                FILE* file = OpenBlockFile(pos);
-                if (file) {
-                    LogPrintf("Pre-allocating up to position 0x%x in blk%05u.dat\n", nNewChunks * BLOCKFILE_CHUNK_SIZE, pos.nFile);
-                    AllocateFileRange(file, pos.nPos, nNewChunks * BLOCKFILE_CHUNK_SIZE - pos.nPos);
-                    fclose(file);
-                }
+        // Pre-allocated a chunk ahead in the background, past the data about
+        // to be written, and the data written so far is committed along: the
+        // writes seldom wait for either.
+        const unsigned int nOldAllocated = PreallocatedSize(pos.nPos, nBlockFileChunkSize);
+        const unsigned int nNewAllocated = PreallocatedSize(vinfoBlockFile[nFile].nSize, nBlockFileChunkSize);
+        if (nNewAllocated > nOldAllocated) {
+            if (CheckDiskSpace(nNewAllocated - pos.nPos)) {
+                const unsigned int nFrom = std::max(nOldAllocated, vinfoBlockFile[nFile].nSize);
+                if (pos.nPos > 0) g_blockfileflusher.Commit(nFile);
+                g_blockfileflusher.Allocate(false, nFile, nFrom, nNewAllocated - nFrom);
             } else
                 return state.Error("out of disk space");
         }
+        g_blockfileflusher.WaitForWrite(false, nFile, pos.nPos, vinfoBlockFile[nFile].nSize);
     }
 
     setDirtyFileInfo.insert(nFile);
@@ -2851,19 +3743,18 @@ bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigne
     nNewSize = vinfoBlockFile[nFile].nUndoSize += nAddSize;
     setDirtyFileInfo.insert(nFile);
 
-    unsigned int nOldChunks = (pos.nPos + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
-    unsigned int nNewChunks = (nNewSize + UNDOFILE_CHUNK_SIZE - 1) / UNDOFILE_CHUNK_SIZE;
-    if (nNewChunks > nOldChunks) {
-        if (CheckDiskSpace(nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos)) {
-            FILE* file = OpenUndoFile(pos);
-            if (file) {
-                LogPrintf("Pre-allocating up to position 0x%x in rev%05u.dat\n", nNewChunks * UNDOFILE_CHUNK_SIZE, pos.nFile);
-                AllocateFileRange(file, pos.nPos, nNewChunks * UNDOFILE_CHUNK_SIZE - pos.nPos);
-                fclose(file);
-            }
+    const unsigned int nOldAllocated = PreallocatedSize(pos.nPos, nUndoFileChunkSize);
+    const unsigned int nNewAllocated = PreallocatedSize(nNewSize, nUndoFileChunkSize);
+    if (nNewAllocated > nOldAllocated) {
+        if (CheckDiskSpace(nNewAllocated - pos.nPos)) {
+            const unsigned int nFrom = std::max(nOldAllocated, nNewSize);
+            if (pos.nPos > 0) g_blockfileflusher.Commit(nFile);
+            g_blockfileflusher.Allocate(true, nFile, nFrom, nNewAllocated - nFrom);
         } else
             return state.Error("out of disk space");
     }
+    // the undo file of a block file left may still be truncated by its finalization
+    g_blockfileflusher.WaitForWrite(true, nFile, pos.nPos, nNewSize);
 
     return true;
 }
@@ -2934,7 +3825,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
-    if (!IsPoS && fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits))
+    if (!IsPoS && fCheckPOW && !block.fPreChecked && !CheckProofOfWork(block.GetHash(), block.nBits))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
     // All potential-corruption validation must be done before we do any
@@ -2942,7 +3833,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // because we receive the wrong transactions for it.
 
     // Check the merkle root.
-    if (fCheckMerkleRoot) {
+    if (fCheckMerkleRoot && !block.fPreChecked) {
         bool mutated;
         uint256 hashMerkleRoot2 = BlockMerkleRoot(block, &mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
@@ -3020,10 +3911,12 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             fColdStakingActive = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE);
 
             // check masternode/budget payment
+            const int64_t nTimePayee = GetTimeMicros();
             if (!IsBlockPayeeValid(block, nHeight)) {
                 mapRejectedBlocks.emplace(block.GetHash(), GetTime());
                 return state.DoS(0, false, REJECT_INVALID, "bad-cb-payee", false, "Couldn't find masternode/budget payment");
             }
+            RecordBlockPhase(BLOCK_PHASE_TIERTWO, GetTimeMicros() - nTimePayee);
         } else {
             LogPrintf("%s: Masternode/Budget payment checks skipped on sync\n", __func__);
         }
@@ -3065,7 +3958,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
             REJECT_INVALID, "bad-blk-sigops", true);
 
     // Check PoS signature.
-    if (fCheckSig && !CheckBlockSignature(block)) {
+    if (fCheckSig && !block.fPreChecked && !CheckBlockSignature(block)) {
         return state.DoS(100, error("%s : bad proof-of-stake block signature", __func__),
                          REJECT_INVALID, "bad-PoS-sig", true);
     }
@@ -3076,6 +3969,26 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
+bool PreCheckBlock(const CBlock& block)
+{
+    if (block.fChecked || block.fPreChecked)
+        return true;
+
+    const uint256 hash = block.CacheHash();
+    if (!block.IsProofOfStake() && !CheckProofOfWork(hash, block.nBits))
+        return false;
+
+    bool mutated;
+    if (block.hashMerkleRoot != BlockMerkleRoot(block, &mutated) || mutated)
+        return false;
+
+    if (!CheckBlockSignature(block))
+        return false;
+
+    block.fPreChecked = true;
+    return true;
+}
+
 bool CheckWork(const CBlock& block, const CBlockIndex* const pindexPrev)
 {
     if (pindexPrev == NULL)
@@ -3211,8 +4124,9 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
 
-        // Sapling: Check transaction contextually against consensus rules at block height
-        if (!SaplingValidation::ContextualCheckTransaction(*tx, state, chainparams, nHeight, true, IsInitialBlockDownload())) {
+        // Sapling: Check transaction contextually against consensus rules at block height.
+        // Proofs are verified for the whole block at once in ConnectBlock.
+        if (!SaplingValidation::ContextualCheckTransaction(*tx, state, chainparams, nHeight, true, IsInitialBlockDownload(), false)) {
             return false; // Failure reason has been set in validation state object
         }
 
@@ -3320,8 +4234,10 @@ bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppi
     bool isPoS = block.IsProofOfStake();
     if (isPoS) {
         std::string strError;
+        const int64_t nTimePoS = GetTimeMicros();
         if (!CheckProofOfStake(block, strError, pindexPrev))
             return state.DoS(100, error("%s: proof of stake check failed (%s)", __func__, strError));
+        RecordBlockPhase(BLOCK_PHASE_POS, GetTimeMicros() - nTimePoS);
     }
 
     if (!AcceptBlockHeader(block, state, &pindex, pindexPrev))
@@ -3532,15 +4448,21 @@ bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** ppi
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
         CDiskBlockPos blockPos;
-        if (dbp != NULL)
+        if (dbp != NULL) {
+            // Already stored, possibly compressed: the uncompressed size only
+            // bounds the end of its record
             blockPos = *dbp;
-        if (!FindBlockPos(state, blockPos, nBlockSize + 8, nHeight, block.GetBlockTime(), dbp != NULL))
-            return error("AcceptBlock() : FindBlockPos failed");
-        if (dbp == NULL)
-            if (!WriteBlockToDisk(block, blockPos))
+            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            if (!FindBlockPos(state, blockPos, nBlockSize + 8, nHeight, block.GetBlockTime(), true))
+                return error("AcceptBlock() : FindBlockPos failed");
+        } else {
+            CDiskRecord record(block, fBlockCompression);
+            if (!FindBlockPos(state, blockPos, record.GetDiskSize(), nHeight, block.GetBlockTime()))
+                return error("AcceptBlock() : FindBlockPos failed");
+            if (!WriteBlockToDisk(record, blockPos))
                 return AbortNode(state, "Failed to write block");
+        }
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock() : ReceivedBlockTransactions failed");
     } catch (const std::runtime_error& e) {
@@ -3562,9 +4484,12 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, const std::shared_pt
     {
         // CheckBlock requires cs_main lock
         LOCK(cs_main);
+        const int64_t nTimeCheck = GetTimeMicros();
+        const bool fChecked = pblock->fChecked;
         if (!CheckBlock(*pblock, state)) {
             return error ("%s : CheckBlock FAILED for block %s, %s", __func__, pblock->GetHash().GetHex(), FormatStateMessage(state));
         }
+        if (!fChecked) RecordBlockPhase(BLOCK_PHASE_CHECKBLOCK, GetTimeMicros() - nTimeCheck);
 
         // Store to disk
         CBlockIndex* pindex = nullptr;
@@ -3581,7 +4506,6 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, const std::shared_pt
         return error("%s : ActivateBestChain failed", __func__);
 
     if (!fLiteMode) {
-        mnodeman.SetBestHeight(newHeight);
         g_budgetman.NewBlock(newHeight);
         if (masternodeSync.RequestedMasternodeAssets > MASTERNODE_SYNC_LIST) {
             masternodePayments.ProcessBlock(newHeight + 10);
@@ -3692,28 +4616,89 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
     return pindexNew;
 }
 
+static fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+bool DumpBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(mapBlockIndex.size());
+    for (const BlockMap::value_type& entry : mapBlockIndex) {
+        // skip the entries created for unknown predecessors, not in the database
+        if ((entry.second->nStatus & BLOCK_VALID_MASK) == BLOCK_VALID_UNKNOWN) continue;
+        vIndex.push_back(entry.second);
+    }
+    if (!pblocktree->WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath(), vIndex))
+        return error("%s: failed to write the block index snapshot", __func__);
+    LogPrintf("Dumped %u block index entries in %dms\n", vIndex.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
 bool static LoadBlockIndexDB(std::string& strError)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    bool fLoaded = false;
+    if (gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCKINDEX_SNAPSHOT)) {
+        int64_t nStart = GetTimeMillis();
+        fLoaded = pblocktree->LoadBlockIndexSnapshot(GetBlockIndexSnapshotPath(), InsertBlockIndex);
+        if (fLoaded) {
+            LogPrintf("%s: loaded %u entries from the block index snapshot in %dms\n", __func__, mapBlockIndex.size(), GetTimeMillis() - nStart);
+        } else {
+            // start over from the database
+            for (BlockMap::value_type& entry : mapBlockIndex) {
+                delete entry.second;
+            }
+            mapBlockIndex.clear();
+        }
+    }
+    if (!fLoaded && !pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
         return false;
 
     boost::this_thread::interruption_point();
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
+    // Sort the entries by height. The heights are dense, count them and place
+    // every entry directly in its height range.
+    int nMaxHeight = 0;
     for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.emplace_back(pindex->nHeight, pindex);
+        nMaxHeight = std::max(nMaxHeight, item.second->nHeight);
+    }
+    std::vector<size_t> vHeightPos(nMaxHeight + 2, 0);
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        vHeightPos[item.second->nHeight + 1]++;
+    }
+    for (int nHeight = 1; nHeight <= nMaxHeight + 1; nHeight++) {
+        vHeightPos[nHeight] += vHeightPos[nHeight - 1];
+    }
+    std::vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        vSortedByHeight[vHeightPos[item.second->nHeight]++] = item.second;
+    }
+
+    // The block proofs don't depend on each other, compute them (in nChainWork)
+    // on all the cores. The chain work is accumulated in height order below.
+    {
+        const size_t nEntries = vSortedByHeight.size();
+        const size_t nChunkSize = 10000;
+        ParallelForEach((nEntries + nChunkSize - 1) / nChunkSize, GetNumCores(), [&vSortedByHeight, nEntries, nChunkSize](size_t nChunk) {
+            for (size_t i = nChunk * nChunkSize; i < std::min(nEntries, (nChunk + 1) * nChunkSize); i++) {
+                vSortedByHeight[i]->nChainWork = GetBlockProof(*vSortedByHeight[i]);
+            }
+        });
     }
-    std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+
+    // Calculate nChainWork
+    for (CBlockIndex* pindex : vSortedByHeight) {
         // Stop if shutdown was requested
         if (ShutdownRequested()) return false;
 
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+        if (pindex->pprev) {
+            pindex->nChainWork = pindex->pprev->nChainWork + pindex->nChainWork;
+        }
+        // The pruned blocks still count their transactions
+        if (pindex->nTx > 0) {
             if (pindex->pprev) {
                 if (pindex->pprev->nChainTx) {
                     pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
@@ -3777,6 +4762,12 @@ bool static LoadBlockIndexDB(std::string& strError)
         }
     }
 
+    // Check whether we have ever pruned block & undo files
+    pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
+    if (fHavePruned)
+        LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
+    fCheckForPruning = fPruneMode;
+
     //Check if the shutdown procedure was followed on last client exit
     bool fLastShutdownWasPrepared = true;
     pblocktree->ReadFlag("shutdown", fLastShutdownWasPrepared);
@@ -3787,22 +4778,6 @@ bool static LoadBlockIndexDB(std::string& strError)
     pblocktree->ReadReindexing(fReindexing);
     if (fReindexing) fReindex = true;
 
-    // Check whether we have an address index
-    pblocktree->ReadFlag("addressindex", fAddressIndex);
-    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
-
-    // Check whether we have a timestamp index
-    pblocktree->ReadFlag("timestampindex", fTimestampIndex);
-    LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
-
-    // Check whether we have a spent index
-    pblocktree->ReadFlag("spentindex", fSpentIndex);
-    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
-
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
-
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3829,6 +4804,7 @@ bool LoadChainTip(const CChainParams& chainparams)
         return false;
     }
     chainActive.SetTip(it->second);
+    PublishChainTipSnapshot(it->second);
 
     PruneBlockIndexCandidates();
 
@@ -3854,6 +4830,38 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100);
 }
 
+//! VerifyDB reads this many blocks ahead of its checks
+static const size_t VERIFYDB_READ_AHEAD = 128;
+
+/** A block of VerifyDB, read (and its undo data checked) ahead of the other checks */
+struct VerifyDBBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    //! Empty if the levels 0 and 2 passed
+    std::string strError;
+};
+
+// Check levels 0 (read from disk) and 2 (undo data) of the blocks over up to one thread per core.
+// The block index entries are only read: the caller holds cs_main.
+static void VerifyDBReadBlocks(std::vector<VerifyDBBlock>& vBlocks, int nCheckLevel)
+{
+    ParallelForEach(vBlocks.size(), GetNumCores(), [&vBlocks, nCheckLevel](size_t i) {
+        VerifyDBBlock& entry = vBlocks[i];
+        const CBlockIndex* pindex = entry.pindex;
+        if (!ReadBlockFromDisk(entry.block, pindex)) {
+            entry.strError = strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return;
+        }
+        if (nCheckLevel >= 2) {
+            CBlockUndo undo;
+            CDiskBlockPos pos = pindex->GetUndoPos();
+            if (!pos.IsNull() && !UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
+                entry.strError = strprintf("found bad undo data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
+    });
+}
+
 bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth)
 {
     LOCK(cs_main);
@@ -3866,6 +4874,9 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
         nCheckDepth = 1000000000; // suffices until the year 19000
     if (nCheckDepth > chainHeight)
         nCheckDepth = chainHeight;
+    // Only the blocks still on disk can be checked
+    if (fHavePruned)
+        nCheckDepth = std::min(nCheckDepth, chainHeight - GetPruneHeight());
     nCheckLevel = std::max(0, std::min(4, nCheckLevel));
     LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
     CCoinsViewCache coins(coinsview);
@@ -3873,27 +4884,33 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
     CValidationState state;
+    std::vector<VerifyDBBlock> vBlocks;
+    size_t nBlock = 0;
+    CBlockIndex* pindexNextRead = chainActive.Tip();
     for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
         boost::this_thread::interruption_point();
         uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainHeight - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
         if (pindex->nHeight < chainHeight - nCheckDepth)
             break;
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex))
-            return error("%s: *** ReadBlockFromDisk failed at %d, hash=%s", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
+        // check levels 0 (read from disk) and 2 (verify undo validity) are done ahead, in parallel
+        if (nBlock == vBlocks.size()) {
+            vBlocks.clear();
+            nBlock = 0;
+            for (; pindexNextRead && pindexNextRead->pprev && pindexNextRead->nHeight >= chainHeight - nCheckDepth &&
+                   vBlocks.size() < VERIFYDB_READ_AHEAD; pindexNextRead = pindexNextRead->pprev) {
+                vBlocks.emplace_back();
+                vBlocks.back().pindex = pindexNextRead;
+            }
+            VerifyDBReadBlocks(vBlocks, nCheckLevel);
+        }
+        VerifyDBBlock& entry = vBlocks[nBlock++];
+        assert(entry.pindex == pindex);
+        if (!entry.strError.empty())
+            return error("%s: *** %s", __func__, entry.strError);
+        CBlock& block = entry.block;
         // check level 1: verify block validity
         if (nCheckLevel >= 1 && !CheckBlock(block, state))
             return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("%s: *** found bad undo data at %d, hash=%s\n", __func__, pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-        }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
@@ -4035,10 +5052,12 @@ void UnloadBlockIndex()
     LOCK(cs_main);
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    PublishChainTipSnapshot(nullptr);
     pindexBestInvalid = NULL;
     pindexBestHeader = NULL;
     mempool.clear();
     mapBlocksUnlinked.clear();
+    recentBlocks.clear();
     vinfoBlockFile.clear();
     nLastBlockFile = 0;
     nBlockSequenceId = 1;
@@ -4068,22 +5087,43 @@ bool LoadBlockIndex(std::string& strError)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
-
-        // Use the provided setting for -addressindex in the new database
-        fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-        pblocktree->WriteFlag("addressindex", fAddressIndex);
+        // The budget collaterals are indexed from the first block
+        pblocktree->WriteFlag("budgetcollaterals", true);
+    }
+    return true;
+}
 
-        // Use the provided setting for -timestampindex in the new database
-        fTimestampIndex = gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
-        pblocktree->WriteFlag("timestampindex", fTimestampIndex);
+bool InitBudgetCollateralIndex()
+{
+    LOCK(cs_main);
+    bool fIndexed = false;
+    pblocktree->ReadFlag("budgetcollaterals", fIndexed);
+    if (fIndexed || !chainActive.Tip()) {
+        return true;
+    }
 
-        fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
-        pblocktree->WriteFlag("spentindex", fSpentIndex);
+    // The proposals and the finalized budgets still paid have their fee in the last budget cycles
+    const Consensus::Params& consensus = Params().GetConsensus();
+    const int nDepth = (consensus.nMaxProposalPayments + 1) * consensus.nBudgetCycleBlocks + consensus.nBudgetFeeConfirmations;
+    const int nStartHeight = std::max(1, chainActive.Height() - nDepth);
+    LogPrintf("%s: indexing the budget collaterals from block %d\n", __func__, nStartHeight);
+    for (int nHeight = nStartHeight; nHeight <= chainActive.Height(); nHeight++) {
+        if (ShutdownRequested()) return false;
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) continue;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex)) {
+            return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        std::vector<CTransactionRef> vCollaterals;
+        for (const CTransactionRef& tx : block.vtx) {
+            if (IsBudgetCollateralCandidate(*tx)) vCollaterals.push_back(tx);
+        }
+        if (!vCollaterals.empty() && !pblocktree->WriteBudgetCollaterals(pindex->GetBlockHash(), vCollaterals)) {
+            return error("%s: failed to write the budget collateral index", __func__);
+        }
     }
-    return true;
+    return pblocktree->WriteFlag("budgetcollaterals", true);
 }
 
 
@@ -4101,12 +5141,12 @@ bool LoadGenesisBlock()
     try {
         CBlock& block = const_cast<CBlock&>(Params().GenesisBlock());
         // Start new block file
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        CDiskRecord record(block, fBlockCompression);
         CDiskBlockPos blockPos;
         CValidationState state;
-        if (!FindBlockPos(state, blockPos, nBlockSize + 8, 0, block.GetBlockTime()))
+        if (!FindBlockPos(state, blockPos, record.GetDiskSize(), 0, block.GetBlockTime()))
             return error("%s: FindBlockPos failed", __func__);
-        if (!WriteBlockToDisk(block, blockPos))
+        if (!WriteBlockToDisk(record, blockPos))
             return error("%s: writing genesis block to disk failed", __func__);
         CBlockIndex *pindex = AddToBlockIndex(block);
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
@@ -4119,106 +5159,271 @@ bool LoadGenesisBlock()
 }
 
 
+namespace {
+
+/** A block whose parent wasn't known yet when it was read */
+struct UnknownParentBlock {
+    std::shared_ptr<const CBlock> pblock; // null if not kept in memory
+    CDiskBlockPos pos;                    // null if the block has no position
+};
+typedef std::multimap<uint256, UnknownParentBlock> UnknownParentMap;
+
+/**
+ * Deserialize the blocks of a block file, in file order, and call fn with each
+ * of them and its position (if dbp). Stops when fn returns false.
+ */
+void ReadBlocksFromFile(FILE* fileIn, CDiskBlockPos* dbp, const std::function<bool(const std::shared_ptr<CBlock>&)>& fn)
+{
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+    CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        nRewind++;         // start one byte further next time, in case of failure
+        blkdat.SetLimit(); // remove former limit
+        unsigned int nSize = 0;
+        try {
+            // locate a header
+            unsigned char buf[MESSAGE_START_SIZE];
+            blkdat.FindByte(Params().MessageStart()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                continue;
+            // read size
+            blkdat >> nSize;
+            const unsigned int nMinSize = (nSize & DISK_RECORD_COMPRESSED) ? 4 : 80;
+            if ((nSize & ~DISK_RECORD_COMPRESSED) < nMinSize || (nSize & ~DISK_RECORD_COMPRESSED) > MAX_BLOCK_SIZE_CURRENT)
+                continue;
+        } catch (const std::exception&) {
+            // no valid block header found; don't complain
+            break;
+        }
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            if (dbp)
+                dbp->nPos = nBlockPos;
+            blkdat.SetLimit(nBlockPos + (nSize & ~DISK_RECORD_COMPRESSED));
+            blkdat.SetPos(nBlockPos);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            if (nSize & DISK_RECORD_COMPRESSED) {
+                CDataStream ss(SER_DISK, CLIENT_VERSION);
+                ReadCompressedRecord(blkdat, nSize, ss);
+                ss >> *pblock;
+            } else {
+                blkdat >> *pblock;
+            }
+            nRewind = blkdat.GetPos();
+            if (!fn(pblock))
+                break;
+        } catch (const std::exception& e) {
+            LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+}
+
+/**
+ * Process a block read from a block file, then the blocks waiting for it in
+ * mapUnknownParent. Returns false if a system error occurred.
+ */
+bool ProcessBlockFromFile(const std::shared_ptr<const CBlock>& pblock, CDiskBlockPos* dbp, UnknownParentMap& mapUnknownParent, int& nLoaded)
+{
+    // Blocks with unknown parent kept in memory, beyond which only their position is kept
+    static const size_t MAX_UNKNOWN_PARENT_BLOCKS_IN_MEMORY = 1000;
+
+    const CBlock& block = *pblock;
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != Params().GetConsensus().hashGenesisBlock && WITH_LOCK(cs_main, return mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end())) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
+                hash.GetHex(), block.hashPrevBlock.GetHex());
+        UnknownParentBlock entry;
+        if (mapUnknownParent.size() < MAX_UNKNOWN_PARENT_BLOCKS_IN_MEMORY)
+            entry.pblock = pblock;
+        if (dbp)
+            entry.pos = *dbp;
+        if (entry.pblock || dbp)
+            mapUnknownParent.emplace(block.hashPrevBlock, entry);
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    int nKnownHeight = WITH_LOCK(cs_main, {
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        return (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_HAVE_DATA) == 0) ? -1 : mi->second->nHeight;
+    });
+    if (nKnownHeight < 0) {
+        CValidationState state;
+        if (ProcessNewBlock(state, nullptr, pblock, dbp))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != Params().GetConsensus().hashGenesisBlock && nKnownHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), nKnownHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<UnknownParentMap::iterator, UnknownParentMap::iterator> range = mapUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            UnknownParentMap::iterator it = range.first;
+            std::shared_ptr<const CBlock> pchild = it->second.pblock;
+            if (!pchild) {
+                std::shared_ptr<CBlock> pread = std::make_shared<CBlock>();
+                if (ReadBlockFromDisk(*pread, it->second.pos))
+                    pchild = pread;
+            }
+            if (pchild) {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, pchild->GetHash().ToString(),
+                    head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, nullptr, pchild, it->second.pos.IsNull() ? nullptr : &it->second.pos)) {
+                    nLoaded++;
+                    queue.push_back(pchild->GetHash());
+                }
+            }
+            range.first++;
+            mapUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
+
+} // namespace
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    // Blocks with unknown parent (kept across the files of a reindex)
+    static UnknownParentMap mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE_CURRENT, MAX_BLOCK_SIZE_CURRENT + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+        ReadBlocksFromFile(fileIn, dbp, [&](const std::shared_ptr<CBlock>& pblock) {
+            return ProcessBlockFromFile(pblock, dbp, mapBlocksUnknownParent, nLoaded);
+        });
+    } catch (const std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+bool ReindexBlockFiles(int nReaders)
+{
+    assert(nReaders > 0);
+    int64_t nStart = GetTimeMillis();
+
+    typedef std::vector<std::pair<std::shared_ptr<const CBlock>, CDiskBlockPos>> ParsedFile;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    // Files being read or read, not yet processed. Readers are at most nReaders files ahead.
+    std::map<int, ParsedFile> mapFiles;
+    int nNextToRead = 0;
+    int nNextToProcess = 0;
+    int nEndFile = std::numeric_limits<int>::max(); // first missing file
+    std::atomic<bool> fStop{false};
+
+    auto reader = [&]() {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (true) {
+            while (!fStop && nNextToRead < nEndFile && nNextToRead >= nNextToProcess + nReaders) {
+                cond.wait(lock);
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
-                            hash.GetHex(), block.hashPrevBlock.GetHex());
-                    if (dbp)
-                        mapBlocksUnknownParent.emplace(block.hashPrevBlock, *dbp);
-                    continue;
-                }
+            if (fStop || nNextToRead >= nEndFile) return;
+            const int nFile = nNextToRead++;
+            lock.unlock();
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                    if (ProcessNewBlock(state, nullptr, block_ptr, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+            CDiskBlockPos pos(nFile, 0);
+            FILE* file = fs::exists(GetBlockPosFilename(pos, "blk")) ? OpenBlockFile(pos, true) : nullptr;
+            ParsedFile parsed;
+            if (file) {
+                try {
+                    ReadBlocksFromFile(file, &pos, [&](const std::shared_ptr<CBlock>& pblock) {
+                        // the context-free checks, not to be redone by the import thread
+                        PreCheckBlock(*pblock);
+                        parsed.emplace_back(pblock, pos);
+                        return !fStop;
+                    });
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: error reading blk%05u.dat: %s\n", __func__, (unsigned int)nFile, e.what());
                 }
+            }
+            lock.lock();
+            if (!file) {
+                // No block files left to reindex
+                nEndFile = std::min(nEndFile, nFile);
+            } else {
+                mapFiles[nFile] = std::move(parsed);
+            }
+            cond.notify_all();
+        }
+    };
+
+    // Stops and joins the readers however the import thread leaves
+    struct ReaderGroup {
+        boost::mutex& mutex;
+        boost::condition_variable& cond;
+        std::atomic<bool>& fStop;
+        std::vector<boost::thread> vThreads;
+        ~ReaderGroup()
+        {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                fStop = true;
+            }
+            cond.notify_all();
+            for (boost::thread& t : vThreads) {
+                t.join();
+            }
+        }
+    } readers{mutex, cond, fStop, {}};
+    for (int i = 0; i < nReaders; i++) {
+        readers.vThreads.emplace_back([&reader, i]() {
+            util::ThreadRename(strprintf("dogecash-reindex.%i", i));
+            reader();
+        });
+    }
 
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            std::shared_ptr<const CBlock> block_ptr = std::make_shared<const CBlock>(block);
-                            if (ProcessNewBlock(dummy, nullptr, block_ptr, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                    }
-                }
+    UnknownParentMap mapBlocksUnknownParent;
+    int nLoaded = 0;
+    while (true) {
+        ParsedFile vBlocks;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            std::map<int, ParsedFile>::iterator it;
+            while ((it = mapFiles.find(nNextToProcess)) == mapFiles.end() && nNextToProcess < nEndFile) {
+                cond.wait(lock); // interruption point
+            }
+            if (it == mapFiles.end()) break;
+            vBlocks = std::move(it->second);
+            mapFiles.erase(it);
+            nNextToProcess++;
+        }
+        cond.notify_all();
+
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)(nNextToProcess - 1));
+        for (auto& it : vBlocks) {
+            boost::this_thread::interruption_point();
+            try {
+                if (!ProcessBlockFromFile(it.first, &it.second, mapBlocksUnknownParent, nLoaded))
+                    return false;
             } catch (const std::exception& e) {
                 LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
+            it.first.reset();
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
-    return nLoaded > 0;
+    LogPrintf("Reindexed %i blocks from %i block files in %dms\n", nLoaded, nNextToProcess, GetTimeMillis() - nStart);
+    return true;
 }
 
 void static CheckBlockIndex()
@@ -4257,6 +5462,7 @@ void static CheckBlockIndex()
     int nHeight = 0;
     CBlockIndex* pindexFirstInvalid = NULL;         // Oldest ancestor of pindex which is invalid.
     CBlockIndex* pindexFirstMissing = NULL;         // Oldest ancestor of pindex which does not have BLOCK_HAVE_DATA.
+    CBlockIndex* pindexFirstNeverProcessed = NULL;  // Oldest ancestor of pindex for which nTx == 0.
     CBlockIndex* pindexFirstNotTreeValid = NULL;    // Oldest ancestor of pindex which does not have BLOCK_VALID_TREE (regardless of being valid or not).
     CBlockIndex* pindexFirstNotChainValid = NULL;   // Oldest ancestor of pindex which does not have BLOCK_VALID_CHAIN (regardless of being valid or not).
     CBlockIndex* pindexFirstNotScriptsValid = NULL; // Oldest ancestor of pindex which does not have BLOCK_VALID_SCRIPTS (regardless of being valid or not).
@@ -4264,6 +5470,7 @@ void static CheckBlockIndex()
         nNodes++;
         if (pindexFirstInvalid == NULL && pindex->nStatus & BLOCK_FAILED_VALID) pindexFirstInvalid = pindex;
         if (pindexFirstMissing == NULL && !(pindex->nStatus & BLOCK_HAVE_DATA)) pindexFirstMissing = pindex;
+        if (pindexFirstNeverProcessed == NULL && pindex->nTx == 0) pindexFirstNeverProcessed = pindex;
         if (pindex->pprev != NULL && pindexFirstNotTreeValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_TREE) pindexFirstNotTreeValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotChainValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_CHAIN) pindexFirstNotChainValid = pindex;
         if (pindex->pprev != NULL && pindexFirstNotScriptsValid == NULL && (pindex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) pindexFirstNotScriptsValid = pindex;
@@ -4274,12 +5481,21 @@ void static CheckBlockIndex()
             assert(pindex->GetBlockHash() == Params().GetConsensus().hashGenesisBlock); // Genesis block's hash must match.
             assert(pindex == chainActive.Genesis());                       // The current active chain's genesis block must be this block.
         }
-        // HAVE_DATA is equivalent to VALID_TRANSACTIONS and equivalent to nTx > 0 (we stored the number of transactions in the block)
-        assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+        // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
+        // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
+        if (!fHavePruned) {
+            // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
+            assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
+            assert(pindexFirstMissing == pindexFirstNeverProcessed);
+        } else {
+            // If we have pruned, then we can only say that HAVE_DATA implies nTx > 0
+            if (pindex->nStatus & BLOCK_HAVE_DATA) assert(pindex->nTx > 0);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) assert(pindex->nStatus & BLOCK_HAVE_DATA);
         assert(((pindex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS) == (pindex->nTx > 0));
         if (pindex->nChainTx == 0) assert(pindex->nSequenceId == 0); // nSequenceId can't be set for blocks that aren't linked
-        // All parents having data is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
-        assert((pindexFirstMissing != NULL) == (pindex->nChainTx == 0));                                             // nChainTx == 0 is used to signal that all parent block's transaction data is available.
+        // All parents having had data (at some point) is equivalent to all parents being VALID_TRANSACTIONS, which is equivalent to nChainTx being set.
+        assert((pindexFirstNeverProcessed != NULL) == (pindex->nChainTx == 0));                                      // nChainTx != 0 is used to signal that all parent blocks have been processed (but may have been pruned).
         assert(pindex->nHeight == nHeight);                                                                          // nHeight must be consistent.
         assert(pindex->pprev == NULL || pindex->nChainWork >= pindex->pprev->nChainWork);                            // For every block except the genesis block, the chainwork must be larger than the parent's.
         assert(nHeight < 2 || (pindex->pskip && (pindex->pskip->nHeight < nHeight)));                                // The pskip pointer must point back for all but the first 2 blocks.
@@ -4291,9 +5507,18 @@ void static CheckBlockIndex()
             // Checks for not-invalid blocks.
             assert((pindex->nStatus & BLOCK_FAILED_MASK) == 0); // The failed mask cannot be set for blocks without invalid parents.
         }
-        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstMissing == NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block sorts at least as good as the current tip and is valid, it must be in setBlockIndexCandidates.
-                assert(setBlockIndexCandidates.count(pindex));
+        if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && pindexFirstNeverProcessed == NULL) {
+            if (pindexFirstInvalid == NULL) {
+                // If this block sorts at least as good as the current tip and
+                // is valid and we have all data for its parents, it must be in
+                // setBlockIndexCandidates.  chainActive.Tip() must also be there
+                // even if some data has been pruned.
+                if (pindexFirstMissing == NULL || pindex == chainActive.Tip()) {
+                    assert(setBlockIndexCandidates.count(pindex));
+                }
+                // If some parent is missing, then it could be that this block was in
+                // setBlockIndexCandidates but had to be removed because of the missing data.
+                // In this case it must be in mapBlocksUnlinked -- see test below.
             }
         } else { // If this block sorts worse than the current tip, it cannot be in setBlockIndexCandidates.
             assert(setBlockIndexCandidates.count(pindex) == 0);
@@ -4309,12 +5534,28 @@ void static CheckBlockIndex()
             }
             rangeUnlinked.first++;
         }
-        if (pindex->pprev && pindex->nStatus & BLOCK_HAVE_DATA && pindexFirstMissing != NULL) {
-            if (pindexFirstInvalid == NULL) { // If this block has block data available, some parent doesn't, and has no invalid parents, it must be in mapBlocksUnlinked.
-                assert(foundInUnlinked);
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed != NULL && pindexFirstInvalid == NULL) {
+            // If this block has block data available, some parent was never received, and has no invalid parents, it must be in mapBlocksUnlinked.
+            assert(foundInUnlinked);
+        }
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) assert(!foundInUnlinked); // Can't be in mapBlocksUnlinked if we don't HAVE_DATA
+        if (pindexFirstMissing == NULL) assert(!foundInUnlinked);          // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == NULL && pindexFirstMissing != NULL) {
+            // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
+            assert(fHavePruned); // We must have pruned.
+            // This block may have entered mapBlocksUnlinked if:
+            //  - it has a descendant that at some point had more work than the
+            //    tip, and
+            //  - we tried switching to that descendant but were missing
+            //    data for some intermediate block between chainActive and the
+            //    tip.
+            // So if this block is itself better than chainActive.Tip() and it wasn't in
+            // setBlockIndexCandidates, then it must be in mapBlocksUnlinked.
+            if (!CBlockIndexWorkComparator()(pindex, chainActive.Tip()) && setBlockIndexCandidates.count(pindex) == 0) {
+                if (pindexFirstInvalid == NULL) {
+                    assert(foundInUnlinked);
+                }
             }
-        } else { // If this block does not have block data available, or all parents do, it cannot be in mapBlocksUnlinked.
-            assert(!foundInUnlinked);
         }
         // assert(pindex->GetBlockHash() == pindex->GetBlockHeader().GetHash()); // Perhaps too slow
         // End: actual consistency checks.
@@ -4334,6 +5575,7 @@ void static CheckBlockIndex()
             // If pindex was the first with a certain property, unset the corresponding variable.
             if (pindex == pindexFirstInvalid) pindexFirstInvalid = NULL;
             if (pindex == pindexFirstMissing) pindexFirstMissing = NULL;
+            if (pindex == pindexFirstNeverProcessed) pindexFirstNeverProcessed = NULL;
             if (pindex == pindexFirstNotTreeValid) pindexFirstNotTreeValid = NULL;
             if (pindex == pindexFirstNotChainValid) pindexFirstNotChainValid = NULL;
             if (pindex == pindexFirstNotScriptsValid) pindexFirstNotScriptsValid = NULL;
@@ -4388,6 +5630,23 @@ std::string CBlockFileInfo::ToString() const
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+/** Number of transactions of the mempool file pre-checked together, then accepted under a single cs_main lock */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+/** Run PreCheckTransaction on the transactions, spread over up to nScriptCheckThreads threads of the shared worker pool */
+static void PreCheckTransactions(const std::vector<CTransactionRef>& vtx, std::vector<TxPreCheckResult>& vResults)
+{
+    vResults.assign(vtx.size(), TxPreCheckResult());
+    ParallelForEach(vtx.size(), nScriptCheckThreads, [&vtx, &vResults](size_t i) {
+        try {
+            PreCheckTransaction(*vtx[i], vResults[i]);
+        } catch (const std::exception& e) {
+            // leave it to AcceptToMemoryPool
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+    });
+}
+
 bool LoadMempool(CTxMemPool& pool)
 {
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
@@ -4411,31 +5670,57 @@ bool LoadMempool(CTxMemPool& pool)
         }
         uint64_t num;
         file >> num;
+        const uint64_t total = num;
+        pool.SetLoadProgress(0, total);
         double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+        std::vector<CTransactionRef> vtx;
+        std::vector<int64_t> vTime;
+        std::vector<TxPreCheckResult> vPreCheck;
+        while (num) {
+            vtx.clear();
+            vTime.clear();
+            while (num && vtx.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                num--;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+
+                CAmount amountdelta = nFeeDelta;
+                if (amountdelta) {
+                    pool.PrioritiseTransaction(tx->GetHash(), tx->GetHash().ToString(), prioritydummy, amountdelta);
+                }
+                if (nTime + nExpiryTimeout > nNow) {
+                    vtx.push_back(tx);
+                    vTime.push_back(nTime);
+                } else {
+                    ++skipped;
+                }
+            }
+
+            // The signatures and proofs are verified out of cs_main, in parallel
+            const bool fPreCheck = nScriptCheckThreads > 0;
+            if (fPreCheck) {
+                PreCheckTransactions(vtx, vPreCheck);
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+
+            {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(pool, state, tx, true, NULL, nTime);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
+                for (size_t i = 0; i < vtx.size(); i++) {
+                    CValidationState state;
+                    AcceptToMemoryPoolWithTime(pool, state, vtx[i], true, NULL, vTime[i], false, false, false,
+                                               fPreCheck ? &vPreCheck[i] : nullptr);
+                    if (state.IsValid()) {
+                        ++count;
+                    } else {
+                        ++failed;
+                    }
                 }
-            } else {
-                ++skipped;
             }
+            pool.SetLoadProgress(total - num, total);
+
             if (ShutdownRequested())
                 return false;
         }
@@ -4454,7 +5739,7 @@ bool LoadMempool(CTxMemPool& pool)
     return true;
 }
 
-bool DumpMempool(const CTxMemPool& pool)
+bool DumpMempool(const CTxMemPool& pool, bool fOnlyIfChanged)
 {
     int64_t start = GetTimeMicros();
 
@@ -4464,8 +5749,18 @@ bool DumpMempool(const CTxMemPool& pool)
     static Mutex dump_mutex;
     LOCK(dump_mutex);
 
+    // mempool state at the last successful dump
+    static bool fDumped = false;
+    static unsigned int nLastTransactionsUpdated = 0;
+    unsigned int nTransactionsUpdated;
+
     {
         LOCK(pool.cs);
+        nTransactionsUpdated = pool.GetTransactionsUpdated();
+        if (fOnlyIfChanged && fDumped && nTransactionsUpdated == nLastTransactionsUpdated &&
+                fs::exists(GetDataDir() / "mempool.dat")) {
+            return true;
+        }
         for (const auto &i : pool.mapDeltas) {
             mapDeltas[i.first] = i.second.second;
         }
@@ -4505,6 +5800,8 @@ bool DumpMempool(const CTxMemPool& pool)
         LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
         return false;
     }
+    fDumped = true;
+    nLastTransactionsUpdated = nTransactionsUpdated;
     return true;
 }
 
@@ -24,6 +24,7 @@
 #include "fs.h"
 #include "moneysupply.h"
 #include "policy/feerate.h"
+#include "sapling/sapling_validation.h"
 #include "script/script_error.h"
 #include "sync.h"
 #include "txmempool.h"
@@ -31,6 +32,7 @@
 #include <algorithm>
 #include <atomic>
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -43,8 +45,14 @@
 #include <index/addressindex.h>
 #include <index/timestampindex.h>
 
+namespace libzerocoin {
+class CoinSpend;
+}
+
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
+class CCoinsViewWriteBack;
 class CBudgetManager;
 class CZerocoinDB;
 class CSporkDB;
@@ -54,6 +62,7 @@ class CConnman;
 class CNode;
 class CScriptCheck;
 
+struct CDiskTxPos;
 struct PrecomputedTransactionData;
 
 //Setup MN Collateral Change
@@ -73,6 +82,8 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -mempooldumpinterval, in minutes */
+static const int64_t DEFAULT_MEMPOOL_DUMP_INTERVAL = 15;
 /** Default for -limitdescendantcount, max number of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
@@ -84,6 +95,10 @@ static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+static const bool DEFAULT_COINSTATSINDEX = false;
+static const bool DEFAULT_BLOCKSTATSINDEX = false;
+static const bool DEFAULT_COMPACTSAPLINGINDEX = false;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 /** Default for -relaypriority */
 static const bool DEFAULT_RELAYPRIORITY = true;
@@ -94,18 +109,43 @@ static const unsigned int MAX_STANDARD_TX_SIZE = 1000000;
 static const unsigned int MAX_ZEROCOIN_TX_SIZE = 1500000;
 /** Default for -checkblocks */
 static const signed int DEFAULT_CHECKBLOCKS = 10;
+/** Default for -checkblocksbackground */
+static const bool DEFAULT_CHECKBLOCKS_BACKGROUND = false;
+/** Default for -blockindexsnapshot */
+static const bool DEFAULT_BLOCKINDEX_SNAPSHOT = false;
+/** Default for -blockcompression */
+static const bool DEFAULT_BLOCK_COMPRESSION = false;
+/** Default for -reindexthreads, the number of block file reader threads used by -reindex */
+static const int DEFAULT_REINDEX_THREADS = 2;
+/** Maximum number of -reindexthreads */
+static const int MAX_REINDEX_THREADS = 16;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** Default for -blockfilechunksize, the pre-allocation chunk of the blk?????.dat files in MiB (1/16 of it for rev?????.dat) */
+static const unsigned int DEFAULT_BLOCKFILE_CHUNK_MIB = BLOCKFILE_CHUNK_SIZE >> 20;
+/** Minimum number of blocks under the tip whose block and undo files are never pruned */
+static const int MIN_BLOCKS_TO_KEEP = 288;
+/** -undocache default: the last blocks connected kept in memory with their undo data */
+static const int DEFAULT_UNDO_CACHE_BLOCKS = 10;
+/** Minimum -prune target, in bytes: the block files are deleted only down to it */
+static const uint64_t MIN_DISK_SPACE_FOR_BLOCK_FILES = 550 * 1024 * 1024;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Coins missing from the tip cache from which a block or transaction reads them on the prefetch threads */
+static const unsigned int MIN_PREFETCH_COINS = 32;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 512;
+/** Bounds, and initial value, of the per-peer number of blocks in flight, adapted to the peer download speed. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 4;
+static const int DEFAULT_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Time (in seconds) worth of downloads we keep in flight from each peer. */
+static const int64_t BLOCK_DOWNLOAD_TARGET_TIME = 2;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 3;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -114,7 +154,7 @@ static const unsigned int MAX_HEADERS_RESULTS = 2000;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
- *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
+ *  harder). The number of blocks requested from each peer within it adapts to the peer speed. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
@@ -160,9 +200,28 @@ extern int nScriptCheckThreads;
 extern bool fAddressIndex;
 extern bool fSpentIndex;
 extern bool fTimestampIndex;
+extern bool fBlockFilterIndex;
+extern bool fCoinStatsIndex;
+extern bool fBlockStatsIndex;
+extern bool fCompactSaplingIndex;
 extern bool fTxIndex;
 extern bool fCheckBlockIndex;
+/** True if we're running in -prune mode */
+extern bool fPruneMode;
+/** True if any block files have ever been pruned */
+extern bool fHavePruned;
+/** Number of bytes of block and undo files -prune keeps on disk, at least */
+extern uint64_t nPruneTarget;
+/** Pre-allocation chunks of the block and undo files (-blockfilechunksize) */
+extern unsigned int nBlockFileChunkSize;
+extern unsigned int nUndoFileChunkSize;
+/** Whether the blocks and undo data are written compressed to the block and undo files (-blockcompression) */
+extern bool fBlockCompression;
+/** Block hash whose ancestors we will assume to have valid scripts and Sapling proofs without checking them. */
+extern uint256 hashAssumeValid;
 extern size_t nCoinCacheUsage;
+/** Memory usage the coins cache is brought down to (instead of emptied) when it's flushed because it's full */
+extern size_t nCoinCacheRetainUsage;
 extern CFeeRate minRelayTxFee;
 extern int64_t nMaxTipAge;
 extern bool fVerifyingBlocks;
@@ -201,13 +260,38 @@ FILE* OpenBlockFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const CDiskBlockPos& pos, const char* prefix);
+/**
+ * Number of blocks under the tip whose data is never pruned. Besides the reorg
+ * depth, the budget collateral checks look back at the fee transactions of the
+ * proposals still paid, up to nMaxProposalPayments budget cycles.
+ */
+int GetPruneKeepDepth();
+/** Height of the first block of the active chain whose data is still on disk (0 if nothing was pruned) */
+int GetPruneHeight();
+/** Whether the data of the blocks of the active chain from pindex up to the tip is on disk */
+bool HaveBlockDataFrom(const CBlockIndex* pindex);
+/** Delete the block and undo files that aren't referenced by the block index, after a -reindex in prune mode */
+void CleanupBlockRevFiles();
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp = NULL);
+/**
+ * Reindex the blk?????.dat files: nReaders threads read and deserialize the
+ * files ahead and run the context-free block checks, while the calling thread
+ * connects the blocks in file order. Out of order blocks are kept in memory
+ * until their parent is known. Returns false on a system error.
+ */
+bool ReindexBlockFiles(int nReaders);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock();
 /** Load the block tree and coins database from disk,
  * initializing state if we're running with -reindex. */
 bool LoadBlockIndex(std::string& strError);
+/**
+ * Without txindex, index the budget collaterals of the last budget cycles, if
+ * they weren't indexed as the blocks were connected (i.e. the node ran with
+ * txindex before).
+ */
+bool InitBudgetCollateralIndex();
 /** Update the chain tip based on database information. */
 bool LoadChainTip(const CChainParams& chainparams);
 /** Unload database information */
@@ -216,11 +300,25 @@ void UnloadBlockIndex();
 int ActiveProtocol();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the Sapling proof checking thread */
+void ThreadSaplingProofCheck();
+/** Run an instance of the zerocoin spend checking thread */
+void ThreadZerocoinSpendCheck();
+/** Run an instance of the coin prefetch thread */
+void ThreadCoinPrefetch();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256& hash, CTransactionRef& tx, uint256& hashBlock, bool fAllowSlow = false, CBlockIndex* blockIndex = nullptr);
+/**
+ * Retrieve the coin spent by outpoint in the active chain, above pindexFork, from the undo data
+ * of the block spending it: the coin as a block forking at pindexFork sees it, without its
+ * transaction, that may have been pruned. Only looks as deep as the blocks kept by pruning.
+ */
+bool GetCoinSpentAfterFork(const COutPoint& outpoint, const CBlockIndex* pindexFork, Coin& coinOut);
+/** Read the transaction at the position postx of the block files, and the hash of its block */
+bool ReadTxFromDisk(const CDiskTxPos& postx, CTransactionRef& txOut, uint256& hashBlock);
 /** Retrieve an output (from memory pool, or from disk, if possible) */
 bool GetOutput(const uint256& hash, unsigned int index, CValidationState& state, CTxOut& out);
 
@@ -237,13 +335,31 @@ CBlockIndex* InsertBlockIndex(uint256 hash);
 void FlushStateToDisk();
 
 
+/** What PreCheckTransaction did ahead of the AcceptToMemoryPool of a transaction */
+struct TxPreCheckResult {
+    //! The shielded proofs and signatures have been verified, and are valid
+    bool fShieldedProofsChecked{false};
+    //! The coins brought in pcoinsTip by the pre-check, to uncache if the transaction is rejected
+    std::vector<COutPoint> coins_to_uncache;
+};
+
+/**
+ * The expensive part of AcceptToMemoryPool, run without cs_main held: the
+ * context-free checks, then the script checks (caching the valid signatures)
+ * and the shielded proofs checks against a snapshot of the inputs. Nothing is
+ * decided here, AcceptToMemoryPool still validates the transaction against
+ * the current chain and mempool, mostly hitting the signature cache.
+ */
+void PreCheckTransaction(const CTransaction& tx, TxPreCheckResult& result);
+
 /** (try to) add transaction to memory pool **/
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionRef& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionRef& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false,
+                        const TxPreCheckResult* pPreCheck = nullptr);
 
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                                 bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit = false,
-                                bool fRejectInsaneFee = false, bool ignoreFees = false);
+                                bool fRejectInsaneFee = false, bool ignoreFees = false, const TxPreCheckResult* pPreCheck = nullptr);
 
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
@@ -270,13 +386,20 @@ CAmount GetShieldedTxMinFee(const CTransaction& tx);
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. A transaction whose scripts passed with the same flags
+ * before, with cacheFullScriptStore, skips them; without it, the cache entry is used up.
  */
-bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& precomTxData, std::vector<CScriptCheck>* pvChecks = NULL);
+
+/** Initializes the script-execution cache */
+void InitScriptExecutionCache();
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight, bool fSkipInvalid = false);
 
+/** Whether the known invalid outputs are kept out of the UTXO set by the blocks at this height */
+bool SkipInvalidUTXOS(int nHeight);
+
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx, CTransactionRef& tx);
 bool IsTransactionInChain(const uint256& txId, int& nHeightTx);
 bool IsBlockHashInChain(const uint256& hashBlock);
@@ -290,6 +413,8 @@ bool IsBlockHashInChain(const uint256& hashBlock);
  */
 bool CheckFinalTx(const CTransactionRef& tx, int flags = -1);
 
+class CSignatureBatch;
+
 /**
  * Closure representing one script verification
  * Note that this stores references to the spending transaction
@@ -320,6 +445,20 @@ public:
 
     bool operator()();
 
+    /**
+     * Run the scripts, adding the signatures that aren't in the signature
+     * cache to a batch instead of verifying them: they are assumed valid.
+     */
+    bool operator()(CSignatureBatch& batch);
+
+    /**
+     * Run a check queue batch of script checks, verifying their signatures
+     * together once all the scripts have run. If a signature is invalid, or a
+     * script fails (it may have expected a signature to fail), the checks run
+     * again one by one, verifying each signature as its script uses it.
+     */
+    static bool RunBatch(std::vector<CScriptCheck>& vChecks);
+
     void swap(CScriptCheck& check)
     {
         scriptPubKey.swap(check.scriptPubKey);
@@ -335,18 +474,113 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Closure representing the verification of the Sapling spend/output proofs
+ * and signatures of one shielded transaction.
+ * Note that this stores a reference to the transaction
+ */
+class CSaplingProofCheck
+{
+private:
+    const CTransaction* ptx;
+    uint256 dataToBeSigned;
+    SaplingValidation::ProofResult result;
+
+public:
+    CSaplingProofCheck() : ptx(nullptr), result(SaplingValidation::PROOF_OK) {}
+    CSaplingProofCheck(const CTransaction& txIn, const uint256& dataToBeSignedIn) :
+        ptx(&txIn),
+        dataToBeSigned(dataToBeSignedIn),
+        result(SaplingValidation::PROOF_OK) {}
+
+    bool operator()();
+
+    void swap(CSaplingProofCheck& check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(dataToBeSigned, check.dataToBeSigned);
+        std::swap(result, check.result);
+    }
+
+    SaplingValidation::ProofResult GetResult() const { return result; }
+};
+
+/**
+ * Closure representing the contextual checks of one zerocoin spend of a
+ * block (signature, spend type and serial range). The lookup of its serial
+ * in the zerocoin database is left to ConnectBlock.
+ * Note that this stores a reference to the transaction
+ */
+class CZerocoinSpendCheck
+{
+private:
+    const CTransaction* ptx;
+    std::shared_ptr<const libzerocoin::CoinSpend> spend;
+    int nHeight;
+
+public:
+    CZerocoinSpendCheck() : ptx(nullptr), nHeight(0) {}
+    CZerocoinSpendCheck(const CTransaction& txIn, std::shared_ptr<const libzerocoin::CoinSpend> spendIn, int nHeightIn) :
+        ptx(&txIn),
+        spend(std::move(spendIn)),
+        nHeight(nHeightIn) {}
+
+    bool operator()();
+
+    void swap(CZerocoinSpendCheck& check)
+    {
+        std::swap(ptx, check.ptx);
+        std::swap(spend, check.spend);
+        std::swap(nHeight, check.nHeight);
+    }
+};
+
+/**
+ * Read of a coin from the backing view of the tip cache, on a coin prefetch thread
+ */
+class CCoinPrefetch
+{
+private:
+    const CCoinsView* base;
+    COutPoint outpoint;
+    std::pair<bool, Coin>* pResult;
+
+public:
+    CCoinPrefetch() : base(nullptr), pResult(nullptr) {}
+    CCoinPrefetch(const CCoinsView* baseIn, const COutPoint& outpointIn, std::pair<bool, Coin>* pResultIn) :
+        base(baseIn),
+        outpoint(outpointIn),
+        pResult(pResultIn) {}
+
+    bool operator()();
+
+    void swap(CCoinPrefetch& check)
+    {
+        std::swap(base, check.base);
+        std::swap(outpoint, check.outpoint);
+        std::swap(pResult, check.pResult);
+    }
+};
+
 // Address Index
 bool GetTimestampIndex(const unsigned int& high, const unsigned int& low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> >& hashes);
 bool GetSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value);
 bool HashOnchainActive(const uint256& hash);
 bool GetAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+bool GetAddressBalance(uint160 addressHash, int type, CAddressBalance& balance);
+/** Visit the activity of an address in chain order, reading it as it goes (see AddressIndex::ScanAddressIndex) */
+bool ScanAddressIndex(uint160 addressHash, int type, int start, int end, const CAddressIndexPosition* pafter, const std::function<bool(const CAddressIndexKey&, CAmount)>& fn);
 
 
 /** Functions for disk access for blocks */
-bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Read the undo data of a block, with the coins spent by its transactions (empty for the genesis block) */
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Read the serialized block as stored on disk, without deserializing it */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CDiskBlockPos& pos);
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& block, const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -354,6 +588,13 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fCheckSig = true);
 bool CheckWork(const CBlock& block, const CBlockIndex* const pindexPrev);
+/**
+ * Run the expensive context-free part of CheckBlock (proof of work, merkle root and
+ * proof-of-stake block signature) without cs_main, so that it can be done on another
+ * thread while the block waits for its predecessors. Marks the block as pre-checked on
+ * success; a failing block gets the full checks, and the rejection, from CheckBlock.
+ */
+bool PreCheckBlock(const CBlock& block);
 
 /** Context-dependent validity checks */
 bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex* pindexPrev);
@@ -394,6 +635,9 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache* pcoinsTip;
 
+/** Layer below pcoinsTip writing its flushes to the coin database in the background (protected by cs_main) */
+extern CCoinsViewWriteBack* pcoinsWriteBack;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
@@ -404,10 +648,39 @@ extern CZerocoinDB* zerocoinDB;
 extern CSporkDB* pSporkDB;
 
 /**
- * Return a reliable pointer (in mapBlockIndex) to the chain's tip index
+ * Return a reliable pointer (in mapBlockIndex) to the chain's tip index.
+ * Doesn't take cs_main: see CChain::TipSnapshot().
  */
 CBlockIndex* GetChainTip();
 
+/**
+ * An immutable picture of the tip of the active chain, published by UpdateTip.
+ * Tier-two and staking code reads the height and the last hashes from it,
+ * instead of reading chainActive under cs_main.
+ */
+struct CChainTipSnapshot
+{
+    //! How many hashes of the last blocks are kept
+    static const int LAST_HASHES = 200;
+
+    int nHeight{-1};
+    uint256 hash;
+    int64_t nTime{0};
+    //! The hashes of the blocks at nHeight, nHeight - 1, ..., LAST_HASHES of them at most
+    std::vector<uint256> vLastHashes;
+
+    /** The hash of the block at a height, if it's one of the last ones, or null */
+    uint256 GetLastHash(int nBlockHeight) const
+    {
+        const int i = nHeight - nBlockHeight;
+        return (i >= 0 && i < (int)vLastHashes.size()) ? vLastHashes[i] : UINT256_ZERO;
+    }
+};
+typedef std::shared_ptr<const CChainTipSnapshot> ChainTipSnapshotRef;
+
+/** The last tip snapshot, never null (nHeight is -1 before the chain is loaded). Doesn't take cs_main. */
+ChainTipSnapshotRef GetChainTipSnapshot();
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -427,10 +700,13 @@ static const unsigned int REJECT_ALREADY_KNOWN = 0x101;
 /** Transaction conflicts with a transaction already known */
 static const unsigned int REJECT_CONFLICT = 0x102;
 
-/** Dump the mempool to disk. */
-bool DumpMempool(const CTxMemPool& pool);
+/** Dump the mempool to disk. With fOnlyIfChanged, skip it if the mempool didn't change since the last dump. */
+bool DumpMempool(const CTxMemPool& pool, bool fOnlyIfChanged = false);
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk, by batches pre-checked on the script check threads. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the block index to the snapshot file loaded at the next startup (-blockindexsnapshot). */
+bool DumpBlockIndexSnapshot();
+
 #endif // BITCOIN_MAIN_H
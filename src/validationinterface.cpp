@@ -8,54 +8,281 @@
 #include "validationinterface.h"
 #include "scheduler.h"
 #include "txmempool.h"
+#include "util/threadnames.h"
+#include "utiltime.h"
 #include "validation.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <future>
-#include <list>
-#include <unordered_map>
-#include <boost/signals2/signal.hpp>
-
-struct ValidationInterfaceConnections {
-    boost::signals2::scoped_connection UpdatedBlockTip;
-    boost::signals2::scoped_connection TransactionAddedToMempool;
-    boost::signals2::scoped_connection BlockConnected;
-    boost::signals2::scoped_connection BlockDisconnected;
-    boost::signals2::scoped_connection TransactionRemovedFromMempool;
-    boost::signals2::scoped_connection SetBestChain;
-    boost::signals2::scoped_connection Broadcast;
-    boost::signals2::scoped_connection BlockChecked;
+#include <mutex>
+#include <thread>
+
+/**
+ * A multi-producer, single-consumer queue without locks (the node-based queue of
+ * Dmitry Vyukov): a producer links its node at the head with one atomic exchange,
+ * the consumer unlinks from the tail. Between the exchange and the link, the
+ * consumer doesn't see the node yet, and Pop returns false.
+ */
+template <typename T>
+class MPSCQueue
+{
+private:
+    struct Node {
+        std::atomic<Node*> next{nullptr};
+        T value;
+    };
+    std::atomic<Node*> head;
+    //! The node taken last, whose value is already moved out
+    Node* tail;
+
+public:
+    MPSCQueue() : head(new Node()) { tail = head.load(); }
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+    ~MPSCQueue()
+    {
+        while (tail) {
+            Node* next = tail->next.load();
+            delete tail;
+            tail = next;
+        }
+    }
+
+    void Push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    //! Consumer only
+    bool Pop(T& value)
+    {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) return false;
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
 };
 
-struct MainSignalsInstance {
+/**
+ * The queue and thread delivering the callbacks of a CValidationInterface. The producers
+ * count an event before they push it, and take the mutex only to wake the thread up when
+ * the queue was empty: under backpressure, queuing is lock-free.
+ *
+ * A synchronous subscriber has neither: its callbacks run on the signalling thread.
+ */
+class ValidationInterfaceSubscriber : public std::enable_shared_from_this<ValidationInterfaceSubscriber>
+{
+private:
+    struct Event {
+        std::function<void ()> func;
+        int64_t nTimeQueued;
+        //! Queued by CallFunctionInValidationInterfaceQueue: run even if the subscriber stops first
+        bool fBarrier;
+    };
+
+    MPSCQueue<Event> queue;
+    std::atomic<size_t> nPending{0};
+    std::atomic<size_t> nPeakPending{0};
+    std::atomic<uint64_t> nDelivered{0};
+    std::atomic<int64_t> nBusyMicros{0};
+    std::atomic<int64_t> nMaxDelayMicros{0};
+    //! The callbacks running on the signalling threads, that Stop waits for
+    std::atomic<size_t> nInline{0};
+    std::atomic<bool> fStop{false};
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread thread;
+
+    //! The subscriber whose callback runs inline on this thread, which can't stop it
+    static thread_local const ValidationInterfaceSubscriber* pInlineCallee;
+
+    //! Holds a reference to the subscriber (see Start)
+    void Thread()
+    {
+        util::ThreadRename("dogecash-notify." + strName);
+        while (true) {
+            if (nPending == 0) {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return nPending > 0 || fStop; });
+            }
+            if (fStop) break;
+            Event event;
+            // The event is counted before it is linked
+            while (!queue.Pop(event)) {
+                std::this_thread::yield();
+            }
+            const int64_t nStart = GetTimeMicros();
+            const int64_t nDelay = nStart - event.nTimeQueued;
+            int64_t nMax = nMaxDelayMicros;
+            while (nDelay > nMax && !nMaxDelayMicros.compare_exchange_weak(nMax, nDelay)) {}
+            event.func();
+            nBusyMicros += GetTimeMicros() - nStart;
+            nDelivered++;
+            if (nPending.fetch_sub(1) == 1) {
+                // Wake up WaitUntilEmpty
+                std::lock_guard<std::mutex> lock(mutex);
+                cond.notify_all();
+            }
+        }
+        // The callbacks left are dropped, but the barriers. No producer may push a barrier anymore.
+        Event event;
+        while (queue.Pop(event)) {
+            if (event.fBarrier) event.func();
+        }
+    }
+
+public:
+    CValidationInterface* const pif;
+    const std::string strName;
+    const bool fSynchronous;
+
+    ValidationInterfaceSubscriber(CValidationInterface* pifIn, const std::string& strNameIn, bool fSynchronousIn) :
+        pif(pifIn), strName(strNameIn), fSynchronous(fSynchronousIn) {}
+
+    ~ValidationInterfaceSubscriber() { Stop(); }
 
-    /** Notifies listeners of updated block chain tip */
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    /** Notifies listeners of a transaction having been added to mempool. */
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
     /**
-     * Notifies listeners of a block being connected.
-     * Provides a vector of transactions evicted from the mempool as a result.
+     * Start the thread of an asynchronous subscriber. The thread holds a reference to the
+     * subscriber: when a callback unregisters its own subscriber, the thread carries on
+     * until the end of the callback, and releases the subscriber last.
      */
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef> &)> BlockConnected;
-    /** Notifies listeners of a block being disconnected */
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const uint256& blockHash, int nBlockHeight, int64_t blockTime)> BlockDisconnected;
-    /** Notifies listeners of a transaction removal from the mempool */
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    /** Notifies listeners of a new active block chain. */
-    boost::signals2::signal<void (const CBlockLocator &)> SetBestChain;
-    /** Tells listeners to broadcast their data. */
-    boost::signals2::signal<void (CConnman* connman)> Broadcast;
-    /** Notifies listeners of a block validation result */
-    boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
-
-    std::unordered_map<CValidationInterface*, ValidationInterfaceConnections> m_connMainSignals;
-
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    void Start()
+    {
+        if (!fSynchronous) {
+            thread = std::thread(&ValidationInterfaceSubscriber::Thread, shared_from_this());
+        }
+    }
+
+    //! Run func on the calling thread, unless the subscriber is stopped
+    void CallInline(const std::function<void ()>& func)
+    {
+        nInline++;
+        if (!fStop) {
+            const ValidationInterfaceSubscriber* pPrevCallee = pInlineCallee;
+            pInlineCallee = this;
+            const int64_t nStart = GetTimeMicros();
+            func();
+            nBusyMicros += GetTimeMicros() - nStart;
+            nDelivered++;
+            pInlineCallee = pPrevCallee;
+        }
+        if (nInline.fetch_sub(1) == 1 && fStop) {
+            // Wake up Stop
+            std::lock_guard<std::mutex> lock(mutex);
+            cond.notify_all();
+        }
+    }
+
+    void Push(std::function<void ()> func, bool fBarrier = false)
+    {
+        if (fSynchronous) {
+            CallInline(func);
+            return;
+        }
+        const size_t nPrev = nPending.fetch_add(1);
+        size_t nPeak = nPeakPending;
+        while (nPrev + 1 > nPeak && !nPeakPending.compare_exchange_weak(nPeak, nPrev + 1)) {}
+        queue.Push(Event{std::move(func), GetTimeMicros(), fBarrier});
+        if (nPrev == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cond.notify_all();
+        }
+    }
+
+    /**
+     * Stop the thread, after the callback running, and wait for the callbacks running
+     * inline. The callbacks left in the queue are dropped, but the barriers. A callback
+     * delivered inline may not unregister its own subscriber.
+     */
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fStop) return;
+            fStop = true;
+        }
+        cond.notify_all();
+        assert(pInlineCallee != this);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [this] { return nInline == 0; });
+        }
+        if (!thread.joinable()) return;
+        if (thread.get_id() == std::this_thread::get_id()) {
+            // Unregistered by its own callback: the thread holds the subscriber until it returns
+            thread.detach();
+            return;
+        }
+        thread.join();
+    }
+
+    void WaitUntilEmpty()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return nPending == 0 || fStop; });
+    }
+
+    size_t Pending() const { return nPending; }
+
+    ValidationInterfaceQueueStats GetStats() const
+    {
+        return ValidationInterfaceQueueStats{strName, nPending, nPeakPending, nDelivered, nBusyMicros, nMaxDelayMicros};
+    }
+};
+
+thread_local const ValidationInterfaceSubscriber* ValidationInterfaceSubscriber::pInlineCallee = nullptr;
+
+typedef std::vector<std::shared_ptr<ValidationInterfaceSubscriber>> SubscriberList;
+typedef std::shared_ptr<const SubscriberList> SubscriberListRef;
+
+struct MainSignalsInstance {
+    //! Guards the changes of m_subscribers, and the barriers, so that Stop doesn't miss one
+    Mutex m_cs_subscribers;
+    //! Copied on write, read with std::atomic_load by the producers
+    SubscriberListRef m_subscribers;
+
+    //! Runs the functions queued while no subscriber is registered
     SingleThreadedSchedulerClient m_schedulerClient;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_subscribers(std::make_shared<SubscriberList>()), m_schedulerClient(pscheduler) {}
+
+    SubscriberListRef GetSubscribers() const { return std::atomic_load(&m_subscribers); }
+
+    //! Queue func(subscriber) to every subscriber
+    template <typename Callable>
+    void Enqueue(const Callable& func)
+    {
+        const SubscriberListRef subscribers = GetSubscribers();
+        for (const auto& subscriber : *subscribers) {
+            CValidationInterface* pif = subscriber->pif;
+            subscriber->Push([pif, func] { func(pif); });
+        }
+    }
+
+    //! Unregister the subscribers of pif, or all of them
+    void Remove(CValidationInterface* pif)
+    {
+        SubscriberList vRemoved;
+        {
+            LOCK(m_cs_subscribers);
+            auto subscribers = std::make_shared<SubscriberList>();
+            for (const auto& subscriber : *m_subscribers) {
+                (pif && subscriber->pif != pif ? *subscribers : vRemoved).push_back(subscriber);
+            }
+            std::atomic_store(&m_subscribers, SubscriberListRef(subscribers));
+        }
+        // The producers holding the old list may still queue to them, in vain
+        for (const auto& subscriber : vRemoved) {
+            subscriber->Stop();
+        }
+    }
 };
 
 static CMainSignals g_signals;
@@ -66,18 +293,40 @@ void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler& scheduler) {
 }
 
 void CMainSignals::UnregisterBackgroundSignalScheduler() {
+    if (m_internals) {
+        m_internals->Remove(nullptr);
+    }
     m_internals.reset(nullptr);
 }
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
+        const SubscriberListRef subscribers = m_internals->GetSubscribers();
+        for (const auto& subscriber : *subscribers) {
+            subscriber->WaitUntilEmpty();
+        }
         m_internals->m_schedulerClient.EmptyQueue();
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    size_t nPending = 0;
+    const SubscriberListRef subscribers = m_internals->GetSubscribers();
+    for (const auto& subscriber : *subscribers) {
+        nPending = std::max(nPending, subscriber->Pending());
+    }
+    return nPending + m_internals->m_schedulerClient.CallbacksPending();
+}
+
+std::vector<ValidationInterfaceQueueStats> CMainSignals::GetQueueStats() {
+    std::vector<ValidationInterfaceQueueStats> vStats;
+    if (!m_internals) return vStats;
+    const SubscriberListRef subscribers = m_internals->GetSubscribers();
+    for (const auto& subscriber : *subscribers) {
+        vStats.push_back(subscriber->GetStats());
+    }
+    return vStats;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
@@ -93,23 +342,21 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn)
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& strName, bool fSynchronous)
 {
-    ValidationInterfaceConnections& conns = g_signals.m_internals->m_connMainSignals[pwalletIn];
-    conns.UpdatedBlockTip = g_signals.m_internals->UpdatedBlockTip.connect(std::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-    conns.TransactionAddedToMempool = g_signals.m_internals->TransactionAddedToMempool.connect(std::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, std::placeholders::_1));
-    conns.BlockConnected = g_signals.m_internals->BlockConnected.connect(std::bind(&CValidationInterface::BlockConnected, pwalletIn, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-    conns.BlockDisconnected = g_signals.m_internals->BlockDisconnected.connect(std::bind(&CValidationInterface::BlockDisconnected, pwalletIn, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4));
-    conns.TransactionRemovedFromMempool = g_signals.m_internals->TransactionRemovedFromMempool.connect(std::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, std::placeholders::_1));
-    conns.SetBestChain = g_signals.m_internals->SetBestChain.connect(std::bind(&CValidationInterface::SetBestChain, pwalletIn, std::placeholders::_1));
-    conns.Broadcast = g_signals.m_internals->Broadcast.connect(std::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, std::placeholders::_1));
-    conns.BlockChecked = g_signals.m_internals->BlockChecked.connect(std::bind(&CValidationInterface::BlockChecked, pwalletIn, std::placeholders::_1, std::placeholders::_2));
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    auto subscriber = std::make_shared<ValidationInterfaceSubscriber>(pwalletIn, strName, fSynchronous);
+    subscriber->Start();
+    LOCK(internals.m_cs_subscribers);
+    auto subscribers = std::make_shared<SubscriberList>(*internals.m_subscribers);
+    subscribers->push_back(subscriber);
+    std::atomic_store(&internals.m_subscribers, SubscriberListRef(subscribers));
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn)
 {
     if (g_signals.m_internals) {
-        g_signals.m_internals->m_connMainSignals.erase(pwalletIn);
+        g_signals.m_internals->Remove(pwalletIn);
     }
 }
 
@@ -118,11 +365,29 @@ void UnregisterAllValidationInterfaces()
     if (!g_signals.m_internals) {
         return;
     }
-    g_signals.m_internals->m_connMainSignals.clear();
+    g_signals.m_internals->Remove(nullptr);
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_subscribers);
+    // The synchronous subscribers have nothing queued to wait for
+    SubscriberList vQueued;
+    for (const auto& subscriber : *internals.m_subscribers) {
+        if (!subscriber->fSynchronous) vQueued.push_back(subscriber);
+    }
+    if (vQueued.empty()) {
+        internals.m_schedulerClient.AddToProcessQueue(std::move(func));
+        return;
+    }
+    // The last subscriber to reach its barrier runs func
+    auto remaining = std::make_shared<std::atomic<size_t>>(vQueued.size());
+    auto pfunc = std::make_shared<std::function<void ()>>(std::move(func));
+    for (const auto& subscriber : vQueued) {
+        subscriber->Push([remaining, pfunc] {
+            if (--*remaining == 0) (*pfunc)();
+        }, true);
+    }
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -138,10 +403,26 @@ void SyncWithValidationInterfaceQueue() {
     promise.get_future().wait();
 }
 
+void SyncWithValidationInterfaceQueue(CValidationInterface* pif) {
+    AssertLockNotHeld(cs_main);
+    std::promise<void> promise;
+    {
+        MainSignalsInstance& internals = *g_signals.m_internals;
+        LOCK(internals.m_cs_subscribers);
+        auto it = std::find_if(internals.m_subscribers->begin(), internals.m_subscribers->end(),
+            [pif](const std::shared_ptr<ValidationInterfaceSubscriber>& subscriber) { return subscriber->pif == pif; });
+        if (it == internals.m_subscribers->end() || (*it)->Pending() == 0) return;
+        (*it)->Push([&promise] {
+            promise.set_value();
+        }, true);
+    }
+    promise.get_future().wait();
+}
+
 void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx, reason](CValidationInterface* pif) {
+            pif->TransactionRemovedFromMempool(ptx, reason);
         });
     }
 }
@@ -151,39 +432,64 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface* pif) {
+        pif->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface* pif) {
+        pif->TransactionAddedToMempool(ptx);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted](CValidationInterface* pif) {
+        pif->BlockConnected(pblock, pindex, *pvtxConflicted);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, blockHash, nBlockHeight, blockTime, this] {
-        m_internals->BlockDisconnected(pblock, blockHash, nBlockHeight, blockTime);
+    m_internals->Enqueue([pblock, blockHash, nBlockHeight, blockTime](CValidationInterface* pif) {
+        pif->BlockDisconnected(pblock, blockHash, nBlockHeight, blockTime);
     });
 }
 
 void CMainSignals::SetBestChain(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->SetBestChain(locator);
+    // Shared by the subscribers rather than copied to each
+    auto plocator = std::make_shared<const CBlockLocator>(locator);
+    m_internals->Enqueue([plocator](CValidationInterface* pif) {
+        pif->SetBestChain(*plocator);
     });
 }
 
 void CMainSignals::Broadcast(CConnman* connman) {
-    m_internals->Broadcast(connman);
+    const SubscriberListRef subscribers = m_internals->GetSubscribers();
+    for (const auto& subscriber : *subscribers) {
+        CValidationInterface* pif = subscriber->pif;
+        subscriber->CallInline([pif, connman] { pif->ResendWalletTransactions(connman); });
+    }
 }
 
 void CMainSignals::BlockChecked(const CBlock& block, const CValidationState& state) {
-    m_internals->BlockChecked(block, state);
+    const SubscriberListRef subscribers = m_internals->GetSubscribers();
+    for (const auto& subscriber : *subscribers) {
+        CValidationInterface* pif = subscriber->pif;
+        subscriber->CallInline([pif, &block, &state] { pif->BlockChecked(block, state); });
+    }
+}
+
+void CMainSignals::MasternodeListChanged(const COutPoint& collateral, bool fAdded) {
+    // The queue is gone at shutdown, while the masternode list is flushed
+    if (!m_internals) return;
+    m_internals->Enqueue([collateral, fAdded](CValidationInterface* pif) {
+        pif->MasternodeListChanged(collateral, fAdded);
+    });
+}
+
+void CMainSignals::BudgetVoteAccepted(const uint256& nBudgetHash, const COutPoint& voter, int nDirection, bool fFinalized) {
+    if (!m_internals) return;
+    m_internals->Enqueue([nBudgetHash, voter, nDirection, fFinalized](CValidationInterface* pif) {
+        pif->BudgetVoteAccepted(nBudgetHash, voter, nDirection, fFinalized);
+    });
 }
@@ -14,6 +14,8 @@
 
 #include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 class CBlock;
 struct CBlockLocator;
@@ -28,9 +30,22 @@ enum class MemPoolRemovalReason;
 
 // These functions dispatch to one or all registered wallets
 
-/** Register a wallet to receive updates from core */
-void RegisterValidationInterface(CValidationInterface* pwalletIn);
-/** Unregister a wallet from core */
+/**
+ * Register a wallet to receive updates from core. The callbacks are delivered
+ * by a thread of its own, named after strName.
+ *
+ * With fSynchronous, there is no thread: the callbacks run inline on the
+ * signalling thread, with its locks held (cs_main). Only for the short-lived
+ * subscribers with cheap callbacks, e.g. the ones listening to BlockChecked
+ * alone.
+ */
+void RegisterValidationInterface(CValidationInterface* pwalletIn, const std::string& strName = "unnamed", bool fSynchronous = false);
+/**
+ * Unregister a wallet from core. The callbacks not delivered yet are dropped,
+ * and the ones running are waited for: don't call it with locks that a callback
+ * may take held (cs_main). A callback delivered on its subscriber's thread may
+ * unregister it, one delivered inline may not.
+ */
 void UnregisterValidationInterface(CValidationInterface* pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
@@ -54,6 +69,8 @@ void CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
  *     promise.get_future().wait();
  */
 void SyncWithValidationInterfaceQueue();
+/** Block until the callbacks generated prior to now are finished for this subscriber only */
+void SyncWithValidationInterfaceQueue(CValidationInterface* pif);
 
 /**
  * Implement this to subscribe to events generated in validation
@@ -68,7 +85,8 @@ void SyncWithValidationInterfaceQueue();
  * UpdatedBlockTip() callback may depend on an operation performed in
  * the BlockConnected() callback without worrying about explicit
  * synchronization. No ordering should be assumed across
- * ValidationInterface() subscribers.
+ * ValidationInterface() subscribers: each one has its own queue and
+ * thread, so that a slow subscriber doesn't delay the others.
  */
 class CValidationInterface {
 public:
@@ -100,7 +118,7 @@ protected:
      *
      * Called on a background thread.
      */
-    virtual void TransactionRemovedFromMempool(const CTransactionRef &ptx) {}
+    virtual void TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason) {}
     /**
      * Notifies listeners of a block being connected.
      * Provides a vector of transactions evicted from the mempool as a result.
@@ -123,9 +141,36 @@ protected:
     /** Tells listeners to broadcast their data. */
     virtual void ResendWalletTransactions(CConnman* connman) {}
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
-    friend void ::RegisterValidationInterface(CValidationInterface*);
-    friend void ::UnregisterValidationInterface(CValidationInterface*);
-    friend void ::UnregisterAllValidationInterfaces();
+    /**
+     * Notifies listeners of a masternode entering (fAdded) or leaving the
+     * masternode list, by its collateral.
+     *
+     * Called on a background thread.
+     */
+    virtual void MasternodeListChanged(const COutPoint& collateral, bool fAdded) {}
+    /**
+     * Notifies listeners of a budget vote accepted for a proposal, or for a
+     * finalized budget (fFinalized, always a yes vote).
+     *
+     * Called on a background thread.
+     */
+    virtual void BudgetVoteAccepted(const uint256& nBudgetHash, const COutPoint& voter, int nDirection, bool fFinalized) {}
+    friend class CMainSignals;
+};
+
+/** The delivery statistics of a subscriber, since it was registered */
+struct ValidationInterfaceQueueStats
+{
+    std::string strName;
+    //! The callbacks queued and not finished yet
+    size_t nPending;
+    //! The most callbacks that were pending at once
+    size_t nPeakPending;
+    uint64_t nDelivered;
+    //! Time spent in the callbacks
+    int64_t nBusyMicros;
+    //! The longest a callback waited in the queue
+    int64_t nMaxDelayMicros;
 };
 
 struct MainSignalsInstance;
@@ -135,21 +180,28 @@ private:
 
     void MempoolEntryRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
 
-    friend void ::RegisterValidationInterface(CValidationInterface*);
+    friend void ::RegisterValidationInterface(CValidationInterface*, const std::string&, bool);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
     friend void ::CallFunctionInValidationInterfaceQueue(std::function<void ()> func);
+    friend void ::SyncWithValidationInterfaceQueue(CValidationInterface* pif);
 
 public:
-    /** Register a CScheduler to give callbacks which should run in the background (may only be called once) */
+    /**
+     * Register a CScheduler to run the functions queued while no subscriber is registered
+     * (may only be called once): the callbacks run on the threads of the subscribers.
+     */
     void RegisterBackgroundSignalScheduler(CScheduler& scheduler);
-    /** Unregister a CScheduler to give callbacks which should run in the background - these callbacks will now be dropped! */
+    /** Unregister all the subscribers and the CScheduler - the callbacks will now be dropped! */
     void UnregisterBackgroundSignalScheduler();
-    /** Call any remaining callbacks on the calling thread */
+    /** Wait for the subscribers to finish their callbacks, and run the functions left to the scheduler on the calling thread */
     void FlushBackgroundCallbacks();
 
+    /** The callbacks not finished yet by the subscriber with the longest queue */
     size_t CallbacksPending();
 
+    std::vector<ValidationInterfaceQueueStats> GetQueueStats();
+
     /** Register with mempool to call TransactionRemovedFromMempool callbacks */
     void RegisterWithMempoolSignals(CTxMemPool& pool);
     /** Unregister with mempool */
@@ -162,6 +214,8 @@ public:
     void SetBestChain(const CBlockLocator &);
     void Broadcast(CConnman* connman);
     void BlockChecked(const CBlock&, const CValidationState&);
+    void MasternodeListChanged(const COutPoint& collateral, bool fAdded);
+    void BudgetVoteAccepted(const uint256& nBudgetHash, const COutPoint& voter, int nDirection, bool fFinalized);
 };
 
 CMainSignals& GetMainSignals();
@@ -0,0 +1,80 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "validationstats.h"
+
+#include "sync.h"
+
+#include <algorithm>
+
+static const char* const BLOCK_PHASE_NAMES[BLOCK_PHASE_COUNT] = {
+    "read", "checkblock", "pos", "tiertwo", "inputs", "scripts", "sapling", "index", "flush", "total"};
+
+/** The last BLOCK_STATS_WINDOW durations of a phase, the oldest one overwritten */
+struct PhaseWindow {
+    std::vector<int64_t> vSamples;
+    size_t nNext{0};
+    uint64_t nTotal{0};
+    int64_t nTotalTime{0};
+};
+
+static Mutex cs_blockStats;
+static PhaseWindow vPhaseWindows[BLOCK_PHASE_COUNT] GUARDED_BY(cs_blockStats);
+
+void RecordBlockPhase(BlockPhase phase, int64_t nMicros)
+{
+    LOCK(cs_blockStats);
+    PhaseWindow& window = vPhaseWindows[phase];
+    if (window.vSamples.size() < BLOCK_STATS_WINDOW) {
+        window.vSamples.push_back(nMicros);
+    } else {
+        window.vSamples[window.nNext] = nMicros;
+        window.nNext = (window.nNext + 1) % BLOCK_STATS_WINDOW;
+    }
+    window.nTotal++;
+    window.nTotalTime += nMicros;
+}
+
+/** The duration under which the given fraction of the sorted samples are */
+static int64_t Percentile(const std::vector<int64_t>& vSorted, double fraction)
+{
+    size_t nIndex = (size_t)(fraction * vSorted.size());
+    return vSorted[std::min(nIndex, vSorted.size() - 1)];
+}
+
+std::vector<BlockPhaseStats> GetBlockPhaseStats()
+{
+    std::vector<BlockPhaseStats> vStats;
+    for (int i = 0; i < BLOCK_PHASE_COUNT; i++) {
+        std::vector<int64_t> vSorted;
+        BlockPhaseStats stats{BLOCK_PHASE_NAMES[i], 0, 0, 0, 0, 0, 0, 0, 0};
+        {
+            LOCK(cs_blockStats);
+            vSorted = vPhaseWindows[i].vSamples;
+            stats.nTotalSamples = vPhaseWindows[i].nTotal;
+            stats.nTotalTime = vPhaseWindows[i].nTotalTime;
+        }
+        stats.nSamples = vSorted.size();
+        if (!vSorted.empty()) {
+            std::sort(vSorted.begin(), vSorted.end());
+            int64_t nSum = 0;
+            for (int64_t n : vSorted)
+                nSum += n;
+            stats.nAvg = nSum / (int64_t)vSorted.size();
+            stats.nP50 = Percentile(vSorted, 0.5);
+            stats.nP90 = Percentile(vSorted, 0.9);
+            stats.nP99 = Percentile(vSorted, 0.99);
+            stats.nMax = vSorted.back();
+        }
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
+
+void ResetBlockPhaseStats()
+{
+    LOCK(cs_blockStats);
+    for (PhaseWindow& window : vPhaseWindows)
+        window = PhaseWindow();
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_VALIDATIONSTATS_H
+#define DOGEC_VALIDATIONSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** The phases of the validation of a block that are timed */
+enum BlockPhase {
+    BLOCK_PHASE_READ,       //! reading the block from disk, in ConnectTip
+    BLOCK_PHASE_CHECKBLOCK, //! CheckBlock, on acceptance
+    BLOCK_PHASE_POS,        //! the proof of stake check, on acceptance
+    BLOCK_PHASE_TIERTWO,    //! the masternode/budget payee checks
+    BLOCK_PHASE_INPUTS,     //! fetching the coins and the serial checks of the transactions, in ConnectBlock
+    BLOCK_PHASE_SCRIPTS,    //! waiting for the script (and zerocoin spend) check threads
+    BLOCK_PHASE_SAPLING,    //! waiting for the Sapling proof check threads
+    BLOCK_PHASE_INDEX,      //! writing the undo data, zerocoin records and tx index
+    BLOCK_PHASE_FLUSH,      //! flushing the coins to pcoinsTip and the chain state to disk
+    BLOCK_PHASE_TOTAL,      //! the whole ConnectTip
+    BLOCK_PHASE_COUNT
+};
+
+/** The durations kept for each phase: the stats are over the last blocks */
+static const size_t BLOCK_STATS_WINDOW = 1000;
+
+struct BlockPhaseStats {
+    const char* name;
+    //! the durations in the window, and since the start
+    size_t nSamples;
+    uint64_t nTotalSamples;
+    //! in microseconds, the sum of the durations since the start
+    int64_t nTotalTime;
+    //! in microseconds, over the window
+    int64_t nAvg;
+    int64_t nP50;
+    int64_t nP90;
+    int64_t nP99;
+    int64_t nMax;
+};
+
+/** Add the duration of a phase, in microseconds, to its window */
+void RecordBlockPhase(BlockPhase phase, int64_t nMicros);
+
+/** The stats of each phase over its window, in the order of BlockPhase */
+std::vector<BlockPhaseStats> GetBlockPhaseStats();
+
+/** Empty the windows */
+void ResetBlockPhaseStats();
+
+#endif // DOGEC_VALIDATIONSTATS_H
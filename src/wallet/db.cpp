@@ -13,6 +13,7 @@
 #include "hash.h"
 #include "protocol.h"
 #include "util.h"
+#include "util/parallel.h"
 #include "utilstrencodings.h"
 
 #include <stdint.h>
@@ -165,6 +166,9 @@ CDBEnv::VerifyResult CDBEnv::Verify(const std::string& strFile, bool (*recoverFu
     return (fRecovered ? RECOVER_OK : RECOVER_FAIL);
 }
 
+//! Fewer salvaged records per thread aren't worth starting the threads
+static const size_t MIN_SALVAGED_RECORDS_PER_THREAD = 256;
+
 bool CDB::Recover(const std::string& filename, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream ssKey, CDataStream ssValue))
 {
     // Recovery procedure:
@@ -207,15 +211,23 @@ bool CDB::Recover(const std::string& filename, void *callbackDataIn, bool (*reco
         return false;
     }
 
-    DbTxn* ptxn = bitdb.TxnBegin();
-    for (CDBEnv::KeyValPair& row : salvagedData) {
-        if (recoverKVcallback) {
+    // Decode and check the records over up to one thread per core, then write the kept ones in order
+    std::vector<char> vKeep(salvagedData.size(), true);
+    if (recoverKVcallback) {
+        const size_t nWorkers = std::max((size_t) 1, std::min((size_t) GetNumCores(), salvagedData.size() / MIN_SALVAGED_RECORDS_PER_THREAD));
+        ParallelForEach(salvagedData.size(), (int) nWorkers, [&](size_t i) {
+            const CDBEnv::KeyValPair& row = salvagedData[i];
             CDataStream ssKey(row.first, SER_DISK, CLIENT_VERSION);
             CDataStream ssValue(row.second, SER_DISK, CLIENT_VERSION);
-            std::string strType, strErr;
-            if (!(*recoverKVcallback)(callbackDataIn, ssKey, ssValue))
-                continue;
-        }
+            vKeep[i] = (*recoverKVcallback)(callbackDataIn, ssKey, ssValue);
+        });
+    }
+
+    DbTxn* ptxn = bitdb.TxnBegin();
+    for (size_t i = 0; i < salvagedData.size(); i++) {
+        if (!vKeep[i])
+            continue;
+        CDBEnv::KeyValPair& row = salvagedData[i];
         Dbt datKey(&row.first[0], row.first.size());
         Dbt datValue(&row.second[0], row.second.size());
         int ret2 = pdbCopy->put(ptxn, &datKey, &datValue, DB_NOOVERWRITE);
@@ -153,6 +153,8 @@ public:
 
     void Flush();
     void Close();
+    /* Salvage the records of the file into a new one. recoverKVcallback, if any, decides which records
+       are kept; it is called from several threads at once and must be thread safe. */
     static bool Recover(const std::string& filename, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream ssKey, CDataStream ssValue));
 
     /* flush the wallet passively (TRY_LOCK)
@@ -76,6 +76,14 @@ std::string DecodeDumpString(const std::string& str)
     return ret.str();
 }
 
+/** Rescanning from pindex needs the blocks up to the tip: a pruned node may have deleted them */
+static void EnsureRescanPossibleFrom(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!HaveBlockDataFrom(pindex))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan is disabled in pruned mode");
+}
+
 bool IsStakingDerPath(KeyOriginInfo keyOrigin)
 {
     return keyOrigin.path.size() > 3 && keyOrigin.path[3] == (2 | BIP32_HARDENED_KEY_LIMIT);
@@ -121,6 +129,7 @@ UniValue importprivkey(const JSONRPCRequest& request)
     {
         LOCK2(cs_main, pwalletMain->cs_wallet);
         EnsureWalletIsUnlocked();
+        if (fRescan) EnsureRescanPossibleFrom(chainActive.Genesis());
 
         pwalletMain->MarkDirty();
         pwalletMain->SetAddressBook(vchAddress, strLabel, (
@@ -213,6 +222,7 @@ UniValue importaddress(const JSONRPCRequest& request)
     const bool fP2SH = (request.params.size() > 3 ? request.params[3].get_bool() : false);
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
+    if (fRescan) EnsureRescanPossibleFrom(chainActive.Genesis());
 
     bool isStakingAddress = false;
     CTxDestination dest = DecodeDestination(request.params[0].get_str(), isStakingAddress);
@@ -272,6 +282,7 @@ UniValue importpubkey(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Pubkey is not a valid public key");
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
+    if (fRescan) EnsureRescanPossibleFrom(chainActive.Genesis());
 
     ImportAddress(pubKey.GetID(), strLabel, "receive");
     ImportScript(GetScriptForRawPubKey(pubKey), strLabel, false);
@@ -305,6 +316,8 @@ UniValue importwallet(const JSONRPCRequest& request)
             HelpExampleRpc("importwallet", "\"test\""));
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
+    if (fPruneMode)
+        throw JSONRPCError(RPC_WALLET_ERROR, "Importing wallets is disabled in pruned mode");
 
     EnsureWalletIsUnlocked();
 
@@ -685,6 +698,7 @@ UniValue bip38decrypt(const JSONRPCRequest& request)
     result.pushKV("Address", EncodeDestination(pubkey.GetID()));
     CKeyID vchAddress = pubkey.GetID();
     {
+        EnsureRescanPossibleFrom(chainActive.Genesis());
         pwalletMain->MarkDirty();
         pwalletMain->SetAddressBook(vchAddress, "", AddressBook::AddressBookPurpose::RECEIVE);
 
@@ -767,6 +781,7 @@ UniValue importsaplingkey(const JSONRPCRequest& request)
     if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
     }
+    if (fRescan) EnsureRescanPossibleFrom(chainActive[nRescanHeight]);
 
     std::string strSecret = request.params[0].get_str();
     auto spendingkey = KeyIO::DecodeSpendingKey(strSecret);
@@ -861,6 +876,7 @@ UniValue importsaplingviewingkey(const JSONRPCRequest& request)
     if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
     }
+    if (fRescan) EnsureRescanPossibleFrom(chainActive[nRescanHeight]);
 
     std::string strVKey = request.params[0].get_str();
     libzcash::ViewingKey viewingkey = KeyIO::DecodeViewingKey(strVKey);
@@ -18,12 +18,14 @@
 #include "masternode-sync.h"
 #include "net.h"
 #include "policy/feerate.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
 #include "wallet.h"
 #include "walletdb.h"
+#include "wallet/shieldsendqueue.h"
 #include "zdogecchain.h"
 
 #include "sapling/sapling_operation.h"
@@ -881,7 +883,7 @@ UniValue getrawchangeaddress(const JSONRPCRequest& request)
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
     if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+        pwalletMain->GetScriptPubKeyMan()->TopUpBeforeUse(HDChain::ChangeType::INTERNAL);
 
     CReserveKey reservekey(pwalletMain);
     CPubKey vchPubKey;
@@ -960,7 +962,7 @@ void SendMoney(const CTxDestination& address, CAmount nValue, CTransactionRef& t
         throw JSONRPCError(RPC_WALLET_ERROR, res.ToString());
 }
 
-static SaplingOperation CreateShieldedTransaction(const JSONRPCRequest& request);
+static std::unique_ptr<SaplingOperation> CreateShieldedTransaction(const JSONRPCRequest& request);
 
 /*
  * redirect sendtoaddress/sendmany inputs to shieldsendmany implementation (CreateShieldedTransaction)
@@ -990,9 +992,9 @@ static UniValue ShieldSendManyTo(const UniValue& sendTo,
     req.params.push_back(nMinDepth);
 
     // send
-    SaplingOperation operation = CreateShieldedTransaction(req);
+    std::unique_ptr<SaplingOperation> operation = CreateShieldedTransaction(req);
     std::string txid;
-    auto res = operation.send(txid);
+    auto res = operation->send(txid);
     if (!res)
         throw JSONRPCError(RPC_WALLET_ERROR, res.getError());
 
@@ -1517,13 +1519,14 @@ UniValue viewshieldtransaction(const JSONRPCRequest& request)
     return entry;
 }
 
-static SaplingOperation CreateShieldedTransaction(const JSONRPCRequest& request)
+// Parse the request, then select the inputs and lock them in the wallet, under cs_main and cs_wallet
+static std::unique_ptr<SaplingOperation> PrepareShieldedTransaction(const JSONRPCRequest& request)
 {
     EnsureWalletIsUnlocked();
     LOCK2(cs_main, pwalletMain->cs_wallet);
     int nextBlockHeight = chainActive.Height() + 1;
     TransactionBuilder txBuilder = TransactionBuilder(Params().GetConsensus(), nextBlockHeight, pwalletMain);
-    SaplingOperation operation(txBuilder);
+    std::unique_ptr<SaplingOperation> operation = MakeUnique<SaplingOperation>(txBuilder);
 
     // Param 0: source of funds. Can either be a valid address, sapling address,
     // or the string "from_transparent"|"from_trans_cold"|"from_shield"
@@ -1531,13 +1534,13 @@ static SaplingOperation CreateShieldedTransaction(const JSONRPCRequest& request)
     std::string sendFromStr = request.params[0].get_str();
     if (sendFromStr == "from_transparent") {
         // send from any transparent address
-        operation.setSelectTransparentCoins(true);
+        operation->setSelectTransparentCoins(true);
     } else if (sendFromStr == "from_trans_cold") {
         // send from any transparent address + delegations
-        operation.setSelectTransparentCoins(true, true);
+        operation->setSelectTransparentCoins(true, true);
     } else if (sendFromStr == "from_shield") {
         // send from any shield address
-        operation.setSelectShieldedCoins(true);
+        operation->setSelectShieldedCoins(true);
         fromSapling = true;
     } else {
         CTxDestination fromTAddressDest = DecodeDestination(sendFromStr);
@@ -1551,11 +1554,11 @@ static SaplingOperation CreateShieldedTransaction(const JSONRPCRequest& request)
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "From address does not belong to this node, shield addr spending key not found.");
             }
             // send from user-supplied shield address
-            operation.setFromAddress(fromShieldedAddress);
+            operation->setFromAddress(fromShieldedAddress);
             fromSapling = true;
         } else {
             // send from user-supplied transparent address
-            operation.setFromAddress(fromTAddressDest);
+            operation->setFromAddress(fromTAddressDest);
         }
     }
 
@@ -1654,7 +1657,7 @@ static SaplingOperation CreateShieldedTransaction(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid fee. Must be positive.");
         }
         // If the user-selected fee is not enough (or too much), the build operation will fail.
-        operation.setFee(nFee);
+        operation->setFee(nFee);
     }
 
     if (fromSapling && nMinDepth == 0) {
@@ -1665,11 +1668,24 @@ static SaplingOperation CreateShieldedTransaction(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Minconf cannot be negative");
     }
 
-    // Build the send operation
-    OperationResult res = operation.setMinDepth(nMinDepth)
+    // Prepare the send operation
+    OperationResult res = operation->setMinDepth(nMinDepth)
             ->setRecipients(recipients)
-            ->build();
+            ->prepare();
     if (!res) throw JSONRPCError(RPC_WALLET_ERROR, res.getError());
+    // The proofs are generated after releasing the locks: keep the inputs away from the other sends meanwhile
+    operation->lockInputs();
+    return operation;
+}
+
+static std::unique_ptr<SaplingOperation> CreateShieldedTransaction(const JSONRPCRequest& request)
+{
+    std::unique_ptr<SaplingOperation> operation = PrepareShieldedTransaction(request);
+    OperationResult res = operation->prove();
+    if (!res) {
+        WITH_LOCK(pwalletMain->cs_wallet, operation->unlockInputs());
+        throw JSONRPCError(RPC_WALLET_ERROR, res.getError());
+    }
     return operation;
 }
 
@@ -1711,9 +1727,9 @@ UniValue shieldsendmany(const JSONRPCRequest& request)
     // the user could have gotten from another RPC command prior to now
     pwalletMain->BlockUntilSyncedToCurrentChain();
 
-    SaplingOperation operation = CreateShieldedTransaction(request);
+    std::unique_ptr<SaplingOperation> operation = CreateShieldedTransaction(request);
     std::string txHash;
-    auto res = operation.send(txHash);
+    auto res = operation->send(txHash);
     if (!res)
         throw JSONRPCError(RPC_WALLET_ERROR, res.getError());
     return txHash;
@@ -1759,8 +1775,157 @@ UniValue rawshieldsendmany(const JSONRPCRequest& request)
     // the user could have gotten from another RPC command prior to now
     pwalletMain->BlockUntilSyncedToCurrentChain();
 
-    CTransaction tx = CreateShieldedTransaction(request).getFinalTx();
-    return EncodeHexTx(tx);
+    std::unique_ptr<SaplingOperation> operation = CreateShieldedTransaction(request);
+    // not committed, the inputs are free again
+    WITH_LOCK(pwalletMain->cs_wallet, operation->unlockInputs());
+    return EncodeHexTx(operation->getFinalTx());
+}
+
+UniValue shieldsendmanyasync(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 4)
+        throw std::runtime_error(
+                "shieldsendmanyasync \"fromaddress\" [{\"address\":... ,\"amount\":...},...] ( minconf fee )\n"
+                "\nAs shieldsendmany, but returns as soon as the inputs are selected, with an operation id."
+                "\nThe proofs are generated, and the transaction committed, by a background worker (see -shieldsendthreads)."
+                "\nThe selected inputs are locked until then. Use getoperationstatus or getoperationresult to follow it.\n"
+                + HelpRequiringPassphrase() + "\n"
+                "\nArguments:\n"
+                "1. \"fromaddress\"         (string, required) The transparent addr or shield addr to send the funds from.\n"
+                "                             It can also be the string \"from_transparent\"|\"from_shield\" to send the funds\n"
+                "                             from any transparent|shield address available.\n"
+                "                             Additionally, it can be the string \"from_trans_cold\" to select transparent funds,\n"
+                "                             possibly including delegated coins, if needed.\n"
+                "2. \"amounts\"             (array, required) An array of json objects representing the amounts to send.\n"
+                "    [{\n"
+                "      \"address\":address  (string, required) The address is a transparent addr or shield addr\n"
+                "      \"amount\":amount    (numeric, required) The numeric amount in " + "DOGEC" + " is the value\n"
+                "      \"memo\":memo        (string, optional) If the address is a shield addr, message string of max 512 bytes\n"
+                "    }, ... ]\n"
+                "3. minconf               (numeric, optional, default=1) Only use funds confirmed at least this many times.\n"
+                "4. fee                   (numeric, optional), The fee amount to attach to this transaction.\n"
+                "                            If not specified, the wallet will try to compute the minimum possible fee for a shield TX,\n"
+                "                            based on the expected transaction size and the current value of -minRelayTxFee.\n"
+                "\nResult:\n"
+                "\"operationid\"          (string) id of the queued operation\n"
+                "\nExamples:\n"
+                + HelpExampleCli("shieldsendmanyasync",
+                                 "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\" '[{\"address\": \"ps1ra969yfhvhp73rw5ak2xvtcm9fkuqsnmad7qln79mphhdrst3lwu9vvv03yuyqlh42p42st47qd\" ,\"amount\": 5.0}]'")
+                + HelpExampleRpc("shieldsendmanyasync",
+                                 "\"DMJRSsuU9zfyrvxVaAEFQqK4MxZg6vgeS6\", [{\"address\": \"ps1ra969yfhvhp73rw5ak2xvtcm9fkuqsnmad7qln79mphhdrst3lwu9vvv03yuyqlh42p42st47qd\" ,\"amount\": 5.0}]")
+        );
+
+    // Make sure the results are valid at least up to the most recent block
+    // the user could have gotten from another RPC command prior to now
+    pwalletMain->BlockUntilSyncedToCurrentChain();
+
+    std::unique_ptr<SaplingOperation> operation = PrepareShieldedTransaction(request);
+    std::string opid, strError;
+    if (!shieldsendqueue.Push(operation, opid, strError)) {
+        WITH_LOCK(pwalletMain->cs_wallet, operation->unlockInputs());
+        throw JSONRPCError(RPC_WALLET_ERROR, strError);
+    }
+    return opid;
+}
+
+static std::vector<std::string> ParseOperationIds(const UniValue& param)
+{
+    std::vector<std::string> ids;
+    if (param.isNull()) return ids;
+    for (const UniValue& id : param.get_array().getValues()) {
+        ids.emplace_back(id.get_str());
+    }
+    if (ids.empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, operationids array is empty.");
+    }
+    return ids;
+}
+
+static UniValue OperationInfoToJSON(const std::vector<CShieldSendQueue::Info>& vInfo)
+{
+    UniValue ret(UniValue::VARR);
+    for (const CShieldSendQueue::Info& info : vInfo) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("id", info.id);
+        entry.pushKV("status", CShieldSendQueue::StatusToString(info.status));
+        entry.pushKV("creation_time", info.nCreationTime);
+        if (info.nExecutionTime) entry.pushKV("execution_time", info.nExecutionTime);
+        if (info.status == CShieldSendQueue::SUCCESS) entry.pushKV("txid", info.txid);
+        if (info.status == CShieldSendQueue::FAILED) entry.pushKV("error", info.strError);
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
+static const std::string OPERATION_STATUS_RESULT_HELP =
+        "\nResult:\n"
+        "[\n"
+        "  {\n"
+        "    \"id\": \"opid\",               (string) The operation id\n"
+        "    \"status\": \"xxxx\",           (string) queued|executing|success|failed\n"
+        "    \"creation_time\": n,         (numeric) Submission time, in seconds since epoch\n"
+        "    \"execution_time\": n,        (numeric, optional) Time a worker picked it up, in seconds since epoch\n"
+        "    \"txid\": \"hash\",             (string, optional) Transaction hash, when successful\n"
+        "    \"error\": \"msg\",             (string, optional) Error message, when failed\n"
+        "  }\n"
+        "  ,...\n"
+        "]\n";
+
+UniValue getoperationstatus(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+                "getoperationstatus ( [\"operationid\", ... ] )\n"
+                "\nGet the status of the shielded send operations queued by shieldsendmanyasync.\n"
+                "\nArguments:\n"
+                "1. \"operationids\"        (array, optional) A list of operation ids. Default: all the known operations.\n"
+                + OPERATION_STATUS_RESULT_HELP +
+                "\nExamples:\n"
+                + HelpExampleCli("getoperationstatus", "") + HelpExampleRpc("getoperationstatus", ""));
+
+    return OperationInfoToJSON(shieldsendqueue.GetStatus(ParseOperationIds(request.params[0])));
+}
+
+UniValue getoperationresult(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+                "getoperationresult ( [\"operationid\", ... ] )\n"
+                "\nAs getoperationstatus, but the finished (success or failed) operations returned are removed from memory.\n"
+                "\nArguments:\n"
+                "1. \"operationids\"        (array, optional) A list of operation ids. Default: all the known operations.\n"
+                + OPERATION_STATUS_RESULT_HELP +
+                "\nExamples:\n"
+                + HelpExampleCli("getoperationresult", "") + HelpExampleRpc("getoperationresult", ""));
+
+    return OperationInfoToJSON(shieldsendqueue.PopFinished(ParseOperationIds(request.params[0])));
+}
+
+UniValue listoperationids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+                "listoperationids ( \"status\" )\n"
+                "\nList the ids of the shielded send operations known to the node.\n"
+                "\nArguments:\n"
+                "1. \"status\"              (string, optional) Only the operations with this status (queued|executing|success|failed).\n"
+                "\nResult:\n"
+                "[\n"
+                "  \"operationid\"          (string) an operation id\n"
+                "  ,...\n"
+                "]\n"
+                "\nExamples:\n"
+                + HelpExampleCli("listoperationids", "") + HelpExampleCli("listoperationids", "\"success\"")
+                + HelpExampleRpc("listoperationids", ""));
+
+    std::string strStatus = request.params[0].isNull() ? "" : request.params[0].get_str();
+    UniValue ret(UniValue::VARR);
+    for (const CShieldSendQueue::Info& info : shieldsendqueue.GetStatus({})) {
+        if (strStatus.empty() || CShieldSendQueue::StatusToString(info.status) == strStatus) {
+            ret.push_back(info.id);
+        }
+    }
+    return ret;
 }
 
 UniValue listaddressgroupings(const JSONRPCRequest& request)
@@ -2659,40 +2824,31 @@ UniValue listcoldutxos(const JSONRPCRequest& request)
         fExcludeWhitelisted = request.params[0].get_bool();
     UniValue results(UniValue::VARR);
 
-    for (std::map<uint256, CWalletTx>::const_iterator it =
-            pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); ++it) {
-        const uint256& wtxid = it->first;
-        const CWalletTx* pcoin = &(*it).second;
+    for (const COutPoint& outpoint : pwalletMain->GetP2CSOutpoints(fExcludeWhitelisted)) {
+        const uint256& wtxid = outpoint.hash;
+        const CWalletTx* pcoin = &pwalletMain->mapWallet.at(wtxid);
         if (!CheckFinalTx(pcoin->tx) || !pcoin->IsTrusted())
             continue;
 
-        // if this tx has no unspent P2CS outputs for us, skip it
-        if(pcoin->GetColdStakingCredit() == 0 && pcoin->GetStakeDelegationCredit() == 0)
+        const unsigned int i = outpoint.n;
+        const CTxOut& out = pcoin->tx->vout[i];
+        if (pwalletMain->IsSpent(outpoint))
             continue;
-
-        for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-            const CTxOut& out = pcoin->tx->vout[i];
-            isminetype mine = pwalletMain->IsMine(out);
-            if (!bool(mine & ISMINE_COLD) && !bool(mine & ISMINE_SPENDABLE_DELEGATED))
-                continue;
-            txnouttype type;
-            std::vector<CTxDestination> addresses;
-            int nRequired;
-            if (!ExtractDestinations(out.scriptPubKey, type, addresses, nRequired))
-                continue;
-            const bool fWhitelisted = pwalletMain->HasAddressBook(addresses[1]) > 0;
-            if (fExcludeWhitelisted && fWhitelisted)
-                continue;
-            UniValue entry(UniValue::VOBJ);
-            entry.pushKV("txid", wtxid.GetHex());
-            entry.pushKV("txidn", (int)i);
-            entry.pushKV("amount", ValueFromAmount(out.nValue));
-            entry.pushKV("confirmations", pcoin->GetDepthInMainChain());
-            entry.pushKV("cold-staker", EncodeDestination(addresses[0], CChainParams::STAKING_ADDRESS));
-            entry.pushKV("coin-owner", EncodeDestination(addresses[1]));
-            entry.pushKV("whitelisted", fWhitelisted ? "true" : "false");
-            results.push_back(entry);
-        }
+        txnouttype type;
+        std::vector<CTxDestination> addresses;
+        int nRequired;
+        if (!ExtractDestinations(out.scriptPubKey, type, addresses, nRequired))
+            continue;
+        const bool fWhitelisted = pwalletMain->HasAddressBook(addresses[1]) > 0;
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", wtxid.GetHex());
+        entry.pushKV("txidn", (int)i);
+        entry.pushKV("amount", ValueFromAmount(out.nValue));
+        entry.pushKV("confirmations", pcoin->GetDepthInMainChain());
+        entry.pushKV("cold-staker", EncodeDestination(addresses[0], CChainParams::STAKING_ADDRESS));
+        entry.pushKV("coin-owner", EncodeDestination(addresses[1]));
+        entry.pushKV("whitelisted", fWhitelisted ? "true" : "false");
+        results.push_back(entry);
     }
 
     return results;
@@ -2863,6 +3019,17 @@ UniValue listtransactions(const JSONRPCRequest& request)
     if ((nFrom + nCount) > (int)ret.size())
         nCount = ret.size() - nFrom;
 
+    // A long history makes a large result: stream it, without copying the entries
+    if (request.streamResult) {
+        const std::vector<UniValue>& entries = ret.getValues();
+        request.streamResult->BeginArray();
+        for (int i = nFrom + nCount - 1; i >= nFrom; i--) { // Return oldest to newest
+            request.streamResult->Value(entries[i]);
+        }
+        request.streamResult->EndArray();
+        return NullUniValue;
+    }
+
     std::vector<UniValue> arrTmp = ret.getValues();
 
     std::vector<UniValue>::iterator first = arrTmp.begin();
@@ -2957,11 +3124,10 @@ UniValue listsinceblock(const JSONRPCRequest& request)
 
     UniValue transactions(UniValue::VARR);
 
-    for (std::map<uint256, CWalletTx>::iterator it = pwalletMain->mapWallet.begin(); it != pwalletMain->mapWallet.end(); it++) {
-        CWalletTx tx = (*it).second;
-
-        if (depth == -1 || tx.GetDepthInMainChain() < depth)
-            ListTransactions(tx, 0, true, transactions, filter);
+    // Only the transactions above the block (or not in a block), by height
+    for (const CWalletTx* pwtx : pwalletMain->GetWalletTxsSince(pindex ? pindex->nHeight : -1)) {
+        if (depth == -1 || pwtx->GetDepthInMainChain() < depth)
+            ListTransactions(*pwtx, 0, true, transactions, filter);
     }
 
     CBlockIndex* pblockLast = chainActive[chainActive.Height() + 1 - target_confirms];
@@ -3029,9 +3195,14 @@ UniValue gettransaction(const JSONRPCRequest& request)
             filter = filter | ISMINE_WATCH_ONLY;
 
     UniValue entry(UniValue::VOBJ);
-    if (!pwalletMain->mapWallet.count(hash))
+    // Fall back to the archived transactions, read from the database
+    CWalletTx wtxArchived(nullptr, MakeTransactionRef());
+    const CWalletTx* pwtx = pwalletMain->GetWalletTx(hash);
+    if (!pwtx && pwalletMain->GetArchivedTx(hash, wtxArchived))
+        pwtx = &wtxArchived;
+    if (!pwtx)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid or non-wallet transaction id");
-    const CWalletTx& wtx = pwalletMain->mapWallet.at(hash);
+    const CWalletTx& wtx = *pwtx;
 
     CAmount nCredit = wtx.GetCredit(filter);
     CAmount nDebit = wtx.GetDebit(filter);
@@ -3094,6 +3265,38 @@ UniValue abandontransaction(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+UniValue archivewallettxs(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+                "archivewallettxs ( mindepth )\n"
+                "\nMove the transparent wallet transactions whose outputs are all spent, and that are\n"
+                "confirmed (with their spends) at least mindepth blocks deep, to the archived records.\n"
+                "They are kept on disk only: gettransaction still returns them, the other history calls don't.\n"
+                "\nArguments:\n"
+                "1. mindepth    (numeric, optional, default=-walletarchivedepth or " + std::to_string(MIN_WALLET_ARCHIVE_DEPTH) + ") The minimum depth, at least " + std::to_string(MIN_WALLET_ARCHIVE_DEPTH) + "\n"
+                "\nResult:\n"
+                "n    (numeric) The number of transactions archived\n"
+                "\nExamples:\n"
+                + HelpExampleCli("archivewallettxs", "")
+                + HelpExampleCli("archivewallettxs", "5000")
+                + HelpExampleRpc("archivewallettxs", "5000")
+        );
+
+    EnsureWallet();
+
+    int nMinDepth = gArgs.GetArg("-walletarchivedepth", DEFAULT_WALLET_ARCHIVE_DEPTH);
+    if (nMinDepth <= 0) nMinDepth = MIN_WALLET_ARCHIVE_DEPTH;
+    if (request.params.size() > 0)
+        nMinDepth = request.params[0].get_int();
+    if (nMinDepth < MIN_WALLET_ARCHIVE_DEPTH)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("mindepth must be at least %d", MIN_WALLET_ARCHIVE_DEPTH));
+
+    pwalletMain->BlockUntilSyncedToCurrentChain();
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    return pwalletMain->ArchiveWalletTxs(nMinDepth);
+}
 
 UniValue backupwallet(const JSONRPCRequest& request)
 {
@@ -3730,6 +3933,13 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"paytxfee\": x.xxxx                       (numeric) the transaction fee configuration, set in DOGEC/kB\n"
             "  \"hdseedid\": \"<hash160>\"                (string, optional) the Hash160 of the HD seed (only present when HD is enabled)\n"
             "  \"last_processed_block\": xxxxx,          (numeric) the last block processed block height\n"
+            "  \"scanning\":                            (json object) current scanning details, or false if no scan is in progress\n"
+            "    {\n"
+            "      \"duration\" : xxxx                    (numeric) elapsed seconds since scan start\n"
+            "      \"progress\" : x.xxxx,                 (numeric) scanning progress percentage [0.0, 1.0]\n"
+            "      \"blocks\" : xxxx,                     (numeric) number of blocks scanned so far\n"
+            "      \"blocks_per_second\" : x.xx           (numeric) average scanning throughput\n"
+            "    }\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -3772,6 +3982,18 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
         obj.pushKV("unlocked_until", nWalletUnlockTime);
     obj.pushKV("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK()));
     obj.pushKV("last_processed_block", pwalletMain->GetLastBlockHeight());
+    if (pwalletMain->IsScanning()) {
+        UniValue scanning(UniValue::VOBJ);
+        const int64_t nDuration = pwalletMain->ScanningDuration();
+        const int64_t nBlocks = pwalletMain->ScanningBlocks();
+        scanning.pushKV("duration", nDuration / 1000);
+        scanning.pushKV("progress", pwalletMain->ScanningProgress());
+        scanning.pushKV("blocks", nBlocks);
+        scanning.pushKV("blocks_per_second", nDuration > 0 ? 1000.0 * nBlocks / nDuration : 0.0);
+        obj.pushKV("scanning", scanning);
+    } else {
+        obj.pushKV("scanning", false);
+    }
     return obj;
 }
 
@@ -3798,6 +4020,16 @@ UniValue getstakingstatus(const JSONRPCRequest& request)
             "  \"lastattempt_hash\": xxx            (hex string) hash of the block on top of which the last stake attempt was made\n"
             "  \"lastattempt_coins\": n             (numeric) number of stakeable coins available during last stake attempt\n"
             "  \"lastattempt_tries\": n             (numeric) number of stakeable coins checked during last stake attempt\n"
+            "  \"lastattempt_timings\": {           (json object) time spent, in microseconds, in the last run of each step\n"
+            "     \"refreshcoins\": n,              (numeric) listing the stakeable coins\n"
+            "     \"kernelsearch\": n,              (numeric) hashing the kernels of the coins\n"
+            "     \"template\": n,                  (numeric) building the rest of the block (last block found)\n"
+            "     \"signing\": n,                   (numeric) signing the coinstake and the block (last block found)\n"
+            "     \"processblock\": n               (numeric) processing the block found (last block found)\n"
+            "  }\n"
+            "  \"kernels_per_second\": n            (numeric) kernels hashed per second during the last stake attempt\n"
+            "  \"missed_slots\": n                  (numeric) time slots skipped between two stake attempts, since the start\n"
+            "  \"stale_tips\": n                    (numeric) stake attempts aborted because a new block came in, since the start\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -3828,6 +4060,16 @@ UniValue getstakingstatus(const JSONRPCRequest& request)
             obj.pushKV("lastattempt_hash", ss->GetLastHash().GetHex());
             obj.pushKV("lastattempt_coins", ss->GetLastCoins());
             obj.pushKV("lastattempt_tries", ss->GetLastTries());
+            UniValue timings(UniValue::VOBJ);
+            timings.pushKV("refreshcoins", ss->GetRefreshTime());
+            timings.pushKV("kernelsearch", ss->GetKernelTime());
+            timings.pushKV("template", ss->GetTemplateTime());
+            timings.pushKV("signing", ss->GetSignTime());
+            timings.pushKV("processblock", ss->GetProcessTime());
+            obj.pushKV("lastattempt_timings", timings);
+            obj.pushKV("kernels_per_second", ss->GetKernelRate());
+            obj.pushKV("missed_slots", ss->GetMissedSlots());
+            obj.pushKV("stale_tips", ss->GetStaleTips());
         }
         return obj;
     }
@@ -3922,8 +4164,7 @@ UniValue autocombinerewards(const JSONRPCRequest& request)
     if (fEnable)
         nThreshold = request.params[1].get_int();
 
-    pwalletMain->fCombineDust = fEnable;
-    pwalletMain->nAutoCombineThreshold = nThreshold;
+    pwalletMain->SetAutoCombineSettings(fEnable, nThreshold);
 
     if (!walletdb.WriteAutoCombineSettings(fEnable, nThreshold))
         throw std::runtime_error("Changed settings in wallet but failed to save to database\n");
@@ -4208,6 +4449,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "getaddressinfo",           &getaddressinfo,           true  },
     { "wallet",             "autocombinerewards",       &autocombinerewards,       false },
     { "wallet",             "abandontransaction",       &abandontransaction,       false },
+    { "wallet",             "archivewallettxs",         &archivewallettxs,         false },
     { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true  },
     { "wallet",             "backupwallet",             &backupwallet,             true  },
     { "wallet",             "delegatestake",            &delegatestake,            false },
@@ -4269,6 +4511,10 @@ static const CRPCCommand commands[] =
     { "wallet",             "listshieldunspent",             &listshieldunspent,              false },
     { "wallet",             "rawshieldsendmany",             &rawshieldsendmany,              false },
     { "wallet",             "shieldsendmany",                &shieldsendmany,                 false },
+    { "wallet",             "shieldsendmanyasync",           &shieldsendmanyasync,            false },
+    { "wallet",             "getoperationstatus",            &getoperationstatus,             true  },
+    { "wallet",             "getoperationresult",            &getoperationresult,             true  },
+    { "wallet",             "listoperationids",              &listoperationids,               true  },
     { "wallet",             "listreceivedbyshieldaddress",   &listreceivedbyshieldaddress,    false },
     { "wallet",             "viewshieldtransaction",         &viewshieldtransaction,          false },
     { "wallet",             "getsaplingnotescount",          &getsaplingnotescount,           false },
@@ -7,7 +7,25 @@
 
 #include "wallet/scriptpubkeyman.h"
 #include "crypter.h"
+#include "random.h"
 #include "script/standard.h"
+#include "util/threadnames.h"
+
+#include <boost/thread.hpp>
+
+SaltedScriptHasher::SaltedScriptHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+// m/44'/119'/0'/change' of the seed, and the id of the master key
+static void DeriveChangeKey(const CKey& seed, const uint8_t& changeType, CExtKey& changeKey, CKeyID& masterId)
+{
+    CExtKey masterKey, purposeKey, cointypeKey, accountKey;
+    masterKey.SetSeed(seed.begin(), seed.size());
+    masterKey.Derive(purposeKey, 44 | BIP32_HARDENED_KEY_LIMIT);
+    purposeKey.Derive(cointypeKey, 119 | BIP32_HARDENED_KEY_LIMIT);
+    cointypeKey.Derive(accountKey, 0 | BIP32_HARDENED_KEY_LIMIT);
+    accountKey.Derive(changeKey, changeType | BIP32_HARDENED_KEY_LIMIT);
+    masterId = masterKey.key.GetPubKey().GetID();
+}
 
 bool ScriptPubKeyMan::SetupGeneration(bool newKeypool, bool force, bool memOnly)
 {
@@ -234,6 +252,8 @@ void ScriptPubKeyMan::KeepDestination(int64_t nIndex)
     assert(have_pk);
     m_index_to_reserved_key.erase(nIndex);
     LogPrintf("keypool keep %d\n", nIndex);
+    // Replace the key in the background
+    RequestTopUp();
 }
 
 void ScriptPubKeyMan::ReturnDestination(int64_t nIndex, const uint8_t& type, const CTxDestination&)
@@ -300,13 +320,56 @@ void ScriptPubKeyMan::MarkUnusedAddresses(const CScript& script)
             LogPrintf("%s: Detected a used keypool key, mark all keypool key up to this key as used\n", __func__);
             MarkReserveKeysAsUsed(mi->second);
 
-            if (!TopUp()) {
+            if (!RequestTopUp() && !TopUp()) {
                 LogPrintf("%s: Topping up keypool failed (locked wallet)\n", __func__);
             }
         }
     }
 }
 
+//! P2PKH or P2PK
+static bool IsPayToKey(const CScript& script)
+{
+    if (script.IsPayToPublicKeyHash()) return true;
+    return (script.size() == CPubKey::COMPRESSED_PUBLIC_KEY_SIZE + 2 || script.size() == CPubKey::PUBLIC_KEY_SIZE + 2) &&
+            script[0] == script.size() - 2 && script.back() == OP_CHECKSIG;
+}
+
+isminetype ScriptPubKeyMan::IsMine(const CScript& script) const
+{
+    {
+        LOCK(wallet->cs_KeyStore);
+        const auto it = mapOwnedScripts.find(script);
+        if (it != mapOwnedScripts.end()) return it->second;
+    }
+    // P2CS, P2SH and multisig depend on the combination of the keys in them
+    return IsPayToKey(script) ? ISMINE_NO : ::IsMine(*wallet, script);
+}
+
+void ScriptPubKeyMan::AddOwnedKey(const CPubKey& pubkey)
+{
+    LOCK(wallet->cs_KeyStore);
+    // A key takes precedence over the watch-only scripts
+    mapOwnedScripts[GetScriptForDestination(pubkey.GetID())] = ISMINE_SPENDABLE;
+    mapOwnedScripts[GetScriptForRawPubKey(pubkey)] = ISMINE_SPENDABLE;
+}
+
+void ScriptPubKeyMan::AddOwnedWatchOnly(const CScript& script)
+{
+    if (!IsPayToKey(script)) return;
+    LOCK(wallet->cs_KeyStore);
+    mapOwnedScripts.emplace(script, ISMINE_WATCH_ONLY);
+}
+
+void ScriptPubKeyMan::RemoveOwnedWatchOnly(const CScript& script)
+{
+    LOCK(wallet->cs_KeyStore);
+    const auto it = mapOwnedScripts.find(script);
+    if (it != mapOwnedScripts.end() && it->second == ISMINE_WATCH_ONLY) {
+        mapOwnedScripts.erase(it);
+    }
+}
+
 void ScriptPubKeyMan::MarkPreSplitKeys()
 {
     CWalletDB batch(wallet->GetDBHandle());
@@ -377,23 +440,8 @@ bool ScriptPubKeyMan::TopUp(unsigned int kpSize)
         if (wallet->IsLocked()) return false;
 
         // Top up key pool
-        unsigned int nTargetSize;
-        if (kpSize > 0)
-            nTargetSize = kpSize;
-        else
-            nTargetSize = std::max(gArgs.GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
-
-        // Count amount of available keys (internal, external)
-        // make sure the keypool of external and internal keys fits the user selected target (-keypool)
-        int64_t missingExternal = std::max(std::max((int64_t) nTargetSize, (int64_t) 1) - (int64_t)setExternalKeyPool.size(), (int64_t) 0);
-        int64_t missingInternal = std::max(std::max((int64_t) nTargetSize, (int64_t) 1) - (int64_t)setInternalKeyPool.size(), (int64_t) 0);
-        int64_t missingStaking = std::max(std::max((int64_t) nTargetSize, (int64_t) 1) - (int64_t)setStakingKeyPool.size(), (int64_t) 0);
-
-        if (!IsHDEnabled()) {
-            // don't create extra internal or staking keys
-            missingInternal = 0;
-            missingStaking = 0;
-        }
+        int64_t missingExternal, missingInternal, missingStaking;
+        GetMissingKeys(kpSize, missingExternal, missingInternal, missingStaking);
 
         CWalletDB batch(wallet->GetDBHandle());
         GeneratePool(batch, missingExternal, HDChain::ChangeType::EXTERNAL);
@@ -412,6 +460,181 @@ bool ScriptPubKeyMan::TopUp(unsigned int kpSize)
     return true;
 }
 
+void ScriptPubKeyMan::GetMissingKeys(unsigned int kpSize, int64_t& missingExternal, int64_t& missingInternal, int64_t& missingStaking) const
+{
+    AssertLockHeld(wallet->cs_wallet);
+    unsigned int nTargetSize;
+    if (kpSize > 0)
+        nTargetSize = kpSize;
+    else
+        nTargetSize = std::max(gArgs.GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
+
+    // Count amount of available keys (internal, external)
+    // make sure the keypool of external and internal keys fits the user selected target (-keypool)
+    missingExternal = std::max(std::max((int64_t) nTargetSize, (int64_t) 1) - (int64_t)setExternalKeyPool.size(), (int64_t) 0);
+    missingInternal = std::max(std::max((int64_t) nTargetSize, (int64_t) 1) - (int64_t)setInternalKeyPool.size(), (int64_t) 0);
+    missingStaking = std::max(std::max((int64_t) nTargetSize, (int64_t) 1) - (int64_t)setStakingKeyPool.size(), (int64_t) 0);
+
+    if (!IsHDEnabled()) {
+        // don't create extra internal or staking keys
+        missingInternal = 0;
+        missingStaking = 0;
+    }
+}
+
+bool ScriptPubKeyMan::TopUpUnlocked(unsigned int kpSize)
+{
+    if (!CanGenerateKeys()) {
+        return false;
+    }
+
+    static const uint8_t types[] = {HDChain::ChangeType::EXTERNAL, HDChain::ChangeType::INTERNAL, HDChain::ChangeType::STAKING};
+    int64_t missing[3];
+    uint32_t counters[3];
+    CKey seed;
+    CKeyID seedId;
+    {
+        LOCK(wallet->cs_wallet);
+        if (wallet->IsLocked()) return false;
+        // Without HD the keys are random, nothing to derive
+        if (!IsHDEnabled()) return TopUp(kpSize);
+
+        GetMissingKeys(kpSize, missing[0], missing[1], missing[2]);
+        if (missing[0] + missing[1] + missing[2] == 0) return true;
+        seedId = hdChain.GetID();
+        if (!wallet->GetKey(seedId, seed))
+            throw std::runtime_error(std::string(__func__) + ": seed not found");
+        for (int i = 0; i < 3; i++) counters[i] = hdChain.GetChainCounter(types[i]);
+    }
+
+    // Derive the keys, without any lock
+    struct DerivedKey {
+        CKey secret;
+        CPubKey pubkey;
+        CKeyMetadata metadata;
+    };
+    std::vector<DerivedKey> vKeys[3];
+    const int64_t nCreationTime = GetTime();
+    for (int i = 0; i < 3; i++) {
+        if (missing[i] == 0) continue;
+        CExtKey changeKey;
+        CKeyID masterId;
+        DeriveChangeKey(seed, types[i], changeKey, masterId);
+        for (int64_t n = 0; n < missing[i]; n++) {
+            const uint32_t nChild = counters[i] + n;
+            CExtKey childKey;
+            changeKey.Derive(childKey, nChild | BIP32_HARDENED_KEY_LIMIT);
+            DerivedKey key{childKey.key, childKey.key.GetPubKey(), CKeyMetadata(nCreationTime)};
+            assert(key.secret.VerifyPubKey(key.pubkey));
+            key.metadata.key_origin.path = {44 | BIP32_HARDENED_KEY_LIMIT, 119 | BIP32_HARDENED_KEY_LIMIT, BIP32_HARDENED_KEY_LIMIT,
+                                            types[i] | BIP32_HARDENED_KEY_LIMIT, nChild | BIP32_HARDENED_KEY_LIMIT};
+            key.metadata.hd_seed_id = seedId;
+            std::copy(masterId.begin(), masterId.begin() + 4, key.metadata.key_origin.fingerprint);
+            vKeys[i].emplace_back(std::move(key));
+        }
+    }
+
+    // Store them, up to what is still missing
+    {
+        LOCK(wallet->cs_wallet);
+        if (wallet->IsLocked() || !IsHDEnabled() || hdChain.GetID() != seedId) return false;
+        GetMissingKeys(kpSize, missing[0], missing[1], missing[2]);
+
+        CWalletDB batch(wallet->GetDBHandle());
+        bool fChainChanged = false;
+        int64_t nAdded[3] = {0, 0, 0};
+        for (int i = 0; i < 3; i++) {
+            uint32_t& chainCounter = hdChain.GetChainCounter(types[i]);
+            if (chainCounter != counters[i]) continue;
+            for (const DerivedKey& key : vKeys[i]) {
+                if (nAdded[i] >= missing[i]) break;
+                chainCounter++;
+                fChainChanged = true;
+                // skip keys already known to the wallet
+                if (wallet->HaveKey(key.pubkey.GetID())) continue;
+                wallet->mapKeyMetadata[key.pubkey.GetID()] = key.metadata;
+                UpdateTimeFirstKey(nCreationTime);
+                if (!AddKeyPubKeyWithDB(batch, key.secret, key.pubkey)) {
+                    throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+                }
+                AddKeypoolPubkeyWithDB(key.pubkey, types[i], batch);
+                nAdded[i]++;
+            }
+        }
+        // update the chain model in the database
+        if (fChainChanged && !batch.WriteHDChain(hdChain))
+            throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
+
+        if (nAdded[0] + nAdded[1] + nAdded[2] > 0) {
+            LogPrintf("keypool added %d keys (%d internal, %d staking), size=%u (%u internal, %u staking)\n",
+                      nAdded[0] + nAdded[1] + nAdded[2], nAdded[1], nAdded[2],
+                      setInternalKeyPool.size() + setExternalKeyPool.size() + set_pre_split_keypool.size(), setInternalKeyPool.size(), setStakingKeyPool.size());
+        }
+    }
+    return true;
+}
+
+bool ScriptPubKeyMan::TopUpBeforeUse(const uint8_t& type)
+{
+    if (fTopUpThread) {
+        LOCK(wallet->cs_wallet);
+        // The pool ReserveKeyFromKeyPool draws from
+        const bool isHDEnabled = IsHDEnabled();
+        const std::set<int64_t>& setKeyPool = !set_pre_split_keypool.empty() ? set_pre_split_keypool :
+                ((isHDEnabled && type == HDChain::ChangeType::INTERNAL) ? setInternalKeyPool :
+                ((isHDEnabled && type == HDChain::ChangeType::STAKING) ? setStakingKeyPool : setExternalKeyPool));
+        if (!setKeyPool.empty()) return true;
+    }
+    return TopUp();
+}
+
+bool ScriptPubKeyMan::RequestTopUp()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutexTopUp);
+        if (!fTopUpThread) return false;
+        fTopUpRequested = true;
+    }
+    condTopUp.notify_one();
+    return true;
+}
+
+void ScriptPubKeyMan::ThreadTopUp()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutexTopUp);
+        fTopUpThread = true;
+        fTopUpRequested = true; // fill the pool at startup
+    }
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutexTopUp);
+                while (!fTopUpRequested) {
+                    condTopUp.wait(lock); // interruption point
+                }
+                fTopUpRequested = false;
+            }
+            try {
+                TopUpUnlocked();
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+            }
+            boost::this_thread::interruption_point();
+        }
+    } catch (const boost::thread_interrupted&) {
+        boost::unique_lock<boost::mutex> lock(mutexTopUp);
+        fTopUpThread = false;
+        throw;
+    }
+}
+
+void ThreadKeyPoolTopUp()
+{
+    util::ThreadRename("dogecash-keypool");
+    pwalletMain->GetScriptPubKeyMan()->ThreadTopUp();
+}
+
 void ScriptPubKeyMan::GeneratePool(CWalletDB& batch, int64_t targetSize, const uint8_t& type)
 {
     for (int64_t i = targetSize; i--;) {
@@ -8,14 +8,37 @@
 #ifndef DOGEC_SCRIPTPUBKEYMAN_H
 #define DOGEC_SCRIPTPUBKEYMAN_H
 
+#include "hash.h"
 #include "wallet/hdchain.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 
+#include <atomic>
+#include <unordered_map>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 //! Default for -keypool
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 100;
+//! Default for -keypoolthread
+static const bool DEFAULT_KEYPOOL_THREAD = true;
 static const uint32_t BIP32_HARDENED_KEY_LIMIT = 0x80000000;
 
+class SaltedScriptHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedScriptHasher();
+
+    size_t operator()(const CScript& script) const {
+        return CSipHasher(k0, k1).Write(script.data(), script.size()).Finalize();
+    }
+};
+
 /*
  * A class implementing ScriptPubKeyMan manages some (or all) scriptPubKeys used in a wallet.
  * It contains the scripts and keys related to the scriptPubKeys it manages.
@@ -88,9 +111,32 @@ public:
       */
     bool TopUp(unsigned int size = 0);
 
+    /** TopUp for HD wallets deriving the keys without holding cs_wallet, which is only locked to
+      * read the chain counters and then to store the keys. A batch raced by a key derived in
+      * the meantime (GenerateNewKey) is dropped, to be derived again at the next call.
+      */
+    bool TopUpUnlocked(unsigned int size = 0);
+    //! Whether ThreadTopUp is running, keeping the pool full after every key taken out of it
+    bool HasTopUpThread() const { return fTopUpThread; }
+    /** Fill the pool before a key of the given type is taken out of it, unless ThreadTopUp is
+      * running and the pool still has one: the thread replaces it once kept (KeepDestination).
+      */
+    bool TopUpBeforeUse(const uint8_t& type);
+    //! Wake up ThreadTopUp, returns false if it isn't running
+    bool RequestTopUp();
+    //! Background top-up loop, exits when the thread is interrupted
+    void ThreadTopUp();
+
     //! Mark unused addresses as being used
     void MarkUnusedAddresses(const CScript& script);
 
+    //! IsMine with a single lookup for the P2PK and P2PKH scripts, solving the other types
+    isminetype IsMine(const CScript& script) const;
+    //! Keep the owned scriptPubKeys in sync with the keys and the watch-only scripts of the wallet
+    void AddOwnedKey(const CPubKey& pubkey);
+    void AddOwnedWatchOnly(const CScript& script);
+    void RemoveOwnedWatchOnly(const CScript& script);
+
     //! First wallet key time
     void UpdateTimeFirstKey(int64_t nCreateTime);
     //! Generate a new key
@@ -143,6 +189,20 @@ private:
     // Tracks keypool indexes to CKeyIDs of keys that have been taken out of the keypool but may be returned to it
     std::map<int64_t, CKeyID> m_index_to_reserved_key;
 
+    /* The P2PK and P2PKH scriptPubKeys paying to the keys (spendable) and to the watch-only
+     * scripts (watch-only) of the wallet, guarded by cs_KeyStore. A script of those types
+     * not here isn't ours. */
+    std::unordered_map<CScript, isminetype, SaltedScriptHasher> mapOwnedScripts;
+
+    // Background top-up (see ThreadTopUp)
+    boost::mutex mutexTopUp;
+    boost::condition_variable condTopUp;
+    bool fTopUpRequested{false};
+    std::atomic<bool> fTopUpThread{false};
+
+    //! Keys missing in the external, internal and staking pools to reach the target size
+    void GetMissingKeys(unsigned int kpSize, int64_t& missingExternal, int64_t& missingInternal, int64_t& missingStaking) const;
+
     /* */
     bool AddKeyPubKeyInner(const CKey& key, const CPubKey &pubkey);
 
@@ -161,5 +221,8 @@ private:
     void MarkReserveKeysAsUsed(int64_t keypool_id);
 };
 
+/** Run ScriptPubKeyMan::ThreadTopUp for pwalletMain */
+void ThreadKeyPoolTopUp();
+
 
 #endif //DOGEC_SCRIPTPUBKEYMAN_H
@@ -0,0 +1,155 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/shieldsendqueue.h"
+
+#include "logging.h"
+#include "random.h"
+#include "tinyformat.h"
+#include "util/threadnames.h"
+#include "utiltime.h"
+
+#include <boost/thread.hpp>
+
+CShieldSendQueue shieldsendqueue(MAX_SHIELDSEND_QUEUE);
+
+bool CShieldSendQueue::Push(std::unique_ptr<SaplingOperation>& operation, std::string& idRet, std::string& strError)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nWorkers == 0) {
+            strError = "No worker is running, start with -shieldsendthreads greater than zero";
+            return false;
+        }
+        if (queue.size() >= nMaxSize) {
+            strError = strprintf("Too many shielded sends waiting (%u), try again later", queue.size());
+            return false;
+        }
+        idRet = "opid-" + GetRandHash().GetHex().substr(0, 32);
+        Entry& entry = mapOperations[idRet];
+        entry.id = idRet;
+        entry.status = QUEUED;
+        entry.nCreationTime = GetTime();
+        entry.operation = std::move(operation);
+        queue.push_back(idRet);
+    }
+    condWorker.notify_one();
+    return true;
+}
+
+std::vector<CShieldSendQueue::Info> CShieldSendQueue::GetStatusInternal(const std::vector<std::string>& ids) const
+{
+    std::vector<Info> vRet;
+    auto addInfo = [&vRet](const Entry& entry) {
+        vRet.push_back(Info{entry.id, entry.status, entry.nCreationTime, entry.nExecutionTime, entry.txid, entry.strError});
+    };
+    if (ids.empty()) {
+        for (const auto& it : mapOperations) addInfo(it.second);
+    } else {
+        for (const std::string& id : ids) {
+            auto it = mapOperations.find(id);
+            if (it != mapOperations.end()) addInfo(it->second);
+        }
+    }
+    return vRet;
+}
+
+std::vector<CShieldSendQueue::Info> CShieldSendQueue::GetStatus(const std::vector<std::string>& ids) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return GetStatusInternal(ids);
+}
+
+std::vector<CShieldSendQueue::Info> CShieldSendQueue::PopFinished(const std::vector<std::string>& ids)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    std::vector<Info> vRet = GetStatusInternal(ids);
+    for (const Info& info : vRet) {
+        if (info.status == SUCCESS || info.status == FAILED) {
+            mapOperations.erase(info.id);
+        }
+    }
+    return vRet;
+}
+
+void CShieldSendQueue::Clear()
+{
+    std::vector<std::unique_ptr<SaplingOperation>> vDropped;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (auto& it : mapOperations) {
+            if (it.second.operation) vDropped.emplace_back(std::move(it.second.operation));
+        }
+        mapOperations.clear();
+        queue.clear();
+    }
+    if (!vDropped.empty()) {
+        LogPrintf("%s: dropped %u queued shielded sends\n", __func__, vDropped.size());
+    }
+}
+
+void CShieldSendQueue::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nWorkers++;
+    try {
+        while (true) {
+            while (queue.empty()) {
+                condWorker.wait(lock); // interruption point
+            }
+            // Entries are erased only once finished, so the reference stays valid.
+            Entry& entry = mapOperations.at(queue.front());
+            queue.pop_front();
+            entry.status = EXECUTING;
+            entry.nExecutionTime = GetTime();
+            std::unique_ptr<SaplingOperation> operation = std::move(entry.operation);
+            lock.unlock();
+
+            std::string txid;
+            OperationResult res(false);
+            try {
+                // Proofs and signatures without cs_main and cs_wallet, then commit (send unlocks the inputs)
+                res = operation->prove();
+                if (res) res = operation->send(txid);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                res = errorOut(e.what());
+            }
+            if (!res) {
+                LOCK(pwalletMain->cs_wallet);
+                operation->unlockInputs();
+            }
+            operation.reset();
+
+            lock.lock();
+            entry.status = res ? SUCCESS : FAILED;
+            entry.txid = txid;
+            if (!res) {
+                entry.strError = res.getError();
+                LogPrintf("%s: shielded send %s failed: %s\n", __func__, entry.id, entry.strError);
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        if (!lock.owns_lock()) lock.lock();
+        nWorkers--;
+        throw;
+    }
+}
+
+std::string CShieldSendQueue::StatusToString(Status status)
+{
+    switch (status) {
+    case QUEUED: return "queued";
+    case EXECUTING: return "executing";
+    case SUCCESS: return "success";
+    case FAILED: return "failed";
+    }
+    return "unknown";
+}
+
+void ThreadShieldSend()
+{
+    util::ThreadRename("dogecash-shieldsend");
+    shieldsendqueue.Thread();
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_SHIELDSENDQUEUE_H
+#define BITCOIN_WALLET_SHIELDSENDQUEUE_H
+
+#include "sapling/sapling_operation.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Default number of threads proving the queued shielded sends */
+static const int DEFAULT_SHIELDSEND_THREADS = 2;
+/** Maximum number of threads proving the queued shielded sends */
+static const int MAX_SHIELDSEND_THREADS = 16;
+/** Maximum number of shielded sends waiting to be proved */
+static const unsigned int MAX_SHIELDSEND_QUEUE = 1000;
+
+/**
+ * Shielded sends submitted by shieldsendmanyasync. The inputs are selected,
+ * and locked in the wallet, by the RPC thread under cs_main and cs_wallet;
+ * the worker threads then generate the proofs and signatures without any of
+ * those locks and commit the transaction, so that many payouts can be proved
+ * at the same time while the other RPC clients keep using the wallet.
+ */
+class CShieldSendQueue
+{
+public:
+    enum Status {
+        QUEUED,
+        EXECUTING,
+        SUCCESS,
+        FAILED,
+    };
+
+    struct Entry {
+        std::string id;
+        Status status;
+        int64_t nCreationTime;
+        int64_t nExecutionTime{0};
+        std::string txid;
+        std::string strError;
+        std::unique_ptr<SaplingOperation> operation;
+    };
+
+    //! Status of a finished (or not yet finished) operation, without the operation itself
+    struct Info {
+        std::string id;
+        Status status;
+        int64_t nCreationTime;
+        int64_t nExecutionTime;
+        std::string txid;
+        std::string strError;
+    };
+
+    explicit CShieldSendQueue(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) {}
+
+    //! Queue a prepared operation, with its inputs locked. On success the queue takes it and returns its id.
+    bool Push(std::unique_ptr<SaplingOperation>& operation, std::string& idRet, std::string& strError);
+
+    //! Status of the given operations (all of them if ids is empty)
+    std::vector<Info> GetStatus(const std::vector<std::string>& ids) const;
+
+    //! As GetStatus, then forget the ones that are finished
+    std::vector<Info> PopFinished(const std::vector<std::string>& ids);
+
+    //! Drop the operations still queued. To be called after the workers are stopped and before the wallet is destroyed.
+    void Clear();
+
+    //! Worker loop, exits when the thread is interrupted
+    void Thread();
+
+    static std::string StatusToString(Status status);
+
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable condWorker;
+    std::map<std::string, Entry> mapOperations;
+    //! ids of the operations waiting for a worker, in submission order
+    std::deque<std::string> queue;
+    int nWorkers{0};
+    const size_t nMaxSize;
+
+    std::vector<Info> GetStatusInternal(const std::vector<std::string>& ids) const;
+};
+
+extern CShieldSendQueue shieldsendqueue;
+
+/** Run a worker of shieldsendqueue */
+void ThreadShieldSend();
+
+#endif // BITCOIN_WALLET_SHIELDSENDQUEUE_H
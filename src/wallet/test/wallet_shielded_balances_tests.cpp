@@ -362,6 +362,18 @@ BOOST_AUTO_TEST_CASE(GetShieldedAvailableCredit)
     wallet.GetSaplingScriptPubKeyMan()->GetFilteredNotes(saplingEntries,
                                                          opPa,
                                                          0);
+    BOOST_CHECK_EQUAL(saplingEntries.size(), 2);
+
+    // Locked notes are not selected
+    std::vector<SaplingNoteEntry> unlockedEntries;
+    wallet.LockNote(saplingEntries[0].op);
+    wallet.GetSaplingScriptPubKeyMan()->GetFilteredNotes(unlockedEntries, opPa, 0);
+    BOOST_CHECK_EQUAL(unlockedEntries.size(), 1);
+    BOOST_CHECK(unlockedEntries[0].op == saplingEntries[1].op);
+    wallet.UnlockNote(saplingEntries[0].op);
+    unlockedEntries.clear();
+    wallet.GetSaplingScriptPubKeyMan()->GetFilteredNotes(unlockedEntries, opPa, 0);
+    BOOST_CHECK_EQUAL(unlockedEntries.size(), 2);
 
     std::vector<SaplingOutPoint> ops = {saplingEntries[0].op};
     uint256 anchor;
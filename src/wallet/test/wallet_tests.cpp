@@ -308,6 +308,55 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(bnb_coin_selection_tests)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    // With no fee the effective values are the coin values
+    const CFeeRate noFee(0);
+
+    LOCK(pwalletMain->cs_wallet);
+    empty_wallet();
+
+    // nothing to select from
+    BOOST_CHECK(!pwalletMain->SelectCoinsNoChange(vCoins, 1 * CENT, noFee, setCoinsRet, nValueRet));
+
+    add_coin(1*CENT);
+    add_coin(2*CENT);
+    add_coin(5*CENT);
+    add_coin(10*CENT);
+    add_coin(20*CENT);
+
+    // 7 cents is 2+5, no change needed
+    BOOST_CHECK(pwalletMain->SelectCoinsNoChange(vCoins, 7 * CENT, noFee, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
+
+    // 4 cents can't be made without change
+    BOOST_CHECK(!pwalletMain->SelectCoinsNoChange(vCoins, 4 * CENT, noFee, setCoinsRet, nValueRet));
+
+    // an excess below the dust threshold goes to the fee
+    BOOST_CHECK(pwalletMain->SelectCoinsNoChange(vCoins, 7 * CENT - 10, noFee, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 7 * CENT);
+
+    // below the consolidation fee rate, the solution with more inputs wins:
+    // 10 cents is 10, 3+7, 1+2+7 or 2+3+5
+    add_coin(3*CENT);
+    add_coin(7*CENT);
+    BOOST_CHECK(pwalletMain->SelectCoinsNoChange(vCoins, 10 * CENT, noFee, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+    // a new coin is selected only if it is our own change, and if allowed
+    empty_wallet();
+    add_coin(1*CENT, 0);
+    BOOST_CHECK(!pwalletMain->SelectCoinsNoChange(vCoins, 1 * CENT, noFee, setCoinsRet, nValueRet));
+    empty_wallet();
+    add_coin(1*CENT, 0, true);
+    BOOST_CHECK(pwalletMain->SelectCoinsNoChange(vCoins, 1 * CENT, noFee, setCoinsRet, nValueRet) == bSpendZeroConfChange);
+    empty_wallet();
+}
+
 void removeTxFromMempool(CWalletTx& wtx)
 {
     LOCK(mempool.cs);
@@ -478,6 +527,133 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
     BOOST_CHECK_EQUAL(wtxCredit.GetAvailableCredit(false), nCredit - nDebit);
     BOOST_CHECK(wtxCredit.IsAmountCached(CWalletTx::AVAILABLE_CREDIT, ISMINE_SPENDABLE));
 
+    // A change in the spends of the credit tx drops its available credit only
+    wallet.MarkAffectedTransactionsDirty(*wtxDebit.tx);
+    BOOST_CHECK(!wtxCredit.IsAmountCached(CWalletTx::AVAILABLE_CREDIT, ISMINE_SPENDABLE));
+    BOOST_CHECK(wtxCredit.IsAmountCached(CWalletTx::CREDIT, ISMINE_SPENDABLE));
+    BOOST_CHECK_EQUAL(wtxCredit.GetAvailableCredit(), nCredit - nDebit);
+
+    // The spent output is no longer available to the coin selection
+    std::vector<COutput> vCoins;
+    BOOST_CHECK(wallet.AvailableCoins(&vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 1);
+    BOOST_CHECK(vCoins[0].tx->GetHash() == wtxCredit.GetHash());
+    BOOST_CHECK_EQUAL(vCoins[0].i, 1);
+}
+
+BOOST_AUTO_TEST_CASE(owned_scripts_ismine_tests)
+{
+    CWallet& wallet = *pwalletMain;
+    LOCK(wallet.cs_wallet);
+    ScriptPubKeyMan* spkm = wallet.GetScriptPubKeyMan();
+
+    CKey key, otherKey, stakerKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    stakerKey.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    const CScript p2pkh = GetScriptForDestination(pubkey.GetID());
+    const CScript p2pk = GetScriptForRawPubKey(pubkey);
+    const CScript otherP2pkh = GetScriptForDestination(otherKey.GetPubKey().GetID());
+    const CScript p2cs = GetScriptForStakeDelegation(stakerKey.GetPubKey().GetID(), pubkey.GetID());
+
+    // A watch-only script is replaced by the key
+    BOOST_CHECK(wallet.AddWatchOnly(p2pkh));
+    BOOST_CHECK_EQUAL(spkm->IsMine(p2pkh), ISMINE_WATCH_ONLY);
+    BOOST_CHECK_EQUAL(spkm->IsMine(p2pk), ISMINE_NO);
+    BOOST_CHECK_EQUAL(spkm->IsMine(p2cs), ISMINE_NO);
+    BOOST_CHECK(wallet.AddKeyPubKey(key, pubkey));
+    for (const CScript& script : {p2pkh, p2pk, otherP2pkh, p2cs}) {
+        BOOST_CHECK_EQUAL(spkm->IsMine(script), ::IsMine(wallet, script));
+    }
+    BOOST_CHECK_EQUAL(spkm->IsMine(p2pkh), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(spkm->IsMine(p2pk), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(spkm->IsMine(otherP2pkh), ISMINE_NO);
+    BOOST_CHECK_EQUAL(spkm->IsMine(p2cs), ISMINE_SPENDABLE_DELEGATED);
+
+    BOOST_CHECK(wallet.AddWatchOnly(otherP2pkh));
+    BOOST_CHECK_EQUAL(spkm->IsMine(otherP2pkh), ISMINE_WATCH_ONLY);
+    BOOST_CHECK(wallet.RemoveWatchOnly(otherP2pkh));
+    BOOST_CHECK_EQUAL(spkm->IsMine(otherP2pkh), ISMINE_NO);
+}
+
+BOOST_AUTO_TEST_CASE(keypool_topup_unlocked_tests)
+{
+    CWallet& wallet = *pwalletMain;
+    ScriptPubKeyMan* spkm = wallet.GetScriptPubKeyMan();
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+        wallet.SetupSPKM(false);
+        BOOST_CHECK_EQUAL(spkm->KeypoolCountExternalKeys(), 0);
+    }
+
+    BOOST_CHECK(spkm->TopUpUnlocked(3));
+    // A second call has nothing left to add
+    BOOST_CHECK(spkm->TopUpUnlocked(3));
+    {
+        LOCK(wallet.cs_wallet);
+        BOOST_CHECK_EQUAL(spkm->KeypoolCountExternalKeys(), 3);
+        BOOST_CHECK_EQUAL(spkm->GetKeyPoolSize(), 6);
+        BOOST_CHECK_EQUAL(spkm->GetStakingKeyPoolSize(), 3);
+        CHDChain chain = spkm->GetHDChain();
+        BOOST_CHECK_EQUAL(chain.GetChainCounter(HDChain::ChangeType::EXTERNAL), 3);
+        BOOST_CHECK_EQUAL(chain.GetChainCounter(HDChain::ChangeType::INTERNAL), 3);
+        BOOST_CHECK_EQUAL(chain.GetChainCounter(HDChain::ChangeType::STAKING), 3);
+
+        // The keys come out of the pool in the derivation order
+        for (uint32_t i = 0; i < 3; i++) {
+            CPubKey pubkey;
+            BOOST_CHECK(spkm->GetKeyFromPool(pubkey, HDChain::ChangeType::EXTERNAL));
+            const CKeyMetadata& meta = wallet.mapKeyMetadata.at(pubkey.GetID());
+            BOOST_CHECK(meta.hd_seed_id == chain.GetID());
+            BOOST_CHECK_EQUAL(meta.key_origin.path.size(), 5);
+            BOOST_CHECK_EQUAL(meta.key_origin.path.back(), i | BIP32_HARDENED_KEY_LIMIT);
+        }
+    }
+
+    // The same keys as the ones derived by TopUp
+    BOOST_CHECK(spkm->TopUp(1));
+    {
+        LOCK(wallet.cs_wallet);
+        CPubKey pubkey;
+        BOOST_CHECK(spkm->GetKeyFromPool(pubkey, HDChain::ChangeType::EXTERNAL));
+        BOOST_CHECK_EQUAL(wallet.mapKeyMetadata.at(pubkey.GetID()).key_origin.path.back(), 3 | BIP32_HARDENED_KEY_LIMIT);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(archived_txs_tests)
+{
+    CWallet& wallet = *pwalletMain;
+    LOCK(wallet.cs_wallet);
+
+    CKey key, otherKey;
+    key.MakeNewKey(true);
+    otherKey.MakeNewKey(true);
+    BOOST_CHECK(wallet.AddKeyPubKey(key, key.GetPubKey()));
+
+    // An archived tx paying us on its first output only
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    mtx.vout.emplace_back(10 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+    mtx.vout.emplace_back(5 * COIN, GetScriptForDestination(otherKey.GetPubKey().GetID()));
+    CWalletTx wtx(&wallet, MakeTransactionRef(mtx));
+    wallet.LoadArchivedTx(wtx);
+    BOOST_CHECK(!wallet.GetWalletTx(wtx.GetHash()));
+
+    const COutPoint out0(wtx.GetHash(), 0);
+    BOOST_CHECK(wallet.GetWalletTxOut(out0) && wallet.GetWalletTxOut(out0)->nValue == 10 * COIN);
+    BOOST_CHECK(!wallet.GetWalletTxOut(COutPoint(wtx.GetHash(), 1)));
+
+    // The debit of a tx spending the archived output is still known
+    const CTxIn txin(out0);
+    BOOST_CHECK_EQUAL(wallet.IsMine(txin), ISMINE_SPENDABLE);
+    BOOST_CHECK_EQUAL(wallet.GetDebit(txin, ISMINE_ALL), 10 * COIN);
+    BOOST_CHECK_EQUAL(wallet.GetDebit(CTxIn(COutPoint(wtx.GetHash(), 1)), ISMINE_ALL), 0);
+
+    // The outpoints spent by the archived tx stay spent
+    BOOST_CHECK(wallet.IsSpent(mtx.vin[0].prevout));
+    BOOST_CHECK(!wallet.IsSpent(out0));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
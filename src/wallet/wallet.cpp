@@ -10,21 +10,33 @@
 #include "wallet/wallet.h"
 
 #include "budget/budgetmanager.h"
+#include "blockfilter.h"
 #include "coincontrol.h"
 #include "init.h"
+#include "kernel.h"
 #include "guiinterfaceutil.h"
+#include "index/blockfilterindex.h"
 #include "masternode.h"
 #include "masternode-payments.h"
+#include "memusage.h"
 #include "policy/policy.h"
 #include "sapling/key_io_sapling.h"
 #include "script/sign.h"
 #include "scheduler.h"
 #include "spork.h"
 #include "util.h"
+#include "util/parallel.h"
+#include "util/threadnames.h"
+#include "util/trace.h"
 #include "utilmoneystr.h"
+#include "wallet/shieldsendqueue.h"
 #include "zdogecchain.h"
 
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
+#include <thread>
 #include <boost/algorithm/string/replace.hpp>
 
 CWallet* pwalletMain = nullptr;
@@ -32,6 +44,7 @@ CWallet* pwalletMain = nullptr;
  * Settings
  */
 CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
+CFeeRate consolidateFeeRate(DEFAULT_CONSOLIDATE_FEERATE);
 CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
 unsigned int nTxConfirmTarget = 1;
 bool bdisableSystemnotifications = false; // Those bubbles can be annoying and slow down the UI when you get lots of trx
@@ -119,17 +132,35 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
     return &(it->second);
 }
 
-std::vector<CWalletTx> CWallet::getWalletTxs()
+std::vector<CWalletTx> CWallet::getWalletTxs(size_t nMaxTxs)
 {
     LOCK(cs_wallet);
+    const size_t nTxs = nMaxTxs ? std::min(nMaxTxs, wtxOrdered.size()) : wtxOrdered.size();
     std::vector<CWalletTx> result;
-    result.reserve(mapWallet.size());
-    for (const auto& entry : mapWallet) {
-        result.emplace_back(entry.second);
+    result.reserve(nTxs);
+    // Walk wtxOrdered backwards: the older transactions, beyond the limit, are never copied
+    for (auto it = wtxOrdered.rbegin(); it != wtxOrdered.rend() && result.size() < nTxs; ++it) {
+        result.emplace_back(*it->second);
     }
     return result;
 }
 
+void CWallet::GetMemoryUsage(size_t& nTxsRet, size_t& nWitnessesRet) const
+{
+    LOCK(cs_wallet);
+    nTxsRet = memusage::DynamicUsage(mapWallet) + memusage::DynamicUsage(wtxOrdered);
+    nWitnessesRet = 0;
+    for (const auto& it : mapWallet) {
+        const CWalletTx& wtx = it.second;
+        nTxsRet += memusage::DynamicUsage(wtx.tx) + wtx.tx->DynamicMemoryUsage() +
+                   memusage::RecursiveDynamicUsage(wtx.mapValue) + memusage::RecursiveDynamicUsage(wtx.vOrderForm) +
+                   memusage::DynamicUsage(wtx.mapSaplingNoteData);
+        for (const auto& nd : wtx.mapSaplingNoteData) {
+            nWitnessesRet += nd.second.DynamicMemoryUsage();
+        }
+    }
+}
+
 PairResult CWallet::getNewAddress(CTxDestination& ret, std::string label){
     return getNewAddress(ret, label, AddressBook::AddressBookPurpose::RECEIVE);
 }
@@ -143,11 +174,12 @@ PairResult CWallet::getNewAddress(CTxDestination& ret, const std::string address
 {
     LOCK(cs_wallet);
 
+    uint8_t type = (addrType == CChainParams::Base58Type::STAKING_ADDRESS ? HDChain::ChangeType::STAKING : HDChain::ChangeType::EXTERNAL);
+
     // Refill keypool if wallet is unlocked
     if (!IsLocked())
-        TopUpKeyPool();
+        m_spk_man->TopUpBeforeUse(type);
 
-    uint8_t type = (addrType == CChainParams::Base58Type::STAKING_ADDRESS ? HDChain::ChangeType::STAKING : HDChain::ChangeType::EXTERNAL);
     CPubKey newKey;
     // Get a key
     if (!GetKeyFromPool(newKey, type)) {
@@ -200,6 +232,7 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     AssertLockHeld(cs_wallet); // mapKeyMetadata
     if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
         return false;
+    m_spk_man->AddOwnedKey(pubkey);
 
     // TODO: Move the follow block entirely inside the spkm (including WriteKey to AddKeyPubKeyWithDB)
     // check if we need to remove from watch-only
@@ -222,11 +255,20 @@ bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey& pubkey)
     return true;
 }
 
+bool CWallet::LoadKey(const CKey& key, const CPubKey& pubkey)
+{
+    if (!CCryptoKeyStore::AddKeyPubKey(key, pubkey))
+        return false;
+    m_spk_man->AddOwnedKey(pubkey);
+    return true;
+}
+
 bool CWallet::AddCryptedKey(const CPubKey& vchPubKey,
     const std::vector<unsigned char>& vchCryptedSecret)
 {
     if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
         return false;
+    m_spk_man->AddOwnedKey(vchPubKey);
     {
         LOCK(cs_wallet);
         if (pwalletdbEncryption)
@@ -251,7 +293,10 @@ bool CWallet::LoadKeyMetadata(const CPubKey& pubkey, const CKeyMetadata& meta)
 
 bool CWallet::LoadCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret)
 {
-    return CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret);
+    if (!CCryptoKeyStore::AddCryptedKey(vchPubKey, vchCryptedSecret))
+        return false;
+    m_spk_man->AddOwnedKey(vchPubKey);
+    return true;
 }
 
 bool CWallet::AddCScript(const CScript& redeemScript)
@@ -280,6 +325,7 @@ bool CWallet::AddWatchOnly(const CScript& dest)
 {
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
+    m_spk_man->AddOwnedWatchOnly(dest);
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
     NotifyWatchonlyChanged(true);
     return CWalletDB(*dbw).WriteWatchOnly(dest);
@@ -290,6 +336,7 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
+    m_spk_man->RemoveOwnedWatchOnly(dest);
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (!CWalletDB(*dbw).EraseWatchOnly(dest))
@@ -300,7 +347,10 @@ bool CWallet::RemoveWatchOnly(const CScript& dest)
 
 bool CWallet::LoadWatchOnly(const CScript& dest)
 {
-    return CCryptoKeyStore::AddWatchOnly(dest);
+    if (!CCryptoKeyStore::AddWatchOnly(dest))
+        return false;
+    m_spk_man->AddOwnedWatchOnly(dest);
+    return true;
 }
 
 bool CWallet::Unlock(const SecureString& strWalletPassphrase, bool stakingOnly)
@@ -345,49 +395,31 @@ bool CWallet::Unlock(const CKeyingMaterial& vMasterKeyIn)
         if (!SetCrypted())
             return false;
 
-        bool keyPass = false;
-        bool keyFail = false;
+        // Check the master key on a single key: the others are decrypted, and
+        // checked against their public key, the first time GetKey needs them.
         CryptedKeyMap::const_iterator mi = mapCryptedKeys.begin();
-        for (; mi != mapCryptedKeys.end(); ++mi) {
-            const CPubKey& vchPubKey = (*mi).second.first;
-            const std::vector<unsigned char>& vchCryptedSecret = (*mi).second.second;
-            CKeyingMaterial vchSecret;
-            if (!DecryptSecret(vMasterKeyIn, vchCryptedSecret, vchPubKey.GetHash(), vchSecret)) {
-                keyFail = true;
-                break;
-            }
-            if (vchSecret.size() != 32) {
-                keyFail = true;
-                break;
-            }
-            CKey key;
-            key.Set(vchSecret.begin(), vchSecret.end(), vchPubKey.IsCompressed());
-            if (key.GetPubKey() != vchPubKey) {
-                keyFail = true;
-                break;
-            }
-            keyPass = true;
-            if (fDecryptionThoroughlyChecked)
-                break;
-        }
-
-        if (keyPass && keyFail) {
-            LogPrintf("The wallet is probably corrupted: Some keys decrypt but not all.\n");
-            throw std::runtime_error("Error unlocking wallet: some keys decrypt but not all. Your wallet file may be corrupt.");
-        }
-
-        if (keyFail || !keyPass)
+        if (mi == mapCryptedKeys.end())
+            return false;
+        const CPubKey& vchPubKey = (*mi).second.first;
+        const std::vector<unsigned char>& vchCryptedSecret = (*mi).second.second;
+        CKeyingMaterial vchSecret;
+        if (!DecryptSecret(vMasterKeyIn, vchCryptedSecret, vchPubKey.GetHash(), vchSecret))
+            return false;
+        if (vchSecret.size() != 32)
             return false;
+        CKey key;
+        key.Set(vchSecret.begin(), vchSecret.end(), vchPubKey.IsCompressed());
+        if (key.GetPubKey() != vchPubKey)
+            return false;
+        setVerifiedCryptedKeys.insert((*mi).first);
 
         // Sapling
-        if (!UnlockSaplingKeys(vMasterKeyIn, fDecryptionThoroughlyChecked)) {
-            // If Sapling key encryption fail, let's unencrypt the rest of the keys
-            LogPrintf("Sapling wallet unlock keys failed\n");
+        if (!UnlockSaplingKeys(vMasterKeyIn)) {
+            LogPrintf("The wallet is probably corrupted: Sapling keys don't decrypt with the master key of the transparent keys.\n");
             throw std::runtime_error("Error unlocking wallet: some Sapling keys decrypt but not all. Your wallet file may be corrupt.");
         }
 
         vMasterKey = vMasterKeyIn;
-        fDecryptionThoroughlyChecked = true;
     }
 
     NotifyStatusChanged(this);
@@ -651,6 +683,12 @@ bool CWallet::ParameterInteraction()
                                        gArgs.GetArg("-paytxfee", ""), ::minRelayTxFee.ToString()));
         }
     }
+    if (gArgs.IsArgSet("-consolidatefeerate")) {
+        CAmount nFeePerK = 0;
+        if (!ParseMoney(gArgs.GetArg("-consolidatefeerate", ""), nFeePerK))
+            return UIError(AmountErrMsg("consolidatefeerate", gArgs.GetArg("-consolidatefeerate", "")));
+        consolidateFeeRate = CFeeRate(nFeePerK, 1000);
+    }
     if (gArgs.IsArgSet("-maxtxfee")) {
         CAmount nMaxFee = 0;
         if (!ParseMoney(gArgs.GetArg("-maxtxfee", ""), nMaxFee))
@@ -670,6 +708,10 @@ bool CWallet::ParameterInteraction()
         else
             return UIError(AmountErrMsg("minstakesplit", gArgs.GetArg("-minstakesplit", "")));
     }
+    const int nArchiveDepth = gArgs.GetArg("-walletarchivedepth", DEFAULT_WALLET_ARCHIVE_DEPTH);
+    if (nArchiveDepth < 0 || (nArchiveDepth > 0 && nArchiveDepth < MIN_WALLET_ARCHIVE_DEPTH)) {
+        return UIError(strprintf(_("Invalid -walletarchivedepth=%d (must be 0 or at least %d)"), nArchiveDepth, MIN_WALLET_ARCHIVE_DEPTH));
+    }
     nTxConfirmTarget = gArgs.GetArg("-txconfirmtarget", 1);
     bSpendZeroConfChange = gArgs.GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     bdisableSystemnotifications = gArgs.GetBoolArg("-disablesystemnotifications", false);
@@ -706,6 +748,7 @@ bool CWallet::HasSaplingSPKM() const
 bool CWallet::IsSpent(const COutPoint& outpoint) const
 {
     AssertLockHeld(cs_wallet);
+    if (setArchivedSpends.count(outpoint)) return true;
     std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range;
     range = mapTxSpends.equal_range(outpoint);
     for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
@@ -874,7 +917,9 @@ int64_t CWallet::IncOrderPosNext(CWalletDB* pwalletdb)
 {
     AssertLockHeld(cs_wallet); // nOrderPosNext
     int64_t nRet = nOrderPosNext++;
-    if (pwalletdb) {
+    if (fDeferBlockWrites) {
+        fBlockOrderPosDirty = true;
+    } else if (pwalletdb) {
         pwalletdb->WriteOrderPosNext(nOrderPosNext);
     } else {
         CWalletDB(*dbw).WriteOrderPosNext(nOrderPosNext);
@@ -903,13 +948,181 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx> & item : mapWallet)
             item.second.MarkDirty();
+        MarkBalancesDirty();
+    }
+}
+
+void CWallet::AddToStakeCandidates(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    for (const CTxOut& out : wtx.tx->vout) {
+        if (out.nValue > 0 && !out.IsZerocoinMint() && IsMine(out) != ISMINE_NO) {
+            setStakeCandidates.emplace(wtx.GetHash());
+            return;
+        }
+    }
+}
+
+bool CWallet::IsFullySpentInChain(const CWalletTx& wtx) const
+{
+    AssertLockHeld(cs_wallet);
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) == ISMINE_NO) continue;
+        bool fSpentInChain = setArchivedSpends.count(COutPoint(wtx.GetHash(), i)) > 0;
+        const auto range = mapTxSpends.equal_range(COutPoint(wtx.GetHash(), i));
+        for (auto it = range.first; it != range.second && !fSpentInChain; ++it) {
+            const auto mit = mapWallet.find(it->second);
+            fSpentInChain = mit != mapWallet.end() && mit->second.GetDepthInMainChain() > 0;
+        }
+        if (!fSpentInChain) return false;
+    }
+    return true;
+}
+
+bool CWallet::IsSpentInChain(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    if (setArchivedSpends.count(outpoint)) return true;
+    const auto range = mapTxSpends.equal_range(outpoint);
+    for (auto it = range.first; it != range.second; ++it) {
+        const auto mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.isConfirmed()) return true;
+    }
+    return false;
+}
+
+void CWallet::AddToWalletUTXO(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    const auto it = mapWallet.find(outpoint.hash);
+    if (it == mapWallet.end() || outpoint.n >= it->second.tx->vout.size()) return;
+    const CTxOut& out = it->second.tx->vout[outpoint.n];
+    const isminetype mine = IsMine(out);
+    if (out.nValue <= 0 || mine == ISMINE_NO || IsSpentInChain(outpoint)) {
+        EraseFromWalletUTXO(outpoint);
+        return;
+    }
+    const auto res = mapWalletUTXO.emplace(outpoint, mine);
+    res.first->second = mine;
+    CTxDestination dest;
+    if (ExtractDestination(out.scriptPubKey, dest)) {
+        mapWalletUTXOByDest[dest].emplace(outpoint);
+        if (res.second) UpdateDustTally(dest, out, mine, true);
+    }
+    UpdateP2CSIndex(outpoint, out, mine, true);
+}
+
+void CWallet::AddToWalletUTXO(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        AddToWalletUTXO(COutPoint(hash, i));
+    }
+    // The coins spent by a tx in the chain can't be selected anymore
+    if (wtx.isConfirmed()) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            EraseFromWalletUTXO(txin.prevout);
+        }
+    }
+}
+
+void CWallet::EraseFromWalletUTXO(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+    const auto uit = mapWalletUTXO.find(outpoint);
+    if (uit == mapWalletUTXO.end()) return;
+    const isminetype mine = uit->second;
+    mapWalletUTXO.erase(uit);
+    const auto it = mapWallet.find(outpoint.hash);
+    CTxDestination dest;
+    if (it != mapWallet.end() && ExtractDestination(it->second.tx->vout[outpoint.n].scriptPubKey, dest)) {
+        auto dit = mapWalletUTXOByDest.find(dest);
+        if (dit != mapWalletUTXOByDest.end()) {
+            dit->second.erase(outpoint);
+            if (dit->second.empty()) mapWalletUTXOByDest.erase(dit);
+        }
+        UpdateDustTally(dest, it->second.tx->vout[outpoint.n], mine, false);
+    }
+    if (it != mapWallet.end()) UpdateP2CSIndex(outpoint, it->second.tx->vout[outpoint.n], mine, false);
+}
+
+void CWallet::UpdateP2CSIndex(const COutPoint& outpoint, const CTxOut& out, isminetype mine, bool fAdd)
+{
+    AssertLockHeld(cs_wallet);
+    if (!(mine & (ISMINE_COLD | ISMINE_SPENDABLE_DELEGATED)) || !out.scriptPubKey.IsPayToColdStaking()) return;
+    txnouttype type;
+    std::vector<CTxDestination> addresses;
+    int nRequired;
+    if (!ExtractDestinations(out.scriptPubKey, type, addresses, nRequired) || addresses.size() != 2) return;
+
+    const auto update = [&](std::map<CTxDestination, std::set<COutPoint>>& index, const CTxDestination& dest) {
+        if (fAdd) {
+            index[dest].insert(outpoint);
+            return;
+        }
+        auto it = index.find(dest);
+        if (it == index.end()) return;
+        it->second.erase(outpoint);
+        if (it->second.empty()) index.erase(it);
+    };
+    update(mapP2CSByStaker, addresses[0]);
+    update(mapP2CSByOwner, addresses[1]);
+}
+
+// The inputs of an auto combine tx, below the standard size (see AutoCombineDust)
+static const unsigned int AUTOCOMBINE_MAX_INPUTS = (MAX_STANDARD_TX_SIZE - 200 - 90) / 190;
+
+void CWallet::UpdateDustTally(const CTxDestination& dest, const CTxOut& out, isminetype mine, bool fAdd)
+{
+    AssertLockHeld(cs_wallet);
+    if (!fCombineDust || nAutoCombineThreshold <= 0) return;
+    const CAmount nThreshold = nAutoCombineThreshold * COIN;
+    if (out.nValue > nThreshold || !(mine & ISMINE_SPENDABLE)) return;
+
+    DustTally& tally = mapDustByDest[dest];
+    if (fAdd) {
+        tally.nCount++;
+        tally.nValue += out.nValue;
+    } else if (tally.nCount > 0) {
+        tally.nCount--;
+        tally.nValue -= out.nValue;
+    }
+    // worth a tx: it reaches the threshold, or the most inputs a tx takes
+    if (tally.nCount > 1 && (tally.nValue >= nThreshold || tally.nCount >= AUTOCOMBINE_MAX_INPUTS)) {
+        setDustToCombine.insert(dest);
+    } else {
+        setDustToCombine.erase(dest);
+        if (tally.nCount == 0) mapDustByDest.erase(dest);
     }
 }
 
+void CWallet::RebuildDustTallies()
+{
+    AssertLockHeld(cs_wallet);
+    mapDustByDest.clear();
+    setDustToCombine.clear();
+    for (const auto& it : mapWalletUTXOByDest) {
+        for (const COutPoint& outpoint : it.second) {
+            UpdateDustTally(it.first, mapWallet.at(outpoint.hash).tx->vout[outpoint.n], mapWalletUTXO.at(outpoint), true);
+        }
+    }
+}
+
+void CWallet::SetAutoCombineSettings(bool fEnable, CAmount nThreshold)
+{
+    LOCK(cs_wallet);
+    fCombineDust = fEnable;
+    nAutoCombineThreshold = nThreshold;
+    RebuildDustTallies();
+}
+
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 {
     LOCK(cs_wallet);
-    CWalletDB walletdb(*dbw, "r+", fFlushOnClose);
+    MarkBalancesDirty();
+    // Within BlockConnected, written at the end of the block
+    std::unique_ptr<CWalletDB> pwalletdb(fDeferBlockWrites ? nullptr : new CWalletDB(*dbw, "r+", fFlushOnClose));
     uint256 hash = wtxIn.GetHash();
 
     // Inserts only if not already there, returns tx inserted or tx found
@@ -921,13 +1134,16 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     bool fInsertedNew = ret.second;
     if (fInsertedNew) {
         wtx.nTimeReceived = GetAdjustedTime();
-        wtx.nOrderPos = IncOrderPosNext(&walletdb);
+        wtx.nOrderPos = IncOrderPosNext(pwalletdb.get());
         wtxOrdered.emplace(wtx.nOrderPos, &wtx);
         wtx.UpdateTimeSmart();
         AddToSpends(hash);
     }
 
     bool fUpdated = false;
+    // A new confirmation status doesn't change the cached amounts (the depth
+    // and the maturity are checked outside of the caches), the rest does.
+    bool fAmountsChanged = fInsertedNew;
     if (!fInsertedNew) {
         if (wtxIn.m_confirm.status != wtx.m_confirm.status) {
             wtx.m_confirm.status = wtxIn.m_confirm.status;
@@ -943,24 +1159,41 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         }
         if (HasSaplingSPKM() && m_sspk_man->UpdatedNoteData(wtxIn, wtx)) {
             fUpdated = true;
+            fAmountsChanged = true;
         }
         if (wtxIn.fFromMe && wtxIn.fFromMe != wtx.fFromMe) {
             wtx.fFromMe = wtxIn.fFromMe;
             fUpdated = true;
+            fAmountsChanged = true;
         }
     }
 
+    UpdateWalletTxHeight(wtx);
+
+    // The outputs can be ours only after a key import and a rescan
+    AddToStakeCandidates(wtx);
+    AddToWalletUTXO(wtx);
+    m_sspk_man->AddToUnspentNotes(wtx);
+
     //// debug print
     LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
     // Write to disk
     if (fInsertedNew || fUpdated) {
-        if (!walletdb.WriteTx(wtx))
+        if (fDeferBlockWrites) {
+            setBlockWrites.insert(hash);
+        } else if (!pwalletdb->WriteTx(wtx)) {
             return false;
+        }
     }
 
     // Break debit/credit balance caches:
-    wtx.MarkDirty();
+    if (fAmountsChanged) {
+        wtx.MarkDirty();
+        MarkSpendersDirty(wtx);
+    } else {
+        MarkBalancesDirty();
+    }
 
     // Notify UI of new or updated transaction
     NotifyTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
@@ -990,6 +1223,7 @@ Optional<int> getTipBlockHeight(const uint256& hash)
 bool CWallet::LoadToWallet(CWalletTx& wtxIn)
 {
     LOCK2(cs_main, cs_wallet);
+    MarkBalancesDirty();
     // If tx hasn't been reorged out of chain while wallet being shutdown
     // change tx status to UNCONFIRMED and reset hashBlock/nIndex.
     if (!wtxIn.m_confirm.hashBlock.IsNull()) {
@@ -1017,7 +1251,11 @@ bool CWallet::LoadToWallet(CWalletTx& wtxIn)
     // Sapling
     m_sspk_man->UpdateNullifierNoteMapWithTx(wtx);
     wtxOrdered.emplace(wtx.nOrderPos, &wtx);
+    UpdateWalletTxHeight(wtx);
     AddToSpends(hash);
+    AddToStakeCandidates(wtx);
+    AddToWalletUTXO(wtx);
+    m_sspk_man->AddToUnspentNotes(wtx);
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
@@ -1030,9 +1268,9 @@ bool CWallet::LoadToWallet(CWalletTx& wtxIn)
     return true;
 }
 
-bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData)
+bool CWallet::FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData, const SaplingNotesFound* pSaplingNotes)
 {
-    auto saplingNoteDataAndAddressesToAdd = m_sspk_man->FindMySaplingNotes(tx);
+    auto saplingNoteDataAndAddressesToAdd = pSaplingNotes ? *pSaplingNotes : m_sspk_man->FindMySaplingNotes(tx);
     saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
     auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
     // Add my addresses
@@ -1081,7 +1319,7 @@ void CWallet::AddExternalNotesDataToTx(CWalletTx& wtx) const
  * Abandoned state should probably be more carefully tracked via different
  * posInBlock signals or by checking mempool presence when necessary.
  */
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate)
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, bool fUpdate, const SaplingNotesFound* pSaplingNotes)
 {
     const CTransaction& tx = *ptx;
     {
@@ -1102,11 +1340,13 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const CWallet
 
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
+        // Archived: already fully spent deep in the chain, don't bring it back on a rescan
+        if (!fExisted && setArchivedTxs.count(tx.GetHash())) return false;
 
         // Check tx for Sapling notes
         Optional<mapSaplingNoteData_t> saplingNoteData {nullopt};
         if (HasSaplingSPKM()) {
-            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData)) {
+            if (!FindNotesDataAndAddMissingIVKToKeystore(tx, saplingNoteData, pSaplingNotes)) {
                 return false; // error adding incoming viewing key.
             }
         }
@@ -1180,6 +1420,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             assert(!wtx.InMempool());
             wtx.setAbandoned();
             wtx.MarkDirty();
+            UpdateWalletTxHeight(wtx);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1195,7 +1436,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             for (const CTxIn& txin : wtx.tx->vin) {
                 auto _it = mapWallet.find(txin.prevout.hash);
                 if (_it != mapWallet.end()) {
-                    _it->second.MarkDirty();
+                    _it->second.MarkSpendsDirty(ISMINE_TRANSPARENT_ALL);
                 }
             }
         }
@@ -1217,7 +1458,8 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
         return;
 
     // Do not flush the wallet here for performance reasons
-    CWalletDB walletdb(*dbw, "r+", false);
+    // (within BlockConnected, written at the end of the block)
+    std::unique_ptr<CWalletDB> pwalletdb(fDeferBlockWrites ? nullptr : new CWalletDB(*dbw, "r+", false));
 
     std::set<uint256> todo;
     std::set<uint256> done;
@@ -1240,7 +1482,12 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
             wtx.m_confirm.block_height = conflicting_height;
             wtx.setConflicted();
             wtx.MarkDirty();
-            walletdb.WriteTx(wtx);
+            UpdateWalletTxHeight(wtx);
+            if (fDeferBlockWrites) {
+                setBlockWrites.insert(now);
+            } else {
+                pwalletdb->WriteTx(wtx);
+            }
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -1254,24 +1501,153 @@ void CWallet::MarkConflicted(const uint256& hashBlock, int conflicting_height, c
             for (const CTxIn& txin : wtx.tx->vin) {
                 auto _it = mapWallet.find(txin.prevout.hash);
                 if (_it != mapWallet.end()) {
-                    _it->second.MarkDirty();
+                    _it->second.MarkSpendsDirty(ISMINE_TRANSPARENT_ALL);
                 }
             }
         }
     }
 }
 
-void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm)
+void CWallet::WriteBlockWrites()
 {
-    if (!AddToWalletIfInvolvingMe(ptx, confirm, true)) {
+    AssertLockHeld(cs_wallet);
+    if (setBlockWrites.empty() && !fBlockOrderPosDirty) return;
+
+    // Do not flush the wallet here for performance reasons
+    CWalletDB walletdb(*dbw, "r+", false);
+    auto writeAll = [&]() {
+        bool fOk = !fBlockOrderPosDirty || walletdb.WriteOrderPosNext(nOrderPosNext);
+        for (const uint256& hash : setBlockWrites) {
+            auto it = mapWallet.find(hash);
+            if (it != mapWallet.end() && !walletdb.WriteTx(it->second)) {
+                LogPrintf("%s: Failed to write CWalletTx %s\n", __func__, hash.ToString());
+                fOk = false;
+            }
+        }
+        return fOk;
+    };
+    bool fCommitted = walletdb.TxnBegin();
+    if (fCommitted) {
+        fCommitted = writeAll() ? walletdb.TxnCommit() : (walletdb.TxnAbort(), false);
+    }
+    if (!fCommitted) {
+        // Not atomically then, write what can be
+        LogPrintf("%s: Couldn't write the block atomically, writing the transactions one by one\n", __func__);
+        writeAll();
+    }
+    setBlockWrites.clear();
+    fBlockOrderPosDirty = false;
+}
+
+void CWallet::SyncTransaction(const CTransactionRef& ptx, const CWalletTx::Confirmation& confirm, const SaplingNotesFound* pSaplingNotes)
+{
+    if (!AddToWalletIfInvolvingMe(ptx, confirm, true, pSaplingNotes)) {
         return; // Not one of ours
     }
 
     MarkAffectedTransactionsDirty(*ptx);
 }
 
+/**
+ * Trial-decrypts the shielded outputs of the mempool transactions in a
+ * background thread, in batches (see SaplingScriptPubKeyMan::FindMySaplingNotes),
+ * so that shielded spam doesn't hold back the validation interface queue of
+ * the wallet. While transactions are queued here, the next ones are queued
+ * after them, shielded or not: a transaction spending the outputs of a queued
+ * one is seen after it.
+ */
+class CMempoolNoteScanner
+{
+public:
+    explicit CMempoolNoteScanner(CWallet* pwalletIn) : pwallet(pwalletIn)
+    {
+        thread = std::thread(&CMempoolNoteScanner::ThreadScan, this);
+    }
+
+    ~CMempoolNoteScanner()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+
+    //! Queue the transaction, if it is shielded or if others are queued already
+    bool MaybePush(const CTransactionRef& ptx)
+    {
+        std::lock_guard<std::mutex> lock(cs);
+        if (queue.empty() && nScanning == 0 && !ptx->IsShieldedTx()) return false;
+        queue.push_back(ptx);
+        cond.notify_all();
+        return true;
+    }
+
+    //! Wait until the transactions queued are in the wallet
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [this]{ return (queue.empty() && nScanning == 0) || fStop; });
+    }
+
+private:
+    static const size_t MAX_BATCH_SIZE = 100;
+
+    CWallet* pwallet;
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<CTransactionRef> queue;
+    size_t nScanning{0};
+    bool fStop{false};
+    std::thread thread;
+
+    void ThreadScan()
+    {
+        util::ThreadRename("dogecash-mempoolnotes");
+        std::unique_lock<std::mutex> lock(cs);
+        while (true) {
+            cond.wait(lock, [this]{ return !queue.empty() || fStop; });
+            if (fStop) return;
+            const size_t nBatch = std::min(queue.size(), MAX_BATCH_SIZE);
+            std::vector<CTransactionRef> vtx(queue.begin(), queue.begin() + nBatch);
+            queue.erase(queue.begin(), queue.begin() + nBatch);
+            nScanning = nBatch;
+            lock.unlock();
+
+            const std::vector<SaplingNotesFound> vSaplingNotes = pwallet->GetSaplingScriptPubKeyMan()->FindMySaplingNotes(vtx);
+            pwallet->SyncMempoolTransactions(vtx, vSaplingNotes);
+
+            lock.lock();
+            nScanning = 0;
+            cond.notify_all();
+        }
+    }
+};
+
+void CWallet::SyncMempoolTransactions(const std::vector<CTransactionRef>& vtx, const std::vector<SaplingNotesFound>& vSaplingNotes)
+{
+    LOCK(cs_wallet);
+    for (size_t i = 0; i < vtx.size(); i++) {
+        // Mined meanwhile, or evicted: BlockConnected has it, or it no longer matters
+        if (!mempool.exists(vtx[i]->GetHash())) continue;
+        CWalletTx::Confirmation confirm(CWalletTx::Status::UNCONFIRMED, /* block_height */ 0, {}, /* nIndex */ 0);
+        SyncTransaction(vtx[i], confirm, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[i]);
+
+        auto it = mapWallet.find(vtx[i]->GetHash());
+        if (it != mapWallet.end()) {
+            it->second.fInMempool = true;
+            MarkBalancesDirty();
+        }
+    }
+}
+
 void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx)
 {
+    if (m_mempool_note_scanner && HasSaplingSPKM() && m_mempool_note_scanner->MaybePush(ptx)) {
+        return;
+    }
+
     LOCK(cs_wallet);
     CWalletTx::Confirmation confirm(CWalletTx::Status::UNCONFIRMED, /* block_height */ 0, {}, /* nIndex */ 0);
     SyncTransaction(ptx, confirm);
@@ -1279,14 +1655,16 @@ void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx)
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = true;
+        MarkBalancesDirty();
     }
 }
 
-void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx) {
+void CWallet::TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason) {
     LOCK(cs_wallet);
     auto it = mapWallet.find(ptx->GetHash());
     if (it != mapWallet.end()) {
         it->second.fInMempool = false;
+        MarkBalancesDirty();
     }
 }
 
@@ -1298,14 +1676,25 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         m_last_block_processed = pindex->GetBlockHash();
         m_last_block_processed_time = pindex->GetBlockTime();
         m_last_block_processed_height = pindex->nHeight;
+        fDeferBlockWrites = true;
+        // Sapling: trial-decrypt all the shielded outputs of the block at once
+        std::vector<SaplingNotesFound> vSaplingNotes;
+        if (HasSaplingSPKM()) vSaplingNotes = m_sspk_man->FindMySaplingNotes(pblock->vtx);
         for (size_t index = 0; index < pblock->vtx.size(); index++) {
             CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, m_last_block_processed_height,
                                             m_last_block_processed, index);
-            SyncTransaction(pblock->vtx[index], confirm);
-            TransactionRemovedFromMempool(pblock->vtx[index]);
+            SyncTransaction(pblock->vtx[index], confirm, vSaplingNotes.empty() ? nullptr : &vSaplingNotes[index]);
+            TransactionRemovedFromMempool(pblock->vtx[index], MemPoolRemovalReason::BLOCK);
         }
         for (const CTransactionRef& ptx : vtxConflicted) {
-            TransactionRemovedFromMempool(ptx);
+            TransactionRemovedFromMempool(ptx, MemPoolRemovalReason::CONFLICT);
+        }
+        fDeferBlockWrites = false;
+        WriteBlockWrites();
+
+        const int nArchiveDepth = gArgs.GetArg("-walletarchivedepth", DEFAULT_WALLET_ARCHIVE_DEPTH);
+        if (nArchiveDepth > 0 && m_last_block_processed_height % WALLET_ARCHIVE_INTERVAL == 0) {
+            ArchiveWalletTxs(nArchiveDepth);
         }
 
         // Sapling: notify about the connected block
@@ -1326,11 +1715,24 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     } // cs_wallet lock end
 
     // Auto-combine functionality
-    // If turned on Auto Combine will scan wallet for dust to combine
-    // Outside of the cs_wallet lock because requires cs_main for now
-    // due CreateTransaction/CommitTransaction dependency.
-    if (fCombineDust) {
-        AutoCombineDust(g_connman.get());
+    // If turned on Auto Combine will combine the dust of the destinations
+    // that have enough of it, on the scheduler thread: it requires cs_main
+    // for now due CreateTransaction/CommitTransaction dependency.
+    bool fDustToCombine;
+    {
+        LOCK(cs_wallet);
+        fDustToCombine = fCombineDust && !setDustToCombine.empty();
+    }
+    if (fDustToCombine && !fAutoCombineScheduled.exchange(true)) {
+        auto autoCombine = [this]() {
+            fAutoCombineScheduled = false;
+            AutoCombineDust(g_connman.get());
+        };
+        if (m_scheduler) {
+            m_scheduler->schedule(autoCombine);
+        } else {
+            autoCombine();
+        }
     }
 }
 
@@ -1348,6 +1750,12 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, con
     for (const CTransactionRef& ptx : pblock->vtx) {
         CWalletTx::Confirmation confirm(CWalletTx::Status::UNCONFIRMED, /* block_height */ 0, {}, /* nIndex */ 0);
         SyncTransaction(ptx, confirm);
+        // The coins spent by the block are no longer spent in the chain
+        for (const CTxIn& txin : ptx->vin) {
+            if (mapWallet.count(txin.prevout.hash)) setStakeCandidates.emplace(txin.prevout.hash);
+            AddToWalletUTXO(txin.prevout);
+        }
+        m_sspk_man->RestoreUnspentNotes(*ptx);
     }
 
     if (Params().GetConsensus().NetworkUpgradeActive(nBlockHeight, Consensus::UPGRADE_V5_0)) {
@@ -1372,14 +1780,17 @@ void CWallet::BlockUntilSyncedToCurrentChain() {
         const CBlockIndex* initialChainTip = chainActive.Tip();
         if (!last_block_hash.IsNull() && initialChainTip &&
             last_block_hash == initialChainTip->GetBlockHash()) {
+                if (m_mempool_note_scanner) m_mempool_note_scanner->Wait();
                 return;
         }
     }
 
-    // ...otherwise put a callback in the validation interface queue and wait
-    // for the queue to drain enough to execute it (indicating we are caught up
-    // at least with the time we entered this function).
-    SyncWithValidationInterfaceQueue();
+    // ...otherwise put a callback in the validation interface queue of the wallet
+    // and wait for the queue to drain enough to execute it (indicating we are caught
+    // up at least with the time we entered this function).
+    SyncWithValidationInterfaceQueue(this);
+    // The mempool transactions it handed out to the trial decryption as well
+    if (m_mempool_note_scanner) m_mempool_note_scanner->Wait();
 }
 
 void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
@@ -1391,7 +1802,7 @@ void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
         if (!txin.IsZerocoinSpend()) {
             auto it = mapWallet.find(txin.prevout.hash);
             if (it != mapWallet.end()) {
-                it->second.MarkDirty();
+                it->second.MarkSpendsDirty(ISMINE_TRANSPARENT_ALL);
             }
         }
     }
@@ -1404,34 +1815,222 @@ void CWallet::MarkAffectedTransactionsDirty(const CTransaction& tx)
                 mapWallet.count(m_sspk_man->mapSaplingNullifiersToNotes[nullifier].hash)) {
                 auto it = mapWallet.find(m_sspk_man->mapSaplingNullifiersToNotes[nullifier].hash);
                 if (it != mapWallet.end()) {
-                    it->second.MarkDirty();
+                    it->second.MarkSpendsDirty(ISMINE_SHIELDED_ALL);
                 }
             }
         }
     }
 }
 
+void CWallet::MarkSpendersDirty(const CWalletTx& wtx)
+{
+    // The debit of the transactions spending wtx is computed from its outputs
+    // (and from the nullifiers of its notes)
+    const uint256& hash = wtx.GetHash();
+    for (TxSpends::const_iterator it = mapTxSpends.lower_bound(COutPoint(hash, 0));
+            it != mapTxSpends.end() && it->first.hash == hash; ++it) {
+        auto itSpender = mapWallet.find(it->second);
+        if (itSpender != mapWallet.end()) {
+            itSpender->second.MarkDirty();
+        }
+    }
+
+    if (HasSaplingSPKM()) {
+        for (const auto& it : wtx.mapSaplingNoteData) {
+            if (!it.second.nullifier) continue;
+            for (const uint256& spender : m_sspk_man->GetSaplingSpends(*it.second.nullifier)) {
+                auto itSpender = mapWallet.find(spender);
+                if (itSpender != mapWallet.end()) {
+                    itSpender->second.MarkDirty();
+                }
+            }
+        }
+    }
+}
+
+void CWallet::UpdateWalletTxHeight(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    const int nHeight = wtx.isConfirmed() ? wtx.m_confirm.block_height : std::numeric_limits<int>::max();
+    auto it = mapWalletTxHeight.find(wtx.GetHash());
+    if (it != mapWalletTxHeight.end()) {
+        if (it->second == nHeight) return;
+        setWalletTxByHeight.erase(std::make_pair(it->second, it->first));
+        it->second = nHeight;
+    } else {
+        mapWalletTxHeight.emplace(wtx.GetHash(), nHeight);
+    }
+    setWalletTxByHeight.emplace(nHeight, wtx.GetHash());
+}
+
+void CWallet::EraseWalletTxHeight(const uint256& hash)
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapWalletTxHeight.find(hash);
+    if (it == mapWalletTxHeight.end()) return;
+    setWalletTxByHeight.erase(std::make_pair(it->second, hash));
+    mapWalletTxHeight.erase(it);
+}
+
+std::vector<const CWalletTx*> CWallet::GetWalletTxsSince(int nHeight) const
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<const CWalletTx*> vRet;
+    for (auto it = setWalletTxByHeight.upper_bound(std::make_pair(nHeight, UINT256_MAX)); it != setWalletTxByHeight.end(); ++it) {
+        auto itWtx = mapWallet.find(it->second);
+        if (itWtx != mapWallet.end()) vRet.emplace_back(&itWtx->second);
+    }
+    return vRet;
+}
+
 void CWallet::EraseFromWallet(const uint256& hash)
 {
     {
         LOCK(cs_wallet);
-        if (mapWallet.erase(hash))
+        setStakeCandidates.erase(hash);
+        auto it = mapWallet.find(hash);
+        if (it != mapWallet.end()) {
+            const CTransactionRef tx = it->second.tx;
+            for (unsigned int i = 0; i < tx->vout.size(); i++) {
+                EraseFromWalletUTXO(COutPoint(hash, i));
+            }
+            m_sspk_man->EraseFromUnspentNotes(it->second);
+            EraseWalletTxHeight(hash);
+            mapWallet.erase(it);
             CWalletDB(*dbw).EraseTx(hash);
+            // The coins it spent are ours again, unless spent by another tx
+            for (const CTxIn& txin : tx->vin) {
+                AddToWalletUTXO(txin.prevout);
+            }
+            m_sspk_man->RestoreUnspentNotes(*tx);
+        }
+        MarkBalancesDirty();
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
     return;
 }
 
+bool CWallet::IsArchivable(const CWalletTx& wtx, int nMinDepth) const
+{
+    AssertLockHeld(cs_wallet);
+    if (wtx.tx->IsShieldedTx() || !wtx.mapSaplingNoteData.empty() ||
+            wtx.tx->HasZerocoinSpendInputs() || wtx.tx->HasZerocoinMintOutputs())
+        return false;
+    if (wtx.GetDepthInMainChain() < nMinDepth) return false;
+    const uint256& hash = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) == ISMINE_NO) continue;
+        const COutPoint outpoint(hash, i);
+        if (setArchivedSpends.count(outpoint)) continue;
+        bool fSpentDeep = false;
+        const auto range = mapTxSpends.equal_range(outpoint);
+        for (auto it = range.first; it != range.second && !fSpentDeep; ++it) {
+            const auto mit = mapWallet.find(it->second);
+            fSpentDeep = mit != mapWallet.end() && mit->second.GetDepthInMainChain() >= nMinDepth;
+        }
+        if (!fSpentDeep) return false;
+    }
+    return true;
+}
+
+void CWallet::LoadArchivedTx(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    const uint256& hash = wtx.GetHash();
+    setArchivedTxs.emplace(hash);
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (IsMine(wtx.tx->vout[i]) != ISMINE_NO) mapArchivedOutputs.emplace(COutPoint(hash, i), wtx.tx->vout[i]);
+    }
+    if (wtx.IsCoinBase()) return;
+    for (const CTxIn& txin : wtx.tx->vin) {
+        setArchivedSpends.emplace(txin.prevout);
+        EraseFromWalletUTXO(txin.prevout);
+    }
+}
+
+int CWallet::ArchiveWalletTxs(int nMinDepth)
+{
+    AssertLockHeld(cs_wallet);
+    std::vector<uint256> vArchive;
+    for (const auto& it : mapWallet) {
+        if (IsArchivable(it.second, nMinDepth)) vArchive.emplace_back(it.first);
+    }
+    if (vArchive.empty()) return 0;
+
+    // Move the records in one db transaction, so that a tx is never lost nor in both places
+    CWalletDB walletdb(*dbw);
+    if (!walletdb.TxnBegin()) return 0;
+    for (const uint256& hash : vArchive) {
+        if (!walletdb.WriteArchivedTx(mapWallet.at(hash)) || !walletdb.EraseTx(hash)) {
+            walletdb.TxnAbort();
+            LogPrintf("%s: failed to archive wallet tx %s\n", __func__, hash.GetHex());
+            return 0;
+        }
+    }
+    if (!walletdb.TxnCommit()) return 0;
+
+    for (const uint256& hash : vArchive) {
+        auto it = mapWallet.find(hash);
+        const CWalletTx& wtx = it->second;
+        LoadArchivedTx(wtx);
+        if (!wtx.IsCoinBase()) {
+            for (const CTxIn& txin : wtx.tx->vin) {
+                auto range = mapTxSpends.equal_range(txin.prevout);
+                for (auto sit = range.first; sit != range.second;) {
+                    sit = sit->second == hash ? mapTxSpends.erase(sit) : std::next(sit);
+                }
+            }
+        }
+        const auto range = wtxOrdered.equal_range(wtx.nOrderPos);
+        for (auto oit = range.first; oit != range.second; ++oit) {
+            if (oit->second == &wtx) {
+                wtxOrdered.erase(oit);
+                break;
+            }
+        }
+        setStakeCandidates.erase(hash);
+        EraseWalletTxHeight(hash);
+        mapWallet.erase(it);
+        NotifyTransactionChanged(this, hash, CT_DELETED);
+    }
+    MarkBalancesDirty();
+    LogPrintf("%s: archived %u wallet txs spent at least %d blocks deep\n", __func__, vArchive.size(), nMinDepth);
+    return (int) vArchive.size();
+}
+
+bool CWallet::GetArchivedTx(const uint256& hash, CWalletTx& wtxRet)
+{
+    {
+        LOCK(cs_wallet);
+        if (!setArchivedTxs.count(hash)) return false;
+    }
+    if (!CWalletDB(*dbw).ReadArchivedTx(hash, wtxRet)) return false;
+    wtxRet.BindWallet(this);
+    // The block height isn't serialized, see LoadToWallet
+    LOCK(cs_main);
+    Optional<int> block_height = getTipBlockHeight(wtxRet.m_confirm.hashBlock);
+    if (block_height) wtxRet.m_confirm.block_height = *block_height;
+    return true;
+}
+
+const CTxOut* CWallet::GetWalletTxOut(const COutPoint& outpoint) const
+{
+    AssertLockHeld(cs_wallet);
+    const auto it = mapWallet.find(outpoint.hash);
+    if (it != mapWallet.end()) {
+        return outpoint.n < it->second.tx->vout.size() ? &it->second.tx->vout[outpoint.n] : nullptr;
+    }
+    const auto ait = mapArchivedOutputs.find(outpoint);
+    return ait != mapArchivedOutputs.end() ? &ait->second : nullptr;
+}
+
 isminetype CWallet::IsMine(const CTxIn& txin) const
 {
     {
         LOCK(cs_wallet);
-        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end()) {
-            const CWalletTx& prev = (*mi).second;
-            if (txin.prevout.n < prev.tx->vout.size())
-                return IsMine(prev.tx->vout[txin.prevout.n]);
-        }
+        const CTxOut* prevout = GetWalletTxOut(txin.prevout);
+        if (prevout)
+            return IsMine(*prevout);
     }
     return ISMINE_NO;
 }
@@ -1461,13 +2060,9 @@ CAmount CWallet::GetDebit(const CTxIn& txin, const isminefilter& filter) const
 {
     {
         LOCK(cs_wallet);
-        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
-        if (mi != mapWallet.end()) {
-            const CWalletTx& prev = (*mi).second;
-            if (txin.prevout.n < prev.tx->vout.size())
-                if (IsMine(prev.tx->vout[txin.prevout.n]) & filter)
-                    return prev.tx->vout[txin.prevout.n].nValue;
-        }
+        const CTxOut* prevout = GetWalletTxOut(txin.prevout);
+        if (prevout && (IsMine(*prevout) & filter))
+            return prevout->nValue;
     }
     return 0;
 }
@@ -1481,7 +2076,7 @@ bool CWallet::IsChange(const CTxOut& txout) const
     // a better way of identifying which outputs are 'the send' and which are
     // 'the change' will need to be implemented (maybe extend CWalletTx to remember
     // which output, if any, was change).
-    if (::IsMine(*this, txout.scriptPubKey)) {
+    if (m_spk_man->IsMine(txout.scriptPubKey)) {
         CTxDestination address;
         if (!ExtractDestination(txout.scriptPubKey, address))
             return true;
@@ -1685,7 +2280,7 @@ CAmount CWalletTx::GetLockedCredit() const
         }
 
         // Add masternode collaterals which are handled like locked coins
-        else if (fMasterNode && tx->vout[i].nValue == GetMNCollateral(chainActive.Height())) {
+        else if (fMasterNode && tx->vout[i].nValue == GetMNCollateral(GetChainTipSnapshot()->nHeight)) {
             nCredit += pwallet->GetCredit(txout, ISMINE_SPENDABLE);
         }
 
@@ -1714,6 +2309,22 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
     std::list<COutputEntry>& listSent,
     CAmount& nFee,
     const isminefilter& filter) const
+{
+    auto it = mapCachedOutputEntries.find(filter);
+    if (it == mapCachedOutputEntries.end()) {
+        CachedOutputEntries entries;
+        ComputeAmounts(entries.listReceived, entries.listSent, entries.nFee, filter);
+        it = mapCachedOutputEntries.emplace(filter, std::move(entries)).first;
+    }
+    listReceived = it->second.listReceived;
+    listSent = it->second.listSent;
+    nFee = it->second.nFee;
+}
+
+void CWalletTx::ComputeAmounts(std::list<COutputEntry>& listReceived,
+    std::list<COutputEntry>& listSent,
+    CAmount& nFee,
+    const isminefilter& filter) const
 {
     nFee = 0;
     listReceived.clear();
@@ -1807,10 +2418,132 @@ bool CWallet::Upgrade(std::string& error, const int& prevVersion)
     return true;
 }
 
+/**
+ * Prefetch and match stages of the wallet rescan pipeline.
+ * A background thread reads and deserializes the blocks ahead of the commit
+ * stage, and trial-decrypts their shielded outputs (in parallel, see
+ * SaplingScriptPubKeyMan::FindMySaplingNotes), without holding cs_main
+ * or cs_wallet. Blocks are handed out in chain order.
+ */
+class CRescanPrefetcher
+{
+public:
+    struct Item {
+        CBlockIndex* pindex{nullptr};
+        CBlock block;
+        bool fReadOk{false};
+        std::vector<SaplingNotesFound> vSaplingNotes;
+    };
+
+    /**
+     * With pFilterElementsIn, the blocks whose basic filter (-blockfilterindex) matches none
+     * of the elements are skipped, unless they could hold shielded notes of ours.
+     */
+    CRescanPrefetcher(const CWallet* pwalletIn, std::vector<CBlockIndex*>&& vIndexesIn, size_t nMaxAheadIn,
+                      const GCSFilter::ElementSet* pFilterElementsIn = nullptr, bool fShieldedKeysIn = false) :
+        pwallet(pwalletIn), vIndexes(std::move(vIndexesIn)), nMaxAhead(std::max<size_t>(nMaxAheadIn, 1)),
+        pFilterElements(pFilterElementsIn), fShieldedKeys(fShieldedKeysIn)
+    {
+        thread = std::thread(&CRescanPrefetcher::ThreadPrefetch, this);
+    }
+
+    ~CRescanPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fStop = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+
+    //! Wait for the next block in order. Returns false once all the blocks were handed out.
+    bool Next(Item& itemRet)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        cond.wait(lock, [this]{ return !queue.empty() || fDone; });
+        if (queue.empty()) return false;
+        itemRet = std::move(queue.front());
+        queue.pop_front();
+        cond.notify_all();
+        return true;
+    }
+
+    //! Number of blocks skipped by the filters
+    size_t GetSkipped() const { return nSkipped; }
+
+private:
+    const CWallet* pwallet;
+    // The caller may hold cs_main for the whole rescan, so the blocks to read are
+    // resolved upfront instead of walking chainActive from this thread.
+    const std::vector<CBlockIndex*> vIndexes;
+    const size_t nMaxAhead;
+    const GCSFilter::ElementSet* pFilterElements;
+    const bool fShieldedKeys;
+    std::atomic<size_t> nSkipped{0};
+    std::mutex cs;
+    std::condition_variable cond;
+    std::deque<Item> queue;
+    bool fStop{false};
+    bool fDone{false};
+    std::thread thread;
+
+    // Whether the block can't have any transaction of ours. Without its filter, it must be read.
+    bool CanSkip(const CBlockIndex* pindex) const
+    {
+        if (!pFilterElements || !g_blockfilterindex) return false;
+        // The filters hold the transparent scripts only, the shielded outputs must be trial-decrypted
+        if (fShieldedKeys && pindex->pprev &&
+                Params().GetConsensus().NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_V5_0))
+            return false;
+        BlockFilter filter;
+        return g_blockfilterindex->LookupFilter(pindex, filter) && !filter.GetFilter().MatchAny(*pFilterElements);
+    }
+
+    void ThreadPrefetch()
+    {
+        util::ThreadRename("dogecash-rescan");
+        for (CBlockIndex* pindex : vIndexes) {
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                cond.wait(lock, [this]{ return queue.size() < nMaxAhead || fStop; });
+                if (fStop) break;
+            }
+
+            if (CanSkip(pindex)) {
+                nSkipped++;
+                continue;
+            }
+
+            Item item;
+            item.pindex = pindex;
+            item.fReadOk = ReadBlockFromDisk(item.block, pindex);
+            if (item.fReadOk && pwallet->HasSaplingSPKM()) {
+                item.vSaplingNotes = pwallet->GetSaplingScriptPubKeyMan()->FindMySaplingNotes(item.block.vtx);
+            }
+
+            const bool fReadOk = item.fReadOk;
+            {
+                std::lock_guard<std::mutex> lock(cs);
+                queue.emplace_back(std::move(item));
+            }
+            cond.notify_all();
+            if (!fReadOk) break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(cs);
+            fDone = true;
+        }
+        cond.notify_all();
+    }
+};
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ * Blocks are read and trial-decrypted ahead by a CRescanPrefetcher, this
+ * thread only commits them, in order, to the wallet.
  * @returns -1 if process was cancelled or the number of tx added to the wallet.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool fromStartup)
@@ -1818,8 +2551,6 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
     int ret = 0;
     int64_t nNow = GetTime();
 
-    const Consensus::Params& consensus = Params().GetConsensus();
-
     CBlockIndex* pindex = pindexStart;
     {
         LOCK(cs_main);
@@ -1836,63 +2567,114 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
         double dProgressTip = 0.0;
         std::vector<uint256> myTxHashes;
 
-        double gvp = dProgressStart;
-        while (pindex) {
-            gvp = Checkpoints::GuessVerificationProgress(pindex, false);
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int) ((gvp - dProgressStart) /
-                                                                                 (dProgressTip - dProgressStart) *
-                                                                                 100))));
-            }
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, gvp);
-            }
-            if (fromStartup && ShutdownRequested()) {
-                return -1;
+        m_scanning_start = GetTimeMillis();
+        m_scanning_progress = 0;
+        m_scanning_blocks = 0;
+        fScanningWallet = true;
+
+        // Skip the blocks that the filters rule out, when the index is there (see GetRescanScripts)
+        std::unique_ptr<GCSFilter::ElementSet> pFilterElements;
+        bool fShieldedKeys = false;
+        if (g_blockfilterindex && gArgs.GetBoolArg("-rescanblockfilter", DEFAULT_RESCAN_BLOCK_FILTER)) {
+            pFilterElements.reset(new GCSFilter::ElementSet());
+            for (const CScript& script : GetRescanScripts()) {
+                pFilterElements->emplace(script.begin(), script.end());
             }
+            LOCK(cs_KeyStore);
+            fShieldedKeys = !mapSaplingIncomingViewingKeys.empty();
+        }
+        size_t nSkipped = 0;
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex)) {
-                LogPrintf("Unable to read block %d (%s) from disk.", pindex->nHeight, pindex->GetBlockHash().ToString());
-                return -1;
+        double gvp = dProgressStart;
+        bool fAbort = false;
+        while (pindex && !fAbort) {
+            // Resolve the next segment of the active chain to scan
+            std::vector<CBlockIndex*> vIndexes;
+            {
+                LOCK(cs_main);
+                for (; pindex && vIndexes.size() < RESCAN_SEGMENT_BLOCKS; pindex = chainActive.Next(pindex)) {
+                    vIndexes.emplace_back(pindex);
+                }
             }
 
-            {
-                LOCK2(cs_main, cs_wallet);
-                if (tip != chainActive.Tip()) {
-                    tip = chainActive.Tip();
-                    // in case the tip has changed, update progress max
-                    dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
+            CBlockIndex* pindexLast = vIndexes.back();
+            CRescanPrefetcher prefetcher(this, std::move(vIndexes), RESCAN_PREFETCH_BLOCKS, pFilterElements.get(), fShieldedKeys);
+            CRescanPrefetcher::Item item;
+            while (prefetcher.Next(item)) {
+                CBlockIndex* pindexScan = item.pindex;
+                gvp = Checkpoints::GuessVerificationProgress(pindexScan, false);
+                if (dProgressTip - dProgressStart > 0.0) {
+                    m_scanning_progress = std::max(0.0, std::min(1.0, (gvp - dProgressStart) / (dProgressTip - dProgressStart)));
+                }
+                if (pindexScan->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int) (m_scanning_progress * 100))));
+                }
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexScan->nHeight, gvp);
+                }
+                if (fromStartup && ShutdownRequested()) {
+                    fScanningWallet = false;
+                    return -1;
                 }
 
-                if (!chainActive.Contains(pindex)) {
-                    // Abort scan if current block is no longer active, to prevent
-                    // marking transactions as coming from the wrong block.
-                    break;
+                if (!item.fReadOk) {
+                    LogPrintf("Unable to read block %d (%s) from disk.", pindexScan->nHeight, pindexScan->GetBlockHash().ToString());
+                    fScanningWallet = false;
+                    return -1;
                 }
-                for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
-                    const auto& tx = block.vtx[posInBlock];
-                    CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindex->nHeight, pindex->GetBlockHash(), posInBlock);
-                    if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate)) {
-                        myTxHashes.push_back(tx->GetHash());
-                        ret++;
+                const CBlock& block = item.block;
+
+                {
+                    LOCK2(cs_main, cs_wallet);
+                    if (tip != chainActive.Tip()) {
+                        tip = chainActive.Tip();
+                        // in case the tip has changed, update progress max
+                        dProgressTip = Checkpoints::GuessVerificationProgress(tip, false);
                     }
-                }
 
-                // Sapling
-                // This should never fail: we should always be able to get the tree
-                // state on the path to the tip of our chain
-                if (pindex->pprev) {
-                    if (Params().GetConsensus().NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_V5_0)) {
-                        SaplingMerkleTree saplingTree;
-                        assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
-                        // Increment note witness caches
-                        ChainTipAdded(pindex, &block, saplingTree);
+                    if (!chainActive.Contains(pindexScan)) {
+                        // Abort scan if current block is no longer active, to prevent
+                        // marking transactions as coming from the wrong block.
+                        fAbort = true;
+                        break;
                     }
+                    for (int posInBlock = 0; posInBlock < (int) block.vtx.size(); posInBlock++) {
+                        const auto& tx = block.vtx[posInBlock];
+                        CWalletTx::Confirmation confirm(CWalletTx::Status::CONFIRMED, pindexScan->nHeight, pindexScan->GetBlockHash(), posInBlock);
+                        if (AddToWalletIfInvolvingMe(tx, confirm, fUpdate, item.vSaplingNotes.empty() ? nullptr : &item.vSaplingNotes[posInBlock])) {
+                            myTxHashes.push_back(tx->GetHash());
+                            ret++;
+                        }
+                    }
+
+                    // Sapling
+                    // This should never fail: we should always be able to get the tree
+                    // state on the path to the tip of our chain
+                    if (pindexScan->pprev) {
+                        if (Params().GetConsensus().NetworkUpgradeActive(pindexScan->pprev->nHeight, Consensus::UPGRADE_V5_0)) {
+                            SaplingMerkleTree saplingTree;
+                            assert(pcoinsTip->GetSaplingAnchorAt(pindexScan->pprev->hashFinalSaplingRoot, saplingTree));
+                            // Increment note witness caches
+                            ChainTipAdded(pindexScan, &block, saplingTree);
+                        }
+                    }
+
+                    // Continue from the active chain, which could have grown meanwhile
+                    pindex = chainActive.Next(pindexScan);
                 }
+                m_scanning_blocks++;
+            }
+            nSkipped += prefetcher.GetSkipped();
 
-                pindex = chainActive.Next(pindex);
+            // The last blocks of the segment may have been skipped
+            if (!fAbort && pFilterElements) {
+                LOCK(cs_main);
+                if (chainActive.Contains(pindexLast)) {
+                    pindex = chainActive.Next(pindexLast);
+                } else {
+                    fAbort = true;
+                }
             }
         }
 
@@ -1909,11 +2691,47 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
             }
         }
 
+        const int64_t nDuration = GetTimeMillis() - m_scanning_start;
+        LogPrintf("Rescan completed: %d blocks in %dms (%.2f blocks/s)\n", m_scanning_blocks,
+                  nDuration, nDuration > 0 ? 1000.0 * m_scanning_blocks / nDuration : 0.0);
+        if (pFilterElements) {
+            LogPrintf("Rescan skipped %u blocks not matching the wallet scripts in their block filter\n", nSkipped);
+        }
+        fScanningWallet = false;
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
 }
 
+std::set<CScript> CWallet::GetRescanScripts() const
+{
+    std::set<CScript> setScripts;
+    {
+        LOCK(cs_KeyStore);
+        auto addKey = [&setScripts](const CPubKey& pubkey) {
+            setScripts.emplace(GetScriptForDestination(pubkey.GetID()));
+            setScripts.emplace(GetScriptForRawPubKey(pubkey));
+        };
+        std::set<CKeyID> setKeys;
+        GetKeys(setKeys);
+        for (const CKeyID& keyID : setKeys) {
+            CPubKey pubkey;
+            if (GetPubKey(keyID, pubkey)) addKey(pubkey);
+        }
+        for (const auto& it : mapWatchKeys) addKey(it.second);
+        for (const CScript& script : setWatchOnly) setScripts.emplace(script);
+        for (const auto& it : mapScripts) setScripts.emplace(GetScriptForDestination(it.first));
+    }
+    // The P2CS and multisig scripts can't be derived from the keys, only the ones already seen are known
+    LOCK(cs_wallet);
+    for (const auto& it : mapWallet) {
+        for (const CTxOut& txout : it.second.tx->vout) {
+            if (IsMine(txout) != ISMINE_NO) setScripts.emplace(txout.scriptPubKey);
+        }
+    }
+    return setScripts;
+}
+
 void CWallet::ReacceptWalletTransactions(bool fFirstLoad)
 {
     LOCK2(cs_main, cs_wallet);
@@ -2062,6 +2880,10 @@ CWallet::Balance CWallet::GetBalance(const int min_depth) const
     Balance ret;
     {
         LOCK(cs_wallet);
+        CheckCachedBalances();
+        const auto& itCached = mapCachedBalanceByDepth.find(min_depth);
+        if (itCached != mapCachedBalanceByDepth.end()) return itCached->second;
+
         std::set<uint256> trusted_parents;
         for (const auto& entry : mapWallet) {
             const CWalletTx& wtx = entry.second;
@@ -2082,15 +2904,53 @@ CWallet::Balance CWallet::GetBalance(const int min_depth) const
             }
             ret.m_mine_immature += wtx.GetImmatureCredit();
         }
+        mapCachedBalanceByDepth.emplace(min_depth, ret);
     }
     return ret;
 }
 
-CAmount CWallet::loopTxsBalance(std::function<void(const uint256&, const CWalletTx&, CAmount&)> method) const
+void CWallet::CheckCachedBalances() const
+{
+    AssertLockHeld(cs_wallet);
+    const uint64_t nVersion = nBalancesVersion.load();
+    if (nVersion != nCachedBalancesVersion || m_last_block_processed != nCachedBalancesBlock) {
+        mapCachedBalances.clear();
+        mapCachedBalanceByDepth.clear();
+        nCachedBalancesVersion = nVersion;
+        nCachedBalancesBlock = m_last_block_processed;
+    }
+}
+
+CAmount CWallet::GetCachedBalance(BalanceType type, int nFilter, int nMinDepth, std::function<void(const uint256&, const CWalletTx&, CAmount&)> method, bool fP2CSOnly) const
+{
+    LOCK(cs_wallet);
+    CheckCachedBalances();
+    const auto& key = std::make_tuple((int)type, nFilter, nMinDepth);
+    const auto& it = mapCachedBalances.find(key);
+    if (it != mapCachedBalances.end()) return it->second;
+
+    const CAmount nTotal = loopTxsBalance(method, fP2CSOnly);
+    mapCachedBalances.emplace(key, nTotal);
+    return nTotal;
+}
+
+CAmount CWallet::loopTxsBalance(std::function<void(const uint256&, const CWalletTx&, CAmount&)> method, bool fP2CSOnly) const
 {
     CAmount nTotal = 0;
     {
         LOCK(cs_wallet);
+        if (fP2CSOnly) {
+            // the txes with P2CS outputs of ours not spent in the chain, the
+            // only ones with a cold staking or a delegated credit
+            std::set<uint256> setTxids;
+            for (const COutPoint& outpoint : GetP2CSOutpoints()) {
+                setTxids.insert(outpoint.hash);
+            }
+            for (const uint256& txid : setTxids) {
+                method(txid, mapWallet.at(txid), nTotal);
+            }
+            return nTotal;
+        }
         for (const auto& it : mapWallet) {
             method(it.first, it.second, nTotal);
         }
@@ -2115,26 +2975,28 @@ CAmount CWallet::GetAvailableBalance(bool fIncludeDelegated, bool fIncludeShield
 
 CAmount CWallet::GetAvailableBalance(isminefilter& filter, bool useCache, int minDepth) const
 {
-    return loopTxsBalance([filter, useCache, minDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal){
+    auto method = [filter, useCache, minDepth](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal){
         bool fConflicted;
         int depth;
         if (pcoin.IsTrusted(depth, fConflicted) && depth >= minDepth) {
             nTotal += pcoin.GetAvailableCredit(useCache, filter);
         }
-    });
+    };
+    // without useCache the credits are recomputed, so skip the cached balance as well
+    return useCache ? GetCachedBalance(BALANCE_AVAILABLE, filter, minDepth, method) : loopTxsBalance(method);
 }
 
 CAmount CWallet::GetColdStakingBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_COLD_STAKING, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
         if (pcoin.tx->HasP2CSOutputs() && pcoin.IsTrusted())
             nTotal += pcoin.GetColdStakingCredit();
-    });
+    }, true);
 }
 
 CAmount CWallet::GetStakingBalance(const bool fIncludeColdStaking) const
 {
-    return std::max(CAmount(0), loopTxsBalance(
+    return std::max(CAmount(0), GetCachedBalance(BALANCE_STAKING, fIncludeColdStaking, 0,
             [fIncludeColdStaking](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
         if (pcoin.IsTrusted() && pcoin.GetDepthInMainChain() >= Params().GetConsensus().nStakeMinDepth) {
             nTotal += pcoin.GetAvailableCredit();       // available coins
@@ -2148,10 +3010,10 @@ CAmount CWallet::GetStakingBalance(const bool fIncludeColdStaking) const
 
 CAmount CWallet::GetDelegatedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_DELEGATED, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             if (pcoin.tx->HasP2CSOutputs() && pcoin.IsTrusted())
                 nTotal += pcoin.GetStakeDelegationCredit();
-    });
+    }, true);
 }
 
 CAmount CWallet::GetLockedCoins() const
@@ -2176,7 +3038,7 @@ CAmount CWallet::GetLockedCoins() const
 
 CAmount CWallet::GetUnconfirmedBalance(isminetype filter) const
 {
-    return loopTxsBalance([filter](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_UNCONFIRMED, filter, 0, [filter](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
                 nTotal += pcoin.GetCredit(filter);
     });
@@ -2184,28 +3046,28 @@ CAmount CWallet::GetUnconfirmedBalance(isminetype filter) const
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_IMMATURE, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             nTotal += pcoin.GetImmatureCredit(false);
     });
 }
 
 CAmount CWallet::GetImmatureColdStakingBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_IMMATURE_COLD_STAKING, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             nTotal += pcoin.GetImmatureCredit(false, ISMINE_COLD);
     });
 }
 
 CAmount CWallet::GetImmatureDelegatedBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_IMMATURE_DELEGATED, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             nTotal += pcoin.GetImmatureCredit(false, ISMINE_SPENDABLE_DELEGATED);
     });
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_WATCHONLY, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             if (pcoin.IsTrusted())
                 nTotal += pcoin.GetAvailableWatchOnlyCredit();
     });
@@ -2213,7 +3075,7 @@ CAmount CWallet::GetWatchOnlyBalance() const
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_UNCONFIRMED_WATCHONLY, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             if (!pcoin.IsTrusted() && pcoin.GetDepthInMainChain() == 0 && pcoin.InMempool())
                 nTotal += pcoin.GetAvailableWatchOnlyCredit();
     });
@@ -2221,7 +3083,7 @@ CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    return loopTxsBalance([](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
+    return GetCachedBalance(BALANCE_IMMATURE_WATCHONLY, 0, 0, [](const uint256& id, const CWalletTx& pcoin, CAmount& nTotal) {
             nTotal += pcoin.GetImmatureWatchOnlyCredit();
     });
 }
@@ -2278,13 +3140,31 @@ CAmount CWallet::GetUnconfirmedShieldedBalance() const
     return GetUnconfirmedBalance(ISMINE_SPENDABLE_SHIELDED);
 };
 
+std::set<COutPoint> CWallet::GetP2CSOutpoints(bool fExcludeWhitelisted) const
+{
+    LOCK(cs_wallet);
+    std::set<COutPoint> setOutpoints;
+    if (fExcludeWhitelisted) {
+        for (const auto& it : mapP2CSByOwner) {
+            if (!HasAddressBook(it.first)) setOutpoints.insert(it.second.begin(), it.second.end());
+        }
+        return setOutpoints;
+    }
+    for (const auto& it : mapP2CSByStaker) {
+        setOutpoints.insert(it.second.begin(), it.second.end());
+    }
+    return setOutpoints;
+}
+
 void CWallet::GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const {
     vCoins.clear();
     {
         LOCK(cs_wallet);
-        for (const auto& it : mapWallet) {
-            const uint256& wtxid = it.first;
-            const CWalletTx* pcoin = &it.second;
+        for (const COutPoint& outpoint : GetP2CSOutpoints()) {
+            const CWalletTx* pcoin = &mapWallet.at(outpoint.hash);
+            const auto &utxo = pcoin->tx->vout[outpoint.n];
+            if (!utxo.scriptPubKey.IsPayToColdStaking())
+                continue;
 
             bool fConflicted;
             int nDepth = pcoin->GetDepthAndMempool(fConflicted);
@@ -2292,22 +3172,14 @@ void CWallet::GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const {
             if (fConflicted || nDepth < 0)
                 continue;
 
-            if (pcoin->tx->HasP2CSOutputs()) {
-                for (int i = 0; i < (int) pcoin->tx->vout.size(); i++) {
-                    const auto &utxo = pcoin->tx->vout[i];
-
-                    if (IsSpent(wtxid, i))
-                        continue;
+            if (IsSpent(outpoint))
+                continue;
 
-                    if (utxo.scriptPubKey.IsPayToColdStaking()) {
-                        isminetype mine = IsMine(utxo);
-                        bool isMineSpendable = mine & ISMINE_SPENDABLE_DELEGATED;
-                        if (mine & ISMINE_COLD || isMineSpendable)
-                            // Depth and solvability members are not used, no need waste resources and set them for now.
-                            vCoins.emplace_back(pcoin, i, 0, isMineSpendable, true);
-                    }
-                }
-            }
+            isminetype mine = IsMine(utxo);
+            bool isMineSpendable = mine & ISMINE_SPENDABLE_DELEGATED;
+            if (mine & ISMINE_COLD || isMineSpendable)
+                // Depth and solvability members are not used, no need waste resources and set them for now.
+                vCoins.emplace_back(pcoin, (int) outpoint.n, 0, isMineSpendable, true);
         }
     }
 
@@ -2384,7 +3256,7 @@ bool CWallet::GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet, CKey&
     CTxOut txOut = wtx->tx->vout[nOutputIndex];
 
     // Masternode collateral value
-    if (txOut.nValue != GetMNCollateral(chainActive.Height())) {
+    if (txOut.nValue != GetMNCollateral(GetChainTipSnapshot()->nHeight)) {
         strError = "Invalid collateral tx value, must be 5,000 DOGEC or 15,000 DOGEC";
         return error("%s: tx %s, index %d not a masternode collateral", __func__, strTxHash, nOutputIndex);
     }
@@ -2439,7 +3311,7 @@ CWallet::OutputAvailabilityResult CWallet::CheckOutputAvailability(
     OutputAvailabilityResult res;
 
     // Check for only 5k utxo
-    if (nCoinType == ONLY_5000 && output.nValue != GetMNCollateral(chainActive.Height())) return res;
+    if (nCoinType == ONLY_5000 && output.nValue != GetMNCollateral(GetChainTipSnapshot()->nHeight)) return res;
 
     // Check for stakeable utxo
     if (nCoinType == STAKEABLE_COINS && output.IsZerocoinMint()) return res;
@@ -2495,68 +3367,88 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
 
     {
         LOCK(cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        // Walk the outputs to the filtered destinations only, when given
+        std::set<COutPoint> setFilteredUTXO;
+        const bool fFilterDest = coinsFilter.onlyFilteredDest && !coinsFilter.onlyFilteredDest->empty();
+        if (fFilterDest) {
+            for (const CTxDestination& dest : *coinsFilter.onlyFilteredDest) {
+                const auto it = mapWalletUTXOByDest.find(dest);
+                if (it != mapWalletUTXOByDest.end()) {
+                    setFilteredUTXO.insert(it->second.begin(), it->second.end());
+                }
+            }
+        }
 
-            // Check if the tx is selectable
-            int nDepth;
-            if (!CheckTXAvailability(pcoin, coinsFilter.fOnlyConfirmed, nDepth, m_last_block_processed_height))
-                continue;
+        const CWalletTx* pcoin = nullptr;
+        bool fTxAvailable = false;
+        int nDepth = 0;
+        const auto checkOutput = [&](const COutPoint& outpoint, isminetype mine) {
+            // The outpoints are sorted, so the tx checks run once per tx
+            if (!pcoin || pcoin->GetHash() != outpoint.hash) {
+                pcoin = &mapWallet.at(outpoint.hash);
+                fTxAvailable =
+                        // Check if the tx is selectable
+                        CheckTXAvailability(pcoin, coinsFilter.fOnlyConfirmed, nDepth, m_last_block_processed_height) &&
+                        // Check min depth requirement for stake inputs
+                        !(coinsFilter.nCoinType == STAKEABLE_COINS && nDepth < Params().GetConsensus().nStakeMinDepth) &&
+                        // Check min depth filtering requirements
+                        nDepth >= coinsFilter.minDepth;
+            }
+            if (!fTxAvailable) return false;
 
-            // Check min depth requirement for stake inputs
-            if (coinsFilter.nCoinType == STAKEABLE_COINS && nDepth < Params().GetConsensus().nStakeMinDepth) continue;
+            // Skip the ownership types that are not requested
+            if (mine == ISMINE_COLD && !coinsFilter.fIncludeColdStaking) return false;
+            if (mine == ISMINE_SPENDABLE_DELEGATED && !coinsFilter.fIncludeDelegated) return false;
 
-            // Check min depth filtering requirements
-            if (nDepth < coinsFilter.minDepth) continue;
+            const unsigned int i = outpoint.n;
+            const auto& output = pcoin->tx->vout[i];
 
-            for (unsigned int i = 0; i < pcoin->tx->vout.size(); i++) {
-                const auto& output = pcoin->tx->vout[i];
+            // Filter by value if needed
+            if (coinsFilter.nMaxOutValue > 0 && output.nValue > coinsFilter.nMaxOutValue) {
+                return false;
+            }
 
-                // Filter by value if needed
-                if (coinsFilter.nMaxOutValue > 0 && output.nValue > coinsFilter.nMaxOutValue) {
-                    continue;
-                }
+            // Now check for chain availability
+            auto res = CheckOutputAvailability(
+                    output,
+                    i,
+                    outpoint.hash,
+                    coinsFilter.nCoinType,
+                    coinControl,
+                    fCoinsSelected,
+                    coinsFilter.fIncludeColdStaking,
+                    coinsFilter.fIncludeDelegated,
+                    coinsFilter.fIncludeLocked);
+
+            if (!res.available) return false;
+            if (coinsFilter.fOnlySpendable && !res.spendable) return false;
 
-                // Filter by specific destinations if needed
-                if (coinsFilter.onlyFilteredDest && !coinsFilter.onlyFilteredDest->empty()) {
-                    CTxDestination address;
-                    if (!ExtractDestination(output.scriptPubKey, address) || !coinsFilter.onlyFilteredDest->count(address)) {
-                        continue;
-                    }
-                }
+            // found valid coin
+            if (pCoins) pCoins->emplace_back(pcoin, (int) i, nDepth, res.spendable, res.solvable);
+            return true;
+        };
 
-                // Now check for chain availability
-                auto res = CheckOutputAvailability(
-                        output,
-                        i,
-                        wtxid,
-                        coinsFilter.nCoinType,
-                        coinControl,
-                        fCoinsSelected,
-                        coinsFilter.fIncludeColdStaking,
-                        coinsFilter.fIncludeDelegated,
-                        coinsFilter.fIncludeLocked);
-
-                if (!res.available) continue;
-                if (coinsFilter.fOnlySpendable && !res.spendable) continue;
-
-                // found valid coin
-                if (!pCoins) return true;
-                pCoins->emplace_back(pcoin, (int) i, nDepth, res.spendable, res.solvable);
+        if (fFilterDest) {
+            for (const COutPoint& outpoint : setFilteredUTXO) {
+                if (checkOutput(outpoint, mapWalletUTXO.at(outpoint)) && !pCoins) return true;
+            }
+        } else {
+            for (const auto& it : mapWalletUTXO) {
+                if (checkOutput(it.first, it.second) && !pCoins) return true;
             }
         }
         return (pCoins && !pCoins->empty());
     }
 }
 
-std::map<CTxDestination , std::vector<COutput> > CWallet::AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue, bool fIncludeColdStaking)
+std::map<CTxDestination , std::vector<COutput> > CWallet::AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue, bool fIncludeColdStaking, std::set<CTxDestination>* onlyFilteredDest)
 {
     CWallet::AvailableCoinsFilter coinFilter;
     coinFilter.fIncludeColdStaking = true;
     coinFilter.fOnlyConfirmed = fConfirmed;
     coinFilter.fIncludeColdStaking = fIncludeColdStaking;
     coinFilter.nMaxOutValue = maxCoinValue;
+    coinFilter.onlyFilteredDest = onlyFilteredDest;
     std::vector<COutput> vCoins;
     AvailableCoins(&vCoins, nullptr, coinFilter);
 
@@ -2621,6 +3513,95 @@ static void ApproximateBestSubset(std::vector<std::pair<CAmount, std::pair<const
     }
 }
 
+//! Maximum number of branches visited by SelectCoinsBnB
+static const size_t BNB_TOTAL_TRIES = 100000;
+
+struct BnBCoin {
+    //! Value minus the fee to spend it at the current fee rate
+    CAmount nEffectiveValue;
+    //! Fee to spend it now, minus the fee at the consolidation fee rate
+    CAmount nWaste;
+    std::pair<const CWalletTx*, unsigned int> coin;
+};
+
+/**
+ * Branch and bound search for the coins whose effective values sum up to
+ * between nTarget and nTarget + nCostOfChange, so that no change output is
+ * needed. Among the solutions found it keeps the one with the least waste:
+ * the excess over the target, plus the waste of each input. vCoins must be
+ * sorted by descending effective value.
+ */
+static bool SelectCoinsBnB(const std::vector<BnBCoin>& vCoins, const CAmount& nTarget, const CAmount& nCostOfChange, bool fFeeRateHigh, std::vector<char>& vfBest)
+{
+    CAmount nAvailable = 0;
+    for (const BnBCoin& coin : vCoins) nAvailable += coin.nEffectiveValue;
+    if (nAvailable < nTarget) return false;
+
+    std::vector<size_t> vCurr;
+    std::vector<size_t> vBest;
+    CAmount nCurrValue = 0;
+    CAmount nCurrWaste = 0;
+    CAmount nBestWaste = std::numeric_limits<CAmount>::max();
+
+    for (size_t nTries = 0, nIndex = 0; nTries < BNB_TOTAL_TRIES; ++nTries, ++nIndex) {
+        bool fBacktrack = false;
+        if (nCurrValue + nAvailable < nTarget ||        // the target can't be reached anymore
+            nCurrValue > nTarget + nCostOfChange ||     // the selection went over the window
+            (nCurrWaste > nBestWaste && fFeeRateHigh)) { // each input only adds waste
+            fBacktrack = true;
+        } else if (nCurrValue >= nTarget) {
+            const CAmount nWaste = nCurrWaste + (nCurrValue - nTarget);
+            if (nWaste <= nBestWaste) {
+                vBest = vCurr;
+                nBestWaste = nWaste;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // Everything explored
+            if (vCurr.empty()) break;
+            // Give back the omitted coins, then try the omission branch of
+            // the last included one
+            for (--nIndex; nIndex > vCurr.back(); --nIndex) {
+                nAvailable += vCoins[nIndex].nEffectiveValue;
+            }
+            nCurrValue -= vCoins[nIndex].nEffectiveValue;
+            nCurrWaste -= vCoins[nIndex].nWaste;
+            vCurr.pop_back();
+        } else {
+            const BnBCoin& coin = vCoins[nIndex];
+            nAvailable -= coin.nEffectiveValue;
+            // Skip the branch equal to the one just explored, when the
+            // previous coin was the same and excluded
+            if (vCurr.empty() || nIndex - 1 == vCurr.back() ||
+                    coin.nEffectiveValue != vCoins[nIndex - 1].nEffectiveValue ||
+                    coin.nWaste != vCoins[nIndex - 1].nWaste) {
+                vCurr.push_back(nIndex);
+                nCurrValue += coin.nEffectiveValue;
+                nCurrWaste += coin.nWaste;
+            }
+        }
+    }
+
+    if (vBest.empty()) return false;
+    vfBest.assign(vCoins.size(), false);
+    for (size_t i : vBest) vfBest[i] = true;
+    return true;
+}
+
+// Estimated size of an input spending scriptPubKey, signed
+static unsigned int GetEstimatedInputSize(const CScript& scriptPubKey)
+{
+    // prevout, nSequence, scriptSig size and signature
+    unsigned int nSize = 36 + 4 + 1 + 73;
+    // pubkey
+    if (scriptPubKey.IsPayToPublicKeyHash() || scriptPubKey.IsPayToColdStaking()) nSize += 34;
+    // P2CS owner/staker flag
+    if (scriptPubKey.IsPayToColdStaking()) nSize += 1;
+    return nSize;
+}
+
 bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
 {
     const bool fIncludeColdStaking = !sporkManager.IsSporkActive(SPORK_19_COLDSTAKING_MAINTENANCE) &&
@@ -2629,14 +3610,29 @@ bool CWallet::StakeableCoins(std::vector<CStakeableOutput>* pCoins)
     if (pCoins) pCoins->clear();
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& it : mapWallet) {
-        const uint256& wtxid = it.first;
-        const CWalletTx* pcoin = &(it).second;
+    for (auto it = setStakeCandidates.begin(); it != setStakeCandidates.end(); ) {
+        const uint256 wtxid = *it;
+        const auto mit = mapWallet.find(wtxid);
+        if (mit == mapWallet.end()) {
+            it = setStakeCandidates.erase(it);
+            continue;
+        }
+        const CWalletTx* pcoin = &mit->second;
 
         // Check if the tx is selectable
-        int nDepth;
-        if (!CheckTXAvailability(pcoin, true, nDepth))
+        int nDepth = 0;
+        if (!CheckTXAvailability(pcoin, true, nDepth)) {
+            ++it;
             continue;
+        }
+
+        // Drop the txes that can't have stakeable outputs anymore (they
+        // get back in when the spending block is disconnected)
+        if (nDepth > 0 && IsFullySpentInChain(*pcoin)) {
+            it = setStakeCandidates.erase(it);
+            continue;
+        }
+        ++it;
 
         // Check min depth requirement for stake inputs
         if (nDepth < Params().GetConsensus().nStakeMinDepth) continue;
@@ -2752,6 +3748,51 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int
     return true;
 }
 
+bool CWallet::SelectCoinsNoChange(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, const CFeeRate& feeRate, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const
+{
+    // Change below the dust threshold would be added to the fee anyway
+    const CAmount nCostOfChange = GetDustThreshold(::minRelayTxFee);
+    const bool fFeeRateHigh = feeRate > consolidateFeeRate;
+
+    for (const auto& conf : {std::make_pair(1, 6), std::make_pair(1, 1), std::make_pair(0, 1)}) {
+        if (conf.first == 0 && !bSpendZeroConfChange) break;
+
+        std::vector<BnBCoin> vValue;
+        for (const COutput& output : vAvailableCoins) {
+            if (!output.fSpendable)
+                continue;
+            if (output.nDepth < (output.tx->IsFromMe(ISMINE_ALL) ? conf.first : conf.second))
+                continue;
+
+            const CTxOut& out = output.tx->tx->vout[output.i];
+            const unsigned int nInputSize = GetEstimatedInputSize(out.scriptPubKey);
+            const CAmount nFee = feeRate.GetFee(nInputSize);
+            // Skip the coins that cost more to spend than they are worth
+            if (out.nValue <= nFee)
+                continue;
+            vValue.push_back({out.nValue - nFee, nFee - consolidateFeeRate.GetFee(nInputSize), {output.tx, (unsigned int) output.i}});
+        }
+        std::sort(vValue.begin(), vValue.end(), [](const BnBCoin& a, const BnBCoin& b) {
+            return a.nEffectiveValue > b.nEffectiveValue;
+        });
+
+        std::vector<char> vfBest;
+        if (!SelectCoinsBnB(vValue, nTargetValue, nCostOfChange, fFeeRateHigh, vfBest))
+            continue;
+
+        setCoinsRet.clear();
+        nValueRet = 0;
+        for (unsigned int i = 0; i < vValue.size(); i++) {
+            if (vfBest[i]) {
+                setCoinsRet.insert(vValue[i].coin);
+                nValueRet += vValue[i].coin.first->tx->vout[vValue[i].coin.second].nValue;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
 bool CWallet::SelectCoinsToSpend(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl) const
 {
     // Note: this function should never be used for "always free" tx types like dstx
@@ -2919,6 +3960,25 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend,
 
             nFeeRet = 0;
             if (nFeePay > 0) nFeeRet = nFeePay;
+
+            // First look for a set of inputs that needs no change output.
+            // The fee goes over the required one by less than the dust
+            // threshold, or the search falls back to the knapsack below.
+            CAmount nValueIn = 0;
+            bool fNoChange = false;
+            if (nFeePay == 0 && !(coinControl && (coinControl->HasSelected() || coinControl->nMinimumTotalFee > 0))) {
+                CMutableTransaction txNoInputs;
+                for (const CRecipient& rec : vecSend) {
+                    txNoInputs.vout.emplace_back(rec.nAmount, rec.scriptPubKey);
+                }
+                const CFeeRate feeRate = (coinControl && coinControl->fOverrideFeeRate) ?
+                                         coinControl->nFeeRate :
+                                         CFeeRate(GetMinimumFee(1000, nTxConfirmTarget, mempool));
+                const CAmount nTargetValue = nValue + feeRate.GetFee(::GetSerializeSize(txNoInputs, SER_NETWORK, PROTOCOL_VERSION));
+                fNoChange = SelectCoinsNoChange(vAvailableCoins, nTargetValue, feeRate, setCoins, nValueIn);
+                if (fNoChange) nFeeRet = nValueIn - nValue;
+            }
+
             while (true) {
                 nChangePosInOut = nChangePosRequest;
                 txNew.vin.clear();
@@ -2936,10 +3996,12 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend,
                 }
 
                 // Choose coins to use
-                CAmount nValueIn = 0;
-                setCoins.clear();
+                if (!fNoChange) {
+                    nValueIn = 0;
+                    setCoins.clear();
+                }
 
-                if (!SelectCoinsToSpend(vAvailableCoins, nTotalValue, setCoins, nValueIn, coinControl)) {
+                if (!fNoChange && !SelectCoinsToSpend(vAvailableCoins, nTotalValue, setCoins, nValueIn, coinControl)) {
                     if (coin_type == ALL_COINS) {
                         strFailReason = _("Insufficient funds.");
                     }
@@ -3062,6 +4124,7 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend,
                     break;
 
                 // Include more fee and try again.
+                fNoChange = false;
                 nFeeRet = nFeeNeeded;
                 continue;
             }
@@ -3116,13 +4179,76 @@ bool CWallet::CreateTransaction(CScript scriptPubKey, const CAmount& nValue, CTr
     return CreateTransaction(vecSend, wtxNew, reservekey, nFeeRet, nChangePosInOut, strFailReason, coinControl, coin_type, true, nFeePay, fIncludeDelegated);
 }
 
+/**
+ * Check the kernels of the coins against the target of kernelSearch, over up to nThreads
+ * threads: vMayStake[i] is cleared for the coins whose kernel misses the target.
+ */
+static void SearchStakeKernels(const CStakeKernelSearch& kernelSearch, const std::vector<CStakeableOutput>& vCoins,
+                               std::vector<char>& vMayStake, int nThreads)
+{
+    // Batches of coins, fetched by the threads as they go
+    static const size_t BATCH_SIZE = 256;
+    if (nThreads < 0)
+        nThreads = GetNumCores();
+    const size_t nWorkers = std::max((size_t) 1, std::min((size_t) nThreads, vCoins.size() / MIN_STAKE_COINS_PER_THREAD));
+    ParallelForEach((vCoins.size() + BATCH_SIZE - 1) / BATCH_SIZE, (int) nWorkers, [&](size_t nBatch) {
+        const size_t nBegin = BATCH_SIZE * nBatch;
+        const size_t nEnd = std::min(nBegin + BATCH_SIZE, vCoins.size());
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const CStakeableOutput& out = vCoins[i];
+            if (!out.pindex) continue;
+            vMayStake[i] = kernelSearch.CheckKernelHash(COutPoint(out.tx->GetHash(), out.i), out.pindex->nTime, out.tx->tx->vout[out.i].nValue);
+        }
+    });
+}
+
+void CStakeKernelSchedule::Compute(const CBlockIndex* pindexPrevIn, unsigned int nBitsIn, int64_t nTimeFirst, int nSlots,
+                                   const std::vector<CStakeableOutput>& vCoins, int nThreads)
+{
+    SetNull();
+    const int nSlotLength = Params().GetConsensus().nTimeSlotLength;
+    std::vector<char> vMayStake(vCoins.size());
+    for (int64_t nTime = nTimeFirst; nTime < nTimeFirst + nSlots * nSlotLength; nTime += nSlotLength) {
+        std::fill(vMayStake.begin(), vMayStake.end(), true);
+        SearchStakeKernels(CStakeKernelSearch(pindexPrevIn, nBitsIn, nTime), vCoins, vMayStake, nThreads);
+        for (size_t i = 0; i < vCoins.size(); i++) {
+            if (vMayStake[i] && vCoins[i].pindex)
+                mapWinners[nTime].emplace(vCoins[i].tx->GetHash(), vCoins[i].i);
+        }
+    }
+    pindexPrev = pindexPrevIn;
+    nBits = nBitsIn;
+    nTimeBegin = nTimeFirst;
+    nTimeEnd = nTimeFirst + nSlots * nSlotLength;
+}
+
+bool CStakeKernelSchedule::Covers(const CBlockIndex* pindexPrevIn, unsigned int nBitsIn, int64_t nTime) const
+{
+    return pindexPrev && pindexPrev == pindexPrevIn && nBits == nBitsIn && nTime >= nTimeBegin && nTime < nTimeEnd;
+}
+
+bool CStakeKernelSchedule::IsWinner(int64_t nTime, const COutPoint& outpoint) const
+{
+    const auto it = mapWinners.find(nTime);
+    return it != mapWinners.end() && it->second.count(outpoint);
+}
+
+void CStakeKernelSchedule::SetNull()
+{
+    pindexPrev = nullptr;
+    nBits = 0;
+    nTimeBegin = nTimeEnd = 0;
+    mapWinners.clear();
+}
+
 bool CWallet::CreateCoinStake(
         const CKeyStore& keystore,
         const CBlockIndex* pindexPrev,
         unsigned int nBits,
         CMutableTransaction& txNew,
         int64_t& nTxNewTime,
-        std::vector<CStakeableOutput>* availableCoins)
+        std::vector<CStakeableOutput>* availableCoins,
+        const CStakeKernelSchedule* pschedule)
 {
 
     const Consensus::Params& consensus = Params().GetConsensus();
@@ -3144,29 +4270,66 @@ bool CWallet::CreateCoinStake(
     CScript scriptPubKeyKernel;
     bool fKernelFound = false;
     int nAttempts = 0;
-    for (auto it = availableCoins->begin(); it != availableCoins->end();) {
+
+    // Snapshot of the coins still unspent: the spent ones leave the available coins
+    {
+        LOCK(cs_wallet);
+        // New block came in, move on
+        if (m_last_block_processed_height != pindexPrev->nHeight) {
+            pStakerStatus->AddStaleTip();
+            return false;
+        }
+        availableCoins->erase(std::remove_if(availableCoins->begin(), availableCoins->end(), [this](const CStakeableOutput& out) {
+            return IsSpent(COutPoint(out.tx->GetHash(), out.i));
+        }), availableCoins->end());
+    }
+
+    // Skip the coins missing the target of the time slot without building their stake
+    // input (-stakethreads), Stake() checking the others in full (min age included)
+    const int64_t nKernelStart = GetTimeMicros();
+    std::vector<char> vMayStake(availableCoins->size(), true);
+    if (CStakeKernelSearch::IsSupported(pindexPrev)) {
+        nTxNewTime = GetStakeTime();
+        // Time slots skipped since the last attempt
+        const int64_t nLastTime = pStakerStatus->GetLastTime();
+        if (!Params().IsRegTestNet() && nLastTime > 0 && nTxNewTime > nLastTime + consensus.nTimeSlotLength)
+            pStakerStatus->AddMissedSlots((nTxNewTime - nLastTime) / consensus.nTimeSlotLength - 1);
+        if (pschedule && pschedule->Covers(pindexPrev, nBits, nTxNewTime)) {
+            // Hashed ahead of time
+            for (size_t i = 0; i < availableCoins->size(); i++) {
+                const CStakeableOutput& out = (*availableCoins)[i];
+                vMayStake[i] = pschedule->IsWinner(nTxNewTime, COutPoint(out.tx->GetHash(), out.i));
+            }
+        } else {
+            const CStakeKernelSearch kernelSearch(pindexPrev, nBits, nTxNewTime);
+            SearchStakeKernels(kernelSearch, *availableCoins, vMayStake, gArgs.GetArg("-stakethreads", DEFAULT_STAKE_THREADS));
+        }
+        nAttempts = (int) std::count(vMayStake.begin(), vMayStake.end(), false);
+        pStakerStatus->SetLastTime(nTxNewTime);
+        pStakerStatus->SetLastTries(nAttempts);
+    }
+
+    for (size_t nCoin = 0; nCoin < availableCoins->size(); nCoin++) {
+        if (!vMayStake[nCoin]) continue;
+        const auto it = availableCoins->begin() + nCoin;
         COutPoint outPoint = COutPoint(it->tx->GetHash(), it->i);
-        CDogeCashStake stakeInput(it->tx->tx->vout[it->i],
-                             outPoint,
-                             it->pindex);
 
         // New block came in, move on
-        if (WITH_LOCK(cs_wallet, return m_last_block_processed_height) != pindexPrev->nHeight) return false;
+        if (WITH_LOCK(cs_wallet, return m_last_block_processed_height) != pindexPrev->nHeight) {
+            pStakerStatus->AddStaleTip();
+            return false;
+        }
 
         // Make sure the wallet is unlocked and shutdown hasn't been requested
         if (IsLocked() || ShutdownRequested()) return false;
 
-        // Make sure the stake input hasn't been spent since last check
-        if (WITH_LOCK(cs_wallet, return IsSpent(outPoint))) {
-            // remove it from the available coins
-            it = availableCoins->erase(it);
-            continue;
-        }
+        CDogeCashStake stakeInput(it->tx->tx->vout[it->i],
+                             outPoint,
+                             it->pindex);
 
         // This should never happen
         if (stakeInput.IsZDOGEC()) {
             LogPrintf("%s: ERROR - zPOS is disabled\n", __func__);
-            it++;
             continue;
         }
 
@@ -3180,7 +4343,6 @@ bool CWallet::CreateCoinStake(
         pStakerStatus->SetLastTries(nAttempts);
 
         if (!fKernelFound) {
-            it++;
             continue;
         }
 
@@ -3195,7 +4357,6 @@ bool CWallet::CreateCoinStake(
         std::vector<CTxOut> vout;
         if (!stakeInput.CreateTxOuts(this, vout, nCredit, onlyP2PK)) {
             LogPrintf("%s : failed to create output\n", __func__);
-            it++;
             continue;
         }
         txNew.vout.insert(txNew.vout.end(), vout.begin(), vout.end());
@@ -3229,25 +4390,29 @@ bool CWallet::CreateCoinStake(
             LogPrintf("%s : failed to create TxIn\n", __func__);
             txNew.vin.clear();
             txNew.vout.clear();
-            it++;
             continue;
         }
         txNew.vin.emplace_back(in);
 
         break;
     }
-    LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
+    pStakerStatus->SetKernelTime(GetTimeMicros() - nKernelStart);
+    TRACE5(staking, kernel_search, pindexPrev->nHeight + 1, fKernelFound, nAttempts, availableCoins->size(), pStakerStatus->GetKernelTime());
+    LogPrint(BCLog::STAKING, "%s: attempted staking %d times in %.2fms (%.0f kernels/s)\n", __func__, nAttempts,
+             pStakerStatus->GetKernelTime() * 0.001, pStakerStatus->GetKernelRate());
 
     if (!fKernelFound)
         return false;
 
     // Sign it
+    const int64_t nSignStart = GetTimeMicros();
     int nIn = 0;
     for (const CTxIn& txIn : txNew.vin) {
         const CWalletTx* wtx = GetWalletTx(txIn.prevout.hash);
         if (!wtx || !SignSignature(*this, *(wtx->tx), txNew, nIn++, SIGHASH_ALL, true))
             return error("%s : failed to sign coinstake", __func__);
     }
+    pStakerStatus->SetSignTime(GetTimeMicros() - nSignStart);
 
     // Successfully generated coinstake
     return true;
@@ -3605,7 +4770,7 @@ std::set<std::set<CTxDestination> > CWallet::GetAddressGroupings()
                 CTxDestination address;
                 if (!IsMine(txin)) /* If this input isn't mine, ignore it */
                     continue;
-                if (!ExtractDestination(mapWallet.at(txin.prevout.hash).tx->vout[txin.prevout.n].scriptPubKey, address))
+                if (!ExtractDestination(GetWalletTxOut(txin.prevout)->scriptPubKey, address))
                     continue;
                 grouping.insert(address);
                 any_mine = true;
@@ -3696,12 +4861,13 @@ bool CReserveKey::GetReservedKey(CPubKey& pubkey, bool _internal)
 
     if (nIndex == -1) {
 
-        // Fill the pool if needed
-        m_spk_man->TopUp();
         internal = _internal;
 
         // Modify this for Staking addresses support if needed.
         uint8_t changeType = internal ? HDChain::ChangeType::INTERNAL : HDChain::ChangeType::EXTERNAL;
+
+        // Fill the pool if needed
+        m_spk_man->TopUpBeforeUse(changeType);
         CKeyPool keypool;
         if (!m_spk_man->GetReservedKey(changeType, nIndex, keypool))
             return false;
@@ -3737,18 +4903,21 @@ void CWallet::LockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.insert(output);
+    MarkBalancesDirty();
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.erase(output);
+    MarkBalancesDirty();
 }
 
 void CWallet::UnlockAllCoins()
 {
     AssertLockHeld(cs_wallet); // setLockedCoins
     setLockedCoins.clear();
+    MarkBalancesDirty();
 }
 
 bool CWallet::IsLockedCoin(const uint256& hash, unsigned int n) const
@@ -3765,6 +4934,26 @@ std::set<COutPoint> CWallet::ListLockedCoins()
     return setLockedCoins;
 }
 
+bool CWallet::IsLockedNote(const SaplingOutPoint& op) const
+{
+    AssertLockHeld(cs_wallet); // setLockedNotes
+    return (setLockedNotes.count(op) > 0);
+}
+
+void CWallet::LockNote(const SaplingOutPoint& op)
+{
+    AssertLockHeld(cs_wallet); // setLockedNotes
+    setLockedNotes.insert(op);
+    MarkBalancesDirty();
+}
+
+void CWallet::UnlockNote(const SaplingOutPoint& op)
+{
+    AssertLockHeld(cs_wallet); // setLockedNotes
+    setLockedNotes.erase(op);
+    MarkBalancesDirty();
+}
+
 /** @} */ // end of Actions
 
 class CAffectedKeysVisitor : public boost::static_visitor<void>
@@ -3892,6 +5081,8 @@ bool CWallet::LoadDestData(const CTxDestination& dest, const std::string& key, c
 
 void CWallet::AutoCombineDust(CConnman* connman)
 {
+    // the destinations with enough dust only, not the whole wallet
+    std::set<CTxDestination> setDest;
     {
         LOCK(cs_wallet);
         if (m_last_block_processed.IsNull() ||
@@ -3899,10 +5090,13 @@ void CWallet::AutoCombineDust(CConnman* connman)
             IsLocked()) {
             return;
         }
+        setDest = setDustToCombine;
     }
+    if (setDest.empty())
+        return;
 
     std::map<CTxDestination, std::vector<COutput> > mapCoinsByAddress =
-            AvailableCoinsByAddress(true, nAutoCombineThreshold * COIN, false);
+            AvailableCoinsByAddress(true, nAutoCombineThreshold * COIN, false, &setDest);
 
     //coins are sectioned by address. This combination code only wants to combine inputs that belong to the same address
     for (std::map<CTxDestination, std::vector<COutput> >::iterator it = mapCoinsByAddress.begin(); it != mapCoinsByAddress.end(); it++) {
@@ -4121,16 +5315,21 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
 {
     std::string strUsage = HelpMessageGroup(_("Wallet options:"));
     strUsage += HelpMessageOpt("-backuppath=<dir|file>", _("Specify custom backup path to add a copy of any wallet backup. If set as dir, every backup generates a timestamped file. If set as file, will rewrite to that file every backup."));
+    strUsage += HelpMessageOpt("-consolidatefeerate=<amt>", strprintf(_("Fee rate (in %s/kB) at or below which the coin selection prefers spending more inputs, to consolidate the small coins (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_CONSOLIDATE_FEERATE)));
     strUsage += HelpMessageOpt("-createwalletbackups=<n>", strprintf(_("Number of automatic wallet backups (default: %d)"), DEFAULT_CREATEWALLETBACKUPS));
     strUsage += HelpMessageOpt("-custombackupthreshold=<n>", strprintf(_("Number of custom location backups to retain (default: %d)"), DEFAULT_CUSTOMBACKUPTHRESHOLD));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
+    strUsage += HelpMessageOpt("-keypoolthread", strprintf(_("Refill the key pool from a background thread, deriving the keys without locking the wallet (default: %u)"), DEFAULT_KEYPOOL_THREAD));
+    strUsage += HelpMessageOpt("-walletarchivedepth=<n>", strprintf(_("Archive the transactions fully spent at least <n> blocks deep, keeping them on disk only (0 = disabled, else at least %d, default: %d)"), MIN_WALLET_ARCHIVE_DEPTH, DEFAULT_WALLET_ARCHIVE_DEPTH));
     strUsage += HelpMessageOpt("-legacywallet", _("On first run, create a legacy wallet instead of a HD wallet"));
     strUsage += HelpMessageOpt("-maxtxfee=<amt>", strprintf(_("Maximum total fees to use in a single wallet transaction, setting too low may abort large transactions (default: %s)"), FormatMoney(maxTxFee)));
     strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for transaction creation (default: %s)"), CURRENCY_UNIT, FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"), CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanblockfilter", strprintf(_("With -blockfilterindex, skip the blocks whose filter matches none of the wallet scripts when rescanning. New cold staking delegations and multisig outputs involving the wallet keys are then not found (default: %u)"), DEFAULT_RESCAN_BLOCK_FILTER));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet file") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-shieldsendthreads=<n>", strprintf(_("Number of threads proving the shielded sends queued by shieldsendmanyasync (0 to %d, default: %d)"), MAX_SHIELDSEND_THREADS, DEFAULT_SHIELDSEND_THREADS));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
     strUsage += HelpMessageOpt("-txconfirmtarget=<n>", strprintf(_("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)"), 1));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format") + " " + _("on startup"));
@@ -4144,6 +5343,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_PROCLIMIT));
     strUsage += HelpMessageOpt("-minstakesplit=<amt>", strprintf(_("Minimum positive amount (in DOGEC) allowed by GUI and RPC for the stake split threshold (default: %s)"), FormatMoney(DEFAULT_MIN_STAKE_SPLIT_THRESHOLD)));
     strUsage += HelpMessageOpt("-staking=<n>", strprintf(_("Enable staking functionality (0-1, default: %u)"), DEFAULT_STAKING));
+    strUsage += HelpMessageOpt("-stakelookahead=<n>", strprintf(_("Hash the stake kernels of the coins for the next <n> time slots after each new block, the slots without a kernel meeting the target being skipped (0 = at the start of each slot, default: %d)"), DEFAULT_STAKE_LOOKAHEAD));
+    strUsage += HelpMessageOpt("-stakethreads=<n>", strprintf(_("Set the number of threads searching the stake kernels of the coins (-1 = all cores, default: %d)"), DEFAULT_STAKE_THREADS));
     if (showDebug) {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), DEFAULT_WALLET_DBLOGSIZE));
@@ -4295,9 +5496,17 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
             walletInstance->m_last_block_processed_time = tip->GetBlockTime();
         }
     }
-    RegisterValidationInterface(walletInstance);
+    walletInstance->m_mempool_note_scanner = MakeUnique<CMempoolNoteScanner>(walletInstance);
+    RegisterValidationInterface(walletInstance, "wallet");
 
     if (chainActive.Tip() && chainActive.Tip() != pindexRescan) {
+        // We can't rescan beyond non-pruned blocks, stop and throw an error.
+        // This might happen if a user uses an old wallet within a pruned node
+        // or if they ran -disablewallet for a longer time, then decided to re-enable.
+        if (fPruneMode && !HaveBlockDataFrom(pindexRescan)) {
+            UIError(_("Prune: last wallet synchronisation goes beyond pruned data. You need to -reindex (download the whole blockchain again in case of pruned node)"));
+            return nullptr;
+        }
         uiInterface.InitMessage(_("Rescanning..."));
         LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
         const int64_t nWalletRescanTime = GetTimeMillis();
@@ -4312,6 +5521,8 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
         // Restore wallet transaction metadata after -zapwallettxes=1
         if (gArgs.GetBoolArg("-zapwallettxes", false) && gArgs.GetArg("-zapwallettxes", "1") != "2") {
             CWalletDB walletdb(*walletInstance->dbw);
+            // One db transaction for all of them
+            walletdb.TxnBegin();
             for (const CWalletTx& wtxOld : vWtx) {
                 uint256 hash = wtxOld.GetHash();
                 std::map<uint256, CWalletTx>::iterator mi = walletInstance->mapWallet.find(hash);
@@ -4327,6 +5538,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
                     walletdb.WriteTx(*copyTo);
                 }
             }
+            walletdb.TxnCommit();
         }
     }
     fVerifyingBlocks = false;
@@ -4359,6 +5571,14 @@ void CWallet::postInitProcess(CScheduler& scheduler)
     // Add wallet transactions that aren't already in a block to mapTransactions
     ReacceptWalletTransactions(/*fFirstLoad*/true);
 
+    const int nArchiveDepth = gArgs.GetArg("-walletarchivedepth", DEFAULT_WALLET_ARCHIVE_DEPTH);
+    if (nArchiveDepth > 0) {
+        LOCK2(cs_main, cs_wallet);
+        ArchiveWalletTxs(nArchiveDepth);
+    }
+
+    m_scheduler = &scheduler;
+
     // Run a thread to flush wallet periodically
     if (!CWallet::fFlushScheduled.exchange(true)) {
         scheduler.scheduleEvery(MaybeCompactWalletDB, 500);
@@ -4424,6 +5644,7 @@ bool CWalletTx::AcceptToMemoryPool(CValidationState& state, bool fLimitFree, boo
     // unavailable as we're not yet aware its in mempool.
     bool fAccepted = ::AcceptToMemoryPool(mempool, state, tx, fLimitFree, nullptr, false, fRejectInsaneFee, ignoreFees);
     fInMempool = fAccepted;
+    if (pwallet) pwallet->MarkBalancesDirty();
     if (!fAccepted)
         LogPrintf("%s : %s\n", __func__, state.GetRejectReason());
     return fAccepted;
@@ -4447,6 +5668,7 @@ CWallet::CWallet(std::unique_ptr<CWalletDBWrapper> dbw_in)
 
 CWallet::~CWallet()
 {
+    m_mempool_note_scanner.reset();
     delete pwalletdbEncryption;
     delete pStakerStatus;
 }
@@ -4521,7 +5743,7 @@ bool CWallet::LoadMinVersion(int nVersion)
 
 isminetype CWallet::IsMine(const CTxOut& txout) const
 {
-    return ::IsMine(*this, txout.scriptPubKey);
+    return m_spk_man->IsMine(txout.scriptPubKey);
 }
 
 CAmount CWallet::GetCredit(const CTxOut& txout, const isminefilter& filter) const
@@ -4763,6 +5985,14 @@ void CWalletTx::MarkDirty()
     nShieldedChangeCached = 0;
     fShieldedChangeCached = false;
     fStakeDelegationVoided = false;
+    mapCachedOutputEntries.clear();
+    if (pwallet) pwallet->MarkBalancesDirty();
+}
+
+void CWalletTx::MarkSpendsDirty(isminefilter filter)
+{
+    m_amounts[AVAILABLE_CREDIT].Reset(filter);
+    if (pwallet) pwallet->MarkBalancesDirty();
 }
 
 void CWalletTx::BindWallet(CWallet* pwalletIn)
@@ -43,6 +43,7 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -52,6 +53,7 @@ extern CWallet* pwalletMain;
  * Settings
  */
 extern CFeeRate payTxFee;
+extern CFeeRate consolidateFeeRate;
 extern CAmount maxTxFee;
 extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
@@ -60,6 +62,8 @@ extern bool fPayAtLeastCustomFee;
 
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
+//! -consolidatefeerate default
+static const CAmount DEFAULT_CONSOLIDATE_FEERATE = 20000;
 //! -paytxfee will warn if called with a higher fee than this amount (in satoshis) per KB
 static const CAmount nHighTransactionFeeWarning = 0.1 * COIN;
 //! -maxtxfee default
@@ -76,6 +80,12 @@ static const CAmount DEFAULT_MIN_STAKE_SPLIT_THRESHOLD = 100 * COIN;
 static const bool DEFAULT_SPEND_ZEROCONF_CHANGE = true;
 //! Default for -staking
 static const bool DEFAULT_STAKING = true;
+//! Default for -stakethreads
+static const int DEFAULT_STAKE_THREADS = 1;
+//! Fewer coins per thread aren't worth starting the kernel search threads
+static const size_t MIN_STAKE_COINS_PER_THREAD = 1000;
+//! Default for -stakelookahead
+static const int DEFAULT_STAKE_LOOKAHEAD = 8;
 //! Default for -coldstaking
 static const bool DEFAULT_COLDSTAKING = true;
 //! Defaults for -gen and -genproclimit
@@ -85,6 +95,18 @@ static const unsigned int DEFAULT_GENERATE_PROCLIMIT = 1;
 static const unsigned int DEFAULT_CREATEWALLETBACKUPS = 10;
 //! Default for -disablewallet
 static const bool DEFAULT_DISABLE_WALLET = false;
+//! Maximum number of blocks read (and decrypted) ahead of the rescan commit stage
+static const unsigned int RESCAN_PREFETCH_BLOCKS = 16;
+//! Number of block indexes resolved at once by the rescan
+static const unsigned int RESCAN_SEGMENT_BLOCKS = 1000;
+//! Default for -rescanblockfilter
+static const bool DEFAULT_RESCAN_BLOCK_FILTER = false;
+//! Default for -walletarchivedepth (0: the wallet transactions are never archived)
+static const int DEFAULT_WALLET_ARCHIVE_DEPTH = 0;
+//! Minimum -walletarchivedepth, far deeper than any reorg the wallet is expected to follow
+static const int MIN_WALLET_ARCHIVE_DEPTH = 1000;
+//! Number of blocks between two archiving passes
+static const int WALLET_ARCHIVE_INTERVAL = 1000;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -94,6 +116,7 @@ class COutput;
 class CStakeableOutput;
 class CReserveKey;
 class CScript;
+class CMempoolNoteScanner;
 class CScheduler;
 class ScriptPubKeyMan;
 class SaplingScriptPubKeyMan;
@@ -177,6 +200,10 @@ public:
  *  - nTime          time slot of last attempt
  *  - nTries         number of UTXOs hashed during last attempt
  *  - nCoins         number of stakeable utxos during last attempt
+ *  and the staking telemetry (written by the staker thread, read by the RPC):
+ *  - n*Time         time spent, in microseconds, in the last run of each step
+ *  - nMissedSlots   time slots skipped between two attempts, since the start
+ *  - nStaleTips     attempts aborted because a new tip came in, since the start
 **/
 class CStakerStatus
 {
@@ -186,6 +213,14 @@ private:
     int nTries{0};
     int nCoins{0};
 
+    std::atomic<int64_t> nRefreshTime{0};   // listing the stakeable coins
+    std::atomic<int64_t> nKernelTime{0};    // searching the kernels
+    std::atomic<int64_t> nTemplateTime{0};  // building the rest of the block
+    std::atomic<int64_t> nSignTime{0};      // signing the coinstake and the block
+    std::atomic<int64_t> nProcessTime{0};   // ProcessBlockFound
+    std::atomic<int64_t> nMissedSlots{0};
+    std::atomic<int64_t> nStaleTips{0};
+
 public:
     // Get
     const CBlockIndex* GetLastTip() const { return tipBlock; }
@@ -194,22 +229,72 @@ public:
     int GetLastCoins() const { return nCoins; }
     int GetLastTries() const { return nTries; }
     int64_t GetLastTime() const { return nTime; }
+    int64_t GetRefreshTime() const { return nRefreshTime; }
+    int64_t GetKernelTime() const { return nKernelTime; }
+    int64_t GetTemplateTime() const { return nTemplateTime; }
+    int64_t GetSignTime() const { return nSignTime; }
+    int64_t GetProcessTime() const { return nProcessTime; }
+    int64_t GetMissedSlots() const { return nMissedSlots; }
+    int64_t GetStaleTips() const { return nStaleTips; }
+    // Kernels hashed per second during the last search
+    double GetKernelRate() const { return nKernelTime > 0 ? 1000000.0 * nTries / nKernelTime : 0; }
     // Set
     void SetLastCoins(const int coins) { nCoins = coins; }
     void SetLastTries(const int tries) { nTries = tries; }
     void SetLastTip(const CBlockIndex* lastTip) { tipBlock = lastTip; }
     void SetLastTime(const uint64_t lastTime) { nTime = lastTime; }
+    void SetRefreshTime(const int64_t micros) { nRefreshTime = micros; }
+    void SetKernelTime(const int64_t micros) { nKernelTime = micros; }
+    void SetTemplateTime(const int64_t micros) { nTemplateTime = micros; }
+    void SetSignTime(const int64_t micros) { nSignTime = micros; }
+    void AddSignTime(const int64_t micros) { nSignTime += micros; }
+    void SetProcessTime(const int64_t micros) { nProcessTime = micros; }
+    void AddMissedSlots(const int64_t slots) { nMissedSlots += slots; }
+    void AddStaleTip() { nStaleTips++; }
     void SetNull()
     {
         SetLastCoins(0);
         SetLastTries(0);
         SetLastTip(nullptr);
         SetLastTime(0);
+        nRefreshTime = nKernelTime = nTemplateTime = nSignTime = nProcessTime = 0;
+        nMissedSlots = nStaleTips = 0;
     }
     // Check whether staking status is active (last attempt earlier than 30 seconds ago)
     bool IsActive() const { return (nTime + 30) >= GetTime(); }
 };
 
+/**
+ * The kernels of the stakeable coins hashed ahead of time on top of a tip, for
+ * the time slots to come (-stakelookahead): the staker skips the slots where
+ * none of them meets the target, and the kernel search of the others is only a
+ * lookup. The kernel only depends on the stake modifier of the tip, the coin
+ * and the slot time, the target on the tip: it holds until the next tip, or a
+ * change of the coins.
+ */
+class CStakeKernelSchedule
+{
+private:
+    const CBlockIndex* pindexPrev{nullptr};
+    unsigned int nBits{0};
+    int64_t nTimeBegin{0};
+    int64_t nTimeEnd{0};
+    // Coins whose kernel meets the target, by slot
+    std::map<int64_t, std::set<COutPoint>> mapWinners;
+
+public:
+    //! Hashes the kernels of vCoins for the nSlots time slots from nTimeFirst, over up to nThreads threads
+    void Compute(const CBlockIndex* pindexPrevIn, unsigned int nBitsIn, int64_t nTimeFirst, int nSlots,
+                 const std::vector<CStakeableOutput>& vCoins, int nThreads);
+    //! Whether the kernels of the slot nTime on top of pindexPrevIn with nBitsIn are known
+    bool Covers(const CBlockIndex* pindexPrevIn, unsigned int nBitsIn, int64_t nTime) const;
+    //! Whether the kernel of the coin meets the target in the slot nTime (if covered)
+    bool IsWinner(int64_t nTime, const COutPoint& outpoint) const;
+    //! Whether some kernel meets the target in the slot nTime (if covered)
+    bool HasWinner(int64_t nTime) const { return mapWinners.count(nTime); }
+    void SetNull();
+};
+
 struct CRecipient
 {
     CScript scriptPubKey;
@@ -257,6 +342,7 @@ private:
 template <class T>
 using TxSpendMap = std::multimap<T, uint256>;
 typedef std::map<SaplingOutPoint, SaplingNoteData> mapSaplingNoteData_t;
+typedef std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> SaplingNotesFound;
 
 typedef std::map<std::string, std::string> mapValue_t;
 
@@ -345,6 +431,13 @@ public:
     mutable CAmount nChangeCached;
     mutable bool fShieldedChangeCached;
     mutable CAmount nShieldedChangeCached;
+    //! GetAmounts results, by filter, until the next MarkDirty
+    struct CachedOutputEntries {
+        std::list<COutputEntry> listReceived;
+        std::list<COutputEntry> listSent;
+        CAmount nFee;
+    };
+    mutable std::map<isminefilter, CachedOutputEntries> mapCachedOutputEntries;
 
     CWalletTx(const CWallet* pwalletIn, CTransactionRef arg);
     void Init(const CWallet* pwalletIn);
@@ -449,6 +542,8 @@ public:
 
     //! make sure balances are recalculated
     void MarkDirty();
+    //! the spent status of the outputs matching filter changed: only their available credit is recalculated
+    void MarkSpendsDirty(isminefilter filter);
 
     void BindWallet(CWallet* pwalletIn);
 
@@ -495,10 +590,15 @@ public:
     CAmount GetStakeDelegationCredit(bool fUseCache = true) const;
     CAmount GetStakeDelegationDebit(bool fUseCache = true) const;
 
+    //! Cached, see ComputeAmounts
     void GetAmounts(std::list<COutputEntry>& listReceived,
                     std::list<COutputEntry>& listSent,
                     CAmount& nFee,
                     const isminefilter& filter) const;
+    void ComputeAmounts(std::list<COutputEntry>& listReceived,
+                        std::list<COutputEntry>& listSent,
+                        CAmount& nFee,
+                        const isminefilter& filter) const;
 
     bool IsFromMe(const isminefilter& filter) const;
 
@@ -563,9 +663,6 @@ class CWallet : public CCryptoKeyStore, public CValidationInterface
 private:
     static std::atomic<bool> fFlushScheduled;
 
-    //! keeps track of whether Unlock has run a thorough check before
-    bool fDecryptionThoroughlyChecked{false};
-
     //! Key manager //
     std::unique_ptr<ScriptPubKeyMan> m_spk_man = MakeUnique<ScriptPubKeyMan>(this);
     std::unique_ptr<SaplingScriptPubKeyMan> m_sspk_man = MakeUnique<SaplingScriptPubKeyMan>(this);
@@ -601,6 +698,12 @@ private:
     int64_t nNextResend;
     int64_t nLastResend;
 
+    //! Rescan progress, readable without cs_wallet
+    std::atomic<bool> fScanningWallet{false};
+    std::atomic<int64_t> m_scanning_start{0};
+    std::atomic<double> m_scanning_progress{0};
+    std::atomic<int64_t> m_scanning_blocks{0};
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -611,6 +714,79 @@ private:
     void AddToSpends(const COutPoint& outpoint, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * The wallet transactions that may still have stakeable outputs: the ones
+     * with outputs of ours that are not spent in the chain. StakeableCoins
+     * walks this set instead of the whole mapWallet.
+     */
+    std::set<uint256> setStakeCandidates;
+    void AddToStakeCandidates(const CWalletTx& wtx);
+    //! Whether all our outputs of wtx are spent by transactions in the chain
+    bool IsFullySpentInChain(const CWalletTx& wtx) const;
+
+    /**
+     * The outputs of ours that are not spent by a transaction in the chain,
+     * with their ownership type, and the same outpoints by destination.
+     * AvailableCoins walks these instead of every output of mapWallet.
+     * Outputs enter when their tx is added or loaded, and again when the
+     * block spending them is disconnected. They leave when a confirmed
+     * wallet tx spends them.
+     */
+    std::map<COutPoint, isminetype> mapWalletUTXO;
+    std::map<CTxDestination, std::set<COutPoint>> mapWalletUTXOByDest;
+    void AddToWalletUTXO(const CWalletTx& wtx);
+    void AddToWalletUTXO(const COutPoint& outpoint);
+    void EraseFromWalletUTXO(const COutPoint& outpoint);
+    bool IsSpentInChain(const COutPoint& outpoint) const;
+
+    /**
+     * The P2CS outputs of mapWalletUTXO, ours to stake or delegated by us,
+     * by staker and by owner key. The cold staking balances, listcoldutxos
+     * and GetAvailableP2CSCoins walk these instead of every wallet tx.
+     */
+    std::map<CTxDestination, std::set<COutPoint>> mapP2CSByStaker;
+    std::map<CTxDestination, std::set<COutPoint>> mapP2CSByOwner;
+    void UpdateP2CSIndex(const COutPoint& outpoint, const CTxOut& out, isminetype mine, bool fAdd);
+
+    /**
+     * Auto combine: the count and the value of the spendable outputs of
+     * mapWalletUTXO at or below the threshold, by destination, kept along
+     * with it, and the destinations with enough of them to combine. These
+     * only are looked at by AutoCombineDust, on the scheduler thread.
+     */
+    struct DustTally {
+        unsigned int nCount{0};
+        CAmount nValue{0};
+    };
+    std::map<CTxDestination, DustTally> mapDustByDest;
+    std::set<CTxDestination> setDustToCombine;
+    void UpdateDustTally(const CTxDestination& dest, const CTxOut& out, isminetype mine, bool fAdd);
+    void RebuildDustTallies();
+    //! AutoCombineDust is queued on the scheduler
+    std::atomic<bool> fAutoCombineScheduled{false};
+    CScheduler* m_scheduler{nullptr};
+
+    /**
+     * The archived transactions: fully spent, deeply confirmed transparent
+     * txs moved from the "tx" records (and mapWallet) to the "atx" records.
+     * Only their hashes, our outputs (for the debit and the history of the
+     * txs spending them) and the outpoints they spend are kept in memory.
+     */
+    std::set<uint256> setArchivedTxs;
+    std::map<COutPoint, CTxOut> mapArchivedOutputs;
+    std::set<COutPoint> setArchivedSpends;
+    bool IsArchivable(const CWalletTx& wtx, int nMinDepth) const;
+
+    /**
+     * While BlockConnected runs, the writes of the wallet transactions (and of
+     * nOrderPosNext) are only recorded here, then made at the end of the block
+     * in a single db transaction, instead of one db write (and log record) each.
+     */
+    bool fDeferBlockWrites GUARDED_BY(cs_wallet) = false;
+    std::set<uint256> setBlockWrites GUARDED_BY(cs_wallet);
+    bool fBlockOrderPosDirty GUARDED_BY(cs_wallet) = false;
+    void WriteBlockWrites();
+
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, int conflicting_height, const uint256& hashTx);
 
@@ -619,7 +795,13 @@ private:
     void ChainTipAdded(const CBlockIndex *pindex, const CBlock *pblock, SaplingMerkleTree saplingTree);
 
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected */
-    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm);
+    void SyncTransaction(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, const SaplingNotesFound* pSaplingNotes = nullptr);
+
+    /* The mempool transactions, with the notes found by the batched decryption, that are still in the mempool */
+    void SyncMempoolTransactions(const std::vector<CTransactionRef>& vtx, const std::vector<SaplingNotesFound>& vSaplingNotes);
+    friend class CMempoolNoteScanner;
+    /* Trial-decrypts the shielded outputs of the mempool transactions, set before the wallet is registered */
+    std::unique_ptr<CMempoolNoteScanner> m_mempool_note_scanner;
 
     bool IsKeyUsed(const CPubKey& vchPubKey);
 
@@ -753,9 +935,22 @@ public:
     typedef std::multimap<int64_t, CWalletTx*> TxItems;
     TxItems wtxOrdered;
 
+    /**
+     * The wallet transactions by the height of their block, the ones not in a
+     * block (unconfirmed, conflicted or abandoned) last, so that listsinceblock
+     * walks the transactions above its block only. Rebuilt at load.
+     */
+    std::set<std::pair<int, uint256>> setWalletTxByHeight;
+    std::map<uint256, int> mapWalletTxHeight;
+    void UpdateWalletTxHeight(const CWalletTx& wtx);
+    void EraseWalletTxHeight(const uint256& hash);
+    //! The transactions in a block above nHeight, or not in a block, by height
+    std::vector<const CWalletTx*> GetWalletTxsSince(int nHeight) const;
+
     int64_t nOrderPosNext;
 
     std::set<COutPoint> setLockedCoins;
+    std::set<SaplingOutPoint> setLockedNotes;
 
     int64_t nTimeFirstKey;
 
@@ -764,7 +959,10 @@ public:
 
     const CWalletTx* GetWalletTx(const uint256& hash) const;
 
-    std::vector<CWalletTx> getWalletTxs();
+    /** Copies of the last nMaxTxs (0: all) transactions added to the wallet, most recent first */
+    std::vector<CWalletTx> getWalletTxs(size_t nMaxTxs = 0);
+    /** Memory used by the wallet transactions, and apart by the witnesses of their Sapling notes */
+    void GetMemoryUsage(size_t& nTxsRet, size_t& nWitnessesRet) const;
     std::string GetUniqueWalletBackupName() const;
 
     //! check whether we are allowed to upgrade (or already support) to the named feature
@@ -811,13 +1009,16 @@ public:
                         ) const;
     //! >> Available coins (spending)
     bool SelectCoinsToSpend(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl* coinControl = nullptr) const;
+    bool SelectCoinsNoChange(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, const CFeeRate& feeRate, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*, unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
     //! >> Available coins (staking)
     bool StakeableCoins(std::vector<CStakeableOutput>* pCoins = nullptr);
     //! >> Available coins (P2CS)
     void GetAvailableP2CSCoins(std::vector<COutput>& vCoins) const;
+    //! The P2CS outputs of the index, sorted, without the ones of the whitelisted owners if requested
+    std::set<COutPoint> GetP2CSOutpoints(bool fExcludeWhitelisted = false) const;
 
-    std::map<CTxDestination, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue, bool fIncludeColdStaking);
+    std::map<CTxDestination, std::vector<COutput> > AvailableCoinsByAddress(bool fConfirmed, CAmount maxCoinValue, bool fIncludeColdStaking, std::set<CTxDestination>* onlyFilteredDest = nullptr);
 
     /// Get 15000 DOGEC output and keys which can be used for the Masternode
     bool GetMasternodeVinAndKeys(CTxIn& txinRet, CPubKey& pubKeyRet,
@@ -834,6 +1035,10 @@ public:
     void UnlockAllCoins();
     std::set<COutPoint> ListLockedCoins();
 
+    bool IsLockedNote(const SaplingOutPoint& op) const;
+    void LockNote(const SaplingOutPoint& op);
+    void UnlockNote(const SaplingOutPoint& op);
+
     //  keystore implementation
     PairResult getNewAddress(CTxDestination& ret, const std::string addressLabel, const std::string purpose,
                                            const CChainParams::Base58Type addrType = CChainParams::PUBKEY_ADDRESS);
@@ -847,7 +1052,8 @@ public:
     //////////// Sapling //////////////////
 
     // Search for notes and addresses from this wallet in the tx, and add the addresses --> IVK mapping to the keystore if missing.
-    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData);
+    // If pSaplingNotes is set, the notes were already found with the batched decryption.
+    bool FindNotesDataAndAddMissingIVKToKeystore(const CTransaction& tx, Optional<mapSaplingNoteData_t>& saplingNoteData, const SaplingNotesFound* pSaplingNotes = nullptr);
     // Decrypt sapling output notes with the inputs ovk and updates saplingNoteDataMap
     void AddExternalNotesDataToTx(CWalletTx& wtx) const;
 
@@ -893,7 +1099,7 @@ public:
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey& pubkey) override;
     //! Adds a key to the store, without saving it to disk (used by LoadWallet)
-    bool LoadKey(const CKey& key, const CPubKey& pubkey) { return CCryptoKeyStore::AddKeyPubKey(key, pubkey); }
+    bool LoadKey(const CKey& key, const CPubKey& pubkey);
     //! Load metadata (used by LoadWallet)
     bool LoadKeyMetadata(const CPubKey& pubkey, const CKeyMetadata& metadata);
 
@@ -938,10 +1144,18 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose = true);
     bool LoadToWallet(CWalletTx& wtxIn);
+    //! Index an archived transaction read from the "atx" records
+    void LoadArchivedTx(const CWalletTx& wtx);
+    //! Archive the transactions spent (and confirmed) at least nMinDepth deep. Returns how many were archived.
+    int ArchiveWalletTxs(int nMinDepth);
+    //! Read an archived transaction back from the database
+    bool GetArchivedTx(const uint256& hash, CWalletTx& wtxRet);
+    //! Our output at outpoint, from mapWallet or from an archived transaction
+    const CTxOut* GetWalletTxOut(const COutPoint& outpoint) const;
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
-    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate);
+    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CWalletTx::Confirmation& confirm, bool fUpdate, const SaplingNotesFound* pSaplingNotes = nullptr);
     void EraseFromWallet(const uint256& hash);
 
     /**
@@ -951,7 +1165,15 @@ public:
     bool ActivateSaplingWallet(bool memOnly = false);
 
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool fromStartup = false);
-    void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
+    //! The scripts of the keys, watch-only and P2SH scripts of the wallet, and of its outputs, matched by the rescan against the block filters
+    std::set<CScript> GetRescanScripts() const;
+    bool IsScanning() const { return fScanningWallet; }
+    //! Milliseconds since the running rescan started, 0 if not scanning
+    int64_t ScanningDuration() const { return fScanningWallet ? GetTimeMillis() - m_scanning_start : 0; }
+    double ScanningProgress() const { return fScanningWallet ? (double) m_scanning_progress : 0; }
+    //! Number of blocks committed by the running rescan
+    int64_t ScanningBlocks() const { return fScanningWallet ? (int64_t) m_scanning_blocks : 0; }
+    void TransactionRemovedFromMempool(const CTransactionRef &ptx, MemPoolRemovalReason reason) override;
     void ReacceptWalletTransactions(bool fFirstLoad = false);
     void ResendWalletTransactions(CConnman* connman) override;
 
@@ -965,7 +1187,35 @@ public:
     };
     Balance GetBalance(int min_depth = 0) const;
 
-    CAmount loopTxsBalance(std::function<void(const uint256&, const CWalletTx&, CAmount&)>method) const;
+    enum BalanceType {
+        BALANCE_AVAILABLE,
+        BALANCE_COLD_STAKING,
+        BALANCE_IMMATURE_COLD_STAKING,
+        BALANCE_STAKING,
+        BALANCE_DELEGATED,
+        BALANCE_IMMATURE_DELEGATED,
+        BALANCE_UNCONFIRMED,
+        BALANCE_IMMATURE,
+        BALANCE_WATCHONLY,
+        BALANCE_UNCONFIRMED_WATCHONLY,
+        BALANCE_IMMATURE_WATCHONLY
+    };
+    //! Memory only. Balances computed since the last change of a wallet tx, of its mempool state,
+    //! of the locked coins, or of the last processed block. Keyed by (type, filter, min depth).
+    mutable std::atomic<uint64_t> nBalancesVersion{0};
+    mutable uint64_t nCachedBalancesVersion GUARDED_BY(cs_wallet){0};
+    mutable uint256 nCachedBalancesBlock GUARDED_BY(cs_wallet);
+    mutable std::map<std::tuple<int, int, int>, CAmount> mapCachedBalances GUARDED_BY(cs_wallet);
+    mutable std::map<int, Balance> mapCachedBalanceByDepth GUARDED_BY(cs_wallet);
+    //! Invalidates the cached balances
+    void MarkBalancesDirty() const { nBalancesVersion++; }
+    //! Clears the cached balances if the wallet changed since they were computed
+    void CheckCachedBalances() const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Returns the cached balance, or computes it with loopTxsBalance
+    CAmount GetCachedBalance(BalanceType type, int nFilter, int nMinDepth, std::function<void(const uint256&, const CWalletTx&, CAmount&)> method, bool fP2CSOnly = false) const;
+
+    //! Over the txes of the P2CS index only, with fP2CSOnly
+    CAmount loopTxsBalance(std::function<void(const uint256&, const CWalletTx&, CAmount&)>method, bool fP2CSOnly = false) const;
     CAmount GetAvailableBalance(bool fIncludeDelegated = true, bool fIncludeShielded = true) const;
     CAmount GetAvailableBalance(isminefilter& filter, bool useCache = false, int minDepth = 1) const;
     CAmount GetColdStakingBalance() const;  // delegated coins for which we have the staking key
@@ -1023,9 +1273,11 @@ public:
                          unsigned int nBits,
                          CMutableTransaction& txNew,
                          int64_t& nTxNewTime,
-                         std::vector<CStakeableOutput>* availableCoins);
+                         std::vector<CStakeableOutput>* availableCoins,
+                         const CStakeKernelSchedule* pschedule = nullptr);
     bool MultiSend();
     void AutoCombineDust(CConnman* connman);
+    void SetAutoCombineSettings(bool fEnable, CAmount nThreshold);
 
     // Shielded balances
     CAmount GetAvailableShieldedBalance(bool fUseCache = true) const;
@@ -1077,6 +1329,8 @@ public:
     void SetBestChainInternal(CWalletDB& walletdb, const CBlockLocator& loc); // only public for testing purposes, must never be called directly in any other situation
     // Force balance recomputation if any transaction got conflicted
     void MarkAffectedTransactionsDirty(const CTransaction& tx); // only public for testing purposes, must never be called directly in any other situation
+    // Force the debit recomputation of the transactions spending a new (or newly decrypted) one
+    void MarkSpendersDirty(const CWalletTx& wtx);
 
     DBErrors LoadWallet(bool& fFirstRunRet);
     DBErrors ZapWalletTx(std::vector<CWalletTx>& vWtx);
@@ -17,6 +17,7 @@
 #include "serialize.h"
 #include "sync.h"
 #include "util.h"
+#include "util/parallel.h"
 #include "utiltime.h"
 #include "wallet/wallet.h"
 
@@ -69,6 +70,17 @@ bool CWalletDB::EraseTx(uint256 hash)
     return batch.Erase(std::make_pair(std::string("tx"), hash));
 }
 
+bool CWalletDB::WriteArchivedTx(const CWalletTx& wtx)
+{
+    nWalletDBUpdateCounter++;
+    return batch.Write(std::make_pair(std::string("atx"), wtx.GetHash()), wtx);
+}
+
+bool CWalletDB::ReadArchivedTx(const uint256& hash, CWalletTx& wtx)
+{
+    return batch.Read(std::make_pair(std::string("atx"), hash), wtx);
+}
+
 bool CWalletDB::WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta)
 {
     nWalletDBUpdateCounter++;
@@ -424,6 +436,46 @@ public:
     }
 };
 
+// Decode a "tx" record, its type already read from ssKey. Doesn't touch the wallet,
+// so that the records can be decoded over several threads.
+static bool ReadWalletTx(CDataStream& ssKey, CDataStream& ssValue, CWalletTx& wtx, bool& fUpgraded, std::string& strErr)
+{
+    uint256 hash;
+    ssKey >> hash;
+    ssValue >> wtx;
+    if (wtx.GetHash() != hash)
+        return false;
+
+    // Undo serialize changes in 31600
+    if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
+        if (!ssValue.empty()) {
+            char fTmp;
+            char fUnused;
+            std::string unused_string;
+            ssValue >> fTmp >> fUnused >> unused_string;
+            strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
+                wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = fTmp;
+        } else {
+            strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+            wtx.fTimeReceivedIsTxTime = 0;
+        }
+        fUpgraded = true;
+    }
+    return true;
+}
+
+static void LoadWalletTx(CWallet* pwallet, CWalletTx& wtx, bool fUpgraded, CWalletScanState& wss)
+{
+    if (fUpgraded)
+        wss.vWalletUpgrade.push_back(wtx.GetHash());
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->LoadToWallet(wtx);
+}
+
 bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CWalletScanState& wss, std::string& strType, std::string& strErr)
 {
     try {
@@ -444,34 +496,11 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
             ssValue >> strPurpose;
             pwallet->LoadAddressBookPurpose(Standard::DecodeDestination(strAddress), strPurpose);
         } else if (strType == "tx") {
-            uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx(nullptr /* pwallet */, MakeTransactionRef());
-            ssValue >> wtx;
-            if (wtx.GetHash() != hash)
+            bool fUpgraded = false;
+            if (!ReadWalletTx(ssKey, ssValue, wtx, fUpgraded, strErr))
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703) {
-                if (!ssValue.empty()) {
-                    char fTmp;
-                    char fUnused;
-                    std::string unused_string;
-                    ssValue >> fTmp >> fUnused >> unused_string;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
-                        wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                } else {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
-            }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
+            LoadWalletTx(pwallet, wtx, fUpgraded, wss);
         } else if (strType == "watchs") {
             CScript script;
             ssKey >> script;
@@ -637,8 +666,7 @@ bool ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue, CW
         } else if (strType == "autocombinesettings") {
             std::pair<bool, CAmount> pSettings;
             ssValue >> pSettings;
-            pwallet->fCombineDust = pSettings.first;
-            pwallet->nAutoCombineThreshold = pSettings.second;
+            pwallet->SetAutoCombineSettings(pSettings.first, pSettings.second);
         } else if (strType == "destdata") {
             std::string strAddress, strKey, strValue;
             ssKey >> strAddress;
@@ -722,11 +750,57 @@ bool CWalletDB::IsKeyType(const std::string& strType)
             strType == "sapzkey" || strType == "csapzkey");
 }
 
+//! Fewer transaction records per thread aren't worth starting the threads
+static const size_t MIN_WALLET_TXS_PER_THREAD = 256;
+
+// A "tx" record, read from the cursor, decoded after the other records
+struct WalletTxRecord {
+    CDataStream ssKey;
+    CDataStream ssValue;
+    std::unique_ptr<CWalletTx> wtx;
+    bool fUpgraded{false};
+    std::string strErr;
+
+    WalletTxRecord(CDataStream&& ssKeyIn, CDataStream&& ssValueIn) : ssKey(std::move(ssKeyIn)), ssValue(std::move(ssValueIn)) {}
+};
+
+// The key of a "tx" record starts with the serialized type string: its size (2), then "tx"
+static bool IsWalletTxRecord(const CDataStream& ssKey)
+{
+    return ssKey.size() > 3 && ssKey[0] == 2 && ssKey[1] == 't' && ssKey[2] == 'x';
+}
+
+// Same for an archived "atx" record
+static bool IsArchivedTxRecord(const CDataStream& ssKey)
+{
+    return ssKey.size() > 4 && ssKey[0] == 3 && ssKey[1] == 'a' && ssKey[2] == 't' && ssKey[3] == 'x';
+}
+
+// Decode the records over up to one thread per core. wtx stays null for the corrupt ones.
+static void DecodeWalletTxRecords(std::vector<WalletTxRecord>& vRecords)
+{
+    const size_t nWorkers = std::max((size_t) 1, std::min((size_t) GetNumCores(), vRecords.size() / MIN_WALLET_TXS_PER_THREAD));
+    ParallelForEach(vRecords.size(), (int) nWorkers, [&vRecords](size_t i) {
+        WalletTxRecord& record = vRecords[i];
+        try {
+            std::string strType;
+            record.ssKey >> strType;
+            std::unique_ptr<CWalletTx> wtx(new CWalletTx(nullptr /* pwallet */, MakeTransactionRef()));
+            if (ReadWalletTx(record.ssKey, record.ssValue, *wtx, record.fUpgraded, record.strErr))
+                record.wtx = std::move(wtx);
+        } catch (...) {
+            record.wtx.reset();
+        }
+    });
+}
+
 DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
 {
     CWalletScanState wss;
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
+    std::vector<WalletTxRecord> vTxRecords;
+    std::vector<WalletTxRecord> vArchivedTxRecords;
 
     LOCK(pwallet->cs_wallet);
     try {
@@ -756,6 +830,16 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 return DB_CORRUPT;
             }
 
+            // The transactions are decoded once all the other records (the keys) are loaded
+            if (IsWalletTxRecord(ssKey)) {
+                vTxRecords.emplace_back(std::move(ssKey), std::move(ssValue));
+                continue;
+            }
+            if (IsArchivedTxRecord(ssKey)) {
+                vArchivedTxRecords.emplace_back(std::move(ssKey), std::move(ssValue));
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
             std::string strType, strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr)) {
@@ -775,6 +859,33 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
                 LogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        // Decode the transactions over several threads, then load them in the database order
+        DecodeWalletTxRecords(vTxRecords);
+        for (WalletTxRecord& record : vTxRecords) {
+            if (record.wtx) {
+                LoadWalletTx(pwallet, *record.wtx, record.fUpgraded, wss);
+            } else {
+                fNoncriticalErrors = true;
+                // Rescan if there is a bad transaction record:
+                gArgs.SoftSetBoolArg("-rescan", true);
+            }
+            if (!record.strErr.empty())
+                LogPrintf("%s\n", record.strErr);
+        }
+        vTxRecords.clear();
+
+        // Archived transactions only fill the small indexes of their outputs and spends
+        DecodeWalletTxRecords(vArchivedTxRecords);
+        for (WalletTxRecord& record : vArchivedTxRecords) {
+            if (record.wtx) {
+                if (!pwallet->mapWallet.count(record.wtx->GetHash()))
+                    pwallet->LoadArchivedTx(*record.wtx);
+            } else {
+                fNoncriticalErrors = true;
+            }
+        }
+        vArchivedTxRecords.clear();
     } catch (const boost::thread_interrupted&) {
         throw;
     } catch (...) {
@@ -821,6 +932,7 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, std::vector<uint256>& vTxHash
 {
     bool fNoncriticalErrors = false;
     DBErrors result = DB_LOAD_OK;
+    std::vector<WalletTxRecord> vTxRecords;
 
     try {
         LOCK(pwallet->cs_wallet);
@@ -850,20 +962,24 @@ DBErrors CWalletDB::FindWalletTx(CWallet* pwallet, std::vector<uint256>& vTxHash
                 return DB_CORRUPT;
             }
 
-            std::string strType;
-            ssKey >> strType;
-            if (strType == "tx") {
-                uint256 hash;
-                ssKey >> hash;
-
-                CWalletTx wtx(nullptr /* pwallet */, MakeTransactionRef());
-                ssValue >> wtx;
-
-                vTxHash.push_back(hash);
-                vWtx.push_back(wtx);
+            if (IsWalletTxRecord(ssKey)) {
+                vTxRecords.emplace_back(std::move(ssKey), std::move(ssValue));
             }
         }
         pcursor->close();
+
+        // Decode the transactions over several threads
+        DecodeWalletTxRecords(vTxRecords);
+        vTxHash.reserve(vTxRecords.size());
+        vWtx.reserve(vTxRecords.size());
+        for (WalletTxRecord& record : vTxRecords) {
+            if (!record.wtx) {
+                result = DB_CORRUPT;
+                break;
+            }
+            vTxHash.push_back(record.wtx->GetHash());
+            vWtx.push_back(std::move(*record.wtx));
+        }
     } catch (const boost::thread_interrupted&) {
         throw;
     } catch (...) {
@@ -884,11 +1000,17 @@ DBErrors CWalletDB::ZapWalletTx(CWallet* pwallet, std::vector<CWalletTx>& vWtx)
     if (err != DB_LOAD_OK)
         return err;
 
-    // erase each wallet TX
+    // erase each wallet TX, in one db transaction
+    if (!TxnBegin())
+        return DB_CORRUPT;
     for (uint256& hash : vTxHash) {
-        if (!EraseTx(hash))
+        if (!EraseTx(hash)) {
+            TxnAbort();
             return DB_CORRUPT;
+        }
     }
+    if (!TxnCommit())
+        return DB_CORRUPT;
 
     return DB_LOAD_OK;
 }
@@ -1078,6 +1200,7 @@ bool AttemptBackupWallet(const CWallet& wallet, const fs::path& pathSrc, const f
 //
 bool CWalletDB::Recover(const std::string& filename, void *callbackDataIn, bool (*recoverKVcallback)(void* callbackData, CDataStream ssKey, CDataStream ssValue))
 {
+    // The callback is called from several threads at once
     return CDB::Recover(filename, callbackDataIn, recoverKVcallback);
 }
 
@@ -1094,14 +1217,21 @@ bool CWalletDB::RecoverKeysOnlyFilter(void *callbackData, CDataStream ssKey, CDa
     CWalletScanState dummyWss;
     std::string strType, strErr;
     bool fReadOK;
+    // Most records are transactions: look at the type before decoding anything
+    try {
+        CDataStream ssType(ssKey);
+        ssType >> strType;
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (!IsKeyType(strType) && strType != "hdchain")
+        return false;
     {
         // Required in LoadKeyMetadata():
         LOCK(dummyWallet->cs_wallet);
         fReadOK = ReadKeyValue(dummyWallet, ssKey, ssValue,
                                dummyWss, strType, strErr);
     }
-    if (!IsKeyType(strType) && strType != "hdchain")
-        return false;
     if (!fReadOK)
     {
         LogPrintf("WARNING: CWalletDB::Recover skipping %s: %s\n", strType, strErr);
@@ -131,6 +131,10 @@ public:
     bool WriteTx(const CWalletTx& wtx);
     bool EraseTx(uint256 hash);
 
+    //! Archived ("atx") transactions, moved out of the "tx" records by CWallet::ArchiveWalletTxs
+    bool WriteArchivedTx(const CWalletTx& wtx);
+    bool ReadArchivedTx(const uint256& hash, CWalletTx& wtx);
+
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata& keyMeta);
     bool WriteCryptedKey(const CPubKey& vchPubKey, const std::vector<unsigned char>& vchCryptedSecret, const CKeyMetadata& keyMeta);
     bool WriteMasterKey(unsigned int nID, const CMasterKey& kMasterKey);
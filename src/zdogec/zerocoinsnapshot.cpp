@@ -0,0 +1,117 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zdogec/zerocoinsnapshot.h"
+
+#include "clientversion.h"
+#include "hash.h"
+#include "streams.h"
+#include "tinyformat.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <atomic>
+
+static std::atomic<int> nZerocoinSnapshotHeight{-1};
+
+bool DumpZerocoinSnapshot(CZerocoinDB& db, int nHeight, const uint256& hashBlock, const fs::path& path, uint256& hashRet, std::string& strError)
+{
+    CZerocoinSnapshot snapshot;
+    snapshot.nHeight = nHeight;
+    snapshot.hashBlock = hashBlock;
+    if (!db.ReadCoinRecords("spends", snapshot.vSpends) || !db.ReadCoinRecords("mints", snapshot.vMints)) {
+        strError = "failed to read the zerocoin database";
+        return false;
+    }
+    // Not written by every version: an empty supply is valid
+    db.ReadZCSupply(snapshot.mapSupply);
+
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << snapshot;
+    hashRet = Hash(ss.begin(), ss.end());
+
+    FILE* file = fsbridge::fopen(path, "wb");
+    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        strError = strprintf("failed to open %s", path.string());
+        return false;
+    }
+    try {
+        fileout.write(ss.data(), ss.size());
+    } catch (const std::exception& e) {
+        strError = strprintf("failed to write %s: %s", path.string(), e.what());
+        return false;
+    }
+    FileCommit(fileout.Get());
+    return true;
+}
+
+bool LoadZerocoinSnapshot(CZerocoinDB& db, const fs::path& path, const uint256& hashExpected, std::string& strError)
+{
+    if (hashExpected.IsNull()) {
+        strError = "no zerocoin snapshot is known for this network";
+        return false;
+    }
+
+    FILE* file = fsbridge::fopen(path, "rb");
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        strError = strprintf("failed to open %s", path.string());
+        return false;
+    }
+    std::vector<char> vchData;
+    try {
+        vchData.resize(fs::file_size(path));
+        filein.read(vchData.data(), vchData.size());
+    } catch (const std::exception& e) {
+        strError = strprintf("failed to read %s: %s", path.string(), e.what());
+        return false;
+    }
+    filein.fclose();
+
+    // The hash covers the whole file: nothing of it is trusted before it is checked
+    const uint256 hash = Hash(vchData.begin(), vchData.end());
+    if (hash != hashExpected) {
+        strError = strprintf("the hash of %s is %s, expected %s", path.string(), hash.GetHex(), hashExpected.GetHex());
+        return false;
+    }
+
+    CZerocoinSnapshot snapshot;
+    try {
+        CDataStream ss(vchData, SER_DISK, CLIENT_VERSION);
+        ss >> snapshot;
+    } catch (const std::exception& e) {
+        strError = strprintf("failed to deserialize %s: %s", path.string(), e.what());
+        return false;
+    }
+
+    LogPrintf("Loading the zerocoin snapshot of block %s (height %d): %u spends, %u mints\n",
+              snapshot.hashBlock.GetHex(), snapshot.nHeight, snapshot.vSpends.size(), snapshot.vMints.size());
+    if (!db.WriteCoinRecords("spends", snapshot.vSpends) ||
+        !db.WriteCoinRecords("mints", snapshot.vMints) ||
+        !db.WriteZCSupply(snapshot.mapSupply) ||
+        !db.WriteSnapshotBlock(snapshot.nHeight, snapshot.hashBlock)) {
+        strError = "failed to write the zerocoin database";
+        return false;
+    }
+    nZerocoinSnapshotHeight = snapshot.nHeight;
+    return true;
+}
+
+void InitZerocoinSnapshot(CZerocoinDB& db)
+{
+    int nHeight;
+    uint256 hashBlock;
+    if (db.ReadSnapshotBlock(nHeight, hashBlock)) {
+        LogPrintf("The zerocoin database holds the snapshot of block %s (height %d)\n", hashBlock.GetHex(), nHeight);
+        nZerocoinSnapshotHeight = nHeight;
+    } else {
+        nZerocoinSnapshotHeight = -1;
+    }
+}
+
+int GetZerocoinSnapshotHeight()
+{
+    return nZerocoinSnapshotHeight;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2020 The DogeCash Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef DOGEC_ZEROCOINSNAPSHOT_H
+#define DOGEC_ZEROCOINSNAPSHOT_H
+
+#include "fs.h"
+#include "libzerocoin/Denominations.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+class CZerocoinDB;
+
+/**
+ * The final state of the legacy zerocoin database: the serials spent and
+ * the coins minted, with the transactions that did it, and the supply by
+ * denomination.
+ * Zerocoin is disabled, so this state never changes after the last
+ * zerocoin block. A node syncing with -assumevalid can load it from a file
+ * (-zerocoinsnapshot) whose hash is in the chain parameters, instead of
+ * writing these records block by block.
+ */
+class CZerocoinSnapshot
+{
+public:
+    //! The block the snapshot was taken at
+    int nHeight{0};
+    uint256 hashBlock;
+    //! serial hash -> txid of the spend
+    std::vector<std::pair<uint256, uint256> > vSpends;
+    //! pubcoin hash -> txid of the mint
+    std::vector<std::pair<uint256, uint256> > vMints;
+    std::map<libzerocoin::CoinDenomination, int64_t> mapSupply;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(vSpends);
+        READWRITE(vMints);
+        READWRITE(mapSupply);
+    }
+};
+
+/** Write the state of the zerocoin database, taken at the given block, to a snapshot file. Returns its hash. */
+bool DumpZerocoinSnapshot(CZerocoinDB& db, int nHeight, const uint256& hashBlock, const fs::path& path, uint256& hashRet, std::string& strError);
+
+/** Load a snapshot file into the zerocoin database, if its hash is hashExpected */
+bool LoadZerocoinSnapshot(CZerocoinDB& db, const fs::path& path, const uint256& hashExpected, std::string& strError);
+
+/** Read the snapshot block from the zerocoin database, if a snapshot was loaded in it */
+void InitZerocoinSnapshot(CZerocoinDB& db);
+
+/**
+ * The height up to which the zerocoin database already has the records of the
+ * blocks, from a snapshot: -1 if none. ConnectBlock doesn't write them again
+ * for the blocks under -assumevalid.
+ */
+int GetZerocoinSnapshotHeight();
+
+#endif // DOGEC_ZEROCOINSNAPSHOT_H
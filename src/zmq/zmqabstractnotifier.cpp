@@ -21,3 +21,32 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
     return true;
 }
 
+bool CZMQAbstractNotifier::NotifyBlockConnect(const CBlock &/*block*/, const CBlockIndex * /*pindex*/, bool /*fInitialDownload*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBlockDisconnect(const uint256 &/*hash*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionAcceptance(const CTransaction &/*transaction*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyTransactionRemoval(const CTransaction &/*transaction*/, MemPoolRemovalReason /*reason*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyMasternodeListChange(const COutPoint &/*collateral*/, bool /*fAdded*/)
+{
+    return true;
+}
+
+bool CZMQAbstractNotifier::NotifyBudgetVote(const uint256 &/*nBudgetHash*/, const COutPoint &/*voter*/, int /*nDirection*/, bool /*fFinalized*/)
+{
+    return true;
+}
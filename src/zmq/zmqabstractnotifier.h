@@ -9,6 +9,7 @@
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+enum class MemPoolRemovalReason;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
@@ -35,6 +36,16 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
 
+    // Every block connected or disconnected, and the mempool additions and removals
+    virtual bool NotifyBlockConnect(const CBlock &block, const CBlockIndex *pindex, bool fInitialDownload);
+    virtual bool NotifyBlockDisconnect(const uint256 &hash);
+    virtual bool NotifyTransactionAcceptance(const CTransaction &transaction);
+    virtual bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason);
+
+    // Tier two
+    virtual bool NotifyMasternodeListChange(const COutPoint &collateral, bool fAdded);
+    virtual bool NotifyBudgetVote(const uint256 &nBudgetHash, const COutPoint &voter, int nDirection, bool fFinalized);
+
 protected:
     void *psocket;
     std::string type;
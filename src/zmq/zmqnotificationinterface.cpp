@@ -5,9 +5,11 @@
 #include "zmqnotificationinterface.h"
 #include "zmqpublishnotifier.h"
 
+#include "txmempool.h"
 #include "version.h"
 #include "streams.h"
 #include "util.h"
+#include "validation.h"
 
 void zmqError(const char *str)
 {
@@ -38,6 +40,9 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubsequence"] = CZMQAbstractNotifier::Create<CZMQPublishSequenceNotifier>;
+    factories["pubmnlist"] = CZMQAbstractNotifier::Create<CZMQPublishMasternodeListNotifier>;
+    factories["pubbudgetvote"] = CZMQAbstractNotifier::Create<CZMQPublishBudgetVoteNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -123,15 +128,13 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
-void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+template <typename Function>
+void CZMQNotificationInterface::NotifyAll(Function func)
 {
-    if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
-        return;
-
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyBlock(pindexNew))
+        if (func(notifier))
         {
             i++;
         }
@@ -143,39 +146,81 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, co
     }
 }
 
+void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload || pindexNew == pindexFork) // In IBD or blocks were disconnected without any new ones
+        return;
+
+    NotifyAll([pindexNew](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlock(pindexNew);
+    });
+}
+
+void CZMQNotificationInterface::NotifyTransaction(const CTransaction& tx)
+{
+    NotifyAll([&tx](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransaction(tx);
+    });
+}
+
 void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef& ptx)
 {
-    // Used by BlockConnected and BlockDisconnected as well, because they're
-    // all the same external callback.
     const CTransaction& tx = *ptx;
+    NotifyTransaction(tx);
+    NotifyAll([&tx](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransactionAcceptance(tx);
+    });
+}
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
-    {
-        CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
-        {
-            i++;
-        }
-        else
-        {
-            notifier->Shutdown();
-            i = notifiers.erase(i);
-        }
-    }
+void CZMQNotificationInterface::TransactionRemovedFromMempool(const CTransactionRef& ptx, MemPoolRemovalReason reason)
+{
+    // Removals for the block and the conflicts come with BlockConnected
+    const CTransaction& tx = *ptx;
+    NotifyAll([&tx, reason](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyTransactionRemoval(tx, reason);
+    });
 }
 
 void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted)
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction added in the block
-        TransactionAddedToMempool(ptx);
+        NotifyTransaction(*ptx);
+    }
+    for (const CTransactionRef& ptx : vtxConflicted) {
+        NotifyAll([&ptx](CZMQAbstractNotifier* notifier) {
+            return notifier->NotifyTransactionRemoval(*ptx, MemPoolRemovalReason::CONFLICT);
+        });
     }
+
+    // The block is published from memory, as it was connected
+    const bool fInitialDownload = IsInitialBlockDownload();
+    NotifyAll([&pblock, pindexConnected, fInitialDownload](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlockConnect(*pblock, pindexConnected, fInitialDownload);
+    });
 }
 
 void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime)
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction removed in block disconnection
-        TransactionAddedToMempool(ptx);
+        NotifyTransaction(*ptx);
     }
+    NotifyAll([&blockHash](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBlockDisconnect(blockHash);
+    });
+}
+
+void CZMQNotificationInterface::MasternodeListChanged(const COutPoint& collateral, bool fAdded)
+{
+    NotifyAll([&collateral, fAdded](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyMasternodeListChange(collateral, fAdded);
+    });
+}
+
+void CZMQNotificationInterface::BudgetVoteAccepted(const uint256& nBudgetHash, const COutPoint& voter, int nDirection, bool fFinalized)
+{
+    NotifyAll([&nBudgetHash, &voter, nDirection, fFinalized](CZMQAbstractNotifier* notifier) {
+        return notifier->NotifyBudgetVote(nBudgetHash, voter, nDirection, fFinalized);
+    });
 }
@@ -26,13 +26,22 @@ protected:
 
     // CValidationInterface
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx, MemPoolRemovalReason reason) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexConnected, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const uint256& blockHash, int nBlockHeight, int64_t blockTime) override;
     void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+    void MasternodeListChanged(const COutPoint& collateral, bool fAdded) override;
+    void BudgetVoteAccepted(const uint256& nBudgetHash, const COutPoint& voter, int nDirection, bool fFinalized) override;
 
 private:
     CZMQNotificationInterface();
 
+    // Calls func on each notifier, shutting down and dropping the ones failing
+    template <typename Function>
+    void NotifyAll(Function func);
+    // hashtx and rawtx, for the transactions entering the mempool or a block, or leaving a block
+    void NotifyTransaction(const CTransaction& tx);
+
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
@@ -4,10 +4,11 @@
 
 #include "zmqpublishnotifier.h"
 
+#include "chain.h"
 #include "chainparams.h"
 #include "util.h"
 #include "crypto/common.h"
-#include "validation.h"     // cs_main
+#include "txmempool.h"      // MemPoolRemovalReason
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
@@ -15,6 +16,16 @@ static const char *MSG_HASHBLOCK  = "hashblock";
 static const char *MSG_HASHTX     = "hashtx";
 static const char *MSG_RAWBLOCK   = "rawblock";
 static const char *MSG_RAWTX      = "rawtx";
+static const char *MSG_SEQUENCE   = "sequence";
+static const char *MSG_MNLIST     = "mnlist";
+static const char *MSG_BUDGETVOTE = "budgetvote";
+
+// Hashes are published in the byte order they are displayed in
+static void WriteReversedHash(unsigned char *data, const uint256 &hash)
+{
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+}
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -162,22 +173,17 @@ bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &t
     return SendMessage(MSG_HASHTX, data, 32);
 }
 
-bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
+bool CZMQPublishRawBlockNotifier::NotifyBlockConnect(const CBlock &block, const CBlockIndex *pindex, bool fInitialDownload)
 {
+    if (fInitialDownload)
+        return true;
+
     LogPrint(BCLog::ZMQ, "Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
+    // The block connected is still in memory: no need to read it back from disk
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
-    }
+    ss.reserve(::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    ss << block;
 
     return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
 }
@@ -190,3 +196,63 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishSequenceNotifier::SendSequenceMsg(const uint256 &hash, char label, int nReason)
+{
+    unsigned char data[32 + 1 + 1];
+    WriteReversedHash(data, hash);
+    data[32] = label;
+    size_t size = 33;
+    if (nReason >= 0)
+        data[size++] = (unsigned char)nReason;
+    return SendMessage(MSG_SEQUENCE, data, size);
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockConnect(const CBlock &block, const CBlockIndex *pindex, bool /*fInitialDownload*/)
+{
+    uint256 hash = pindex->GetBlockHash();
+    LogPrint(BCLog::ZMQ, "Publish sequence block connect %s\n", hash.GetHex());
+    return SendSequenceMsg(hash, 'C');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyBlockDisconnect(const uint256 &hash)
+{
+    LogPrint(BCLog::ZMQ, "Publish sequence block disconnect %s\n", hash.GetHex());
+    return SendSequenceMsg(hash, 'D');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionAcceptance(const CTransaction &transaction)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "Publish sequence mempool acceptance %s\n", hash.GetHex());
+    return SendSequenceMsg(hash, 'A');
+}
+
+bool CZMQPublishSequenceNotifier::NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason)
+{
+    uint256 hash = transaction.GetHash();
+    LogPrint(BCLog::ZMQ, "Publish sequence mempool removal %s (reason %d)\n", hash.GetHex(), (int)reason);
+    return SendSequenceMsg(hash, 'R', (int)reason);
+}
+
+bool CZMQPublishMasternodeListNotifier::NotifyMasternodeListChange(const COutPoint &collateral, bool fAdded)
+{
+    LogPrint(BCLog::ZMQ, "Publish mnlist %s %s\n", collateral.ToStringShort(), fAdded ? "added" : "removed");
+    unsigned char data[32 + 4 + 1];
+    WriteReversedHash(data, collateral.hash);
+    WriteLE32(&data[32], collateral.n);
+    data[36] = fAdded ? 'A' : 'R';
+    return SendMessage(MSG_MNLIST, data, sizeof(data));
+}
+
+bool CZMQPublishBudgetVoteNotifier::NotifyBudgetVote(const uint256 &nBudgetHash, const COutPoint &voter, int nDirection, bool fFinalized)
+{
+    LogPrint(BCLog::ZMQ, "Publish budgetvote %s from %s\n", nBudgetHash.GetHex(), voter.ToStringShort());
+    unsigned char data[32 + 32 + 4 + 1 + 1];
+    WriteReversedHash(data, nBudgetHash);
+    WriteReversedHash(&data[32], voter.hash);
+    WriteLE32(&data[64], voter.n);
+    data[68] = fFinalized ? 'F' : 'P';
+    data[69] = (unsigned char)nDirection;
+    return SendMessage(MSG_BUDGETVOTE, data, sizeof(data));
+}
@@ -43,7 +43,7 @@ public:
 class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyBlock(const CBlockIndex *pindex);
+    bool NotifyBlockConnect(const CBlock &block, const CBlockIndex *pindex, bool fInitialDownload);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -52,4 +52,38 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+/* The body of a sequence message is the hash (32 bytes), a label and, for a
+   mempool removal, the reason (1 byte, MemPoolRemovalReason):
+      * 'C' block connected, 'D' block disconnected
+      * 'A' transaction added to the mempool, 'R' removed from it
+*/
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    bool SendSequenceMsg(const uint256 &hash, char label, int nReason = -1);
+
+public:
+    bool NotifyBlockConnect(const CBlock &block, const CBlockIndex *pindex, bool fInitialDownload);
+    bool NotifyBlockDisconnect(const uint256 &hash);
+    bool NotifyTransactionAcceptance(const CTransaction &transaction);
+    bool NotifyTransactionRemoval(const CTransaction &transaction, MemPoolRemovalReason reason);
+};
+
+/* The body is the collateral (txid, 32 bytes, and LE 4byte output index)
+   followed by 'A' when the masternode entered the list, 'R' when it left */
+class CZMQPublishMasternodeListNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyMasternodeListChange(const COutPoint &collateral, bool fAdded);
+};
+
+/* The body is the proposal or finalized budget hash (32 bytes), the voter's
+   collateral (36 bytes), 'P' (proposal) or 'F' (finalized budget) and the
+   vote direction (1 byte: 0 abstain, 1 yes, 2 no) */
+class CZMQPublishBudgetVoteNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBudgetVote(const uint256 &nBudgetHash, const COutPoint &voter, int nDirection, bool fFinalized);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
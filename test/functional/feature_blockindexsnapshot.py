@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The DogeCash Developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the block index snapshot (-blockindexsnapshot).
+
+- Restart a node with -blockindexsnapshot: the snapshot is written at shutdown.
+- Restart it again: the block index is loaded from the snapshot.
+- Corrupt the snapshot: the block index is loaded from the database.
+"""
+
+import os
+
+from test_framework.test_framework import DogeCashTestFramework
+from test_framework.util import assert_equal
+
+LOADED_MSG = "from the block index snapshot"
+
+class BlockIndexSnapshotTest(DogeCashTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.extra_args = [["-blockindexsnapshot"]]
+
+    def debug_log_contains(self, msg):
+        with open(os.path.join(self.nodes[0].datadir, "regtest", "debug.log"), encoding="utf-8") as f:
+            return msg in f.read()
+
+    def check_chain(self, tip, height):
+        node = self.nodes[0]
+        assert_equal(node.getbestblockhash(), tip)
+        assert_equal(node.getblockcount(), height)
+        assert_equal(node.getblockheader(tip)["height"], height)
+        assert_equal(node.getchaintips()[0]["hash"], tip)
+
+    def run_test(self):
+        node = self.nodes[0]
+        snapshot_path = os.path.join(node.datadir, "regtest", "blocks", "index.snapshot")
+        node.generate(2)
+        tip = node.getbestblockhash()
+        height = node.getblockcount()
+
+        self.log.info("Write the snapshot at shutdown")
+        self.stop_node(0)
+        assert os.path.isfile(snapshot_path)
+
+        self.log.info("Load the block index from the snapshot")
+        self.start_node(0)
+        assert self.debug_log_contains(LOADED_MSG)
+        self.check_chain(tip, height)
+
+        self.log.info("Ignore a corrupted snapshot")
+        self.stop_node(0)
+        with open(snapshot_path, "r+b") as f:
+            f.seek(os.path.getsize(snapshot_path) // 2)
+            byte = f.read(1)
+            f.seek(-1, os.SEEK_CUR)
+            f.write(bytes([byte[0] ^ 0xff]))
+        os.remove(os.path.join(node.datadir, "regtest", "debug.log"))
+        self.start_node(0)
+        assert not self.debug_log_contains(LOADED_MSG)
+        self.check_chain(tip, height)
+
+        self.log.info("Keep going on the new blocks")
+        node.generate(3)
+        tip = node.getbestblockhash()
+        self.restart_node(0)
+        self.check_chain(tip, height + 3)
+
+if __name__ == '__main__':
+    BlockIndexSnapshotTest().main()
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The DogeCash Developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test enabling the address, spent and timestamp indexes on an existing chain.
+
+- Build a chain without the indexes, with a payment to a new address.
+- Restart with -addressindex, -spentindex and -timestampindex (no reindex) and
+  wait for the indexes to be built in the background.
+- Invalidate and reconsider the tip, and check the indexes follow the chain.
+- Page through the history of an address with a limit and a cursor.
+"""
+
+from test_framework.test_framework import DogeCashTestFramework
+from test_framework.util import (
+    assert_equal,
+    wait_until,
+)
+
+COIN = 100000000
+INDEX_ARGS = ["-addressindex", "-spentindex", "-timestampindex"]
+
+class IndexSyncTest(DogeCashTestFramework):
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def address_balance(self, address):
+        return self.nodes[0].getaddressbalance(address)["balance"]
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(110)
+        address = node.getnewaddress()
+        txid = node.sendtoaddress(address, 10)
+        node.generate(1)
+        tip = node.getblock(node.getbestblockhash())
+        vin = node.getrawtransaction(txid, True)["vin"][0]
+
+        self.log.info("Enable the indexes without a reindex")
+        self.restart_node(0, INDEX_ARGS)
+        node = self.nodes[0]
+
+        def indexes_synced():
+            try:
+                self.address_balance(address)
+                node.getblockhashes(tip["time"] + 1000, 0)
+                return True
+            except Exception:
+                return False
+        wait_until(indexes_synced, timeout=60)
+
+        assert_equal(self.address_balance(address), 10 * COIN)
+        spent = node.getspentinfo(vin["txid"])[vin["vout"]]
+        assert_equal(spent["spent"], True)
+        assert_equal(spent["height"], tip["height"])
+        assert tip["hash"] in node.getblockhashes(tip["time"] + 1000, 0)
+
+        self.log.info("Follow the chain tip")
+        node.invalidateblock(tip["hash"])
+        wait_until(lambda: self.address_balance(address) == 0, timeout=10)
+        node.reconsiderblock(tip["hash"])
+        wait_until(lambda: self.address_balance(address) == 10 * COIN, timeout=10)
+        assert_equal(node.getspentinfo(vin["txid"])[vin["vout"]]["height"], tip["height"])
+
+        self.log.info("Keep the indexes across restarts")
+        node.generate(1)
+        self.restart_node(0, INDEX_ARGS)
+        wait_until(indexes_synced, timeout=60)
+        assert_equal(self.address_balance(address), 10 * COIN)
+
+        self.log.info("Page through the address history")
+        node = self.nodes[0]
+        for i in range(5):
+            node.sendtoaddress(address, 1)
+            if i % 2 == 0:
+                node.generate(1)
+        node.generate(1)
+        wait_until(lambda: self.address_balance(address) == 15 * COIN, timeout=10)
+        query = {"addresses": [address]}
+        all_txids = node.getaddresstxids(query)
+        all_deltas = node.getaddressdeltas(query)
+        assert_equal(len(all_txids), 6)
+        # the running totals match the history
+        totals = node.getaddressbalance(query)
+        assert_equal(totals["balance"], sum(d["satoshis"] for d in all_deltas))
+        assert_equal(totals["received"], sum(d["satoshis"] for d in all_deltas if d["satoshis"] > 0))
+        for limit in [1, 2, 4, 10]:
+            for method, field, expected in [("getaddresstxids", "txids", all_txids),
+                                            ("getaddressdeltas", "deltas", all_deltas)]:
+                items = []
+                page = getattr(node, method)(dict(query, limit=limit))
+                while True:
+                    assert len(page[field]) <= limit
+                    items += page[field]
+                    if page["cursor"] is None:
+                        break
+                    page = getattr(node, method)(dict(query, limit=limit, cursor=page["cursor"]))
+                assert_equal(items, expected)
+
+if __name__ == '__main__':
+    IndexSyncTest().main()
@@ -7,6 +7,8 @@
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has reindexed up to block 3.
 - Stop the node and restart it with -reindex-chainstate. Verify that the node has reindexed up to block 3.
+- Do the same with -reindexthreads=0 (block files read by the import thread) and -reindexthreads=4.
+- Generate blocks with -blockcompression and reindex them, with blocks stored both compressed and not.
 """
 
 from test_framework.test_framework import DogeCashTestFramework
@@ -19,17 +21,27 @@ class ReindexTest(DogeCashTestFramework):
         self.setup_clean_chain = True
         self.num_nodes = 1
 
-    def reindex(self):
+    def reindex(self, extra=[]):
         self.nodes[0].generate(3)
         blockcount = self.nodes[0].getblockcount()
         self.stop_nodes()
-        extra_args = [["-reindex", "-checkblockindex=1"]]
+        extra_args = [["-reindex", "-checkblockindex=1"] + extra]
         self.start_nodes(extra_args)
         assert_equal(self.nodes[0].getblockcount(), blockcount)  # start_node is blocking on reindex
         self.log.info("Success")
 
     def run_test(self):
         self.reindex()
+        self.reindex(["-reindexthreads=0"])
+        self.reindex(["-reindexthreads=4"])
+
+        self.stop_nodes()
+        self.start_nodes([["-blockcompression"]])
+        self.reindex(["-blockcompression"])
+        # read back through the block index and the transaction index
+        block = self.nodes[0].getblock(self.nodes[0].getbestblockhash())
+        for txid in block['tx']:
+            assert_equal(self.nodes[0].getrawtransaction(txid, True)['blockhash'], block['hash'])
 
 if __name__ == '__main__':
     ReindexTest().main()
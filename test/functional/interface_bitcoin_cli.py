@@ -29,6 +29,12 @@ class TestBitcoinCli(DogeCashTestFramework):
         rpc_response = self.nodes[0].getblockchaininfo()
         assert_equal(cli_response, rpc_response)
 
+        self.log.info("Compare responses from the RPCs and `dogecash-cli -stdin`, in batches smaller than the commands")
+        commands = "getblockcount\n\ngetbestblockhash\ngetblockhash 0\ngetblockcount\n"
+        cli_response = self.nodes[0].cli('-stdin', '-stdinbatchsize=3', input=commands).send_cli().split("\n")
+        assert_equal(cli_response, [str(self.nodes[0].getblockcount()), self.nodes[0].getbestblockhash(),
+                                    self.nodes[0].getblockhash(0), str(self.nodes[0].getblockcount())])
+
         user, password = get_auth_cookie(self.nodes[0].datadir)
 
         self.log.info("Compare responses from `dogecash-cli -getinfo` and the RPCs data is retrieved from.")
@@ -72,6 +72,7 @@ class MempoolPersistTest(DogeCashTestFramework):
         self.start_node(2)
         assert self.nodes[0].getmempoolinfo()["loaded"]  # start_node is blocking on the mempool being loaded
         assert self.nodes[2].getmempoolinfo()["loaded"]
+        assert_equal(self.nodes[0].getmempoolinfo()["loadprogress"], 1)
         assert_equal(len(self.nodes[0].getrawmempool()), 5)
         assert_equal(len(self.nodes[2].getrawmempool()), 5)
         # The others have loaded their mempool. If node_1 loaded anything, we'd probably notice by now:
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The DogeCash Developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the chainstate snapshots written by dumptxoutset and checked by verifytxoutset."""
+
+import os
+
+from test_framework.test_framework import DogeCashTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+class DumptxoutsetTest(DogeCashTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+
+    def run_test(self):
+        node = self.nodes[0]
+        txoutset = node.gettxoutsetinfo()
+
+        self.log.info("Dump the chainstate")
+        out = node.dumptxoutset("txoutset.dat")
+        expected_path = os.path.join(node.datadir, "regtest", "txoutset.dat")
+        assert_equal(out["coins_written"], txoutset["txouts"])
+        assert_equal(out["base_height"], node.getblockcount())
+        assert_equal(out["base_hash"], node.getbestblockhash())
+        assert_equal(out["path"], expected_path)
+        assert os.path.isfile(expected_path)
+
+        assert_raises_rpc_error(-8, "already exists", node.dumptxoutset, "txoutset.dat")
+
+        self.log.info("Check the snapshot")
+        res = node.verifytxoutset(expected_path)
+        assert_equal(res["base_hash"], out["base_hash"])
+        assert_equal(res["coins"], out["coins_written"])
+        assert_equal(res["txoutset_hash"], out["txoutset_hash"])
+        assert_equal(res["transparentsupply"], txoutset["total_amount"])
+        # no snapshot hash in the regtest parameters
+        assert "expected_txoutset_hash" not in res
+        assert_equal(res["valid"], False)
+
+        self.log.info("Reject a truncated snapshot")
+        truncated_path = expected_path + ".truncated"
+        with open(expected_path, "rb") as f:
+            data = f.read()
+        with open(truncated_path, "wb") as f:
+            f.write(data[:len(data) // 2])
+        assert_raises_rpc_error(-22, "truncated", node.verifytxoutset, truncated_path)
+
+if __name__ == '__main__':
+    DumptxoutsetTest().main()
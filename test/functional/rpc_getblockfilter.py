@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin Core developers
+# Copyright (c) 2020 The DogeCash Developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the getblockfilter RPC and the -blockfilterindex.
+
+- Build the filters of a chain in the background, check the filter headers
+  commit to the filters and to the previous headers.
+- Check the filter of a block disconnected from the chain is still served.
+- Check the errors for an unknown block, an unknown filter type and a node
+  without the index.
+"""
+
+from test_framework.messages import hash256
+from test_framework.test_framework import DogeCashTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_is_hex_string,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+FILTER_TYPES = ["basic"]
+
+class GetBlockFilterTest(DogeCashTestFramework):
+
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-blockfilterindex"], []]
+
+    def filter_header(self, filter_hex, prev_header_hex):
+        filter_hash = hash256(bytes.fromhex(filter_hex))
+        return hash256(filter_hash + bytes.fromhex(prev_header_hex)[::-1])[::-1].hex()
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(20)
+        self.sync_all()
+
+        def filters_synced():
+            try:
+                node.getblockfilter(node.getbestblockhash())
+                return True
+            except Exception:
+                return False
+        wait_until(filters_synced, timeout=60)
+
+        self.log.info("Check the filter headers chain")
+        prev_header = "00" * 32
+        for height in range(node.getblockcount() + 1):
+            result = node.getblockfilter(node.getblockhash(height), "basic")
+            assert_is_hex_string(result["filter"])
+            assert_equal(result["header"], self.filter_header(result["filter"], prev_header))
+            prev_header = result["header"]
+
+        self.log.info("Check the filter of a stale block is still served")
+        stale_hash = node.getbestblockhash()
+        stale_filter = node.getblockfilter(stale_hash)
+        node.invalidateblock(stale_hash)
+        node.generate(2)
+        wait_until(filters_synced, timeout=60)
+        assert_equal(node.getblockfilter(stale_hash), stale_filter)
+        new_tip = node.getblockfilter(node.getbestblockhash())
+        assert_is_hex_string(new_tip["header"])
+
+        self.log.info("Check the errors")
+        assert_raises_rpc_error(-5, "Block not found", node.getblockfilter, "00" * 32)
+        assert_raises_rpc_error(-5, "Unknown filtertype", node.getblockfilter, stale_hash, "unknown")
+        assert_raises_rpc_error(-1, "Index is not enabled for filtertype basic",
+                                self.nodes[1].getblockfilter, stale_hash)
+
+
+if __name__ == '__main__':
+    GetBlockFilterTest().main()
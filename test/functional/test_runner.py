@@ -87,6 +87,8 @@ BASE_SCRIPTS= [
     'wallet_listreceivedby.py',                 # ~ 117 sec
     'mining_pos_fakestake.py',                  # ~ 113 sec
     'feature_reindex.py',                       # ~ 110 sec
+    'feature_index_sync.py',
+    'rpc_getblockfilter.py',
     'interface_http.py',                        # ~ 105 sec
     'feature_blockhashcache.py',                # ~ 100 sec
     'wallet_listtransactions.py',               # ~ 97 sec
@@ -109,6 +111,8 @@ BASE_SCRIPTS= [
     'mempool_spend_coinbase.py',                # ~ 50 sec
     'rpc_signrawtransaction.py',                # ~ 50 sec
     'rpc_decodescript.py',                      # ~ 50 sec
+    'rpc_dumptxoutset.py',                      # ~ 50 sec
+    'feature_blockindexsnapshot.py',            # ~ 50 sec
     'rpc_blockchain.py',                        # ~ 50 sec
     'wallet_disable.py',                        # ~ 50 sec
     'mining_v5_upgrade.py',                     # ~ 48 sec